@@ -126,5 +126,20 @@ void BowVector::saveM(const std::string &filename, size_t W) const
 
 // --------------------------------------------------------------------------
 
+void FlatBowVector::assign(const BowVector &v)
+{
+  words.clear();
+  values.clear();
+  words.reserve(v.size());
+  values.reserve(v.size());
+  for(BowVector::const_iterator vit = v.begin(); vit != v.end(); ++vit)
+  {
+    words.push_back(vit->first);
+    values.push_back(vit->second);
+  }
+}
+
+// --------------------------------------------------------------------------
+
 } // namespace DBoW2
 
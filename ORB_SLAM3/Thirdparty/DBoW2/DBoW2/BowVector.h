@@ -11,6 +11,7 @@
 #define __D_T_BOW_VECTOR__
 
 #include <iostream>
+#include <algorithm>
 #include <map>
 #include <vector>
 
@@ -114,6 +115,54 @@ public:
 	void saveM(const std::string &filename, size_t W) const;
 };
 
+/**
+ * Index of the first element not less than target in the sorted array p[0..n),
+ * searching from i, where p[i] < target. The step doubles until it passes
+ * target and the last step is bisected, so skipping k elements costs
+ * O(log k) instead of O(k) or O(log n)
+ */
+template<class Id>
+inline size_t gallop(const Id *p, size_t i, const size_t n, const Id target)
+{
+  size_t step = 1;
+  while(i + step < n && p[i + step] < target)
+  {
+    i += step;
+    step <<= 1;
+  }
+  return std::lower_bound(p + i + 1, p + std::min(i + step + 1, n), target) - p;
+}
+
+/// Bow vector as two sorted arrays, for the merges of the keyframe database
+class FlatBowVector
+{
+public:
+
+  /// Word ids, increasing
+  std::vector<WordId> words;
+  /// Value of each word
+  std::vector<WordValue> values;
+
+  FlatBowVector() {}
+  explicit FlatBowVector(const BowVector &v) { assign(v); }
+
+  /**
+   * Copies a bow vector, in its word order
+   * @param v bow vector
+   */
+  void assign(const BowVector &v);
+
+  size_t size() const { return words.size(); }
+  bool empty() const { return words.empty(); }
+  void clear() { words.clear(); values.clear(); }
+
+  /// Position of the first word >= id from i, where words[i] < id
+  size_t seek(size_t i, WordId id) const
+  {
+    return gallop(words.data(), i, words.size(), id);
+  }
+};
+
 } // namespace DBoW2
 
 #endif
@@ -24,6 +24,7 @@ namespace DBoW2 {
 // --------------------------------------------------------------------------
 
 const int FORB::L=32;
+const char* const FORB::NAME="ORB";
 
 void FORB::meanValue(const std::vector<FORB::pDescriptor> &descriptors, 
   FORB::TDescriptor &mean)
@@ -29,6 +29,8 @@ public:
   typedef const TDescriptor *pDescriptor;
   /// Descriptor length (in bytes)
   static const int L;
+  /// Name of the descriptors, kept with the vocabularies trained on them
+  static const char* const NAME;
 
   /**
    * Calculates the mean value of a set of descriptors
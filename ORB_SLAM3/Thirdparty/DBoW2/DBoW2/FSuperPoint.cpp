@@ -0,0 +1,37 @@
+/**
+ * File: FSuperPoint.cpp
+ * Description: functions for binarized SuperPoint descriptors
+ * License: see the LICENSE.txt file
+ *
+ */
+
+#include "FSuperPoint.h"
+
+namespace DBoW2 {
+
+// --------------------------------------------------------------------------
+
+const char* const FSuperPoint::NAME="SuperPoint";
+
+void FSuperPoint::binarize(const cv::Mat &descriptors, cv::Mat &binary)
+{
+  binary.create(descriptors.rows, FSuperPoint::L, CV_8U);
+
+  for(int i = 0; i < descriptors.rows; ++i)
+  {
+    const float *p = descriptors.ptr<float>(i);
+    unsigned char *q = binary.ptr<unsigned char>(i);
+
+    for(int j = 0; j < FSuperPoint::L; ++j, p += 8)
+    {
+      unsigned char byte = 0;
+      for(int k = 0; k < 8; ++k)
+        if(p[k] > 0.f) byte |= (unsigned char)(1 << k);
+      q[j] = byte;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
@@ -0,0 +1,39 @@
+/**
+ * File: FSuperPoint.h
+ * Description: functions for binarized SuperPoint descriptors
+ * License: see the LICENSE.txt file
+ *
+ */
+
+#ifndef __D_T_F_SUPERPOINT__
+#define __D_T_F_SUPERPOINT__
+
+#include <opencv2/core/core.hpp>
+
+#include "FORB.h"
+
+namespace DBoW2 {
+
+/// Functions to manipulate binarized SuperPoint descriptors. The signs of
+/// the 256 floats are packed in 32 bytes, least significant bit first, so
+/// the descriptors share the layout, the Hamming distance and the bitwise
+/// mean of the ORB ones.
+class FSuperPoint: public FORB
+{
+public:
+
+  /// Name of the descriptors, kept with the vocabularies trained on them
+  static const char* const NAME;
+
+  /**
+   * Packs the signs of float SuperPoint descriptors
+   * @param descriptors Nx256 32F matrix
+   * @param binary (out) Nx32 8U matrix, bit set for positive values
+   */
+  static void binarize(const cv::Mat &descriptors, cv::Mat &binary);
+
+};
+
+} // namespace DBoW2
+
+#endif
@@ -82,4 +82,28 @@ std::ostream& operator<<(std::ostream &out,
 
 // ---------------------------------------------------------------------------
 
+void FlatFeatureVector::assign(const FeatureVector &v)
+{
+  nodes.clear();
+  offsets.clear();
+  features.clear();
+  nodes.reserve(v.size());
+  offsets.reserve(v.size() + 1);
+  
+  size_t n = 0;
+  for(FeatureVector::const_iterator vit = v.begin(); vit != v.end(); ++vit)
+    n += vit->second.size();
+  features.reserve(n);
+  
+  for(FeatureVector::const_iterator vit = v.begin(); vit != v.end(); ++vit)
+  {
+    nodes.push_back(vit->first);
+    offsets.push_back(features.size());
+    features.insert(features.end(), vit->second.begin(), vit->second.end());
+  }
+  offsets.push_back(features.size());
+}
+
+// ---------------------------------------------------------------------------
+
 } // namespace DBoW2
@@ -60,6 +60,59 @@ public:
     
 };
 
+/// Feature vector as sorted arrays, with the feature indexes of all the nodes
+/// in one buffer: those of nodes[i] are features[offsets[i]..offsets[i+1])
+class FlatFeatureVector
+{
+public:
+
+  /// Feature indexes of one node, a view into the buffer
+  struct Features
+  {
+    const unsigned int *p;
+    size_t n;
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    unsigned int operator[](size_t i) const { return p[i]; }
+    const unsigned int* begin() const { return p; }
+    const unsigned int* end() const { return p + n; }
+  };
+
+  /// Node ids, increasing
+  std::vector<NodeId> nodes;
+  /// Start of the indexes of each node in features, and the end of the last one
+  std::vector<unsigned int> offsets;
+  /// Feature indexes, node after node
+  std::vector<unsigned int> features;
+
+  FlatFeatureVector() {}
+  explicit FlatFeatureVector(const FeatureVector &v) { assign(v); }
+
+  /**
+   * Copies a feature vector, in its node order
+   * @param v feature vector
+   */
+  void assign(const FeatureVector &v);
+
+  size_t size() const { return nodes.size(); }
+  bool empty() const { return nodes.empty(); }
+  void clear() { nodes.clear(); offsets.clear(); features.clear(); }
+
+  /// Feature indexes of nodes[i]
+  Features at(size_t i) const
+  {
+    Features f = { features.data() + offsets[i], offsets[i+1] - offsets[i] };
+    return f;
+  }
+
+  /// Position of the first node >= id from i, where nodes[i] < id
+  size_t seek(size_t i, NodeId id) const
+  {
+    return gallop(nodes.data(), i, nodes.size(), id);
+  }
+};
+
 } // namespace DBoW2
 
 #endif
@@ -3,6 +3,8 @@
  * Added functions: Save and Load from text files without using cv::FileStorage.
  * Date: August 2015
  * Raúl Mur-Artal
+ *
+ * Added functions: Save and Load from memory mapped binary files.
  */
 
 /**
@@ -26,6 +28,14 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <memory>
+#include <cstring>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
@@ -127,6 +137,13 @@ public:
    */
   virtual inline bool empty() const;
 
+  /**
+   * Returns an estimate of the memory held by the vocabulary: the tree,
+   * the node descriptors and the flat arrays
+   * @return bytes
+   */
+  size_t getMemoryBytes() const;
+
   /**
    * Transforms a set of descriptores into a bow vector
    * @param features
@@ -145,6 +162,18 @@ public:
   virtual void transform(const std::vector<TDescriptor>& features,
     BowVector &v, FeatureVector &fv, int levelsup) const;
 
+  /**
+   * Transform the rows of a descriptor matrix into a bow vector and a
+   * feature vector, as the overload above but without splitting the matrix
+   * into a vector of descriptors
+   * @param features one descriptor per row
+   * @param v (out) bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  void transform(const cv::Mat &features,
+    BowVector &v, FeatureVector &fv, int levelsup) const;
+
   /**
    * Transforms a single feature into a word (without weight)
    * @param feature
@@ -221,6 +250,14 @@ public:
    * @return scoring method
    */
   inline ScoringType getScoringType() const { return m_scoring; }
+
+  /**
+   * Returns the name of the descriptors the vocabulary was trained with,
+   * F::NAME unless a file written for another descriptor class of
+   * the same length was loaded (e.g. "SuperPoint" into an FORB vocabulary)
+   * @return descriptor name
+   */
+  inline const std::string& getDescriptorName() const { return m_descriptor; }
   
   /**
    * Changes the weighting method
@@ -246,6 +283,28 @@ public:
    */
   void saveToTextFile(const std::string &filename) const;  
 
+  /**
+   * Loads the vocabulary from a binary file written by saveToBinaryFile.
+   * The file is memory mapped and the node descriptors point into the
+   * mapping, which is kept while the vocabulary uses it. Only for
+   * descriptors stored in a cv::Mat of F::L bytes, like FORB.
+   * @param filename
+   * @param checksum (out) if given, checksum stored in the file header
+   */
+  bool loadFromBinaryFile(const std::string &filename,
+    std::string *checksum = NULL);
+
+  /**
+   * Saves the vocabulary into a binary file: a header followed by flat
+   * arrays with the descriptors, weights, parents and leaf flags of the
+   * nodes
+   * @param filename
+   * @param checksum stored in the header, e.g. of the text vocabulary
+   *   the binary one was converted from
+   */
+  bool saveToBinaryFile(const std::string &filename,
+    const std::string &checksum = std::string()) const;
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -393,6 +452,27 @@ protected:
    * Create the words of the vocabulary once the tree has been built
    */
   void createWords();
+
+  /**
+   * Lays out the tree for transform once it has been built or loaded: the
+   * descriptors of the children of a node are contiguous, so a level is
+   * descended with one pass of XOR and popcount over them. Only for
+   * descriptors of 32 bytes in a cv::Mat, like FORB, and trees whose
+   * children have consecutive ids, as built by HKmeansStep. Otherwise the
+   * tree is descended through the nodes.
+   */
+  void createFlatTree();
+
+  /**
+   * Descends the flat tree with a descriptor of W 64 bit words
+   * @param feature descriptor bytes
+   * @param nid (out) if given, id of the node at level nid_level
+   * @param nid_level
+   * @return id of the leaf
+   */
+  template<int W>
+  NodeId descendFlatTree(const unsigned char *feature, NodeId *nid,
+    int nid_level) const;
   
   /**
    * Sets the weights of the nodes of tree according to the given features.
@@ -418,6 +498,9 @@ protected:
   
   /// Object for computing scores
   GeneralScoring* m_scoring_object;
+
+  /// Name of the training descriptors
+  std::string m_descriptor;
   
   /// Tree nodes
   std::vector<Node> m_nodes;
@@ -425,6 +508,34 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Binary file mapping the node descriptors point to, if any
+  std::shared_ptr<void> m_mapping;
+
+  /// Descriptors of the nodes by id for the flat tree, NULL if not used.
+  /// They point to m_flat_storage or in place to the loaded descriptors.
+  const unsigned char *m_flat_descriptors;
+  std::vector<unsigned char> m_flat_storage;
+  /// First child and number of children of every node
+  std::vector<NodeId> m_first_child;
+  std::vector<unsigned short> m_num_children;
+
+  /// Header of the binary files, followed by the arrays at the offsets
+  struct BinaryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    int32_t k, L, scoring, weighting;
+    uint32_t descriptor_bytes;
+    uint32_t nodes;
+    uint32_t words;
+    uint64_t descriptors_offset, weights_offset, parents_offset, leaves_offset;
+    uint64_t file_size;
+    char checksum[48];
+    /// Name of the training descriptors, empty in the files converted from
+    /// the ORB text vocabulary before it was stored
+    char descriptor[16];
+  };
   
 };
 
@@ -434,7 +545,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_descriptor(F::NAME), m_flat_descriptors(NULL)
 {
   createScoringObject();
 }
@@ -443,7 +554,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL), m_descriptor(F::NAME), m_flat_descriptors(NULL)
 {
   load(filename);
 }
@@ -452,7 +563,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL), m_descriptor(F::NAME), m_flat_descriptors(NULL)
 {
   load(filename);
 }
@@ -516,7 +627,7 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_descriptor(F::NAME), m_flat_descriptors(NULL)
 {
   *this = voc;
 }
@@ -540,14 +651,18 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   this->m_L = voc.m_L;
   this->m_scoring = voc.m_scoring;
   this->m_weighting = voc.m_weighting;
+  this->m_descriptor = voc.m_descriptor;
 
   this->createScoringObject();
   
   this->m_nodes.clear();
+  this->m_flat_descriptors = NULL;
   this->m_words.clear();
   
   this->m_nodes = voc.m_nodes;
+  this->m_mapping = voc.m_mapping;
   this->createWords();
+  this->createFlatTree();
   
   return *this;
 }
@@ -559,6 +674,7 @@ void TemplatedVocabulary<TDescriptor,F>::create(
   const std::vector<std::vector<TDescriptor> > &training_features)
 {
   m_nodes.clear();
+  m_flat_descriptors = NULL;
   m_words.clear();
   
   // expected_nodes = Sum_{i=0..L} ( k^i )
@@ -583,7 +699,8 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 
   // and set the weight of each node of the tree
   setNodeWeights(training_features);
-  
+
+  createFlatTree();
 }
 
 // --------------------------------------------------------------------------
@@ -939,6 +1056,108 @@ void TemplatedVocabulary<TDescriptor,F>::createWords()
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::createFlatTree()
+{
+  m_flat_descriptors = NULL;
+  m_flat_storage.clear();
+  m_first_child.clear();
+  m_num_children.clear();
+
+  // 256 bit descriptors, like ORB
+  const size_t N = m_nodes.size();
+  const size_t L = F::L;
+  if(N < 2 || L != 32) return;
+
+  m_first_child.resize(N, 0);
+  m_num_children.resize(N, 0);
+
+  // the descriptors are used in place if they are already contiguous by
+  // node id, e.g. in the mapping of a binary file
+  const unsigned char *base = m_nodes[1].descriptor.data;
+  bool in_place = (base != NULL);
+
+  for(size_t i = 0; i < N; ++i)
+  {
+    const Node &node = m_nodes[i];
+    if(i > 0 && (node.descriptor.rows != 1 || node.descriptor.cols != (int)L ||
+       node.descriptor.elemSize() != 1 || !node.descriptor.isContinuous()))
+      return;
+
+    if(in_place && i > 0 && node.descriptor.data != base + (i-1)*L)
+      in_place = false;
+
+    const vector<NodeId> &children = node.children;
+    if(children.size() > std::numeric_limits<unsigned short>::max())
+      return;
+    for(size_t j = 1; j < children.size(); ++j)
+      if(children[j] != children[0] + j) return;
+
+    if(!children.empty()) m_first_child[i] = children[0];
+    m_num_children[i] = children.size();
+  }
+
+  if(in_place)
+  {
+    m_flat_descriptors = base - L;
+  }
+  else
+  {
+    m_flat_storage.resize(N*L, 0);
+    for(size_t i = 1; i < N; ++i)
+      memcpy(&m_flat_storage[i*L], m_nodes[i].descriptor.data, L);
+    m_flat_descriptors = &m_flat_storage[0];
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<int W>
+NodeId TemplatedVocabulary<TDescriptor,F>::descendFlatTree(
+  const unsigned char *feature, NodeId *nid, int nid_level) const
+{
+  uint64_t f[W];
+  memcpy(f, feature, sizeof(f));
+
+  NodeId final_id = 0; // root
+  int current_level = 0;
+
+  do
+  {
+    ++current_level;
+    const NodeId first = m_first_child[final_id];
+    const int n = m_num_children[final_id];
+    const unsigned char *d = m_flat_descriptors + (size_t)first*W*8;
+
+    // Hamming distance to every child, the first of the closest ones wins
+    int best_d = std::numeric_limits<int>::max();
+    int best = 0;
+    for(int j = 0; j < n; ++j, d += W*8)
+    {
+      uint64_t c[W];
+      memcpy(c, d, sizeof(c));
+      int dist = 0;
+      for(int w = 0; w < W; ++w)
+        dist += __builtin_popcountll(f[w] ^ c[w]);
+      if(dist < best_d)
+      {
+        best_d = dist;
+        best = j;
+      }
+    }
+    final_id = first + best;
+
+    if(nid != NULL && current_level == nid_level)
+      *nid = final_id;
+
+  } while(m_num_children[final_id] > 0);
+
+  return final_id;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
   (const vector<vector<TDescriptor> > &training_features)
@@ -1013,6 +1232,23 @@ inline bool TemplatedVocabulary<TDescriptor,F>::empty() const
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+size_t TemplatedVocabulary<TDescriptor,F>::getMemoryBytes() const
+{
+  size_t bytes = sizeof(*this) + m_nodes.capacity()*sizeof(Node) +
+    m_words.capacity()*sizeof(Node*) + m_flat_storage.capacity() +
+    m_first_child.capacity()*sizeof(NodeId) +
+    m_num_children.capacity()*sizeof(unsigned short);
+
+  // The descriptors, owned by the nodes or in the mapped file
+  bytes += m_nodes.size()*F::L;
+  for(size_t i = 0; i < m_nodes.size(); ++i)
+    bytes += m_nodes[i].children.capacity()*sizeof(NodeId);
+  return bytes;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 float TemplatedVocabulary<TDescriptor,F>::getEffectiveLevels() const
 {
@@ -1195,6 +1431,57 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::transform(
+  const cv::Mat &features,
+  BowVector &v, FeatureVector &fv, int levelsup) const
+{
+  v.clear();
+  fv.clear();
+  
+  if(empty()) // safe for subclasses
+  {
+    return;
+  }
+  
+  // normalize 
+  LNorm norm;
+  bool must = m_scoring_object->mustNormalize(norm);
+  
+  // a row is a header over the matrix data, nothing is copied
+  const bool add_weights = (m_weighting == TF || m_weighting == TF_IDF);
+  for(int i_feature = 0; i_feature < features.rows; ++i_feature)
+  {
+    WordId id;
+    NodeId nid;
+    WordValue w;
+    // w is the idf value if TF_IDF or IDF, 1 if TF or BINARY
+    
+    transform(features.row(i_feature), id, w, &nid, levelsup);
+    
+    if(w > 0) // not stopped
+    {
+      if(add_weights)
+        v.addWeight(id, w);
+      else
+        v.addIfNotExist(id, w);
+      fv.addFeature(nid, i_feature);
+    }
+  }
+  
+  if(add_weights && !v.empty() && !must)
+  {
+    // unnecessary when normalizing
+    const double nd = v.size();
+    for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
+      vit->second /= nd;
+  }
+  
+  if(must) v.normalize(norm);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F> 
 inline double TemplatedVocabulary<TDescriptor,F>::score
   (const BowVector &v1, const BowVector &v2) const
@@ -1219,7 +1506,6 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
 { 
   // propagate the feature down the tree
-  vector<NodeId> nodes;
   typename vector<NodeId>::const_iterator nit;
 
   // level at which the node must be stored in nid, if given
@@ -1229,10 +1515,18 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   NodeId final_id = 0; // root
   int current_level = 0;
 
+  if(m_flat_descriptors != NULL)
+  {
+    final_id = descendFlatTree<4>(feature.data, nid, nid_level);
+    word_id = m_nodes[final_id].word_id;
+    weight = m_nodes[final_id].weight;
+    return;
+  }
+
   do
   {
     ++current_level;
-    nodes = m_nodes[final_id].children;
+    const vector<NodeId> &nodes = m_nodes[final_id].children;
     final_id = nodes[0];
  
     double best_d = F::distance(feature, m_nodes[final_id].descriptor);
@@ -1345,6 +1639,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
 
     m_words.clear();
     m_nodes.clear();
+    m_flat_descriptors = NULL;
+    m_mapping.reset();
 
     string s;
     getline(f,s);
@@ -1366,6 +1662,10 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
     m_weighting = (WeightingType)n2;
     createScoringObject();
 
+    // Optional name of the training descriptors, the ORB vocabularies have none
+    string descriptor;
+    m_descriptor = (ss >> descriptor) ? descriptor : string("ORB");
+
     // nodes
     int expected_nodes =
     (int)((pow((double)m_k, (double)m_L + 1) - 1)/(m_k - 1));
@@ -1419,6 +1719,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
         }
     }
 
+    createFlatTree();
+
     return true;
 
 }
@@ -1430,7 +1732,10 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
 {
     fstream f;
     f.open(filename.c_str(),ios_base::out);
-    f << m_k << " " << m_L << " " << " " << m_scoring << " " << m_weighting << endl;
+    f << m_k << " " << m_L << " " << " " << m_scoring << " " << m_weighting;
+    if(m_descriptor!="ORB")
+        f << " " << m_descriptor;
+    f << endl;
 
     for(size_t i=1; i<m_nodes.size();i++)
     {
@@ -1450,6 +1755,169 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile(
+  const std::string &filename, std::string *checksum)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd<0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd,&st)!=0 || (size_t)st.st_size<sizeof(BinaryHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t size = st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED)
+        return false;
+
+    std::shared_ptr<void> mapping(data, [size](void* p){ munmap(p,size); });
+
+    BinaryHeader h;
+    memcpy(&h, data, sizeof(h));
+    if(memcmp(h.magic,"DBOW2VOC",8)!=0 || h.version!=1 || h.file_size!=size ||
+       h.descriptor_bytes!=(uint32_t)F::L || h.nodes<1 || h.words>h.nodes ||
+       h.k<0 || h.k>20 || h.L<1 || h.L>10 || h.scoring<0 || h.scoring>5 ||
+       h.weighting<0 || h.weighting>3 ||
+       h.descriptors_offset+(uint64_t)h.nodes*h.descriptor_bytes>size ||
+       h.weights_offset+(uint64_t)h.nodes*sizeof(double)>size ||
+       h.parents_offset+(uint64_t)h.nodes*sizeof(uint32_t)>size ||
+       h.leaves_offset+(uint64_t)h.nodes>size)
+    {
+        std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+        return false;
+    }
+
+    // The descriptors are used from the mapping, ask to read them ahead
+    madvise(data, size, MADV_WILLNEED);
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const unsigned char* descriptors = bytes + h.descriptors_offset;
+    const unsigned char* leaves = bytes + h.leaves_offset;
+    std::vector<double> weights(h.nodes);
+    std::vector<uint32_t> parents(h.nodes);
+    memcpy(weights.data(), bytes + h.weights_offset, h.nodes*sizeof(double));
+    memcpy(parents.data(), bytes + h.parents_offset, h.nodes*sizeof(uint32_t));
+
+    m_words.clear();
+    m_nodes.clear();
+    m_flat_descriptors = NULL;
+
+    m_k = h.k;
+    m_L = h.L;
+    const size_t descriptorLength = strnlen(h.descriptor, sizeof(h.descriptor));
+    m_descriptor = descriptorLength>0 ? std::string(h.descriptor, descriptorLength) : std::string("ORB");
+    m_scoring = (ScoringType)h.scoring;
+    m_weighting = (WeightingType)h.weighting;
+    createScoringObject();
+
+    m_nodes.resize(h.nodes);
+    m_words.reserve(h.words);
+    m_nodes[0].id = 0;
+    for(uint32_t nid=1; nid<h.nodes; nid++)
+    {
+        Node &node = m_nodes[nid];
+        node.id = nid;
+
+        const uint32_t pid = parents[nid];
+        if(pid>=nid)
+        {
+            std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+            m_nodes.clear();
+            m_flat_descriptors = NULL;
+            m_words.clear();
+            return false;
+        }
+        node.parent = pid;
+        m_nodes[pid].children.push_back(nid);
+
+        node.descriptor = cv::Mat(1, F::L, CV_8U,
+          const_cast<unsigned char*>(descriptors + (size_t)nid*F::L));
+        node.weight = weights[nid];
+
+        if(leaves[nid])
+        {
+            node.word_id = m_words.size();
+            m_words.push_back(&node);
+        }
+    }
+
+    m_mapping = mapping;
+    createFlatTree();
+
+    if(checksum)
+        *checksum = std::string(h.checksum, strnlen(h.checksum, sizeof(h.checksum)));
+
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile(
+  const std::string &filename, const std::string &checksum) const
+{
+    if(m_nodes.empty() || checksum.size()>=sizeof(((BinaryHeader*)0)->checksum) ||
+       m_descriptor.size()>=sizeof(((BinaryHeader*)0)->descriptor))
+        return false;
+
+    const uint64_t nodes = m_nodes.size();
+    const uint64_t align = 64;
+
+    BinaryHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "DBOW2VOC", 8);
+    h.version = 1;
+    h.k = m_k;
+    h.L = m_L;
+    h.scoring = m_scoring;
+    h.weighting = m_weighting;
+    h.descriptor_bytes = F::L;
+    h.nodes = nodes;
+    h.words = m_words.size();
+    h.descriptors_offset = (sizeof(h)+align-1)/align*align;
+    h.weights_offset = (h.descriptors_offset+nodes*F::L+align-1)/align*align;
+    h.parents_offset = h.weights_offset+nodes*sizeof(double);
+    h.leaves_offset = h.parents_offset+nodes*sizeof(uint32_t);
+    h.file_size = h.leaves_offset+nodes;
+    memcpy(h.checksum, checksum.data(), checksum.size());
+    memcpy(h.descriptor, m_descriptor.data(), m_descriptor.size());
+
+    std::vector<unsigned char> buffer(h.file_size, 0);
+    memcpy(buffer.data(), &h, sizeof(h));
+
+    for(size_t i=1; i<nodes; i++)
+    {
+        const Node& node = m_nodes[i];
+        if(node.descriptor.total()*node.descriptor.elemSize()!=(size_t)F::L)
+            return false;
+
+        const cv::Mat descriptor = node.descriptor.isContinuous() ? node.descriptor : node.descriptor.clone();
+        memcpy(&buffer[h.descriptors_offset+i*F::L], descriptor.data, F::L);
+
+        const double weight = node.weight;
+        const uint32_t parent = node.parent;
+        memcpy(&buffer[h.weights_offset+i*sizeof(double)], &weight, sizeof(double));
+        memcpy(&buffer[h.parents_offset+i*sizeof(uint32_t)], &parent, sizeof(uint32_t));
+        // Words as loaded, not as leaves, so the word ids are kept
+        buffer[h.leaves_offset+i] = (node.word_id<m_words.size() && m_words[node.word_id]==&node) ? 1 : 0;
+    }
+
+    ofstream f(filename.c_str(), ios_base::out | ios_base::binary);
+    if(!f.is_open())
+        return false;
+    f.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+    return f.good();
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::save(const std::string &filename) const
 {
@@ -1575,6 +2043,7 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 {
   m_words.clear();
   m_nodes.clear();
+  m_flat_descriptors = NULL;
   
   cv::FileNode fvoc = fs[name];
   
@@ -1619,6 +2088,8 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  createFlatTree();
 }
 
 // --------------------------------------------------------------------------
@@ -89,6 +89,7 @@ namespace g2o {
       const JacobianXjOplusType& jacobianOplusXj() const { return _jacobianOplusXj;}
 
       virtual void constructQuadraticForm() ;
+      virtual void constructQuadraticForm(QuadraticFormBuffer& buffer);
 
       virtual void mapHessianMemory(double* d, int i, int j, bool rowMajor);
 
@@ -108,6 +109,10 @@ namespace g2o {
       JacobianXiOplusType _jacobianOplusXi;
       JacobianXjOplusType _jacobianOplusXj;
 
+      //! adds the quadratic form of the edge to the given blocks of the vertices and to _hessian
+      template <typename FromA, typename FromB, typename ToA, typename ToB>
+      void accumulateQuadraticForm(FromA& fromA, FromB& fromB, ToA& toA, ToB& toB);
+
     public:
       EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
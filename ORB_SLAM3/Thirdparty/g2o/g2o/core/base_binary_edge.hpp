@@ -57,65 +57,92 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
   VertexXiType* from = static_cast<VertexXiType*>(_vertices[0]);
   VertexXjType* to   = static_cast<VertexXjType*>(_vertices[1]);
 
+  if (from->fixed() && to->fixed())
+    return;
+
+#ifdef G2O_OPENMP
+  from->lockQuadraticForm();
+  to->lockQuadraticForm();
+#endif
+  accumulateQuadraticForm(from->A(), from->b(), to->A(), to->b());
+#ifdef G2O_OPENMP
+  to->unlockQuadraticForm();
+  from->unlockQuadraticForm();
+#endif
+}
+
+template <int D, typename E, typename VertexXiType, typename VertexXjType>
+void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm(QuadraticFormBuffer& buffer)
+{
+  VertexXiType* from = static_cast<VertexXiType*>(_vertices[0]);
+  VertexXjType* to   = static_cast<VertexXjType*>(_vertices[1]);
+
+  if (from->fixed() && to->fixed())
+    return;
+
+  // the blocks of a fixed vertex are neither in the buffer nor accessed
+  Eigen::Map<Matrix<double, Di, Di> > fromA(from->fixed() ? 0 : buffer.hessianData(from->hessianIndex()));
+  Eigen::Map<Matrix<double, Di, 1> > fromB(from->fixed() ? 0 : buffer.bData(from->hessianIndex(), Di));
+  Eigen::Map<Matrix<double, Dj, Dj> > toA(to->fixed() ? 0 : buffer.hessianData(to->hessianIndex()));
+  Eigen::Map<Matrix<double, Dj, 1> > toB(to->fixed() ? 0 : buffer.bData(to->hessianIndex(), Dj));
+  accumulateQuadraticForm(fromA, fromB, toA, toB);
+}
+
+template <int D, typename E, typename VertexXiType, typename VertexXjType>
+template <typename FromA, typename FromB, typename ToA, typename ToB>
+void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::accumulateQuadraticForm(FromA& fromA, FromB& fromB, ToA& toA, ToB& toB)
+{
+  VertexXiType* from = static_cast<VertexXiType*>(_vertices[0]);
+  VertexXjType* to   = static_cast<VertexXjType*>(_vertices[1]);
+
   // get the Jacobian of the nodes in the manifold domain
   const JacobianXiOplusType& A = jacobianOplusXi();
   const JacobianXjOplusType& B = jacobianOplusXj();
 
-
   bool fromNotFixed = !(from->fixed());
   bool toNotFixed = !(to->fixed());
 
-  if (fromNotFixed || toNotFixed) {
-#ifdef G2O_OPENMP
-    from->lockQuadraticForm();
-    to->lockQuadraticForm();
-#endif
-    const InformationType& omega = _information;
-    Matrix<double, D, 1> omega_r = - omega * _error;
-    if (this->robustKernel() == 0) {
-      if (fromNotFixed) {
-        Matrix<double, VertexXiType::Dimension, D> AtO = A.transpose() * omega;
-        from->b().noalias() += A.transpose() * omega_r;
-        from->A().noalias() += AtO*A;
-        if (toNotFixed ) {
-          if (_hessianRowMajor) // we have to write to the block as transposed
-            _hessianTransposed.noalias() += B.transpose() * AtO.transpose();
-          else
-            _hessian.noalias() += AtO * B;
-        }
-      } 
-      if (toNotFixed) {
-        to->b().noalias() += B.transpose() * omega_r;
-        to->A().noalias() += B.transpose() * omega * B;
+  const InformationType& omega = _information;
+  Matrix<double, D, 1> omega_r = - omega * _error;
+  if (this->robustKernel() == 0) {
+    if (fromNotFixed) {
+      Matrix<double, VertexXiType::Dimension, D> AtO = A.transpose() * omega;
+      fromB.noalias() += A.transpose() * omega_r;
+      fromA.noalias() += AtO*A;
+      if (toNotFixed ) {
+        if (_hessianRowMajor) // we have to write to the block as transposed
+          _hessianTransposed.noalias() += B.transpose() * AtO.transpose();
+        else
+          _hessian.noalias() += AtO * B;
       }
-    } else { // robust (weighted) error according to some kernel
-      double error = this->chi2();
-      Eigen::Vector3d rho;
-      this->robustKernel()->robustify(error, rho);
-      InformationType weightedOmega = this->robustInformation(rho);
-      //std::cout << PVAR(rho.transpose()) << std::endl;
-      //std::cout << PVAR(weightedOmega) << std::endl;
-
-      omega_r *= rho[1];
-      if (fromNotFixed) {
-        from->b().noalias() += A.transpose() * omega_r;
-        from->A().noalias() += A.transpose() * weightedOmega * A;
-        if (toNotFixed ) {
-          if (_hessianRowMajor) // we have to write to the block as transposed
-            _hessianTransposed.noalias() += B.transpose() * weightedOmega * A;
-          else
-            _hessian.noalias() += A.transpose() * weightedOmega * B;
-        }
-      } 
-      if (toNotFixed) {
-        to->b().noalias() += B.transpose() * omega_r;
-        to->A().noalias() += B.transpose() * weightedOmega * B;
+    } 
+    if (toNotFixed) {
+      toB.noalias() += B.transpose() * omega_r;
+      toA.noalias() += B.transpose() * omega * B;
+    }
+  } else { // robust (weighted) error according to some kernel
+    double error = this->chi2();
+    Eigen::Vector3d rho;
+    this->robustKernel()->robustify(error, rho);
+    InformationType weightedOmega = this->robustInformation(rho);
+    //std::cout << PVAR(rho.transpose()) << std::endl;
+    //std::cout << PVAR(weightedOmega) << std::endl;
+
+    omega_r *= rho[1];
+    if (fromNotFixed) {
+      fromB.noalias() += A.transpose() * omega_r;
+      fromA.noalias() += A.transpose() * weightedOmega * A;
+      if (toNotFixed ) {
+        if (_hessianRowMajor) // we have to write to the block as transposed
+          _hessianTransposed.noalias() += B.transpose() * weightedOmega * A;
+        else
+          _hessian.noalias() += A.transpose() * weightedOmega * B;
       }
+    } 
+    if (toNotFixed) {
+      toB.noalias() += B.transpose() * omega_r;
+      toA.noalias() += B.transpose() * weightedOmega * B;
     }
-#ifdef G2O_OPENMP
-    to->unlockQuadraticForm();
-    from->unlockQuadraticForm();
-#endif
   }
 }
 
@@ -85,6 +85,7 @@ namespace g2o {
       virtual bool allVerticesFixed() const;
 
       virtual void constructQuadraticForm() ;
+      virtual void constructQuadraticForm(QuadraticFormBuffer& buffer);
 
       virtual void mapHessianMemory(double* d, int i, int j, bool rowMajor);
 
@@ -100,7 +101,9 @@ namespace g2o {
       std::vector<HessianHelper> _hessian;
       std::vector<JacobianType, aligned_allocator<JacobianType> > _jacobianOplus; ///< jacobians of the edge (w.r.t. oplus)
 
-      void computeQuadraticForm(const InformationType& omega, const ErrorVector& weightedError);
+      //! adds the quadratic form to the buffer if given, else to the vertices
+      void accumulateQuadraticForm(QuadraticFormBuffer* buffer);
+      void computeQuadraticForm(const InformationType& omega, const ErrorVector& weightedError, QuadraticFormBuffer* buffer);
 
     public:
       EIGEN_MAKE_ALIGNED_OPERATOR_NEW
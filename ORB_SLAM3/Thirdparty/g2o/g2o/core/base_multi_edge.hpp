@@ -34,6 +34,18 @@ namespace internal {
 
 template <int D, typename E>
 void BaseMultiEdge<D, E>::constructQuadraticForm()
+{
+  accumulateQuadraticForm(0);
+}
+
+template <int D, typename E>
+void BaseMultiEdge<D, E>::constructQuadraticForm(QuadraticFormBuffer& buffer)
+{
+  accumulateQuadraticForm(&buffer);
+}
+
+template <int D, typename E>
+void BaseMultiEdge<D, E>::accumulateQuadraticForm(QuadraticFormBuffer* buffer)
 {
   if (this->robustKernel()) {
     double error = this->chi2();
@@ -41,9 +53,9 @@ void BaseMultiEdge<D, E>::constructQuadraticForm()
     this->robustKernel()->robustify(error, rho);
     Matrix<double, D, 1> omega_r = - _information * _error;
     omega_r *= rho[1];
-    computeQuadraticForm(this->robustInformation(rho), omega_r);
+    computeQuadraticForm(this->robustInformation(rho), omega_r, buffer);
   } else {
-    computeQuadraticForm(_information, - _information * _error);
+    computeQuadraticForm(_information, - _information * _error, buffer);
   }
 }
 
@@ -168,7 +180,7 @@ bool BaseMultiEdge<D, E>::allVerticesFixed() const
 }
 
 template <int D, typename E>
-void BaseMultiEdge<D, E>::computeQuadraticForm(const InformationType& omega, const ErrorVector& weightedError)
+void BaseMultiEdge<D, E>::computeQuadraticForm(const InformationType& omega, const ErrorVector& weightedError, QuadraticFormBuffer* buffer)
 {
   for (size_t i = 0; i < _vertices.size(); ++i) {
     OptimizableGraph::Vertex* from = static_cast<OptimizableGraph::Vertex*>(_vertices[i]);
@@ -180,8 +192,8 @@ void BaseMultiEdge<D, E>::computeQuadraticForm(const InformationType& omega, con
       MatrixXd AtO = A.transpose() * omega;
       int fromDim = from->dimension();
       assert(fromDim >= 0);
-      Eigen::Map<MatrixXd> fromMap(from->hessianData(), fromDim, fromDim);
-      Eigen::Map<VectorXd> fromB(from->bData(), fromDim);
+      Eigen::Map<MatrixXd> fromMap(buffer ? buffer->hessianData(from->hessianIndex()) : from->hessianData(), fromDim, fromDim);
+      Eigen::Map<VectorXd> fromB(buffer ? buffer->bData(from->hessianIndex(), fromDim) : from->bData(), fromDim);
 
       // ii block in the hessian
 #ifdef G2O_OPENMP
@@ -72,6 +72,7 @@ namespace g2o {
       const JacobianXiOplusType& jacobianOplusXi() const { return _jacobianOplusXi;}
 
       virtual void constructQuadraticForm();
+      virtual void constructQuadraticForm(QuadraticFormBuffer& buffer);
 
       virtual void initialEstimate(const OptimizableGraph::VertexSet& from, OptimizableGraph::Vertex* to);
 
@@ -89,6 +90,10 @@ namespace g2o {
 
       JacobianXiOplusType _jacobianOplusXi;
 
+      //! adds the quadratic form of the edge to the given blocks of the vertex
+      template <typename FromA, typename FromB>
+      void accumulateQuadraticForm(FromA& fromA, FromB& fromB);
+
     public:
       EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
@@ -44,33 +44,53 @@ void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticForm()
 {
   VertexXiType* from=static_cast<VertexXiType*>(_vertices[0]);
 
-  // chain rule to get the Jacobian of the nodes in the manifold domain
-  const JacobianXiOplusType& A = jacobianOplusXi();
-  const InformationType& omega = _information;
-
   bool istatus = !from->fixed();
   if (istatus) {
 #ifdef G2O_OPENMP
     from->lockQuadraticForm();
 #endif
-    if (this->robustKernel()) {
-      double error = this->chi2();
-      Eigen::Vector3d rho;
-      this->robustKernel()->robustify(error, rho);
-      InformationType weightedOmega = this->robustInformation(rho);
-
-      from->b().noalias() -= rho[1] * A.transpose() * omega * _error;
-      from->A().noalias() += A.transpose() * weightedOmega * A;
-    } else {
-      from->b().noalias() -= A.transpose() * omega * _error;
-      from->A().noalias() += A.transpose() * omega * A;
-    }
+    accumulateQuadraticForm(from->A(), from->b());
 #ifdef G2O_OPENMP
     from->unlockQuadraticForm();
 #endif
   }
 }
 
+template <int D, typename E, typename VertexXiType>
+void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticForm(QuadraticFormBuffer& buffer)
+{
+  VertexXiType* from=static_cast<VertexXiType*>(_vertices[0]);
+
+  bool istatus = !from->fixed();
+  if (istatus) {
+    Eigen::Map<Matrix<double, VertexXiType::Dimension, VertexXiType::Dimension> > fromA(buffer.hessianData(from->hessianIndex()));
+    Eigen::Map<Matrix<double, VertexXiType::Dimension, 1> > fromB(buffer.bData(from->hessianIndex(), VertexXiType::Dimension));
+    accumulateQuadraticForm(fromA, fromB);
+  }
+}
+
+template <int D, typename E, typename VertexXiType>
+template <typename FromA, typename FromB>
+void BaseUnaryEdge<D, E, VertexXiType>::accumulateQuadraticForm(FromA& fromA, FromB& fromB)
+{
+  // chain rule to get the Jacobian of the nodes in the manifold domain
+  const JacobianXiOplusType& A = jacobianOplusXi();
+  const InformationType& omega = _information;
+
+  if (this->robustKernel()) {
+    double error = this->chi2();
+    Eigen::Vector3d rho;
+    this->robustKernel()->robustify(error, rho);
+    InformationType weightedOmega = this->robustInformation(rho);
+
+    fromB.noalias() -= rho[1] * A.transpose() * omega * _error;
+    fromA.noalias() += A.transpose() * weightedOmega * A;
+  } else {
+    fromB.noalias() -= A.transpose() * omega * _error;
+    fromA.noalias() += A.transpose() * omega * A;
+  }
+}
+
 template <int D, typename E, typename VertexXiType>
 void BaseUnaryEdge<D, E, VertexXiType>::linearizeOplus(JacobianWorkspace& jacobianWorkspace)
 {
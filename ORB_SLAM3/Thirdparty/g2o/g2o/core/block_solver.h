@@ -31,6 +31,7 @@
 #include "linear_solver.h"
 #include "sparse_block_matrix.h"
 #include "sparse_block_matrix_diagonal.h"
+#include "optimizable_graph.h"
 #include "openmp_mutex.h"
 #include "../../config.h"
 
@@ -147,6 +148,16 @@ namespace g2o {
 
       void deallocate();
 
+      /**
+       * splits the active edges for buildSystem() on several threads and allocates the buffers
+       * of the threads. Called by buildStructure() if the optimizer has more than one thread.
+       */
+      void prepareParallelBuild(const std::vector<double*>& edgeBlocks, const std::vector<int>& edgeBlocksEnd);
+      //! linearizes the edges and constructs the quadratic form on numThreads threads
+      void linearizeParallel(int numThreads);
+      //! the Schur complement of the landmarks, the rows of _Hschur and _coefficients split over numThreads threads
+      void computeSchurComplementParallel(int numThreads);
+
       SparseBlockMatrix<PoseMatrixType>* _Hpp;
       SparseBlockMatrix<LandmarkMatrixType>* _Hll;
       SparseBlockMatrix<PoseLandmarkMatrixType>* _Hpl;
@@ -173,6 +184,15 @@ namespace g2o {
 
       int _numPoses, _numLandmarks;
       int _sizePoses, _sizeLandmarks;
+
+      // parallel buildSystem(), edges sharing an off diagonal block with another edge are
+      // linearized by the calling thread only, the other threads add the vertex blocks to buffers
+      bool _parallelBuild;
+      std::vector<OptimizableGraph::Edge*> _parallelEdges;
+      std::vector<OptimizableGraph::Edge*> _serialEdges;
+      std::vector<int> _quadraticFormOffsets;
+      std::vector<QuadraticFormBuffer> _quadraticFormBuffers;  ///< one for each thread but the calling one
+      std::vector<JacobianWorkspace> _jacobianWorkspaces;      ///< one for each thread but the calling one
   };
 
 
@@ -25,6 +25,7 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "sparse_optimizer.h"
+#include "parallel_for.h"
 #include <Eigen/LU>
 #include <fstream>
 #include <iomanip>
@@ -59,6 +60,7 @@ BlockSolver<Traits>::BlockSolver(LinearSolverType* linearSolver) :
   _sizePoses=0;
   _sizeLandmarks=0;
   _doSchur=true;
+  _parallelBuild=false;
 }
 
 template <typename Traits>
@@ -201,6 +203,11 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
     schurMatrixLookup->blockCols().resize(_Hschur->blockCols().size());
   }
 
+  // off diagonal blocks of each edge, to find the edges sharing one in a parallel build
+  const bool parallelBuild = _optimizer->numThreads() > 1;
+  std::vector<double*> edgeBlocks;
+  std::vector<int> edgeBlocksEnd;
+
   // here we assume that the landmark indices start after the pose ones
   // create the structure in Hpp, Hll and in Hpl
   for (SparseOptimizer::EdgeContainer::const_iterator it=_optimizer->activeEdges().begin(); it!=_optimizer->activeEdges().end(); ++it){
@@ -227,6 +234,8 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
           if (zeroBlocks)
             m->setZero();
           e->mapHessianMemory(m->data(), viIdx, vjIdx, transposedBlock);
+          if (parallelBuild)
+            edgeBlocks.push_back(m->data());
           if (_Hschur) {// assume this is only needed in case we solve with the schur complement
             schurMatrixLookup->addBlock(ind1, ind2);
           }
@@ -236,23 +245,35 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
           if (zeroBlocks)
             m->setZero();
           e->mapHessianMemory(m->data(), viIdx, vjIdx, false);
+          if (parallelBuild)
+            edgeBlocks.push_back(m->data());
         } else { 
           if (v1->marginalized()){ 
             PoseLandmarkMatrixType* m = _Hpl->block(v2->hessianIndex(),v1->hessianIndex()-_numPoses, true);
             if (zeroBlocks)
               m->setZero();
             e->mapHessianMemory(m->data(), viIdx, vjIdx, true); // transpose the block before writing to it
+            if (parallelBuild)
+              edgeBlocks.push_back(m->data());
           } else {
             PoseLandmarkMatrixType* m = _Hpl->block(v1->hessianIndex(),v2->hessianIndex()-_numPoses, true);
             if (zeroBlocks)
               m->setZero();
             e->mapHessianMemory(m->data(), viIdx, vjIdx, false); // directly the block
+            if (parallelBuild)
+              edgeBlocks.push_back(m->data());
           }
         }
       }
     }
+    if (parallelBuild)
+      edgeBlocksEnd.push_back(static_cast<int>(edgeBlocks.size()));
   }
 
+  _parallelBuild = parallelBuild;
+  if (parallelBuild)
+    prepareParallelBuild(edgeBlocks, edgeBlocksEnd);
+
   if (! _doSchur)
     return true;
 
@@ -297,6 +318,9 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
 template <typename Traits>
 bool BlockSolver<Traits>::updateStructure(const std::vector<HyperGraph::Vertex*>& vset, const HyperGraph::EdgeSet& edges)
 {
+  // the split of the edges does not cover the new ones
+  _parallelBuild = false;
+
   for (std::vector<HyperGraph::Vertex*>::const_iterator vit = vset.begin(); vit != vset.end(); ++vit) {
     OptimizableGraph::Vertex* v = static_cast<OptimizableGraph::Vertex*>(*vit);
     int dim = v->dimension();
@@ -375,58 +399,63 @@ bool BlockSolver<Traits>::solve(){
 
   //_DInvSchur->clear();
   memset (_coefficients, 0, _sizePoses*sizeof(double));
+  const int numSchurThreads = std::min(_optimizer->numThreads(), _numLandmarks / kMinEdgesPerThread);
+  if (numSchurThreads > 1) {
+    computeSchurComplementParallel(numSchurThreads);
+  } else {
 # ifdef G2O_OPENMP
 # pragma omp parallel for default (shared) schedule(dynamic, 10)
 # endif
-  for (int landmarkIndex = 0; landmarkIndex < static_cast<int>(_Hll->blockCols().size()); ++landmarkIndex) {
-    const typename SparseBlockMatrix<LandmarkMatrixType>::IntBlockMap& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
-    assert(marginalizeColumn.size() == 1 && "more than one block in _Hll column");
-
-    // calculate inverse block for the landmark
-    const LandmarkMatrixType * D = marginalizeColumn.begin()->second;
-    assert (D && D->rows()==D->cols() && "Error in landmark matrix");
-    LandmarkMatrixType& Dinv = _DInvSchur->diagonal()[landmarkIndex];
-    Dinv = D->inverse();
-
-    LandmarkVectorType  db(D->rows());
-    for (int j=0; j<D->rows(); ++j) {
-      db[j]=_b[_Hll->rowBaseOfBlock(landmarkIndex) + _sizePoses + j];
-    }
-    db=Dinv*db;
+    for (int landmarkIndex = 0; landmarkIndex < static_cast<int>(_Hll->blockCols().size()); ++landmarkIndex) {
+      const typename SparseBlockMatrix<LandmarkMatrixType>::IntBlockMap& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
+      assert(marginalizeColumn.size() == 1 && "more than one block in _Hll column");
+
+      // calculate inverse block for the landmark
+      const LandmarkMatrixType * D = marginalizeColumn.begin()->second;
+      assert (D && D->rows()==D->cols() && "Error in landmark matrix");
+      LandmarkMatrixType& Dinv = _DInvSchur->diagonal()[landmarkIndex];
+      Dinv = D->inverse();
+
+      LandmarkVectorType  db(D->rows());
+      for (int j=0; j<D->rows(); ++j) {
+        db[j]=_b[_Hll->rowBaseOfBlock(landmarkIndex) + _sizePoses + j];
+      }
+      db=Dinv*db;
 
-    assert((size_t)landmarkIndex < _HplCCS->blockCols().size() && "Index out of bounds");
-    const typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn& landmarkColumn = _HplCCS->blockCols()[landmarkIndex];
+      assert((size_t)landmarkIndex < _HplCCS->blockCols().size() && "Index out of bounds");
+      const typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn& landmarkColumn = _HplCCS->blockCols()[landmarkIndex];
 
-    for (typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_outer = landmarkColumn.begin();
-        it_outer != landmarkColumn.end(); ++it_outer) {
-      int i1 = it_outer->row;
+      for (typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_outer = landmarkColumn.begin();
+          it_outer != landmarkColumn.end(); ++it_outer) {
+        int i1 = it_outer->row;
 
-      const PoseLandmarkMatrixType* Bi = it_outer->block;
-      assert(Bi);
+        const PoseLandmarkMatrixType* Bi = it_outer->block;
+        assert(Bi);
 
-      PoseLandmarkMatrixType BDinv = (*Bi)*(Dinv);
-      assert(_HplCCS->rowBaseOfBlock(i1) < _sizePoses && "Index out of bounds");
-      typename PoseVectorType::MapType Bb(&_coefficients[_HplCCS->rowBaseOfBlock(i1)], Bi->rows());
+        PoseLandmarkMatrixType BDinv = (*Bi)*(Dinv);
+        assert(_HplCCS->rowBaseOfBlock(i1) < _sizePoses && "Index out of bounds");
+        typename PoseVectorType::MapType Bb(&_coefficients[_HplCCS->rowBaseOfBlock(i1)], Bi->rows());
 #    ifdef G2O_OPENMP
-      ScopedOpenMPMutex mutexLock(&_coefficientsMutex[i1]);
+        ScopedOpenMPMutex mutexLock(&_coefficientsMutex[i1]);
 #    endif
-      Bb.noalias() += (*Bi)*db;
-
-      assert(i1 >= 0 && i1 < static_cast<int>(_HschurTransposedCCS->blockCols().size()) && "Index out of bounds");
-      typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn::iterator targetColumnIt = _HschurTransposedCCS->blockCols()[i1].begin();
-
-      typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::RowBlock aux(i1, 0);
-      typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_inner = lower_bound(landmarkColumn.begin(), landmarkColumn.end(), aux);
-      for (; it_inner != landmarkColumn.end(); ++it_inner) {
-        int i2 = it_inner->row;
-        const PoseLandmarkMatrixType* Bj = it_inner->block;
-        assert(Bj); 
-        while (targetColumnIt->row < i2 /*&& targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end()*/)
-          ++targetColumnIt;
-        assert(targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end() && targetColumnIt->row == i2 && "invalid iterator, something wrong with the matrix structure");
-        PoseMatrixType* Hi1i2 = targetColumnIt->block;//_Hschur->block(i1,i2);
-        assert(Hi1i2);
-        (*Hi1i2).noalias() -= BDinv*Bj->transpose();
+        Bb.noalias() += (*Bi)*db;
+
+        assert(i1 >= 0 && i1 < static_cast<int>(_HschurTransposedCCS->blockCols().size()) && "Index out of bounds");
+        typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn::iterator targetColumnIt = _HschurTransposedCCS->blockCols()[i1].begin();
+
+        typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::RowBlock aux(i1, 0);
+        typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_inner = lower_bound(landmarkColumn.begin(), landmarkColumn.end(), aux);
+        for (; it_inner != landmarkColumn.end(); ++it_inner) {
+          int i2 = it_inner->row;
+          const PoseLandmarkMatrixType* Bj = it_inner->block;
+          assert(Bj); 
+          while (targetColumnIt->row < i2 /*&& targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end()*/)
+            ++targetColumnIt;
+          assert(targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end() && targetColumnIt->row == i2 && "invalid iterator, something wrong with the matrix structure");
+          PoseMatrixType* Hi1i2 = targetColumnIt->block;//_Hschur->block(i1,i2);
+          assert(Hi1i2);
+          (*Hi1i2).noalias() -= BDinv*Bj->transpose();
+        }
       }
     }
   }
@@ -518,30 +547,36 @@ bool BlockSolver<Traits>::buildSystem()
 
   // resetting the terms for the pairwise constraints
   // built up the current system by storing the Hessian blocks in the edges and vertices
+  const int numBuildThreads = _parallelBuild ?
+    std::min(_optimizer->numThreads(), static_cast<int>(_parallelEdges.size()) / kMinEdgesPerThread) : 1;
+  if (numBuildThreads > 1) {
+    linearizeParallel(numBuildThreads);
+  } else {
 # ifndef G2O_OPENMP
-  // no threading, we do not need to copy the workspace
-  JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
+    // no threading, we do not need to copy the workspace
+    JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
 # else
-  // if running with threads need to produce copies of the workspace for each thread
-  JacobianWorkspace jacobianWorkspace = _optimizer->jacobianWorkspace();
+    // if running with threads need to produce copies of the workspace for each thread
+    JacobianWorkspace jacobianWorkspace = _optimizer->jacobianWorkspace();
 # pragma omp parallel for default (shared) firstprivate(jacobianWorkspace) if (_optimizer->activeEdges().size() > 100)
 # endif
-  for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k) {
-    OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
-    e->linearizeOplus(jacobianWorkspace); // jacobian of the nodes' oplus (manifold)
-    e->constructQuadraticForm();
+    for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k) {
+      OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
+      e->linearizeOplus(jacobianWorkspace); // jacobian of the nodes' oplus (manifold)
+      e->constructQuadraticForm();
 #  ifndef NDEBUG
-    for (size_t i = 0; i < e->vertices().size(); ++i) {
-      const OptimizableGraph::Vertex* v = static_cast<const OptimizableGraph::Vertex*>(e->vertex(i));
-      if (! v->fixed()) {
-        bool hasANan = arrayHasNaN(jacobianWorkspace.workspaceForVertex(i), e->dimension() * v->dimension());
-        if (hasANan) {
-          cerr << "buildSystem(): NaN within Jacobian for edge " << e << " for vertex " << i << endl;
-          break;
+      for (size_t i = 0; i < e->vertices().size(); ++i) {
+        const OptimizableGraph::Vertex* v = static_cast<const OptimizableGraph::Vertex*>(e->vertex(i));
+        if (! v->fixed()) {
+          bool hasANan = arrayHasNaN(jacobianWorkspace.workspaceForVertex(i), e->dimension() * v->dimension());
+          if (hasANan) {
+            cerr << "buildSystem(): NaN within Jacobian for edge " << e << " for vertex " << i << endl;
+            break;
+          }
         }
       }
-    }
 #  endif
+    }
   }
 
   // flush the current system in a sparse block matrix
@@ -560,6 +595,173 @@ bool BlockSolver<Traits>::buildSystem()
 }
 
 
+template <typename Traits>
+void BlockSolver<Traits>::prepareParallelBuild(const std::vector<double*>& edgeBlocks, const std::vector<int>& edgeBlocksEnd)
+{
+  // off diagonal blocks written by more than one edge
+  std::vector<double*> sortedBlocks(edgeBlocks);
+  std::sort(sortedBlocks.begin(), sortedBlocks.end());
+  std::vector<double*> sharedBlocks;
+  for (size_t i = 1; i < sortedBlocks.size(); ++i) {
+    if (sortedBlocks[i] == sortedBlocks[i-1] && (sharedBlocks.empty() || sharedBlocks.back() != sortedBlocks[i]))
+      sharedBlocks.push_back(sortedBlocks[i]);
+  }
+
+  _parallelEdges.clear();
+  _serialEdges.clear();
+  int blockBegin = 0;
+  for (size_t k = 0; k < _optimizer->activeEdges().size(); ++k) {
+    bool shared = false;
+    for (int i = blockBegin; i < edgeBlocksEnd[k] && !shared; ++i)
+      shared = std::binary_search(sharedBlocks.begin(), sharedBlocks.end(), edgeBlocks[i]);
+    if (shared)
+      _serialEdges.push_back(_optimizer->activeEdges()[k]);
+    else
+      _parallelEdges.push_back(_optimizer->activeEdges()[k]);
+    blockBegin = edgeBlocksEnd[k];
+  }
+
+  // one block and b vector for each vertex
+  const size_t numVertices = _optimizer->indexMapping().size();
+  _quadraticFormOffsets.resize(numVertices + 1);
+  _quadraticFormOffsets[0] = 0;
+  for (size_t i = 0; i < numVertices; ++i) {
+    const int dim = _optimizer->indexMapping()[i]->dimension();
+    _quadraticFormOffsets[i+1] = _quadraticFormOffsets[i] + dim * dim + dim;
+  }
+
+  const int numThreads = _optimizer->numThreads();
+  _quadraticFormBuffers.resize(numThreads - 1);
+  for (size_t t = 0; t < _quadraticFormBuffers.size(); ++t)
+    _quadraticFormBuffers[t].setLayout(&_quadraticFormOffsets);
+  _jacobianWorkspaces.assign(numThreads - 1, _optimizer->jacobianWorkspace());
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::linearizeParallel(int numThreads)
+{
+  const int numEdges = static_cast<int>(_parallelEdges.size());
+  runOnThreads(numThreads, [this, numEdges, numThreads](int t) {
+    const int begin = threadRangeBegin(numEdges, t, numThreads);
+    const int end = threadRangeBegin(numEdges, t + 1, numThreads);
+    if (t == 0) {
+      // the calling thread writes to the vertices, and is the only one writing to shared off diagonal blocks
+      JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
+      for (int k = begin; k < end; ++k) {
+        OptimizableGraph::Edge* e = _parallelEdges[k];
+        e->linearizeOplus(jacobianWorkspace);
+        e->constructQuadraticForm();
+      }
+      for (size_t k = 0; k < _serialEdges.size(); ++k) {
+        OptimizableGraph::Edge* e = _serialEdges[k];
+        e->linearizeOplus(jacobianWorkspace);
+        e->constructQuadraticForm();
+      }
+    } else {
+      JacobianWorkspace& jacobianWorkspace = _jacobianWorkspaces[t - 1];
+      QuadraticFormBuffer& buffer = _quadraticFormBuffers[t - 1];
+      buffer.clear();
+      for (int k = begin; k < end; ++k) {
+        OptimizableGraph::Edge* e = _parallelEdges[k];
+        e->linearizeOplus(jacobianWorkspace);
+        e->constructQuadraticForm(buffer);
+      }
+    }
+  });
+
+  // add the vertex blocks of the other threads, in thread order
+  for (size_t i = 0; i < _optimizer->indexMapping().size(); ++i) {
+    OptimizableGraph::Vertex* v = _optimizer->indexMapping()[i];
+    const int dim = v->dimension();
+    Eigen::Map<MatrixXd> A(v->hessianData(), dim, dim);
+    Eigen::Map<VectorXd> b(v->bData(), dim);
+    for (int t = 1; t < numThreads; ++t) {
+      QuadraticFormBuffer& buffer = _quadraticFormBuffers[t - 1];
+      A += Eigen::Map<MatrixXd>(buffer.hessianData(i), dim, dim);
+      b += Eigen::Map<VectorXd>(buffer.bData(i, dim), dim);
+    }
+  }
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::computeSchurComplementParallel(int numThreads)
+{
+  typedef typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn LandmarkColumn;
+
+  // inverse landmark blocks and Dinv * b, in the landmark part of _coefficients until the
+  // landmark update overwrites it
+  double* dbl = _coefficients + _sizePoses;
+  runOnThreads(numThreads, [this, numThreads, dbl](int t) {
+    for (int landmarkIndex = threadRangeBegin(_numLandmarks, t, numThreads); landmarkIndex < threadRangeBegin(_numLandmarks, t + 1, numThreads); ++landmarkIndex) {
+      const typename SparseBlockMatrix<LandmarkMatrixType>::IntBlockMap& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
+      assert(marginalizeColumn.size() == 1 && "more than one block in _Hll column");
+
+      const LandmarkMatrixType * D = marginalizeColumn.begin()->second;
+      assert (D && D->rows()==D->cols() && "Error in landmark matrix");
+      LandmarkMatrixType& Dinv = _DInvSchur->diagonal()[landmarkIndex];
+      Dinv = D->inverse();
+
+      const int base = _Hll->rowBaseOfBlock(landmarkIndex);
+      typename LandmarkVectorType::MapType db(dbl + base, D->rows());
+      db = Dinv * typename LandmarkVectorType::ConstMapType(_b + _sizePoses + base, D->rows());
+    }
+  });
+
+  // the row i1 of _Hschur and _coefficients receives the products of the landmarks seen by pose i1 and
+  // by the poses after it, split the rows in ranges of about the same work
+  std::vector<long long> rowWork(_numPoses + 1, 0);
+  for (int landmarkIndex = 0; landmarkIndex < _numLandmarks; ++landmarkIndex) {
+    const LandmarkColumn& landmarkColumn = _HplCCS->blockCols()[landmarkIndex];
+    const int n = static_cast<int>(landmarkColumn.size());
+    for (int p = 0; p < n; ++p)
+      rowWork[landmarkColumn[p].row + 1] += n - p + 1;
+  }
+  for (int i = 0; i < _numPoses; ++i)
+    rowWork[i+1] += rowWork[i];
+  std::vector<int> rowBegin(numThreads + 1, _numPoses);
+  rowBegin[0] = 0;
+  for (int t = 1; t < numThreads; ++t)
+    rowBegin[t] = static_cast<int>(std::lower_bound(rowWork.begin(), rowWork.end(), (rowWork.back() * t) / numThreads) - rowWork.begin());
+
+  // each thread accumulates its rows over the landmarks in the serial order
+  runOnThreads(numThreads, [this, &rowBegin, dbl](int t) {
+    const typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::RowBlock first(rowBegin[t], 0);
+    for (int landmarkIndex = 0; landmarkIndex < _numLandmarks; ++landmarkIndex) {
+      const LandmarkColumn& landmarkColumn = _HplCCS->blockCols()[landmarkIndex];
+      typename LandmarkColumn::const_iterator it_outer = lower_bound(landmarkColumn.begin(), landmarkColumn.end(), first);
+      if (it_outer == landmarkColumn.end() || it_outer->row >= rowBegin[t+1])
+        continue;
+
+      const LandmarkMatrixType& Dinv = _DInvSchur->diagonal()[landmarkIndex];
+      const typename LandmarkVectorType::ConstMapType db(dbl + _Hll->rowBaseOfBlock(landmarkIndex), Dinv.rows());
+
+      for (; it_outer != landmarkColumn.end() && it_outer->row < rowBegin[t+1]; ++it_outer) {
+        int i1 = it_outer->row;
+
+        const PoseLandmarkMatrixType* Bi = it_outer->block;
+        assert(Bi);
+
+        PoseLandmarkMatrixType BDinv = (*Bi)*(Dinv);
+        typename PoseVectorType::MapType Bb(&_coefficients[_HplCCS->rowBaseOfBlock(i1)], Bi->rows());
+        Bb.noalias() += (*Bi)*db;
+
+        typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn::iterator targetColumnIt = _HschurTransposedCCS->blockCols()[i1].begin();
+        for (typename LandmarkColumn::const_iterator it_inner = it_outer; it_inner != landmarkColumn.end(); ++it_inner) {
+          int i2 = it_inner->row;
+          const PoseLandmarkMatrixType* Bj = it_inner->block;
+          assert(Bj);
+          while (targetColumnIt->row < i2)
+            ++targetColumnIt;
+          assert(targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end() && targetColumnIt->row == i2 && "invalid iterator, something wrong with the matrix structure");
+          PoseMatrixType* Hi1i2 = targetColumnIt->block;
+          assert(Hi1i2);
+          (*Hi1i2).noalias() -= BDinv*Bj->transpose();
+        }
+      }
+    }
+  });
+}
+
 template <typename Traits>
 bool BlockSolver<Traits>::setLambda(double lambda, bool backup)
 {
@@ -39,6 +39,7 @@
 #include "parameter.h"
 #include "parameter_container.h"
 #include "jacobian_workspace.h"
+#include "quadratic_form_buffer.h"
 
 #include "../stuff/macros.h"
 
@@ -437,6 +438,13 @@ namespace g2o {
          */
         virtual void constructQuadraticForm() = 0;
 
+        /**
+         * As constructQuadraticForm(), but adds the blocks ii and jj and the parameter
+         * vectors b to the buffer instead of the vertices. The off diagonal blocks are
+         * still written to _hessian.
+         */
+        virtual void constructQuadraticForm(QuadraticFormBuffer& buffer) = 0;
+
         /**
          * maps the internal matrix to some external memory location,
          * you need to provide the memory before calling constructQuadraticForm
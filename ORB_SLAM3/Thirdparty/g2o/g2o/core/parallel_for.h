@@ -0,0 +1,68 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef G2O_PARALLEL_FOR_H
+#define G2O_PARALLEL_FOR_H
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace g2o {
+
+  //! fewest edges (or landmarks) given to a thread, below that the thread costs more than it saves
+  const int kMinEdgesPerThread = 100;
+
+  /**
+   * \brief runs job(0) ... job(numThreads-1) concurrently and returns when all are done
+   *
+   * job(0) runs on the calling thread, the others on threads started for the call.
+   */
+  template <typename Job>
+  void runOnThreads(int numThreads, const Job& job)
+  {
+    std::vector<std::thread> threads;
+    threads.reserve(std::max(numThreads - 1, 0));
+    for (int t = 1; t < numThreads; ++t)
+      threads.push_back(std::thread(std::cref(job), t));
+    job(0);
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i].join();
+  }
+
+  /**
+   * \brief begin of the range of thread t when [0, n) is split evenly over numThreads threads
+   */
+  inline int threadRangeBegin(int n, int t, int numThreads)
+  {
+    return static_cast<int>((static_cast<long long>(n) * t) / numThreads);
+  }
+
+} // end namespace
+
+#endif
@@ -0,0 +1,80 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef G2O_QUADRATIC_FORM_BUFFER_H
+#define G2O_QUADRATIC_FORM_BUFFER_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace g2o {
+
+  /**
+   * \brief the blocks of the vertices in the quadratic form, accumulated by one thread
+   *
+   * Holds the Hessian block (column major) followed by the b vector of each vertex
+   * of the index mapping, so that edges constructing their quadratic form on
+   * different threads do not write to the same vertex. The owner adds the blocks
+   * to the vertices once all edges are done.
+   */
+  class QuadraticFormBuffer
+  {
+    public:
+      QuadraticFormBuffer() : _offsets(0) {}
+
+      /**
+       * offsets[i] is the start of the vertex with hessianIndex i, offsets.back() the total size.
+       * The offsets are shared and have to outlive the buffer.
+       */
+      void setLayout(const std::vector<int>* offsets)
+      {
+        _offsets = offsets;
+        _data.resize(offsets->back());
+      }
+
+      //! zero all blocks
+      void clear() { std::fill(_data.begin(), _data.end(), 0.); }
+
+      //! Hessian block of the vertex with this hessianIndex
+      double* hessianData(int hessianIndex)
+      {
+        assert(_offsets && hessianIndex >= 0 && hessianIndex + 1 < (int)_offsets->size() && "Index out of bounds");
+        return &_data[(*_offsets)[hessianIndex]];
+      }
+
+      //! b vector of the vertex with this hessianIndex and dimension
+      double* bData(int hessianIndex, int dimension) { return hessianData(hessianIndex) + dimension * dimension; }
+
+    protected:
+      const std::vector<int>* _offsets;
+      std::vector<double> _data;
+  };
+
+} // end namespace
+
+#endif
@@ -38,6 +38,7 @@
 #include "batch_stats.h"
 #include "hyper_graph_action.h"
 #include "robust_kernel.h"
+#include "parallel_for.h"
 #include "../stuff/timeutil.h"
 #include "../stuff/macros.h"
 #include "../stuff/misc.h"
@@ -48,7 +49,7 @@ namespace g2o{
 
 
   SparseOptimizer::SparseOptimizer() :
-    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false)
+    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false), _numThreads(1)
   {
     _graphActions.resize(AT_NUM_ELEMENTS);
   }
@@ -67,12 +68,22 @@ namespace g2o{
         (*(*it))(this);
     }
 
+    const int numEdges = static_cast<int>(_activeEdges.size());
+    if (_numThreads > 1 && numEdges > kMinEdgesPerThread) {
+      // each edge only writes its own error
+      const int numThreads = std::min(_numThreads, numEdges / kMinEdgesPerThread);
+      runOnThreads(numThreads, [this, numEdges, numThreads](int t) {
+        for (int k = threadRangeBegin(numEdges, t, numThreads); k < threadRangeBegin(numEdges, t + 1, numThreads); ++k)
+          _activeEdges[k]->computeError();
+      });
+    } else {
 #   ifdef G2O_OPENMP
 #   pragma omp parallel for default (shared) if (_activeEdges.size() > 50)
 #   endif
-    for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
-      OptimizableGraph::Edge* e = _activeEdges[k];
-      e->computeError();
+      for (int k = 0; k < numEdges; ++k) {
+        OptimizableGraph::Edge* e = _activeEdges[k];
+        e->computeError();
+      }
     }
 
 #  ifndef NDEBUG
@@ -434,6 +445,11 @@ namespace g2o{
     }
   }
 
+  void SparseOptimizer::setNumThreads(int numThreads)
+  {
+    _numThreads = std::max(numThreads, 1);
+  }
+
   void SparseOptimizer::setComputeBatchStatistics(bool computeBatchStatistics)
   {
     if ((_computeBatchStatistics == true) && (computeBatchStatistics == false)) {
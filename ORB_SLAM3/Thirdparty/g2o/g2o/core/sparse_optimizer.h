@@ -278,6 +278,15 @@ namespace g2o {
     
     bool computeBatchStatistics() const { return _computeBatchStatistics;}
 
+    /**
+     * number of threads computing the errors and building the linear system,
+     * 1 (the default) for the calling thread only. The edges of a graph optimized
+     * with more threads must compute their Jacobians analytically, since the numerical
+     * linearization perturbs the shared vertices.
+     */
+    void setNumThreads(int numThreads);
+    int numThreads() const { return _numThreads;}
+
     /**** callbacks ****/
     //! add an action to be executed before the error vectors are computed
     bool addComputeErrorAction(HyperGraphAction* action);
@@ -306,6 +315,7 @@ namespace g2o {
 
     BatchStatisticsContainer _batchStatistics;   ///< global statistics of the optimizer, e.g., timing, num-non-zeros
     bool _computeBatchStatistics;
+    int _numThreads;
   };
 } // end namespace
 
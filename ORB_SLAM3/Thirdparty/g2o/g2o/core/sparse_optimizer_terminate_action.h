@@ -0,0 +1,90 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef G2O_SPARSE_OPTIMIZER_TERMINATE_ACTION_H
+#define G2O_SPARSE_OPTIMIZER_TERMINATE_ACTION_H
+
+#include <chrono>
+
+#include "hyper_graph_action.h"
+
+namespace g2o {
+
+  class SparseOptimizer;
+
+  /**
+   * \brief stop iterating based on the gain which is (oldChi - currentChi) / currentChi.
+   *
+   * If the gain is larger than zero and below the threshold, then the optimizer is stopped.
+   * Typically usage of this action includes adding it as a postIteration action, by calling
+   * addPostIterationAction on a sparse optimizer.
+   *
+   * Besides the gain the optimization is stopped once the deadline has passed or the last
+   * iteration predicts that the next one would end after it. A force stop flag set on the
+   * optimizer is never written to, the optimizer is redirected to the flag of the action
+   * instead. Call reset() before each optimize() with the action.
+   */
+  class SparseOptimizerTerminateAction : public HyperGraphAction
+  {
+    public:
+      typedef std::chrono::steady_clock Clock;
+
+      SparseOptimizerTerminateAction();
+      virtual HyperGraphAction* operator()(const HyperGraph* graph, Parameters* parameters = 0);
+
+      double gainThreshold() const { return _gainThreshold;}
+      void setGainThreshold(double gainThreshold);
+
+      int maxIterations() const { return _maxIterations;}
+      void setMaxIterations(int maxit);
+
+      //! the optimization does not start iterations ending after the deadline
+      const Clock::time_point& deadline() const { return _deadline;}
+      void setDeadline(const Clock::time_point& deadline);
+      bool hasDeadline() const { return _hasDeadline;}
+
+      //! starts timing the iterations, call just before optimize()
+      void reset();
+
+      //! true if the action stopped the last optimization
+      bool terminated() const { return _auxTerminateFlag;}
+
+    protected:
+      double _gainThreshold;
+      double _lastChi;
+      bool _auxTerminateFlag;
+      int _maxIterations;
+      bool _hasDeadline;
+      Clock::time_point _deadline;
+      Clock::time_point _lastIterationEnd;
+
+      void setOptimizerStopFlag(const SparseOptimizer* optimizer, bool stop);
+  };
+
+} // end namespace
+
+#endif
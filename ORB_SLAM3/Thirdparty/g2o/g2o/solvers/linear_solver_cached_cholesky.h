@@ -0,0 +1,367 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef G2O_LINEAR_SOLVER_CACHED_CHOLESKY_H
+#define G2O_LINEAR_SOLVER_CACHED_CHOLESKY_H
+
+#include <Eigen/Cholesky>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include "../core/linear_solver.h"
+#include "../core/batch_stats.h"
+#include "../stuff/timeutil.h"
+
+#include "../core/eigen_types.h"
+
+#include <iostream>
+#include <vector>
+
+namespace g2o {
+
+/**
+ * \brief fill-reducing ordering of a block pattern, kept across solvers
+ *
+ * The solvers of consecutive optimizations with the same block pattern of the
+ * system matrix share the ordering and the choice of the dense or the sparse
+ * factorization instead of recomputing them. Holds the last pattern only and
+ * is not thread safe, each optimizing thread needs its own cache.
+ */
+class SymbolicFactorizationCache
+{
+  public:
+    SymbolicFactorizationCache() : _dense(false), _hits(0), _misses(0) {}
+
+    /**
+     * returns true and the cached ordering if the pattern equals the stored one.
+     * The pattern is given by the block sizes and the upper triangle of the block
+     * columns in compressed column form.
+     */
+    bool lookup(const std::vector<int>& blockSizes, const std::vector<int>& blockColPtr, const std::vector<int>& blockRowIdx,
+        std::vector<int>& blockOrdering, bool& dense)
+    {
+      if (blockSizes != _blockSizes || blockColPtr != _blockColPtr || blockRowIdx != _blockRowIdx) {
+        ++_misses;
+        return false;
+      }
+      ++_hits;
+      blockOrdering = _blockOrdering;
+      dense = _dense;
+      return true;
+    }
+
+    //! replaces the stored pattern
+    void store(const std::vector<int>& blockSizes, const std::vector<int>& blockColPtr, const std::vector<int>& blockRowIdx,
+        const std::vector<int>& blockOrdering, bool dense)
+    {
+      _blockSizes = blockSizes;
+      _blockColPtr = blockColPtr;
+      _blockRowIdx = blockRowIdx;
+      _blockOrdering = blockOrdering;
+      _dense = dense;
+    }
+
+    void clear()
+    {
+      _blockSizes.clear();
+      _blockColPtr.clear();
+      _blockRowIdx.clear();
+      _blockOrdering.clear();
+    }
+
+    int hits() const { return _hits;}
+    int misses() const { return _misses;}
+
+  protected:
+    std::vector<int> _blockSizes;
+    std::vector<int> _blockColPtr;
+    std::vector<int> _blockRowIdx;
+    std::vector<int> _blockOrdering;
+    bool _dense;
+    int _hits;
+    int _misses;
+};
+
+/**
+ * \brief Cholesky solver which reuses the symbolic factorization of previous optimizations
+ *
+ * Computes a block AMD ordering of the system and, if the factor is dense enough,
+ * factorizes the system as a single dense block with the blocked LLT of Eigen
+ * instead of the simplicial LDLT, the reduced camera system of a local BA with
+ * well connected keyframes is dense. Given a SymbolicFactorizationCache the
+ * ordering and the choice are reused while the block pattern does not change,
+ * e.g. after removing the outliers of a BA or between consecutive BA calls.
+ */
+template <typename MatrixType>
+class LinearSolverCachedCholesky: public LinearSolver<MatrixType>
+{
+  public:
+    typedef Eigen::SparseMatrix<double, Eigen::ColMajor> SparseMatrix;
+    typedef Eigen::Triplet<double> Triplet;
+    typedef Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> PermutationMatrix;
+
+    /**
+     * \brief Sub-classing Eigen's SimplicialLDLT to perform ordering with a given ordering
+     */
+    class CholeskyDecomposition : public Eigen::SimplicialLDLT<SparseMatrix, Eigen::Upper>
+    {
+      public:
+        CholeskyDecomposition() : Eigen::SimplicialLDLT<SparseMatrix, Eigen::Upper>() {}
+        using Eigen::SimplicialLDLT< SparseMatrix, Eigen::Upper>::analyzePattern_preordered;
+
+        void analyzePatternWithPermutation(SparseMatrix& a, const PermutationMatrix& permutation)
+        {
+          m_Pinv = permutation;
+          m_P = permutation.inverse();
+          int size = a.cols();
+          SparseMatrix ap(size, size);
+          ap.selfadjointView<Eigen::Upper>() = a.selfadjointView<UpLo>().twistedBy(m_P);
+          analyzePattern_preordered(ap, true);
+        }
+
+        //! non-zeros of the factor below the diagonal, valid after the analysis
+        int factorNonZeros() const { return m_nonZerosPerCol.sum();}
+    };
+
+  public:
+    LinearSolverCachedCholesky(SymbolicFactorizationCache* cache = 0) :
+      LinearSolver<MatrixType>(),
+      _init(true), _dense(false), _denseFillRatio(0.3), _writeDebug(false), _cache(cache)
+    {
+    }
+
+    virtual ~LinearSolverCachedCholesky()
+    {
+    }
+
+    virtual bool init()
+    {
+      _init = true;
+      return true;
+    }
+
+    bool solve(const SparseBlockMatrix<MatrixType>& A, double* x, double* b)
+    {
+      if (_init)
+        computeSymbolicDecomposition(A);
+      else if (! _dense)
+        fillSparseMatrix(A, true);
+      _init = false;
+
+      double t=get_monotonic_time();
+      VectorXD::MapType xx(x, A.cols());
+      VectorXD::ConstMapType bb(b, A.cols());
+      size_t factorNNZ;
+      if (_dense) {
+        fillDenseMatrix(A);
+        _denseCholesky.compute(_denseMatrix);
+        if (_denseCholesky.info() != Eigen::Success)
+          return failure(A);
+        xx = _denseCholesky.solve(bb);
+        factorNNZ = _denseMatrix.cols() * (_denseMatrix.cols() + 1) / 2;
+      } else {
+        _cholesky.factorize(_sparseMatrix);
+        if (_cholesky.info() != Eigen::Success)
+          return failure(A);
+        xx = _cholesky.solve(bb);
+        factorNNZ = _cholesky.matrixL().nestedExpression().nonZeros() + _sparseMatrix.cols(); // the elements of D
+      }
+      G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
+      if (globalStats) {
+        globalStats->timeNumericDecomposition = get_monotonic_time() - t;
+        globalStats->choleskyNNZ = factorNNZ;
+      }
+
+      return true;
+    }
+
+    //! factor density (relative to the full triangle) above which the dense factorization is used
+    double denseFillRatio() const { return _denseFillRatio;}
+    void setDenseFillRatio(double ratio) { _denseFillRatio = ratio;}
+
+    //! true if the current structure is factorized as a dense matrix
+    bool dense() const { return _dense;}
+
+    //! write a debug dump of the system matrix if it is not SPD in solve
+    virtual bool writeDebug() const { return _writeDebug;}
+    virtual void setWriteDebug(bool b) { _writeDebug = b;}
+
+  protected:
+    bool _init;
+    bool _dense;
+    double _denseFillRatio;
+    bool _writeDebug;
+    SymbolicFactorizationCache* _cache;
+    SparseMatrix _sparseMatrix;
+    CholeskyDecomposition _cholesky;
+    Eigen::MatrixXd _denseMatrix;
+    Eigen::LLT<Eigen::MatrixXd, Eigen::Upper> _denseCholesky;
+
+    bool failure(const SparseBlockMatrix<MatrixType>& A)
+    {
+      // the matrix is not positive definite
+      if (_writeDebug) {
+        std::cerr << "Cholesky failure, writing debug.txt (Hessian loadable by Octave)" << std::endl;
+        A.writeOctave("debug.txt");
+      }
+      return false;
+    }
+
+    /**
+     * computes the block ordering and decides between the dense and the sparse
+     * factorization, unless the cache holds them for the pattern of A
+     */
+    void computeSymbolicDecomposition(const SparseBlockMatrix<MatrixType>& A)
+    {
+      double t=get_monotonic_time();
+      std::vector<int> blockSizes, blockColPtr, blockRowIdx, blockOrdering;
+      blockSizes.reserve(A.blockCols().size());
+      blockColPtr.reserve(A.blockCols().size() + 1);
+      blockColPtr.push_back(0);
+      for (size_t c = 0; c < A.blockCols().size(); ++c) {
+        blockSizes.push_back(A.colsOfBlock(c));
+        const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first > static_cast<int>(c)) // only upper triangle
+            break;
+          blockRowIdx.push_back(it->first);
+        }
+        blockColPtr.push_back(blockRowIdx.size());
+      }
+
+      bool cached = _cache && _cache->lookup(blockSizes, blockColPtr, blockRowIdx, blockOrdering, _dense);
+      if (cached && _dense) {
+        _denseMatrix.setZero(A.rows(), A.cols());
+      } else {
+        if (! cached)
+          blockOrdering = computeBlockOrdering(blockColPtr, blockRowIdx);
+        _sparseMatrix.resize(A.rows(), A.cols());
+        fillSparseMatrix(A, false);
+        _cholesky.analyzePatternWithPermutation(_sparseMatrix, scalarPermutation(A, blockOrdering));
+        if (! cached) {
+          double n = A.cols();
+          _dense = _cholesky.factorNonZeros() > _denseFillRatio * n * (n - 1) / 2;
+          if (_cache)
+            _cache->store(blockSizes, blockColPtr, blockRowIdx, blockOrdering, _dense);
+        }
+        if (_dense)
+          _denseMatrix.setZero(A.rows(), A.cols());
+      }
+      G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
+      if (globalStats)
+        globalStats->timeSymbolicDecomposition = get_monotonic_time() - t;
+    }
+
+    //! AMD ordering on the block structure
+    static std::vector<int> computeBlockOrdering(const std::vector<int>& blockColPtr, const std::vector<int>& blockRowIdx)
+    {
+      int numBlocks = blockColPtr.size() - 1;
+      std::vector<Triplet> triplets;
+      triplets.reserve(blockRowIdx.size());
+      for (int c = 0; c < numBlocks; ++c)
+        for (int i = blockColPtr[c]; i < blockColPtr[c+1]; ++i)
+          triplets.push_back(Triplet(blockRowIdx[i], c, 0.));
+
+      // Relies on Eigen's internal stuff, as the block ordering of LinearSolverEigen
+      SparseMatrix auxBlockMatrix(numBlocks, numBlocks);
+      auxBlockMatrix.setFromTriplets(triplets.begin(), triplets.end());
+      typename CholeskyDecomposition::CholMatrixType C;
+      C = auxBlockMatrix.selfadjointView<Eigen::Upper>();
+      Eigen::PermutationMatrix<Eigen::Dynamic,Eigen::Dynamic> blockP;
+      Eigen::internal::minimum_degree_ordering(C, blockP);
+      return std::vector<int>(blockP.indices().data(), blockP.indices().data() + blockP.size());
+    }
+
+    //! adapts the block permutation to the scalar matrix
+    static PermutationMatrix scalarPermutation(const SparseBlockMatrix<MatrixType>& A, const std::vector<int>& blockOrdering)
+    {
+      int rows = A.rows();
+      assert(rows == A.cols() && "Matrix A is not square");
+      PermutationMatrix scalarP;
+      scalarP.resize(rows);
+      int scalarIdx = 0;
+      for (size_t i = 0; i < blockOrdering.size(); ++i) {
+        const int& p = blockOrdering[i];
+        int base  = A.colBaseOfBlock(p);
+        int nCols = A.colsOfBlock(p);
+        for (int j = 0; j < nCols; ++j)
+          scalarP.indices()(scalarIdx++) = base++;
+      }
+      assert(scalarIdx == rows && "did not completely fill the permutation matrix");
+      return scalarP;
+    }
+
+    //! copies the upper triangle of A, the pattern is already zeroed
+    void fillDenseMatrix(const SparseBlockMatrix<MatrixType>& A)
+    {
+      for (size_t c = 0; c < A.blockCols().size(); ++c) {
+        int colBaseOfBlock = A.colBaseOfBlock(c);
+        const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first > static_cast<int>(c))
+            break;
+          const MatrixType& m = *(it->second);
+          _denseMatrix.block(A.rowBaseOfBlock(it->first), colBaseOfBlock, m.rows(), m.cols()) = m;
+        }
+      }
+    }
+
+    void fillSparseMatrix(const SparseBlockMatrix<MatrixType>& A, bool onlyValues)
+    {
+      if (onlyValues) {
+        A.fillCCS(_sparseMatrix.valuePtr(), true);
+      } else {
+
+        // create from triplet structure
+        std::vector<Triplet> triplets;
+        triplets.reserve(A.nonZeros());
+        for (size_t c = 0; c < A.blockCols().size(); ++c) {
+          int colBaseOfBlock = A.colBaseOfBlock(c);
+          const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+          for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+            int rowBaseOfBlock = A.rowBaseOfBlock(it->first);
+            const MatrixType& m = *(it->second);
+            for (int cc = 0; cc < m.cols(); ++cc) {
+              int aux_c = colBaseOfBlock + cc;
+              for (int rr = 0; rr < m.rows(); ++rr) {
+                int aux_r = rowBaseOfBlock + rr;
+                if (aux_r > aux_c)
+                  break;
+                triplets.push_back(Triplet(aux_r, aux_c, m(rr, cc)));
+              }
+            }
+          }
+        }
+        _sparseMatrix.setFromTriplets(triplets.begin(), triplets.end());
+
+      }
+    }
+};
+
+} // end namespace
+
+#endif
@@ -38,3 +38,9 @@ mkdir build
 cd build
 cmake .. -DCMAKE_BUILD_TYPE=Release
 make -j4
+
+cd ..
+
+echo "Converting vocabulary to binary ..."
+
+./tools/bin_vocabulary Vocabulary/ORBvoc.txt Vocabulary/ORBvoc.bin
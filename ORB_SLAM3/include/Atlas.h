@@ -25,9 +25,14 @@
 #include "GeometricCamera.h"
 #include "Pinhole.h"
 #include "KannalaBrandt8.h"
+#include "ProfiledMutex.h"
 
+#include <atomic>
+#include <map>
 #include <set>
 #include <mutex>
+#include <memory>
+#include <unordered_map>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/export.hpp>
 
@@ -78,6 +83,9 @@ public:
 
     void CreateNewMap();
     void ChangeMap(Map* pMap);
+    // Makes a stored map current after relocalizing in it. The current map is dropped if
+    // it has no keyframes yet. Returns false if pMap is not a valid map of the atlas.
+    bool SwitchToMap(Map* pMap);
 
     unsigned long int GetLastInitKFid();
 
@@ -127,6 +135,44 @@ public:
     void PreSave();
     void PostLoad();
 
+    // Sectioned atlas file: a versioned header, a section table, and the maps with their keyframes, keyframe
+    // descriptors and map points split in sections that are serialized in parallel. Save after PreSave; load
+    // into an empty atlas, then set the database and the vocabulary and call PostLoad
+    bool SaveToFile(const std::string &strFile, const std::string &strVocName, const std::string &strVocChecksum);
+
+    // Sections of an atlas file serialized in memory, TakeSnapshot has the cost of the serialization only and
+    // WriteSnapshot, that does not touch the atlas, can run later on any thread. SaveToFile does both
+    struct FileSnapshot
+    {
+        std::string strTable;   // header and section table
+        std::vector<std::string> vSections;
+        std::vector<uint64_t> vOffsets;
+        uint64_t nFileSize;
+    };
+    bool TakeSnapshot(const std::string &strVocName, const std::string &strVocChecksum, FileSnapshot &snapshot);
+    // Writes to a temporary file that is synced and renamed, at most nBytesPerSecond if it is not 0
+    static bool WriteSnapshot(const FileSnapshot &snapshot, const std::string &strFile, size_t nBytesPerSecond=0);
+    bool LoadFromFile(const std::string &strFile, std::string &strVocName, std::string &strVocChecksum);
+    static bool IsAtlasFile(const std::string &strFile);
+
+    // The keyframes are saved grouped in spatial cells of fCellSize meters. With a resident budget, the keyframe
+    // descriptors of a loaded atlas file are left in the file mapping and paged in by cell around the reference
+    // keyframe of the tracking, releasing the least recently used cells above the budget. 0 loads all of them
+    void SetMapCells(float fCellSize, size_t nResidentBytes);
+    void UpdateMapCells(KeyFrame* pRefKF);
+
+    // Memory budget of the maps, 0 disables it. It is checked every few keyframes, and over it the grids of
+    // the keyframes out of the local window are released, the keyframe features of the inactive maps are
+    // paged out and, if that is not enough, local mapping culls keyframes more aggressively
+    void SetMemoryBudget(size_t nBytes);
+    // Called by local mapping once a keyframe is processed
+    void EnforceMemoryBudget(KeyFrame* pCurrentKF);
+    bool IsOverMemoryBudget();
+    // Estimate of the resident memory of the maps
+    size_t GetMemoryBytes();
+    // Estimate of the memory of the maps and the keyframe database by structure, paged out bytes included
+    void GetMemoryBreakdown(MemoryBreakdown &breakdown);
+
     map<long unsigned int, KeyFrame*> GetAtlasKeyframes();
 
     void SetKeyFrameDababase(KeyFrameDatabase* pKFDB);
@@ -159,8 +205,35 @@ protected:
     KeyFrameDatabase* mpKeyFrameDB;
     ORBVocabulary* mpORBVocabulary;
 
+    // Spatial cells of the keyframe descriptors left in the mapping of the loaded atlas file
+    struct MapCell
+    {
+        std::vector<std::pair<const char*, size_t> > vRanges;
+        size_t nBytes;
+        std::vector<size_t> vNeighbors;
+        unsigned long nLastUse;
+        bool bResident;
+    };
+    float mfMapCellSize;
+    size_t mnMapCellBudget;
+    std::vector<std::shared_ptr<void> > mvpAtlasFiles;
+    std::vector<MapCell> mvMapCells;
+    std::unordered_map<KeyFrame*, size_t> mmKeyFrameCell;
+    size_t mnCurrentCell;
+    size_t mnResidentBytes;
+    unsigned long mnMapCellTick;
+
+    // Memory budget, with the bytes paged out of the inactive maps
+    size_t MapResidentBytes(Map* pMap);
+    size_t mnMemoryBudget;
+    unsigned long mnMemoryBudgetChecks;
+    std::atomic<bool> mbOverMemoryBudget;
+    std::map<Map*, size_t> mmPagedOutBytes;
+
     // Mutex
-    std::mutex mMutexAtlas;
+    ProfiledMutex mMutexAtlas{"Atlas::mMutexAtlas"};
+    std::mutex mMutexMapCells;
+    std::mutex mMutexMemoryBudget;
 
 
 }; // class Atlas
@@ -70,6 +70,17 @@ namespace ORB_SLAM3 {
 
         virtual Eigen::Matrix<double,2,3> projectJac(const Eigen::Vector3d& v3D) = 0;
 
+        // Projects (unprojects) n points with one virtual call, the models override them
+        // with loops over their inline kernels that the compiler can vectorize
+        virtual void projectBatch(const Eigen::Vector3f* pv3D, Eigen::Vector2f* pv2D, const size_t n) {
+            for(size_t i=0; i<n; i++)
+                pv2D[i] = project(pv3D[i]);
+        }
+        virtual void unprojectBatch(const cv::Point2f* pv2D, Eigen::Vector3f* pvRays, const size_t n) {
+            for(size_t i=0; i<n; i++)
+                pvRays[i] = unprojectEig(pv2D[i]);
+        }
+
         virtual bool ReconstructWithTwoViews(const std::vector<cv::KeyPoint>& vKeys1, const std::vector<cv::KeyPoint>& vKeys2, const std::vector<int> &vMatches12,
                                              Sophus::SE3f &T21, std::vector<cv::Point3f> &vP3D, std::vector<bool> &vbTriangulated) = 0;
 
@@ -74,6 +74,9 @@ namespace ORB_SLAM3 {
 
         Eigen::Matrix<double,2,3> projectJac(const Eigen::Vector3d& v3D);
 
+        void projectBatch(const Eigen::Vector3f* pv3D, Eigen::Vector2f* pv2D, const size_t n);
+        void unprojectBatch(const cv::Point2f* pv2D, Eigen::Vector3f* pvRays, const size_t n);
+
 
         bool ReconstructWithTwoViews(const std::vector<cv::KeyPoint>& vKeys1, const std::vector<cv::KeyPoint>& vKeys2, const std::vector<int> &vMatches12,
                                      Sophus::SE3f &T21, std::vector<cv::Point3f> &vP3D, std::vector<bool> &vbTriangulated);
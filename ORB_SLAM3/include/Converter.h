@@ -36,6 +36,7 @@ class Converter
 {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    // Only for callers that need a vector: the vocabulary transforms the descriptor matrix directly
     static std::vector<cv::Mat> toDescriptorVector(const cv::Mat &Descriptors);
 
     static g2o::SE3Quat toSE3Quat(const cv::Mat &cvT);
@@ -66,6 +67,12 @@ public:
     static Eigen::Matrix<double,4,4> toMatrix4d(const cv::Mat &cvMat4);
     static Eigen::Matrix<float,3,3> toMatrix3f(const cv::Mat &cvMat3);
     static Eigen::Matrix<float,4,4> toMatrix4f(const cv::Mat &cvMat4);
+
+    // Views over the data of a continuous CV_32F cv::Mat, nothing is copied.
+    // They are valid as long as the cv::Mat data is.
+    static Eigen::Map<const Eigen::Matrix<float,3,3,Eigen::RowMajor>> toMatrix3fMap(const cv::Mat &cvMat3);
+    static Eigen::Map<const Eigen::Matrix<float,4,4,Eigen::RowMajor>> toMatrix4fMap(const cv::Mat &cvMat4);
+    static Eigen::Map<const Eigen::Matrix<float,3,1>> toVector3fMap(const cv::Mat &cvVector);
     static std::vector<float> toQuaternion(const cv::Mat &M);
 
     static bool isRotationMatrix(const cv::Mat &R);
@@ -73,6 +80,7 @@ public:
 
     //TODO: Sophus migration, to be deleted in the future
     static Sophus::SE3<float> toSophus(const cv::Mat& T);
+    static Sophus::SE3<float> toSophus(const Eigen::Map<const Eigen::Matrix<float,4,4,Eigen::RowMajor>>& T);
     static Sophus::Sim3f toSophus(const g2o::Sim3& S);
 };
 
@@ -0,0 +1,206 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DESCRIPTORARENA_H
+#define DESCRIPTORARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Contiguous store of the ORB descriptors of the map points of a map. A row is
+// one cache line: a sequence counter, the arena and the 32 descriptor bytes at
+// a 32 byte boundary. Rows are handed out in creation order from chunks that
+// never move, so points searched together mostly read neighbouring lines.
+//
+// Rows are published like SeqLockArray: readers copy without locking and retry
+// if a write overlapped, writes to a row are serialized by its map point.
+// The owner (the map) drops its reference with Release(), rows of points moved
+// to another map keep the arena until they are freed.
+class DescriptorArena
+{
+public:
+    static const size_t kDescriptorBytes = 32;
+
+    struct alignas(64) Row
+    {
+        std::atomic<unsigned int> nSequence;
+        std::atomic<unsigned int> bValid;
+        DescriptorArena* pArena;
+        char padding[16];
+        std::atomic<uint64_t> words[kDescriptorBytes/8];
+
+        void Store(const unsigned char* pDescriptor)
+        {
+            uint64_t values[kDescriptorBytes/8];
+            memcpy(values, pDescriptor, kDescriptorBytes);
+
+            const unsigned int seq = nSequence.load(std::memory_order_relaxed);
+            nSequence.store(seq+1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for(size_t i=0; i<kDescriptorBytes/8; i++)
+                words[i].store(values[i], std::memory_order_relaxed);
+            bValid.store(1, std::memory_order_relaxed);
+            nSequence.store(seq+2, std::memory_order_release);
+        }
+
+        // False if no descriptor has been stored yet
+        bool Load(unsigned char* pDescriptor) const
+        {
+            uint64_t values[kDescriptorBytes/8];
+            while(true)
+            {
+                const unsigned int seq = nSequence.load(std::memory_order_acquire);
+                if(seq & 1)
+                    continue;
+                const unsigned int valid = bValid.load(std::memory_order_relaxed);
+                for(size_t i=0; i<kDescriptorBytes/8; i++)
+                    values[i] = words[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(nSequence.load(std::memory_order_relaxed) != seq)
+                    continue;
+                if(!valid)
+                    return false;
+                memcpy(pDescriptor, values, kDescriptorBytes);
+                return true;
+            }
+        }
+    };
+
+    explicit DescriptorArena(size_t nChunkRows): mnChunkRows(nChunkRows), mnLive(0), mbReleased(false)
+    {
+    }
+
+    // A row from pArena, or from the arena shared by points created without a map
+    // (e.g. loaded by boost::serialization)
+    static Row* Allocate(DescriptorArena* pArena)
+    {
+        return (pArena ? pArena : Shared())->AllocateRow();
+    }
+
+    static void Free(Row* pRow)
+    {
+        if(pRow)
+            pRow->pArena->FreeRow(pRow);
+    }
+
+    void Release()
+    {
+        bool bDestroy;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mbReleased = true;
+            bDestroy = mnLive==0;
+        }
+        if(bDestroy)
+            delete this;
+    }
+
+    size_t LiveRows()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mnLive;
+    }
+
+private:
+    static const size_t kRowAlignment = 64;
+
+    static DescriptorArena* Shared()
+    {
+        // Never released, loaded points live as long as the process
+        static DescriptorArena* pShared = new DescriptorArena(1024);
+        return pShared;
+    }
+
+    Row* AllocateRow()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if(mvpFree.empty())
+            AddChunk();
+        Row* pRow = mvpFree.back();
+        mvpFree.pop_back();
+        mnLive++;
+
+        // A recycled row must not publish the descriptor of its previous point
+        pRow->bValid.store(0, std::memory_order_relaxed);
+        return pRow;
+    }
+
+    void FreeRow(Row* pRow)
+    {
+        bool bDestroy;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mvpFree.push_back(pRow);
+            mnLive--;
+            bDestroy = mbReleased && mnLive==0;
+        }
+        if(bDestroy)
+            delete this;
+    }
+
+    void AddChunk()
+    {
+        char* pRaw = static_cast<char*>(::operator new(mnChunkRows*sizeof(Row) + kRowAlignment));
+        mvpChunks.push_back(pRaw);
+
+        Row* pRows = reinterpret_cast<Row*>((reinterpret_cast<uintptr_t>(pRaw) + kRowAlignment - 1) & ~(uintptr_t)(kRowAlignment - 1));
+        // Pushed backwards, so rows are handed out in address order
+        mvpFree.reserve(mvpFree.size() + mnChunkRows);
+        for(size_t i=mnChunkRows; i-->0;)
+        {
+            Row* pRow = new (pRows + i) Row;
+            pRow->nSequence.store(0, std::memory_order_relaxed);
+            pRow->bValid.store(0, std::memory_order_relaxed);
+            pRow->pArena = this;
+            mvpFree.push_back(pRow);
+        }
+    }
+
+    // Destroyed by Release() or by freeing its last row
+    ~DescriptorArena()
+    {
+        for(size_t i=0; i<mvpChunks.size(); i++)
+            ::operator delete(mvpChunks[i]);
+    }
+
+    DescriptorArena(const DescriptorArena&);
+    DescriptorArena& operator=(const DescriptorArena&);
+
+    const size_t mnChunkRows;
+    std::vector<char*> mvpChunks;
+    std::vector<Row*> mvpFree;
+    size_t mnLive;
+    bool mbReleased;
+    std::mutex mMutex;
+};
+
+static_assert(sizeof(DescriptorArena::Row) == 64, "a descriptor row is one cache line");
+static_assert(alignof(DescriptorArena::Row) == 64, "descriptors are 32 byte aligned");
+
+} //namespace ORB_SLAM
+
+#endif // DESCRIPTORARENA_H
@@ -0,0 +1,205 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef DESCRIPTORTRAITS_H
+#define DESCRIPTORTRAITS_H
+
+#include <opencv2/core/core.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace ORB_SLAM3
+{
+
+// Compile-time description of a descriptor type for DescriptorMatcher: the element type and
+// length of a descriptor row, its distance kernels and the matching thresholds. Distances
+// of every type are integers on the scale of the Hamming distance of 256 bits, 0 for equal
+// descriptors and MAX_DISTANCE (or more) for unrelated ones, so the thresholds and the
+// ratio tests of the searches keep their meaning.
+
+// Hamming distance of 256-bit binary descriptors, 32 CV_8U columns
+struct BinaryDescriptor256
+{
+    typedef uchar Element;
+    static const int CV_TYPE = CV_8U;
+    static const int LENGTH = 32;
+    static const int MAX_DISTANCE = 256;
+
+    // Bit set count operation from
+    // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+    static int Distance(const Element *a, const Element *b)
+    {
+        const int32_t *pa = reinterpret_cast<const int32_t*>(a);
+        const int32_t *pb = reinterpret_cast<const int32_t*>(b);
+
+        int dist=0;
+
+        for(int i=0; i<8; i++, pa++, pb++)
+        {
+            unsigned  int v = *pa ^ *pb;
+            v = v - ((v >> 1) & 0x55555555);
+            v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+            dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+        }
+
+        return dist;
+    }
+
+    // Distances from a to the rows vIndices of descriptors, with NEON (aarch64) or AVX2 when
+    // the build enables them
+    static void Distances(const Element *a, const cv::Mat &descriptors, const std::vector<size_t> &vIndices, int *pDistances)
+    {
+        const size_t n = vIndices.size();
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        // Per candidate: two 16 byte xors, vcnt per byte and one widening add across lanes
+        const uint8x16_t a0 = vld1q_u8(a);
+        const uint8x16_t a1 = vld1q_u8(a+16);
+        for(size_t i=0; i<n; i++)
+        {
+            const uchar *pb = descriptors.ptr<uchar>((int)vIndices[i]);
+            const uint8x16_t c0 = vcntq_u8(veorq_u8(a0, vld1q_u8(pb)));
+            const uint8x16_t c1 = vcntq_u8(veorq_u8(a1, vld1q_u8(pb+16)));
+            pDistances[i] = vaddlvq_u8(vaddq_u8(c0, c1));
+        }
+#elif defined(__AVX2__)
+        // Per candidate: one 32 byte xor, nibble popcount by table lookup and a byte sum
+        const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                             0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+        const __m256i low = _mm256_set1_epi8(0x0f);
+        const __m256i va = _mm256_loadu_si256((const __m256i*)a);
+        for(size_t i=0; i<n; i++)
+        {
+            const uchar *pb = descriptors.ptr<uchar>((int)vIndices[i]);
+            const __m256i x = _mm256_xor_si256(va, _mm256_loadu_si256((const __m256i*)pb));
+            const __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)),
+                                              _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+            const __m256i s4 = _mm256_sad_epu8(c, _mm256_setzero_si256());
+            const __m128i s2 = _mm_add_epi64(_mm256_castsi256_si128(s4), _mm256_extracti128_si256(s4, 1));
+            pDistances[i] = _mm_cvtsi128_si32(s2) + _mm_extract_epi32(s2, 2);
+        }
+#else
+        for(size_t i=0; i<n; i++)
+            pDistances[i] = Distance(a, descriptors.ptr<uchar>((int)vIndices[i]));
+#endif
+    }
+};
+
+// ORB descriptors of ORBextractor and GPUORBextractor
+struct OrbDescriptor: public BinaryDescriptor256
+{
+    static const int TH_LOW = 50;
+    static const int TH_HIGH = 100;
+};
+
+// Signs of the SuperPoint descriptors of TPUFeatureExtractor (BINARY_BILINEAR), also words of
+// the ORB vocabulary. They are matched with the ORB thresholds until tuned on their own
+// distance distribution.
+struct BinarySuperPointDescriptor: public BinaryDescriptor256
+{
+    static const int TH_LOW = 50;
+    static const int TH_HIGH = 100;
+};
+
+// L2-normalized 256-float SuperPoint descriptors of TPUFeatureExtractor (FLOAT_NEAREST and
+// FLOAT_BILINEAR). The distance is the euclidean one times 128, [0,2] to [0,256] for unit
+// descriptors.
+struct FloatSuperPointDescriptor
+{
+    typedef float Element;
+    static const int CV_TYPE = CV_32F;
+    static const int LENGTH = 256;
+    static const int MAX_DISTANCE = 256;
+
+    // Euclidean distances 0.5 and 0.7
+    static const int TH_LOW = 64;
+    static const int TH_HIGH = 90;
+
+    static int ScaledDistance(const float squaredDistance)
+    {
+        return static_cast<int>(128.f*std::sqrt(squaredDistance)+0.5f);
+    }
+
+    static float SquaredDistance(const Element *a, const Element *b)
+    {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        float32x4_t s0 = vdupq_n_f32(0.f);
+        float32x4_t s1 = vdupq_n_f32(0.f);
+        for(int i=0; i<LENGTH; i+=8)
+        {
+            const float32x4_t d0 = vsubq_f32(vld1q_f32(a+i), vld1q_f32(b+i));
+            const float32x4_t d1 = vsubq_f32(vld1q_f32(a+i+4), vld1q_f32(b+i+4));
+            s0 = vfmaq_f32(s0, d0, d0);
+            s1 = vfmaq_f32(s1, d1, d1);
+        }
+        return vaddvq_f32(vaddq_f32(s0, s1));
+#elif defined(__AVX2__)
+        __m256 s0 = _mm256_setzero_ps();
+        __m256 s1 = _mm256_setzero_ps();
+        for(int i=0; i<LENGTH; i+=16)
+        {
+            const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i));
+            const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8));
+            s0 = _mm256_add_ps(s0, _mm256_mul_ps(d0, d0));
+            s1 = _mm256_add_ps(s1, _mm256_mul_ps(d1, d1));
+        }
+        const __m256 s = _mm256_add_ps(s0, s1);
+        __m128 s4 = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+        s4 = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+        s4 = _mm_add_ss(s4, _mm_shuffle_ps(s4, s4, 1));
+        return _mm_cvtss_f32(s4);
+#else
+        float s[4] = {0.f, 0.f, 0.f, 0.f};
+        for(int i=0; i<LENGTH; i+=4)
+        {
+            for(int j=0; j<4; j++)
+            {
+                const float d = a[i+j]-b[i+j];
+                s[j] += d*d;
+            }
+        }
+        return (s[0]+s[1])+(s[2]+s[3]);
+#endif
+    }
+
+    static int Distance(const Element *a, const Element *b)
+    {
+        return ScaledDistance(SquaredDistance(a, b));
+    }
+
+    static void Distances(const Element *a, const cv::Mat &descriptors, const std::vector<size_t> &vIndices, int *pDistances)
+    {
+        for(size_t i=0, n=vIndices.size(); i<n; i++)
+            pDistances[i] = Distance(a, descriptors.ptr<float>((int)vIndices[i]));
+    }
+};
+
+} // namespace ORB_SLAM3
+
+#endif // DESCRIPTORTRAITS_H
@@ -0,0 +1,112 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ENERGYCOUNTERS_H
+#define ENERGYCOUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Instantaneous power of a supply, from sysfs: a power file, or a voltage and a current file
+struct PowerRail
+{
+    std::string name;
+    std::string powerPath;          // Empty to read voltagePath and currentPath
+    std::string voltagePath;
+    std::string currentPath;
+    double scale = 1e-6;            // Watts per unit of the power reading, or of voltage times current
+};
+
+// Energy of a span name on one rail, summed over all the threads and spans of that name. Spans
+// are inclusive: a nested span is also counted in the span around it.
+struct StageEnergy
+{
+    std::string name;
+    std::string rail;
+    uint64_t nSpans = 0;
+    double busyMs = 0.0;            // Time spent in the spans
+    double energyMj = 0.0;
+    double averagePowerMw = 0.0;    // Energy over the time spent in the spans
+};
+
+// Energy of one rail since Start() or Reset()
+struct RailEnergy
+{
+    std::string name;
+    uint64_t nSamples = 0;
+    double durationS = 0.0;
+    double energyMj = 0.0;
+    double idleMj = 0.0;            // While no thread was in a span
+    double averagePowerMw = 0.0;
+};
+
+// Energy of the TraceScope spans. A sampler thread reads the power of the rails (fuel gauge,
+// PMIC or shunt monitors) every sample period with a pread() per file. At every span boundary the
+// thread credits itself the last sampled power for the time since its previous boundary, split
+// evenly between the threads that are in a span meanwhile, so a span gets the energy of the rails
+// while it ran, at any span length and at the power resolution of the sample period. What no span
+// covers is the idle energy of the rail. A span boundary costs a clock read and a few atomic loads.
+//
+// The spans are compiled in with ENABLE_TRACING (Trace.h), metering does not need the tracer to be
+// recording. Without them only the rail totals are measured.
+class EnergyCounters
+{
+public:
+    // Batteries of /sys/class/power_supply (power_now, or voltage_now and
+    // current_now), then the power inputs of /sys/class/hwmon. A battery rail is the whole
+    // headset, the hwmon rails are parts of it.
+    static std::vector<PowerRail> FindRails(const std::string &strSysfsRoot = "/sys");
+
+    // Starts the sampler on the rails that can be read and resets the statistics. Returns false
+    // if none can.
+    static bool Start(const std::vector<PowerRail> &vRails, int nSamplePeriodUs = 1000);
+    static void Stop();
+
+    static bool IsEnabled()
+    {
+        return sbEnabled.load(std::memory_order_relaxed);
+    }
+
+    // Span boundaries of the calling thread, the name must be a string literal
+    static void BeginSpan();
+    static void EndSpan(const char* name);
+
+    // Per span name and rail, by energy
+    static std::vector<StageEnergy> GetStatistics();
+
+    // Per rail, in the order of Start()
+    static std::vector<RailEnergy> GetRails();
+
+    static void Reset();
+
+    static void PrintStatistics(std::ostream &os);
+
+private:
+    static std::atomic<bool> sbEnabled;
+};
+
+} //namespace ORB_SLAM
+
+#endif // ENERGYCOUNTERS_H
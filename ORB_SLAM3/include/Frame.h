@@ -33,6 +33,9 @@
 #include "Converter.h"
 #include "Settings.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <opencv2/opencv.hpp>
 
@@ -49,6 +52,69 @@ class KeyFrame;
 class ConstraintPoseImu;
 class GeometricCamera;
 class ORBextractor;
+class StereoDepthGPU;
+
+// Bag of words of the descriptors of a frame, shared by the copies of the frame and by the
+// keyframe made from it so the vocabulary transform runs once. The first caller of Compute()
+// transforms, concurrent callers wait for it.
+class BowCache
+{
+public:
+    // Queues a job, e.g. on a thread pool
+    typedef std::function<void(const std::function<void()>&)> Submit;
+
+    void Compute(ORBVocabulary* pVocabulary, const cv::Mat &descriptors);
+
+    // Queues the transform through submit unless it was started already
+    static void ComputeAsync(const std::shared_ptr<BowCache> &pCache, ORBVocabulary* pVocabulary,
+                             const cv::Mat &descriptors, const Submit &submit);
+
+    DBoW2::BowVector mBowVec;
+    DBoW2::FeatureVector mFeatVec;
+    // Same as sorted arrays, for the merges of the matcher and the keyframe database
+    DBoW2::FlatBowVector mFlatBowVec;
+    DBoW2::FlatFeatureVector mFlatFeatVec;
+
+private:
+    std::once_flag mOnce;
+    std::atomic<bool> mbStarted{false};
+};
+
+// Keypoints of one image sorted by grid cell, in compressed rows. The keypoints of cell (i,j)
+// are the positions vCellStart[c] to vCellStart[c+1]-1, with c = i*FRAME_GRID_ROWS+j, so the
+// cells of a grid column are consecutive. Each position stores the keypoint index, its
+// coordinates and octave, and descriptors holds the keypoint descriptors in the same order.
+struct FrameGrid
+{
+    std::vector<int> vCellStart;
+    std::vector<size_t> vIndices;
+    std::vector<float> vX;
+    std::vector<float> vY;
+    std::vector<int> vOctave;
+    cv::Mat descriptors;
+
+    bool empty() const { return vCellStart.empty(); }
+    const size_t* CellBegin(const int i, const int j) const { return vIndices.data() + vCellStart[i*FRAME_GRID_ROWS+j]; }
+    const size_t* CellEnd(const int i, const int j) const { return vIndices.data() + vCellStart[i*FRAME_GRID_ROWS+j+1]; }
+};
+
+// Geometry of the local MapPoints of the tracking as a structure of arrays, so the frustum test
+// runs over contiguous floats. Position i holds the world position, normal and scale invariance
+// distances of vpMapPoints[i], read by Load() from the published copies of the points.
+struct LocalMapSnapshot
+{
+    std::vector<MapPoint*> vpMapPoints;
+    std::vector<float> vX, vY, vZ;
+    std::vector<float> vNx, vNy, vNz;
+    std::vector<float> vMinDistance, vMaxDistance;
+
+    // Sizes the arrays for vpMapPoints
+    void Resize();
+    // Reads the geometry of the points [i0,i1), one read per point
+    void Load(const size_t i0, const size_t i1);
+
+    size_t size() const { return vpMapPoints.size(); }
+};
 
 class Frame
 {
@@ -58,8 +124,18 @@ public:
     // Copy constructor.
     Frame(const Frame &frame);
 
-    // Constructor for stereo cameras.
-    Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, GeometricCamera* pCamera,Frame* pPrevF = static_cast<Frame*>(NULL), const IMU::Calib &ImuCalib = IMU::Calib());
+    // Copies like the copy constructor into the storage this frame already holds, so the
+    // last frame of the tracking reuses its buffers every frame. Descriptors are shared,
+    // they are not modified after extraction.
+    Frame& operator=(const Frame &frame);
+
+    // Hands over all buffers, for frames built as temporaries
+    Frame(Frame &&frame) = default;
+    Frame& operator=(Frame &&frame) = default;
+
+    // Constructor for stereo cameras. With pStereoDepth the pair is also densely matched on the GPU
+    // while the features are extracted, and the keypoint depths are read from its depth map.
+    Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, GeometricCamera* pCamera,Frame* pPrevF = static_cast<Frame*>(NULL), const IMU::Calib &ImuCalib = IMU::Calib(), StereoDepthGPU* pStereoDepth = nullptr);
 
     // Constructor for RGB-D cameras.
     Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, GeometricCamera* pCamera,Frame* pPrevF = static_cast<Frame*>(NULL), const IMU::Calib &ImuCalib = IMU::Calib());
@@ -76,6 +152,10 @@ public:
     // Compute Bag of Words representation.
     void ComputeBoW();
 
+    // Start the Bag of Words on another thread through submit, ComputeBoW() then waits for it
+    // if it is still running
+    void ComputeBoWAsync(const BowCache::Submit &submit);
+
     // Set the camera pose. (Imu pose is not modified!)
     void SetPose(const Sophus::SE3<float> &Tcw);
 
@@ -102,6 +182,12 @@ public:
     // and fill variables of the MapPoint to be used by the tracking
     bool isInFrustum(MapPoint* pMP, float viewingCosLimit);
 
+    // isInFrustum of the points [i0,i1) of a snapshot against every camera of the frame, vectorized
+    // over the snapshot arrays. Only the points that pass the depth, distance and viewing angle
+    // tests are projected, in batches through the camera model. vbInFrustum is indexed as the snapshot.
+    void isInFrustum(const LocalMapSnapshot &snapshot, const size_t i0, const size_t i1,
+                     float viewingCosLimit, char* vbInFrustum);
+
     bool ProjectPointDistort(MapPoint* pMP, cv::Point2f &kp, float &u, float &v);
 
     Eigen::Vector3f inRefCoordinates(Eigen::Vector3f pCw);
@@ -111,13 +197,24 @@ public:
 
     vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel=-1, const int maxLevel=-1, const bool bRight = false) const;
 
+    // Grid positions (see FrameGrid) of the keypoints in the area, in the order of GetFeaturesInArea.
+    // vPositions is cleared and refilled, so a caller reusing it does not allocate.
+    void GetGridPositionsInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, const bool bRight, vector<size_t> &vPositions) const;
+
     // Search a match for each keypoint in the left image to a keypoint in the right image.
     // If there is a match, depth is computed and the right coordinate associated to the left keypoint is stored.
     void ComputeStereoMatches();
 
+    // L1 distances between the 11x11 window of IL centred at (uL,v) and the windows of IR centred at
+    // (uR0+inc,v), for inc in [-5,5] stored at vDists[inc+5]. The caller checks that the windows are inside.
+    static void StereoWindowDistances(const cv::Mat &IL, const cv::Mat &IR, const int uL, const int uR0, const int v, float* vDists);
+
     // Associate a "right" coordinate to a keypoint if there is valid depth in the depthmap.
     void ComputeStereoFromRGBD(const cv::Mat &imDepth);
 
+    // Same from a depth map at 1/nScale of the image resolution (StereoDepthGPU).
+    void ComputeStereoFromDepthMap(const cv::Mat &imDepth, const int nScale);
+
     // Backprojects a keypoint (if stereo/depth info available) into 3D world coordinates.
     bool UnprojectStereo(const int &i, Eigen::Vector3f &x3D);
 
@@ -237,6 +334,10 @@ public:
     // Bag of Words Vector structures.
     DBoW2::BowVector mBowVec;
     DBoW2::FeatureVector mFeatVec;
+    DBoW2::FlatBowVector mFlatBowVec;
+    DBoW2::FlatFeatureVector mFlatFeatVec;
+    // Transform shared with the copies of the frame, created by the first ComputeBoW*()
+    std::shared_ptr<BowCache> mpBowCache;
 
     // ORB descriptor, each row associated to a keypoint.
     cv::Mat mDescriptors, mDescriptorsRight;
@@ -249,7 +350,7 @@ public:
     // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
     static float mfGridElementWidthInv;
     static float mfGridElementHeightInv;
-    std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+    FrameGrid mGrid;
 
     IMU::Bias mPredBias;
 
@@ -307,8 +408,8 @@ private:
 
     // Undistort keypoints given OpenCV distortion parameters.
     // Only for the RGB-D case. Stereo must be already rectified!
-    // (called in the constructor).
-    void UndistortKeyPoints();
+    // (called in the constructor, with the size of the image the keypoints are from).
+    void UndistortKeyPoints(const cv::Size &imageSize);
 
     // Computes image bounds for the undistorted image (called in the constructor).
     void ComputeImageBounds(const cv::Mat &imLeft);
@@ -316,6 +417,9 @@ private:
     // Assign keypoints to the grid for speed up feature matching (called in the constructor).
     void AssignFeaturesToGrid();
 
+    // Build grid from vKeys, whose descriptors are the rows of mDescriptors from nRowOffset.
+    void AssignFeaturesToGrid(FrameGrid &grid, const std::vector<cv::KeyPoint> &vKeys, const int nRowOffset);
+
     bool mbIsSet;
 
     bool mbImuPreintegrated;
@@ -341,7 +445,7 @@ public:
     std::vector<Eigen::Vector3f> mvStereo3Dpoints;
 
     //Grid for the right image
-    std::vector<std::size_t> mGridRight[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+    FrameGrid mGridRight;
 
     Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, GeometricCamera* pCamera, GeometricCamera* pCamera2, Sophus::SE3f& Tlr,Frame* pPrevF = static_cast<Frame*>(NULL), const IMU::Calib &ImuCalib = IMU::Calib());
 
@@ -350,6 +454,10 @@ public:
 
     bool isInFrustumChecks(MapPoint* pMP, float viewingCosLimit, bool bRight = false);
 
+    // Checks of isInFrustum after projecting P (Pc in camera coordinates, in front of it) to uv
+    bool isInFrustumProjected(MapPoint* pMP, const Eigen::Vector3f &P, const Eigen::Vector3f &Pc,
+                              const Eigen::Vector2f &uv, float viewingCosLimit);
+
     Eigen::Vector3f UnprojectStereoFishEye(const int &i);
 
     cv::Mat imgLeft, imgRight;
@@ -28,6 +28,7 @@
 #include<opencv2/features2d/features2d.hpp>
 
 #include<mutex>
+#include <atomic>
 #include <unordered_set>
 
 
@@ -46,6 +47,11 @@ public:
     // Update info from the last processed frame.
     void Update(Tracking *pTracker);
 
+    // Copy the frame every nFrames-th Update (1 every frame, the default). 0 disables the copies
+    // for headless tracking, a low rate is enough for a debug view.
+    void SetUpdateInterval(int nFrames);
+    int GetUpdateInterval() const;
+
     // Draw last processed frame.
     cv::Mat DrawFrame(float imageScale=1.f);
     cv::Mat DrawRightFrame(float imageScale=1.f);
@@ -74,6 +80,10 @@ protected:
     std::mutex mMutex;
     vector<pair<cv::Point2f, cv::Point2f> > mvTracks;
 
+    std::atomic<int> mnUpdateInterval;
+    // Only touched by the tracking thread
+    int mnFramesSinceUpdate;
+
     Frame mCurrentFrame;
     vector<MapPoint*> mvpLocalMap;
     vector<cv::KeyPoint> mvMatchedKeys;
@@ -492,6 +492,34 @@ public:
     const int cam_idx;
 };
 
+// Bias corrected deltas of a preintegration in double. The original deltas, bias and
+// Jacobians are copied at construction, so the inertial edges never take the mutex of the
+// preintegration, and the deltas are only corrected again when the bias changes
+// (computeError and linearizeOplus of one iteration share them).
+class PreintegratedDeltas
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    PreintegratedDeltas(IMU::Preintegrated* pInt);
+
+    void Update(const Eigen::Vector3d &bg, const Eigen::Vector3d &ba);
+
+    // Values for the bias of the last update
+    Eigen::Matrix3d dR;
+    Eigen::Vector3d dV, dP;
+    Eigen::Vector3d dbg;
+
+private:
+    Eigen::Matrix3d dR0;
+    Eigen::Vector3d dV0, dP0;
+    Eigen::Vector3d bg0, ba0;
+    Eigen::Matrix3d JRg, JVg, JPg, JVa, JPa;
+
+    bool mbUpdated;
+    Eigen::Vector3d bg, ba;
+};
+
 class EdgeInertial : public g2o::BaseMultiEdge<9,Vector9d>
 {
 public:
@@ -541,6 +569,9 @@ public:
     IMU::Preintegrated* mpInt;
     const double dt;
     Eigen::Vector3d g;
+
+protected:
+    PreintegratedDeltas mDeltas;
 };
 
 
@@ -565,6 +596,11 @@ public:
     const double dt;
     Eigen::Vector3d g, gI;
 
+protected:
+    PreintegratedDeltas mDeltas;
+
+public:
+
     Eigen::Matrix<double,27,27> GetHessian(){
         linearizeOplus();
         Eigen::Matrix<double,9,27> J;
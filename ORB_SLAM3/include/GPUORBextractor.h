@@ -0,0 +1,79 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef GPUORBEXTRACTOR_H
+#define GPUORBEXTRACTOR_H
+
+#include "ORBextractor.h"
+
+#include <memory>
+#include <mutex>
+
+namespace ORB_SLAM3
+{
+
+// ORBextractor running on the GPU (the Mali-G610 of the RK3588) with OpenCL. The pyramid, FAST
+// with its score, the feature selection, the orientation and rBRIEF run as compute kernels on
+// one in-order queue per extractor, so several extractors (one per camera) run concurrently.
+// The keypoints, descriptors and pyramid are written to host-visible buffers that are read in
+// place; mvImagePyramid points into them until the next extraction.
+//
+// The selection replaces the octree: corners are bucketed on a grid of about twice the
+// features of the level, the best corner of each bucket is kept and the strongest buckets up
+// to the feature count of the level are selected. As in ORBextractor, corners below iniThFAST
+// only count in the 35 pixel cells without a stronger one.
+//
+// Images that lie in a registered DMA-BUF are imported (cl_arm_import_memory) instead of
+// uploaded. Without HAVE_OPENCL, without a GPU, or for images the kernels do not take, the
+// CPU extraction of ORBextractor runs.
+class GPUORBextractor : public ORBextractor
+{
+public:
+    GPUORBextractor(int nfeatures, float scaleFactor, int nlevels,
+                    int iniThFAST, int minThFAST);
+
+    ~GPUORBextractor();
+
+    int operator()( cv::InputArray _image, cv::InputArray _mask,
+                    std::vector<cv::KeyPoint>& _keypoints,
+                    cv::OutputArray _descriptors, std::vector<int> &vLappingArea);
+
+    // Whether the extraction runs on the GPU
+    bool IsGPUAvailable() const;
+
+    // Register a DMA-BUF that images may lie in, e.g. the camera buffer a frame is mapped from.
+    // It is imported on first use. A buffer with the same fd or overlapping memory replaces the
+    // earlier one, which was unmapped. Returns false if it cannot be imported.
+    bool RegisterDmaBuffer(int fd, const void* data, size_t size);
+
+private:
+    // OpenCL objects and the buffers of the current image size, defined with HAVE_OPENCL
+    struct CLState;
+
+    bool InitializeCL();
+    bool AllocateLevels(const cv::Size &size);
+    bool ExtractGPU(const cv::Mat &image);
+
+    std::unique_ptr<CLState> mpCL;
+    std::mutex mMutexDmaBuffers;
+};
+
+} //namespace ORB_SLAM
+
+#endif // GPUORBEXTRACTOR_H
@@ -39,6 +39,13 @@ public:
     //Triangulate point with KF1 and KF2
     static bool Triangulate(Eigen::Vector3f &x_c1, Eigen::Vector3f &x_c2,Eigen::Matrix<float,3,4> &Tc1w ,Eigen::Matrix<float,3,4> &Tc2w , Eigen::Vector3f &x3D);
 
+    // Triangulate the n correspondences of the contiguous arrays x_c1 and x_c2 with KF1 and KF2.
+    // vbValid[i] is set when x3D[i] exists and, with bCheckDepth, is in front of both cameras.
+    // Returns the number of valid points
+    static int Triangulate(const Eigen::Vector3f* x_c1, const Eigen::Vector3f* x_c2, const size_t n,
+                           const Eigen::Matrix<float,3,4> &Tc1w, const Eigen::Matrix<float,3,4> &Tc2w,
+                           Eigen::Vector3f* x3D, unsigned char* vbValid, const bool bCheckDepth);
+
     template<int rows, int cols>
     static bool CheckMatrices(const cv::Mat &cvMat, const Eigen::Matrix<float,rows,cols> &eigMat) {
         const float epsilon = 1e-3;
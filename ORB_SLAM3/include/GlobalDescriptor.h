@@ -0,0 +1,124 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef GLOBALDESCRIPTOR_H
+#define GLOBALDESCRIPTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace ORB_SLAM3
+{
+
+class KeyFrame;
+class Map;
+
+// Whole-image descriptor of a frame for a coarse place recognition pass before the bag of
+// words. The SuperPoint descriptors of the image are aggregated into one vector of DIM
+// values: the mean of the signed bits (binary descriptors) or of the values (float ones),
+// square-rooted per dimension to damp the features repeated over the image, L2-normalized
+// and quantized to int8 (127 for 1).
+class GlobalDescriptor
+{
+public:
+    static const int DIM = 256;
+    // Similarity of a descriptor with itself, up to the rounding
+    static const int MAX_SIMILARITY = 127*127;
+
+    // Aggregates the local descriptors (32 CV_8U or 256 CV_32F columns) into pGlobal,
+    // false for other types or no descriptors
+    static bool Compute(const cv::Mat &descriptors, int8_t *pGlobal);
+
+    // Dot product of two descriptors, about MAX_SIMILARITY for equal ones
+    static int Similarity(const int8_t *a, const int8_t *b)
+    {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        int32x4_t s = vdupq_n_s32(0);
+        for(int i=0; i<DIM; i+=16)
+        {
+            const int8x16_t va = vld1q_s8(a+i);
+            const int8x16_t vb = vld1q_s8(b+i);
+            s = vpadalq_s16(s, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+            s = vpadalq_s16(s, vmull_high_s8(va, vb));
+        }
+        return vaddvq_s32(s);
+#elif defined(__AVX2__)
+        __m256i s = _mm256_setzero_si256();
+        for(int i=0; i<DIM; i+=16)
+        {
+            const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a+i)));
+            const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b+i)));
+            s = _mm256_add_epi32(s, _mm256_madd_epi16(va, vb));
+        }
+        __m128i s4 = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+        s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(1,0,3,2)));
+        s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(2,3,0,1)));
+        return _mm_cvtsi128_si32(s4);
+#else
+        int s = 0;
+        for(int i=0; i<DIM; i++)
+            s += a[i]*b[i];
+        return s;
+#endif
+    }
+};
+
+// Global descriptors of the keyframes of the KeyFrameDatabase, stored flat so a query
+// scans them in one pass. Thread-safe.
+class GlobalDescriptorIndex
+{
+public:
+    void add(KeyFrame* pKF, const int8_t *pGlobal);
+    void erase(KeyFrame* pKF);
+    void clear();
+    void clearMap(Map* pMap);
+
+    size_t size() const;
+
+    // The (at most) nCandidates indexed keyframes most similar to pQuery, most similar first
+    void Search(const int8_t *pQuery, size_t nCandidates, std::vector<KeyFrame*> &vpKFs) const;
+
+    size_t GetMemoryBytes() const;
+
+protected:
+    // Removes row idx moving the last row into it, with mMutex held
+    void EraseRow(size_t idx);
+
+    // DIM values per keyframe, row i belongs to mvpKeyFrames[i]
+    std::vector<int8_t> mvDescriptors;
+    std::vector<KeyFrame*> mvpKeyFrames;
+    std::unordered_map<KeyFrame*,size_t> mIndex;
+
+    mutable std::mutex mMutex;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // GLOBALDESCRIPTOR_H
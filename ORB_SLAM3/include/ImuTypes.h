@@ -30,6 +30,7 @@
 #include <mutex>
 
 #include "SerializationUtils.h"
+#include "SeqLock.h"
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/vector.hpp>
@@ -166,6 +167,8 @@ class Preintegrated
         ar & bu;
         ar & boost::serialization::make_array(db.data(), db.size());
         ar & mvMeasurements;
+
+        Publish();
     }
 
 public:
@@ -180,24 +183,26 @@ public:
     void Reintegrate();
     void MergePrevious(Preintegrated* pPrev);
     void SetNewBias(const Bias &bu_);
-    IMU::Bias GetDeltaBias(const Bias &b_);
 
-    Eigen::Matrix3f GetDeltaRotation(const Bias &b_);
-    Eigen::Vector3f GetDeltaVelocity(const Bias &b_);
-    Eigen::Vector3f GetDeltaPosition(const Bias &b_);
+    // The getters read the state published by the last writer and never lock
+    IMU::Bias GetDeltaBias(const Bias &b_) const;
+
+    Eigen::Matrix3f GetDeltaRotation(const Bias &b_) const;
+    Eigen::Vector3f GetDeltaVelocity(const Bias &b_) const;
+    Eigen::Vector3f GetDeltaPosition(const Bias &b_) const;
 
-    Eigen::Matrix3f GetUpdatedDeltaRotation();
-    Eigen::Vector3f GetUpdatedDeltaVelocity();
-    Eigen::Vector3f GetUpdatedDeltaPosition();
+    Eigen::Matrix3f GetUpdatedDeltaRotation() const;
+    Eigen::Vector3f GetUpdatedDeltaVelocity() const;
+    Eigen::Vector3f GetUpdatedDeltaPosition() const;
 
-    Eigen::Matrix3f GetOriginalDeltaRotation();
-    Eigen::Vector3f GetOriginalDeltaVelocity();
-    Eigen::Vector3f GetOriginalDeltaPosition();
+    Eigen::Matrix3f GetOriginalDeltaRotation() const;
+    Eigen::Vector3f GetOriginalDeltaVelocity() const;
+    Eigen::Vector3f GetOriginalDeltaPosition() const;
 
-    Eigen::Matrix<float,6,1> GetDeltaBias();
+    Eigen::Matrix<float,6,1> GetDeltaBias() const;
 
-    Bias GetOriginalBias();
-    Bias GetUpdatedBias();
+    Bias GetOriginalBias() const;
+    Bias GetUpdatedBias() const;
 
     void printMeasurements() const {
         std::cout << "pint meas:\n";
@@ -247,6 +252,28 @@ private:
 
     std::vector<integrable> mvMeasurements;
 
+    // Integration and reset without locking or publishing, for the writers
+    // that replay several measurements and publish once at the end
+    void Reset(const Bias &b_);
+    void Integrate(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const float &dt);
+
+    // Copy of the state the getters need: b, bu, db, dR, dV, dP and the bias
+    // jacobians. Writers hold mMutex and publish when they are done, so
+    // readers in the optimizer edges and in tracking only see complete
+    // integrations.
+    struct State
+    {
+        Bias b, bu;
+        Eigen::Matrix<float,6,1> db;
+        Eigen::Matrix3f dR;
+        Eigen::Vector3f dV, dP;
+        Eigen::Matrix3f JRg, JVg, JVa, JPg, JPa;
+    };
+    static const int kStateSize = 6+6+6+9+3+3+5*9;
+    void Publish();
+    State LoadState() const;
+    SeqLockArray<float,kStateSize> mState;
+
     std::mutex mMutex;
 };
 
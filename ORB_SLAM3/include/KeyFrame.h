@@ -31,8 +31,12 @@
 
 #include "GeometricCamera.h"
 #include "SerializationUtils.h"
+#include "PackedKeyPoints.h"
+#include "ProfiledMutex.h"
+#include "MemoryAccounting.h"
 
 #include <mutex>
+#include <atomic>
 
 #include <boost/serialization/base_object.hpp>
 #include <boost/serialization/vector.hpp>
@@ -125,7 +129,9 @@ class KeyFrame
         serializeVectorKeyPoints<Archive>(ar, mvKeysUn, version);
         ar & const_cast<vector<float>& >(mvuRight);
         ar & const_cast<vector<float>& >(mvDepth);
-        serializeMatrix<Archive>(ar,mDescriptors,version);
+        // The atlas file keeps the descriptors in their own table
+        if(bSerializeDescriptors)
+            serializeMatrix<Archive>(ar,mDescriptors,version);
         // BOW
         ar & mBowVec;
         ar & mFeatVec;
@@ -148,8 +154,11 @@ class KeyFrame
         serializeSophusSE3<Archive>(ar, mTcw, version);
         // MapPointsId associated to keypoints
         ar & mvBackupMapPointsId;
-        // Grid
-        ar & mGrid;
+        // Grid, a keyframe trimmed by the memory budget saves its grid empty
+        {
+            std::unique_lock<std::mutex> lock(mMutexGrid);
+            ar & mGrid;
+        }
         // Connected KeyFrameWeight
         ar & mBackupConnectedKeyFrameIdWeights;
         // Spanning Tree and Loop Edges
@@ -178,7 +187,10 @@ class KeyFrame
         ar & const_cast<int&>(NRight);
         serializeSophusSE3<Archive>(ar, mTlr, version);
         serializeVectorKeyPoints<Archive>(ar, mvKeysRight, version);
-        ar & mGridRight;
+        {
+            std::unique_lock<std::mutex> lock(mMutexGrid);
+            ar & mGridRight;
+        }
 
         // Inertial variables
         ar & mImuBias;
@@ -193,7 +205,13 @@ class KeyFrame
     }
 
 public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    // Allocated from the slab pool of a map, new(pMap) KeyFrame(...). Plain new, as used by
+    // boost::serialization, takes the pool shared by objects without a map
+    static void* operator new(size_t size, Map* pMap);
+    static void* operator new(size_t size);
+    static void operator delete(void* p, Map* pMap);
+    static void operator delete(void* p);
+
     KeyFrame();
     KeyFrame(Frame &F, Map* pMap, KeyFrameDatabase* pKFDB);
 
@@ -206,6 +224,11 @@ public:
     Sophus::SE3f GetPoseInverse();
     Eigen::Vector3f GetCameraCenter();
 
+    // Bumped from a global counter whenever a keyframe is created or its pose is set, the
+    // map renderer of the Viewer only uploads keyframes whose epoch changed
+    unsigned long GetPoseEpoch();
+    static unsigned long GetPoseEpochCounter();
+
     Eigen::Vector3f GetImuPosition();
     Eigen::Matrix3f GetImuRotation();
     Sophus::SE3f GetImuPose();
@@ -214,8 +237,11 @@ public:
     Eigen::Vector3f GetVelocity();
     bool isVelocitySet();
 
-    // Bag of Words Representation
+    // Bag of Words Representation, reusing the transform of the frame the keyframe was made from
     void ComputeBoW();
+    // Start the Bag of Words on another thread through submit before the keyframe is inserted,
+    // ComputeBoW() then waits for it
+    void ComputeBoWAsync(const BowCache::Submit &submit);
 
     // Covisibility graph functions
     void AddConnection(KeyFrame* pKF, const int &weight);
@@ -259,6 +285,15 @@ public:
 
     // KeyPoint functions
     std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r, const bool bRight = false) const;
+
+    // Frees the grid of a keyframe out of the local window, it is built again by the next
+    // GetFeaturesInArea. Returns the bytes released
+    size_t ReleaseGrid();
+
+    // Estimate of the memory held by the keyframe, for the memory budget of the atlas
+    size_t GetMemoryBytes();
+    // Same estimate, added to the breakdown by structure
+    void GetMemoryBreakdown(MemoryBreakdown &breakdown);
     bool UnprojectStereo(int i, Eigen::Vector3f &x3D);
 
     // Image
@@ -309,6 +344,8 @@ public:
 public:
 
     static long unsigned int nNextId;
+    // Whether the descriptors are archived with the keyframe, per thread
+    static thread_local bool bSerializeDescriptors;
     long unsigned int mnId;
     const long unsigned int mnFrameId;
 
@@ -378,8 +415,9 @@ public:
     const int N;
 
     // KeyPoints, stereo coordinate and descriptors (all associated by an index)
-    const std::vector<cv::KeyPoint> mvKeys;
-    const std::vector<cv::KeyPoint> mvKeysUn;
+    // Packed, 8 bytes per keypoint
+    const PackedKeyPoints mvKeys;
+    const PackedKeyPoints mvKeysUn;
     const std::vector<float> mvuRight; // negative value for monocular points
     const std::vector<float> mvDepth; // negative value for monocular points
     const cv::Mat mDescriptors;
@@ -387,6 +425,11 @@ public:
     //BoW
     DBoW2::BowVector mBowVec;
     DBoW2::FeatureVector mFeatVec;
+    // Same as sorted arrays, rebuilt from the maps after loading
+    DBoW2::FlatBowVector mFlatBowVec;
+    DBoW2::FlatFeatureVector mFlatFeatVec;
+    // Transform shared with the frame until ComputeBoW() took its result
+    std::shared_ptr<BowCache> mpBowCache;
 
     // Pose relative to parent (this is computed when bad flag is activated)
     Sophus::SE3f mTcp;
@@ -454,12 +497,17 @@ protected:
     KeyFrameDatabase* mpKeyFrameDB;
     ORBVocabulary* mpORBvocabulary;
 
-    // Grid over the image to speed up feature matching
-    std::vector< std::vector <std::vector<size_t> > > mGrid;
+    // Grid over the image to speed up feature matching, empty while released
+    mutable std::vector< std::vector <std::vector<size_t> > > mGrid;
 
     std::map<KeyFrame*,int> mConnectedKeyFrameWeights;
     std::vector<KeyFrame*> mvpOrderedConnectedKeyFrames;
     std::vector<int> mvOrderedWeights;
+    // UpdateConnections only orders the connections over the threshold, the first change
+    // after it sorts all of them again and later ones move a single entry in place
+    bool mbOrderedAllConnections;
+    void EraseOrderedConnection(KeyFrame* pKF);
+    void InsertOrderedConnection(KeyFrame* pKF, const int weight);
     // For save relation without pointer, this is necessary for save/load function
     std::map<long unsigned int, int> mBackupConnectedKeyFrameIdWeights;
 
@@ -495,11 +543,19 @@ protected:
     // Calibration
     Eigen::Matrix3f mK_;
 
+    static std::atomic<unsigned long> nPoseEpoch;
+    std::atomic<unsigned long> mnPoseEpoch{++nPoseEpoch};
+
     // Mutex
-    std::mutex mMutexPose; // for pose, velocity and biases
-    std::mutex mMutexConnections;
-    std::mutex mMutexFeatures;
-    std::mutex mMutexMap;
+    ProfiledMutex mMutexPose{"KeyFrame::mMutexPose"}; // for pose, velocity and biases
+    ProfiledMutex mMutexConnections{"KeyFrame::mMutexConnections"};
+    ProfiledMutex mMutexFeatures{"KeyFrame::mMutexFeatures"};
+    ProfiledMutex mMutexMap{"KeyFrame::mMutexMap"};
+    mutable std::mutex mMutexGrid;
+
+    // Fills the grids from the keypoints, with mMutexGrid held
+    void BuildGrid() const;
+    void AssignKeysToGrid(const PackedKeyPoints &vKeys, std::vector< std::vector <std::vector<size_t> > > &grid) const;
 
 public:
     GeometricCamera* mpCamera, *mpCamera2;
@@ -511,11 +567,11 @@ public:
     Sophus::SE3f GetRelativePoseTlr();
 
     //KeyPoints in the right image (for stereo fisheye, coordinates are needed)
-    const std::vector<cv::KeyPoint> mvKeysRight;
+    const PackedKeyPoints mvKeysRight;
 
     const int NLeft, NRight;
 
-    std::vector< std::vector <std::vector<size_t> > > mGridRight;
+    mutable std::vector< std::vector <std::vector<size_t> > > mGridRight;
 
     Sophus::SE3<float> GetRightPose();
     Sophus::SE3<float> GetRightPoseInverse();
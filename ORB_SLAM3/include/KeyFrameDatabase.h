@@ -23,11 +23,15 @@
 #include <vector>
 #include <list>
 #include <set>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
 
 #include "KeyFrame.h"
 #include "Frame.h"
 #include "ORBVocabulary.h"
 #include "Map.h"
+#include "GlobalDescriptor.h"
 
 #include <boost/serialization/base_object.hpp>
 #include <boost/serialization/vector.hpp>
@@ -57,10 +61,12 @@ class KeyFrameDatabase
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    KeyFrameDatabase(){}
+    KeyFrameDatabase():mpVoc(NULL), mbL1Score(false), mnPostingLists(0), mnPostings(0), mnGlobalCandidates(0), mnGlobalMinKeyFrames(0){}
     KeyFrameDatabase(const ORBVocabulary &voc);
 
     void add(KeyFrame* pKF);
+    // Adds the keyframes copying each posting list once, used when a map is loaded
+    void add(const std::vector<KeyFrame*> &vpKFs);
 
     void erase(KeyFrame* pKF);
 
@@ -76,24 +82,105 @@ public:
     void DetectNBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &vpLoopCand, vector<KeyFrame*> &vpMergeCand, int nNumCandidates);
 
     // Relocalization
-    std::vector<KeyFrame*> DetectRelocalizationCandidates(Frame* F, Map* pMap);
+    // Camera centers a relocalization can come from when the pose is roughly known: within a
+    // squared Mahalanobis distance chi2 of center, for the inverse covariance information
+    struct SearchRegion
+    {
+        Eigen::Vector3f center;
+        Eigen::Matrix3f information;
+        float chi2;
+
+        bool Contains(const Eigen::Vector3f &x) const
+        {
+            const Eigen::Vector3f d = x - center;
+            return d.dot(information * d) <= chi2;
+        }
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    // With a region, keyframes outside it are neither scored nor returned
+    std::vector<KeyFrame*> DetectRelocalizationCandidates(Frame* F, Map* pMap, const SearchRegion* pRegion=NULL);
+
+    // Relocalization candidates of all the maps of the atlas from one query, grouped by map.
+    // The maps are ranked by their best score; each keeps its keyframes scoring above 0.75 of
+    // that best, at most nMaxCandidates, best first. Bad maps are skipped.
+    struct MapCandidates
+    {
+        Map* pMap;
+        float score;
+        std::vector<KeyFrame*> vpKeyFrames;
+    };
+    std::vector<MapCandidates> DetectRelocalizationCandidatesByMap(Frame* F, size_t nMaxCandidates);
 
     void PreSave();
     void PostLoad(map<long unsigned int, KeyFrame*> mpKFid);
     void SetORBVocabulary(ORBVocabulary* pORBVoc);
 
+    // With nCandidates>0 the keyframes are also indexed by their global descriptor, and once
+    // nMinKeyFrames are indexed the loop, merge and relocalization queries only score the
+    // nCandidates keyframes with the most similar global descriptors instead of walking the
+    // inverted file. Set before keyframes are added.
+    void SetGlobalPrefilter(int nCandidates, int nMinKeyFrames);
+
+    // Estimate of the memory held by the inverted file
+    size_t GetMemoryBytes() const;
+
 protected:
 
+   // Keyframes observing a word and the tf-idf weight of the word in each of them
+   struct PostingList
+   {
+       std::vector<KeyFrame*> vpKeyFrames;
+       std::vector<double> vWeights;
+   };
+
+   // Keyframes sharing words with a query, filled per query so concurrent queries do not write on the keyframes
+   struct SharingWords
+   {
+       std::vector<KeyFrame*> vpKeyFrames;
+       std::vector<int> vnCommonWords;
+       std::vector<double> vL1Sum;
+       std::unordered_map<KeyFrame*,size_t> mIndex;
+
+       int find(KeyFrame* pKF) const
+       {
+           std::unordered_map<KeyFrame*,size_t>::const_iterator it = mIndex.find(pKF);
+           return it==mIndex.end() ? -1 : (int)it->second;
+       }
+   };
+
+   // Swaps the posting list of a word, with mMutex held
+   void Publish(size_t nWordId, const std::shared_ptr<const PostingList> &pPosting);
+
+   void SearchSharingWords(const DBoW2::FlatBowVector &vBowVec, SharingWords &sharing) const;
+   // Same for the given keyframes only, comparing their bag of words with the query
+   void SearchSharingWords(const DBoW2::FlatBowVector &vBowVec, const std::vector<KeyFrame*> &vpKFs, const KeyFrame* pQueryKF, SharingWords &sharing) const;
+   // Keyframes preselected by the global descriptor of the query descriptors, false when the prefilter is off
+   bool SearchGlobalCandidates(const cv::Mat &descriptors, std::vector<KeyFrame*> &vpKFs) const;
+   float Score(const DBoW2::BowVector &vBowVec, const SharingWords &sharing, const size_t idx) const;
+   // Relocalization scores accumulated over the covisibility of each scored keyframe, with the
+   // best keyframe of its neighbourhood
+   void ScoreRelocalizationCandidates(Frame* F, const SearchRegion* pRegion, std::list<std::pair<float,KeyFrame*> > &lAccScoreAndMatch);
+
    // Associated vocabulary
    const ORBVocabulary* mpVoc;
+   bool mbL1Score;
+
+   // Inverted file. Posting lists are never modified once published: add/erase build a new list and swap it
+   // atomically, so queries only take a snapshot of each list and never wait on mMutex. Null means empty.
+   std::vector<std::shared_ptr<const PostingList> > mvInvertedFile;
+   // Published lists and their postings, for GetMemoryBytes without walking the vocabulary
+   std::atomic<size_t> mnPostingLists;
+   std::atomic<size_t> mnPostings;
 
-   // Inverted file
-   std::vector<list<KeyFrame*> > mvInvertedFile;
+   // Global descriptors of the keyframes and the prefilter parameters
+   GlobalDescriptorIndex mGlobalIndex;
+   int mnGlobalCandidates;
+   size_t mnGlobalMinKeyFrames;
 
    // For save relation without pointer, this is necessary for save/load function
    std::vector<list<long unsigned int> > mvBackupInvertedFileId;
 
-   // Mutex
+   // Mutex, serializes the writers of the inverted file
    std::mutex mMutex;
 
 };
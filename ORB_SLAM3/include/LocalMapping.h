@@ -26,8 +26,11 @@
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
 #include "Settings.h"
+#include "ORBmatcher.h"
+#include "ProfiledMutex.h"
 
 #include <mutex>
+#include <thread>
 
 
 namespace ORB_SLAM3
@@ -66,13 +69,61 @@ public:
     void SetAcceptKeyFrames(bool flag);
     bool SetNotStop(bool flag);
 
+    // Keyframes queued while local mapping is busy are processed together, up to n per iteration:
+    // each one is added to the map and triangulated, then the fusion, one local BA and the culling
+    // cover all of them. Only a full batch in the queue interrupts the BA (1, the default, processes
+    // one keyframe at a time and every new keyframe interrupts the BA).
+    void SetKeyFrameBatchSize(int n);
+    int GetKeyFrameBatchSize();
+
+    // Backpressure for tracking: more keyframes are queued than local mapping keeps up with, at
+    // least the batch size and 3. Tracking then only inserts the keyframes it cannot do without.
+    bool IsBacklogged();
+
+    // Off when mapping a recording offline: new keyframes and tracking no longer interrupt the
+    // local BA, every BA runs to its end and keyframes wait in the queue. Stop and reset requests
+    // still abort it. On by default.
+    void SetRealTime(bool bRealTime);
+    bool IsRealTime();
+
+    // Maximum number of covisible keyframes optimized by the visual local BA (0 for all)
+    void SetMaxLocalBAKeyFrames(int n);
+    int GetMaxLocalBAKeyFrames();
+
+    // Threads used by the local BA to linearize the edges and build the Schur complement
+    void SetLocalBAThreads(int n);
+    int GetLocalBAThreads();
+
+    // Wall time in ms a local BA may take (0 for no limit) and the relative chi2 gain of an
+    // iteration below which it stops early (0 to keep the iteration count)
+    void SetLocalBATermination(float fTimeBudget, float fGainThreshold);
+    void GetLocalBATermination(float &fTimeBudget, float &fGainThreshold);
+
+    // Smoothed wall time in ms of an iteration per keyframe of its batch and of a local BA, 0
+    // until measured. Tracking weighs the cost of a new keyframe with them.
+    void GetMappingCost(float &fKeyFrameMs, float &fLocalBAMs);
+
+    // Runs the full inertial BA of the IMU initialization in its own thread while mapping
+    // continues, the map is corrected once it finishes
+    void SetBackgroundInertialBA(bool bBackground);
+    bool GetBackgroundInertialBA();
+
+    // Matches and triangulates the neighbor keyframes of CreateNewMapPoints and checks the
+    // MapPoints and keyframes to cull in parallel, e.g. on a pool shared with tracking.
+    // An empty function restores the serial loops.
+    void SetParallelFor(const ORBmatcher::ParallelFor& parallelFor);
+
+    // Incremented before and after local mapping changes keyframes, MapPoints or their
+    // observations. Tracking keeps its local map while the version is unchanged.
+    unsigned long GetMapVersion();
+
     void InterruptBA();
 
     void RequestFinish();
     bool isFinished();
 
     int KeyframesInQueue(){
-        unique_lock<std::mutex> lock(mMutexNewKFs);
+        unique_lock<ProfiledMutex> lock(mMutexNewKFs);
         return mlNewKeyFrames.size();
     }
 
@@ -132,12 +183,30 @@ public:
 protected:
 
     bool CheckNewKeyFrames();
+    // A full batch waits in the queue, the current one stops its optional steps
+    bool CheckKeyFrameBatch();
     void ProcessNewKeyFrame();
     void CreateNewMapPoints();
 
+    // A match of the current keyframe with a neighbor that passed the triangulation checks
+    struct NewMapPointCandidate
+    {
+        size_t idx1;
+        size_t idx2;
+        Eigen::Vector3f x3D;
+    };
+    // Matches and triangulates the current keyframe with pKF2, without changing the map
+    void TriangulateWithNeighbor(KeyFrame* pKF2, const bool bCoarse, std::vector<NewMapPointCandidate> &vCandidates);
+
     void MapPointCulling();
     void SearchInNeighbors();
     void KeyFrameCulling();
+    // Counts in nMPs the MapPoints of pKF checked for culling (the close ones for stereo) and
+    // returns how many are seen by more than 3 other keyframes at a similar or finer scale
+    int CountRedundantObservations(KeyFrame* pKF, int &nMPs);
+
+    // Runs job(0) ... job(n-1) through mParallelFor, or inline if it is not set
+    void RunParallel(int n, const std::function<void(int)>& job);
 
     System *mpSystem;
 
@@ -167,9 +236,11 @@ protected:
 
     std::list<MapPoint*> mlpRecentAddedMapPoints;
 
-    std::mutex mMutexNewKFs;
+    ProfiledMutex mMutexNewKFs{"LocalMapping::mMutexNewKFs"};
 
     bool mbAbortBA;
+    int mnKeyFrameBatch;
+    bool mbRealTime;
 
     bool mbStopped;
     bool mbStopRequested;
@@ -179,9 +250,51 @@ protected:
     bool mbAcceptKeyFrames;
     std::mutex mMutexAccept;
 
+    int mnMaxLocalBAKeyFrames;
+    int mnLocalBAThreads;
+    float mfLocalBATimeBudget;
+    float mfLocalBAGainThreshold;
+    float mfKeyFrameCostMs;
+    float mfLocalBAMs;
+    std::mutex mMutexLocalBA;
+
+    ORBmatcher::ParallelFor mParallelFor;
+    std::mutex mMutexParallelFor;
+
+    void IncreaseMapVersion();
+    unsigned long mnMapVersion;
+    std::mutex mMutexMapVersion;
+
     void InitializeIMU(float priorG = 1e2, float priorA = 1e6, bool bFirst = false);
     void ScaleRefinement();
 
+    // Applies the poses, velocities, biases and positions of a full inertial BA up to GBAid
+    void CorrectMapWithFullInertialBA(Map* pMap, unsigned long GBAid);
+
+    void StartFullInertialBA(Map* pMap, float priorG, float priorA);
+    void RunFullInertialBA(Map* pMap, unsigned long nFIBAid, float priorG, float priorA);
+    void StopFullInertialBA();
+    void MergeFullInertialBA();
+
+    // Deletes culled map points once no thread can hold them anymore
+    void ReclaimMapPoints();
+
+    // Folds the times of an iteration into the mapping cost (tLocalBA < 0 without a BA)
+    void UpdateMappingCost(const double tKeyFrame, const double tLocalBA);
+
+    // Releases the grid of the keyframes leaving the local window, after adding the new ones
+    void ReleaseKeyFrameScratch(const vector<KeyFrame*> &vpNewKFs);
+    static const size_t kLocalWindowKeyFrames = 40;
+    std::list<KeyFrame*> mlpWindowKeyFrames;
+
+    bool mbBackgroundInertialBA;
+    std::thread* mpThreadFIBA;
+    bool mbStopFIBA;
+    bool mbFinishedFIBA;
+    unsigned long mnFIBAid;
+    Map* mpFIBAMap;
+    std::mutex mMutexFIBA;
+
     bool bInitializing;
 
     Eigen::MatrixXd infoInertial;
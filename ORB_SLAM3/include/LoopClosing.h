@@ -27,6 +27,8 @@
 #include "Tracking.h"
 
 #include "KeyFrameDatabase.h"
+#include "ProfiledMutex.h"
+#include "RemoteBackend.h"
 
 #include <boost/algorithm/string.hpp>
 #include <thread>
@@ -78,6 +80,32 @@ public:
         return mbFinishedGBA;
     }   
 
+    // Optimize the essential graph of a loop while Local Mapping keeps running, the map is only stopped to fuse
+    // the loop and to apply the optimized poses
+    void SetAsyncLoopCorrection(bool bAsync);
+    bool GetAsyncLoopCorrection();
+    bool isCorrectingLoop();
+
+    // Threads used by the essential graph optimization of a loop to linearize the edges
+    void SetEssentialGraphThreads(int n);
+    int GetEssentialGraphThreads();
+
+    // Reoptimize only the keyframes moved by the loop corrections since the last finished Global BA, an aborted
+    // Global BA leaves its keyframes pending for the next one
+    void SetIncrementalGBA(bool bIncremental);
+
+    // Solves the whole-map visual Global BA on a remote back end when it is reachable, locally otherwise
+    void SetRemoteBackend(RemoteBackend* pRemoteBackend);
+
+    // Verifies the BoW loop and merge candidates through parallelFor, serially if it is empty
+    void SetParallelFor(const ORBmatcher::ParallelFor& parallelFor);
+
+    // Parks the loop closing between keyframes, isHeld once no loop correction nor Global BA is in flight,
+    // so the map can be read consistently with Local Mapping stopped
+    void RequestHold();
+    bool isHeld();
+    void ReleaseHold();
+
     void RequestFinish();
 
     bool isFinished();
@@ -127,6 +155,11 @@ protected:
                                         std::vector<MapPoint*> &vpMPs, std::vector<MapPoint*> &vpMatchedMPs);
     bool DetectCommonRegionsFromBoW(std::vector<KeyFrame*> &vpBowCand, KeyFrame* &pMatchedKF, KeyFrame* &pLastCurrentKF, g2o::Sim3 &g2oScw,
                                      int &nNumCoincidences, std::vector<MapPoint*> &vpMPs, std::vector<MapPoint*> &vpMatchedMPs);
+    // Geometric check of one BoW candidate, only reads the map so the candidates can be verified concurrently.
+    // Returns true if the candidate has enough matches with the optimized Sim3, nNumKFs are the current covisibles confirming it
+    bool VerifyBoWCandidate(KeyFrame* pKFi, const set<KeyFrame*> &spConnectedKeyFrames, KeyFrame* &pMostBoWMatchesKF,
+                            g2o::Sim3 &gScw, int &nNumProjOptMatches, int &nNumKFs,
+                            std::vector<MapPoint*> &vpMapPoints, std::vector<MapPoint*> &vpMatchedMP);
     bool DetectCommonRegionsFromLastKF(KeyFrame* pCurrentKF, KeyFrame* pMatchedKF, g2o::Sim3 &gScw, int &nNumProjMatches,
                                             std::vector<MapPoint*> &vpMPs, std::vector<MapPoint*> &vpMatchedMPs);
     int FindMatchesByProjection(KeyFrame* pCurrentKF, KeyFrame* pMatchedKFw, g2o::Sim3 &g2oScw,
@@ -136,14 +169,24 @@ protected:
 
     void SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap, vector<MapPoint*> &vpMapPoints);
     void SearchAndFuse(const vector<KeyFrame*> &vConectedKFs, vector<MapPoint*> &vpMapPoints);
+    // Matches the points in each keyframe in parallel, then applies the replacements in keyframe order
+    void FuseInKeyFrames(const vector<KeyFrame*> &vpKFs, vector<Sophus::Sim3f> &vScw, vector<MapPoint*> &vpMapPoints);
 
     void CorrectLoop();
+    void ApplyLoopCorrection(Map* pMap, KeyFrameAndPose &LoopCorrections);
+    void AddGBAPendingKeyFrames(Map* pMap, const map<KeyFrame*,Sophus::SE3f> &mPosesBefCorrection);
 
     void MergeLocal();
     void MergeLocal2();
 
     void CheckObservations(set<KeyFrame*> &spKFsMap1, set<KeyFrame*> &spKFsMap2);
 
+    // Moves the keyframes and map points to pDstMap, with one batched update of each map
+    void MoveToMap(Map* pSrcMap, Map* pDstMap, const vector<KeyFrame*> &vpKFs, const vector<MapPoint*> &vpMPs);
+
+    // Runs job(0) ... job(n-1) through mParallelFor, or inline if it is not set
+    void RunParallel(int n, const std::function<void(int)>& job);
+
     void ResetIfRequested();
     bool mbResetRequested;
     bool mbResetActiveMapRequested;
@@ -156,6 +199,11 @@ protected:
     bool mbFinished;
     std::mutex mMutexFinish;
 
+    bool CheckHold();
+    bool mbHoldRequested;
+    bool mbHeld;
+    std::mutex mMutexHold;
+
     Atlas* mpAtlas;
     Tracking* mpTracker;
 
@@ -166,7 +214,7 @@ protected:
 
     std::list<KeyFrame*> mlpLoopKeyFrameQueue;
 
-    std::mutex mMutexLoopQueue;
+    ProfiledMutex mMutexLoopQueue{"LoopClosing::mMutexLoopQueue"};
 
     // Loop detector parameters
     float mnCovisibilityConsistencyTh;
@@ -219,11 +267,27 @@ protected:
     std::mutex mMutexGBA;
     std::thread* mpThreadGBA;
 
+    // Keyframes to reoptimize in the next Global BA, protected by mMutexGBA
+    bool mbIncrementalGBA;
+    std::set<KeyFrame*> mspGBAPendingKFs;
+
+    // Remote back end of the Global BA, optional
+    RemoteBackend* mpRemoteBackend;
+
     // Fix scale in the stereo/RGB-D case
     bool mbFixScale;
 
+    // Asynchronous loop correction, mbCorrectingLoop is set while the essential graph is optimized with Local Mapping running
+    bool mbAsyncLoopCorrection;
+    bool mbCorrectingLoop;
+    int mnEssentialGraphThreads;
+    std::mutex mMutexLoopCorrection;
+
+    ORBmatcher::ParallelFor mParallelFor;
+    std::mutex mMutexParallelFor;
+
 
-    bool mnFullBAIdx;
+    int mnFullBAIdx;
 
 
 
@@ -71,6 +71,10 @@ namespace ORB_SLAM3{
 
         bool iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers, Eigen::Matrix4f &Tout);
 
+        // Inlier count of the best hypothesis and iterations run so far, for preemptive scoring
+        int GetBestInliers() const { return mnBestInliers; }
+        int GetIterations() const { return mnIterations; }
+
         //Type definitions needed by the original code
 
         /** A 3-vector of unit length used to describe landmark observations/bearings
@@ -225,6 +229,12 @@ namespace ORB_SLAM3{
         // Indices for random selection [0 .. N-1]
         vector<size_t> mvAllIndices;
 
+        // Minimal set drawn by each iteration
+        vector<size_t> mvAvailableIndices;
+        bearingVectors_t mvMinSetBearings;
+        points_t mvMinSetPoints;
+        vector<int> mvMinSetIndices;
+
         // RANSAC probability
         double mRansacProb;
 
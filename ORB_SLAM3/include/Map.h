@@ -22,7 +22,14 @@
 
 #include "MapPoint.h"
 #include "KeyFrame.h"
-
+#include "MapObjectPool.h"
+#include "DescriptorArena.h"
+#include "ProfiledMutex.h"
+#include "MemoryAccounting.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <set>
 #include <pangolin/pangolin.h>
 #include <mutex>
@@ -77,10 +84,25 @@ public:
     void AddMapPoint(MapPoint* pMP);
     void EraseMapPoint(MapPoint* pMP);
     void EraseKeyFrame(KeyFrame* pKF);
+
+    // Batched versions, the map is locked once, e.g. to move the elements of a map into another one
+    void AddKeyFrames(const std::vector<KeyFrame*> &vpKFs);
+    void AddMapPoints(const std::vector<MapPoint*> &vpMPs);
+    void EraseKeyFrames(const std::vector<KeyFrame*> &vpKFs);
+    void EraseMapPoints(const std::vector<MapPoint*> &vpMPs);
     void SetReferenceMapPoints(const std::vector<MapPoint*> &vpMPs);
     void InformNewBigChange();
     int GetLastBigChangeIdx();
 
+    // Immutable views of the map, shared by every reader until the map changes.
+    // They are iterated without the map lock, and a map point culled after the
+    // snapshot was taken is not deleted while the snapshot is alive
+    typedef std::shared_ptr<const std::vector<MapPoint*> > MapPointSnapshot;
+    typedef std::shared_ptr<const std::vector<KeyFrame*> > KeyFrameSnapshot;
+    MapPointSnapshot GetMapPointsSnapshot();
+    KeyFrameSnapshot GetKeyFramesSnapshot();
+
+    // Copies of the snapshots, for callers that modify the vector
     std::vector<KeyFrame*> GetAllKeyFrames();
     std::vector<MapPoint*> GetAllMapPoints();
     std::vector<MapPoint*> GetReferenceMapPoints();
@@ -128,20 +150,40 @@ public:
     bool CheckEssentialGraph();
     void ChangeId(long unsigned int nId);
 
+    // Slab pools the map points and keyframes of this map are allocated from
+    MapObjectPool<MapPoint>* GetMapPointPool();
+    MapObjectPool<KeyFrame>* GetKeyFramePool();
+
+    // Contiguous store of the descriptors of the map points of this map
+    DescriptorArena* GetDescriptorArena();
+
+    // Estimate of the memory held by the keyframes and map points of this map
+    size_t GetMemoryBytes();
+    void GetMemoryBreakdown(MemoryBreakdown &breakdown);
+
+    // Deletes the map points culled at least kReclaimGraceFrames tracked frames
+    // ago and not in a live snapshot, to be called at a safe point of the thread culling them
+    size_t ReclaimMapPoints();
+
+    // Called by tracking once per frame, it ages the culled map points
+    static void NotifyTrackedFrame();
+
     unsigned int GetLowerKFID();
 
     void PreSave(std::set<GeometricCamera*> &spCams);
     void PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long unsigned int, KeyFrame*>& mpKeyFrameId*/, map<unsigned int, GeometricCamera*> &mpCams);
+    // Exchanges the saved keyframes and map points, the atlas file stores them apart from the map
+    void SwapBackupData(std::vector<KeyFrame*> &vpKFs, std::vector<MapPoint*> &vpMPs);
 
     void printReprojectionError(list<KeyFrame*> &lpLocalWindowKFs, KeyFrame* mpCurrentKF, string &name, string &name_folder);
 
     vector<KeyFrame*> mvpKeyFrameOrigins;
     vector<unsigned long int> mvBackupKeyFrameOriginsId;
     KeyFrame* mpFirstRegionKF;
-    std::mutex mMutexMapUpdate;
+    ProfiledMutex mMutexMapUpdate{"Map::mMutexMapUpdate"};
 
     // This avoid that two points are created simultaneously in separate threads (id conflict)
-    std::mutex mMutexPointCreation;
+    ProfiledMutex mMutexPointCreation{"Map::mMutexPointCreation"};
 
     bool mbFail;
 
@@ -151,6 +193,11 @@ public:
 
     static long unsigned int nNextId;
 
+    // Frames a culled map point waits before it is deleted. Tracking drops unobserved points from
+    // its frames after one frame, and the local mapping and loop closing lists are refreshed
+    // at every keyframe, the margin covers the threads that copy map point vectors
+    static const unsigned long kReclaimGraceFrames = 30;
+
     // DEBUG: show KFs which are used in LBA
     std::set<long unsigned int> msOptKFs;
     std::set<long unsigned int> msFixedKFs;
@@ -172,7 +219,37 @@ protected:
     unsigned long int mnBackupKFinitialID;
     unsigned long int mnBackupKFlowerID;
 
-    std::vector<MapPoint*> mvpReferenceMapPoints;
+    // Published by tracking and read by the viewer, the handles drop points reclaimed since
+    std::vector<MapObjectPool<MapPoint>::Handle> mvReferenceMapPoints;
+
+    MapObjectPool<MapPoint>* mpMapPointPool;
+    MapObjectPool<KeyFrame>* mpKeyFramePool;
+    DescriptorArena* mpDescriptorArena;
+
+    // Current snapshots, built by the first reader after a change. The epoch counts the
+    // changes of the map point set, and the snapshots handed out are kept as weak
+    // references with the epoch they were built at
+    MapPointSnapshot mpMapPointsSnapshot;
+    KeyFrameSnapshot mpKeyFramesSnapshot;
+    unsigned long mnMapPointsEpoch;
+    std::deque<std::pair<unsigned long, std::weak_ptr<const std::vector<MapPoint*> > > > mdMapPointSnapshots;
+
+    // Called with mMutexMap held when the sets change
+    void InvalidateMapPointsSnapshot();
+    void InvalidateKeyFramesSnapshot();
+
+    // Culled map points with the tracked frame count when they were culled
+    // and the epoch of the map point set after they were erased
+    struct RetiredMapPoint
+    {
+        MapPoint* pMP;
+        unsigned long nFrame;
+        unsigned long nEpoch;
+    };
+    std::deque<RetiredMapPoint> mdRetiredMapPoints;
+    std::mutex mMutexRetired;
+
+    static std::atomic<unsigned long> nTrackedFrames;
 
     bool mbImuInitialized;
 
@@ -199,7 +276,7 @@ protected:
     bool mbIMU_BA2;
 
     // Mutex
-    std::mutex mMutexMap;
+    ProfiledMutex mMutexMap{"Map::mMutexMap"};
 
 };
 
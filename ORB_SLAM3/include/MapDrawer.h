@@ -24,9 +24,11 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include "Settings.h"
+#include "MapRenderer.h"
 #include<pangolin/pangolin.h>
 
 #include<mutex>
+#include<atomic>
 
 namespace ORB_SLAM3
 {
@@ -47,6 +49,9 @@ public:
     void DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const bool bDrawInertialGraph, const bool bDrawOptLba);
     void DrawCurrentCamera(pangolin::OpenGlMatrix &Twc);
     void SetCurrentCameraPose(const Sophus::SE3f &Tcw);
+    // Disabled for headless tracking, the camera pose is then not updated
+    void SetUpdateEnabled(bool bEnabled);
+    bool IsUpdateEnabled() const;
     void SetReferenceKeyFrame(KeyFrame *pKF);
     void GetCurrentOpenGLCameraMatrix(pangolin::OpenGlMatrix &M, pangolin::OpenGlMatrix &MOw);
 
@@ -54,6 +59,9 @@ private:
 
     bool ParseViewerParamFile(cv::FileStorage &fSettings);
 
+    // Created by the first draw, on the Viewer thread that owns the GL context
+    MapRenderer* GetRenderer();
+
     float mKeyFrameSize;
     float mKeyFrameLineWidth;
     float mGraphLineWidth;
@@ -61,9 +69,14 @@ private:
     float mCameraSize;
     float mCameraLineWidth;
 
+    // Map buffers refreshed this many times per second, 0 draws in immediate mode
+    float mfMapUpdateRate;
+    MapRenderer* mpRenderer;
+
     Sophus::SE3f mCameraPose;
 
     std::mutex mMutexCamera;
+    std::atomic<bool> mbUpdateEnabled;
 
     float mfFrameColors[6][3] = {{0.0f, 0.0f, 1.0f},
                                 {0.8f, 0.4f, 1.0f},
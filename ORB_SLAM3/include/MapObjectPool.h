@@ -0,0 +1,219 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MAPOBJECTPOOL_H
+#define MAPOBJECTPOOL_H
+
+#include <Eigen/Core>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Slab allocator for the map points and keyframes of a map. Objects are carved
+// from slabs of a few hundred slots that are only released with the pool, so a
+// long session reuses the same memory instead of fragmenting the heap, and the
+// allocation lock is the pool's own instead of the allocator's. Every slot keeps
+// its pool and a generation, bumped when its object is freed, so a Handle
+// can tell a live object from a reclaimed one even if the slot was reused.
+//
+// The owner (the map) drops its reference with Release(). Objects moved to
+// another map still live in this pool, which is destroyed with its last object.
+template<typename T>
+class MapObjectPool
+{
+public:
+    // Object pointer with the generation of its slot when it was taken
+    struct Handle
+    {
+        Handle(): pObject(static_cast<T*>(NULL)), nGeneration(0) {}
+
+        T* pObject;
+        unsigned int nGeneration;
+    };
+
+    explicit MapObjectPool(size_t nSlabObjects): mnSlabObjects(nSlabObjects), mpFree(NULL), mnLive(0), mbReleased(false)
+    {
+    }
+
+    // Storage for one T from pPool, or from the pool shared by objects created
+    // without a map (e.g. loaded by boost::serialization)
+    static void* Allocate(MapObjectPool* pPool, size_t size)
+    {
+        if(size>sizeof(T))
+            throw std::bad_alloc();
+        return (pPool ? pPool : Shared())->AllocateSlot();
+    }
+
+    static void Free(void* p)
+    {
+        if(!p)
+            return;
+        Slot* pSlot = SlotOf(p);
+        pSlot->pPool->FreeSlot(pSlot);
+    }
+
+    static Handle GetHandle(T* p)
+    {
+        Handle h;
+        if(p)
+        {
+            h.pObject = p;
+            h.nGeneration = SlotOf(p)->nGeneration.load(std::memory_order_acquire);
+        }
+        return h;
+    }
+
+    // The object of the handle, NULL once it has been deleted. The check does not
+    // keep the object alive, it only has to outlive the use the caller makes of it
+    static T* Resolve(const Handle& h)
+    {
+        if(!h.pObject || SlotOf(h.pObject)->nGeneration.load(std::memory_order_acquire)!=h.nGeneration)
+            return static_cast<T*>(NULL);
+        return h.pObject;
+    }
+
+    void Release()
+    {
+        bool bDestroy;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mbReleased = true;
+            bDestroy = mnLive==0;
+        }
+        if(bDestroy)
+            delete this;
+    }
+
+    size_t LiveObjects()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mnLive;
+    }
+
+    size_t Capacity()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mvpSlabs.size()*mnSlabObjects;
+    }
+
+private:
+    struct Slot
+    {
+        MapObjectPool* pPool;
+        std::atomic<unsigned int> nGeneration;
+        Slot* pNextFree;
+    };
+
+    // Objects are aligned as Eigen expects from its aligned operator new
+    static const size_t kAlignment = EIGEN_MAX_ALIGN_BYTES > 16 ? EIGEN_MAX_ALIGN_BYTES : 16;
+
+    static size_t HeaderSize()
+    {
+        return (sizeof(Slot) + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    static size_t SlotSize()
+    {
+        return HeaderSize() + (sizeof(T) + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    static Slot* SlotOf(void* p)
+    {
+        return reinterpret_cast<Slot*>(static_cast<char*>(p) - HeaderSize());
+    }
+
+    static MapObjectPool* Shared()
+    {
+        // Never released, loaded objects live as long as the process
+        static MapObjectPool* pShared = new MapObjectPool(64);
+        return pShared;
+    }
+
+    void* AllocateSlot()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if(!mpFree)
+            AddSlab();
+        Slot* pSlot = mpFree;
+        mpFree = pSlot->pNextFree;
+        mnLive++;
+        return reinterpret_cast<char*>(pSlot) + HeaderSize();
+    }
+
+    void FreeSlot(Slot* pSlot)
+    {
+        bool bDestroy;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            pSlot->nGeneration.fetch_add(1, std::memory_order_release);
+            pSlot->pNextFree = mpFree;
+            mpFree = pSlot;
+            mnLive--;
+            bDestroy = mbReleased && mnLive==0;
+        }
+        if(bDestroy)
+            delete this;
+    }
+
+    void AddSlab()
+    {
+        const size_t nSlotSize = SlotSize();
+        char* pRaw = static_cast<char*>(::operator new(mnSlabObjects*nSlotSize + kAlignment));
+        mvpSlabs.push_back(pRaw);
+
+        char* pSlab = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(pRaw) + kAlignment - 1) & ~(uintptr_t)(kAlignment - 1));
+        // Pushed backwards, so objects are handed out in address order
+        for(size_t i=mnSlabObjects; i-->0;)
+        {
+            Slot* pSlot = reinterpret_cast<Slot*>(pSlab + i*nSlotSize);
+            pSlot->pPool = this;
+            new (&pSlot->nGeneration) std::atomic<unsigned int>(0);
+            pSlot->pNextFree = mpFree;
+            mpFree = pSlot;
+        }
+    }
+
+    // Destroyed by Release() or by freeing its last object
+    ~MapObjectPool()
+    {
+        for(size_t i=0; i<mvpSlabs.size(); i++)
+            ::operator delete(mvpSlabs[i]);
+    }
+
+    MapObjectPool(const MapObjectPool&);
+    MapObjectPool& operator=(const MapObjectPool&);
+
+    const size_t mnSlabObjects;
+    std::vector<char*> mvpSlabs;
+    Slot* mpFree;
+    size_t mnLive;
+    bool mbReleased;
+    std::mutex mMutex;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPOBJECTPOOL_H
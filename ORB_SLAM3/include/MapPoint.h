@@ -26,9 +26,14 @@
 #include "Converter.h"
 
 #include "SerializationUtils.h"
+#include "SeqLock.h"
+#include "DescriptorArena.h"
+#include "ProfiledMutex.h"
+#include "MemoryAccounting.h"
 
 #include <opencv2/core/core.hpp>
 #include <mutex>
+#include <atomic>
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/array.hpp>
@@ -89,34 +94,61 @@ class MapPoint
         //ar & mObservations;
         ar & mBackupObservationsId1;
         ar & mBackupObservationsId2;
-        serializeMatrix(ar,mDescriptor,version);
+        cv::Mat descriptor;
+        if(Archive::is_saving::value)
+            descriptor = GetDescriptor();
+        serializeMatrix(ar,descriptor,version);
         ar & mBackupRefKFId;
         //ar & mnVisible;
         //ar & mnFound;
 
-        ar & mbBad;
+        bool bBad = mbBad;
+        ar & bBad;
+        mbBad = bBad;
         ar & mBackupReplacedId;
 
         ar & mfMinDistance;
         ar & mfMaxDistance;
 
+        // Refresh the lock-free copies after loading
+        if(Archive::is_loading::value)
+        {
+            PublishGeometry();
+            if(!descriptor.empty())
+                SetDescriptor(descriptor.ptr<unsigned char>(0));
+        }
     }
 
 
 public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    // Allocated from the slab pool of a map, new(pMap) MapPoint(...). Plain new, as used by
+    // boost::serialization, takes the pool shared by objects without a map
+    static void* operator new(size_t size, Map* pMap);
+    static void* operator new(size_t size);
+    static void operator delete(void* p, Map* pMap);
+    static void operator delete(void* p);
+
     MapPoint();
 
     MapPoint(const Eigen::Vector3f &Pos, KeyFrame* pRefKF, Map* pMap);
     MapPoint(const double invDepth, cv::Point2f uv_init, KeyFrame* pRefKF, KeyFrame* pHostKF, Map* pMap);
     MapPoint(const Eigen::Vector3f &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
+    ~MapPoint();
 
     void SetWorldPos(const Eigen::Vector3f &Pos);
     Eigen::Vector3f GetWorldPos();
 
+    // Bumped from a global counter whenever a point is created or moved, the map renderer
+    // of the Viewer only uploads points whose epoch changed
+    unsigned long GetPositionEpoch();
+    static unsigned long GetPositionEpochCounter();
+
     Eigen::Vector3f GetNormal();
     void SetNormalVector(const Eigen::Vector3f& normal);
 
+    // Position, normal, min and max scale invariance distances (8 floats) in one consistent read
+    void GetGeometry(float* pGeometry);
+
     KeyFrame* GetReferenceKeyFrame();
 
     std::map<KeyFrame*,std::tuple<int,int>> GetObservations();
@@ -144,9 +176,20 @@ public:
     void ComputeDistinctiveDescriptors();
 
     cv::Mat GetDescriptor();
+    // Copies the descriptor into pBuffer (32 bytes) and returns a header over it,
+    // for the matchers that read one descriptor per candidate
+    cv::Mat GetDescriptor(unsigned char* pBuffer);
+    // Starts loading the descriptor row ahead of GetDescriptor
+    inline void PrefetchDescriptor() const {
+        __builtin_prefetch(mpDescriptor);
+    }
 
     void UpdateNormalAndDepth();
 
+    // Estimate of the memory held by the point, for the memory budget of the atlas
+    size_t GetMemoryBytes();
+    void GetMemoryBreakdown(MemoryBreakdown &breakdown);
+
     float GetMinDistanceInvariance();
     float GetMaxDistanceInvariance();
     int PredictScale(const float &currentDist, KeyFrame*pKF);
@@ -203,7 +246,7 @@ public:
     double mInitV;
     KeyFrame* mpHostKF;
 
-    static std::mutex mGlobalMutex;
+    static ProfiledMutex mGlobalMutex;
 
     unsigned int mnOriginMapId;
 
@@ -221,8 +264,17 @@ protected:
      // Mean viewing direction
      Eigen::Vector3f mNormalVector;
 
-     // Best descriptor to fast matching
-     cv::Mat mDescriptor;
+     // Best descriptor to fast matching, a row of the descriptor arena of the map
+     // the point was created in
+     DescriptorArena::Row* mpDescriptor;
+     void SetDescriptor(const unsigned char* pDescriptor);
+
+     // Hamming distances between the observed descriptors of the last
+     // ComputeDistinctiveDescriptors, packed upper triangle over the observations
+     // in mvDescriptorKeys (KeyFrame id, keypoint index), so that a new
+     // observation only computes its own row
+     std::vector<std::pair<long unsigned int,int> > mvDescriptorKeys;
+     std::vector<uint16_t> mvDescriptorDistances;
 
      // Reference KeyFrame
      KeyFrame* mpRefKF;
@@ -233,7 +285,7 @@ protected:
      int mnFound;
 
      // Bad flag (we do not currently erase MapPoint from memory)
-     bool mbBad;
+     std::atomic<bool> mbBad;
      MapPoint* mpReplaced;
      // For save relation without pointer, this is necessary for save/load function
      long long int mBackupReplacedId;
@@ -245,9 +297,19 @@ protected:
      Map* mpMap;
 
      // Mutex
-     std::mutex mMutexPos;
-     std::mutex mMutexFeatures;
-     std::mutex mMutexMap;
+     ProfiledMutex mMutexPos{"MapPoint::mMutexPos"};
+     ProfiledMutex mMutexFeatures{"MapPoint::mMutexFeatures"};
+     ProfiledMutex mMutexMap{"MapPoint::mMutexMap"};
+     std::mutex mMutexDescriptorCache;
+
+     // Copies of the position, normal and scale distances (guarded by mMutexPos)
+     // for the getters. The tracking thread reads them without taking the mutexes
+     // the mapping threads write under, like the descriptor row.
+     void PublishGeometry();
+     SeqLockArray<float,8> mSharedGeometry;
+
+     static std::atomic<unsigned long> nPositionEpoch;
+     std::atomic<unsigned long> mnPositionEpoch{++nPositionEpoch};
 
 };
 
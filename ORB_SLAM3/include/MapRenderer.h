@@ -0,0 +1,144 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MAPRENDERER_H
+#define MAPRENDERER_H
+
+#include"Atlas.h"
+#include"MapPoint.h"
+#include"KeyFrame.h"
+#include<pangolin/pangolin.h>
+
+#include<chrono>
+#include<unordered_map>
+#include<vector>
+
+namespace ORB_SLAM3
+{
+
+// Draws the atlas from persistent vertex buffers for the Viewer. At most fUpdateRate times per
+// second the map is compared against what was uploaded, and only the map points and keyframes
+// that were added, removed or moved since (by their position epoch) are written to the buffers.
+// In between, and while the map does not change, drawing costs one draw call per buffer instead
+// of re-emitting every point in immediate mode.
+// It is only used from the Viewer thread, which owns the GL context.
+class MapRenderer
+{
+public:
+    MapRenderer(float fUpdateRate, float fKeyFrameSize, const float (*pFrameColors)[3], int nFrameColors);
+
+    // Map points of the active map, the reference map points in red
+    void DrawMapPoints(Atlas* pAtlas, float fPointSize);
+
+    // Keyframes of every map, and the covisibility graph and inertial links of the active map
+    void DrawKeyFrames(Atlas* pAtlas, const bool bDrawKF, const bool bDrawGraph, const bool bDrawInertialGraph,
+                       float fKeyFrameLineWidth, float fGraphLineWidth);
+
+private:
+
+    // Vertex positions and colors, mirrored on the CPU. Only the ranges written since the last
+    // Upload() are transferred, unless the buffer had to grow.
+    class VertexBuffer
+    {
+    public:
+        VertexBuffer();
+
+        size_t Size() const {return mnSize;}
+        void Resize(size_t nSize);
+        void SetPosition(size_t i, const Eigen::Vector3f &pos);
+        void SetColor(size_t i, const float* color);
+        const float* GetColor(size_t i) const {return &mvColors[3*i];}
+        // Moves nCount vertices, for removals by swapping in the last element
+        void Move(size_t iFrom, size_t iTo, size_t nCount);
+
+        void Upload();
+        void Draw(GLenum mode, size_t nFirst, size_t nCount, bool bColors);
+
+    private:
+        void MarkDirty(size_t i, size_t nCount);
+
+        std::vector<float> mvPositions;
+        std::vector<float> mvColors;
+        size_t mnSize;
+
+        // Written vertex ranges [first,last)
+        std::vector<std::pair<size_t,size_t> > mvDirty;
+
+        pangolin::GlBuffer mVbo;
+        pangolin::GlBuffer mCbo;
+        size_t mnCapacity;
+    };
+
+    struct Slot
+    {
+        size_t nIndex;
+        unsigned long nEpoch;
+        unsigned long nSeen;
+    };
+
+    bool DueForUpdate(std::chrono::steady_clock::time_point &tLastUpdate);
+
+    void UpdateMapPoints(Atlas* pAtlas);
+    void RemoveMapPoint(MapPoint* pMP);
+    void ClearMapPoints();
+
+    void UpdateKeyFrames(Atlas* pAtlas);
+    void WriteKeyFrame(size_t nIndex, KeyFrame* pKF);
+    void RemoveKeyFrame(KeyFrame* pKF);
+    void UpdateGraph(const bool bDrawGraph, const bool bDrawInertialGraph);
+
+    std::chrono::steady_clock::duration mUpdatePeriod;
+    float mfKeyFrameSize;
+    const float (*mpFrameColors)[3];
+    int mnFrameColors;
+
+    // Map points of the active map, one vertex each. The snapshot is held until the next update
+    // so the set is only compared when it was rebuilt.
+    VertexBuffer mPoints;
+    std::unordered_map<MapPoint*,Slot> mmPointSlots;
+    std::vector<MapPoint*> mvpPointAtIndex;
+    std::vector<MapPoint*> mvpReferencePoints;
+    Map* mpPointsMap;
+    Map::MapPointSnapshot mpPointsSnapshot;
+    unsigned long mnPointsEpoch;
+    unsigned long mnPointsScan;
+    std::chrono::steady_clock::time_point mtPointsUpdate;
+
+    // Keyframe frustums of all maps, kFrustumVertices line vertices each
+    VertexBuffer mKeyFrames;
+    std::unordered_map<KeyFrame*,Slot> mmKeyFrameSlots;
+    std::vector<KeyFrame*> mvpKeyFrameAtIndex;
+    std::vector<KeyFrame*> mvpOriginKeyFrames;
+    std::vector<Map*> mvpKeyFrameMaps;
+    std::vector<Map::KeyFrameSnapshot> mvpKeyFrameSnapshots;
+    Map* mpKeyFramesActiveMap;
+    unsigned long mnKeyFramesEpoch;
+    unsigned long mnKeyFramesScan;
+    std::chrono::steady_clock::time_point mtKeyFramesUpdate;
+
+    // Edges, rebuilt as a whole when a keyframe changed or they are enabled again
+    VertexBuffer mGraph;
+    VertexBuffer mInertialGraph;
+    unsigned long mnGraphScan;
+    unsigned long mnInertialGraphScan;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPRENDERER_H
@@ -0,0 +1,86 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <cstddef>
+
+namespace ORB_SLAM3
+{
+
+// Bytes of the system by the structure holding them. The map structures are estimated by walking
+// the atlas (Atlas::GetMemoryBreakdown), the memory owned outside of the maps is registered by
+// its owner with MemoryAccounting.
+struct MemoryBreakdown
+{
+    enum Category
+    {
+        MAP = 0,                // Map and atlas containers
+        KEYFRAME_KEYPOINTS,     // Keypoints, right coordinates and depths
+        KEYFRAME_DESCRIPTORS,
+        KEYFRAME_GRIDS,
+        KEYFRAME_BOW,           // BoW and feature vectors
+        KEYFRAME_GRAPH,         // Map point associations, covisibility graph and spanning tree
+        MAPPOINTS,              // Points and their observations
+        MAPPOINT_DESCRIPTORS,   // Descriptor arena rows and descriptor caches of the points
+        KEYFRAME_DATABASE,      // Inverted files of the place recognition
+        VOCABULARY,
+        TPU_ARENAS,             // Tensor arenas of the TPU interpreters
+        FRAME_BUFFERS,          // Camera buffers mapped from the drivers
+        NUM_CATEGORIES
+    };
+
+    size_t vBytes[NUM_CATEGORIES];
+    // Keyframe features of the inactive maps paged out by the memory budget, included in the
+    // categories above
+    size_t nPagedOutBytes;
+
+    MemoryBreakdown();
+
+    void Add(Category category, size_t nBytes)
+    {
+        vBytes[category] += nBytes;
+    }
+
+    size_t Total() const;
+
+    MemoryBreakdown& operator+=(const MemoryBreakdown &other);
+
+    static const char* GetCategoryName(Category category);
+};
+
+// Counters of the memory owned outside of the maps. Owners add their bytes when they allocate and
+// remove them when they free; thread-safe.
+class MemoryAccounting
+{
+public:
+    static void Add(MemoryBreakdown::Category category, size_t nBytes);
+    static void Remove(MemoryBreakdown::Category category, size_t nBytes);
+
+    // Adds the registered bytes of every category to the breakdown
+    static void AddRegistered(MemoryBreakdown &breakdown);
+
+    // Resident set of the process, from /proc/self/statm (0 if unavailable)
+    static size_t GetResidentBytes();
+};
+
+} //namespace ORB_SLAM
+
+#endif // MEMORYACCOUNTING_H
@@ -21,6 +21,7 @@
 #define ORBVOCABULARY_H
 
 #include"Thirdparty/DBoW2/DBoW2/FORB.h"
+#include"Thirdparty/DBoW2/DBoW2/FSuperPoint.h"
 #include"Thirdparty/DBoW2/DBoW2/TemplatedVocabulary.h"
 
 namespace ORB_SLAM3
@@ -29,6 +30,11 @@ namespace ORB_SLAM3
 typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
   ORBVocabulary;
 
+// Trained on binarized SuperPoint descriptors. Same words as ORBVocabulary, the
+// files it saves are tagged "SuperPoint" and load as an ORBVocabulary.
+typedef DBoW2::TemplatedVocabulary<DBoW2::FSuperPoint::TDescriptor, DBoW2::FSuperPoint>
+  SuperPointVocabulary;
+
 } //namespace ORB_SLAM
 
 #endif // ORBVOCABULARY_H
@@ -21,12 +21,16 @@
 
 #include <vector>
 #include <list>
+#include <functional>
+#include <memory>
 #include <opencv2/opencv.hpp>
 
 
 namespace ORB_SLAM3
 {
 
+class RGAPyramid;
+
 class ExtractorNode
 {
 public:
@@ -49,12 +53,26 @@ public:
     ORBextractor(int nfeatures, float scaleFactor, int nlevels,
                  int iniThFAST, int minThFAST);
 
-    ~ORBextractor(){}
+    virtual ~ORBextractor(){}
+
+    // Runs job(0) ... job(n-1), possibly concurrently, and returns when all are done.
+    typedef std::function<void(int, const std::function<void(int)>&)> ParallelFor;
+
+    // Spread the FAST detection (per cell row of each level), the per-level octree
+    // distribution and the per-level descriptors over a thread pool, e.g. one shared
+    // with the caller. The result is the same as the serial extraction.
+    // An empty function restores the serial extraction.
+    void SetParallelFor(const ParallelFor& parallelFor);
+
+    // Pyramid of the next image, built on the RGA (RGAPyramidBuilder) from the camera buffer the
+    // image is mapped from. The next call waits for it instead of computing the pyramid, unless
+    // its levels differ from those of the extractor for the image.
+    void SetPyramid(const std::shared_ptr<RGAPyramid> &pPyramid);
 
     // Compute the ORB features and descriptors on an image.
     // ORB are dispersed on the image using an octree.
     // Mask is ignored in the current implementation.
-    int operator()( cv::InputArray _image, cv::InputArray _mask,
+    virtual int operator()( cv::InputArray _image, cv::InputArray _mask,
                     std::vector<cv::KeyPoint>& _keypoints,
                     cv::OutputArray _descriptors, std::vector<int> &vLappingArea);
 
@@ -84,14 +102,58 @@ public:
 
 protected:
 
+    // Per-level storage kept across frames. Buffers are sized by the first frame of
+    // an image size and then reused, so the steady state does not allocate.
+    struct LevelArena
+    {
+        // Level image with EDGE_THRESHOLD borders (mvImagePyramid is its interior),
+        // its blurred copy and the descriptor rows
+        cv::Mat bordered;
+        cv::Mat blurred;
+        cv::Mat descriptors;
+
+        // FAST cell grid
+        int minBorderX, minBorderY, maxBorderX, maxBorderY;
+        int nCols, nRows, wCell, hCell;
+
+        // FAST keypoints of each cell row and the scratch of its cells
+        std::vector<std::vector<cv::KeyPoint> > vRowKeys;
+        std::vector<std::vector<cv::KeyPoint> > vCellKeys;
+        std::vector<cv::KeyPoint> vToDistributeKeys;
+
+        // Octree nodes in use, and the spare ones spliced in and out instead of allocated
+        std::list<ExtractorNode> lNodes;
+        std::list<ExtractorNode> lSpareNodes;
+        std::vector<ExtractorNode*> vpIniNodes;
+        std::vector<std::pair<int,ExtractorNode*> > vSizeAndPointerToNode;
+        std::vector<std::pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode;
+    };
+
     void ComputePyramid(cv::Mat image);
+    // Points mvImagePyramid at the levels of the pyramid set for the image, if it was set and fits
+    bool UsePyramid(const cv::Mat &image);
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
-    std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
-                                           const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
+    void DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
+                           const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level,
+                           std::vector<cv::KeyPoint>& vResultKeys);
+    // Blurs a level and computes the descriptors of its keypoints in mvAllKeypoints
+    // into the first rows of its arena
+    void ComputeDescriptors(int level);
 
     void ComputeKeyPointsOld(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
+    void RunParallel(int n, const std::function<void(int)>& job);
     std::vector<cv::Point> pattern;
 
+    ParallelFor mParallelFor;
+
+    std::vector<LevelArena> mvArena;
+    std::vector<std::pair<int,int> > mvRowTasks;
+    std::vector<std::vector<cv::KeyPoint> > mvAllKeypoints;
+
+    // Pyramid set for the next image, and the one mvImagePyramid points into
+    std::shared_ptr<RGAPyramid> mpNextPyramid;
+    std::shared_ptr<RGAPyramid> mpPyramid;
+
     int nfeatures;
     double scaleFactor;
     int nlevels;
@@ -21,6 +21,7 @@
 #define ORBMATCHER_H
 
 #include<vector>
+#include<functional>
 #include<opencv2/core/core.hpp>
 #include<opencv2/features2d/features2d.hpp>
 #include"sophus/sim3.hpp"
@@ -28,28 +29,68 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include"Frame.h"
+#include"DescriptorTraits.h"
 
 
 namespace ORB_SLAM3
 {
 
-    class ORBmatcher
+    // The searches of the tracking, mapping and loop closing threads, generated for the descriptor
+    // type given by the traits of DescriptorTraits.h so that every distance and threshold of a search
+    // is resolved at compile time. ORBmatcher matches ORB descriptors, the other instantiations the
+    // SuperPoint descriptors of TPUFeatureExtractor.
+    template<class Descriptor>
+    class DescriptorMatcher
     {
     public:
 
-        ORBmatcher(float nnratio=0.6, bool checkOri=true);
+        typedef typename Descriptor::Element Element;
 
-        // Computes the Hamming distance between two ORB descriptors
+        DescriptorMatcher(float nnratio=0.6, bool checkOri=true);
+
+        // Computes the distance between two descriptors
         static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
 
+        // Best and second best distance from one descriptor to a set of candidates
+        struct DescriptorMatch
+        {
+            int bestDist;   // Descriptor::MAX_DISTANCE if no candidate is closer
+            int bestDist2;
+            int bestIdx;    // Row of the best candidate, -1 if none
+            int bestIdx2;   // Row of the candidate at bestDist2, -1 if none
+        };
+
+        // Computes the distances between a and the rows vIndices of descriptors,
+        // with NEON (aarch64) or AVX2 when the build enables them
+        static void DescriptorDistances(const cv::Mat &a, const cv::Mat &descriptors,
+                                        const std::vector<size_t> &vIndices, std::vector<int> &vDistances);
+
+        // Best and second best match of a among the rows vIndices of descriptors, ties keep
+        // the earlier candidate as the per-candidate loops do
+        static DescriptorMatch SearchDescriptors(const cv::Mat &a, const cv::Mat &descriptors,
+                                                 const std::vector<size_t> &vIndices, std::vector<int> &vDistances);
+
+        // Runs job(0) ... job(n-1), possibly concurrently, and returns when all are done.
+        typedef std::function<void(int, const std::function<void(int)>&)> ParallelFor;
+
         // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
         // Used to track the local map (Tracking)
-        int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3, const bool bFarPoints = false, const float thFarPoints = 50.0f);
+        // With parallelFor the MapPoints are searched in batches concurrently and a keypoint found by
+        // several of them goes to the smallest distance, ties to the earlier MapPoint, so the result
+        // does not depend on the scheduling. Unlike the serial search, the MapPoints that lose a
+        // keypoint are not matched to their next candidate.
+        int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3, const bool bFarPoints = false, const float thFarPoints = 50.0f, const ParallelFor &parallelFor = ParallelFor());
 
         // Project MapPoints tracked in last frame into the current frame and search matches.
         // Used to track from previous frame (Tracking)
         int SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono);
 
+        // Same, with the search window of each point sized from the covariance of the current frame
+        // pose error [dp, dtheta] (dp added to the translation, dtheta a rotation vector applied on the
+        // right of the rotation): th*scale plus 3 standard deviations of the projection, at most thMax*scale.
+        int SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono,
+                               const Eigen::Matrix<float,6,6> &poseCovariance, const float thMax);
+
         // Project MapPoints seen in KeyFrame into the Frame and search matches.
         // Used in relocalisation (Tracking)
         int SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const std::set<MapPoint*> &sAlreadyFound, const float th, const int ORBdist);
@@ -83,25 +124,71 @@ namespace ORB_SLAM3
         // Project MapPoints into KeyFrame and search for duplicated MapPoints.
         int Fuse(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, const float th=3.0, const bool bRight = false);
 
+        // Keypoint of a KeyFrame matched to a MapPoint by SearchFuse
+        struct FuseMatch
+        {
+            MapPoint* pMP;
+            int idx;
+        };
+
+        // The two steps of Fuse. SearchFuse only reads the map, so searches into different keyframes,
+        // or of different MapPoints into one keyframe, can run concurrently. ApplyFuse adds the
+        // observations and replaces the duplicated MapPoints, serially. The matches are checked again
+        // against the map when applied: MapPoints replaced by an earlier match are skipped, as Fuse
+        // skips the bad ones, and the MapPoint of the keypoint is read at that time.
+        void SearchFuse(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, vector<FuseMatch> &vMatches, const float th=3.0, const bool bRight = false);
+        static int ApplyFuse(KeyFrame* pKF, const vector<FuseMatch> &vMatches);
+
         // Project MapPoints into KeyFrame using a given Sim3 and search for duplicated MapPoints.
         int Fuse(KeyFrame* pKF, Sophus::Sim3f &Scw, const std::vector<MapPoint*> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint);
 
     public:
 
-        static const int TH_LOW;
-        static const int TH_HIGH;
-        static const int HISTO_LENGTH;
+        static const int TH_LOW = Descriptor::TH_LOW;
+        static const int TH_HIGH = Descriptor::TH_HIGH;
+        static const int HISTO_LENGTH = 30;
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
     protected:
         float RadiusByViewingCos(const float &viewCos);
 
+        // Best match of a MapPoint projected by Frame::isInFrustum in the left (or only) or right image
+        // of F, as a keypoint index of F. Returns -1 if none is within TH_HIGH and -2 if the ratio test fails.
+        int SearchProjectedPoint(const Frame &F, MapPoint* pMP, const bool bRight, const float th,
+                                 std::vector<size_t> &vPositions, std::vector<size_t> &vCandidates,
+                                 std::vector<int> &vDistances, int &bestDist);
+
+        // Assign pMP to keypoint idx of F and to its stereo observation in the other camera.
+        // Returns the number of keypoints assigned.
+        int AssignProjectedMatch(Frame &F, MapPoint* pMP, const int idx);
+
+        // Largest standard deviation in pixels of the projection of x3D, whose Jacobian with respect
+        // to the pose error is J, for a pose error covariance C
+        static float ProjectionSigma(GeometricCamera* pCamera, const Eigen::Vector3f &x3D,
+                                     const Eigen::Matrix<float,3,6> &J, const Eigen::Matrix<float,6,6> &C);
+
+        int SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono,
+                               const Eigen::Matrix<float,6,6>* pPoseCovariance, const float thMax);
+
         void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3);
 
         float mfNNratio;
         bool mbCheckOrientation;
     };
 
+    template<class Descriptor> const int DescriptorMatcher<Descriptor>::TH_LOW;
+    template<class Descriptor> const int DescriptorMatcher<Descriptor>::TH_HIGH;
+    template<class Descriptor> const int DescriptorMatcher<Descriptor>::HISTO_LENGTH;
+
+    // Instantiated in ORBmatcher.cc
+    extern template class DescriptorMatcher<OrbDescriptor>;
+    extern template class DescriptorMatcher<BinarySuperPointDescriptor>;
+    extern template class DescriptorMatcher<FloatSuperPointDescriptor>;
+
+    typedef DescriptorMatcher<OrbDescriptor> ORBmatcher;
+    typedef DescriptorMatcher<BinarySuperPointDescriptor> BinarySuperPointMatcher;
+    typedef DescriptorMatcher<FloatSuperPointDescriptor> FloatSuperPointMatcher;
+
 }// namespace ORB_SLAM
 
 #endif // ORBMATCHER_H
\ No newline at end of file
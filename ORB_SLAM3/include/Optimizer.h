@@ -25,6 +25,7 @@
 #include "KeyFrame.h"
 #include "LoopClosing.h"
 #include "Frame.h"
+#include "RemoteBackend.h"
 
 #include <math.h>
 
@@ -49,31 +50,46 @@ public:
 
     void static BundleAdjustment(const std::vector<KeyFrame*> &vpKF, const std::vector<MapPoint*> &vpMP,
                                  int nIterations = 5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
-                                 const bool bRobust = true);
+                                 const bool bRobust = true, const std::set<KeyFrame*> *pspFixedKFs=NULL);
+    // With pspAffectedKFs only those keyframes and their map points are optimized, the other keyframes observing
+    // the points are kept fixed and the rest of the map is left untouched
     void static GlobalBundleAdjustemnt(Map* pMap, int nIterations=5, bool *pbStopFlag=NULL,
-                                       const unsigned long nLoopKF=0, const bool bRobust = true);
+                                       const unsigned long nLoopKF=0, const bool bRobust = true,
+                                       const std::set<KeyFrame*> *pspAffectedKFs=NULL);
+    // Bundle adjustment of a map sent as plain data, solved by the remote back end server.
+    // Monocular observations are robust only with problem.bRobust, stereo ones like in BundleAdjustment
+    void static BundleAdjustment(const BundleAdjustmentProblem &problem, BundleAdjustmentSolution &solution,
+                                 bool *pbStopFlag=NULL);
     void static FullInertialBA(Map *pMap, int its, const bool bFixLocal=false, const unsigned long nLoopKF=0, bool *pbStopFlag=NULL, bool bInit=false, float priorG = 1e2, float priorA=1e6, Eigen::VectorXd *vSingVal = NULL, bool *bHess=NULL);
 
-    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges);
+    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, int nMaxLocalKFs = 0, int nThreads = 1,
+                                      float fTimeBudget = 0.f, float fGainThreshold = 0.f);
 
     int static PoseOptimization(Frame* pFrame);
+    // Pose of pFrame from its own and the rig cameras' observations, vTcr[i] maps pFrame's camera to vpRigFrames[i]'s
+    int static PoseOptimizationMultiCamera(Frame* pFrame, const std::vector<Frame*> &vpRigFrames, const std::vector<Sophus::SE3f> &vTcr);
     int static PoseInertialOptimizationLastKeyFrame(Frame* pFrame, bool bRecInit = false);
     int static PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit = false);
 
     // if bFixScale is true, 6DoF optimization (stereo,rgbd), 7DoF otherwise (mono)
+    // If pLoopCorrections is given the map is left untouched and the world correction Swi_opt*Siw of every keyframe is returned
+    // The keyframes between the loop and the current keyframe start from the loop correction interpolated along them,
+    // the iterations stop once they converge
     void static OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
                                        const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
-                                       const bool &bFixScale);
+                                       const bool &bFixScale, LoopClosing::KeyFrameAndPose* pLoopCorrections = NULL, int nThreads = 1);
     void static OptimizeEssentialGraph(KeyFrame* pCurKF, vector<KeyFrame*> &vpFixedKFs, vector<KeyFrame*> &vpFixedCorrectedKFs,
                                        vector<KeyFrame*> &vpNonFixedKFs, vector<MapPoint*> &vpNonCorrectedMPs);
 
     // For inertial loopclosing
+    // If pLoopCorrections is given the map is left untouched and the world correction Swi_opt*Siw of every keyframe is returned
     void static OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections);
+                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
+                                       LoopClosing::KeyFrameAndPose* pLoopCorrections = NULL, int nThreads = 1);
 
 
     // if bFixScale is true, optimize SE3 (stereo,rgbd), Sim3 otherwise (mono) (NEW)
@@ -83,7 +99,8 @@ public:
 
     // For inertial systems
 
-    void static LocalInertialBA(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge = false, bool bRecInit = false);
+    void static LocalInertialBA(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge = false, bool bRecInit = false, int nThreads = 1,
+                                float fTimeBudget = 0.f, float fGainThreshold = 0.f);
     void static MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbStopFlag, Map *pMap, LoopClosing::KeyFrameAndPose &corrPoses);
 
     // Local BA in welding area when two maps are merged
@@ -0,0 +1,111 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef PACKEDKEYPOINTS_H
+#define PACKEDKEYPOINTS_H
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Keypoints of a keyframe in 8 bytes instead of the 28 of cv::KeyPoint. Only
+// what the keyframe users read is kept: the coordinates in 1/8 pixel fixed
+// point (+-4096 pixels, 1/16 pixel at most off), the octave, and the angle in
+// 1/65535 of a turn. Elements are decoded to cv::KeyPoint by value, so
+// "const cv::KeyPoint &kp = pKF->mvKeysUn[i]" keeps working.
+class PackedKeyPoints
+{
+public:
+    struct Packed
+    {
+        int16_t x;
+        int16_t y;
+        uint16_t angle;
+        uint8_t octave;
+        uint8_t reserved;
+    };
+
+    static const int kSubpixels = 8;
+    // A negative angle, i.e. not computed, is kept as such
+    static const uint16_t kNoAngle = 0xFFFF;
+
+    PackedKeyPoints() {}
+
+    PackedKeyPoints(const std::vector<cv::KeyPoint> &vKeys): mvPacked(vKeys.size())
+    {
+        for(size_t i=0; i<vKeys.size(); i++)
+            mvPacked[i] = Pack(vKeys[i]);
+    }
+
+    cv::KeyPoint operator[](size_t i) const
+    {
+        const Packed &p = mvPacked[i];
+        const float angle = p.angle==kNoAngle ? -1.f : p.angle*(360.f/65535.f);
+        return cv::KeyPoint(p.x*(1.f/kSubpixels), p.y*(1.f/kSubpixels), 1.f, angle, 0.f, p.octave);
+    }
+
+    size_t size() const { return mvPacked.size(); }
+    bool empty() const { return mvPacked.empty(); }
+
+    const Packed* data() const { return mvPacked.data(); }
+    size_t MemoryBytes() const { return mvPacked.size()*sizeof(Packed); }
+
+    std::vector<cv::KeyPoint> Unpack() const
+    {
+        std::vector<cv::KeyPoint> vKeys(mvPacked.size());
+        for(size_t i=0; i<mvPacked.size(); i++)
+            vKeys[i] = (*this)[i];
+        return vKeys;
+    }
+
+private:
+    static int16_t Fixed(float v)
+    {
+        const float f = std::round(v*kSubpixels);
+        return static_cast<int16_t>(std::min(32767.f, std::max(-32768.f, f)));
+    }
+
+    static Packed Pack(const cv::KeyPoint &kp)
+    {
+        Packed p;
+        p.x = Fixed(kp.pt.x);
+        p.y = Fixed(kp.pt.y);
+        if(kp.angle<0.f)
+            p.angle = kNoAngle;
+        else
+            p.angle = static_cast<uint16_t>(std::min(65534.f, std::round(std::fmod(kp.angle, 360.f)*(65535.f/360.f))));
+        p.octave = static_cast<uint8_t>(std::max(0, std::min(255, kp.octave)));
+        p.reserved = 0;
+        return p;
+    }
+
+    std::vector<Packed> mvPacked;
+};
+
+} //namespace ORB_SLAM
+
+#endif // PACKEDKEYPOINTS_H
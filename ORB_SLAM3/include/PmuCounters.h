@@ -0,0 +1,91 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PMUCOUNTERS_H
+#define PMUCOUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Hardware counters of a span name on one core type, summed over all the threads and spans of
+// that name. Spans are inclusive: a nested span is also counted in the span around it.
+struct StageCounters
+{
+    std::string name;
+    std::string core;               // PMU of the cores, e.g. cortex_a76, or "cpu" without per-core PMUs
+    uint64_t nSpans = 0;            // Spans that ran on these cores
+    double runningMs = 0.0;         // Time the spans ran on these cores
+    uint64_t nCycles = 0;
+    uint64_t nInstructions = 0;
+    uint64_t nL2Accesses = 0;       // L2 data cache accesses and refills (0 if the PMU lacks them)
+    uint64_t nL2Refills = 0;
+    uint64_t nL3Accesses = 0;       // L3 (last level without per-core PMUs) accesses and refills
+    uint64_t nL3Refills = 0;
+    uint64_t nBranchMisses = 0;
+    double ipc = 0.0;
+    double l2MissRate = 0.0;        // Refills / accesses
+    double l3MissRate = 0.0;
+    double branchMissesPKI = 0.0;   // Per thousand instructions
+};
+
+// Per-thread perf_event counter groups read at the boundaries of the TraceScope spans, so every
+// traced stage gets its IPC, cache miss rates and branch misses. On big.LITTLE the threads get one
+// group per core PMU (A76 and A55 on the RK3588, with the raw ARMv8 events), each counting only
+// while the thread runs on its cores. The groups are opened by every thread at its first span after
+// Start() and stay open until the thread exits. A span boundary costs a read() per group, about 1 us.
+//
+// The spans are compiled in with ENABLE_TRACING (Trace.h), counting does not need the tracer to be
+// recording. Needs perf_event_paranoid <= 2 (user space counting); threads that cannot open their
+// groups are not counted.
+class PmuCounters
+{
+public:
+    // Returns false if the calling thread cannot open its counters (not Linux, no permission)
+    static bool Start();
+    static void Stop();
+
+    static bool IsEnabled()
+    {
+        return sbEnabled.load(std::memory_order_relaxed);
+    }
+
+    // Span boundaries of the calling thread, the name must be a string literal
+    static void BeginSpan();
+    static void EndSpan(const char* name);
+
+    // Per span name and core, by running time
+    static std::vector<StageCounters> GetStatistics();
+
+    static void Reset();
+
+    static void PrintStatistics(std::ostream &os);
+
+private:
+    static std::atomic<bool> sbEnabled;
+};
+
+} //namespace ORB_SLAM
+
+#endif // PMUCOUNTERS_H
@@ -0,0 +1,118 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PROFILEDMUTEX_H
+#define PROFILEDMUTEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Contention of a named lock, summed over all the mutexes of that name (all the
+// MapPoint::mMutexPos of the map count as one lock)
+struct LockStatistics
+{
+    // Code holding the lock, the function that called lock() (symbol + offset)
+    struct Site
+    {
+        std::string function;
+        uint64_t nAcquisitions = 0;
+        uint64_t nContended = 0;
+        double totalWaitMs = 0.0;
+        double totalHoldMs = 0.0;
+    };
+
+    std::string name;
+    uint64_t nAcquisitions = 0;
+    uint64_t nContended = 0;        // Acquisitions that found the lock taken
+    double contendedRate = 0.0;     // nContended / nAcquisitions
+    double waitP50Us = 0.0;         // Wait of the contended acquisitions
+    double waitP99Us = 0.0;
+    double waitMaxUs = 0.0;
+    double totalWaitMs = 0.0;
+    double holdP50Us = 0.0;         // Time from acquisition to release
+    double holdP99Us = 0.0;
+    double holdMaxUs = 0.0;
+    double totalHoldMs = 0.0;
+    std::vector<Site> vTopSites;    // By wait, then hold time
+};
+
+// Statistics of the ProfiledMutex locks. Without ENABLE_LOCK_PROFILING (the CMake option of the
+// same name) nothing is recorded and GetStatistics() returns no lock.
+class LockProfiler
+{
+public:
+    static bool IsEnabled();
+
+    // Locks sorted by total wait, with the nTopSites sites of each
+    static std::vector<LockStatistics> GetStatistics(size_t nTopSites = 5);
+
+    static void Reset();
+
+    static void PrintStatistics(std::ostream &os, size_t nTopSites = 5);
+};
+
+#ifdef ENABLE_LOCK_PROFILING
+
+struct LockCounters;
+
+// Mutex that records its acquisitions, waits, hold times and the sites holding it into the
+// counters of its name. Uncontended acquisitions cost a try_lock and two clock reads. Use with
+// unique_lock<ProfiledMutex>.
+class ProfiledMutex
+{
+public:
+    explicit ProfiledMutex(const char* name);
+
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+private:
+    std::mutex mMutex;
+    LockCounters* mpCounters;
+
+    // Written by the holder
+    uint64_t mnAcquireTime;
+    void* mpSite;
+};
+
+#else
+
+// Plain mutex, the name is dropped
+class ProfiledMutex : public std::mutex
+{
+public:
+    explicit ProfiledMutex(const char*) {}
+};
+
+#endif
+
+} //namespace ORB_SLAM
+
+#endif // PROFILEDMUTEX_H
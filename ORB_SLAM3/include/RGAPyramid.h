@@ -0,0 +1,108 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef RGAPYRAMID_H
+#define RGAPYRAMID_H
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Pooled level buffers and imported camera buffers, defined with HAVE_RGA
+struct RGAPyramidPool;
+
+// Image pyramid built on the RGA, in a pooled buffer set that returns to the pool when the
+// last reference is dropped. Each level is written by its own asynchronous RGA job, which
+// signals a release fence; a level can be read once Wait() returned for it.
+// A pyramid is used by one thread at a time.
+class RGAPyramid
+{
+public:
+    ~RGAPyramid();
+
+    int GetLevels() const;
+
+    // Release fence of the job writing a level (a sync_file fd owned by the pyramid), -1 once
+    // the level was waited for
+    int GetFence(int level) const;
+
+    // Waits for the job of a level and fills its borders (BORDER_REFLECT_101, as
+    // ORBextractor::ComputePyramid). Returns false if the job failed or timed out.
+    bool Wait(int level);
+    bool WaitAll();
+
+    // Level image, the interior of a buffer with EDGE_THRESHOLD borders. Valid after Wait(level)
+    // for the lifetime of the pyramid.
+    const cv::Mat &GetLevel(int level) const;
+
+private:
+    friend class RGAPyramidBuilder;
+
+    RGAPyramid(const std::shared_ptr<RGAPyramidPool> &pPool, int nSlot);
+
+    std::shared_ptr<RGAPyramidPool> mpPool;
+    int mnSlot;
+    std::vector<int> mvFences;
+    std::vector<bool> mvReady;
+    std::vector<cv::Mat> mvLevels;
+    bool mbFailed;
+};
+
+// Builds the scale pyramids of the extractors (ORBextractor, TPUFeatureExtractor) on the RGA
+// 2D engines of the RK3588 instead of cv::resize on the CPU. The grey camera image is read
+// straight from its ZeroCopyFrameProvider DMA-BUF; level 0 is copied and every other level
+// scaled from the previous one, as in ORBextractor::ComputePyramid, into DMA-BUFs of a pool of
+// nPyramids buffer sets. The jobs are chained by their fences, so Build() returns as soon as
+// they are queued and the extractor waits for the levels when it needs them.
+// Without HAVE_RGA, without an RGA device, or when all buffer sets are in use Build() returns
+// nullptr and the extractors build the pyramid on the CPU.
+class RGAPyramidBuilder
+{
+public:
+    RGAPyramidBuilder(int nlevels, float scaleFactor, int nPyramids);
+    ~RGAPyramidBuilder();
+
+    bool IsAvailable() const;
+
+    int GetLevels() const;
+    float GetScaleFactor() const;
+
+    // Starts building the pyramid of a grey image of width x height pixels with a row stride of
+    // stride bytes, at the start of a DMA-BUF mapped at data. Camera buffers are imported on first
+    // use; a buffer with the same fd or overlapping memory replaces the earlier one.
+    // Thread-safe.
+    std::shared_ptr<RGAPyramid> Build(int fd, const void* data, size_t size, int width, int height, int stride);
+
+    // Imports a camera buffer ahead of its first Build(), e.g. the buffers of a DmaBufferPool
+    // before the capture starts. Returns false if the RGA cannot import it. Thread-safe.
+    bool Import(int fd, const void* data, size_t size);
+
+private:
+    std::shared_ptr<RGAPyramidPool> mpPool;
+    int mnLevels;
+    float mfScaleFactor;
+};
+
+} //namespace ORB_SLAM
+
+#endif // RGAPYRAMID_H
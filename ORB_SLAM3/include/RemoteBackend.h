@@ -0,0 +1,162 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef REMOTEBACKEND_H
+#define REMOTEBACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+class Map;
+class KeyFrame;
+class MapPoint;
+
+// Global Bundle Adjustment of a map as plain data, so it can be solved away from the
+// headset. Pinhole cameras with monocular and rectified stereo observations, like the
+// visual Optimizer::BundleAdjustment.
+struct BundleAdjustmentProblem
+{
+    struct Camera
+    {
+        float fx, fy, cx, cy;
+        float bf;                       // Baseline times fx, for the stereo observations
+    };
+
+    struct KeyFrameEntry
+    {
+        uint32_t camera;
+        uint32_t fixed;
+        float q[4];                     // Tcw, quaternion x y z w
+        float t[3];
+    };
+
+    struct Observation
+    {
+        uint32_t keyframe;
+        uint32_t point;
+        float u, v;                     // Undistorted keypoint
+        float ur;                       // Right coordinate, negative for monocular
+        float invSigma2;
+    };
+
+    int nIterations;
+    bool bRobust;
+    std::vector<Camera> vCameras;
+    std::vector<KeyFrameEntry> vKeyFrames;
+    std::vector<float> vPoints;         // x y z per point
+    std::vector<Observation> vObservations;
+
+    void Encode(std::vector<uint8_t> &payload) const;
+    // False for a truncated or inconsistent payload
+    bool Decode(const uint8_t *pData, size_t size);
+};
+
+// Result of a BundleAdjustmentProblem, in the order of its keyframes and points
+struct BundleAdjustmentSolution
+{
+    std::vector<float> vPoses;          // q x y z w, t x y z per keyframe
+    std::vector<float> vPoints;         // x y z per point
+    std::vector<uint8_t> vbIncluded;    // Per point, false for points without observations
+
+    void Encode(std::vector<uint8_t> &payload) const;
+    bool Decode(const uint8_t *pData, size_t size);
+};
+
+// Message on the connection to the back end server
+struct RemoteBackendHeader
+{
+    uint32_t magic;
+    uint16_t kind;
+    uint16_t reserved;
+    uint64_t requestId;
+    uint64_t payloadBytes;
+};
+
+static_assert(sizeof(RemoteBackendHeader) == 24, "RemoteBackendHeader layout changed");
+
+// Offloads the Global Bundle Adjustment of the loop closing to a server on a tethered PC
+// or an edge box. The map is sent as a BundleAdjustmentProblem and the optimized poses
+// and points come back into mTcwGBA and mPosGBA, so the loop closing propagates and
+// applies them like those of a local Global BA. The GBA thread only waits on the link,
+// tracking and local mapping keep the cores. When the link is down, the server does not
+// answer in time or the map has cameras the server does not model, the caller runs the
+// Global BA locally. After a failure the server is not tried again for a few seconds.
+class RemoteBackend
+{
+public:
+    static const uint32_t MAGIC = 0x31414252; // "RBA1"
+    static const uint16_t KIND_REQUEST = 1;
+    static const uint16_t KIND_SOLUTION = 2;
+    static const uint64_t MAX_PAYLOAD = 1ull << 30;
+
+    // fTimeout in seconds for the whole exchange, solving included
+    RemoteBackend(const std::string &strHost, int nPort, float fTimeout);
+    ~RemoteBackend();
+
+    // Same contract as Optimizer::GlobalBundleAdjustemnt on the whole map. False if it was
+    // not solved remotely, nothing is written then and the caller runs it locally. True
+    // with nothing written if pbStopFlag was raised while waiting.
+    bool GlobalBundleAdjustment(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF);
+
+    // Global BAs solved remotely, and those handed back to the caller
+    int GetNumRemote();
+    int GetNumFallbacks();
+
+    // Problem of the whole map, false if it has cameras the server does not model
+    static bool BuildProblem(Map* pMap, int nIterations, BundleAdjustmentProblem &problem,
+                             std::vector<KeyFrame*> &vpKFs, std::vector<MapPoint*> &vpMPs);
+
+    // Exchange of one message on a connected socket, used by the server too. False on a
+    // link error, once pbStopFlag is raised or at the steady clock deadline in seconds
+    // (negative for none)
+    static bool SendMessage(int fd, uint16_t kind, uint64_t requestId, const std::vector<uint8_t> &payload,
+                            bool* pbStopFlag, double deadline);
+    static bool ReceiveMessage(int fd, RemoteBackendHeader &header, std::vector<uint8_t> &payload,
+                               bool* pbStopFlag, double deadline);
+
+private:
+    bool Solve(const BundleAdjustmentProblem &problem, bool* pbStopFlag, BundleAdjustmentSolution &solution);
+    bool Connect(double deadline);
+    void Disconnect();
+
+    std::string mStrHost;
+    int mnPort;
+    float mfTimeout;
+
+    // Connection, held for a whole exchange
+    std::mutex mMutex;
+    int mSocket;
+    uint64_t mnRequestId;
+    double mRetryTime;
+    std::vector<uint8_t> mvPayload;
+
+    std::mutex mMutexStats;
+    int mnRemote;
+    int mnFallbacks;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // REMOTEBACKEND_H
@@ -0,0 +1,78 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+
+namespace ORB_SLAM3
+{
+
+// Fixed-size array of values published with a sequence lock. Readers never
+// write shared memory, so they neither block the writer nor each other and
+// the cache line stays shared between cores. A reader retries if a write
+// overlapped its copy. Writers must be serialized by the caller (e.g. by a
+// mutex they already hold). T must be lock-free as std::atomic<T>.
+template<typename T, int N>
+class SeqLockArray
+{
+public:
+    SeqLockArray(): mnSequence(0)
+    {
+        for(int i=0; i<N; i++)
+            mValues[i].store(T(), std::memory_order_relaxed);
+    }
+
+    void Store(const T* values)
+    {
+        const unsigned int seq = mnSequence.load(std::memory_order_relaxed);
+        mnSequence.store(seq+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(int i=0; i<N; i++)
+            mValues[i].store(values[i], std::memory_order_relaxed);
+        mnSequence.store(seq+2, std::memory_order_release);
+    }
+
+    void Load(T* values) const
+    {
+        while(true)
+        {
+            const unsigned int seq = mnSequence.load(std::memory_order_acquire);
+            if(seq & 1)
+                continue;
+            for(int i=0; i<N; i++)
+                values[i] = mValues[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(mnSequence.load(std::memory_order_relaxed) == seq)
+                return;
+        }
+    }
+
+private:
+    SeqLockArray(const SeqLockArray&);
+    SeqLockArray& operator=(const SeqLockArray&);
+
+    std::atomic<unsigned int> mnSequence;
+    std::atomic<T> mValues[N];
+};
+
+} //namespace ORB_SLAM
+
+#endif // SEQLOCK_H
@@ -30,6 +30,8 @@
 
 #include <vector>
 
+#include "PackedKeyPoints.h"
+
 namespace ORB_SLAM3
 {
 
@@ -161,6 +163,20 @@ void serializeVectorKeyPoints(Archive& ar, const std::vector<cv::KeyPoint>& vKP,
     }
 }
 
+// Same format as the vectors of cv::KeyPoint, the fields not packed are saved with their defaults
+template<class Archive>
+void serializeVectorKeyPoints(Archive& ar, const PackedKeyPoints& vKP, const unsigned int version)
+{
+    std::vector<cv::KeyPoint> vKeys;
+    if (Archive::is_saving::value)
+        vKeys = vKP.Unpack();
+
+    serializeVectorKeyPoints<Archive>(ar, vKeys, version);
+
+    if (Archive::is_loading::value)
+        const_cast<PackedKeyPoints&>(vKP) = PackedKeyPoints(vKeys);
+}
+
 } // namespace ORB_SLAM3
 
 #endif // SERIALIZATION_UTILS_H
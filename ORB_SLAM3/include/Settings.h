@@ -111,11 +111,28 @@ namespace ORB_SLAM3 {
         float viewPointZ() {return viewPointZ_;}
         float viewPointF() {return viewPointF_;}
         float imageViewerScale() {return imageViewerScale_;}
+        float mapUpdateRate() {return mapUpdateRate_;}
 
         std::string atlasLoadFile() {return sLoadFrom_;}
         std::string atlasSaveFile() {return sSaveto_;}
 
         float thFarPoints() {return thFarPoints_;}
+        int localBAThreads() {return localBAThreads_;}
+        float localBATimeBudget() {return localBATimeBudget_;}
+        float localBAGainThreshold() {return localBAGainThreshold_;}
+        bool backgroundInertialBA() {return backgroundInertialBA_;}
+        bool asyncLoopCorrection() {return asyncLoopCorrection_;}
+        int loopClosingThreads() {return loopClosingThreads_;}
+        bool incrementalGBA() {return incrementalGBA_;}
+        float mapCellSize() {return mapCellSize_;}
+        int mapResidentMB() {return mapResidentMB_;}
+        int memoryBudgetMB() {return memoryBudgetMB_;}
+        int globalCandidates() {return globalCandidates_;}
+        int globalMinKeyFrames() {return globalMinKeyFrames_;}
+        int atlasRelocMaps() {return atlasRelocMaps_;}
+        std::string remoteBackendHost() {return remoteBackendHost_;}
+        int remoteBackendPort() {return remoteBackendPort_;}
+        float remoteBackendTimeout() {return remoteBackendTimeout_;}
 
         cv::Mat M1l() {return M1l_;}
         cv::Mat M2l() {return M2l_;}
@@ -217,6 +234,7 @@ namespace ORB_SLAM3 {
         float cameraLineWidth_;
         float viewPointX_, viewPointY_, viewPointZ_, viewPointF_;
         float imageViewerScale_;
+        float mapUpdateRate_;
 
         /*
          * Save & load maps
@@ -227,6 +245,21 @@ namespace ORB_SLAM3 {
          * Other stuff
          */
         float thFarPoints_;
+        int localBAThreads_;
+        float localBATimeBudget_, localBAGainThreshold_;
+        bool backgroundInertialBA_;
+        bool asyncLoopCorrection_;
+        int loopClosingThreads_;
+        bool incrementalGBA_;
+        float mapCellSize_;
+        int mapResidentMB_;
+        int memoryBudgetMB_;
+        int globalCandidates_;
+        int globalMinKeyFrames_;
+        int atlasRelocMaps_;
+        std::string remoteBackendHost_;
+        int remoteBackendPort_;
+        float remoteBackendTimeout_;
 
     };
 };
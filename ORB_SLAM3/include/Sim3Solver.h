@@ -22,6 +22,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <random>
 
 #include "KeyFrame.h"
 
@@ -30,6 +31,10 @@
 namespace ORB_SLAM3
 {
 
+// RANSAC of the similarity between two keyframes from matched MapPoints. The solver keeps all its
+// state (matches, buffers, random generator), so the candidates of a loop or merge can be verified
+// in parallel with one solver each. The matches are stored one array per coordinate and the
+// iterations allocate nothing, the pinhole reprojections of a hypothesis run 4 points at a time.
 class Sim3Solver
 {
 public:
@@ -57,8 +62,14 @@ protected:
 
     void CheckInliers();
 
-    void Project(const std::vector<Eigen::Vector3f> &vP3Dw, std::vector<Eigen::Vector2f> &vP2D, Eigen::Matrix4f Tcw, GeometricCamera* pCamera);
-    void FromCameraToImage(const std::vector<Eigen::Vector3f> &vP3Dc, std::vector<Eigen::Vector2f> &vP2D, GeometricCamera* pCamera);
+    // Squared reprojection errors in pCamera of the points (X,Y,Z) transformed by Tcw against
+    // the keypoints (U,V), into vErr
+    static void ReprojectionErrors(const std::vector<float> &vX, const std::vector<float> &vY, const std::vector<float> &vZ,
+                                   const std::vector<float> &vU, const std::vector<float> &vV,
+                                   const Eigen::Matrix4f &Tcw, GeometricCamera* pCamera, std::vector<float> &vErr);
+
+    // Draws the minimal set of 3 correspondences into P3Dc1i and P3Dc2i
+    void SampleMinimalSet(Eigen::Matrix3f &P3Dc1i, Eigen::Matrix3f &P3Dc2i);
 
 
 protected:
@@ -67,16 +78,18 @@ protected:
     KeyFrame* mpKF1;
     KeyFrame* mpKF2;
 
-    std::vector<Eigen::Vector3f> mvX3Dc1;
-    std::vector<Eigen::Vector3f> mvX3Dc2;
+    // Matched points in their camera frames
+    std::vector<float> mvX1, mvY1, mvZ1;
+    std::vector<float> mvX2, mvY2, mvZ2;
     std::vector<MapPoint*> mvpMapPoints1;
     std::vector<MapPoint*> mvpMapPoints2;
     std::vector<MapPoint*> mvpMatches12;
     std::vector<size_t> mvnIndices1;
     std::vector<size_t> mvSigmaSquare1;
     std::vector<size_t> mvSigmaSquare2;
-    std::vector<size_t> mvnMaxError1;
-    std::vector<size_t> mvnMaxError2;
+    // Inlier thresholds on the squared errors (9.210*sigma^2, truncated to whole pixels^2)
+    std::vector<float> mvMaxError1;
+    std::vector<float> mvMaxError2;
 
     int N;
     int mN1;
@@ -87,12 +100,12 @@ protected:
     float ms12i;
     Eigen::Matrix4f mT12i;
     Eigen::Matrix4f mT21i;
-    std::vector<bool> mvbInliersi;
+    std::vector<unsigned char> mvbInliersi;
     int mnInliersi;
 
     // Current Ransac State
     int mnIterations;
-    std::vector<bool> mvbBestInliers;
+    std::vector<unsigned char> mvbBestInliers;
     int mnBestInliers;
     Eigen::Matrix4f mBestT12;
     Eigen::Matrix3f mBestRotation;
@@ -104,10 +117,19 @@ protected:
 
     // Indices for random selection
     std::vector<size_t> mvAllIndices;
+    std::vector<size_t> mvAvailableIndices;
+
+    // Own generator, seeded from the keyframes, so several solvers can run at the same time and
+    // the hypotheses do not depend on the thread scheduling
+    std::minstd_rand mRandomGenerator;
+
+    // Projections of the points in their own image
+    std::vector<float> mvU1, mvV1;
+    std::vector<float> mvU2, mvV2;
 
-    // Projections
-    std::vector<Eigen::Vector2f> mvP1im1;
-    std::vector<Eigen::Vector2f> mvP2im2;
+    // Squared errors of the hypothesis, set 2 in image 1 and set 1 in image 2
+    std::vector<float> mvErr1;
+    std::vector<float> mvErr2;
 
     // RANSAC probability
     double mRansacProb;
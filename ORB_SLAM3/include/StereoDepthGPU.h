@@ -0,0 +1,104 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef STEREODEPTHGPU_H
+#define STEREODEPTHGPU_H
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <mutex>
+
+namespace ORB_SLAM3
+{
+
+// Dense depth of a stereo pair by semi-global matching on the GPU (the Mali-G610 of the RK3588)
+// with OpenCL, at a reduced resolution. The images are downscaled by nDownscale, or rectified
+// and downscaled in one pass with the maps of MultiCameraRig::GetStereoRectification(). Census
+// costs are aggregated along four paths and the disparities of the left image are kept where
+// they agree with those of the right one.
+//
+// Submit() queues a pair and returns, so the GPU matches while the caller extracts features;
+// Wait() returns its depth map. The last depth map is also kept for other consumers
+// (passthrough, occlusion), see GetLatestDepth(). Without HAVE_OPENCL or a GPU, Submit() fails
+// and the caller keeps its sparse stereo search.
+class StereoDepthGPU
+{
+public:
+    // imageSize is the size of the images passed to Submit(), bf the baseline times the focal
+    // length at that size, nMaxDisparity the search range at the reduced resolution (rounded up to
+    // a power of two, 16 to 256). nP1 and nP2 are the smoothness penalties of SGM, nP2 is lowered
+    // across intensity edges.
+    StereoDepthGPU(const cv::Size &imageSize, float bf, int nDownscale = 2, int nMaxDisparity = 64,
+                   int nP1 = 8, int nP2 = 96);
+    ~StereoDepthGPU();
+
+    bool IsGPUAvailable() const;
+
+    // Maps of the rectified, downscaled images into the images passed to Submit() (CV_32FC1, all
+    // of the reduced size), e.g. from MultiCameraRig::GetStereoRectification() at GetDepthSize().
+    // Empty maps mean the images are already rectified. With maps, bf must be that of the
+    // rectified images scaled to imageSize (rectified fx * baseline * nDownscale).
+    bool SetRectification(const cv::Mat &mapLeftX, const cv::Mat &mapLeftY,
+                          const cv::Mat &mapRightX, const cv::Mat &mapRightY);
+
+    // Queues the matching of a pair of CV_8UC1 images of imageSize. The images are kept
+    // referenced until Wait(). Returns false if the GPU is not available.
+    bool Submit(const cv::Mat &imLeft, const cv::Mat &imRight, double timestamp);
+
+    // Depth of the submitted pair along the optical axis of the rectified left camera, CV_32FC1
+    // at the reduced resolution, 0 where unknown. Returns false if nothing was submitted or the
+    // matching failed.
+    bool Wait(cv::Mat &depth);
+
+    // Last depth map returned by Wait() and the timestamp of its pair. Thread-safe.
+    bool GetLatestDepth(cv::Mat &depth, double &timestamp);
+
+    int GetDownscale() const;
+    cv::Size GetDepthSize() const;
+
+private:
+    // OpenCL objects and buffers, defined with HAVE_OPENCL
+    struct CLState;
+
+    bool InitializeCL();
+
+    std::unique_ptr<CLState> mpCL;
+
+    cv::Size mImageSize;
+    cv::Size mDepthSize;
+    float mbf;
+    int mnDownscale;
+    int mnMaxDisparity;
+    int mnP1, mnP2;
+
+    // Pair in flight
+    cv::Mat mImLeft, mImRight;
+    cv::Mat mDepth;
+    double mTimestamp;
+    bool mbPending;
+
+    std::mutex mMutexLatest;
+    cv::Mat mLatestDepth;
+    double mLatestTimestamp;
+};
+
+} //namespace ORB_SLAM
+
+#endif // STEREODEPTHGPU_H
@@ -26,6 +26,7 @@
 #include<stdlib.h>
 #include<string>
 #include<thread>
+#include<atomic>
 #include<opencv2/core/core.hpp>
 
 #include "Tracking.h"
@@ -79,6 +80,7 @@ class Tracking;
 class LocalMapping;
 class LoopClosing;
 class Settings;
+class StereoDepthGPU;
 
 class System
 {
@@ -97,6 +99,7 @@ public:
     enum FileType{
         TEXT_FILE=0,
         BINARY_FILE=1,
+        ATLAS_FILE=2, // sectioned atlas file, see Atlas::SaveToFile
     };
 
 public:
@@ -167,9 +170,26 @@ public:
     // See format details at: http://www.cvlibs.net/datasets/kitti/eval_odometry.php
     void SaveTrajectoryKITTI(const string &filename);
 
-    // TODO: Save/Load functions
-    // SaveMap(const string &filename);
-    // LoadMap(const string &filename);
+    // Save the atlas to an atlas file, Local Mapping is stopped while saving.
+    bool SaveMap(const string &filename);
+    // Load an atlas file saved with the same vocabulary. Only before tracking starts, the loaded maps are
+    // kept and a new map is started.
+    bool LoadMap(const string &filename);
+
+    // Save the atlas to an atlas file on a low priority thread while tracking continues. Local Mapping is
+    // stopped and Loop Closing held only while the maps are serialized in memory, the file is written
+    // afterwards at most nBytesPerSecond (0 unthrottled). False if a checkpoint is still being written.
+    bool Checkpoint(const string &filename, size_t nBytesPerSecond);
+    bool isCheckpointing();
+
+    // Offline mapping of a recording: Local Mapping runs every local BA to its end and tracking waits for it
+    // instead of dropping keyframes (see LocalMapping::SetRealTime). On by default.
+    void SetRealTime(bool bRealTime);
+
+    // Global BA of every map of the atlas, e.g. before saving a map built offline. The keyframes queued for
+    // Local Mapping are processed first and Local Mapping is stopped while it runs, inertial maps get the
+    // full inertial BA. Call it once the input has ended.
+    void RunGlobalBundleAdjustment(int nIterations);
 
     // Information from most recent processed frame
     // You can call this right after TrackMonocular (or stereo or RGBD)
@@ -186,6 +206,17 @@ public:
 
     float GetImageScale();
 
+    // Without a Viewer the drawers are disabled (headless). A debug view can sample the FrameDrawer
+    // every nFrames-th frame instead, 0 disables it again.
+    void SetDrawerUpdateInterval(int nFrames);
+
+    // Dense depth of the stereo pairs on the GPU (pinhole STEREO and IMU_STEREO), read by the
+    // tracking for the keypoint depths. The matcher must outlive the System, nullptr disables it.
+    void SetStereoDepth(StereoDepthGPU* pStereoDepth);
+
+    // MD5 of a file, e.g. of the text vocabulary an atlas was created with
+    static string CalculateCheckSum(string filename, int type);
+
 #ifdef REGISTER_TIMES
     void InsertRectTime(double& time);
     void InsertResizeTime(double& time);
@@ -197,7 +228,10 @@ private:
     void SaveAtlas(int type);
     bool LoadAtlas(int type);
 
-    string CalculateCheckSum(string filename, int type);
+    // Loads a binary vocabulary (.bin, see tools/bin_vocabulary) or a text one
+    bool LoadVocabulary(const string &strVocFile);
+    // Checksum of the text vocabulary, read from the header of a binary one
+    string GetVocabularyCheckSum();
 
     // Input sensor
     eSensor mSensor;
@@ -224,6 +258,9 @@ private:
     // a pose graph optimization and full bundle adjustment (in a new thread) afterwards.
     LoopClosing* mpLoopCloser;
 
+    // Remote back end of the loop closing's Global BA, NULL unless LoopClosing.remoteBackendHost is set
+    RemoteBackend* mpRemoteBackend;
+
     // The viewer draws the map and the current camera pose. It uses Pangolin.
     Viewer* mpViewer;
 
@@ -236,6 +273,11 @@ private:
     std::thread* mptLoopClosing;
     std::thread* mptViewer;
 
+    // Checkpoint thread, mMutexSnapshot serializes the map snapshots of the checkpoints and SaveMap
+    std::thread* mptCheckpoint;
+    std::atomic<bool> mbCheckpointing;
+    std::mutex mMutexSnapshot;
+
     // Reset flag
     std::mutex mMutexReset;
     bool mbReset;
@@ -260,6 +302,7 @@ private:
     string mStrSaveAtlasToFile;
 
     string mStrVocabularyFilePath;
+    string mStrVocabularyChecksum;
 
     Settings* settings_;
 };
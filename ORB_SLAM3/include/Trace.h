@@ -0,0 +1,162 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// Compiles the TRACE_* trace points in, without it they expand to nothing
+//#define ENABLE_TRACING
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "EnergyCounters.h"
+#include "PmuCounters.h"
+
+namespace ORB_SLAM3
+{
+
+// Spans, counters and flows of the pipeline threads (camera acquisition, TPU, tracking, local
+// mapping, loop closing, IMU), exported as a Chrome JSON trace that the Perfetto UI and
+// trace_processor open. Every thread records into its own ring of events, without a lock and
+// without allocating after its first event: an event is a read of CLOCK_MONOTONIC (the clock of
+// the V4L2 and latency stamps) and a 32 byte store, about 20 ns on the A76 cores. A ring keeps the
+// last nEventsPerThread events of its thread, so a capture can run for as long as needed and
+// holds the moments before Stop().
+//
+// Names must be string literals, only their address is recorded. Flows link the spans of a frame
+// across threads; the id of a frame is its timestamp (FlowId), which every stage knows.
+class Tracer
+{
+public:
+    enum EventType : uint8_t
+    {
+        BEGIN = 0,
+        END,
+        INSTANT,
+        COUNTER,
+        FLOW_START,
+        FLOW_STEP,
+        FLOW_END
+    };
+
+    // Starts recording, threads that record for the first time get rings of nEventsPerThread
+    // events (rounded up to a power of two). Only events after the last Start() are exported.
+    static void Start(size_t nEventsPerThread = 1 << 16);
+    static void Stop();
+
+    static bool IsEnabled()
+    {
+        return sbEnabled.load(std::memory_order_relaxed);
+    }
+
+    static void Record(EventType type, const char* name, int64_t value = 0)
+    {
+        if(IsEnabled())
+            Write(type, name, value);
+    }
+
+    // Name of the calling thread in the trace, instead of its kernel name
+    static void SetThreadName(const char* name);
+
+    // Id of the flow of the frame with this timestamp (seconds)
+    static int64_t FlowId(double timestamp);
+
+    // Writes the events of all threads since the last Start(). May run while threads record;
+    // the events they overwrite meanwhile are dropped.
+    static bool ExportChromeTrace(const std::string &filename);
+
+    // Records an event into the ring of the calling thread
+    static void Write(EventType type, const char* name, int64_t value);
+
+private:
+    static std::atomic<bool> sbEnabled;
+};
+
+// Span of the scope it is declared in, with an optional value shown as its argument. With
+// PmuCounters started it is also a stage of the hardware counters, with EnergyCounters started a
+// stage of the rail energy.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name, int64_t value = 0): mbActive(Tracer::IsEnabled()),
+        mpCountedName(PmuCounters::IsEnabled() ? name : nullptr),
+        mpMeteredName(EnergyCounters::IsEnabled() ? name : nullptr)
+    {
+        if(mbActive)
+            Tracer::Write(Tracer::BEGIN, name, value);
+        if(mpCountedName)
+            PmuCounters::BeginSpan();
+        if(mpMeteredName)
+            EnergyCounters::BeginSpan();
+    }
+
+    ~TraceScope()
+    {
+        if(mpMeteredName)
+            EnergyCounters::EndSpan(mpMeteredName);
+        if(mpCountedName)
+            PmuCounters::EndSpan(mpCountedName);
+        if(mbActive)
+            Tracer::Write(Tracer::END, nullptr, 0);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    // A span started before Stop() is still ended
+    bool mbActive;
+    const char* mpCountedName;
+    const char* mpMeteredName;
+};
+
+} //namespace ORB_SLAM
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef ENABLE_TRACING
+#define TRACE_SCOPE(name) ORB_SLAM3::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_VALUE(name, value) ORB_SLAM3::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, (int64_t)(value))
+#define TRACE_BEGIN(name) ORB_SLAM3::Tracer::Record(ORB_SLAM3::Tracer::BEGIN, name)
+#define TRACE_END() ORB_SLAM3::Tracer::Record(ORB_SLAM3::Tracer::END, nullptr)
+#define TRACE_INSTANT(name, value) ORB_SLAM3::Tracer::Record(ORB_SLAM3::Tracer::INSTANT, name, (int64_t)(value))
+#define TRACE_COUNTER(name, value) ORB_SLAM3::Tracer::Record(ORB_SLAM3::Tracer::COUNTER, name, (int64_t)(value))
+// Flows of a frame, bound to the span they are recorded in
+#define TRACE_FLOW_START(timestamp) ORB_SLAM3::Tracer::Record(ORB_SLAM3::Tracer::FLOW_START, "frame", ORB_SLAM3::Tracer::FlowId(timestamp))
+#define TRACE_FLOW_STEP(timestamp) ORB_SLAM3::Tracer::Record(ORB_SLAM3::Tracer::FLOW_STEP, "frame", ORB_SLAM3::Tracer::FlowId(timestamp))
+#define TRACE_FLOW_END(timestamp) ORB_SLAM3::Tracer::Record(ORB_SLAM3::Tracer::FLOW_END, "frame", ORB_SLAM3::Tracer::FlowId(timestamp))
+#define TRACE_THREAD_NAME(name) ORB_SLAM3::Tracer::SetThreadName(name)
+#else
+#define TRACE_SCOPE(name) do {} while(0)
+#define TRACE_SCOPE_VALUE(name, value) do {} while(0)
+#define TRACE_BEGIN(name) do {} while(0)
+#define TRACE_END() do {} while(0)
+#define TRACE_INSTANT(name, value) do {} while(0)
+#define TRACE_COUNTER(name, value) do {} while(0)
+#define TRACE_FLOW_START(timestamp) do {} while(0)
+#define TRACE_FLOW_STEP(timestamp) do {} while(0)
+#define TRACE_FLOW_END(timestamp) do {} while(0)
+#define TRACE_THREAD_NAME(name) do {} while(0)
+#endif
+
+#endif // TRACE_H
@@ -29,6 +29,7 @@
 #include "LocalMapping.h"
 #include "LoopClosing.h"
 #include "Frame.h"
+#include "ORBmatcher.h"
 #include "ORBVocabulary.h"
 #include "KeyFrameDatabase.h"
 #include "tpu_feature_extractor.hpp" // Replaced ORBextractor
@@ -39,9 +40,11 @@
 #include "Settings.h"
 
 #include "GeometricCamera.h"
+#include "ProfiledMutex.h"
 
 #include <mutex>
 #include <unordered_set>
+#include <unordered_map>
 
 namespace ORB_SLAM3
 {
@@ -53,6 +56,7 @@ class LocalMapping;
 class LoopClosing;
 class System;
 class Settings;
+class StereoDepthGPU;
 
 class Tracking
 {  
@@ -103,6 +107,42 @@ public:
     int GetNumberDataset();
     int GetMatchesInliers();
 
+    // Maximum number of keyframes in the local map the frame is tracked against
+    void SetMaxLocalKeyFrames(int n);
+    int GetMaxLocalKeyFrames();
+
+    // Spread the local map projection and matching over a thread pool, e.g. one shared
+    // with the caller, in batches of MapPoints. An empty function restores the serial search.
+    void SetParallelFor(const ORBmatcher::ParallelFor& parallelFor);
+
+    // Queue for the Bag of Words of the frames likely to need one (keyframe candidates, tracking
+    // lost) and of the new keyframes, computed while tracking proceeds. Empty computes it on use.
+    void SetBowSubmit(const BowCache::Submit& submit);
+
+    // Dense GPU matcher of rectified pinhole stereo pairs. The keypoint depths are then read from its
+    // depth map instead of the sparse stereo search, nullptr restores it. Not owned.
+    void SetStereoDepth(StereoDepthGPU* pStereoDepth);
+
+    // Pose of the frame with this timestamp predicted by an external motion model, and the
+    // covariance of its error [dp, dtheta] (dp added to the translation, dtheta a rotation vector
+    // applied on the right of the rotation). Without an initialized IMU, TrackWithMotionModel
+    // starts from it instead of the constant velocity model and sizes the search window of each
+    // point from the covariance. Used by that frame only.
+    void SetPosePrediction(const Sophus::SE3f &Tcw, const Eigen::Matrix<float,6,6> &covariance, const double &timestamp);
+    void ClearPosePrediction();
+
+    // Pose of the camera propagated without vision while tracking is lost (e.g. IMU dead
+    // reckoning), with the covariance of its error in the convention of SetPosePrediction.
+    // Relocalization then only considers keyframes whose camera center is inside the
+    // covariance ellipsoid, falling back to the whole database if none is, and first tries
+    // to register the frame at the prior pose. Kept until replaced, cleared, or relocalized.
+    void SetRelocalizationPrior(const Sophus::SE3f &Tcw, const Eigen::Matrix<float,6,6> &covariance);
+    void ClearRelocalizationPrior();
+
+    // Number of stored Atlas maps (best ranked first) searched when relocalization in the
+    // current map fails or a new map is still initializing. 0 disables it. Visual only.
+    void SetAtlasRelocalization(int nMaps);
+
     //DEBUG
     void SaveSubTrajectory(string strNameFile_frames, string strNameFile_kf, string strFolder="");
     void SaveSubTrajectory(string strNameFile_frames, string strNameFile_kf, Map* pMap);
@@ -211,17 +251,32 @@ protected:
     void UpdateLastFrame();
     bool TrackWithMotionModel();
     bool PredictStateIMU();
+    // Takes the prediction set for the current frame, if any
+    bool TakePosePrediction(Sophus::SE3f &Tcw, Eigen::Matrix<float,6,6> &covariance);
 
     bool Relocalization();
+    // Matches the map points of the candidates projected at the prior pose, no RANSAC
+    bool RelocalizationFromPrior(const vector<KeyFrame*> &vpCandidateKFs, const Sophus::SE3f &Tcw);
+    // Parallel RANSAC over the candidates, returns the index of the one registered or -1
+    int RelocalizationFromCandidates(const vector<KeyFrame*> &vpCandidateKFs);
+    // Relocalizes against the keyframes of all maps and switches to the map registered in
+    bool RelocalizationInAtlas();
 
     void UpdateLocalMap();
     void UpdateLocalPoints();
-    void UpdateLocalKeyFrames();
+    // Returns false if the local keyframes were kept from the previous frame
+    bool UpdateLocalKeyFrames();
 
     bool TrackLocalMap();
     void SearchLocalPoints();
 
+    // Runs job(0) ... job(n-1) through mParallelFor, or inline if it is not set
+    void RunParallel(int n, const std::function<void(int)>& job);
+
     bool NeedNewKeyFrame();
+    // Last say on a keyframe NeedNewKeyFrame would insert, weighing what it adds to the map
+    // against its cost to local mapping. bUrgent when tracking is weak. Accepts all by default.
+    virtual bool AcceptKeyFrame(bool bUrgent);
     void CreateNewKeyFrame();
 
     // Perform preintegration from last frame
@@ -240,7 +295,7 @@ protected:
 
     // Vector of IMU measurements from previous to current frame (to be filled by PreintegrateIMU)
     std::vector<IMU::Point> mvImuFromLastFrame;
-    std::mutex mMutexImuQueue;
+    ProfiledMutex mMutexImuQueue{"Tracking::mMutexImuQueue"};
 
     // Imu calibration parameters
     IMU::Calib *mpImuCalib;
@@ -273,7 +328,50 @@ protected:
     //Local Map
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
+    int mnMaxLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
+    // Geometry of the local MapPoints searched in the current frame, reused across frames
+    LocalMapSnapshot mLocalMapSnapshot;
+    ORBmatcher::ParallelFor mParallelFor;
+    BowCache::Submit mBowSubmit;
+
+    StereoDepthGPU* mpStereoDepth;
+
+    // Inputs of the last local map. While the map version of local mapping, the map and
+    // its change index and the last keyframe are the same, the observations of the MapPoints
+    // are unchanged, so the keyframe votes are updated with the MapPoints that started or
+    // stopped voting, and the local map is kept if the voted keyframes are the same.
+    struct LocalMapCache
+    {
+        bool bValid;
+        unsigned long nMapVersion;
+        Map* pMap;
+        int nMapChangeIndex;
+        KeyFrame* pLastKF;
+        bool bVoteLastFrame;
+
+        // Voting MapPoints, with their number of keypoints in the frame and the keyframes observing them
+        std::unordered_map<MapPoint*, std::pair<int, std::vector<KeyFrame*> > > mVoters;
+        std::map<KeyFrame*,int> mKeyFrameVotes;
+        std::vector<KeyFrame*> vpVotedKFs;
+
+        // Keypoints per voting MapPoint in the frame, reused every frame
+        std::unordered_map<MapPoint*,int> mFrameVoters;
+    };
+    LocalMapCache mLocalMapCache;
+
+    // External pose prediction for the next frame
+    std::mutex mMutexPosePrediction;
+    bool mbPosePrediction;
+    Sophus::SE3f mPredictedTcw;
+    Eigen::Matrix<float,6,6> mPredictedCovariance;
+    double mPredictionTimestamp;
+
+    // External pose prior for relocalization
+    std::mutex mMutexRelocalizationPrior;
+    bool mbRelocalizationPrior;
+    Sophus::SE3f mRelocalizationPriorTcw;
+    Eigen::Matrix<float,6,6> mRelocalizationPriorCovariance;
     
     // System
     System* mpSystem;
@@ -321,6 +419,20 @@ protected:
     unsigned int mnLastKeyFrameId;
     unsigned int mnLastRelocFrameId;
     double mTimeStampLost;
+
+    // Relocalization RANSAC: iterations per turn of a candidate, and iterations
+    // after which a candidate with less than half the best support is dropped
+    static const int kRelocRansacIterations = 5;
+    static const int kRelocPreemptIterations = 20;
+
+    // Relocalization prior: candidates tried at the prior pose, and the radius (meters) added
+    // to the position uncertainty, as a keyframe can see the scene from a few steps away
+    static const int kRelocPriorCandidates = 3;
+    static constexpr float kRelocPriorMinRadius = 0.5f;
+
+    // Atlas relocalization: maps searched (0 disables) and candidates kept per map
+    int mnAtlasRelocMaps;
+    static const int kAtlasRelocCandidates = 5;
     double time_recently_lost;
 
     unsigned int mnFirstFrameId;
@@ -54,6 +54,14 @@ namespace ORB_SLAM3
 
         float CheckFundamental(const Eigen::Matrix3f &F21, std::vector<bool> &vbMatchesInliers, float sigma);
 
+        // Same scores without the inliers, branch-free over the matched point arrays
+        float ScoreHomography(const Eigen::Matrix3f &H21, const Eigen::Matrix3f &H12, float sigma) const;
+
+        float ScoreFundamental(const Eigen::Matrix3f &F21, float sigma) const;
+
+        // Threads each model splits its RANSAC iterations across
+        int RansacThreads() const;
+
         bool ReconstructF(std::vector<bool> &vbMatchesInliers, Eigen::Matrix3f &F21, Eigen::Matrix3f &K,
                           Sophus::SE3f &T21, std::vector<cv::Point3f> &vP3D, std::vector<bool> &vbTriangulated, float minParallax, int minTriangulated);
 
@@ -80,6 +88,13 @@ namespace ORB_SLAM3
         std::vector<Match> mvMatches12;
         std::vector<bool> mvbMatched1;
 
+        // Matched keypoints in pixels, one entry per match, for the scoring loops
+        std::vector<float> mvMatchedU1, mvMatchedV1, mvMatchedU2, mvMatchedV2;
+
+        // Normalized keypoints and their normalizations, shared by both models
+        std::vector<cv::Point2f> mvPn1, mvPn2;
+        Eigen::Matrix3f mT1, mT2;
+
         // Calibration
         Eigen::Matrix3f mK;
 
@@ -92,6 +107,9 @@ namespace ORB_SLAM3
         // Ransac sets
         std::vector<std::vector<size_t> > mvSets;
 
+        // Fewest RANSAC iterations worth a thread of their own
+        static const int kMinIterationsPerThread = 25;
+
     };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,203 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef UNDISTORTIONMAP_H
+#define UNDISTORTIONMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace ORB_SLAM3
+{
+
+// Undistorted coordinates of a grid of image positions, interpolated bilinearly for
+// keypoints instead of running the iterative cv::undistortPoints solve per keypoint.
+// Cells where the interpolation is more than kMaxError pixels off cv::undistortPoints
+// at the cell centre (strong distortion near the corners) keep the exact solve. Maps
+// are built once per calibration and shared by all frames taken with it.
+class UndistortionMap
+{
+public:
+    static constexpr float kMaxError = 0.02f;
+    static const int kStep = 8;
+
+    // The map for camera matrix K, distortion distCoef and new camera matrix P over
+    // images of the given size
+    static std::shared_ptr<const UndistortionMap> Get(const cv::Mat &K, const cv::Mat &distCoef, const cv::Mat &P,
+                                                      const cv::Size &size)
+    {
+        static std::mutex mutex;
+        static std::vector<std::shared_ptr<const UndistortionMap> > vpMaps;
+
+        const std::vector<double> vKey = MakeKey(K, distCoef, P, size);
+        std::unique_lock<std::mutex> lock(mutex);
+        for(size_t i=0; i<vpMaps.size(); i++)
+        {
+            if(vpMaps[i]->mvKey == vKey)
+                return vpMaps[i];
+        }
+        vpMaps.push_back(std::shared_ptr<const UndistortionMap>(new UndistortionMap(K, distCoef, P, size, vKey)));
+        return vpMaps.back();
+    }
+
+    // Undistorts the keypoints, those outside the grid or in inexact cells are solved exactly
+    void Undistort(const std::vector<cv::KeyPoint> &vKeys, std::vector<cv::KeyPoint> &vKeysUn) const
+    {
+        const size_t N = vKeys.size();
+        vKeysUn = vKeys;
+
+        std::vector<size_t> vExact;
+        const float maxX = (mnCols-1)*kStep, maxY = (mnRows-1)*kStep;
+        for(size_t i=0; i<N; i++)
+        {
+            const float x = vKeys[i].pt.x, y = vKeys[i].pt.y;
+            if(!(x>=0.f && y>=0.f && x<=maxX && y<=maxY))
+            {
+                vExact.push_back(i);
+                continue;
+            }
+
+            const float gx = x*(1.f/kStep), gy = y*(1.f/kStep);
+            const int c = std::min((int)gx, mnCols-2);
+            const int r = std::min((int)gy, mnRows-2);
+            if(!mvbInterpolated[r*(mnCols-1)+c])
+            {
+                vExact.push_back(i);
+                continue;
+            }
+
+            const float fx = gx-c, fy = gy-r;
+            const float* p0 = &mvNodes[2*(r*mnCols+c)];
+            const float* p1 = p0 + 2*mnCols;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+            // (x,y) of the four corners, interpolated as lane pairs
+            const float32x2_t top = vmla_n_f32(vld1_f32(p0), vsub_f32(vld1_f32(p0+2), vld1_f32(p0)), fx);
+            const float32x2_t bottom = vmla_n_f32(vld1_f32(p1), vsub_f32(vld1_f32(p1+2), vld1_f32(p1)), fx);
+            const float32x2_t un = vmla_n_f32(top, vsub_f32(bottom, top), fy);
+            vKeysUn[i].pt.x = vget_lane_f32(un, 0);
+            vKeysUn[i].pt.y = vget_lane_f32(un, 1);
+#else
+            const float topX = p0[0] + fx*(p0[2]-p0[0]), topY = p0[1] + fx*(p0[3]-p0[1]);
+            const float bottomX = p1[0] + fx*(p1[2]-p1[0]), bottomY = p1[1] + fx*(p1[3]-p1[1]);
+            vKeysUn[i].pt.x = topX + fy*(bottomX-topX);
+            vKeysUn[i].pt.y = topY + fy*(bottomY-topY);
+#endif
+        }
+
+        if(vExact.empty())
+            return;
+
+        cv::Mat mat(vExact.size(), 1, CV_32FC2);
+        for(size_t i=0; i<vExact.size(); i++)
+            mat.at<cv::Vec2f>(i) = cv::Vec2f(vKeys[vExact[i]].pt.x, vKeys[vExact[i]].pt.y);
+        cv::undistortPoints(mat, mat, mK, mDistCoef, cv::Mat(), mP);
+        for(size_t i=0; i<vExact.size(); i++)
+        {
+            vKeysUn[vExact[i]].pt.x = mat.at<cv::Vec2f>(i)[0];
+            vKeysUn[vExact[i]].pt.y = mat.at<cv::Vec2f>(i)[1];
+        }
+    }
+
+    // Fraction of the cells that are interpolated
+    float GetCoverage() const
+    {
+        return mvbInterpolated.empty() ? 0.f :
+               (float)std::count(mvbInterpolated.begin(), mvbInterpolated.end(), 1) / mvbInterpolated.size();
+    }
+
+private:
+    UndistortionMap(const cv::Mat &K, const cv::Mat &distCoef, const cv::Mat &P, const cv::Size &size,
+                    const std::vector<double> &vKey):
+        mK(K.clone()), mDistCoef(distCoef.clone()), mP(P.clone()), mvKey(vKey)
+    {
+        mnCols = (size.width + kStep-1)/kStep + 1;
+        mnRows = (size.height + kStep-1)/kStep + 1;
+
+        std::vector<float> vCentres;
+        Solve(0.f, mvNodes);
+        Solve(0.5f, vCentres);
+
+        // A cell is interpolated if its centre is, the bilinear error peaks around there
+        mvbInterpolated.assign((mnRows-1)*(mnCols-1), 0);
+        for(int r=0; r+1<mnRows; r++)
+        {
+            for(int c=0; c+1<mnCols; c++)
+            {
+                const float* p0 = &mvNodes[2*(r*mnCols+c)];
+                const float* p1 = p0 + 2*mnCols;
+                const float* e = &vCentres[2*(r*mnCols+c)];
+                const float ex = 0.25f*(p0[0]+p0[2]+p1[0]+p1[2]) - e[0];
+                const float ey = 0.25f*(p0[1]+p0[3]+p1[1]+p1[3]) - e[1];
+                mvbInterpolated[r*(mnCols-1)+c] = ex*ex+ey*ey <= kMaxError*kMaxError;
+            }
+        }
+    }
+
+    // Exact undistortion of the grid positions shifted by offset steps
+    void Solve(const float offset, std::vector<float> &vPoints) const
+    {
+        cv::Mat mat(mnRows*mnCols, 1, CV_32FC2);
+        for(int r=0; r<mnRows; r++)
+            for(int c=0; c<mnCols; c++)
+                mat.at<cv::Vec2f>(r*mnCols+c) = cv::Vec2f((c+offset)*kStep, (r+offset)*kStep);
+        cv::undistortPoints(mat, mat, mK, mDistCoef, cv::Mat(), mP);
+        vPoints.assign(mat.ptr<float>(), mat.ptr<float>() + 2*mnRows*mnCols);
+    }
+
+    static std::vector<double> MakeKey(const cv::Mat &K, const cv::Mat &distCoef, const cv::Mat &P, const cv::Size &size)
+    {
+        std::vector<double> vKey;
+        vKey.push_back(size.width);
+        vKey.push_back(size.height);
+        const cv::Mat* mats[3] = {&K, &distCoef, &P};
+        for(int m=0; m<3; m++)
+        {
+            cv::Mat values;
+            mats[m]->convertTo(values, CV_64F);
+            values = values.reshape(1, 1);
+            vKey.push_back(values.total());
+            for(size_t i=0; i<values.total(); i++)
+                vKey.push_back(values.at<double>(0, i));
+        }
+        return vKey;
+    }
+
+    cv::Mat mK, mDistCoef, mP;
+    std::vector<double> mvKey;
+
+    int mnCols, mnRows;
+    // Undistorted (x,y) of the position (c*kStep, r*kStep) at 2*(r*mnCols+c)
+    std::vector<float> mvNodes;
+    // Per cell, row major over the (mnRows-1) x (mnCols-1) cells
+    std::vector<unsigned char> mvbInterpolated;
+};
+
+} //namespace ORB_SLAM
+
+#endif // UNDISTORTIONMAP_H
@@ -1,9 +1,15 @@
 #ifndef TPU_FEATURE_EXTRACTOR_HPP
 #define TPU_FEATURE_EXTRACTOR_HPP
 
+#include <atomic>
 #include <vector>
 #include <string>
 #include <memory>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
 #include "opencv2/core/mat.hpp"
 #include "opencv2/features2d.hpp"
 
@@ -16,31 +22,123 @@ namespace tflite {
 namespace ORB_SLAM3
 {
 
+class RGAPyramid;
+
 /**
  * @brief TPU-accelerated feature extractor using SuperPoint model
  * 
  * This class implements a feature extractor compatible with ORB-SLAM3
  * that uses the EdgeTPU to accelerate the SuperPoint neural network model.
- * It is designed to be a drop-in replacement for ORBextractor.
+ * It is designed to be a drop-in replacement for ORBextractor. The same
+ * model can run on a core of the RK3588 NPU instead (Backend::RKNN_NPU).
  */
 class TPUFeatureExtractor
 {
 public:
+    /**
+     * @brief Format of the extracted descriptors
+     */
+    enum class DescriptorMode {
+        FLOAT_NEAREST,    ///< CV_32F rows of the nearest descriptor cell, L2-normalized
+        FLOAT_BILINEAR,   ///< CV_32F rows interpolated between the four nearest cells, L2-normalized
+        BINARY_BILINEAR   ///< CV_8U rows of the interpolated descriptor's signs (256 bits = 32 bytes, like ORB)
+    };
+
+    /**
+     * @brief Accelerator the model runs on
+     */
+    enum class Backend {
+        EDGETPU,          ///< EdgeTPU-compiled .tflite model via the EdgeTPU delegate (CPU if no device)
+        RKNN_NPU          ///< RKNN-compiled .rknn model on the RK3588 NPU (builds with HAVE_RKNN only)
+    };
+
+    /**
+     * @brief When the extractor moves along its model ladder (see AddModelRung())
+     */
+    struct LadderConfig {
+        double degrade_latency_ms = 12.0;   ///< Smoothed time per call above which the next cheaper rung is taken
+        double recover_latency_ms = 7.0;    ///< Predicted time per call of the dearer rung below which it is taken back
+        int hold_frames = 30;               ///< Calls on a rung before it is left for latency
+        double smoothing = 0.1;             ///< Weight of the newest call in the smoothed time
+    };
+
     /**
      * @brief Constructor
      * 
-     * @param model_path Path to the TFLite model file (EdgeTPU-compiled SuperPoint)
-     * @param delegate_path Path to EdgeTPU delegate library (optional, usually auto-detected)
+     * @param model_path Path to the model file (EdgeTPU-compiled SuperPoint, or RKNN-compiled for the NPU)
+     * @param delegate_path Path to EdgeTPU delegate library (optional, usually auto-detected; unused on the NPU)
      * @param n_features_target Target number of features to extract
      * @param scale_factor Scale factor between pyramid levels
      * @param n_levels Number of pyramid levels
+     * @param device_index EdgeTPU device to run on, as listed by ListEdgeTPUDevices() (-1 for the first one),
+     *                     or NPU core (0 to 2, -1 for any idle core) on the NPU
+     * @param backend Accelerator the model runs on
      */
     TPUFeatureExtractor(
         const std::string& model_path,
         const std::string& delegate_path,
         int n_features_target,
         float scale_factor,
-        int n_levels);
+        int n_levels,
+        int device_index = -1,
+        Backend backend = Backend::EDGETPU);
+    
+    /**
+     * @brief Enumerate the EdgeTPU devices (PCIe and USB)
+     * 
+     * @return Device paths, indexed like the device_index constructor argument
+     */
+    static std::vector<std::string> ListEdgeTPUDevices();
+    
+    /**
+     * @brief Map a model into the process-wide model cache
+     * 
+     * Extractors load their model through the cache, so extractors of the
+     * same model (one per camera or device, or recreated after a restart of
+     * a component) share one memory-mapped FlatBuffer. Preloading also asks
+     * the kernel to read the mapping ahead. Call it early during start-up to
+     * overlap the file I/O with the initialization of other components.
+     * 
+     * @param model_path Path to the .tflite model
+     * @return true if the model is in the cache, false if it failed to load
+     */
+    static bool PreloadModel(const std::string& model_path);
+    
+    /**
+     * @brief Run dummy inferences to upload the model parameters to the EdgeTPU
+     * 
+     * The first Invoke() on a device pays for caching the parameters in the
+     * EdgeTPU memory. Warm-up runs on its own interpreter, so it may overlap
+     * with extraction, which then shares the device.
+     * 
+     * @param iterations Number of dummy inferences
+     * @return true if all inferences succeeded, false otherwise
+     */
+    bool Warmup(int iterations = 2);
+    
+    /**
+     * @brief Run Warmup() on a background thread
+     * 
+     * Does nothing if a warm-up is already running or done.
+     * 
+     * @param iterations Number of dummy inferences
+     */
+    void StartWarmup(int iterations = 2);
+    
+    /**
+     * @brief Wait for a warm-up to finish
+     * 
+     * @param timeout_ms Timeout in milliseconds (-1 to wait indefinitely)
+     * @return true if the extractor is warmed up, false on timeout or failure
+     */
+    bool WaitForWarmup(int timeout_ms = -1);
+    
+    /**
+     * @brief Check if a warm-up finished successfully
+     * 
+     * @return true if the extractor is warmed up, false otherwise
+     */
+    bool IsWarmedUp() const;
     
     /**
      * @brief Destructor
@@ -66,6 +164,326 @@ public:
         cv::OutputArray descriptors_out,
         std::vector<int>& vLappingArea);
 
+    /**
+     * @brief Extract features using a pre-scaled model input
+     * 
+     * Same as the ORBextractor-compatible operator, but runs the model on
+     * model_input (e.g. a hardware-scaled plane from the camera ISP) and maps
+     * the keypoints back to the full-resolution image_in. If model_input
+     * already matches the model input size, no resize is done on the CPU.
+     * 
+     * @param image_in Full-resolution input image
+     * @param model_input_in Scaled copy of image_in (empty to scale image_in)
+     * @param mask_in Optional mask in full-resolution coordinates
+     * @param keypoints Output vector of detected keypoints
+     * @param descriptors_out Output matrix of descriptors
+     * @param vLappingArea Output vector for stereo/overlapping regions
+     * @return Number of detected keypoints
+     */
+    int operator()(
+        cv::InputArray image_in,
+        cv::InputArray model_input_in,
+        cv::InputArray mask_in,
+        std::vector<cv::KeyPoint>& keypoints,
+        cv::OutputArray descriptors_out,
+        std::vector<int>& vLappingArea);
+
+    /**
+     * @brief Extract features from several images in one pass
+     * 
+     * Used for the synchronized frames of a multi-camera rig. With a model
+     * compiled with a batch dimension all images of a batch are uploaded and
+     * run in a single Invoke(), and each batch is postprocessed on worker
+     * threads while the next one runs; single-image models go through the
+     * Submit()/Complete() pipeline. The image pyramid (mvImagePyramid) is
+     * not built.
+     * 
+     * @param images Full-resolution input images
+     * @param model_inputs Scaled copies of the images (empty, or one per image; empty Mats are scaled on the CPU)
+     * @param keypoints Output keypoints, one vector per image
+     * @param descriptors Output descriptors, one matrix per image
+     * @return Total number of detected keypoints
+     */
+    int ExtractBatch(
+        const std::vector<cv::Mat>& images,
+        const std::vector<cv::Mat>& model_inputs,
+        std::vector<std::vector<cv::KeyPoint>>& keypoints,
+        std::vector<cv::Mat>& descriptors);
+
+    /**
+     * @brief Submit an image to the asynchronous extraction pipeline
+     * 
+     * Preprocesses the image on the calling thread and queues it for the
+     * TPU. Inference and NMS/descriptor postprocessing run on two pipeline
+     * threads, each image in its own input slot (interpreter), so that the
+     * caller can preprocess frame N+1 while the TPU runs frame N and frame
+     * N-1 is postprocessed. Blocks while all slots are in flight. The image
+     * pyramid (mvImagePyramid) is not built.
+     * 
+     * @param image_in Full-resolution input image
+     * @param model_input_in Scaled copy of image_in (empty to scale image_in)
+     * @param mask_in Optional mask in full-resolution coordinates (must stay valid until Complete())
+     * @return Ticket to pass to Complete(), or -1 on failure
+     */
+    int64_t Submit(
+        cv::InputArray image_in,
+        cv::InputArray model_input_in,
+        cv::InputArray mask_in);
+    
+    /**
+     * @brief Wait for a submitted image and take its results
+     * 
+     * Results can be collected in any order; each ticket can be completed once.
+     * 
+     * @param ticket Ticket returned by Submit()
+     * @param keypoints Output vector of detected keypoints
+     * @param descriptors_out Output matrix of descriptors
+     * @param vLappingArea Output vector for stereo/overlapping regions
+     * @return Number of detected keypoints, or -1 if the ticket is unknown or inference failed
+     */
+    int Complete(
+        int64_t ticket,
+        std::vector<cv::KeyPoint>& keypoints,
+        cv::OutputArray descriptors_out,
+        std::vector<int>& vLappingArea);
+    
+    /**
+     * @brief Set the number of input slots of the asynchronous pipeline
+     * 
+     * Two slots overlap preprocessing with inference; three or more also
+     * overlap postprocessing, so throughput is bounded by the slowest stage.
+     * Each slot holds its own interpreter and tensor arena.
+     * 
+     * @param num_slots Number of images that can be in flight at once (at least 1)
+     * @return true if the depth was set, false if images are in flight
+     */
+    bool SetPipelineDepth(int num_slots);
+    
+    /**
+     * @brief Get the number of input slots of the asynchronous pipeline
+     * 
+     * @return Number of images that can be in flight at once
+     */
+    int GetPipelineDepth() const;
+
+    /**
+     * @brief Get the image size the model runs on
+     * 
+     * @return Model input size
+     */
+    cv::Size GetModelInputSize() const;
+    
+    /**
+     * @brief Get the number of images the model runs per invocation
+     * 
+     * @return Batch dimension of the model input (1 for single-image models)
+     */
+    int GetBatchSize() const;
+    
+    /**
+     * @brief Check if model inputs can be bound without a copy
+     * 
+     * A single-image model with a uint8 input (the default of the EdgeTPU
+     * compiler for image models) accepts the camera bytes as they are. A
+     * model-sized, continuous, 64-byte aligned CV_8UC1 model input, such as
+     * the ISP-scaled DMA-BUF plane, is then bound as the input tensor memory
+     * instead of being copied. int8-input models need the zero point shift
+     * and are always copied.
+     * 
+     * On the NPU, single-channel models read a model input that lies in a
+     * buffer passed to RegisterDmaBuffer() straight from the DMA-BUF, if its
+     * row stride is the one the NPU expects.
+     * 
+     * @return true if the input tensor can be bound to caller memory
+     */
+    bool SupportsZeroCopyInput() const;
+    
+    /**
+     * @brief Register a DMA-BUF that model inputs may lie in (NPU only)
+     * 
+     * The NPU imports the buffer on first use and then reads model inputs
+     * within it without a copy (see SupportsZeroCopyInput()). Registering a
+     * buffer again is cheap, so it can be done for every frame. A buffer
+     * that overlaps the new one or has the same fd replaces it, since it
+     * was unmapped and its fd may have been reused.
+     * 
+     * @param dma_fd DMA-BUF file descriptor
+     * @param data Start of the buffer's CPU mapping
+     * @param size Size of the buffer in bytes
+     * @return true if the buffer is registered, false on the EdgeTPU or for an invalid buffer
+     */
+    bool RegisterDmaBuffer(int dma_fd, const void* data, size_t size);
+    
+    /**
+     * @brief Set the image pyramid of the next image, built on the RGA
+     * 
+     * The pyramid is built by an RGAPyramidBuilder from the camera buffer
+     * the next image is mapped from. The next operator() waits for its
+     * levels instead of resizing on the CPU, unless its levels differ from
+     * those of the extractor for the image. mvImagePyramid then points
+     * into the pyramid until the next image.
+     * 
+     * @param pyramid Pyramid of the next image (nullptr to build it on the CPU)
+     */
+    void SetPyramid(std::shared_ptr<RGAPyramid> pyramid);
+    
+    /**
+     * @brief Get the EdgeTPU device or NPU core the extractor runs on
+     * 
+     * @return Device index (see ListEdgeTPUDevices()) or NPU core, or -1 if running on the CPU
+     */
+    int GetDeviceIndex() const;
+    
+    /**
+     * @brief Get the accelerator the model runs on
+     * 
+     * @return Backend passed to the constructor
+     */
+    Backend GetBackend() const;
+    
+    /**
+     * @brief Set the format of the extracted descriptors
+     * 
+     * BINARY_BILINEAR descriptors are matched by BinarySuperPointMatcher and
+     * converted by DBoW2 FORB like ORB descriptors, the float modes are matched by
+     * FloatSuperPointMatcher (see DescriptorTraits.h). Set before extracting;
+     * images already in the Submit() pipeline may use either mode.
+     * 
+     * @param mode Descriptor format
+     */
+    void SetDescriptorMode(DescriptorMode mode);
+    
+    /**
+     * @brief Get the format of the extracted descriptors
+     * 
+     * @return Descriptor format
+     */
+    DescriptorMode GetDescriptorMode() const;
+    
+    /**
+     * @brief Set the number of pyramid levels the model runs on
+     * 
+     * With more than one level, the operator() runs the model on model-sized
+     * tiles of each level of mvImagePyramid (up to GetLevels()); the first
+     * level that fits into the model input, or the last requested level,
+     * runs as a whole. Keypoints carry the octave and size of their level,
+     * and a scale-aware NMS with a radius growing with the scale factor
+     * merges the levels. Costs one inference per tile. The Submit() and
+     * ExtractBatch() paths stay single-scale.
+     * 
+     * @param num_levels Number of levels (1 for single-scale inference)
+     */
+    void SetInferenceLevels(int num_levels);
+    
+    /**
+     * @brief Get the number of pyramid levels the model runs on
+     * 
+     * @return Number of levels (1 for single-scale inference)
+     */
+    int GetInferenceLevels() const;
+    
+    /**
+     * @brief Set the mask coverage below which a tile is not sent to the TPU
+     * 
+     * With a mask, tiles of the multi-level path (see SetInferenceLevels())
+     * whose fraction of non-zero mask pixels is below min_coverage are
+     * skipped, so regions that see the headset shell or the user's face cost
+     * no inference. Fully masked tiles, and fully masked frames on the
+     * single-scale path, are always skipped.
+     * 
+     * @param min_coverage Minimum fraction of valid pixels in [0, 1] (default 0)
+     */
+    void SetMinTileMaskCoverage(float min_coverage);
+    
+    /**
+     * @brief Set the number of keypoints kept per frame
+     * 
+     * May be called from another thread while extracting, it applies
+     * from the next frame on.
+     * 
+     * @param n_features_target Maximum number of keypoints (0 for no limit)
+     */
+    void SetFeatureTarget(int n_features_target);
+    
+    /**
+     * @brief Get the number of keypoints kept per frame
+     * 
+     * @return Maximum number of keypoints (0 for no limit)
+     */
+    int GetFeatureTarget() const;
+    
+    /**
+     * @brief Get the mask coverage below which a tile is not sent to the TPU
+     * 
+     * @return Minimum fraction of valid pixels
+     */
+    float GetMinTileMaskCoverage() const;
+    
+    /**
+     * @brief Add a cheaper model to the ladder the extractor degrades along
+     * 
+     * The model of the constructor is rung 0; every added model (e.g. a
+     * reduced-width SuperPoint, then one with a lower input resolution) is
+     * the next rung and should be cheaper than the one before. Each rung is
+     * loaded on the same device and backend, warmed up in the background and
+     * stays resident, so operator() and ExtractBatch() switch rungs between
+     * two calls without a stall. They take the next cheaper rung when the
+     * smoothed time per call exceeds LadderConfig::degrade_latency_ms, and
+     * the dearer one back when its time, predicted from its own unthrottled
+     * time and the current slowdown, is below recover_latency_ms. The thermal
+     * level (see SetThermalLevel()) sets the dearest rung allowed. Submit()
+     * and Complete() always run rung 0.
+     * 
+     * The descriptors of a rung must have the channels of rung 0. A rung
+     * trained to the descriptor space of the full model keeps version 0 and
+     * matches against it; any other version is reported with every call (see
+     * GetDescriptorVersion()) so that matching can keep the two apart.
+     * Add the rungs before extracting.
+     * 
+     * @param model_path Path to the model file, for the backend of this extractor
+     * @param descriptor_version Descriptor space of the model (0 for that of rung 0)
+     * @return true if the rung was added, false if the model failed to load or its descriptors differ
+     */
+    bool AddModelRung(const std::string& model_path, int descriptor_version = 0);
+    
+    /**
+     * @brief Set when the extractor moves along its model ladder
+     * 
+     * @param config Latency thresholds and hysteresis
+     */
+    void SetLadderConfig(const LadderConfig& config);
+    
+    /**
+     * @brief Set the thermal state of the accelerator
+     * 
+     * Thread-safe, applies from the next call. Level n allows no rung dearer
+     * than rung n (or the cheapest rung if there are fewer).
+     * 
+     * @param level Thermal status of the NPU zone of the power driver (0 normal, 1 warning, 2 critical, 3 emergency)
+     */
+    void SetThermalLevel(int level);
+    
+    /**
+     * @brief Get the number of models of the ladder
+     * 
+     * @return 1 plus the number of rungs added with AddModelRung()
+     */
+    int GetModelRungCount() const;
+    
+    /**
+     * @brief Get the rung of the last call
+     * 
+     * @return Rung index (0 for the model of the constructor)
+     */
+    int GetModelRung() const;
+    
+    /**
+     * @brief Get the descriptor version of the last call
+     * 
+     * @return Descriptor version of the rung that extracted the last image or batch
+     */
+    int GetDescriptorVersion() const;
+
     // --- ORBextractor-like accessors for compatibility ---
     int GetLevels();
     float GetScaleFactor();
@@ -78,12 +496,15 @@ public:
     std::vector<cv::Mat> mvImagePyramid;
 
 private:
+    // The kernel benchmarks (tests/performance/kernel_benchmarks.cpp) drive the postprocessing directly
+    friend class TPUFeatureExtractorBenchmark;
+    
     // Model paths
     std::string model_path_;
     std::string delegate_path_;
     
     // ORB-SLAM3 compatible parameters
-    int n_features_target_;
+    std::atomic<int> n_features_target_;
     float scale_factor_;
     int n_levels_;
     std::vector<float> scale_factors_;
@@ -91,12 +512,44 @@ private:
     std::vector<float> level_sigma2_;
     std::vector<float> inv_level_sigma2_;
     
+    // RGA pyramid set for the next image, and the one mvImagePyramid points into
+    std::shared_ptr<RGAPyramid> next_pyramid_;
+    std::shared_ptr<RGAPyramid> pyramid_;
+    
     // TensorFlow Lite and EdgeTPU objects
-    std::unique_ptr<tflite::FlatBufferModel> model_;
+    std::shared_ptr<tflite::FlatBufferModel> model_; // Shared through the model cache
     std::unique_ptr<tflite::Interpreter> interpreter_;
     void* edgetpu_delegate_; // TfLiteDelegate* from EdgeTPU
+    int device_index_;       // Requested EdgeTPU device (-1 for the first one)
+    bool on_edgetpu_;        // Whether the delegate was created
+    Backend backend_;
+    
+    // RKNN runtime objects of the NPU backend (defined with HAVE_RKNN)
+    struct NPUContext;
+    std::unique_ptr<NPUContext> npu_;           // Context of operator() and ExtractBatch()
+    
+    // DMA-BUFs registered for zero-copy NPU input (RegisterDmaBuffer())
+    struct DmaBuffer {
+        int fd;
+        const uint8_t* data;
+        size_t size;
+        uint64_t generation;                    // Changes when a buffer is replaced
+    };
+    std::vector<DmaBuffer> dma_buffers_;
+    uint64_t dma_buffer_generation_;
+    std::mutex dma_buffers_mutex_;
+    
+    // Zero-copy input of interpreter_ (uint8-input models only)
+    bool input_bound_;                          // Input tensor points at caller memory
+    bool input_custom_allocated_;               // AllocateTensors() ran with a custom allocation
+    std::unique_ptr<uint8_t[]> owned_input_storage_;
+    uint8_t* owned_input_;                      // 64-byte aligned input memory after unbinding
+    
+    // Tensor arena of interpreter_ registered with MemoryAccounting
+    size_t arena_bytes_;
     
     // Model input tensor dimensions
+    int input_tensor_batch_;
     int input_tensor_width_;
     int input_tensor_height_;
     int input_tensor_channels_;
@@ -121,6 +574,51 @@ private:
     float nms_radius_;
     float confidence_threshold_;
     
+    // Descriptor output format
+    DescriptorMode descriptor_mode_;
+    
+    // Number of pyramid levels the model runs on (1 for single-scale)
+    int inference_levels_;
+    
+    // Tiles with a smaller fraction of valid mask pixels are skipped
+    float min_tile_mask_coverage_;
+    
+    // Asynchronous pipeline (Submit/Complete), started on the first Submit()
+    struct PipelineSlot;
+    std::vector<std::unique_ptr<PipelineSlot>> pipeline_slots_;
+    int pipeline_depth_;
+    size_t pipeline_arena_bytes_;        // Of the slot interpreters, registered with MemoryAccounting
+    std::deque<int> tpu_queue_;          // Slots waiting for Invoke()
+    std::deque<int> postprocess_queue_;  // Slots waiting for postprocessing
+    mutable std::mutex pipeline_mutex_;
+    std::condition_variable pipeline_cv_;
+    std::thread tpu_thread_;
+    std::thread postprocess_thread_;
+    bool pipeline_running_;
+    int64_t next_ticket_;
+    
+    // Background warm-up (StartWarmup)
+    std::thread warmup_thread_;
+    mutable std::mutex warmup_mutex_;
+    std::condition_variable warmup_cv_;
+    bool warmup_running_;
+    bool warmed_up_;
+    double warmup_inference_ms_;         // Time of the last warm-up inference, 0 until warmed up
+    
+    // Model ladder (AddModelRung), rung 0 is this extractor
+    struct ModelRung {
+        std::unique_ptr<TPUFeatureExtractor> extractor; // nullptr for rung 0
+        int descriptor_version;
+        double latency_ms;                  // Smoothed time per call while on the rung, 0 until run
+        double baseline_ms;                 // Lowest smoothed time per call, the unthrottled cost
+    };
+    std::vector<ModelRung> ladder_;
+    LadderConfig ladder_config_;
+    int active_rung_;
+    int calls_on_rung_;
+    std::atomic<int> thermal_level_;
+    std::atomic<int> last_rung_;
+    
     /**
      * @brief Load the TFLite model and initialize the interpreter
      * 
@@ -128,6 +626,127 @@ private:
      */
     bool loadModel();
     
+    /**
+     * @brief Build an interpreter for the loaded model with the EdgeTPU delegate
+     * 
+     * @return Interpreter with allocated tensors, or nullptr on failure
+     */
+    std::unique_ptr<tflite::Interpreter> buildInterpreter();
+    
+    /**
+     * @brief Load the RKNN model on the NPU and read the tensor layout
+     * 
+     * @return true if successful, false otherwise (always without HAVE_RKNN)
+     */
+    bool loadNPUModel();
+    
+    /**
+     * @brief Create another context of the NPU model, sharing its weights
+     * 
+     * @return Context with its own input and output memory, or nullptr on failure
+     */
+    std::unique_ptr<NPUContext> buildNPUContext();
+    
+    /**
+     * @brief Bind or copy a preprocessed image as the input of an NPU context
+     * 
+     * The image is bound in place if it lies in a registered DMA-BUF
+     * (see RegisterDmaBuffer()) and has the input row stride of the NPU.
+     * 
+     * @param context NPU context whose input is set
+     * @param preprocessed_image Image prepared for model input
+     * @return true if successful, false otherwise
+     */
+    bool fillNPUInput(NPUContext* context, const cv::Mat& preprocessed_image);
+    
+    /**
+     * @brief Run an NPU context on its input
+     * 
+     * @param context NPU context to run
+     * @return true if successful, false otherwise
+     */
+    bool invokeNPU(NPUContext* context);
+    
+    /**
+     * @brief Get the int8 outputs of an NPU context after invokeNPU()
+     * 
+     * Same layout as getOutputData(), valid until the next invokeNPU().
+     * 
+     * @param context NPU context whose outputs are read
+     * @param semi_data Output pointer to the semi tensor ([H, W, 65])
+     * @param descriptor_data Output pointer to the descriptor tensor ([256, H, W])
+     * @return true if successful, false otherwise
+     */
+    bool getNPUOutputData(
+        NPUContext* context,
+        const int8_t*& semi_data,
+        const int8_t*& descriptor_data);
+    
+    /**
+     * @brief Get a model from the process-wide model cache, loading it on a miss
+     * 
+     * @param model_path Path to the .tflite model
+     * @return Shared model, or nullptr if it failed to load
+     */
+    static std::shared_ptr<tflite::FlatBufferModel> loadCachedModel(const std::string& model_path);
+    
+    /**
+     * @brief Create the pipeline slots and start the pipeline threads if not running
+     * 
+     * @return true if the pipeline is running, false otherwise
+     */
+    bool startPipeline();
+    
+    /**
+     * @brief Stop the pipeline threads and drop the pipeline slots
+     */
+    void stopPipeline();
+    
+    /**
+     * @brief Pipeline stage 2: invoke the queued slots on the TPU in order
+     */
+    void tpuThreadFunc();
+    
+    /**
+     * @brief Pipeline stage 3: postprocess the invoked slots in order
+     */
+    void postprocessThreadFunc();
+    
+    /**
+     * @brief Pick the rung of the model ladder for the next call
+     * 
+     * @return Extractor of the rung, this extractor for rung 0
+     */
+    TPUFeatureExtractor& beginLadderCall();
+    
+    /**
+     * @brief Account the time of a call on the current rung
+     * 
+     * @param extractor Extractor returned by beginLadderCall()
+     * @param elapsed_ms Time of the call
+     */
+    void endLadderCall(TPUFeatureExtractor& extractor, double elapsed_ms);
+    
+    /**
+     * @brief Extract the features of one image on this extractor (see operator())
+     */
+    int extract(
+        cv::InputArray image_in,
+        cv::InputArray model_input_in,
+        cv::InputArray mask_in,
+        std::vector<cv::KeyPoint>& keypoints,
+        cv::OutputArray descriptors_out,
+        std::vector<int>& vLappingArea);
+    
+    /**
+     * @brief Extract the features of several images on this extractor (see ExtractBatch())
+     */
+    int extractBatch(
+        const std::vector<cv::Mat>& images,
+        const std::vector<cv::Mat>& model_inputs,
+        std::vector<std::vector<cv::KeyPoint>>& keypoints,
+        std::vector<cv::Mat>& descriptors);
+    
     /**
      * @brief Initialize scale factors for image pyramid
      */
@@ -136,6 +755,8 @@ private:
     /**
      * @brief Create image pyramid for compatibility with ORB-SLAM3
      * 
+     * Uses the RGA pyramid set by SetPyramid() if it fits the image.
+     * 
      * @param image Input image
      */
     void createImagePyramid(const cv::Mat& image);
@@ -155,30 +776,81 @@ private:
     /**
      * @brief Run inference on the preprocessed image
      * 
-     * Executes the SuperPoint model on the EdgeTPU and extracts the output tensors.
+     * Executes the SuperPoint model on the EdgeTPU or the NPU. The quantized
+     * outputs stay in the output tensors of interpreter_ or npu_ (see
+     * getOutputData() and getNPUOutputData()).
      * 
      * @param preprocessed_image Image prepared for model input
-     * @param raw_keypoints Output vector for keypoint data (unused in current implementation)
-     * @param raw_descriptors Output vector for descriptor data
-     * @param raw_scores Output vector for keypoint score data
+     * @return true if successful, false otherwise
      */
-    void runInference(
-        const cv::Mat& preprocessed_image,
-        std::vector<float>& raw_keypoints,
-        std::vector<float>& raw_descriptors,
-        std::vector<float>& raw_scores);
+    bool runInference(const cv::Mat& preprocessed_image);
+    
+    /**
+     * @brief Copy a preprocessed image into one batch slot of the input tensor
+     * 
+     * @param interpreter Interpreter whose input tensor is filled
+     * @param slot Batch index (0 to GetBatchSize() - 1)
+     * @param preprocessed_image Image prepared for model input
+     * @return true if successful, false otherwise
+     */
+    bool fillInputTensor(tflite::Interpreter* interpreter, int slot, const cv::Mat& preprocessed_image);
+    
+    /**
+     * @brief Bind caller memory as the input tensor of interpreter_ (see SupportsZeroCopyInput())
+     * 
+     * The memory must stay valid and unchanged until Invoke() returns.
+     * 
+     * @param preprocessed_image Model-sized image prepared for model input
+     * @return true if the image is bound, false if it has to be copied
+     */
+    bool bindInputTensor(const cv::Mat& preprocessed_image);
+    
+    /**
+     * @brief Point the input tensor of interpreter_ back at memory owned by the extractor
+     * 
+     * @return true if successful, false otherwise
+     */
+    bool unbindInputTensor();
+    
+    /**
+     * @brief Get the int8 outputs of one batch slot after Invoke()
+     * 
+     * The pointers refer to the interpreter's output tensors and are valid
+     * until its next Invoke().
+     * 
+     * @param interpreter Interpreter whose output tensors are read
+     * @param slot Batch index (0 to GetBatchSize() - 1)
+     * @param semi_data Output pointer to the semi tensor slot ([H, W, 65])
+     * @param descriptor_data Output pointer to the descriptor tensor slot ([256, H, W])
+     * @return true if both outputs are available as int8, false otherwise
+     */
+    bool getOutputData(
+        tflite::Interpreter* interpreter,
+        int slot,
+        const int8_t*& semi_data,
+        const int8_t*& descriptor_data);
+    
+    /**
+     * @brief Number of int8 elements of one batch slot of the semi tensor
+     */
+    size_t semiSlotSize() const;
+    
+    /**
+     * @brief Number of int8 elements of one batch slot of the descriptor tensor
+     */
+    size_t descriptorSlotSize() const;
     
     /**
      * @brief Process model outputs to extract keypoints and descriptors
      * 
-     * Converts the raw model outputs into OpenCV keypoints and descriptors,
-     * applying non-maximum suppression and filtering based on confidence threshold.
+     * Works on the quantized outputs: thresholding and NMS compare int8
+     * scores, and only the descriptor cells of the selected keypoints are
+     * dequantized and L2-normalized.
      * 
      * @param original_image Original input image (for coordinate mapping)
      * @param mask_in Optional mask for filtering keypoints
-     * @param raw_keypoints Raw keypoint data from model (unused in current implementation)
-     * @param raw_descriptors Raw descriptor data from model
-     * @param raw_scores Raw score data from model
+     * @param semi_data Quantized semi tensor slot ([H, W, 65])
+     * @param descriptor_data Quantized descriptor tensor slot ([256, H, W])
      * @param keypoints Output vector of detected keypoints
      * @param descriptors Output matrix of descriptors
      * @param vLappingArea Output vector for stereo/overlapping regions
@@ -186,25 +858,75 @@ private:
     void postprocessResults(
         const cv::Mat& original_image,
         const cv::InputArray& mask_in,
-        const std::vector<float>& raw_keypoints,
-        const std::vector<float>& raw_descriptors,
-        const std::vector<float>& raw_scores,
+        const int8_t* semi_data,
+        const int8_t* descriptor_data,
         std::vector<cv::KeyPoint>& keypoints,
         cv::Mat& descriptors,
         std::vector<int>& vLappingArea);
     
     /**
-     * @brief Apply non-maximum suppression to keypoint scores
+     * @brief Apply grid-bucketed non-maximum suppression to keypoint scores
+     * 
+     * The score map is split into buckets of radius x radius pixels. Each
+     * bucket keeps its best point above the threshold, which is dropped if
+     * the best point of a neighbouring bucket within the radius is stronger.
+     * The cost is linear in the map size and independent of the number of
+     * points above the threshold. Scores are compared in the int8 domain;
+     * only the responses of the kept points are dequantized.
      * 
-     * @param scores Score map from model output
+     * @param semi_data Quantized semi tensor slot ([H, W, 65], the last channel is the dustbin)
      * @param radius Radius for NMS
-     * @param threshold Confidence threshold
+     * @param threshold Confidence threshold (dequantized)
      * @return Vector of keypoints after NMS
      */
     std::vector<cv::KeyPoint> applyNMS(
-        const std::vector<std::vector<std::vector<float>>>& scores,
+        const int8_t* semi_data,
         float radius,
         float threshold);
+    
+    /**
+     * @brief Sample the descriptor of each keypoint in the current DescriptorMode
+     * 
+     * @param descriptor_data Quantized descriptor tensor slot ([256, H, W])
+     * @param image_size Size of the image the keypoint coordinates refer to
+     * @param keypoints Keypoints in image coordinates
+     * @param descriptors Output matrix of descriptors (one row per keypoint)
+     */
+    void sampleDescriptors(
+        const int8_t* descriptor_data,
+        const cv::Size& image_size,
+        const std::vector<cv::KeyPoint>& keypoints,
+        cv::Mat& descriptors);
+    
+    /**
+     * @brief Extract features on several pyramid levels (see SetInferenceLevels())
+     * 
+     * Expects mvImagePyramid to be built for the image.
+     * 
+     * @param image Full-resolution input image
+     * @param mask_in Optional mask in full-resolution coordinates
+     * @param keypoints Output keypoints in full-resolution coordinates, with octaves
+     * @param descriptors Output matrix of descriptors
+     */
+    void extractMultiScale(
+        const cv::Mat& image,
+        const cv::InputArray& mask_in,
+        std::vector<cv::KeyPoint>& keypoints,
+        cv::Mat& descriptors);
+    
+    /**
+     * @brief Bilinearly interpolate the descriptor map at a sub-cell position
+     * 
+     * @param descriptor_data Quantized descriptor tensor slot ([256, H, W])
+     * @param u Column in descriptor cells (cell centers at integer positions)
+     * @param v Row in descriptor cells
+     * @param values Output, one value per channel without the zero point (not normalized)
+     */
+    void interpolateDescriptor(
+        const int8_t* descriptor_data,
+        float u,
+        float v,
+        float* values) const;
 };
 
 } // namespace ORB_SLAM3
@@ -23,14 +23,159 @@
 #include "Pinhole.h"
 #include "KannalaBrandt8.h"
 
+#include <boost/serialization/string.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace ORB_SLAM3
 {
 
-Atlas::Atlas(){
+namespace
+{
+
+// Atlas file: header, section table, and the sections, each one starting at a multiple of kAtlasFileAlign
+struct AtlasFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sections;
+    uint64_t file_size;
+};
+
+struct AtlasFileSection
+{
+    uint32_t type;
+    uint32_t map;       // index of the map the section belongs to
+    uint64_t offset;
+    uint64_t size;
+};
+
+enum AtlasFileSectionType
+{
+    ATLAS_SECTION=1,        // vocabulary, cameras and static ids
+    MAP_SECTION=2,          // map fields, without its keyframes and map points
+    KEYFRAMES_SECTION=3,    // keyframes without descriptors
+    DESCRIPTORS_SECTION=4,  // descriptor table of the keyframes of the previous section
+    MAPPOINTS_SECTION=5
+};
+
+// Descriptors of a keyframe, stored contiguously at offset from the start of the section
+struct DescriptorEntry
+{
+    uint32_t rows;
+    uint32_t cols;
+    int32_t type;
+    uint32_t pad;
+    uint64_t offset;
+};
+
+const char kAtlasFileMagic[8] = {'O','R','B','A','T','L','A','S'};
+const uint32_t kAtlasFileVersion = 1;
+const uint64_t kAtlasFileAlign = 64;
+const size_t kKeyFramesPerSection = 128;
+const size_t kMapPointsPerSection = 4096;
+
+const float kDefaultMapCellSize = 4.f;
+const size_t kNoMapCell = std::numeric_limits<size_t>::max();
+
+// Keyframes between two walks of the maps to account their memory
+const unsigned long kMemoryBudgetPeriod = 10;
+
+// Reclaims the pages right away, to swap (zram on the headset) or to the file they map.
+// Older kernels reject the advice and the pages stay resident
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+uint64_t AlignAtlasFile(uint64_t n)
+{
+    return (n + kAtlasFileAlign - 1) / kAtlasFileAlign * kAtlasFileAlign;
+}
+
+typedef std::tuple<int,int,int> CellKey;
+
+CellKey MapCellOf(const Eigen::Vector3f &p, float fCellSize)
+{
+    return CellKey((int)std::floor(p.x()/fCellSize), (int)std::floor(p.y()/fCellSize), (int)std::floor(p.z()/fCellSize));
+}
+
+// madvise over the whole pages of a range of the mapping, or over all the pages it touches
+void AdviseMapping(const char* p, size_t n, int advice, bool bWholePages)
+{
+    static const uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(p), end = begin + n;
+    if(bWholePages)
+    {
+        begin = (begin + page - 1) / page * page;
+        end = end / page * page;
+    }
+    else
+    {
+        begin = begin / page * page;
+        end = (end + page - 1) / page * page;
+    }
+    if(end > begin)
+        madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+}
+
+// Read only stream over a section of the mapped file
+class SectionBuffer : public std::streambuf
+{
+public:
+    SectionBuffer(const char* data, size_t size)
+    {
+        char* p = const_cast<char*>(data);
+        setg(p, p, p + size);
+    }
+};
+
+// Runs func over [0,n) on up to one thread per core
+void RunSections(size_t n, const std::function<void(size_t)> &func)
+{
+    const size_t nThreads = std::min<size_t>(n, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for(size_t i = next++; i < n; i = next++)
+            func(i);
+    };
+
+    std::vector<std::thread> vThreads;
+    for(size_t t = 1; t < nThreads; t++)
+        vThreads.push_back(std::thread(worker));
+    worker();
+    for(size_t t = 0; t < vThreads.size(); t++)
+        vThreads[t].join();
+}
+
+} // namespace
+
+Atlas::Atlas(): mfMapCellSize(kDefaultMapCellSize), mnMapCellBudget(0), mnCurrentCell(kNoMapCell),
+    mnResidentBytes(0), mnMapCellTick(0), mnMemoryBudget(0), mnMemoryBudgetChecks(0), mbOverMemoryBudget(false)
+{
     mpCurrentMap = static_cast<Map*>(NULL);
 }
 
-Atlas::Atlas(int initKFid): mnLastInitKFidMap(initKFid), mHasViewer(false)
+Atlas::Atlas(int initKFid): mnLastInitKFidMap(initKFid), mHasViewer(false), mfMapCellSize(kDefaultMapCellSize),
+    mnMapCellBudget(0), mnCurrentCell(kNoMapCell), mnResidentBytes(0), mnMapCellTick(0),
+    mnMemoryBudget(0), mnMemoryBudgetChecks(0), mbOverMemoryBudget(false)
 {
     mpCurrentMap = static_cast<Map*>(NULL);
     CreateNewMap();
@@ -57,7 +202,7 @@ Atlas::~Atlas()
 
 void Atlas::CreateNewMap()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     cout << "Creation of new map with id: " << Map::nNextId << endl;
     if(mpCurrentMap){
         if(!mspMaps.empty() && mnLastInitKFidMap < mpCurrentMap->GetMaxKFid())
@@ -78,7 +223,7 @@ void Atlas::CreateNewMap()
 
 void Atlas::ChangeMap(Map* pMap)
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     cout << "Change to map with id: " << pMap->GetId() << endl;
     if(mpCurrentMap){
         mpCurrentMap->SetStoredMap();
@@ -88,9 +233,28 @@ void Atlas::ChangeMap(Map* pMap)
     mpCurrentMap->SetCurrentMap();
 }
 
+bool Atlas::SwitchToMap(Map* pMap)
+{
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
+    if(!mspMaps.count(pMap) || pMap->IsBad())
+        return false;
+
+    cout << "Switch to map with id: " << pMap->GetId() << endl;
+    if(mpCurrentMap && mpCurrentMap != pMap){
+        if(mpCurrentMap->KeyFramesInMap() == 0)
+            SetMapBad(mpCurrentMap);
+        else
+            mpCurrentMap->SetStoredMap();
+    }
+
+    mpCurrentMap = pMap;
+    mpCurrentMap->SetCurrentMap();
+    return true;
+}
+
 unsigned long int Atlas::GetLastInitKFid()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mnLastInitKFidMap;
 }
 
@@ -160,55 +324,55 @@ std::vector<GeometricCamera*> Atlas::GetAllCameras()
 
 void Atlas::SetReferenceMapPoints(const std::vector<MapPoint*> &vpMPs)
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     mpCurrentMap->SetReferenceMapPoints(vpMPs);
 }
 
 void Atlas::InformNewBigChange()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     mpCurrentMap->InformNewBigChange();
 }
 
 int Atlas::GetLastBigChangeIdx()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->GetLastBigChangeIdx();
 }
 
 long unsigned int Atlas::MapPointsInMap()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->MapPointsInMap();
 }
 
 long unsigned Atlas::KeyFramesInMap()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->KeyFramesInMap();
 }
 
 std::vector<KeyFrame*> Atlas::GetAllKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->GetAllKeyFrames();
 }
 
 std::vector<MapPoint*> Atlas::GetAllMapPoints()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->GetAllMapPoints();
 }
 
 std::vector<MapPoint*> Atlas::GetReferenceMapPoints()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->GetReferenceMapPoints();
 }
 
 vector<Map*> Atlas::GetAllMaps()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     struct compFunctor
     {
         inline bool operator()(Map* elem1 ,Map* elem2)
@@ -223,19 +387,19 @@ vector<Map*> Atlas::GetAllMaps()
 
 int Atlas::CountMaps()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mspMaps.size();
 }
 
 void Atlas::clearMap()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     mpCurrentMap->clear();
 }
 
 void Atlas::clearAtlas()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     /*for(std::set<Map*>::iterator it=mspMaps.begin(), send=mspMaps.end(); it!=send; it++)
     {
         (*it)->clear();
@@ -248,7 +412,7 @@ void Atlas::clearAtlas()
 
 Map* Atlas::GetCurrentMap()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     if(!mpCurrentMap)
         CreateNewMap();
     while(mpCurrentMap->IsBad())
@@ -277,25 +441,25 @@ void Atlas::RemoveBadMaps()
 
 bool Atlas::isInertial()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->IsInertial();
 }
 
 void Atlas::SetInertialSensor()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     mpCurrentMap->SetInertialSensor();
 }
 
 void Atlas::SetImuInitialized()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     mpCurrentMap->SetImuInitialized();
 }
 
 bool Atlas::isImuInitialized()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     return mpCurrentMap->isImuInitialized();
 }
 
@@ -313,21 +477,25 @@ void Atlas::PreSave()
             return elem1->GetId() < elem2->GetId();
         }
     };
-    std::copy(mspMaps.begin(), mspMaps.end(), std::back_inserter(mvpBackupMaps));
-    sort(mvpBackupMaps.begin(), mvpBackupMaps.end(), compFunctor());
+    vector<Map*> vpMaps(mspMaps.begin(), mspMaps.end());
+    sort(vpMaps.begin(), vpMaps.end(), compFunctor());
 
+    // Only the maps with keyframes are saved, the atlas can be saved more than once
+    mvpBackupMaps.clear();
     std::set<GeometricCamera*> spCams(mvpCameras.begin(), mvpCameras.end());
-    for(Map* pMi : mvpBackupMaps)
+    for(Map* pMi : vpMaps)
     {
         if(!pMi || pMi->IsBad())
             continue;
 
-        if(pMi->GetAllKeyFrames().size() == 0) {
-            // Empty map, erase before of save it.
-            SetMapBad(pMi);
+        if(pMi->KeyFramesInMap() == 0) {
+            // Empty map, erase before of save it. The current map is kept in use
+            if(pMi != mpCurrentMap)
+                SetMapBad(pMi);
             continue;
         }
         pMi->PreSave(spCams);
+        mvpBackupMaps.push_back(pMi);
     }
     RemoveBadMaps();
 }
@@ -346,12 +514,709 @@ void Atlas::PostLoad()
     {
         mspMaps.insert(pMi);
         pMi->PostLoad(mpKeyFrameDB, mpORBVocabulary, mpCams);
-        numKF += pMi->GetAllKeyFrames().size();
-        numMP += pMi->GetAllMapPoints().size();
+        numKF += pMi->KeyFramesInMap();
+        numMP += pMi->MapPointsInMap();
     }
     mvpBackupMaps.clear();
 }
 
+bool Atlas::SaveToFile(const string &strFile, const string &strVocName, const string &strVocChecksum)
+{
+    FileSnapshot snapshot;
+    return TakeSnapshot(strVocName, strVocChecksum, snapshot) && WriteSnapshot(snapshot, strFile);
+}
+
+bool Atlas::TakeSnapshot(const string &strVocName, const string &strVocChecksum, FileSnapshot &snapshot)
+{
+    struct Section
+    {
+        uint32_t type;
+        uint32_t map;
+        size_t first;   // first keyframe or map point of the section
+        size_t count;
+        string data;
+    };
+
+    // The keyframes and map points are taken out of the maps while saving
+    const size_t nMaps = mvpBackupMaps.size();
+    vector<vector<KeyFrame*> > vvpKFs(nMaps);
+    vector<vector<MapPoint*> > vvpMPs(nMaps);
+    for(size_t m=0; m<nMaps; m++)
+        mvpBackupMaps[m]->SwapBackupData(vvpKFs[m], vvpMPs[m]);
+
+    // Keyframes and map points sorted by spatial cell, a keyframe section never spans two cells
+    vector<Section> vSections;
+    vSections.push_back(Section{ATLAS_SECTION, 0, 0, 0, string()});
+    for(size_t m=0; m<nMaps; m++)
+    {
+        vector<pair<CellKey,KeyFrame*> > vCellKFs;
+        vCellKFs.reserve(vvpKFs[m].size());
+        for(KeyFrame* pKFi : vvpKFs[m])
+            vCellKFs.push_back(make_pair(MapCellOf(pKFi->GetCameraCenter(), mfMapCellSize), pKFi));
+        stable_sort(vCellKFs.begin(), vCellKFs.end(),
+                    [](const pair<CellKey,KeyFrame*> &a, const pair<CellKey,KeyFrame*> &b){ return a.first < b.first; });
+
+        vector<pair<CellKey,MapPoint*> > vCellMPs;
+        vCellMPs.reserve(vvpMPs[m].size());
+        for(MapPoint* pMPi : vvpMPs[m])
+            vCellMPs.push_back(make_pair(MapCellOf(pMPi->GetWorldPos(), mfMapCellSize), pMPi));
+        stable_sort(vCellMPs.begin(), vCellMPs.end(),
+                    [](const pair<CellKey,MapPoint*> &a, const pair<CellKey,MapPoint*> &b){ return a.first < b.first; });
+
+        for(size_t i=0; i<vCellKFs.size(); i++)
+            vvpKFs[m][i] = vCellKFs[i].second;
+        for(size_t i=0; i<vCellMPs.size(); i++)
+            vvpMPs[m][i] = vCellMPs[i].second;
+
+        vSections.push_back(Section{MAP_SECTION, (uint32_t)m, 0, 0, string()});
+        for(size_t i=0; i<vCellKFs.size();)
+        {
+            size_t j = i+1;
+            while(j<vCellKFs.size() && j-i<kKeyFramesPerSection && vCellKFs[j].first==vCellKFs[i].first)
+                j++;
+            vSections.push_back(Section{KEYFRAMES_SECTION, (uint32_t)m, i, j-i, string()});
+            vSections.push_back(Section{DESCRIPTORS_SECTION, (uint32_t)m, i, j-i, string()});
+            i = j;
+        }
+        for(size_t i=0; i<vvpMPs[m].size(); i+=kMapPointsPerSection)
+            vSections.push_back(Section{MAPPOINTS_SECTION, (uint32_t)m, i,
+                                        min(kMapPointsPerSection, vvpMPs[m].size()-i), string()});
+    }
+
+    std::atomic<bool> bOk(true);
+    RunSections(vSections.size(), [&](size_t idx)
+    {
+        Section &section = vSections[idx];
+        // The descriptors are written with their keyframes
+        if(section.type==DESCRIPTORS_SECTION)
+            return;
+
+        try
+        {
+            std::ostringstream os(std::ios::out | std::ios::binary);
+            {
+                boost::archive::binary_oarchive oa(os);
+                if(section.type==ATLAS_SECTION)
+                {
+                    oa.register_type<Pinhole>();
+                    oa.register_type<KannalaBrandt8>();
+                    oa << strVocName;
+                    oa << strVocChecksum;
+                    oa << mvpCameras;
+                    oa << Map::nNextId;
+                    oa << Frame::nNextId;
+                    oa << KeyFrame::nNextId;
+                    oa << MapPoint::nNextId;
+                    oa << GeometricCamera::nNextId;
+                    oa << mnLastInitKFidMap;
+                }
+                else if(section.type==MAP_SECTION)
+                {
+                    oa << mvpBackupMaps[section.map];
+                }
+                else if(section.type==KEYFRAMES_SECTION)
+                {
+                    const vector<KeyFrame*> &vpKFs = vvpKFs[section.map];
+                    vector<KeyFrame*> vpSectionKFs(vpKFs.begin()+section.first,
+                                                   vpKFs.begin()+section.first+section.count);
+
+                    KeyFrame::bSerializeDescriptors = false;
+                    oa << vpSectionKFs;
+                    KeyFrame::bSerializeDescriptors = true;
+
+                    // Descriptor table of the keyframes
+                    vector<DescriptorEntry> vEntries(vpSectionKFs.size());
+                    uint64_t offset = AlignAtlasFile(sizeof(uint64_t) + vEntries.size()*sizeof(DescriptorEntry));
+                    for(size_t i=0; i<vpSectionKFs.size(); i++)
+                    {
+                        const cv::Mat &descriptors = vpSectionKFs[i]->mDescriptors;
+                        DescriptorEntry &entry = vEntries[i];
+                        entry.rows = descriptors.rows;
+                        entry.cols = descriptors.cols;
+                        entry.type = descriptors.type();
+                        entry.pad = 0;
+                        entry.offset = offset;
+                        offset = AlignAtlasFile(offset + descriptors.total()*descriptors.elemSize());
+                    }
+
+                    string &table = vSections[idx+1].data;
+                    table.assign(offset, 0);
+                    const uint64_t nEntries = vEntries.size();
+                    memcpy(&table[0], &nEntries, sizeof(nEntries));
+                    if(!vEntries.empty())
+                        memcpy(&table[sizeof(nEntries)], vEntries.data(), vEntries.size()*sizeof(DescriptorEntry));
+                    for(size_t i=0; i<vpSectionKFs.size(); i++)
+                    {
+                        const cv::Mat &descriptors = vpSectionKFs[i]->mDescriptors;
+                        const size_t rowBytes = descriptors.cols*descriptors.elemSize();
+                        for(int r=0; r<descriptors.rows; r++)
+                            memcpy(&table[vEntries[i].offset + r*rowBytes], descriptors.ptr(r), rowBytes);
+                    }
+                }
+                else
+                {
+                    const vector<MapPoint*> &vpMPs = vvpMPs[section.map];
+                    vector<MapPoint*> vpSectionMPs(vpMPs.begin()+section.first,
+                                                   vpMPs.begin()+section.first+section.count);
+                    oa << vpSectionMPs;
+                }
+            }
+            section.data = os.str();
+        }
+        catch(const std::exception &e)
+        {
+            KeyFrame::bSerializeDescriptors = true;
+            cerr << "Atlas saving failure: " << e.what() << endl;
+            bOk = false;
+        }
+    });
+
+    for(size_t m=0; m<nMaps; m++)
+        mvpBackupMaps[m]->SwapBackupData(vvpKFs[m], vvpMPs[m]);
+
+    if(!bOk)
+        return false;
+
+    AtlasFileHeader header;
+    memcpy(header.magic, kAtlasFileMagic, sizeof(header.magic));
+    header.version = kAtlasFileVersion;
+    header.sections = vSections.size();
+
+    vector<AtlasFileSection> vTable(vSections.size());
+    uint64_t offset = AlignAtlasFile(sizeof(header) + vTable.size()*sizeof(AtlasFileSection));
+    for(size_t i=0; i<vSections.size(); i++)
+    {
+        vTable[i].type = vSections[i].type;
+        vTable[i].map = vSections[i].map;
+        vTable[i].offset = offset;
+        vTable[i].size = vSections[i].data.size();
+        offset = AlignAtlasFile(offset + vTable[i].size);
+    }
+    header.file_size = offset;
+
+    snapshot.strTable.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    snapshot.strTable.append(reinterpret_cast<const char*>(vTable.data()), vTable.size()*sizeof(AtlasFileSection));
+    snapshot.vSections.resize(vSections.size());
+    snapshot.vOffsets.resize(vSections.size());
+    for(size_t i=0; i<vSections.size(); i++)
+    {
+        snapshot.vSections[i].swap(vSections[i].data);
+        snapshot.vOffsets[i] = vTable[i].offset;
+    }
+    snapshot.nFileSize = header.file_size;
+
+    // The backup of the maps is only needed for the file
+    mvpBackupMaps.clear();
+
+    return true;
+}
+
+bool Atlas::WriteSnapshot(const FileSnapshot &snapshot, const string &strFile, size_t nBytesPerSecond)
+{
+    // Written aside and renamed, the file may be mapped by the descriptors of a loaded atlas, and a
+    // checkpoint interrupted by a crash leaves the previous one in place
+    const string strTmpFile = strFile + ".tmp";
+    const int fd = open(strTmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd<0)
+        return false;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t written = 0;
+    bool bOk = true;
+    auto writeBytes = [&](const char* data, size_t n)
+    {
+        const size_t kChunk = 1 << 20;
+        while(bOk && n>0)
+        {
+            const ssize_t nChunk = write(fd, data, min(n, kChunk));
+            if(nChunk<=0)
+            {
+                bOk = false;
+                break;
+            }
+            data += nChunk;
+            n -= nChunk;
+            written += nChunk;
+
+            // Keep under the write rate, so the checkpoint does not compete for the disk
+            if(nBytesPerSecond>0)
+                std::this_thread::sleep_until(start + std::chrono::microseconds(written*1000000/nBytesPerSecond));
+        }
+    };
+
+    const string padding(kAtlasFileAlign, 0);
+    writeBytes(snapshot.strTable.data(), snapshot.strTable.size());
+    for(size_t i=0; i<snapshot.vSections.size(); i++)
+    {
+        writeBytes(padding.data(), snapshot.vOffsets[i] - written);
+        writeBytes(snapshot.vSections[i].data(), snapshot.vSections[i].size());
+    }
+    writeBytes(padding.data(), snapshot.nFileSize - written);
+
+    bOk = bOk && fsync(fd)==0;
+    bOk = close(fd)==0 && bOk;
+    if(!bOk || std::rename(strTmpFile.c_str(), strFile.c_str())!=0)
+    {
+        std::remove(strTmpFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Atlas::IsAtlasFile(const string &strFile)
+{
+    std::ifstream ifs(strFile, std::ios::binary);
+    char magic[sizeof(kAtlasFileMagic)];
+    return ifs.read(magic, sizeof(magic)) && memcmp(magic, kAtlasFileMagic, sizeof(magic))==0;
+}
+
+bool Atlas::LoadFromFile(const string &strFile, string &strVocName, string &strVocChecksum)
+{
+    const int fd = open(strFile.c_str(), O_RDONLY);
+    if(fd<0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd,&st)!=0 || (size_t)st.st_size<sizeof(AtlasFileHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t size = st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED)
+        return false;
+
+    std::shared_ptr<void> mapping(data, [size](void* p){ munmap(p,size); });
+    const bool bMapCells = mnMapCellBudget>0;
+    if(!bMapCells)
+        madvise(data, size, MADV_WILLNEED);
+    const char* bytes = static_cast<const char*>(data);
+
+    AtlasFileHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    if(memcmp(header.magic, kAtlasFileMagic, sizeof(header.magic))!=0 || header.version!=kAtlasFileVersion ||
+       header.file_size!=size || header.sections<1 ||
+       sizeof(header) + (uint64_t)header.sections*sizeof(AtlasFileSection)>size)
+    {
+        cerr << "Atlas loading failure: This is not a correct atlas file!" << endl;
+        return false;
+    }
+
+    vector<AtlasFileSection> vTable(header.sections);
+    memcpy(vTable.data(), bytes + sizeof(header), vTable.size()*sizeof(AtlasFileSection));
+    for(size_t i=0; i<vTable.size(); i++)
+    {
+        if(vTable[i].offset>size || vTable[i].size>size-vTable[i].offset ||
+           (vTable[i].type==KEYFRAMES_SECTION && (i+1==vTable.size() || vTable[i+1].type!=DESCRIPTORS_SECTION)))
+        {
+            cerr << "Atlas loading failure: This is not a correct atlas file!" << endl;
+            return false;
+        }
+    }
+
+    if(vTable[0].type!=ATLAS_SECTION)
+    {
+        cerr << "Atlas loading failure: This is not a correct atlas file!" << endl;
+        return false;
+    }
+
+    // Cameras, static ids and maps, serially since creating a map takes the next map id
+    vector<GeometricCamera*> vpCameras;
+    long unsigned int nNextMapId, nNextFrameId, nNextKFId, nNextMPId, nNextCameraId, nLastInitKFidMap;
+    vector<Map*> vpMaps;
+    try
+    {
+        SectionBuffer buffer(bytes + vTable[0].offset, vTable[0].size);
+        boost::archive::binary_iarchive ia(buffer);
+        ia.register_type<Pinhole>();
+        ia.register_type<KannalaBrandt8>();
+        ia >> strVocName;
+        ia >> strVocChecksum;
+        ia >> vpCameras;
+        ia >> nNextMapId;
+        ia >> nNextFrameId;
+        ia >> nNextKFId;
+        ia >> nNextMPId;
+        ia >> nNextCameraId;
+        ia >> nLastInitKFidMap;
+
+        for(size_t i=1; i<vTable.size(); i++)
+        {
+            if(vTable[i].type!=MAP_SECTION)
+                continue;
+            if(vTable[i].map!=vpMaps.size())
+                throw std::runtime_error("unordered map sections");
+
+            SectionBuffer mapBuffer(bytes + vTable[i].offset, vTable[i].size);
+            boost::archive::binary_iarchive mapArchive(mapBuffer);
+            Map* pMap;
+            mapArchive >> pMap;
+            vpMaps.push_back(pMap);
+        }
+    }
+    catch(const std::exception &e)
+    {
+        cerr << "Atlas loading failure: " << e.what() << endl;
+        for(size_t m=0; m<vpMaps.size(); m++)
+            delete vpMaps[m];
+        return false;
+    }
+
+    // Keyframes, with their descriptors, and map points in parallel
+    vector<vector<KeyFrame*> > vvpSectionKFs(vTable.size());
+    vector<vector<MapPoint*> > vvpSectionMPs(vTable.size());
+    vector<char> vbFailed(vTable.size(), 0);
+    std::atomic<bool> bOk(true);
+    RunSections(vTable.size(), [&](size_t idx)
+    {
+        const AtlasFileSection &section = vTable[idx];
+        if(section.type!=KEYFRAMES_SECTION && section.type!=MAPPOINTS_SECTION)
+            return;
+
+        try
+        {
+            if(section.map>=vpMaps.size())
+                throw std::runtime_error("section of a missing map");
+
+            SectionBuffer buffer(bytes + section.offset, section.size);
+            boost::archive::binary_iarchive ia(buffer);
+            if(section.type==MAPPOINTS_SECTION)
+            {
+                ia >> vvpSectionMPs[idx];
+                return;
+            }
+
+            vector<KeyFrame*> &vpKFs = vvpSectionKFs[idx];
+            KeyFrame::bSerializeDescriptors = false;
+            ia >> vpKFs;
+            KeyFrame::bSerializeDescriptors = true;
+
+            // The descriptors are copied straight from the mapping
+            const AtlasFileSection &table = vTable[idx+1];
+            const char* pTable = bytes + table.offset;
+            uint64_t nEntries = 0;
+            if(table.size>=sizeof(nEntries))
+                memcpy(&nEntries, pTable, sizeof(nEntries));
+            if(nEntries!=vpKFs.size() || sizeof(nEntries) + nEntries*sizeof(DescriptorEntry)>table.size)
+                throw std::runtime_error("wrong descriptor table");
+
+            for(size_t i=0; i<vpKFs.size(); i++)
+            {
+                DescriptorEntry entry;
+                memcpy(&entry, pTable + sizeof(nEntries) + i*sizeof(DescriptorEntry), sizeof(entry));
+                if(CV_MAT_DEPTH(entry.type)>CV_64F)
+                    throw std::runtime_error("wrong descriptor type");
+
+                const size_t nBytes = (size_t)entry.rows*entry.cols*CV_ELEM_SIZE(entry.type);
+                if(entry.offset>table.size || nBytes>table.size-entry.offset)
+                    throw std::runtime_error("wrong descriptor table");
+
+                // With map cells the descriptors are read, and paged, from the mapping
+                cv::Mat descriptors;
+                if(bMapCells)
+                    descriptors = cv::Mat(entry.rows, entry.cols, entry.type, const_cast<char*>(pTable + entry.offset));
+                else
+                {
+                    descriptors.create(entry.rows, entry.cols, entry.type);
+                    if(nBytes)
+                        memcpy(descriptors.data, pTable + entry.offset, nBytes);
+                }
+                const_cast<cv::Mat&>(vpKFs[i]->mDescriptors) = descriptors;
+            }
+        }
+        catch(const std::exception &e)
+        {
+            KeyFrame::bSerializeDescriptors = true;
+            cerr << "Atlas loading failure: " << e.what() << endl;
+            vbFailed[idx] = 1;
+            bOk = false;
+        }
+    });
+
+    if(!bOk)
+    {
+        // Sections that failed may hold partially loaded objects, they are left alone
+        for(size_t i=0; i<vTable.size(); i++)
+        {
+            if(vbFailed[i])
+                continue;
+            for(size_t j=0; j<vvpSectionKFs[i].size(); j++)
+                delete vvpSectionKFs[i][j];
+            for(size_t j=0; j<vvpSectionMPs[i].size(); j++)
+                delete vvpSectionMPs[i][j];
+        }
+        for(size_t m=0; m<vpMaps.size(); m++)
+            delete vpMaps[m];
+        return false;
+    }
+
+    // Give each map its keyframes and map points in the saved order
+    vector<vector<KeyFrame*> > vvpKFs(vpMaps.size());
+    vector<vector<MapPoint*> > vvpMPs(vpMaps.size());
+    for(size_t i=0; i<vTable.size(); i++)
+    {
+        if(vTable[i].type==KEYFRAMES_SECTION)
+            vvpKFs[vTable[i].map].insert(vvpKFs[vTable[i].map].end(), vvpSectionKFs[i].begin(), vvpSectionKFs[i].end());
+        else if(vTable[i].type==MAPPOINTS_SECTION)
+            vvpMPs[vTable[i].map].insert(vvpMPs[vTable[i].map].end(), vvpSectionMPs[i].begin(), vvpSectionMPs[i].end());
+    }
+    for(size_t m=0; m<vpMaps.size(); m++)
+        vpMaps[m]->SwapBackupData(vvpKFs[m], vvpMPs[m]);
+
+    mvpBackupMaps.insert(mvpBackupMaps.end(), vpMaps.begin(), vpMaps.end());
+    mvpCameras.insert(mvpCameras.end(), vpCameras.begin(), vpCameras.end());
+    mnLastInitKFidMap = nLastInitKFidMap;
+
+    // Never go back in the ids given in this session
+    Map::nNextId = max(Map::nNextId, nNextMapId);
+    Frame::nNextId = max(Frame::nNextId, nNextFrameId);
+    KeyFrame::nNextId = max(KeyFrame::nNextId, nNextKFId);
+    MapPoint::nNextId = max(MapPoint::nNextId, nNextMPId);
+    GeometricCamera::nNextId = max(GeometricCamera::nNextId, nNextCameraId);
+
+    if(bMapCells)
+    {
+        // One cell per map and position of the keyframe sections, the rest of the file is no longer needed
+        unique_lock<mutex> lock(mMutexMapCells);
+        std::map<pair<uint32_t,CellKey>, size_t> mCells;
+        for(size_t i=0; i<vTable.size(); i++)
+        {
+            if(vTable[i].type!=DESCRIPTORS_SECTION)
+                AdviseMapping(bytes + vTable[i].offset, vTable[i].size, MADV_DONTNEED, true);
+            if(vTable[i].type!=KEYFRAMES_SECTION || vvpSectionKFs[i].empty())
+                continue;
+
+            const pair<uint32_t,CellKey> key(vTable[i].map,
+                                             MapCellOf(vvpSectionKFs[i][0]->GetPose().inverse().translation(), mfMapCellSize));
+            std::map<pair<uint32_t,CellKey>, size_t>::iterator it = mCells.find(key);
+            if(it==mCells.end())
+            {
+                it = mCells.insert(make_pair(key, mvMapCells.size())).first;
+                mvMapCells.push_back(MapCell{vector<pair<const char*,size_t> >(), 0, vector<size_t>(), 0, false});
+            }
+
+            MapCell &cell = mvMapCells[it->second];
+            cell.vRanges.push_back(make_pair(bytes + vTable[i+1].offset, (size_t)vTable[i+1].size));
+            cell.nBytes += vTable[i+1].size;
+            for(KeyFrame* pKFi : vvpSectionKFs[i])
+                mmKeyFrameCell[pKFi] = it->second;
+        }
+
+        for(std::map<pair<uint32_t,CellKey>, size_t>::iterator it=mCells.begin(); it!=mCells.end(); it++)
+        {
+            const CellKey &c = it->first.second;
+            for(int dx=-1; dx<=1; dx++)
+                for(int dy=-1; dy<=1; dy++)
+                    for(int dz=-1; dz<=1; dz++)
+                    {
+                        std::map<pair<uint32_t,CellKey>, size_t>::iterator itN = mCells.find(make_pair(it->first.first,
+                            CellKey(std::get<0>(c)+dx, std::get<1>(c)+dy, std::get<2>(c)+dz)));
+                        if(itN!=mCells.end())
+                            mvMapCells[it->second].vNeighbors.push_back(itN->second);
+                    }
+        }
+        mvpAtlasFiles.push_back(mapping);
+    }
+
+    return true;
+}
+
+void Atlas::SetMapCells(float fCellSize, size_t nResidentBytes)
+{
+    unique_lock<mutex> lock(mMutexMapCells);
+    if(fCellSize>0)
+        mfMapCellSize = fCellSize;
+    mnMapCellBudget = nResidentBytes;
+}
+
+void Atlas::UpdateMapCells(KeyFrame* pRefKF)
+{
+    unique_lock<mutex> lock(mMutexMapCells);
+    if(!pRefKF || mmKeyFrameCell.empty())
+        return;
+
+    std::unordered_map<KeyFrame*, size_t>::const_iterator it = mmKeyFrameCell.find(pRefKF);
+    if(it==mmKeyFrameCell.end() || it->second==mnCurrentCell)
+        return;
+    mnCurrentCell = it->second;
+    mnMapCellTick++;
+
+    // The cell of the reference keyframe and its neighbors are read ahead
+    for(size_t idx : mvMapCells[mnCurrentCell].vNeighbors)
+    {
+        MapCell &cell = mvMapCells[idx];
+        cell.nLastUse = mnMapCellTick;
+        if(cell.bResident)
+            continue;
+        for(const pair<const char*,size_t> &range : cell.vRanges)
+            AdviseMapping(range.first, range.second, MADV_WILLNEED, false);
+        cell.bResident = true;
+        mnResidentBytes += cell.nBytes;
+    }
+
+    // Release the least recently used cells, the pages are clean and read again from the file if needed
+    while(mnResidentBytes>mnMapCellBudget)
+    {
+        size_t oldest = kNoMapCell;
+        for(size_t i=0; i<mvMapCells.size(); i++)
+        {
+            const MapCell &cell = mvMapCells[i];
+            if(cell.bResident && cell.nLastUse<mnMapCellTick &&
+               (oldest==kNoMapCell || cell.nLastUse<mvMapCells[oldest].nLastUse))
+                oldest = i;
+        }
+        if(oldest==kNoMapCell)
+            break;
+
+        MapCell &cell = mvMapCells[oldest];
+        for(const pair<const char*,size_t> &range : cell.vRanges)
+            AdviseMapping(range.first, range.second, MADV_DONTNEED, true);
+        cell.bResident = false;
+        mnResidentBytes -= cell.nBytes;
+    }
+}
+
+void Atlas::SetMemoryBudget(size_t nBytes)
+{
+    unique_lock<mutex> lock(mMutexMemoryBudget);
+    mnMemoryBudget = nBytes;
+    if(!nBytes)
+        mbOverMemoryBudget = false;
+}
+
+bool Atlas::IsOverMemoryBudget()
+{
+    return mbOverMemoryBudget;
+}
+
+size_t Atlas::GetMemoryBytes()
+{
+    const vector<Map*> vpMaps = GetAllMaps();
+    unique_lock<mutex> lock(mMutexMemoryBudget);
+    size_t nBytes = 0;
+    for(Map* pMap : vpMaps)
+        nBytes += MapResidentBytes(pMap);
+    return nBytes;
+}
+
+void Atlas::GetMemoryBreakdown(MemoryBreakdown &breakdown)
+{
+    const vector<Map*> vpMaps = GetAllMaps();
+    breakdown.Add(MemoryBreakdown::MAP, sizeof(Atlas));
+    for(Map* pMap : vpMaps)
+        pMap->GetMemoryBreakdown(breakdown);
+    {
+        unique_lock<mutex> lock(mMutexMemoryBudget);
+        for(std::map<Map*, size_t>::const_iterator it=mmPagedOutBytes.begin(); it!=mmPagedOutBytes.end(); it++)
+            breakdown.nPagedOutBytes += it->second;
+    }
+    if(mpKeyFrameDB)
+        breakdown.Add(MemoryBreakdown::KEYFRAME_DATABASE, mpKeyFrameDB->GetMemoryBytes());
+}
+
+size_t Atlas::MapResidentBytes(Map* pMap)
+{
+    const size_t nBytes = pMap->GetMemoryBytes();
+    std::map<Map*, size_t>::const_iterator it = mmPagedOutBytes.find(pMap);
+    if(it==mmPagedOutBytes.end())
+        return nBytes;
+    return nBytes > it->second ? nBytes - it->second : 0;
+}
+
+void Atlas::EnforceMemoryBudget(KeyFrame* pCurrentKF)
+{
+    unique_lock<mutex> lock(mMutexMemoryBudget);
+    if(!mnMemoryBudget || !pCurrentKF || (mnMemoryBudgetChecks++ % kMemoryBudgetPeriod)!=0)
+        return;
+
+    Map* pCurrentMap = pCurrentKF->GetMap();
+    vector<Map*> vpMaps;
+    {
+        unique_lock<ProfiledMutex> lockAtlas(mMutexAtlas);
+        vpMaps.assign(mspMaps.begin(), mspMaps.end());
+    }
+
+    // A map that is active again faults its pages back in, merged maps are gone
+    for(std::map<Map*, size_t>::iterator it=mmPagedOutBytes.begin(); it!=mmPagedOutBytes.end();)
+    {
+        if(it->first==pCurrentMap || std::find(vpMaps.begin(), vpMaps.end(), it->first)==vpMaps.end())
+            it = mmPagedOutBytes.erase(it);
+        else
+            ++it;
+    }
+
+    size_t nBytes = 0;
+    for(Map* pMap : vpMaps)
+        nBytes += MapResidentBytes(pMap);
+    if(nBytes<=mnMemoryBudget)
+    {
+        mbOverMemoryBudget = false;
+        return;
+    }
+
+    // First the grids of the keyframes out of the local window, as tracking builds it: the current
+    // keyframe, its covisible keyframes and their best covisible keyframes
+    std::set<KeyFrame*> spLocalKFs;
+    spLocalKFs.insert(pCurrentKF);
+    const vector<KeyFrame*> vpCovisibleKFs = pCurrentKF->GetVectorCovisibleKeyFrames();
+    for(KeyFrame* pKFi : vpCovisibleKFs)
+    {
+        spLocalKFs.insert(pKFi);
+        const vector<KeyFrame*> vpNeighKFs = pKFi->GetBestCovisibilityKeyFrames(10);
+        spLocalKFs.insert(vpNeighKFs.begin(), vpNeighKFs.end());
+    }
+
+    for(Map* pMap : vpMaps)
+    {
+        const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+        for(KeyFrame* pKFi : *pKeyFrames)
+        {
+            if(spLocalKFs.count(pKFi))
+                continue;
+            const size_t nReleased = pKFi->ReleaseGrid();
+            nBytes -= min(nBytes, nReleased);
+        }
+    }
+
+    // Then the features of the inactive maps are paged out, the largest map first. They are read
+    // back from swap or from the atlas file if place recognition or a merge touches them again
+    if(nBytes>mnMemoryBudget)
+    {
+        vector<pair<size_t, Map*> > vInactiveMaps;
+        for(Map* pMap : vpMaps)
+        {
+            if(pMap!=pCurrentMap && !mmPagedOutBytes.count(pMap))
+                vInactiveMaps.push_back(make_pair(pMap->KeyFramesInMap(), pMap));
+        }
+        sort(vInactiveMaps.rbegin(), vInactiveMaps.rend());
+
+        for(size_t i=0; i<vInactiveMaps.size() && nBytes>mnMemoryBudget; i++)
+        {
+            Map* pMap = vInactiveMaps[i].second;
+            size_t nPaged = 0;
+            const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+            for(KeyFrame* pKFi : *pKeyFrames)
+            {
+                const size_t nDescriptors = pKFi->mDescriptors.total()*pKFi->mDescriptors.elemSize();
+                AdviseMapping(reinterpret_cast<const char*>(pKFi->mDescriptors.data), nDescriptors, MADV_PAGEOUT, true);
+                AdviseMapping(reinterpret_cast<const char*>(pKFi->mvKeys.data()), pKFi->mvKeys.MemoryBytes(), MADV_PAGEOUT, true);
+                AdviseMapping(reinterpret_cast<const char*>(pKFi->mvKeysUn.data()), pKFi->mvKeysUn.MemoryBytes(), MADV_PAGEOUT, true);
+                nPaged += nDescriptors + pKFi->mvKeys.MemoryBytes() + pKFi->mvKeysUn.MemoryBytes();
+            }
+            mmPagedOutBytes[pMap] = nPaged;
+            nBytes -= min(nBytes, nPaged);
+        }
+    }
+
+    // Still over the budget, local mapping culls keyframes more aggressively
+    mbOverMemoryBudget = nBytes>mnMemoryBudget;
+    if(mbOverMemoryBudget)
+        cout << "Atlas: " << (nBytes >> 20) << " MB over a budget of " << (mnMemoryBudget >> 20) << " MB" << endl;
+}
+
 void Atlas::SetKeyFrameDababase(KeyFrameDatabase* pKFDB)
 {
     mpKeyFrameDB = pKFDB;
@@ -374,21 +1239,21 @@ ORBVocabulary* Atlas::GetORBVocabulary()
 
 long unsigned int Atlas::GetNumLivedKF()
 {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     long unsigned int num = 0;
     for(Map* pMap_i : mspMaps)
     {
-        num += pMap_i->GetAllKeyFrames().size();
+        num += pMap_i->KeyFramesInMap();
     }
 
     return num;
 }
 
 long unsigned int Atlas::GetNumLivedMP() {
-    unique_lock<mutex> lock(mMutexAtlas);
+    unique_lock<ProfiledMutex> lock(mMutexAtlas);
     long unsigned int num = 0;
     for (Map* pMap_i : mspMaps) {
-        num += pMap_i->GetAllMapPoints().size();
+        num += pMap_i->MapPointsInMap();
     }
 
     return num;
@@ -20,6 +20,8 @@
 
 #include <boost/serialization/export.hpp>
 
+#include <algorithm>
+
 //BOOST_CLASS_EXPORT_IMPLEMENT(ORB_SLAM3::KannalaBrandt8)
 
 namespace ORB_SLAM3 {
@@ -142,6 +144,87 @@ namespace ORB_SLAM3 {
         return cv::Point3f(pw.x * scale, pw.y * scale, 1.f);
     }
 
+    // Lanes of points processed together, Eigen evaluates the array expressions with
+    // SSE/AVX or NEON packets
+    typedef Eigen::Array<float,16,1> KB8Lanes;
+    typedef Eigen::Array<bool,16,1> KB8Mask;
+
+    void KannalaBrandt8::projectBatch(const Eigen::Vector3f* pv3D, Eigen::Vector2f* pv2D, const size_t n) {
+        const float fx = mvParameters[0], fy = mvParameters[1], cx = mvParameters[2], cy = mvParameters[3];
+        const float k0 = mvParameters[4], k1 = mvParameters[5], k2 = mvParameters[6], k3 = mvParameters[7];
+
+        for(size_t i0 = 0; i0 < n; i0 += KB8Lanes::SizeAtCompileTime) {
+            const size_t m = std::min<size_t>(KB8Lanes::SizeAtCompileTime, n - i0);
+            KB8Lanes x = KB8Lanes::Zero(), y = KB8Lanes::Zero(), z = KB8Lanes::Ones();
+            for(size_t j = 0; j < m; j++) {
+                x[j] = pv3D[i0 + j][0];
+                y[j] = pv3D[i0 + j][1];
+                z[j] = pv3D[i0 + j][2];
+            }
+
+            const KB8Lanes rxy = (x * x + y * y).sqrt();
+            const KB8Lanes az = z.abs();
+
+            // theta = atan2(rxy, z) from the atan of the smaller over the larger, with the
+            // reduction at tan(pi/8) and polynomial of Cephes atanf (error ~1e-7 rad)
+            const KB8Lanes ratio = rxy.min(az) / rxy.max(az).max(1e-30f);
+            const KB8Lanes a = (ratio > 0.41421356f).select((ratio - 1.f) / (ratio + 1.f), ratio);
+            const KB8Lanes a2 = a * a;
+            KB8Lanes theta = (((8.05374449538e-2f * a2 - 1.38776856032e-1f) * a2 + 1.99777106478e-1f) * a2
+                              - 3.33329491539e-1f) * a2 * a + a;
+            theta = (ratio > 0.41421356f).select(theta + 0.78539816f, theta);
+            theta = (rxy > az).select(1.57079633f - theta, theta);
+            theta = (z < 0.f).select(3.14159265f - theta, theta);
+
+            const KB8Lanes theta2 = theta * theta;
+            const KB8Lanes r = theta * (1.f + theta2 * (k0 + theta2 * (k1 + theta2 * (k2 + theta2 * k3))));
+
+            // (cos psi, sin psi) = (x, y) / rxy, psi = 0 on the optical axis
+            const KB8Lanes invrxy = rxy.max(1e-30f).inverse();
+            const KB8Lanes cosPsi = (rxy > 0.f).select(x * invrxy, 1.f);
+            const KB8Lanes u = fx * r * cosPsi + cx;
+            const KB8Lanes v = fy * r * y * invrxy + cy;
+            for(size_t j = 0; j < m; j++) {
+                pv2D[i0 + j][0] = u[j];
+                pv2D[i0 + j][1] = v[j];
+            }
+        }
+    }
+
+    void KannalaBrandt8::unprojectBatch(const cv::Point2f* pv2D, Eigen::Vector3f* pvRays, const size_t n) {
+        const float fx = mvParameters[0], fy = mvParameters[1], cx = mvParameters[2], cy = mvParameters[3];
+        const float k0 = mvParameters[4], k1 = mvParameters[5], k2 = mvParameters[6], k3 = mvParameters[7];
+
+        for(size_t i0 = 0; i0 < n; i0 += KB8Lanes::SizeAtCompileTime) {
+            const size_t m = std::min<size_t>(KB8Lanes::SizeAtCompileTime, n - i0);
+            KB8Lanes x = KB8Lanes::Zero(), y = KB8Lanes::Zero();
+            for(size_t j = 0; j < m; j++) {
+                x[j] = (pv2D[i0 + j].x - cx) / fx;
+                y[j] = (pv2D[i0 + j].y - cy) / fy;
+            }
+
+            const KB8Lanes thetaD = (x * x + y * y).sqrt().min(float(CV_PI / 2.));
+
+            // Newton steps as in unproject, a lane stops once its step is below the precision
+            KB8Lanes theta = thetaD;
+            KB8Mask active = thetaD > 1e-8f;
+            for(int it = 0; it < 10 && active.any(); it++) {
+                const KB8Lanes theta2 = theta * theta, theta4 = theta2 * theta2, theta6 = theta4 * theta2, theta8 = theta4 * theta4;
+                const KB8Lanes k0_theta2 = k0 * theta2, k1_theta4 = k1 * theta4;
+                const KB8Lanes k2_theta6 = k2 * theta6, k3_theta8 = k3 * theta8;
+                const KB8Lanes theta_fix = (theta * (1.f + k0_theta2 + k1_theta4 + k2_theta6 + k3_theta8) - thetaD) /
+                                           (1.f + 3.f * k0_theta2 + 5.f * k1_theta4 + 7.f * k2_theta6 + 9.f * k3_theta8);
+                theta = active.select(theta - theta_fix, theta);
+                active = active && (theta_fix.abs() >= precision);
+            }
+
+            // tan as sin/cos, which Eigen vectorizes
+            const KB8Lanes scale = (thetaD > 1e-8f).select(theta.sin() / (theta.cos() * thetaD), 1.f);
+            for(size_t j = 0; j < m; j++)
+                pvRays[i0 + j] = Eigen::Vector3f(x[j] * scale[j], y[j] * scale[j], 1.f);
+        }
+    }
+
     Eigen::Matrix<double, 2, 3> KannalaBrandt8::projectJac(const Eigen::Vector3d &v3D) {
         double x2 = v3D[0] * v3D[0], y2 = v3D[1] * v3D[1], z2 = v3D[2] * v3D[2];
         double r2 = x2 + y2;
@@ -68,6 +68,24 @@ namespace ORB_SLAM3 {
                            1.f);
     }
 
+    // Same arithmetic as project and unprojectEig, so both give the same result
+    void Pinhole::projectBatch(const Eigen::Vector3f* pv3D, Eigen::Vector2f* pv2D, const size_t n) {
+        const float fx = mvParameters[0], fy = mvParameters[1], cx = mvParameters[2], cy = mvParameters[3];
+        for(size_t i=0; i<n; i++) {
+            pv2D[i][0] = fx * pv3D[i][0] / pv3D[i][2] + cx;
+            pv2D[i][1] = fy * pv3D[i][1] / pv3D[i][2] + cy;
+        }
+    }
+
+    void Pinhole::unprojectBatch(const cv::Point2f* pv2D, Eigen::Vector3f* pvRays, const size_t n) {
+        const float fx = mvParameters[0], fy = mvParameters[1], cx = mvParameters[2], cy = mvParameters[3];
+        for(size_t i=0; i<n; i++) {
+            pvRays[i][0] = (pv2D[i].x - cx) / fx;
+            pvRays[i][1] = (pv2D[i].y - cy) / fy;
+            pvRays[i][2] = 1.f;
+        }
+    }
+
     Eigen::Matrix<double, 2, 3> Pinhole::projectJac(const Eigen::Vector3d &v3D) {
         Eigen::Matrix<double, 2, 3> Jac;
         Jac(0, 0) = mvParameters[0] / v3D[2];
@@ -18,6 +18,8 @@
 
 #include "Converter.h"
 
+#include <cassert>
+
 namespace ORB_SLAM3
 {
 
@@ -236,6 +238,24 @@ Eigen::Matrix<float,4,4> Converter::toMatrix4f(const cv::Mat &cvMat4)
     return M;
 }
 
+Eigen::Map<const Eigen::Matrix<float,3,3,Eigen::RowMajor>> Converter::toMatrix3fMap(const cv::Mat &cvMat3)
+{
+    assert(cvMat3.type()==CV_32F && cvMat3.rows==3 && cvMat3.cols==3 && cvMat3.isContinuous());
+    return Eigen::Map<const Eigen::Matrix<float,3,3,Eigen::RowMajor>>(cvMat3.ptr<float>());
+}
+
+Eigen::Map<const Eigen::Matrix<float,4,4,Eigen::RowMajor>> Converter::toMatrix4fMap(const cv::Mat &cvMat4)
+{
+    assert(cvMat4.type()==CV_32F && cvMat4.rows==4 && cvMat4.cols==4 && cvMat4.isContinuous());
+    return Eigen::Map<const Eigen::Matrix<float,4,4,Eigen::RowMajor>>(cvMat4.ptr<float>());
+}
+
+Eigen::Map<const Eigen::Matrix<float,3,1>> Converter::toVector3fMap(const cv::Mat &cvVector)
+{
+    assert(cvVector.type()==CV_32F && cvVector.total()==3 && cvVector.isContinuous());
+    return Eigen::Map<const Eigen::Matrix<float,3,1>>(cvVector.ptr<float>());
+}
+
 std::vector<float> Converter::toQuaternion(const cv::Mat &M)
 {
     Eigen::Matrix<double,3,3> eigMat = toMatrix3d(M);
@@ -306,6 +326,12 @@ Sophus::SE3<float> Converter::toSophus(const cv::Mat &T) {
     return Sophus::SE3<float>(q,t);
 }
 
+Sophus::SE3<float> Converter::toSophus(const Eigen::Map<const Eigen::Matrix<float,4,4,Eigen::RowMajor>>& T) {
+    Eigen::Quaternionf q(Eigen::Matrix3f(T.block<3,3>(0,0)));
+
+    return Sophus::SE3<float>(q.normalized(),T.block<3,1>(0,3));
+}
+
 Sophus::Sim3f Converter::toSophus(const g2o::Sim3& S) {
     return Sophus::Sim3f(Sophus::RxSO3d((float)S.scale(), S.rotation().matrix()).cast<float>() ,
                          S.translation().cast<float>());
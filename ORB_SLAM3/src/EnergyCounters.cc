@@ -0,0 +1,620 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EnergyCounters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+std::atomic<bool> EnergyCounters::sbEnabled(false);
+
+namespace
+{
+
+// Rails sampled together and depth of the nested spans of a thread
+const int kMaxRails = 8;
+const int kMaxDepth = 32;
+
+// The clock of the trace events and latency stamps
+int64_t NowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+struct Accumulator
+{
+    uint64_t nSpans;
+    int64_t nBusyNs;
+    double vEnergyJ[kMaxRails];
+
+    Accumulator()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    Accumulator& operator+=(const Accumulator &other)
+    {
+        nSpans += other.nSpans;
+        nBusyNs += other.nBusyNs;
+        for(int r=0; r<kMaxRails; r++)
+            vEnergyJ[r] += other.vEnergyJ[r];
+        return *this;
+    }
+};
+
+// Credit of a thread when it entered a span
+struct Mark
+{
+    int64_t nTimeNs;
+    double vEnergyJ[kMaxRails];
+};
+
+struct RailFiles
+{
+    int nPowerFd = -1;
+    int nVoltageFd = -1;
+    int nCurrentFd = -1;
+    double scale = 1e-6;
+
+    void Close()
+    {
+        if(nPowerFd >= 0)
+            close(nPowerFd);
+        if(nVoltageFd >= 0)
+            close(nVoltageFd);
+        if(nCurrentFd >= 0)
+            close(nCurrentFd);
+        nPowerFd = nVoltageFd = nCurrentFd = -1;
+    }
+};
+
+// sysfs attributes are read again from offset 0, without reopening them
+bool ReadValue(int fd, double &value)
+{
+    char buffer[32];
+    const ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if(n <= 0)
+        return false;
+    buffer[n] = '\0';
+    char* pEnd = nullptr;
+    value = strtod(buffer, &pEnd);
+    return pEnd != buffer;
+}
+
+bool ReadPower(const RailFiles &files, double &watts)
+{
+    double value = 0.0;
+    if(files.nPowerFd >= 0)
+    {
+        if(!ReadValue(files.nPowerFd, value))
+            return false;
+    }
+    else
+    {
+        double current = 0.0;
+        if(!ReadValue(files.nVoltageFd, value) || !ReadValue(files.nCurrentFd, current))
+            return false;
+        value *= current;
+    }
+
+    // A discharging battery reports a negative current
+    watts = fabs(value)*files.scale;
+    return true;
+}
+
+int OpenFile(const string &strPath)
+{
+    return strPath.empty() ? -1 : open(strPath.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+// Sampler thread and the rail totals, under mMutex
+struct Sampler
+{
+    mutex mMutex;
+    vector<string> vNames;
+    vector<RailFiles> vFiles;
+    int64_t nPeriodNs;
+    thread worker;
+    atomic<bool> bRun;
+
+    uint64_t nSamples;
+    int64_t nStartNs;
+    int64_t nLastNs;
+    double vTotalJ[kMaxRails];
+
+    // Last sampled power and threads in a span, read at every span boundary
+    atomic<double> vPowerW[kMaxRails];
+    atomic<int> nBusyThreads;
+
+    Sampler(): nPeriodNs(1000000), bRun(false), nSamples(0), nStartNs(0), nLastNs(0), nBusyThreads(0)
+    {
+        for(int r=0; r<kMaxRails; r++)
+        {
+            vTotalJ[r] = 0.0;
+            vPowerW[r].store(0.0, std::memory_order_relaxed);
+        }
+    }
+
+    // The power of the last sample is held until this one, like the spans credit it
+    void Sample(int64_t nNow)
+    {
+        const double seconds = (nNow - nLastNs)*1e-9;
+        for(size_t r=0; r<vFiles.size(); r++)
+        {
+            const double previous = vPowerW[r].load(std::memory_order_relaxed);
+            vTotalJ[r] += previous*seconds;
+
+            double watts;
+            if(ReadPower(vFiles[r], watts))
+                vPowerW[r].store(watts, std::memory_order_relaxed);
+        }
+        nSamples++;
+        nLastNs = nNow;
+    }
+
+    void Run()
+    {
+        int64_t nNext = NowNs();
+        while(bRun.load(std::memory_order_relaxed))
+        {
+            nNext += nPeriodNs;
+            const int64_t nNow = NowNs();
+            if(nNow > nNext + nPeriodNs)
+                nNext = nNow;   // A slow read, do not catch up with a burst of samples
+
+            timespec ts;
+            ts.tv_sec = nNext/1000000000;
+            ts.tv_nsec = nNext%1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+
+            unique_lock<mutex> lock(mMutex);
+            Sample(NowNs());
+        }
+    }
+};
+
+// Never destroyed, like the registry of the threads
+Sampler &GetSampler()
+{
+    static Sampler* pSampler = new Sampler();
+    return *pSampler;
+}
+
+// Energy credited to a thread and the spans it metered. The credit is only written by the thread,
+// the accumulators under mMutex so the statistics can be read meanwhile.
+struct ThreadEnergy
+{
+    int nDepth;
+    int64_t nLastNs;
+    double vEnergyJ[kMaxRails];
+    Mark vStack[kMaxDepth];
+
+    mutex mMutex;
+    unordered_map<const char*, Accumulator> mAccumulators;
+    double vTopLevelJ[kMaxRails];   // Of the outermost spans, the energy that is not idle
+
+    ThreadEnergy(): nDepth(0), nLastNs(0)
+    {
+        for(int r=0; r<kMaxRails; r++)
+        {
+            vEnergyJ[r] = 0.0;
+            vTopLevelJ[r] = 0.0;
+        }
+    }
+
+    // Last sampled power since the previous boundary, shared with the other threads in a span
+    void Credit(int64_t nNow)
+    {
+        if(nDepth > 0)
+        {
+            Sampler &sampler = GetSampler();
+            const int nBusy = max(1, sampler.nBusyThreads.load(std::memory_order_relaxed));
+            const double seconds = (nNow - nLastNs)*1e-9/nBusy;
+            for(int r=0; r<kMaxRails; r++)
+                vEnergyJ[r] += sampler.vPowerW[r].load(std::memory_order_relaxed)*seconds;
+        }
+        nLastNs = nNow;
+    }
+};
+
+struct Registry
+{
+    mutex mMutex;
+    vector<ThreadEnergy*> vpThreads;
+};
+
+// Never destroyed, the energy of a thread outlives it
+Registry &GetRegistry()
+{
+    static Registry* pRegistry = new Registry();
+    return *pRegistry;
+}
+
+thread_local ThreadEnergy* tpThread = nullptr;
+
+ThreadEnergy* GetThreadEnergy()
+{
+    if(!tpThread)
+    {
+        tpThread = new ThreadEnergy();
+        Registry &registry = GetRegistry();
+        unique_lock<mutex> lock(registry.mMutex);
+        registry.vpThreads.push_back(tpThread);
+    }
+    return tpThread;
+}
+
+void ResetThreads()
+{
+    Registry &registry = GetRegistry();
+    unique_lock<mutex> lock(registry.mMutex);
+    for(ThreadEnergy* pThread : registry.vpThreads)
+    {
+        unique_lock<mutex> lockThread(pThread->mMutex);
+        pThread->mAccumulators.clear();
+        for(int r=0; r<kMaxRails; r++)
+            pThread->vTopLevelJ[r] = 0.0;
+    }
+}
+
+vector<string> ListDirectory(const string &strPath)
+{
+    vector<string> vNames;
+    DIR* pDir = opendir(strPath.c_str());
+    while(pDir)
+    {
+        dirent* pEntry = readdir(pDir);
+        if(!pEntry)
+            break;
+        if(pEntry->d_name[0] != '.')
+            vNames.push_back(pEntry->d_name);
+    }
+    if(pDir)
+        closedir(pDir);
+    sort(vNames.begin(), vNames.end());
+    return vNames;
+}
+
+bool IsReadable(const string &strPath)
+{
+    return access(strPath.c_str(), R_OK) == 0;
+}
+
+string ReadLine(const string &strPath)
+{
+    ifstream f(strPath);
+    string strLine;
+    getline(f, strLine);
+    return strLine;
+}
+
+} // namespace
+
+vector<PowerRail> EnergyCounters::FindRails(const string &strSysfsRoot)
+{
+    vector<PowerRail> vRails;
+
+    // Fuel gauges, power_now in uW, or voltage_now in uV and current_now in uA
+    const string strSupplies = strSysfsRoot + "/class/power_supply/";
+    for(const string &strName : ListDirectory(strSupplies))
+    {
+        const string strDir = strSupplies + strName + "/";
+        if(ReadLine(strDir + "type") != "Battery")
+            continue;
+
+        PowerRail rail;
+        rail.name = strName;
+        if(IsReadable(strDir + "power_now"))
+        {
+            rail.powerPath = strDir + "power_now";
+            rail.scale = 1e-6;
+        }
+        else if(IsReadable(strDir + "voltage_now") && IsReadable(strDir + "current_now"))
+        {
+            rail.voltagePath = strDir + "voltage_now";
+            rail.currentPath = strDir + "current_now";
+            rail.scale = 1e-12;
+        }
+        else
+            continue;
+        vRails.push_back(rail);
+    }
+
+    // PMIC and shunt monitor rails, powerN_input in uW
+    const string strHwmon = strSysfsRoot + "/class/hwmon/";
+    for(const string &strName : ListDirectory(strHwmon))
+    {
+        const string strDir = strHwmon + strName + "/";
+        const string strDevice = ReadLine(strDir + "name");
+        for(int i=1; i<=kMaxRails; i++)
+        {
+            const string strInput = strDir + "power" + to_string(i) + "_input";
+            if(!IsReadable(strInput))
+                continue;
+            const string strLabel = ReadLine(strDir + "power" + to_string(i) + "_label");
+
+            PowerRail rail;
+            rail.name = (strDevice.empty() ? strName : strDevice) + "." + (strLabel.empty() ? "power" + to_string(i) : strLabel);
+            rail.powerPath = strInput;
+            rail.scale = 1e-6;
+            vRails.push_back(rail);
+        }
+    }
+
+    return vRails;
+}
+
+bool EnergyCounters::Start(const vector<PowerRail> &vRails, int nSamplePeriodUs)
+{
+    Stop();
+
+    Sampler &sampler = GetSampler();
+    {
+        unique_lock<mutex> lock(sampler.mMutex);
+        sampler.vNames.clear();
+        for(const PowerRail &rail : vRails)
+        {
+            if(sampler.vFiles.size() >= (size_t)kMaxRails)
+                break;
+
+            RailFiles files;
+            files.scale = rail.scale;
+            if(!rail.powerPath.empty())
+                files.nPowerFd = OpenFile(rail.powerPath);
+            else
+            {
+                files.nVoltageFd = OpenFile(rail.voltagePath);
+                files.nCurrentFd = OpenFile(rail.currentPath);
+            }
+
+            double watts;
+            if(!ReadPower(files, watts))
+            {
+                files.Close();
+                continue;
+            }
+            sampler.vPowerW[sampler.vFiles.size()].store(watts, std::memory_order_relaxed);
+            sampler.vNames.push_back(rail.name);
+            sampler.vFiles.push_back(files);
+        }
+        if(sampler.vFiles.empty())
+            return false;
+
+        sampler.nPeriodNs = (int64_t)max(nSamplePeriodUs, 100)*1000;
+        sampler.nSamples = 0;
+        sampler.nStartNs = sampler.nLastNs = NowNs();
+        for(int r=0; r<kMaxRails; r++)
+            sampler.vTotalJ[r] = 0.0;
+    }
+    ResetThreads();
+
+    sampler.bRun.store(true, std::memory_order_relaxed);
+    sampler.worker = thread(&Sampler::Run, &sampler);
+    sbEnabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void EnergyCounters::Stop()
+{
+    sbEnabled.store(false, std::memory_order_relaxed);
+
+    Sampler &sampler = GetSampler();
+    if(sampler.worker.joinable())
+    {
+        sampler.bRun.store(false, std::memory_order_relaxed);
+        sampler.worker.join();
+    }
+
+    // The totals run up to here, spans still open get nothing more
+    unique_lock<mutex> lock(sampler.mMutex);
+    if(sampler.vFiles.empty())
+        return;
+    sampler.Sample(NowNs());
+    for(size_t r=0; r<sampler.vFiles.size(); r++)
+    {
+        sampler.vFiles[r].Close();
+        sampler.vPowerW[r].store(0.0, std::memory_order_relaxed);
+    }
+    sampler.vFiles.clear();
+}
+
+void EnergyCounters::BeginSpan()
+{
+    ThreadEnergy* pThread = GetThreadEnergy();
+    const int64_t nNow = NowNs();
+    pThread->Credit(nNow);
+    if(pThread->nDepth == 0)
+        GetSampler().nBusyThreads.fetch_add(1, std::memory_order_relaxed);
+    if(pThread->nDepth < kMaxDepth)
+    {
+        Mark &mark = pThread->vStack[pThread->nDepth];
+        mark.nTimeNs = nNow;
+        memcpy(mark.vEnergyJ, pThread->vEnergyJ, sizeof(mark.vEnergyJ));
+    }
+    pThread->nDepth++;
+}
+
+void EnergyCounters::EndSpan(const char* name)
+{
+    ThreadEnergy* pThread = tpThread;
+    if(!pThread || pThread->nDepth == 0)
+        return;
+    const int64_t nNow = NowNs();
+    pThread->Credit(nNow);
+    const int nDepth = --pThread->nDepth;
+    if(nDepth == 0)
+        GetSampler().nBusyThreads.fetch_sub(1, std::memory_order_relaxed);
+    if(nDepth >= kMaxDepth)
+        return;
+
+    const Mark &begin = pThread->vStack[nDepth];
+    unique_lock<mutex> lock(pThread->mMutex);
+    Accumulator &accumulator = pThread->mAccumulators[name];
+    accumulator.nSpans++;
+    accumulator.nBusyNs += nNow - begin.nTimeNs;
+    for(int r=0; r<kMaxRails; r++)
+    {
+        const double energy = pThread->vEnergyJ[r] - begin.vEnergyJ[r];
+        accumulator.vEnergyJ[r] += energy;
+        if(nDepth == 0)
+            pThread->vTopLevelJ[r] += energy;
+    }
+}
+
+vector<StageEnergy> EnergyCounters::GetStatistics()
+{
+    // The same literal may have a different address in every translation unit
+    map<string, Accumulator> mTotals;
+    {
+        Registry &registry = GetRegistry();
+        unique_lock<mutex> lock(registry.mMutex);
+        for(ThreadEnergy* pThread : registry.vpThreads)
+        {
+            unique_lock<mutex> lockThread(pThread->mMutex);
+            for(const pair<const char* const, Accumulator> &entry : pThread->mAccumulators)
+                mTotals[entry.first] += entry.second;
+        }
+    }
+
+    vector<string> vNames;
+    {
+        Sampler &sampler = GetSampler();
+        unique_lock<mutex> lock(sampler.mMutex);
+        vNames = sampler.vNames;
+    }
+
+    vector<StageEnergy> vStats;
+    for(const pair<const string, Accumulator> &entry : mTotals)
+    {
+        const Accumulator &total = entry.second;
+        if(total.nSpans == 0)
+            continue;
+        for(size_t r=0; r<vNames.size(); r++)
+        {
+            StageEnergy stats;
+            stats.name = entry.first;
+            stats.rail = vNames[r];
+            stats.nSpans = total.nSpans;
+            stats.busyMs = total.nBusyNs*1e-6;
+            stats.energyMj = total.vEnergyJ[r]*1e3;
+            if(stats.busyMs > 0.0)
+                stats.averagePowerMw = stats.energyMj/(stats.busyMs*1e-3);
+            vStats.push_back(stats);
+        }
+    }
+
+    sort(vStats.begin(), vStats.end(), [](const StageEnergy &a, const StageEnergy &b)
+    {
+        return a.energyMj > b.energyMj;
+    });
+    return vStats;
+}
+
+vector<RailEnergy> EnergyCounters::GetRails()
+{
+    double vTopLevelJ[kMaxRails] = {};
+    {
+        Registry &registry = GetRegistry();
+        unique_lock<mutex> lock(registry.mMutex);
+        for(ThreadEnergy* pThread : registry.vpThreads)
+        {
+            unique_lock<mutex> lockThread(pThread->mMutex);
+            for(int r=0; r<kMaxRails; r++)
+                vTopLevelJ[r] += pThread->vTopLevelJ[r];
+        }
+    }
+
+    vector<RailEnergy> vRails;
+    Sampler &sampler = GetSampler();
+    unique_lock<mutex> lock(sampler.mMutex);
+    for(size_t r=0; r<sampler.vNames.size(); r++)
+    {
+        RailEnergy rail;
+        rail.name = sampler.vNames[r];
+        rail.nSamples = sampler.nSamples;
+        rail.durationS = (sampler.nLastNs - sampler.nStartNs)*1e-9;
+        rail.energyMj = sampler.vTotalJ[r]*1e3;
+        rail.idleMj = max(0.0, sampler.vTotalJ[r] - vTopLevelJ[r])*1e3;
+        if(rail.durationS > 0.0)
+            rail.averagePowerMw = rail.energyMj/rail.durationS;
+        vRails.push_back(rail);
+    }
+    return vRails;
+}
+
+void EnergyCounters::Reset()
+{
+    ResetThreads();
+
+    Sampler &sampler = GetSampler();
+    unique_lock<mutex> lock(sampler.mMutex);
+    sampler.nSamples = 0;
+    sampler.nStartNs = sampler.nLastNs = NowNs();
+    for(int r=0; r<kMaxRails; r++)
+        sampler.vTotalJ[r] = 0.0;
+}
+
+void EnergyCounters::PrintStatistics(std::ostream &os)
+{
+    const vector<RailEnergy> vRails = GetRails();
+    if(vRails.empty())
+        return;
+
+    os << endl << "Energy per rail:" << endl;
+    os << fixed << setprecision(2);
+    for(const RailEnergy &rail : vRails)
+    {
+        os << rail.name << ": " << rail.energyMj << " mJ in " << rail.durationS << " s, " << rail.averagePowerMw << " mW"
+           << ", idle " << rail.idleMj << " mJ" << endl;
+    }
+
+    const vector<StageEnergy> vStats = GetStatistics();
+    if(!vStats.empty())
+    {
+        os << "Energy per stage (inclusive of nested stages):" << endl;
+        for(const StageEnergy &stats : vStats)
+        {
+            os << stats.name << " on " << stats.rail << ": " << stats.nSpans << " spans, " << stats.busyMs << " ms"
+               << ", " << stats.energyMj << " mJ, " << stats.energyMj/stats.nSpans << " mJ/span"
+               << ", " << stats.averagePowerMw << " mW" << endl;
+        }
+    }
+    os << defaultfloat;
+}
+
+} //namespace ORB_SLAM
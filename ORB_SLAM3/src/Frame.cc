@@ -25,11 +25,21 @@
 #include "Converter.h"
 #include "ORBmatcher.h"
 #include "GeometricCamera.h"
+#include "UndistortionMap.h"
+#include "StereoDepthGPU.h"
 
 #include <thread>
 #include <include/CameraModels/Pinhole.h>
 #include <include/CameraModels/KannalaBrandt8.h>
 
+#include <cstring>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace ORB_SLAM3
 {
 
@@ -54,11 +64,12 @@ Frame::Frame(): mpcpi(NULL), mpImuPreintegrated(NULL), mpPrevFrame(NULL), mpImuP
 //Copy Constructor
 Frame::Frame(const Frame &frame)
     :mpcpi(frame.mpcpi),mpORBvocabulary(frame.mpORBvocabulary), mpORBextractorLeft(frame.mpORBextractorLeft), mpORBextractorRight(frame.mpORBextractorRight),
-     mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), mK_(Converter::toMatrix3f(frame.mK)), mDistCoef(frame.mDistCoef.clone()),
+     mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), mK_(frame.mK_), mDistCoef(frame.mDistCoef.clone()),
      mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
      mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn), mvuRight(frame.mvuRight),
      mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
-     mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
+     mFlatBowVec(frame.mFlatBowVec), mFlatFeatVec(frame.mFlatFeatVec), mpBowCache(frame.mpBowCache),
+     mDescriptors(frame.mDescriptors), mDescriptorsRight(frame.mDescriptorsRight),
      mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mImuCalib(frame.mImuCalib), mnCloseMPs(frame.mnCloseMPs),
      mpImuPreintegrated(frame.mpImuPreintegrated), mpImuPreintegratedFrame(frame.mpImuPreintegratedFrame), mImuBias(frame.mImuBias),
      mnId(frame.mnId), mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
@@ -72,17 +83,106 @@ Frame::Frame(const Frame &frame)
      mTlr(frame.mTlr), mRlr(frame.mRlr), mtlr(frame.mtlr), mTrl(frame.mTrl),
      mTcw(frame.mTcw), mbHasPose(false), mbHasVelocity(false)
 {
-    for(int i=0;i<FRAME_GRID_COLS;i++)
-        for(int j=0; j<FRAME_GRID_ROWS; j++){
-            mGrid[i][j]=frame.mGrid[i][j];
-            if(frame.Nleft > 0){
-                mGridRight[i][j] = frame.mGridRight[i][j];
-            }
-        }
+    // The grid descriptors are shared, they are not modified after AssignFeaturesToGrid
+    mGrid = frame.mGrid;
+    if(frame.Nleft > 0)
+        mGridRight = frame.mGridRight;
+
+    if(frame.mbHasPose)
+        SetPose(frame.GetPose());
+
+    if(frame.HasVelocity())
+    {
+        SetVelocity(frame.GetVelocity());
+    }
+
+    mmProjectPoints = frame.mmProjectPoints;
+    mmMatchedInImage = frame.mmMatchedInImage;
 
+#ifdef REGISTER_TIMES
+    mTimeStereoMatch = frame.mTimeStereoMatch;
+    mTimeORB_Ext = frame.mTimeORB_Ext;
+#endif
+}
+
+Frame& Frame::operator=(const Frame &frame)
+{
+    if(this == &frame)
+        return *this;
+
+    mpcpi = frame.mpcpi;
+    mpORBvocabulary = frame.mpORBvocabulary;
+    mpORBextractorLeft = frame.mpORBextractorLeft;
+    mpORBextractorRight = frame.mpORBextractorRight;
+    mTimeStamp = frame.mTimeStamp;
+    frame.mK.copyTo(mK);
+    mK_ = frame.mK_;
+    frame.mDistCoef.copyTo(mDistCoef);
+    mbf = frame.mbf;
+    mb = frame.mb;
+    mThDepth = frame.mThDepth;
+    N = frame.N;
+    mvKeys = frame.mvKeys;
+    mvKeysRight = frame.mvKeysRight;
+    mvKeysUn = frame.mvKeysUn;
+    mvuRight = frame.mvuRight;
+    mvDepth = frame.mvDepth;
+    mBowVec = frame.mBowVec;
+    mFeatVec = frame.mFeatVec;
+    mFlatBowVec = frame.mFlatBowVec;
+    mFlatFeatVec = frame.mFlatFeatVec;
+    mpBowCache = frame.mpBowCache;
+    mDescriptors = frame.mDescriptors;
+    mDescriptorsRight = frame.mDescriptorsRight;
+    mvpMapPoints = frame.mvpMapPoints;
+    mvbOutlier = frame.mvbOutlier;
+    mImuCalib = frame.mImuCalib;
+    mnCloseMPs = frame.mnCloseMPs;
+    mpImuPreintegrated = frame.mpImuPreintegrated;
+    mpImuPreintegratedFrame = frame.mpImuPreintegratedFrame;
+    mImuBias = frame.mImuBias;
+    mnId = frame.mnId;
+    mpReferenceKF = frame.mpReferenceKF;
+    mnScaleLevels = frame.mnScaleLevels;
+    mfScaleFactor = frame.mfScaleFactor;
+    mfLogScaleFactor = frame.mfLogScaleFactor;
+    mvScaleFactors = frame.mvScaleFactors;
+    mvInvScaleFactors = frame.mvInvScaleFactors;
+    mNameFile = frame.mNameFile;
+    mnDataset = frame.mnDataset;
+    mvLevelSigma2 = frame.mvLevelSigma2;
+    mvInvLevelSigma2 = frame.mvInvLevelSigma2;
+    mpPrevFrame = frame.mpPrevFrame;
+    mpLastKeyFrame = frame.mpLastKeyFrame;
+    mbIsSet = frame.mbIsSet;
+    mbImuPreintegrated = frame.mbImuPreintegrated;
+    mpMutexImu = frame.mpMutexImu;
+    mpCamera = frame.mpCamera;
+    mpCamera2 = frame.mpCamera2;
+    Nleft = frame.Nleft;
+    Nright = frame.Nright;
+    monoLeft = frame.monoLeft;
+    monoRight = frame.monoRight;
+    mvLeftToRightMatch = frame.mvLeftToRightMatch;
+    mvRightToLeftMatch = frame.mvRightToLeftMatch;
+    mvStereo3Dpoints = frame.mvStereo3Dpoints;
+    mTlr = frame.mTlr;
+    mRlr = frame.mRlr;
+    mtlr = frame.mtlr;
+    mTrl = frame.mTrl;
+    mTcw = frame.mTcw;
+
+    mGrid = frame.mGrid;
+    if(frame.Nleft > 0)
+        mGridRight = frame.mGridRight;
+    else
+        mGridRight = FrameGrid();
+
+    mbHasPose = false;
     if(frame.mbHasPose)
         SetPose(frame.GetPose());
 
+    mbHasVelocity = false;
     if(frame.HasVelocity())
     {
         SetVelocity(frame.GetVelocity());
@@ -91,14 +191,20 @@ Frame::Frame(const Frame &frame)
     mmProjectPoints = frame.mmProjectPoints;
     mmMatchedInImage = frame.mmMatchedInImage;
 
+    // Not kept by copies
+    imgLeft.release();
+    imgRight.release();
+
 #ifdef REGISTER_TIMES
     mTimeStereoMatch = frame.mTimeStereoMatch;
     mTimeORB_Ext = frame.mTimeORB_Ext;
 #endif
+
+    return *this;
 }
 
 
-Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, GeometricCamera* pCamera, Frame* pPrevF, const IMU::Calib &ImuCalib)
+Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, GeometricCamera* pCamera, Frame* pPrevF, const IMU::Calib &ImuCalib, StereoDepthGPU* pStereoDepth)
     :mpcpi(NULL), mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mK(K.clone()), mK_(Converter::toMatrix3f(K)), mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
      mImuCalib(ImuCalib), mpImuPreintegrated(NULL), mpPrevFrame(pPrevF),mpImuPreintegratedFrame(NULL), mpReferenceKF(static_cast<KeyFrame*>(NULL)), mbIsSet(false), mbImuPreintegrated(false),
      mpCamera(pCamera) ,mpCamera2(nullptr), mbHasPose(false), mbHasVelocity(false)
@@ -119,6 +225,8 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartExtORB = std::chrono::steady_clock::now();
 #endif
+    // The GPU matches the pair while the features are extracted
+    const bool bDenseStereo = pStereoDepth && pStereoDepth->Submit(imLeft, imRight, timeStamp);
     thread threadLeft(&Frame::ExtractORB,this,0,imLeft,0,0);
     thread threadRight(&Frame::ExtractORB,this,1,imRight,0,0);
     threadLeft.join();
@@ -130,15 +238,20 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 #endif
 
     N = mvKeys.size();
+    cv::Mat imDenseDepth;
+    const bool bDenseDepth = bDenseStereo && pStereoDepth->Wait(imDenseDepth);
     if(mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(imLeft.size());
 
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartStereoMatches = std::chrono::steady_clock::now();
 #endif
-    ComputeStereoMatches();
+    if(bDenseDepth)
+        ComputeStereoFromDepthMap(imDenseDepth, pStereoDepth->GetDownscale());
+    else
+        ComputeStereoMatches();
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_EndStereoMatches = std::chrono::steady_clock::now();
 
@@ -232,7 +345,7 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
     if(mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(imGray.size());
 
     ComputeStereoFromRGBD(imDepth);
 
@@ -320,7 +433,7 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
     if(mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(imGray.size());
 
     // Set no stereo information
     mvuRight = vector<float>(N,-1);
@@ -384,35 +497,58 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
 
 void Frame::AssignFeaturesToGrid()
 {
-    // Fill matrix with points
-    const int nCells = FRAME_GRID_COLS*FRAME_GRID_ROWS;
+    if(Nleft == -1)
+        AssignFeaturesToGrid(mGrid, mvKeysUn, 0);
+    else
+    {
+        AssignFeaturesToGrid(mGrid, mvKeys, 0);
+        AssignFeaturesToGrid(mGridRight, mvKeysRight, Nleft);
+    }
+}
 
-    int nReserve = 0.5f*N/(nCells);
+void Frame::AssignFeaturesToGrid(FrameGrid &grid, const std::vector<cv::KeyPoint> &vKeys, const int nRowOffset)
+{
+    const int nCells = FRAME_GRID_COLS*FRAME_GRID_ROWS;
+    const int nKeys = vKeys.size();
 
-    for(unsigned int i=0; i<FRAME_GRID_COLS;i++)
-        for (unsigned int j=0; j<FRAME_GRID_ROWS;j++){
-            mGrid[i][j].reserve(nReserve);
-            if(Nleft != -1){
-                mGridRight[i][j].reserve(nReserve);
-            }
-        }
+    // Count the keypoints of each cell, cell c is counted in vCellStart[c+1]
+    grid.vCellStart.assign(nCells+1, 0);
+    for(int i=0;i<nKeys;i++)
+    {
+        int nGridPosX, nGridPosY;
+        if(PosInGrid(vKeys[i],nGridPosX,nGridPosY))
+            grid.vCellStart[nGridPosX*FRAME_GRID_ROWS+nGridPosY+1]++;
+    }
 
+    for(int c=0; c<nCells; c++)
+        grid.vCellStart[c+1] += grid.vCellStart[c];
 
+    const int nPlaced = grid.vCellStart[nCells];
+    grid.vIndices.resize(nPlaced);
+    grid.vX.resize(nPlaced);
+    grid.vY.resize(nPlaced);
+    grid.vOctave.resize(nPlaced);
+    grid.descriptors.create(nPlaced, mDescriptors.cols, mDescriptors.type());
 
-    for(int i=0;i<N;i++)
+    // Place the keypoints in cell order, keeping their order inside a cell. vCellStart[c]
+    // is the next free position of cell c, and is shifted back to the start of c afterwards
+    for(int i=0;i<nKeys;i++)
     {
-        const cv::KeyPoint &kp = (Nleft == -1) ? mvKeysUn[i]
-                                                 : (i < Nleft) ? mvKeys[i]
-                                                                 : mvKeysRight[i - Nleft];
-
         int nGridPosX, nGridPosY;
-        if(PosInGrid(kp,nGridPosX,nGridPosY)){
-            if(Nleft == -1 || i < Nleft)
-                mGrid[nGridPosX][nGridPosY].push_back(i);
-            else
-                mGridRight[nGridPosX][nGridPosY].push_back(i - Nleft);
-        }
+        if(!PosInGrid(vKeys[i],nGridPosX,nGridPosY))
+            continue;
+
+        const int pos = grid.vCellStart[nGridPosX*FRAME_GRID_ROWS+nGridPosY]++;
+        grid.vIndices[pos] = i;
+        grid.vX[pos] = vKeys[i].pt.x;
+        grid.vY[pos] = vKeys[i].pt.y;
+        grid.vOctave[pos] = vKeys[i].octave;
+        mDescriptors.row(nRowOffset+i).copyTo(grid.descriptors.row(pos));
     }
+
+    for(int c=nCells; c>0; c--)
+        grid.vCellStart[c] = grid.vCellStart[c-1];
+    grid.vCellStart[0] = 0;
 }
 
 void Frame::ExtractORB(int flag, const cv::Mat &im, const int x0, const int x1)
@@ -521,56 +657,12 @@ bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit)
 
         // 3D in camera coordinates
         const Eigen::Matrix<float,3,1> Pc = mRcw * P + mtcw;
-        const float Pc_dist = Pc.norm();
 
         // Check positive depth
-        const float &PcZ = Pc(2);
-        const float invz = 1.0f/PcZ;
-        if(PcZ<0.0f)
-            return false;
-
-        const Eigen::Vector2f uv = mpCamera->project(Pc);
-
-        if(uv(0)<mnMinX || uv(0)>mnMaxX)
+        if(Pc(2)<0.0f)
             return false;
-        if(uv(1)<mnMinY || uv(1)>mnMaxY)
-            return false;
-
-        pMP->mTrackProjX = uv(0);
-        pMP->mTrackProjY = uv(1);
-
-        // Check distance is in the scale invariance region of the MapPoint
-        const float maxDistance = pMP->GetMaxDistanceInvariance();
-        const float minDistance = pMP->GetMinDistanceInvariance();
-        const Eigen::Vector3f PO = P - mOw;
-        const float dist = PO.norm();
-
-        if(dist<minDistance || dist>maxDistance)
-            return false;
-
-        // Check viewing angle
-        Eigen::Vector3f Pn = pMP->GetNormal();
-
-        const float viewCos = PO.dot(Pn)/dist;
-
-        if(viewCos<viewingCosLimit)
-            return false;
-
-        // Predict scale in the image
-        const int nPredictedLevel = pMP->PredictScale(dist,this);
-
-        // Data used by the tracking
-        pMP->mbTrackInView = true;
-        pMP->mTrackProjX = uv(0);
-        pMP->mTrackProjXR = uv(0) - mbf*invz;
 
-        pMP->mTrackDepth = Pc_dist;
-
-        pMP->mTrackProjY = uv(1);
-        pMP->mnTrackScaleLevel= nPredictedLevel;
-        pMP->mTrackViewCos = viewCos;
-
-        return true;
+        return isInFrustumProjected(pMP,P,Pc,mpCamera->project(Pc),viewingCosLimit);
     }
     else{
         pMP->mbTrackInView = false;
@@ -657,7 +749,22 @@ Eigen::Vector3f Frame::inRefCoordinates(Eigen::Vector3f pCw)
 vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, const bool bRight) const
 {
     vector<size_t> vIndices;
-    vIndices.reserve(N);
+    GetGridPositionsInArea(x,y,r,minLevel,maxLevel,bRight,vIndices);
+
+    const FrameGrid &grid = (!bRight) ? mGrid : mGridRight;
+    for(size_t j=0, jend=vIndices.size(); j<jend; j++)
+        vIndices[j] = grid.vIndices[vIndices[j]];
+
+    return vIndices;
+}
+
+void Frame::GetGridPositionsInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, const bool bRight, vector<size_t> &vPositions) const
+{
+    vPositions.clear();
+
+    const FrameGrid &grid = (!bRight) ? mGrid : mGridRight;
+    if(grid.empty())
+        return;
 
     float factorX = r;
     float factorY = r;
@@ -665,61 +772,53 @@ vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const f
     const int nMinCellX = max(0,(int)floor((x-mnMinX-factorX)*mfGridElementWidthInv));
     if(nMinCellX>=FRAME_GRID_COLS)
     {
-        return vIndices;
+        return;
     }
 
     const int nMaxCellX = min((int)FRAME_GRID_COLS-1,(int)ceil((x-mnMinX+factorX)*mfGridElementWidthInv));
     if(nMaxCellX<0)
     {
-        return vIndices;
+        return;
     }
 
     const int nMinCellY = max(0,(int)floor((y-mnMinY-factorY)*mfGridElementHeightInv));
     if(nMinCellY>=FRAME_GRID_ROWS)
     {
-        return vIndices;
+        return;
     }
 
     const int nMaxCellY = min((int)FRAME_GRID_ROWS-1,(int)ceil((y-mnMinY+factorY)*mfGridElementHeightInv));
     if(nMaxCellY<0)
     {
-        return vIndices;
+        return;
     }
 
     const bool bCheckLevels = (minLevel>0) || (maxLevel>=0);
 
     for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
     {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
-        {
-            const vector<size_t> vCell = (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy];
-            if(vCell.empty())
-                continue;
+        // The cells nMinCellY to nMaxCellY of a column are one span of positions
+        const int jbegin = grid.vCellStart[ix*FRAME_GRID_ROWS+nMinCellY];
+        const int jend = grid.vCellStart[ix*FRAME_GRID_ROWS+nMaxCellY+1];
 
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
+        for(int j=jbegin; j<jend; j++)
+        {
+            if(bCheckLevels)
             {
-                const cv::KeyPoint &kpUn = (Nleft == -1) ? mvKeysUn[vCell[j]]
-                                                         : (!bRight) ? mvKeys[vCell[j]]
-                                                                     : mvKeysRight[vCell[j]];
-                if(bCheckLevels)
-                {
-                    if(kpUn.octave<minLevel)
+                if(grid.vOctave[j]<minLevel)
+                    continue;
+                if(maxLevel>=0)
+                    if(grid.vOctave[j]>maxLevel)
                         continue;
-                    if(maxLevel>=0)
-                        if(kpUn.octave>maxLevel)
-                            continue;
-                }
+            }
 
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
+            const float distx = grid.vX[j]-x;
+            const float disty = grid.vY[j]-y;
 
-                if(fabs(distx)<factorX && fabs(disty)<factorY)
-                    vIndices.push_back(vCell[j]);
-            }
+            if(fabs(distx)<factorX && fabs(disty)<factorY)
+                vPositions.push_back(j);
         }
     }
-
-    return vIndices;
 }
 
 bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
@@ -735,48 +834,67 @@ bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
 }
 
 
-void Frame::ComputeBoW()
+void BowCache::Compute(ORBVocabulary* pVocabulary, const cv::Mat &descriptors)
 {
-    if(mBowVec.empty())
+    mbStarted = true;
+    std::call_once(mOnce, [this, pVocabulary, &descriptors]()
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
-    }
+        pVocabulary->transform(descriptors,mBowVec,mFeatVec,4);
+        mFlatBowVec.assign(mBowVec);
+        mFlatFeatVec.assign(mFeatVec);
+    });
 }
 
-void Frame::UndistortKeyPoints()
+void BowCache::ComputeAsync(const std::shared_ptr<BowCache> &pCache, ORBVocabulary* pVocabulary,
+                            const cv::Mat &descriptors, const Submit &submit)
 {
-    if(mDistCoef.at<float>(0)==0.0)
-    {
-        mvKeysUn=mvKeys;
+    if(pCache->mbStarted.exchange(true))
         return;
-    }
 
-    // Fill matrix with points
-    cv::Mat mat(N,2,CV_32F);
+    // The job keeps the cache and the descriptor data alive, a frame may be gone when it runs
+    cv::Mat desc = descriptors;
+    submit([pCache, pVocabulary, desc]()
+    {
+        pCache->Compute(pVocabulary, desc);
+    });
+}
 
-    for(int i=0; i<N; i++)
+void Frame::ComputeBoW()
+{
+    if(mBowVec.empty())
     {
-        mat.at<float>(i,0)=mvKeys[i].pt.x;
-        mat.at<float>(i,1)=mvKeys[i].pt.y;
+        // Copies of this frame and the keyframe made from it share the transform
+        if(!mpBowCache)
+            mpBowCache = std::make_shared<BowCache>();
+        mpBowCache->Compute(mpORBvocabulary, mDescriptors);
+        mBowVec = mpBowCache->mBowVec;
+        mFeatVec = mpBowCache->mFeatVec;
+        mFlatBowVec = mpBowCache->mFlatBowVec;
+        mFlatFeatVec = mpBowCache->mFlatFeatVec;
     }
+}
 
-    // Undistort points
-    mat=mat.reshape(2);
-    cv::undistortPoints(mat,mat, static_cast<Pinhole*>(mpCamera)->toK(),mDistCoef,cv::Mat(),mK);
-    mat=mat.reshape(1);
-
+void Frame::ComputeBoWAsync(const BowCache::Submit &submit)
+{
+    if(!mBowVec.empty())
+        return;
+    if(!mpBowCache)
+        mpBowCache = std::make_shared<BowCache>();
+    BowCache::ComputeAsync(mpBowCache, mpORBvocabulary, mDescriptors, submit);
+}
 
-    // Fill undistorted keypoint vector
-    mvKeysUn.resize(N);
-    for(int i=0; i<N; i++)
+void Frame::UndistortKeyPoints(const cv::Size &imageSize)
+{
+    if(mDistCoef.at<float>(0)==0.0)
     {
-        cv::KeyPoint kp = mvKeys[i];
-        kp.pt.x=mat.at<float>(i,0);
-        kp.pt.y=mat.at<float>(i,1);
-        mvKeysUn[i]=kp;
+        mvKeysUn=mvKeys;
+        return;
     }
 
+    // Interpolated from the map of this calibration, built by the first frame that uses it
+    const std::shared_ptr<const UndistortionMap> pMap =
+            UndistortionMap::Get(static_cast<Pinhole*>(mpCamera)->toK(),mDistCoef,mK,imageSize);
+    pMap->Undistort(mvKeys,mvKeysUn);
 }
 
 void Frame::ComputeImageBounds(const cv::Mat &imLeft)
@@ -817,26 +935,34 @@ void Frame::ComputeStereoMatches()
 
     const int nRows = mpORBextractorLeft->mvImagePyramid[0].rows;
 
-    //Assign keypoints to row table
-    vector<vector<size_t> > vRowIndices(nRows,vector<size_t>());
-
-    for(int i=0; i<nRows; i++)
-        vRowIndices[i].reserve(200);
-
+    //Assign keypoints to row table, flat: the keypoints of row y are vRowIndices[vRowStart[y]..vRowStart[y+1])
     const int Nr = mvKeysRight.size();
 
+    vector<int> vMinRow(Nr), vMaxRow(Nr);
+    vector<int> vRowStart(nRows+1,0);
+
     for(int iR=0; iR<Nr; iR++)
     {
         const cv::KeyPoint &kp = mvKeysRight[iR];
         const float &kpY = kp.pt.y;
         const float r = 2.0f*mvScaleFactors[mvKeysRight[iR].octave];
-        const int maxr = ceil(kpY+r);
-        const int minr = floor(kpY-r);
+        vMaxRow[iR] = min((int)ceil(kpY+r),nRows-1);
+        vMinRow[iR] = max((int)floor(kpY-r),0);
 
-        for(int yi=minr;yi<=maxr;yi++)
-            vRowIndices[yi].push_back(iR);
+        for(int yi=vMinRow[iR];yi<=vMaxRow[iR];yi++)
+            vRowStart[yi+1]++;
     }
 
+    for(int yi=0; yi<nRows; yi++)
+        vRowStart[yi+1] += vRowStart[yi];
+
+    // Filled in keypoint order, so each row keeps the candidates sorted as before
+    vector<size_t> vRowIndices(vRowStart[nRows]);
+    vector<int> vRowFill(vRowStart.begin(),vRowStart.end()-1);
+    for(int iR=0; iR<Nr; iR++)
+        for(int yi=vMinRow[iR];yi<=vMaxRow[iR];yi++)
+            vRowIndices[vRowFill[yi]++] = iR;
+
     // Set limits for search
     const float minZ = mb;
     const float minD = 0;
@@ -846,6 +972,10 @@ void Frame::ComputeStereoMatches()
     vector<pair<int, int> > vDistIdx;
     vDistIdx.reserve(N);
 
+    // Candidates left after the checks and their distances, reused for all keypoints
+    vector<size_t> vCandidates;
+    vector<int> vDistances;
+
     for(int iL=0; iL<N; iL++)
     {
         const cv::KeyPoint &kpL = mvKeys[iL];
@@ -853,9 +983,11 @@ void Frame::ComputeStereoMatches()
         const float &vL = kpL.pt.y;
         const float &uL = kpL.pt.x;
 
-        const vector<size_t> &vCandidates = vRowIndices[vL];
+        const int row = vL;
+        const size_t *pRowBegin = vRowIndices.data() + vRowStart[row];
+        const size_t *pRowEnd = vRowIndices.data() + vRowStart[row+1];
 
-        if(vCandidates.empty())
+        if(pRowBegin==pRowEnd)
             continue;
 
         const float minU = uL-maxD;
@@ -864,15 +996,13 @@ void Frame::ComputeStereoMatches()
         if(maxU<0)
             continue;
 
-        int bestDist = ORBmatcher::TH_HIGH;
-        size_t bestIdxR = 0;
-
         const cv::Mat &dL = mDescriptors.row(iL);
 
         // Compare descriptor to right keypoints
-        for(size_t iC=0; iC<vCandidates.size(); iC++)
+        vCandidates.clear();
+        for(const size_t *pC=pRowBegin; pC!=pRowEnd; pC++)
         {
-            const size_t iR = vCandidates[iC];
+            const size_t iR = *pC;
             const cv::KeyPoint &kpR = mvKeysRight[iR];
 
             if(kpR.octave<levelL-1 || kpR.octave>levelL+1)
@@ -881,18 +1011,13 @@ void Frame::ComputeStereoMatches()
             const float &uR = kpR.pt.x;
 
             if(uR>=minU && uR<=maxU)
-            {
-                const cv::Mat &dR = mDescriptorsRight.row(iR);
-                const int dist = ORBmatcher::DescriptorDistance(dL,dR);
-
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdxR = iR;
-                }
-            }
+                vCandidates.push_back(iR);
         }
 
+        const ORBmatcher::DescriptorMatch match = ORBmatcher::SearchDescriptors(dL, mDescriptorsRight, vCandidates, vDistances);
+        const int bestDist = match.bestDist;
+        const size_t bestIdxR = match.bestIdx;
+
         // Subpixel match by correlation
         if(bestDist<thOrbDist)
         {
@@ -905,31 +1030,30 @@ void Frame::ComputeStereoMatches()
 
             // sliding window search
             const int w = 5;
-            cv::Mat IL = mpORBextractorLeft->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduL-w,scaleduL+w+1);
+            const cv::Mat &IL = mpORBextractorLeft->mvImagePyramid[kpL.octave];
+            const cv::Mat &IR = mpORBextractorRight->mvImagePyramid[kpL.octave];
 
             int bestDist = INT_MAX;
             int bestincR = 0;
             const int L = 5;
-            vector<float> vDists;
-            vDists.resize(2*L+1);
+            float vDists[2*L+1];
 
-            const float iniu = scaleduR0+L-w;
+            // Columns of all the right windows
+            const float iniu = scaleduR0-L-w;
             const float endu = scaleduR0+L+w+1;
-            if(iniu<0 || endu >= mpORBextractorRight->mvImagePyramid[kpL.octave].cols)
+            if(iniu<0 || endu >= IR.cols)
                 continue;
 
+            StereoWindowDistances(IL, IR, scaleduL, scaleduR0, scaledvL, vDists);
+
             for(int incR=-L; incR<=+L; incR++)
             {
-                cv::Mat IR = mpORBextractorRight->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduR0+incR-w,scaleduR0+incR+w+1);
-
-                float dist = cv::norm(IL,IR,cv::NORM_L1);
+                const float dist = vDists[L+incR];
                 if(dist<bestDist)
                 {
                     bestDist =  dist;
                     bestincR = incR;
                 }
-
-                vDists[L+incR] = dist;
             }
 
             if(bestincR==-L || bestincR==L)
@@ -981,6 +1105,71 @@ void Frame::ComputeStereoMatches()
 }
 
 
+void Frame::StereoWindowDistances(const cv::Mat &IL, const cv::Mat &IR, const int uL, const int uR0, const int v, float* vDists)
+{
+    const int w = 5;
+    const int L = 5;
+
+#if (defined(__ARM_NEON) && defined(__aarch64__)) || defined(__SSE2__)
+    // Left window zero padded to 16 bytes a row, right windows as one 21 byte strip a row,
+    // in stack buffers so that the 16 byte loads stay inside
+    alignas(16) uchar patchL[2*w+1][16] = {};
+    alignas(16) uchar stripR[2*w+1][32];
+    for(int r=0; r<2*w+1; r++)
+    {
+        memcpy(patchL[r], IL.ptr<uchar>(v-w+r)+uL-w, 2*w+1);
+        memcpy(stripR[r], IR.ptr<uchar>(v-w+r)+uR0-L-w, 2*(L+w)+1);
+    }
+
+    // Only the first 11 bytes of a row are in the window
+    static const uchar kMask[16] = {255,255,255,255,255,255,255,255,255,255,255,0,0,0,0,0};
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t mask = vld1q_u8(kMask);
+    uint8x16_t l[2*w+1];
+    for(int r=0; r<2*w+1; r++)
+        l[r] = vld1q_u8(patchL[r]);
+
+    // Per window: absolute differences of 11 rows, pairwise widened into 16 bit lanes (at most 11*11*255)
+    for(int o=0; o<2*L+1; o++)
+    {
+        uint16x8_t acc = vdupq_n_u16(0);
+        for(int r=0; r<2*w+1; r++)
+            acc = vpadalq_u8(acc, vandq_u8(vabdq_u8(l[r], vld1q_u8(stripR[r]+o)), mask));
+        vDists[o] = vaddvq_u16(acc);
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_loadu_si128((const __m128i*)kMask);
+    __m128i l[2*w+1];
+    for(int r=0; r<2*w+1; r++)
+        l[r] = _mm_load_si128((const __m128i*)patchL[r]);
+
+    // Per window: one psadbw a row, the padding of the left row against the masked right bytes adds nothing
+    for(int o=0; o<2*L+1; o++)
+    {
+        __m128i acc = _mm_setzero_si128();
+        for(int r=0; r<2*w+1; r++)
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(l[r], _mm_and_si128(_mm_loadu_si128((const __m128i*)(stripR[r]+o)), mask)));
+        vDists[o] = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+    }
+#else
+    for(int o=0; o<2*L+1; o++)
+    {
+        int dist = 0;
+        for(int r=0; r<2*w+1; r++)
+        {
+            const uchar *pL = IL.ptr<uchar>(v-w+r)+uL-w;
+            const uchar *pR = IR.ptr<uchar>(v-w+r)+uR0-L-w+o;
+            for(int c=0; c<2*w+1; c++)
+                dist += abs((int)pL[c]-(int)pR[c]);
+        }
+        vDists[o] = dist;
+    }
+#endif
+}
+
+
 void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth)
 {
     mvuRight = vector<float>(N,-1);
@@ -1004,6 +1193,29 @@ void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth)
     }
 }
 
+void Frame::ComputeStereoFromDepthMap(const cv::Mat &imDepth, const int nScale)
+{
+    mvuRight = vector<float>(N,-1);
+    mvDepth = vector<float>(N,-1);
+
+    for(int i=0; i<N; i++)
+    {
+        const cv::KeyPoint &kp = mvKeys[i];
+        const cv::KeyPoint &kpU = mvKeysUn[i];
+
+        const int v = std::min(cvFloor(kp.pt.y)/nScale, imDepth.rows-1);
+        const int u = std::min(cvFloor(kp.pt.x)/nScale, imDepth.cols-1);
+
+        const float d = imDepth.at<float>(v,u);
+
+        if(d>0)
+        {
+            mvDepth[i] = d;
+            mvuRight[i] = kpU.pt.x-mbf/d;
+        }
+    }
+}
+
 bool Frame::UnprojectStereo(const int &i, Eigen::Vector3f &x3D)
 {
     const float z = mvDepth[i];
@@ -1119,7 +1331,7 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 
     mpMutexImu = new std::mutex();
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(imLeft.size());
 
 }
 
@@ -1165,6 +1377,268 @@ void Frame::ComputeStereoFishEyeMatches() {
     }
 }
 
+void LocalMapSnapshot::Resize()
+{
+    const size_t n = vpMapPoints.size();
+    vX.resize(n); vY.resize(n); vZ.resize(n);
+    vNx.resize(n); vNy.resize(n); vNz.resize(n);
+    vMinDistance.resize(n); vMaxDistance.resize(n);
+}
+
+void LocalMapSnapshot::Load(const size_t i0, const size_t i1)
+{
+    float geometry[8];
+    for(size_t i=i0; i<i1; i++)
+    {
+        vpMapPoints[i]->GetGeometry(geometry);
+        vX[i] = geometry[0]; vY[i] = geometry[1]; vZ[i] = geometry[2];
+        vNx[i] = geometry[3]; vNy[i] = geometry[4]; vNz[i] = geometry[5];
+        vMinDistance[i] = geometry[6]; vMaxDistance[i] = geometry[7];
+    }
+}
+
+// Camera coordinates, distance to the camera center O and viewing cosine of n snapshot points
+// starting at i0, and whether they pass the depth, distance and viewing angle tests
+static void FrustumChecksBatch(const LocalMapSnapshot &snapshot, const size_t i0, const size_t n,
+                               const Eigen::Matrix3f &R, const Eigen::Vector3f &t, const Eigen::Vector3f &O,
+                               const float viewingCosLimit, float* vPcx, float* vPcy, float* vPcz,
+                               float* vDist, float* vCos, char* vbPass)
+{
+    const float *pX = snapshot.vX.data()+i0, *pY = snapshot.vY.data()+i0, *pZ = snapshot.vZ.data()+i0;
+    const float *pNx = snapshot.vNx.data()+i0, *pNy = snapshot.vNy.data()+i0, *pNz = snapshot.vNz.data()+i0;
+    const float *pMin = snapshot.vMinDistance.data()+i0, *pMax = snapshot.vMaxDistance.data()+i0;
+
+    size_t j = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t r00 = vdupq_n_f32(R(0,0)), r01 = vdupq_n_f32(R(0,1)), r02 = vdupq_n_f32(R(0,2));
+    const float32x4_t r10 = vdupq_n_f32(R(1,0)), r11 = vdupq_n_f32(R(1,1)), r12 = vdupq_n_f32(R(1,2));
+    const float32x4_t r20 = vdupq_n_f32(R(2,0)), r21 = vdupq_n_f32(R(2,1)), r22 = vdupq_n_f32(R(2,2));
+    const float32x4_t t0 = vdupq_n_f32(t(0)), t1 = vdupq_n_f32(t(1)), t2 = vdupq_n_f32(t(2));
+    const float32x4_t o0 = vdupq_n_f32(O(0)), o1 = vdupq_n_f32(O(1)), o2 = vdupq_n_f32(O(2));
+    const float32x4_t cosLimit = vdupq_n_f32(viewingCosLimit);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    for(; j+4<=n; j+=4)
+    {
+        const float32x4_t x = vld1q_f32(pX+j), y = vld1q_f32(pY+j), z = vld1q_f32(pZ+j);
+        const float32x4_t pcx = vfmaq_f32(vfmaq_f32(vfmaq_f32(t0,r00,x),r01,y),r02,z);
+        const float32x4_t pcy = vfmaq_f32(vfmaq_f32(vfmaq_f32(t1,r10,x),r11,y),r12,z);
+        const float32x4_t pcz = vfmaq_f32(vfmaq_f32(vfmaq_f32(t2,r20,x),r21,y),r22,z);
+
+        const float32x4_t dx = vsubq_f32(x,o0), dy = vsubq_f32(y,o1), dz = vsubq_f32(z,o2);
+        const float32x4_t dist = vsqrtq_f32(vfmaq_f32(vfmaq_f32(vmulq_f32(dx,dx),dy,dy),dz,dz));
+        const float32x4_t dot = vfmaq_f32(vfmaq_f32(vmulq_f32(dx,vld1q_f32(pNx+j)),dy,vld1q_f32(pNy+j)),dz,vld1q_f32(pNz+j));
+        const float32x4_t viewCos = vdivq_f32(dot,dist);
+
+        uint32x4_t pass = vcgeq_f32(pcz,zero);
+        pass = vandq_u32(pass, vcgeq_f32(dist,vld1q_f32(pMin+j)));
+        pass = vandq_u32(pass, vcleq_f32(dist,vld1q_f32(pMax+j)));
+        pass = vandq_u32(pass, vcgeq_f32(viewCos,cosLimit));
+
+        vst1q_f32(vPcx+j,pcx); vst1q_f32(vPcy+j,pcy); vst1q_f32(vPcz+j,pcz);
+        vst1q_f32(vDist+j,dist); vst1q_f32(vCos+j,viewCos);
+
+        // All ones lanes narrowed to one byte each, as 0 or 1
+        const uint16x4_t pass16 = vmovn_u32(pass);
+        const uint8x8_t pass8 = vand_u8(vmovn_u16(vcombine_u16(pass16,pass16)), vdup_n_u8(1));
+        vst1_lane_u32(reinterpret_cast<uint32_t*>(vbPass+j), vreinterpret_u32_u8(pass8), 0);
+    }
+#elif defined(__SSE2__)
+    const __m128 r00 = _mm_set1_ps(R(0,0)), r01 = _mm_set1_ps(R(0,1)), r02 = _mm_set1_ps(R(0,2));
+    const __m128 r10 = _mm_set1_ps(R(1,0)), r11 = _mm_set1_ps(R(1,1)), r12 = _mm_set1_ps(R(1,2));
+    const __m128 r20 = _mm_set1_ps(R(2,0)), r21 = _mm_set1_ps(R(2,1)), r22 = _mm_set1_ps(R(2,2));
+    const __m128 t0 = _mm_set1_ps(t(0)), t1 = _mm_set1_ps(t(1)), t2 = _mm_set1_ps(t(2));
+    const __m128 o0 = _mm_set1_ps(O(0)), o1 = _mm_set1_ps(O(1)), o2 = _mm_set1_ps(O(2));
+    const __m128 cosLimit = _mm_set1_ps(viewingCosLimit);
+    const __m128 zero = _mm_setzero_ps();
+    for(; j+4<=n; j+=4)
+    {
+        const __m128 x = _mm_loadu_ps(pX+j), y = _mm_loadu_ps(pY+j), z = _mm_loadu_ps(pZ+j);
+        const __m128 pcx = _mm_add_ps(_mm_add_ps(_mm_add_ps(t0,_mm_mul_ps(r00,x)),_mm_mul_ps(r01,y)),_mm_mul_ps(r02,z));
+        const __m128 pcy = _mm_add_ps(_mm_add_ps(_mm_add_ps(t1,_mm_mul_ps(r10,x)),_mm_mul_ps(r11,y)),_mm_mul_ps(r12,z));
+        const __m128 pcz = _mm_add_ps(_mm_add_ps(_mm_add_ps(t2,_mm_mul_ps(r20,x)),_mm_mul_ps(r21,y)),_mm_mul_ps(r22,z));
+
+        const __m128 dx = _mm_sub_ps(x,o0), dy = _mm_sub_ps(y,o1), dz = _mm_sub_ps(z,o2);
+        const __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,dx),_mm_mul_ps(dy,dy)),_mm_mul_ps(dz,dz)));
+        const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,_mm_loadu_ps(pNx+j)),_mm_mul_ps(dy,_mm_loadu_ps(pNy+j))),
+                                      _mm_mul_ps(dz,_mm_loadu_ps(pNz+j)));
+        const __m128 viewCos = _mm_div_ps(dot,dist);
+
+        __m128 pass = _mm_cmpge_ps(pcz,zero);
+        pass = _mm_and_ps(pass, _mm_cmpge_ps(dist,_mm_loadu_ps(pMin+j)));
+        pass = _mm_and_ps(pass, _mm_cmple_ps(dist,_mm_loadu_ps(pMax+j)));
+        pass = _mm_and_ps(pass, _mm_cmpge_ps(viewCos,cosLimit));
+
+        _mm_storeu_ps(vPcx+j,pcx); _mm_storeu_ps(vPcy+j,pcy); _mm_storeu_ps(vPcz+j,pcz);
+        _mm_storeu_ps(vDist+j,dist); _mm_storeu_ps(vCos+j,viewCos);
+
+        const int mask = _mm_movemask_ps(pass);
+        for(int k=0; k<4; k++)
+            vbPass[j+k] = (mask>>k)&1;
+    }
+#endif
+    for(; j<n; j++)
+    {
+        const Eigen::Vector3f P(pX[j],pY[j],pZ[j]);
+        const Eigen::Vector3f Pc = R * P + t;
+        const Eigen::Vector3f PO = P - O;
+        const float dist = PO.norm();
+        const float viewCos = PO.dot(Eigen::Vector3f(pNx[j],pNy[j],pNz[j]))/dist;
+
+        vPcx[j] = Pc(0); vPcy[j] = Pc(1); vPcz[j] = Pc(2);
+        vDist[j] = dist; vCos[j] = viewCos;
+        vbPass[j] = Pc(2)>=0.0f && dist>=pMin[j] && dist<=pMax[j] && viewCos>=viewingCosLimit;
+    }
+}
+
+void Frame::isInFrustum(const LocalMapSnapshot &snapshot, const size_t i0, const size_t i1,
+                        float viewingCosLimit, char* vbInFrustum)
+{
+    // Poses and centers of the cameras of the frame, the right one only for stereo fisheye
+    const bool bRight = Nleft != -1;
+    const int nCameras = bRight ? 2 : 1;
+    Eigen::Matrix3f vR[2];
+    Eigen::Vector3f vt[2], vO[2];
+    GeometricCamera* vpCameras[2] = {mpCamera, mpCamera2};
+    vR[0] = mRcw;
+    vt[0] = mtcw;
+    vO[0] = mOw;
+    if(bRight)
+    {
+        const Eigen::Matrix3f Rrl = mTrl.rotationMatrix();
+        vR[1] = Rrl * mRcw;
+        vt[1] = Rrl * mtcw + mTrl.translation();
+        vO[1] = mRwc * mTlr.translation() + mOw;
+    }
+
+    const size_t nBatch = 64;
+    alignas(16) float vPcx[nBatch], vPcy[nBatch], vPcz[nBatch], vDist[nBatch], vCos[nBatch];
+    alignas(16) char vbPass[nBatch];
+    Eigen::Vector3f vPc[nBatch];
+    Eigen::Vector2f vuv[nBatch];
+    size_t vIndices[nBatch];
+    for(size_t b0=i0; b0<i1; b0+=nBatch)
+    {
+        const size_t m = min(nBatch,i1-b0);
+        for(size_t j=0; j<m; j++)
+        {
+            MapPoint* pMP = snapshot.vpMapPoints[b0+j];
+            pMP->mbTrackInView = false;
+            pMP->mTrackProjX = -1;
+            pMP->mTrackProjY = -1;
+            if(bRight)
+            {
+                pMP->mbTrackInViewR = false;
+                pMP->mnTrackScaleLevel = -1;
+                pMP->mnTrackScaleLevelR = -1;
+            }
+            vbInFrustum[b0+j] = 0;
+        }
+
+        for(int c=0; c<nCameras; c++)
+        {
+            FrustumChecksBatch(snapshot,b0,m,vR[c],vt[c],vO[c],viewingCosLimit,vPcx,vPcy,vPcz,vDist,vCos,vbPass);
+
+            // Only the points that passed are projected, with one call to the camera model
+            size_t nPass = 0;
+            for(size_t j=0; j<m; j++)
+            {
+                if(!vbPass[j])
+                    continue;
+                vIndices[nPass] = j;
+                vPc[nPass++] = Eigen::Vector3f(vPcx[j],vPcy[j],vPcz[j]);
+            }
+            vpCameras[c]->projectBatch(vPc,vuv,nPass);
+
+            for(size_t k=0; k<nPass; k++)
+            {
+                const Eigen::Vector2f &uv = vuv[k];
+                if(uv(0)<mnMinX || uv(0)>mnMaxX || uv(1)<mnMinY || uv(1)>mnMaxY)
+                    continue;
+
+                // Predict scale in the image, as MapPoint::PredictScale
+                const size_t j = vIndices[k];
+                int nPredictedLevel = ceil(log(snapshot.vMaxDistance[b0+j]/vDist[j])/mfLogScaleFactor);
+                if(nPredictedLevel<0)
+                    nPredictedLevel = 0;
+                else if(nPredictedLevel>=mnScaleLevels)
+                    nPredictedLevel = mnScaleLevels-1;
+
+                // Data used by the tracking
+                MapPoint* pMP = snapshot.vpMapPoints[b0+j];
+                if(c==0)
+                {
+                    pMP->mbTrackInView = true;
+                    pMP->mTrackProjX = uv(0);
+                    pMP->mTrackProjY = uv(1);
+                    pMP->mnTrackScaleLevel = nPredictedLevel;
+                    pMP->mTrackViewCos = vCos[j];
+                    pMP->mTrackDepth = vPc[k].norm();
+                    if(!bRight)
+                        pMP->mTrackProjXR = uv(0) - mbf/vPcz[j];
+                }
+                else
+                {
+                    pMP->mbTrackInViewR = true;
+                    pMP->mTrackProjXR = uv(0);
+                    pMP->mTrackProjYR = uv(1);
+                    pMP->mnTrackScaleLevelR = nPredictedLevel;
+                    pMP->mTrackViewCosR = vCos[j];
+                    pMP->mTrackDepthR = vPc[k].norm();
+                }
+                vbInFrustum[b0+j] = 1;
+            }
+        }
+    }
+}
+
+bool Frame::isInFrustumProjected(MapPoint* pMP, const Eigen::Vector3f &P, const Eigen::Vector3f &Pc,
+                                 const Eigen::Vector2f &uv, float viewingCosLimit)
+{
+    const float Pc_dist = Pc.norm();
+    const float invz = 1.0f/Pc(2);
+
+    if(uv(0)<mnMinX || uv(0)>mnMaxX)
+        return false;
+    if(uv(1)<mnMinY || uv(1)>mnMaxY)
+        return false;
+
+    pMP->mTrackProjX = uv(0);
+    pMP->mTrackProjY = uv(1);
+
+    // Check distance is in the scale invariance region of the MapPoint
+    const float maxDistance = pMP->GetMaxDistanceInvariance();
+    const float minDistance = pMP->GetMinDistanceInvariance();
+    const Eigen::Vector3f PO = P - mOw;
+    const float dist = PO.norm();
+
+    if(dist<minDistance || dist>maxDistance)
+        return false;
+
+    // Check viewing angle
+    Eigen::Vector3f Pn = pMP->GetNormal();
+
+    const float viewCos = PO.dot(Pn)/dist;
+
+    if(viewCos<viewingCosLimit)
+        return false;
+
+    // Predict scale in the image
+    const int nPredictedLevel = pMP->PredictScale(dist,this);
+
+    // Data used by the tracking
+    pMP->mbTrackInView = true;
+    pMP->mTrackProjX = uv(0);
+    pMP->mTrackProjXR = uv(0) - mbf*invz;
+
+    pMP->mTrackDepth = Pc_dist;
+
+    pMP->mTrackProjY = uv(1);
+    pMP->mnTrackScaleLevel= nPredictedLevel;
+    pMP->mTrackViewCos = viewCos;
+
+    return true;
+}
+
 bool Frame::isInFrustumChecks(MapPoint *pMP, float viewingCosLimit, bool bRight) {
     // 3D in absolute coordinates
     Eigen::Vector3f P = pMP->GetWorldPos();
@@ -27,7 +27,7 @@
 namespace ORB_SLAM3
 {
 
-FrameDrawer::FrameDrawer(Atlas* pAtlas):both(false),mpAtlas(pAtlas)
+FrameDrawer::FrameDrawer(Atlas* pAtlas):both(false),mpAtlas(pAtlas),mnUpdateInterval(1),mnFramesSinceUpdate(0)
 {
     mState=Tracking::SYSTEM_NOT_READY;
     mIm = cv::Mat(480,640,CV_8UC3, cv::Scalar(0,0,0));
@@ -367,8 +367,24 @@ void FrameDrawer::DrawTextInfo(cv::Mat &im, int nState, cv::Mat &imText)
 
 }
 
+void FrameDrawer::SetUpdateInterval(int nFrames)
+{
+    mnUpdateInterval = max(nFrames,0);
+}
+
+int FrameDrawer::GetUpdateInterval() const
+{
+    return mnUpdateInterval;
+}
+
 void FrameDrawer::Update(Tracking *pTracker)
 {
+    // Headless or sampled: skip the image and keypoint copies and the lock
+    const int nInterval = mnUpdateInterval.load(memory_order_relaxed);
+    if(nInterval==0 || ++mnFramesSinceUpdate<nInterval)
+        return;
+    mnFramesSinceUpdate = 0;
+
     unique_lock<mutex> lock(mMutex);
     pTracker->mImGray.copyTo(mIm);
     mvCurrentKeys=pTracker->mCurrentFrame.mvKeys;
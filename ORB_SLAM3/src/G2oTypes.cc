@@ -489,9 +489,38 @@ VertexAccBias::VertexAccBias(Frame *pF)
 
 
 
+PreintegratedDeltas::PreintegratedDeltas(IMU::Preintegrated *pInt):
+    dR0(NormalizeRotation(pInt->GetOriginalDeltaRotation().cast<double>())),
+    dV0(pInt->GetOriginalDeltaVelocity().cast<double>()), dP0(pInt->GetOriginalDeltaPosition().cast<double>()),
+    JRg(pInt->JRg.cast<double>()), JVg(pInt->JVg.cast<double>()), JPg(pInt->JPg.cast<double>()),
+    JVa(pInt->JVa.cast<double>()), JPa(pInt->JPa.cast<double>()), mbUpdated(false)
+{
+    const IMU::Bias b0 = pInt->GetOriginalBias();
+    bg0 << b0.bwx, b0.bwy, b0.bwz;
+    ba0 << b0.bax, b0.bay, b0.baz;
+}
+
+void PreintegratedDeltas::Update(const Eigen::Vector3d &bg_, const Eigen::Vector3d &ba_)
+{
+    if(mbUpdated && bg_==bg && ba_==ba)
+        return;
+
+    bg = bg_;
+    ba = ba_;
+    mbUpdated = true;
+
+    // Same first order correction as IMU::Preintegrated::GetDeltaRotation and others,
+    // dR0 is already normalized and the product of two rotations stays orthonormal
+    dbg = bg - bg0;
+    const Eigen::Vector3d dba = ba - ba0;
+    dR = dR0 * Sophus::SO3d::exp(JRg * dbg).matrix();
+    dV = dV0 + JVg * dbg + JVa * dba;
+    dP = dP0 + JPg * dbg + JPa * dba;
+}
+
 EdgeInertial::EdgeInertial(IMU::Preintegrated *pInt):JRg(pInt->JRg.cast<double>()),
     JVg(pInt->JVg.cast<double>()), JPg(pInt->JPg.cast<double>()), JVa(pInt->JVa.cast<double>()),
-    JPa(pInt->JPa.cast<double>()), mpInt(pInt), dt(pInt->dT)
+    JPa(pInt->JPa.cast<double>()), mpInt(pInt), dt(pInt->dT), mDeltas(pInt)
 {
     // This edge links 6 vertices
     resize(6);
@@ -520,10 +549,10 @@ void EdgeInertial::computeError()
     const VertexAccBias* VA1= static_cast<const VertexAccBias*>(_vertices[3]);
     const VertexPose* VP2 = static_cast<const VertexPose*>(_vertices[4]);
     const VertexVelocity* VV2 = static_cast<const VertexVelocity*>(_vertices[5]);
-    const IMU::Bias b1(VA1->estimate()[0],VA1->estimate()[1],VA1->estimate()[2],VG1->estimate()[0],VG1->estimate()[1],VG1->estimate()[2]);
-    const Eigen::Matrix3d dR = mpInt->GetDeltaRotation(b1).cast<double>();
-    const Eigen::Vector3d dV = mpInt->GetDeltaVelocity(b1).cast<double>();
-    const Eigen::Vector3d dP = mpInt->GetDeltaPosition(b1).cast<double>();
+    mDeltas.Update(VG1->estimate(), VA1->estimate());
+    const Eigen::Matrix3d &dR = mDeltas.dR;
+    const Eigen::Vector3d &dV = mDeltas.dV;
+    const Eigen::Vector3d &dP = mDeltas.dP;
 
     const Eigen::Vector3d er = LogSO3(dR.transpose()*VP1->estimate().Rwb.transpose()*VP2->estimate().Rwb);
     const Eigen::Vector3d ev = VP1->estimate().Rwb.transpose()*(VV2->estimate() - VV1->estimate() - g*dt) - dV;
@@ -541,16 +570,14 @@ void EdgeInertial::linearizeOplus()
     const VertexAccBias* VA1= static_cast<const VertexAccBias*>(_vertices[3]);
     const VertexPose* VP2 = static_cast<const VertexPose*>(_vertices[4]);
     const VertexVelocity* VV2= static_cast<const VertexVelocity*>(_vertices[5]);
-    const IMU::Bias b1(VA1->estimate()[0],VA1->estimate()[1],VA1->estimate()[2],VG1->estimate()[0],VG1->estimate()[1],VG1->estimate()[2]);
-    const IMU::Bias db = mpInt->GetDeltaBias(b1);
-    Eigen::Vector3d dbg;
-    dbg << db.bwx, db.bwy, db.bwz;
+    mDeltas.Update(VG1->estimate(), VA1->estimate());
+    const Eigen::Vector3d &dbg = mDeltas.dbg;
 
     const Eigen::Matrix3d Rwb1 = VP1->estimate().Rwb;
     const Eigen::Matrix3d Rbw1 = Rwb1.transpose();
     const Eigen::Matrix3d Rwb2 = VP2->estimate().Rwb;
 
-    const Eigen::Matrix3d dR = mpInt->GetDeltaRotation(b1).cast<double>();
+    const Eigen::Matrix3d &dR = mDeltas.dR;
     const Eigen::Matrix3d eR = dR.transpose()*Rbw1*Rwb2;
     const Eigen::Vector3d er = LogSO3(eR);
     const Eigen::Matrix3d invJr = InverseRightJacobianSO3(er);
@@ -595,7 +622,7 @@ void EdgeInertial::linearizeOplus()
 
 EdgeInertialGS::EdgeInertialGS(IMU::Preintegrated *pInt):JRg(pInt->JRg.cast<double>()),
     JVg(pInt->JVg.cast<double>()), JPg(pInt->JPg.cast<double>()), JVa(pInt->JVa.cast<double>()),
-    JPa(pInt->JPa.cast<double>()), mpInt(pInt), dt(pInt->dT)
+    JPa(pInt->JPa.cast<double>()), mpInt(pInt), dt(pInt->dT), mDeltas(pInt)
 {
     // This edge links 8 vertices
     resize(8);
@@ -625,12 +652,12 @@ void EdgeInertialGS::computeError()
     const VertexVelocity* VV2 = static_cast<const VertexVelocity*>(_vertices[5]);
     const VertexGDir* VGDir = static_cast<const VertexGDir*>(_vertices[6]);
     const VertexScale* VS = static_cast<const VertexScale*>(_vertices[7]);
-    const IMU::Bias b(VA->estimate()[0],VA->estimate()[1],VA->estimate()[2],VG->estimate()[0],VG->estimate()[1],VG->estimate()[2]);
+    mDeltas.Update(VG->estimate(), VA->estimate());
     g = VGDir->estimate().Rwg*gI;
     const double s = VS->estimate();
-    const Eigen::Matrix3d dR = mpInt->GetDeltaRotation(b).cast<double>();
-    const Eigen::Vector3d dV = mpInt->GetDeltaVelocity(b).cast<double>();
-    const Eigen::Vector3d dP = mpInt->GetDeltaPosition(b).cast<double>();
+    const Eigen::Matrix3d &dR = mDeltas.dR;
+    const Eigen::Vector3d &dV = mDeltas.dV;
+    const Eigen::Vector3d &dP = mDeltas.dP;
 
     const Eigen::Vector3d er = LogSO3(dR.transpose()*VP1->estimate().Rwb.transpose()*VP2->estimate().Rwb);
     const Eigen::Vector3d ev = VP1->estimate().Rwb.transpose()*(s*(VV2->estimate() - VV1->estimate()) - g*dt) - dV;
@@ -649,22 +676,19 @@ void EdgeInertialGS::linearizeOplus()
     const VertexVelocity* VV2 = static_cast<const VertexVelocity*>(_vertices[5]);
     const VertexGDir* VGDir = static_cast<const VertexGDir*>(_vertices[6]);
     const VertexScale* VS = static_cast<const VertexScale*>(_vertices[7]);
-    const IMU::Bias b(VA->estimate()[0],VA->estimate()[1],VA->estimate()[2],VG->estimate()[0],VG->estimate()[1],VG->estimate()[2]);
-    const IMU::Bias db = mpInt->GetDeltaBias(b);
-
-    Eigen::Vector3d dbg;
-    dbg << db.bwx, db.bwy, db.bwz;
+    mDeltas.Update(VG->estimate(), VA->estimate());
+    const Eigen::Vector3d &dbg = mDeltas.dbg;
 
     const Eigen::Matrix3d Rwb1 = VP1->estimate().Rwb;
     const Eigen::Matrix3d Rbw1 = Rwb1.transpose();
     const Eigen::Matrix3d Rwb2 = VP2->estimate().Rwb;
     const Eigen::Matrix3d Rwg = VGDir->estimate().Rwg;
-    Eigen::MatrixXd Gm = Eigen::MatrixXd::Zero(3,2);
+    Eigen::Matrix<double,3,2> Gm = Eigen::Matrix<double,3,2>::Zero();
     Gm(0,1) = -IMU::GRAVITY_VALUE;
     Gm(1,0) = IMU::GRAVITY_VALUE;
     const double s = VS->estimate();
-    const Eigen::MatrixXd dGdTheta = Rwg*Gm;
-    const Eigen::Matrix3d dR = mpInt->GetDeltaRotation(b).cast<double>();
+    const Eigen::Matrix<double,3,2> dGdTheta = Rwg*Gm;
+    const Eigen::Matrix3d &dR = mDeltas.dR;
     const Eigen::Matrix3d eR = dR.transpose()*Rbw1*Rwb2;
     const Eigen::Vector3d er = LogSO3(eR);
     const Eigen::Matrix3d invJr = InverseRightJacobianSO3(er);
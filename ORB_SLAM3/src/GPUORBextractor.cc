@@ -0,0 +1,1026 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "GPUORBextractor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(HAVE_OPENCL)
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+#include <CL/cl_ext.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+#if defined(HAVE_OPENCL)
+
+namespace
+{
+
+const int PATCH_SIZE = 31;
+const int EDGE_THRESHOLD = 19;
+
+// Selection kernel work-group, one per level
+const int SELECT_GROUP_SIZE = 256;
+
+// Bucket keys pack the score and the position into 8+11+11 bits
+const int MAX_IMAGE_SIZE = 2048;
+
+// Buckets per feature of a level
+const int BUCKETS_PER_FEATURE = 2;
+
+// Cell size of the iniThFAST/minThFAST decision, as in ORBextractor::ComputeKeyPointsOctTree
+const float FAST_CELL_SIZE = 35;
+
+typedef cl_mem (CL_API_CALL *ImportMemoryARMFn)(cl_context, cl_mem_flags, const cl_import_properties_arm*,
+                                               void*, size_t, cl_int*);
+
+const char* kProgramSource = R"CLC(
+#define EDGE_THRESHOLD 19
+#define HALF_PATCH_SIZE 15
+
+// The FAST cells start 3 pixels outside the detection region, as in ComputeKeyPointsOctTree
+#define CELL_BORDER (EDGE_THRESHOLD-3)
+
+__constant int2 kCircle[16] = {
+    (int2)(0,-3), (int2)(1,-3), (int2)(2,-2), (int2)(3,-1), (int2)(3,0), (int2)(3,1), (int2)(2,2), (int2)(1,3),
+    (int2)(0,3), (int2)(-1,3), (int2)(-2,2), (int2)(-3,1), (int2)(-3,0), (int2)(-3,-1), (int2)(-2,-2), (int2)(-1,-3)};
+
+inline int reflect101(int i, int n)
+{
+    if(i < 0)
+        i = -i;
+    if(i >= n)
+        i = 2*n - 2 - i;
+    return i;
+}
+
+// Level 0 from the camera image
+__kernel void copy_plane(__global const uchar* src, int srcOffset, int srcStep,
+                         __global uchar* pyramid, int dstOffset, int width, int height)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+    pyramid[dstOffset + y*width + x] = src[srcOffset + y*srcStep + x];
+}
+
+// Bilinear downscale of the previous level, sampled as cv::resize with INTER_LINEAR
+__kernel void resize_level(__global uchar* pyramid, int srcOffset, int srcWidth, int srcHeight,
+                           int dstOffset, int dstWidth, int dstHeight)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= dstWidth || y >= dstHeight)
+        return;
+
+    float fx = (x + 0.5f)*((float)srcWidth/dstWidth) - 0.5f;
+    float fy = (y + 0.5f)*((float)srcHeight/dstHeight) - 0.5f;
+    int sx = (int)floor(fx);
+    int sy = (int)floor(fy);
+    fx -= sx;
+    fy -= sy;
+    if(sx < 0) { sx = 0; fx = 0.f; }
+    if(sy < 0) { sy = 0; fy = 0.f; }
+    if(sx >= srcWidth-1) { sx = srcWidth-1; fx = 0.f; }
+    if(sy >= srcHeight-1) { sy = srcHeight-1; fy = 0.f; }
+    const int sx1 = min(sx+1, srcWidth-1);
+    const int sy1 = min(sy+1, srcHeight-1);
+
+    __global const uchar* src = pyramid + srcOffset;
+    const float top = (1.f-fx)*src[sy*srcWidth + sx] + fx*src[sy*srcWidth + sx1];
+    const float bottom = (1.f-fx)*src[sy1*srcWidth + sx] + fx*src[sy1*srcWidth + sx1];
+    pyramid[dstOffset + y*dstWidth + x] = convert_uchar_sat_rte((1.f-fy)*top + fy*bottom);
+}
+
+// FAST-9 score of every pixel at least EDGE_THRESHOLD from the border. The score is the
+// largest threshold the pixel is a corner for, as cv::FAST; scores stores score+1 for corners
+// above minThFAST (0 otherwise), and cells with a corner above iniThFAST are flagged.
+__kernel void fast_score(__global const uchar* pyramid, int offset, int width, int height,
+                         int minTh, int iniTh, int cellWidth, int cellHeight, int cellCols, int cellRows,
+                         __global uchar* scores, __global uchar* strongCells, int cellOffset)
+{
+    const int x = get_global_id(0) + EDGE_THRESHOLD;
+    const int y = get_global_id(1) + EDGE_THRESHOLD;
+    if(x >= width-EDGE_THRESHOLD || y >= height-EDGE_THRESHOLD)
+        return;
+
+    __global const uchar* center = pyramid + offset + y*width + x;
+    const int c = center[0];
+    int d[16];
+    for(int i=0; i<16; i++)
+        d[i] = center[kCircle[i].y*width + kCircle[i].x] - c;
+
+    // Best arc of 9 contiguous pixels, all brighter or all darker
+    int best = 0;
+    for(int s=0; s<16; s++)
+    {
+        int brighter = 255, darker = 255;
+        for(int k=0; k<9; k++)
+        {
+            const int v = d[(s+k) & 15];
+            brighter = min(brighter, v);
+            darker = min(darker, -v);
+        }
+        best = max(best, max(brighter, darker));
+    }
+
+    const int score = best - 1;
+    if(score < minTh)
+        return;
+
+    scores[offset + y*width + x] = (uchar)(score + 1);
+    if(score >= iniTh)
+    {
+        const int cx = min((x-CELL_BORDER)/cellWidth, cellCols-1);
+        const int cy = min((y-CELL_BORDER)/cellHeight, cellRows-1);
+        strongCells[cellOffset + cy*cellCols + cx] = 1;
+    }
+}
+
+// Non-maximum suppression (strict, as cv::FAST) and the best corner of each bucket. A key is
+// (score+1) << 22 | y << 11 | x, so the maximum is the strongest corner.
+__kernel void bucket_corners(__global const uchar* scores, int offset, int width, int height, int iniTh,
+                             int cellWidth, int cellHeight, int cellCols, int cellRows,
+                             __global const uchar* strongCells, int cellOffset,
+                             int bucketCols, int bucketRows, __global uint* buckets, int bucketOffset)
+{
+    const int x = get_global_id(0) + EDGE_THRESHOLD;
+    const int y = get_global_id(1) + EDGE_THRESHOLD;
+    if(x >= width-EDGE_THRESHOLD || y >= height-EDGE_THRESHOLD)
+        return;
+
+    __global const uchar* s = scores + offset + y*width + x;
+    const uchar score = s[0];
+    if(score == 0)
+        return;
+    if(s[-width-1] >= score || s[-width] >= score || s[-width+1] >= score ||
+       s[-1] >= score || s[1] >= score ||
+       s[width-1] >= score || s[width] >= score || s[width+1] >= score)
+        return;
+
+    // Weak corners only count in cells without a strong one
+    if(score-1 < iniTh)
+    {
+        const int cx = min((x-CELL_BORDER)/cellWidth, cellCols-1);
+        const int cy = min((y-CELL_BORDER)/cellHeight, cellRows-1);
+        if(strongCells[cellOffset + cy*cellCols + cx])
+            return;
+    }
+
+    const int regionWidth = width - 2*EDGE_THRESHOLD;
+    const int regionHeight = height - 2*EDGE_THRESHOLD;
+    const int bx = min((x-EDGE_THRESHOLD)*bucketCols/regionWidth, bucketCols-1);
+    const int by = min((y-EDGE_THRESHOLD)*bucketRows/regionHeight, bucketRows-1);
+    atomic_max(&buckets[bucketOffset + by*bucketCols + bx], ((uint)score << 22) | ((uint)y << 11) | (uint)x);
+}
+
+inline void inclusive_scan(__local int* data, int lid)
+{
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int d=1; d<SELECT_GROUP_SIZE; d<<=1)
+    {
+        const int v = lid >= d ? data[lid-d] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        data[lid] += v;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+// One work-group per level: the strongest buckets up to the capacity of the level, ties in
+// bucket order. levels holds (first bucket, buckets, capacity, first keypoint) per level.
+__kernel __attribute__((reqd_work_group_size(SELECT_GROUP_SIZE, 1, 1)))
+void select_features(__global const uint* buckets, __global const int4* levels,
+                     __global float4* keypoints, __global uint* counts)
+{
+    const int level = get_group_id(0);
+    const int lid = get_local_id(0);
+    const int4 info = levels[level];
+
+    __local int histogram[256];
+    __local int taken[SELECT_GROUP_SIZE];
+    __local int ties[SELECT_GROUP_SIZE];
+    __local int threshold, quota, base, tieBase;
+
+    histogram[lid] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int i=lid; i<info.y; i+=SELECT_GROUP_SIZE)
+    {
+        const uint key = buckets[info.x + i];
+        if(key)
+            atomic_inc(&histogram[key >> 22]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Keys above the threshold are all taken, keys at it up to the quota
+    if(lid == 0)
+    {
+        int count = 0;
+        threshold = 0;
+        quota = 0;
+        for(int s=255; s>0; s--)
+        {
+            if(count + histogram[s] >= info.z)
+            {
+                threshold = s;
+                quota = info.z - count;
+                break;
+            }
+            count += histogram[s];
+        }
+        base = 0;
+        tieBase = 0;
+    }
+
+    for(int first=0; first<info.y; first+=SELECT_GROUP_SIZE)
+    {
+        const int i = first + lid;
+        const uint key = i < info.y ? buckets[info.x + i] : 0;
+        const int score = key >> 22;
+        const int tie = key && score == threshold;
+
+        ties[lid] = tie;
+        inclusive_scan(ties, lid);
+        const int take = (key && score > threshold) || (tie && tieBase + ties[lid] - 1 < quota);
+
+        taken[lid] = take;
+        inclusive_scan(taken, lid);
+        if(take)
+            keypoints[info.w + base + taken[lid] - 1] =
+                    (float4)((float)(key & 2047), (float)((key >> 11) & 2047), (float)(score - 1), 0.f);
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(lid == SELECT_GROUP_SIZE-1)
+        {
+            base += taken[lid];
+            tieBase += ties[lid];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if(lid == 0)
+        counts[level] = base;
+}
+
+// Separable 7x7 Gaussian, sigma 2, borders reflected within the level (BORDER_REFLECT_101)
+__kernel void blur_rows(__global const uchar* pyramid, int offset, int width, int height,
+                        __constant float* weights, __global float* rows)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    __global const uchar* src = pyramid + offset + y*width;
+    float sum = 0.f;
+    for(int k=-3; k<=3; k++)
+        sum += weights[k+3]*src[reflect101(x+k, width)];
+    rows[offset + y*width + x] = sum;
+}
+
+__kernel void blur_cols(__global const float* rows, int offset, int width, int height,
+                        __constant float* weights, __global uchar* blurred)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    __global const float* src = rows + offset + x;
+    float sum = 0.f;
+    for(int k=-3; k<=3; k++)
+        sum += weights[k+3]*src[reflect101(y+k, height)*width];
+    blurred[offset + y*width + x] = convert_uchar_sat_rte(sum);
+}
+
+// Intensity centroid orientation (IC_Angle) on the level and rBRIEF on its blurred copy
+__kernel void describe(__global const uchar* pyramid, __global const uchar* blurred, int offset, int width,
+                       __constant int* umax, __constant char2* pattern,
+                       __global float4* keypoints, int firstKeypoint, __global const uint* counts, int level,
+                       __global uchar* descriptors)
+{
+    const int i = get_global_id(0);
+    if(i >= (int)counts[level])
+        return;
+
+    float4 kp = keypoints[firstKeypoint + i];
+    const int x = (int)kp.x;
+    const int y = (int)kp.y;
+
+    __global const uchar* center = pyramid + offset + y*width + x;
+    int m_01 = 0, m_10 = 0;
+    for(int u=-HALF_PATCH_SIZE; u<=HALF_PATCH_SIZE; u++)
+        m_10 += u*center[u];
+    for(int v=1; v<=HALF_PATCH_SIZE; v++)
+    {
+        int v_sum = 0;
+        const int d = umax[v];
+        for(int u=-d; u<=d; u++)
+        {
+            const int val_plus = center[u + v*width], val_minus = center[u - v*width];
+            v_sum += val_plus - val_minus;
+            m_10 += u*(val_plus + val_minus);
+        }
+        m_01 += v*v_sum;
+    }
+
+    float angle = degrees(atan2((float)m_01, (float)m_10));
+    if(angle < 0.f)
+        angle += 360.f;
+    kp.w = angle;
+    keypoints[firstKeypoint + i] = kp;
+
+    const float a = cos(radians(angle)), b = sin(radians(angle));
+    __global const uchar* bcenter = blurred + offset + y*width + x;
+    __global uchar* desc = descriptors + (firstKeypoint + i)*32;
+    for(int k=0; k<32; k++)
+    {
+        uint byte = 0;
+        for(int j=0; j<8; j++)
+        {
+            const float2 p0 = convert_float2(pattern[16*k + 2*j]);
+            const float2 p1 = convert_float2(pattern[16*k + 2*j + 1]);
+            const int t0 = bcenter[(int)rint(p0.x*b + p0.y*a)*width + (int)rint(p0.x*a - p0.y*b)];
+            const int t1 = bcenter[(int)rint(p1.x*b + p1.y*a)*width + (int)rint(p1.x*a - p1.y*b)];
+            byte |= (uint)(t0 < t1) << j;
+        }
+        desc[k] = (uchar)byte;
+    }
+}
+)CLC";
+
+size_t RoundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1)/multiple*multiple;
+}
+
+} // namespace
+
+struct GPUORBextractor::CLState
+{
+    // Geometry of a pyramid level and its part of the buffers
+    struct Level
+    {
+        int width, height;
+        size_t offset;                      // Of the level in pyramid, scores, blurred
+        int cellWidth, cellHeight, cellCols, cellRows;
+        size_t cellOffset;                  // Of its FAST cells in strongCells
+        int bucketCols, bucketRows;
+        size_t bucketOffset;                // Of its buckets in buckets
+        int capacity;                       // Features of the level
+        size_t keypointOffset;              // Of its keypoints and descriptors
+    };
+
+    // A registered DMA-BUF, imported on first use
+    struct DmaBuffer
+    {
+        int fd;
+        const uchar* data;
+        size_t size;
+        cl_mem mem;                         // nullptr until imported
+        bool failed;
+    };
+
+    cl_context context = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program program = nullptr;
+    cl_kernel copyPlane = nullptr, resizeLevel = nullptr, fastScore = nullptr, bucketCorners = nullptr;
+    cl_kernel selectFeatures = nullptr, blurRows = nullptr, blurCols = nullptr, describe = nullptr;
+    ImportMemoryARMFn importMemory = nullptr;
+
+    // Constant across image sizes
+    cl_mem umax = nullptr, pattern = nullptr, weights = nullptr;
+
+    // Sized by AllocateLevels()
+    cv::Size size;
+    std::vector<Level> levels;
+    cl_mem pyramid = nullptr, scores = nullptr, blurRowsBuffer = nullptr, blurred = nullptr;
+    cl_mem strongCells = nullptr, buckets = nullptr, levelInfo = nullptr;
+    cl_mem keypoints = nullptr, descriptors = nullptr, counts = nullptr;
+    cl_mem upload = nullptr;
+    size_t pyramidSize = 0, strongCellsSize = 0, bucketsSize = 0, keypointsCapacity = 0, uploadSize = 0;
+
+    // Host mappings of the outputs, held from the end of an extraction to the start of the next
+    uchar* mappedPyramid = nullptr;
+    cl_float4* mappedKeypoints = nullptr;
+    uchar* mappedDescriptors = nullptr;
+    cl_uint* mappedCounts = nullptr;
+
+    std::vector<DmaBuffer> dmaBuffers;
+
+    static void Release(cl_mem &mem)
+    {
+        if(mem)
+            clReleaseMemObject(mem);
+        mem = nullptr;
+    }
+
+    void Unmap()
+    {
+        if(mappedPyramid)
+            clEnqueueUnmapMemObject(queue, pyramid, mappedPyramid, 0, nullptr, nullptr);
+        if(mappedKeypoints)
+            clEnqueueUnmapMemObject(queue, keypoints, mappedKeypoints, 0, nullptr, nullptr);
+        if(mappedDescriptors)
+            clEnqueueUnmapMemObject(queue, descriptors, mappedDescriptors, 0, nullptr, nullptr);
+        if(mappedCounts)
+            clEnqueueUnmapMemObject(queue, counts, mappedCounts, 0, nullptr, nullptr);
+        mappedPyramid = nullptr;
+        mappedKeypoints = nullptr;
+        mappedDescriptors = nullptr;
+        mappedCounts = nullptr;
+    }
+
+    void ReleaseLevels()
+    {
+        Unmap();
+        if(queue)
+            clFinish(queue);
+        Release(pyramid);
+        Release(scores);
+        Release(blurRowsBuffer);
+        Release(blurred);
+        Release(strongCells);
+        Release(buckets);
+        Release(levelInfo);
+        Release(keypoints);
+        Release(descriptors);
+        Release(counts);
+        levels.clear();
+        size = cv::Size();
+    }
+
+    ~CLState()
+    {
+        ReleaseLevels();
+        Release(upload);
+        Release(umax);
+        Release(pattern);
+        Release(weights);
+        for(size_t i=0; i<dmaBuffers.size(); i++)
+            Release(dmaBuffers[i].mem);
+        cl_kernel kernels[] = {copyPlane, resizeLevel, fastScore, bucketCorners,
+                               selectFeatures, blurRows, blurCols, describe};
+        for(cl_kernel kernel : kernels)
+            if(kernel)
+                clReleaseKernel(kernel);
+        if(program)
+            clReleaseProgram(program);
+        if(queue)
+            clReleaseCommandQueue(queue);
+        if(context)
+            clReleaseContext(context);
+    }
+};
+
+namespace
+{
+
+template<typename T>
+cl_int SetArg(cl_kernel kernel, cl_uint index, const T &value)
+{
+    return clSetKernelArg(kernel, index, sizeof(T), &value);
+}
+
+template<typename T, typename... Args>
+cl_int SetArg(cl_kernel kernel, cl_uint index, const T &value, const Args&... args)
+{
+    const cl_int err = clSetKernelArg(kernel, index, sizeof(T), &value);
+    return err != CL_SUCCESS ? err : SetArg(kernel, index+1, args...);
+}
+
+// Rounded up, the kernels skip the excess work-items
+cl_int Enqueue2D(cl_command_queue queue, cl_kernel kernel, int width, int height)
+{
+    if(width <= 0 || height <= 0)
+        return CL_SUCCESS;
+    const size_t global[2] = {RoundUp(width, 16), RoundUp(height, 4)};
+    return clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, global, nullptr, 0, nullptr, nullptr);
+}
+
+} // namespace
+
+#else
+
+struct GPUORBextractor::CLState {};
+
+#endif
+
+GPUORBextractor::GPUORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
+                                 int _iniThFAST, int _minThFAST):
+    ORBextractor(_nfeatures, _scaleFactor, _nlevels, _iniThFAST, _minThFAST)
+{
+    if(!InitializeCL())
+    {
+        cerr << "GPUORBextractor: OpenCL is not available, extracting on the CPU" << endl;
+        mpCL.reset();
+    }
+}
+
+GPUORBextractor::~GPUORBextractor()
+{
+}
+
+bool GPUORBextractor::IsGPUAvailable() const
+{
+    return mpCL != nullptr;
+}
+
+bool GPUORBextractor::InitializeCL()
+{
+#if defined(HAVE_OPENCL)
+    cl_platform_id platforms[8];
+    cl_uint nPlatforms = 0;
+    if(clGetPlatformIDs(8, platforms, &nPlatforms) != CL_SUCCESS || nPlatforms == 0)
+        return false;
+
+    cl_platform_id platform = nullptr;
+    cl_device_id device = nullptr;
+    for(cl_uint i=0; i<std::min<cl_uint>(nPlatforms, 8) && !device; i++)
+    {
+        if(clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, nullptr) == CL_SUCCESS)
+            platform = platforms[i];
+        else
+            device = nullptr;
+    }
+    if(!device)
+        return false;
+
+    mpCL.reset(new CLState());
+    CLState &cl = *mpCL;
+    cl_int err = CL_SUCCESS;
+    cl.context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+    if(err != CL_SUCCESS)
+        return false;
+    cl.queue = clCreateCommandQueue(cl.context, device, 0, &err);
+    if(err != CL_SUCCESS)
+        return false;
+
+    const std::string source = std::string("#define SELECT_GROUP_SIZE ") + std::to_string(SELECT_GROUP_SIZE) + "\n" +
+                               kProgramSource;
+    const char* sources[] = {source.c_str()};
+    cl.program = clCreateProgramWithSource(cl.context, 1, sources, nullptr, &err);
+    if(err != CL_SUCCESS)
+        return false;
+    if(clBuildProgram(cl.program, 1, &device, "-cl-std=CL1.2", nullptr, nullptr) != CL_SUCCESS)
+    {
+        size_t logSize = 0;
+        clGetProgramBuildInfo(cl.program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+        std::string log(logSize, '\0');
+        clGetProgramBuildInfo(cl.program, device, CL_PROGRAM_BUILD_LOG, logSize, &log[0], nullptr);
+        cerr << "GPUORBextractor: failed to build the kernels:" << endl << log << endl;
+        return false;
+    }
+
+    struct { cl_kernel* kernel; const char* name; } kernels[] = {
+        {&cl.copyPlane, "copy_plane"}, {&cl.resizeLevel, "resize_level"},
+        {&cl.fastScore, "fast_score"}, {&cl.bucketCorners, "bucket_corners"},
+        {&cl.selectFeatures, "select_features"}, {&cl.blurRows, "blur_rows"},
+        {&cl.blurCols, "blur_cols"}, {&cl.describe, "describe"}};
+    for(auto &k : kernels)
+    {
+        *k.kernel = clCreateKernel(cl.program, k.name, &err);
+        if(err != CL_SUCCESS)
+            return false;
+    }
+
+    // The orientation circle, the rBRIEF pairs and the blur weights of GaussianBlur(7x7, sigma 2)
+    std::vector<cl_int> vUmax(umax.begin(), umax.end());
+    std::vector<cl_char2> vPattern(pattern.size());
+    for(size_t i=0; i<pattern.size(); i++)
+    {
+        vPattern[i].s[0] = (cl_char)pattern[i].x;
+        vPattern[i].s[1] = (cl_char)pattern[i].y;
+    }
+    cl_float vWeights[7];
+    float sum = 0.f;
+    for(int k=0; k<7; k++)
+    {
+        vWeights[k] = std::exp(-(k-3)*(k-3)/(2.f*2.f*2.f));
+        sum += vWeights[k];
+    }
+    for(int k=0; k<7; k++)
+        vWeights[k] /= sum;
+
+    cl.umax = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                             vUmax.size()*sizeof(cl_int), vUmax.data(), &err);
+    if(err != CL_SUCCESS)
+        return false;
+    cl.pattern = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                vPattern.size()*sizeof(cl_char2), vPattern.data(), &err);
+    if(err != CL_SUCCESS)
+        return false;
+    cl.weights = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                sizeof(vWeights), vWeights, &err);
+    if(err != CL_SUCCESS)
+        return false;
+
+    // Camera buffers are imported where the driver can
+    size_t extensionsSize = 0;
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, nullptr, &extensionsSize);
+    std::string extensions(extensionsSize, '\0');
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, extensionsSize, &extensions[0], nullptr);
+    if(extensions.find("cl_arm_import_memory_dma_buf") != std::string::npos)
+        cl.importMemory = (ImportMemoryARMFn)clGetExtensionFunctionAddressForPlatform(platform, "clImportMemoryARM");
+
+    char name[256] = {0};
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name)-1, name, nullptr);
+    cout << "GPUORBextractor: extracting on " << name
+         << (cl.importMemory ? " (DMA-BUF import)" : "") << endl;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool GPUORBextractor::RegisterDmaBuffer(int fd, const void* data, size_t size)
+{
+#if defined(HAVE_OPENCL)
+    if(!mpCL || !mpCL->importMemory || fd < 0 || !data || size == 0)
+        return false;
+
+    const uchar* begin = static_cast<const uchar*>(data);
+    unique_lock<mutex> lock(mMutexDmaBuffers);
+    std::vector<CLState::DmaBuffer> &vBuffers = mpCL->dmaBuffers;
+    for(size_t i=0; i<vBuffers.size(); i++)
+        if(vBuffers[i].fd == fd && vBuffers[i].data == begin && vBuffers[i].size == size)
+            return !vBuffers[i].failed;
+
+    // The replaced buffers were unmapped, their fd may have been reused
+    for(size_t i=0; i<vBuffers.size();)
+    {
+        CLState::DmaBuffer &buffer = vBuffers[i];
+        if(buffer.fd == fd || (buffer.data < begin+size && begin < buffer.data+buffer.size))
+        {
+            CLState::Release(buffer.mem);
+            buffer = vBuffers.back();
+            vBuffers.pop_back();
+        }
+        else
+            i++;
+    }
+
+    CLState::DmaBuffer buffer = {fd, begin, size, nullptr, false};
+    vBuffers.push_back(buffer);
+    return true;
+#else
+    (void)fd;
+    (void)data;
+    (void)size;
+    return false;
+#endif
+}
+
+bool GPUORBextractor::AllocateLevels(const cv::Size &size)
+{
+#if defined(HAVE_OPENCL)
+    CLState &cl = *mpCL;
+    if(cl.size == size)
+        return true;
+    cl.ReleaseLevels();
+
+    // Level sizes as ORBextractor::ComputePyramid, without the borders
+    cl.levels.resize(nlevels);
+    size_t pyramidSize = 0, cellsSize = 0, bucketsSize = 0, keypointsSize = 0;
+    for(int level=0; level<nlevels; level++)
+    {
+        CLState::Level &l = cl.levels[level];
+        l.width = cvRound((float)size.width*mvInvScaleFactor[level]);
+        l.height = cvRound((float)size.height*mvInvScaleFactor[level]);
+        l.offset = pyramidSize;
+        pyramidSize += RoundUp((size_t)l.width*l.height, 64);
+
+        const float width = std::max(l.width - 2*EDGE_THRESHOLD + 6, 1);
+        const float height = std::max(l.height - 2*EDGE_THRESHOLD + 6, 1);
+        l.cellCols = std::max((int)(width/FAST_CELL_SIZE), 1);
+        l.cellRows = std::max((int)(height/FAST_CELL_SIZE), 1);
+        l.cellWidth = std::ceil(width/l.cellCols);
+        l.cellHeight = std::ceil(height/l.cellRows);
+        l.cellOffset = cellsSize;
+        cellsSize += l.cellCols*l.cellRows;
+
+        // Square buckets, about BUCKETS_PER_FEATURE per feature
+        l.capacity = mnFeaturesPerLevel[level];
+        const float regionWidth = std::max(l.width - 2*EDGE_THRESHOLD, 1);
+        const float regionHeight = std::max(l.height - 2*EDGE_THRESHOLD, 1);
+        const float side = std::sqrt(regionWidth*regionHeight/std::max(BUCKETS_PER_FEATURE*l.capacity, 1));
+        l.bucketCols = std::max(cvRound(regionWidth/side), 1);
+        l.bucketRows = std::max(cvRound(regionHeight/side), 1);
+        l.bucketOffset = bucketsSize;
+        bucketsSize += l.bucketCols*l.bucketRows;
+
+        l.keypointOffset = keypointsSize;
+        keypointsSize += l.capacity;
+    }
+
+    std::vector<cl_int4> vLevelInfo(nlevels);
+    for(int level=0; level<nlevels; level++)
+    {
+        const CLState::Level &l = cl.levels[level];
+        vLevelInfo[level].s[0] = (cl_int)l.bucketOffset;
+        vLevelInfo[level].s[1] = l.bucketCols*l.bucketRows;
+        vLevelInfo[level].s[2] = l.capacity;
+        vLevelInfo[level].s[3] = (cl_int)l.keypointOffset;
+    }
+
+    // The outputs are read by the host in place
+    cl_int err = CL_SUCCESS, e;
+    cl.pyramid = clCreateBuffer(cl.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, pyramidSize, nullptr, &e); err |= e;
+    cl.scores = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, pyramidSize, nullptr, &e); err |= e;
+    cl.blurRowsBuffer = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, pyramidSize*sizeof(cl_float), nullptr, &e); err |= e;
+    cl.blurred = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, pyramidSize, nullptr, &e); err |= e;
+    cl.strongCells = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, cellsSize, nullptr, &e); err |= e;
+    cl.buckets = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, bucketsSize*sizeof(cl_uint), nullptr, &e); err |= e;
+    cl.levelInfo = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                  vLevelInfo.size()*sizeof(cl_int4), vLevelInfo.data(), &e); err |= e;
+    cl.keypoints = clCreateBuffer(cl.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                  std::max<size_t>(keypointsSize, 1)*sizeof(cl_float4), nullptr, &e); err |= e;
+    cl.descriptors = clCreateBuffer(cl.context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                    std::max<size_t>(keypointsSize, 1)*32, nullptr, &e); err |= e;
+    cl.counts = clCreateBuffer(cl.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                               nlevels*sizeof(cl_uint), nullptr, &e); err |= e;
+    if(err != CL_SUCCESS)
+    {
+        cerr << "GPUORBextractor: failed to allocate the buffers for " << size.width << "x" << size.height << endl;
+        cl.ReleaseLevels();
+        return false;
+    }
+
+    cl.size = size;
+    cl.pyramidSize = pyramidSize;
+    cl.strongCellsSize = cellsSize;
+    cl.bucketsSize = bucketsSize;
+    cl.keypointsCapacity = keypointsSize;
+    return true;
+#else
+    (void)size;
+    return false;
+#endif
+}
+
+bool GPUORBextractor::ExtractGPU(const cv::Mat &image)
+{
+#if defined(HAVE_OPENCL)
+    if(!AllocateLevels(image.size()))
+        return false;
+
+    CLState &cl = *mpCL;
+    cl.Unmap();
+
+    // 1. Source: the imported camera buffer the image lies in, or an upload of the image
+    const size_t span = image.step*(image.rows-1) + image.cols;
+    cl_mem source = nullptr;
+    cl_int sourceOffset = 0;
+    {
+        unique_lock<mutex> lock(mMutexDmaBuffers);
+        for(size_t i=0; i<cl.dmaBuffers.size() && !source; i++)
+        {
+            CLState::DmaBuffer &buffer = cl.dmaBuffers[i];
+            if(buffer.failed || image.data < buffer.data || image.data+span > buffer.data+buffer.size)
+                continue;
+            if(!buffer.mem)
+            {
+                const cl_import_properties_arm properties[] = {CL_IMPORT_TYPE_ARM, CL_IMPORT_TYPE_DMA_BUF_ARM, 0};
+                cl_int err = CL_SUCCESS;
+                buffer.mem = cl.importMemory(cl.context, CL_MEM_READ_ONLY, properties, &buffer.fd, buffer.size, &err);
+                if(err != CL_SUCCESS)
+                {
+                    cerr << "GPUORBextractor: failed to import DMA-BUF " << buffer.fd << ", uploading its frames" << endl;
+                    buffer.mem = nullptr;
+                    buffer.failed = true;
+                    continue;
+                }
+            }
+            source = buffer.mem;
+            sourceOffset = (cl_int)(image.data - buffer.data);
+        }
+    }
+
+    cl_int err = CL_SUCCESS;
+    if(!source)
+    {
+        if(cl.uploadSize < span)
+        {
+            CLState::Release(cl.upload);
+            cl.upload = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, span, nullptr, &err);
+            if(err != CL_SUCCESS)
+            {
+                cl.uploadSize = 0;
+                return false;
+            }
+            cl.uploadSize = span;
+        }
+        err = clEnqueueWriteBuffer(cl.queue, cl.upload, CL_FALSE, 0, span, image.data, 0, nullptr, nullptr);
+        if(err != CL_SUCCESS)
+            return false;
+        source = cl.upload;
+    }
+
+    // 2. Clear the scores, cell flags and buckets of the last frame
+    const cl_uchar zero8 = 0;
+    const cl_uint zero32 = 0;
+    err |= clEnqueueFillBuffer(cl.queue, cl.scores, &zero8, sizeof(zero8), 0, cl.pyramidSize, 0, nullptr, nullptr);
+    err |= clEnqueueFillBuffer(cl.queue, cl.strongCells, &zero8, sizeof(zero8), 0, cl.strongCellsSize, 0, nullptr, nullptr);
+    err |= clEnqueueFillBuffer(cl.queue, cl.buckets, &zero32, sizeof(zero32), 0,
+                               cl.bucketsSize*sizeof(cl_uint), 0, nullptr, nullptr);
+
+    // 3. Pyramid
+    const CLState::Level &l0 = cl.levels[0];
+    const cl_int srcStep = (cl_int)image.step;
+    err |= SetArg(cl.copyPlane, 0, source, sourceOffset, srcStep, cl.pyramid, (cl_int)l0.offset,
+                  (cl_int)l0.width, (cl_int)l0.height);
+    err |= Enqueue2D(cl.queue, cl.copyPlane, l0.width, l0.height);
+    for(int level=1; level<nlevels; level++)
+    {
+        const CLState::Level &src = cl.levels[level-1];
+        const CLState::Level &dst = cl.levels[level];
+        err |= SetArg(cl.resizeLevel, 0, cl.pyramid, (cl_int)src.offset, (cl_int)src.width, (cl_int)src.height,
+                      (cl_int)dst.offset, (cl_int)dst.width, (cl_int)dst.height);
+        err |= Enqueue2D(cl.queue, cl.resizeLevel, dst.width, dst.height);
+    }
+
+    // 4. FAST, bucketing and selection
+    for(int level=0; level<nlevels; level++)
+    {
+        const CLState::Level &l = cl.levels[level];
+        const int regionWidth = l.width - 2*EDGE_THRESHOLD;
+        const int regionHeight = l.height - 2*EDGE_THRESHOLD;
+        err |= SetArg(cl.fastScore, 0, cl.pyramid, (cl_int)l.offset, (cl_int)l.width, (cl_int)l.height,
+                      (cl_int)minThFAST, (cl_int)iniThFAST, (cl_int)l.cellWidth, (cl_int)l.cellHeight,
+                      (cl_int)l.cellCols, (cl_int)l.cellRows, cl.scores, cl.strongCells, (cl_int)l.cellOffset);
+        err |= Enqueue2D(cl.queue, cl.fastScore, regionWidth, regionHeight);
+        err |= SetArg(cl.bucketCorners, 0, cl.scores, (cl_int)l.offset, (cl_int)l.width, (cl_int)l.height,
+                      (cl_int)iniThFAST, (cl_int)l.cellWidth, (cl_int)l.cellHeight, (cl_int)l.cellCols,
+                      (cl_int)l.cellRows, cl.strongCells, (cl_int)l.cellOffset, (cl_int)l.bucketCols,
+                      (cl_int)l.bucketRows, cl.buckets, (cl_int)l.bucketOffset);
+        err |= Enqueue2D(cl.queue, cl.bucketCorners, regionWidth, regionHeight);
+    }
+
+    err |= SetArg(cl.selectFeatures, 0, cl.buckets, cl.levelInfo, cl.keypoints, cl.counts);
+    const size_t selectGlobal = (size_t)nlevels*SELECT_GROUP_SIZE;
+    const size_t selectLocal = SELECT_GROUP_SIZE;
+    err |= clEnqueueNDRangeKernel(cl.queue, cl.selectFeatures, 1, nullptr, &selectGlobal, &selectLocal,
+                                  0, nullptr, nullptr);
+
+    // 5. Orientation and descriptors
+    for(int level=0; level<nlevels; level++)
+    {
+        const CLState::Level &l = cl.levels[level];
+        err |= SetArg(cl.blurRows, 0, cl.pyramid, (cl_int)l.offset, (cl_int)l.width, (cl_int)l.height,
+                      cl.weights, cl.blurRowsBuffer);
+        err |= Enqueue2D(cl.queue, cl.blurRows, l.width, l.height);
+        err |= SetArg(cl.blurCols, 0, cl.blurRowsBuffer, (cl_int)l.offset, (cl_int)l.width, (cl_int)l.height,
+                      cl.weights, cl.blurred);
+        err |= Enqueue2D(cl.queue, cl.blurCols, l.width, l.height);
+
+        if(l.capacity == 0)
+            continue;
+        err |= SetArg(cl.describe, 0, cl.pyramid, cl.blurred, (cl_int)l.offset, (cl_int)l.width,
+                      cl.umax, cl.pattern, cl.keypoints, (cl_int)l.keypointOffset, cl.counts, (cl_int)level,
+                      cl.descriptors);
+        const size_t global = RoundUp(l.capacity, 64);
+        err |= clEnqueueNDRangeKernel(cl.queue, cl.describe, 1, nullptr, &global, nullptr, 0, nullptr, nullptr);
+    }
+
+    if(err != CL_SUCCESS)
+    {
+        cerr << "GPUORBextractor: failed to enqueue the extraction" << endl;
+        clFinish(cl.queue);
+        return false;
+    }
+
+    // 6. The blocking maps wait for the queue
+    cl_int e[4];
+    cl.mappedCounts = (cl_uint*)clEnqueueMapBuffer(cl.queue, cl.counts, CL_TRUE, CL_MAP_READ, 0,
+                                                   nlevels*sizeof(cl_uint), 0, nullptr, nullptr, &e[0]);
+    cl.mappedKeypoints = (cl_float4*)clEnqueueMapBuffer(cl.queue, cl.keypoints, CL_TRUE, CL_MAP_READ, 0,
+                                                        std::max<size_t>(cl.keypointsCapacity, 1)*sizeof(cl_float4),
+                                                        0, nullptr, nullptr, &e[1]);
+    cl.mappedDescriptors = (uchar*)clEnqueueMapBuffer(cl.queue, cl.descriptors, CL_TRUE, CL_MAP_READ, 0,
+                                                      std::max<size_t>(cl.keypointsCapacity, 1)*32,
+                                                      0, nullptr, nullptr, &e[2]);
+    cl.mappedPyramid = (uchar*)clEnqueueMapBuffer(cl.queue, cl.pyramid, CL_TRUE, CL_MAP_READ, 0, cl.pyramidSize,
+                                                  0, nullptr, nullptr, &e[3]);
+    if(e[0] != CL_SUCCESS || e[1] != CL_SUCCESS || e[2] != CL_SUCCESS || e[3] != CL_SUCCESS)
+    {
+        cerr << "GPUORBextractor: extraction failed" << endl;
+        cl.Unmap();
+        return false;
+    }
+    return true;
+#else
+    (void)image;
+    return false;
+#endif
+}
+
+int GPUORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints,
+                                 OutputArray _descriptors, std::vector<int> &vLappingArea)
+{
+#if defined(HAVE_OPENCL)
+    if(_image.empty())
+        return -1;
+
+    Mat image = _image.getMat();
+    if(!mpCL || image.type() != CV_8UC1 || image.cols > MAX_IMAGE_SIZE || image.rows > MAX_IMAGE_SIZE ||
+       !ExtractGPU(image))
+        return ORBextractor::operator()(_image, _mask, _keypoints, _descriptors, vLappingArea);
+
+    // The GPU builds its own pyramid
+    mpNextPyramid.reset();
+    mpPyramid.reset();
+
+    CLState &cl = *mpCL;
+    for(int level=0; level<nlevels; ++level)
+    {
+        const CLState::Level &l = cl.levels[level];
+        mvImagePyramid[level] = Mat(l.height, l.width, CV_8UC1, cl.mappedPyramid + l.offset);
+    }
+
+    // Keypoints of each level in row order, as the CPU scan finds them
+    vector < vector<KeyPoint> > allKeypoints(nlevels);
+    int nkeypoints = 0;
+    for(int level=0; level<nlevels; ++level)
+    {
+        const CLState::Level &l = cl.levels[level];
+        const int nkeypointsLevel = std::min((int)cl.mappedCounts[level], l.capacity);
+        vector<KeyPoint> &keypoints = allKeypoints[level];
+        keypoints.resize(nkeypointsLevel);
+        const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+        for(int i=0; i<nkeypointsLevel; i++)
+        {
+            const cl_float4 &kp = cl.mappedKeypoints[l.keypointOffset + i];
+            keypoints[i] = KeyPoint(kp.s[0], kp.s[1], scaledPatchSize, kp.s[3], kp.s[2], level, i);
+        }
+        sort(keypoints.begin(), keypoints.end(), [](const KeyPoint &a, const KeyPoint &b)
+        {
+            return a.pt.y < b.pt.y || (a.pt.y == b.pt.y && a.pt.x < b.pt.x);
+        });
+        nkeypoints += nkeypointsLevel;
+    }
+
+    Mat descriptors;
+    if( nkeypoints == 0 )
+        _descriptors.release();
+    else
+    {
+        _descriptors.create(nkeypoints, 32, CV_8U);
+        descriptors = _descriptors.getMat();
+    }
+    _keypoints.resize(nkeypoints);
+
+    // Same order as ORBextractor: keypoints in the lapping area from the back
+    int monoIndex = 0, stereoIndex = nkeypoints-1;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        const CLState::Level &l = cl.levels[level];
+        const float scale = mvScaleFactor[level];
+        vector<KeyPoint>& keypoints = allKeypoints[level];
+        for(size_t i=0; i<keypoints.size(); i++)
+        {
+            KeyPoint keypoint = keypoints[i];
+            const uchar* desc = cl.mappedDescriptors + (l.keypointOffset + keypoint.class_id)*32;
+            keypoint.class_id = -1;
+            if (level != 0)
+                keypoint.pt *= scale;
+
+            const int index = keypoint.pt.x >= vLappingArea[0] && keypoint.pt.x <= vLappingArea[1] ?
+                              stereoIndex-- : monoIndex++;
+            _keypoints[index] = keypoint;
+            memcpy(descriptors.ptr(index), desc, 32);
+        }
+    }
+    return monoIndex;
+#else
+    return ORBextractor::operator()(_image, _mask, _keypoints, _descriptors, vLappingArea);
+#endif
+}
+
+} //namespace ORB_SLAM
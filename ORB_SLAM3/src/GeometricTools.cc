@@ -44,25 +44,86 @@ Eigen::Matrix3f GeometricTools::ComputeF12(KeyFrame* &pKF1, KeyFrame* &pKF2)
     return K1.transpose().inverse() * tc1c2x * Rc1c2 * K2.inverse();
 }
 
-bool GeometricTools::Triangulate(Eigen::Vector3f &x_c1, Eigen::Vector3f &x_c2,Eigen::Matrix<float,3,4> &Tc1w ,Eigen::Matrix<float,3,4> &Tc2w , Eigen::Vector3f &x3D)
+namespace
 {
-    Eigen::Matrix4f A;
-    A.block<1,4>(0,0) = x_c1(0) * Tc1w.block<1,4>(2,0) - Tc1w.block<1,4>(0,0);
-    A.block<1,4>(1,0) = x_c1(1) * Tc1w.block<1,4>(2,0) - Tc1w.block<1,4>(1,0);
-    A.block<1,4>(2,0) = x_c2(0) * Tc2w.block<1,4>(2,0) - Tc2w.block<1,4>(0,0);
-    A.block<1,4>(3,0) = x_c2(1) * Tc2w.block<1,4>(2,0) - Tc2w.block<1,4>(1,0);
-
-    Eigen::JacobiSVD<Eigen::Matrix4f> svd(A, Eigen::ComputeFullV);
 
-    Eigen::Vector4f x3Dh = svd.matrixV().col(3);
+// Homogeneous DLT solution, the right singular vector of A for its smallest singular value.
+// It is the dominant eigenvector of (A^T A)^-1, found in double precision by a couple of
+// power iterations, a fraction of the cost of a JacobiSVD of A.
+bool TriangulateDLT(const Eigen::Vector3f &x_c1, const Eigen::Vector3f &x_c2,
+                    const Eigen::Matrix<float,3,4> &Tc1w, const Eigen::Matrix<float,3,4> &Tc2w, Eigen::Vector3f &x3D)
+{
+    Eigen::Matrix4d A;
+    A.block<1,4>(0,0) = (x_c1(0) * Tc1w.block<1,4>(2,0) - Tc1w.block<1,4>(0,0)).cast<double>();
+    A.block<1,4>(1,0) = (x_c1(1) * Tc1w.block<1,4>(2,0) - Tc1w.block<1,4>(1,0)).cast<double>();
+    A.block<1,4>(2,0) = (x_c2(0) * Tc2w.block<1,4>(2,0) - Tc2w.block<1,4>(0,0)).cast<double>();
+    A.block<1,4>(3,0) = (x_c2(1) * Tc2w.block<1,4>(2,0) - Tc2w.block<1,4>(1,0)).cast<double>();
+
+    Eigen::Matrix4d AtA;
+    AtA.noalias() = A.transpose() * A;
+
+    Eigen::Matrix4d AtAinv;
+    double det;
+    bool bInvertible;
+    AtA.computeInverseAndDetWithCheck(AtAinv, det, bInvertible, 0.0);
+
+    Eigen::Vector4d x3Dh;
+    if(bInvertible && AtAinv.allFinite())
+    {
+        // The column with the largest diagonal is already close to the solution
+        int k;
+        AtAinv.diagonal().maxCoeff(&k);
+        x3Dh = AtAinv.col(k);
+        for(int it=0; it<2; it++)
+        {
+            x3Dh.normalize();
+            x3Dh = AtAinv * x3Dh;
+        }
+    }
+    else
+    {
+        // Noise free correspondences, A has an exact null vector
+        Eigen::JacobiSVD<Eigen::Matrix4d> svd(A, Eigen::ComputeFullV);
+        x3Dh = svd.matrixV().col(3);
+    }
 
     if(x3Dh(3)==0)
         return false;
 
     // Euclidean coordinates
-    x3D = x3Dh.head(3)/x3Dh(3);
+    x3D = (x3Dh.head(3)/x3Dh(3)).cast<float>();
 
     return true;
 }
 
+} // namespace
+
+bool GeometricTools::Triangulate(Eigen::Vector3f &x_c1, Eigen::Vector3f &x_c2,Eigen::Matrix<float,3,4> &Tc1w ,Eigen::Matrix<float,3,4> &Tc2w , Eigen::Vector3f &x3D)
+{
+    return TriangulateDLT(x_c1, x_c2, Tc1w, Tc2w, x3D);
+}
+
+int GeometricTools::Triangulate(const Eigen::Vector3f* x_c1, const Eigen::Vector3f* x_c2, const size_t n,
+                                const Eigen::Matrix<float,3,4> &Tc1w, const Eigen::Matrix<float,3,4> &Tc2w,
+                                Eigen::Vector3f* x3D, unsigned char* vbValid, const bool bCheckDepth)
+{
+    const Eigen::Vector4f depth1 = Tc1w.row(2).transpose();
+    const Eigen::Vector4f depth2 = Tc2w.row(2).transpose();
+
+    int nValid = 0;
+    for(size_t i=0; i<n; i++)
+    {
+        bool bValid = TriangulateDLT(x_c1[i], x_c2[i], Tc1w, Tc2w, x3D[i]) && x3D[i].allFinite();
+
+        // Check triangulation in front of cameras
+        if(bValid && bCheckDepth)
+            bValid = depth1.head<3>().dot(x3D[i]) + depth1(3) > 0 && depth2.head<3>().dot(x3D[i]) + depth2(3) > 0;
+
+        vbValid[i] = bValid;
+        nValid += bValid;
+    }
+
+    return nValid;
+}
+
 } //namespace ORB_SLAM
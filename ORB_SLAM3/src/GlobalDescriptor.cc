@@ -0,0 +1,185 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "GlobalDescriptor.h"
+
+#include "KeyFrame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+bool GlobalDescriptor::Compute(const cv::Mat &descriptors, int8_t *pGlobal)
+{
+    fill(pGlobal, pGlobal+DIM, 0);
+
+    const int N = descriptors.rows;
+    if(N==0)
+        return false;
+
+    // Mean local descriptor, in [-1,1] per dimension for the signed bits
+    float vMean[DIM];
+    if(descriptors.type()==CV_8U && descriptors.cols*8==DIM)
+    {
+        int vCount[DIM];
+        fill(vCount, vCount+DIM, 0);
+        for(int i=0; i<N; i++)
+        {
+            const uchar *p = descriptors.ptr<uchar>(i);
+            for(int j=0; j<DIM/8; j++)
+            {
+                const uchar byte = p[j];
+                for(int k=0; k<8; k++)
+                    vCount[8*j+k] += (byte >> k) & 1;
+            }
+        }
+        for(int j=0; j<DIM; j++)
+            vMean[j] = 2.f*vCount[j]/N-1.f;
+    }
+    else if(descriptors.type()==CV_32F && descriptors.cols==DIM)
+    {
+        fill(vMean, vMean+DIM, 0.f);
+        for(int i=0; i<N; i++)
+        {
+            const float *p = descriptors.ptr<float>(i);
+            for(int j=0; j<DIM; j++)
+                vMean[j] += p[j];
+        }
+        for(int j=0; j<DIM; j++)
+            vMean[j] /= N;
+    }
+    else
+        return false;
+
+    float norm2 = 0.f;
+    for(int j=0; j<DIM; j++)
+    {
+        vMean[j] = copysign(sqrt(fabs(vMean[j])), vMean[j]);
+        norm2 += vMean[j]*vMean[j];
+    }
+    if(norm2<=0.f)
+        return false;
+
+    const float scale = 127.f/sqrt(norm2);
+    for(int j=0; j<DIM; j++)
+        pGlobal[j] = (int8_t)lround(vMean[j]*scale);
+
+    return true;
+}
+
+void GlobalDescriptorIndex::add(KeyFrame* pKF, const int8_t *pGlobal)
+{
+    unique_lock<mutex> lock(mMutex);
+
+    pair<unordered_map<KeyFrame*,size_t>::iterator,bool> res = mIndex.insert(make_pair(pKF,mvpKeyFrames.size()));
+    if(res.second)
+    {
+        mvpKeyFrames.push_back(pKF);
+        mvDescriptors.resize(mvpKeyFrames.size()*GlobalDescriptor::DIM);
+    }
+    copy(pGlobal, pGlobal+GlobalDescriptor::DIM, mvDescriptors.begin()+res.first->second*GlobalDescriptor::DIM);
+}
+
+void GlobalDescriptorIndex::erase(KeyFrame* pKF)
+{
+    unique_lock<mutex> lock(mMutex);
+
+    unordered_map<KeyFrame*,size_t>::iterator it = mIndex.find(pKF);
+    if(it!=mIndex.end())
+        EraseRow(it->second);
+}
+
+void GlobalDescriptorIndex::clear()
+{
+    unique_lock<mutex> lock(mMutex);
+
+    mvDescriptors.clear();
+    mvpKeyFrames.clear();
+    mIndex.clear();
+}
+
+void GlobalDescriptorIndex::clearMap(Map* pMap)
+{
+    unique_lock<mutex> lock(mMutex);
+
+    for(size_t i=mvpKeyFrames.size(); i>0; i--)
+    {
+        if(mvpKeyFrames[i-1]->GetMap()==pMap)
+            EraseRow(i-1);
+    }
+}
+
+void GlobalDescriptorIndex::EraseRow(size_t idx)
+{
+    const size_t last = mvpKeyFrames.size()-1;
+    mIndex.erase(mvpKeyFrames[idx]);
+    if(idx!=last)
+    {
+        mvpKeyFrames[idx] = mvpKeyFrames[last];
+        mIndex[mvpKeyFrames[idx]] = idx;
+        copy(mvDescriptors.begin()+last*GlobalDescriptor::DIM, mvDescriptors.end(), mvDescriptors.begin()+idx*GlobalDescriptor::DIM);
+    }
+    mvpKeyFrames.pop_back();
+    mvDescriptors.resize(last*GlobalDescriptor::DIM);
+}
+
+size_t GlobalDescriptorIndex::size() const
+{
+    unique_lock<mutex> lock(mMutex);
+    return mvpKeyFrames.size();
+}
+
+void GlobalDescriptorIndex::Search(const int8_t *pQuery, size_t nCandidates, vector<KeyFrame*> &vpKFs) const
+{
+    vpKFs.clear();
+
+    unique_lock<mutex> lock(mMutex);
+
+    const size_t N = mvpKeyFrames.size();
+    if(N==0 || nCandidates==0)
+        return;
+
+    vector<pair<int,size_t> > vSimilarities(N);
+    const int8_t *pRow = mvDescriptors.data();
+    for(size_t i=0; i<N; i++, pRow+=GlobalDescriptor::DIM)
+        vSimilarities[i] = make_pair(GlobalDescriptor::Similarity(pQuery, pRow), i);
+
+    const size_t n = min(N, nCandidates);
+    partial_sort(vSimilarities.begin(), vSimilarities.begin()+n, vSimilarities.end(), greater<pair<int,size_t> >());
+
+    vpKFs.reserve(n);
+    for(size_t i=0; i<n; i++)
+        vpKFs.push_back(mvpKeyFrames[vSimilarities[i].second]);
+}
+
+size_t GlobalDescriptorIndex::GetMemoryBytes() const
+{
+    unique_lock<mutex> lock(mMutex);
+
+    // One descriptor row, pointer and hash node per keyframe
+    return mvDescriptors.capacity() + mvpKeyFrames.capacity()*sizeof(KeyFrame*) +
+           mIndex.size()*(sizeof(KeyFrame*) + sizeof(size_t) + 2*sizeof(void*));
+}
+
+} //namespace ORB_SLAM3
@@ -117,11 +117,12 @@ Preintegrated::Preintegrated(Preintegrated* pImuPre): dT(pImuPre->dT),C(pImuPre-
     dP(pImuPre->dP), JRg(pImuPre->JRg), JVg(pImuPre->JVg), JVa(pImuPre->JVa), JPg(pImuPre->JPg), JPa(pImuPre->JPa),
     avgA(pImuPre->avgA), avgW(pImuPre->avgW), bu(pImuPre->bu), db(pImuPre->db), mvMeasurements(pImuPre->mvMeasurements)
 {
-
+    Publish();
 }
 
 void Preintegrated::CopyFrom(Preintegrated* pImuPre)
 {
+    std::unique_lock<std::mutex> lock(mMutex);
     dT = pImuPre->dT;
     C = pImuPre->C;
     Info = pImuPre->Info;
@@ -141,10 +142,18 @@ void Preintegrated::CopyFrom(Preintegrated* pImuPre)
     bu.CopyFrom(pImuPre->bu);
     db = pImuPre->db;
     mvMeasurements = pImuPre->mvMeasurements;
+    Publish();
 }
 
 
 void Preintegrated::Initialize(const Bias &b_)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    Reset(b_);
+    Publish();
+}
+
+void Preintegrated::Reset(const Bias &b_)
 {
     dR.setIdentity();
     dV.setZero();
@@ -169,12 +178,20 @@ void Preintegrated::Reintegrate()
 {
     std::unique_lock<std::mutex> lock(mMutex);
     const std::vector<integrable> aux = mvMeasurements;
-    Initialize(bu);
+    Reset(bu);
     for(size_t i=0;i<aux.size();i++)
-        IntegrateNewMeasurement(aux[i].a,aux[i].w,aux[i].t);
+        Integrate(aux[i].a,aux[i].w,aux[i].t);
+    Publish();
 }
 
 void Preintegrated::IntegrateNewMeasurement(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const float &dt)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    Integrate(acceleration,angVel,dt);
+    Publish();
+}
+
+void Preintegrated::Integrate(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const float &dt)
 {
     mvMeasurements.push_back(integrable(acceleration,angVel,dt));
 
@@ -252,12 +269,12 @@ void Preintegrated::MergePrevious(Preintegrated* pPrev)
     const std::vector<integrable > aux1 = pPrev->mvMeasurements;
     const std::vector<integrable> aux2 = mvMeasurements;
 
-    Initialize(bav);
+    Reset(bav);
     for(size_t i=0;i<aux1.size();i++)
-        IntegrateNewMeasurement(aux1[i].a,aux1[i].w,aux1[i].t);
+        Integrate(aux1[i].a,aux1[i].w,aux1[i].t);
     for(size_t i=0;i<aux2.size();i++)
-        IntegrateNewMeasurement(aux2[i].a,aux2[i].w,aux2[i].t);
-
+        Integrate(aux2[i].a,aux2[i].w,aux2[i].t);
+    Publish();
 }
 
 void Preintegrated::SetNewBias(const Bias &bu_)
@@ -271,91 +288,132 @@ void Preintegrated::SetNewBias(const Bias &bu_)
     db(3) = bu_.bax-b.bax;
     db(4) = bu_.bay-b.bay;
     db(5) = bu_.baz-b.baz;
+    Publish();
 }
 
-IMU::Bias Preintegrated::GetDeltaBias(const Bias &b_)
+void Preintegrated::Publish()
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return IMU::Bias(b_.bax-b.bax,b_.bay-b.bay,b_.baz-b.baz,b_.bwx-b.bwx,b_.bwy-b.bwy,b_.bwz-b.bwz);
+    float v[kStateSize];
+    const Bias* biases[2] = {&b, &bu};
+    int k = 0;
+    for(int i=0; i<2; i++)
+    {
+        v[k++] = biases[i]->bax; v[k++] = biases[i]->bay; v[k++] = biases[i]->baz;
+        v[k++] = biases[i]->bwx; v[k++] = biases[i]->bwy; v[k++] = biases[i]->bwz;
+    }
+    const float* blocks[9] = {db.data(), dR.data(), dV.data(), dP.data(),
+                              JRg.data(), JVg.data(), JVa.data(), JPg.data(), JPa.data()};
+    const int sizes[9] = {6, 9, 3, 3, 9, 9, 9, 9, 9};
+    for(int i=0; i<9; i++)
+        for(int j=0; j<sizes[i]; j++)
+            v[k++] = blocks[i][j];
+    mState.Store(v);
+}
+
+Preintegrated::State Preintegrated::LoadState() const
+{
+    float v[kStateSize];
+    mState.Load(v);
+    State s;
+    Bias* biases[2] = {&s.b, &s.bu};
+    int k = 0;
+    for(int i=0; i<2; i++)
+    {
+        biases[i]->bax = v[k++]; biases[i]->bay = v[k++]; biases[i]->baz = v[k++];
+        biases[i]->bwx = v[k++]; biases[i]->bwy = v[k++]; biases[i]->bwz = v[k++];
+    }
+    float* blocks[9] = {s.db.data(), s.dR.data(), s.dV.data(), s.dP.data(),
+                        s.JRg.data(), s.JVg.data(), s.JVa.data(), s.JPg.data(), s.JPa.data()};
+    const int sizes[9] = {6, 9, 3, 3, 9, 9, 9, 9, 9};
+    for(int i=0; i<9; i++)
+        for(int j=0; j<sizes[i]; j++)
+            blocks[i][j] = v[k++];
+    return s;
+}
+
+IMU::Bias Preintegrated::GetDeltaBias(const Bias &b_) const
+{
+    const State s = LoadState();
+    return IMU::Bias(b_.bax-s.b.bax,b_.bay-s.b.bay,b_.baz-s.b.baz,b_.bwx-s.b.bwx,b_.bwy-s.b.bwy,b_.bwz-s.b.bwz);
 }
 
 
-Eigen::Matrix3f Preintegrated::GetDeltaRotation(const Bias &b_)
+Eigen::Matrix3f Preintegrated::GetDeltaRotation(const Bias &b_) const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
+    const State s = LoadState();
     Eigen::Vector3f dbg;
-    dbg << b_.bwx-b.bwx,b_.bwy-b.bwy,b_.bwz-b.bwz;
-    return NormalizeRotation(dR * Sophus::SO3f::exp(JRg * dbg).matrix());
+    dbg << b_.bwx-s.b.bwx,b_.bwy-s.b.bwy,b_.bwz-s.b.bwz;
+    return NormalizeRotation(s.dR * Sophus::SO3f::exp(s.JRg * dbg).matrix());
 }
 
-Eigen::Vector3f Preintegrated::GetDeltaVelocity(const Bias &b_)
+Eigen::Vector3f Preintegrated::GetDeltaVelocity(const Bias &b_) const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
+    const State s = LoadState();
     Eigen::Vector3f dbg, dba;
-    dbg << b_.bwx-b.bwx,b_.bwy-b.bwy,b_.bwz-b.bwz;
-    dba << b_.bax-b.bax,b_.bay-b.bay,b_.baz-b.baz;
-    return dV + JVg * dbg + JVa * dba;
+    dbg << b_.bwx-s.b.bwx,b_.bwy-s.b.bwy,b_.bwz-s.b.bwz;
+    dba << b_.bax-s.b.bax,b_.bay-s.b.bay,b_.baz-s.b.baz;
+    return s.dV + s.JVg * dbg + s.JVa * dba;
 }
 
-Eigen::Vector3f Preintegrated::GetDeltaPosition(const Bias &b_)
+Eigen::Vector3f Preintegrated::GetDeltaPosition(const Bias &b_) const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
+    const State s = LoadState();
     Eigen::Vector3f dbg, dba;
-    dbg << b_.bwx-b.bwx,b_.bwy-b.bwy,b_.bwz-b.bwz;
-    dba << b_.bax-b.bax,b_.bay-b.bay,b_.baz-b.baz;
-    return dP + JPg * dbg + JPa * dba;
+    dbg << b_.bwx-s.b.bwx,b_.bwy-s.b.bwy,b_.bwz-s.b.bwz;
+    dba << b_.bax-s.b.bax,b_.bay-s.b.bay,b_.baz-s.b.baz;
+    return s.dP + s.JPg * dbg + s.JPa * dba;
 }
 
-Eigen::Matrix3f Preintegrated::GetUpdatedDeltaRotation()
+Eigen::Matrix3f Preintegrated::GetUpdatedDeltaRotation() const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return NormalizeRotation(dR * Sophus::SO3f::exp(JRg*db.head(3)).matrix());
+    const State s = LoadState();
+    return NormalizeRotation(s.dR * Sophus::SO3f::exp(s.JRg*s.db.head(3)).matrix());
 }
 
-Eigen::Vector3f Preintegrated::GetUpdatedDeltaVelocity()
+Eigen::Vector3f Preintegrated::GetUpdatedDeltaVelocity() const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return dV + JVg * db.head(3) + JVa * db.tail(3);
+    const State s = LoadState();
+    return s.dV + s.JVg * s.db.head(3) + s.JVa * s.db.tail(3);
 }
 
-Eigen::Vector3f Preintegrated::GetUpdatedDeltaPosition()
+Eigen::Vector3f Preintegrated::GetUpdatedDeltaPosition() const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return dP + JPg*db.head(3) + JPa*db.tail(3);
+    const State s = LoadState();
+    return s.dP + s.JPg*s.db.head(3) + s.JPa*s.db.tail(3);
 }
 
-Eigen::Matrix3f Preintegrated::GetOriginalDeltaRotation() {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return dR;
+Eigen::Matrix3f Preintegrated::GetOriginalDeltaRotation() const {
+    const State s = LoadState();
+    return s.dR;
 }
 
-Eigen::Vector3f Preintegrated::GetOriginalDeltaVelocity() {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return dV;
+Eigen::Vector3f Preintegrated::GetOriginalDeltaVelocity() const {
+    const State s = LoadState();
+    return s.dV;
 }
 
-Eigen::Vector3f Preintegrated::GetOriginalDeltaPosition()
+Eigen::Vector3f Preintegrated::GetOriginalDeltaPosition() const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return dP;
+    const State s = LoadState();
+    return s.dP;
 }
 
-Bias Preintegrated::GetOriginalBias()
+Bias Preintegrated::GetOriginalBias() const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return b;
+    const State s = LoadState();
+    return s.b;
 }
 
-Bias Preintegrated::GetUpdatedBias()
+Bias Preintegrated::GetUpdatedBias() const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return bu;
+    const State s = LoadState();
+    return s.bu;
 }
 
-Eigen::Matrix<float,6,1> Preintegrated::GetDeltaBias()
+Eigen::Matrix<float,6,1> Preintegrated::GetDeltaBias() const
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    return db;
+    const State s = LoadState();
+    return s.db;
 }
 
 void Bias::CopyFrom(Bias &b)
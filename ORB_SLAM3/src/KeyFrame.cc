@@ -24,7 +24,46 @@
 namespace ORB_SLAM3
 {
 
+// Heap node of a std::map or std::set with a small payload, with the allocator overhead
+static const size_t kTreeNodeBytes = 48;
+
+// Memory of a keyframe grid, every non empty cell is a heap block
+static size_t GridBytes(const vector< vector <vector<size_t> > > &grid)
+{
+    size_t nBytes = grid.capacity()*sizeof(vector<vector<size_t> >);
+    for(size_t i=0; i<grid.size(); i++)
+    {
+        nBytes += grid[i].capacity()*sizeof(vector<size_t>);
+        for(size_t j=0; j<grid[i].size(); j++)
+            if(grid[i][j].capacity())
+                nBytes += grid[i][j].capacity()*sizeof(size_t) + 16;
+    }
+    return nBytes;
+}
+
 long unsigned int KeyFrame::nNextId=0;
+thread_local bool KeyFrame::bSerializeDescriptors=true;
+atomic<unsigned long> KeyFrame::nPoseEpoch(0);
+
+void* KeyFrame::operator new(size_t size, Map* pMap)
+{
+    return MapObjectPool<KeyFrame>::Allocate(pMap ? pMap->GetKeyFramePool() : static_cast<MapObjectPool<KeyFrame>*>(NULL), size);
+}
+
+void* KeyFrame::operator new(size_t size)
+{
+    return MapObjectPool<KeyFrame>::Allocate(NULL, size);
+}
+
+void KeyFrame::operator delete(void* p, Map*)
+{
+    MapObjectPool<KeyFrame>::Free(p);
+}
+
+void KeyFrame::operator delete(void* p)
+{
+    MapObjectPool<KeyFrame>::Free(p);
+}
 
 KeyFrame::KeyFrame():
         mnFrameId(0),  mTimeStamp(0), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
@@ -35,7 +74,7 @@ KeyFrame::KeyFrame():
         mbf(0), mb(0), mThDepth(0), N(0), mvKeys(static_cast<vector<cv::KeyPoint> >(NULL)), mvKeysUn(static_cast<vector<cv::KeyPoint> >(NULL)),
         mvuRight(static_cast<vector<float> >(NULL)), mvDepth(static_cast<vector<float> >(NULL)), mnScaleLevels(0), mfScaleFactor(0),
         mfLogScaleFactor(0), mvScaleFactors(0), mvLevelSigma2(0), mvInvLevelSigma2(0), mnMinX(0), mnMinY(0), mnMaxX(0),
-        mnMaxY(0), mPrevKF(static_cast<KeyFrame*>(NULL)), mNextKF(static_cast<KeyFrame*>(NULL)), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
+        mnMaxY(0), mPrevKF(static_cast<KeyFrame*>(NULL)), mNextKF(static_cast<KeyFrame*>(NULL)), mbOrderedAllConnections(true), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
         mbToBeErased(false), mbBad(false), mHalfBaseline(0), mbCurrentPlaceRecognition(false), mnMergeCorrectedForKF(0),
         NLeft(0),NRight(0), mnNumberOfOpt(0), mbHasVelocity(false)
 {
@@ -50,12 +89,12 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
     mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn),
     mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors.clone()),
-    mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
+    mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mFlatBowVec(F.mFlatBowVec), mFlatFeatVec(F.mFlatFeatVec), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
     mfLogScaleFactor(F.mfLogScaleFactor), mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
     mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY), mnMaxX(F.mnMaxX),
     mnMaxY(F.mnMaxY), mK_(F.mK_), mPrevKF(NULL), mNextKF(NULL), mpImuPreintegrated(F.mpImuPreintegrated),
     mImuCalib(F.mImuCalib), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
-    mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mpParent(NULL), mDistCoef(F.mDistCoef), mbNotErase(false), mnDataset(F.mnDataset),
+    mpORBvocabulary(F.mpORBvocabulary), mbOrderedAllConnections(true), mbFirstConnection(true), mpParent(NULL), mDistCoef(F.mDistCoef), mbNotErase(false), mnDataset(F.mnDataset),
     mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap), mbCurrentPlaceRecognition(false), mNameFile(F.mNameFile), mnMergeCorrectedForKF(0),
     mpCamera(F.mpCamera), mpCamera2(F.mpCamera2),
     mvLeftToRightMatch(F.mvLeftToRightMatch),mvRightToLeftMatch(F.mvRightToLeftMatch), mTlr(F.GetRelativePoseTlr()),
@@ -70,9 +109,9 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
         mGrid[i].resize(mnGridRows);
         if(F.Nleft != -1) mGridRight[i].resize(mnGridRows);
         for(int j=0; j<mnGridRows; j++){
-            mGrid[i][j] = F.mGrid[i][j];
+            mGrid[i][j].assign(F.mGrid.CellBegin(i,j), F.mGrid.CellEnd(i,j));
             if(F.Nleft != -1){
-                mGridRight[i][j] = F.mGridRight[i][j];
+                mGridRight[i][j].assign(F.mGridRight.CellBegin(i,j), F.mGridRight.CellEnd(i,j));
             }
         }
     }
@@ -93,22 +132,42 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     SetPose(F.GetPose());
 
     mnOriginMapId = pMap->GetId();
+
+    // The frame's transform may be running or done already, share it instead of starting over
+    if(mBowVec.empty())
+    {
+        if(!F.mpBowCache)
+            F.mpBowCache = std::make_shared<BowCache>();
+        mpBowCache = F.mpBowCache;
+    }
 }
 
 void KeyFrame::ComputeBoW()
 {
     if(mBowVec.empty() || mFeatVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
         // Feature vector associate features with nodes in the 4th level (from leaves up)
-        // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        // We assume the vocabulary tree has 6 levels, change the 4 in BowCache otherwise
+        if(!mpBowCache)
+            mpBowCache = std::make_shared<BowCache>();
+        mpBowCache->Compute(mpORBvocabulary, mDescriptors);
+        mBowVec = mpBowCache->mBowVec;
+        mFeatVec = mpBowCache->mFeatVec;
+        mFlatBowVec = mpBowCache->mFlatBowVec;
+        mFlatFeatVec = mpBowCache->mFlatFeatVec;
     }
+    mpBowCache.reset();
+}
+
+void KeyFrame::ComputeBoWAsync(const BowCache::Submit &submit)
+{
+    if(mpBowCache && mBowVec.empty())
+        BowCache::ComputeAsync(mpBowCache, mpORBvocabulary, mDescriptors, submit);
 }
 
 void KeyFrame::SetPose(const Sophus::SE3f &Tcw)
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
 
     mTcw = Tcw;
     mRcw = mTcw.rotationMatrix();
@@ -119,83 +178,104 @@ void KeyFrame::SetPose(const Sophus::SE3f &Tcw)
     {
         mOwb = mRwc * mImuCalib.mTcb.translation() + mTwc.translation();
     }
+
+    mnPoseEpoch = ++nPoseEpoch;
 }
 
 void KeyFrame::SetVelocity(const Eigen::Vector3f &Vw)
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     mVw = Vw;
     mbHasVelocity = true;
 }
 
 Sophus::SE3f KeyFrame::GetPose()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mTcw;
 }
 
 Sophus::SE3f KeyFrame::GetPoseInverse()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mTwc;
 }
 
 Eigen::Vector3f KeyFrame::GetCameraCenter(){
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mTwc.translation();
 }
 
+unsigned long KeyFrame::GetPoseEpoch()
+{
+    return mnPoseEpoch;
+}
+
+unsigned long KeyFrame::GetPoseEpochCounter()
+{
+    return nPoseEpoch;
+}
+
 Eigen::Vector3f KeyFrame::GetImuPosition()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mOwb;
 }
 
 Eigen::Matrix3f KeyFrame::GetImuRotation()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return (mTwc * mImuCalib.mTcb).rotationMatrix();
 }
 
 Sophus::SE3f KeyFrame::GetImuPose()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mTwc * mImuCalib.mTcb;
 }
 
 Eigen::Matrix3f KeyFrame::GetRotation(){
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mRcw;
 }
 
 Eigen::Vector3f KeyFrame::GetTranslation()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mTcw.translation();
 }
 
 Eigen::Vector3f KeyFrame::GetVelocity()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mVw;
 }
 
 bool KeyFrame::isVelocitySet()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mbHasVelocity;
 }
 
 void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 {
     {
-        unique_lock<mutex> lock(mMutexConnections);
-        if(!mConnectedKeyFrameWeights.count(pKF))
-            mConnectedKeyFrameWeights[pKF]=weight;
-        else if(mConnectedKeyFrameWeights[pKF]!=weight)
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
+        map<KeyFrame*,int>::iterator mit = mConnectedKeyFrameWeights.find(pKF);
+        if(mit==mConnectedKeyFrameWeights.end())
             mConnectedKeyFrameWeights[pKF]=weight;
+        else if(mit->second!=weight)
+            mit->second=weight;
         else
             return;
+
+        if(mbOrderedAllConnections)
+        {
+            EraseOrderedConnection(pKF);
+            if(!pKF->isBad())
+                InsertOrderedConnection(pKF,weight);
+            return;
+        }
     }
 
     UpdateBestCovisibles();
@@ -203,31 +283,52 @@ void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 
 void KeyFrame::UpdateBestCovisibles()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     vector<pair<int,KeyFrame*> > vPairs;
     vPairs.reserve(mConnectedKeyFrameWeights.size());
     for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
        vPairs.push_back(make_pair(mit->second,mit->first));
 
     sort(vPairs.begin(),vPairs.end());
-    list<KeyFrame*> lKFs;
-    list<int> lWs;
-    for(size_t i=0, iend=vPairs.size(); i<iend;i++)
+    mvpOrderedConnectedKeyFrames.clear();
+    mvOrderedWeights.clear();
+    mvpOrderedConnectedKeyFrames.reserve(vPairs.size());
+    mvOrderedWeights.reserve(vPairs.size());
+    for(vector<pair<int,KeyFrame*> >::reverse_iterator rit=vPairs.rbegin(), rend=vPairs.rend(); rit!=rend; rit++)
     {
-        if(!vPairs[i].second->isBad())
+        if(!rit->second->isBad())
         {
-            lKFs.push_front(vPairs[i].second);
-            lWs.push_front(vPairs[i].first);
+            mvpOrderedConnectedKeyFrames.push_back(rit->second);
+            mvOrderedWeights.push_back(rit->first);
         }
     }
+    mbOrderedAllConnections = true;
+}
+
+void KeyFrame::EraseOrderedConnection(KeyFrame* pKF)
+{
+    vector<KeyFrame*>::iterator vit = find(mvpOrderedConnectedKeyFrames.begin(),mvpOrderedConnectedKeyFrames.end(),pKF);
+    if(vit==mvpOrderedConnectedKeyFrames.end())
+        return;
+
+    mvOrderedWeights.erase(mvOrderedWeights.begin()+(vit-mvpOrderedConnectedKeyFrames.begin()));
+    mvpOrderedConnectedKeyFrames.erase(vit);
+}
+
+void KeyFrame::InsertOrderedConnection(KeyFrame* pKF, const int weight)
+{
+    // Same order as UpdateBestCovisibles, decreasing weight and then decreasing pointer
+    size_t i = lower_bound(mvOrderedWeights.begin(),mvOrderedWeights.end(),weight,KeyFrame::weightComp)-mvOrderedWeights.begin();
+    while(i<mvOrderedWeights.size() && mvOrderedWeights[i]==weight && mvpOrderedConnectedKeyFrames[i]>pKF)
+        i++;
 
-    mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
-    mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());
+    mvpOrderedConnectedKeyFrames.insert(mvpOrderedConnectedKeyFrames.begin()+i,pKF);
+    mvOrderedWeights.insert(mvOrderedWeights.begin()+i,weight);
 }
 
 set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     set<KeyFrame*> s;
     for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
         s.insert(mit->first);
@@ -236,13 +337,13 @@ set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
 
 vector<KeyFrame*> KeyFrame::GetVectorCovisibleKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     return mvpOrderedConnectedKeyFrames;
 }
 
 vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N)
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     if((int)mvpOrderedConnectedKeyFrames.size()<N)
         return mvpOrderedConnectedKeyFrames;
     else
@@ -252,7 +353,7 @@ vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N)
 
 vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
 
     if(mvpOrderedConnectedKeyFrames.empty())
     {
@@ -274,16 +375,17 @@ vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 
 int KeyFrame::GetWeight(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexConnections);
-    if(mConnectedKeyFrameWeights.count(pKF))
-        return mConnectedKeyFrameWeights[pKF];
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
+    map<KeyFrame*,int>::const_iterator mit = mConnectedKeyFrameWeights.find(pKF);
+    if(mit!=mConnectedKeyFrameWeights.end())
+        return mit->second;
     else
         return 0;
 }
 
 int KeyFrame::GetNumberMPs()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     int numberMPs = 0;
     for(size_t i=0, iend=mvpMapPoints.size(); i<iend; i++)
     {
@@ -296,13 +398,13 @@ int KeyFrame::GetNumberMPs()
 
 void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     mvpMapPoints[idx]=pMP;
 }
 
 void KeyFrame::EraseMapPointMatch(const int &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     mvpMapPoints[idx]=static_cast<MapPoint*>(NULL);
 }
 
@@ -324,7 +426,7 @@ void KeyFrame::ReplaceMapPointMatch(const int &idx, MapPoint* pMP)
 
 set<MapPoint*> KeyFrame::GetMapPoints()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     set<MapPoint*> s;
     for(size_t i=0, iend=mvpMapPoints.size(); i<iend; i++)
     {
@@ -339,7 +441,7 @@ set<MapPoint*> KeyFrame::GetMapPoints()
 
 int KeyFrame::TrackedMapPoints(const int &minObs)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
 
     int nPoints=0;
     const bool bCheckObs = minObs>0;
@@ -366,13 +468,13 @@ int KeyFrame::TrackedMapPoints(const int &minObs)
 
 vector<MapPoint*> KeyFrame::GetMapPointMatches()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mvpMapPoints;
 }
 
 MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mvpMapPoints[idx];
 }
 
@@ -383,7 +485,7 @@ void KeyFrame::UpdateConnections(bool upParent)
     vector<MapPoint*> vpMP;
 
     {
-        unique_lock<mutex> lockMPs(mMutexFeatures);
+        unique_lock<ProfiledMutex> lockMPs(mMutexFeatures);
         vpMP = mvpMapPoints;
     }
 
@@ -447,20 +549,21 @@ void KeyFrame::UpdateConnections(bool upParent)
     }
 
     sort(vPairs.begin(),vPairs.end());
-    list<KeyFrame*> lKFs;
-    list<int> lWs;
-    for(size_t i=0; i<vPairs.size();i++)
-    {
-        lKFs.push_front(vPairs[i].second);
-        lWs.push_front(vPairs[i].first);
-    }
 
     {
-        unique_lock<mutex> lockCon(mMutexConnections);
+        unique_lock<ProfiledMutex> lockCon(mMutexConnections);
 
         mConnectedKeyFrameWeights = KFcounter;
-        mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
-        mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());
+        mvpOrderedConnectedKeyFrames.clear();
+        mvOrderedWeights.clear();
+        mvpOrderedConnectedKeyFrames.reserve(vPairs.size());
+        mvOrderedWeights.reserve(vPairs.size());
+        for(vector<pair<int,KeyFrame*> >::reverse_iterator rit=vPairs.rbegin(), rend=vPairs.rend(); rit!=rend; rit++)
+        {
+            mvpOrderedConnectedKeyFrames.push_back(rit->second);
+            mvOrderedWeights.push_back(rit->first);
+        }
+        mbOrderedAllConnections = mvpOrderedConnectedKeyFrames.size()==mConnectedKeyFrameWeights.size();
 
 
         if(mbFirstConnection && mnId!=mpMap->GetInitKFid())
@@ -475,19 +578,19 @@ void KeyFrame::UpdateConnections(bool upParent)
 
 void KeyFrame::AddChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mspChildrens.insert(pKF);
 }
 
 void KeyFrame::EraseChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mspChildrens.erase(pKF);
 }
 
 void KeyFrame::ChangeParent(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     if(pKF == this)
     {
         cout << "ERROR: Change parent KF, the parent and child are the same KF" << endl;
@@ -500,64 +603,64 @@ void KeyFrame::ChangeParent(KeyFrame *pKF)
 
 set<KeyFrame*> KeyFrame::GetChilds()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mspChildrens;
 }
 
 KeyFrame* KeyFrame::GetParent()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mpParent;
 }
 
 bool KeyFrame::hasChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mspChildrens.count(pKF);
 }
 
 void KeyFrame::SetFirstConnection(bool bFirst)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mbFirstConnection=bFirst;
 }
 
 void KeyFrame::AddLoopEdge(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mbNotErase = true;
     mspLoopEdges.insert(pKF);
 }
 
 set<KeyFrame*> KeyFrame::GetLoopEdges()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mspLoopEdges;
 }
 
 void KeyFrame::AddMergeEdge(KeyFrame* pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mbNotErase = true;
     mspMergeEdges.insert(pKF);
 }
 
 set<KeyFrame*> KeyFrame::GetMergeEdges()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mspMergeEdges;
 }
 
 void KeyFrame::SetNotErase()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     mbNotErase = true;
 }
 
 void KeyFrame::SetErase()
 {
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
         if(mspLoopEdges.empty())
         {
             mbNotErase = false;
@@ -573,7 +676,7 @@ void KeyFrame::SetErase()
 void KeyFrame::SetBadFlag()
 {
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
         if(mnId==mpMap->GetInitKFid())
         {
             return;
@@ -599,11 +702,12 @@ void KeyFrame::SetBadFlag()
     }
 
     {
-        unique_lock<mutex> lock(mMutexConnections);
-        unique_lock<mutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
 
         mConnectedKeyFrameWeights.clear();
         mvpOrderedConnectedKeyFrames.clear();
+        mvOrderedWeights.clear();
 
         // Update Spanning Tree
         set<KeyFrame*> sParentCandidates;
@@ -680,7 +784,7 @@ void KeyFrame::SetBadFlag()
 
 bool KeyFrame::isBad()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     return mbBad;
 }
 
@@ -688,11 +792,13 @@ void KeyFrame::EraseConnection(KeyFrame* pKF)
 {
     bool bUpdate = false;
     {
-        unique_lock<mutex> lock(mMutexConnections);
-        if(mConnectedKeyFrameWeights.count(pKF))
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
+        if(mConnectedKeyFrameWeights.erase(pKF))
         {
-            mConnectedKeyFrameWeights.erase(pKF);
-            bUpdate=true;
+            if(mbOrderedAllConnections)
+                EraseOrderedConnection(pKF);
+            else
+                bUpdate=true;
         }
     }
 
@@ -725,11 +831,15 @@ vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const
     if(nMaxCellY<0)
         return vIndices;
 
+    unique_lock<mutex> lock(mMutexGrid);
+    if(mGrid.empty())
+        BuildGrid();
+
     for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
     {
         for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
         {
-            const vector<size_t> vCell = (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy];
+            const vector<size_t> &vCell = (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy];
             for(size_t j=0, jend=vCell.size(); j<jend; j++)
             {
                 const cv::KeyPoint &kpUn = (NLeft == -1) ? mvKeysUn[vCell[j]]
@@ -747,6 +857,71 @@ vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const
     return vIndices;
 }
 
+void KeyFrame::BuildGrid() const
+{
+    const PackedKeyPoints &vKeys = (NLeft == -1) ? mvKeysUn : mvKeys;
+    AssignKeysToGrid(vKeys, mGrid);
+    if(NLeft != -1)
+        AssignKeysToGrid(mvKeysRight, mGridRight);
+}
+
+void KeyFrame::AssignKeysToGrid(const PackedKeyPoints &vKeys, vector< vector <vector<size_t> > > &grid) const
+{
+    // Same cells as Frame::PosInGrid
+    grid.assign(mnGridCols, vector<vector<size_t> >(mnGridRows));
+    for(size_t i=0; i<vKeys.size(); i++)
+    {
+        const cv::Point2f pt = vKeys[i].pt;
+        const int nGridPosX = round((pt.x-mnMinX)*mfGridElementWidthInv);
+        const int nGridPosY = round((pt.y-mnMinY)*mfGridElementHeightInv);
+        if(nGridPosX<0 || nGridPosX>=mnGridCols || nGridPosY<0 || nGridPosY>=mnGridRows)
+            continue;
+        grid[nGridPosX][nGridPosY].push_back(i);
+    }
+}
+
+size_t KeyFrame::ReleaseGrid()
+{
+    unique_lock<mutex> lock(mMutexGrid);
+    const size_t nBytes = GridBytes(mGrid) + GridBytes(mGridRight);
+    vector< vector <vector<size_t> > >().swap(mGrid);
+    vector< vector <vector<size_t> > >().swap(mGridRight);
+    return nBytes;
+}
+
+size_t KeyFrame::GetMemoryBytes()
+{
+    MemoryBreakdown breakdown;
+    GetMemoryBreakdown(breakdown);
+    return breakdown.Total();
+}
+
+void KeyFrame::GetMemoryBreakdown(MemoryBreakdown &breakdown)
+{
+    breakdown.Add(MemoryBreakdown::KEYFRAME_GRAPH, sizeof(KeyFrame));
+    breakdown.Add(MemoryBreakdown::KEYFRAME_KEYPOINTS, mvKeys.MemoryBytes() + mvKeysUn.MemoryBytes() + mvKeysRight.MemoryBytes() +
+                  (mvuRight.capacity() + mvDepth.capacity())*sizeof(float));
+    breakdown.Add(MemoryBreakdown::KEYFRAME_DESCRIPTORS, mDescriptors.total()*mDescriptors.elemSize());
+    breakdown.Add(MemoryBreakdown::KEYFRAME_BOW, (mBowVec.size() + mFeatVec.size())*kTreeNodeBytes + N*sizeof(unsigned int) +
+                  mFlatBowVec.size()*(sizeof(DBoW2::WordId) + sizeof(DBoW2::WordValue)) +
+                  mFlatFeatVec.size()*(sizeof(DBoW2::NodeId) + sizeof(unsigned int)) + mFlatFeatVec.features.size()*sizeof(unsigned int));
+    {
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        breakdown.Add(MemoryBreakdown::KEYFRAME_GRAPH, mvpMapPoints.capacity()*sizeof(MapPoint*));
+    }
+    {
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
+        size_t nBytes = mConnectedKeyFrameWeights.size()*kTreeNodeBytes;
+        nBytes += mvpOrderedConnectedKeyFrames.capacity()*sizeof(KeyFrame*) + mvOrderedWeights.capacity()*sizeof(int);
+        nBytes += (mspChildrens.size() + mspLoopEdges.size() + mspMergeEdges.size())*kTreeNodeBytes;
+        breakdown.Add(MemoryBreakdown::KEYFRAME_GRAPH, nBytes);
+    }
+    {
+        unique_lock<mutex> lock(mMutexGrid);
+        breakdown.Add(MemoryBreakdown::KEYFRAME_GRIDS, GridBytes(mGrid) + GridBytes(mGridRight));
+    }
+}
+
 bool KeyFrame::IsInImage(const float &x, const float &y) const
 {
     return (x>=mnMinX && x<mnMaxX && y>=mnMinY && y<mnMaxY);
@@ -763,7 +938,7 @@ bool KeyFrame::UnprojectStereo(int i, Eigen::Vector3f &x3D)
         const float y = (v-cy)*z*invfy;
         Eigen::Vector3f x3Dc(x, y, z);
 
-        unique_lock<mutex> lock(mMutexPose);
+        unique_lock<ProfiledMutex> lock(mMutexPose);
         x3D = mRwc * x3Dc + mTwc.translation();
         return true;
     }
@@ -780,8 +955,8 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
     Eigen::Matrix3f Rcw;
     Eigen::Vector3f tcw;
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPose);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPose);
         vpMapPoints = mvpMapPoints;
         tcw = mTcw.translation();
         Rcw = mRcw;
@@ -808,7 +983,7 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
 
 void KeyFrame::SetNewBias(const IMU::Bias &b)
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     mImuBias = b;
     if(mpImuPreintegrated)
         mpImuPreintegrated->SetNewBias(b);
@@ -816,31 +991,31 @@ void KeyFrame::SetNewBias(const IMU::Bias &b)
 
 Eigen::Vector3f KeyFrame::GetGyroBias()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Eigen::Vector3f(mImuBias.bwx, mImuBias.bwy, mImuBias.bwz);
 }
 
 Eigen::Vector3f KeyFrame::GetAccBias()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Eigen::Vector3f(mImuBias.bax, mImuBias.bay, mImuBias.baz);
 }
 
 IMU::Bias KeyFrame::GetImuBias()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mImuBias;
 }
 
 Map* KeyFrame::GetMap()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mpMap;
 }
 
 void KeyFrame::UpdateMap(Map* pMap)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mpMap = pMap;
 }
 
@@ -925,6 +1100,10 @@ void KeyFrame::PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsi
     // Pose
     SetPose(mTcw);
 
+    // Bag of words as sorted arrays
+    mFlatBowVec.assign(mBowVec);
+    mFlatFeatVec.assign(mFeatVec);
+
     mTrl = mTlr.inverse();
 
     // Reference reconstruction
@@ -1107,42 +1286,42 @@ bool KeyFrame::ProjectPointUnDistort(MapPoint* pMP, cv::Point2f &kp, float &u, f
 
 Sophus::SE3f KeyFrame::GetRelativePoseTrl()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mTrl;
 }
 
 Sophus::SE3f KeyFrame::GetRelativePoseTlr()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return mTlr;
 }
 
 Sophus::SE3<float> KeyFrame::GetRightPose() {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
 
     return mTrl * mTcw;
 }
 
 Sophus::SE3<float> KeyFrame::GetRightPoseInverse() {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
 
     return mTwc * mTlr;
 }
 
 Eigen::Vector3f KeyFrame::GetRightCameraCenter() {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
 
     return (mTwc * mTlr).translation();
 }
 
 Eigen::Matrix<float,3,3> KeyFrame::GetRightRotation() {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
 
     return (mTrl.so3() * mTcw.so3()).matrix();
 }
 
 Eigen::Vector3f KeyFrame::GetRightTranslation() {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return (mTrl * mTcw).translation();
 }
 
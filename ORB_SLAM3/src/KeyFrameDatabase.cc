@@ -23,6 +23,8 @@
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 
 #include<mutex>
+#include<algorithm>
+#include<cmath>
 
 using namespace std;
 
@@ -30,8 +32,9 @@ namespace ORB_SLAM3
 {
 
 KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
-    mpVoc(&voc)
+    mpVoc(&voc), mnPostingLists(0), mnPostings(0), mnGlobalCandidates(0), mnGlobalMinKeyFrames(0)
 {
+    mbL1Score = mpVoc->getScoringType()==DBoW2::L1_NORM;
     mvInvertedFile.resize(voc.size());
 }
 
@@ -41,7 +44,46 @@ void KeyFrameDatabase::add(KeyFrame *pKF)
     unique_lock<mutex> lock(mMutex);
 
     for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
-        mvInvertedFile[vit->first].push_back(pKF);
+    {
+        shared_ptr<const PostingList> pPosting = atomic_load(&mvInvertedFile[vit->first]);
+        shared_ptr<PostingList> pNewPosting = pPosting ? make_shared<PostingList>(*pPosting) : make_shared<PostingList>();
+        pNewPosting->vpKeyFrames.push_back(pKF);
+        pNewPosting->vWeights.push_back(vit->second);
+        Publish(vit->first, pNewPosting);
+    }
+
+    int8_t global[GlobalDescriptor::DIM];
+    if(mnGlobalCandidates>0 && GlobalDescriptor::Compute(pKF->mDescriptors,global))
+        mGlobalIndex.add(pKF,global);
+}
+
+void KeyFrameDatabase::add(const vector<KeyFrame*> &vpKFs)
+{
+    unique_lock<mutex> lock(mMutex);
+
+    map<DBoW2::WordId,shared_ptr<PostingList> > mNewPostings;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
+        {
+            shared_ptr<PostingList> &pNewPosting = mNewPostings[vit->first];
+            if(!pNewPosting)
+            {
+                shared_ptr<const PostingList> pPosting = atomic_load(&mvInvertedFile[vit->first]);
+                pNewPosting = pPosting ? make_shared<PostingList>(*pPosting) : make_shared<PostingList>();
+            }
+            pNewPosting->vpKeyFrames.push_back(pKF);
+            pNewPosting->vWeights.push_back(vit->second);
+        }
+
+        int8_t global[GlobalDescriptor::DIM];
+        if(mnGlobalCandidates>0 && GlobalDescriptor::Compute(pKF->mDescriptors,global))
+            mGlobalIndex.add(pKF,global);
+    }
+
+    for(map<DBoW2::WordId,shared_ptr<PostingList> >::iterator mit=mNewPostings.begin(); mit!=mNewPostings.end(); mit++)
+        Publish(mit->first, mit->second);
 }
 
 void KeyFrameDatabase::erase(KeyFrame* pKF)
@@ -52,23 +94,35 @@ void KeyFrameDatabase::erase(KeyFrame* pKF)
     for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
     {
         // List of keyframes that share the word
-        list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+        shared_ptr<const PostingList> pPosting = atomic_load(&mvInvertedFile[vit->first]);
+        if(!pPosting)
+            continue;
 
-        for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+        const vector<KeyFrame*> &vpKFs = pPosting->vpKeyFrames;
+        const size_t idx = find(vpKFs.begin(), vpKFs.end(), pKF) - vpKFs.begin();
+        if(idx==vpKFs.size())
+            continue;
+
+        shared_ptr<PostingList> pNewPosting;
+        if(vpKFs.size()>1)
         {
-            if(pKF==*lit)
-            {
-                lKFs.erase(lit);
-                break;
-            }
+            pNewPosting = make_shared<PostingList>(*pPosting);
+            pNewPosting->vpKeyFrames.erase(pNewPosting->vpKeyFrames.begin()+idx);
+            pNewPosting->vWeights.erase(pNewPosting->vWeights.begin()+idx);
         }
+        Publish(vit->first, pNewPosting);
     }
+
+    mGlobalIndex.erase(pKF);
 }
 
 void KeyFrameDatabase::clear()
 {
-    mvInvertedFile.clear();
-    mvInvertedFile.resize(mpVoc->size());
+    unique_lock<mutex> lock(mMutex);
+
+    for(size_t i=0; i<mvInvertedFile.size(); i++)
+        Publish(i, shared_ptr<const PostingList>());
+    mGlobalIndex.clear();
 }
 
 void KeyFrameDatabase::clearMap(Map* pMap)
@@ -76,94 +130,201 @@ void KeyFrameDatabase::clearMap(Map* pMap)
     unique_lock<mutex> lock(mMutex);
 
     // Erase elements in the Inverse File for the entry
-    for(std::vector<list<KeyFrame*> >::iterator vit=mvInvertedFile.begin(), vend=mvInvertedFile.end(); vit!=vend; vit++)
+    for(size_t i=0; i<mvInvertedFile.size(); i++)
     {
         // List of keyframes that share the word
-        list<KeyFrame*> &lKFs =  *vit;
+        shared_ptr<const PostingList> pPosting = atomic_load(&mvInvertedFile[i]);
+        if(!pPosting)
+            continue;
 
-        for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend;)
+        shared_ptr<PostingList> pNewPosting = make_shared<PostingList>();
+        for(size_t j=0; j<pPosting->vpKeyFrames.size(); j++)
         {
-            KeyFrame* pKFi = *lit;
-            if(pMap == pKFi->GetMap())
-            {
-                lit = lKFs.erase(lit);
-                // Dont delete the KF because the class Map clean all the KF when it is destroyed
-            }
-            else
+            KeyFrame* pKFi = pPosting->vpKeyFrames[j];
+            // Dont delete the KF because the class Map clean all the KF when it is destroyed
+            if(pMap != pKFi->GetMap())
             {
-                ++lit;
+                pNewPosting->vpKeyFrames.push_back(pKFi);
+                pNewPosting->vWeights.push_back(pPosting->vWeights[j]);
             }
         }
+
+        if(pNewPosting->vpKeyFrames.size()==pPosting->vpKeyFrames.size())
+            continue;
+        if(pNewPosting->vpKeyFrames.empty())
+            pNewPosting.reset();
+        Publish(i, pNewPosting);
     }
+
+    mGlobalIndex.clearMap(pMap);
 }
 
-vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float minScore)
+void KeyFrameDatabase::Publish(size_t nWordId, const shared_ptr<const PostingList> &pPosting)
 {
-    set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-    list<KeyFrame*> lKFsSharingWords;
+    shared_ptr<const PostingList> pOldPosting = atomic_load(&mvInvertedFile[nWordId]);
+    if(pOldPosting)
+    {
+        mnPostingLists.fetch_sub(1, std::memory_order_relaxed);
+        mnPostings.fetch_sub(pOldPosting->vpKeyFrames.size(), std::memory_order_relaxed);
+    }
+    if(pPosting)
+    {
+        mnPostingLists.fetch_add(1, std::memory_order_relaxed);
+        mnPostings.fetch_add(pPosting->vpKeyFrames.size(), std::memory_order_relaxed);
+    }
+    atomic_store(&mvInvertedFile[nWordId], pPosting);
+}
 
-    // Search all keyframes that share a word with current keyframes
-    // Discard keyframes connected to the query keyframe
+size_t KeyFrameDatabase::GetMemoryBytes() const
+{
+    // A published list is a shared_ptr control block with the list, and one keyframe and one weight per posting
+    static const size_t kPostingListBytes = 64 + sizeof(PostingList);
+
+    return sizeof(KeyFrameDatabase) + mvInvertedFile.capacity()*sizeof(shared_ptr<const PostingList>) +
+           mnPostingLists.load(std::memory_order_relaxed)*kPostingListBytes +
+           mnPostings.load(std::memory_order_relaxed)*(sizeof(KeyFrame*) + sizeof(double)) +
+           mGlobalIndex.GetMemoryBytes();
+}
+
+void KeyFrameDatabase::SearchSharingWords(const DBoW2::FlatBowVector &vBowVec, SharingWords &sharing) const
+{
+    // Words are visited in increasing id order, as DBoW2 does, so the L1 sums match mpVoc->score exactly
+    for(size_t w=0, wend=vBowVec.size(); w<wend; w++)
     {
-        unique_lock<mutex> lock(mMutex);
+        shared_ptr<const PostingList> pPosting = atomic_load(&mvInvertedFile[vBowVec.words[w]]);
+        if(!pPosting)
+            continue;
 
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
+        const double vi = vBowVec.values[w];
+        const vector<KeyFrame*> &vpKFs = pPosting->vpKeyFrames;
+        const vector<double> &vWeights = pPosting->vWeights;
+        for(size_t j=0, jend=vpKFs.size(); j<jend; j++)
         {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+            pair<unordered_map<KeyFrame*,size_t>::iterator,bool> res = sharing.mIndex.insert(make_pair(vpKFs[j],sharing.vpKeyFrames.size()));
+            if(res.second)
             {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->GetMap()==pKF->GetMap()) // For consider a loop candidate it a candidate it must be in the same map
-                {
-                    if(pKFi->mnLoopQuery!=pKF->mnId)
-                    {
-                        pKFi->mnLoopWords=0;
-                        if(!spConnectedKeyFrames.count(pKFi))
-                        {
-                            pKFi->mnLoopQuery=pKF->mnId;
-                            lKFsSharingWords.push_back(pKFi);
-                        }
-                    }
-                    pKFi->mnLoopWords++;
-                }
+                sharing.vpKeyFrames.push_back(vpKFs[j]);
+                sharing.vnCommonWords.push_back(0);
+                sharing.vL1Sum.push_back(0.0);
+            }
 
+            const size_t idx = res.first->second;
+            const double wi = vWeights[j];
+            sharing.vnCommonWords[idx]++;
+            sharing.vL1Sum[idx] += fabs(vi - wi) - fabs(vi) - fabs(wi);
+        }
+    }
+}
 
+void KeyFrameDatabase::SearchSharingWords(const DBoW2::FlatBowVector &vBowVec, const vector<KeyFrame*> &vpKFs, const KeyFrame* pQueryKF,
+                                          SharingWords &sharing) const
+{
+    // Merge of the sorted word ids, the side behind gallops to the other. The sums are accumulated
+    // in the order of the inverted file walk
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKFi = vpKFs[i];
+        if(pKFi==pQueryKF)
+            continue;
+
+        int nCommonWords = 0;
+        double l1Sum = 0.0;
+        const DBoW2::FlatBowVector &wBowVec = pKFi->mFlatBowVec;
+        size_t vit=0, wit=0;
+        const size_t vend=vBowVec.size(), wend=wBowVec.size();
+        while(vit!=vend && wit!=wend)
+        {
+            if(vBowVec.words[vit]<wBowVec.words[wit])
+                vit = vBowVec.seek(vit,wBowVec.words[wit]);
+            else if(wBowVec.words[wit]<vBowVec.words[vit])
+                wit = wBowVec.seek(wit,vBowVec.words[vit]);
+            else
+            {
+                const double vi = vBowVec.values[vit];
+                const double wi = wBowVec.values[wit];
+                nCommonWords++;
+                l1Sum += fabs(vi - wi) - fabs(vi) - fabs(wi);
+                vit++;
+                wit++;
             }
         }
+
+        if(nCommonWords==0)
+            continue;
+
+        sharing.mIndex[pKFi] = sharing.vpKeyFrames.size();
+        sharing.vpKeyFrames.push_back(pKFi);
+        sharing.vnCommonWords.push_back(nCommonWords);
+        sharing.vL1Sum.push_back(l1Sum);
     }
+}
 
-    if(lKFsSharingWords.empty())
-        return vector<KeyFrame*>();
+bool KeyFrameDatabase::SearchGlobalCandidates(const cv::Mat &descriptors, vector<KeyFrame*> &vpKFs) const
+{
+    if(mnGlobalCandidates<=0 || mGlobalIndex.size()<mnGlobalMinKeyFrames)
+        return false;
 
-    list<pair<float,KeyFrame*> > lScoreAndMatch;
+    int8_t global[GlobalDescriptor::DIM];
+    if(!GlobalDescriptor::Compute(descriptors,global))
+        return false;
 
-    // Only compare against those keyframes that share enough words
+    mGlobalIndex.Search(global,mnGlobalCandidates,vpKFs);
+    return true;
+}
+
+float KeyFrameDatabase::Score(const DBoW2::BowVector &vBowVec, const SharingWords &sharing, const size_t idx) const
+{
+    if(mbL1Score)
+        return -sharing.vL1Sum[idx]/2.0;
+    else
+        return mpVoc->score(vBowVec,sharing.vpKeyFrames[idx]->mBowVec);
+}
+
+vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float minScore)
+{
+    set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
+
+    // Search all keyframes that share a word with current keyframes
+    SharingWords sharing;
+    SearchSharingWords(pKF->mFlatBowVec,sharing);
+
+    // Discard keyframes connected to the query keyframe
+    // For consider a loop candidate it a candidate it must be in the same map
+    const size_t N = sharing.vpKeyFrames.size();
+    vector<bool> vbCandidate(N,false);
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<N; i++)
     {
-        if((*lit)->mnLoopWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnLoopWords;
+        KeyFrame* pKFi = sharing.vpKeyFrames[i];
+        if(pKFi->GetMap()!=pKF->GetMap() || spConnectedKeyFrames.count(pKFi))
+            continue;
+
+        vbCandidate[i] = true;
+        if(sharing.vnCommonWords[i]>maxCommonWords)
+            maxCommonWords=sharing.vnCommonWords[i];
     }
 
-    int minCommonWords = maxCommonWords*0.8f;
+    if(maxCommonWords==0)
+        return vector<KeyFrame*>();
 
-    int nscores=0;
+    list<pair<float,KeyFrame*> > lScoreAndMatch;
+
+    // Only compare against those keyframes that share enough words
+    int minCommonWords = maxCommonWords*0.8f;
 
     // Compute similarity score. Retain the matches whose score is higher than minScore
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    vector<bool> vbScored(N,false);
+    vector<float> vScores(N,0.f);
+    for(size_t i=0; i<N; i++)
     {
-        KeyFrame* pKFi = *lit;
-
-        if(pKFi->mnLoopWords>minCommonWords)
+        if(vbCandidate[i] && sharing.vnCommonWords[i]>minCommonWords)
         {
-            nscores++;
-
-            float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
+            float si = Score(pKF->mBowVec,sharing,i);
 
-            pKFi->mLoopScore = si;
+            vbScored[i] = true;
+            vScores[i] = si;
             if(si>=minScore)
-                lScoreAndMatch.push_back(make_pair(si,pKFi));
+                lScoreAndMatch.push_back(make_pair(si,sharing.vpKeyFrames[i]));
         }
     }
 
@@ -185,13 +346,14 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnLoopQuery==pKF->mnId && pKF2->mnLoopWords>minCommonWords)
+            const int idx = sharing.find(pKF2);
+            if(idx>=0 && vbScored[idx])
             {
-                accScore+=pKF2->mLoopScore;
-                if(pKF2->mLoopScore>bestScore)
+                accScore+=vScores[idx];
+                if(vScores[idx]>bestScore)
                 {
                     pBestKF=pKF2;
-                    bestScore = pKF2->mLoopScore;
+                    bestScore = vScores[idx];
                 }
             }
         }
@@ -228,287 +390,149 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
 void KeyFrameDatabase::DetectCandidates(KeyFrame* pKF, float minScore,vector<KeyFrame*>& vpLoopCand, vector<KeyFrame*>& vpMergeCand)
 {
     set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-    list<KeyFrame*> lKFsSharingWordsLoop,lKFsSharingWordsMerge;
 
     // Search all keyframes that share a word with current keyframes
-    // Discard keyframes connected to the query keyframe
+    SharingWords sharing;
+    SearchSharingWords(pKF->mFlatBowVec,sharing);
+
+    // Discard keyframes connected to the query keyframe. Keyframes in the same map are loop candidates,
+    // keyframes in other (not bad) maps are merge candidates
+    const size_t N = sharing.vpKeyFrames.size();
+    vector<bool> vbLoop(N,false), vbMerge(N,false);
+    int maxCommonWordsLoop=0, maxCommonWordsMerge=0;
+    for(size_t i=0; i<N; i++)
     {
-        unique_lock<mutex> lock(mMutex);
+        KeyFrame* pKFi = sharing.vpKeyFrames[i];
+        if(spConnectedKeyFrames.count(pKFi))
+            continue;
 
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
+        if(pKFi->GetMap()==pKF->GetMap())
         {
-            list<KeyFrame*> &lKFs = mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->GetMap()==pKF->GetMap()) // For consider a loop candidate it a candidate it must be in the same map
-                {
-                    if(pKFi->mnLoopQuery!=pKF->mnId)
-                    {
-                        pKFi->mnLoopWords=0;
-                        if(!spConnectedKeyFrames.count(pKFi))
-                        {
-                            pKFi->mnLoopQuery=pKF->mnId;
-                            lKFsSharingWordsLoop.push_back(pKFi);
-                        }
-                    }
-                    pKFi->mnLoopWords++;
-                }
-                else if(!pKFi->GetMap()->IsBad())
-                {
-                    if(pKFi->mnMergeQuery!=pKF->mnId)
-                    {
-                        pKFi->mnMergeWords=0;
-                        if(!spConnectedKeyFrames.count(pKFi))
-                        {
-                            pKFi->mnMergeQuery=pKF->mnId;
-                            lKFsSharingWordsMerge.push_back(pKFi);
-                        }
-                    }
-                    pKFi->mnMergeWords++;
-                }
-            }
+            vbLoop[i] = true;
+            if(sharing.vnCommonWords[i]>maxCommonWordsLoop)
+                maxCommonWordsLoop=sharing.vnCommonWords[i];
+        }
+        else if(!pKFi->GetMap()->IsBad())
+        {
+            vbMerge[i] = true;
+            if(sharing.vnCommonWords[i]>maxCommonWordsMerge)
+                maxCommonWordsMerge=sharing.vnCommonWords[i];
         }
     }
 
-    if(lKFsSharingWordsLoop.empty() && lKFsSharingWordsMerge.empty())
+    if(maxCommonWordsLoop==0 && maxCommonWordsMerge==0)
         return;
 
-    if(!lKFsSharingWordsLoop.empty())
+    for(int nType=0; nType<2; nType++)
     {
+        const vector<bool> &vbCandidate = nType==0 ? vbLoop : vbMerge;
+        vector<KeyFrame*> &vpCand = nType==0 ? vpLoopCand : vpMergeCand;
+        const int maxCommonWords = nType==0 ? maxCommonWordsLoop : maxCommonWordsMerge;
+        if(maxCommonWords==0)
+            continue;
+
         list<pair<float,KeyFrame*> > lScoreAndMatch;
 
         // Only compare against those keyframes that share enough words
-        int maxCommonWords=0;
-        for(list<KeyFrame*>::iterator lit=lKFsSharingWordsLoop.begin(), lend= lKFsSharingWordsLoop.end(); lit!=lend; lit++)
-        {
-            if((*lit)->mnLoopWords>maxCommonWords)
-                maxCommonWords=(*lit)->mnLoopWords;
-        }
-
         int minCommonWords = maxCommonWords*0.8f;
 
-        int nscores=0;
-
         // Compute similarity score. Retain the matches whose score is higher than minScore
-        for(list<KeyFrame*>::iterator lit=lKFsSharingWordsLoop.begin(), lend= lKFsSharingWordsLoop.end(); lit!=lend; lit++)
+        vector<bool> vbScored(N,false);
+        vector<float> vScores(N,0.f);
+        for(size_t i=0; i<N; i++)
         {
-            KeyFrame* pKFi = *lit;
-
-            if(pKFi->mnLoopWords>minCommonWords)
+            if(vbCandidate[i] && sharing.vnCommonWords[i]>minCommonWords)
             {
-                nscores++;
-
-                float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
+                float si = Score(pKF->mBowVec,sharing,i);
 
-                pKFi->mLoopScore = si;
+                vbScored[i] = true;
+                vScores[i] = si;
                 if(si>=minScore)
-                    lScoreAndMatch.push_back(make_pair(si,pKFi));
+                    lScoreAndMatch.push_back(make_pair(si,sharing.vpKeyFrames[i]));
             }
         }
 
-        if(!lScoreAndMatch.empty())
-        {
-            list<pair<float,KeyFrame*> > lAccScoreAndMatch;
-            float bestAccScore = minScore;
-
-            // Lets now accumulate score by covisibility
-            for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-            {
-                KeyFrame* pKFi = it->second;
-                vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-                float bestScore = it->first;
-                float accScore = it->first;
-                KeyFrame* pBestKF = pKFi;
-                for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-                {
-                    KeyFrame* pKF2 = *vit;
-                    if(pKF2->mnLoopQuery==pKF->mnId && pKF2->mnLoopWords>minCommonWords)
-                    {
-                        accScore+=pKF2->mLoopScore;
-                        if(pKF2->mLoopScore>bestScore)
-                        {
-                            pBestKF=pKF2;
-                            bestScore = pKF2->mLoopScore;
-                        }
-                    }
-                }
-
-                lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-                if(accScore>bestAccScore)
-                    bestAccScore=accScore;
-            }
+        if(lScoreAndMatch.empty())
+            continue;
 
-            // Return all those keyframes with a score higher than 0.75*bestScore
-            float minScoreToRetain = 0.75f*bestAccScore;
+        list<pair<float,KeyFrame*> > lAccScoreAndMatch;
+        float bestAccScore = minScore;
 
-            set<KeyFrame*> spAlreadyAddedKF;
-            vpLoopCand.reserve(lAccScoreAndMatch.size());
+        // Lets now accumulate score by covisibility
+        for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
+        {
+            KeyFrame* pKFi = it->second;
+            vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
 
-            for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+            float bestScore = it->first;
+            float accScore = it->first;
+            KeyFrame* pBestKF = pKFi;
+            for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
             {
-                if(it->first>minScoreToRetain)
+                KeyFrame* pKF2 = *vit;
+                const int idx = sharing.find(pKF2);
+                if(idx>=0 && vbScored[idx])
                 {
-                    KeyFrame* pKFi = it->second;
-                    if(!spAlreadyAddedKF.count(pKFi))
+                    accScore+=vScores[idx];
+                    if(vScores[idx]>bestScore)
                     {
-                        vpLoopCand.push_back(pKFi);
-                        spAlreadyAddedKF.insert(pKFi);
+                        pBestKF=pKF2;
+                        bestScore = vScores[idx];
                     }
                 }
             }
-        }
 
-    }
-
-    if(!lKFsSharingWordsMerge.empty())
-    {
-        list<pair<float,KeyFrame*> > lScoreAndMatch;
-
-        // Only compare against those keyframes that share enough words
-        int maxCommonWords=0;
-        for(list<KeyFrame*>::iterator lit=lKFsSharingWordsMerge.begin(), lend=lKFsSharingWordsMerge.end(); lit!=lend; lit++)
-        {
-            if((*lit)->mnMergeWords>maxCommonWords)
-                maxCommonWords=(*lit)->mnMergeWords;
+            lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
+            if(accScore>bestAccScore)
+                bestAccScore=accScore;
         }
 
-        int minCommonWords = maxCommonWords*0.8f;
+        // Return all those keyframes with a score higher than 0.75*bestScore
+        float minScoreToRetain = 0.75f*bestAccScore;
 
-        int nscores=0;
+        set<KeyFrame*> spAlreadyAddedKF;
+        vpCand.reserve(lAccScoreAndMatch.size());
 
-        // Compute similarity score. Retain the matches whose score is higher than minScore
-        for(list<KeyFrame*>::iterator lit=lKFsSharingWordsMerge.begin(), lend=lKFsSharingWordsMerge.end(); lit!=lend; lit++)
+        for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
         {
-            KeyFrame* pKFi = *lit;
-
-            if(pKFi->mnMergeWords>minCommonWords)
-            {
-                nscores++;
-
-                float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
-
-                pKFi->mMergeScore = si;
-                if(si>=minScore)
-                    lScoreAndMatch.push_back(make_pair(si,pKFi));
-            }
-        }
-
-        if(!lScoreAndMatch.empty())
-        {
-            list<pair<float,KeyFrame*> > lAccScoreAndMatch;
-            float bestAccScore = minScore;
-
-            // Lets now accumulate score by covisibility
-            for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
+            if(it->first>minScoreToRetain)
             {
                 KeyFrame* pKFi = it->second;
-                vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-                float bestScore = it->first;
-                float accScore = it->first;
-                KeyFrame* pBestKF = pKFi;
-                for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-                {
-                    KeyFrame* pKF2 = *vit;
-                    if(pKF2->mnMergeQuery==pKF->mnId && pKF2->mnMergeWords>minCommonWords)
-                    {
-                        accScore+=pKF2->mMergeScore;
-                        if(pKF2->mMergeScore>bestScore)
-                        {
-                            pBestKF=pKF2;
-                            bestScore = pKF2->mMergeScore;
-                        }
-                    }
-                }
-
-                lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-                if(accScore>bestAccScore)
-                    bestAccScore=accScore;
-            }
-
-            // Return all those keyframes with a score higher than 0.75*bestScore
-            float minScoreToRetain = 0.75f*bestAccScore;
-
-            set<KeyFrame*> spAlreadyAddedKF;
-            vpMergeCand.reserve(lAccScoreAndMatch.size());
-
-            for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
-            {
-                if(it->first>minScoreToRetain)
+                if(!spAlreadyAddedKF.count(pKFi))
                 {
-                    KeyFrame* pKFi = it->second;
-                    if(!spAlreadyAddedKF.count(pKFi))
-                    {
-                        vpMergeCand.push_back(pKFi);
-                        spAlreadyAddedKF.insert(pKFi);
-                    }
+                    vpCand.push_back(pKFi);
+                    spAlreadyAddedKF.insert(pKFi);
                 }
             }
         }
-
-    }
-
-    for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-    {
-        list<KeyFrame*> &lKFs = mvInvertedFile[vit->first];
-
-        for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-        {
-            KeyFrame* pKFi=*lit;
-            pKFi->mnLoopQuery=-1;
-            pKFi->mnMergeQuery=-1;
-        }
     }
-
 }
 
 void KeyFrameDatabase::DetectBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &vpLoopCand, vector<KeyFrame*> &vpMergeCand, int nMinWords)
 {
-    list<KeyFrame*> lKFsSharingWords;
-    set<KeyFrame*> spConnectedKF;
+    set<KeyFrame*> spConnectedKF = pKF->GetConnectedKeyFrames();
 
     // Search all keyframes that share a word with current frame
-    {
-        unique_lock<mutex> lock(mMutex);
-
-        spConnectedKF = pKF->GetConnectedKeyFrames();
-
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-                if(spConnectedKF.find(pKFi) != spConnectedKF.end())
-                {
-                    continue;
-                }
-                if(pKFi->mnPlaceRecognitionQuery!=pKF->mnId)
-                {
-                    pKFi->mnPlaceRecognitionWords=0;
-                    pKFi->mnPlaceRecognitionQuery=pKF->mnId;
-                    lKFsSharingWords.push_back(pKFi);
-                }
-               pKFi->mnPlaceRecognitionWords++;
-
-            }
-        }
-    }
-    if(lKFsSharingWords.empty())
-        return;
+    SharingWords sharing;
+    SearchSharingWords(pKF->mFlatBowVec,sharing);
 
     // Only compare against those keyframes that share enough words
+    const size_t N = sharing.vpKeyFrames.size();
+    vector<bool> vbCandidate(N,false);
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<N; i++)
     {
-        if((*lit)->mnPlaceRecognitionWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnPlaceRecognitionWords;
+        if(spConnectedKF.count(sharing.vpKeyFrames[i]))
+            continue;
+
+        vbCandidate[i] = true;
+        if(sharing.vnCommonWords[i]>maxCommonWords)
+            maxCommonWords=sharing.vnCommonWords[i];
     }
 
+    if(maxCommonWords==0)
+        return;
+
     int minCommonWords = maxCommonWords*0.8f;
 
     if(minCommonWords < nMinWords)
@@ -518,19 +542,17 @@ void KeyFrameDatabase::DetectBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &vp
 
     list<pair<float,KeyFrame*> > lScoreAndMatch;
 
-    int nscores=0;
-
     // Compute similarity score.
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    vector<bool> vbScored(N,false);
+    vector<float> vScores(N,0.f);
+    for(size_t i=0; i<N; i++)
     {
-        KeyFrame* pKFi = *lit;
-
-        if(pKFi->mnPlaceRecognitionWords>minCommonWords)
+        if(vbCandidate[i] && sharing.vnCommonWords[i]>minCommonWords)
         {
-            nscores++;
-            float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
-            pKFi->mPlaceRecognitionScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            float si = Score(pKF->mBowVec,sharing,i);
+            vbScored[i] = true;
+            vScores[i] = si;
+            lScoreAndMatch.push_back(make_pair(si,sharing.vpKeyFrames[i]));
         }
     }
 
@@ -552,14 +574,15 @@ void KeyFrameDatabase::DetectBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &vp
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnPlaceRecognitionQuery!=pKF->mnId)
+            const int idx = sharing.find(pKF2);
+            if(idx<0 || !vbScored[idx])
                 continue;
 
-            accScore+=pKF2->mPlaceRecognitionScore;
-            if(pKF2->mPlaceRecognitionScore>bestScore)
+            accScore+=vScores[idx];
+            if(vScores[idx]>bestScore)
             {
                 pBestKF=pKF2;
-                bestScore = pKF2->mPlaceRecognitionScore;
+                bestScore = vScores[idx];
             }
 
         }
@@ -603,65 +626,49 @@ bool compFirst(const pair<float, KeyFrame*> & a, const pair<float, KeyFrame*> &
 
 void KeyFrameDatabase::DetectNBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &vpLoopCand, vector<KeyFrame*> &vpMergeCand, int nNumCandidates)
 {
-    list<KeyFrame*> lKFsSharingWords;
-    set<KeyFrame*> spConnectedKF;
-
-    // Search all keyframes that share a word with current frame
-    {
-        unique_lock<mutex> lock(mMutex);
+    set<KeyFrame*> spConnectedKF = pKF->GetConnectedKeyFrames();
 
-        spConnectedKF = pKF->GetConnectedKeyFrames();
-
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-
-                if(pKFi->mnPlaceRecognitionQuery!=pKF->mnId)
-                {
-                    pKFi->mnPlaceRecognitionWords=0;
-                    if(!spConnectedKF.count(pKFi))
-                    {
-
-                        pKFi->mnPlaceRecognitionQuery=pKF->mnId;
-                        lKFsSharingWords.push_back(pKFi);
-                    }
-                }
-                pKFi->mnPlaceRecognitionWords++;
-            }
-        }
-    }
-    if(lKFsSharingWords.empty())
-        return;
+    // Search all keyframes that share a word with current frame, or only those with similar
+    // global descriptors in large maps
+    SharingWords sharing;
+    vector<KeyFrame*> vpGlobalCandidates;
+    if(SearchGlobalCandidates(pKF->mDescriptors,vpGlobalCandidates))
+        SearchSharingWords(pKF->mFlatBowVec,vpGlobalCandidates,pKF,sharing);
+    else
+        SearchSharingWords(pKF->mFlatBowVec,sharing);
 
     // Only compare against those keyframes that share enough words
+    const size_t N = sharing.vpKeyFrames.size();
+    vector<bool> vbCandidate(N,false);
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<N; i++)
     {
-        if((*lit)->mnPlaceRecognitionWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnPlaceRecognitionWords;
+        if(spConnectedKF.count(sharing.vpKeyFrames[i]))
+            continue;
+
+        vbCandidate[i] = true;
+        if(sharing.vnCommonWords[i]>maxCommonWords)
+            maxCommonWords=sharing.vnCommonWords[i];
     }
 
+    if(maxCommonWords==0)
+        return;
+
     int minCommonWords = maxCommonWords*0.8f;
 
     list<pair<float,KeyFrame*> > lScoreAndMatch;
 
-    int nscores=0;
-
     // Compute similarity score.
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    vector<bool> vbScored(N,false);
+    vector<float> vScores(N,0.f);
+    for(size_t i=0; i<N; i++)
     {
-        KeyFrame* pKFi = *lit;
-
-        if(pKFi->mnPlaceRecognitionWords>minCommonWords)
+        if(vbCandidate[i] && sharing.vnCommonWords[i]>minCommonWords)
         {
-            nscores++;
-            float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
-            pKFi->mPlaceRecognitionScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            float si = Score(pKF->mBowVec,sharing,i);
+            vbScored[i] = true;
+            vScores[i] = si;
+            lScoreAndMatch.push_back(make_pair(si,sharing.vpKeyFrames[i]));
         }
     }
 
@@ -683,14 +690,15 @@ void KeyFrameDatabase::DetectNBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &v
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnPlaceRecognitionQuery!=pKF->mnId)
+            const int idx = sharing.find(pKF2);
+            if(idx<0 || !vbScored[idx])
                 continue;
 
-            accScore+=pKF2->mPlaceRecognitionScore;
-            if(pKF2->mPlaceRecognitionScore>bestScore)
+            accScore+=vScores[idx];
+            if(vScores[idx]>bestScore)
             {
                 pBestKF=pKF2;
-                bestScore = pKF2->mPlaceRecognitionScore;
+                bestScore = vScores[idx];
             }
 
         }
@@ -704,9 +712,8 @@ void KeyFrameDatabase::DetectNBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &v
     vpLoopCand.reserve(nNumCandidates);
     vpMergeCand.reserve(nNumCandidates);
     set<KeyFrame*> spAlreadyAddedKF;
-    int i = 0;
-    list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin();
-    while(i < lAccScoreAndMatch.size() && (vpLoopCand.size() < nNumCandidates || vpMergeCand.size() < nNumCandidates))
+    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end();
+        it!=itend && (vpLoopCand.size() < nNumCandidates || vpMergeCand.size() < nNumCandidates); it++)
     {
         KeyFrame* pKFi = it->second;
         if(pKFi->isBad())
@@ -724,74 +731,60 @@ void KeyFrameDatabase::DetectNBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &v
             }
             spAlreadyAddedKF.insert(pKFi);
         }
-        i++;
-        it++;
     }
 }
 
 
-vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map* pMap)
+void KeyFrameDatabase::ScoreRelocalizationCandidates(Frame *F, const SearchRegion* pRegion,
+                                                     list<pair<float,KeyFrame*> > &lAccScoreAndMatch)
 {
-    list<KeyFrame*> lKFsSharingWords;
+    // Search all keyframes that share a word with current frame, or only those with similar
+    // global descriptors in large maps
+    SharingWords sharing;
+    vector<KeyFrame*> vpGlobalCandidates;
+    if(SearchGlobalCandidates(F->mDescriptors,vpGlobalCandidates))
+        SearchSharingWords(F->mFlatBowVec,vpGlobalCandidates,NULL,sharing);
+    else
+        SearchSharingWords(F->mFlatBowVec,sharing);
+
+    const size_t N = sharing.vpKeyFrames.size();
+    if(N==0)
+        return;
 
-    // Search all keyframes that share a word with current frame
+    // Keyframes the camera can be at, all without a region
+    vector<bool> vbInRegion(N,true);
+    if(pRegion)
     {
-        unique_lock<mutex> lock(mMutex);
-
-        for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
-        {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnRelocQuery!=F->mnId)
-                {
-                    pKFi->mnRelocWords=0;
-                    pKFi->mnRelocQuery=F->mnId;
-                    lKFsSharingWords.push_back(pKFi);
-                }
-                pKFi->mnRelocWords++;
-            }
-        }
+        for(size_t i=0; i<N; i++)
+            vbInRegion[i] = pRegion->Contains(sharing.vpKeyFrames[i]->GetCameraCenter());
     }
-    if(lKFsSharingWords.empty())
-        return vector<KeyFrame*>();
 
     // Only compare against those keyframes that share enough words
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<N; i++)
     {
-        if((*lit)->mnRelocWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnRelocWords;
+        if(vbInRegion[i] && sharing.vnCommonWords[i]>maxCommonWords)
+            maxCommonWords=sharing.vnCommonWords[i];
     }
 
     int minCommonWords = maxCommonWords*0.8f;
 
     list<pair<float,KeyFrame*> > lScoreAndMatch;
 
-    int nscores=0;
-
     // Compute similarity score.
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    vector<bool> vbScored(N,false);
+    vector<float> vScores(N,0.f);
+    for(size_t i=0; i<N; i++)
     {
-        KeyFrame* pKFi = *lit;
-
-        if(pKFi->mnRelocWords>minCommonWords)
+        if(vbInRegion[i] && sharing.vnCommonWords[i]>minCommonWords)
         {
-            nscores++;
-            float si = mpVoc->score(F->mBowVec,pKFi->mBowVec);
-            pKFi->mRelocScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            float si = Score(F->mBowVec,sharing,i);
+            vbScored[i] = true;
+            vScores[i] = si;
+            lScoreAndMatch.push_back(make_pair(si,sharing.vpKeyFrames[i]));
         }
     }
 
-    if(lScoreAndMatch.empty())
-        return vector<KeyFrame*>();
-
-    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
-    float bestAccScore = 0;
-
     // Lets now accumulate score by covisibility
     for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
     {
@@ -804,21 +797,32 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnRelocQuery!=F->mnId)
+            const int idx = sharing.find(pKF2);
+            if(idx<0 || !vbScored[idx])
                 continue;
 
-            accScore+=pKF2->mRelocScore;
-            if(pKF2->mRelocScore>bestScore)
+            accScore+=vScores[idx];
+            if(vScores[idx]>bestScore)
             {
                 pBestKF=pKF2;
-                bestScore = pKF2->mRelocScore;
+                bestScore = vScores[idx];
             }
 
         }
         lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-        if(accScore>bestAccScore)
-            bestAccScore=accScore;
     }
+}
+
+vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map* pMap, const SearchRegion* pRegion)
+{
+    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
+    ScoreRelocalizationCandidates(F,pRegion,lAccScoreAndMatch);
+    if(lAccScoreAndMatch.empty())
+        return vector<KeyFrame*>();
+
+    float bestAccScore = 0;
+    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+        bestAccScore = max(bestAccScore,it->first);
 
     // Return all those keyframes with a score higher than 0.75*bestScore
     float minScoreToRetain = 0.75f*bestAccScore;
@@ -844,14 +848,74 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map
     return vpRelocCandidates;
 }
 
+vector<KeyFrameDatabase::MapCandidates> KeyFrameDatabase::DetectRelocalizationCandidatesByMap(Frame *F, size_t nMaxCandidates)
+{
+    // One query over the inverted file covers the keyframes of every map
+    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
+    ScoreRelocalizationCandidates(F,NULL,lAccScoreAndMatch);
+
+    // Best accumulated score of each map
+    map<Map*,float> mBestAccScore;
+    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    {
+        Map* pMapi = it->second->GetMap();
+        if(!pMapi || pMapi->IsBad())
+            continue;
+        float &best = mBestAccScore[pMapi];
+        best = max(best,it->first);
+    }
+
+    // Keyframes with a score higher than 0.75 of the best of their map, best first
+    lAccScoreAndMatch.sort([](const pair<float,KeyFrame*> &a, const pair<float,KeyFrame*> &b) { return a.first>b.first; });
+    map<Map*,size_t> mMapIdx;
+    vector<MapCandidates> vMapCandidates;
+    set<KeyFrame*> spAlreadyAddedKF;
+    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    {
+        KeyFrame* pKFi = it->second;
+        map<Map*,float>::const_iterator best = mBestAccScore.find(pKFi->GetMap());
+        if(best==mBestAccScore.end() || it->first<=0.75f*best->second)
+            continue;
+        if(!spAlreadyAddedKF.insert(pKFi).second)
+            continue;
+
+        pair<map<Map*,size_t>::iterator,bool> res = mMapIdx.insert(make_pair(best->first,vMapCandidates.size()));
+        if(res.second)
+        {
+            MapCandidates candidates;
+            candidates.pMap = best->first;
+            candidates.score = best->second;
+            vMapCandidates.push_back(candidates);
+        }
+        vector<KeyFrame*> &vpKFs = vMapCandidates[res.first->second].vpKeyFrames;
+        if(vpKFs.size()<nMaxCandidates)
+            vpKFs.push_back(pKFi);
+    }
+
+    // The list is visited best score first, so the maps are ranked already
+    return vMapCandidates;
+}
+
 void KeyFrameDatabase::SetORBVocabulary(ORBVocabulary* pORBVoc)
 {
     ORBVocabulary** ptr;
     ptr = (ORBVocabulary**)( &mpVoc );
     *ptr = pORBVoc;
+    mbL1Score = mpVoc->getScoringType()==DBoW2::L1_NORM;
 
     mvInvertedFile.clear();
     mvInvertedFile.resize(mpVoc->size());
+    mnPostingLists = 0;
+    mnPostings = 0;
+    mGlobalIndex.clear();
+}
+
+void KeyFrameDatabase::SetGlobalPrefilter(int nCandidates, int nMinKeyFrames)
+{
+    unique_lock<mutex> lock(mMutex);
+
+    mnGlobalCandidates = max(nCandidates, 0);
+    mnGlobalMinKeyFrames = (size_t)max(nMinKeyFrames, 0);
 }
 
 } //namespace ORB_SLAM
@@ -23,6 +23,7 @@
 #include "Optimizer.h"
 #include "Converter.h"
 #include "GeometricTools.h"
+#include "Trace.h"
 
 #include<mutex>
 #include<chrono>
@@ -32,7 +33,8 @@ namespace ORB_SLAM3
 
 LocalMapping::LocalMapping(System* pSys, Atlas *pAtlas, const float bMonocular, bool bInertial, const string &_strSeqName):
     mpSystem(pSys), mbMonocular(bMonocular), mbInertial(bInertial), mbResetRequested(false), mbResetRequestedActiveMap(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas), bInitializing(false),
-    mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
+    mbAbortBA(false), mnKeyFrameBatch(1), mbRealTime(true), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true), mnMaxLocalBAKeyFrames(0), mnLocalBAThreads(1), mfLocalBATimeBudget(0.f), mfLocalBAGainThreshold(0.f), mfKeyFrameCostMs(0.f), mfLocalBAMs(0.f), mnMapVersion(0),
+    mbBackgroundInertialBA(false), mpThreadFIBA(NULL), mbStopFIBA(false), mbFinishedFIBA(true), mnFIBAid(0), mpFIBAMap(NULL),
     mIdxInit(0), mScale(1.0), mInitSect(0), mbNotBA1(true), mbNotBA2(true), mIdxIteration(0), infoInertial(Eigen::MatrixXd::Zero(9,9))
 {
     mnMatchesInliers = 0;
@@ -64,23 +66,39 @@ void LocalMapping::SetTracker(Tracking *pTracker)
 void LocalMapping::Run()
 {
     mbFinished = false;
+    TRACE_THREAD_NAME("LocalMapping");
 
     while(1)
     {
         // Tracking will see that Local Mapping is busy
         SetAcceptKeyFrames(false);
 
+        // Correct the map with the full inertial BA of the IMU initialization once it ends
+        MergeFullInertialBA();
+
         // Check if there are keyframes in the queue
         if(CheckNewKeyFrames() && !mbBadImu)
         {
+            TRACE_SCOPE("LocalMapping");
 #ifdef REGISTER_TIMES
             double timeLBA_ms = 0;
             double timeKFCulling_ms = 0;
 
             std::chrono::steady_clock::time_point time_StartProcessKF = std::chrono::steady_clock::now();
 #endif
-            // BoW conversion and insertion in Map
-            ProcessNewKeyFrame();
+            const std::chrono::steady_clock::time_point tStartIteration = std::chrono::steady_clock::now();
+            double tLocalBA = -1.0;
+            IncreaseMapVersion();
+
+            // BoW conversion and insertion in Map, of the keyframes queued up to the batch size
+            const int nBatchKFs = min(KeyframesInQueue(), GetKeyFrameBatchSize());
+            vector<KeyFrame*> vpBatchKFs;
+            vpBatchKFs.reserve(nBatchKFs);
+            for(int i=0; i<nBatchKFs; i++)
+            {
+                ProcessNewKeyFrame();
+                vpBatchKFs.push_back(mpCurrentKeyFrame);
+            }
 #ifdef REGISTER_TIMES
             std::chrono::steady_clock::time_point time_EndProcessKF = std::chrono::steady_clock::now();
 
@@ -97,16 +115,26 @@ void LocalMapping::Run()
             vdMPCulling_ms.push_back(timeMPCulling);
 #endif
 
-            // Triangulate new MapPoints
-            CreateNewMapPoints();
+            // Triangulate new MapPoints, the newest keyframe of the batch stays the current one
+            for(KeyFrame* pKFi : vpBatchKFs)
+            {
+                mpCurrentKeyFrame = pKFi;
+                CreateNewMapPoints();
+            }
 
             mbAbortBA = false;
 
-            if(!CheckNewKeyFrames())
+            if(!CheckKeyFrameBatch())
             {
-                // Find more matches in neighbor keyframes and fuse point duplications
-                SearchInNeighbors();
+                // Find more matches in neighbor keyframes and fuse point duplications, once the
+                // points of the whole batch exist
+                for(KeyFrame* pKFi : vpBatchKFs)
+                {
+                    mpCurrentKeyFrame = pKFi;
+                    SearchInNeighbors();
+                }
             }
+            mpCurrentKeyFrame = vpBatchKFs.back();
 
 #ifdef REGISTER_TIMES
             std::chrono::steady_clock::time_point time_EndMPCreation = std::chrono::steady_clock::now();
@@ -121,18 +149,26 @@ void LocalMapping::Run()
             int num_MPs_BA = 0;
             int num_edges_BA = 0;
 
-            if(!CheckNewKeyFrames() && !stopRequested())
+            if(!CheckKeyFrameBatch() && !stopRequested())
             {
+                const std::chrono::steady_clock::time_point tStartBA = std::chrono::steady_clock::now();
                 if(mpAtlas->KeyFramesInMap()>2)
                 {
+                    float fTimeBudgetBA, fGainThresholdBA;
+                    GetLocalBATermination(fTimeBudgetBA, fGainThresholdBA);
 
                     if(mbInertial && mpCurrentKeyFrame->GetMap()->isImuInitialized())
                     {
-                        float dist = (mpCurrentKeyFrame->mPrevKF->GetCameraCenter() - mpCurrentKeyFrame->GetCameraCenter()).norm() +
-                                (mpCurrentKeyFrame->mPrevKF->mPrevKF->GetCameraCenter() - mpCurrentKeyFrame->mPrevKF->GetCameraCenter()).norm();
+                        // Time in motion, over every keyframe of the batch
+                        float dist = 0.f;
+                        for(KeyFrame* pKFi : vpBatchKFs)
+                        {
+                            dist = (pKFi->mPrevKF->GetCameraCenter() - pKFi->GetCameraCenter()).norm() +
+                                    (pKFi->mPrevKF->mPrevKF->GetCameraCenter() - pKFi->mPrevKF->GetCameraCenter()).norm();
 
-                        if(dist>0.05)
-                            mTinit += mpCurrentKeyFrame->mTimeStamp - mpCurrentKeyFrame->mPrevKF->mTimeStamp;
+                            if(dist>0.05)
+                                mTinit += pKFi->mTimeStamp - pKFi->mPrevKF->mTimeStamp;
+                        }
                         if(!mpCurrentKeyFrame->GetMap()->GetIniertialBA2())
                         {
                             if((mTinit<10.f) && (dist<0.02))
@@ -146,15 +182,16 @@ void LocalMapping::Run()
                         }
 
                         bool bLarge = ((mpTracker->GetMatchesInliers()>75)&&mbMonocular)||((mpTracker->GetMatchesInliers()>100)&&!mbMonocular);
-                        Optimizer::LocalInertialBA(mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA, bLarge, !mpCurrentKeyFrame->GetMap()->GetIniertialBA2());
+                        Optimizer::LocalInertialBA(mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA, bLarge, !mpCurrentKeyFrame->GetMap()->GetIniertialBA2(), GetLocalBAThreads(), fTimeBudgetBA, fGainThresholdBA);
                         b_doneLBA = true;
                     }
                     else
                     {
-                        Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA);
+                        Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA,GetMaxLocalBAKeyFrames(),GetLocalBAThreads(),fTimeBudgetBA,fGainThresholdBA);
                         b_doneLBA = true;
                     }
 
+                    tLocalBA = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(std::chrono::steady_clock::now() - tStartBA).count();
                 }
 #ifdef REGISTER_TIMES
                 std::chrono::steady_clock::time_point time_EndLBA = std::chrono::steady_clock::now();
@@ -227,8 +264,8 @@ void LocalMapping::Run()
                             }
                         }
 
-                        // scale refinement
-                        if (((mpAtlas->KeyFramesInMap())<=200) &&
+                        // scale refinement, not while a loop correction computed on the current world frame is pending
+                        if (((mpAtlas->KeyFramesInMap())<=200) && !mpLoopCloser->isCorrectingLoop() &&
                                 ((mTinit>25.0f && mTinit<25.5f)||
                                 (mTinit>35.0f && mTinit<35.5f)||
                                 (mTinit>45.0f && mTinit<45.5f)||
@@ -247,7 +284,18 @@ void LocalMapping::Run()
             vdKFCullingSync_ms.push_back(timeKFCulling_ms);
 #endif
 
-            mpLoopCloser->InsertKeyFrame(mpCurrentKeyFrame);
+            IncreaseMapVersion();
+
+            // Safe point, culling is done and no local optimization holds map points
+            ReclaimMapPoints();
+            ReleaseKeyFrameScratch(vpBatchKFs);
+            mpAtlas->EnforceMemoryBudget(mpCurrentKeyFrame);
+
+            for(KeyFrame* pKFi : vpBatchKFs)
+                mpLoopCloser->InsertKeyFrame(pKFi);
+
+            const double tIteration = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(std::chrono::steady_clock::now() - tStartIteration).count();
+            UpdateMappingCost(tIteration/vpBatchKFs.size(), tLocalBA);
 
 #ifdef REGISTER_TIMES
             std::chrono::steady_clock::time_point time_EndLocalMap = std::chrono::steady_clock::now();
@@ -278,30 +326,71 @@ void LocalMapping::Run()
         usleep(3000);
     }
 
+    StopFullInertialBA();
     SetFinish();
 }
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
     mlNewKeyFrames.push_back(pKF);
-    mbAbortBA=true;
+    // Smaller queues wait for the BA, the next iteration takes them together
+    if(mbRealTime && (int)mlNewKeyFrames.size()>=mnKeyFrameBatch)
+        mbAbortBA=true;
 }
 
 
 bool LocalMapping::CheckNewKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
     return(!mlNewKeyFrames.empty());
 }
 
+bool LocalMapping::CheckKeyFrameBatch()
+{
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
+    return (int)mlNewKeyFrames.size()>=mnKeyFrameBatch;
+}
+
+void LocalMapping::SetKeyFrameBatchSize(int n)
+{
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
+    mnKeyFrameBatch = std::max(n, 1);
+}
+
+int LocalMapping::GetKeyFrameBatchSize()
+{
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
+    return mnKeyFrameBatch;
+}
+
+bool LocalMapping::IsBacklogged()
+{
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
+    return (int)mlNewKeyFrames.size()>=std::max(mnKeyFrameBatch, 3);
+}
+
+void LocalMapping::SetRealTime(bool bRealTime)
+{
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
+    mbRealTime = bRealTime;
+}
+
+bool LocalMapping::IsRealTime()
+{
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
+    return mbRealTime;
+}
+
 void LocalMapping::ProcessNewKeyFrame()
 {
+    TRACE_SCOPE("ProcessNewKeyFrame");
     {
-        unique_lock<mutex> lock(mMutexNewKFs);
+        unique_lock<ProfiledMutex> lock(mMutexNewKFs);
         mpCurrentKeyFrame = mlNewKeyFrames.front();
         mlNewKeyFrames.pop_front();
     }
+    TRACE_FLOW_END(mpCurrentKeyFrame->mTimeStamp);
 
     // Compute Bags of Words structures
     mpCurrentKeyFrame->ComputeBoW();
@@ -345,6 +434,7 @@ void LocalMapping::EmptyQueue()
 
 void LocalMapping::MapPointCulling()
 {
+    TRACE_SCOPE("MapPointCulling");
     // Check Recent Added MapPoints
     list<MapPoint*>::iterator lit = mlpRecentAddedMapPoints.begin();
     const unsigned long int nCurrentKFid = mpCurrentKeyFrame->mnId;
@@ -356,37 +446,46 @@ void LocalMapping::MapPointCulling()
         nThObs = 3;
     const int cnThObs = nThObs;
 
-    int borrar = mlpRecentAddedMapPoints.size();
-
-    while(lit!=mlpRecentAddedMapPoints.end())
+    // Decide on each MapPoint in batches, a decision does not depend on the culling of the
+    // others. Only setting the bad flags changes the map.
+    enum {KEEP, FORGET, CULL};
+    const vector<MapPoint*> vpRecentMPs(mlpRecentAddedMapPoints.begin(), mlpRecentAddedMapPoints.end());
+    const int nRecentMPs = vpRecentMPs.size();
+    const int nBatch = 256;
+    vector<char> vDecisions(nRecentMPs,KEEP);
+    RunParallel((nRecentMPs+nBatch-1)/nBatch, [&vpRecentMPs, &vDecisions, nRecentMPs, nBatch, nCurrentKFid, cnThObs](int t)
     {
-        MapPoint* pMP = *lit;
-
-        if(pMP->isBad())
-            lit = mlpRecentAddedMapPoints.erase(lit);
-        else if(pMP->GetFoundRatio()<0.25f)
-        {
-            pMP->SetBadFlag();
-            lit = mlpRecentAddedMapPoints.erase(lit);
-        }
-        else if(((int)nCurrentKFid-(int)pMP->mnFirstKFid)>=2 && pMP->Observations()<=cnThObs)
+        for(int i=t*nBatch, iend=min(nRecentMPs,(t+1)*nBatch); i<iend; i++)
         {
-            pMP->SetBadFlag();
-            lit = mlpRecentAddedMapPoints.erase(lit);
+            MapPoint* pMP = vpRecentMPs[i];
+
+            if(pMP->isBad())
+                vDecisions[i] = FORGET;
+            else if(pMP->GetFoundRatio()<0.25f)
+                vDecisions[i] = CULL;
+            else if(((int)nCurrentKFid-(int)pMP->mnFirstKFid)>=2 && pMP->Observations()<=cnThObs)
+                vDecisions[i] = CULL;
+            else if(((int)nCurrentKFid-(int)pMP->mnFirstKFid)>=3)
+                vDecisions[i] = FORGET;
         }
-        else if(((int)nCurrentKFid-(int)pMP->mnFirstKFid)>=3)
-            lit = mlpRecentAddedMapPoints.erase(lit);
-        else
-        {
+    });
+
+    for(int i=0; i<nRecentMPs; i++)
+    {
+        if(vDecisions[i]==CULL)
+            (*lit)->SetBadFlag();
+
+        if(vDecisions[i]==KEEP)
             lit++;
-            borrar--;
-        }
+        else
+            lit = mlpRecentAddedMapPoints.erase(lit);
     }
 }
 
 
 void LocalMapping::CreateNewMapPoints()
 {
+    TRACE_SCOPE("CreateNewMapPoints");
     // Retrieve neighbor keyframes in covisibility graph
     int nn = 10;
     // For stereo inertial case
@@ -407,312 +506,324 @@ void LocalMapping::CreateNewMapPoints()
         }
     }
 
-    float th = 0.6f;
+    bool bCoarse = mbInertial && mpTracker->mState==Tracking::RECENTLY_LOST && mpCurrentKeyFrame->GetMap()->GetIniertialBA2();
 
-    ORBmatcher matcher(th,false);
-
-    Sophus::SE3<float> sophTcw1 = mpCurrentKeyFrame->GetPose();
-    Eigen::Matrix<float,3,4> eigTcw1 = sophTcw1.matrix3x4();
-    Eigen::Matrix<float,3,3> Rcw1 = eigTcw1.block<3,3>(0,0);
-    Eigen::Matrix<float,3,3> Rwc1 = Rcw1.transpose();
-    Eigen::Vector3f tcw1 = sophTcw1.translation();
-    Eigen::Vector3f Ow1 = mpCurrentKeyFrame->GetCameraCenter();
-
-    const float &fx1 = mpCurrentKeyFrame->fx;
-    const float &fy1 = mpCurrentKeyFrame->fy;
-    const float &cx1 = mpCurrentKeyFrame->cx;
-    const float &cy1 = mpCurrentKeyFrame->cy;
-    const float &invfx1 = mpCurrentKeyFrame->invfx;
-    const float &invfy1 = mpCurrentKeyFrame->invfy;
+    // Search matches with epipolar restriction and triangulate, independently for each neighbor
+    vector<vector<NewMapPointCandidate> > vvCandidates(vpNeighKFs.size());
+    RunParallel(vpNeighKFs.size(), [this, &vpNeighKFs, &vvCandidates, bCoarse](int i)
+    {
+        if(i>0 && CheckKeyFrameBatch())
+            return;
+        TriangulateWithNeighbor(vpNeighKFs[i], bCoarse, vvCandidates[i]);
+    });
 
-    const float ratioFactor = 1.5f*mpCurrentKeyFrame->mfScaleFactor;
-    int countStereo = 0;
-    int countStereoGoodProj = 0;
-    int countStereoAttempt = 0;
-    int totalStereoPts = 0;
-    // Search matches with epipolar restriction and triangulate
+    // Create the MapPoints in neighbor order, a keypoint triangulated with an earlier
+    // neighbor is not triangulated again
+    Map* pMap = mpAtlas->GetCurrentMap();
     for(size_t i=0; i<vpNeighKFs.size(); i++)
     {
-        if(i>0 && CheckNewKeyFrames())
+        if(i>0 && CheckKeyFrameBatch())
             return;
 
         KeyFrame* pKF2 = vpNeighKFs[i];
+        for(const NewMapPointCandidate &candidate : vvCandidates[i])
+        {
+            if(mpCurrentKeyFrame->GetMapPoint(candidate.idx1))
+                continue;
+
+            // Triangulation is succesfull
+            MapPoint* pMP = new(pMap) MapPoint(candidate.x3D, mpCurrentKeyFrame, pMap);
 
-        GeometricCamera* pCamera1 = mpCurrentKeyFrame->mpCamera, *pCamera2 = pKF2->mpCamera;
+            pMP->AddObservation(mpCurrentKeyFrame,candidate.idx1);
+            pMP->AddObservation(pKF2,candidate.idx2);
 
-        // Check first that baseline is not too short
-        Eigen::Vector3f Ow2 = pKF2->GetCameraCenter();
-        Eigen::Vector3f vBaseline = Ow2-Ow1;
-        const float baseline = vBaseline.norm();
+            mpCurrentKeyFrame->AddMapPoint(pMP,candidate.idx1);
+            pKF2->AddMapPoint(pMP,candidate.idx2);
 
-        if(!mbMonocular)
-        {
-            if(baseline<pKF2->mb)
-                continue;
-        }
-        else
-        {
-            const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
-            const float ratioBaselineDepth = baseline/medianDepthKF2;
+            pMP->ComputeDistinctiveDescriptors();
 
-            if(ratioBaselineDepth<0.01)
-                continue;
+            pMP->UpdateNormalAndDepth();
+
+            mpAtlas->AddMapPoint(pMP);
+            mlpRecentAddedMapPoints.push_back(pMP);
         }
+    }
+}
 
-        // Search matches that fullfil epipolar constraint
-        vector<pair<size_t,size_t> > vMatchedIndices;
-        bool bCoarse = mbInertial && mpTracker->mState==Tracking::RECENTLY_LOST && mpCurrentKeyFrame->GetMap()->GetIniertialBA2();
+void LocalMapping::TriangulateWithNeighbor(KeyFrame* pKF2, const bool bCoarse, vector<NewMapPointCandidate> &vCandidates)
+{
+    float th = 0.6f;
 
-        matcher.SearchForTriangulation(mpCurrentKeyFrame,pKF2,vMatchedIndices,false,bCoarse);
+    ORBmatcher matcher(th,false);
 
-        Sophus::SE3<float> sophTcw2 = pKF2->GetPose();
-        Eigen::Matrix<float,3,4> eigTcw2 = sophTcw2.matrix3x4();
-        Eigen::Matrix<float,3,3> Rcw2 = eigTcw2.block<3,3>(0,0);
-        Eigen::Matrix<float,3,3> Rwc2 = Rcw2.transpose();
-        Eigen::Vector3f tcw2 = sophTcw2.translation();
+    const float &fx1 = mpCurrentKeyFrame->fx;
+    const float &fy1 = mpCurrentKeyFrame->fy;
+    const float &cx1 = mpCurrentKeyFrame->cx;
+    const float &cy1 = mpCurrentKeyFrame->cy;
 
-        const float &fx2 = pKF2->fx;
-        const float &fy2 = pKF2->fy;
-        const float &cx2 = pKF2->cx;
-        const float &cy2 = pKF2->cy;
-        const float &invfx2 = pKF2->invfx;
-        const float &invfy2 = pKF2->invfy;
+    const float ratioFactor = 1.5f*mpCurrentKeyFrame->mfScaleFactor;
 
-        // Triangulate each match
-        const int nmatches = vMatchedIndices.size();
-        for(int ikp=0; ikp<nmatches; ikp++)
-        {
-            const int &idx1 = vMatchedIndices[ikp].first;
-            const int &idx2 = vMatchedIndices[ikp].second;
-
-            const cv::KeyPoint &kp1 = (mpCurrentKeyFrame -> NLeft == -1) ? mpCurrentKeyFrame->mvKeysUn[idx1]
-                                                                         : (idx1 < mpCurrentKeyFrame -> NLeft) ? mpCurrentKeyFrame -> mvKeys[idx1]
-                                                                                                               : mpCurrentKeyFrame -> mvKeysRight[idx1 - mpCurrentKeyFrame -> NLeft];
-            const float kp1_ur=mpCurrentKeyFrame->mvuRight[idx1];
-            bool bStereo1 = (!mpCurrentKeyFrame->mpCamera2 && kp1_ur>=0);
-            const bool bRight1 = (mpCurrentKeyFrame -> NLeft == -1 || idx1 < mpCurrentKeyFrame -> NLeft) ? false
-                                                                                                         : true;
-
-            const cv::KeyPoint &kp2 = (pKF2 -> NLeft == -1) ? pKF2->mvKeysUn[idx2]
-                                                            : (idx2 < pKF2 -> NLeft) ? pKF2 -> mvKeys[idx2]
-                                                                                     : pKF2 -> mvKeysRight[idx2 - pKF2 -> NLeft];
-
-            const float kp2_ur = pKF2->mvuRight[idx2];
-            bool bStereo2 = (!pKF2->mpCamera2 && kp2_ur>=0);
-            const bool bRight2 = (pKF2 -> NLeft == -1 || idx2 < pKF2 -> NLeft) ? false
-                                                                               : true;
-
-            if(mpCurrentKeyFrame->mpCamera2 && pKF2->mpCamera2){
-                if(bRight1 && bRight2){
-                    sophTcw1 = mpCurrentKeyFrame->GetRightPose();
-                    Ow1 = mpCurrentKeyFrame->GetRightCameraCenter();
-
-                    sophTcw2 = pKF2->GetRightPose();
-                    Ow2 = pKF2->GetRightCameraCenter();
-
-                    pCamera1 = mpCurrentKeyFrame->mpCamera2;
-                    pCamera2 = pKF2->mpCamera2;
-                }
-                else if(bRight1 && !bRight2){
-                    sophTcw1 = mpCurrentKeyFrame->GetRightPose();
-                    Ow1 = mpCurrentKeyFrame->GetRightCameraCenter();
+    // Check first that baseline is not too short
+    Eigen::Vector3f vBaseline = pKF2->GetCameraCenter()-mpCurrentKeyFrame->GetCameraCenter();
+    const float baseline = vBaseline.norm();
 
-                    sophTcw2 = pKF2->GetPose();
-                    Ow2 = pKF2->GetCameraCenter();
+    if(!mbMonocular)
+    {
+        if(baseline<pKF2->mb)
+            return;
+    }
+    else
+    {
+        const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
+        const float ratioBaselineDepth = baseline/medianDepthKF2;
 
-                    pCamera1 = mpCurrentKeyFrame->mpCamera2;
-                    pCamera2 = pKF2->mpCamera;
-                }
-                else if(!bRight1 && bRight2){
-                    sophTcw1 = mpCurrentKeyFrame->GetPose();
-                    Ow1 = mpCurrentKeyFrame->GetCameraCenter();
+        if(ratioBaselineDepth<0.01)
+            return;
+    }
 
-                    sophTcw2 = pKF2->GetRightPose();
-                    Ow2 = pKF2->GetRightCameraCenter();
+    // Search matches that fullfil epipolar constraint
+    vector<pair<size_t,size_t> > vMatchedIndices;
 
-                    pCamera1 = mpCurrentKeyFrame->mpCamera;
-                    pCamera2 = pKF2->mpCamera2;
-                }
-                else{
-                    sophTcw1 = mpCurrentKeyFrame->GetPose();
-                    Ow1 = mpCurrentKeyFrame->GetCameraCenter();
+    matcher.SearchForTriangulation(mpCurrentKeyFrame,pKF2,vMatchedIndices,false,bCoarse);
 
-                    sophTcw2 = pKF2->GetPose();
-                    Ow2 = pKF2->GetCameraCenter();
+    const float &fx2 = pKF2->fx;
+    const float &fy2 = pKF2->fy;
+    const float &cx2 = pKF2->cx;
+    const float &cy2 = pKF2->cy;
 
-                    pCamera1 = mpCurrentKeyFrame->mpCamera;
-                    pCamera2 = pKF2->mpCamera;
-                }
-                eigTcw1 = sophTcw1.matrix3x4();
-                Rcw1 = eigTcw1.block<3,3>(0,0);
-                Rwc1 = Rcw1.transpose();
-                tcw1 = sophTcw1.translation();
-
-                eigTcw2 = sophTcw2.matrix3x4();
-                Rcw2 = eigTcw2.block<3,3>(0,0);
-                Rwc2 = Rcw2.transpose();
-                tcw2 = sophTcw2.translation();
-            }
+    // Cameras a match is seen from, the left ones unless both keyframes have two cameras,
+    // then view 2*bRight1+bRight2
+    struct CameraPair
+    {
+        Eigen::Matrix<float,3,4> Tcw1, Tcw2;
+        Eigen::Vector3f Ow1, Ow2;
+        GeometricCamera *pCamera1, *pCamera2;
+    };
+    const bool bTwoCameras = mpCurrentKeyFrame->mpCamera2 && pKF2->mpCamera2;
+    const int nViews = bTwoCameras ? 4 : 1;
+    CameraPair vViews[4];
+    for(int v=0; v<nViews; v++)
+    {
+        const bool bRight1 = v & 2;
+        const bool bRight2 = v & 1;
+        vViews[v].Tcw1 = (bRight1 ? mpCurrentKeyFrame->GetRightPose() : mpCurrentKeyFrame->GetPose()).matrix3x4();
+        vViews[v].Tcw2 = (bRight2 ? pKF2->GetRightPose() : pKF2->GetPose()).matrix3x4();
+        vViews[v].Ow1 = bRight1 ? mpCurrentKeyFrame->GetRightCameraCenter() : mpCurrentKeyFrame->GetCameraCenter();
+        vViews[v].Ow2 = bRight2 ? pKF2->GetRightCameraCenter() : pKF2->GetCameraCenter();
+        vViews[v].pCamera1 = bRight1 ? mpCurrentKeyFrame->mpCamera2 : mpCurrentKeyFrame->mpCamera;
+        vViews[v].pCamera2 = bRight2 ? pKF2->mpCamera2 : pKF2->mpCamera;
+    }
 
-            // Check parallax between rays
-            Eigen::Vector3f xn1 = pCamera1->unprojectEig(kp1.pt);
-            Eigen::Vector3f xn2 = pCamera2->unprojectEig(kp2.pt);
+    // A match that gets a 3D point, from the stereo depth or from the batch triangulation
+    struct TriangulatedMatch
+    {
+        size_t idx1, idx2;
+        int view;
+        const cv::KeyPoint *pKp1, *pKp2;
+        bool bStereo1, bStereo2;
+        Eigen::Vector3f x3D;
+        bool bValid;
+    };
+    const int nmatches = vMatchedIndices.size();
+    vector<TriangulatedMatch> vMatches;
+    vMatches.reserve(nmatches);
+
+    // Rays of the matches with enough parallax, triangulated together for each view
+    vector<Eigen::Vector3f> vxn1[4], vxn2[4];
+    vector<size_t> vBatchMatches[4];
+
+    // Check parallax between rays
+    for(int ikp=0; ikp<nmatches; ikp++)
+    {
+        const int &idx1 = vMatchedIndices[ikp].first;
+        const int &idx2 = vMatchedIndices[ikp].second;
 
-            Eigen::Vector3f ray1 = Rwc1 * xn1;
-            Eigen::Vector3f ray2 = Rwc2 * xn2;
-            const float cosParallaxRays = ray1.dot(ray2)/(ray1.norm() * ray2.norm());
+        const cv::KeyPoint &kp1 = (mpCurrentKeyFrame -> NLeft == -1) ? mpCurrentKeyFrame->mvKeysUn[idx1]
+                                                                     : (idx1 < mpCurrentKeyFrame -> NLeft) ? mpCurrentKeyFrame -> mvKeys[idx1]
+                                                                                                           : mpCurrentKeyFrame -> mvKeysRight[idx1 - mpCurrentKeyFrame -> NLeft];
+        const float kp1_ur=mpCurrentKeyFrame->mvuRight[idx1];
+        bool bStereo1 = (!mpCurrentKeyFrame->mpCamera2 && kp1_ur>=0);
+        const bool bRight1 = (mpCurrentKeyFrame -> NLeft == -1 || idx1 < mpCurrentKeyFrame -> NLeft) ? false
+                                                                                                     : true;
 
-            float cosParallaxStereo = cosParallaxRays+1;
-            float cosParallaxStereo1 = cosParallaxStereo;
-            float cosParallaxStereo2 = cosParallaxStereo;
+        const cv::KeyPoint &kp2 = (pKF2 -> NLeft == -1) ? pKF2->mvKeysUn[idx2]
+                                                        : (idx2 < pKF2 -> NLeft) ? pKF2 -> mvKeys[idx2]
+                                                                                 : pKF2 -> mvKeysRight[idx2 - pKF2 -> NLeft];
 
-            if(bStereo1)
-                cosParallaxStereo1 = cos(2*atan2(mpCurrentKeyFrame->mb/2,mpCurrentKeyFrame->mvDepth[idx1]));
-            else if(bStereo2)
-                cosParallaxStereo2 = cos(2*atan2(pKF2->mb/2,pKF2->mvDepth[idx2]));
+        const float kp2_ur = pKF2->mvuRight[idx2];
+        bool bStereo2 = (!pKF2->mpCamera2 && kp2_ur>=0);
+        const bool bRight2 = (pKF2 -> NLeft == -1 || idx2 < pKF2 -> NLeft) ? false
+                                                                           : true;
 
-            if (bStereo1 || bStereo2) totalStereoPts++;
-            
-            cosParallaxStereo = min(cosParallaxStereo1,cosParallaxStereo2);
+        const int view = bTwoCameras ? 2*bRight1+bRight2 : 0;
+        const CameraPair &cameras = vViews[view];
 
-            Eigen::Vector3f x3D;
+        Eigen::Vector3f xn1 = cameras.pCamera1->unprojectEig(kp1.pt);
+        Eigen::Vector3f xn2 = cameras.pCamera2->unprojectEig(kp2.pt);
 
-            bool goodProj = false;
-            bool bPointStereo = false;
-            if(cosParallaxRays<cosParallaxStereo && cosParallaxRays>0 && (bStereo1 || bStereo2 ||
-                                                                          (cosParallaxRays<0.9996 && mbInertial) || (cosParallaxRays<0.9998 && !mbInertial)))
-            {
-                goodProj = GeometricTools::Triangulate(xn1, xn2, eigTcw1, eigTcw2, x3D);
-                if(!goodProj)
-                    continue;
-            }
-            else if(bStereo1 && cosParallaxStereo1<cosParallaxStereo2)
-            {
-                countStereoAttempt++;
-                bPointStereo = true;
-                goodProj = mpCurrentKeyFrame->UnprojectStereo(idx1, x3D);
-            }
-            else if(bStereo2 && cosParallaxStereo2<cosParallaxStereo1)
-            {
-                countStereoAttempt++;
-                bPointStereo = true;
-                goodProj = pKF2->UnprojectStereo(idx2, x3D);
-            }
-            else
-            {
-                continue; //No stereo and very low parallax
-            }
+        Eigen::Vector3f ray1 = cameras.Tcw1.leftCols<3>().transpose() * xn1;
+        Eigen::Vector3f ray2 = cameras.Tcw2.leftCols<3>().transpose() * xn2;
+        const float cosParallaxRays = ray1.dot(ray2)/(ray1.norm() * ray2.norm());
 
-            if(goodProj && bPointStereo)
-                countStereoGoodProj++;
+        float cosParallaxStereo = cosParallaxRays+1;
+        float cosParallaxStereo1 = cosParallaxStereo;
+        float cosParallaxStereo2 = cosParallaxStereo;
 
-            if(!goodProj)
-                continue;
+        if(bStereo1)
+            cosParallaxStereo1 = cos(2*atan2(mpCurrentKeyFrame->mb/2,mpCurrentKeyFrame->mvDepth[idx1]));
+        else if(bStereo2)
+            cosParallaxStereo2 = cos(2*atan2(pKF2->mb/2,pKF2->mvDepth[idx2]));
 
-            //Check triangulation in front of cameras
-            float z1 = Rcw1.row(2).dot(x3D) + tcw1(2);
-            if(z1<=0)
-                continue;
+        cosParallaxStereo = min(cosParallaxStereo1,cosParallaxStereo2);
 
-            float z2 = Rcw2.row(2).dot(x3D) + tcw2(2);
-            if(z2<=0)
-                continue;
+        TriangulatedMatch match = {static_cast<size_t>(idx1), static_cast<size_t>(idx2), view, &kp1, &kp2, bStereo1, bStereo2, Eigen::Vector3f(), false};
 
-            //Check reprojection error in first keyframe
-            const float &sigmaSquare1 = mpCurrentKeyFrame->mvLevelSigma2[kp1.octave];
-            const float x1 = Rcw1.row(0).dot(x3D)+tcw1(0);
-            const float y1 = Rcw1.row(1).dot(x3D)+tcw1(1);
-            const float invz1 = 1.0/z1;
+        if(cosParallaxRays<cosParallaxStereo && cosParallaxRays>0 && (bStereo1 || bStereo2 ||
+                                                                      (cosParallaxRays<0.9996 && mbInertial) || (cosParallaxRays<0.9998 && !mbInertial)))
+        {
+            vxn1[view].push_back(xn1);
+            vxn2[view].push_back(xn2);
+            vBatchMatches[view].push_back(vMatches.size());
+        }
+        else if(bStereo1 && cosParallaxStereo1<cosParallaxStereo2)
+        {
+            match.bValid = mpCurrentKeyFrame->UnprojectStereo(idx1, match.x3D);
+        }
+        else if(bStereo2 && cosParallaxStereo2<cosParallaxStereo1)
+        {
+            match.bValid = pKF2->UnprojectStereo(idx2, match.x3D);
+        }
+        else
+        {
+            continue; //No stereo and very low parallax
+        }
 
-            if(!bStereo1)
-            {
-                cv::Point2f uv1 = pCamera1->project(cv::Point3f(x1,y1,z1));
-                float errX1 = uv1.x - kp1.pt.x;
-                float errY1 = uv1.y - kp1.pt.y;
+        vMatches.push_back(match);
+    }
 
-                if((errX1*errX1+errY1*errY1)>5.991*sigmaSquare1)
-                    continue;
+    vector<Eigen::Vector3f> vx3D;
+    vector<unsigned char> vbTriangulated;
+    for(int v=0; v<nViews; v++)
+    {
+        const size_t nBatch = vBatchMatches[v].size();
+        vx3D.resize(nBatch);
+        vbTriangulated.resize(nBatch);
+        GeometricTools::Triangulate(vxn1[v].data(), vxn2[v].data(), nBatch, vViews[v].Tcw1, vViews[v].Tcw2,
+                                    vx3D.data(), vbTriangulated.data(), true);
+        for(size_t i=0; i<nBatch; i++)
+        {
+            TriangulatedMatch &match = vMatches[vBatchMatches[v][i]];
+            match.x3D = vx3D[i];
+            match.bValid = vbTriangulated[i];
+        }
+    }
 
-            }
-            else
-            {
-                float u1 = fx1*x1*invz1+cx1;
-                float u1_r = u1 - mpCurrentKeyFrame->mbf*invz1;
-                float v1 = fy1*y1*invz1+cy1;
-                float errX1 = u1 - kp1.pt.x;
-                float errY1 = v1 - kp1.pt.y;
-                float errX1_r = u1_r - kp1_ur;
-                if((errX1*errX1+errY1*errY1+errX1_r*errX1_r)>7.8*sigmaSquare1)
-                    continue;
-            }
+    // Check each 3D point in the order of the matches
+    for(const TriangulatedMatch &match : vMatches)
+    {
+        if(!match.bValid)
+            continue;
 
-            //Check reprojection error in second keyframe
-            const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
-            const float x2 = Rcw2.row(0).dot(x3D)+tcw2(0);
-            const float y2 = Rcw2.row(1).dot(x3D)+tcw2(1);
-            const float invz2 = 1.0/z2;
-            if(!bStereo2)
-            {
-                cv::Point2f uv2 = pCamera2->project(cv::Point3f(x2,y2,z2));
-                float errX2 = uv2.x - kp2.pt.x;
-                float errY2 = uv2.y - kp2.pt.y;
-                if((errX2*errX2+errY2*errY2)>5.991*sigmaSquare2)
-                    continue;
-            }
-            else
-            {
-                float u2 = fx2*x2*invz2+cx2;
-                float u2_r = u2 - mpCurrentKeyFrame->mbf*invz2;
-                float v2 = fy2*y2*invz2+cy2;
-                float errX2 = u2 - kp2.pt.x;
-                float errY2 = v2 - kp2.pt.y;
-                float errX2_r = u2_r - kp2_ur;
-                if((errX2*errX2+errY2*errY2+errX2_r*errX2_r)>7.8*sigmaSquare2)
-                    continue;
-            }
+        const cv::KeyPoint &kp1 = *match.pKp1;
+        const cv::KeyPoint &kp2 = *match.pKp2;
+        const bool bStereo1 = match.bStereo1;
+        const bool bStereo2 = match.bStereo2;
+        const float kp1_ur = mpCurrentKeyFrame->mvuRight[match.idx1];
+        const float kp2_ur = pKF2->mvuRight[match.idx2];
+        const Eigen::Vector3f &x3D = match.x3D;
+
+        const CameraPair &cameras = vViews[match.view];
+        const Eigen::Matrix<float,3,4> &Tcw1 = cameras.Tcw1;
+        const Eigen::Matrix<float,3,4> &Tcw2 = cameras.Tcw2;
+
+        //Check triangulation in front of cameras
+        float z1 = Tcw1.block<1,3>(2,0).dot(x3D) + Tcw1(2,3);
+        if(z1<=0)
+            continue;
 
-            //Check scale consistency
-            Eigen::Vector3f normal1 = x3D - Ow1;
-            float dist1 = normal1.norm();
+        float z2 = Tcw2.block<1,3>(2,0).dot(x3D) + Tcw2(2,3);
+        if(z2<=0)
+            continue;
 
-            Eigen::Vector3f normal2 = x3D - Ow2;
-            float dist2 = normal2.norm();
+        //Check reprojection error in first keyframe
+        const float &sigmaSquare1 = mpCurrentKeyFrame->mvLevelSigma2[kp1.octave];
+        const float x1 = Tcw1.block<1,3>(0,0).dot(x3D)+Tcw1(0,3);
+        const float y1 = Tcw1.block<1,3>(1,0).dot(x3D)+Tcw1(1,3);
+        const float invz1 = 1.0/z1;
 
-            if(dist1==0 || dist2==0)
-                continue;
+        if(!bStereo1)
+        {
+            cv::Point2f uv1 = cameras.pCamera1->project(cv::Point3f(x1,y1,z1));
+            float errX1 = uv1.x - kp1.pt.x;
+            float errY1 = uv1.y - kp1.pt.y;
 
-            if(mbFarPoints && (dist1>=mThFarPoints||dist2>=mThFarPoints)) // MODIFICATION
+            if((errX1*errX1+errY1*errY1)>5.991*sigmaSquare1)
                 continue;
 
-            const float ratioDist = dist2/dist1;
-            const float ratioOctave = mpCurrentKeyFrame->mvScaleFactors[kp1.octave]/pKF2->mvScaleFactors[kp2.octave];
+        }
+        else
+        {
+            float u1 = fx1*x1*invz1+cx1;
+            float u1_r = u1 - mpCurrentKeyFrame->mbf*invz1;
+            float v1 = fy1*y1*invz1+cy1;
+            float errX1 = u1 - kp1.pt.x;
+            float errY1 = v1 - kp1.pt.y;
+            float errX1_r = u1_r - kp1_ur;
+            if((errX1*errX1+errY1*errY1+errX1_r*errX1_r)>7.8*sigmaSquare1)
+                continue;
+        }
 
-            if(ratioDist*ratioFactor<ratioOctave || ratioDist>ratioOctave*ratioFactor)
+        //Check reprojection error in second keyframe
+        const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
+        const float x2 = Tcw2.block<1,3>(0,0).dot(x3D)+Tcw2(0,3);
+        const float y2 = Tcw2.block<1,3>(1,0).dot(x3D)+Tcw2(1,3);
+        const float invz2 = 1.0/z2;
+        if(!bStereo2)
+        {
+            cv::Point2f uv2 = cameras.pCamera2->project(cv::Point3f(x2,y2,z2));
+            float errX2 = uv2.x - kp2.pt.x;
+            float errY2 = uv2.y - kp2.pt.y;
+            if((errX2*errX2+errY2*errY2)>5.991*sigmaSquare2)
+                continue;
+        }
+        else
+        {
+            float u2 = fx2*x2*invz2+cx2;
+            float u2_r = u2 - mpCurrentKeyFrame->mbf*invz2;
+            float v2 = fy2*y2*invz2+cy2;
+            float errX2 = u2 - kp2.pt.x;
+            float errY2 = v2 - kp2.pt.y;
+            float errX2_r = u2_r - kp2_ur;
+            if((errX2*errX2+errY2*errY2+errX2_r*errX2_r)>7.8*sigmaSquare2)
                 continue;
+        }
 
-            // Triangulation is succesfull
-            MapPoint* pMP = new MapPoint(x3D, mpCurrentKeyFrame, mpAtlas->GetCurrentMap());
-            if (bPointStereo)
-                countStereo++;
-            
-            pMP->AddObservation(mpCurrentKeyFrame,idx1);
-            pMP->AddObservation(pKF2,idx2);
+        //Check scale consistency
+        Eigen::Vector3f normal1 = x3D - cameras.Ow1;
+        float dist1 = normal1.norm();
 
-            mpCurrentKeyFrame->AddMapPoint(pMP,idx1);
-            pKF2->AddMapPoint(pMP,idx2);
+        Eigen::Vector3f normal2 = x3D - cameras.Ow2;
+        float dist2 = normal2.norm();
 
-            pMP->ComputeDistinctiveDescriptors();
+        if(dist1==0 || dist2==0)
+            continue;
 
-            pMP->UpdateNormalAndDepth();
+        if(mbFarPoints && (dist1>=mThFarPoints||dist2>=mThFarPoints)) // MODIFICATION
+            continue;
 
-            mpAtlas->AddMapPoint(pMP);
-            mlpRecentAddedMapPoints.push_back(pMP);
-        }
-    }    
+        const float ratioDist = dist2/dist1;
+        const float ratioOctave = mpCurrentKeyFrame->mvScaleFactors[kp1.octave]/pKF2->mvScaleFactors[kp2.octave];
+
+        if(ratioDist*ratioFactor<ratioOctave || ratioDist>ratioOctave*ratioFactor)
+            continue;
+
+        vCandidates.push_back({match.idx1, match.idx2, x3D});
+    }
 }
 
 void LocalMapping::SearchInNeighbors()
 {
+    TRACE_SCOPE("SearchInNeighbors");
     // Retrieve neighbor keyframes
     int nn = 10;
     if(mbMonocular)
@@ -762,17 +873,33 @@ void LocalMapping::SearchInNeighbors()
         }
     }
 
-    // Search matches by projection from current KF in target KFs
-    ORBmatcher matcher;
-    vector<MapPoint*> vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
-    for(vector<KeyFrame*>::iterator vit=vpTargetKFs.begin(), vend=vpTargetKFs.end(); vit!=vend; vit++)
+    // Search matches by projection from current KF in target KFs. The searches only read the
+    // map and run concurrently, one per target and camera, the matches are fused in target order
+    struct FuseSearch
     {
-        KeyFrame* pKFi = *vit;
-
-        matcher.Fuse(pKFi,vpMapPointMatches);
-        if(pKFi->NLeft != -1) matcher.Fuse(pKFi,vpMapPointMatches,true);
+        KeyFrame* pKF;
+        bool bRight;
+        vector<ORBmatcher::FuseMatch> vMatches;
+    };
+
+    vector<FuseSearch> vSearches;
+    vSearches.reserve(2*vpTargetKFs.size());
+    for(KeyFrame* pKFi : vpTargetKFs)
+    {
+        vSearches.push_back({pKFi, false, vector<ORBmatcher::FuseMatch>()});
+        if(pKFi->NLeft != -1)
+            vSearches.push_back({pKFi, true, vector<ORBmatcher::FuseMatch>()});
     }
 
+    vector<MapPoint*> vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
+    RunParallel(vSearches.size(), [&vSearches, &vpMapPointMatches](int i)
+    {
+        ORBmatcher matcher;
+        matcher.SearchFuse(vSearches[i].pKF,vpMapPointMatches,vSearches[i].vMatches,3.0,vSearches[i].bRight);
+    });
+    for(const FuseSearch &search : vSearches)
+        ORBmatcher::ApplyFuse(search.pKF,search.vMatches);
+
 
     if (mbAbortBA)
         return;
@@ -799,24 +926,46 @@ void LocalMapping::SearchInNeighbors()
         }
     }
 
-    matcher.Fuse(mpCurrentKeyFrame,vpFuseCandidates);
-    if(mpCurrentKeyFrame->NLeft != -1) matcher.Fuse(mpCurrentKeyFrame,vpFuseCandidates,true);
+    // The candidates are searched in batches concurrently and fused in candidate order, the left
+    // camera before the right one
+    const int nBatch = 256;
+    const int nCandidates = vpFuseCandidates.size();
+    const int nBatches = (nCandidates+nBatch-1)/nBatch;
+    const int nCameras = mpCurrentKeyFrame->NLeft != -1 ? 2 : 1;
+    vector<vector<ORBmatcher::FuseMatch> > vvMatches(nCameras*nBatches);
+    RunParallel(vvMatches.size(), [this, &vpFuseCandidates, &vvMatches, nBatches, nBatch, nCandidates](int i)
+    {
+        const int b = i%nBatches;
+        const vector<MapPoint*> vpBatch(vpFuseCandidates.begin()+b*nBatch,
+                                        vpFuseCandidates.begin()+min(nCandidates,(b+1)*nBatch));
+        ORBmatcher matcher;
+        matcher.SearchFuse(mpCurrentKeyFrame,vpBatch,vvMatches[i],3.0,i>=nBatches);
+    });
+    for(const vector<ORBmatcher::FuseMatch> &vMatches : vvMatches)
+        ORBmatcher::ApplyFuse(mpCurrentKeyFrame,vMatches);
 
 
-    // Update points
+    // Update points, each one only reads its observations
     vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
-    for(size_t i=0, iend=vpMapPointMatches.size(); i<iend; i++)
+    vector<MapPoint*> vpUpdatedMPs;
+    vpUpdatedMPs.reserve(vpMapPointMatches.size());
+    for(MapPoint* pMP : vpMapPointMatches)
     {
-        MapPoint* pMP=vpMapPointMatches[i];
-        if(pMP)
+        if(pMP && !pMP->isBad())
+            vpUpdatedMPs.push_back(pMP);
+    }
+    // A point matched in both cameras is updated once
+    sort(vpUpdatedMPs.begin(),vpUpdatedMPs.end());
+    vpUpdatedMPs.erase(unique(vpUpdatedMPs.begin(),vpUpdatedMPs.end()),vpUpdatedMPs.end());
+    const int nUpdated = vpUpdatedMPs.size();
+    RunParallel((nUpdated+nBatch-1)/nBatch, [&vpUpdatedMPs, nUpdated, nBatch](int b)
+    {
+        for(int i=b*nBatch, iend=min(nUpdated,(b+1)*nBatch); i<iend; i++)
         {
-            if(!pMP->isBad())
-            {
-                pMP->ComputeDistinctiveDescriptors();
-                pMP->UpdateNormalAndDepth();
-            }
+            vpUpdatedMPs[i]->ComputeDistinctiveDescriptors();
+            vpUpdatedMPs[i]->UpdateNormalAndDepth();
         }
-    }
+    });
 
     // Update connections in covisibility graph
     mpCurrentKeyFrame->UpdateConnections();
@@ -826,8 +975,11 @@ void LocalMapping::RequestStop()
 {
     unique_lock<mutex> lock(mMutexStop);
     mbStopRequested = true;
-    unique_lock<mutex> lock2(mMutexNewKFs);
+    unique_lock<ProfiledMutex> lock2(mMutexNewKFs);
     mbAbortBA = true;
+    // The map is changed while stopped, discard a full inertial BA in progress
+    unique_lock<mutex> lock3(mMutexFIBA);
+    mbStopFIBA = true;
 }
 
 bool LocalMapping::Stop()
@@ -882,6 +1034,94 @@ void LocalMapping::SetAcceptKeyFrames(bool flag)
     mbAcceptKeyFrames=flag;
 }
 
+void LocalMapping::SetMaxLocalBAKeyFrames(int n)
+{
+    unique_lock<mutex> lock(mMutexLocalBA);
+    mnMaxLocalBAKeyFrames = std::max(n, 0);
+}
+
+int LocalMapping::GetMaxLocalBAKeyFrames()
+{
+    unique_lock<mutex> lock(mMutexLocalBA);
+    return mnMaxLocalBAKeyFrames;
+}
+
+void LocalMapping::SetLocalBAThreads(int n)
+{
+    unique_lock<mutex> lock(mMutexLocalBA);
+    mnLocalBAThreads = std::max(n, 1);
+}
+
+int LocalMapping::GetLocalBAThreads()
+{
+    unique_lock<mutex> lock(mMutexLocalBA);
+    return mnLocalBAThreads;
+}
+
+void LocalMapping::GetMappingCost(float &fKeyFrameMs, float &fLocalBAMs)
+{
+    unique_lock<mutex> lock(mMutexLocalBA);
+    fKeyFrameMs = mfKeyFrameCostMs;
+    fLocalBAMs = mfLocalBAMs;
+}
+
+void LocalMapping::UpdateMappingCost(const double tKeyFrame, const double tLocalBA)
+{
+    // Exponential average, the first measurement is taken as is
+    const float alpha = 0.2f;
+    unique_lock<mutex> lock(mMutexLocalBA);
+    mfKeyFrameCostMs = mfKeyFrameCostMs>0.f ? (1.f-alpha)*mfKeyFrameCostMs + alpha*tKeyFrame : tKeyFrame;
+    if(tLocalBA>=0.0)
+        mfLocalBAMs = mfLocalBAMs>0.f ? (1.f-alpha)*mfLocalBAMs + alpha*tLocalBA : tLocalBA;
+}
+
+void LocalMapping::SetLocalBATermination(float fTimeBudget, float fGainThreshold)
+{
+    unique_lock<mutex> lock(mMutexLocalBA);
+    mfLocalBATimeBudget = std::max(fTimeBudget, 0.f);
+    mfLocalBAGainThreshold = std::max(fGainThreshold, 0.f);
+}
+
+void LocalMapping::GetLocalBATermination(float &fTimeBudget, float &fGainThreshold)
+{
+    unique_lock<mutex> lock(mMutexLocalBA);
+    fTimeBudget = mfLocalBATimeBudget;
+    fGainThreshold = mfLocalBAGainThreshold;
+}
+
+void LocalMapping::SetParallelFor(const ORBmatcher::ParallelFor& parallelFor)
+{
+    unique_lock<mutex> lock(mMutexParallelFor);
+    mParallelFor = parallelFor;
+}
+
+void LocalMapping::RunParallel(int n, const std::function<void(int)>& job)
+{
+    ORBmatcher::ParallelFor parallelFor;
+    {
+        unique_lock<mutex> lock(mMutexParallelFor);
+        parallelFor = mParallelFor;
+    }
+
+    if(parallelFor)
+        parallelFor(n, job);
+    else
+        for(int i=0; i<n; i++)
+            job(i);
+}
+
+void LocalMapping::IncreaseMapVersion()
+{
+    unique_lock<mutex> lock(mMutexMapVersion);
+    mnMapVersion++;
+}
+
+unsigned long LocalMapping::GetMapVersion()
+{
+    unique_lock<mutex> lock(mMutexMapVersion);
+    return mnMapVersion;
+}
+
 bool LocalMapping::SetNotStop(bool flag)
 {
     unique_lock<mutex> lock(mMutexStop);
@@ -896,11 +1136,83 @@ bool LocalMapping::SetNotStop(bool flag)
 
 void LocalMapping::InterruptBA()
 {
-    mbAbortBA = true;
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
+    if(mbRealTime)
+        mbAbortBA = true;
+}
+
+int LocalMapping::CountRedundantObservations(KeyFrame* pKF, int &nMPs)
+{
+    const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
+
+    int nObs = 3;
+    const int thObs=nObs;
+    int nRedundantObservations=0;
+    nMPs=0;
+    for(size_t i=0, iend=vpMapPoints.size(); i<iend; i++)
+    {
+        MapPoint* pMP = vpMapPoints[i];
+        if(pMP)
+        {
+            if(!pMP->isBad())
+            {
+                if(!mbMonocular)
+                {
+                    if(pKF->mvDepth[i]>pKF->mThDepth || pKF->mvDepth[i]<0)
+                        continue;
+                }
+
+                nMPs++;
+                if(pMP->Observations()>thObs)
+                {
+                    const int &scaleLevel = (pKF -> NLeft == -1) ? pKF->mvKeysUn[i].octave
+                                                                 : (i < pKF -> NLeft) ? pKF -> mvKeys[i].octave
+                                                                                      : pKF -> mvKeysRight[i].octave;
+                    const map<KeyFrame*, tuple<int,int>> observations = pMP->GetObservations();
+                    int nObs=0;
+                    for(map<KeyFrame*, tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+                    {
+                        KeyFrame* pKFi = mit->first;
+                        if(pKFi==pKF)
+                            continue;
+                        tuple<int,int> indexes = mit->second;
+                        int leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
+                        int scaleLeveli = -1;
+                        if(pKFi -> NLeft == -1)
+                            scaleLeveli = pKFi->mvKeysUn[leftIndex].octave;
+                        else {
+                            if (leftIndex != -1) {
+                                scaleLeveli = pKFi->mvKeys[leftIndex].octave;
+                            }
+                            if (rightIndex != -1) {
+                                int rightLevel = pKFi->mvKeysRight[rightIndex - pKFi->NLeft].octave;
+                                scaleLeveli = (scaleLeveli == -1 || scaleLeveli > rightLevel) ? rightLevel
+                                                                                              : scaleLeveli;
+                            }
+                        }
+
+                        if(scaleLeveli<=scaleLevel+1)
+                        {
+                            nObs++;
+                            if(nObs>thObs)
+                                break;
+                        }
+                    }
+                    if(nObs>thObs)
+                    {
+                        nRedundantObservations++;
+                    }
+                }
+            }
+        }
+    }
+
+    return nRedundantObservations;
 }
 
 void LocalMapping::KeyFrameCulling()
 {
+    TRACE_SCOPE("KeyFrameCulling");
     // Check redundant keyframes (only local keyframes)
     // A keyframe is considered redundant if the 90% of the MapPoints it sees, are seen
     // in at least other 3 keyframes (in the same or finer scale)
@@ -917,6 +1229,10 @@ void LocalMapping::KeyFrameCulling()
     else
         redundant_th = 0.5;
 
+    // Over the memory budget of the atlas, keyframes with less redundancy are culled as well
+    if(mpAtlas->IsOverMemoryBudget())
+        redundant_th -= 0.1f;
+
     const bool bInitImu = mpAtlas->isImuInitialized();
     int count=0;
 
@@ -936,76 +1252,32 @@ void LocalMapping::KeyFrameCulling()
 
 
 
-    for(vector<KeyFrame*>::iterator vit=vpLocalKeyFrames.begin(), vend=vpLocalKeyFrames.end(); vit!=vend; vit++)
+    // Count the redundant observations of the keyframes the loop below may reach in parallel,
+    // culling is rare and the keyframes are then counted again one by one
+    const int nMaxCandidates = min<int>(vpLocalKeyFrames.size(), 101);
+    vector<int> vnRedundantObservations(nMaxCandidates,0), vnMPs(nMaxCandidates,0);
+    RunParallel(nMaxCandidates, [this, &vpLocalKeyFrames, &vnRedundantObservations, &vnMPs](int k)
+    {
+        KeyFrame* pKF = vpLocalKeyFrames[k];
+        if((pKF->mnId==pKF->GetMap()->GetInitKFid()) || pKF->isBad())
+            return;
+        vnRedundantObservations[k] = CountRedundantObservations(pKF, vnMPs[k]);
+    });
+
+    bool bCulled = false;
+    for(int k=0; k<nMaxCandidates; k++)
     {
         count++;
-        KeyFrame* pKF = *vit;
+        KeyFrame* pKF = vpLocalKeyFrames[k];
 
         if((pKF->mnId==pKF->GetMap()->GetInitKFid()) || pKF->isBad())
             continue;
-        const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
-
-        int nObs = 3;
-        const int thObs=nObs;
-        int nRedundantObservations=0;
-        int nMPs=0;
-        for(size_t i=0, iend=vpMapPoints.size(); i<iend; i++)
-        {
-            MapPoint* pMP = vpMapPoints[i];
-            if(pMP)
-            {
-                if(!pMP->isBad())
-                {
-                    if(!mbMonocular)
-                    {
-                        if(pKF->mvDepth[i]>pKF->mThDepth || pKF->mvDepth[i]<0)
-                            continue;
-                    }
-
-                    nMPs++;
-                    if(pMP->Observations()>thObs)
-                    {
-                        const int &scaleLevel = (pKF -> NLeft == -1) ? pKF->mvKeysUn[i].octave
-                                                                     : (i < pKF -> NLeft) ? pKF -> mvKeys[i].octave
-                                                                                          : pKF -> mvKeysRight[i].octave;
-                        const map<KeyFrame*, tuple<int,int>> observations = pMP->GetObservations();
-                        int nObs=0;
-                        for(map<KeyFrame*, tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
-                        {
-                            KeyFrame* pKFi = mit->first;
-                            if(pKFi==pKF)
-                                continue;
-                            tuple<int,int> indexes = mit->second;
-                            int leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
-                            int scaleLeveli = -1;
-                            if(pKFi -> NLeft == -1)
-                                scaleLeveli = pKFi->mvKeysUn[leftIndex].octave;
-                            else {
-                                if (leftIndex != -1) {
-                                    scaleLeveli = pKFi->mvKeys[leftIndex].octave;
-                                }
-                                if (rightIndex != -1) {
-                                    int rightLevel = pKFi->mvKeysRight[rightIndex - pKFi->NLeft].octave;
-                                    scaleLeveli = (scaleLeveli == -1 || scaleLeveli > rightLevel) ? rightLevel
-                                                                                                  : scaleLeveli;
-                                }
-                            }
 
-                            if(scaleLeveli<=scaleLevel+1)
-                            {
-                                nObs++;
-                                if(nObs>thObs)
-                                    break;
-                            }
-                        }
-                        if(nObs>thObs)
-                        {
-                            nRedundantObservations++;
-                        }
-                    }
-                }
-            }
-        }
+        // Culling a keyframe removes observations and MapPoints, count again after that
+        int nMPs = vnMPs[k];
+        int nRedundantObservations = vnRedundantObservations[k];
+        if(bCulled)
+            nRedundantObservations = CountRedundantObservations(pKF, nMPs);
 
         if(nRedundantObservations>redundant_th*nMPs)
         {
@@ -1046,6 +1318,7 @@ void LocalMapping::KeyFrameCulling()
                 pKF->SetBadFlag();
             }
         }
+        bCulled = bCulled || pKF->isBad();
         if((count > 20 && mbAbortBA) || count>100)
         {
             break;
@@ -1106,8 +1379,10 @@ void LocalMapping::ResetIfRequested()
             executed_reset = true;
 
             cout << "LM: Reseting Atlas in Local Mapping..." << endl;
+            StopFullInertialBA();
             mlNewKeyFrames.clear();
             mlpRecentAddedMapPoints.clear();
+            mlpWindowKeyFrames.clear();
             mbResetRequested = false;
             mbResetRequestedActiveMap = false;
 
@@ -1125,8 +1400,10 @@ void LocalMapping::ResetIfRequested()
         if(mbResetRequestedActiveMap) {
             executed_reset = true;
             cout << "LM: Reseting current map in Local Mapping..." << endl;
+            StopFullInertialBA();
             mlNewKeyFrames.clear();
             mlpRecentAddedMapPoints.clear();
+            mlpWindowKeyFrames.clear();
 
             // Inertial parameters
             mTinit = 0.f;
@@ -1140,7 +1417,10 @@ void LocalMapping::ResetIfRequested()
         }
     }
     if(executed_reset)
+    {
+        IncreaseMapVersion();
         cout << "LM: Reset free the mutex" << endl;
+    }
 
 }
 
@@ -1172,6 +1452,7 @@ bool LocalMapping::isFinished()
 
 void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
 {
+    TRACE_SCOPE("InitializeIMU");
     if (mbResetRequested)
         return;
 
@@ -1263,6 +1544,9 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
 
     mInitTime = mpTracker->mLastFrame.mTimeStamp-vpKF.front()->mTimeStamp;
 
+    // The map is rotated and scaled below, a full inertial BA still running would be obsolete
+    StopFullInertialBA();
+
     std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
     Optimizer::InertialOptimization(mpAtlas->GetCurrentMap(), mRwg, mScale, mbg, mba, mbMonocular, infoInertial, false, false, priorG, priorA);
 
@@ -1277,7 +1561,7 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
 
     // Before this line we are not changing the map
     {
-        unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+        unique_lock<ProfiledMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
         if ((fabs(mScale - 1.f) > 0.00001) || !mbMonocular) {
             Sophus::SE3f Twg(mRwg.cast<float>().transpose(), Eigen::Vector3f::Zero());
             mpAtlas->GetCurrentMap()->ApplyScaledRotation(Twg, mScale, true);
@@ -1301,6 +1585,23 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
     }
 
     std::chrono::steady_clock::time_point t4 = std::chrono::steady_clock::now();
+    if (bFIBA && GetBackgroundInertialBA() && !mpLoopCloser->isRunningGBA())
+    {
+        // Keep mapping during the full inertial BA, Run merges its results like the loop
+        // closing GBA through the spanning tree
+        StartFullInertialBA(mpAtlas->GetCurrentMap(), priorG, priorA);
+
+        mnKFs=vpKF.size();
+        mIdxInit++;
+
+        mpTracker->mState=Tracking::OK;
+        bInitializing = false;
+
+        mpCurrentKeyFrame->GetMap()->IncreaseChangeIndex();
+
+        return;
+    }
+
     if (bFIBA)
     {
         if (priorA!=0.f)
@@ -1314,7 +1615,7 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
     Verbose::PrintMess("Global Bundle Adjustment finished\nUpdating map ...", Verbose::VERBOSITY_NORMAL);
 
     // Get Map Mutex
-    unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
 
     unsigned long GBAid = mpCurrentKeyFrame->mnId;
 
@@ -1326,8 +1627,32 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
         lpKF.push_back(mpCurrentKeyFrame);
     }
 
+    CorrectMapWithFullInertialBA(mpAtlas->GetCurrentMap(), GBAid);
+
+    Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
+
+    mnKFs=vpKF.size();
+    mIdxInit++;
+
+    for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+    {
+        (*lit)->SetBadFlag();
+        delete *lit;
+    }
+    mlNewKeyFrames.clear();
+
+    mpTracker->mState=Tracking::OK;
+    bInitializing = false;
+
+    mpCurrentKeyFrame->GetMap()->IncreaseChangeIndex();
+
+    return;
+}
+
+void LocalMapping::CorrectMapWithFullInertialBA(Map* pMap, unsigned long GBAid)
+{
     // Correct keyframes starting at map first keyframe
-    list<KeyFrame*> lpKFtoCheck(mpAtlas->GetCurrentMap()->mvpKeyFrameOrigins.begin(),mpAtlas->GetCurrentMap()->mvpKeyFrameOrigins.end());
+    list<KeyFrame*> lpKFtoCheck(pMap->mvpKeyFrameOrigins.begin(),pMap->mvpKeyFrameOrigins.end());
 
     while(!lpKFtoCheck.empty())
     {
@@ -1376,7 +1701,8 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
     }
 
     // Correct MapPoints
-    const vector<MapPoint*> vpMPs = mpAtlas->GetCurrentMap()->GetAllMapPoints();
+    const Map::MapPointSnapshot pMapPoints = pMap->GetMapPointsSnapshot();
+    const vector<MapPoint*> &vpMPs = *pMapPoints;
 
     for(size_t i=0; i<vpMPs.size(); i++)
     {
@@ -1405,29 +1731,11 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
             pMP->SetWorldPos(pRefKF->GetPoseInverse() * Xc);
         }
     }
-
-    Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
-
-    mnKFs=vpKF.size();
-    mIdxInit++;
-
-    for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-    {
-        (*lit)->SetBadFlag();
-        delete *lit;
-    }
-    mlNewKeyFrames.clear();
-
-    mpTracker->mState=Tracking::OK;
-    bInitializing = false;
-
-    mpCurrentKeyFrame->GetMap()->IncreaseChangeIndex();
-
-    return;
 }
 
 void LocalMapping::ScaleRefinement()
 {
+    TRACE_SCOPE("ScaleRefinement");
     // Minimum number of keyframes to compute a solution
     // Minimum time (seconds) between first and last keyframe to compute a solution. Make the difference between monocular and stereo
     // unique_lock<mutex> lock0(mMutexImuInit);
@@ -1457,6 +1765,8 @@ void LocalMapping::ScaleRefinement()
     mRwg = Eigen::Matrix3d::Identity();
     mScale=1.0;
 
+    StopFullInertialBA();
+
     std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
     Optimizer::InertialOptimization(mpAtlas->GetCurrentMap(), mRwg, mScale);
     std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -1470,7 +1780,7 @@ void LocalMapping::ScaleRefinement()
     
     Sophus::SO3d so3wg(mRwg);
     // Before this line we are not changing the map
-    unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
     std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
     if ((fabs(mScale-1.f)>0.002)||!mbMonocular)
     {
@@ -1497,6 +1807,117 @@ void LocalMapping::ScaleRefinement()
 
 
 
+void LocalMapping::SetBackgroundInertialBA(bool bBackground)
+{
+    unique_lock<mutex> lock(mMutexFIBA);
+    mbBackgroundInertialBA = bBackground;
+}
+
+bool LocalMapping::GetBackgroundInertialBA()
+{
+    unique_lock<mutex> lock(mMutexFIBA);
+    return mbBackgroundInertialBA;
+}
+
+void LocalMapping::StartFullInertialBA(Map* pMap, float priorG, float priorA)
+{
+    unique_lock<mutex> lock(mMutexFIBA);
+    mbStopFIBA = false;
+    mbFinishedFIBA = false;
+    mnFIBAid = mpCurrentKeyFrame->mnId;
+    mpFIBAMap = pMap;
+    mpThreadFIBA = new thread(&LocalMapping::RunFullInertialBA, this, pMap, mnFIBAid, priorG, priorA);
+}
+
+void LocalMapping::RunFullInertialBA(Map* pMap, unsigned long nFIBAid, float priorG, float priorA)
+{
+    Verbose::PrintMess("Starting full inertial BA", Verbose::VERBOSITY_NORMAL);
+
+    // The results are kept in the GBA members of the keyframes and MapPoints
+    if (priorA!=0.f)
+        Optimizer::FullInertialBA(pMap, 100, false, nFIBAid, &mbStopFIBA, true, priorG, priorA);
+    else
+        Optimizer::FullInertialBA(pMap, 100, false, nFIBAid, &mbStopFIBA, false);
+
+    unique_lock<mutex> lock(mMutexFIBA);
+    mbFinishedFIBA = true;
+}
+
+void LocalMapping::StopFullInertialBA()
+{
+    thread* pThreadFIBA;
+    {
+        unique_lock<mutex> lock(mMutexFIBA);
+        if(!mpThreadFIBA)
+            return;
+        mbStopFIBA = true;
+        pThreadFIBA = mpThreadFIBA;
+        mpThreadFIBA = NULL;
+    }
+
+    pThreadFIBA->join();
+    delete pThreadFIBA;
+}
+
+void LocalMapping::MergeFullInertialBA()
+{
+    thread* pThreadFIBA;
+    {
+        unique_lock<mutex> lock(mMutexFIBA);
+        if(!mpThreadFIBA || !mbFinishedFIBA)
+            return;
+        pThreadFIBA = mpThreadFIBA;
+        mpThreadFIBA = NULL;
+    }
+
+    pThreadFIBA->join();
+    delete pThreadFIBA;
+
+    {
+        unique_lock<mutex> lock(mMutexFIBA);
+        if(mbStopFIBA)
+            return;
+    }
+
+    Verbose::PrintMess("Full inertial BA finished\nUpdating map ...", Verbose::VERBOSITY_NORMAL);
+
+    // Keyframes inserted during the BA are corrected with their parents in the spanning tree
+    unique_lock<ProfiledMutex> lock(mpFIBAMap->mMutexMapUpdate);
+    CorrectMapWithFullInertialBA(mpFIBAMap, mnFIBAid);
+    mpFIBAMap->IncreaseChangeIndex();
+
+    Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
+}
+
+void LocalMapping::ReclaimMapPoints()
+{
+    // Background optimizations hold map point vectors without the map locked
+    {
+        unique_lock<mutex> lock(mMutexFIBA);
+        if(mpThreadFIBA)
+            return;
+    }
+    if(mpLoopCloser->isRunningGBA())
+        return;
+
+    mpCurrentKeyFrame->GetMap()->ReclaimMapPoints();
+}
+
+void LocalMapping::ReleaseKeyFrameScratch(const vector<KeyFrame*> &vpNewKFs)
+{
+    // Keyframes leave the local window in insertion order, one still covisible with the new
+    // keyframe is kept. The grid is built again if a loop or a merge searches the keyframe
+    mlpWindowKeyFrames.insert(mlpWindowKeyFrames.end(), vpNewKFs.begin(), vpNewKFs.end());
+    while(mlpWindowKeyFrames.size()>kLocalWindowKeyFrames)
+    {
+        KeyFrame* pKF = mlpWindowKeyFrames.front();
+        mlpWindowKeyFrames.pop_front();
+        if(pKF->GetMap()==mpCurrentKeyFrame->GetMap() && mpCurrentKeyFrame->GetWeight(pKF)>0)
+            continue;
+        pKF->ReleaseGrid();
+    }
+}
+
 bool LocalMapping::IsInitializing()
 {
     return bInitializing;
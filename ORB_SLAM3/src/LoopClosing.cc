@@ -24,6 +24,7 @@
 #include "Optimizer.h"
 #include "ORBmatcher.h"
 #include "G2oTypes.h"
+#include "Trace.h"
 
 #include<mutex>
 #include<thread>
@@ -33,9 +34,10 @@ namespace ORB_SLAM3
 {
 
 LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale, const bool bActiveLC):
-    mbResetRequested(false), mbResetActiveMapRequested(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas),
+    mbResetRequested(false), mbResetActiveMapRequested(false), mbFinishRequested(false), mbFinished(true),
+    mbHoldRequested(false), mbHeld(false), mpAtlas(pAtlas),
     mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
-    mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0), mnLoopNumCoincidences(0), mnMergeNumCoincidences(0),
+    mbStopGBA(false), mpThreadGBA(NULL), mbIncrementalGBA(false), mpRemoteBackend(NULL), mbFixScale(bFixScale), mbAsyncLoopCorrection(false), mbCorrectingLoop(false), mnEssentialGraphThreads(1), mnFullBAIdx(0), mnLoopNumCoincidences(0), mnMergeNumCoincidences(0),
     mbLoopDetected(false), mbMergeDetected(false), mnLoopNumNotFound(0), mnMergeNumNotFound(0), mbActiveLC(bActiveLC)
 {
     mnCovisibilityConsistencyTh = 3;
@@ -90,9 +92,18 @@ void LoopClosing::SetLocalMapper(LocalMapping *pLocalMapper)
 void LoopClosing::Run()
 {
     mbFinished =false;
+    TRACE_THREAD_NAME("LoopClosing");
 
     while(1)
     {
+        if(CheckHold())
+        {
+            ResetIfRequested();
+            if(CheckFinish())
+                break;
+            usleep(3000);
+            continue;
+        }
 
         //NEW LOOP AND MERGE DETECTION ALGORITHM
         //----------------------------
@@ -310,25 +321,26 @@ void LoopClosing::Run()
 
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexLoopQueue);
+    unique_lock<ProfiledMutex> lock(mMutexLoopQueue);
     if(pKF->mnId!=0)
         mlpLoopKeyFrameQueue.push_back(pKF);
 }
 
 bool LoopClosing::CheckNewKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexLoopQueue);
+    unique_lock<ProfiledMutex> lock(mMutexLoopQueue);
     return(!mlpLoopKeyFrameQueue.empty());
 }
 
 bool LoopClosing::NewDetectCommonRegions()
 {
+    TRACE_SCOPE("DetectCommonRegions");
     // To deactivate placerecognition. No loopclosing nor merging will be performed
     if(!mbActiveLC)
         return false;
 
     {
-        unique_lock<mutex> lock(mMutexLoopQueue);
+        unique_lock<ProfiledMutex> lock(mMutexLoopQueue);
         mpCurrentKF = mlpLoopKeyFrameQueue.front();
         mlpLoopKeyFrameQueue.pop_front();
         // Avoid that a keyframe can be erased while it is being process by this thread
@@ -345,7 +357,7 @@ bool LoopClosing::NewDetectCommonRegions()
         return false;
     }
 
-    if(mpTracker->mSensor == System::STEREO && mpLastMap->GetAllKeyFrames().size() < 5) //12
+    if(mpTracker->mSensor == System::STEREO && mpLastMap->KeyFramesInMap() < 5) //12
     {
         // cout << "LoopClousure: Stereo KF inserted without check: " << mpCurrentKF->mnId << endl;
         mpKeyFrameDB->add(mpCurrentKF);
@@ -353,7 +365,7 @@ bool LoopClosing::NewDetectCommonRegions()
         return false;
     }
 
-    if(mpLastMap->GetAllKeyFrames().size() < 12)
+    if(mpLastMap->KeyFramesInMap() < 12)
     {
         // cout << "LoopClousure: Stereo KF inserted without check, map is small: " << mpCurrentKF->mnId << endl;
         mpKeyFrameDB->add(mpCurrentKF);
@@ -577,6 +589,60 @@ bool LoopClosing::DetectAndReffineSim3FromLastKF(KeyFrame* pCurrentKF, KeyFrame*
 
 bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<KeyFrame*> &vpBowCand, KeyFrame* &pMatchedKF2, KeyFrame* &pLastCurrentKF, g2o::Sim3 &g2oScw,
                                              int &nNumCoincidences, std::vector<MapPoint*> &vpMPs, std::vector<MapPoint*> &vpMatchedMPs)
+{
+    set<KeyFrame*> spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
+
+    // Candidates are independent until the best one is chosen, verify them on the worker pool
+    const int numCandidates = vpBowCand.size();
+    vector<bool> vbValid(numCandidates, false);
+    vector<KeyFrame*> vpMostBoWMatchesKF(numCandidates, static_cast<KeyFrame*>(NULL));
+    vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > vgScw(numCandidates);
+    vector<int> vnProjOptMatches(numCandidates, 0);
+    vector<int> vnNumKFs(numCandidates, 0);
+    vector<vector<MapPoint*> > vvpMapPoints(numCandidates);
+    vector<vector<MapPoint*> > vvpMatchedMapPoints(numCandidates);
+
+    //Verbose::PrintMess("BoW candidates: There are " + to_string(vpBowCand.size()) + " possible candidates ", Verbose::VERBOSITY_DEBUG);
+    RunParallel(numCandidates, [&](int i)
+    {
+        vbValid[i] = VerifyBoWCandidate(vpBowCand[i], spConnectedKeyFrames, vpMostBoWMatchesKF[i], vgScw[i], vnProjOptMatches[i],
+                                        vnNumKFs[i], vvpMapPoints[i], vvpMatchedMapPoints[i]);
+    });
+
+    // Varibles to select the best numbe, in the candidate order as the first one wins the ties
+    KeyFrame* pBestMatchedKF;
+    int nBestMatchesReproj = 0;
+    int nBestNumCoindicendes = 0;
+    int nBestIndex = -1;
+    for(int i=0; i<numCandidates; ++i)
+    {
+        if(vbValid[i] && nBestMatchesReproj < vnProjOptMatches[i])
+        {
+            nBestMatchesReproj = vnProjOptMatches[i];
+            nBestNumCoindicendes = vnNumKFs[i];
+            pBestMatchedKF = vpMostBoWMatchesKF[i];
+            nBestIndex = i;
+        }
+    }
+
+    if(nBestMatchesReproj > 0)
+    {
+        pLastCurrentKF = mpCurrentKF;
+        nNumCoincidences = nBestNumCoindicendes;
+        pMatchedKF2 = pBestMatchedKF;
+        pMatchedKF2->SetNotErase();
+        g2oScw = vgScw[nBestIndex];
+        vpMPs.swap(vvpMapPoints[nBestIndex]);
+        vpMatchedMPs.swap(vvpMatchedMapPoints[nBestIndex]);
+
+        return nNumCoincidences >= 3;
+    }
+    return false;
+}
+
+bool LoopClosing::VerifyBoWCandidate(KeyFrame* pKFi, const set<KeyFrame*> &spConnectedKeyFrames, KeyFrame* &pMostBoWMatchesKF,
+                                     g2o::Sim3 &gScw, int &nNumProjOptMatches, int &nNumKFs,
+                                     std::vector<MapPoint*> &vpMapPoints, std::vector<MapPoint*> &vpMatchedMP)
 {
     int nBoWMatches = 20;
     int nBoWInliers = 15;
@@ -584,315 +650,205 @@ bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<KeyFrame*> &vpBowCand,
     int nProjMatches = 50;
     int nProjOptMatches = 80;
 
-    set<KeyFrame*> spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
-
     int nNumCovisibles = 10;
 
     ORBmatcher matcherBoW(0.9, true);
     ORBmatcher matcher(0.75, true);
 
-    // Varibles to select the best numbe
-    KeyFrame* pBestMatchedKF;
-    int nBestMatchesReproj = 0;
-    int nBestNumCoindicendes = 0;
-    g2o::Sim3 g2oBestScw;
-    std::vector<MapPoint*> vpBestMapPoints;
-    std::vector<MapPoint*> vpBestMatchedMapPoints;
-
-    int numCandidates = vpBowCand.size();
-    vector<int> vnStage(numCandidates, 0);
-    vector<int> vnMatchesStage(numCandidates, 0);
+    if(!pKFi || pKFi->isBad())
+        return false;
 
-    int index = 0;
-    //Verbose::PrintMess("BoW candidates: There are " + to_string(vpBowCand.size()) + " possible candidates ", Verbose::VERBOSITY_DEBUG);
-    for(KeyFrame* pKFi : vpBowCand)
+    // std::cout << "KF candidate: " << pKFi->mnId << std::endl;
+    // Current KF against KF with covisibles version
+    std::vector<KeyFrame*> vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    if(vpCovKFi.empty())
     {
-        if(!pKFi || pKFi->isBad())
-            continue;
-
-        // std::cout << "KF candidate: " << pKFi->mnId << std::endl;
-        // Current KF against KF with covisibles version
-        std::vector<KeyFrame*> vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
-        if(vpCovKFi.empty())
-        {
-            std::cout << "Covisible list empty" << std::endl;
-            vpCovKFi.push_back(pKFi);
-        }
-        else
-        {
-            vpCovKFi.push_back(vpCovKFi[0]);
-            vpCovKFi[0] = pKFi;
-        }
+        std::cout << "Covisible list empty" << std::endl;
+        vpCovKFi.push_back(pKFi);
+    }
+    else
+    {
+        vpCovKFi.push_back(vpCovKFi[0]);
+        vpCovKFi[0] = pKFi;
+    }
 
 
-        bool bAbortByNearKF = false;
-        for(int j=0; j<vpCovKFi.size(); ++j)
-        {
-            if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
-            {
-                bAbortByNearKF = true;
-                break;
-            }
-        }
-        if(bAbortByNearKF)
+    bool bAbortByNearKF = false;
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
         {
-            //std::cout << "Check BoW aborted because is close to the matched one " << std::endl;
-            continue;
+            bAbortByNearKF = true;
+            break;
         }
-        //std::cout << "Check BoW continue because is far to the matched one " << std::endl;
+    }
+    if(bAbortByNearKF)
+    {
+        //std::cout << "Check BoW aborted because is close to the matched one " << std::endl;
+        return false;
+    }
+    //std::cout << "Check BoW continue because is far to the matched one " << std::endl;
 
 
-        std::vector<std::vector<MapPoint*> > vvpMatchedMPs;
-        vvpMatchedMPs.resize(vpCovKFi.size());
-        std::set<MapPoint*> spMatchedMPi;
-        int numBoWMatches = 0;
+    std::vector<std::vector<MapPoint*> > vvpMatchedMPs;
+    vvpMatchedMPs.resize(vpCovKFi.size());
+    std::set<MapPoint*> spMatchedMPi;
+    int numBoWMatches = 0;
 
-        KeyFrame* pMostBoWMatchesKF = pKFi;
-        int nMostBoWNumMatches = 0;
+    pMostBoWMatchesKF = pKFi;
+    int nMostBoWNumMatches = 0;
 
-        std::vector<MapPoint*> vpMatchedPoints = std::vector<MapPoint*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
-        std::vector<KeyFrame*> vpKeyFrameMatchedMP = std::vector<KeyFrame*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
+    std::vector<MapPoint*> vpMatchedPoints = std::vector<MapPoint*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
+    std::vector<KeyFrame*> vpKeyFrameMatchedMP = std::vector<KeyFrame*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
 
-        int nIndexMostBoWMatchesKF=0;
-        for(int j=0; j<vpCovKFi.size(); ++j)
-        {
-            if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
-                continue;
+    int nIndexMostBoWMatchesKF=0;
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
+            continue;
 
-            int num = matcherBoW.SearchByBoW(mpCurrentKF, vpCovKFi[j], vvpMatchedMPs[j]);
-            if (num > nMostBoWNumMatches)
-            {
-                nMostBoWNumMatches = num;
-                nIndexMostBoWMatchesKF = j;
-            }
+        int num = matcherBoW.SearchByBoW(mpCurrentKF, vpCovKFi[j], vvpMatchedMPs[j]);
+        if (num > nMostBoWNumMatches)
+        {
+            nMostBoWNumMatches = num;
+            nIndexMostBoWMatchesKF = j;
         }
+    }
 
-        for(int j=0; j<vpCovKFi.size(); ++j)
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
         {
-            for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
-            {
-                MapPoint* pMPi_j = vvpMatchedMPs[j][k];
-                if(!pMPi_j || pMPi_j->isBad())
-                    continue;
+            MapPoint* pMPi_j = vvpMatchedMPs[j][k];
+            if(!pMPi_j || pMPi_j->isBad())
+                continue;
 
-                if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
-                {
-                    spMatchedMPi.insert(pMPi_j);
-                    numBoWMatches++;
+            if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
+            {
+                spMatchedMPi.insert(pMPi_j);
+                numBoWMatches++;
 
-                    vpMatchedPoints[k]= pMPi_j;
-                    vpKeyFrameMatchedMP[k] = vpCovKFi[j];
-                }
+                vpMatchedPoints[k]= pMPi_j;
+                vpKeyFrameMatchedMP[k] = vpCovKFi[j];
             }
         }
+    }
 
-        //pMostBoWMatchesKF = vpCovKFi[pMostBoWMatchesKF];
+    //pMostBoWMatchesKF = vpCovKFi[pMostBoWMatchesKF];
 
-        if(numBoWMatches >= nBoWMatches) // TODO pick a good threshold
-        {
-            // Geometric validation
-            bool bFixedScale = mbFixScale;
-            if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                bFixedScale=false;
-
-            Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
-            solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
-
-            bool bNoMore = false;
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bConverge = false;
-            Eigen::Matrix4f mTcm;
-            while(!bConverge && !bNoMore)
-            {
-                mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
-                //Verbose::PrintMess("BoW guess: Solver achieve " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
-            }
+    if(numBoWMatches < nBoWMatches) // TODO pick a good threshold
+        return false;
 
-            if(bConverge)
-            {
-                //std::cout << "Check BoW: SolverSim3 converged" << std::endl;
+    // Geometric validation
+    bool bFixedScale = mbFixScale;
+    if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
+        bFixedScale=false;
 
-                //Verbose::PrintMess("BoW guess: Convergende with " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
-                // Match by reprojection
-                vpCovKFi.clear();
-                vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
-                vpCovKFi.push_back(pMostBoWMatchesKF);
-                set<KeyFrame*> spCheckKFs(vpCovKFi.begin(), vpCovKFi.end());
+    Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
+    solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
 
-                //std::cout << "There are " << vpCovKFi.size() <<" near KFs" << std::endl;
+    bool bNoMore = false;
+    vector<bool> vbInliers;
+    int nInliers;
+    bool bConverge = false;
+    Eigen::Matrix4f mTcm;
+    while(!bConverge && !bNoMore)
+    {
+        mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
+        //Verbose::PrintMess("BoW guess: Solver achieve " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
+    }
 
-                set<MapPoint*> spMapPoints;
-                vector<MapPoint*> vpMapPoints;
-                vector<KeyFrame*> vpKeyFrames;
-                for(KeyFrame* pCovKFi : vpCovKFi)
-                {
-                    for(MapPoint* pCovMPij : pCovKFi->GetMapPointMatches())
-                    {
-                        if(!pCovMPij || pCovMPij->isBad())
-                            continue;
+    if(!bConverge)
+    {
+        //Verbose::PrintMess("BoW candidate: it don't match with the current one", Verbose::VERBOSITY_DEBUG);
+        return false;
+    }
 
-                        if(spMapPoints.find(pCovMPij) == spMapPoints.end())
-                        {
-                            spMapPoints.insert(pCovMPij);
-                            vpMapPoints.push_back(pCovMPij);
-                            vpKeyFrames.push_back(pCovKFi);
-                        }
-                    }
-                }
+    //std::cout << "Check BoW: SolverSim3 converged" << std::endl;
 
-                //std::cout << "There are " << vpKeyFrames.size() <<" KFs which view all the mappoints" << std::endl;
+    //Verbose::PrintMess("BoW guess: Convergende with " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
+    // Match by reprojection
+    vpCovKFi.clear();
+    vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    vpCovKFi.push_back(pMostBoWMatchesKF);
+    set<KeyFrame*> spCheckKFs(vpCovKFi.begin(), vpCovKFi.end());
 
-                g2o::Sim3 gScm(solver.GetEstimatedRotation().cast<double>(),solver.GetEstimatedTranslation().cast<double>(), (double) solver.GetEstimatedScale());
-                g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
-                g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                Sophus::Sim3f mScw = Converter::toSophus(gScw);
+    //std::cout << "There are " << vpCovKFi.size() <<" near KFs" << std::endl;
 
-                vector<MapPoint*> vpMatchedMP;
-                vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
-                vector<KeyFrame*> vpMatchedKF;
-                vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
-                int numProjMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMP, vpMatchedKF, 8, 1.5);
-                //cout <<"BoW: " << numProjMatches << " matches between " << vpMapPoints.size() << " points with coarse Sim3" << endl;
+    set<MapPoint*> spMapPoints;
+    vpMapPoints.clear();
+    vector<KeyFrame*> vpKeyFrames;
+    for(KeyFrame* pCovKFi : vpCovKFi)
+    {
+        for(MapPoint* pCovMPij : pCovKFi->GetMapPointMatches())
+        {
+            if(!pCovMPij || pCovMPij->isBad())
+                continue;
 
-                if(numProjMatches >= nProjMatches)
-                {
-                    // Optimize Sim3 transformation with every matches
-                    Eigen::Matrix<double, 7, 7> mHessian7x7;
+            if(spMapPoints.find(pCovMPij) == spMapPoints.end())
+            {
+                spMapPoints.insert(pCovMPij);
+                vpMapPoints.push_back(pCovMPij);
+                vpKeyFrames.push_back(pCovKFi);
+            }
+        }
+    }
 
-                    bool bFixedScale = mbFixScale;
-                    if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                        bFixedScale=false;
+    //std::cout << "There are " << vpKeyFrames.size() <<" KFs which view all the mappoints" << std::endl;
 
-                    int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMP, gScm, 10, mbFixScale, mHessian7x7, true);
+    g2o::Sim3 gScm(solver.GetEstimatedRotation().cast<double>(),solver.GetEstimatedTranslation().cast<double>(), (double) solver.GetEstimatedScale());
+    g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
+    gScw = gScm*gSmw; // Similarity matrix of current from the world position
+    Sophus::Sim3f mScw = Converter::toSophus(gScw);
 
-                    if(numOptMatches >= nSim3Inliers)
-                    {
-                        g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
-                        g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                        Sophus::Sim3f mScw = Converter::toSophus(gScw);
+    vector<MapPoint*> vpMatchedMPCoarse;
+    vpMatchedMPCoarse.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
+    vector<KeyFrame*> vpMatchedKF;
+    vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
+    int numProjMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMPCoarse, vpMatchedKF, 8, 1.5);
+    //cout <<"BoW: " << numProjMatches << " matches between " << vpMapPoints.size() << " points with coarse Sim3" << endl;
 
-                        vector<MapPoint*> vpMatchedMP;
-                        vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
-                        int numProjOptMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
+    if(numProjMatches < nProjMatches)
+        return false;
 
-                        if(numProjOptMatches >= nProjOptMatches)
-                        {
-                            int max_x = -1, min_x = 1000000;
-                            int max_y = -1, min_y = 1000000;
-                            for(MapPoint* pMPi : vpMatchedMP)
-                            {
-                                if(!pMPi || pMPi->isBad())
-                                {
-                                    continue;
-                                }
+    // Optimize Sim3 transformation with every matches
+    Eigen::Matrix<double, 7, 7> mHessian7x7;
 
-                                tuple<size_t,size_t> indexes = pMPi->GetIndexInKeyFrame(pKFi);
-                                int index = get<0>(indexes);
-                                if(index >= 0)
-                                {
-                                    int coord_x = pKFi->mvKeysUn[index].pt.x;
-                                    if(coord_x < min_x)
-                                    {
-                                        min_x = coord_x;
-                                    }
-                                    if(coord_x > max_x)
-                                    {
-                                        max_x = coord_x;
-                                    }
-                                    int coord_y = pKFi->mvKeysUn[index].pt.y;
-                                    if(coord_y < min_y)
-                                    {
-                                        min_y = coord_y;
-                                    }
-                                    if(coord_y > max_y)
-                                    {
-                                        max_y = coord_y;
-                                    }
-                                }
-                            }
+    int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMPCoarse, gScm, 10, mbFixScale, mHessian7x7, true);
 
-                            int nNumKFs = 0;
-                            //vpMatchedMPs = vpMatchedMP;
-                            //vpMPs = vpMapPoints;
-                            // Check the Sim3 transformation with the current KeyFrame covisibles
-                            vector<KeyFrame*> vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    if(numOptMatches < nSim3Inliers)
+        return false;
 
-                            int j = 0;
-                            while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
-                            {
-                                KeyFrame* pKFj = vpCurrentCovKFs[j];
-                                Sophus::SE3d mTjc = (pKFj->GetPose() * mpCurrentKF->GetPoseInverse()).cast<double>();
-                                g2o::Sim3 gSjc(mTjc.unit_quaternion(),mTjc.translation(),1.0);
-                                g2o::Sim3 gSjw = gSjc * gScw;
-                                int numProjMatches_j = 0;
-                                vector<MapPoint*> vpMatchedMPs_j;
-                                bool bValid = DetectCommonRegionsFromLastKF(pKFj,pMostBoWMatchesKF, gSjw,numProjMatches_j, vpMapPoints, vpMatchedMPs_j);
-
-                                if(bValid)
-                                {
-                                    Sophus::SE3f Tc_w = mpCurrentKF->GetPose();
-                                    Sophus::SE3f Tw_cj = pKFj->GetPoseInverse();
-                                    Sophus::SE3f Tc_cj = Tc_w * Tw_cj;
-                                    Eigen::Vector3f vector_dist = Tc_cj.translation();
-                                    nNumKFs++;
-                                }
-                                j++;
-                            }
+    gScw = gScm*gSmw; // Similarity matrix of current from the world position
+    mScw = Converter::toSophus(gScw);
 
-                            if(nNumKFs < 3)
-                            {
-                                vnStage[index] = 8;
-                                vnMatchesStage[index] = nNumKFs;
-                            }
+    vpMatchedMP.assign(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
+    nNumProjOptMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
 
-                            if(nBestMatchesReproj < numProjOptMatches)
-                            {
-                                nBestMatchesReproj = numProjOptMatches;
-                                nBestNumCoindicendes = nNumKFs;
-                                pBestMatchedKF = pMostBoWMatchesKF;
-                                g2oBestScw = gScw;
-                                vpBestMapPoints = vpMapPoints;
-                                vpBestMatchedMapPoints = vpMatchedMP;
-                            }
-                        }
-                    }
-                }
-            }
-            /*else
-            {
-                Verbose::PrintMess("BoW candidate: it don't match with the current one", Verbose::VERBOSITY_DEBUG);
-            }*/
-        }
-        index++;
-    }
+    if(nNumProjOptMatches < nProjOptMatches)
+        return false;
 
-    if(nBestMatchesReproj > 0)
-    {
-        pLastCurrentKF = mpCurrentKF;
-        nNumCoincidences = nBestNumCoindicendes;
-        pMatchedKF2 = pBestMatchedKF;
-        pMatchedKF2->SetNotErase();
-        g2oScw = g2oBestScw;
-        vpMPs = vpBestMapPoints;
-        vpMatchedMPs = vpBestMatchedMapPoints;
+    nNumKFs = 0;
+    // Check the Sim3 transformation with the current KeyFrame covisibles
+    vector<KeyFrame*> vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
 
-        return nNumCoincidences >= 3;
-    }
-    else
+    int j = 0;
+    while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
     {
-        int maxStage = -1;
-        int maxMatched;
-        for(int i=0; i<vnStage.size(); ++i)
-        {
-            if(vnStage[i] > maxStage)
-            {
-                maxStage = vnStage[i];
-                maxMatched = vnMatchesStage[i];
-            }
-        }
+        KeyFrame* pKFj = vpCurrentCovKFs[j];
+        Sophus::SE3d mTjc = (pKFj->GetPose() * mpCurrentKF->GetPoseInverse()).cast<double>();
+        g2o::Sim3 gSjc(mTjc.unit_quaternion(),mTjc.translation(),1.0);
+        g2o::Sim3 gSjw = gSjc * gScw;
+        int numProjMatches_j = 0;
+        vector<MapPoint*> vpMatchedMPs_j;
+        bool bValid = DetectCommonRegionsFromLastKF(pKFj,pMostBoWMatchesKF, gSjw,numProjMatches_j, vpMapPoints, vpMatchedMPs_j);
+
+        if(bValid)
+            nNumKFs++;
+        j++;
     }
-    return false;
+
+    return true;
 }
 
 bool LoopClosing::DetectCommonRegionsFromLastKF(KeyFrame* pCurrentKF, KeyFrame* pMatchedKF, g2o::Sim3 &gScw, int &nNumProjMatches,
@@ -968,6 +924,7 @@ int LoopClosing::FindMatchesByProjection(KeyFrame* pCurrentKF, KeyFrame* pMatche
 
 void LoopClosing::CorrectLoop()
 {
+    TRACE_SCOPE("CorrectLoop");
     //cout << "Loop detected!" << endl;
 
     // Send a stop signal to Local Mapping
@@ -1010,6 +967,20 @@ void LoopClosing::CorrectLoop()
 
     //std::cout << "Loop: number of connected KFs -> " + to_string(mvpCurrentConnectedKFs.size()) << std::endl;
 
+    // Poses before the correction, to find the keyframes moved by the loop for the incremental Global BA
+    bool bIncrementalGBA;
+    {
+        unique_lock<mutex> lock(mMutexGBA);
+        bIncrementalGBA = mbIncrementalGBA;
+    }
+    map<KeyFrame*,Sophus::SE3f> mPosesBefCorrection;
+    if(bIncrementalGBA)
+    {
+        const vector<KeyFrame*> vpMapKFs = mpCurrentKF->GetMap()->GetAllKeyFrames();
+        for(size_t i=0; i<vpMapKFs.size(); i++)
+            mPosesBefCorrection[vpMapKFs[i]] = vpMapKFs[i]->GetPose();
+    }
+
     KeyFrameAndPose CorrectedSim3, NonCorrectedSim3;
     CorrectedSim3[mpCurrentKF]=mg2oLoopScw;
     Sophus::SE3f Twc = mpCurrentKF->GetPoseInverse();
@@ -1038,7 +1009,7 @@ void LoopClosing::CorrectLoop()
 
     {
         // Get Map Mutex
-        unique_lock<mutex> lock(pLoopMap->mMutexMapUpdate);
+        unique_lock<ProfiledMutex> lock(pLoopMap->mMutexMapUpdate);
 
         const bool bImuInit = pLoopMap->isImuInitialized();
 
@@ -1172,15 +1143,45 @@ void LoopClosing::CorrectLoop()
         double timeFusion = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndFusion - time_StartFusion).count();
         vdLoopFusion_ms.push_back(timeFusion);
 #endif
+    // The loop is fused, with an asynchronous correction Local Mapping is released while the essential graph is optimized.
+    // Not before the inertial initialization is finished, it changes the world frame of the map
+    const bool bAsync = GetAsyncLoopCorrection() && (!pLoopMap->IsInertial() || pLoopMap->GetIniertialBA2());
+    KeyFrameAndPose LoopCorrections;
+    if(bAsync)
+    {
+        {
+            unique_lock<mutex> lock(mMutexLoopCorrection);
+            mbCorrectingLoop = true;
+        }
+        mpLocalMapper->Release();
+    }
+
     //cout << "Optimize essential graph" << endl;
     if(pLoopMap->IsInertial() && pLoopMap->isImuInitialized())
     {
-        Optimizer::OptimizeEssentialGraph4DoF(pLoopMap, mpLoopMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections);
+        Optimizer::OptimizeEssentialGraph4DoF(pLoopMap, mpLoopMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections,
+                                              bAsync ? &LoopCorrections : NULL, GetEssentialGraphThreads());
     }
     else
     {
         //cout << "Loop -> Scale correction: " << mg2oLoopScw.scale() << endl;
-        Optimizer::OptimizeEssentialGraph(pLoopMap, mpLoopMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, bFixedScale);
+        Optimizer::OptimizeEssentialGraph(pLoopMap, mpLoopMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, bFixedScale,
+                                          bAsync ? &LoopCorrections : NULL, GetEssentialGraphThreads());
+    }
+
+    if(bAsync)
+    {
+        // Stop Local Mapping again, only to apply the correction
+        mpLocalMapper->RequestStop();
+        while(!mpLocalMapper->isStopped())
+        {
+            usleep(1000);
+        }
+
+        ApplyLoopCorrection(pLoopMap, LoopCorrections);
+
+        unique_lock<mutex> lock(mMutexLoopCorrection);
+        mbCorrectingLoop = false;
     }
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_EndOpt = std::chrono::steady_clock::now();
@@ -1195,6 +1196,9 @@ void LoopClosing::CorrectLoop()
     mpLoopMatchedKF->AddLoopEdge(mpCurrentKF);
     mpCurrentKF->AddLoopEdge(mpLoopMatchedKF);
 
+    if(bIncrementalGBA)
+        AddGBAPendingKeyFrames(pLoopMap, mPosesBefCorrection);
+
     // Launch a new thread to perform Global Bundle Adjustment (Only if few keyframes, if not it would take too much time)
     if(!pLoopMap->isImuInitialized() || (pLoopMap->KeyFramesInMap()<200 && mpAtlas->CountMaps()==1))
     {
@@ -1212,8 +1216,187 @@ void LoopClosing::CorrectLoop()
     mLastLoopKFid = mpCurrentKF->mnId; //TODO old varible, it is not use in the new algorithm
 }
 
+void LoopClosing::AddGBAPendingKeyFrames(Map* pMap, const map<KeyFrame*,Sophus::SE3f> &mPosesBefCorrection)
+{
+    // Relinearization thresholds, keyframes moved less than this by the loop correction are not reoptimized
+    const float thAngle = 0.2f*M_PI/180.f;
+    const float thDist = 0.01f*mpCurrentKF->ComputeSceneMedianDepth(2);
+
+    unique_lock<mutex> lock(mMutexGBA);
+
+    // A Global BA pending on another map can not be resumed
+    if(!mspGBAPendingKFs.empty() && (*mspGBAPendingKFs.begin())->GetMap()!=pMap)
+        mspGBAPendingKFs.clear();
+
+    // The keyframes of both sides of the loop are always reoptimized
+    mspGBAPendingKFs.insert(mvpCurrentConnectedKFs.begin(),mvpCurrentConnectedKFs.end());
+    const vector<KeyFrame*> vpMatchedConnectedKFs = mpLoopMatchedKF->GetVectorCovisibleKeyFrames();
+    mspGBAPendingKFs.insert(vpMatchedConnectedKFs.begin(),vpMatchedConnectedKFs.end());
+    mspGBAPendingKFs.insert(mpLoopMatchedKF);
+
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKFi = vpKFs[i];
+        if(pKFi->isBad())
+            continue;
+
+        // Keyframes inserted during an asynchronous correction have no previous pose
+        map<KeyFrame*,Sophus::SE3f>::const_iterator mit = mPosesBefCorrection.find(pKFi);
+        if(mit==mPosesBefCorrection.end())
+        {
+            mspGBAPendingKFs.insert(pKFi);
+            continue;
+        }
+
+        const Sophus::SE3f Tcorr = pKFi->GetPose() * mit->second.inverse();
+        if(Tcorr.so3().log().norm()>thAngle || (pKFi->GetCameraCenter()-mit->second.inverse().translation()).norm()>thDist)
+            mspGBAPendingKFs.insert(pKFi);
+    }
+}
+
+void LoopClosing::ApplyLoopCorrection(Map* pMap, KeyFrameAndPose &LoopCorrections)
+{
+    unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
+
+    // Keyframes of the optimized graph, map points fused with the loop are corrected with their mnCorrectedReference
+    map<long unsigned int, KeyFrame*> mpCorrectedKFs;
+    for(KeyFrameAndPose::iterator mit=LoopCorrections.begin(), mend=LoopCorrections.end(); mit!=mend; mit++)
+        mpCorrectedKFs[mit->first->mnId] = mit->first;
+
+    // Keyframes inserted by Local Mapping during the optimization take the correction of their parent in the spanning tree
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKFi = vpKFs[i];
+        if(LoopCorrections.count(pKFi))
+            continue;
+
+        vector<KeyFrame*> vpPath;
+        KeyFrame* pKFp = pKFi;
+        while(pKFp && !LoopCorrections.count(pKFp) && vpPath.size()<=vpKFs.size())
+        {
+            vpPath.push_back(pKFp);
+            pKFp = pKFp->GetParent();
+        }
+
+        if(!pKFp || !LoopCorrections.count(pKFp))
+            continue;
+
+        const g2o::Sim3 Corr = LoopCorrections[pKFp];
+        for(size_t j=0; j<vpPath.size(); j++)
+            LoopCorrections[vpPath[j]] = Corr;
+    }
+
+    // Correct the current pose, which keeps the refinement done by Local Mapping since the snapshot.
+    // Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKFi = vpKFs[i];
+        KeyFrameAndPose::const_iterator it = LoopCorrections.find(pKFi);
+        if(it==LoopCorrections.end())
+            continue;
+
+        Sophus::SE3d Tiw = pKFi->GetPose().cast<double>();
+        g2o::Sim3 CorrectedSiw = g2o::Sim3(Tiw.unit_quaternion(),Tiw.translation(),1.0) * it->second.inverse();
+        Sophus::SE3d correctedTiw(CorrectedSiw.rotation(),CorrectedSiw.translation() / CorrectedSiw.scale());
+        pKFi->SetPose(correctedTiw.cast<float>());
+    }
+
+    // Correct points with the correction of their reference keyframe
+    const Map::MapPointSnapshot pMapPoints = pMap->GetMapPointsSnapshot();
+    const vector<MapPoint*> &vpMPs = *pMapPoints;
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMPi = vpMPs[i];
+        if(pMPi->isBad())
+            continue;
+
+        KeyFrame* pRefKF = pMPi->GetReferenceKeyFrame();
+        if(pMPi->mnCorrectedByKF==mpCurrentKF->mnId && mpCorrectedKFs.count(pMPi->mnCorrectedReference))
+            pRefKF = mpCorrectedKFs[pMPi->mnCorrectedReference];
+
+        KeyFrameAndPose::const_iterator it = LoopCorrections.find(pRefKF);
+        if(it==LoopCorrections.end())
+            continue;
+
+        Eigen::Vector3d P3Dw = pMPi->GetWorldPos().cast<double>();
+        pMPi->SetWorldPos(it->second.map(P3Dw).cast<float>());
+        pMPi->UpdateNormalAndDepth();
+    }
+
+    pMap->IncreaseChangeIndex();
+}
+
+void LoopClosing::SetParallelFor(const ORBmatcher::ParallelFor& parallelFor)
+{
+    unique_lock<mutex> lock(mMutexParallelFor);
+    mParallelFor = parallelFor;
+}
+
+void LoopClosing::RunParallel(int n, const std::function<void(int)>& job)
+{
+    ORBmatcher::ParallelFor parallelFor;
+    {
+        unique_lock<mutex> lock(mMutexParallelFor);
+        parallelFor = mParallelFor;
+    }
+
+    if(parallelFor)
+        parallelFor(n, job);
+    else
+        for(int i=0; i<n; i++)
+            job(i);
+}
+
+void LoopClosing::SetAsyncLoopCorrection(bool bAsync)
+{
+    unique_lock<mutex> lock(mMutexLoopCorrection);
+    mbAsyncLoopCorrection = bAsync;
+}
+
+bool LoopClosing::GetAsyncLoopCorrection()
+{
+    unique_lock<mutex> lock(mMutexLoopCorrection);
+    return mbAsyncLoopCorrection;
+}
+
+void LoopClosing::SetEssentialGraphThreads(int n)
+{
+    unique_lock<mutex> lock(mMutexLoopCorrection);
+    mnEssentialGraphThreads = std::max(n, 1);
+}
+
+int LoopClosing::GetEssentialGraphThreads()
+{
+    unique_lock<mutex> lock(mMutexLoopCorrection);
+    return mnEssentialGraphThreads;
+}
+
+bool LoopClosing::isCorrectingLoop()
+{
+    unique_lock<mutex> lock(mMutexLoopCorrection);
+    return mbCorrectingLoop;
+}
+
+void LoopClosing::SetIncrementalGBA(bool bIncremental)
+{
+    unique_lock<mutex> lock(mMutexGBA);
+    mbIncrementalGBA = bIncremental;
+    mspGBAPendingKFs.clear();
+}
+
+void LoopClosing::SetRemoteBackend(RemoteBackend* pRemoteBackend)
+{
+    unique_lock<mutex> lock(mMutexGBA);
+    mpRemoteBackend = pRemoteBackend;
+}
+
 void LoopClosing::MergeLocal()
 {
+    TRACE_SCOPE("MergeLocal");
     int numTemporalKFs = 25; //Temporal KFs in the local window if the map is inertial.
 
     //Relationship to rebuild the essential graph, it is used two times, first in the local window and later in the rest of the map
@@ -1466,26 +1649,21 @@ void LoopClosing::MergeLocal()
 
     int numPointsWithCorrection = 0;
 
-    //for(MapPoint* pMPi : spLocalWindowMPs)
-    set<MapPoint*>::iterator itMP = spLocalWindowMPs.begin();
-    while(itMP != spLocalWindowMPs.end())
+    // The corrections of the points are independent, they are computed in parallel
+    vector<MapPoint*> vpLocalWindowMPs(spLocalWindowMPs.begin(), spLocalWindowMPs.end());
+    vector<char> vbCorrectedMP(vpLocalWindowMPs.size(), 0);
+    RunParallel(vpLocalWindowMPs.size(), [&](int i)
     {
-        MapPoint* pMPi = *itMP;
+        MapPoint* pMPi = vpLocalWindowMPs[i];
         if(!pMPi || pMPi->isBad())
-        {
-            itMP = spLocalWindowMPs.erase(itMP);
-            continue;
-        }
+            return;
 
         KeyFrame* pKFref = pMPi->GetReferenceKeyFrame();
-        if(vCorrectedSim3.find(pKFref) == vCorrectedSim3.end())
-        {
-            itMP = spLocalWindowMPs.erase(itMP);
-            numPointsWithCorrection++;
-            continue;
-        }
-        g2o::Sim3 g2oCorrectedSwi = vCorrectedSim3[pKFref].inverse();
-        g2o::Sim3 g2oNonCorrectedSiw = vNonCorrectedSim3[pKFref];
+        KeyFrameAndPose::const_iterator itCorrected = vCorrectedSim3.find(pKFref);
+        if(itCorrected == vCorrectedSim3.end())
+            return;
+        g2o::Sim3 g2oCorrectedSwi = itCorrected->second.inverse();
+        g2o::Sim3 g2oNonCorrectedSiw = vNonCorrectedSim3.find(pKFref)->second;
 
         // Project with non-corrected pose and project back with corrected pose
         Eigen::Vector3d P3Dw = pMPi->GetWorldPos().cast<double>();
@@ -1494,8 +1672,17 @@ void LoopClosing::MergeLocal()
 
         pMPi->mPosMerge = eigCorrectedP3Dw.cast<float>();
         pMPi->mNormalVectorMerge = Rcor.cast<float>() * pMPi->GetNormal();
+        vbCorrectedMP[i] = 1;
+    });
 
-        itMP++;
+    vector<MapPoint*> vpCorrectedWindowMPs;
+    vpCorrectedWindowMPs.reserve(vpLocalWindowMPs.size());
+    for(size_t i=0; i<vpLocalWindowMPs.size(); i++)
+    {
+        if(vbCorrectedMP[i])
+            vpCorrectedWindowMPs.push_back(vpLocalWindowMPs[i]);
+        else if(vpLocalWindowMPs[i] && !vpLocalWindowMPs[i]->isBad())
+            numPointsWithCorrection++;
     }
     /*if(numPointsWithCorrection>0)
     {
@@ -1504,11 +1691,13 @@ void LoopClosing::MergeLocal()
     }*/
 
     {
-        unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
-        unique_lock<mutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
+        unique_lock<ProfiledMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+        unique_lock<ProfiledMutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
 
         //std::cout << "Merge local window: " << spLocalWindowKFs.size() << std::endl;
         //std::cout << "[Merge]: init merging maps " << std::endl;
+        vector<KeyFrame*> vpWindowKFs;
+        vpWindowKFs.reserve(spLocalWindowKFs.size());
         for(KeyFrame* pKFi : spLocalWindowKFs)
         {
             if(!pKFi || pKFi->isBad())
@@ -1523,11 +1712,8 @@ void LoopClosing::MergeLocal()
             pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
             pKFi->SetPose(pKFi->mTcwMerge);
 
-            // Make sure connections are updated
-            pKFi->UpdateMap(pMergeMap);
             pKFi->mnMergeCorrectedForKF = mpCurrentKF->mnId;
-            pMergeMap->AddKeyFrame(pKFi);
-            pCurrentMap->EraseKeyFrame(pKFi);
+            vpWindowKFs.push_back(pKFi);
 
             if(pCurrentMap->isImuInitialized())
             {
@@ -1535,17 +1721,18 @@ void LoopClosing::MergeLocal()
             }
         }
 
-        for(MapPoint* pMPi : spLocalWindowMPs)
+        RunParallel(vpCorrectedWindowMPs.size(), [&](int i)
         {
+            MapPoint* pMPi = vpCorrectedWindowMPs[i];
             if(!pMPi || pMPi->isBad())
-                continue;
+                return;
 
             pMPi->SetWorldPos(pMPi->mPosMerge);
             pMPi->SetNormalVector(pMPi->mNormalVectorMerge);
-            pMPi->UpdateMap(pMergeMap);
-            pMergeMap->AddMapPoint(pMPi);
-            pCurrentMap->EraseMapPoint(pMPi);
-        }
+        });
+
+        // Make sure connections are updated
+        MoveToMap(pCurrentMap, pMergeMap, vpWindowKFs, vpCorrectedWindowMPs);
 
         mpAtlas->ChangeMap(pMergeMap);
         mpAtlas->SetMapBad(pCurrentMap);
@@ -1646,7 +1833,7 @@ void LoopClosing::MergeLocal()
     else {
         if(mpTracker->mSensor == System::MONOCULAR)
         {
-            unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+            unique_lock<ProfiledMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
 
             for(KeyFrame* pKFi : vpCurrentMapKFs)
             {
@@ -1686,22 +1873,29 @@ void LoopClosing::MergeLocal()
                 }
 
             }
-            for(MapPoint* pMPi : vpCurrentMapMPs)
+            RunParallel(vpCurrentMapMPs.size(), [&](int i)
             {
+                MapPoint* pMPi = vpCurrentMapMPs[i];
                 if(!pMPi || pMPi->isBad()|| pMPi->GetMap() != pCurrentMap)
-                    continue;
+                    return;
 
+                // Without the reference keyframe in the correction both poses are the identity
                 KeyFrame* pKFref = pMPi->GetReferenceKeyFrame();
-                g2o::Sim3 g2oCorrectedSwi = vCorrectedSim3[pKFref].inverse();
-                g2o::Sim3 g2oNonCorrectedSiw = vNonCorrectedSim3[pKFref];
+                KeyFrameAndPose::const_iterator itCorrected = vCorrectedSim3.find(pKFref);
+                KeyFrameAndPose::const_iterator itNonCorrected = vNonCorrectedSim3.find(pKFref);
+                if(itCorrected != vCorrectedSim3.end() && itNonCorrected != vNonCorrectedSim3.end())
+                {
+                    g2o::Sim3 g2oCorrectedSwi = itCorrected->second.inverse();
+                    g2o::Sim3 g2oNonCorrectedSiw = itNonCorrected->second;
 
-                // Project with non-corrected pose and project back with corrected pose
-                Eigen::Vector3d P3Dw = pMPi->GetWorldPos().cast<double>();
-                Eigen::Vector3d eigCorrectedP3Dw = g2oCorrectedSwi.map(g2oNonCorrectedSiw.map(P3Dw));
-                pMPi->SetWorldPos(eigCorrectedP3Dw.cast<float>());
+                    // Project with non-corrected pose and project back with corrected pose
+                    Eigen::Vector3d P3Dw = pMPi->GetWorldPos().cast<double>();
+                    Eigen::Vector3d eigCorrectedP3Dw = g2oCorrectedSwi.map(g2oNonCorrectedSiw.map(P3Dw));
+                    pMPi->SetWorldPos(eigCorrectedP3Dw.cast<float>());
+                }
 
                 pMPi->UpdateNormalAndDepth();
-            }
+            });
         }
 
         mpLocalMapper->RequestStop();
@@ -1720,33 +1914,20 @@ void LoopClosing::MergeLocal()
 
         {
             // Get Merge Map Mutex
-            unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
-            unique_lock<mutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
+            unique_lock<ProfiledMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+            unique_lock<ProfiledMutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
 
             //std::cout << "Merge outside KFs: " << vpCurrentMapKFs.size() << std::endl;
+            vector<KeyFrame*> vpOutsideKFs;
+            vpOutsideKFs.reserve(vpCurrentMapKFs.size());
             for(KeyFrame* pKFi : vpCurrentMapKFs)
             {
-                if(!pKFi || pKFi->isBad() || pKFi->GetMap() != pCurrentMap)
-                {
-                    continue;
-                }
-                //std::cout << "KF id: " << pKFi->mnId << std::endl;
-
-                // Make sure connections are updated
-                pKFi->UpdateMap(pMergeMap);
-                pMergeMap->AddKeyFrame(pKFi);
-                pCurrentMap->EraseKeyFrame(pKFi);
+                if(pKFi && !pKFi->isBad() && pKFi->GetMap() == pCurrentMap)
+                    vpOutsideKFs.push_back(pKFi);
             }
 
-            for(MapPoint* pMPi : vpCurrentMapMPs)
-            {
-                if(!pMPi || pMPi->isBad())
-                    continue;
-
-                pMPi->UpdateMap(pMergeMap);
-                pMergeMap->AddMapPoint(pMPi);
-                pCurrentMap->EraseMapPoint(pMPi);
-            }
+            // Make sure connections are updated
+            MoveToMap(pCurrentMap, pMergeMap, vpOutsideKFs, vpCurrentMapMPs);
         }
     }
 
@@ -1766,6 +1947,11 @@ void LoopClosing::MergeLocal()
         mbRunningGBA = true;
         mbFinishedGBA = false;
         mbStopGBA = false;
+        {
+            // The merged map is optimized entirely
+            unique_lock<mutex> lock(mMutexGBA);
+            mspGBAPendingKFs.clear();
+        }
         mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this, pMergeMap, mpCurrentKF->mnId);
     }
 
@@ -1782,6 +1968,7 @@ void LoopClosing::MergeLocal()
 
 void LoopClosing::MergeLocal2()
 {
+    TRACE_SCOPE("MergeLocal2");
     //cout << "Merge detected!!!!" << endl;
 
     int numTemporalKFs = 11; //TODO (set by parameter): Temporal KFs in the local window if the map is inertial.
@@ -1833,7 +2020,7 @@ void LoopClosing::MergeLocal2()
         float s_on = mSold_new.scale();
         Sophus::SE3f T_on(mSold_new.rotation().cast<float>(), mSold_new.translation().cast<float>());
 
-        unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+        unique_lock<ProfiledMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
 
         //cout << "KFs before empty: " << mpAtlas->GetCurrentMap()->KeyFramesInMap() << endl;
         mpLocalMapper->EmptyQueue();
@@ -1862,7 +2049,7 @@ void LoopClosing::MergeLocal2()
         ba << 0., 0., 0.;
         Optimizer::InertialOptimization(pCurrentMap,bg,ba);
         IMU::Bias b (ba[0],ba[1],ba[2],bg[0],bg[1],bg[2]);
-        unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+        unique_lock<ProfiledMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
         mpTracker->UpdateFrameIMU(1.0f,b,mpTracker->GetLastKeyFrame());
 
         // Set map initialized
@@ -1879,39 +2066,37 @@ void LoopClosing::MergeLocal2()
     //cout << "updating current map" << endl;
     {
         // Get Merge Map Mutex (This section stops tracking!!)
-        unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
-        unique_lock<mutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
-
+        unique_lock<ProfiledMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+        unique_lock<ProfiledMutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
 
-        vector<KeyFrame*> vpMergeMapKFs = pMergeMap->GetAllKeyFrames();
-        vector<MapPoint*> vpMergeMapMPs = pMergeMap->GetAllMapPoints();
 
+        const Map::KeyFrameSnapshot pKeyFrames = pMergeMap->GetKeyFramesSnapshot();
+        const vector<KeyFrame*> &vpMergeMapKFs = *pKeyFrames;
+        const Map::MapPointSnapshot pMapPoints = pMergeMap->GetMapPointsSnapshot();
+        const vector<MapPoint*> &vpMergeMapMPs = *pMapPoints;
 
+        vector<KeyFrame*> vpMovedKFs;
+        vpMovedKFs.reserve(vpMergeMapKFs.size());
         for(KeyFrame* pKFi : vpMergeMapKFs)
         {
-            if(!pKFi || pKFi->isBad() || pKFi->GetMap() != pMergeMap)
-            {
-                continue;
-            }
-
-            // Make sure connections are updated
-            pKFi->UpdateMap(pCurrentMap);
-            pCurrentMap->AddKeyFrame(pKFi);
-            pMergeMap->EraseKeyFrame(pKFi);
+            if(pKFi && !pKFi->isBad() && pKFi->GetMap() == pMergeMap)
+                vpMovedKFs.push_back(pKFi);
         }
 
+        vector<MapPoint*> vpMovedMPs;
+        vpMovedMPs.reserve(vpMergeMapMPs.size());
         for(MapPoint* pMPi : vpMergeMapMPs)
         {
-            if(!pMPi || pMPi->isBad() || pMPi->GetMap() != pMergeMap)
-                continue;
-
-            pMPi->UpdateMap(pCurrentMap);
-            pCurrentMap->AddMapPoint(pMPi);
-            pMergeMap->EraseMapPoint(pMPi);
+            if(pMPi && !pMPi->isBad() && pMPi->GetMap() == pMergeMap)
+                vpMovedMPs.push_back(pMPi);
         }
 
+        // Make sure connections are updated
+        MoveToMap(pMergeMap, pCurrentMap, vpMovedKFs, vpMovedMPs);
+
         // Save non corrected poses (already merged maps)
-        vector<KeyFrame*> vpKFs = pCurrentMap->GetAllKeyFrames();
+        const Map::KeyFrameSnapshot pCurrentKeyFrames = pCurrentMap->GetKeyFramesSnapshot();
+        const vector<KeyFrame*> &vpKFs = *pCurrentKeyFrames;
         for(KeyFrame* pKFi : vpKFs)
         {
             Sophus::SE3d Tiw = (pKFi->GetPose()).cast<double>();
@@ -2062,6 +2247,38 @@ void LoopClosing::MergeLocal2()
     return;
 }
 
+void LoopClosing::MoveToMap(Map* pSrcMap, Map* pDstMap, const vector<KeyFrame*> &vpKFs, const vector<MapPoint*> &vpMPs)
+{
+    vector<KeyFrame*> vpMovedKFs;
+    vpMovedKFs.reserve(vpKFs.size());
+    for(KeyFrame* pKFi : vpKFs)
+    {
+        if(!pKFi || pKFi->isBad())
+            continue;
+
+        pKFi->UpdateMap(pDstMap);
+        vpMovedKFs.push_back(pKFi);
+    }
+
+    vector<MapPoint*> vpMovedMPs;
+    vpMovedMPs.reserve(vpMPs.size());
+    for(MapPoint* pMPi : vpMPs)
+    {
+        if(pMPi && !pMPi->isBad())
+            vpMovedMPs.push_back(pMPi);
+    }
+    RunParallel(vpMovedMPs.size(), [&](int i)
+    {
+        vpMovedMPs[i]->UpdateMap(pDstMap);
+    });
+
+    // Each map is locked once for all the elements
+    pDstMap->AddKeyFrames(vpMovedKFs);
+    pSrcMap->EraseKeyFrames(vpMovedKFs);
+    pDstMap->AddMapPoints(vpMovedMPs);
+    pSrcMap->EraseMapPoints(vpMovedMPs);
+}
+
 void LoopClosing::CheckObservations(set<KeyFrame*> &spKFsMap1, set<KeyFrame*> &spKFsMap2)
 {
     cout << "----------------------" << endl;
@@ -2114,85 +2331,67 @@ void LoopClosing::CheckObservations(set<KeyFrame*> &spKFsMap1, set<KeyFrame*> &s
 
 void LoopClosing::SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap, vector<MapPoint*> &vpMapPoints)
 {
-    ORBmatcher matcher(0.8);
-
-    int total_replaces = 0;
-
-    //cout << "[FUSE]: Initially there are " << vpMapPoints.size() << " MPs" << endl;
-    //cout << "FUSE: Intially there are " << CorrectedPosesMap.size() << " KFs" << endl;
+    vector<KeyFrame*> vpKFs;
+    vector<Sophus::Sim3f> vScw;
+    vpKFs.reserve(CorrectedPosesMap.size());
+    vScw.reserve(CorrectedPosesMap.size());
     for(KeyFrameAndPose::const_iterator mit=CorrectedPosesMap.begin(), mend=CorrectedPosesMap.end(); mit!=mend;mit++)
     {
-        int num_replaces = 0;
-        KeyFrame* pKFi = mit->first;
-        Map* pMap = pKFi->GetMap();
-
-        g2o::Sim3 g2oScw = mit->second;
-        Sophus::Sim3f Scw = Converter::toSophus(g2oScw);
-
-        vector<MapPoint*> vpReplacePoints(vpMapPoints.size(),static_cast<MapPoint*>(NULL));
-        int numFused = matcher.Fuse(pKFi,Scw,vpMapPoints,4,vpReplacePoints);
-
-        // Get Map Mutex
-        unique_lock<mutex> lock(pMap->mMutexMapUpdate);
-        const int nLP = vpMapPoints.size();
-        for(int i=0; i<nLP;i++)
-        {
-            MapPoint* pRep = vpReplacePoints[i];
-            if(pRep)
-            {
-
-
-                num_replaces += 1;
-                pRep->Replace(vpMapPoints[i]);
-
-            }
-        }
-
-        total_replaces += num_replaces;
+        vpKFs.push_back(mit->first);
+        vScw.push_back(Converter::toSophus(mit->second));
     }
-    //cout << "[FUSE]: " << total_replaces << " MPs had been fused" << endl;
+
+    FuseInKeyFrames(vpKFs, vScw, vpMapPoints);
 }
 
 
 void LoopClosing::SearchAndFuse(const vector<KeyFrame*> &vConectedKFs, vector<MapPoint*> &vpMapPoints)
 {
-    ORBmatcher matcher(0.8);
-
-    int total_replaces = 0;
-
-    //cout << "FUSE-POSE: Initially there are " << vpMapPoints.size() << " MPs" << endl;
-    //cout << "FUSE-POSE: Intially there are " << vConectedKFs.size() << " KFs" << endl;
-    for(auto mit=vConectedKFs.begin(), mend=vConectedKFs.end(); mit!=mend;mit++)
+    vector<Sophus::Sim3f> vScw;
+    vScw.reserve(vConectedKFs.size());
+    for(KeyFrame* pKF : vConectedKFs)
     {
-        int num_replaces = 0;
-        KeyFrame* pKF = (*mit);
-        Map* pMap = pKF->GetMap();
         Sophus::SE3f Tcw = pKF->GetPose();
         Sophus::Sim3f Scw(Tcw.unit_quaternion(),Tcw.translation());
         Scw.setScale(1.f);
-        /*std::cout << "These should be zeros: " <<
-            Scw.rotationMatrix() - Tcw.rotationMatrix() << std::endl <<
-            Scw.translation() - Tcw.translation() << std::endl <<
-            Scw.scale() - 1.f << std::endl;*/
-        vector<MapPoint*> vpReplacePoints(vpMapPoints.size(),static_cast<MapPoint*>(NULL));
-        matcher.Fuse(pKF,Scw,vpMapPoints,4,vpReplacePoints);
+        vScw.push_back(Scw);
+    }
+
+    FuseInKeyFrames(vConectedKFs, vScw, vpMapPoints);
+}
+
+void LoopClosing::FuseInKeyFrames(const vector<KeyFrame*> &vpKFs, vector<Sophus::Sim3f> &vScw, vector<MapPoint*> &vpMapPoints)
+{
+    // The matching of each keyframe is independent, a keyframe only gets new observations in its own slots
+    vector<vector<MapPoint*> > vvpReplacePoints(vpKFs.size());
+    RunParallel(vpKFs.size(), [&](int i)
+    {
+        ORBmatcher matcher(0.8);
+        vvpReplacePoints[i].assign(vpMapPoints.size(), static_cast<MapPoint*>(NULL));
+        matcher.Fuse(vpKFs[i], vScw[i], vpMapPoints, 4, vvpReplacePoints[i]);
+    });
 
+    // The replacements of a keyframe may target a point replaced by a previous keyframe, it is followed to the
+    // point that replaced it
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
         // Get Map Mutex
-        unique_lock<mutex> lock(pMap->mMutexMapUpdate);
-        const int nLP = vpMapPoints.size();
-        for(int i=0; i<nLP;i++)
+        Map* pMap = vpKFs[i]->GetMap();
+        unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
+        const vector<MapPoint*> &vpReplacePoints = vvpReplacePoints[i];
+        for(size_t j=0; j<vpReplacePoints.size(); j++)
         {
-            MapPoint* pRep = vpReplacePoints[i];
-            if(pRep)
-            {
-                num_replaces += 1;
-                pRep->Replace(vpMapPoints[i]);
-            }
+            MapPoint* pRep = vpReplacePoints[j];
+            if(!pRep || pRep->isBad())
+                continue;
+
+            MapPoint* pMP = vpMapPoints[j];
+            while(pMP && pMP->isBad())
+                pMP = pMP->GetReplaced();
+            if(pMP && pMP!=pRep)
+                pRep->Replace(pMP);
         }
-        /*cout << "FUSE-POSE: KF " << pKF->mnId << " ->" << num_replaces << " MPs fused" << endl;
-        total_replaces += num_replaces;*/
     }
-    //cout << "FUSE-POSE: " << total_replaces << " MPs had been fused" << endl;
 }
 
 
@@ -2241,6 +2440,10 @@ void LoopClosing::ResetIfRequested()
     {
         cout << "Loop closer reset requested..." << endl;
         mlpLoopKeyFrameQueue.clear();
+        {
+            unique_lock<mutex> lock2(mMutexGBA);
+            mspGBAPendingKFs.clear();
+        }
         mLastLoopKFid=0;  //TODO old variable, it is not use in the new algorithm
         mbResetRequested=false;
         mbResetActiveMapRequested = false;
@@ -2259,6 +2462,12 @@ void LoopClosing::ResetIfRequested()
                 ++it;
         }
 
+        {
+            unique_lock<mutex> lock2(mMutexGBA);
+            if(!mspGBAPendingKFs.empty() && (*mspGBAPendingKFs.begin())->GetMap()==mpMapToReset)
+                mspGBAPendingKFs.clear();
+        }
+
         mLastLoopKFid=mpAtlas->GetLastInitKFid(); //TODO old variable, it is not use in the new algorithm
         mbResetActiveMapRequested=false;
 
@@ -2267,6 +2476,8 @@ void LoopClosing::ResetIfRequested()
 
 void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoopKF)
 {  
+    TRACE_THREAD_NAME("GlobalBA");
+    TRACE_SCOPE("RunGlobalBundleAdjustment");
     Verbose::PrintMess("Starting Global Bundle Adjustment", Verbose::VERBOSITY_NORMAL);
 
 #ifdef REGISTER_TIMES
@@ -2274,14 +2485,29 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
 
     nFGBA_exec += 1;
 
-    vnGBAKFs.push_back(pActiveMap->GetAllKeyFrames().size());
-    vnGBAMPs.push_back(pActiveMap->GetAllMapPoints().size());
+    vnGBAKFs.push_back(pActiveMap->KeyFramesInMap());
+    vnGBAMPs.push_back(pActiveMap->MapPointsInMap());
 #endif
 
     const bool bImuInit = pActiveMap->isImuInitialized();
 
+    // Keyframes left by the loop corrections, and by an aborted Global BA, the inertial BA always uses the whole map
+    set<KeyFrame*> spAffectedKFs;
+    RemoteBackend* pRemoteBackend;
+    {
+        unique_lock<mutex> lock(mMutexGBA);
+        if(mbIncrementalGBA && !bImuInit)
+            spAffectedKFs = mspGBAPendingKFs;
+        pRemoteBackend = mpRemoteBackend;
+    }
+
+    // The whole-map visual BA goes to the remote back end, the incremental one is small enough to stay local.
+    // Its solution lands in mTcwGBA and mPosGBA and is propagated below like a local one
     if(!bImuInit)
-        Optimizer::GlobalBundleAdjustemnt(pActiveMap,10,&mbStopGBA,nLoopKF,false);
+    {
+        if(!spAffectedKFs.empty() || !pRemoteBackend || !pRemoteBackend->GlobalBundleAdjustment(pActiveMap,10,&mbStopGBA,nLoopKF))
+            Optimizer::GlobalBundleAdjustemnt(pActiveMap,10,&mbStopGBA,nLoopKF,false,spAffectedKFs.empty() ? NULL : &spAffectedKFs);
+    }
     else
         Optimizer::FullInertialBA(pActiveMap,7,false,nLoopKF,&mbStopGBA);
 
@@ -2325,9 +2551,9 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
                 usleep(1000);
             }
 
-            // Get Map Mutex
-            unique_lock<mutex> lock(pActiveMap->mMutexMapUpdate);
-            // cout << "LC: Update Map Mutex adquired" << endl;
+            // The corrections are computed with Local Mapping stopped, the map mutex is only held to apply them
+            vector<KeyFrame*> vpKFsToUpdate;
+            vector<pair<MapPoint*,Eigen::Vector3f> > vCorrectedMPs;
 
             //pActiveMap->PrintEssentialGraph();
             // Correct keyframes starting at map first keyframe
@@ -2378,7 +2604,7 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
                 //cout << "-------Update pose" << endl;
                 pKF->mTcwBefGBA = pKF->GetPose();
                 //cout << "pKF->mTcwBefGBA: " << pKF->mTcwBefGBA << endl;
-                pKF->SetPose(pKF->mTcwGBA);
+                vpKFsToUpdate.push_back(pKF);
                 /*cv::Mat Tco_cn = pKF->mTcwBefGBA * pKF->mTcwGBA.inv();
                 cv::Vec3d trasl = Tco_cn.rowRange(0,3).col(3);
                 double dist = cv::norm(trasl);
@@ -2441,8 +2667,6 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
                     //    Verbose::PrintMess("pKF->mVwbGBA is empty", Verbose::VERBOSITY_NORMAL);
 
                     //assert(!pKF->mVwbGBA.empty());
-                    pKF->SetVelocity(pKF->mVwbGBA);
-                    pKF->SetNewBias(pKF->mBiasGBA);                    
                 }
 
                 lpKFtoCheck.pop_front();
@@ -2450,7 +2674,9 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
 
             //cout << "GBA: Correct MapPoints" << endl;
             // Correct MapPoints
-            const vector<MapPoint*> vpMPs = pActiveMap->GetAllMapPoints();
+            const Map::MapPointSnapshot pMapPoints = pActiveMap->GetMapPointsSnapshot();
+            const vector<MapPoint*> &vpMPs = *pMapPoints;
+            vCorrectedMPs.reserve(vpMPs.size());
 
             for(size_t i=0; i<vpMPs.size(); i++)
             {
@@ -2462,7 +2688,7 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
                 if(pMP->mnBAGlobalForKF==nLoopKF)
                 {
                     // If optimized by Global BA, just update
-                    pMP->SetWorldPos(pMP->mPosGBA);
+                    vCorrectedMPs.push_back(make_pair(pMP,pMP->mPosGBA));
                 }
                 else
                 {
@@ -2481,12 +2707,35 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
                     Eigen::Vector3f Xc = pRefKF->mTcwBefGBA * pMP->GetWorldPos();
 
                     // Backproject using corrected camera
-                    pMP->SetWorldPos(pRefKF->GetPoseInverse() * Xc);
+                    vCorrectedMPs.push_back(make_pair(pMP,pRefKF->mTcwGBA.inverse() * Xc));
+                }
+            }
+
+            {
+                // Get Map Mutex
+                unique_lock<ProfiledMutex> lock(pActiveMap->mMutexMapUpdate);
+                // cout << "LC: Update Map Mutex adquired" << endl;
+
+                for(size_t i=0; i<vpKFsToUpdate.size(); i++)
+                {
+                    KeyFrame* pKF = vpKFsToUpdate[i];
+                    pKF->SetPose(pKF->mTcwGBA);
+                    if(pKF->bImu)
+                    {
+                        pKF->SetVelocity(pKF->mVwbGBA);
+                        pKF->SetNewBias(pKF->mBiasGBA);
+                    }
                 }
+
+                for(size_t i=0; i<vCorrectedMPs.size(); i++)
+                    vCorrectedMPs[i].first->SetWorldPos(vCorrectedMPs[i].second);
+
+                pActiveMap->InformNewBigChange();
+                pActiveMap->IncreaseChangeIndex();
             }
 
-            pActiveMap->InformNewBigChange();
-            pActiveMap->IncreaseChangeIndex();
+            // The pending keyframes have been reoptimized
+            mspGBAPendingKFs.clear();
 
             // TODO Check this update
             // mpTracker->UpdateFrameIMU(1.0f, mpTracker->GetLastKeyFrame()->GetImuBias(), mpTracker->GetLastKeyFrame());
@@ -2510,6 +2759,36 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
     }
 }
 
+void LoopClosing::RequestHold()
+{
+    unique_lock<mutex> lock(mMutexHold);
+    mbHoldRequested = true;
+}
+
+bool LoopClosing::CheckHold()
+{
+    unique_lock<mutex> lock(mMutexHold);
+    mbHeld = mbHoldRequested;
+    return mbHeld;
+}
+
+bool LoopClosing::isHeld()
+{
+    {
+        unique_lock<mutex> lock(mMutexHold);
+        if(!mbHeld)
+            return false;
+    }
+    return !isRunningGBA() && !isCorrectingLoop();
+}
+
+void LoopClosing::ReleaseHold()
+{
+    unique_lock<mutex> lock(mMutexHold);
+    mbHoldRequested = false;
+    mbHeld = false;
+}
+
 void LoopClosing::RequestFinish()
 {
     unique_lock<mutex> lock(mMutexFinish);
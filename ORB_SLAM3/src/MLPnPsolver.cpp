@@ -74,12 +74,6 @@ namespace ORB_SLAM3 {
                     mvP2D.push_back(kp.pt);
                     mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
 
-                    //Bearing vector should be normalized
-                    cv::Point3f cv_br = mpCamera->unproject(kp.pt);
-                    cv_br /= cv_br.z;
-                    bearingVector_t br(cv_br.x,cv_br.y,cv_br.z);
-                    mvBearingVecs.push_back(br);
-
                     //3D coordinates
                     Eigen::Matrix<float,3,1> posEig = pMP -> GetWorldPos();
                     point_t pos(posEig(0),posEig(1),posEig(2));
@@ -93,6 +87,14 @@ namespace ORB_SLAM3 {
             }
         }
 
+        //Bearing vectors of all keypoints with one call to the camera model, they should be normalized
+        vector<Eigen::Vector3f> vRays(mvP2D.size());
+        mpCamera->unprojectBatch(mvP2D.data(),vRays.data(),mvP2D.size());
+        for(size_t i = 0; i < vRays.size(); i++){
+            const Eigen::Vector3f br = vRays[i] / vRays[i](2);
+            mvBearingVecs.push_back(bearingVector_t(br(0),br(1),br(2)));
+        }
+
         SetRansacParameters();
     }
 
@@ -109,34 +111,28 @@ namespace ORB_SLAM3 {
 	        return false;
 	    }
 
-	    vector<size_t> vAvailableIndices;
-
+	    // Stop after nIterations so callers can interleave several solvers
 	    int nCurrentIterations = 0;
-	    while(mnIterations<mRansacMaxIts || nCurrentIterations<nIterations)
+	    while(mnIterations<mRansacMaxIts && nCurrentIterations<nIterations)
 	    {
 	        nCurrentIterations++;
 	        mnIterations++;
 
-	        vAvailableIndices = mvAllIndices;
-
-            //Bearing vectors and 3D points used for this ransac iteration
-            bearingVectors_t bearingVecs(mRansacMinSet);
-            points_t p3DS(mRansacMinSet);
-            vector<int> indexes(mRansacMinSet);
+	        mvAvailableIndices = mvAllIndices;
 
 	        // Get min set of points
 	        for(short i = 0; i < mRansacMinSet; ++i)
 	        {
-	            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+	            int randi = DUtils::Random::RandomInt(0, mvAvailableIndices.size()-1);
 
-	            int idx = vAvailableIndices[randi];
+	            int idx = mvAvailableIndices[randi];
 
-                bearingVecs[i] = mvBearingVecs[idx];
-                p3DS[i] = mvP3Dw[idx];
-                indexes[i] = i;
+                mvMinSetBearings[i] = mvBearingVecs[idx];
+                mvMinSetPoints[i] = mvP3Dw[idx];
+                mvMinSetIndices[i] = i;
 
-	            vAvailableIndices[randi] = vAvailableIndices.back();
-	            vAvailableIndices.pop_back();
+	            mvAvailableIndices[randi] = mvAvailableIndices.back();
+	            mvAvailableIndices.pop_back();
 	        }
 
             //By the moment, we are using MLPnP without covariance info
@@ -146,7 +142,7 @@ namespace ORB_SLAM3 {
             transformation_t result;
 
 	        // Compute camera pose
-            computePose(bearingVecs,p3DS,covs,indexes,result);
+            computePose(mvMinSetBearings,mvMinSetPoints,covs,mvMinSetIndices,result);
 
             //Save result
             mRi[0][0] = result(0,0);
@@ -174,16 +170,11 @@ namespace ORB_SLAM3 {
 	                mvbBestInliers = mvbInliersi;
 	                mnBestInliers = mnInliersi;
 
-	                cv::Mat Rcw(3,3,CV_64F,mRi);
-	                cv::Mat tcw(3,1,CV_64F,mti);
-	                Rcw.convertTo(Rcw,CV_32F);
-	                tcw.convertTo(tcw,CV_32F);
+                    Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>> eigRcw(mRi[0]);
+                    Eigen::Map<const Eigen::Vector3d> eigtcw(mti);
                     mBestTcw.setIdentity();
-                    mBestTcw.block<3,3>(0,0) = Converter::toMatrix3f(Rcw);
-                    mBestTcw.block<3,1>(0,3) = Converter::toVector3f(tcw);
-
-                    Eigen::Matrix<double, 3, 3, Eigen::RowMajor> eigRcw(mRi[0]);
-                    Eigen::Vector3d eigtcw(mti);
+                    mBestTcw.block<3,3>(0,0) = eigRcw.cast<float>();
+                    mBestTcw.block<3,1>(0,3) = eigtcw.cast<float>();
 	            }
 
 	            if(Refine())
@@ -233,6 +224,12 @@ namespace ORB_SLAM3 {
 
 	    mvbInliersi.resize(N);
 
+	    // Scratch of iterate, sized once instead of per hypothesis
+	    mvAvailableIndices.reserve(N);
+	    mvMinSetBearings.resize(mRansacMinSet);
+	    mvMinSetPoints.resize(mRansacMinSet);
+	    mvMinSetIndices.resize(mRansacMinSet);
+
 	    // Adjust Parameters according to number of correspondences
 	    int nMinInliers = N*mRansacEpsilon;
 	    if(nMinInliers<mRansacMinInliers)
@@ -335,17 +332,12 @@ namespace ORB_SLAM3 {
 
         if(mnInliersi>mRansacMinInliers)
         {
-            cv::Mat Rcw(3,3,CV_64F,mRi);
-            cv::Mat tcw(3,1,CV_64F,mti);
-            Rcw.convertTo(Rcw,CV_32F);
-            tcw.convertTo(tcw,CV_32F);
+            Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>> eigRcw(mRi[0]);
+            Eigen::Map<const Eigen::Vector3d> eigtcw(mti);
             mRefinedTcw.setIdentity();
 
-            mRefinedTcw.block<3,3>(0,0) = Converter::toMatrix3f(Rcw);
-            mRefinedTcw.block<3,1>(0,3) = Converter::toVector3f(tcw);
-
-            Eigen::Matrix<double, 3, 3, Eigen::RowMajor> eigRcw(mRi[0]);
-            Eigen::Vector3d eigtcw(mti);
+            mRefinedTcw.block<3,3>(0,0) = eigRcw.cast<float>();
+            mRefinedTcw.block<3,1>(0,3) = eigtcw.cast<float>();
 
             return true;
         }
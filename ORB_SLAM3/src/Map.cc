@@ -19,18 +19,32 @@
 
 #include "Map.h"
 
+#include<limits>
 #include<mutex>
 
 namespace ORB_SLAM3
 {
 
 long unsigned int Map::nNextId=0;
+std::atomic<unsigned long> Map::nTrackedFrames(0);
+
+// Map points are small and many, keyframes large and few
+static const size_t kMapPointsPerSlab = 512;
+static const size_t kKeyFramesPerSlab = 32;
+// One 64 KB chunk of descriptor rows
+static const size_t kDescriptorsPerChunk = 1024;
+// Heap node of the keyframe and map point sets
+static const size_t kSetNodeBytes = 48;
 
 Map::Map():mnMaxKFid(0),mnBigChangeIdx(0), mbImuInitialized(false), mnMapChange(0), mpFirstRegionKF(static_cast<KeyFrame*>(NULL)),
 mbFail(false), mIsInUse(false), mHasTumbnail(false), mbBad(false), mnMapChangeNotified(0), mbIsInertial(false), mbIMU_BA1(false), mbIMU_BA2(false)
 {
     mnId=nNextId++;
     mThumbnail = static_cast<GLubyte*>(NULL);
+    mpMapPointPool = new MapObjectPool<MapPoint>(kMapPointsPerSlab);
+    mpKeyFramePool = new MapObjectPool<KeyFrame>(kKeyFramesPerSlab);
+    mpDescriptorArena = new DescriptorArena(kDescriptorsPerChunk);
+    mnMapPointsEpoch = 0;
 }
 
 Map::Map(int initKFid):mnInitKFid(initKFid), mnMaxKFid(initKFid),/*mnLastLoopKFid(initKFid),*/ mnBigChangeIdx(0), mIsInUse(false),
@@ -39,6 +53,10 @@ Map::Map(int initKFid):mnInitKFid(initKFid), mnMaxKFid(initKFid),/*mnLastLoopKFi
 {
     mnId=nNextId++;
     mThumbnail = static_cast<GLubyte*>(NULL);
+    mpMapPointPool = new MapObjectPool<MapPoint>(kMapPointsPerSlab);
+    mpKeyFramePool = new MapObjectPool<KeyFrame>(kKeyFramesPerSlab);
+    mpDescriptorArena = new DescriptorArena(kDescriptorsPerChunk);
+    mnMapPointsEpoch = 0;
 }
 
 Map::~Map()
@@ -53,13 +71,25 @@ Map::~Map()
         delete mThumbnail;
     mThumbnail = static_cast<GLubyte*>(NULL);
 
-    mvpReferenceMapPoints.clear();
+    mvReferenceMapPoints.clear();
     mvpKeyFrameOrigins.clear();
+
+    {
+        unique_lock<mutex> lock(mMutexRetired);
+        for(size_t i=0; i<mdRetiredMapPoints.size(); i++)
+            delete mdRetiredMapPoints[i].pMP;
+        mdRetiredMapPoints.clear();
+    }
+
+    // Live objects, and those moved to other maps, keep the pools until they are deleted
+    mpMapPointPool->Release();
+    mpKeyFramePool->Release();
+    mpDescriptorArena->Release();
 }
 
 void Map::AddKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     if(mspKeyFrames.empty()){
         cout << "First KF:" << pKF->mnId << "; Map init KF:" << mnInitKFid << endl;
         mnInitKFid = pKF->mnId;
@@ -67,6 +97,7 @@ void Map::AddKeyFrame(KeyFrame *pKF)
         mpKFlowerID = pKF;
     }
     mspKeyFrames.insert(pKF);
+    InvalidateKeyFramesSnapshot();
     if(pKF->mnId>mnMaxKFid)
     {
         mnMaxKFid=pKF->mnId;
@@ -77,37 +108,101 @@ void Map::AddKeyFrame(KeyFrame *pKF)
     }
 }
 
+void Map::AddKeyFrames(const vector<KeyFrame*> &vpKFs)
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    for(KeyFrame* pKF : vpKFs)
+    {
+        if(mspKeyFrames.empty()){
+            mnInitKFid = pKF->mnId;
+            mpKFinitial = pKF;
+            mpKFlowerID = pKF;
+        }
+        mspKeyFrames.insert(pKF);
+        if(pKF->mnId>mnMaxKFid)
+            mnMaxKFid=pKF->mnId;
+        if(pKF->mnId<mpKFlowerID->mnId)
+            mpKFlowerID = pKF;
+    }
+    InvalidateKeyFramesSnapshot();
+}
+
+void Map::AddMapPoints(const vector<MapPoint*> &vpMPs)
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    mspMapPoints.insert(vpMPs.begin(), vpMPs.end());
+    InvalidateMapPointsSnapshot();
+}
+
+void Map::EraseKeyFrames(const vector<KeyFrame*> &vpKFs)
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    bool bLowerErased = false;
+    for(KeyFrame* pKF : vpKFs)
+    {
+        if(mspKeyFrames.erase(pKF) && pKF==mpKFlowerID)
+            bLowerErased = true;
+    }
+
+    InvalidateKeyFramesSnapshot();
+
+    // The lower id keyframe is looked for once
+    if(mspKeyFrames.empty())
+        mpKFlowerID = 0;
+    else if(bLowerErased)
+        mpKFlowerID = *min_element(mspKeyFrames.begin(), mspKeyFrames.end(), KeyFrame::lId);
+}
+
+void Map::EraseMapPoints(const vector<MapPoint*> &vpMPs)
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    for(MapPoint* pMP : vpMPs)
+        mspMapPoints.erase(pMP);
+    InvalidateMapPointsSnapshot();
+}
+
 void Map::AddMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.insert(pMP);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    if(mspMapPoints.insert(pMP).second)
+        InvalidateMapPointsSnapshot();
 }
 
 void Map::SetImuInitialized()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mbImuInitialized = true;
 }
 
 bool Map::isImuInitialized()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mbImuInitialized;
 }
 
 void Map::EraseMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.erase(pMP);
+    RetiredMapPoint retired;
+    {
+        unique_lock<ProfiledMutex> lock(mMutexMap);
+        if(!mspMapPoints.erase(pMP))
+            return;
+        InvalidateMapPointsSnapshot();
+        retired.nEpoch = mnMapPointsEpoch;
+    }
 
-    // TODO: This only erase the pointer.
-    // Delete the MapPoint
+    // The point is culled or replaced, it is deleted once no thread can hold it
+    retired.pMP = pMP;
+    retired.nFrame = nTrackedFrames.load(std::memory_order_relaxed);
+    unique_lock<mutex> lock(mMutexRetired);
+    mdRetiredMapPoints.push_back(retired);
 }
 
 void Map::EraseKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mspKeyFrames.erase(pKF);
+    InvalidateKeyFramesSnapshot();
     if(mspKeyFrames.size()>0)
     {
         if(pKF->mnId == mpKFlowerID->mnId)
@@ -128,50 +223,94 @@ void Map::EraseKeyFrame(KeyFrame *pKF)
 
 void Map::SetReferenceMapPoints(const vector<MapPoint *> &vpMPs)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mvpReferenceMapPoints = vpMPs;
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    mvReferenceMapPoints.resize(vpMPs.size());
+    for(size_t i=0; i<vpMPs.size(); i++)
+        mvReferenceMapPoints[i] = MapObjectPool<MapPoint>::GetHandle(vpMPs[i]);
 }
 
 void Map::InformNewBigChange()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mnBigChangeIdx++;
 }
 
 int Map::GetLastBigChangeIdx()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mnBigChangeIdx;
 }
 
+Map::MapPointSnapshot Map::GetMapPointsSnapshot()
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    if(!mpMapPointsSnapshot)
+    {
+        mpMapPointsSnapshot = make_shared<const vector<MapPoint*> >(mspMapPoints.begin(),mspMapPoints.end());
+
+        // Drop the references of the snapshots released meanwhile
+        while(!mdMapPointSnapshots.empty() && mdMapPointSnapshots.front().second.expired())
+            mdMapPointSnapshots.pop_front();
+        while(!mdMapPointSnapshots.empty() && mdMapPointSnapshots.back().second.expired())
+            mdMapPointSnapshots.pop_back();
+        mdMapPointSnapshots.push_back(make_pair(mnMapPointsEpoch, std::weak_ptr<const vector<MapPoint*> >(mpMapPointsSnapshot)));
+    }
+    return mpMapPointsSnapshot;
+}
+
+Map::KeyFrameSnapshot Map::GetKeyFramesSnapshot()
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    if(!mpKeyFramesSnapshot)
+        mpKeyFramesSnapshot = make_shared<const vector<KeyFrame*> >(mspKeyFrames.begin(),mspKeyFrames.end());
+    return mpKeyFramesSnapshot;
+}
+
 vector<KeyFrame*> Map::GetAllKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexMap);
-    return vector<KeyFrame*>(mspKeyFrames.begin(),mspKeyFrames.end());
+    return *GetKeyFramesSnapshot();
 }
 
 vector<MapPoint*> Map::GetAllMapPoints()
 {
-    unique_lock<mutex> lock(mMutexMap);
-    return vector<MapPoint*>(mspMapPoints.begin(),mspMapPoints.end());
+    return *GetMapPointsSnapshot();
+}
+
+void Map::InvalidateMapPointsSnapshot()
+{
+    mpMapPointsSnapshot.reset();
+    mnMapPointsEpoch++;
+}
+
+void Map::InvalidateKeyFramesSnapshot()
+{
+    mpKeyFramesSnapshot.reset();
 }
 
 long unsigned int Map::MapPointsInMap()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mspMapPoints.size();
 }
 
 long unsigned int Map::KeyFramesInMap()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mspKeyFrames.size();
 }
 
 vector<MapPoint*> Map::GetReferenceMapPoints()
 {
-    unique_lock<mutex> lock(mMutexMap);
-    return mvpReferenceMapPoints;
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    vector<MapPoint*> vpMPs;
+    vpMPs.reserve(mvReferenceMapPoints.size());
+    for(size_t i=0; i<mvReferenceMapPoints.size(); i++)
+    {
+        MapPoint* pMP = MapObjectPool<MapPoint>::Resolve(mvReferenceMapPoints[i]);
+        if(pMP)
+            vpMPs.push_back(pMP);
+    }
+    return vpMPs;
 }
 
 long unsigned int Map::GetId()
@@ -180,19 +319,19 @@ long unsigned int Map::GetId()
 }
 long unsigned int Map::GetInitKFid()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mnInitKFid;
 }
 
 void Map::SetInitKFid(long unsigned int initKFif)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mnInitKFid = initKFif;
 }
 
 long unsigned int Map::GetMaxKFid()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mnMaxKFid;
 }
 
@@ -225,9 +364,11 @@ void Map::clear()
 
     mspMapPoints.clear();
     mspKeyFrames.clear();
+    InvalidateMapPointsSnapshot();
+    InvalidateKeyFramesSnapshot();
     mnMaxKFid = mnInitKFid;
     mbImuInitialized = false;
-    mvpReferenceMapPoints.clear();
+    mvReferenceMapPoints.clear();
     mvpKeyFrameOrigins.clear();
     mbIMU_BA1 = false;
     mbIMU_BA2 = false;
@@ -251,7 +392,7 @@ bool Map::IsBad()
 
 void Map::ApplyScaledRotation(const Sophus::SE3f &T, const float s, const bool bScaledVel)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
 
     // Body position (IMU) of first keyframe is fixed to (0,0,0)
     Sophus::SE3f Tyw = T;
@@ -284,37 +425,37 @@ void Map::ApplyScaledRotation(const Sophus::SE3f &T, const float s, const bool b
 
 void Map::SetInertialSensor()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mbIsInertial = true;
 }
 
 bool Map::IsInertial()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mbIsInertial;
 }
 
 void Map::SetIniertialBA1()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mbIMU_BA1 = true;
 }
 
 void Map::SetIniertialBA2()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mbIMU_BA2 = true;
 }
 
 bool Map::GetIniertialBA1()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mbIMU_BA1;
 }
 
 bool Map::GetIniertialBA2()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mbIMU_BA2;
 }
 
@@ -323,9 +464,79 @@ void Map::ChangeId(long unsigned int nId)
     mnId = nId;
 }
 
+MapObjectPool<MapPoint>* Map::GetMapPointPool()
+{
+    return mpMapPointPool;
+}
+
+MapObjectPool<KeyFrame>* Map::GetKeyFramePool()
+{
+    return mpKeyFramePool;
+}
+
+DescriptorArena* Map::GetDescriptorArena()
+{
+    return mpDescriptorArena;
+}
+
+size_t Map::GetMemoryBytes()
+{
+    MemoryBreakdown breakdown;
+    GetMemoryBreakdown(breakdown);
+    return breakdown.Total();
+}
+
+void Map::GetMemoryBreakdown(MemoryBreakdown &breakdown)
+{
+    const KeyFrameSnapshot pKeyFrames = GetKeyFramesSnapshot();
+    const MapPointSnapshot pMapPoints = GetMapPointsSnapshot();
+
+    // The sets and their snapshots hold one pointer per element
+    breakdown.Add(MemoryBreakdown::MAP, sizeof(Map) + (pKeyFrames->size() + pMapPoints->size())*(kSetNodeBytes + sizeof(void*)));
+    for(KeyFrame* pKFi : *pKeyFrames)
+        pKFi->GetMemoryBreakdown(breakdown);
+    for(MapPoint* pMPi : *pMapPoints)
+        pMPi->GetMemoryBreakdown(breakdown);
+}
+
+size_t Map::ReclaimMapPoints()
+{
+    const unsigned long nNow = nTrackedFrames.load(std::memory_order_relaxed);
+
+    // A point erased at epoch e is in the snapshots built before e
+    unsigned long nOldestSnapshot = numeric_limits<unsigned long>::max();
+    {
+        unique_lock<ProfiledMutex> lock(mMutexMap);
+        while(!mdMapPointSnapshots.empty() && mdMapPointSnapshots.front().second.expired())
+            mdMapPointSnapshots.pop_front();
+        if(!mdMapPointSnapshots.empty())
+            nOldestSnapshot = mdMapPointSnapshots.front().first;
+    }
+
+    vector<MapPoint*> vpReclaimed;
+    {
+        unique_lock<mutex> lock(mMutexRetired);
+        while(!mdRetiredMapPoints.empty() && mdRetiredMapPoints.front().nFrame + kReclaimGraceFrames <= nNow &&
+              mdRetiredMapPoints.front().nEpoch <= nOldestSnapshot)
+        {
+            vpReclaimed.push_back(mdRetiredMapPoints.front().pMP);
+            mdRetiredMapPoints.pop_front();
+        }
+    }
+
+    for(size_t i=0; i<vpReclaimed.size(); i++)
+        delete vpReclaimed[i];
+    return vpReclaimed.size();
+}
+
+void Map::NotifyTrackedFrame()
+{
+    nTrackedFrames.fetch_add(1, std::memory_order_relaxed);
+}
+
 unsigned int Map::GetLowerKFID()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     if (mpKFlowerID) {
         return mpKFlowerID->mnId;
     }
@@ -334,25 +545,25 @@ unsigned int Map::GetLowerKFID()
 
 int Map::GetMapChangeIndex()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mnMapChange;
 }
 
 void Map::IncreaseChangeIndex()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mnMapChange++;
 }
 
 int Map::GetLastMapChange()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mnMapChangeNotified;
 }
 
 void Map::SetLastMapChange(int currentChangeId)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mnMapChangeNotified = currentChangeId;
 }
 
@@ -428,6 +639,8 @@ void Map::PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long u
 {
     std::copy(mvpBackupMapPoints.begin(), mvpBackupMapPoints.end(), std::inserter(mspMapPoints, mspMapPoints.begin()));
     std::copy(mvpBackupKeyFrames.begin(), mvpBackupKeyFrames.end(), std::inserter(mspKeyFrames, mspKeyFrames.begin()));
+    InvalidateMapPointsSnapshot();
+    InvalidateKeyFramesSnapshot();
 
     map<long unsigned int,MapPoint*> mpMapPointId;
     for(MapPoint* pMPi : mspMapPoints)
@@ -452,6 +665,8 @@ void Map::PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long u
     }
 
     // References reconstruction between different instances
+    vector<KeyFrame*> vpLoadedKFs;
+    vpLoadedKFs.reserve(mpKeyFrameId.size());
     for(MapPoint* pMPi : mspMapPoints)
     {
         if(!pMPi || pMPi->isBad())
@@ -466,8 +681,9 @@ void Map::PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long u
             continue;
 
         pKFi->PostLoad(mpKeyFrameId, mpMapPointId, mpCams);
-        pKFDB->add(pKFi);
+        vpLoadedKFs.push_back(pKFi);
     }
+    pKFDB->add(vpLoadedKFs);
 
 
     if(mnBackupKFinitialID != -1)
@@ -490,5 +706,11 @@ void Map::PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long u
     mvpBackupMapPoints.clear();
 }
 
+void Map::SwapBackupData(std::vector<KeyFrame*> &vpKFs, std::vector<MapPoint*> &vpMPs)
+{
+    mvpBackupKeyFrames.swap(vpKFs);
+    mvpBackupMapPoints.swap(vpMPs);
+}
+
 
 } //namespace ORB_SLAM3
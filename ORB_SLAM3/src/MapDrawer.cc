@@ -26,7 +26,8 @@ namespace ORB_SLAM3
 {
 
 
-MapDrawer::MapDrawer(Atlas* pAtlas, const string &strSettingPath, Settings* settings):mpAtlas(pAtlas)
+MapDrawer::MapDrawer(Atlas* pAtlas, const string &strSettingPath, Settings* settings):mpAtlas(pAtlas), mfMapUpdateRate(10.0f),
+    mpRenderer(static_cast<MapRenderer*>(NULL)), mbUpdateEnabled(true)
 {
     if(settings){
         newParameterLoader(settings);
@@ -57,6 +58,7 @@ void MapDrawer::newParameterLoader(Settings *settings) {
     mPointSize = settings->pointSize();
     mCameraSize = settings->cameraSize();
     mCameraLineWidth  = settings->cameraLineWidth();
+    mfMapUpdateRate = settings->mapUpdateRate();
 }
 
 bool MapDrawer::ParseViewerParamFile(cv::FileStorage &fSettings)
@@ -129,16 +131,36 @@ bool MapDrawer::ParseViewerParamFile(cv::FileStorage &fSettings)
         b_miss_params = true;
     }
 
+    node = fSettings["Viewer.mapUpdateRate"];
+    if(!node.empty())
+    {
+        mfMapUpdateRate = node.real();
+    }
+
     return !b_miss_params;
 }
 
+MapRenderer* MapDrawer::GetRenderer()
+{
+    if(!mpRenderer)
+        mpRenderer = new MapRenderer(mfMapUpdateRate, mKeyFrameSize, mfFrameColors, 6);
+    return mpRenderer;
+}
+
 void MapDrawer::DrawMapPoints()
 {
+    if(mfMapUpdateRate>0)
+    {
+        GetRenderer()->DrawMapPoints(mpAtlas, mPointSize);
+        return;
+    }
+
     Map* pActiveMap = mpAtlas->GetCurrentMap();
     if(!pActiveMap)
         return;
 
-    const vector<MapPoint*> &vpMPs = pActiveMap->GetAllMapPoints();
+    const Map::MapPointSnapshot pMapPoints = pActiveMap->GetMapPointsSnapshot();
+    const vector<MapPoint*> &vpMPs = *pMapPoints;
     const vector<MapPoint*> &vpRefMPs = pActiveMap->GetReferenceMapPoints();
 
     set<MapPoint*> spRefMPs(vpRefMPs.begin(), vpRefMPs.end());
@@ -177,6 +199,13 @@ void MapDrawer::DrawMapPoints()
 
 void MapDrawer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const bool bDrawInertialGraph, const bool bDrawOptLba)
 {
+    // The local BA debug colors change with every optimization, they are drawn in immediate mode
+    if(mfMapUpdateRate>0 && !bDrawOptLba)
+    {
+        GetRenderer()->DrawKeyFrames(mpAtlas, bDrawKF, bDrawGraph, bDrawInertialGraph, mKeyFrameLineWidth, mGraphLineWidth);
+        return;
+    }
+
     const float &w = mKeyFrameSize;
     const float h = w*0.75;
     const float z = w*0.6;
@@ -189,7 +218,8 @@ void MapDrawer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const b
     if(!pActiveMap)
         return;
 
-    const vector<KeyFrame*> vpKFs = pActiveMap->GetAllKeyFrames();
+    const Map::KeyFrameSnapshot pKeyFrames = pActiveMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
 
     if(bDrawKF)
     {
@@ -342,7 +372,8 @@ void MapDrawer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const b
             if(pMap == pActiveMap)
                 continue;
 
-            vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+            const Map::KeyFrameSnapshot pMapKeyFrames = pMap->GetKeyFramesSnapshot();
+            const vector<KeyFrame*> &vpKFs = *pMapKeyFrames;
 
             for(size_t i=0; i<vpKFs.size(); i++)
             {
@@ -440,10 +471,23 @@ void MapDrawer::DrawCurrentCamera(pangolin::OpenGlMatrix &Twc)
 
 void MapDrawer::SetCurrentCameraPose(const Sophus::SE3f &Tcw)
 {
+    if(!mbUpdateEnabled.load(memory_order_relaxed))
+        return;
+
     unique_lock<mutex> lock(mMutexCamera);
     mCameraPose = Tcw.inverse();
 }
 
+void MapDrawer::SetUpdateEnabled(bool bEnabled)
+{
+    mbUpdateEnabled = bEnabled;
+}
+
+bool MapDrawer::IsUpdateEnabled() const
+{
+    return mbUpdateEnabled;
+}
+
 void MapDrawer::GetCurrentOpenGLCameraMatrix(pangolin::OpenGlMatrix &M, pangolin::OpenGlMatrix &MOw)
 {
     Eigen::Matrix4f Twc;
@@ -20,18 +20,40 @@
 #include "ORBmatcher.h"
 
 #include<mutex>
+#include<cstring>
 
 namespace ORB_SLAM3
 {
 
 long unsigned int MapPoint::nNextId=0;
-mutex MapPoint::mGlobalMutex;
+ProfiledMutex MapPoint::mGlobalMutex("MapPoint::mGlobalMutex");
+atomic<unsigned long> MapPoint::nPositionEpoch(0);
+
+void* MapPoint::operator new(size_t size, Map* pMap)
+{
+    return MapObjectPool<MapPoint>::Allocate(pMap ? pMap->GetMapPointPool() : static_cast<MapObjectPool<MapPoint>*>(NULL), size);
+}
+
+void* MapPoint::operator new(size_t size)
+{
+    return MapObjectPool<MapPoint>::Allocate(NULL, size);
+}
+
+void MapPoint::operator delete(void* p, Map*)
+{
+    MapObjectPool<MapPoint>::Free(p);
+}
+
+void MapPoint::operator delete(void* p)
+{
+    MapObjectPool<MapPoint>::Free(p);
+}
 
 MapPoint::MapPoint():
     mnFirstKFid(0), mnFirstFrame(0), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL))
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mpDescriptor(DescriptorArena::Allocate(NULL)), mnVisible(1),
+    mnFound(1), mbBad(false), mpReplaced(static_cast<MapPoint*>(NULL))
 {
     mpReplaced = static_cast<MapPoint*>(NULL);
 }
@@ -39,26 +61,27 @@ MapPoint::MapPoint():
 MapPoint::MapPoint(const Eigen::Vector3f &Pos, KeyFrame *pRefKF, Map* pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mpDescriptor(DescriptorArena::Allocate(pMap->GetDescriptorArena())),
+    mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
     mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap),
     mnOriginMapId(pMap->GetId())
 {
-    SetWorldPos(Pos);
-
     mNormalVector.setZero();
+    SetWorldPos(Pos);
 
     mbTrackInViewR = false;
     mbTrackInView = false;
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-    unique_lock<mutex> lock(mpMap->mMutexPointCreation);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexPointCreation);
     mnId=nNextId++;
 }
 
 MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, KeyFrame* pRefKF, KeyFrame* pHostKF, Map* pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mpDescriptor(DescriptorArena::Allocate(pMap->GetDescriptorArena())),
+    mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
     mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap),
     mnOriginMapId(pMap->GetId())
 {
@@ -67,18 +90,21 @@ MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, KeyFrame* pRefKF,
     mInitV=(double)uv_init.y;
     mpHostKF = pHostKF;
 
+    mWorldPos.setZero();
     mNormalVector.setZero();
+    PublishGeometry();
 
     // Worldpos is not set
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-    unique_lock<mutex> lock(mpMap->mMutexPointCreation);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexPointCreation);
     mnId=nNextId++;
 }
 
 MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map* pMap, Frame* pFrame, const int &idxF):
     mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
     mnBALocalForKF(0), mnFuseCandidateForKF(0),mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mpDescriptor(DescriptorArena::Allocate(pMap->GetDescriptorArena())),
+    mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
     mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap), mnOriginMapId(pMap->GetId())
 {
     SetWorldPos(Pos);
@@ -108,39 +134,77 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map* pMap, Frame* pFrame, const i
     mfMaxDistance = dist*levelScaleFactor;
     mfMinDistance = mfMaxDistance/pFrame->mvScaleFactors[nLevels-1];
 
-    pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
+    SetDescriptor(pFrame->mDescriptors.ptr<unsigned char>(idxF));
+
+    PublishGeometry();
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-    unique_lock<mutex> lock(mpMap->mMutexPointCreation);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexPointCreation);
     mnId=nNextId++;
 }
 
+MapPoint::~MapPoint()
+{
+    DescriptorArena::Free(mpDescriptor);
+}
+
 void MapPoint::SetWorldPos(const Eigen::Vector3f &Pos) {
-    unique_lock<mutex> lock2(mGlobalMutex);
-    unique_lock<mutex> lock(mMutexPos);
+    unique_lock<ProfiledMutex> lock2(mGlobalMutex);
+    unique_lock<ProfiledMutex> lock(mMutexPos);
     mWorldPos = Pos;
+    PublishGeometry();
+    mnPositionEpoch = ++nPositionEpoch;
+}
+
+unsigned long MapPoint::GetPositionEpoch()
+{
+    return mnPositionEpoch;
+}
+
+unsigned long MapPoint::GetPositionEpochCounter()
+{
+    return nPositionEpoch;
 }
 
 Eigen::Vector3f MapPoint::GetWorldPos() {
-    unique_lock<mutex> lock(mMutexPos);
-    return mWorldPos;
+    float geometry[8];
+    mSharedGeometry.Load(geometry);
+    return Eigen::Vector3f(geometry[0], geometry[1], geometry[2]);
 }
 
 Eigen::Vector3f MapPoint::GetNormal() {
-    unique_lock<mutex> lock(mMutexPos);
-    return mNormalVector;
+    float geometry[8];
+    mSharedGeometry.Load(geometry);
+    return Eigen::Vector3f(geometry[3], geometry[4], geometry[5]);
+}
+
+void MapPoint::GetGeometry(float* pGeometry) {
+    mSharedGeometry.Load(pGeometry);
+}
+
+void MapPoint::PublishGeometry()
+{
+    const float geometry[8] = {mWorldPos(0), mWorldPos(1), mWorldPos(2),
+                               mNormalVector(0), mNormalVector(1), mNormalVector(2),
+                               mfMinDistance, mfMaxDistance};
+    mSharedGeometry.Store(geometry);
+}
+
+void MapPoint::SetDescriptor(const unsigned char* pDescriptor)
+{
+    mpDescriptor->Store(pDescriptor);
 }
 
 
 KeyFrame* MapPoint::GetReferenceKeyFrame()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mpRefKF;
 }
 
 void MapPoint::AddObservation(KeyFrame* pKF, int idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     tuple<int,int> indexes;
 
     if(mObservations.count(pKF)){
@@ -169,7 +233,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 {
     bool bBad=false;
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         if(mObservations.count(pKF))
         {
             tuple<int,int> indexes = mObservations[pKF];
@@ -203,13 +267,13 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 
 std::map<KeyFrame*, std::tuple<int,int>>  MapPoint::GetObservations()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mObservations;
 }
 
 int MapPoint::Observations()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return nObs;
 }
 
@@ -217,8 +281,8 @@ void MapPoint::SetBadFlag()
 {
     map<KeyFrame*, tuple<int,int>> obs;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         mbBad=true;
         obs = mObservations;
         mObservations.clear();
@@ -240,8 +304,8 @@ void MapPoint::SetBadFlag()
 
 MapPoint* MapPoint::GetReplaced()
 {
-    unique_lock<mutex> lock1(mMutexFeatures);
-    unique_lock<mutex> lock2(mMutexPos);
+    unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock2(mMutexPos);
     return mpReplaced;
 }
 
@@ -253,8 +317,8 @@ void MapPoint::Replace(MapPoint* pMP)
     int nvisible, nfound;
     map<KeyFrame*,tuple<int,int>> obs;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         obs=mObservations;
         mObservations.clear();
         mbBad=true;
@@ -301,28 +365,24 @@ void MapPoint::Replace(MapPoint* pMP)
 
 bool MapPoint::isBad()
 {
-    unique_lock<mutex> lock1(mMutexFeatures,std::defer_lock);
-    unique_lock<mutex> lock2(mMutexPos,std::defer_lock);
-    lock(lock1, lock2);
-
-    return mbBad;
+    return mbBad.load(std::memory_order_acquire);
 }
 
 void MapPoint::IncreaseVisible(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     mnVisible+=n;
 }
 
 void MapPoint::IncreaseFound(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     mnFound+=n;
 }
 
 float MapPoint::GetFoundRatio()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return static_cast<float>(mnFound)/mnVisible;
 }
 
@@ -330,11 +390,12 @@ void MapPoint::ComputeDistinctiveDescriptors()
 {
     // Retrieve all observed descriptors
     vector<cv::Mat> vDescriptors;
+    vector<pair<long unsigned int,int> > vKeys;
 
     map<KeyFrame*,tuple<int,int>> observations;
 
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
         if(mbBad)
             return;
         observations=mObservations;
@@ -343,7 +404,8 @@ void MapPoint::ComputeDistinctiveDescriptors()
     if(observations.empty())
         return;
 
-    vDescriptors.reserve(observations.size());
+    vDescriptors.reserve(2*observations.size());
+    vKeys.reserve(2*observations.size());
 
     for(map<KeyFrame*,tuple<int,int>>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
@@ -355,9 +417,11 @@ void MapPoint::ComputeDistinctiveDescriptors()
 
             if(leftIndex != -1){
                 vDescriptors.push_back(pKF->mDescriptors.row(leftIndex));
+                vKeys.push_back(make_pair(pKF->mnId,leftIndex));
             }
             if(rightIndex != -1){
                 vDescriptors.push_back(pKF->mDescriptors.row(rightIndex));
+                vKeys.push_back(make_pair(pKF->mnId,rightIndex));
             }
         }
     }
@@ -365,29 +429,55 @@ void MapPoint::ComputeDistinctiveDescriptors()
     if(vDescriptors.empty())
         return;
 
-    // Compute distances between them
+    unique_lock<mutex> lockCache(mMutexDescriptorCache);
+
+    // Position of every observation in the previous computation, -1 if it is new.
+    // KeyFrame descriptors never change, so the distance of two old observations is reused
     const size_t N = vDescriptors.size();
+    const size_t N0 = mvDescriptorKeys.size();
+    vector<pair<pair<long unsigned int,int>,int> > vOldKeys;
+    vOldKeys.reserve(N0);
+    for(size_t i=0;i<N0;i++)
+        vOldKeys.push_back(make_pair(mvDescriptorKeys[i],(int)i));
+    sort(vOldKeys.begin(),vOldKeys.end());
+
+    vector<int> vOldIdx(N,-1);
+    for(size_t i=0;i<N;i++)
+    {
+        vector<pair<pair<long unsigned int,int>,int> >::iterator it =
+                lower_bound(vOldKeys.begin(),vOldKeys.end(),make_pair(vKeys[i],-1));
+        if(it!=vOldKeys.end() && it->first==vKeys[i])
+            vOldIdx[i] = it->second;
+    }
+
+    // Packed upper triangle, (i,j) with i<j
+    auto packed = [](size_t n, size_t i, size_t j) { return i*n - i*(i+1)/2 + j - i - 1; };
 
-    float Distances[N][N];
+    // Compute distances between them
+    vector<uint16_t> vDistances(N*(N-1)/2);
     for(size_t i=0;i<N;i++)
     {
-        Distances[i][i]=0;
         for(size_t j=i+1;j<N;j++)
         {
-            int distij = ORBmatcher::DescriptorDistance(vDescriptors[i],vDescriptors[j]);
-            Distances[i][j]=distij;
-            Distances[j][i]=distij;
+            const int oi = vOldIdx[i], oj = vOldIdx[j];
+            if(oi>=0 && oj>=0)
+                vDistances[packed(N,i,j)] = mvDescriptorDistances[packed(N0,min(oi,oj),max(oi,oj))];
+            else
+                vDistances[packed(N,i,j)] = ORBmatcher::DescriptorDistance(vDescriptors[i],vDescriptors[j]);
         }
     }
 
     // Take the descriptor with least median distance to the rest
     int BestMedian = INT_MAX;
     int BestIdx = 0;
+    vector<int> vDists(N);
+    const size_t nMedian = (N-1)/2;
     for(size_t i=0;i<N;i++)
     {
-        vector<int> vDists(Distances[i],Distances[i]+N);
-        sort(vDists.begin(),vDists.end());
-        int median = vDists[0.5*(N-1)];
+        for(size_t j=0;j<N;j++)
+            vDists[j] = i==j ? 0 : vDistances[packed(N,min(i,j),max(i,j))];
+        nth_element(vDists.begin(),vDists.begin()+nMedian,vDists.end());
+        int median = vDists[nMedian];
 
         if(median<BestMedian)
         {
@@ -396,21 +486,57 @@ void MapPoint::ComputeDistinctiveDescriptors()
         }
     }
 
+    mvDescriptorKeys.swap(vKeys);
+    mvDescriptorDistances.swap(vDistances);
+
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        mDescriptor = vDescriptors[BestIdx].clone();
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        SetDescriptor(vDescriptors[BestIdx].ptr<unsigned char>());
     }
 }
 
 cv::Mat MapPoint::GetDescriptor()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    return mDescriptor.clone();
+    cv::Mat desc(1, DescriptorArena::kDescriptorBytes, CV_8U);
+    if(!mpDescriptor->Load(desc.data))
+        return cv::Mat();
+    return desc;
+}
+
+cv::Mat MapPoint::GetDescriptor(unsigned char* pBuffer)
+{
+    if(!mpDescriptor->Load(pBuffer))
+        return cv::Mat();
+    return cv::Mat(1, DescriptorArena::kDescriptorBytes, CV_8U, pBuffer);
+}
+
+size_t MapPoint::GetMemoryBytes()
+{
+    MemoryBreakdown breakdown;
+    GetMemoryBreakdown(breakdown);
+    return breakdown.Total();
+}
+
+void MapPoint::GetMemoryBreakdown(MemoryBreakdown &breakdown)
+{
+    // A node of the observations map with its allocator overhead
+    static const size_t kObservationBytes = 64;
+
+    {
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        breakdown.Add(MemoryBreakdown::MAPPOINTS, sizeof(MapPoint) + mObservations.size()*kObservationBytes);
+    }
+    {
+        unique_lock<mutex> lock(mMutexDescriptorCache);
+        breakdown.Add(MemoryBreakdown::MAPPOINT_DESCRIPTORS, sizeof(DescriptorArena::Row) +
+                      mvDescriptorKeys.capacity()*sizeof(pair<long unsigned int,int>) +
+                      mvDescriptorDistances.capacity()*sizeof(uint16_t));
+    }
 }
 
 tuple<int,int> MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     if(mObservations.count(pKF))
         return mObservations[pKF];
     else
@@ -419,7 +545,7 @@ tuple<int,int> MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
 
 bool MapPoint::IsInKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return (mObservations.count(pKF));
 }
 
@@ -429,8 +555,8 @@ void MapPoint::UpdateNormalAndDepth()
     KeyFrame* pRefKF;
     Eigen::Vector3f Pos;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         if(mbBad)
             return;
         observations = mObservations;
@@ -486,38 +612,40 @@ void MapPoint::UpdateNormalAndDepth()
     const int nLevels = pRefKF->mnScaleLevels;
 
     {
-        unique_lock<mutex> lock3(mMutexPos);
+        unique_lock<ProfiledMutex> lock3(mMutexPos);
         mfMaxDistance = dist*levelScaleFactor;
         mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
         mNormalVector = normal/n;
+        PublishGeometry();
     }
 }
 
 void MapPoint::SetNormalVector(const Eigen::Vector3f& normal)
 {
-    unique_lock<mutex> lock3(mMutexPos);
+    unique_lock<ProfiledMutex> lock3(mMutexPos);
     mNormalVector = normal;
+    PublishGeometry();
 }
 
 float MapPoint::GetMinDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return 0.8f * mfMinDistance;
+    float geometry[8];
+    mSharedGeometry.Load(geometry);
+    return 0.8f * geometry[6];
 }
 
 float MapPoint::GetMaxDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return 1.2f * mfMaxDistance;
+    float geometry[8];
+    mSharedGeometry.Load(geometry);
+    return 1.2f * geometry[7];
 }
 
 int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
 {
-    float ratio;
-    {
-        unique_lock<mutex> lock(mMutexPos);
-        ratio = mfMaxDistance/currentDist;
-    }
+    float geometry[8];
+    mSharedGeometry.Load(geometry);
+    const float ratio = geometry[7]/currentDist;
 
     int nScale = ceil(log(ratio)/pKF->mfLogScaleFactor);
     if(nScale<0)
@@ -530,11 +658,9 @@ int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
 
 int MapPoint::PredictScale(const float &currentDist, Frame* pF)
 {
-    float ratio;
-    {
-        unique_lock<mutex> lock(mMutexPos);
-        ratio = mfMaxDistance/currentDist;
-    }
+    float geometry[8];
+    mSharedGeometry.Load(geometry);
+    const float ratio = geometry[7]/currentDist;
 
     int nScale = ceil(log(ratio)/pF->mfLogScaleFactor);
     if(nScale<0)
@@ -559,13 +685,13 @@ void MapPoint::PrintObservations()
 
 Map* MapPoint::GetMap()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mpMap;
 }
 
 void MapPoint::UpdateMap(Map* pMap)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mpMap = pMap;
 }
 
@@ -0,0 +1,529 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MapRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+// Line vertices of a keyframe frustum
+const size_t kFrustumVertices = 16;
+// Smallest buffer allocated, in vertices
+const size_t kMinCapacity = 1024;
+
+const float kMapPointColor[3] = {0.0f, 0.0f, 0.0f};
+const float kReferencePointColor[3] = {1.0f, 0.0f, 0.0f};
+const float kOriginKeyFrameColor[3] = {1.0f, 0.0f, 0.0f};
+const float kKeyFrameColor[3] = {0.0f, 0.0f, 1.0f};
+
+}
+
+MapRenderer::VertexBuffer::VertexBuffer():mnSize(0), mnCapacity(0)
+{
+}
+
+void MapRenderer::VertexBuffer::Resize(size_t nSize)
+{
+    const size_t nOldSize = mnSize;
+    mvPositions.resize(3*nSize, 0.f);
+    mvColors.resize(3*nSize, 0.f);
+    mnSize = nSize;
+    if(nSize>nOldSize)
+        MarkDirty(nOldSize, nSize-nOldSize);
+}
+
+void MapRenderer::VertexBuffer::SetPosition(size_t i, const Eigen::Vector3f &pos)
+{
+    float* p = &mvPositions[3*i];
+    p[0] = pos(0);
+    p[1] = pos(1);
+    p[2] = pos(2);
+    MarkDirty(i, 1);
+}
+
+void MapRenderer::VertexBuffer::SetColor(size_t i, const float* color)
+{
+    std::memcpy(&mvColors[3*i], color, 3*sizeof(float));
+    MarkDirty(i, 1);
+}
+
+void MapRenderer::VertexBuffer::Move(size_t iFrom, size_t iTo, size_t nCount)
+{
+    std::memmove(&mvPositions[3*iTo], &mvPositions[3*iFrom], 3*nCount*sizeof(float));
+    std::memmove(&mvColors[3*iTo], &mvColors[3*iFrom], 3*nCount*sizeof(float));
+    MarkDirty(iTo, nCount);
+}
+
+void MapRenderer::VertexBuffer::MarkDirty(size_t i, size_t nCount)
+{
+    if(!mvDirty.empty() && mvDirty.back().second==i)
+        mvDirty.back().second += nCount;
+    else
+        mvDirty.push_back(std::make_pair(i, i+nCount));
+}
+
+void MapRenderer::VertexBuffer::Upload()
+{
+    if(mnSize>mnCapacity)
+    {
+        // Grown past the buffer, everything is uploaded into a new one
+        mnCapacity = std::max(std::max(mnSize, 2*mnCapacity), kMinCapacity);
+        mVbo.Reinitialise(pangolin::GlArrayBuffer, mnCapacity, GL_FLOAT, 3, GL_DYNAMIC_DRAW);
+        mCbo.Reinitialise(pangolin::GlArrayBuffer, mnCapacity, GL_FLOAT, 3, GL_DYNAMIC_DRAW);
+        mvDirty.assign(1, std::make_pair(size_t(0), mnSize));
+    }
+
+    std::sort(mvDirty.begin(), mvDirty.end());
+    size_t i = 0;
+    while(i<mvDirty.size())
+    {
+        size_t nFirst = mvDirty[i].first;
+        size_t nLast = mvDirty[i].second;
+        for(i++; i<mvDirty.size() && mvDirty[i].first<=nLast; i++)
+            nLast = std::max(nLast, mvDirty[i].second);
+
+        // Ranges past a shrink are gone
+        nLast = std::min(nLast, mnSize);
+        if(nFirst>=nLast)
+            continue;
+
+        const GLsizeiptr nBytes = 3*(nLast-nFirst)*sizeof(float);
+        const GLintptr nOffset = 3*nFirst*sizeof(float);
+        mVbo.Upload(&mvPositions[3*nFirst], nBytes, nOffset);
+        mCbo.Upload(&mvColors[3*nFirst], nBytes, nOffset);
+    }
+    mvDirty.clear();
+}
+
+void MapRenderer::VertexBuffer::Draw(GLenum mode, size_t nFirst, size_t nCount, bool bColors)
+{
+    if(nCount==0 || nFirst+nCount>std::min(mnSize, mnCapacity))
+        return;
+
+    mVbo.Bind();
+    glVertexPointer(3, GL_FLOAT, 0, 0);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if(bColors)
+    {
+        mCbo.Bind();
+        glColorPointer(3, GL_FLOAT, 0, 0);
+        glEnableClientState(GL_COLOR_ARRAY);
+    }
+
+    glDrawArrays(mode, static_cast<GLint>(nFirst), static_cast<GLsizei>(nCount));
+
+    if(bColors)
+    {
+        glDisableClientState(GL_COLOR_ARRAY);
+        mCbo.Unbind();
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    mVbo.Unbind();
+}
+
+MapRenderer::MapRenderer(float fUpdateRate, float fKeyFrameSize, const float (*pFrameColors)[3], int nFrameColors):
+    mfKeyFrameSize(fKeyFrameSize), mpFrameColors(pFrameColors), mnFrameColors(nFrameColors),
+    mpPointsMap(static_cast<Map*>(NULL)), mnPointsEpoch(0), mnPointsScan(0),
+    mpKeyFramesActiveMap(static_cast<Map*>(NULL)), mnKeyFramesEpoch(0), mnKeyFramesScan(0),
+    mnGraphScan(0), mnInertialGraphScan(0)
+{
+    if(fUpdateRate>0)
+        mUpdatePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0/fUpdateRate));
+    else
+        mUpdatePeriod = std::chrono::steady_clock::duration::zero();
+}
+
+bool MapRenderer::DueForUpdate(std::chrono::steady_clock::time_point &tLastUpdate)
+{
+    const std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+    if(tLastUpdate!=std::chrono::steady_clock::time_point() && tNow-tLastUpdate<mUpdatePeriod)
+        return false;
+    tLastUpdate = tNow;
+    return true;
+}
+
+void MapRenderer::DrawMapPoints(Atlas* pAtlas, float fPointSize)
+{
+    if(DueForUpdate(mtPointsUpdate))
+    {
+        UpdateMapPoints(pAtlas);
+        mPoints.Upload();
+    }
+
+    glPointSize(fPointSize);
+    mPoints.Draw(GL_POINTS, 0, mPoints.Size(), true);
+}
+
+void MapRenderer::UpdateMapPoints(Atlas* pAtlas)
+{
+    Map* pMap = pAtlas->GetCurrentMap();
+    if(pMap!=mpPointsMap)
+    {
+        ClearMapPoints();
+        mpPointsMap = pMap;
+    }
+    if(!pMap)
+        return;
+
+    // The counter is read first, a point moved during the scan is uploaded again next time
+    const unsigned long nEpoch = MapPoint::GetPositionEpochCounter();
+    const Map::MapPointSnapshot pSnapshot = pMap->GetMapPointsSnapshot();
+    const bool bScan = pSnapshot!=mpPointsSnapshot || nEpoch!=mnPointsEpoch;
+    if(bScan)
+    {
+        mnPointsScan++;
+        for(MapPoint* pMP : *pSnapshot)
+        {
+            if(pMP->isBad())
+                continue;
+
+            const unsigned long nPointEpoch = pMP->GetPositionEpoch();
+            std::unordered_map<MapPoint*,Slot>::iterator it = mmPointSlots.find(pMP);
+            if(it==mmPointSlots.end())
+            {
+                Slot slot;
+                slot.nIndex = mvpPointAtIndex.size();
+                slot.nEpoch = nPointEpoch;
+                slot.nSeen = mnPointsScan;
+                mmPointSlots[pMP] = slot;
+                mvpPointAtIndex.push_back(pMP);
+
+                mPoints.Resize(mvpPointAtIndex.size());
+                mPoints.SetPosition(slot.nIndex, pMP->GetWorldPos());
+                mPoints.SetColor(slot.nIndex, kMapPointColor);
+            }
+            else
+            {
+                it->second.nSeen = mnPointsScan;
+                if(it->second.nEpoch!=nPointEpoch)
+                {
+                    it->second.nEpoch = nPointEpoch;
+                    mPoints.SetPosition(it->second.nIndex, pMP->GetWorldPos());
+                }
+            }
+        }
+
+        // Points culled from the map or gone bad since the last scan
+        for(size_t i=0; i<mvpPointAtIndex.size();)
+        {
+            MapPoint* pMP = mvpPointAtIndex[i];
+            if(mmPointSlots[pMP].nSeen!=mnPointsScan)
+                RemoveMapPoint(pMP);
+            else
+                i++;
+        }
+
+        mpPointsSnapshot = pSnapshot;
+        mnPointsEpoch = nEpoch;
+    }
+
+    // The reference map points change with every tracked frame and are only recolored
+    std::vector<MapPoint*> vpReferencePoints = pMap->GetReferenceMapPoints();
+    if(bScan || vpReferencePoints!=mvpReferencePoints)
+    {
+        for(MapPoint* pMP : mvpReferencePoints)
+        {
+            std::unordered_map<MapPoint*,Slot>::iterator it = mmPointSlots.find(pMP);
+            if(it!=mmPointSlots.end())
+                mPoints.SetColor(it->second.nIndex, kMapPointColor);
+        }
+        for(MapPoint* pMP : vpReferencePoints)
+        {
+            std::unordered_map<MapPoint*,Slot>::iterator it = mmPointSlots.find(pMP);
+            if(it!=mmPointSlots.end())
+                mPoints.SetColor(it->second.nIndex, kReferencePointColor);
+        }
+        mvpReferencePoints.swap(vpReferencePoints);
+    }
+}
+
+void MapRenderer::RemoveMapPoint(MapPoint* pMP)
+{
+    std::unordered_map<MapPoint*,Slot>::iterator it = mmPointSlots.find(pMP);
+    const size_t nIndex = it->second.nIndex;
+    const size_t nLast = mvpPointAtIndex.size()-1;
+    if(nIndex!=nLast)
+    {
+        MapPoint* pLast = mvpPointAtIndex[nLast];
+        mPoints.Move(nLast, nIndex, 1);
+        mvpPointAtIndex[nIndex] = pLast;
+        mmPointSlots[pLast].nIndex = nIndex;
+    }
+    mvpPointAtIndex.pop_back();
+    mPoints.Resize(nLast);
+    mmPointSlots.erase(it);
+}
+
+void MapRenderer::ClearMapPoints()
+{
+    mmPointSlots.clear();
+    mvpPointAtIndex.clear();
+    mvpReferencePoints.clear();
+    mPoints.Resize(0);
+    mpPointsSnapshot.reset();
+}
+
+void MapRenderer::DrawKeyFrames(Atlas* pAtlas, const bool bDrawKF, const bool bDrawGraph, const bool bDrawInertialGraph,
+                                float fKeyFrameLineWidth, float fGraphLineWidth)
+{
+    if(DueForUpdate(mtKeyFramesUpdate))
+    {
+        UpdateKeyFrames(pAtlas);
+        mKeyFrames.Upload();
+        UpdateGraph(bDrawGraph, bDrawInertialGraph);
+    }
+
+    if(bDrawKF)
+    {
+        glLineWidth(fKeyFrameLineWidth);
+        mKeyFrames.Draw(GL_LINES, 0, mKeyFrames.Size(), true);
+
+        // The first keyframe of each map is drawn again with a wider line
+        glLineWidth(fKeyFrameLineWidth*5);
+        for(KeyFrame* pKF : mvpOriginKeyFrames)
+        {
+            std::unordered_map<KeyFrame*,Slot>::iterator it = mmKeyFrameSlots.find(pKF);
+            if(it!=mmKeyFrameSlots.end())
+                mKeyFrames.Draw(GL_LINES, it->second.nIndex*kFrustumVertices, kFrustumVertices, true);
+        }
+    }
+
+    if(bDrawGraph)
+    {
+        glLineWidth(fGraphLineWidth);
+        glColor4f(0.0f,1.0f,0.0f,0.6f);
+        mGraph.Draw(GL_LINES, 0, mGraph.Size(), false);
+    }
+
+    if(bDrawInertialGraph)
+    {
+        Map* pActiveMap = pAtlas->GetCurrentMap();
+        if(pActiveMap && pActiveMap->isImuInitialized())
+        {
+            glLineWidth(fGraphLineWidth);
+            glColor4f(1.0f,0.0f,0.0f,0.6f);
+            mInertialGraph.Draw(GL_LINES, 0, mInertialGraph.Size(), false);
+        }
+    }
+}
+
+void MapRenderer::UpdateKeyFrames(Atlas* pAtlas)
+{
+    Map* pActiveMap = pAtlas->GetCurrentMap();
+    const std::vector<Map*> vpMaps = pAtlas->GetAllMaps();
+
+    const unsigned long nEpoch = KeyFrame::GetPoseEpochCounter();
+    std::vector<Map::KeyFrameSnapshot> vpSnapshots;
+    vpSnapshots.reserve(vpMaps.size());
+    for(Map* pMap : vpMaps)
+        vpSnapshots.push_back(pMap->GetKeyFramesSnapshot());
+
+    if(pActiveMap==mpKeyFramesActiveMap && vpMaps==mvpKeyFrameMaps && vpSnapshots==mvpKeyFrameSnapshots &&
+       nEpoch==mnKeyFramesEpoch)
+        return;
+
+    mnKeyFramesScan++;
+    mvpOriginKeyFrames.clear();
+    for(size_t iMap=0; iMap<vpMaps.size(); iMap++)
+    {
+        const bool bActive = vpMaps[iMap]==pActiveMap;
+        for(KeyFrame* pKF : *vpSnapshots[iMap])
+        {
+            if(pKF->isBad())
+                continue;
+
+            const bool bOrigin = !pKF->GetParent();
+            const float* color = bOrigin ? kOriginKeyFrameColor :
+                                 bActive ? kKeyFrameColor : mpFrameColors[pKF->mnOriginMapId % mnFrameColors];
+            if(bOrigin)
+                mvpOriginKeyFrames.push_back(pKF);
+
+            const unsigned long nPoseEpoch = pKF->GetPoseEpoch();
+            std::unordered_map<KeyFrame*,Slot>::iterator it = mmKeyFrameSlots.find(pKF);
+            bool bRecolor;
+            if(it==mmKeyFrameSlots.end())
+            {
+                Slot slot;
+                slot.nIndex = mvpKeyFrameAtIndex.size();
+                slot.nEpoch = nPoseEpoch;
+                slot.nSeen = mnKeyFramesScan;
+                it = mmKeyFrameSlots.insert(std::make_pair(pKF, slot)).first;
+                mvpKeyFrameAtIndex.push_back(pKF);
+
+                mKeyFrames.Resize(mvpKeyFrameAtIndex.size()*kFrustumVertices);
+                WriteKeyFrame(slot.nIndex, pKF);
+                bRecolor = true;
+            }
+            else
+            {
+                it->second.nSeen = mnKeyFramesScan;
+                if(it->second.nEpoch!=nPoseEpoch)
+                {
+                    it->second.nEpoch = nPoseEpoch;
+                    WriteKeyFrame(it->second.nIndex, pKF);
+                }
+                bRecolor = std::memcmp(mKeyFrames.GetColor(it->second.nIndex*kFrustumVertices), color, 3*sizeof(float))!=0;
+            }
+
+            if(bRecolor)
+            {
+                const size_t nFirst = it->second.nIndex*kFrustumVertices;
+                for(size_t i=0; i<kFrustumVertices; i++)
+                    mKeyFrames.SetColor(nFirst+i, color);
+            }
+        }
+    }
+
+    for(size_t i=0; i<mvpKeyFrameAtIndex.size();)
+    {
+        KeyFrame* pKF = mvpKeyFrameAtIndex[i];
+        if(mmKeyFrameSlots[pKF].nSeen!=mnKeyFramesScan)
+            RemoveKeyFrame(pKF);
+        else
+            i++;
+    }
+
+    mpKeyFramesActiveMap = pActiveMap;
+    mvpKeyFrameMaps = vpMaps;
+    mvpKeyFrameSnapshots.swap(vpSnapshots);
+    mnKeyFramesEpoch = nEpoch;
+}
+
+void MapRenderer::WriteKeyFrame(size_t nIndex, KeyFrame* pKF)
+{
+    const float &w = mfKeyFrameSize;
+    const float h = w*0.75;
+    const float z = w*0.6;
+
+    const Eigen::Vector3f vFrustum[kFrustumVertices] = {
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(w,h,z),
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(w,-h,z),
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(-w,-h,z),
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(-w,h,z),
+        Eigen::Vector3f(w,h,z), Eigen::Vector3f(w,-h,z),
+        Eigen::Vector3f(-w,h,z), Eigen::Vector3f(-w,-h,z),
+        Eigen::Vector3f(-w,h,z), Eigen::Vector3f(w,h,z),
+        Eigen::Vector3f(-w,-h,z), Eigen::Vector3f(w,-h,z)};
+
+    const Sophus::SE3f Twc = pKF->GetPoseInverse();
+    const size_t nFirst = nIndex*kFrustumVertices;
+    for(size_t i=0; i<kFrustumVertices; i++)
+        mKeyFrames.SetPosition(nFirst+i, Twc*vFrustum[i]);
+}
+
+void MapRenderer::RemoveKeyFrame(KeyFrame* pKF)
+{
+    std::unordered_map<KeyFrame*,Slot>::iterator it = mmKeyFrameSlots.find(pKF);
+    const size_t nIndex = it->second.nIndex;
+    const size_t nLast = mvpKeyFrameAtIndex.size()-1;
+    if(nIndex!=nLast)
+    {
+        KeyFrame* pLast = mvpKeyFrameAtIndex[nLast];
+        mKeyFrames.Move(nLast*kFrustumVertices, nIndex*kFrustumVertices, kFrustumVertices);
+        mvpKeyFrameAtIndex[nIndex] = pLast;
+        mmKeyFrameSlots[pLast].nIndex = nIndex;
+    }
+    mvpKeyFrameAtIndex.pop_back();
+    mKeyFrames.Resize(nLast*kFrustumVertices);
+    mmKeyFrameSlots.erase(it);
+}
+
+void MapRenderer::UpdateGraph(const bool bDrawGraph, const bool bDrawInertialGraph)
+{
+    // Keyframes of the active map as of the last scan
+    const std::vector<Map*>::const_iterator itMap = std::find(mvpKeyFrameMaps.begin(), mvpKeyFrameMaps.end(), mpKeyFramesActiveMap);
+    if(itMap==mvpKeyFrameMaps.end())
+    {
+        mGraph.Resize(0);
+        mInertialGraph.Resize(0);
+        return;
+    }
+    const std::vector<KeyFrame*> &vpKFs = *mvpKeyFrameSnapshots[itMap-mvpKeyFrameMaps.begin()];
+
+    std::vector<Eigen::Vector3f> vLines;
+    if(bDrawGraph && mnGraphScan!=mnKeyFramesScan)
+    {
+        for(KeyFrame* pKF : vpKFs)
+        {
+            if(pKF->isBad())
+                continue;
+
+            // Covisibility Graph
+            const Eigen::Vector3f Ow = pKF->GetCameraCenter();
+            const std::vector<KeyFrame*> vCovKFs = pKF->GetCovisiblesByWeight(100);
+            for(KeyFrame* pCovKF : vCovKFs)
+            {
+                if(pCovKF->mnId<pKF->mnId)
+                    continue;
+                vLines.push_back(Ow);
+                vLines.push_back(pCovKF->GetCameraCenter());
+            }
+
+            // Spanning tree
+            KeyFrame* pParent = pKF->GetParent();
+            if(pParent)
+            {
+                vLines.push_back(Ow);
+                vLines.push_back(pParent->GetCameraCenter());
+            }
+
+            // Loops
+            const std::set<KeyFrame*> sLoopKFs = pKF->GetLoopEdges();
+            for(KeyFrame* pLoopKF : sLoopKFs)
+            {
+                if(pLoopKF->mnId<pKF->mnId)
+                    continue;
+                vLines.push_back(Ow);
+                vLines.push_back(pLoopKF->GetCameraCenter());
+            }
+        }
+
+        mGraph.Resize(vLines.size());
+        for(size_t i=0; i<vLines.size(); i++)
+            mGraph.SetPosition(i, vLines[i]);
+        mGraph.Upload();
+        mnGraphScan = mnKeyFramesScan;
+    }
+
+    if(bDrawInertialGraph && mnInertialGraphScan!=mnKeyFramesScan && mpKeyFramesActiveMap->isImuInitialized())
+    {
+        vLines.clear();
+        for(KeyFrame* pKF : vpKFs)
+        {
+            KeyFrame* pNext = pKF->mNextKF;
+            if(pKF->isBad() || !pNext)
+                continue;
+            vLines.push_back(pKF->GetCameraCenter());
+            vLines.push_back(pNext->GetCameraCenter());
+        }
+
+        mInertialGraph.Resize(vLines.size());
+        for(size_t i=0; i<vLines.size(); i++)
+            mInertialGraph.SetPosition(i, vLines[i]);
+        mInertialGraph.Upload();
+        mnInertialGraphScan = mnKeyFramesScan;
+    }
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,106 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryAccounting.h"
+
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+std::atomic<size_t> gvRegisteredBytes[MemoryBreakdown::NUM_CATEGORIES];
+
+} // namespace
+
+MemoryBreakdown::MemoryBreakdown(): nPagedOutBytes(0)
+{
+    for(int i=0; i<NUM_CATEGORIES; i++)
+        vBytes[i] = 0;
+}
+
+size_t MemoryBreakdown::Total() const
+{
+    size_t nTotal = 0;
+    for(int i=0; i<NUM_CATEGORIES; i++)
+        nTotal += vBytes[i];
+    return nTotal;
+}
+
+MemoryBreakdown& MemoryBreakdown::operator+=(const MemoryBreakdown &other)
+{
+    for(int i=0; i<NUM_CATEGORIES; i++)
+        vBytes[i] += other.vBytes[i];
+    nPagedOutBytes += other.nPagedOutBytes;
+    return *this;
+}
+
+const char* MemoryBreakdown::GetCategoryName(Category category)
+{
+    switch(category)
+    {
+    case MAP: return "map";
+    case KEYFRAME_KEYPOINTS: return "keyframe_keypoints";
+    case KEYFRAME_DESCRIPTORS: return "keyframe_descriptors";
+    case KEYFRAME_GRIDS: return "keyframe_grids";
+    case KEYFRAME_BOW: return "keyframe_bow";
+    case KEYFRAME_GRAPH: return "keyframe_graph";
+    case MAPPOINTS: return "mappoints";
+    case MAPPOINT_DESCRIPTORS: return "mappoint_descriptors";
+    case KEYFRAME_DATABASE: return "keyframe_database";
+    case VOCABULARY: return "vocabulary";
+    case TPU_ARENAS: return "tpu_arenas";
+    case FRAME_BUFFERS: return "frame_buffers";
+    default: return "unknown";
+    }
+}
+
+void MemoryAccounting::Add(MemoryBreakdown::Category category, size_t nBytes)
+{
+    gvRegisteredBytes[category].fetch_add(nBytes, std::memory_order_relaxed);
+}
+
+void MemoryAccounting::Remove(MemoryBreakdown::Category category, size_t nBytes)
+{
+    gvRegisteredBytes[category].fetch_sub(nBytes, std::memory_order_relaxed);
+}
+
+void MemoryAccounting::AddRegistered(MemoryBreakdown &breakdown)
+{
+    for(int i=0; i<MemoryBreakdown::NUM_CATEGORIES; i++)
+        breakdown.vBytes[i] += gvRegisteredBytes[i].load(std::memory_order_relaxed);
+}
+
+size_t MemoryAccounting::GetResidentBytes()
+{
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(!f)
+        return 0;
+    unsigned long nSize = 0, nResident = 0;
+    const int n = fscanf(f, "%lu %lu", &nSize, &nResident);
+    fclose(f);
+    if(n != 2)
+        return 0;
+    return (size_t)nResident*(size_t)sysconf(_SC_PAGESIZE);
+}
+
+} //namespace ORB_SLAM
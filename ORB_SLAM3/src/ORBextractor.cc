@@ -58,8 +58,14 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
 #include <iostream>
+#include <cstring>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "ORBextractor.h"
+#include "RGAPyramid.h"
 
 
 using namespace cv;
@@ -114,6 +120,25 @@ namespace ORB_SLAM3
         const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
         const int step = (int)img.step;
 
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        // Gather the rotated pattern once, then compare 16 pairs per instruction.
+        // The offsets are rounded exactly as in the scalar path, so the bits are identical.
+        uchar values[512];
+        for (int i = 0; i < 512; ++i)
+            values[i] = center[cvRound(pattern[i].x*b + pattern[i].y*a)*step +
+                               cvRound(pattern[i].x*a - pattern[i].y*b)];
+
+        static const uint8_t bitsData[16] = {1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128};
+        const uint8x16_t bits = vld1q_u8(bitsData);
+        for (int i = 0; i < 32; i += 2)
+        {
+            // 16 (t0,t1) pairs, the first 8 make desc[i] and the last 8 desc[i+1]
+            const uint8x16x2_t pairs = vld2q_u8(values + 16*i);
+            const uint8x16_t lt = vandq_u8(vcltq_u8(pairs.val[0], pairs.val[1]), bits);
+            desc[i] = vaddv_u8(vget_low_u8(lt));
+            desc[i+1] = vaddv_u8(vget_high_u8(lt));
+        }
+#else
 #define GET_VALUE(idx) \
         center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
                cvRound(pattern[idx].x*a - pattern[idx].y*b)]
@@ -143,6 +168,200 @@ namespace ORB_SLAM3
         }
 
 #undef GET_VALUE
+#endif
+    }
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    // FAST-9 on the 16 pixel circle with non-maximum suppression. Same segment test,
+    // score and keypoint order as cv::FAST(img,keypoints,threshold,true), with 16
+    // pixels tested at once.
+    const int FAST_K = 8;
+    const int FAST_N = 25;
+
+    static void makeFastOffsets(int pixel[FAST_N], int step)
+    {
+        static const int offsets[16][2] =
+        {
+            {0, 3}, { 1, 3}, { 2, 2}, { 3, 1}, { 3, 0}, { 3, -1}, { 2, -2}, { 1, -3},
+            {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3, 1}, {-2, 2}, {-1, 3}
+        };
+
+        for (int k = 0; k < 16; ++k)
+            pixel[k] = offsets[k][0] + offsets[k][1]*step;
+        for (int k = 16; k < FAST_N; ++k)
+            pixel[k] = pixel[k - 16];
+    }
+
+    // Largest threshold for which the pixel is still a corner
+    static int fastCornerScore(const uchar* ptr, const int pixel[])
+    {
+        const int v = ptr[0];
+        int16_t d[FAST_N];
+        for (int k = 0; k < FAST_N; ++k)
+            d[k] = (int16_t)(v - ptr[pixel[k]]);
+
+        // Lane l of pass k covers the 9 pixel arcs starting at k+l and k+l+1
+        int16x8_t q0 = vdupq_n_s16(-1000), q1 = vdupq_n_s16(1000);
+        for (int k = 0; k < 16; k += 8)
+        {
+            int16x8_t v0 = vld1q_s16(d + k + 1);
+            int16x8_t a = v0, b = v0;
+            for (int m = 2; m <= 8; ++m)
+            {
+                v0 = vld1q_s16(d + k + m);
+                a = vminq_s16(a, v0);
+                b = vmaxq_s16(b, v0);
+            }
+            v0 = vld1q_s16(d + k);
+            q0 = vmaxq_s16(q0, vminq_s16(a, v0));
+            q1 = vminq_s16(q1, vmaxq_s16(b, v0));
+            v0 = vld1q_s16(d + k + 9);
+            q0 = vmaxq_s16(q0, vminq_s16(a, v0));
+            q1 = vminq_s16(q1, vmaxq_s16(b, v0));
+        }
+        q0 = vmaxq_s16(q0, vnegq_s16(q1));
+        return vmaxvq_s16(q0) - 1;
+    }
+
+    static bool isFastCorner(const uchar* ptr, const int pixel[], int threshold)
+    {
+        const int vd = ptr[0] - threshold, vb = ptr[0] + threshold;
+        int cd = 0, cb = 0;
+        for (int k = 0; k < FAST_N; ++k)
+        {
+            const int x = ptr[pixel[k]];
+            cd = x < vd ? cd + 1 : 0;
+            cb = x > vb ? cb + 1 : 0;
+            if (cd > FAST_K || cb > FAST_K)
+                return true;
+        }
+        return false;
+    }
+
+    static void FASTNeon(const Mat& img, vector<KeyPoint>& keypoints, int threshold)
+    {
+        keypoints.clear();
+        threshold = std::min(std::max(threshold, 0), 255);
+
+        int pixel[FAST_N];
+        makeFastOffsets(pixel, (int)img.step);
+
+        // Scores and corner columns of the last three rows, cornerpos[-1] is the count
+        const int cols = img.cols;
+        vector<uchar> vScores(3*cols, 0);
+        vector<int> vCorners(3*(cols + 1), 0);
+        uchar* buf[3] = {&vScores[0], &vScores[cols], &vScores[2*cols]};
+        int* cpbuf[3] = {&vCorners[0], &vCorners[cols + 1], &vCorners[2*(cols + 1)]};
+
+        const uint8x16_t t = vdupq_n_u8((uchar)threshold);
+        const uint8x16_t K16 = vdupq_n_u8((uchar)FAST_K);
+
+        for (int i = 3; i < img.rows - 2; ++i)
+        {
+            const uchar* ptr = img.ptr<uchar>(i) + 3;
+            uchar* curr = buf[(i - 3)%3];
+            int* cornerpos = cpbuf[(i - 3)%3] + 1;
+            memset(curr, 0, cols);
+            int ncorners = 0;
+
+            if (i < img.rows - 3)
+            {
+                int j = 3;
+                for (; j < cols - 16 - 3; j += 16, ptr += 16)
+                {
+                    // Brighter than v+t or darker than v-t, saturated like the scalar compare
+                    const uint8x16_t v = vld1q_u8(ptr);
+                    const uint8x16_t vb = vqaddq_u8(v, t);
+                    const uint8x16_t vd = vqsubq_u8(v, t);
+
+                    // A 9 pixel arc covers two neighbouring points of 0, 4, 8 and 12
+                    const uint8x16_t x0 = vld1q_u8(ptr + pixel[0]);
+                    const uint8x16_t x1 = vld1q_u8(ptr + pixel[4]);
+                    const uint8x16_t x2 = vld1q_u8(ptr + pixel[8]);
+                    const uint8x16_t x3 = vld1q_u8(ptr + pixel[12]);
+                    uint8x16_t m0 = vandq_u8(vcgtq_u8(x0, vb), vcgtq_u8(x1, vb));
+                    uint8x16_t m1 = vandq_u8(vcltq_u8(x0, vd), vcltq_u8(x1, vd));
+                    m0 = vorrq_u8(m0, vandq_u8(vcgtq_u8(x1, vb), vcgtq_u8(x2, vb)));
+                    m1 = vorrq_u8(m1, vandq_u8(vcltq_u8(x1, vd), vcltq_u8(x2, vd)));
+                    m0 = vorrq_u8(m0, vandq_u8(vcgtq_u8(x2, vb), vcgtq_u8(x3, vb)));
+                    m1 = vorrq_u8(m1, vandq_u8(vcltq_u8(x2, vd), vcltq_u8(x3, vd)));
+                    m0 = vorrq_u8(m0, vandq_u8(vcgtq_u8(x3, vb), vcgtq_u8(x0, vb)));
+                    m1 = vorrq_u8(m1, vandq_u8(vcltq_u8(x3, vd), vcltq_u8(x0, vd)));
+                    if (vmaxvq_u8(vorrq_u8(m0, m1)) == 0)
+                        continue;
+
+                    // Longest run of brighter and darker pixels around the circle
+                    uint8x16_t c0 = vdupq_n_u8(0), c1 = c0, max0 = c0, max1 = c0;
+                    for (int k = 0; k < FAST_N; ++k)
+                    {
+                        const uint8x16_t x = vld1q_u8(ptr + pixel[k]);
+                        m0 = vcgtq_u8(x, vb);
+                        m1 = vcltq_u8(x, vd);
+                        c0 = vandq_u8(vsubq_u8(c0, m0), m0);
+                        c1 = vandq_u8(vsubq_u8(c1, m1), m1);
+                        max0 = vmaxq_u8(max0, c0);
+                        max1 = vmaxq_u8(max1, c1);
+                    }
+
+                    const uint8x16_t corners = vcgtq_u8(vmaxq_u8(max0, max1), K16);
+                    if (vmaxvq_u8(corners) == 0)
+                        continue;
+
+                    uchar mask[16];
+                    vst1q_u8(mask, corners);
+                    for (int k = 0; k < 16; ++k)
+                    {
+                        if (mask[k])
+                        {
+                            cornerpos[ncorners++] = j + k;
+                            curr[j + k] = (uchar)fastCornerScore(ptr + k, pixel);
+                        }
+                    }
+                }
+
+                for (; j < cols - 3; ++j, ++ptr)
+                {
+                    if (isFastCorner(ptr, pixel, threshold))
+                    {
+                        cornerpos[ncorners++] = j;
+                        curr[j] = (uchar)fastCornerScore(ptr, pixel);
+                    }
+                }
+            }
+
+            cornerpos[-1] = ncorners;
+
+            if (i == 3)
+                continue;
+
+            // Keep the corners of the previous row that beat their 8 neighbours
+            const uchar* prev = buf[(i - 4 + 3)%3];
+            const uchar* pprev = buf[(i - 5 + 3)%3];
+            cornerpos = cpbuf[(i - 4 + 3)%3] + 1;
+            ncorners = cornerpos[-1];
+
+            for (int k = 0; k < ncorners; ++k)
+            {
+                const int j = cornerpos[k];
+                const int score = prev[j];
+                if (score > prev[j+1] && score > prev[j-1] &&
+                    score > pprev[j-1] && score > pprev[j] && score > pprev[j+1] &&
+                    score > curr[j-1] && score > curr[j] && score > curr[j+1])
+                {
+                    keypoints.push_back(KeyPoint((float)j, (float)(i - 1), 7.f, -1, (float)score));
+                }
+            }
+        }
+    }
+#endif
+
+    static void FASTCell(const Mat& img, vector<KeyPoint>& keypoints, int threshold)
+    {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        FASTNeon(img, keypoints, threshold);
+#else
+        FAST(img, keypoints, threshold, true);
+#endif
     }
 
 
@@ -430,6 +649,7 @@ namespace ORB_SLAM3
         }
 
         mvImagePyramid.resize(nlevels);
+        mvArena.resize(nlevels);
 
         mnFeaturesPerLevel.resize(nlevels);
         float factor = 1.0f / scaleFactor;
@@ -552,29 +772,50 @@ namespace ORB_SLAM3
         }
     }
 
-    vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
-                                                         const int &maxX, const int &minY, const int &maxY, const int &N, const int &level)
+    // Move a spare node (allocated only while the arena warms up) to the front of
+    // lSpareNodes, reset as a default constructed node but keeping its key capacity
+    static list<ExtractorNode>::iterator spareNode(list<ExtractorNode> &lSpareNodes, int position)
     {
+        while((int)lSpareNodes.size()<=position)
+            lSpareNodes.emplace_back();
+
+        list<ExtractorNode>::iterator lit = lSpareNodes.begin();
+        advance(lit, position);
+        lit->vKeys.clear();
+        lit->bNoMore = false;
+        return lit;
+    }
+
+    void ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
+                                         const int &maxX, const int &minY, const int &maxY, const int &N, const int &level,
+                                         vector<cv::KeyPoint>& vResultKeys)
+    {
+        LevelArena &arena = mvArena[level];
+        list<ExtractorNode> &lNodes = arena.lNodes;
+        list<ExtractorNode> &lSpareNodes = arena.lSpareNodes;
+
+        // Recycle the nodes of the previous frame
+        lSpareNodes.splice(lSpareNodes.end(), lNodes);
+
         // Compute how many initial nodes
         const int nIni = round(static_cast<float>(maxX-minX)/(maxY-minY));
 
         const float hX = static_cast<float>(maxX-minX)/nIni;
 
-        list<ExtractorNode> lNodes;
-
-        vector<ExtractorNode*> vpIniNodes;
+        vector<ExtractorNode*> &vpIniNodes = arena.vpIniNodes;
         vpIniNodes.resize(nIni);
 
         for(int i=0; i<nIni; i++)
         {
-            ExtractorNode ni;
+            list<ExtractorNode>::iterator nit = spareNode(lSpareNodes, 0);
+            ExtractorNode &ni = *nit;
             ni.UL = cv::Point2i(hX*static_cast<float>(i),0);
             ni.UR = cv::Point2i(hX*static_cast<float>(i+1),0);
             ni.BL = cv::Point2i(ni.UL.x,maxY-minY);
             ni.BR = cv::Point2i(ni.UR.x,maxY-minY);
             ni.vKeys.reserve(vToDistributeKeys.size());
 
-            lNodes.push_back(ni);
+            lNodes.splice(lNodes.end(), lSpareNodes, nit);
             vpIniNodes[i] = &lNodes.back();
         }
 
@@ -595,7 +836,7 @@ namespace ORB_SLAM3
                 lit++;
             }
             else if(lit->vKeys.empty())
-                lit = lNodes.erase(lit);
+                lSpareNodes.splice(lSpareNodes.end(), lNodes, lit++);
             else
                 lit++;
         }
@@ -604,9 +845,35 @@ namespace ORB_SLAM3
 
         int iteration = 0;
 
-        vector<pair<int,ExtractorNode*> > vSizeAndPointerToNode;
+        vector<pair<int,ExtractorNode*> > &vSizeAndPointerToNode = arena.vSizeAndPointerToNode;
+        vSizeAndPointerToNode.clear();
         vSizeAndPointerToNode.reserve(lNodes.size()*4);
 
+        // Divide a node into four spare nodes and push the non-empty ones to the front
+        // of lNodes, n1 first, collecting those that can be divided further
+        auto divide = [&](ExtractorNode &node, int &nToExpand)
+        {
+            list<ExtractorNode>::iterator vChilds[4];
+            for(int k=0; k<4; k++)
+                vChilds[k] = spareNode(lSpareNodes, k);
+            node.DivideNode(*vChilds[0],*vChilds[1],*vChilds[2],*vChilds[3]);
+
+            // Add childs if they contain points
+            for(int k=0; k<4; k++)
+            {
+                if(vChilds[k]->vKeys.size()>0)
+                {
+                    lNodes.splice(lNodes.begin(), lSpareNodes, vChilds[k]);
+                    if(lNodes.front().vKeys.size()>1)
+                    {
+                        nToExpand++;
+                        vSizeAndPointerToNode.push_back(make_pair(lNodes.front().vKeys.size(),&lNodes.front()));
+                        lNodes.front().lit = lNodes.begin();
+                    }
+                }
+            }
+        };
+
         while(!bFinish)
         {
             iteration++;
@@ -630,52 +897,9 @@ namespace ORB_SLAM3
                 else
                 {
                     // If more than one point, subdivide
-                    ExtractorNode n1,n2,n3,n4;
-                    lit->DivideNode(n1,n2,n3,n4);
+                    divide(*lit, nToExpand);
 
-                    // Add childs if they contain points
-                    if(n1.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n1);
-                        if(n1.vKeys.size()>1)
-                        {
-                            nToExpand++;
-                            vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n2.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n2);
-                        if(n2.vKeys.size()>1)
-                        {
-                            nToExpand++;
-                            vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n3.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n3);
-                        if(n3.vKeys.size()>1)
-                        {
-                            nToExpand++;
-                            vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n4.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n4);
-                        if(n4.vKeys.size()>1)
-                        {
-                            nToExpand++;
-                            vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-
-                    lit=lNodes.erase(lit);
+                    lSpareNodes.splice(lSpareNodes.end(), lNodes, lit++);
                     continue;
                 }
             }
@@ -694,54 +918,17 @@ namespace ORB_SLAM3
 
                     prevSize = lNodes.size();
 
-                    vector<pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
+                    vector<pair<int,ExtractorNode*> > &vPrevSizeAndPointerToNode = arena.vPrevSizeAndPointerToNode;
+                    vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
                     vSizeAndPointerToNode.clear();
 
                     sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end(),compareNodes);
                     for(int j=vPrevSizeAndPointerToNode.size()-1;j>=0;j--)
                     {
-                        ExtractorNode n1,n2,n3,n4;
-                        vPrevSizeAndPointerToNode[j].second->DivideNode(n1,n2,n3,n4);
-
-                        // Add childs if they contain points
-                        if(n1.vKeys.size()>0)
-                        {
-                            lNodes.push_front(n1);
-                            if(n1.vKeys.size()>1)
-                            {
-                                vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-                                lNodes.front().lit = lNodes.begin();
-                            }
-                        }
-                        if(n2.vKeys.size()>0)
-                        {
-                            lNodes.push_front(n2);
-                            if(n2.vKeys.size()>1)
-                            {
-                                vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                                lNodes.front().lit = lNodes.begin();
-                            }
-                        }
-                        if(n3.vKeys.size()>0)
-                        {
-                            lNodes.push_front(n3);
-                            if(n3.vKeys.size()>1)
-                            {
-                                vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                                lNodes.front().lit = lNodes.begin();
-                            }
-                        }
-                        if(n4.vKeys.size()>0)
-                        {
-                            lNodes.push_front(n4);
-                            if(n4.vKeys.size()>1)
-                            {
-                                vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                                lNodes.front().lit = lNodes.begin();
-                            }
-                        }
+                        int nExpanded = 0;
+                        divide(*vPrevSizeAndPointerToNode[j].second, nExpanded);
 
-                        lNodes.erase(vPrevSizeAndPointerToNode[j].second->lit);
+                        lSpareNodes.splice(lSpareNodes.end(), lNodes, vPrevSizeAndPointerToNode[j].second->lit);
 
                         if((int)lNodes.size()>=N)
                             break;
@@ -755,7 +942,7 @@ namespace ORB_SLAM3
         }
 
         // Retain the best point in each node
-        vector<cv::KeyPoint> vResultKeys;
+        vResultKeys.clear();
         vResultKeys.reserve(nfeatures);
         for(list<ExtractorNode>::iterator lit=lNodes.begin(); lit!=lNodes.end(); lit++)
         {
@@ -774,8 +961,25 @@ namespace ORB_SLAM3
 
             vResultKeys.push_back(*pKP);
         }
+    }
+
+    void ORBextractor::SetParallelFor(const ParallelFor& parallelFor)
+    {
+        mParallelFor = parallelFor;
+    }
 
-        return vResultKeys;
+    void ORBextractor::SetPyramid(const std::shared_ptr<RGAPyramid> &pPyramid)
+    {
+        mpNextPyramid = pPyramid;
+    }
+
+    void ORBextractor::RunParallel(int n, const std::function<void(int)>& job)
+    {
+        if(mParallelFor)
+            mParallelFor(n, job);
+        else
+            for(int i=0; i<n; i++)
+                job(i);
     }
 
     void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
@@ -784,98 +988,93 @@ namespace ORB_SLAM3
 
         const float W = 35;
 
+        mvRowTasks.clear();
         for (int level = 0; level < nlevels; ++level)
         {
-            const int minBorderX = EDGE_THRESHOLD-3;
-            const int minBorderY = minBorderX;
-            const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
-            const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
-
-            vector<cv::KeyPoint> vToDistributeKeys;
-            vToDistributeKeys.reserve(nfeatures*10);
-
-            const float width = (maxBorderX-minBorderX);
-            const float height = (maxBorderY-minBorderY);
-
-            const int nCols = width/W;
-            const int nRows = height/W;
-            const int wCell = ceil(width/nCols);
-            const int hCell = ceil(height/nRows);
+            LevelArena &grid = mvArena[level];
+            grid.minBorderX = EDGE_THRESHOLD-3;
+            grid.minBorderY = grid.minBorderX;
+            grid.maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+            grid.maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+            const float width = (grid.maxBorderX-grid.minBorderX);
+            const float height = (grid.maxBorderY-grid.minBorderY);
+
+            grid.nCols = width/W;
+            grid.nRows = height/W;
+            grid.wCell = ceil(width/grid.nCols);
+            grid.hCell = ceil(height/grid.nRows);
+
+            grid.vRowKeys.resize(grid.nRows);
+            grid.vCellKeys.resize(grid.nRows);
+            for(int i=0; i<grid.nRows; i++)
+                mvRowTasks.push_back(make_pair(level,i));
+        }
 
-            for(int i=0; i<nRows; i++)
+        // FAST per cell row, the rows of all levels are independent
+        RunParallel(mvRowTasks.size(), [this](int task)
+        {
+            const int level = mvRowTasks[task].first;
+            const int i = mvRowTasks[task].second;
+            LevelArena &grid = mvArena[level];
+            vector<cv::KeyPoint> &vRow = grid.vRowKeys[i];
+            vector<cv::KeyPoint> &vKeysCell = grid.vCellKeys[i];
+            vRow.clear();
+
+            const float iniY =grid.minBorderY+i*grid.hCell;
+            float maxY = iniY+grid.hCell+6;
+
+            if(iniY>=grid.maxBorderY-3)
+                return;
+            if(maxY>grid.maxBorderY)
+                maxY = grid.maxBorderY;
+
+            for(int j=0; j<grid.nCols; j++)
             {
-                const float iniY =minBorderY+i*hCell;
-                float maxY = iniY+hCell+6;
-
-                if(iniY>=maxBorderY-3)
+                const float iniX =grid.minBorderX+j*grid.wCell;
+                float maxX = iniX+grid.wCell+6;
+                if(iniX>=grid.maxBorderX-6)
                     continue;
-                if(maxY>maxBorderY)
-                    maxY = maxBorderY;
-
-                for(int j=0; j<nCols; j++)
-                {
-                    const float iniX =minBorderX+j*wCell;
-                    float maxX = iniX+wCell+6;
-                    if(iniX>=maxBorderX-6)
-                        continue;
-                    if(maxX>maxBorderX)
-                        maxX = maxBorderX;
-
-                    vector<cv::KeyPoint> vKeysCell;
+                if(maxX>grid.maxBorderX)
+                    maxX = grid.maxBorderX;
 
-                    FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                         vKeysCell,iniThFAST,true);
+                FASTCell(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+                         vKeysCell,iniThFAST);
 
-                    /*if(bRight && j <= 13){
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,10,true);
-                    }
-                    else if(!bRight && j >= 16){
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,10,true);
-                    }
-                    else{
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,iniThFAST,true);
-                    }*/
-
-
-                    if(vKeysCell.empty())
-                    {
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,minThFAST,true);
-                        /*if(bRight && j <= 13){
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,5,true);
-                        }
-                        else if(!bRight && j >= 16){
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,5,true);
-                        }
-                        else{
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,minThFAST,true);
-                        }*/
-                    }
+                if(vKeysCell.empty())
+                {
+                    FASTCell(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+                             vKeysCell,minThFAST);
+                }
 
-                    if(!vKeysCell.empty())
+                if(!vKeysCell.empty())
+                {
+                    for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
                     {
-                        for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
-                        {
-                            (*vit).pt.x+=j*wCell;
-                            (*vit).pt.y+=i*hCell;
-                            vToDistributeKeys.push_back(*vit);
-                        }
+                        (*vit).pt.x+=j*grid.wCell;
+                        (*vit).pt.y+=i*grid.hCell;
+                        vRow.push_back(*vit);
                     }
-
                 }
             }
+        });
+
+        // Octree distribution and orientation per level
+        RunParallel(nlevels, [this, &allKeypoints](int level)
+        {
+            LevelArena &grid = mvArena[level];
+
+            // Rows in order, as the serial scan finds the keypoints
+            vector<cv::KeyPoint> &vToDistributeKeys = grid.vToDistributeKeys;
+            vToDistributeKeys.clear();
+            vToDistributeKeys.reserve(nfeatures*10);
+            for(size_t i=0; i<grid.vRowKeys.size(); i++)
+                vToDistributeKeys.insert(vToDistributeKeys.end(), grid.vRowKeys[i].begin(), grid.vRowKeys[i].end());
 
             vector<KeyPoint> & keypoints = allKeypoints[level];
-            keypoints.reserve(nfeatures);
 
-            keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
-                                          minBorderY, maxBorderY,mnFeaturesPerLevel[level], level);
+            DistributeOctTree(vToDistributeKeys, grid.minBorderX, grid.maxBorderX,
+                              grid.minBorderY, grid.maxBorderY,mnFeaturesPerLevel[level], level, keypoints);
 
             const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
 
@@ -883,16 +1082,15 @@ namespace ORB_SLAM3
             const int nkps = keypoints.size();
             for(int i=0; i<nkps ; i++)
             {
-                keypoints[i].pt.x+=minBorderX;
-                keypoints[i].pt.y+=minBorderY;
+                keypoints[i].pt.x+=grid.minBorderX;
+                keypoints[i].pt.y+=grid.minBorderY;
                 keypoints[i].octave=level;
                 keypoints[i].size = scaledPatchSize;
             }
-        }
 
-        // compute orientations
-        for (int level = 0; level < nlevels; ++level)
-            computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+            // compute orientations
+            computeOrientation(mvImagePyramid[level], keypoints, umax);
+        });
     }
 
     void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allKeypoints)
@@ -1077,12 +1275,32 @@ namespace ORB_SLAM3
     static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Mat& descriptors,
                                    const vector<Point>& pattern)
     {
-        descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
+        // Every row is written, a preallocated view of the right size is kept
+        descriptors.create((int)keypoints.size(), 32, CV_8UC1);
 
         for (size_t i = 0; i < keypoints.size(); i++)
             computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
     }
 
+    void ORBextractor::ComputeDescriptors(int level)
+    {
+        LevelArena &arena = mvArena[level];
+        vector<KeyPoint>& keypoints = mvAllKeypoints[level];
+        int nkeypointsLevel = (int)keypoints.size();
+
+        if(nkeypointsLevel==0)
+            return;
+
+        // preprocess the resized image, isolated from its borders like a copy of it
+        GaussianBlur(mvImagePyramid[level], arena.blurred, Size(7, 7), 2, 2, BORDER_REFLECT_101+BORDER_ISOLATED);
+
+        // Compute the descriptors into the first rows of the level buffer
+        if(arena.descriptors.rows < nkeypointsLevel)
+            arena.descriptors.create(nkeypointsLevel, 32, CV_8U);
+        Mat desc = arena.descriptors.rowRange(0, nkeypointsLevel);
+        computeDescriptors(arena.blurred, keypoints, desc, pattern);
+    }
+
     int ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints,
                                   OutputArray _descriptors, std::vector<int> &vLappingArea)
     {
@@ -1093,10 +1311,11 @@ namespace ORB_SLAM3
         Mat image = _image.getMat();
         assert(image.type() == CV_8UC1 );
 
-        // Pre-compute the scale pyramid
-        ComputePyramid(image);
+        // Pre-compute the scale pyramid, unless the RGA built it
+        if(!UsePyramid(image))
+            ComputePyramid(image);
 
-        vector < vector<KeyPoint> > allKeypoints;
+        vector < vector<KeyPoint> > &allKeypoints = mvAllKeypoints;
         ComputeKeyPointsOctTree(allKeypoints);
         //ComputeKeyPointsOld(allKeypoints);
 
@@ -1115,7 +1334,11 @@ namespace ORB_SLAM3
 
         //_keypoints.clear();
         //_keypoints.reserve(nkeypoints);
-        _keypoints = vector<cv::KeyPoint>(nkeypoints);
+        // Every element is assigned below
+        _keypoints.resize(nkeypoints);
+
+        // Compute the descriptors of the levels independently
+        RunParallel(nlevels, [this](int level) { ComputeDescriptors(level); });
 
         int offset = 0;
         //Modified for speeding up stereo fisheye matching
@@ -1128,14 +1351,7 @@ namespace ORB_SLAM3
             if(nkeypointsLevel==0)
                 continue;
 
-            // preprocess the resized image
-            Mat workingMat = mvImagePyramid[level].clone();
-            GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
-
-            // Compute the descriptors
-            //Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-            Mat desc = cv::Mat(nkeypointsLevel, 32, CV_8U);
-            computeDescriptors(workingMat, keypoints, desc, pattern);
+            const Mat &desc = mvArena[level].descriptors;
 
             offset += nkeypointsLevel;
 
@@ -1167,6 +1383,31 @@ namespace ORB_SLAM3
         return monoIndex;
     }
 
+    bool ORBextractor::UsePyramid(const cv::Mat &image)
+    {
+        // The previous pyramid is released once mvImagePyramid no longer points into it
+        std::shared_ptr<RGAPyramid> pPyramid;
+        pPyramid.swap(mpNextPyramid);
+        mpPyramid.reset();
+        if(!pPyramid || pPyramid->GetLevels() != nlevels)
+            return false;
+
+        for (int level = 0; level < nlevels; ++level)
+        {
+            float scale = mvInvScaleFactor[level];
+            Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
+            if(pPyramid->GetLevel(level).size() != sz)
+                return false;
+        }
+        if(!pPyramid->WaitAll())
+            return false;
+
+        for (int level = 0; level < nlevels; ++level)
+            mvImagePyramid[level] = pPyramid->GetLevel(level);
+        mpPyramid = pPyramid;
+        return true;
+    }
+
     void ORBextractor::ComputePyramid(cv::Mat image)
     {
         for (int level = 0; level < nlevels; ++level)
@@ -1174,7 +1415,10 @@ namespace ORB_SLAM3
             float scale = mvInvScaleFactor[level];
             Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
             Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
-            Mat temp(wholeSize, image.type()), masktemp;
+
+            // Only allocates when the image size or type changes
+            Mat &temp = mvArena[level].bordered;
+            temp.create(wholeSize, image.type());
             mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
 
             // Compute the resized image
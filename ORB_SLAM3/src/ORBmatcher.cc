@@ -20,10 +20,12 @@
 #include "ORBmatcher.h"
 
 #include<limits.h>
+#include<atomic>
 
 #include<opencv2/core/core.hpp>
 
 #include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
+#include "GeometricCamera.h"
 
 #include<stdint-gcc.h>
 
@@ -32,23 +34,113 @@ using namespace std;
 namespace ORB_SLAM3
 {
 
-    const int ORBmatcher::TH_HIGH = 100;
-    const int ORBmatcher::TH_LOW = 50;
-    const int ORBmatcher::HISTO_LENGTH = 30;
+    template<class Descriptor>
+    DescriptorMatcher<Descriptor>::DescriptorMatcher(float nnratio, bool checkOri): mfNNratio(nnratio), mbCheckOrientation(checkOri)
+    {
+    }
 
-    ORBmatcher::ORBmatcher(float nnratio, bool checkOri): mfNNratio(nnratio), mbCheckOrientation(checkOri)
+    // Lowers claim to key if key is smaller
+    static void ClaimKeypoint(std::atomic<uint64_t> &claim, const uint64_t key)
     {
+        uint64_t current = claim.load(std::memory_order_relaxed);
+        while(key<current && !claim.compare_exchange_weak(current, key, std::memory_order_relaxed))
+        {
+        }
     }
 
-    int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th, const bool bFarPoints, const float thFarPoints)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th, const bool bFarPoints, const float thFarPoints, const ParallelFor &parallelFor)
     {
-        int nmatches=0, left = 0, right = 0;
+        if(parallelFor)
+        {
+            const int nMPs = vpMapPoints.size();
+
+            // Match of each MapPoint in the left (or only) and right image, and the claim it makes
+            // on the keypoint: the distance in the high bits, then the MapPoint and image
+            vector<int> vMatchIdx(2*nMPs,-1);
+            vector<uint64_t> vMatchKey(2*nMPs);
+
+            // Smallest claim on each keypoint
+            vector<std::atomic<uint64_t> > vClaims(F.N);
+            for(int i=0; i<F.N; i++)
+                vClaims[i].store(UINT64_MAX, std::memory_order_relaxed);
+
+            // F.mvpMapPoints is only read until all MapPoints are searched
+            const int nBatch = 64;
+            const int nTasks = (nMPs+nBatch-1)/nBatch;
+            parallelFor(nTasks, [this, &F, &vpMapPoints, th, bFarPoints, thFarPoints, nMPs, nBatch, &vMatchIdx, &vMatchKey, &vClaims](int t)
+            {
+                vector<size_t> vPositions;
+                vector<size_t> vCandidates;
+                vector<int> vDistances;
+
+                for(int iMP=t*nBatch, iend=min(nMPs,(t+1)*nBatch); iMP<iend; iMP++)
+                {
+                    MapPoint* pMP = vpMapPoints[iMP];
+                    if(iMP+1<iend)
+                        vpMapPoints[iMP+1]->PrefetchDescriptor();
+                    if(!pMP->mbTrackInView && !pMP->mbTrackInViewR)
+                        continue;
+
+                    if(bFarPoints && pMP->mTrackDepth>thFarPoints)
+                        continue;
+
+                    if(pMP->isBad())
+                        continue;
+
+                    int bestDist;
+                    if(pMP->mbTrackInView)
+                    {
+                        const int bestIdx = SearchProjectedPoint(F,pMP,false,th,vPositions,vCandidates,vDistances,bestDist);
+                        if(bestIdx==-2)
+                            continue;
+                        if(bestIdx>=0)
+                        {
+                            vMatchIdx[2*iMP] = bestIdx;
+                            vMatchKey[2*iMP] = (uint64_t(bestDist)<<32) | uint64_t(2*iMP);
+                            ClaimKeypoint(vClaims[bestIdx], vMatchKey[2*iMP]);
+                        }
+                    }
+
+                    if(F.Nleft != -1 && pMP->mbTrackInViewR && pMP->mnTrackScaleLevelR != -1)
+                    {
+                        const int bestIdx = SearchProjectedPoint(F,pMP,true,th,vPositions,vCandidates,vDistances,bestDist);
+                        if(bestIdx>=0)
+                        {
+                            vMatchIdx[2*iMP+1] = bestIdx;
+                            vMatchKey[2*iMP+1] = (uint64_t(bestDist)<<32) | uint64_t(2*iMP+1);
+                            ClaimKeypoint(vClaims[bestIdx], vMatchKey[2*iMP+1]);
+                        }
+                    }
+                }
+            });
+
+            // Assign the keypoints to the MapPoints that won them, in MapPoint order so that
+            // stereo observations found by two MapPoints resolve the same way every time
+            int nmatches=0;
+            for(int k=0; k<2*nMPs; k++)
+            {
+                const int idx = vMatchIdx[k];
+                if(idx>=0 && vClaims[idx].load(std::memory_order_relaxed)==vMatchKey[k])
+                    nmatches += AssignProjectedMatch(F,vpMapPoints[k/2],idx);
+            }
 
-        const bool bFactor = th!=1.0;
+            return nmatches;
+        }
+
+        int nmatches=0;
+
+        // Grid positions in the search area, the candidates left after the checks and their distances, reused for all MapPoints
+        vector<size_t> vPositions;
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
 
         for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
         {
             MapPoint* pMP = vpMapPoints[iMP];
+            // The descriptor row is read last, after the grid search of this point
+            if(iMP+1<vpMapPoints.size())
+                vpMapPoints[iMP+1]->PrefetchDescriptor();
             if(!pMP->mbTrackInView && !pMP->mbTrackInViewR)
                 continue;
 
@@ -58,161 +150,115 @@ namespace ORB_SLAM3
             if(pMP->isBad())
                 continue;
 
+            int bestDist;
             if(pMP->mbTrackInView)
             {
-                const int &nPredictedLevel = pMP->mnTrackScaleLevel;
-
-                // The size of the window will depend on the viewing direction
-                float r = RadiusByViewingCos(pMP->mTrackViewCos);
-
-                if(bFactor)
-                    r*=th;
-
-                const vector<size_t> vIndices =
-                        F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+                const int bestIdx = SearchProjectedPoint(F,pMP,false,th,vPositions,vCandidates,vDistances,bestDist);
+                if(bestIdx==-2)
+                    continue;
+                if(bestIdx>=0)
+                    nmatches += AssignProjectedMatch(F,pMP,bestIdx);
+            }
 
-                if(!vIndices.empty()){
-                    const cv::Mat MPdescriptor = pMP->GetDescriptor();
+            if(F.Nleft != -1 && pMP->mbTrackInViewR && pMP->mnTrackScaleLevelR != -1)
+            {
+                const int bestIdx = SearchProjectedPoint(F,pMP,true,th,vPositions,vCandidates,vDistances,bestDist);
+                if(bestIdx>=0)
+                    nmatches += AssignProjectedMatch(F,pMP,bestIdx);
+            }
+        }
+        return nmatches;
+    }
 
-                    int bestDist=256;
-                    int bestLevel= -1;
-                    int bestDist2=256;
-                    int bestLevel2 = -1;
-                    int bestIdx =-1 ;
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchProjectedPoint(const Frame &F, MapPoint* pMP, const bool bRight, const float th,
+                                         vector<size_t> &vPositions, vector<size_t> &vCandidates,
+                                         vector<int> &vDistances, int &bestDist)
+    {
+        const FrameGrid &grid = (!bRight) ? F.mGrid : F.mGridRight;
+        const int &nPredictedLevel = (!bRight) ? pMP->mnTrackScaleLevel : pMP->mnTrackScaleLevelR;
 
-                    // Get best and second matches with near keypoints
-                    for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
-                    {
-                        const size_t idx = *vit;
+        // The size of the window will depend on the viewing direction (th only widens the left one)
+        float r = RadiusByViewingCos((!bRight) ? pMP->mTrackViewCos : pMP->mTrackViewCosR);
 
-                        if(F.mvpMapPoints[idx])
-                            if(F.mvpMapPoints[idx]->Observations()>0)
-                                continue;
+        if(!bRight && th!=1.0)
+            r*=th;
 
-                        if(F.Nleft == -1 && F.mvuRight[idx]>0)
-                        {
-                            const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
-                            if(er>r*F.mvScaleFactors[nPredictedLevel])
-                                continue;
-                        }
+        r *= F.mvScaleFactors[nPredictedLevel];
 
-                        const cv::Mat &d = F.mDescriptors.row(idx);
+        if(!bRight)
+            F.GetGridPositionsInArea(pMP->mTrackProjX,pMP->mTrackProjY,r,nPredictedLevel-1,nPredictedLevel,false,vPositions);
+        else
+            F.GetGridPositionsInArea(pMP->mTrackProjXR,pMP->mTrackProjYR,r,nPredictedLevel-1,nPredictedLevel,true,vPositions);
 
-                        const int dist = DescriptorDistance(MPdescriptor,d);
+        if(vPositions.empty())
+            return -1;
 
-                        if(dist<bestDist)
-                        {
-                            bestDist2=bestDist;
-                            bestDist=dist;
-                            bestLevel2 = bestLevel;
-                            bestLevel = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
-                                                        : (idx < F.Nleft) ? F.mvKeys[idx].octave
-                                                                          : F.mvKeysRight[idx - F.Nleft].octave;
-                            bestIdx=idx;
-                        }
-                        else if(dist<bestDist2)
-                        {
-                            bestLevel2 = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
-                                                         : (idx < F.Nleft) ? F.mvKeys[idx].octave
-                                                                           : F.mvKeysRight[idx - F.Nleft].octave;
-                            bestDist2=dist;
-                        }
-                    }
-
-                    // Apply ratio to second match (only if best and second are in the same scale level)
-                    if(bestDist<=TH_HIGH)
-                    {
-                        if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                            continue;
+        alignas(32) uchar descriptor[DescriptorArena::kDescriptorBytes];
+        const cv::Mat MPdescriptor = pMP->GetDescriptor(descriptor);
 
-                        if(bestLevel!=bestLevel2 || bestDist<=mfNNratio*bestDist2){
-                            F.mvpMapPoints[bestIdx]=pMP;
+        // Candidates are grid positions, their descriptors are consecutive rows of the grid.
+        // Right keypoints come after the Nleft left ones in F.
+        const size_t nOffset = (!bRight) ? 0 : F.Nleft;
+        vCandidates.clear();
+        for(vector<size_t>::const_iterator vit=vPositions.begin(), vend=vPositions.end(); vit!=vend; vit++)
+        {
+            const size_t idx = grid.vIndices[*vit] + nOffset;
 
-                            if(F.Nleft != -1 && F.mvLeftToRightMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
-                                F.mvpMapPoints[F.mvLeftToRightMatch[bestIdx] + F.Nleft] = pMP;
-                                nmatches++;
-                                right++;
-                            }
+            if(F.mvpMapPoints[idx])
+                if(F.mvpMapPoints[idx]->Observations()>0)
+                    continue;
 
-                            nmatches++;
-                            left++;
-                        }
-                    }
-                }
+            if(F.Nleft == -1 && F.mvuRight[idx]>0)
+            {
+                const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
+                if(er>r)
+                    continue;
             }
 
-            if(F.Nleft != -1 && pMP->mbTrackInViewR){
-                const int &nPredictedLevel = pMP->mnTrackScaleLevelR;
-                if(nPredictedLevel != -1){
-                    float r = RadiusByViewingCos(pMP->mTrackViewCosR);
-
-                    const vector<size_t> vIndices =
-                            F.GetFeaturesInArea(pMP->mTrackProjXR,pMP->mTrackProjYR,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,true);
-
-                    if(vIndices.empty())
-                        continue;
-
-                    const cv::Mat MPdescriptor = pMP->GetDescriptor();
-
-                    int bestDist=256;
-                    int bestLevel= -1;
-                    int bestDist2=256;
-                    int bestLevel2 = -1;
-                    int bestIdx =-1 ;
-
-                    // Get best and second matches with near keypoints
-                    for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
-                    {
-                        const size_t idx = *vit;
-
-                        if(F.mvpMapPoints[idx + F.Nleft])
-                            if(F.mvpMapPoints[idx + F.Nleft]->Observations()>0)
-                                continue;
-
-
-                        const cv::Mat &d = F.mDescriptors.row(idx + F.Nleft);
+            vCandidates.push_back(*vit);
+        }
 
-                        const int dist = DescriptorDistance(MPdescriptor,d);
+        // Get best and second matches with near keypoints
+        const DescriptorMatch match = SearchDescriptors(MPdescriptor, grid.descriptors, vCandidates, vDistances);
+        if(match.bestDist>TH_HIGH)
+            return -1;
 
-                        if(dist<bestDist)
-                        {
-                            bestDist2=bestDist;
-                            bestDist=dist;
-                            bestLevel2 = bestLevel;
-                            bestLevel = F.mvKeysRight[idx].octave;
-                            bestIdx=idx;
-                        }
-                        else if(dist<bestDist2)
-                        {
-                            bestLevel2 = F.mvKeysRight[idx].octave;
-                            bestDist2=dist;
-                        }
-                    }
-
-                    // Apply ratio to second match (only if best and second are in the same scale level)
-                    if(bestDist<=TH_HIGH)
-                    {
-                        if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                            continue;
+        // Apply ratio to second match (only if best and second are in the same scale level)
+        const int bestLevel = grid.vOctave[match.bestIdx];
+        const int bestLevel2 = (match.bestIdx2 < 0) ? -1 : grid.vOctave[match.bestIdx2];
+        if(bestLevel==bestLevel2 && match.bestDist>mfNNratio*match.bestDist2)
+            return -2;
 
-                        if(F.Nleft != -1 && F.mvRightToLeftMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
-                            F.mvpMapPoints[F.mvRightToLeftMatch[bestIdx]] = pMP;
-                            nmatches++;
-                            left++;
-                        }
+        bestDist = match.bestDist;
+        return grid.vIndices[match.bestIdx] + nOffset;
+    }
 
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::AssignProjectedMatch(Frame &F, MapPoint* pMP, const int idx)
+    {
+        F.mvpMapPoints[idx]=pMP;
+        if(F.Nleft == -1)
+            return 1;
 
-                        F.mvpMapPoints[bestIdx + F.Nleft]=pMP;
-                        nmatches++;
-                        right++;
-                    }
-                }
-            }
+        //Also match with the stereo observation at the other camera
+        if(idx < F.Nleft)
+        {
+            if(F.mvLeftToRightMatch[idx] == -1)
+                return 1;
+            F.mvpMapPoints[F.mvLeftToRightMatch[idx] + F.Nleft] = pMP;
         }
-        return nmatches;
+        else
+        {
+            if(F.mvRightToLeftMatch[idx - F.Nleft] == -1)
+                return 1;
+            F.mvpMapPoints[F.mvRightToLeftMatch[idx - F.Nleft]] = pMP;
+        }
+        return 2;
     }
 
-    float ORBmatcher::RadiusByViewingCos(const float &viewCos)
+    template<class Descriptor>
+    float DescriptorMatcher<Descriptor>::RadiusByViewingCos(const float &viewCos)
     {
         if(viewCos>0.998)
             return 2.5;
@@ -220,13 +266,15 @@ namespace ORB_SLAM3
             return 4.0;
     }
 
-    int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPointMatches)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPointMatches)
     {
         const vector<MapPoint*> vpMapPointsKF = pKF->GetMapPointMatches();
 
         vpMapPointMatches = vector<MapPoint*>(F.N,static_cast<MapPoint*>(NULL));
 
-        const DBoW2::FeatureVector &vFeatVecKF = pKF->mFeatVec;
+        const DBoW2::FlatFeatureVector &vFeatVecKF = pKF->mFlatFeatVec;
+        const DBoW2::FlatFeatureVector &vFeatVecF = F.mFlatFeatVec;
 
         int nmatches=0;
 
@@ -235,18 +283,20 @@ namespace ORB_SLAM3
             rotHist[i].reserve(500);
         const float factor = 1.0f/HISTO_LENGTH;
 
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         // We perform the matching over ORB that belong to the same vocabulary node (at a certain level)
-        DBoW2::FeatureVector::const_iterator KFit = vFeatVecKF.begin();
-        DBoW2::FeatureVector::const_iterator Fit = F.mFeatVec.begin();
-        DBoW2::FeatureVector::const_iterator KFend = vFeatVecKF.end();
-        DBoW2::FeatureVector::const_iterator Fend = F.mFeatVec.end();
+        // Merge of the sorted node ids, the side behind gallops to the other
+        size_t KFit = 0, Fit = 0;
+        const size_t KFend = vFeatVecKF.size(), Fend = vFeatVecF.size();
 
         while(KFit != KFend && Fit != Fend)
         {
-            if(KFit->first == Fit->first)
+            if(vFeatVecKF.nodes[KFit] == vFeatVecF.nodes[Fit])
             {
-                const vector<unsigned int> vIndicesKF = KFit->second;
-                const vector<unsigned int> vIndicesF = Fit->second;
+                const DBoW2::FlatFeatureVector::Features vIndicesKF = vFeatVecKF.at(KFit);
+                const DBoW2::FlatFeatureVector::Features vIndicesF = vFeatVecF.at(Fit);
 
                 for(size_t iKF=0; iKF<vIndicesKF.size(); iKF++)
                 {
@@ -262,25 +312,28 @@ namespace ORB_SLAM3
 
                     const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
 
-                    int bestDist1=256;
+                    int bestDist1=Descriptor::MAX_DISTANCE;
                     int bestIdxF =-1 ;
-                    int bestDist2=256;
+                    int bestDist2=Descriptor::MAX_DISTANCE;
 
-                    int bestDist1R=256;
+                    int bestDist1R=Descriptor::MAX_DISTANCE;
                     int bestIdxFR =-1 ;
-                    int bestDist2R=256;
+                    int bestDist2R=Descriptor::MAX_DISTANCE;
 
+                    vCandidates.clear();
                     for(size_t iF=0; iF<vIndicesF.size(); iF++)
                     {
-                        if(F.Nleft == -1){
-                            const unsigned int realIdxF = vIndicesF[iF];
-
-                            if(vpMapPointMatches[realIdxF])
-                                continue;
+                        if(!vpMapPointMatches[vIndicesF[iF]])
+                            vCandidates.push_back(vIndicesF[iF]);
+                    }
+                    DescriptorDistances(dKF, F.mDescriptors, vCandidates, vDistances);
 
-                            const cv::Mat &dF = F.mDescriptors.row(realIdxF);
+                    for(size_t iF=0; iF<vCandidates.size(); iF++)
+                    {
+                        if(F.Nleft == -1){
+                            const unsigned int realIdxF = vCandidates[iF];
 
-                            const int dist =  DescriptorDistance(dKF,dF);
+                            const int dist = vDistances[iF];
 
                             if(dist<bestDist1)
                             {
@@ -294,14 +347,9 @@ namespace ORB_SLAM3
                             }
                         }
                         else{
-                            const unsigned int realIdxF = vIndicesF[iF];
-
-                            if(vpMapPointMatches[realIdxF])
-                                continue;
+                            const unsigned int realIdxF = vCandidates[iF];
 
-                            const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                            const int dist =  DescriptorDistance(dKF,dF);
+                            const int dist = vDistances[iF];
 
                             if(realIdxF < F.Nleft && dist<bestDist1){
                                 bestDist2=bestDist1;
@@ -391,13 +439,13 @@ namespace ORB_SLAM3
                 KFit++;
                 Fit++;
             }
-            else if(KFit->first < Fit->first)
+            else if(vFeatVecKF.nodes[KFit] < vFeatVecF.nodes[Fit])
             {
-                KFit = vFeatVecKF.lower_bound(Fit->first);
+                KFit = vFeatVecKF.seek(KFit, vFeatVecF.nodes[Fit]);
             }
             else
             {
-                Fit = F.mFeatVec.lower_bound(KFit->first);
+                Fit = vFeatVecF.seek(Fit, vFeatVecKF.nodes[KFit]);
             }
         }
 
@@ -424,9 +472,14 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    int ORBmatcher::SearchByProjection(KeyFrame* pKF, Sophus::Sim3f &Scw, const vector<MapPoint*> &vpPoints,
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByProjection(KeyFrame* pKF, Sophus::Sim3f &Scw, const vector<MapPoint*> &vpPoints,
                                        vector<MapPoint*> &vpMatched, int th, float ratioHamming)
     {
+        // Candidate rows of each search and their descriptor distances
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         // Get Calibration Parameters for later projection
         const float &fx = pKF->fx;
         const float &fy = pKF->fy;
@@ -494,10 +547,10 @@ namespace ORB_SLAM3
                 continue;
 
             // Match to the most similar keypoint in the radius
-            const cv::Mat dMP = pMP->GetDescriptor();
+            alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+            const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-            int bestDist = 256;
-            int bestIdx = -1;
+            vCandidates.clear();
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -509,17 +562,13 @@ namespace ORB_SLAM3
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
-
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdx = idx;
-                }
+                vCandidates.push_back(idx);
             }
 
+            const DescriptorMatch match = SearchDescriptors(dMP, pKF->mDescriptors, vCandidates, vDistances);
+            const int bestDist = match.bestDist;
+            const int bestIdx = match.bestIdx;
+
             if(bestDist<=TH_LOW*ratioHamming)
             {
                 vpMatched[bestIdx]=pMP;
@@ -531,9 +580,14 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    int ORBmatcher::SearchByProjection(KeyFrame* pKF, Sophus::Sim3<float> &Scw, const std::vector<MapPoint*> &vpPoints, const std::vector<KeyFrame*> &vpPointsKFs,
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByProjection(KeyFrame* pKF, Sophus::Sim3<float> &Scw, const std::vector<MapPoint*> &vpPoints, const std::vector<KeyFrame*> &vpPointsKFs,
                                        std::vector<MapPoint*> &vpMatched, std::vector<KeyFrame*> &vpMatchedKF, int th, float ratioHamming)
     {
+        // Candidate rows of each search and their descriptor distances
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         // Get Calibration Parameters for later projection
         const float &fx = pKF->fx;
         const float &fy = pKF->fy;
@@ -607,10 +661,10 @@ namespace ORB_SLAM3
                 continue;
 
             // Match to the most similar keypoint in the radius
-            const cv::Mat dMP = pMP->GetDescriptor();
+            alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+            const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-            int bestDist = 256;
-            int bestIdx = -1;
+            vCandidates.clear();
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -622,17 +676,13 @@ namespace ORB_SLAM3
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
-
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdx = idx;
-                }
+                vCandidates.push_back(idx);
             }
 
+            const DescriptorMatch match = SearchDescriptors(dMP, pKF->mDescriptors, vCandidates, vDistances);
+            const int bestDist = match.bestDist;
+            const int bestIdx = match.bestIdx;
+
             if(bestDist<=TH_LOW*ratioHamming)
             {
                 vpMatched[bestIdx] = pMP;
@@ -645,8 +695,13 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f> &vbPrevMatched, vector<int> &vnMatches12, int windowSize)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f> &vbPrevMatched, vector<int> &vnMatches12, int windowSize)
     {
+        // Grid positions in each search area and their descriptor distances
+        vector<size_t> vPositions;
+        vector<int> vDistances;
+
         int nmatches=0;
         vnMatches12 = vector<int>(F1.mvKeysUn.size(),-1);
 
@@ -665,9 +720,9 @@ namespace ORB_SLAM3
             if(level1>0)
                 continue;
 
-            vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1);
+            F2.GetGridPositionsInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1,false,vPositions);
 
-            if(vIndices2.empty())
+            if(vPositions.empty())
                 continue;
 
             cv::Mat d1 = F1.mDescriptors.row(i1);
@@ -676,13 +731,13 @@ namespace ORB_SLAM3
             int bestDist2 = INT_MAX;
             int bestIdx2 = -1;
 
-            for(vector<size_t>::iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
-            {
-                size_t i2 = *vit;
+            DescriptorDistances(d1, F2.mGrid.descriptors, vPositions, vDistances);
 
-                cv::Mat d2 = F2.mDescriptors.row(i2);
+            for(size_t k=0; k<vPositions.size(); k++)
+            {
+                size_t i2 = F2.mGrid.vIndices[vPositions[k]];
 
-                int dist = DescriptorDistance(d1,d2);
+                int dist = vDistances[k];
 
                 if(vMatchedDistance[i2]<=dist)
                     continue;
@@ -762,15 +817,20 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches12)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches12)
     {
-        const vector<cv::KeyPoint> &vKeysUn1 = pKF1->mvKeysUn;
-        const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
+        // Candidate rows of each search and their descriptor distances
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
+        const PackedKeyPoints &vKeysUn1 = pKF1->mvKeysUn;
+        const DBoW2::FlatFeatureVector &vFeatVec1 = pKF1->mFlatFeatVec;
         const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
         const cv::Mat &Descriptors1 = pKF1->mDescriptors;
 
-        const vector<cv::KeyPoint> &vKeysUn2 = pKF2->mvKeysUn;
-        const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
+        const PackedKeyPoints &vKeysUn2 = pKF2->mvKeysUn;
+        const DBoW2::FlatFeatureVector &vFeatVec2 = pKF2->mFlatFeatVec;
         const vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
         const cv::Mat &Descriptors2 = pKF2->mDescriptors;
 
@@ -785,18 +845,19 @@ namespace ORB_SLAM3
 
         int nmatches = 0;
 
-        DBoW2::FeatureVector::const_iterator f1it = vFeatVec1.begin();
-        DBoW2::FeatureVector::const_iterator f2it = vFeatVec2.begin();
-        DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
-        DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
+        // Merge of the sorted node ids, the side behind gallops to the other
+        size_t f1it = 0, f2it = 0;
+        const size_t f1end = vFeatVec1.size(), f2end = vFeatVec2.size();
 
         while(f1it != f1end && f2it != f2end)
         {
-            if(f1it->first == f2it->first)
+            if(vFeatVec1.nodes[f1it] == vFeatVec2.nodes[f2it])
             {
-                for(size_t i1=0, iend1=f1it->second.size(); i1<iend1; i1++)
+                const DBoW2::FlatFeatureVector::Features vIndices1 = vFeatVec1.at(f1it);
+                const DBoW2::FlatFeatureVector::Features vIndices2 = vFeatVec2.at(f2it);
+                for(size_t i1=0, iend1=vIndices1.size(); i1<iend1; i1++)
                 {
-                    const size_t idx1 = f1it->second[i1];
+                    const size_t idx1 = vIndices1[i1];
                     if(pKF1 -> NLeft != -1 && idx1 >= pKF1 -> mvKeysUn.size()){
                         continue;
                     }
@@ -809,13 +870,10 @@ namespace ORB_SLAM3
 
                     const cv::Mat &d1 = Descriptors1.row(idx1);
 
-                    int bestDist1=256;
-                    int bestIdx2 =-1 ;
-                    int bestDist2=256;
-
-                    for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
+                    vCandidates.clear();
+                    for(size_t i2=0, iend2=vIndices2.size(); i2<iend2; i2++)
                     {
-                        const size_t idx2 = f2it->second[i2];
+                        const size_t idx2 = vIndices2[i2];
 
                         if(pKF2 -> NLeft != -1 && idx2 >= pKF2 -> mvKeysUn.size()){
                             continue;
@@ -829,22 +887,14 @@ namespace ORB_SLAM3
                         if(pMP2->isBad())
                             continue;
 
-                        const cv::Mat &d2 = Descriptors2.row(idx2);
-
-                        int dist = DescriptorDistance(d1,d2);
-
-                        if(dist<bestDist1)
-                        {
-                            bestDist2=bestDist1;
-                            bestDist1=dist;
-                            bestIdx2=idx2;
-                        }
-                        else if(dist<bestDist2)
-                        {
-                            bestDist2=dist;
-                        }
+                        vCandidates.push_back(idx2);
                     }
 
+                    const DescriptorMatch match = SearchDescriptors(d1, Descriptors2, vCandidates, vDistances);
+                    const int bestDist1 = match.bestDist;
+                    const int bestDist2 = match.bestDist2;
+                    const int bestIdx2 = match.bestIdx;
+
                     if(bestDist1<TH_LOW)
                     {
                         if(static_cast<float>(bestDist1)<mfNNratio*static_cast<float>(bestDist2))
@@ -871,13 +921,13 @@ namespace ORB_SLAM3
                 f1it++;
                 f2it++;
             }
-            else if(f1it->first < f2it->first)
+            else if(vFeatVec1.nodes[f1it] < vFeatVec2.nodes[f2it])
             {
-                f1it = vFeatVec1.lower_bound(f2it->first);
+                f1it = vFeatVec1.seek(f1it, vFeatVec2.nodes[f2it]);
             }
             else
             {
-                f2it = vFeatVec2.lower_bound(f1it->first);
+                f2it = vFeatVec2.seek(f2it, vFeatVec1.nodes[f1it]);
             }
         }
 
@@ -904,11 +954,16 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2,
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2,
                                            vector<pair<size_t, size_t> > &vMatchedPairs, const bool bOnlyStereo, const bool bCoarse)
     {
-        const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
-        const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
+        // Candidate rows of each search and their descriptor distances
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
+        const DBoW2::FlatFeatureVector &vFeatVec1 = pKF1->mFlatFeatVec;
+        const DBoW2::FlatFeatureVector &vFeatVec2 = pKF2->mFlatFeatVec;
 
         //Compute epipole in second image
         Sophus::SE3f T1w = pKF1->GetPose();
@@ -955,18 +1010,19 @@ namespace ORB_SLAM3
 
         const float factor = 1.0f/HISTO_LENGTH;
 
-        DBoW2::FeatureVector::const_iterator f1it = vFeatVec1.begin();
-        DBoW2::FeatureVector::const_iterator f2it = vFeatVec2.begin();
-        DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
-        DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
+        // Merge of the sorted node ids, the side behind gallops to the other
+        size_t f1it = 0, f2it = 0;
+        const size_t f1end = vFeatVec1.size(), f2end = vFeatVec2.size();
 
         while(f1it!=f1end && f2it!=f2end)
         {
-            if(f1it->first == f2it->first)
+            if(vFeatVec1.nodes[f1it] == vFeatVec2.nodes[f2it])
             {
-                for(size_t i1=0, iend1=f1it->second.size(); i1<iend1; i1++)
+                const DBoW2::FlatFeatureVector::Features vIndices1 = vFeatVec1.at(f1it);
+                const DBoW2::FlatFeatureVector::Features vIndices2 = vFeatVec2.at(f2it);
+                for(size_t i1=0, iend1=vIndices1.size(); i1<iend1; i1++)
                 {
-                    const size_t idx1 = f1it->second[i1];
+                    const size_t idx1 = vIndices1[i1];
 
                     MapPoint* pMP1 = pKF1->GetMapPoint(idx1);
 
@@ -991,12 +1047,10 @@ namespace ORB_SLAM3
 
                     const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
 
-                    int bestDist = TH_LOW;
-                    int bestIdx2 = -1;
-
-                    for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
+                    vCandidates.clear();
+                    for(size_t i2=0, iend2=vIndices2.size(); i2<iend2; i2++)
                     {
-                        size_t idx2 = f2it->second[i2];
+                        size_t idx2 = vIndices2[i2];
 
                         MapPoint* pMP2 = pKF2->GetMapPoint(idx2);
 
@@ -1010,9 +1064,20 @@ namespace ORB_SLAM3
                             if(!bStereo2)
                                 continue;
 
-                        const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+                        vCandidates.push_back(idx2);
+                    }
+                    DescriptorDistances(d1, pKF2->mDescriptors, vCandidates, vDistances);
+
+                    int bestDist = TH_LOW;
+                    int bestIdx2 = -1;
+
+                    for(size_t i2=0, iend2=vCandidates.size(); i2<iend2; i2++)
+                    {
+                        size_t idx2 = vCandidates[i2];
+
+                        const bool bStereo2 = (!pKF2->mpCamera2 &&  pKF2->mvuRight[idx2]>=0);
 
-                        const int dist = DescriptorDistance(d1,d2);
+                        const int dist = vDistances[i2];
 
                         if(dist>TH_LOW || dist>bestDist)
                             continue;
@@ -1101,13 +1166,13 @@ namespace ORB_SLAM3
                 f1it++;
                 f2it++;
             }
-            else if(f1it->first < f2it->first)
+            else if(vFeatVec1.nodes[f1it] < vFeatVec2.nodes[f2it])
             {
-                f1it = vFeatVec1.lower_bound(f2it->first);
+                f1it = vFeatVec1.seek(f1it, vFeatVec2.nodes[f2it]);
             }
             else
             {
-                f2it = vFeatVec2.lower_bound(f1it->first);
+                f2it = vFeatVec2.seek(f2it, vFeatVec1.nodes[f1it]);
             }
         }
 
@@ -1145,8 +1210,21 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const float th, const bool bRight)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const float th, const bool bRight)
     {
+        vector<FuseMatch> vMatches;
+        SearchFuse(pKF,vpMapPoints,vMatches,th,bRight);
+        return ApplyFuse(pKF,vMatches);
+    }
+
+    template<class Descriptor>
+    void DescriptorMatcher<Descriptor>::SearchFuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, vector<FuseMatch> &vMatches, const float th, const bool bRight)
+    {
+        // Candidate rows of each search and their descriptor distances
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         GeometricCamera* pCamera;
         Sophus::SE3f Tcw;
         Eigen::Vector3f Ow;
@@ -1162,48 +1240,28 @@ namespace ORB_SLAM3
             pCamera = pKF->mpCamera;
         }
 
-        const float &fx = pKF->fx;
-        const float &fy = pKF->fy;
-        const float &cx = pKF->cx;
-        const float &cy = pKF->cy;
         const float &bf = pKF->mbf;
 
-        int nFused=0;
+        vMatches.clear();
 
         const int nMPs = vpMapPoints.size();
 
-        // For debbuging
-        int count_notMP = 0, count_bad=0, count_isinKF = 0, count_negdepth = 0, count_notinim = 0, count_dist = 0, count_normal=0, count_notidx = 0, count_thcheck = 0;
         for(int i=0; i<nMPs; i++)
         {
             MapPoint* pMP = vpMapPoints[i];
 
             if(!pMP)
-            {
-                count_notMP++;
                 continue;
-            }
 
-            if(pMP->isBad())
-            {
-                count_bad++;
+            if(pMP->isBad() || pMP->IsInKeyFrame(pKF))
                 continue;
-            }
-            else if(pMP->IsInKeyFrame(pKF))
-            {
-                count_isinKF++;
-                continue;
-            }
 
             Eigen::Vector3f p3Dw = pMP->GetWorldPos();
             Eigen::Vector3f p3Dc = Tcw * p3Dw;
 
             // Depth must be positive
             if(p3Dc(2)<0.0f)
-            {
-                count_negdepth++;
                 continue;
-            }
 
             const float invz = 1/p3Dc(2);
 
@@ -1211,10 +1269,7 @@ namespace ORB_SLAM3
 
             // Point must be inside the image
             if(!pKF->IsInImage(uv(0),uv(1)))
-            {
-                count_notinim++;
                 continue;
-            }
 
             const float ur = uv(0)-bf*invz;
 
@@ -1224,19 +1279,14 @@ namespace ORB_SLAM3
             const float dist3D = PO.norm();
 
             // Depth must be inside the scale pyramid of the image
-            if(dist3D<minDistance || dist3D>maxDistance) {
-                count_dist++;
+            if(dist3D<minDistance || dist3D>maxDistance)
                 continue;
-            }
 
             // Viewing angle must be less than 60 deg
             Eigen::Vector3f Pn = pMP->GetNormal();
 
             if(PO.dot(Pn)<0.5*dist3D)
-            {
-                count_normal++;
                 continue;
-            }
 
             int nPredictedLevel = pMP->PredictScale(dist3D,pKF);
 
@@ -1246,17 +1296,14 @@ namespace ORB_SLAM3
             const vector<size_t> vIndices = pKF->GetFeaturesInArea(uv(0),uv(1),radius,bRight);
 
             if(vIndices.empty())
-            {
-                count_notidx++;
                 continue;
-            }
 
             // Match to the most similar keypoint in the radius
 
-            const cv::Mat dMP = pMP->GetDescriptor();
+            alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+            const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-            int bestDist = 256;
-            int bestIdx = -1;
+            vCandidates.clear();
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 size_t idx = *vit;
@@ -1297,48 +1344,64 @@ namespace ORB_SLAM3
 
                 if(bRight) idx += pKF->NLeft;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+                vCandidates.push_back(idx);
+            }
 
-                const int dist = DescriptorDistance(dMP,dKF);
+            const DescriptorMatch match = SearchDescriptors(dMP, pKF->mDescriptors, vCandidates, vDistances);
 
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdx = idx;
-                }
+            if(match.bestDist<=TH_LOW)
+            {
+                FuseMatch fuseMatch;
+                fuseMatch.pMP = pMP;
+                fuseMatch.idx = match.bestIdx;
+                vMatches.push_back(fuseMatch);
             }
+        }
+    }
+
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::ApplyFuse(KeyFrame *pKF, const vector<FuseMatch> &vMatches)
+    {
+        int nFused=0;
+
+        for(const FuseMatch &match : vMatches)
+        {
+            MapPoint* pMP = match.pMP;
+
+            // Replaced by an earlier match, or already fused into this keyframe at another keypoint
+            if(pMP->isBad() || pMP->IsInKeyFrame(pKF))
+                continue;
 
             // If there is already a MapPoint replace otherwise add new measurement
-            if(bestDist<=TH_LOW)
+            MapPoint* pMPinKF = pKF->GetMapPoint(match.idx);
+            if(pMPinKF)
             {
-                MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
-                if(pMPinKF)
+                if(!pMPinKF->isBad())
                 {
-                    if(!pMPinKF->isBad())
-                    {
-                        if(pMPinKF->Observations()>pMP->Observations())
-                            pMP->Replace(pMPinKF);
-                        else
-                            pMPinKF->Replace(pMP);
-                    }
-                }
-                else
-                {
-                    pMP->AddObservation(pKF,bestIdx);
-                    pKF->AddMapPoint(pMP,bestIdx);
+                    if(pMPinKF->Observations()>pMP->Observations())
+                        pMP->Replace(pMPinKF);
+                    else
+                        pMPinKF->Replace(pMP);
                 }
-                nFused++;
             }
             else
-                count_thcheck++;
-
+            {
+                pMP->AddObservation(pKF,match.idx);
+                pKF->AddMapPoint(pMP,match.idx);
+            }
+            nFused++;
         }
 
         return nFused;
     }
 
-    int ORBmatcher::Fuse(KeyFrame *pKF, Sophus::Sim3f &Scw, const vector<MapPoint *> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::Fuse(KeyFrame *pKF, Sophus::Sim3f &Scw, const vector<MapPoint *> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint)
     {
+        // Candidate rows of each search and their descriptor distances
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         // Get Calibration Parameters for later projection
         const float &fx = pKF->fx;
         const float &fy = pKF->fy;
@@ -1410,10 +1473,10 @@ namespace ORB_SLAM3
 
             // Match to the most similar keypoint in the radius
 
-            const cv::Mat dMP = pMP->GetDescriptor();
+            alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+            const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-            int bestDist = INT_MAX;
-            int bestIdx = -1;
+            vCandidates.clear();
             for(vector<size_t>::const_iterator vit=vIndices.begin(); vit!=vIndices.end(); vit++)
             {
                 const size_t idx = *vit;
@@ -1422,17 +1485,13 @@ namespace ORB_SLAM3
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                int dist = DescriptorDistance(dMP,dKF);
-
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdx = idx;
-                }
+                vCandidates.push_back(idx);
             }
 
+            const DescriptorMatch match = SearchDescriptors(dMP, pKF->mDescriptors, vCandidates, vDistances);
+            const int bestDist = match.bestDist;
+            const int bestIdx = match.bestIdx;
+
             // If there is already a MapPoint replace otherwise add new measurement
             if(bestDist<=TH_LOW)
             {
@@ -1454,8 +1513,13 @@ namespace ORB_SLAM3
         return nFused;
     }
 
-    int ORBmatcher::SearchBySim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches12, const Sophus::Sim3f &S12, const float th)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchBySim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches12, const Sophus::Sim3f &S12, const float th)
     {
+        // Candidate rows of each search and their descriptor distances
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         const float &fx = pKF1->fx;
         const float &fy = pKF1->fy;
         const float &cx = pKF1->cx;
@@ -1542,10 +1606,10 @@ namespace ORB_SLAM3
                 continue;
 
             // Match to the most similar keypoint in the radius
-            const cv::Mat dMP = pMP->GetDescriptor();
+            alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+            const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-            int bestDist = INT_MAX;
-            int bestIdx = -1;
+            vCandidates.clear();
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -1555,17 +1619,13 @@ namespace ORB_SLAM3
                 if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
-
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdx = idx;
-                }
+                vCandidates.push_back(idx);
             }
 
+            const DescriptorMatch match = SearchDescriptors(dMP, pKF2->mDescriptors, vCandidates, vDistances);
+            const int bestDist = match.bestDist;
+            const int bestIdx = match.bestIdx;
+
             if(bestDist<=TH_HIGH)
             {
                 vnMatch1[i1]=bestIdx;
@@ -1622,10 +1682,10 @@ namespace ORB_SLAM3
                 continue;
 
             // Match to the most similar keypoint in the radius
-            const cv::Mat dMP = pMP->GetDescriptor();
+            alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+            const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-            int bestDist = INT_MAX;
-            int bestIdx = -1;
+            vCandidates.clear();
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -1635,17 +1695,13 @@ namespace ORB_SLAM3
                 if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
-
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdx = idx;
-                }
+                vCandidates.push_back(idx);
             }
 
+            const DescriptorMatch match = SearchDescriptors(dMP, pKF1->mDescriptors, vCandidates, vDistances);
+            const int bestDist = match.bestDist;
+            const int bestIdx = match.bestIdx;
+
             if(bestDist<=TH_HIGH)
             {
                 vnMatch2[i2]=bestIdx;
@@ -1673,8 +1729,41 @@ namespace ORB_SLAM3
         return nFound;
     }
 
-    int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono)
+    template<class Descriptor>
+    float DescriptorMatcher<Descriptor>::ProjectionSigma(GeometricCamera* pCamera, const Eigen::Vector3f &x3D,
+                                      const Eigen::Matrix<float,3,6> &J, const Eigen::Matrix<float,6,6> &C)
+    {
+        const Eigen::Matrix<float,2,6> Juv = pCamera->projectJac(x3D.cast<double>()).cast<float>() * J;
+        const Eigen::Matrix2f S = Juv * C * Juv.transpose();
+
+        // Largest eigenvalue of the 2x2 projection covariance
+        const float half = 0.5f*(S(0,0)+S(1,1));
+        const float diff = 0.5f*(S(0,0)-S(1,1));
+        return sqrt(half + sqrt(diff*diff + S(0,1)*S(0,1)));
+    }
+
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono)
     {
+        return SearchByProjection(CurrentFrame, LastFrame, th, bMono, static_cast<const Eigen::Matrix<float,6,6>*>(NULL), 0.f);
+    }
+
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono,
+                                       const Eigen::Matrix<float,6,6> &poseCovariance, const float thMax)
+    {
+        return SearchByProjection(CurrentFrame, LastFrame, th, bMono, &poseCovariance, thMax);
+    }
+
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono,
+                                       const Eigen::Matrix<float,6,6>* pPoseCovariance, const float thMax)
+    {
+        // Grid positions in each search area, the candidates left after the checks and their descriptor distances
+        vector<size_t> vPositions;
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         int nmatches = 0;
 
         // Rotation Histogram (to check rotation consistency)
@@ -1685,6 +1774,7 @@ namespace ORB_SLAM3
 
         const Sophus::SE3f Tcw = CurrentFrame.GetPose();
         const Eigen::Vector3f twc = Tcw.inverse().translation();
+        const Eigen::Matrix3f Rcw = Tcw.rotationMatrix();
 
         const Sophus::SE3f Tlw = LastFrame.GetPose();
         const Eigen::Vector3f tlc = Tlw * twc;
@@ -1692,6 +1782,10 @@ namespace ORB_SLAM3
         const bool bForward = tlc(2)>CurrentFrame.mb && !bMono;
         const bool bBackward = -tlc(2)>CurrentFrame.mb && !bMono;
 
+        // Jacobian of the camera coordinates of a point with respect to the pose error
+        Eigen::Matrix<float,3,6> J;
+        J.leftCols<3>().setIdentity();
+
         for(int i=0; i<LastFrame.N; i++)
         {
             MapPoint* pMP = LastFrame.mvpMapPoints[i];
@@ -1720,29 +1814,32 @@ namespace ORB_SLAM3
                     int nLastOctave = (LastFrame.Nleft == -1 || i < LastFrame.Nleft) ? LastFrame.mvKeys[i].octave
                                                                                      : LastFrame.mvKeysRight[i - LastFrame.Nleft].octave;
 
-                    // Search in a window. Size depends on scale
+                    // Search in a window. Size depends on scale and on the pose uncertainty
                     float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
-
-                    vector<size_t> vIndices2;
+                    if(pPoseCovariance)
+                    {
+                        J.rightCols<3>() = -Rcw * Sophus::SO3f::hat(x3Dw);
+                        radius = min(radius + 3.f*ProjectionSigma(CurrentFrame.mpCamera, x3Dc, J, *pPoseCovariance),
+                                     thMax*CurrentFrame.mvScaleFactors[nLastOctave]);
+                    }
 
                     if(bForward)
-                        vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave);
+                        CurrentFrame.GetGridPositionsInArea(uv(0),uv(1), radius, nLastOctave, -1, false, vPositions);
                     else if(bBackward)
-                        vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, 0, nLastOctave);
+                        CurrentFrame.GetGridPositionsInArea(uv(0),uv(1), radius, 0, nLastOctave, false, vPositions);
                     else
-                        vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1);
+                        CurrentFrame.GetGridPositionsInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1, false, vPositions);
 
-                    if(vIndices2.empty())
+                    if(vPositions.empty())
                         continue;
 
-                    const cv::Mat dMP = pMP->GetDescriptor();
-
-                    int bestDist = 256;
-                    int bestIdx2 = -1;
+                    alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+                    const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-                    for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
+                    vCandidates.clear();
+                    for(vector<size_t>::const_iterator vit=vPositions.begin(), vend=vPositions.end(); vit!=vend; vit++)
                     {
-                        const size_t i2 = *vit;
+                        const size_t i2 = CurrentFrame.mGrid.vIndices[*vit];
 
                         if(CurrentFrame.mvpMapPoints[i2])
                             if(CurrentFrame.mvpMapPoints[i2]->Observations()>0)
@@ -1756,17 +1853,13 @@ namespace ORB_SLAM3
                                 continue;
                         }
 
-                        const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                        const int dist = DescriptorDistance(dMP,d);
-
-                        if(dist<bestDist)
-                        {
-                            bestDist=dist;
-                            bestIdx2=i2;
-                        }
+                        vCandidates.push_back(*vit);
                     }
 
+                    const DescriptorMatch match = SearchDescriptors(dMP, CurrentFrame.mGrid.descriptors, vCandidates, vDistances);
+                    const int bestDist = match.bestDist;
+                    const int bestIdx2 = (match.bestIdx < 0) ? -1 : CurrentFrame.mGrid.vIndices[match.bestIdx];
+
                     if(bestDist<=TH_HIGH)
                     {
                         CurrentFrame.mvpMapPoints[bestIdx2]=pMP;
@@ -1798,41 +1891,40 @@ namespace ORB_SLAM3
                         int nLastOctave = (LastFrame.Nleft == -1 || i < LastFrame.Nleft) ? LastFrame.mvKeys[i].octave
                                              : LastFrame.mvKeysRight[i - LastFrame.Nleft].octave;
 
-                        // Search in a window. Size depends on scale
+                        // Search in a window. Size depends on scale and on the pose uncertainty
                         float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
-
-                        vector<size_t> vIndices2;
+                        if(pPoseCovariance)
+                        {
+                            const Eigen::Matrix<float,3,6> Jr = CurrentFrame.GetRelativePoseTrl().rotationMatrix() * J;
+                            radius = min(radius + 3.f*ProjectionSigma(CurrentFrame.mpCamera, x3Dr, Jr, *pPoseCovariance),
+                                         thMax*CurrentFrame.mvScaleFactors[nLastOctave]);
+                        }
 
                         if(bForward)
-                            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave, -1,true);
+                            CurrentFrame.GetGridPositionsInArea(uv(0),uv(1), radius, nLastOctave, -1, true, vPositions);
                         else if(bBackward)
-                            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, 0, nLastOctave, true);
+                            CurrentFrame.GetGridPositionsInArea(uv(0),uv(1), radius, 0, nLastOctave, true, vPositions);
                         else
-                            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1, true);
+                            CurrentFrame.GetGridPositionsInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1, true, vPositions);
 
-                        const cv::Mat dMP = pMP->GetDescriptor();
+                        alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+                        const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-                        int bestDist = 256;
-                        int bestIdx2 = -1;
-
-                        for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
+                        vCandidates.clear();
+                        for(vector<size_t>::const_iterator vit=vPositions.begin(), vend=vPositions.end(); vit!=vend; vit++)
                         {
-                            const size_t i2 = *vit;
+                            const size_t i2 = CurrentFrame.mGridRight.vIndices[*vit];
                             if(CurrentFrame.mvpMapPoints[i2 + CurrentFrame.Nleft])
                                 if(CurrentFrame.mvpMapPoints[i2 + CurrentFrame.Nleft]->Observations()>0)
                                     continue;
 
-                            const cv::Mat &d = CurrentFrame.mDescriptors.row(i2 + CurrentFrame.Nleft);
-
-                            const int dist = DescriptorDistance(dMP,d);
-
-                            if(dist<bestDist)
-                            {
-                                bestDist=dist;
-                                bestIdx2=i2;
-                            }
+                            vCandidates.push_back(*vit);
                         }
 
+                        const DescriptorMatch match = SearchDescriptors(dMP, CurrentFrame.mGridRight.descriptors, vCandidates, vDistances);
+                        const int bestDist = match.bestDist;
+                        const int bestIdx2 = (match.bestIdx < 0) ? -1 : CurrentFrame.mGridRight.vIndices[match.bestIdx];
+
                         if(bestDist<=TH_HIGH)
                         {
                             CurrentFrame.mvpMapPoints[bestIdx2 + CurrentFrame.Nleft]=pMP;
@@ -1886,8 +1978,14 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set<MapPoint*> &sAlreadyFound, const float th , const int ORBdist)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set<MapPoint*> &sAlreadyFound, const float th , const int ORBdist)
     {
+        // Grid positions in each search area, the candidates left after the checks and their descriptor distances
+        vector<size_t> vPositions;
+        vector<size_t> vCandidates;
+        vector<int> vDistances;
+
         int nmatches = 0;
 
         const Sophus::SE3f Tcw = CurrentFrame.GetPose();
@@ -1936,33 +2034,28 @@ namespace ORB_SLAM3
                     // Search in a window
                     const float radius = th*CurrentFrame.mvScaleFactors[nPredictedLevel];
 
-                    const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0), uv(1), radius, nPredictedLevel-1, nPredictedLevel+1);
+                    CurrentFrame.GetGridPositionsInArea(uv(0), uv(1), radius, nPredictedLevel-1, nPredictedLevel+1, false, vPositions);
 
-                    if(vIndices2.empty())
+                    if(vPositions.empty())
                         continue;
 
-                    const cv::Mat dMP = pMP->GetDescriptor();
-
-                    int bestDist = 256;
-                    int bestIdx2 = -1;
+                    alignas(32) uchar descriptorMP[DescriptorArena::kDescriptorBytes];
+                    const cv::Mat dMP = pMP->GetDescriptor(descriptorMP);
 
-                    for(vector<size_t>::const_iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
+                    vCandidates.clear();
+                    for(vector<size_t>::const_iterator vit=vPositions.begin(); vit!=vPositions.end(); vit++)
                     {
-                        const size_t i2 = *vit;
+                        const size_t i2 = CurrentFrame.mGrid.vIndices[*vit];
                         if(CurrentFrame.mvpMapPoints[i2])
                             continue;
 
-                        const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                        const int dist = DescriptorDistance(dMP,d);
-
-                        if(dist<bestDist)
-                        {
-                            bestDist=dist;
-                            bestIdx2=i2;
-                        }
+                        vCandidates.push_back(*vit);
                     }
 
+                    const DescriptorMatch match = SearchDescriptors(dMP, CurrentFrame.mGrid.descriptors, vCandidates, vDistances);
+                    const int bestDist = match.bestDist;
+                    const int bestIdx2 = (match.bestIdx < 0) ? -1 : CurrentFrame.mGrid.vIndices[match.bestIdx];
+
                     if(bestDist<=ORBdist)
                     {
                         CurrentFrame.mvpMapPoints[bestIdx2]=pMP;
@@ -2009,7 +2102,8 @@ namespace ORB_SLAM3
         return nmatches;
     }
 
-    void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3)
+    template<class Descriptor>
+    void DescriptorMatcher<Descriptor>::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3)
     {
         int max1=0;
         int max2=0;
@@ -2053,24 +2147,55 @@ namespace ORB_SLAM3
     }
 
 
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-    int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
+    template<class Descriptor>
+    int DescriptorMatcher<Descriptor>::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
     {
-        const int *pa = a.ptr<int32_t>();
-        const int *pb = b.ptr<int32_t>();
+        return Descriptor::Distance(a.ptr<Element>(), b.ptr<Element>());
+    }
 
-        int dist=0;
+    template<class Descriptor>
+    void DescriptorMatcher<Descriptor>::DescriptorDistances(const cv::Mat &a, const cv::Mat &descriptors,
+                                                            const std::vector<size_t> &vIndices, std::vector<int> &vDistances)
+    {
+        vDistances.resize(vIndices.size());
+        Descriptor::Distances(a.ptr<Element>(), descriptors, vIndices, vDistances.data());
+    }
 
-        for(int i=0; i<8; i++, pa++, pb++)
+    template<class Descriptor>
+    typename DescriptorMatcher<Descriptor>::DescriptorMatch DescriptorMatcher<Descriptor>::SearchDescriptors(const cv::Mat &a, const cv::Mat &descriptors,
+                                                              const std::vector<size_t> &vIndices, std::vector<int> &vDistances)
+    {
+        DescriptorDistances(a, descriptors, vIndices, vDistances);
+
+        DescriptorMatch match;
+        match.bestDist = Descriptor::MAX_DISTANCE;
+        match.bestDist2 = Descriptor::MAX_DISTANCE;
+        match.bestIdx = -1;
+        match.bestIdx2 = -1;
+
+        for(size_t i=0; i<vIndices.size(); i++)
         {
-            unsigned  int v = *pa ^ *pb;
-            v = v - ((v >> 1) & 0x55555555);
-            v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-            dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+            const int dist = vDistances[i];
+
+            if(dist<match.bestDist)
+            {
+                match.bestDist2 = match.bestDist;
+                match.bestIdx2 = match.bestIdx;
+                match.bestDist = dist;
+                match.bestIdx = vIndices[i];
+            }
+            else if(dist<match.bestDist2)
+            {
+                match.bestDist2 = dist;
+                match.bestIdx2 = vIndices[i];
+            }
         }
 
-        return dist;
+        return match;
     }
 
+    template class DescriptorMatcher<OrbDescriptor>;
+    template class DescriptorMatcher<BinarySuperPointDescriptor>;
+    template class DescriptorMatcher<FloatSuperPointDescriptor>;
+
 } //namespace ORB_SLAM
@@ -30,42 +30,157 @@
 #include "Thirdparty/g2o/g2o/core/block_solver.h"
 #include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
 #include "Thirdparty/g2o/g2o/core/optimization_algorithm_gauss_newton.h"
+#include "Thirdparty/g2o/g2o/core/sparse_optimizer_terminate_action.h"
 #include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_cached_cholesky.h"
 #include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
 #include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
 #include "Thirdparty/g2o/g2o/solvers/linear_solver_dense.h"
 #include "G2oTypes.h"
 #include "Converter.h"
+#include "Trace.h"
 
 #include<mutex>
+#include<chrono>
 
 #include "OptimizableTypes.h"
+#include "CameraModels/Pinhole.h"
 
 
 namespace ORB_SLAM3
 {
+
+#ifdef ENABLE_TRACING
+// Spans of the iterations of a g2o optimization, from its pre to its post iteration actions
+class IterationTraceAction : public g2o::HyperGraphAction
+{
+public:
+    explicit IterationTraceAction(bool bBegin): mbBegin(bBegin) {}
+
+    HyperGraphAction* operator()(const g2o::HyperGraph* graph, Parameters* parameters)
+    {
+        (void)graph;
+        if(!mbBegin)
+            Tracer::Record(Tracer::END, nullptr);
+        else
+        {
+            ParametersIteration* pIteration = dynamic_cast<ParametersIteration*>(parameters);
+            Tracer::Record(Tracer::BEGIN, "Iteration", pIteration ? pIteration->iteration : 0);
+        }
+        return this;
+    }
+
+private:
+    bool mbBegin;
+};
+
+class IterationTrace
+{
+public:
+    explicit IterationTrace(g2o::SparseOptimizer &optimizer): mOptimizer(optimizer), mBegin(true), mEnd(false)
+    {
+        mOptimizer.addPreIterationAction(&mBegin);
+        mOptimizer.addPostIterationAction(&mEnd);
+    }
+
+    ~IterationTrace()
+    {
+        mOptimizer.removePreIterationAction(&mBegin);
+        mOptimizer.removePostIterationAction(&mEnd);
+    }
+
+private:
+    g2o::SparseOptimizer &mOptimizer;
+    IterationTraceAction mBegin, mEnd;
+};
+
+#define TRACE_ITERATIONS(optimizer) IterationTrace TRACE_CONCAT(iterationTrace, __LINE__)(optimizer)
+#else
+#define TRACE_ITERATIONS(optimizer) do {} while(0)
+#endif
+
 bool sortByVal(const pair<MapPoint*, int> &a, const pair<MapPoint*, int> &b)
 {
     return (a.second < b.second);
 }
 
-void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                       const set<KeyFrame*> *pspAffectedKFs)
 {
-    vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
-    vector<MapPoint*> vpMP = pMap->GetAllMapPoints();
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
+
+    if(pspAffectedKFs)
+    {
+        // Map points seen by the affected keyframes, the other keyframes observing them are fixed
+        set<MapPoint*> spMPs;
+        for(set<KeyFrame*>::const_iterator sit=pspAffectedKFs->begin(); sit!=pspAffectedKFs->end(); sit++)
+        {
+            KeyFrame* pKFi = *sit;
+            if(pKFi->isBad() || pKFi->GetMap()!=pMap)
+                continue;
+            const set<MapPoint*> spKFMPs = pKFi->GetMapPoints();
+            spMPs.insert(spKFMPs.begin(),spKFMPs.end());
+        }
+
+        vector<KeyFrame*> vpSubKFs;
+        set<KeyFrame*> spFixedKFs;
+        for(set<KeyFrame*>::const_iterator sit=pspAffectedKFs->begin(); sit!=pspAffectedKFs->end(); sit++)
+            if(!(*sit)->isBad() && (*sit)->GetMap()==pMap)
+                vpSubKFs.push_back(*sit);
+        for(set<MapPoint*>::iterator sit=spMPs.begin(); sit!=spMPs.end(); sit++)
+        {
+            const map<KeyFrame*,tuple<int,int>> observations = (*sit)->GetObservations();
+            for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+            {
+                KeyFrame* pKFi = mit->first;
+                if(pKFi->isBad() || pKFi->GetMap()!=pMap || pspAffectedKFs->count(pKFi))
+                    continue;
+                if(spFixedKFs.insert(pKFi).second)
+                    vpSubKFs.push_back(pKFi);
+            }
+        }
+
+        // Without fixed keyframes the subgraph has no anchor, optimize the whole map
+        if(!vpSubKFs.empty() && !spFixedKFs.empty())
+        {
+            vector<MapPoint*> vpSubMPs(spMPs.begin(),spMPs.end());
+            BundleAdjustment(vpSubKFs,vpSubMPs,nIterations,pbStopFlag,nLoopKF,bRobust,&spFixedKFs);
+
+            // Keyframes outside the subgraph keep their pose
+            if(nLoopKF!=pMap->GetOriginKF()->mnId)
+            {
+                for(size_t i=0; i<vpKFs.size(); i++)
+                {
+                    KeyFrame* pKFi = vpKFs[i];
+                    if(pKFi->isBad() || pKFi->mnBAGlobalForKF==nLoopKF)
+                        continue;
+                    pKFi->mTcwGBA = pKFi->GetPose();
+                    pKFi->mnBAGlobalForKF = nLoopKF;
+                }
+            }
+            return;
+        }
+    }
+
+    const Map::MapPointSnapshot pMapPoints = pMap->GetMapPointsSnapshot();
+    const vector<MapPoint*> &vpMP = *pMapPoints;
     BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust);
 }
 
 
 void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<MapPoint *> &vpMP,
-                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                 const set<KeyFrame*> *pspFixedKFs)
 {
+    TRACE_SCOPE("BundleAdjustment");
     vector<bool> vbNotIncludedMP;
     vbNotIncludedMP.resize(vpMP.size());
 
     Map* pMap = vpKFs[0]->GetMap();
 
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
@@ -122,7 +237,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
         Sophus::SE3<float> Tcw = pKF->GetPose();
         vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>()));
         vSE3->setId(pKF->mnId);
-        vSE3->setFixed(pKF->mnId==pMap->GetInitKFid());
+        vSE3->setFixed(pKF->mnId==pMap->GetInitKFid() || (pspFixedKFs && pspFixedKFs->count(pKF)));
         optimizer.addVertex(vSE3);
         if(pKF->mnId>maxKFid)
             maxKFid=pKF->mnId;
@@ -389,14 +504,171 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     }
 }
 
+void Optimizer::BundleAdjustment(const BundleAdjustmentProblem &problem, BundleAdjustmentSolution &solution,
+                                 bool *pbStopFlag)
+{
+    TRACE_SCOPE("BundleAdjustmentProblem");
+    const size_t nKFs = problem.vKeyFrames.size();
+    const size_t nMPs = problem.vPoints.size()/3;
+
+    g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
+    g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
+
+    linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+
+    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    optimizer.setAlgorithm(solver);
+    optimizer.setVerbose(false);
+
+    if(pbStopFlag)
+        optimizer.setForceStopFlag(pbStopFlag);
+
+    // The edges project through the camera models
+    vector<Pinhole*> vpCameras;
+    vpCameras.reserve(problem.vCameras.size());
+    for(const BundleAdjustmentProblem::Camera &camera : problem.vCameras)
+        vpCameras.push_back(new Pinhole(vector<float>{camera.fx, camera.fy, camera.cx, camera.cy}));
+
+    // Set KeyFrame vertices, ids 0 to nKFs-1
+    for(size_t i=0; i<nKFs; i++)
+    {
+        const BundleAdjustmentProblem::KeyFrameEntry &entry = problem.vKeyFrames[i];
+        g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
+        const Eigen::Quaterniond q(entry.q[3], entry.q[0], entry.q[1], entry.q[2]);
+        vSE3->setEstimate(g2o::SE3Quat(q.normalized(), Eigen::Vector3d(entry.t[0], entry.t[1], entry.t[2])));
+        vSE3->setId(i);
+        vSE3->setFixed(entry.fixed != 0);
+        optimizer.addVertex(vSE3);
+    }
+
+    const float thHuber2D = sqrt(5.99);
+    const float thHuber3D = sqrt(7.815);
+
+    // Set MapPoint vertices, the points without observations are left out
+    vector<int> vnEdges(nMPs, 0);
+    for(const BundleAdjustmentProblem::Observation &obs : problem.vObservations)
+        vnEdges[obs.point]++;
+
+    for(size_t i=0; i<nMPs; i++)
+    {
+        if(vnEdges[i]==0)
+            continue;
+        g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
+        vPoint->setEstimate(Eigen::Vector3d(problem.vPoints[3*i], problem.vPoints[3*i+1], problem.vPoints[3*i+2]));
+        vPoint->setId(nKFs+i);
+        vPoint->setMarginalized(true);
+        optimizer.addVertex(vPoint);
+    }
+
+    //SET EDGES
+    for(const BundleAdjustmentProblem::Observation &obs : problem.vObservations)
+    {
+        const BundleAdjustmentProblem::Camera &camera = problem.vCameras[problem.vKeyFrames[obs.keyframe].camera];
+        g2o::OptimizableGraph::Vertex* vPoint = dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(nKFs+obs.point));
+        g2o::OptimizableGraph::Vertex* vSE3 = dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(obs.keyframe));
+
+        if(obs.ur<0)
+        {
+            Eigen::Matrix<double,2,1> measurement;
+            measurement << obs.u, obs.v;
+
+            ORB_SLAM3::EdgeSE3ProjectXYZ* e = new ORB_SLAM3::EdgeSE3ProjectXYZ();
+
+            e->setVertex(0, vPoint);
+            e->setVertex(1, vSE3);
+            e->setMeasurement(measurement);
+            e->setInformation(Eigen::Matrix2d::Identity()*obs.invSigma2);
+
+            if(problem.bRobust)
+            {
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuber2D);
+            }
+
+            e->pCamera = vpCameras[problem.vKeyFrames[obs.keyframe].camera];
+
+            optimizer.addEdge(e);
+        }
+        else
+        {
+            Eigen::Matrix<double,3,1> measurement;
+            measurement << obs.u, obs.v, obs.ur;
+
+            g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
+
+            e->setVertex(0, vPoint);
+            e->setVertex(1, vSE3);
+            e->setMeasurement(measurement);
+            e->setInformation(Eigen::Matrix3d::Identity()*obs.invSigma2);
+
+            if(problem.bRobust)
+            {
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuber3D);
+            }
+
+            e->fx = camera.fx;
+            e->fy = camera.fy;
+            e->cx = camera.cx;
+            e->cy = camera.cy;
+            e->bf = camera.bf;
+
+            optimizer.addEdge(e);
+        }
+    }
+
+    // Optimize!
+    optimizer.initializeOptimization();
+    optimizer.optimize(problem.nIterations);
+
+    // Recover optimized data
+    solution.vPoses.resize(7*nKFs);
+    for(size_t i=0; i<nKFs; i++)
+    {
+        const g2o::SE3Quat SE3quat = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(i))->estimate();
+        const Eigen::Quaterniond q = SE3quat.rotation();
+        float* p = &solution.vPoses[7*i];
+        p[0] = q.x();
+        p[1] = q.y();
+        p[2] = q.z();
+        p[3] = q.w();
+        for(int j=0; j<3; j++)
+            p[4+j] = SE3quat.translation()[j];
+    }
+
+    solution.vPoints.assign(3*nMPs, 0.f);
+    solution.vbIncluded.assign(nMPs, 0);
+    for(size_t i=0; i<nMPs; i++)
+    {
+        if(vnEdges[i]==0)
+            continue;
+        const Eigen::Vector3d pos = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(nKFs+i))->estimate();
+        for(int j=0; j<3; j++)
+            solution.vPoints[3*i+j] = pos[j];
+        solution.vbIncluded[i] = 1;
+    }
+
+    for(Pinhole* pCamera : vpCameras)
+        delete pCamera;
+}
+
 void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const long unsigned int nLoopId, bool *pbStopFlag, bool bInit, float priorG, float priorA, Eigen::VectorXd *vSingVal, bool *bHess)
 {
+    TRACE_SCOPE("FullInertialBA");
     long unsigned int maxKFid = pMap->GetMaxKFid();
-    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
-    const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
+    const Map::MapPointSnapshot pMapPoints = pMap->GetMapPointsSnapshot();
+    const vector<MapPoint*> &vpMPs = *pMapPoints;
 
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
@@ -811,182 +1083,359 @@ void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const l
 }
 
 
-int Optimizer::PoseOptimization(Frame *pFrame)
+namespace
 {
-    g2o::SparseOptimizer optimizer;
-    g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
-    linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
-
-    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
-
-    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-    optimizer.setAlgorithm(solver);
-
-    int nInitialCorrespondences=0;
-
-    // Set Frame vertex
-    g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-    Sophus::SE3<float> Tcw = pFrame->GetPose();
-    vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>()));
-    vSE3->setId(0);
-    vSE3->setFixed(false);
-    optimizer.addVertex(vSE3);
+/*
+ * Pose-only optimization of a frame (or of a camera rig) against fixed map points. Runs the
+ * Levenberg-Marquardt steps of g2o::OptimizationAlgorithmLevenberg on the 6 DoF of a single
+ * VertexSE3Expmap with Huber weights, without creating a g2o graph. The observations are kept
+ * in a buffer that is reused by the following frames, so tracking does not allocate once it
+ * has seen its largest frame.
+ */
+class PoseOnlyOptimizer
+{
+public:
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,6,1> Vector6d;
 
-    // Set MapPoint vertices
-    const int N = pFrame->N;
+    void Clear()
+    {
+        mvObs.clear();
+        mvTcb.clear();
+    }
 
-    vector<ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
-    vector<ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody *> vpEdgesMono_FHR;
-    vector<size_t> vnIndexEdgeMono, vnIndexEdgeRight;
-    vpEdgesMono.reserve(N);
-    vpEdgesMono_FHR.reserve(N);
-    vnIndexEdgeMono.reserve(N);
-    vnIndexEdgeRight.reserve(N);
+    // Camera from body transform of the observations of a second camera, returns its index
+    int AddCameraPose(const g2o::SE3Quat &Tcb)
+    {
+        mvTcb.push_back(Pose(Tcb));
+        return mvTcb.size()-1;
+    }
 
-    vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose*> vpEdgesStereo;
-    vector<size_t> vnIndexEdgeStereo;
-    vpEdgesStereo.reserve(N);
-    vnIndexEdgeStereo.reserve(N);
+    // Monocular observation in pCamera, nTcb is -1 for the camera of the optimized pose
+    void AddMono(const Eigen::Vector3d &Xw, const cv::KeyPoint &kp, const float invSigma2, const float th2,
+                 GeometricCamera* pCamera, const int nTcb, const bool bCheckDepth, Frame* pFrame, const size_t idx)
+    {
+        Observation obs;
+        obs.Xw = Xw;
+        obs.z << kp.pt.x, kp.pt.y, 0.0;
+        obs.invSigma2 = invSigma2;
+        obs.th2 = th2;
+        obs.pCamera = pCamera;
+        obs.nTcb = nTcb;
+        obs.bCheckDepth = bCheckDepth;
+        obs.bInlier = true;
+        obs.pFrame = pFrame;
+        obs.idx = idx;
+        mvObs.push_back(obs);
+    }
 
-    const float deltaMono = sqrt(5.991);
-    const float deltaStereo = sqrt(7.815);
+    // Observation of a rectified stereo pair (keypoint and right coordinate)
+    void AddStereo(const Eigen::Vector3d &Xw, const cv::KeyPoint &kp, const float ur, const float invSigma2, const float th2,
+                   Frame* pFrame, const size_t idx)
+    {
+        AddMono(Xw,kp,invSigma2,th2,static_cast<GeometricCamera*>(NULL),-1,false,pFrame,idx);
+        mvObs.back().z[2] = ur;
+    }
 
+    size_t size() const
     {
-    unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+        return mvObs.size();
+    }
 
-    for(int i=0; i<N; i++)
+    // We perform 4 optimizations from the initial pose, after each optimization we classify observation as inlier/outlier.
+    // At the next optimization, outliers are not included, but at the end they can be classified as inliers again.
+    // The robust kernel is dropped for the last optimization. Returns the number of outliers.
+    int Optimize(g2o::SE3Quat &Tcw)
     {
-        MapPoint* pMP = pFrame->mvpMapPoints[i];
-        if(pMP)
-        {
-            //Conventional SLAM
-            if(!pFrame->mpCamera2){
-                // Monocular observation
-                if(pFrame->mvuRight[i]<0)
-                {
-                    nInitialCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
+        const g2o::SE3Quat Tcw0 = Tcw;
+        const int its[4]={10,10,10,10};
 
-                    Eigen::Matrix<double,2,1> obs;
-                    const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-                    obs << kpUn.pt.x, kpUn.pt.y;
+        int nBad=0;
+        for(size_t it=0; it<4; it++)
+        {
+            Tcw = Tcw0;
+            Levenberg(Tcw,its[it],it<3);
 
-                    ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose* e = new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose();
+            const Pose T(Tcw);
+            nBad=0;
+            for(size_t i=0; i<mvObs.size(); i++)
+            {
+                Observation &obs = mvObs[i];
+                Eigen::Vector3d Xb, e;
+                double depth;
+                const double chi2 = Error(obs,T,Xb,e,depth);
+
+                obs.bInlier = chi2<=obs.th2 && (!obs.bCheckDepth || depth>0.0);
+                obs.pFrame->mvbOutlier[obs.idx] = !obs.bInlier;
+                if(!obs.bInlier)
+                    nBad++;
+            }
 
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+            if(mvObs.size()<10)
+                break;
+        }
 
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaMono);
+        return nBad;
+    }
 
-                    e->pCamera = pFrame->mpCamera;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
+private:
+    struct Pose
+    {
+        Pose(const g2o::SE3Quat &T) : R(T.rotation().toRotationMatrix()), t(T.translation()) {}
+        Eigen::Matrix3d R;
+        Eigen::Vector3d t;
+    };
 
-                    optimizer.addEdge(e);
+    struct Observation
+    {
+        Eigen::Vector3d Xw;
+        Eigen::Vector3d z;          // keypoint, and the right coordinate for stereo
+        double invSigma2;
+        double th2;                 // inlier chi2 threshold and squared Huber width
+        GeometricCamera* pCamera;   // NULL for a rectified stereo observation
+        int nTcb;
+        bool bCheckDepth;
+        bool bInlier;
+        Frame* pFrame;
+        size_t idx;
+    };
+
+    // Reprojection error and its chi2 at Tcw, Xb is the point in the camera of Tcw
+    double Error(const Observation &obs, const Pose &Tcw, Eigen::Vector3d &Xb, Eigen::Vector3d &e, double &depth) const
+    {
+        Xb = Tcw.R*obs.Xw + Tcw.t;
+        Eigen::Vector3d Xc = Xb;
+        if(obs.nTcb>=0)
+            Xc = mvTcb[obs.nTcb].R*Xb + mvTcb[obs.nTcb].t;
+        depth = Xc[2];
 
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-                else  // Stereo observation
-                {
-                    nInitialCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
+        if(obs.pCamera)
+        {
+            e.head<2>() = obs.z.head<2>() - obs.pCamera->project(Xc);
+            e[2] = 0.0;
+        }
+        else
+        {
+            const Frame* pF = obs.pFrame;
+            const double invz = 1.0/Xc[2];
+            const double u = pF->fx*Xc[0]*invz + pF->cx;
+            e << obs.z[0] - u, obs.z[1] - (pF->fy*Xc[1]*invz + pF->cy), obs.z[2] - (u - pF->mbf*invz);
+        }
+        return obs.invSigma2*e.squaredNorm();
+    }
 
-                    Eigen::Matrix<double,3,1> obs;
-                    const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-                    const float &kp_ur = pFrame->mvuRight[i];
-                    obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
+    // Jacobian of the error with respect to the left multiplied update of Tcw
+    void Jacobian(const Observation &obs, const Eigen::Vector3d &Xb, Eigen::Matrix<double,3,6> &J) const
+    {
+        Eigen::Matrix<double,3,6> SE3deriv;
+        SE3deriv << 0.0, Xb[2], -Xb[1], 1.0, 0.0, 0.0,
+                -Xb[2], 0.0, Xb[0], 0.0, 1.0, 0.0,
+                Xb[1], -Xb[0], 0.0, 0.0, 0.0, 1.0;
 
-                    g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+        Eigen::Matrix3d projJac;
+        if(obs.pCamera)
+        {
+            if(obs.nTcb>=0)
+            {
+                const Pose &Tcb = mvTcb[obs.nTcb];
+                projJac.topRows<2>() = obs.pCamera->projectJac(Tcb.R*Xb + Tcb.t) * Tcb.R;
+            }
+            else
+                projJac.topRows<2>() = obs.pCamera->projectJac(Xb);
+            projJac.row(2).setZero();
+        }
+        else
+        {
+            const Frame* pF = obs.pFrame;
+            const double invz = 1.0/Xb[2];
+            const double invz_2 = invz*invz;
+            projJac << pF->fx*invz, 0.0, -pF->fx*Xb[0]*invz_2,
+                    0.0, pF->fy*invz, -pF->fy*Xb[1]*invz_2,
+                    pF->fx*invz, 0.0, (pF->mbf - pF->fx*Xb[0])*invz_2;
+        }
+        J = -projJac*SE3deriv;
+    }
 
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    Eigen::Matrix3d Info = Eigen::Matrix3d::Identity()*invSigma2;
-                    e->setInformation(Info);
+    // rho(chi2) of the Huber kernel and its derivative, the weight of the information
+    static double Robustify(const double chi2, const double th2, const bool bRobust, double &w)
+    {
+        if(!bRobust || chi2<=th2)
+        {
+            w = 1.0;
+            return chi2;
+        }
+        const double sqrtChi2 = sqrt(chi2);
+        const double delta = sqrt(th2);
+        w = delta/sqrtChi2;
+        return 2*sqrtChi2*delta - th2;
+    }
 
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaStereo);
+    double RobustChi2(const g2o::SE3Quat &T, const bool bRobust) const
+    {
+        const Pose Tcw(T);
+        double chi2Sum = 0;
+        for(size_t i=0; i<mvObs.size(); i++)
+        {
+            if(!mvObs[i].bInlier)
+                continue;
+            Eigen::Vector3d Xb, e;
+            double depth, w;
+            chi2Sum += Robustify(Error(mvObs[i],Tcw,Xb,e,depth),mvObs[i].th2,bRobust,w);
+        }
+        return chi2Sum;
+    }
 
-                    e->fx = pFrame->fx;
-                    e->fy = pFrame->fy;
-                    e->cx = pFrame->cx;
-                    e->cy = pFrame->cy;
-                    e->bf = pFrame->mbf;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
+    // Normal equations H x = b at Tcw, returns the robust chi2. Returns -1 without inliers.
+    double BuildSystem(const g2o::SE3Quat &T, const bool bRobust, Matrix6d &H, Vector6d &b) const
+    {
+        const Pose Tcw(T);
+        H.setZero();
+        b.setZero();
+        double chi2Sum = 0;
+        int nInliers = 0;
+        for(size_t i=0; i<mvObs.size(); i++)
+        {
+            const Observation &obs = mvObs[i];
+            if(!obs.bInlier)
+                continue;
+            nInliers++;
 
-                    optimizer.addEdge(e);
+            Eigen::Vector3d Xb, e;
+            double depth, w;
+            chi2Sum += Robustify(Error(obs,Tcw,Xb,e,depth),obs.th2,bRobust,w);
 
-                    vpEdgesStereo.push_back(e);
-                    vnIndexEdgeStereo.push_back(i);
-                }
-            }
-            //SLAM with respect a rigid body
-            else{
-                nInitialCorrespondences++;
+            Eigen::Matrix<double,3,6> J;
+            Jacobian(obs,Xb,J);
+            const double wInfo = w*obs.invSigma2;
+            H.noalias() += wInfo * J.transpose()*J;
+            b.noalias() -= wInfo * J.transpose()*e;
+        }
+        return nInliers>0 ? chi2Sum : -1.0;
+    }
 
-                cv::KeyPoint kpUn;
+    // optimize(nIts) of g2o with OptimizationAlgorithmLevenberg and its default parameters
+    void Levenberg(g2o::SE3Quat &Tcw, const int nIts, const bool bRobust) const
+    {
+        double lambda = 0.0;
+        double ni = 2.0;
+        int nBad = 0;
+        for(int it=0; it<nIts; it++)
+        {
+            Matrix6d H;
+            Vector6d b;
+            const double iniChi = BuildSystem(Tcw,bRobust,H,b);
+            if(iniChi<0)
+                return;
+            double currentChi = iniChi;
 
-                if (i < pFrame->Nleft) {    //Left camera observation
-                    kpUn = pFrame->mvKeys[i];
+            if(it==0)
+            {
+                lambda = 1e-5*H.diagonal().cwiseAbs().maxCoeff();
+                ni = 2.0;
+                nBad = 0;
+            }
 
-                    pFrame->mvbOutlier[i] = false;
+            double rho = 0;
+            int q = 0;
+            do
+            {
+                Matrix6d Hl = H;
+                Hl.diagonal().array() += lambda;
+                const Eigen::LDLT<Matrix6d> ldlt(Hl);
+                const Vector6d x = ldlt.solve(b);
+                const g2o::SE3Quat Tnew = g2o::SE3Quat::exp(x)*Tcw;
 
-                    Eigen::Matrix<double, 2, 1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
+                const double tempChi = ldlt.isPositive() ? RobustChi2(Tnew,bRobust) : std::numeric_limits<double>::max();
+                rho = (currentChi-tempChi)/(x.dot(lambda*x + b) + 1e-3);
 
-                    ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose *e = new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose();
+                if(rho>0 && std::isfinite(tempChi))
+                {
+                    const double alpha = std::min(1.0-pow(2*rho-1,3), 2.0/3.0);
+                    lambda *= std::max(1.0/3.0, alpha);
+                    ni = 2.0;
+                    currentChi = tempChi;
+                    Tcw = Tnew;
+                }
+                else
+                {
+                    lambda *= ni;
+                    ni *= 2;
+                }
+                q++;
+            } while(rho<0 && q<10);
 
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
+            if(q==10 || rho==0)
+                return;
 
-                    g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaMono);
+            // Stop criterium (Raul)
+            if((iniChi-currentChi)*1e3<iniChi)
+                nBad++;
+            else
+                nBad=0;
+            if(nBad>=3)
+                return;
+        }
+    }
 
-                    e->pCamera = pFrame->mpCamera;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
+    std::vector<Observation> mvObs;
+    std::vector<Pose, Eigen::aligned_allocator<Pose> > mvTcb;
+};
 
-                    optimizer.addEdge(e);
+} // namespace
 
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-                else {
-                    kpUn = pFrame->mvKeysRight[i - pFrame->Nleft];
+int Optimizer::PoseOptimization(Frame *pFrame)
+{
+    TRACE_SCOPE("PoseOptimization");
+    static thread_local PoseOnlyOptimizer optimizer;
+    optimizer.Clear();
 
-                    Eigen::Matrix<double, 2, 1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
+    int nInitialCorrespondences=0;
 
-                    pFrame->mvbOutlier[i] = false;
+    Sophus::SE3<float> Tcw = pFrame->GetPose();
 
-                    ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody *e = new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody();
+    const int N = pFrame->N;
 
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
+    const float chi2Mono = 5.991;
+    const float chi2Stereo = 7.815;
 
-                    g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaMono);
+    int nTrl = -1;
+    if(pFrame->mpCamera2)
+        nTrl = optimizer.AddCameraPose(g2o::SE3Quat(pFrame->GetRelativePoseTrl().unit_quaternion().cast<double>(), pFrame->GetRelativePoseTrl().translation().cast<double>()));
 
-                    e->pCamera = pFrame->mpCamera2;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
+    {
+    unique_lock<ProfiledMutex> lock(MapPoint::mGlobalMutex);
 
-                    e->mTrl = g2o::SE3Quat(pFrame->GetRelativePoseTrl().unit_quaternion().cast<double>(), pFrame->GetRelativePoseTrl().translation().cast<double>());
+    for(int i=0; i<N; i++)
+    {
+        MapPoint* pMP = pFrame->mvpMapPoints[i];
+        if(pMP)
+        {
+            nInitialCorrespondences++;
+            pFrame->mvbOutlier[i] = false;
 
-                    optimizer.addEdge(e);
+            //Conventional SLAM
+            if(!pFrame->mpCamera2){
+                const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+                const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
 
-                    vpEdgesMono_FHR.push_back(e);
-                    vnIndexEdgeRight.push_back(i);
+                // Monocular observation
+                if(pFrame->mvuRight[i]<0)
+                    optimizer.AddMono(pMP->GetWorldPos().cast<double>(),kpUn,invSigma2,chi2Mono,pFrame->mpCamera,-1,false,pFrame,i);
+                else  // Stereo observation
+                    optimizer.AddStereo(pMP->GetWorldPos().cast<double>(),kpUn,pFrame->mvuRight[i],invSigma2,chi2Stereo,pFrame,i);
+            }
+            //SLAM with respect a rigid body
+            else{
+                if (i < pFrame->Nleft) {    //Left camera observation
+                    const cv::KeyPoint &kpUn = pFrame->mvKeys[i];
+                    optimizer.AddMono(pMP->GetWorldPos().cast<double>(),kpUn,pFrame->mvInvLevelSigma2[kpUn.octave],chi2Mono,
+                                      pFrame->mpCamera,-1,false,pFrame,i);
+                }
+                else {
+                    const cv::KeyPoint &kpUn = pFrame->mvKeysRight[i - pFrame->Nleft];
+                    optimizer.AddMono(pMP->GetWorldPos().cast<double>(),kpUn,pFrame->mvInvLevelSigma2[kpUn.octave],chi2Mono,
+                                      pFrame->mpCamera2,nTrl,false,pFrame,i);
                 }
             }
         }
@@ -996,125 +1445,93 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     if(nInitialCorrespondences<3)
         return 0;
 
-    // We perform 4 optimizations, after each optimization we classify observation as inlier/outlier
-    // At the next optimization, outliers are not included, but at the end they can be classified as inliers again.
-    const float chi2Mono[4]={5.991,5.991,5.991,5.991};
-    const float chi2Stereo[4]={7.815,7.815,7.815, 7.815};
-    const int its[4]={10,10,10,10};    
-
-    int nBad=0;
-    for(size_t it=0; it<4; it++)
-    {
-        Tcw = pFrame->GetPose();
-        vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>()));
+    g2o::SE3Quat SE3quat(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>());
+    const int nBad = optimizer.Optimize(SE3quat);
 
-        optimizer.initializeOptimization(0);
-        optimizer.optimize(its[it]);
+    // Recover optimized pose and return number of inliers
+    Sophus::SE3<float> pose(SE3quat.rotation().cast<float>(),
+            SE3quat.translation().cast<float>());
+    pFrame->SetPose(pose);
 
-        nBad=0;
-        for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
-        {
-            ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
+    return nInitialCorrespondences-nBad;
+}
 
-            const size_t idx = vnIndexEdgeMono[i];
+int Optimizer::PoseOptimizationMultiCamera(Frame *pFrame, const vector<Frame*> &vpRigFrames, const vector<Sophus::SE3f> &vTcr)
+{
+    TRACE_SCOPE("PoseOptimizationMultiCamera");
+    static thread_local PoseOnlyOptimizer optimizer;
+    optimizer.Clear();
 
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
+    int nInitialCorrespondences=0;
 
-            const float chi2 = e->chi2();
+    // Pose of pFrame's camera, the other rig cameras are observed through their fixed extrinsics
+    Sophus::SE3<float> Tcw = pFrame->GetPose();
 
-            if(chi2>chi2Mono[it])
-            {                
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBad++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-            }
+    const float chi2Mono = 5.991;
 
-            if(it==2)
-                e->setRobustKernel(0);
-        }
-
-        for(size_t i=0, iend=vpEdgesMono_FHR.size(); i<iend; i++)
-        {
-            ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody* e = vpEdgesMono_FHR[i];
+    {
+    unique_lock<ProfiledMutex> lock(MapPoint::mGlobalMutex);
 
-            const size_t idx = vnIndexEdgeRight[i];
+    for(int i=0; i<pFrame->N; i++)
+    {
+        MapPoint* pMP = pFrame->mvpMapPoints[i];
+        if(!pMP)
+            continue;
 
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
+        nInitialCorrespondences++;
+        pFrame->mvbOutlier[i] = false;
 
-            const float chi2 = e->chi2();
+        const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+        optimizer.AddMono(pMP->GetWorldPos().cast<double>(),kpUn,pFrame->mvInvLevelSigma2[kpUn.octave],chi2Mono,
+                          pFrame->mpCamera,-1,false,pFrame,i);
+    }
 
-            if(chi2>chi2Mono[it])
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBad++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-            }
+    for(size_t k=0; k<vpRigFrames.size(); k++)
+    {
+        Frame* pF = vpRigFrames[k];
+        if(!pF || !pF->mpCamera)
+            continue;
 
-            if(it==2)
-                e->setRobustKernel(0);
-        }
+        const int nTcr = optimizer.AddCameraPose(g2o::SE3Quat(vTcr[k].unit_quaternion().cast<double>(), vTcr[k].translation().cast<double>()));
 
-        for(size_t i=0, iend=vpEdgesStereo.size(); i<iend; i++)
+        for(int i=0; i<pF->N; i++)
         {
-            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = vpEdgesStereo[i];
-
-            const size_t idx = vnIndexEdgeStereo[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
+            MapPoint* pMP = pF->mvpMapPoints[i];
+            if(!pMP)
+                continue;
 
-            const float chi2 = e->chi2();
+            nInitialCorrespondences++;
+            pF->mvbOutlier[i] = false;
 
-            if(chi2>chi2Stereo[it])
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBad++;
-            }
-            else
-            {                
-                e->setLevel(0);
-                pFrame->mvbOutlier[idx]=false;
-            }
-
-            if(it==2)
-                e->setRobustKernel(0);
+            const cv::KeyPoint &kpUn = pF->mvKeysUn[i];
+            optimizer.AddMono(pMP->GetWorldPos().cast<double>(),kpUn,pF->mvInvLevelSigma2[kpUn.octave],chi2Mono,
+                              pF->mpCamera,nTcr,true,pF,i);
         }
+    }
+    }
 
-        if(optimizer.edges().size()<10)
-            break;
-    }    
+    if(nInitialCorrespondences<3)
+        return 0;
+
+    // Same 4 rounds of inlier/outlier classification as PoseOptimization, over all cameras at once
+    g2o::SE3Quat SE3quat(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>());
+    const int nBad = optimizer.Optimize(SE3quat);
 
     // Recover optimized pose and return number of inliers
-    g2o::VertexSE3Expmap* vSE3_recov = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(0));
-    g2o::SE3Quat SE3quat_recov = vSE3_recov->estimate();
-    Sophus::SE3<float> pose(SE3quat_recov.rotation().cast<float>(),
-            SE3quat_recov.translation().cast<float>());
+    Sophus::SE3<float> pose(SE3quat.rotation().cast<float>(),
+            SE3quat.translation().cast<float>());
     pFrame->SetPose(pose);
 
     return nInitialCorrespondences-nBad;
 }
 
-void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges)
+void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, int nMaxLocalKFs, int nThreads,
+                                      float fTimeBudget, float fGainThreshold)
 {
+    TRACE_SCOPE("LocalBundleAdjustment");
+    // The time budget includes building the graph
+    const std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+
     // Local KeyFrames: First Breath Search from Current Keyframe
     list<KeyFrame*> lLocalKeyFrames;
 
@@ -1122,9 +1539,12 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     pKF->mnBALocalForKF = pKF->mnId;
     Map* pCurrentMap = pKF->GetMap();
 
+    // Neighbours are sorted by covisibility weight, the ones beyond the limit become fixed keyframes
     const vector<KeyFrame*> vNeighKFs = pKF->GetVectorCovisibleKeyFrames();
     for(int i=0, iend=vNeighKFs.size(); i<iend; i++)
     {
+        if(nMaxLocalKFs>0 && (int)lLocalKeyFrames.size()>=nMaxLocalKFs)
+            break;
         KeyFrame* pKFi = vNeighKFs[i];
         pKFi->mnBALocalForKF = pKF->mnId;
         if(!pKFi->isBad() && pKFi->GetMap() == pCurrentMap)
@@ -1187,9 +1607,12 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
-    linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    // Consecutive local BAs often share the structure of the reduced camera system
+    static thread_local g2o::SymbolicFactorizationCache symbolicCache;
+    linearSolver = new g2o::LinearSolverCachedCholesky<g2o::BlockSolver_6_3::PoseMatrixType>(&symbolicCache);
 
     g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
@@ -1199,6 +1622,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 
     optimizer.setAlgorithm(solver);
     optimizer.setVerbose(false);
+    optimizer.setNumThreads(nThreads);
 
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
@@ -1408,7 +1832,23 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
             return;
 
     optimizer.initializeOptimization();
+    g2o::SparseOptimizerTerminateAction terminateAction;
+    const bool bTerminateAction = fTimeBudget>0 || fGainThreshold>0;
+    if(bTerminateAction)
+    {
+        terminateAction.setGainThreshold(fGainThreshold);
+        if(fTimeBudget>0)
+            terminateAction.setDeadline(tStart + std::chrono::microseconds(static_cast<long>(fTimeBudget*1000)));
+        terminateAction.reset();
+        optimizer.addPostIterationAction(&terminateAction);
+    }
     optimizer.optimize(10);
+    if(bTerminateAction)
+    {
+        optimizer.removePostIterationAction(&terminateAction);
+        if(terminateAction.terminated())
+            Verbose::PrintMess("LM-LBA: stopped early by convergence or time budget", Verbose::VERBOSITY_DEBUG);
+    }
 
     vector<pair<KeyFrame*,MapPoint*> > vToErase;
     vToErase.reserve(vpEdgesMono.size()+vpEdgesBody.size()+vpEdgesStereo.size());
@@ -1461,7 +1901,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 
 
     // Get Map Mutex
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
 
     if(!vToErase.empty())
     {
@@ -1498,14 +1938,47 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 }
 
 
+namespace
+{
+
+// World correction Scw_corr^-1*Scw of the current keyframe of a loop, false if it was not corrected
+bool GetLoopCorrection(KeyFrame* pLoopKF, KeyFrame* pCurKF, const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
+                       const LoopClosing::KeyFrameAndPose &CorrectedSim3, g2o::Sim3 &Sc)
+{
+    LoopClosing::KeyFrameAndPose::const_iterator itc = CorrectedSim3.find(pCurKF);
+    LoopClosing::KeyFrameAndPose::const_iterator itn = NonCorrectedSim3.find(pCurKF);
+    if(itc==CorrectedSim3.end() || itn==NonCorrectedSim3.end() || pLoopKF->mnId>=pCurKF->mnId)
+        return false;
+
+    Sc = itc->second.inverse() * itn->second;
+    return true;
+}
+
+// Share of the loop correction a keyframe starts the essential graph optimization with. The drift accumulates along
+// the keyframes of the loop, so the share grows linearly from the loop keyframe to the current one
+double LoopCorrectionShare(const unsigned long nId, const unsigned long nLoopId, const unsigned long nCurId)
+{
+    if(nId<=nLoopId)
+        return 0.0;
+    if(nId>=nCurId)
+        return 1.0;
+    return static_cast<double>(nId-nLoopId)/static_cast<double>(nCurId-nLoopId);
+}
+
+} // namespace
+
 void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, const bool &bFixScale)
+                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, const bool &bFixScale,
+                                       LoopClosing::KeyFrameAndPose* pLoopCorrections, int nThreads)
 {   
+    TRACE_SCOPE("OptimizeEssentialGraph");
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     optimizer.setVerbose(false);
+    optimizer.setNumThreads(nThreads);
     g2o::BlockSolver_7_3::LinearSolverType * linearSolver =
            new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
     g2o::BlockSolver_7_3 * solver_ptr= new g2o::BlockSolver_7_3(linearSolver);
@@ -1514,8 +1987,10 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
     solver->setUserLambdaInit(1e-16);
     optimizer.setAlgorithm(solver);
 
-    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
-    const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
+    const Map::MapPointSnapshot pMapPoints = pMap->GetMapPointsSnapshot();
+    const vector<MapPoint*> &vpMPs = *pMapPoints;
 
     const unsigned int nMaxKFid = pMap->GetMaxKFid();
 
@@ -1529,6 +2004,11 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
     const int minFeat = 100;
 
+    // Warm start from the loop correction, the edges keep the uncorrected poses
+    g2o::Sim3 Sc;
+    const bool bWarmStart = GetLoopCorrection(pLoopKF,pCurKF,NonCorrectedSim3,CorrectedSim3,Sc);
+    const g2o::Vector7d logSc = Sc.log();
+
     // Set KeyFrame vertices
     for(size_t i=0, iend=vpKFs.size(); i<iend;i++)
     {
@@ -1551,7 +2031,12 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
             Sophus::SE3d Tcw = pKF->GetPose().cast<double>();
             g2o::Sim3 Siw(Tcw.unit_quaternion(),Tcw.translation(),1.0);
             vScw[nIDi] = Siw;
-            VSim3->setEstimate(Siw);
+
+            const double share = bWarmStart ? LoopCorrectionShare(pKF->mnId,pLoopKF->mnId,pCurKF->mnId) : 0.0;
+            if(share>0.0 && pKF->mnId!=pMap->GetInitKFid())
+                VSim3->setEstimate(Siw * g2o::Sim3(share*logSc).inverse());
+            else
+                VSim3->setEstimate(Siw);
         }
 
         if(pKF->mnId==pMap->GetInitKFid())
@@ -1622,8 +2107,9 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
         KeyFrame* pParentKF = pKF->GetParent();
 
-        // Spanning tree edge
-        if(pParentKF)
+        // Spanning tree edge. Local Mapping may keep running while the graph is built, so the parent
+        // could be a keyframe inserted after the snapshot
+        if(pParentKF && pParentKF->mnId<=nMaxKFid && vpVertices[pParentKF->mnId])
         {
             int nIDj = pParentKF->mnId;
 
@@ -1728,9 +2214,30 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
     optimizer.initializeOptimization();
     optimizer.computeActiveErrors();
+    // From the warm start the graph usually converges well before the 20 iterations
+    g2o::SparseOptimizerTerminateAction terminateAction;
+    terminateAction.setGainThreshold(1e-6);
+    terminateAction.reset();
+    optimizer.addPostIterationAction(&terminateAction);
     optimizer.optimize(20);
+    optimizer.removePostIterationAction(&terminateAction);
     optimizer.computeActiveErrors();
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+
+    if(pLoopCorrections)
+    {
+        for(size_t i=0;i<vpKFs.size();i++)
+        {
+            const int nIDi = vpKFs[i]->mnId;
+            if(!vpVertices[nIDi])
+                continue;
+
+            g2o::Sim3 CorrectedSiw = vpVertices[nIDi]->estimate();
+            (*pLoopCorrections)[vpKFs[i]] = CorrectedSiw.inverse() * vScw[nIDi];
+        }
+        return;
+    }
+
+    unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
     for(size_t i=0;i<vpKFs.size();i++)
@@ -1785,12 +2292,14 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 void Optimizer::OptimizeEssentialGraph(KeyFrame* pCurKF, vector<KeyFrame*> &vpFixedKFs, vector<KeyFrame*> &vpFixedCorrectedKFs,
                                        vector<KeyFrame*> &vpNonFixedKFs, vector<MapPoint*> &vpNonCorrectedMPs)
 {
+    TRACE_SCOPE("OptimizeEssentialGraph");
     Verbose::PrintMess("Opt_Essential: There are " + to_string(vpFixedKFs.size()) + " KFs fixed in the merged map", Verbose::VERBOSITY_DEBUG);
     Verbose::PrintMess("Opt_Essential: There are " + to_string(vpFixedCorrectedKFs.size()) + " KFs fixed in the old map", Verbose::VERBOSITY_DEBUG);
     Verbose::PrintMess("Opt_Essential: There are " + to_string(vpNonFixedKFs.size()) + " KFs non-fixed in the merged map", Verbose::VERBOSITY_DEBUG);
     Verbose::PrintMess("Opt_Essential: There are " + to_string(vpNonCorrectedMPs.size()) + " MPs non-corrected in the merged map", Verbose::VERBOSITY_DEBUG);
 
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     optimizer.setVerbose(false);
     g2o::BlockSolver_7_3::LinearSolverType * linearSolver =
            new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
@@ -2054,7 +2563,7 @@ void Optimizer::OptimizeEssentialGraph(KeyFrame* pCurKF, vector<KeyFrame*> &vpFi
     optimizer.initializeOptimization();
     optimizer.optimize(20);
 
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
     for(KeyFrame* pKFi : vpNonFixedKFs)
@@ -2115,7 +2624,9 @@ void Optimizer::OptimizeEssentialGraph(KeyFrame* pCurKF, vector<KeyFrame*> &vpFi
 int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches1, g2o::Sim3 &g2oS12, const float th2,
                             const bool bFixScale, Eigen::Matrix<double,7,7> &mAcumHessian, const bool bAllPoints)
 {
+    TRACE_SCOPE("OptimizeSim3");
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
@@ -2380,8 +2891,13 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
     return nIn;
 }
 
-void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge, bool bRecInit)
+void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge, bool bRecInit, int nThreads,
+                                float fTimeBudget, float fGainThreshold)
 {
+    TRACE_SCOPE("LocalInertialBA");
+    // The time budget includes building the graph
+    const std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+
     Map* pCurrentMap = pKF->GetMap();
 
     int maxOpt=10;
@@ -2505,8 +3021,10 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
 
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
-    linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
+    static thread_local g2o::SymbolicFactorizationCache symbolicCache;
+    linearSolver = new g2o::LinearSolverCachedCholesky<g2o::BlockSolverX::PoseMatrixType>(&symbolicCache);
 
     g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
 
@@ -2522,7 +3040,7 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
         solver->setUserLambdaInit(1e0);
         optimizer.setAlgorithm(solver);
     }
-
+    optimizer.setNumThreads(nThreads);
 
     // Set Local temporal KeyFrame vertices
     N=vpOptimizableKFs.size();
@@ -2840,7 +3358,19 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
     optimizer.initializeOptimization();
     optimizer.computeActiveErrors();
     float err = optimizer.activeRobustChi2();
+    g2o::SparseOptimizerTerminateAction terminateAction;
+    const bool bTerminateAction = fTimeBudget>0 || fGainThreshold>0;
+    if(bTerminateAction)
+    {
+        terminateAction.setGainThreshold(fGainThreshold);
+        if(fTimeBudget>0)
+            terminateAction.setDeadline(tStart + std::chrono::microseconds(static_cast<long>(fTimeBudget*1000)));
+        terminateAction.reset();
+        optimizer.addPostIterationAction(&terminateAction);
+    }
     optimizer.optimize(opt_it); // Originally to 2
+    if(bTerminateAction)
+        optimizer.removePostIterationAction(&terminateAction);
     float err_end = optimizer.activeRobustChi2();
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
@@ -2884,7 +3414,7 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
     }
 
     // Get Map Mutex and erase outliers
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
 
 
     // TODO: Some convergence problems have been detected here
@@ -2957,6 +3487,53 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
     pMap->IncreaseChangeIndex();
 }
 
+namespace
+{
+
+// Pseudo-inverse dropping the singular values below 1e-6
+template<int B>
+Eigen::Matrix<double,B,B> PseudoInverse(const Eigen::Matrix<double,B,B> &Hb)
+{
+    Eigen::JacobiSVD<Eigen::Matrix<double,B,B> > svd(Hb,Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Matrix<double,B,1> singularValues_inv=svd.singularValues();
+    for (int i=0; i<singularValues_inv.size(); ++i)
+    {
+        if (singularValues_inv(i)>1e-6)
+            singularValues_inv(i)=1.0/singularValues_inv(i);
+        else singularValues_inv(i)=0;
+    }
+    return svd.matrixV()*singularValues_inv.asDiagonal()*svd.matrixU().transpose();
+}
+
+// Subtracts from res the Schur complement term Hkb*Hb^-1*Hbk of the marginalized block (start, size b)
+// over the kept indices vCoupled, the only ones with a non-zero coupling to it
+template<int B>
+void SubtractSchurTerm(const Eigen::MatrixXd &H, const int start, const int b, const std::vector<int> &vCoupled, Eigen::MatrixXd &res)
+{
+    typedef Eigen::Matrix<double,B,B> MatrixB;
+    const int k = vCoupled.size();
+
+    const MatrixB Hb = H.block(start,start,b,b);
+    Eigen::Matrix<double,Eigen::Dynamic,B> Hkb(k,b);
+    for(int i=0; i<k; i++)
+        Hkb.row(i) = H.block(vCoupled[i],start,1,b);
+
+    // LDLT while the block is clearly positive definite, the pseudo-inverse of the SVD otherwise
+    Eigen::Matrix<double,B,Eigen::Dynamic> X;
+    const Eigen::LDLT<MatrixB> ldlt(Hb);
+    if(ldlt.info()==Eigen::Success && ldlt.isPositive() && ldlt.vectorD().minCoeff()>1e-6)
+        X = ldlt.solve(Hkb.transpose());
+    else
+        X = PseudoInverse<B>(Hb)*Hkb.transpose();
+
+    const Eigen::MatrixXd S = Hkb*X;
+    for(int j=0; j<k; j++)
+        for(int i=0; i<k; i++)
+            res(vCoupled[i],vCoupled[j]) -= S(i,j);
+}
+
+} // namespace
+
 Eigen::MatrixXd Optimizer::Marginalize(const Eigen::MatrixXd &H, const int &start, const int &end)
 {
     // Goal
@@ -2964,90 +3541,54 @@ Eigen::MatrixXd Optimizer::Marginalize(const Eigen::MatrixXd &H, const int &star
     // ba | b  | bc  -->  0   | 0 | 0
     // ca | cb | c        ca* | 0 | c*
 
-    // Size of block before block to marginalize
-    const int a = start;
     // Size of block to marginalize
     const int b = end-start+1;
-    // Size of block after block to marginalize
-    const int c = H.cols() - (end+1);
 
-    // Reorder as follows:
-    // a  | ab | ac       a  | ac | ab
-    // ba | b  | bc  -->  ca | c  | cb
-    // ca | cb | c        ba | bc | b
-
-    Eigen::MatrixXd Hn = Eigen::MatrixXd::Zero(H.rows(),H.cols());
-    if(a>0)
-    {
-        Hn.block(0,0,a,a) = H.block(0,0,a,a);
-        Hn.block(0,a+c,a,b) = H.block(0,a,a,b);
-        Hn.block(a+c,0,b,a) = H.block(a,0,b,a);
-    }
-    if(a>0 && c>0)
+    // Only the kept states coupled to the marginalized block change, in a banded inertial window
+    // its neighbors, so the Schur complement is formed over them alone and in place
+    std::vector<int> vCoupled;
+    vCoupled.reserve(H.rows()-b);
+    for(int i=0; i<H.rows(); i++)
     {
-        Hn.block(0,a,a,c) = H.block(0,a+b,a,c);
-        Hn.block(a,0,c,a) = H.block(a+b,0,c,a);
-    }
-    if(c>0)
-    {
-        Hn.block(a,a,c,c) = H.block(a+b,a+b,c,c);
-        Hn.block(a,a+c,c,b) = H.block(a+b,a,c,b);
-        Hn.block(a+c,a,b,c) = H.block(a,a+b,b,c);
-    }
-    Hn.block(a+c,a+c,b,b) = H.block(a,a,b,b);
-
-    // Perform marginalization (Schur complement)
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(Hn.block(a+c,a+c,b,b),Eigen::ComputeThinU | Eigen::ComputeThinV);
-    Eigen::JacobiSVD<Eigen::MatrixXd>::SingularValuesType singularValues_inv=svd.singularValues();
-    for (int i=0; i<b; ++i)
-    {
-        if (singularValues_inv(i)>1e-6)
-            singularValues_inv(i)=1.0/singularValues_inv(i);
-        else singularValues_inv(i)=0;
+        if(i>=start && i<=end)
+            continue;
+        if(!H.block(i,start,1,b).isZero(0))
+            vCoupled.push_back(i);
     }
-    Eigen::MatrixXd invHb = svd.matrixV()*singularValues_inv.asDiagonal()*svd.matrixU().transpose();
-    Hn.block(0,0,a+c,a+c) = Hn.block(0,0,a+c,a+c) - Hn.block(0,a+c,a+c,b)*invHb*Hn.block(a+c,0,b,a+c);
-    Hn.block(a+c,a+c,b,b) = Eigen::MatrixXd::Zero(b,b);
-    Hn.block(0,a+c,a+c,b) = Eigen::MatrixXd::Zero(a+c,b);
-    Hn.block(a+c,0,b,a+c) = Eigen::MatrixXd::Zero(b,a+c);
 
-    // Inverse reorder
-    // a*  | ac* | 0       a*  | 0 | ac*
-    // ca* | c*  | 0  -->  0   | 0 | 0
-    // 0   | 0   | 0       ca* | 0 | c*
-    Eigen::MatrixXd res = Eigen::MatrixXd::Zero(H.rows(),H.cols());
-    if(a>0)
-    {
-        res.block(0,0,a,a) = Hn.block(0,0,a,a);
-        res.block(0,a,a,b) = Hn.block(0,a+c,a,b);
-        res.block(a,0,b,a) = Hn.block(a+c,0,b,a);
-    }
-    if(a>0 && c>0)
+    Eigen::MatrixXd res = H;
+    if(!vCoupled.empty())
     {
-        res.block(0,a+b,a,c) = Hn.block(0,a,a,c);
-        res.block(a+b,0,c,a) = Hn.block(a,0,c,a);
-    }
-    if(c>0)
-    {
-        res.block(a+b,a+b,c,c) = Hn.block(a,a,c,c);
-        res.block(a+b,a,c,b) = Hn.block(a,a+c,c,b);
-        res.block(a,a+b,b,c) = Hn.block(a+c,a,b,c);
+        // The inertial state of a frame (pose, velocity and biases) in fixed-size matrices
+        if(b==15)
+            SubtractSchurTerm<15>(H,start,b,vCoupled,res);
+        else if(b==9)
+            SubtractSchurTerm<9>(H,start,b,vCoupled,res);
+        else if(b==6)
+            SubtractSchurTerm<6>(H,start,b,vCoupled,res);
+        else
+            SubtractSchurTerm<Eigen::Dynamic>(H,start,b,vCoupled,res);
     }
 
-    res.block(a,a,b,b) = Hn.block(a+c,a+c,b,b);
+    // Marginalized elements are filled with zeros
+    res.middleRows(start,b).setZero();
+    res.middleCols(start,b).setZero();
 
     return res;
 }
 
 void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &scale, Eigen::Vector3d &bg, Eigen::Vector3d &ba, bool bMono, Eigen::MatrixXd  &covInertial, bool bFixedVel, bool bGauss, float priorG, float priorA)
 {
+    TRACE_SCOPE("InertialOptimization");
     Verbose::PrintMess("inertial optimization", Verbose::VERBOSITY_NORMAL);
     int its = 200;
     long unsigned int maxKFid = pMap->GetMaxKFid();
-    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
 
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
@@ -3226,12 +3767,15 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &sc
 
 void Optimizer::InertialOptimization(Map *pMap, Eigen::Vector3d &bg, Eigen::Vector3d &ba, float priorG, float priorA)
 {
+    TRACE_SCOPE("InertialOptimization");
     int its = 200; // Check number of iterations
     long unsigned int maxKFid = pMap->GetMaxKFid();
-    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
 
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
@@ -3388,12 +3932,15 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Vector3d &bg, Eigen::Vect
 
 void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &scale)
 {
+    TRACE_SCOPE("InertialOptimization");
     int its = 10;
     long unsigned int maxKFid = pMap->GetMaxKFid();
-    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
 
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
@@ -3497,11 +4044,13 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &sc
 
 void Optimizer::LocalBundleAdjustment(KeyFrame* pMainKF,vector<KeyFrame*> vpAdjustKF, vector<KeyFrame*> vpFixedKF, bool *pbStopFlag)
 {
+    TRACE_SCOPE("LocalBundleAdjustment");
     bool bShowImages = false;
 
     vector<MapPoint*> vpMPs;
 
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
@@ -3822,7 +4371,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame* pMainKF,vector<KeyFrame*> vpAdju
     Verbose::PrintMess("[BA]: Second optimization, there are " + to_string(badMonoMP) + " monocular and " + to_string(badStereoMP) + " sterero bad edges", Verbose::VERBOSITY_DEBUG);
 
     // Get Map Mutex
-    unique_lock<mutex> lock(pMainKF->GetMap()->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(pMainKF->GetMap()->mMutexMapUpdate);
 
     if(!vToErase.empty())
     {
@@ -3947,6 +4496,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame* pMainKF,vector<KeyFrame*> vpAdju
 
 void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbStopFlag, Map *pMap, LoopClosing::KeyFrameAndPose &corrPoses)
 {
+    TRACE_SCOPE("MergeInertialBA");
     const int Nd = 6;
     const unsigned long maxKFid = pCurrKF->mnId;
 
@@ -4088,6 +4638,7 @@ void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbS
     }
 
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
     linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
 
@@ -4413,7 +4964,7 @@ void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbS
     }
 
     // Get Map Mutex and erase outliers
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
     if(!vToErase.empty())
     {
         for(size_t i=0;i<vToErase.size();i++)
@@ -4490,7 +5041,9 @@ void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbS
 
 int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame, bool bRecInit)
 {
+    TRACE_SCOPE("PoseInertialOptimizationLastKeyFrame");
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
@@ -4541,7 +5094,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame, bool bRecInit
     const float thHuberStereo = sqrt(7.815);
 
     {
-        unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+        unique_lock<ProfiledMutex> lock(MapPoint::mGlobalMutex);
 
         for(int i=0; i<N; i++)
         {
@@ -4874,7 +5427,9 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame, bool bRecInit
 
 int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit)
 {
+    TRACE_SCOPE("PoseInertialOptimizationLastFrame");
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
     linearSolver = new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
@@ -4925,7 +5480,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit)
     const float thHuberStereo = sqrt(7.815);
 
     {
-        unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+        unique_lock<ProfiledMutex> lock(MapPoint::mGlobalMutex);
 
         for(int i=0; i<N; i++)
         {
@@ -5292,13 +5847,17 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit)
 void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections)
+                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
+                                       LoopClosing::KeyFrameAndPose* pLoopCorrections, int nThreads)
 {
+    TRACE_SCOPE("OptimizeEssentialGraph4DoF");
     typedef g2o::BlockSolver< g2o::BlockSolverTraits<4, 4> > BlockSolver_4_4;
 
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
+    TRACE_ITERATIONS(optimizer);
     optimizer.setVerbose(false);
+    optimizer.setNumThreads(nThreads);
     g2o::BlockSolverX::LinearSolverType * linearSolver =
             new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
     g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
@@ -5307,8 +5866,10 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFram
 
     optimizer.setAlgorithm(solver);
 
-    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
-    const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const vector<KeyFrame*> &vpKFs = *pKeyFrames;
+    const Map::MapPointSnapshot pMapPoints = pMap->GetMapPointsSnapshot();
+    const vector<MapPoint*> &vpMPs = *pMapPoints;
 
     const unsigned int nMaxKFid = pMap->GetMaxKFid();
 
@@ -5318,6 +5879,14 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFram
     vector<VertexPose4DoF*> vpVertices(nMaxKFid+1);
 
     const int minFeat = 100;
+
+    // Warm start from the yaw and translation of the loop correction, roll and pitch are observable with the IMU
+    // and the vertices do not update them
+    g2o::Sim3 Sc;
+    const bool bWarmStart = GetLoopCorrection(pLoopKF,pCurKF,NonCorrectedSim3,CorrectedSim3,Sc);
+    const Eigen::Matrix3d Rc = Sc.rotation().toRotationMatrix();
+    const double yawc = atan2(Rc(1,0),Rc(0,0));
+
     // Set KeyFrame vertices
     for(size_t i=0, iend=vpKFs.size(); i<iend;i++)
     {
@@ -5345,7 +5914,18 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFram
             g2o::Sim3 Siw(Tcw.unit_quaternion(),Tcw.translation(),1.0);
 
             vScw[nIDi] = Siw;
-            V4DoF = new VertexPose4DoF(pKF);
+
+            const double share = bWarmStart && pKF!=pLoopKF ? LoopCorrectionShare(pKF->mnId,pLoopKF->mnId,pCurKF->mnId) : 0.0;
+            if(share>0.0)
+            {
+                const g2o::Sim3 Sci(Eigen::AngleAxisd(share*yawc,Eigen::Vector3d::UnitZ()).toRotationMatrix(),share*Sc.translation(),1.0);
+                const g2o::Sim3 Swc = Sci * Siw.inverse();
+                Eigen::Matrix3d Rwc = Swc.rotation().toRotationMatrix();
+                Eigen::Vector3d twc = Swc.translation();
+                V4DoF = new VertexPose4DoF(Rwc, twc, pKF);
+            }
+            else
+                V4DoF = new VertexPose4DoF(pKF);
         }
 
         if(pKF==pLoopKF)
@@ -5540,9 +6120,28 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFram
 
     optimizer.initializeOptimization();
     optimizer.computeActiveErrors();
+    g2o::SparseOptimizerTerminateAction terminateAction;
+    terminateAction.setGainThreshold(1e-6);
+    terminateAction.reset();
+    optimizer.addPostIterationAction(&terminateAction);
     optimizer.optimize(20);
+    optimizer.removePostIterationAction(&terminateAction);
+
+    if(pLoopCorrections)
+    {
+        for(size_t i=0;i<vpKFs.size();i++)
+        {
+            const int nIDi = vpKFs[i]->mnId;
+            if(!vpVertices[nIDi])
+                continue;
+
+            g2o::Sim3 CorrectedSiw = g2o::Sim3(vpVertices[nIDi]->estimate().Rcw[0],vpVertices[nIDi]->estimate().tcw[0],1.);
+            (*pLoopCorrections)[vpKFs[i]] = CorrectedSiw.inverse() * vScw[nIDi];
+        }
+        return;
+    }
 
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
     for(size_t i=0;i<vpKFs.size();i++)
@@ -0,0 +1,456 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PmuCounters.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+std::atomic<bool> PmuCounters::sbEnabled(false);
+
+namespace
+{
+
+enum Event
+{
+    CYCLES = 0,
+    INSTRUCTIONS,
+    L2_ACCESSES,
+    L2_REFILLS,
+    L3_ACCESSES,
+    L3_REFILLS,
+    BRANCH_MISSES,
+    NUM_EVENTS
+};
+
+// Core PMUs of a thread (two on the RK3588) and depth of the nested spans it counts
+const int kMaxPmus = 4;
+const int kMaxDepth = 32;
+
+struct Accumulator
+{
+    uint64_t vSpans[kMaxPmus];
+    uint64_t vRunningNs[kMaxPmus];
+    uint64_t vValues[kMaxPmus][NUM_EVENTS];
+
+    Accumulator()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    Accumulator& operator+=(const Accumulator &other)
+    {
+        for(int i=0; i<kMaxPmus; i++)
+        {
+            vSpans[i] += other.vSpans[i];
+            vRunningNs[i] += other.vRunningNs[i];
+            for(int e=0; e<NUM_EVENTS; e++)
+                vValues[i][e] += other.vValues[i][e];
+        }
+        return *this;
+    }
+};
+
+struct Sample
+{
+    uint64_t vRunningNs[kMaxPmus];
+    uint64_t vValues[kMaxPmus][NUM_EVENTS];
+};
+
+struct Pmu
+{
+    string name;
+    uint32_t nType;
+    bool bArm;      // Raw ARMv8 PMUv3 events, else the generic hardware events
+};
+
+#ifdef __linux__
+
+const uint64_t kNoEvent = ~0ull;
+
+// ARMv8 PMUv3 common events: CPU_CYCLES, INST_RETIRED, L2D_CACHE, L2D_CACHE_REFILL, L3D_CACHE,
+// L3D_CACHE_REFILL, BR_MIS_PRED
+const uint64_t kArmEvents[NUM_EVENTS] = {0x11, 0x08, 0x16, 0x17, 0x2B, 0x2A, 0x10};
+const uint64_t kGenericEvents[NUM_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, kNoEvent, kNoEvent,
+                                             PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+                                             PERF_COUNT_HW_BRANCH_MISSES};
+
+// The core PMUs in sysfs (armv8_cortex_a55, armv8_cortex_a76), a generic one without them
+const vector<Pmu> &GetPmus()
+{
+    static const vector<Pmu> vPmus = []()
+    {
+        vector<Pmu> vFound;
+        const string strDevices = "/sys/bus/event_source/devices/";
+        DIR* pDir = opendir(strDevices.c_str());
+        while(pDir)
+        {
+            dirent* pEntry = readdir(pDir);
+            if(!pEntry)
+                break;
+            const string strName = pEntry->d_name;
+            if(strName.compare(0, 5, "armv8") != 0 && strName.compare(0, 5, "armv9") != 0)
+                continue;
+            ifstream fCpus(strDevices + strName + "/cpus");
+            ifstream fType(strDevices + strName + "/type");
+            Pmu pmu;
+            if(!fCpus || !(fType >> pmu.nType))
+                continue;
+            const size_t nSeparator = strName.find('_');
+            pmu.name = nSeparator == string::npos ? strName : strName.substr(nSeparator + 1);
+            pmu.bArm = true;
+            vFound.push_back(pmu);
+        }
+        if(pDir)
+            closedir(pDir);
+
+        sort(vFound.begin(), vFound.end(), [](const Pmu &a, const Pmu &b) { return a.name < b.name; });
+        if(vFound.size() > (size_t)kMaxPmus)
+            vFound.resize(kMaxPmus);
+        if(vFound.empty())
+        {
+            Pmu pmu;
+            pmu.name = "cpu";
+            pmu.nType = PERF_TYPE_HARDWARE;
+            pmu.bArm = false;
+            vFound.push_back(pmu);
+        }
+        return vFound;
+    }();
+    return vPmus;
+}
+
+#endif
+
+// Counter groups of a thread and the spans it counted. The counts are only written by the thread,
+// under mMutex so the statistics can be read meanwhile.
+struct ThreadCounters
+{
+    int nPmus;
+    int vLeaderFds[kMaxPmus];
+    int vnGroupSizes[kMaxPmus];
+    int vSlots[kMaxPmus][NUM_EVENTS];   // Position in the group read, -1 if the PMU lacks the event
+    vector<int> vFds;
+
+    Sample vStack[kMaxDepth];
+    int nDepth;
+
+    mutex mMutex;
+    unordered_map<const char*, Accumulator> mAccumulators;
+
+    ThreadCounters(): nPmus(0), nDepth(0)
+    {
+        for(int i=0; i<kMaxPmus; i++)
+        {
+            vLeaderFds[i] = -1;
+            vnGroupSizes[i] = 0;
+            for(int e=0; e<NUM_EVENTS; e++)
+                vSlots[i][e] = -1;
+        }
+    }
+
+    bool Open()
+    {
+#ifdef __linux__
+        const vector<Pmu> &vPmus = GetPmus();
+        for(size_t i=0; i<vPmus.size(); i++)
+        {
+            const int p = nPmus;
+            for(int e=0; e<NUM_EVENTS; e++)
+            {
+                const uint64_t nConfig = vPmus[i].bArm ? kArmEvents[e] : kGenericEvents[e];
+                if(nConfig == kNoEvent)
+                    continue;
+
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = vPmus[i].nType;
+                attr.config = nConfig;
+                attr.disabled = vLeaderFds[p] < 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                // This thread only, on any CPU of the PMU
+                const int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, vLeaderFds[p], PERF_FLAG_FD_CLOEXEC);
+                if(fd < 0)
+                {
+                    // Without cycles there is no group on this PMU, other events may be missing
+                    if(e == CYCLES)
+                        break;
+                    continue;
+                }
+                vFds.push_back(fd);
+                if(vLeaderFds[p] < 0)
+                    vLeaderFds[p] = fd;
+                vSlots[p][e] = vnGroupSizes[p]++;
+            }
+            if(vLeaderFds[p] < 0)
+                continue;
+
+            ioctl(vLeaderFds[p], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(vLeaderFds[p], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            nPmus++;
+        }
+#endif
+        return nPmus > 0;
+    }
+
+    void Read(Sample &sample)
+    {
+        memset(&sample, 0, sizeof(sample));
+#ifdef __linux__
+        for(int p=0; p<nPmus; p++)
+        {
+            // nr, time_running, then the values in the order the events were opened
+            uint64_t vBuffer[2 + NUM_EVENTS];
+            if(vLeaderFds[p] < 0 || read(vLeaderFds[p], vBuffer, sizeof(vBuffer)) < (ssize_t)(2*sizeof(uint64_t)))
+                continue;
+            sample.vRunningNs[p] = vBuffer[1];
+            for(int e=0; e<NUM_EVENTS; e++)
+            {
+                if(vSlots[p][e] >= 0 && (uint64_t)vSlots[p][e] < vBuffer[0])
+                    sample.vValues[p][e] = vBuffer[2 + vSlots[p][e]];
+            }
+        }
+#endif
+    }
+
+    void Close()
+    {
+        unique_lock<mutex> lock(mMutex);
+#ifdef __linux__
+        for(size_t i=0; i<vFds.size(); i++)
+            close(vFds[i]);
+#endif
+        vFds.clear();
+        for(int p=0; p<kMaxPmus; p++)
+            vLeaderFds[p] = -1;
+    }
+};
+
+struct Registry
+{
+    mutex mMutex;
+    vector<ThreadCounters*> vpThreads;
+};
+
+// Never destroyed, the counts of a thread outlive it
+Registry &GetRegistry()
+{
+    static Registry* pRegistry = new Registry();
+    return *pRegistry;
+}
+
+// Counters of the calling thread, its groups closed when it exits
+struct ThreadHandle
+{
+    ThreadCounters* pCounters = nullptr;
+    bool bOpened = false;
+
+    ~ThreadHandle()
+    {
+        if(pCounters)
+            pCounters->Close();
+    }
+};
+
+thread_local ThreadHandle tHandle;
+
+ThreadCounters* GetThreadCounters()
+{
+    if(!tHandle.bOpened)
+    {
+        tHandle.bOpened = true;
+        ThreadCounters* pCounters = new ThreadCounters();
+        if(!pCounters->Open())
+        {
+            delete pCounters;
+            return nullptr;
+        }
+        Registry &registry = GetRegistry();
+        unique_lock<mutex> lock(registry.mMutex);
+        registry.vpThreads.push_back(pCounters);
+        tHandle.pCounters = pCounters;
+    }
+    return tHandle.pCounters;
+}
+
+} // namespace
+
+bool PmuCounters::Start()
+{
+    if(!GetThreadCounters())
+        return false;
+    sbEnabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void PmuCounters::Stop()
+{
+    // The groups stay open, counting costs nothing while no span reads them
+    sbEnabled.store(false, std::memory_order_relaxed);
+}
+
+void PmuCounters::BeginSpan()
+{
+    ThreadCounters* pCounters = GetThreadCounters();
+    if(!pCounters)
+        return;
+    if(pCounters->nDepth < kMaxDepth)
+        pCounters->Read(pCounters->vStack[pCounters->nDepth]);
+    pCounters->nDepth++;
+}
+
+void PmuCounters::EndSpan(const char* name)
+{
+    ThreadCounters* pCounters = tHandle.pCounters;
+    if(!pCounters || pCounters->nDepth == 0)
+        return;
+    const int nDepth = --pCounters->nDepth;
+    if(nDepth >= kMaxDepth)
+        return;
+
+    Sample end;
+    pCounters->Read(end);
+    const Sample &begin = pCounters->vStack[nDepth];
+
+    unique_lock<mutex> lock(pCounters->mMutex);
+    Accumulator &accumulator = pCounters->mAccumulators[name];
+    for(int p=0; p<pCounters->nPmus; p++)
+    {
+        const uint64_t nRunning = end.vRunningNs[p] - begin.vRunningNs[p];
+        if(nRunning == 0)
+            continue;
+        accumulator.vSpans[p]++;
+        accumulator.vRunningNs[p] += nRunning;
+        for(int e=0; e<NUM_EVENTS; e++)
+            accumulator.vValues[p][e] += end.vValues[p][e] - begin.vValues[p][e];
+    }
+}
+
+vector<StageCounters> PmuCounters::GetStatistics()
+{
+    // The same literal may have a different address in every translation unit
+    map<string, Accumulator> mTotals;
+    int nPmus = 0;
+    {
+        Registry &registry = GetRegistry();
+        unique_lock<mutex> lock(registry.mMutex);
+        for(ThreadCounters* pCounters : registry.vpThreads)
+        {
+            unique_lock<mutex> lockThread(pCounters->mMutex);
+            nPmus = max(nPmus, pCounters->nPmus);
+            for(const pair<const char* const, Accumulator> &entry : pCounters->mAccumulators)
+                mTotals[entry.first] += entry.second;
+        }
+    }
+
+    vector<StageCounters> vStats;
+#ifdef __linux__
+    const vector<Pmu> &vPmus = GetPmus();
+    for(const pair<const string, Accumulator> &entry : mTotals)
+    {
+        const Accumulator &total = entry.second;
+        for(int p=0; p<nPmus && p<(int)vPmus.size(); p++)
+        {
+            if(total.vSpans[p] == 0)
+                continue;
+
+            StageCounters stats;
+            stats.name = entry.first;
+            stats.core = vPmus[p].name;
+            stats.nSpans = total.vSpans[p];
+            stats.runningMs = total.vRunningNs[p]*1e-6;
+            stats.nCycles = total.vValues[p][CYCLES];
+            stats.nInstructions = total.vValues[p][INSTRUCTIONS];
+            stats.nL2Accesses = total.vValues[p][L2_ACCESSES];
+            stats.nL2Refills = total.vValues[p][L2_REFILLS];
+            stats.nL3Accesses = total.vValues[p][L3_ACCESSES];
+            stats.nL3Refills = total.vValues[p][L3_REFILLS];
+            stats.nBranchMisses = total.vValues[p][BRANCH_MISSES];
+            if(stats.nCycles > 0)
+                stats.ipc = (double)stats.nInstructions/stats.nCycles;
+            if(stats.nL2Accesses > 0)
+                stats.l2MissRate = (double)stats.nL2Refills/stats.nL2Accesses;
+            if(stats.nL3Accesses > 0)
+                stats.l3MissRate = (double)stats.nL3Refills/stats.nL3Accesses;
+            if(stats.nInstructions > 0)
+                stats.branchMissesPKI = 1000.0*stats.nBranchMisses/stats.nInstructions;
+            vStats.push_back(stats);
+        }
+    }
+#endif
+
+    sort(vStats.begin(), vStats.end(), [](const StageCounters &a, const StageCounters &b)
+    {
+        return a.runningMs > b.runningMs;
+    });
+    return vStats;
+}
+
+void PmuCounters::Reset()
+{
+    Registry &registry = GetRegistry();
+    unique_lock<mutex> lock(registry.mMutex);
+    for(ThreadCounters* pCounters : registry.vpThreads)
+    {
+        unique_lock<mutex> lockThread(pCounters->mMutex);
+        pCounters->mAccumulators.clear();
+    }
+}
+
+void PmuCounters::PrintStatistics(std::ostream &os)
+{
+    const vector<StageCounters> vStats = GetStatistics();
+    if(vStats.empty())
+        return;
+
+    os << endl << "Hardware counters per stage (inclusive of nested stages):" << endl;
+    os << fixed << setprecision(2);
+    for(const StageCounters &stats : vStats)
+    {
+        os << stats.name << " on " << stats.core << ": " << stats.nSpans << " spans, " << stats.runningMs << " ms"
+           << ", IPC " << stats.ipc
+           << ", L2 miss " << stats.l2MissRate*100.0 << "%"
+           << ", L3 miss " << stats.l3MissRate*100.0 << "%"
+           << ", branch misses " << stats.branchMissesPKI << "/kinst" << endl;
+    }
+    os << defaultfloat;
+}
+
+} //namespace ORB_SLAM
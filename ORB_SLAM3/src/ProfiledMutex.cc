@@ -0,0 +1,406 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ProfiledMutex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <memory>
+
+#ifdef ENABLE_LOCK_PROFILING
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <time.h>
+#endif
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+#ifdef ENABLE_LOCK_PROFILING
+
+namespace
+{
+
+inline uint64_t Now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Log-linear histogram of durations in ns, 4 buckets per power of two, so percentiles are exact
+// to within a quarter of their value
+class DurationHistogram
+{
+public:
+    DurationHistogram()
+    {
+        Reset();
+    }
+
+    void Record(uint64_t ns)
+    {
+        mvCounts[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        mnCount.fetch_add(1, std::memory_order_relaxed);
+        mnTotal.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t nMax = mnMax.load(std::memory_order_relaxed);
+        while(ns > nMax && !mnMax.compare_exchange_weak(nMax, ns, std::memory_order_relaxed)) {}
+    }
+
+    // Upper bound of the bucket holding the percentile, in us
+    double Percentile(double percentile) const
+    {
+        const uint64_t nCount = mnCount.load(std::memory_order_relaxed);
+        if(nCount == 0)
+            return 0.0;
+        const uint64_t nRank = std::max<uint64_t>(1, (uint64_t)(percentile/100.0*nCount + 0.5));
+        uint64_t nSeen = 0;
+        for(int i=0; i<nBuckets; i++)
+        {
+            nSeen += mvCounts[i].load(std::memory_order_relaxed);
+            if(nSeen >= nRank)
+                return std::min(UpperBound(i), mnMax.load(std::memory_order_relaxed))*1e-3;
+        }
+        return mnMax.load(std::memory_order_relaxed)*1e-3;
+    }
+
+    double MaxUs() const
+    {
+        return mnMax.load(std::memory_order_relaxed)*1e-3;
+    }
+
+    double TotalMs() const
+    {
+        return mnTotal.load(std::memory_order_relaxed)*1e-6;
+    }
+
+    void Reset()
+    {
+        for(int i=0; i<nBuckets; i++)
+            mvCounts[i].store(0, std::memory_order_relaxed);
+        mnCount.store(0, std::memory_order_relaxed);
+        mnTotal.store(0, std::memory_order_relaxed);
+        mnMax.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static const int nSubBits = 2;
+    static const int nBuckets = 64 << nSubBits;
+
+    static int Bucket(uint64_t ns)
+    {
+        if(ns < (1u << nSubBits))
+            return (int)ns;
+        const int msb = 63 - __builtin_clzll(ns);
+        const int sub = (int)(ns >> (msb - nSubBits)) & ((1 << nSubBits) - 1);
+        return ((msb - nSubBits + 1) << nSubBits) + sub;
+    }
+
+    static uint64_t UpperBound(int bucket)
+    {
+        if(bucket < (1 << nSubBits))
+            return (uint64_t)bucket;
+        const int msb = (bucket >> nSubBits) + nSubBits - 1;
+        const uint64_t nStep = 1ull << (msb - nSubBits);
+        return (1ull << msb) + (uint64_t)(bucket & ((1 << nSubBits) - 1))*nStep + nStep - 1;
+    }
+
+    std::atomic<uint64_t> mvCounts[nBuckets];
+    std::atomic<uint64_t> mnCount;
+    std::atomic<uint64_t> mnTotal;
+    std::atomic<uint64_t> mnMax;
+};
+
+struct SiteCounters
+{
+    std::atomic<uintptr_t> nAddress{0};
+    std::atomic<uint64_t> nAcquisitions{0};
+    std::atomic<uint64_t> nContended{0};
+    std::atomic<uint64_t> nWaitNs{0};
+    std::atomic<uint64_t> nHoldNs{0};
+};
+
+string SiteName(uintptr_t nAddress)
+{
+    if(nAddress == 0)
+        return "other";
+
+    char buffer[512];
+    Dl_info info;
+    if(dladdr((void*)nAddress, &info) && info.dli_sname)
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        snprintf(buffer, sizeof(buffer), "%s+0x%lx", status == 0 && demangled ? demangled : info.dli_sname,
+                 (unsigned long)(nAddress - (uintptr_t)info.dli_saddr));
+        free(demangled);
+    }
+    else if(dladdr((void*)nAddress, &info) && info.dli_fname)
+        snprintf(buffer, sizeof(buffer), "%s+0x%lx", info.dli_fname, (unsigned long)(nAddress - (uintptr_t)info.dli_fbase));
+    else
+        snprintf(buffer, sizeof(buffer), "0x%lx", (unsigned long)nAddress);
+    return buffer;
+}
+
+} // namespace
+
+// Counters of all the mutexes of a name, never freed: the mutexes of the map outlive the profiler
+struct LockCounters
+{
+    // Sites in an open addressing table, once full the new sites count as "other"
+    static const int nSites = 64;
+
+    string name;
+    std::atomic<uint64_t> nAcquisitions{0};
+    std::atomic<uint64_t> nContended{0};
+    DurationHistogram wait;
+    DurationHistogram hold;
+    SiteCounters vSites[nSites + 1];
+
+    SiteCounters &FindSite(void* pAddress)
+    {
+        const uintptr_t nAddress = (uintptr_t)pAddress;
+        size_t i = (size_t)((nAddress >> 2) * 0x9E3779B97F4A7C15ull >> 58);
+        for(int n=0; n<nSites; n++, i=(i+1) % nSites)
+        {
+            uintptr_t nSlot = vSites[i].nAddress.load(std::memory_order_acquire);
+            if(nSlot == nAddress)
+                return vSites[i];
+            if(nSlot == 0 && (vSites[i].nAddress.compare_exchange_strong(nSlot, nAddress, std::memory_order_acq_rel) ||
+                              nSlot == nAddress))
+                return vSites[i];
+        }
+        return vSites[nSites];
+    }
+
+    void RecordAcquire(void* pSite, bool bContended, uint64_t nWait)
+    {
+        SiteCounters &site = FindSite(pSite);
+        nAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        site.nAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        if(bContended)
+        {
+            nContended.fetch_add(1, std::memory_order_relaxed);
+            wait.Record(nWait);
+            site.nContended.fetch_add(1, std::memory_order_relaxed);
+            site.nWaitNs.fetch_add(nWait, std::memory_order_relaxed);
+        }
+    }
+
+    void RecordRelease(void* pSite, uint64_t nHold)
+    {
+        hold.Record(nHold);
+        FindSite(pSite).nHoldNs.fetch_add(nHold, std::memory_order_relaxed);
+    }
+};
+
+namespace
+{
+
+struct Registry
+{
+    mutex mMutex;
+    map<string, LockCounters*> mCounters;
+};
+
+// Never destroyed, static mutexes (MapPoint::mGlobalMutex) are built before and used after main
+Registry &GetRegistry()
+{
+    static Registry* pRegistry = new Registry();
+    return *pRegistry;
+}
+
+} // namespace
+
+ProfiledMutex::ProfiledMutex(const char* name): mnAcquireTime(0), mpSite(nullptr)
+{
+    Registry &registry = GetRegistry();
+    unique_lock<mutex> lock(registry.mMutex);
+    LockCounters* &pCounters = registry.mCounters[name];
+    if(!pCounters)
+    {
+        pCounters = new LockCounters();
+        pCounters->name = name;
+    }
+    mpCounters = pCounters;
+}
+
+// Not inlined, so the return address is in the function taking the lock
+__attribute__((noinline)) void ProfiledMutex::lock()
+{
+    void* pSite = __builtin_return_address(0);
+    uint64_t nWait = 0;
+    const bool bContended = !mMutex.try_lock();
+    if(bContended)
+    {
+        const uint64_t nStart = Now();
+        mMutex.lock();
+        mnAcquireTime = Now();
+        nWait = mnAcquireTime - nStart;
+    }
+    else
+        mnAcquireTime = Now();
+    mpSite = pSite;
+    mpCounters->RecordAcquire(pSite, bContended, nWait);
+}
+
+__attribute__((noinline)) bool ProfiledMutex::try_lock()
+{
+    void* pSite = __builtin_return_address(0);
+    if(!mMutex.try_lock())
+        return false;
+    mnAcquireTime = Now();
+    mpSite = pSite;
+    mpCounters->RecordAcquire(pSite, false, 0);
+    return true;
+}
+
+void ProfiledMutex::unlock()
+{
+    const uint64_t nHold = Now() - mnAcquireTime;
+    void* pSite = mpSite;
+    mMutex.unlock();
+    mpCounters->RecordRelease(pSite, nHold);
+}
+
+bool LockProfiler::IsEnabled()
+{
+    return true;
+}
+
+vector<LockStatistics> LockProfiler::GetStatistics(size_t nTopSites)
+{
+    vector<LockStatistics> vStats;
+    Registry &registry = GetRegistry();
+    unique_lock<mutex> lock(registry.mMutex);
+    for(const auto &entry : registry.mCounters)
+    {
+        const LockCounters &counters = *entry.second;
+        LockStatistics stats;
+        stats.name = counters.name;
+        stats.nAcquisitions = counters.nAcquisitions.load(std::memory_order_relaxed);
+        stats.nContended = counters.nContended.load(std::memory_order_relaxed);
+        stats.contendedRate = stats.nAcquisitions ? (double)stats.nContended/stats.nAcquisitions : 0.0;
+        stats.waitP50Us = counters.wait.Percentile(50.0);
+        stats.waitP99Us = counters.wait.Percentile(99.0);
+        stats.waitMaxUs = counters.wait.MaxUs();
+        stats.totalWaitMs = counters.wait.TotalMs();
+        stats.holdP50Us = counters.hold.Percentile(50.0);
+        stats.holdP99Us = counters.hold.Percentile(99.0);
+        stats.holdMaxUs = counters.hold.MaxUs();
+        stats.totalHoldMs = counters.hold.TotalMs();
+
+        vector<LockStatistics::Site> vSites;
+        for(int i=0; i<=LockCounters::nSites; i++)
+        {
+            const SiteCounters &site = counters.vSites[i];
+            LockStatistics::Site s;
+            s.nAcquisitions = site.nAcquisitions.load(std::memory_order_relaxed);
+            if(s.nAcquisitions == 0)
+                continue;
+            s.function = SiteName(i < LockCounters::nSites ? site.nAddress.load(std::memory_order_relaxed) : 0);
+            s.nContended = site.nContended.load(std::memory_order_relaxed);
+            s.totalWaitMs = site.nWaitNs.load(std::memory_order_relaxed)*1e-6;
+            s.totalHoldMs = site.nHoldNs.load(std::memory_order_relaxed)*1e-6;
+            vSites.push_back(s);
+        }
+        std::sort(vSites.begin(), vSites.end(), [](const LockStatistics::Site &a, const LockStatistics::Site &b) {
+            return a.totalWaitMs != b.totalWaitMs ? a.totalWaitMs > b.totalWaitMs : a.totalHoldMs > b.totalHoldMs;
+        });
+        if(vSites.size() > nTopSites)
+            vSites.resize(nTopSites);
+        stats.vTopSites = vSites;
+        vStats.push_back(stats);
+    }
+
+    std::sort(vStats.begin(), vStats.end(), [](const LockStatistics &a, const LockStatistics &b) {
+        return a.totalWaitMs != b.totalWaitMs ? a.totalWaitMs > b.totalWaitMs : a.nAcquisitions > b.nAcquisitions;
+    });
+    return vStats;
+}
+
+void LockProfiler::Reset()
+{
+    Registry &registry = GetRegistry();
+    unique_lock<mutex> lock(registry.mMutex);
+    for(auto &entry : registry.mCounters)
+    {
+        LockCounters &counters = *entry.second;
+        counters.nAcquisitions.store(0, std::memory_order_relaxed);
+        counters.nContended.store(0, std::memory_order_relaxed);
+        counters.wait.Reset();
+        counters.hold.Reset();
+        for(int i=0; i<=LockCounters::nSites; i++)
+        {
+            counters.vSites[i].nAcquisitions.store(0, std::memory_order_relaxed);
+            counters.vSites[i].nContended.store(0, std::memory_order_relaxed);
+            counters.vSites[i].nWaitNs.store(0, std::memory_order_relaxed);
+            counters.vSites[i].nHoldNs.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+#else
+
+bool LockProfiler::IsEnabled()
+{
+    return false;
+}
+
+vector<LockStatistics> LockProfiler::GetStatistics(size_t)
+{
+    return vector<LockStatistics>();
+}
+
+void LockProfiler::Reset()
+{
+}
+
+#endif
+
+void LockProfiler::PrintStatistics(std::ostream &os, size_t nTopSites)
+{
+    const vector<LockStatistics> vStats = GetStatistics(nTopSites);
+    if(vStats.empty())
+        return;
+
+    os << endl << "Lock contention (wait of contended acquisitions, hold of all):" << endl;
+    os << fixed << setprecision(2);
+    for(const LockStatistics &stats : vStats)
+    {
+        os << stats.name << ": " << stats.nAcquisitions << " acquisitions, " << stats.contendedRate*100.0 << "% contended"
+           << ", wait p50/p99/max " << stats.waitP50Us << "/" << stats.waitP99Us << "/" << stats.waitMaxUs << " us"
+           << " (" << stats.totalWaitMs << " ms)"
+           << ", hold p50/p99/max " << stats.holdP50Us << "/" << stats.holdP99Us << "/" << stats.holdMaxUs << " us"
+           << " (" << stats.totalHoldMs << " ms)" << endl;
+        for(const LockStatistics::Site &site : stats.vTopSites)
+        {
+            os << "    " << site.function << ": " << site.nAcquisitions << " acquisitions, " << site.nContended
+               << " contended, wait " << site.totalWaitMs << " ms, hold " << site.totalHoldMs << " ms" << endl;
+        }
+    }
+    os << defaultfloat;
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,512 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "RGAPyramid.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#if defined(HAVE_RGA)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <rga/rga.h>
+#include <rga/im2d.h>
+#endif
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+#if defined(HAVE_RGA)
+
+namespace
+{
+
+// Border of the levels, as in ORBextractor
+const int EDGE_THRESHOLD = 19;
+
+// Row stride of the level buffers, as the RGA expects
+const int STRIDE_ALIGNMENT = 16;
+
+// A level takes well under a millisecond on the RGA
+const int WAIT_TIMEOUT_MS = 100;
+const int RELEASE_TIMEOUT_MS = 1000;
+
+// RGA2 addresses 32 bits, the dma32 heap of the Rockchip kernels stays below 4 GB
+const char* kDmaHeaps[] = {"/dev/dma_heap/system-dma32", "/dev/dma_heap/system"};
+
+bool WaitFence(int fence, int timeoutMs)
+{
+    struct pollfd pfd;
+    pfd.fd = fence;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int r;
+    do
+    {
+        r = poll(&pfd, 1, timeoutMs);
+    } while(r < 0 && errno == EINTR);
+    return r > 0 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
+
+bool SyncDmaBuffer(int fd, uint64_t flags)
+{
+    struct dma_buf_sync sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.flags = flags;
+    while(ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0)
+    {
+        if(errno != EINTR && errno != EAGAIN)
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+struct RGAPyramidPool
+{
+    // A level buffer with its EDGE_THRESHOLD borders
+    struct Buffer
+    {
+        int fd;
+        uchar* data;
+        size_t size;
+        int width, height, stride;          // Of the interior, and the row stride of the buffer
+        rga_buffer_handle_t handle;
+    };
+
+    // The level buffers of one pyramid
+    struct Slot
+    {
+        cv::Size size;                      // Of level 0
+        vector<Buffer> vBuffers;
+        bool bInUse;
+    };
+
+    // An imported camera buffer
+    struct Import
+    {
+        int fd;
+        const uchar* data;
+        size_t size;
+        rga_buffer_handle_t handle;
+    };
+
+    int nLevels;
+    vector<float> vInvScaleFactor;
+    int heapFd;
+    bool bAvailable;
+    bool bWarned;
+
+    mutex mMutex;
+    vector<Slot> vSlots;
+    vector<Import> vImports;
+
+    static void Free(Buffer &buffer)
+    {
+        if(buffer.handle)
+            releasebuffer_handle(buffer.handle);
+        if(buffer.data)
+            munmap(buffer.data, buffer.size);
+        if(buffer.fd >= 0)
+            close(buffer.fd);
+        buffer.handle = 0;
+        buffer.data = nullptr;
+        buffer.fd = -1;
+    }
+
+    static void Free(Slot &slot)
+    {
+        for(size_t i=0; i<slot.vBuffers.size(); i++)
+            Free(slot.vBuffers[i]);
+        slot.vBuffers.clear();
+        slot.size = cv::Size();
+    }
+
+    bool Allocate(Buffer &buffer, int width, int height)
+    {
+        buffer.fd = -1;
+        buffer.data = nullptr;
+        buffer.handle = 0;
+        buffer.width = width;
+        buffer.height = height;
+        buffer.stride = (width + 2*EDGE_THRESHOLD + STRIDE_ALIGNMENT-1)/STRIDE_ALIGNMENT*STRIDE_ALIGNMENT;
+        buffer.size = (size_t)buffer.stride*(height + 2*EDGE_THRESHOLD);
+
+        struct dma_heap_allocation_data allocation;
+        memset(&allocation, 0, sizeof(allocation));
+        allocation.len = buffer.size;
+        allocation.fd_flags = O_RDWR | O_CLOEXEC;
+        if(ioctl(heapFd, DMA_HEAP_IOCTL_ALLOC, &allocation) < 0)
+            return false;
+        buffer.fd = allocation.fd;
+
+        void* data = mmap(nullptr, buffer.size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.fd, 0);
+        if(data == MAP_FAILED)
+        {
+            Free(buffer);
+            return false;
+        }
+        buffer.data = static_cast<uchar*>(data);
+
+        buffer.handle = importbuffer_fd(buffer.fd, buffer.size);
+        if(!buffer.handle)
+        {
+            Free(buffer);
+            return false;
+        }
+        return true;
+    }
+
+    // Sizes the level buffers of a slot for an image size, as ORBextractor::ComputePyramid
+    bool Allocate(Slot &slot, const cv::Size &size)
+    {
+        if(slot.size == size)
+            return true;
+        Free(slot);
+
+        slot.vBuffers.resize(nLevels);
+        for(int level=0; level<nLevels; level++)
+        {
+            const int width = cvRound((float)size.width*vInvScaleFactor[level]);
+            const int height = cvRound((float)size.height*vInvScaleFactor[level]);
+            if(!Allocate(slot.vBuffers[level], width, height))
+            {
+                slot.vBuffers.resize(level);
+                Free(slot);
+                return false;
+            }
+        }
+        slot.size = size;
+        return true;
+    }
+
+    // Import of a camera buffer, kept while its fd and mapping stay the same
+    rga_buffer_handle_t GetImport(int fd, const uchar* data, size_t size)
+    {
+        for(size_t i=0; i<vImports.size(); i++)
+            if(vImports[i].fd == fd && vImports[i].data == data && vImports[i].size == size)
+                return vImports[i].handle;
+
+        // The replaced buffers were unmapped, their fd may have been reused
+        for(size_t i=0; i<vImports.size();)
+        {
+            Import &import = vImports[i];
+            if(import.fd == fd || (import.data < data+size && data < import.data+import.size))
+            {
+                releasebuffer_handle(import.handle);
+                import = vImports.back();
+                vImports.pop_back();
+            }
+            else
+                i++;
+        }
+
+        Import import = {fd, data, size, importbuffer_fd(fd, size)};
+        if(!import.handle)
+            return 0;
+        vImports.push_back(import);
+        return import.handle;
+    }
+
+    ~RGAPyramidPool()
+    {
+        for(size_t i=0; i<vSlots.size(); i++)
+            Free(vSlots[i]);
+        for(size_t i=0; i<vImports.size(); i++)
+            releasebuffer_handle(vImports[i].handle);
+        if(heapFd >= 0)
+            close(heapFd);
+    }
+};
+
+#else
+
+struct RGAPyramidPool {};
+
+#endif
+
+RGAPyramid::RGAPyramid(const std::shared_ptr<RGAPyramidPool> &pPool, int nSlot):
+    mpPool(pPool), mnSlot(nSlot), mbFailed(false)
+{
+}
+
+RGAPyramid::~RGAPyramid()
+{
+#if defined(HAVE_RGA)
+    // The buffers go back to the pool once no job writes them and the CPU caches are clean
+    bool bIdle = true;
+    for(size_t level=0; level<mvFences.size(); level++)
+    {
+        if(mvFences[level] >= 0)
+        {
+            bIdle = WaitFence(mvFences[level], RELEASE_TIMEOUT_MS) && bIdle;
+            close(mvFences[level]);
+        }
+    }
+
+    unique_lock<mutex> lock(mpPool->mMutex);
+    RGAPyramidPool::Slot &slot = mpPool->vSlots[mnSlot];
+    for(size_t level=0; level<mvReady.size(); level++)
+        if(mvReady[level])
+            SyncDmaBuffer(slot.vBuffers[level].fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW);
+    if(bIdle)
+        slot.bInUse = false;
+    else
+        cerr << "RGAPyramid: a job did not finish, its buffers are not reused" << endl;
+#endif
+}
+
+int RGAPyramid::GetLevels() const
+{
+    return mvLevels.size();
+}
+
+int RGAPyramid::GetFence(int level) const
+{
+    return mvFences[level];
+}
+
+bool RGAPyramid::Wait(int level)
+{
+#if defined(HAVE_RGA)
+    if(mbFailed)
+        return false;
+    if(mvReady[level])
+        return true;
+
+    if(mvFences[level] >= 0)
+    {
+        if(!WaitFence(mvFences[level], WAIT_TIMEOUT_MS))
+        {
+            cerr << "RGAPyramid: level " << level << " timed out" << endl;
+            mbFailed = true;
+            return false;
+        }
+        close(mvFences[level]);
+        mvFences[level] = -1;
+    }
+
+    // The CPU reads the level and writes the borders, the next level's job only reads the interior
+    const RGAPyramidPool::Buffer &buffer = mpPool->vSlots[mnSlot].vBuffers[level];
+    if(!SyncDmaBuffer(buffer.fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW))
+    {
+        mbFailed = true;
+        return false;
+    }
+    mvReady[level] = true;
+
+    cv::Mat bordered(buffer.height + 2*EDGE_THRESHOLD, buffer.width + 2*EDGE_THRESHOLD, CV_8UC1,
+                     buffer.data, buffer.stride);
+    copyMakeBorder(mvLevels[level], bordered, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
+                   cv::BORDER_REFLECT_101+cv::BORDER_ISOLATED);
+    return true;
+#else
+    (void)level;
+    return false;
+#endif
+}
+
+bool RGAPyramid::WaitAll()
+{
+    for(int level=0; level<GetLevels(); level++)
+        if(!Wait(level))
+            return false;
+    return true;
+}
+
+const cv::Mat &RGAPyramid::GetLevel(int level) const
+{
+    return mvLevels[level];
+}
+
+RGAPyramidBuilder::RGAPyramidBuilder(int nlevels, float scaleFactor, int nPyramids):
+    mpPool(new RGAPyramidPool()), mnLevels(nlevels), mfScaleFactor(scaleFactor)
+{
+#if defined(HAVE_RGA)
+    RGAPyramidPool &pool = *mpPool;
+    pool.nLevels = nlevels;
+    pool.vInvScaleFactor.resize(nlevels);
+    float scale = 1.0f;
+    for(int level=0; level<nlevels; level++)
+    {
+        // As mvScaleFactor/mvInvScaleFactor of the extractors
+        pool.vInvScaleFactor[level] = 1.0f/scale;
+        scale *= scaleFactor;
+    }
+    pool.vSlots.resize(nPyramids);
+    for(int i=0; i<nPyramids; i++)
+        pool.vSlots[i].bInUse = false;
+    pool.bWarned = false;
+
+    pool.heapFd = -1;
+    for(const char* heap : kDmaHeaps)
+    {
+        pool.heapFd = open(heap, O_RDWR | O_CLOEXEC);
+        if(pool.heapFd >= 0)
+            break;
+    }
+    pool.bAvailable = pool.heapFd >= 0 && access("/dev/rga", F_OK) == 0;
+    if(!pool.bAvailable)
+        cerr << "RGAPyramidBuilder: no RGA or DMA heap, pyramids are built on the CPU" << endl;
+#else
+    (void)nPyramids;
+#endif
+}
+
+RGAPyramidBuilder::~RGAPyramidBuilder()
+{
+}
+
+bool RGAPyramidBuilder::IsAvailable() const
+{
+#if defined(HAVE_RGA)
+    unique_lock<mutex> lock(mpPool->mMutex);
+    return mpPool->bAvailable;
+#else
+    return false;
+#endif
+}
+
+int RGAPyramidBuilder::GetLevels() const
+{
+    return mnLevels;
+}
+
+float RGAPyramidBuilder::GetScaleFactor() const
+{
+    return mfScaleFactor;
+}
+
+std::shared_ptr<RGAPyramid> RGAPyramidBuilder::Build(int fd, const void* data, size_t size,
+                                                     int width, int height, int stride)
+{
+#if defined(HAVE_RGA)
+    RGAPyramidPool &pool = *mpPool;
+    if(fd < 0 || !data || width <= 0 || height <= 0 || stride < width || (size_t)stride*(height-1) + width > size)
+        return nullptr;
+
+    unique_lock<mutex> lock(pool.mMutex);
+    if(!pool.bAvailable)
+        return nullptr;
+    int nSlot = -1;
+    for(size_t i=0; i<pool.vSlots.size() && nSlot < 0; i++)
+        if(!pool.vSlots[i].bInUse)
+            nSlot = i;
+    if(nSlot < 0)
+        return nullptr;
+
+    RGAPyramidPool::Slot &slot = pool.vSlots[nSlot];
+    const rga_buffer_handle_t source = pool.GetImport(fd, static_cast<const uchar*>(data), size);
+    if(!source || !pool.Allocate(slot, cv::Size(width, height)))
+    {
+        if(!pool.bWarned)
+            cerr << "RGAPyramidBuilder: failed to import or allocate the buffers for "
+                 << width << "x" << height << endl;
+        pool.bWarned = true;
+        return nullptr;
+    }
+    slot.bInUse = true;
+
+    std::shared_ptr<RGAPyramid> pPyramid(new RGAPyramid(mpPool, nSlot));
+    pPyramid->mvFences.assign(mnLevels, -1);
+    pPyramid->mvReady.assign(mnLevels, false);
+    pPyramid->mvLevels.resize(mnLevels);
+
+    // Level 0 is copied into its bordered buffer, every other level scaled from the previous one.
+    // Each job starts when the fence of the previous level signals.
+    rga_buffer_t src = wrapbuffer_handle(source, width, height, RK_FORMAT_YCbCr_400, stride, height);
+    im_rect srect = {0, 0, width, height};
+    rga_buffer_t pat;
+    memset(&pat, 0, sizeof(pat));
+    im_rect prect = {0, 0, 0, 0};
+    int acquireFence = -1;
+    for(int level=0; level<mnLevels; level++)
+    {
+        const RGAPyramidPool::Buffer &buffer = slot.vBuffers[level];
+        const int wholeHeight = buffer.height + 2*EDGE_THRESHOLD;
+        rga_buffer_t dst = wrapbuffer_handle(buffer.handle, buffer.stride, wholeHeight, RK_FORMAT_YCbCr_400,
+                                             buffer.stride, wholeHeight);
+        im_rect drect = {EDGE_THRESHOLD, EDGE_THRESHOLD, buffer.width, buffer.height};
+
+        pPyramid->mvLevels[level] = cv::Mat(wholeHeight, buffer.width + 2*EDGE_THRESHOLD, CV_8UC1,
+                                            buffer.data, buffer.stride)(
+                                            cv::Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, buffer.width, buffer.height));
+
+        int releaseFence = -1;
+        if(imcheck(src, dst, srect, drect) != IM_STATUS_NOERROR ||
+           improcess(src, dst, pat, srect, drect, prect, acquireFence, &releaseFence, nullptr, IM_ASYNC) !=
+                IM_STATUS_SUCCESS || releaseFence < 0)
+        {
+            cerr << "RGAPyramidBuilder: the RGA refused level " << level << " of " << width << "x" << height
+                 << ", pyramids are built on the CPU" << endl;
+            pool.bAvailable = false;
+
+            // The pyramid waits for the queued jobs and returns its slot
+            pPyramid->mbFailed = true;
+            lock.unlock();
+            return nullptr;
+        }
+        pPyramid->mvFences[level] = releaseFence;
+        acquireFence = releaseFence;
+
+        src = dst;
+        srect = drect;
+    }
+    return pPyramid;
+#else
+    (void)fd;
+    (void)data;
+    (void)size;
+    (void)width;
+    (void)height;
+    (void)stride;
+    return nullptr;
+#endif
+}
+
+bool RGAPyramidBuilder::Import(int fd, const void* data, size_t size)
+{
+#if defined(HAVE_RGA)
+    RGAPyramidPool &pool = *mpPool;
+    if(fd < 0 || !data || size == 0)
+        return false;
+
+    unique_lock<mutex> lock(pool.mMutex);
+    return pool.bAvailable && pool.GetImport(fd, static_cast<const uchar*>(data), size) != 0;
+#else
+    (void)fd;
+    (void)data;
+    (void)size;
+    return false;
+#endif
+}
+
+} //namespace ORB_SLAM
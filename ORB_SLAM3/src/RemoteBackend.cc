@@ -0,0 +1,556 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "RemoteBackend.h"
+
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "System.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <cstring>
+#include <map>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+// Time before a failed server is tried again, the Global BAs in between run locally
+const double RETRY_INTERVAL = 5.0;
+// Longest wait for the connection, the rest of the timeout is for the exchange
+const double CONNECT_TIMEOUT = 2.0;
+// Period the stop flag is checked at while waiting on the link
+const int POLL_INTERVAL_MS = 10;
+
+double Now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<class T>
+void Put(vector<uint8_t> &payload, const T &value)
+{
+    const size_t offset = payload.size();
+    payload.resize(offset+sizeof(T));
+    memcpy(payload.data()+offset, &value, sizeof(T));
+}
+
+template<class T>
+void PutArray(vector<uint8_t> &payload, const vector<T> &values)
+{
+    Put(payload, static_cast<uint64_t>(values.size()));
+    const size_t offset = payload.size();
+    payload.resize(offset+values.size()*sizeof(T));
+    if(!values.empty())
+        memcpy(payload.data()+offset, values.data(), values.size()*sizeof(T));
+}
+
+class Reader
+{
+public:
+    Reader(const uint8_t *pData, size_t size): mpData(pData), mnSize(size), mnOffset(0) {}
+
+    template<class T>
+    bool Get(T &value)
+    {
+        if(mnSize-mnOffset < sizeof(T))
+            return false;
+        memcpy(&value, mpData+mnOffset, sizeof(T));
+        mnOffset += sizeof(T);
+        return true;
+    }
+
+    template<class T>
+    bool GetArray(vector<T> &values)
+    {
+        uint64_t n;
+        if(!Get(n) || n > (mnSize-mnOffset)/sizeof(T))
+            return false;
+        values.resize(n);
+        if(n>0)
+            memcpy(values.data(), mpData+mnOffset, n*sizeof(T));
+        mnOffset += n*sizeof(T);
+        return true;
+    }
+
+    bool AtEnd() const { return mnOffset==mnSize; }
+
+private:
+    const uint8_t *mpData;
+    size_t mnSize;
+    size_t mnOffset;
+};
+
+// Waits for the socket until the deadline (negative for none), false on timeout or stop
+bool WaitSocket(int fd, short events, bool* pbStopFlag, double deadline)
+{
+    while(true)
+    {
+        if(pbStopFlag && *pbStopFlag)
+            return false;
+
+        int timeout = POLL_INTERVAL_MS;
+        if(deadline >= 0.0)
+        {
+            const double left = deadline-Now();
+            if(left <= 0.0)
+                return false;
+            timeout = min(timeout, static_cast<int>(left*1000.0)+1);
+        }
+
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        const int ret = poll(&pfd, 1, pbStopFlag || deadline >= 0.0 ? timeout : -1);
+        if(ret < 0 && errno != EINTR)
+            return false;
+        if(ret > 0)
+            return !(pfd.revents & (POLLERR | POLLNVAL)) || (pfd.revents & POLLIN);
+    }
+}
+
+bool SendAll(int fd, const uint8_t *pData, size_t size, bool* pbStopFlag, double deadline)
+{
+    while(size > 0)
+    {
+        const ssize_t n = send(fd, pData, size, MSG_NOSIGNAL);
+        if(n > 0)
+        {
+            pData += n;
+            size -= n;
+        }
+        else if(n < 0 && errno == EINTR)
+            continue;
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if(!WaitSocket(fd, POLLOUT, pbStopFlag, deadline))
+                return false;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+bool ReceiveAll(int fd, uint8_t *pData, size_t size, bool* pbStopFlag, double deadline)
+{
+    while(size > 0)
+    {
+        if(!WaitSocket(fd, POLLIN, pbStopFlag, deadline))
+            return false;
+        const ssize_t n = recv(fd, pData, size, 0);
+        if(n > 0)
+        {
+            pData += n;
+            size -= n;
+        }
+        else if(n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+        else
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void BundleAdjustmentProblem::Encode(vector<uint8_t> &payload) const
+{
+    payload.clear();
+    Put(payload, static_cast<int32_t>(nIterations));
+    Put(payload, static_cast<uint8_t>(bRobust));
+    PutArray(payload, vCameras);
+    PutArray(payload, vKeyFrames);
+    PutArray(payload, vPoints);
+    PutArray(payload, vObservations);
+}
+
+bool BundleAdjustmentProblem::Decode(const uint8_t *pData, size_t size)
+{
+    Reader reader(pData, size);
+    int32_t iterations;
+    uint8_t robust;
+    if(!reader.Get(iterations) || !reader.Get(robust) || !reader.GetArray(vCameras) || !reader.GetArray(vKeyFrames) ||
+       !reader.GetArray(vPoints) || !reader.GetArray(vObservations) || !reader.AtEnd())
+        return false;
+    nIterations = iterations;
+    bRobust = robust != 0;
+
+    if(vPoints.size()%3 != 0)
+        return false;
+    for(size_t i=0; i<vKeyFrames.size(); i++)
+    {
+        if(vKeyFrames[i].camera >= vCameras.size())
+            return false;
+    }
+    for(size_t i=0; i<vObservations.size(); i++)
+    {
+        if(vObservations[i].keyframe >= vKeyFrames.size() || vObservations[i].point >= vPoints.size()/3)
+            return false;
+    }
+    return true;
+}
+
+void BundleAdjustmentSolution::Encode(vector<uint8_t> &payload) const
+{
+    payload.clear();
+    PutArray(payload, vPoses);
+    PutArray(payload, vPoints);
+    PutArray(payload, vbIncluded);
+}
+
+bool BundleAdjustmentSolution::Decode(const uint8_t *pData, size_t size)
+{
+    Reader reader(pData, size);
+    return reader.GetArray(vPoses) && reader.GetArray(vPoints) && reader.GetArray(vbIncluded) && reader.AtEnd() &&
+           vPoses.size()%7 == 0 && vPoints.size() == 3*vbIncluded.size();
+}
+
+RemoteBackend::RemoteBackend(const string &strHost, int nPort, float fTimeout):
+    mStrHost(strHost), mnPort(nPort), mfTimeout(fTimeout), mSocket(-1), mnRequestId(0), mRetryTime(0.0),
+    mnRemote(0), mnFallbacks(0)
+{
+}
+
+RemoteBackend::~RemoteBackend()
+{
+    Disconnect();
+}
+
+bool RemoteBackend::BuildProblem(Map* pMap, int nIterations, BundleAdjustmentProblem &problem,
+                                 vector<KeyFrame*> &vpKFs, vector<MapPoint*> &vpMPs)
+{
+    problem.nIterations = nIterations;
+    problem.bRobust = false;
+    problem.vCameras.clear();
+    problem.vKeyFrames.clear();
+    problem.vPoints.clear();
+    problem.vObservations.clear();
+    vpKFs.clear();
+    vpMPs.clear();
+
+    const Map::KeyFrameSnapshot pKeyFrames = pMap->GetKeyFramesSnapshot();
+    const Map::MapPointSnapshot pMapPoints = pMap->GetMapPointsSnapshot();
+    if(pKeyFrames->empty())
+        return false;
+
+    map<GeometricCamera*,uint32_t> mCameras;
+    map<KeyFrame*,uint32_t> mKFs;
+    vpKFs.reserve(pKeyFrames->size());
+    problem.vKeyFrames.reserve(pKeyFrames->size());
+    for(KeyFrame* pKF : *pKeyFrames)
+    {
+        if(pKF->isBad())
+            continue;
+
+        // The right camera of a fisheye stereo rig is not modelled by the server
+        if(pKF->mpCamera2 || pKF->mpCamera->GetType() != GeometricCamera::CAM_PINHOLE)
+            return false;
+
+        map<GeometricCamera*,uint32_t>::iterator cit = mCameras.find(pKF->mpCamera);
+        if(cit == mCameras.end())
+        {
+            BundleAdjustmentProblem::Camera camera;
+            camera.fx = pKF->mpCamera->getParameter(0);
+            camera.fy = pKF->mpCamera->getParameter(1);
+            camera.cx = pKF->mpCamera->getParameter(2);
+            camera.cy = pKF->mpCamera->getParameter(3);
+            camera.bf = pKF->mbf;
+            cit = mCameras.insert(make_pair(pKF->mpCamera, static_cast<uint32_t>(problem.vCameras.size()))).first;
+            problem.vCameras.push_back(camera);
+        }
+
+        BundleAdjustmentProblem::KeyFrameEntry entry;
+        entry.camera = cit->second;
+        entry.fixed = pKF->mnId==pMap->GetInitKFid();
+        const Sophus::SE3f Tcw = pKF->GetPose();
+        const Eigen::Quaternionf q = Tcw.unit_quaternion();
+        entry.q[0] = q.x();
+        entry.q[1] = q.y();
+        entry.q[2] = q.z();
+        entry.q[3] = q.w();
+        for(int i=0; i<3; i++)
+            entry.t[i] = Tcw.translation()[i];
+
+        mKFs[pKF] = static_cast<uint32_t>(problem.vKeyFrames.size());
+        problem.vKeyFrames.push_back(entry);
+        vpKFs.push_back(pKF);
+    }
+
+    vpMPs.reserve(pMapPoints->size());
+    problem.vPoints.reserve(3*pMapPoints->size());
+    for(MapPoint* pMP : *pMapPoints)
+    {
+        if(pMP->isBad())
+            continue;
+
+        const uint32_t point = static_cast<uint32_t>(vpMPs.size());
+        const size_t nObservations = problem.vObservations.size();
+        const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
+        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        {
+            KeyFrame* pKF = mit->first;
+            const int leftIndex = get<0>(mit->second);
+            map<KeyFrame*,uint32_t>::const_iterator kit = mKFs.find(pKF);
+            if(leftIndex == -1 || kit == mKFs.end() || pKF->isBad())
+                continue;
+
+            const cv::KeyPoint &kpUn = pKF->mvKeysUn[leftIndex];
+            BundleAdjustmentProblem::Observation obs;
+            obs.keyframe = kit->second;
+            obs.point = point;
+            obs.u = kpUn.pt.x;
+            obs.v = kpUn.pt.y;
+            obs.ur = pKF->mvuRight[leftIndex];
+            obs.invSigma2 = pKF->mvInvLevelSigma2[kpUn.octave];
+            problem.vObservations.push_back(obs);
+        }
+
+        if(problem.vObservations.size() == nObservations)
+            continue;
+
+        const Eigen::Vector3f pos = pMP->GetWorldPos();
+        problem.vPoints.push_back(pos[0]);
+        problem.vPoints.push_back(pos[1]);
+        problem.vPoints.push_back(pos[2]);
+        vpMPs.push_back(pMP);
+    }
+
+    return true;
+}
+
+bool RemoteBackend::GlobalBundleAdjustment(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF)
+{
+    TRACE_SCOPE("RemoteGlobalBundleAdjustment");
+    {
+        unique_lock<mutex> lock(mMutex);
+        if(Now() < mRetryTime)
+        {
+            unique_lock<mutex> lockStats(mMutexStats);
+            mnFallbacks++;
+            return false;
+        }
+    }
+
+    BundleAdjustmentProblem problem;
+    vector<KeyFrame*> vpKFs;
+    vector<MapPoint*> vpMPs;
+    BundleAdjustmentSolution solution;
+    if(!BuildProblem(pMap, nIterations, problem, vpKFs, vpMPs) || !Solve(problem, pbStopFlag, solution))
+    {
+        if(pbStopFlag && *pbStopFlag)
+            return true;
+        unique_lock<mutex> lock(mMutexStats);
+        mnFallbacks++;
+        return false;
+    }
+
+    if(solution.vPoses.size() != 7*vpKFs.size() || solution.vbIncluded.size() != vpMPs.size())
+    {
+        Verbose::PrintMess("Remote Global BA: solution does not match the problem", Verbose::VERBOSITY_NORMAL);
+        unique_lock<mutex> lock(mMutexStats);
+        mnFallbacks++;
+        return false;
+    }
+
+    // Same outputs as Optimizer::BundleAdjustment
+    const bool bOrigin = nLoopKF==pMap->GetOriginKF()->mnId;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        if(pKF->isBad())
+            continue;
+
+        const float* p = &solution.vPoses[7*i];
+        const Eigen::Quaternionf q = Eigen::Quaternionf(p[3], p[0], p[1], p[2]).normalized();
+        const Sophus::SE3f Tcw(q, Eigen::Vector3f(p[4], p[5], p[6]));
+        if(bOrigin)
+            pKF->SetPose(Tcw);
+        else
+        {
+            pKF->mTcwGBA = Tcw;
+            pKF->mnBAGlobalForKF = nLoopKF;
+        }
+    }
+
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+        if(!solution.vbIncluded[i] || pMP->isBad())
+            continue;
+
+        const Eigen::Vector3f pos(solution.vPoints[3*i], solution.vPoints[3*i+1], solution.vPoints[3*i+2]);
+        if(bOrigin)
+        {
+            pMP->SetWorldPos(pos);
+            pMP->UpdateNormalAndDepth();
+        }
+        else
+        {
+            pMP->mPosGBA = pos;
+            pMP->mnBAGlobalForKF = nLoopKF;
+        }
+    }
+
+    unique_lock<mutex> lock(mMutexStats);
+    mnRemote++;
+    return true;
+}
+
+bool RemoteBackend::Solve(const BundleAdjustmentProblem &problem, bool* pbStopFlag, BundleAdjustmentSolution &solution)
+{
+    unique_lock<mutex> lock(mMutex);
+    const double deadline = Now()+mfTimeout;
+
+    if(mSocket < 0 && !Connect(min(deadline, Now()+CONNECT_TIMEOUT)))
+    {
+        Verbose::PrintMess("Remote Global BA: server " + mStrHost + " unreachable", Verbose::VERBOSITY_NORMAL);
+        mRetryTime = Now()+RETRY_INTERVAL;
+        return false;
+    }
+
+    problem.Encode(mvPayload);
+    const uint64_t requestId = ++mnRequestId;
+    bool bSolved = SendMessage(mSocket, KIND_REQUEST, requestId, mvPayload, pbStopFlag, deadline);
+
+    // A solution of an abandoned request may still be in flight on a kept connection
+    RemoteBackendHeader header;
+    while(bSolved)
+    {
+        bSolved = ReceiveMessage(mSocket, header, mvPayload, pbStopFlag, deadline);
+        if(bSolved && header.kind == KIND_SOLUTION && header.requestId == requestId)
+            break;
+    }
+
+    if(bSolved && !solution.Decode(mvPayload.data(), mvPayload.size()))
+        bSolved = false;
+
+    if(!bSolved)
+    {
+        // The server may still be solving, the connection is dropped so its answer is not waited for
+        Disconnect();
+        if(!(pbStopFlag && *pbStopFlag))
+        {
+            Verbose::PrintMess("Remote Global BA: no solution from " + mStrHost, Verbose::VERBOSITY_NORMAL);
+            mRetryTime = Now()+RETRY_INTERVAL;
+        }
+    }
+    return bSolved;
+}
+
+bool RemoteBackend::Connect(double deadline)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* pAddresses = NULL;
+    if(getaddrinfo(mStrHost.c_str(), to_string(mnPort).c_str(), &hints, &pAddresses) != 0)
+        return false;
+
+    for(struct addrinfo* pAddress=pAddresses; pAddress && mSocket<0; pAddress=pAddress->ai_next)
+    {
+        const int fd = socket(pAddress->ai_family, pAddress->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                              pAddress->ai_protocol);
+        if(fd < 0)
+            continue;
+
+        int ret = connect(fd, pAddress->ai_addr, pAddress->ai_addrlen);
+        if(ret < 0 && errno == EINPROGRESS && WaitSocket(fd, POLLOUT, NULL, deadline))
+        {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0 ? 0 : -1;
+        }
+
+        if(ret == 0)
+        {
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            mSocket = fd;
+        }
+        else
+            close(fd);
+    }
+    freeaddrinfo(pAddresses);
+    return mSocket >= 0;
+}
+
+void RemoteBackend::Disconnect()
+{
+    if(mSocket >= 0)
+    {
+        close(mSocket);
+        mSocket = -1;
+    }
+}
+
+bool RemoteBackend::SendMessage(int fd, uint16_t kind, uint64_t requestId, const vector<uint8_t> &payload,
+                                bool* pbStopFlag, double deadline)
+{
+    RemoteBackendHeader header;
+    header.magic = MAGIC;
+    header.kind = kind;
+    header.reserved = 0;
+    header.requestId = requestId;
+    header.payloadBytes = payload.size();
+    return SendAll(fd, reinterpret_cast<const uint8_t*>(&header), sizeof(header), pbStopFlag, deadline) &&
+           SendAll(fd, payload.data(), payload.size(), pbStopFlag, deadline);
+}
+
+bool RemoteBackend::ReceiveMessage(int fd, RemoteBackendHeader &header, vector<uint8_t> &payload,
+                                   bool* pbStopFlag, double deadline)
+{
+    if(!ReceiveAll(fd, reinterpret_cast<uint8_t*>(&header), sizeof(header), pbStopFlag, deadline))
+        return false;
+    if(header.magic != MAGIC || header.payloadBytes > MAX_PAYLOAD)
+        return false;
+    payload.resize(header.payloadBytes);
+    return ReceiveAll(fd, payload.data(), payload.size(), pbStopFlag, deadline);
+}
+
+int RemoteBackend::GetNumRemote()
+{
+    unique_lock<mutex> lock(mMutexStats);
+    return mnRemote;
+}
+
+int RemoteBackend::GetNumFallbacks()
+{
+    unique_lock<mutex> lock(mMutexStats);
+    return mnFallbacks;
+}
+
+} //namespace ORB_SLAM3
@@ -467,6 +467,11 @@ namespace ORB_SLAM3 {
 
          if(!found)
             imageViewerScale_ = 1.0f;
+
+        // Refreshes per second of the map buffers, 0 draws the map in immediate mode every frame
+        mapUpdateRate_ = readParameter<float>(fSettings,"Viewer.mapUpdateRate",found,false);
+        if(!found)
+            mapUpdateRate_ = 10.0f;
     }
 
     void Settings::readLoadAndSave(cv::FileStorage &fSettings) {
@@ -480,6 +485,69 @@ namespace ORB_SLAM3 {
         bool found;
 
         thFarPoints_ = readParameter<float>(fSettings,"System.thFarPoints",found,false);
+
+        localBAThreads_ = readParameter<int>(fSettings,"System.localBAThreads",found,false);
+        if(!found || localBAThreads_ < 1){
+            localBAThreads_ = 1;
+        }
+
+        localBATimeBudget_ = readParameter<float>(fSettings,"System.localBATimeBudget",found,false);
+        if(!found){
+            localBATimeBudget_ = 0.f;
+        }
+
+        localBAGainThreshold_ = readParameter<float>(fSettings,"System.localBAGainThreshold",found,false);
+        if(!found){
+            localBAGainThreshold_ = 0.f;
+        }
+
+        int backgroundInertialBA = readParameter<int>(fSettings,"System.backgroundInertialBA",found,false);
+        backgroundInertialBA_ = found && backgroundInertialBA != 0;
+
+        int asyncLoopCorrection = readParameter<int>(fSettings,"System.asyncLoopCorrection",found,false);
+        asyncLoopCorrection_ = found && asyncLoopCorrection != 0;
+
+        loopClosingThreads_ = readParameter<int>(fSettings,"System.loopClosingThreads",found,false);
+        if(!found || loopClosingThreads_ < 1){
+            loopClosingThreads_ = 1;
+        }
+
+        int incrementalGBA = readParameter<int>(fSettings,"System.incrementalGBA",found,false);
+        incrementalGBA_ = found && incrementalGBA != 0;
+
+        mapCellSize_ = readParameter<float>(fSettings,"System.mapCellSize",found,false);
+        if(!found){
+            mapCellSize_ = 0.f;
+        }
+
+        int mapResidentMB = readParameter<int>(fSettings,"System.mapResidentMB",found,false);
+        mapResidentMB_ = found && mapResidentMB > 0 ? mapResidentMB : 0;
+
+        int memoryBudgetMB = readParameter<int>(fSettings,"System.memoryBudgetMB",found,false);
+        memoryBudgetMB_ = found && memoryBudgetMB > 0 ? memoryBudgetMB : 0;
+
+        int globalCandidates = readParameter<int>(fSettings,"System.globalCandidates",found,false);
+        globalCandidates_ = found && globalCandidates > 0 ? globalCandidates : 0;
+
+        globalMinKeyFrames_ = readParameter<int>(fSettings,"System.globalMinKeyFrames",found,false);
+        if(!found || globalMinKeyFrames_ < 0){
+            globalMinKeyFrames_ = 500;
+        }
+
+        int atlasRelocMaps = readParameter<int>(fSettings,"System.atlasRelocMaps",found,false);
+        atlasRelocMaps_ = found && atlasRelocMaps > 0 ? atlasRelocMaps : 0;
+
+        remoteBackendHost_ = readParameter<string>(fSettings,"LoopClosing.remoteBackendHost",found,false);
+
+        remoteBackendPort_ = readParameter<int>(fSettings,"LoopClosing.remoteBackendPort",found,false);
+        if(!found || remoteBackendPort_ <= 0){
+            remoteBackendPort_ = 9956;
+        }
+
+        remoteBackendTimeout_ = readParameter<float>(fSettings,"LoopClosing.remoteBackendTimeout",found,false);
+        if(!found || remoteBackendTimeout_ <= 0.f){
+            remoteBackendTimeout_ = 30.f;
+        }
     }
 
     void Settings::precomputeRectificationMaps() {
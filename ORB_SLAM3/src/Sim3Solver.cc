@@ -26,7 +26,12 @@
 #include "KeyFrame.h"
 #include "ORBmatcher.h"
 
-#include "Thirdparty/DBoW2/DUtils/Random.h"
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 namespace ORB_SLAM3
 {
@@ -35,6 +40,7 @@ namespace ORB_SLAM3
 Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *> &vpMatched12, const bool bFixScale,
                        vector<KeyFrame*> vpKeyFrameMatchedMP):
     mnIterations(0), mnBestInliers(0), mbFixScale(bFixScale),
+    mRandomGenerator(static_cast<std::minstd_rand::result_type>(pKF1->mnId*7919 + pKF2->mnId + 1)),
     pCamera1(pKF1->mpCamera), pCamera2(pKF2->mpCamera)
 {
     bool bDifferentKFs = false;
@@ -55,8 +61,8 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
     mvpMapPoints2.reserve(mN1);
     mvpMatches12 = vpMatched12;
     mvnIndices1.reserve(mN1);
-    mvX3Dc1.reserve(mN1);
-    mvX3Dc2.reserve(mN1);
+    mvX1.reserve(mN1); mvY1.reserve(mN1); mvZ1.reserve(mN1);
+    mvX2.reserve(mN1); mvY2.reserve(mN1); mvZ2.reserve(mN1);
 
     Eigen::Matrix3f Rcw1 = pKF1->GetRotation();
     Eigen::Vector3f tcw1 = pKF1->GetTranslation();
@@ -64,6 +70,7 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
     Eigen::Vector3f tcw2 = pKF2->GetTranslation();
 
     mvAllIndices.reserve(mN1);
+    mvAvailableIndices.reserve(mN1);
 
     size_t idx=0;
 
@@ -96,26 +103,35 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
             const float sigmaSquare1 = pKF1->mvLevelSigma2[kp1.octave];
             const float sigmaSquare2 = pKFm->mvLevelSigma2[kp2.octave];
 
-            mvnMaxError1.push_back(9.210*sigmaSquare1);
-            mvnMaxError2.push_back(9.210*sigmaSquare2);
+            mvMaxError1.push_back(static_cast<size_t>(9.210*sigmaSquare1));
+            mvMaxError2.push_back(static_cast<size_t>(9.210*sigmaSquare2));
 
             mvpMapPoints1.push_back(pMP1);
             mvpMapPoints2.push_back(pMP2);
             mvnIndices1.push_back(i1);
 
-            Eigen::Vector3f X3D1w = pMP1->GetWorldPos();
-            mvX3Dc1.push_back(Rcw1*X3D1w+tcw1);
+            const Eigen::Vector3f X3D1c = Rcw1*pMP1->GetWorldPos()+tcw1;
+            mvX1.push_back(X3D1c(0)); mvY1.push_back(X3D1c(1)); mvZ1.push_back(X3D1c(2));
 
-            Eigen::Vector3f X3D2w = pMP2->GetWorldPos();
-            mvX3Dc2.push_back(Rcw2*X3D2w+tcw2);
+            const Eigen::Vector3f X3D2c = Rcw2*pMP2->GetWorldPos()+tcw2;
+            mvX2.push_back(X3D2c(0)); mvY2.push_back(X3D2c(1)); mvZ2.push_back(X3D2c(2));
 
             mvAllIndices.push_back(idx);
             idx++;
         }
     }
 
-    FromCameraToImage(mvX3Dc1,mvP1im1,pCamera1);
-    FromCameraToImage(mvX3Dc2,mvP2im2,pCamera2);
+    // Projections of the points in their own keyframe
+    const size_t nMatches = mvX1.size();
+    mvU1.resize(nMatches); mvV1.resize(nMatches);
+    mvU2.resize(nMatches); mvV2.resize(nMatches);
+    for(size_t i=0; i<nMatches; i++)
+    {
+        const Eigen::Vector2f p1 = pCamera1->project(Eigen::Vector3f(mvX1[i],mvY1[i],mvZ1[i]));
+        mvU1[i] = p1(0); mvV1[i] = p1(1);
+        const Eigen::Vector2f p2 = pCamera2->project(Eigen::Vector3f(mvX2[i],mvY2[i],mvZ2[i]));
+        mvU2[i] = p2(0); mvV2[i] = p2(1);
+    }
 
     SetRansacParameters();
 }
@@ -129,6 +145,8 @@ void Sim3Solver::SetRansacParameters(double probability, int minInliers, int max
     N = mvpMapPoints1.size(); // number of correspondences
 
     mvbInliersi.resize(N);
+    mvErr1.resize(N);
+    mvErr2.resize(N);
 
     // Adjust Parameters according to number of correspondences
     float epsilon = (float)mRansacMinInliers/N;
@@ -158,8 +176,6 @@ Eigen::Matrix4f Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool>
         return Eigen::Matrix4f::Identity();
     }
 
-    vector<size_t> vAvailableIndices;
-
     Eigen::Matrix3f P3Dc1i;
     Eigen::Matrix3f P3Dc2i;
 
@@ -169,21 +185,8 @@ Eigen::Matrix4f Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool>
         nCurrentIterations++;
         mnIterations++;
 
-        vAvailableIndices = mvAllIndices;
-
         // Get min set of points
-        for(short i = 0; i < 3; ++i)
-        {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
-
-            int idx = vAvailableIndices[randi];
-
-            P3Dc1i.col(i) = mvX3Dc1[idx];
-            P3Dc2i.col(i) = mvX3Dc2[idx];
-
-            vAvailableIndices[randi] = vAvailableIndices.back();
-            vAvailableIndices.pop_back();
-        }
+        SampleMinimalSet(P3Dc1i,P3Dc2i);
 
         ComputeSim3(P3Dc1i,P3Dc2i);
 
@@ -228,8 +231,6 @@ Eigen::Matrix4f Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool>
         return Eigen::Matrix4f::Identity();
     }
 
-    vector<size_t> vAvailableIndices;
-
     Eigen::Matrix3f P3Dc1i;
     Eigen::Matrix3f P3Dc2i;
 
@@ -242,21 +243,8 @@ Eigen::Matrix4f Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool>
         nCurrentIterations++;
         mnIterations++;
 
-        vAvailableIndices = mvAllIndices;
-
         // Get min set of points
-        for(short i = 0; i < 3; ++i)
-        {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
-
-            int idx = vAvailableIndices[randi];
-
-            P3Dc1i.col(i) = mvX3Dc1[idx];
-            P3Dc2i.col(i) = mvX3Dc2[idx];
-
-            vAvailableIndices[randi] = vAvailableIndices.back();
-            vAvailableIndices.pop_back();
-        }
+        SampleMinimalSet(P3Dc1i,P3Dc2i);
 
         ComputeSim3(P3Dc1i,P3Dc2i);
 
@@ -293,6 +281,25 @@ Eigen::Matrix4f Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool>
     return bestSim3;
 }
 
+void Sim3Solver::SampleMinimalSet(Eigen::Matrix3f &P3Dc1i, Eigen::Matrix3f &P3Dc2i)
+{
+    mvAvailableIndices.assign(mvAllIndices.begin(),mvAllIndices.end());
+
+    for(short i = 0; i < 3; ++i)
+    {
+        std::uniform_int_distribution<int> dist(0, mvAvailableIndices.size()-1);
+        int randi = dist(mRandomGenerator);
+
+        int idx = mvAvailableIndices[randi];
+
+        P3Dc1i.col(i) = Eigen::Vector3f(mvX1[idx],mvY1[idx],mvZ1[idx]);
+        P3Dc2i.col(i) = Eigen::Vector3f(mvX2[idx],mvY2[idx],mvZ2[idx]);
+
+        mvAvailableIndices[randi] = mvAvailableIndices.back();
+        mvAvailableIndices.pop_back();
+    }
+}
+
 Eigen::Matrix4f Sim3Solver::find(vector<bool> &vbInliers12, int &nInliers)
 {
     bool bFlag;
@@ -349,12 +356,12 @@ void Sim3Solver::ComputeSim3(Eigen::Matrix3f &P1, Eigen::Matrix3f &P2)
          N14, N24, N34, N44;
 
 
-    // Step 4: Eigenvector of the highest eigenvalue
-    Eigen::EigenSolver<Eigen::Matrix4f> eigSolver;
+    // Step 4: Eigenvector of the highest eigenvalue, N is symmetric
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4f> eigSolver;
     eigSolver.compute(N);
 
-    Eigen::Vector4f eval = eigSolver.eigenvalues().real();
-    Eigen::Matrix4f evec = eigSolver.eigenvectors().real(); //evec[0] is the quaternion of the desired rotation
+    Eigen::Vector4f eval = eigSolver.eigenvalues();
+    Eigen::Matrix4f evec = eigSolver.eigenvectors(); //evec[0] is the quaternion of the desired rotation
 
     int maxIndex; // should be zero
     eval.maxCoeff(&maxIndex);
@@ -374,10 +381,7 @@ void Sim3Solver::ComputeSim3(Eigen::Matrix3f &P1, Eigen::Matrix3f &P2)
 
     if(!mbFixScale)
     {
-        double cvnom = Converter::toCvMat(Pr1).dot(Converter::toCvMat(P3));
         double nom = (Pr1.array() * P3.array()).sum();
-        if (abs(nom-cvnom)>1e-3)
-            std::cout << "sim3 solver: " << abs(nom-cvnom) << std::endl << nom << std::endl;
         Eigen::Array<float,3,3> aux_P3;
         aux_P3 = P3.array() * P3.array();
         double den = aux_P3.sum();
@@ -414,28 +418,17 @@ void Sim3Solver::ComputeSim3(Eigen::Matrix3f &P1, Eigen::Matrix3f &P2)
 
 void Sim3Solver::CheckInliers()
 {
-    vector<Eigen::Vector2f> vP1im2, vP2im1;
-    Project(mvX3Dc2,vP2im1,mT12i,pCamera1);
-    Project(mvX3Dc1,vP1im2,mT21i,pCamera2);
-
-    mnInliersi=0;
+    ReprojectionErrors(mvX2,mvY2,mvZ2,mvU1,mvV1,mT12i,pCamera1,mvErr1);
+    ReprojectionErrors(mvX1,mvY1,mvZ1,mvU2,mvV2,mT21i,pCamera2,mvErr2);
 
-    for(size_t i=0; i<mvP1im1.size(); i++)
+    int nInliers = 0;
+    for(int i=0; i<N; i++)
     {
-        Eigen::Vector2f dist1 = mvP1im1[i] - vP2im1[i];
-        Eigen::Vector2f dist2 = vP1im2[i] - mvP2im2[i];
-
-        const float err1 = dist1.dot(dist1);
-        const float err2 = dist2.dot(dist2);
-
-        if(err1<mvnMaxError1[i] && err2<mvnMaxError2[i])
-        {
-            mvbInliersi[i]=true;
-            mnInliersi++;
-        }
-        else
-            mvbInliersi[i]=false;
+        const unsigned char bInlier = mvErr1[i]<mvMaxError1[i] && mvErr2[i]<mvMaxError2[i];
+        mvbInliersi[i] = bInlier;
+        nInliers += bInlier;
     }
+    mnInliersi = nInliers;
 }
 
 Eigen::Matrix4f Sim3Solver::GetEstimatedTransformation()
@@ -458,31 +451,66 @@ float Sim3Solver::GetEstimatedScale()
     return mBestScale;
 }
 
-void Sim3Solver::Project(const vector<Eigen::Vector3f> &vP3Dw, vector<Eigen::Vector2f> &vP2D, Eigen::Matrix4f Tcw, GeometricCamera* pCamera)
+void Sim3Solver::ReprojectionErrors(const vector<float> &vX, const vector<float> &vY, const vector<float> &vZ,
+                                    const vector<float> &vU, const vector<float> &vV,
+                                    const Eigen::Matrix4f &Tcw, GeometricCamera* pCamera, vector<float> &vErr)
 {
-    Eigen::Matrix3f Rcw = Tcw.block<3,3>(0,0);
-    Eigen::Vector3f tcw = Tcw.block<3,1>(0,3);
-
-    vP2D.clear();
-    vP2D.reserve(vP3Dw.size());
+    const int n = vX.size();
+    const Eigen::Matrix3f Rcw = Tcw.block<3,3>(0,0);
+    const Eigen::Vector3f tcw = Tcw.block<3,1>(0,3);
 
-    for(size_t i=0, iend=vP3Dw.size(); i<iend; i++)
+    int i = 0;
+    if(pCamera->GetType()==GeometricCamera::CAM_PINHOLE)
     {
-        Eigen::Vector3f P3Dc = Rcw*vP3Dw[i]+tcw;
-        Eigen::Vector2f pt2D = pCamera->project(P3Dc);
-        vP2D.push_back(pt2D);
-    }
-}
+        const float fx = pCamera->getParameter(0);
+        const float fy = pCamera->getParameter(1);
+        const float cx = pCamera->getParameter(2);
+        const float cy = pCamera->getParameter(3);
 
-void Sim3Solver::FromCameraToImage(const vector<Eigen::Vector3f> &vP3Dc, vector<Eigen::Vector2f> &vP2D, GeometricCamera* pCamera)
-{
-    vP2D.clear();
-    vP2D.reserve(vP3Dc.size());
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        for(; i+4<=n; i+=4)
+        {
+            const float32x4_t x = vld1q_f32(&vX[i]), y = vld1q_f32(&vY[i]), z = vld1q_f32(&vZ[i]);
+            float32x4_t xc = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(tcw(0)), x, Rcw(0,0)), y, Rcw(0,1)), z, Rcw(0,2));
+            float32x4_t yc = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(tcw(1)), x, Rcw(1,0)), y, Rcw(1,1)), z, Rcw(1,2));
+            float32x4_t zc = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(tcw(2)), x, Rcw(2,0)), y, Rcw(2,1)), z, Rcw(2,2));
+            const float32x4_t du = vsubq_f32(vld1q_f32(&vU[i]), vmlaq_n_f32(vdupq_n_f32(cx), vdivq_f32(xc, zc), fx));
+            const float32x4_t dv = vsubq_f32(vld1q_f32(&vV[i]), vmlaq_n_f32(vdupq_n_f32(cy), vdivq_f32(yc, zc), fy));
+            vst1q_f32(&vErr[i], vmlaq_f32(vmulq_f32(du, du), dv, dv));
+        }
+#elif defined(__SSE2__)
+        for(; i+4<=n; i+=4)
+        {
+            const __m128 x = _mm_loadu_ps(&vX[i]), y = _mm_loadu_ps(&vY[i]), z = _mm_loadu_ps(&vZ[i]);
+            const __m128 xc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(Rcw(0,0))), _mm_mul_ps(y, _mm_set1_ps(Rcw(0,1)))),
+                                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(Rcw(0,2))), _mm_set1_ps(tcw(0))));
+            const __m128 yc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(Rcw(1,0))), _mm_mul_ps(y, _mm_set1_ps(Rcw(1,1)))),
+                                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(Rcw(1,2))), _mm_set1_ps(tcw(1))));
+            const __m128 zc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(Rcw(2,0))), _mm_mul_ps(y, _mm_set1_ps(Rcw(2,1)))),
+                                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(Rcw(2,2))), _mm_set1_ps(tcw(2))));
+            const __m128 du = _mm_sub_ps(_mm_loadu_ps(&vU[i]), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(fx), _mm_div_ps(xc, zc)), _mm_set1_ps(cx)));
+            const __m128 dv = _mm_sub_ps(_mm_loadu_ps(&vV[i]), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(fy), _mm_div_ps(yc, zc)), _mm_set1_ps(cy)));
+            _mm_storeu_ps(&vErr[i], _mm_add_ps(_mm_mul_ps(du, du), _mm_mul_ps(dv, dv)));
+        }
+#endif
+        for(; i<n; i++)
+        {
+            const float xc = Rcw(0,0)*vX[i] + Rcw(0,1)*vY[i] + Rcw(0,2)*vZ[i] + tcw(0);
+            const float yc = Rcw(1,0)*vX[i] + Rcw(1,1)*vY[i] + Rcw(1,2)*vZ[i] + tcw(1);
+            const float zc = Rcw(2,0)*vX[i] + Rcw(2,1)*vY[i] + Rcw(2,2)*vZ[i] + tcw(2);
+            const float du = vU[i] - (fx*xc/zc + cx);
+            const float dv = vV[i] - (fy*yc/zc + cy);
+            vErr[i] = du*du + dv*dv;
+        }
+        return;
+    }
 
-    for(size_t i=0, iend=vP3Dc.size(); i<iend; i++)
+    // Other camera models through their projection
+    for(; i<n; i++)
     {
-        Eigen::Vector2f pt2D = pCamera->project(vP3Dc[i]);
-        vP2D.push_back(pt2D);
+        const Eigen::Vector3f P3Dc = Rcw*Eigen::Vector3f(vX[i],vY[i],vZ[i]) + tcw;
+        const Eigen::Vector2f d = Eigen::Vector2f(vU[i],vV[i]) - pCamera->project(P3Dc);
+        vErr[i] = d.dot(d);
     }
 }
 
@@ -0,0 +1,702 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StereoDepthGPU.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#if defined(HAVE_OPENCL)
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+#endif
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+#if defined(HAVE_OPENCL)
+
+namespace
+{
+
+// Uniqueness margin of the best cost over the second best, in percent
+const int UNIQUENESS_RATIO = 10;
+
+// NDISP, the number of disparities, is defined when building the program
+const char* kProgramSource = R"CLC(
+// A 5x5 census transform has 24 bits
+#define MAX_COST 24
+
+// Box downscale of an image that is already rectified
+__kernel void downscale(__global const uchar* src, int srcStep, int scale,
+                        __global uchar* dst, int width, int height)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    int sum = 0;
+    for(int dy=0; dy<scale; dy++)
+        for(int dx=0; dx<scale; dx++)
+            sum += src[(y*scale + dy)*srcStep + x*scale + dx];
+    dst[y*width + x] = (uchar)((sum + scale*scale/2)/(scale*scale));
+}
+
+// Rectification and downscale in one bilinear remap, as cv::remap with INTER_LINEAR and a black border
+__kernel void rectify(__global const uchar* src, int srcStep, int srcWidth, int srcHeight,
+                      __global const float* mapX, __global const float* mapY,
+                      __global uchar* dst, int width, int height)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    const float fx = mapX[y*width + x];
+    const float fy = mapY[y*width + x];
+    const int sx = (int)floor(fx);
+    const int sy = (int)floor(fy);
+    if(sx < 0 || sy < 0 || sx+1 >= srcWidth || sy+1 >= srcHeight)
+    {
+        dst[y*width + x] = 0;
+        return;
+    }
+    const float ax = fx - sx;
+    const float ay = fy - sy;
+    __global const uchar* p = src + sy*srcStep + sx;
+    const float top = p[0] + ax*(p[1] - p[0]);
+    const float bottom = p[srcStep] + ax*(p[srcStep+1] - p[srcStep]);
+    dst[y*width + x] = convert_uchar_sat_rte(top + ay*(bottom - top));
+}
+
+__kernel void census(__global const uchar* image, int width, int height, __global uint* out)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    const int center = image[y*width + x];
+    uint bits = 0;
+    for(int dy=-2; dy<=2; dy++)
+    {
+        const int yy = clamp(y + dy, 0, height-1);
+        for(int dx=-2; dx<=2; dx++)
+        {
+            if(dx == 0 && dy == 0)
+                continue;
+            const int xx = clamp(x + dx, 0, width-1);
+            bits = (bits << 1) | (image[yy*width + xx] < center);
+        }
+    }
+    out[y*width + x] = bits;
+}
+
+// Hamming distances of the left census to the right ones on the same row, NDISP per pixel
+__kernel void matching_cost(__global const uint* censusLeft, __global const uint* censusRight,
+                            int width, int height, __global uchar* cost)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    const int pixel = y*width + x;
+    const uint left = censusLeft[pixel];
+    __global uchar* c = cost + pixel*NDISP;
+    for(int d=0; d<NDISP; d++)
+        c[d] = x-d >= 0 ? (uchar)popcount(left ^ censusRight[pixel - d]) : MAX_COST;
+}
+
+// Aggregation along one of the four paths, 0: left to right, 1: right to left, 2: top to bottom,
+// 3: bottom to top. A work-group of NDISP items walks one scanline, each item one disparity.
+// P2 is lowered across intensity edges, where the disparity is likely to jump.
+__kernel void aggregate(__global const uchar* cost, __global const uchar* image, int width, int height,
+                        int P1, int P2, int direction, int accumulate, __global ushort* sum)
+{
+    __local int previous[NDISP];
+    __local int minimum[NDISP];
+
+    const int d = get_local_id(0);
+    const int line = get_group_id(0);
+    const int horizontal = direction < 2;
+    const int length = horizontal ? width : height;
+
+    int previousIntensity = 0;
+    int previousMinimum = 0;
+    for(int step=0; step<length; step++)
+    {
+        const int s = (direction & 1) ? length-1-step : step;
+        const int pixel = horizontal ? line*width + s : s*width + line;
+        const int intensity = image[pixel];
+
+        int L = cost[pixel*NDISP + d];
+        if(step > 0)
+        {
+            const int P2Edge = max(P1 + 1, P2*16/(16 + abs(intensity - previousIntensity)));
+            int best = min(previous[d], previousMinimum + P2Edge);
+            if(d > 0)
+                best = min(best, previous[d-1] + P1);
+            if(d < NDISP-1)
+                best = min(best, previous[d+1] + P1);
+            L += best - previousMinimum;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        previous[d] = L;
+        minimum[d] = L;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for(int n=NDISP/2; n>0; n>>=1)
+        {
+            if(d < n)
+                minimum[d] = min(minimum[d], minimum[d+n]);
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+        previousMinimum = minimum[0];
+        previousIntensity = intensity;
+
+        __global ushort* out = sum + pixel*NDISP + d;
+        *out = (ushort)(accumulate ? *out + L : L);
+    }
+}
+
+// Winner-takes-all disparity of the left image with a parabola fit, -1 where it is not unique
+__kernel void select_left(__global const ushort* sum, int width, int height, int uniqueness,
+                          __global float* disparity)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    const int pixel = y*width + x;
+    __global const ushort* s = sum + pixel*NDISP;
+    const int nDisparities = min(NDISP, x+1);
+    int best = 0;
+    int bestCost = s[0];
+    for(int d=1; d<nDisparities; d++)
+    {
+        if(s[d] < bestCost)
+        {
+            bestCost = s[d];
+            best = d;
+        }
+    }
+    int secondCost = 0xffff;
+    for(int d=0; d<nDisparities; d++)
+        if(abs(d - best) > 1)
+            secondCost = min(secondCost, (int)s[d]);
+
+    float result = -1.f;
+    if(secondCost*(100 - uniqueness) > bestCost*100)
+    {
+        result = best;
+        if(best > 0 && best < nDisparities-1)
+        {
+            const int c0 = s[best-1];
+            const int c2 = s[best+1];
+            const int denominator = c0 + c2 - 2*bestCost;
+            if(denominator > 0)
+                result += (float)(c0 - c2)/(2.f*denominator);
+        }
+    }
+    disparity[pixel] = result;
+}
+
+// Winner-takes-all disparity of the right image from the same volume, for the left-right check
+__kernel void select_right(__global const ushort* sum, int width, int height, __global int* disparity)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    const int nDisparities = min(NDISP, width-x);
+    int best = 0;
+    int bestCost = 0xffff;
+    for(int d=0; d<nDisparities; d++)
+    {
+        const int c = sum[(y*width + x + d)*NDISP + d];
+        if(c < bestCost)
+        {
+            bestCost = c;
+            best = d;
+        }
+    }
+    disparity[y*width + x] = best;
+}
+
+// bf is scaled to the reduced resolution. Disparities under a pixel are dropped as too far.
+__kernel void to_depth(__global const float* disparity, __global const int* disparityRight,
+                       int width, int height, float bf, __global float* depth)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= width || y >= height)
+        return;
+
+    const int pixel = y*width + x;
+    const float d = disparity[pixel];
+    float z = 0.f;
+    if(d >= 1.f)
+    {
+        const int xr = (int)rint(x - d);
+        if(xr >= 0 && fabs(disparityRight[y*width + xr] - d) <= 1.f)
+            z = bf/d;
+    }
+    depth[pixel] = z;
+}
+)CLC";
+
+size_t RoundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1)/multiple*multiple;
+}
+
+template<typename T>
+cl_int SetArg(cl_kernel kernel, cl_uint index, const T &value)
+{
+    return clSetKernelArg(kernel, index, sizeof(T), &value);
+}
+
+template<typename T, typename... Args>
+cl_int SetArg(cl_kernel kernel, cl_uint index, const T &value, const Args&... args)
+{
+    const cl_int err = clSetKernelArg(kernel, index, sizeof(T), &value);
+    return err != CL_SUCCESS ? err : SetArg(kernel, index+1, args...);
+}
+
+// Rounded up, the kernels skip the excess work-items
+cl_int Enqueue2D(cl_command_queue queue, cl_kernel kernel, int width, int height)
+{
+    const size_t global[2] = {RoundUp(width, 16), RoundUp(height, 4)};
+    return clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, global, nullptr, 0, nullptr, nullptr);
+}
+
+} // namespace
+
+struct StereoDepthGPU::CLState
+{
+    cl_context context = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program program = nullptr;
+    cl_kernel downscale = nullptr, rectify = nullptr, census = nullptr, matchingCost = nullptr;
+    cl_kernel aggregate = nullptr, selectLeft = nullptr, selectRight = nullptr, toDepth = nullptr;
+
+    // Full-size input images, reduced images and their census transforms
+    cl_mem source[2] = {nullptr, nullptr};
+    cl_mem images[2] = {nullptr, nullptr};
+    cl_mem transforms[2] = {nullptr, nullptr};
+
+    // Rectification maps, set by SetRectification()
+    cl_mem maps[4] = {nullptr, nullptr, nullptr, nullptr};
+    bool useMaps = false;
+
+    cl_mem cost = nullptr, sum = nullptr;
+    cl_mem disparity = nullptr, disparityRight = nullptr, depth = nullptr;
+
+    // Read back of the depth of the pair in flight
+    cl_event readEvent = nullptr;
+
+    size_t groupSize = 0;
+
+    static void Release(cl_mem &mem)
+    {
+        if(mem)
+            clReleaseMemObject(mem);
+        mem = nullptr;
+    }
+
+    ~CLState()
+    {
+        if(queue)
+            clFinish(queue);
+        if(readEvent)
+            clReleaseEvent(readEvent);
+        for(int i=0; i<2; i++)
+        {
+            Release(source[i]);
+            Release(images[i]);
+            Release(transforms[i]);
+        }
+        for(int i=0; i<4; i++)
+            Release(maps[i]);
+        Release(cost);
+        Release(sum);
+        Release(disparity);
+        Release(disparityRight);
+        Release(depth);
+        cl_kernel kernels[] = {downscale, rectify, census, matchingCost,
+                               aggregate, selectLeft, selectRight, toDepth};
+        for(cl_kernel kernel : kernels)
+            if(kernel)
+                clReleaseKernel(kernel);
+        if(program)
+            clReleaseProgram(program);
+        if(queue)
+            clReleaseCommandQueue(queue);
+        if(context)
+            clReleaseContext(context);
+    }
+};
+
+#else
+
+struct StereoDepthGPU::CLState {};
+
+#endif
+
+StereoDepthGPU::StereoDepthGPU(const cv::Size &imageSize, float bf, int nDownscale, int nMaxDisparity,
+                               int nP1, int nP2):
+    mImageSize(imageSize), mbf(bf), mnDownscale(std::max(nDownscale, 1)), mnMaxDisparity(16),
+    mnP1(nP1), mnP2(nP2), mTimestamp(0), mbPending(false), mLatestTimestamp(0)
+{
+    while(mnMaxDisparity < nMaxDisparity && mnMaxDisparity < 256)
+        mnMaxDisparity *= 2;
+    mDepthSize = cv::Size(mImageSize.width/mnDownscale, mImageSize.height/mnDownscale);
+
+    if(!InitializeCL())
+    {
+        cerr << "StereoDepthGPU: OpenCL is not available, no dense stereo depth" << endl;
+        mpCL.reset();
+    }
+}
+
+StereoDepthGPU::~StereoDepthGPU()
+{
+}
+
+bool StereoDepthGPU::IsGPUAvailable() const
+{
+    return mpCL != nullptr;
+}
+
+int StereoDepthGPU::GetDownscale() const
+{
+    return mnDownscale;
+}
+
+cv::Size StereoDepthGPU::GetDepthSize() const
+{
+    return mDepthSize;
+}
+
+bool StereoDepthGPU::InitializeCL()
+{
+#if defined(HAVE_OPENCL)
+    if(mDepthSize.width < mnMaxDisparity || mDepthSize.height <= 0)
+        return false;
+
+    cl_platform_id platforms[8];
+    cl_uint nPlatforms = 0;
+    if(clGetPlatformIDs(8, platforms, &nPlatforms) != CL_SUCCESS || nPlatforms == 0)
+        return false;
+
+    cl_device_id device = nullptr;
+    for(cl_uint i=0; i<std::min<cl_uint>(nPlatforms, 8) && !device; i++)
+        if(clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &device, nullptr) != CL_SUCCESS)
+            device = nullptr;
+    if(!device)
+        return false;
+
+    mpCL.reset(new CLState());
+    CLState &cl = *mpCL;
+    cl_int err = CL_SUCCESS;
+    cl.context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+    if(err != CL_SUCCESS)
+        return false;
+    cl.queue = clCreateCommandQueue(cl.context, device, 0, &err);
+    if(err != CL_SUCCESS)
+        return false;
+
+    const std::string source = std::string("#define NDISP ") + std::to_string(mnMaxDisparity) + "\n" +
+                               kProgramSource;
+    const char* sources[] = {source.c_str()};
+    cl.program = clCreateProgramWithSource(cl.context, 1, sources, nullptr, &err);
+    if(err != CL_SUCCESS)
+        return false;
+    if(clBuildProgram(cl.program, 1, &device, "-cl-std=CL1.2", nullptr, nullptr) != CL_SUCCESS)
+    {
+        size_t logSize = 0;
+        clGetProgramBuildInfo(cl.program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+        std::string log(logSize, '\0');
+        clGetProgramBuildInfo(cl.program, device, CL_PROGRAM_BUILD_LOG, logSize, &log[0], nullptr);
+        cerr << "StereoDepthGPU: failed to build the kernels:" << endl << log << endl;
+        return false;
+    }
+
+    struct { cl_kernel* kernel; const char* name; } kernels[] = {
+        {&cl.downscale, "downscale"}, {&cl.rectify, "rectify"},
+        {&cl.census, "census"}, {&cl.matchingCost, "matching_cost"},
+        {&cl.aggregate, "aggregate"}, {&cl.selectLeft, "select_left"},
+        {&cl.selectRight, "select_right"}, {&cl.toDepth, "to_depth"}};
+    for(auto &k : kernels)
+    {
+        *k.kernel = clCreateKernel(cl.program, k.name, &err);
+        if(err != CL_SUCCESS)
+            return false;
+    }
+
+    // A work-group walks a scanline with an item per disparity
+    clGetKernelWorkGroupInfo(cl.aggregate, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &cl.groupSize, nullptr);
+    if(cl.groupSize < (size_t)mnMaxDisparity)
+    {
+        cerr << "StereoDepthGPU: " << mnMaxDisparity << " disparities exceed the work-group size "
+             << cl.groupSize << endl;
+        return false;
+    }
+
+    const size_t sourceSize = mImageSize.area();
+    const size_t size = mDepthSize.area();
+    cl_int e;
+    err = CL_SUCCESS;
+    for(int i=0; i<2; i++)
+    {
+        cl.source[i] = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, sourceSize, nullptr, &e); err |= e;
+        cl.images[i] = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, size, nullptr, &e); err |= e;
+        cl.transforms[i] = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, size*sizeof(cl_uint), nullptr, &e); err |= e;
+    }
+    cl.cost = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, size*mnMaxDisparity, nullptr, &e); err |= e;
+    cl.sum = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, size*mnMaxDisparity*sizeof(cl_ushort), nullptr, &e); err |= e;
+    cl.disparity = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, size*sizeof(cl_float), nullptr, &e); err |= e;
+    cl.disparityRight = clCreateBuffer(cl.context, CL_MEM_READ_WRITE, size*sizeof(cl_int), nullptr, &e); err |= e;
+    cl.depth = clCreateBuffer(cl.context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, size*sizeof(cl_float), nullptr, &e); err |= e;
+    if(err != CL_SUCCESS)
+    {
+        cerr << "StereoDepthGPU: failed to allocate the buffers for " << mDepthSize.width << "x"
+             << mDepthSize.height << "x" << mnMaxDisparity << endl;
+        return false;
+    }
+
+    char name[256] = {0};
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name)-1, name, nullptr);
+    cout << "StereoDepthGPU: matching " << mDepthSize.width << "x" << mDepthSize.height << " with "
+         << mnMaxDisparity << " disparities on " << name << endl;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool StereoDepthGPU::SetRectification(const cv::Mat &mapLeftX, const cv::Mat &mapLeftY,
+                                      const cv::Mat &mapRightX, const cv::Mat &mapRightY)
+{
+#if defined(HAVE_OPENCL)
+    if(!mpCL)
+        return false;
+    CLState &cl = *mpCL;
+
+    const cv::Mat* maps[4] = {&mapLeftX, &mapLeftY, &mapRightX, &mapRightY};
+    if(mapLeftX.empty() && mapLeftY.empty() && mapRightX.empty() && mapRightY.empty())
+    {
+        cl.useMaps = false;
+        return true;
+    }
+    for(int i=0; i<4; i++)
+    {
+        if(maps[i]->type() != CV_32FC1 || maps[i]->size() != mDepthSize)
+        {
+            cerr << "StereoDepthGPU: the rectification maps must be CV_32FC1 of " << mDepthSize.width
+                 << "x" << mDepthSize.height << endl;
+            return false;
+        }
+    }
+
+    cl_int err = CL_SUCCESS;
+    for(int i=0; i<4; i++)
+    {
+        const cv::Mat map = maps[i]->isContinuous() ? *maps[i] : maps[i]->clone();
+        if(!cl.maps[i])
+        {
+            cl_int e;
+            cl.maps[i] = clCreateBuffer(cl.context, CL_MEM_READ_ONLY, map.total()*sizeof(cl_float), nullptr, &e);
+            err |= e;
+        }
+        if(cl.maps[i])
+            err |= clEnqueueWriteBuffer(cl.queue, cl.maps[i], CL_TRUE, 0, map.total()*sizeof(cl_float),
+                                        map.data, 0, nullptr, nullptr);
+    }
+    cl.useMaps = err == CL_SUCCESS;
+    if(!cl.useMaps)
+        cerr << "StereoDepthGPU: failed to upload the rectification maps" << endl;
+    return cl.useMaps;
+#else
+    (void)mapLeftX;
+    (void)mapLeftY;
+    (void)mapRightX;
+    (void)mapRightY;
+    return false;
+#endif
+}
+
+bool StereoDepthGPU::Submit(const cv::Mat &imLeft, const cv::Mat &imRight, double timestamp)
+{
+#if defined(HAVE_OPENCL)
+    if(!mpCL)
+        return false;
+
+    // A pair that was never waited for still becomes the latest depth
+    if(mbPending)
+    {
+        cv::Mat depth;
+        Wait(depth);
+    }
+
+    if(imLeft.type() != CV_8UC1 || imRight.type() != CV_8UC1 ||
+       imLeft.size() != mImageSize || imRight.size() != mImageSize)
+    {
+        cerr << "StereoDepthGPU: expected two CV_8UC1 images of " << mImageSize.width << "x"
+             << mImageSize.height << endl;
+        return false;
+    }
+
+    CLState &cl = *mpCL;
+    const cl_int sourceStep = mImageSize.width;
+    const cl_int width = mDepthSize.width;
+    const cl_int height = mDepthSize.height;
+
+    // 1. Upload, the images stay referenced until the writes are done
+    mImLeft = imLeft.isContinuous() ? imLeft : imLeft.clone();
+    mImRight = imRight.isContinuous() ? imRight : imRight.clone();
+    cl_int err = CL_SUCCESS;
+    err |= clEnqueueWriteBuffer(cl.queue, cl.source[0], CL_FALSE, 0, mImageSize.area(), mImLeft.data,
+                                0, nullptr, nullptr);
+    err |= clEnqueueWriteBuffer(cl.queue, cl.source[1], CL_FALSE, 0, mImageSize.area(), mImRight.data,
+                                0, nullptr, nullptr);
+
+    // 2. Rectified or box-downscaled images and their census transforms
+    for(int i=0; i<2; i++)
+    {
+        if(cl.useMaps)
+        {
+            err |= SetArg(cl.rectify, 0, cl.source[i], sourceStep, (cl_int)mImageSize.width, (cl_int)mImageSize.height,
+                          cl.maps[2*i], cl.maps[2*i+1], cl.images[i], width, height);
+            err |= Enqueue2D(cl.queue, cl.rectify, width, height);
+        }
+        else
+        {
+            err |= SetArg(cl.downscale, 0, cl.source[i], sourceStep, (cl_int)mnDownscale, cl.images[i], width, height);
+            err |= Enqueue2D(cl.queue, cl.downscale, width, height);
+        }
+        err |= SetArg(cl.census, 0, cl.images[i], width, height, cl.transforms[i]);
+        err |= Enqueue2D(cl.queue, cl.census, width, height);
+    }
+
+    // 3. Cost volume, aggregated along the rows and the columns in both directions
+    err |= SetArg(cl.matchingCost, 0, cl.transforms[0], cl.transforms[1], width, height, cl.cost);
+    err |= Enqueue2D(cl.queue, cl.matchingCost, width, height);
+    for(cl_int direction=0; direction<4; direction++)
+    {
+        err |= SetArg(cl.aggregate, 0, cl.cost, cl.images[0], width, height, (cl_int)mnP1, (cl_int)mnP2,
+                      direction, (cl_int)(direction > 0), cl.sum);
+        const size_t nScanlines = direction < 2 ? height : width;
+        const size_t local = mnMaxDisparity;
+        const size_t global = nScanlines*local;
+        err |= clEnqueueNDRangeKernel(cl.queue, cl.aggregate, 1, nullptr, &global, &local, 0, nullptr, nullptr);
+    }
+
+    // 4. Disparities of both images, checked against each other, and the depth
+    err |= SetArg(cl.selectLeft, 0, cl.sum, width, height, (cl_int)UNIQUENESS_RATIO, cl.disparity);
+    err |= Enqueue2D(cl.queue, cl.selectLeft, width, height);
+    err |= SetArg(cl.selectRight, 0, cl.sum, width, height, cl.disparityRight);
+    err |= Enqueue2D(cl.queue, cl.selectRight, width, height);
+    err |= SetArg(cl.toDepth, 0, cl.disparity, cl.disparityRight, width, height, mbf/mnDownscale, cl.depth);
+    err |= Enqueue2D(cl.queue, cl.toDepth, width, height);
+
+    // 5. Read back into a new map, the previous ones may still be used
+    mDepth = cv::Mat(mDepthSize, CV_32FC1);
+    if(err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(cl.queue, cl.depth, CL_FALSE, 0, mDepthSize.area()*sizeof(cl_float), mDepth.data,
+                                  0, nullptr, &cl.readEvent);
+    if(err != CL_SUCCESS)
+    {
+        cerr << "StereoDepthGPU: failed to enqueue the matching" << endl;
+        clFinish(cl.queue);
+        if(cl.readEvent)
+            clReleaseEvent(cl.readEvent);
+        cl.readEvent = nullptr;
+        mImLeft.release();
+        mImRight.release();
+        mDepth.release();
+        return false;
+    }
+    clFlush(cl.queue);
+
+    mTimestamp = timestamp;
+    mbPending = true;
+    return true;
+#else
+    (void)imLeft;
+    (void)imRight;
+    (void)timestamp;
+    return false;
+#endif
+}
+
+bool StereoDepthGPU::Wait(cv::Mat &depth)
+{
+#if defined(HAVE_OPENCL)
+    if(!mpCL || !mbPending)
+        return false;
+    mbPending = false;
+
+    CLState &cl = *mpCL;
+    cl_int status = CL_SUCCESS;
+    cl_int err = clWaitForEvents(1, &cl.readEvent);
+    if(err == CL_SUCCESS)
+        err = clGetEventInfo(cl.readEvent, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+    clReleaseEvent(cl.readEvent);
+    cl.readEvent = nullptr;
+    mImLeft.release();
+    mImRight.release();
+    if(err != CL_SUCCESS || status != CL_COMPLETE)
+    {
+        cerr << "StereoDepthGPU: matching failed" << endl;
+        mDepth.release();
+        return false;
+    }
+
+    depth = mDepth;
+    {
+        unique_lock<mutex> lock(mMutexLatest);
+        mLatestDepth = mDepth;
+        mLatestTimestamp = mTimestamp;
+    }
+    mDepth.release();
+    return true;
+#else
+    (void)depth;
+    return false;
+#endif
+}
+
+bool StereoDepthGPU::GetLatestDepth(cv::Mat &depth, double &timestamp)
+{
+    unique_lock<mutex> lock(mMutexLatest);
+    if(mLatestDepth.empty())
+        return false;
+    depth = mLatestDepth;
+    timestamp = mLatestTimestamp;
+    return true;
+}
+
+} //namespace ORB_SLAM
@@ -20,10 +20,14 @@
 
 #include "System.h"
 #include "Converter.h"
+#include "Optimizer.h"
+#include "PmuCounters.h"
 #include <thread>
 #include <pangolin/pangolin.h>
 #include <iomanip>
 #include <openssl/md5.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <boost/serialization/base_object.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -40,8 +44,9 @@ Verbose::eLevel Verbose::th = Verbose::VERBOSITY_NORMAL;
 
 System::System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor,
                const bool bUseViewer, const int initFr, const string &strSequence):
-    mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false), mbResetActiveMap(false),
-    mbActivateLocalizationMode(false), mbDeactivateLocalizationMode(false), mbShutDown(false)
+    mSensor(sensor), mpRemoteBackend(NULL), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false), mbResetActiveMap(false),
+    mbActivateLocalizationMode(false), mbDeactivateLocalizationMode(false), mbShutDown(false),
+    mptCheckpoint(NULL), mbCheckpointing(false)
 {
     // Output welcome message
     cout << endl <<
@@ -114,8 +119,7 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
         //Load ORB Vocabulary
         cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
 
-        mpVocabulary = new ORBVocabulary();
-        bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
+        bool bVocLoad = LoadVocabulary(strVocFile);
         if(!bVocLoad)
         {
             cerr << "Wrong path to vocabulary. " << endl;
@@ -126,18 +130,24 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
 
         //Create KeyFrame Database
         mpKeyFrameDatabase = new KeyFrameDatabase(*mpVocabulary);
+        if(settings_)
+            mpKeyFrameDatabase->SetGlobalPrefilter(settings_->globalCandidates(), settings_->globalMinKeyFrames());
 
         //Create the Atlas
         cout << "Initialization of Atlas from scratch " << endl;
         mpAtlas = new Atlas(0);
+        if(settings_)
+        {
+            mpAtlas->SetMapCells(settings_->mapCellSize(), (size_t)settings_->mapResidentMB() << 20);
+            mpAtlas->SetMemoryBudget((size_t)settings_->memoryBudgetMB() << 20);
+        }
     }
     else
     {
         //Load ORB Vocabulary
         cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
 
-        mpVocabulary = new ORBVocabulary();
-        bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
+        bool bVocLoad = LoadVocabulary(strVocFile);
         if(!bVocLoad)
         {
             cerr << "Wrong path to vocabulary. " << endl;
@@ -148,6 +158,8 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
 
         //Create KeyFrame Database
         mpKeyFrameDatabase = new KeyFrameDatabase(*mpVocabulary);
+        if(settings_)
+            mpKeyFrameDatabase->SetGlobalPrefilter(settings_->globalCandidates(), settings_->globalMinKeyFrames());
 
         cout << "Load File" << endl;
 
@@ -190,6 +202,8 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     cout << "Seq. Name: " << strSequence << endl;
     mpTracker = new Tracking(this, mpVocabulary, mpFrameDrawer, mpMapDrawer,
                              mpAtlas, mpKeyFrameDatabase, strSettingsFile, mSensor, settings_, strSequence);
+    if(settings_)
+        mpTracker->SetAtlasRelocalization(settings_->atlasRelocMaps());
 
     //Initialize the Local Mapping thread and launch
     mpLocalMapper = new LocalMapping(this, mpAtlas, mSensor==MONOCULAR || mSensor==IMU_MONOCULAR,
@@ -207,10 +221,28 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     }
     else
         mpLocalMapper->mbFarPoints = false;
+    if(settings_)
+    {
+        mpLocalMapper->SetLocalBAThreads(settings_->localBAThreads());
+        mpLocalMapper->SetLocalBATermination(settings_->localBATimeBudget(), settings_->localBAGainThreshold());
+        mpLocalMapper->SetBackgroundInertialBA(settings_->backgroundInertialBA());
+    }
 
     //Initialize the Loop Closing thread and launch
     // mSensor!=MONOCULAR && mSensor!=IMU_MONOCULAR
     mpLoopCloser = new LoopClosing(mpAtlas, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR, activeLC); // mSensor!=MONOCULAR);
+    if(settings_)
+    {
+        mpLoopCloser->SetAsyncLoopCorrection(settings_->asyncLoopCorrection());
+        mpLoopCloser->SetEssentialGraphThreads(settings_->loopClosingThreads());
+        mpLoopCloser->SetIncrementalGBA(settings_->incrementalGBA());
+        if(!settings_->remoteBackendHost().empty())
+        {
+            mpRemoteBackend = new RemoteBackend(settings_->remoteBackendHost(), settings_->remoteBackendPort(),
+                                                settings_->remoteBackendTimeout());
+            mpLoopCloser->SetRemoteBackend(mpRemoteBackend);
+        }
+    }
     mptLoopClosing = new thread(&ORB_SLAM3::LoopClosing::Run, mpLoopCloser);
 
     //Set pointers between threads
@@ -235,6 +267,11 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
         mpLoopCloser->mpViewer = mpViewer;
         mpViewer->both = mpFrameDrawer->both;
     }
+    else
+    {
+        // Headless: no per-frame image, keypoint and pose copies for drawers nobody reads
+        SetDrawerUpdateInterval(0);
+    }
 
     // Fix verbosity
     Verbose::SetTh(Verbose::VERBOSITY_QUIET);
@@ -545,10 +582,18 @@ void System::Shutdown()
         /*usleep(5000);
     }*/
 
+    // A checkpoint being written is completed
+    if(mptCheckpoint)
+    {
+        mptCheckpoint->join();
+        delete mptCheckpoint;
+        mptCheckpoint = NULL;
+    }
+
     if(!mStrSaveAtlasToFile.empty())
     {
         Verbose::PrintMess("Atlas saving to file " + mStrSaveAtlasToFile, Verbose::VERBOSITY_NORMAL);
-        SaveAtlas(FileType::BINARY_FILE);
+        SaveAtlas(FileType::ATLAS_FILE);
     }
 
     /*if(mpViewer)
@@ -558,6 +603,10 @@ void System::Shutdown()
     mpTracker->PrintTimeStats();
 #endif
 
+#ifdef ENABLE_LOCK_PROFILING
+    LockProfiler::PrintStatistics(cout);
+#endif
+    PmuCounters::PrintStatistics(cout);
 
 }
 
@@ -675,10 +724,10 @@ void System::SaveTrajectoryEuRoC(const string &filename)
     std::cout << "There are " << std::to_string(vpMaps.size()) << " maps in the atlas" << std::endl;
     for(Map* pMap :vpMaps)
     {
-        std::cout << "  Map " << std::to_string(pMap->GetId()) << " has " << std::to_string(pMap->GetAllKeyFrames().size()) << " KFs" << std::endl;
-        if(pMap->GetAllKeyFrames().size() > numMaxKFs)
+        std::cout << "  Map " << std::to_string(pMap->GetId()) << " has " << std::to_string(pMap->KeyFramesInMap()) << " KFs" << std::endl;
+        if(pMap->KeyFramesInMap() > numMaxKFs)
         {
-            numMaxKFs = pMap->GetAllKeyFrames().size();
+            numMaxKFs = pMap->KeyFramesInMap();
             pBiggerMap = pMap;
         }
     }
@@ -896,9 +945,9 @@ void System::SaveTrajectoryEuRoC(const string &filename, Map* pMap)
     int numMaxKFs = 0;
     for(Map* pMap :vpMaps)
     {
-        if(pMap->GetAllKeyFrames().size() > numMaxKFs)
+        if(pMap->KeyFramesInMap() > numMaxKFs)
         {
-            numMaxKFs = pMap->GetAllKeyFrames().size();
+            numMaxKFs = pMap->KeyFramesInMap();
             pBiggerMap = pMap;
         }
     }
@@ -1011,9 +1060,9 @@ void System::SaveTrajectoryEuRoC(const string &filename, Map* pMap)
     int numMaxKFs = 0;
     for(Map* pMap :vpMaps)
     {
-        if(pMap->GetAllKeyFrames().size() > numMaxKFs)
+        if(pMap->KeyFramesInMap() > numMaxKFs)
         {
-            numMaxKFs = pMap->GetAllKeyFrames().size();
+            numMaxKFs = pMap->KeyFramesInMap();
             pBiggerMap = pMap;
         }
     }
@@ -1063,9 +1112,9 @@ void System::SaveKeyFrameTrajectoryEuRoC(const string &filename)
     int numMaxKFs = 0;
     for(Map* pMap :vpMaps)
     {
-        if(pMap && pMap->GetAllKeyFrames().size() > numMaxKFs)
+        if(pMap && pMap->KeyFramesInMap() > numMaxKFs)
         {
-            numMaxKFs = pMap->GetAllKeyFrames().size();
+            numMaxKFs = pMap->KeyFramesInMap();
             pBiggerMap = pMap;
         }
     }
@@ -1383,6 +1432,18 @@ float System::GetImageScale()
     return mpTracker->GetImageScale();
 }
 
+void System::SetDrawerUpdateInterval(int nFrames)
+{
+    mpFrameDrawer->SetUpdateInterval(nFrames);
+    // The camera pose is a single copy, kept current whenever anything is drawn
+    mpMapDrawer->SetUpdateEnabled(nFrames>0);
+}
+
+void System::SetStereoDepth(StereoDepthGPU* pStereoDepth)
+{
+    mpTracker->SetStereoDepth(pStereoDepth);
+}
+
 #ifdef REGISTER_TIMES
 void System::InsertRectTime(double& time)
 {
@@ -1412,7 +1473,7 @@ void System::SaveAtlas(int type){
         pathSaveFileName = pathSaveFileName.append(mStrSaveAtlasToFile);
         pathSaveFileName = pathSaveFileName.append(".osa");
 
-        string strVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath,TEXT_FILE);
+        string strVocabularyChecksum = GetVocabularyCheckSum();
         std::size_t found = mStrVocabularyFilePath.find_last_of("/\\");
         string strVocabularyName = mStrVocabularyFilePath.substr(found+1);
 
@@ -1439,6 +1500,13 @@ void System::SaveAtlas(int type){
             oa << mpAtlas;
             cout << "End to write save binary file" << endl;
         }
+        else if(type == ATLAS_FILE)
+        {
+            cout << "Starting to write the atlas file" << endl;
+            if(!mpAtlas->SaveToFile(pathSaveFileName, strVocabularyName, strVocabularyChecksum))
+                cout << "Error writing the atlas file" << endl;
+            cout << "End to write the atlas file" << endl;
+        }
     }
 }
 
@@ -1451,6 +1519,10 @@ bool System::LoadAtlas(int type)
     pathLoadFileName = pathLoadFileName.append(mStrLoadAtlasFromFile);
     pathLoadFileName = pathLoadFileName.append(".osa");
 
+    // The atlas file and the binary archive share the extension
+    if(type == BINARY_FILE && Atlas::IsAtlasFile(pathLoadFileName))
+        type = ATLAS_FILE;
+
     if(type == TEXT_FILE) // File text
     {
         cout << "Starting to read the save text file " << endl;
@@ -1483,11 +1555,28 @@ bool System::LoadAtlas(int type)
         cout << "End to load the save binary file" << endl;
         isRead = true;
     }
+    else if(type == ATLAS_FILE)
+    {
+        cout << "Starting to read the atlas file" << endl;
+        mpAtlas = new Atlas();
+        if(settings_)
+        {
+            mpAtlas->SetMapCells(settings_->mapCellSize(), (size_t)settings_->mapResidentMB() << 20);
+            mpAtlas->SetMemoryBudget((size_t)settings_->memoryBudgetMB() << 20);
+        }
+        if(!mpAtlas->LoadFromFile(pathLoadFileName, strFileVoc, strVocChecksum))
+        {
+            cout << "Error to read the atlas file" << endl;
+            return false;
+        }
+        cout << "End to load the atlas file" << endl;
+        isRead = true;
+    }
 
     if(isRead)
     {
         //Check if the vocabulary is the same
-        string strInputVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath,TEXT_FILE);
+        string strInputVocabularyChecksum = GetVocabularyCheckSum();
 
         if(strInputVocabularyChecksum.compare(strVocChecksum) != 0)
         {
@@ -1505,6 +1594,183 @@ bool System::LoadAtlas(int type)
     return false;
 }
 
+bool System::SaveMap(const string &filename)
+{
+    unique_lock<mutex> lockSnapshot(mMutexSnapshot);
+
+    // Keep Local Mapping from changing the map while it is saved
+    mpLocalMapper->RequestStop();
+    while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+        usleep(1000);
+
+    string strVocabularyChecksum = GetVocabularyCheckSum();
+    std::size_t found = mStrVocabularyFilePath.find_last_of("/\\");
+    string strVocabularyName = mStrVocabularyFilePath.substr(found+1);
+
+    bool bSaved;
+    {
+        unique_lock<ProfiledMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+        mpAtlas->PreSave();
+        bSaved = mpAtlas->SaveToFile(filename, strVocabularyName, strVocabularyChecksum);
+    }
+
+    mpLocalMapper->Release();
+
+    if(!bSaved)
+        cout << "Error writing the atlas file " << filename << endl;
+    return bSaved;
+}
+
+void System::SetRealTime(bool bRealTime)
+{
+    mpLocalMapper->SetRealTime(bRealTime);
+}
+
+void System::RunGlobalBundleAdjustment(int nIterations)
+{
+    // Let Local Mapping work off its queue and a Global BA of the loop closing finish
+    while(!mpLocalMapper->isFinished() && (mpLocalMapper->KeyframesInQueue()>0 || !mpLocalMapper->AcceptKeyFrames()))
+        usleep(5000);
+    while(mpLoopCloser->isRunningGBA())
+        usleep(5000);
+
+    mpLocalMapper->RequestStop();
+    while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+        usleep(1000);
+
+    vector<Map*> vpMaps = mpAtlas->GetAllMaps();
+    for(Map* pMap : vpMaps)
+    {
+        if(pMap->IsBad() || pMap->KeyFramesInMap()<2)
+            continue;
+
+        cout << "Global BA of map " << pMap->GetId() << " with " << pMap->KeyFramesInMap() << " keyframes" << endl;
+        // Optimized in place, the origin keyframe as loop keyframe of the visual BA
+        if(pMap->isImuInitialized())
+            Optimizer::FullInertialBA(pMap,nIterations,false,0,NULL);
+        else
+            Optimizer::GlobalBundleAdjustemnt(pMap,nIterations,NULL,pMap->GetOriginKF()->mnId,false);
+        pMap->InformNewBigChange();
+    }
+
+    mpLocalMapper->Release();
+}
+
+bool System::Checkpoint(const string &filename, size_t nBytesPerSecond)
+{
+    if(mbCheckpointing)
+        return false;
+    if(mptCheckpoint)
+    {
+        mptCheckpoint->join();
+        delete mptCheckpoint;
+    }
+
+    mbCheckpointing = true;
+    mptCheckpoint = new thread([this, filename, nBytesPerSecond]()
+    {
+        // Lowest CPU and disk priority, the serialization threads inherit it
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+        syscall(SYS_ioprio_set, 1 /*IOPRIO_WHO_PROCESS*/, syscall(SYS_gettid), 3 << 13 /*IOPRIO_CLASS_IDLE*/);
+
+        string strVocabularyChecksum = GetVocabularyCheckSum();
+        std::size_t found = mStrVocabularyFilePath.find_last_of("/\\");
+        string strVocabularyName = mStrVocabularyFilePath.substr(found+1);
+
+        // Snapshot: with Loop Closing held and Local Mapping stopped, Tracking does not change the maps and
+        // keeps running, the map update mutex is not taken
+        Atlas::FileSnapshot snapshot;
+        bool bSnapshot;
+        {
+            unique_lock<mutex> lockSnapshot(mMutexSnapshot);
+            mpLoopCloser->RequestHold();
+            while(!mpLoopCloser->isHeld() && !mpLoopCloser->isFinished())
+                usleep(1000);
+            mpLocalMapper->RequestStop();
+            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+                usleep(1000);
+
+            mpAtlas->PreSave();
+            bSnapshot = mpAtlas->TakeSnapshot(strVocabularyName, strVocabularyChecksum, snapshot);
+
+            mpLocalMapper->Release();
+            mpLoopCloser->ReleaseHold();
+        }
+
+        if(!bSnapshot || !Atlas::WriteSnapshot(snapshot, filename, nBytesPerSecond))
+            cout << "Error writing the checkpoint " << filename << endl;
+        mbCheckpointing = false;
+    });
+    return true;
+}
+
+bool System::isCheckpointing()
+{
+    return mbCheckpointing;
+}
+
+bool System::LoadMap(const string &filename)
+{
+    if(mpAtlas->CountMaps()>1 || mpAtlas->KeyFramesInMap()>0)
+    {
+        cout << "An atlas file can only be loaded before tracking starts" << endl;
+        return false;
+    }
+
+    mpLocalMapper->RequestStop();
+    while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+        usleep(1000);
+
+    string strFileVoc, strVocChecksum;
+    mpAtlas->clearAtlas();
+    bool isRead = mpAtlas->LoadFromFile(filename, strFileVoc, strVocChecksum);
+    if(isRead && GetVocabularyCheckSum().compare(strVocChecksum) != 0)
+    {
+        cout << "The vocabulary load isn't the same which the load session was created " << endl;
+        cout << "-Vocabulary name: " << strFileVoc << endl;
+        isRead = false;
+    }
+
+    if(isRead)
+    {
+        mpAtlas->SetKeyFrameDababase(mpKeyFrameDatabase);
+        mpAtlas->SetORBVocabulary(mpVocabulary);
+        mpAtlas->PostLoad();
+    }
+
+    // Continue in a new map, as after loading an atlas at start up
+    mpAtlas->CreateNewMap();
+
+    mpLocalMapper->Release();
+    return isRead;
+}
+
+bool System::LoadVocabulary(const string &strVocFile)
+{
+    mpVocabulary = new ORBVocabulary();
+    mStrVocabularyChecksum.clear();
+
+    const string strBinExt = ".bin";
+    bool bLoaded;
+    if(strVocFile.size()>=strBinExt.size() &&
+       strVocFile.compare(strVocFile.size()-strBinExt.size(), strBinExt.size(), strBinExt)==0)
+        bLoaded = mpVocabulary->loadFromBinaryFile(strVocFile, &mStrVocabularyChecksum);
+    else
+        bLoaded = mpVocabulary->loadFromTextFile(strVocFile);
+
+    // The vocabulary lives as long as the process
+    if(bLoaded)
+        MemoryAccounting::Add(MemoryBreakdown::VOCABULARY, mpVocabulary->getMemoryBytes());
+    return bLoaded;
+}
+
+string System::GetVocabularyCheckSum()
+{
+    if(mStrVocabularyChecksum.empty())
+        mStrVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath,TEXT_FILE);
+    return mStrVocabularyChecksum;
+}
+
 string System::CalculateCheckSum(string filename, int type)
 {
     string checksum = "";
@@ -0,0 +1,313 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Trace.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+struct Event
+{
+    uint64_t nTimestamp;                // CLOCK_MONOTONIC, ns
+    const char* pName;
+    int64_t nValue;                     // Argument of spans and instants, value of counters, id of flows
+    int32_t nThreadId;
+    uint8_t type;
+};
+
+// Ring of a thread. Only its thread writes; nWritten is published after each event so the
+// exporter knows which slots hold complete events. Returned to the pool when the thread exits,
+// its events stay exportable as they carry their thread id.
+struct ThreadBuffer
+{
+    vector<Event> vEvents;
+    uint64_t nMask;
+    atomic<uint64_t> nWritten;
+
+    explicit ThreadBuffer(size_t nEvents): vEvents(nEvents), nMask(nEvents-1), nWritten(0) {}
+};
+
+// Never destroyed, threads may record while the statics are destroyed
+struct Registry
+{
+    mutex mMutex;
+    vector<unique_ptr<ThreadBuffer>> vpBuffers;
+    vector<ThreadBuffer*> vpFree;
+    map<int32_t, string> mThreadNames;
+    size_t nEventsPerThread = 1 << 16;
+    atomic<uint64_t> nStartTime{0};
+};
+
+Registry &GetRegistry()
+{
+    static Registry* pRegistry = new Registry();
+    return *pRegistry;
+}
+
+inline uint64_t Now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int32_t CurrentThreadId()
+{
+    return (int32_t)syscall(SYS_gettid);
+}
+
+// Ring of the calling thread, handed back when it exits
+struct ThreadSlot
+{
+    ThreadBuffer* pBuffer = nullptr;
+    int32_t nThreadId = 0;
+
+    ~ThreadSlot()
+    {
+        if(!pBuffer)
+            return;
+        Registry &registry = GetRegistry();
+        unique_lock<mutex> lock(registry.mMutex);
+        registry.vpFree.push_back(pBuffer);
+    }
+};
+
+thread_local ThreadSlot tSlot;
+
+ThreadBuffer* AcquireBuffer(int32_t nThreadId)
+{
+    Registry &registry = GetRegistry();
+    unique_lock<mutex> lock(registry.mMutex);
+
+    // The kernel name, unless SetThreadName() named the thread
+    if(!registry.mThreadNames.count(nThreadId))
+    {
+        char name[16] = {0};
+        if(pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 && name[0])
+            registry.mThreadNames[nThreadId] = name;
+    }
+
+    for(size_t i=0; i<registry.vpFree.size(); i++)
+    {
+        if(registry.vpFree[i]->vEvents.size() == registry.nEventsPerThread)
+        {
+            ThreadBuffer* pBuffer = registry.vpFree[i];
+            registry.vpFree.erase(registry.vpFree.begin()+i);
+            return pBuffer;
+        }
+    }
+    registry.vpBuffers.emplace_back(new ThreadBuffer(registry.nEventsPerThread));
+    return registry.vpBuffers.back().get();
+}
+
+void WriteString(ostream &f, const char* s)
+{
+    f << '"';
+    for(; s && *s; s++)
+    {
+        if(*s == '"' || *s == '\\')
+            f << '\\' << *s;
+        else if((unsigned char)*s < 0x20)
+            f << ' ';
+        else
+            f << *s;
+    }
+    f << '"';
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::sbEnabled(false);
+
+void Tracer::Start(size_t nEventsPerThread)
+{
+    Registry &registry = GetRegistry();
+    {
+        unique_lock<mutex> lock(registry.mMutex);
+        size_t n = 16;
+        while(n < nEventsPerThread)
+            n <<= 1;
+        registry.nEventsPerThread = n;
+    }
+    registry.nStartTime.store(Now(), std::memory_order_relaxed);
+    sbEnabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::Stop()
+{
+    sbEnabled.store(false, std::memory_order_relaxed);
+}
+
+void Tracer::SetThreadName(const char* name)
+{
+    Registry &registry = GetRegistry();
+    unique_lock<mutex> lock(registry.mMutex);
+    registry.mThreadNames[CurrentThreadId()] = name;
+}
+
+int64_t Tracer::FlowId(double timestamp)
+{
+    return (int64_t)llround(timestamp*1e9);
+}
+
+void Tracer::Write(EventType type, const char* name, int64_t value)
+{
+    ThreadSlot &slot = tSlot;
+    if(!slot.pBuffer)
+    {
+        slot.nThreadId = CurrentThreadId();
+        slot.pBuffer = AcquireBuffer(slot.nThreadId);
+    }
+
+    ThreadBuffer &buffer = *slot.pBuffer;
+    const uint64_t n = buffer.nWritten.load(std::memory_order_relaxed);
+    Event &event = buffer.vEvents[n & buffer.nMask];
+    event.nTimestamp = Now();
+    event.pName = name;
+    event.nValue = value;
+    event.nThreadId = slot.nThreadId;
+    event.type = type;
+    buffer.nWritten.store(n+1, std::memory_order_release);
+}
+
+bool Tracer::ExportChromeTrace(const std::string &filename)
+{
+    Registry &registry = GetRegistry();
+
+    // Copy the rings, then drop the events that were overwritten during the copy
+    vector<Event> vEvents;
+    map<int32_t, string> mThreadNames;
+    {
+        unique_lock<mutex> lock(registry.mMutex);
+        mThreadNames = registry.mThreadNames;
+        for(const unique_ptr<ThreadBuffer> &pBuffer : registry.vpBuffers)
+        {
+            const ThreadBuffer &buffer = *pBuffer;
+            const uint64_t nCapacity = buffer.vEvents.size();
+            const uint64_t nEnd = buffer.nWritten.load(std::memory_order_acquire);
+            const uint64_t nBegin = nEnd > nCapacity ? nEnd - nCapacity : 0;
+            const size_t nCopied = vEvents.size();
+            for(uint64_t i=nBegin; i<nEnd; i++)
+                vEvents.push_back(buffer.vEvents[i & buffer.nMask]);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t nNow = buffer.nWritten.load(std::memory_order_relaxed);
+            const uint64_t nValid = nNow > nCapacity ? nNow - nCapacity : 0;
+            if(nValid > nBegin)
+                vEvents.erase(vEvents.begin()+nCopied, vEvents.begin()+nCopied+std::min(nValid, nEnd)-nBegin);
+        }
+    }
+
+    ofstream f(filename.c_str());
+    if(!f.is_open())
+    {
+        cerr << "Tracer: cannot write " << filename << endl;
+        return false;
+    }
+
+    const int pid = getpid();
+    const uint64_t nStartTime = registry.nStartTime.load(std::memory_order_relaxed);
+    f << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << endl;
+    bool bFirst = true;
+    for(const auto &thread : mThreadNames)
+    {
+        f << (bFirst ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+          << ",\"tid\":" << thread.first << ",\"args\":{\"name\":";
+        WriteString(f, thread.second.c_str());
+        f << "}}";
+        bFirst = false;
+    }
+
+    // Ends whose begin was overwritten, or recorded before Start(), are dropped so the spans nest
+    map<int32_t, int> mDepth;
+    char ts[32];
+    for(const Event &event : vEvents)
+    {
+        if(event.nTimestamp < nStartTime)
+            continue;
+        int &depth = mDepth[event.nThreadId];
+        if(event.type == END && depth == 0)
+            continue;
+        snprintf(ts, sizeof(ts), "%.3f", (event.nTimestamp - nStartTime)*1e-3);
+
+        f << (bFirst ? "" : ",\n") << "{\"pid\":" << pid << ",\"tid\":" << event.nThreadId << ",\"ts\":" << ts;
+        bFirst = false;
+        switch(event.type)
+        {
+        case BEGIN:
+            depth++;
+            f << ",\"ph\":\"B\",\"name\":";
+            WriteString(f, event.pName);
+            if(event.nValue)
+                f << ",\"args\":{\"value\":" << event.nValue << "}";
+            break;
+        case END:
+            depth--;
+            f << ",\"ph\":\"E\"";
+            break;
+        case INSTANT:
+            f << ",\"ph\":\"i\",\"s\":\"t\",\"name\":";
+            WriteString(f, event.pName);
+            f << ",\"args\":{\"value\":" << event.nValue << "}";
+            break;
+        case COUNTER:
+            f << ",\"ph\":\"C\",\"name\":";
+            WriteString(f, event.pName);
+            f << ",\"args\":{\"value\":" << event.nValue << "}";
+            break;
+        default:
+            // Flows bind to the span enclosing them
+            f << ",\"ph\":\"" << (event.type == FLOW_START ? 's' : event.type == FLOW_STEP ? 't' : 'f')
+              << "\",\"bp\":\"e\",\"cat\":\"flow\",\"id\":\"0x" << std::hex << event.nValue << std::dec
+              << "\",\"name\":";
+            WriteString(f, event.pName);
+            break;
+        }
+        f << "}";
+    }
+    f << endl << "]}" << endl;
+
+    f.close();
+    if(f.fail())
+    {
+        cerr << "Tracer: failed to write " << filename << endl;
+        return false;
+    }
+    cout << "Tracer: " << vEvents.size() << " events written to " << filename << endl;
+    return true;
+}
+
+} //namespace ORB_SLAM
@@ -28,11 +28,15 @@
 #include "KannalaBrandt8.h"
 #include "MLPnPsolver.h"
 #include "GeometricTools.h"
+#include "Trace.h"
 
 #include <iostream>
 
 #include <mutex>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 
 
 using namespace std;
@@ -46,8 +50,12 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     mbOnlyTracking(false), mbMapUpdated(false), mbVO(false), mpORBVocabulary(pVoc), mpKeyFrameDB(pKFDB),
     mbReadyToInitializate(false), mpSystem(pSys), mpViewer(NULL), bStepByStep(false),
     mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpAtlas(pAtlas), mnLastRelocFrameId(0), time_recently_lost(5.0),
-    mnInitialFrameId(0), mbCreatedMap(false), mnFirstFrameId(0), mpCamera2(nullptr), mpLastKeyFrame(static_cast<KeyFrame*>(NULL))
+    mnInitialFrameId(0), mbCreatedMap(false), mnFirstFrameId(0), mpCamera2(nullptr), mpLastKeyFrame(static_cast<KeyFrame*>(NULL)),
+    mpLocalMapper(NULL), mnMaxLocalKeyFrames(80), mpStereoDepth(nullptr), mbPosePrediction(false), mbRelocalizationPrior(false),
+    mnAtlasRelocMaps(0)
 {
+    mLocalMapCache.bValid = false;
+
     // Load camera parameters from settings file
     if(settings){
         newParameterLoader(settings);
@@ -94,6 +102,19 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
         }
     }
 
+    // Signs of the SuperPoint descriptors are the words of the vocabulary and of the keyframe
+    // database, frames need no ORB extraction for the bag of words
+    mpORBextractorLeft->SetDescriptorMode(TPUFeatureExtractor::DescriptorMode::BINARY_BILINEAR);
+    if(mSensor==System::STEREO || mSensor==System::IMU_STEREO)
+        mpORBextractorRight->SetDescriptorMode(TPUFeatureExtractor::DescriptorMode::BINARY_BILINEAR);
+    if(mSensor==System::MONOCULAR || mSensor==System::IMU_MONOCULAR)
+        mpIniORBextractor->SetDescriptorMode(TPUFeatureExtractor::DescriptorMode::BINARY_BILINEAR);
+
+    if(mpORBVocabulary->getDescriptorName()!=DBoW2::FSuperPoint::NAME)
+        std::cout << "Warning: the vocabulary was trained on " << mpORBVocabulary->getDescriptorName()
+                  << " descriptors, place recognition works best with a SuperPoint vocabulary "
+                  << "(tools/train_superpoint_vocabulary)" << std::endl;
+
     initID = 0; lastID = 0;
     mbInitWith3KFs = false;
     mnNumDataset = 0;
@@ -215,8 +236,8 @@ void Tracking::TrackStats2File()
     ofstream f;
     f.open("SessionInfo.txt");
     f << fixed;
-    f << "Number of KFs: " << mpAtlas->GetAllKeyFrames().size() << endl;
-    f << "Number of MPs: " << mpAtlas->GetAllMapPoints().size() << endl;
+    f << "Number of KFs: " << mpAtlas->KeyFramesInMap() << endl;
+    f << "Number of MPs: " << mpAtlas->MapPointsInMap() << endl;
 
     f << "OpenCV version: " << CV_VERSION << endl;
 
@@ -406,22 +427,22 @@ void Tracking::PrintTimeStats()
     // Map complexity
     std::cout << "---------------------------" << std::endl;
     std::cout << std::endl << "Map complexity" << std::endl;
-    std::cout << "KFs in map: " << mpAtlas->GetAllKeyFrames().size() << std::endl;
-    std::cout << "MPs in map: " << mpAtlas->GetAllMapPoints().size() << std::endl;
+    std::cout << "KFs in map: " << mpAtlas->KeyFramesInMap() << std::endl;
+    std::cout << "MPs in map: " << mpAtlas->MapPointsInMap() << std::endl;
     f << "---------------------------" << std::endl;
     f << std::endl << "Map complexity" << std::endl;
     vector<Map*> vpMaps = mpAtlas->GetAllMaps();
     Map* pBestMap = vpMaps[0];
     for(int i=1; i<vpMaps.size(); ++i)
     {
-        if(pBestMap->GetAllKeyFrames().size() < vpMaps[i]->GetAllKeyFrames().size())
+        if(pBestMap->KeyFramesInMap() < vpMaps[i]->KeyFramesInMap())
         {
             pBestMap = vpMaps[i];
         }
     }
 
-    f << "KFs in map: " << pBestMap->GetAllKeyFrames().size() << std::endl;
-    f << "MPs in map: " << pBestMap->GetAllMapPoints().size() << std::endl;
+    f << "KFs in map: " << pBestMap->KeyFramesInMap() << std::endl;
+    f << "MPs in map: " << pBestMap->MapPointsInMap() << std::endl;
 
     f << "---------------------------" << std::endl;
     f << std::endl << "Place Recognition (mean$\\pm$std)" << std::endl;
@@ -565,7 +586,8 @@ void Tracking::newParameterLoader(Settings *settings) {
 
         mTlr = settings->Tlr();
 
-        mpFrameDrawer->both = true;
+        if(mpFrameDrawer)
+            mpFrameDrawer->both = true;
     }
 
     if(mSensor==System::STEREO || mSensor==System::RGBD || mSensor==System::IMU_STEREO || mSensor==System::IMU_RGBD ){
@@ -1087,7 +1109,8 @@ bool Tracking::ParseCamParamFile(cv::FileStorage &fSettings)
                 static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[0] = leftLappingBegin;
                 static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[1] = leftLappingEnd;
 
-                mpFrameDrawer->both = true;
+                if(mpFrameDrawer)
+                    mpFrameDrawer->both = true;
 
                 vector<float> vCamCalib2{fx,fy,cx,cy,k1,k2,k3,k4};
                 mpCamera2 = new KannalaBrandt8(vCamCalib2);
@@ -1439,6 +1462,90 @@ void Tracking::SetViewer(Viewer *pViewer)
     mpViewer=pViewer;
 }
 
+void Tracking::SetMaxLocalKeyFrames(int n)
+{
+    mnMaxLocalKeyFrames = std::max(n, 1);
+    mLocalMapCache.bValid = false;
+}
+
+int Tracking::GetMaxLocalKeyFrames()
+{
+    return mnMaxLocalKeyFrames;
+}
+
+void Tracking::SetParallelFor(const ORBmatcher::ParallelFor& parallelFor)
+{
+    mParallelFor = parallelFor;
+}
+
+void Tracking::SetBowSubmit(const BowCache::Submit& submit)
+{
+    mBowSubmit = submit;
+}
+
+void Tracking::SetStereoDepth(StereoDepthGPU* pStereoDepth)
+{
+    mpStereoDepth = pStereoDepth;
+}
+
+void Tracking::RunParallel(int n, const std::function<void(int)>& job)
+{
+    if(mParallelFor)
+        mParallelFor(n, job);
+    else
+        for(int i=0; i<n; i++)
+            job(i);
+}
+
+void Tracking::SetPosePrediction(const Sophus::SE3f &Tcw, const Eigen::Matrix<float,6,6> &covariance, const double &timestamp)
+{
+    unique_lock<mutex> lock(mMutexPosePrediction);
+    mPredictedTcw = Tcw;
+    mPredictedCovariance = covariance;
+    mPredictionTimestamp = timestamp;
+    mbPosePrediction = true;
+}
+
+void Tracking::ClearPosePrediction()
+{
+    unique_lock<mutex> lock(mMutexPosePrediction);
+    mbPosePrediction = false;
+}
+
+void Tracking::SetRelocalizationPrior(const Sophus::SE3f &Tcw, const Eigen::Matrix<float,6,6> &covariance)
+{
+    unique_lock<mutex> lock(mMutexRelocalizationPrior);
+    mRelocalizationPriorTcw = Tcw;
+    mRelocalizationPriorCovariance = covariance;
+    mbRelocalizationPrior = true;
+}
+
+void Tracking::ClearRelocalizationPrior()
+{
+    unique_lock<mutex> lock(mMutexRelocalizationPrior);
+    mbRelocalizationPrior = false;
+}
+
+void Tracking::SetAtlasRelocalization(int nMaps)
+{
+    mnAtlasRelocMaps = std::max(nMaps, 0);
+}
+
+bool Tracking::TakePosePrediction(Sophus::SE3f &Tcw, Eigen::Matrix<float,6,6> &covariance)
+{
+    unique_lock<mutex> lock(mMutexPosePrediction);
+    if(!mbPosePrediction)
+        return false;
+
+    mbPosePrediction = false;
+    if(fabs(mPredictionTimestamp-mCurrentFrame.mTimeStamp)>1e-4)
+        return false;
+
+    Tcw = mPredictedTcw;
+    covariance = mPredictedCovariance;
+    return true;
+}
+
 void Tracking::SetStepByStep(bool bSet)
 {
     bStepByStep = bSet;
@@ -1490,15 +1597,18 @@ Sophus::SE3f Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat
 
     //cout << "Incoming frame creation" << endl;
 
+    TRACE_BEGIN("Frame");
     if (mSensor == System::STEREO && !mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera);
+        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,static_cast<Frame*>(NULL),IMU::Calib(),mpStereoDepth);
     else if(mSensor == System::STEREO && mpCamera2)
         mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr);
     else if(mSensor == System::IMU_STEREO && !mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,&mLastFrame,*mpImuCalib);
+        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,&mLastFrame,*mpImuCalib,mpStereoDepth);
     else if(mSensor == System::IMU_STEREO && mpCamera2)
         mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr,&mLastFrame,*mpImuCalib);
 
+    TRACE_END();
+
     //cout << "Incoming frame ended" << endl;
 
     mCurrentFrame.mNameFile = filename;
@@ -1540,10 +1650,12 @@ Sophus::SE3f Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, co
     if((fabs(mDepthMapFactor-1.0f)>1e-5) || imDepth.type()!=CV_32F)
         imDepth.convertTo(imDepth,CV_32F,mDepthMapFactor);
 
+    TRACE_BEGIN("Frame");
     if (mSensor == System::RGBD)
         mCurrentFrame = Frame(mImGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera);
     else if(mSensor == System::IMU_RGBD)
         mCurrentFrame = Frame(mImGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,&mLastFrame,*mpImuCalib);
+    TRACE_END();
 
 
 
@@ -1581,6 +1693,7 @@ Sophus::SE3f Tracking::GrabImageMonocular(const cv::Mat &im, const double &times
             cvtColor(mImGray,mImGray,cv::COLOR_BGRA2GRAY);
     }
 
+    TRACE_BEGIN("Frame");
     if (mSensor == System::MONOCULAR)
     {
         if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET ||(lastID - initID) < mMaxFrames)
@@ -1597,6 +1710,7 @@ Sophus::SE3f Tracking::GrabImageMonocular(const cv::Mat &im, const double &times
         else
             mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mpCamera,mDistCoef,mbf,mThDepth,&mLastFrame,*mpImuCalib);
     }
+    TRACE_END();
 
     if (mState==NO_IMAGES_YET)
         t0=timestamp;
@@ -1617,12 +1731,13 @@ Sophus::SE3f Tracking::GrabImageMonocular(const cv::Mat &im, const double &times
 
 void Tracking::GrabImuData(const IMU::Point &imuMeasurement)
 {
-    unique_lock<mutex> lock(mMutexImuQueue);
+    unique_lock<ProfiledMutex> lock(mMutexImuQueue);
     mlQueueImuData.push_back(imuMeasurement);
 }
 
 void Tracking::PreintegrateIMU()
 {
+    TRACE_SCOPE("PreintegrateIMU");
 
     if(!mCurrentFrame.mpPrevFrame)
     {
@@ -1644,7 +1759,7 @@ void Tracking::PreintegrateIMU()
     {
         bool bSleep = false;
         {
-            unique_lock<mutex> lock(mMutexImuQueue);
+            unique_lock<ProfiledMutex> lock(mMutexImuQueue);
             if(!mlQueueImuData.empty())
             {
                 IMU::Point* m = &mlQueueImuData.front();
@@ -1793,6 +1908,8 @@ void Tracking::ResetFrameIMU()
 
 void Tracking::Track()
 {
+    TRACE_SCOPE_VALUE("Track", mCurrentFrame.mnId);
+    TRACE_FLOW_STEP(mCurrentFrame.mTimeStamp);
 
     if (bStepByStep)
     {
@@ -1802,6 +1919,14 @@ void Tracking::Track()
         mbStep = false;
     }
 
+    // The previous frame is done with the map points it matched, culled ones age by a frame
+    Map::NotifyTrackedFrame();
+
+    // Relocalization, the reference keyframe search and a new keyframe need the Bag of Words,
+    // start it while the frame is tracked
+    if(mBowSubmit && (mState!=OK || mCurrentFrame.mnId>=mnLastKeyFrameId+mMinFrames))
+        mCurrentFrame.ComputeBoWAsync(mBowSubmit);
+
     if(mpLocalMapper->mbBadImu)
     {
         cout << "TRACK: Reset map because local mapper set the bad imu flag " << endl;
@@ -1820,7 +1945,7 @@ void Tracking::Track()
         if(mLastFrame.mTimeStamp>mCurrentFrame.mTimeStamp)
         {
             cerr << "ERROR: Frame with a timestamp older than previous frame detected!" << endl;
-            unique_lock<mutex> lock(mMutexImuQueue);
+            unique_lock<ProfiledMutex> lock(mMutexImuQueue);
             mlQueueImuData.clear();
             CreateMapInAtlas();
             return;
@@ -1882,8 +2007,20 @@ void Tracking::Track()
     }
     mbCreatedMap = false;
 
+    // Relocalization in the other maps of the atlas changes the current map, so it runs before
+    // the map is locked: while a new map initializes, or tracking of the current one is lost
+    bool bRelocalizedInAtlas = false;
+    if(mnAtlasRelocMaps>0 && mpAtlas->CountMaps()>1 &&
+       (mState==NOT_INITIALIZED || (mState==RECENTLY_LOST && !mbOnlyTracking) || (mState==LOST && mbOnlyTracking)) &&
+       RelocalizationInAtlas())
+    {
+        bRelocalizedInAtlas = true;
+        mState = OK;
+        pCurrentMap = mpAtlas->GetCurrentMap();
+    }
+
     // Get Map Mutex -> Map cannot be changed
-    unique_lock<mutex> lock(pCurrentMap->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(pCurrentMap->mMutexMapUpdate);
 
     mbMapUpdated = false;
 
@@ -1911,7 +2048,7 @@ void Tracking::Track()
 
         if(mState!=OK) // If rightly initialized, mState=OK
         {
-            mLastFrame = Frame(mCurrentFrame);
+            mLastFrame = mCurrentFrame;
             return;
         }
 
@@ -1930,7 +2067,11 @@ void Tracking::Track()
 #endif
 
         // Initial camera pose estimation using motion model or relocalization (if tracking is lost)
-        if(!mbOnlyTracking)
+        if(bRelocalizedInAtlas)
+        {
+            bOK = true;
+        }
+        else if(!mbOnlyTracking)
         {
 
             // State OK
@@ -2197,11 +2338,16 @@ void Tracking::Track()
         vdLMTrack_ms.push_back(timeLMTrack);
 #endif
 
-        // Update drawer
-        mpFrameDrawer->Update(this);
-        if(mCurrentFrame.isSet())
+        // Update drawer, nothing is copied when tracking headless
+        if(mpFrameDrawer)
+            mpFrameDrawer->Update(this);
+        if(mpMapDrawer && mCurrentFrame.isSet())
             mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetPose());
 
+        // Page in the descriptors of the loaded map around the camera
+        if(bOK)
+            mpAtlas->UpdateMapCells(mpReferenceKF);
+
         if(bOK || mState==RECENTLY_LOST)
         {
             // Update motion model
@@ -2215,7 +2361,7 @@ void Tracking::Track()
                 mbVelocity = false;
             }
 
-            if(mSensor == System::IMU_MONOCULAR || mSensor == System::IMU_STEREO || mSensor == System::IMU_RGBD)
+            if(mpMapDrawer && (mSensor == System::IMU_MONOCULAR || mSensor == System::IMU_STEREO || mSensor == System::IMU_RGBD))
                 mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetPose());
 
             // Clean VO matches
@@ -2291,7 +2437,7 @@ void Tracking::Track()
         if(!mCurrentFrame.mpReferenceKF)
             mCurrentFrame.mpReferenceKF = mpReferenceKF;
 
-        mLastFrame = Frame(mCurrentFrame);
+        mLastFrame = mCurrentFrame;
     }
 
 
@@ -2334,6 +2480,7 @@ void Tracking::Track()
 
 void Tracking::StereoInitialization()
 {
+    TRACE_SCOPE("StereoInitialization");
     if(mCurrentFrame.N>500)
     {
         if (mSensor == System::IMU_STEREO || mSensor == System::IMU_RGBD)
@@ -2370,7 +2517,8 @@ void Tracking::StereoInitialization()
             mCurrentFrame.SetPose(Sophus::SE3f());
 
         // Create KeyFrame
-        KeyFrame* pKFini = new KeyFrame(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+        Map* pMap = mpAtlas->GetCurrentMap();
+        KeyFrame* pKFini = new(pMap) KeyFrame(mCurrentFrame,pMap,mpKeyFrameDB);
 
         // Insert KeyFrame in the map
         mpAtlas->AddKeyFrame(pKFini);
@@ -2384,7 +2532,7 @@ void Tracking::StereoInitialization()
                 {
                     Eigen::Vector3f x3D;
                     mCurrentFrame.UnprojectStereo(i, x3D);
-                    MapPoint* pNewMP = new MapPoint(x3D, pKFini, mpAtlas->GetCurrentMap());
+                    MapPoint* pNewMP = new(pMap) MapPoint(x3D, pKFini, pMap);
                     pNewMP->AddObservation(pKFini,i);
                     pKFini->AddMapPoint(pNewMP,i);
                     pNewMP->ComputeDistinctiveDescriptors();
@@ -2400,7 +2548,7 @@ void Tracking::StereoInitialization()
                 if(rightIndex != -1){
                     Eigen::Vector3f x3D = mCurrentFrame.mvStereo3Dpoints[i];
 
-                    MapPoint* pNewMP = new MapPoint(x3D, pKFini, mpAtlas->GetCurrentMap());
+                    MapPoint* pNewMP = new(pMap) MapPoint(x3D, pKFini, pMap);
 
                     pNewMP->AddObservation(pKFini,i);
                     pNewMP->AddObservation(pKFini,rightIndex + mCurrentFrame.Nleft);
@@ -2424,13 +2572,14 @@ void Tracking::StereoInitialization()
 
         mpLocalMapper->InsertKeyFrame(pKFini);
 
-        mLastFrame = Frame(mCurrentFrame);
+        mLastFrame = mCurrentFrame;
         mnLastKeyFrameId = mCurrentFrame.mnId;
         mpLastKeyFrame = pKFini;
         //mnLastRelocFrameId = mCurrentFrame.mnId;
 
         mvpLocalKeyFrames.push_back(pKFini);
         mvpLocalMapPoints=mpAtlas->GetAllMapPoints();
+        mLocalMapCache.bValid = false;
         mpReferenceKF = pKFini;
         mCurrentFrame.mpReferenceKF = pKFini;
 
@@ -2438,7 +2587,8 @@ void Tracking::StereoInitialization()
 
         mpAtlas->GetCurrentMap()->mvpKeyFrameOrigins.push_back(pKFini);
 
-        mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetPose());
+        if(mpMapDrawer)
+            mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetPose());
 
         mState=OK;
     }
@@ -2447,6 +2597,7 @@ void Tracking::StereoInitialization()
 
 void Tracking::MonocularInitialization()
 {
+    TRACE_SCOPE("MonocularInitialization");
 
     if(!mbReadyToInitializate)
     {
@@ -2454,8 +2605,8 @@ void Tracking::MonocularInitialization()
         if(mCurrentFrame.mvKeys.size()>100)
         {
 
-            mInitialFrame = Frame(mCurrentFrame);
-            mLastFrame = Frame(mCurrentFrame);
+            mInitialFrame = mCurrentFrame;
+            mLastFrame = mCurrentFrame;
             mvbPrevMatched.resize(mCurrentFrame.mvKeysUn.size());
             for(size_t i=0; i<mCurrentFrame.mvKeysUn.size(); i++)
                 mvbPrevMatched[i]=mCurrentFrame.mvKeysUn[i].pt;
@@ -2526,8 +2677,9 @@ void Tracking::MonocularInitialization()
 void Tracking::CreateInitialMapMonocular()
 {
     // Create KeyFrames
-    KeyFrame* pKFini = new KeyFrame(mInitialFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
-    KeyFrame* pKFcur = new KeyFrame(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+    Map* pMap = mpAtlas->GetCurrentMap();
+    KeyFrame* pKFini = new(pMap) KeyFrame(mInitialFrame,pMap,mpKeyFrameDB);
+    KeyFrame* pKFcur = new(pMap) KeyFrame(mCurrentFrame,pMap,mpKeyFrameDB);
 
     if(mSensor == System::IMU_MONOCULAR)
         pKFini->mpImuPreintegrated = (IMU::Preintegrated*)(NULL);
@@ -2548,7 +2700,7 @@ void Tracking::CreateInitialMapMonocular()
         //Create MapPoint.
         Eigen::Vector3f worldPos;
         worldPos << mvIniP3D[i].x, mvIniP3D[i].y, mvIniP3D[i].z;
-        MapPoint* pMP = new MapPoint(worldPos,pKFcur,mpAtlas->GetCurrentMap());
+        MapPoint* pMP = new(pMap) MapPoint(worldPos,pKFcur,pMap);
 
         pKFini->AddMapPoint(pMP,i);
         pKFcur->AddMapPoint(pMP,mvIniMatches[i]);
@@ -2632,6 +2784,7 @@ void Tracking::CreateInitialMapMonocular()
     mvpLocalKeyFrames.push_back(pKFcur);
     mvpLocalKeyFrames.push_back(pKFini);
     mvpLocalMapPoints=mpAtlas->GetAllMapPoints();
+    mLocalMapCache.bValid = false;
     mpReferenceKF = pKFcur;
     mCurrentFrame.mpReferenceKF = pKFcur;
 
@@ -2645,11 +2798,12 @@ void Tracking::CreateInitialMapMonocular()
     double aux = (mCurrentFrame.mTimeStamp-mLastFrame.mTimeStamp)/(mCurrentFrame.mTimeStamp-mInitialFrame.mTimeStamp);
     phi *= aux;
 
-    mLastFrame = Frame(mCurrentFrame);
+    mLastFrame = mCurrentFrame;
 
     mpAtlas->SetReferenceMapPoints(mvpLocalMapPoints);
 
-    mpMapDrawer->SetCurrentCameraPose(pKFcur->GetPose());
+    if(mpMapDrawer)
+        mpMapDrawer->SetCurrentCameraPose(pKFcur->GetPose());
 
     mpAtlas->GetCurrentMap()->mvpKeyFrameOrigins.push_back(pKFini);
 
@@ -2719,6 +2873,7 @@ void Tracking::CheckReplacedInLastFrame()
 
 bool Tracking::TrackReferenceKeyFrame()
 {
+    TRACE_SCOPE("TrackReferenceKeyFrame");
     // Compute Bag of Words vector
     mCurrentFrame.ComputeBoW();
 
@@ -2810,6 +2965,7 @@ void Tracking::UpdateLastFrame()
     // We insert all close points (depth<mThDepth)
     // If less than 100 close points, we insert the 100 closest ones.
     int nPoints = 0;
+    Map* pMap = mpAtlas->GetCurrentMap();
     for(size_t j=0; j<vDepthIdx.size();j++)
     {
         int i = vDepthIdx[j].second;
@@ -2834,7 +2990,7 @@ void Tracking::UpdateLastFrame()
                 x3D = mLastFrame.UnprojectStereoFishEye(i);
             }
 
-            MapPoint* pNewMP = new MapPoint(x3D,mpAtlas->GetCurrentMap(),&mLastFrame,i);
+            MapPoint* pNewMP = new(pMap) MapPoint(x3D,pMap,&mLastFrame,i);
             mLastFrame.mvpMapPoints[i]=pNewMP;
 
             mlpTemporalPoints.push_back(pNewMP);
@@ -2853,18 +3009,27 @@ void Tracking::UpdateLastFrame()
 
 bool Tracking::TrackWithMotionModel()
 {
+    TRACE_SCOPE("TrackWithMotionModel");
     ORBmatcher matcher(0.9,true);
 
     // Update last frame pose according to its reference keyframe
     // Create "visual odometry" points if in Localization Mode
     UpdateLastFrame();
 
+    Sophus::SE3f predictedTcw;
+    Eigen::Matrix<float,6,6> predictionCovariance;
+    const bool bPrediction = TakePosePrediction(predictedTcw, predictionCovariance);
+
     if (mpAtlas->isImuInitialized() && (mCurrentFrame.mnId>mnLastRelocFrameId+mnFramesToResetIMU))
     {
         // Predict state with IMU if it is initialized and it doesnt need reset
         PredictStateIMU();
         return true;
     }
+    else if(bPrediction)
+    {
+        mCurrentFrame.SetPose(predictedTcw);
+    }
     else
     {
         mCurrentFrame.SetPose(mVelocity * mLastFrame.GetPose());
@@ -2883,7 +3048,13 @@ bool Tracking::TrackWithMotionModel()
     else
         th=15;
 
-    int nmatches = matcher.SearchByProjection(mCurrentFrame,mLastFrame,th,mSensor==System::MONOCULAR || mSensor==System::IMU_MONOCULAR);
+    // With a predicted pose the window of each point covers its projection uncertainty on top of
+    // the keypoint error, from a few pixels in slow motion up to the wider fallback window
+    int nmatches;
+    if(bPrediction)
+        nmatches = matcher.SearchByProjection(mCurrentFrame,mLastFrame,3,mSensor==System::MONOCULAR || mSensor==System::IMU_MONOCULAR,predictionCovariance,2*th);
+    else
+        nmatches = matcher.SearchByProjection(mCurrentFrame,mLastFrame,th,mSensor==System::MONOCULAR || mSensor==System::IMU_MONOCULAR);
 
     // If few matches, uses a wider window search
     if(nmatches<20)
@@ -2948,6 +3119,7 @@ bool Tracking::TrackWithMotionModel()
 
 bool Tracking::TrackLocalMap()
 {
+    TRACE_SCOPE("TrackLocalMap");
 
     // We have an estimation of the camera pose and some map points tracked in the frame.
     // We retrieve the local map and try to find matches to points in the local map.
@@ -3101,6 +3273,11 @@ bool Tracking::NeedNewKeyFrame()
 
     // Local Mapping accept keyframes?
     bool bLocalMappingIdle = mpLocalMapper->AcceptKeyFrames();
+    // Mapping a recording offline, keyframes are decided as if local mapping kept up and tracking
+    // waits for it below
+    const bool bRealTime = mpLocalMapper->IsRealTime();
+    if(!bRealTime)
+        bLocalMappingIdle = true;
 
     // Check how many "close" points are being tracked and how many could be potentially created.
     int nNonTrackedClose = 0;
@@ -3186,18 +3363,27 @@ bool Tracking::NeedNewKeyFrame()
 
     if(((c1a||c1b||c1c) && c2)||c3 ||c4)
     {
+        if(!AcceptKeyFrame(c1c || c4 || mState==RECENTLY_LOST))
+            return false;
+
         // If the mapping accepts keyframes, insert keyframe.
         // Otherwise send a signal to interrupt BA
         if(bLocalMappingIdle || mpLocalMapper->IsInitializing())
         {
+            while(!bRealTime && mpLocalMapper->IsBacklogged() && !mpLocalMapper->isStopped() &&
+                  !mpLocalMapper->stopRequested() && !mpLocalMapper->isFinished())
+                usleep(1000);
             return true;
         }
         else
         {
-            mpLocalMapper->InterruptBA();
+            // A partial batch of queued keyframes waits for the BA, the keyframe that completes
+            // the batch interrupts it
+            if(mpLocalMapper->KeyframesInQueue()+1>=mpLocalMapper->GetKeyFrameBatchSize())
+                mpLocalMapper->InterruptBA();
             if(mSensor!=System::MONOCULAR  && mSensor!=System::IMU_MONOCULAR)
             {
-                if(mpLocalMapper->KeyframesInQueue()<3)
+                if(!mpLocalMapper->IsBacklogged())
                     return true;
                 else
                     return false;
@@ -3213,15 +3399,25 @@ bool Tracking::NeedNewKeyFrame()
         return false;
 }
 
+bool Tracking::AcceptKeyFrame(bool bUrgent)
+{
+    return true;
+}
+
 void Tracking::CreateNewKeyFrame()
 {
+    TRACE_SCOPE("CreateNewKeyFrame");
     if(mpLocalMapper->IsInitializing() && !mpAtlas->isImuInitialized())
         return;
 
     if(!mpLocalMapper->SetNotStop(true))
         return;
 
-    KeyFrame* pKF = new KeyFrame(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+    Map* pMap = mpAtlas->GetCurrentMap();
+    KeyFrame* pKF = new(pMap) KeyFrame(mCurrentFrame,pMap,mpKeyFrameDB);
+    // Local mapping takes the Bag of Words from the frame's transform once it is queued
+    if(mBowSubmit)
+        pKF->ComputeBoWAsync(mBowSubmit);
 
     if(mpAtlas->isImuInitialized()) //  || mpLocalMapper->IsInitializing())
         pKF->bImu = true;
@@ -3298,7 +3494,7 @@ void Tracking::CreateNewKeyFrame()
                         x3D = mCurrentFrame.UnprojectStereoFishEye(i);
                     }
 
-                    MapPoint* pNewMP = new MapPoint(x3D,pKF,mpAtlas->GetCurrentMap());
+                    MapPoint* pNewMP = new(pMap) MapPoint(x3D,pKF,pMap);
                     pNewMP->AddObservation(pKF,i);
 
                     //Check if it is a stereo observation in order to not
@@ -3342,6 +3538,7 @@ void Tracking::CreateNewKeyFrame()
 
 void Tracking::SearchLocalPoints()
 {
+    TRACE_SCOPE("SearchLocalPoints");
     // Do not search map points already matched
     for(vector<MapPoint*>::iterator vit=mCurrentFrame.mvpMapPoints.begin(), vend=mCurrentFrame.mvpMapPoints.end(); vit!=vend; vit++)
     {
@@ -3364,17 +3561,36 @@ void Tracking::SearchLocalPoints()
 
     int nToMatch=0;
 
-    // Project points in frame and check its visibility
-    for(vector<MapPoint*>::iterator vit=mvpLocalMapPoints.begin(), vend=mvpLocalMapPoints.end(); vit!=vend; vit++)
+    // Snapshot the geometry of the candidates, then project them in frame and check their
+    // visibility in batches over the snapshot. isInFrustum only writes to the MapPoints of its
+    // batch, and the local MapPoints are unique.
+    LocalMapSnapshot &snapshot = mLocalMapSnapshot;
+    snapshot.vpMapPoints.clear();
+    for(MapPoint* pMP : mvpLocalMapPoints)
     {
-        MapPoint* pMP = *vit;
-
         if(pMP->mnLastFrameSeen == mCurrentFrame.mnId)
             continue;
         if(pMP->isBad())
             continue;
+        snapshot.vpMapPoints.push_back(pMP);
+    }
+    snapshot.Resize();
+
+    const size_t nCandidates = snapshot.size();
+    const size_t nBatch = 64;
+    vector<char> vbInFrustum(nCandidates,0);
+    RunParallel((nCandidates+nBatch-1)/nBatch, [this, &snapshot, nCandidates, nBatch, &vbInFrustum](int t)
+    {
+        const size_t i0 = t*nBatch, i1 = min(nCandidates,(t+1)*nBatch);
+        snapshot.Load(i0,i1);
         // Project (this fills MapPoint variables for matching)
-        if(mCurrentFrame.isInFrustum(pMP,0.5))
+        mCurrentFrame.isInFrustum(snapshot,i0,i1,0.5,vbInFrustum.data());
+    });
+
+    for(size_t i=0; i<nCandidates; i++)
+    {
+        MapPoint* pMP = snapshot.vpMapPoints[i];
+        if(vbInFrustum[i])
         {
             pMP->IncreaseVisible();
             nToMatch++;
@@ -3410,18 +3626,19 @@ void Tracking::SearchLocalPoints()
         if(mState==LOST || mState==RECENTLY_LOST) // Lost for less than 1 second
             th=15; // 15
 
-        int matches = matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, th, mpLocalMapper->mbFarPoints, mpLocalMapper->mThFarPoints);
+        int matches = matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, th, mpLocalMapper->mbFarPoints, mpLocalMapper->mThFarPoints, mParallelFor);
     }
 }
 
 void Tracking::UpdateLocalMap()
 {
+    TRACE_SCOPE("UpdateLocalMap");
     // This is for visualization
     mpAtlas->SetReferenceMapPoints(mvpLocalMapPoints);
 
-    // Update
-    UpdateLocalKeyFrames();
-    UpdateLocalPoints();
+    // Update, the points only change with the keyframes
+    if(UpdateLocalKeyFrames())
+        UpdateLocalPoints();
 }
 
 void Tracking::UpdateLocalPoints()
@@ -3454,55 +3671,126 @@ void Tracking::UpdateLocalPoints()
 }
 
 
-void Tracking::UpdateLocalKeyFrames()
+bool Tracking::UpdateLocalKeyFrames()
 {
-    // Each map point vote for the keyframes in which it has been observed
-    map<KeyFrame*,int> keyframeCounter;
-    if(!mpAtlas->isImuInitialized() || (mCurrentFrame.mnId<mnLastRelocFrameId+2))
+    // Each map point vote for the keyframes in which it has been observed.
+    // Using lastframe when the current frame has not matches yet.
+    const bool bVoteLastFrame = mpAtlas->isImuInitialized() && (mCurrentFrame.mnId>=mnLastRelocFrameId+2);
+    Frame &voteFrame = bVoteLastFrame ? mLastFrame : mCurrentFrame;
+
+    // The votes of the previous frame are updated if the observations cannot have changed
+    LocalMapCache &cache = mLocalMapCache;
+    Map* pMap = mpAtlas->GetCurrentMap();
+    const unsigned long nMapVersion = mpLocalMapper->GetMapVersion();
+    const int nMapChangeIndex = pMap->GetMapChangeIndex();
+    const bool bIncremental = cache.bValid && cache.nMapVersion==nMapVersion && cache.pMap==pMap &&
+                              cache.nMapChangeIndex==nMapChangeIndex && cache.pLastKF==mCurrentFrame.mpLastKeyFrame &&
+                              cache.bVoteLastFrame==bVoteLastFrame;
+    if(!bIncremental)
+    {
+        cache.mVoters.clear();
+        cache.mKeyFrameVotes.clear();
+        cache.nMapVersion = nMapVersion;
+        cache.pMap = pMap;
+        cache.nMapChangeIndex = nMapChangeIndex;
+        cache.pLastKF = mCurrentFrame.mpLastKeyFrame;
+        cache.bVoteLastFrame = bVoteLastFrame;
+        cache.bValid = true;
+    }
+
+    // MapPoints that voted in the previous frame are not bad, nothing could cull them since
+    cache.mFrameVoters.clear();
+    for(int i=0; i<voteFrame.N; i++)
+    {
+        MapPoint* pMP = voteFrame.mvpMapPoints[i];
+        if(!pMP)
+            continue;
+        if(cache.mVoters.count(pMP) || !pMP->isBad())
+            cache.mFrameVoters[pMP]++;
+        else
+            voteFrame.mvpMapPoints[i]=NULL;
+    }
+
+    std::map<KeyFrame*,int> &keyframeCounter = cache.mKeyFrameVotes;
+    for(unordered_map<MapPoint*, pair<int, vector<KeyFrame*> > >::iterator it=cache.mVoters.begin(); it!=cache.mVoters.end(); )
     {
-        for(int i=0; i<mCurrentFrame.N; i++)
+        unordered_map<MapPoint*,int>::const_iterator fit = cache.mFrameVoters.find(it->first);
+        const int nVotes = (fit==cache.mFrameVoters.end()) ? 0 : fit->second;
+        if(nVotes!=it->second.first)
         {
-            MapPoint* pMP = mCurrentFrame.mvpMapPoints[i];
-            if(pMP)
+            for(KeyFrame* pKF : it->second.second)
             {
-                if(!pMP->isBad())
-                {
-                    const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
-                    for(map<KeyFrame*,tuple<int,int>>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
-                        keyframeCounter[it->first]++;
-                }
-                else
-                {
-                    mCurrentFrame.mvpMapPoints[i]=NULL;
-                }
+                map<KeyFrame*,int>::iterator kit = keyframeCounter.find(pKF);
+                kit->second += nVotes-it->second.first;
+                if(kit->second==0)
+                    keyframeCounter.erase(kit);
             }
         }
+
+        if(nVotes==0)
+            it = cache.mVoters.erase(it);
+        else
+        {
+            it->second.first = nVotes;
+            ++it;
+        }
     }
-    else
+
+    for(unordered_map<MapPoint*,int>::const_iterator fit=cache.mFrameVoters.begin(), fend=cache.mFrameVoters.end(); fit!=fend; fit++)
+    {
+        if(cache.mVoters.count(fit->first))
+            continue;
+
+        pair<int, vector<KeyFrame*> > &voter = cache.mVoters[fit->first];
+        voter.first = fit->second;
+        const map<KeyFrame*,tuple<int,int>> observations = fit->first->GetObservations();
+        voter.second.reserve(observations.size());
+        for(map<KeyFrame*,tuple<int,int>>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
+        {
+            voter.second.push_back(it->first);
+            keyframeCounter[it->first] += fit->second;
+        }
+    }
+
+    // With the same voted keyframes and graph the local keyframes are the same, only the reference can change
+    bool bRebuild = !bIncremental || cache.vpVotedKFs.size()!=keyframeCounter.size();
+    if(!bRebuild)
     {
-        for(int i=0; i<mLastFrame.N; i++)
+        vector<KeyFrame*>::const_iterator vit = cache.vpVotedKFs.begin();
+        for(map<KeyFrame*,int>::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++, vit++)
         {
-            // Using lastframe since current frame has not matches yet
-            if(mLastFrame.mvpMapPoints[i])
+            if(it->first!=*vit)
             {
-                MapPoint* pMP = mLastFrame.mvpMapPoints[i];
-                if(!pMP)
-                    continue;
-                if(!pMP->isBad())
-                {
-                    const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
-                    for(map<KeyFrame*,tuple<int,int>>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
-                        keyframeCounter[it->first]++;
-                }
-                else
-                {
-                    // MODIFICATION
-                    mLastFrame.mvpMapPoints[i]=NULL;
-                }
+                bRebuild = true;
+                break;
             }
         }
     }
 
+    if(!bRebuild)
+    {
+        int max=0;
+        KeyFrame* pKFmax= static_cast<KeyFrame*>(NULL);
+        for(map<KeyFrame*,int>::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++)
+        {
+            if(it->second>max && !it->first->isBad())
+            {
+                max=it->second;
+                pKFmax=it->first;
+            }
+        }
+
+        if(pKFmax)
+        {
+            mpReferenceKF = pKFmax;
+            mCurrentFrame.mpReferenceKF = mpReferenceKF;
+        }
+        return false;
+    }
+
+    cache.vpVotedKFs.clear();
+    for(map<KeyFrame*,int>::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++)
+        cache.vpVotedKFs.push_back(it->first);
 
     int max=0;
     KeyFrame* pKFmax= static_cast<KeyFrame*>(NULL);
@@ -3532,7 +3820,7 @@ void Tracking::UpdateLocalKeyFrames()
     for(vector<KeyFrame*>::const_iterator itKF=mvpLocalKeyFrames.begin(), itEndKF=mvpLocalKeyFrames.end(); itKF!=itEndKF; itKF++)
     {
         // Limit the number of keyframes
-        if(mvpLocalKeyFrames.size()>80) // 80
+        if((int)mvpLocalKeyFrames.size()>mnMaxLocalKeyFrames) // 80
             break;
 
         KeyFrame* pKF = *itKF;
@@ -3582,7 +3870,7 @@ void Tracking::UpdateLocalKeyFrames()
     }
 
     // Add 10 last temporal KFs (mainly for IMU)
-    if((mSensor == System::IMU_MONOCULAR || mSensor == System::IMU_STEREO || mSensor == System::IMU_RGBD) &&mvpLocalKeyFrames.size()<80)
+    if((mSensor == System::IMU_MONOCULAR || mSensor == System::IMU_STEREO || mSensor == System::IMU_RGBD) &&(int)mvpLocalKeyFrames.size()<mnMaxLocalKeyFrames)
     {
         KeyFrame* tempKeyFrame = mCurrentFrame.mpLastKeyFrame;
 
@@ -3604,23 +3892,75 @@ void Tracking::UpdateLocalKeyFrames()
         mpReferenceKF = pKFmax;
         mCurrentFrame.mpReferenceKF = mpReferenceKF;
     }
+    return true;
 }
 
 bool Tracking::Relocalization()
 {
+    TRACE_SCOPE("Relocalization");
     Verbose::PrintMess("Starting relocalization", Verbose::VERBOSITY_NORMAL);
     // Compute Bag of Words Vector
     mCurrentFrame.ComputeBoW();
 
+    bool bPrior;
+    Sophus::SE3f priorTcw;
+    Eigen::Matrix<float,6,6> priorCovariance;
+    {
+        unique_lock<mutex> lock(mMutexRelocalizationPrior);
+        bPrior = mbRelocalizationPrior;
+        priorTcw = mRelocalizationPriorTcw;
+        priorCovariance = mRelocalizationPriorCovariance;
+    }
+
     // Relocalization is performed when tracking is lost
     // Track Lost: Query KeyFrame Database for keyframe candidates for relocalisation
-    vector<KeyFrame*> vpCandidateKFs = mpKeyFrameDB->DetectRelocalizationCandidates(&mCurrentFrame, mpAtlas->GetCurrentMap());
+    vector<KeyFrame*> vpCandidateKFs;
+    if(bPrior)
+    {
+        // Camera center c = -R^T t, perturbed by [dp, dtheta] through J = [-R^T, [c]x]
+        const Eigen::Matrix3f Rwc = priorTcw.rotationMatrix().transpose();
+        const Eigen::Vector3f c = -Rwc*priorTcw.translation();
+        Eigen::Matrix<float,3,6> J;
+        J.leftCols<3>() = -Rwc;
+        J.rightCols<3>() = Sophus::SO3f::hat(c);
+        const Eigen::Matrix3f covariance = J*priorCovariance*J.transpose() +
+                kRelocPriorMinRadius*kRelocPriorMinRadius*Eigen::Matrix3f::Identity();
+
+        KeyFrameDatabase::SearchRegion region;
+        region.center = c;
+        region.information = covariance.inverse();
+        region.chi2 = 11.345f; // 99% for 3 dof
+        vpCandidateKFs = mpKeyFrameDB->DetectRelocalizationCandidates(&mCurrentFrame, mpAtlas->GetCurrentMap(), &region);
+
+        if(!vpCandidateKFs.empty() && RelocalizationFromPrior(vpCandidateKFs, priorTcw))
+        {
+            mnLastRelocFrameId = mCurrentFrame.mnId;
+            ClearRelocalizationPrior();
+            cout << "Relocalized from prior!!" << endl;
+            return true;
+        }
+    }
+
+    // Without a prior, or nothing was found where it puts the camera
+    if(vpCandidateKFs.empty())
+        vpCandidateKFs = mpKeyFrameDB->DetectRelocalizationCandidates(&mCurrentFrame, mpAtlas->GetCurrentMap());
 
     if(vpCandidateKFs.empty()) {
         Verbose::PrintMess("There are not candidates", Verbose::VERBOSITY_NORMAL);
         return false;
     }
 
+    if(RelocalizationFromCandidates(vpCandidateKFs)<0)
+        return false;
+
+    mnLastRelocFrameId = mCurrentFrame.mnId;
+    ClearRelocalizationPrior();
+    cout << "Relocalized!!" << endl;
+    return true;
+}
+
+int Tracking::RelocalizationFromCandidates(const vector<KeyFrame*> &vpCandidateKFs)
+{
     const int nKFs = vpCandidateKFs.size();
 
     // We perform first an ORB matching with each candidate
@@ -3661,124 +4001,284 @@ bool Tracking::Relocalization()
         }
     }
 
-    // Alternatively perform some iterations of P4P RANSAC
-    // Until we found a camera pose supported by enough inliers
-    bool bMatch = false;
-    ORBmatcher matcher2(0.9,true);
+    if(nCandidates==0)
+        return -1;
 
-    while(nCandidates>0 && !bMatch)
+    // Candidate RANSACs run concurrently, each worker taking turns of a few
+    // iterations over its own candidates. The hypotheses come back to this
+    // thread, which refines them on mCurrentFrame best supported first. A
+    // candidate far behind the best support of all of them is preempted, and
+    // everything stops at the first pose supported by enough inliers.
+    struct Hypothesis
     {
-        for(int i=0; i<nKFs; i++)
-        {
-            if(vbDiscarded[i])
-                continue;
+        int nKF;
+        int nInliers;
+        vector<bool> vbInliers;
+        Eigen::Matrix4f Tcw;
+    };
+    vector<Hypothesis, Eigen::aligned_allocator<Hypothesis> > vHypotheses;
+    std::mutex mutexHypotheses;
+    std::condition_variable cvHypotheses;
+    std::atomic<bool> bStop(false);
+    std::atomic<int> nBestSupport(0);
 
-            // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bNoMore;
+    vector<int> vCandidates;
+    for(int i=0; i<nKFs; i++)
+        if(!vbDiscarded[i])
+            vCandidates.push_back(i);
+    const size_t nWorkers = std::min<size_t>(vCandidates.size(), std::max(1u, std::thread::hardware_concurrency()));
+    size_t nRunning = nWorkers;
 
-            MLPnPsolver* pSolver = vpMLPnPsolvers[i];
-            Eigen::Matrix4f eigTcw;
-            bool bTcw = pSolver->iterate(5,bNoMore,vbInliers,nInliers, eigTcw);
+    auto worker = [&](size_t w)
+    {
+        vector<int> vTurns;
+        for(size_t c=w; c<vCandidates.size(); c+=nWorkers)
+            vTurns.push_back(vCandidates[c]);
 
-            // If Ransac reachs max. iterations discard keyframe
-            if(bNoMore)
+        vector<bool> vbInliers;
+        int nInliers;
+        bool bNoMore;
+        Eigen::Matrix4f eigTcw;
+        while(!vTurns.empty() && !bStop)
+        {
+            for(size_t k=0; k<vTurns.size() && !bStop; )
             {
-                vbDiscarded[i]=true;
-                nCandidates--;
+                const int i = vTurns[k];
+                MLPnPsolver* pSolver = vpMLPnPsolvers[i];
+                const bool bTcw = pSolver->iterate(kRelocRansacIterations,bNoMore,vbInliers,nInliers,eigTcw);
+
+                // Raise the shared bound to the best support of this candidate
+                const int nSupport = pSolver->GetBestInliers();
+                int nBound = nBestSupport.load();
+                while(nSupport>nBound && !nBestSupport.compare_exchange_weak(nBound,nSupport));
+                const bool bPreempted = pSolver->GetIterations()>=kRelocPreemptIterations && 2*nSupport<nBestSupport.load();
+
+                if(bTcw)
+                {
+                    Hypothesis h;
+                    h.nKF = i;
+                    h.nInliers = nInliers;
+                    h.vbInliers = vbInliers;
+                    h.Tcw = eigTcw;
+                    unique_lock<mutex> lock(mutexHypotheses);
+                    vHypotheses.push_back(h);
+                    cvHypotheses.notify_one();
+                }
+
+                // If Ransac reachs max. iterations or is preempted discard keyframe
+                if(bNoMore || bPreempted)
+                {
+                    vTurns[k] = vTurns.back();
+                    vTurns.pop_back();
+                }
+                else
+                    k++;
             }
+        }
+
+        unique_lock<mutex> lock(mutexHypotheses);
+        nRunning--;
+        cvHypotheses.notify_one();
+    };
+
+    vector<std::thread> vWorkers;
+    for(size_t w=0; w<nWorkers; w++)
+        vWorkers.push_back(std::thread(worker, w));
 
-            // If a Camera Pose is computed, optimize
-            if(bTcw)
+    // Optimize a camera pose hypothesis, returns if it is supported by enough inliers
+    ORBmatcher matcher2(0.9,true);
+    auto refine = [&](const Hypothesis &h)
+    {
+        const int i = h.nKF;
+        Sophus::SE3f Tcw(h.Tcw);
+        mCurrentFrame.SetPose(Tcw);
+        // Tcw.copyTo(mCurrentFrame.mTcw);
+
+        set<MapPoint*> sFound;
+
+        const int np = h.vbInliers.size();
+
+        for(int j=0; j<np; j++)
+        {
+            if(h.vbInliers[j])
             {
-                Sophus::SE3f Tcw(eigTcw);
-                mCurrentFrame.SetPose(Tcw);
-                // Tcw.copyTo(mCurrentFrame.mTcw);
+                mCurrentFrame.mvpMapPoints[j]=vvpMapPointMatches[i][j];
+                sFound.insert(vvpMapPointMatches[i][j]);
+            }
+            else
+                mCurrentFrame.mvpMapPoints[j]=NULL;
+        }
+
+        int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+
+        if(nGood<10)
+            return false;
+
+        for(int io =0; io<mCurrentFrame.N; io++)
+            if(mCurrentFrame.mvbOutlier[io])
+                mCurrentFrame.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
 
-                set<MapPoint*> sFound;
+        // If few inliers, search by projection in a coarse window and optimize again
+        if(nGood<50)
+        {
+            int nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,10,100);
 
-                const int np = vbInliers.size();
+            if(nadditional+nGood>=50)
+            {
+                nGood = Optimizer::PoseOptimization(&mCurrentFrame);
 
-                for(int j=0; j<np; j++)
+                // If many inliers but still not enough, search by projection again in a narrower window
+                // the camera has been already optimized with many points
+                if(nGood>30 && nGood<50)
                 {
-                    if(vbInliers[j])
+                    sFound.clear();
+                    for(int ip =0; ip<mCurrentFrame.N; ip++)
+                        if(mCurrentFrame.mvpMapPoints[ip])
+                            sFound.insert(mCurrentFrame.mvpMapPoints[ip]);
+                    nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,3,64);
+
+                    // Final optimization
+                    if(nGood+nadditional>=50)
                     {
-                        mCurrentFrame.mvpMapPoints[j]=vvpMapPointMatches[i][j];
-                        sFound.insert(vvpMapPointMatches[i][j]);
+                        nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+
+                        for(int io =0; io<mCurrentFrame.N; io++)
+                            if(mCurrentFrame.mvbOutlier[io])
+                                mCurrentFrame.mvpMapPoints[io]=NULL;
                     }
-                    else
-                        mCurrentFrame.mvpMapPoints[j]=NULL;
                 }
+            }
+        }
+
+        // If the pose is supported by enough inliers stop ransacs and continue
+        return nGood>=50;
+    };
 
-                int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+    bool bMatch = false;
+    int nMatchedKF = -1;
+    while(!bMatch)
+    {
+        Hypothesis h;
+        {
+            unique_lock<mutex> lock(mutexHypotheses);
+            cvHypotheses.wait(lock, [&]{ return !vHypotheses.empty() || nRunning==0; });
+            if(vHypotheses.empty())
+                break;
 
-                if(nGood<10)
-                    continue;
+            size_t nBest = 0;
+            for(size_t k=1; k<vHypotheses.size(); k++)
+                if(vHypotheses[k].nInliers>vHypotheses[nBest].nInliers)
+                    nBest = k;
+            h = vHypotheses[nBest];
+            vHypotheses[nBest] = vHypotheses.back();
+            vHypotheses.pop_back();
+        }
 
-                for(int io =0; io<mCurrentFrame.N; io++)
-                    if(mCurrentFrame.mvbOutlier[io])
-                        mCurrentFrame.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
+        bMatch = refine(h);
+        if(bMatch)
+            nMatchedKF = h.nKF;
+    }
 
-                // If few inliers, search by projection in a coarse window and optimize again
-                if(nGood<50)
-                {
-                    int nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,10,100);
+    bStop = true;
+    for(size_t w=0; w<vWorkers.size(); w++)
+        vWorkers[w].join();
+    for(int i=0; i<nKFs; i++)
+        delete vpMLPnPsolvers[i];
 
-                    if(nadditional+nGood>=50)
-                    {
-                        nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+    return nMatchedKF;
+}
 
-                        // If many inliers but still not enough, search by projection again in a narrower window
-                        // the camera has been already optimized with many points
-                        if(nGood>30 && nGood<50)
-                        {
-                            sFound.clear();
-                            for(int ip =0; ip<mCurrentFrame.N; ip++)
-                                if(mCurrentFrame.mvpMapPoints[ip])
-                                    sFound.insert(mCurrentFrame.mvpMapPoints[ip]);
-                            nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,3,64);
-
-                            // Final optimization
-                            if(nGood+nadditional>=50)
-                            {
-                                nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+bool Tracking::RelocalizationInAtlas()
+{
+    if(mnAtlasRelocMaps<=0 || mSensor==System::IMU_MONOCULAR || mSensor==System::IMU_STEREO || mSensor==System::IMU_RGBD)
+        return false;
 
-                                for(int io =0; io<mCurrentFrame.N; io++)
-                                    if(mCurrentFrame.mvbOutlier[io])
-                                        mCurrentFrame.mvpMapPoints[io]=NULL;
-                            }
-                        }
-                    }
-                }
+    mCurrentFrame.ComputeBoW();
 
+    // One query ranks the maps, the candidates of the best ones are verified together. When the
+    // current map ranks first its own relocalization, which uses the prior, handles the frame.
+    Map* pPreviousMap = mpAtlas->GetCurrentMap();
+    const vector<KeyFrameDatabase::MapCandidates> vMapCandidates =
+            mpKeyFrameDB->DetectRelocalizationCandidatesByMap(&mCurrentFrame, kAtlasRelocCandidates);
+    if(vMapCandidates.empty() || vMapCandidates[0].pMap==pPreviousMap)
+        return false;
 
-                // If the pose is supported by enough inliers stop ransacs and continue
-                if(nGood>=50)
-                {
-                    bMatch = true;
-                    break;
-                }
-            }
-        }
+    vector<KeyFrame*> vpCandidateKFs;
+    for(size_t m=0; m<vMapCandidates.size() && m<(size_t)mnAtlasRelocMaps; m++)
+    {
+        if(vMapCandidates[m].pMap!=pPreviousMap)
+            vpCandidateKFs.insert(vpCandidateKFs.end(), vMapCandidates[m].vpKeyFrames.begin(), vMapCandidates[m].vpKeyFrames.end());
     }
 
-    if(!bMatch)
+    const int nMatchedKF = RelocalizationFromCandidates(vpCandidateKFs);
+    if(nMatchedKF<0)
+        return false;
+
+    // A merge may have retired the map since the query
+    KeyFrame* pKF = vpCandidateKFs[nMatchedKF];
+    Map* pMap = pKF->GetMap();
+    if(!mpAtlas->SwitchToMap(pMap))
     {
+        fill(mCurrentFrame.mvpMapPoints.begin(),mCurrentFrame.mvpMapPoints.end(),static_cast<MapPoint*>(NULL));
         return false;
     }
-    else
+    Verbose::PrintMess("Relocalized in map " + to_string(pMap->GetId()) + ", was map " + to_string(pPreviousMap->GetId()),
+                       Verbose::VERBOSITY_NORMAL);
+
+    // Track from the matched keyframe, as after the initialization of a map
+    mpReferenceKF = pKF;
+    mCurrentFrame.mpReferenceKF = pKF;
+    mpLastKeyFrame = pKF;
+    mnLastKeyFrameId = mCurrentFrame.mnId;
+    mbVelocity = false;
+    mbVO = false;
+    mLocalMapCache.bValid = false;
+    mvpLocalKeyFrames.clear();
+    mvpLocalMapPoints.clear();
+
+    mnLastRelocFrameId = mCurrentFrame.mnId;
+    ClearRelocalizationPrior();
+    cout << "Relocalized in the atlas!!" << endl;
+    return true;
+}
+
+bool Tracking::RelocalizationFromPrior(const vector<KeyFrame*> &vpCandidateKFs, const Sophus::SE3f &Tcw)
+{
+    ORBmatcher matcher(0.9,true);
+
+    const int nKFs = std::min<int>(vpCandidateKFs.size(), kRelocPriorCandidates);
+    for(int i=0; i<nKFs; i++)
     {
-        mnLastRelocFrameId = mCurrentFrame.mnId;
-        cout << "Relocalized!!" << endl;
-        return true;
+        KeyFrame* pKF = vpCandidateKFs[i];
+        if(pKF->isBad())
+            continue;
+
+        mCurrentFrame.SetPose(Tcw);
+        fill(mCurrentFrame.mvpMapPoints.begin(),mCurrentFrame.mvpMapPoints.end(),static_cast<MapPoint*>(NULL));
+
+        // Wide window, the prior is off by its drift
+        const set<MapPoint*> sFound;
+        int nmatches = matcher.SearchByProjection(mCurrentFrame,pKF,sFound,10,100);
+        if(nmatches<15)
+            continue;
+
+        int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+        for(int io =0; io<mCurrentFrame.N; io++)
+            if(mCurrentFrame.mvbOutlier[io])
+                mCurrentFrame.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
+
+        if(nGood>=50)
+            return true;
     }
 
+    fill(mCurrentFrame.mvpMapPoints.begin(),mCurrentFrame.mvpMapPoints.end(),static_cast<MapPoint*>(NULL));
+    return false;
 }
 
 void Tracking::Reset(bool bLocMap)
 {
     Verbose::PrintMess("System Reseting", Verbose::VERBOSITY_NORMAL);
+    mLocalMapCache.bValid = false;
 
     if(mpViewer)
     {
@@ -3826,6 +4326,7 @@ void Tracking::Reset(bool bLocMap)
     mlbLost.clear();
     mCurrentFrame = Frame();
     mnLastRelocFrameId = 0;
+    ClearRelocalizationPrior();
     mLastFrame = Frame();
     mpReferenceKF = static_cast<KeyFrame*>(NULL);
     mpLastKeyFrame = static_cast<KeyFrame*>(NULL);
@@ -3840,6 +4341,7 @@ void Tracking::Reset(bool bLocMap)
 void Tracking::ResetActiveMap(bool bLocMap)
 {
     Verbose::PrintMess("Active map Reseting", Verbose::VERBOSITY_NORMAL);
+    mLocalMapCache.bValid = false;
     if(mpViewer)
     {
         mpViewer->RequestStop();
@@ -3884,7 +4386,7 @@ void Tracking::ResetActiveMap(bool bLocMap)
     cout << "mnFirstFrameId = " << mnFirstFrameId << endl;
     for(Map* pMap : mpAtlas->GetAllMaps())
     {
-        if(pMap->GetAllKeyFrames().size() > 0)
+        if(pMap->KeyFramesInMap() > 0)
         {
             if(index > pMap->GetLowerKFID())
                 index = pMap->GetLowerKFID();
@@ -3913,6 +4415,7 @@ void Tracking::ResetActiveMap(bool bLocMap)
 
     mnInitialFrameId = mCurrentFrame.mnId;
     mnLastRelocFrameId = mCurrentFrame.mnId;
+    ClearRelocalizationPrior();
 
     mCurrentFrame = Frame();
     mLastFrame = Frame();
@@ -29,6 +29,63 @@
 using namespace std;
 namespace ORB_SLAM3
 {
+    namespace
+    {
+        // Symmetric transfer errors of a match, in units of sigma^2
+        inline void HomographyChiSquares(const float *h, const float *hinv, const float u1, const float v1,
+                                         const float u2, const float v2, const float invSigmaSquare,
+                                         float &chiSquare1, float &chiSquare2)
+        {
+            // Reprojection error in first image
+            // x2in1 = H12*x2
+            const float w2in1inv = 1.0f/(hinv[6]*u2+hinv[7]*v2+hinv[8]);
+            const float u2in1 = (hinv[0]*u2+hinv[1]*v2+hinv[2])*w2in1inv;
+            const float v2in1 = (hinv[3]*u2+hinv[4]*v2+hinv[5])*w2in1inv;
+            chiSquare1 = ((u1-u2in1)*(u1-u2in1)+(v1-v2in1)*(v1-v2in1))*invSigmaSquare;
+
+            // Reprojection error in second image
+            // x1in2 = H21*x1
+            const float w1in2inv = 1.0f/(h[6]*u1+h[7]*v1+h[8]);
+            const float u1in2 = (h[0]*u1+h[1]*v1+h[2])*w1in2inv;
+            const float v1in2 = (h[3]*u1+h[4]*v1+h[5])*w1in2inv;
+            chiSquare2 = ((u2-u1in2)*(u2-u1in2)+(v2-v1in2)*(v2-v1in2))*invSigmaSquare;
+        }
+
+        // Point to epipolar line distances of a match, in units of sigma^2
+        inline void FundamentalChiSquares(const float *f, const float u1, const float v1,
+                                          const float u2, const float v2, const float invSigmaSquare,
+                                          float &chiSquare1, float &chiSquare2)
+        {
+            // Reprojection error in second image
+            // l2=F21x1=(a2,b2,c2)
+            const float a2 = f[0]*u1+f[1]*v1+f[2];
+            const float b2 = f[3]*u1+f[4]*v1+f[5];
+            const float c2 = f[6]*u1+f[7]*v1+f[8];
+            const float num2 = a2*u2+b2*v2+c2;
+            chiSquare1 = num2*num2/(a2*a2+b2*b2)*invSigmaSquare;
+
+            // Reprojection error in first image
+            // l1 =x2tF21=(a1,b1,c1)
+            const float a1 = f[0]*u2+f[3]*v2+f[6];
+            const float b1 = f[1]*u2+f[4]*v2+f[7];
+            const float c1 = f[2]*u2+f[5]*v2+f[8];
+            const float num1 = a1*u1+b1*v1+c1;
+            chiSquare2 = num1*num1/(a1*a1+b1*b1)*invSigmaSquare;
+        }
+
+        // Splits [0,nIterations) into nThreads ranges, the first one run on this thread
+        template<typename Job>
+        void RunIterationRanges(const int nIterations, const int nThreads, const Job &job)
+        {
+            vector<thread> vThreads;
+            for(int t=1; t<nThreads; t++)
+                vThreads.push_back(thread(job, t, t*nIterations/nThreads, (t+1)*nIterations/nThreads));
+            job(0, 0, nIterations/nThreads);
+            for(size_t t=0; t<vThreads.size(); t++)
+                vThreads[t].join();
+        }
+    }
+
     TwoViewReconstruction::TwoViewReconstruction(const Eigen::Matrix3f& k, float sigma, int iterations)
     {
         mK = k;
@@ -65,6 +122,24 @@ namespace ORB_SLAM3
 
         const int N = mvMatches12.size();
 
+        mvMatchedU1.resize(N);
+        mvMatchedV1.resize(N);
+        mvMatchedU2.resize(N);
+        mvMatchedV2.resize(N);
+        for(int i=0; i<N; i++)
+        {
+            const cv::Point2f &pt1 = mvKeys1[mvMatches12[i].first].pt;
+            const cv::Point2f &pt2 = mvKeys2[mvMatches12[i].second].pt;
+            mvMatchedU1[i] = pt1.x;
+            mvMatchedV1[i] = pt1.y;
+            mvMatchedU2[i] = pt2.x;
+            mvMatchedV2[i] = pt2.y;
+        }
+
+        // Normalize coordinates
+        Normalize(mvKeys1,mvPn1, mT1);
+        Normalize(mvKeys2,mvPn2, mT2);
+
         // Indices for minimum set selection
         vector<size_t> vAllIndices;
         vAllIndices.reserve(N);
@@ -128,105 +203,136 @@ namespace ORB_SLAM3
         }
     }
 
+    int TwoViewReconstruction::RansacThreads() const
+    {
+        // Both models run at once, each gets half of the cores
+        const int nCores = max(1u, thread::hardware_concurrency());
+        return max(1, min(max(1, nCores/2), mMaxIterations/kMinIterationsPerThread));
+    }
+
     void TwoViewReconstruction::FindHomography(vector<bool> &vbMatchesInliers, float &score, Eigen::Matrix3f &H21)
     {
         // Number of putative matches
         const int N = mvMatches12.size();
 
-        // Normalize coordinates
-        vector<cv::Point2f> vPn1, vPn2;
-        Eigen::Matrix3f T1, T2;
-        Normalize(mvKeys1,vPn1, T1);
-        Normalize(mvKeys2,vPn2, T2);
-        Eigen::Matrix3f T2inv = T2.inverse();
+        const Eigen::Matrix3f T2inv = mT2.inverse();
 
-        // Best Results variables
-        score = 0.0;
-        vbMatchesInliers = vector<bool>(N,false);
+        // Best result of each range of iterations
+        const int nThreads = RansacThreads();
+        vector<float> vScores(nThreads,0.f);
+        vector<Eigen::Matrix3f> vH21(nThreads);
 
-        // Iteration variables
-        vector<cv::Point2f> vPn1i(8);
-        vector<cv::Point2f> vPn2i(8);
-        Eigen::Matrix3f H21i, H12i;
-        vector<bool> vbCurrentInliers(N,false);
-        float currentScore;
-
-        // Perform all RANSAC iterations and save the solution with highest score
-        for(int it=0; it<mMaxIterations; it++)
+        auto ransac = [&](const int t, const int itBegin, const int itEnd)
         {
-            // Select a minimum set
-            for(size_t j=0; j<8; j++)
-            {
-                int idx = mvSets[it][j];
+            // Iteration variables
+            vector<cv::Point2f> vPn1i(8);
+            vector<cv::Point2f> vPn2i(8);
 
-                vPn1i[j] = vPn1[mvMatches12[idx].first];
-                vPn2i[j] = vPn2[mvMatches12[idx].second];
+            for(int it=itBegin; it<itEnd; it++)
+            {
+                // Select a minimum set
+                for(size_t j=0; j<8; j++)
+                {
+                    int idx = mvSets[it][j];
+
+                    vPn1i[j] = mvPn1[mvMatches12[idx].first];
+                    vPn2i[j] = mvPn2[mvMatches12[idx].second];
+                }
+
+                Eigen::Matrix3f Hn = ComputeH21(vPn1i,vPn2i);
+                const Eigen::Matrix3f H21i = T2inv * Hn * mT1;
+                const Eigen::Matrix3f H12i = H21i.inverse();
+
+                const float currentScore = ScoreHomography(H21i, H12i, mSigma);
+
+                if(currentScore>vScores[t])
+                {
+                    vH21[t] = H21i;
+                    vScores[t] = currentScore;
+                }
             }
+        };
 
-            Eigen::Matrix3f Hn = ComputeH21(vPn1i,vPn2i);
-            H21i = T2inv * Hn * T1;
-            H12i = H21i.inverse();
-
-            currentScore = CheckHomography(H21i, H12i, vbCurrentInliers, mSigma);
+        // Perform all RANSAC iterations and save the solution with highest score
+        RunIterationRanges(mMaxIterations, nThreads, ransac);
 
-            if(currentScore>score)
+        // Ranges are in iteration order, ties go to the earliest as in a single loop
+        score = 0.0;
+        vbMatchesInliers = vector<bool>(N,false);
+        for(int t=0; t<nThreads; t++)
+        {
+            if(vScores[t]>score)
             {
-                H21 = H21i;
-                vbMatchesInliers = vbCurrentInliers;
-                score = currentScore;
+                H21 = vH21[t];
+                score = vScores[t];
             }
         }
+
+        if(score>0.f)
+            CheckHomography(H21, H21.inverse(), vbMatchesInliers, mSigma);
     }
 
 
     void TwoViewReconstruction::FindFundamental(vector<bool> &vbMatchesInliers, float &score, Eigen::Matrix3f &F21)
     {
         // Number of putative matches
-        const int N = vbMatchesInliers.size();
+        const int N = mvMatches12.size();
 
-        // Normalize coordinates
-        vector<cv::Point2f> vPn1, vPn2;
-        Eigen::Matrix3f T1, T2;
-        Normalize(mvKeys1,vPn1, T1);
-        Normalize(mvKeys2,vPn2, T2);
-        Eigen::Matrix3f T2t = T2.transpose();
+        const Eigen::Matrix3f T2t = mT2.transpose();
 
-        // Best Results variables
-        score = 0.0;
-        vbMatchesInliers = vector<bool>(N,false);
+        // Best result of each range of iterations
+        const int nThreads = RansacThreads();
+        vector<float> vScores(nThreads,0.f);
+        vector<Eigen::Matrix3f> vF21(nThreads);
 
-        // Iteration variables
-        vector<cv::Point2f> vPn1i(8);
-        vector<cv::Point2f> vPn2i(8);
-        Eigen::Matrix3f F21i;
-        vector<bool> vbCurrentInliers(N,false);
-        float currentScore;
-
-        // Perform all RANSAC iterations and save the solution with highest score
-        for(int it=0; it<mMaxIterations; it++)
+        auto ransac = [&](const int t, const int itBegin, const int itEnd)
         {
-            // Select a minimum set
-            for(int j=0; j<8; j++)
+            // Iteration variables
+            vector<cv::Point2f> vPn1i(8);
+            vector<cv::Point2f> vPn2i(8);
+
+            for(int it=itBegin; it<itEnd; it++)
             {
-                int idx = mvSets[it][j];
+                // Select a minimum set
+                for(int j=0; j<8; j++)
+                {
+                    int idx = mvSets[it][j];
 
-                vPn1i[j] = vPn1[mvMatches12[idx].first];
-                vPn2i[j] = vPn2[mvMatches12[idx].second];
-            }
+                    vPn1i[j] = mvPn1[mvMatches12[idx].first];
+                    vPn2i[j] = mvPn2[mvMatches12[idx].second];
+                }
 
-            Eigen::Matrix3f Fn = ComputeF21(vPn1i,vPn2i);
+                Eigen::Matrix3f Fn = ComputeF21(vPn1i,vPn2i);
 
-            F21i = T2t * Fn * T1;
+                const Eigen::Matrix3f F21i = T2t * Fn * mT1;
 
-            currentScore = CheckFundamental(F21i, vbCurrentInliers, mSigma);
+                const float currentScore = ScoreFundamental(F21i, mSigma);
 
-            if(currentScore>score)
+                if(currentScore>vScores[t])
+                {
+                    vF21[t] = F21i;
+                    vScores[t] = currentScore;
+                }
+            }
+        };
+
+        // Perform all RANSAC iterations and save the solution with highest score
+        RunIterationRanges(mMaxIterations, nThreads, ransac);
+
+        // Ranges are in iteration order, ties go to the earliest as in a single loop
+        score = 0.0;
+        vbMatchesInliers = vector<bool>(N,false);
+        for(int t=0; t<nThreads; t++)
+        {
+            if(vScores[t]>score)
             {
-                F21 = F21i;
-                vbMatchesInliers = vbCurrentInliers;
-                score = currentScore;
+                F21 = vF21[t];
+                score = vScores[t];
             }
         }
+
+        if(score>0.f)
+            CheckFundamental(F21, vbMatchesInliers, mSigma);
     }
 
     Eigen::Matrix3f TwoViewReconstruction::ComputeH21(const vector<cv::Point2f> &vP1, const vector<cv::Point2f> &vP2)
@@ -311,25 +417,8 @@ namespace ORB_SLAM3
     {
         const int N = mvMatches12.size();
 
-        const float h11 = H21(0,0);
-        const float h12 = H21(0,1);
-        const float h13 = H21(0,2);
-        const float h21 = H21(1,0);
-        const float h22 = H21(1,1);
-        const float h23 = H21(1,2);
-        const float h31 = H21(2,0);
-        const float h32 = H21(2,1);
-        const float h33 = H21(2,2);
-
-        const float h11inv = H12(0,0);
-        const float h12inv = H12(0,1);
-        const float h13inv = H12(0,2);
-        const float h21inv = H12(1,0);
-        const float h22inv = H12(1,1);
-        const float h23inv = H12(1,2);
-        const float h31inv = H12(2,0);
-        const float h32inv = H12(2,1);
-        const float h33inv = H12(2,2);
+        const Eigen::Matrix<float,3,3,Eigen::RowMajor> h(H21);
+        const Eigen::Matrix<float,3,3,Eigen::RowMajor> hinv(H12);
 
         vbMatchesInliers.resize(N);
 
@@ -343,41 +432,15 @@ namespace ORB_SLAM3
         {
             bool bIn = true;
 
-            const cv::KeyPoint &kp1 = mvKeys1[mvMatches12[i].first];
-            const cv::KeyPoint &kp2 = mvKeys2[mvMatches12[i].second];
-
-            const float u1 = kp1.pt.x;
-            const float v1 = kp1.pt.y;
-            const float u2 = kp2.pt.x;
-            const float v2 = kp2.pt.y;
-
-            // Reprojection error in first image
-            // x2in1 = H12*x2
-
-            const float w2in1inv = 1.0/(h31inv*u2+h32inv*v2+h33inv);
-            const float u2in1 = (h11inv*u2+h12inv*v2+h13inv)*w2in1inv;
-            const float v2in1 = (h21inv*u2+h22inv*v2+h23inv)*w2in1inv;
-
-            const float squareDist1 = (u1-u2in1)*(u1-u2in1)+(v1-v2in1)*(v1-v2in1);
-
-            const float chiSquare1 = squareDist1*invSigmaSquare;
+            float chiSquare1, chiSquare2;
+            HomographyChiSquares(h.data(), hinv.data(), mvMatchedU1[i], mvMatchedV1[i], mvMatchedU2[i], mvMatchedV2[i],
+                                 invSigmaSquare, chiSquare1, chiSquare2);
 
             if(chiSquare1>th)
                 bIn = false;
             else
                 score += th - chiSquare1;
 
-            // Reprojection error in second image
-            // x1in2 = H21*x1
-
-            const float w1in2inv = 1.0/(h31*u1+h32*v1+h33);
-            const float u1in2 = (h11*u1+h12*v1+h13)*w1in2inv;
-            const float v1in2 = (h21*u1+h22*v1+h23)*w1in2inv;
-
-            const float squareDist2 = (u2-u1in2)*(u2-u1in2)+(v2-v1in2)*(v2-v1in2);
-
-            const float chiSquare2 = squareDist2*invSigmaSquare;
-
             if(chiSquare2>th)
                 bIn = false;
             else
@@ -396,15 +459,7 @@ namespace ORB_SLAM3
     {
         const int N = mvMatches12.size();
 
-        const float f11 = F21(0,0);
-        const float f12 = F21(0,1);
-        const float f13 = F21(0,2);
-        const float f21 = F21(1,0);
-        const float f22 = F21(1,1);
-        const float f23 = F21(1,2);
-        const float f31 = F21(2,0);
-        const float f32 = F21(2,1);
-        const float f33 = F21(2,2);
+        const Eigen::Matrix<float,3,3,Eigen::RowMajor> f(F21);
 
         vbMatchesInliers.resize(N);
 
@@ -419,45 +474,15 @@ namespace ORB_SLAM3
         {
             bool bIn = true;
 
-            const cv::KeyPoint &kp1 = mvKeys1[mvMatches12[i].first];
-            const cv::KeyPoint &kp2 = mvKeys2[mvMatches12[i].second];
-
-            const float u1 = kp1.pt.x;
-            const float v1 = kp1.pt.y;
-            const float u2 = kp2.pt.x;
-            const float v2 = kp2.pt.y;
-
-            // Reprojection error in second image
-            // l2=F21x1=(a2,b2,c2)
-
-            const float a2 = f11*u1+f12*v1+f13;
-            const float b2 = f21*u1+f22*v1+f23;
-            const float c2 = f31*u1+f32*v1+f33;
-
-            const float num2 = a2*u2+b2*v2+c2;
-
-            const float squareDist1 = num2*num2/(a2*a2+b2*b2);
-
-            const float chiSquare1 = squareDist1*invSigmaSquare;
+            float chiSquare1, chiSquare2;
+            FundamentalChiSquares(f.data(), mvMatchedU1[i], mvMatchedV1[i], mvMatchedU2[i], mvMatchedV2[i],
+                                  invSigmaSquare, chiSquare1, chiSquare2);
 
             if(chiSquare1>th)
                 bIn = false;
             else
                 score += thScore - chiSquare1;
 
-            // Reprojection error in second image
-            // l1 =x2tF21=(a1,b1,c1)
-
-            const float a1 = f11*u2+f21*v2+f31;
-            const float b1 = f12*u2+f22*v2+f32;
-            const float c1 = f13*u2+f23*v2+f33;
-
-            const float num1 = a1*u1+b1*v1+c1;
-
-            const float squareDist2 = num1*num1/(a1*a1+b1*b1);
-
-            const float chiSquare2 = squareDist2*invSigmaSquare;
-
             if(chiSquare2>th)
                 bIn = false;
             else
@@ -472,6 +497,97 @@ namespace ORB_SLAM3
         return score;
     }
 
+    // The RANSAC loops only need the scores. Without the inlier flags and with one
+    // partial sum per lane (the sum is not reassociated without -ffast-math), the
+    // loops below vectorize.
+    float TwoViewReconstruction::ScoreHomography(const Eigen::Matrix3f &H21, const Eigen::Matrix3f &H12, float sigma) const
+    {
+        const int N = mvMatchedU1.size();
+
+        const Eigen::Matrix<float,3,3,Eigen::RowMajor> h(H21);
+        const Eigen::Matrix<float,3,3,Eigen::RowMajor> hinv(H12);
+
+        const float *pU1 = mvMatchedU1.data();
+        const float *pV1 = mvMatchedV1.data();
+        const float *pU2 = mvMatchedU2.data();
+        const float *pV2 = mvMatchedV2.data();
+
+        const float th = 5.991;
+
+        const float invSigmaSquare = 1.0/(sigma*sigma);
+
+        const int nLanes = 8;
+        float vScore[nLanes] = {0.f};
+
+        int i=0;
+        for(; i+nLanes<=N; i+=nLanes)
+        {
+            for(int l=0; l<nLanes; l++)
+            {
+                float chiSquare1, chiSquare2;
+                HomographyChiSquares(h.data(), hinv.data(), pU1[i+l], pV1[i+l], pU2[i+l], pV2[i+l],
+                                     invSigmaSquare, chiSquare1, chiSquare2);
+                vScore[l] += (chiSquare1>th ? 0.f : th - chiSquare1) + (chiSquare2>th ? 0.f : th - chiSquare2);
+            }
+        }
+        for(; i<N; i++)
+        {
+            float chiSquare1, chiSquare2;
+            HomographyChiSquares(h.data(), hinv.data(), pU1[i], pV1[i], pU2[i], pV2[i],
+                                 invSigmaSquare, chiSquare1, chiSquare2);
+            vScore[0] += (chiSquare1>th ? 0.f : th - chiSquare1) + (chiSquare2>th ? 0.f : th - chiSquare2);
+        }
+
+        float score = 0;
+        for(int l=0; l<nLanes; l++)
+            score += vScore[l];
+        return score;
+    }
+
+    float TwoViewReconstruction::ScoreFundamental(const Eigen::Matrix3f &F21, float sigma) const
+    {
+        const int N = mvMatchedU1.size();
+
+        const Eigen::Matrix<float,3,3,Eigen::RowMajor> f(F21);
+
+        const float *pU1 = mvMatchedU1.data();
+        const float *pV1 = mvMatchedV1.data();
+        const float *pU2 = mvMatchedU2.data();
+        const float *pV2 = mvMatchedV2.data();
+
+        const float th = 3.841;
+        const float thScore = 5.991;
+
+        const float invSigmaSquare = 1.0/(sigma*sigma);
+
+        const int nLanes = 8;
+        float vScore[nLanes] = {0.f};
+
+        int i=0;
+        for(; i+nLanes<=N; i+=nLanes)
+        {
+            for(int l=0; l<nLanes; l++)
+            {
+                float chiSquare1, chiSquare2;
+                FundamentalChiSquares(f.data(), pU1[i+l], pV1[i+l], pU2[i+l], pV2[i+l],
+                                      invSigmaSquare, chiSquare1, chiSquare2);
+                vScore[l] += (chiSquare1>th ? 0.f : thScore - chiSquare1) + (chiSquare2>th ? 0.f : thScore - chiSquare2);
+            }
+        }
+        for(; i<N; i++)
+        {
+            float chiSquare1, chiSquare2;
+            FundamentalChiSquares(f.data(), pU1[i], pV1[i], pU2[i], pV2[i],
+                                  invSigmaSquare, chiSquare1, chiSquare2);
+            vScore[0] += (chiSquare1>th ? 0.f : thScore - chiSquare1) + (chiSquare2>th ? 0.f : thScore - chiSquare2);
+        }
+
+        float score = 0;
+        for(int l=0; l<nLanes; l++)
+            score += vScore[l];
+        return score;
+    }
+
     bool TwoViewReconstruction::ReconstructF(vector<bool> &vbMatchesInliers, Eigen::Matrix3f &F21, Eigen::Matrix3f &K,
                                              Sophus::SE3f &T21, vector<cv::Point3f> &vP3D, vector<bool> &vbTriangulated, float minParallax, int minTriangulated)
     {
@@ -815,8 +931,12 @@ namespace ORB_SLAM3
 
         Eigen::Vector3f O2 = -R.transpose() * t;
 
-        int nGood=0;
-
+        // Triangulate all inliers in one batch, the depth is checked below depending on the parallax
+        vector<size_t> vInliers;
+        vector<Eigen::Vector3f> vx_p1, vx_p2;
+        vInliers.reserve(vMatches12.size());
+        vx_p1.reserve(vMatches12.size());
+        vx_p2.reserve(vMatches12.size());
         for(size_t i=0, iend=vMatches12.size();i<iend;i++)
         {
             if(!vbMatchesInliers[i])
@@ -825,14 +945,27 @@ namespace ORB_SLAM3
             const cv::KeyPoint &kp1 = vKeys1[vMatches12[i].first];
             const cv::KeyPoint &kp2 = vKeys2[vMatches12[i].second];
 
-            Eigen::Vector3f p3dC1;
-            Eigen::Vector3f x_p1(kp1.pt.x, kp1.pt.y, 1);
-            Eigen::Vector3f x_p2(kp2.pt.x, kp2.pt.y, 1);
+            vInliers.push_back(i);
+            vx_p1.push_back(Eigen::Vector3f(kp1.pt.x, kp1.pt.y, 1));
+            vx_p2.push_back(Eigen::Vector3f(kp2.pt.x, kp2.pt.y, 1));
+        }
+
+        vector<Eigen::Vector3f> vp3dC1(vInliers.size());
+        vector<unsigned char> vbTriangulated(vInliers.size());
+        GeometricTools::Triangulate(vx_p1.data(), vx_p2.data(), vInliers.size(), P1, P2, vp3dC1.data(), vbTriangulated.data(), false);
+
+        int nGood=0;
 
-            GeometricTools::Triangulate(x_p1, x_p2, P1, P2, p3dC1);
+        for(size_t j=0, jend=vInliers.size();j<jend;j++)
+        {
+            const size_t i = vInliers[j];
+
+            const cv::KeyPoint &kp1 = vKeys1[vMatches12[i].first];
+            const cv::KeyPoint &kp2 = vKeys2[vMatches12[i].second];
 
+            const Eigen::Vector3f &p3dC1 = vp3dC1[j];
 
-            if(!isfinite(p3dC1(0)) || !isfinite(p3dC1(1)) || !isfinite(p3dC1(2)))
+            if(!vbTriangulated[j])
             {
                 vbGood[vMatches12[i].first]=false;
                 continue;
@@ -1,10 +1,17 @@
 #include "include/tpu_feature_extractor.hpp"
+#include "include/RGAPyramid.h"
+#include "include/Trace.h"
+#include "include/MemoryAccounting.h"
 #include <iostream> // For std::cerr, std::cout
 #include <fstream>  // For std::ifstream
 #include <algorithm> // For std::min, std::max
+#include <cmath> // For std::ceil
 #include <chrono> // For performance measurement
 #include <thread> // For parallel processing
 #include <mutex> // For thread synchronization
+#include <future> // For overlapping postprocessing with inference
+#include <map> // For the model cache
+#include <cstring> // For std::memcpy
 
 // TensorFlow Lite and EdgeTPU Delegate headers
 #include "tensorflow/lite/interpreter.h"
@@ -21,9 +28,24 @@
     #include "tensorflow/lite/delegates/edgetpu/edgetpu_delegate.h"
 #endif
 
+// RKNN runtime for the NPU backend
+#if defined(HAVE_RKNN)
+    #include <rknn_api.h>
+#endif
+
 #include "opencv2/imgproc.hpp" // For cv::resize, cv::cvtColor
 #include "opencv2/highgui.hpp" // For cv::imread (if testing standalone)
 
+// NEON for the quantized postprocessing on the A76 cores
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+// madvise for reading the model mapping ahead
+#if defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
 // OpenMP for parallel processing if available
 #ifdef _OPENMP
     #include <omp.h>
@@ -38,25 +60,210 @@ static double total_inference_time = 0;
 static double total_postprocess_time = 0;
 static int frame_count = 0;
 
+// Default number of input slots of the asynchronous pipeline
+static const int kDefaultPipelineDepth = 2;
+
+// Cores of the RK3588 NPU
+static const int kNPUCores = 3;
+
+// Process-wide model cache; models stay mapped until the process exits
+static std::mutex model_cache_mutex;
+static std::map<std::string, std::shared_ptr<tflite::FlatBufferModel>> model_cache;
+
+// Bytes of the tensor arena of an interpreter: the span of its arena tensors, which share
+// offsets, plus the persistent ones
+static size_t interpreterArenaBytes(const tflite::Interpreter& interpreter)
+{
+    const char* arena_begin = nullptr;
+    const char* arena_end = nullptr;
+    size_t persistent_bytes = 0;
+    for (size_t i = 0; i < interpreter.tensors_size(); ++i) {
+        const TfLiteTensor* tensor = interpreter.tensor(static_cast<int>(i));
+        if (!tensor || !tensor->data.raw) {
+            continue;
+        }
+        if (tensor->allocation_type == kTfLiteArenaRwPersistent) {
+            persistent_bytes += tensor->bytes;
+        } else if (tensor->allocation_type == kTfLiteArenaRw) {
+            const char* begin = tensor->data.raw;
+            if (!arena_begin || begin < arena_begin) {
+                arena_begin = begin;
+            }
+            if (!arena_end || begin + tensor->bytes > arena_end) {
+                arena_end = begin + tensor->bytes;
+            }
+        }
+    }
+    return static_cast<size_t>(arena_end - arena_begin) + persistent_bytes;
+}
+
+#if defined(HAVE_RKNN)
+/**
+ * @brief RKNN context with its own input and output memory
+ */
+struct TPUFeatureExtractor::NPUContext
+{
+    // A registered DMA-BUF imported as input memory
+    struct Import {
+        int fd;
+        uint64_t generation;
+        size_t offset;              // Of the model input within the buffer
+        rknn_tensor_mem* mem;       // nullptr if the import failed
+    };
+    
+    rknn_context context = 0;
+    rknn_tensor_attr input_attr;        // As bound: uint8 NHWC
+    rknn_tensor_attr semi_attr;         // As bound: int8 NHWC
+    rknn_tensor_attr descriptor_attr;   // As bound: int8 NCHW
+    rknn_tensor_mem* input_mem = nullptr;
+    rknn_tensor_mem* semi_mem = nullptr;
+    rknn_tensor_mem* descriptor_mem = nullptr;
+    rknn_tensor_mem* bound_input = nullptr; // input_mem or the mem of an import
+    std::vector<Import> imports;
+    uint64_t imports_generation = 0;        // DMA-BUF registry generation the imports were checked at
+    
+    ~NPUContext()
+    {
+        if (!context) {
+            return;
+        }
+        for (const Import& import : imports) {
+            if (import.mem) {
+                rknn_destroy_mem(context, import.mem);
+            }
+        }
+        if (input_mem) {
+            rknn_destroy_mem(context, input_mem);
+        }
+        if (semi_mem) {
+            rknn_destroy_mem(context, semi_mem);
+        }
+        if (descriptor_mem) {
+            rknn_destroy_mem(context, descriptor_mem);
+        }
+        rknn_destroy(context);
+    }
+    
+    // Pin the context to a core (-1 for any) and bind its tensor memory as described by the attributes
+    bool Configure(int core)
+    {
+        const rknn_core_mask core_mask = core < 0 ? RKNN_NPU_CORE_AUTO
+                                                  : static_cast<rknn_core_mask>(RKNN_NPU_CORE_0 << core);
+        if (rknn_set_core_mask(context, core_mask) != RKNN_SUCC) {
+            std::cerr << "Failed to set the NPU core mask." << std::endl;
+            return false;
+        }
+        
+        input_mem = rknn_create_mem(context, std::max(input_attr.size, input_attr.size_with_stride));
+        semi_mem = rknn_create_mem(context, semi_attr.size);
+        descriptor_mem = rknn_create_mem(context, descriptor_attr.size);
+        if (!input_mem || !semi_mem || !descriptor_mem) {
+            std::cerr << "Failed to allocate NPU tensor memory." << std::endl;
+            return false;
+        }
+        
+        if (rknn_set_io_mem(context, input_mem, &input_attr) != RKNN_SUCC ||
+            rknn_set_io_mem(context, semi_mem, &semi_attr) != RKNN_SUCC ||
+            rknn_set_io_mem(context, descriptor_mem, &descriptor_attr) != RKNN_SUCC) {
+            std::cerr << "Failed to bind NPU tensor memory." << std::endl;
+            return false;
+        }
+        bound_input = input_mem;
+        return true;
+    }
+};
+
+// Shape of a 4D RKNN tensor in either layout
+static void npuTensorShape(const rknn_tensor_attr& attr, int& batch, int& height, int& width, int& channels)
+{
+    batch = static_cast<int>(attr.dims[0]);
+    if (attr.fmt == RKNN_TENSOR_NHWC) {
+        height = static_cast<int>(attr.dims[1]);
+        width = static_cast<int>(attr.dims[2]);
+        channels = static_cast<int>(attr.dims[3]);
+    } else {
+        channels = static_cast<int>(attr.dims[1]);
+        height = static_cast<int>(attr.dims[2]);
+        width = static_cast<int>(attr.dims[3]);
+    }
+}
+#else
+struct TPUFeatureExtractor::NPUContext {};
+#endif
+
+/**
+ * @brief One in-flight image of the asynchronous pipeline
+ */
+struct TPUFeatureExtractor::PipelineSlot
+{
+    enum class State { FREE, FILLING, QUEUED, INVOKED, DONE };
+    
+    std::unique_ptr<tflite::Interpreter> interpreter; // Own input/output tensors
+    std::unique_ptr<NPUContext> npu;                  // Instead of the interpreter on the NPU
+    State state = State::FREE;
+    int64_t ticket = -1;
+    bool ok = false;
+    
+    cv::Mat image;  // Full-resolution image header (for coordinate mapping)
+    cv::Mat mask;
+    
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    std::vector<int> lapping_area;
+    
+    double preprocess_ms = 0;
+    double inference_ms = 0;
+};
+
 TPUFeatureExtractor::TPUFeatureExtractor(
     const std::string& model_path,
     const std::string& delegate_path,
     int n_features_target,
     float scale_factor,
-    int n_levels)
+    int n_levels,
+    int device_index,
+    Backend backend)
     : model_path_(model_path),
       delegate_path_(delegate_path),
       n_features_target_(n_features_target),
       scale_factor_(scale_factor),
       n_levels_(n_levels),
       edgetpu_delegate_(nullptr),
+      device_index_(device_index),
+      on_edgetpu_(false),
+      backend_(backend),
+      dma_buffer_generation_(0),
+      input_bound_(false),
+      input_custom_allocated_(false),
+      owned_input_(nullptr),
+      arena_bytes_(0),
+      input_tensor_batch_(1),
       descriptor_output_index_(-1),
       semi_output_index_(-1),
       nms_radius_(4.0f),
-      confidence_threshold_(0.005f)
+      confidence_threshold_(0.005f),
+      descriptor_mode_(DescriptorMode::FLOAT_NEAREST),
+      inference_levels_(1),
+      min_tile_mask_coverage_(0.0f),
+      pipeline_depth_(kDefaultPipelineDepth),
+      pipeline_arena_bytes_(0),
+      pipeline_running_(false),
+      next_ticket_(0),
+      warmup_running_(false),
+      warmed_up_(false),
+      warmup_inference_ms_(0.0),
+      active_rung_(0),
+      calls_on_rung_(0),
+      thermal_level_(0),
+      last_rung_(0)
 {
+    ladder_.push_back(ModelRung{nullptr, 0, 0.0, 0.0});
     try {
-        if (!loadModel()) {
+        if (backend_ == Backend::RKNN_NPU) {
+            if (!loadNPUModel()) {
+                throw std::runtime_error("Failed to load RKNN model: " + model_path_);
+            }
+        } else if (!loadModel()) {
             throw std::runtime_error("Failed to load EdgeTPU model: " + model_path_);
         }
         initializeScaleFactors();
@@ -69,6 +276,13 @@ TPUFeatureExtractor::TPUFeatureExtractor(
 
 TPUFeatureExtractor::~TPUFeatureExtractor()
 {
+    // Stop the warm-up and the asynchronous pipeline before the delegate goes away
+    if (warmup_thread_.joinable()) {
+        warmup_thread_.join();
+    }
+    stopPipeline();
+    MemoryAccounting::Remove(MemoryBreakdown::TPU_ARENAS, arena_bytes_);
+    
     // Print performance statistics
     if (frame_count > 0) {
         std::cout << "TPUFeatureExtractor Performance Statistics:" << std::endl;
@@ -84,7 +298,7 @@ TPUFeatureExtractor::~TPUFeatureExtractor()
     // Cleanup EdgeTPU delegate if needed
     #if !defined(__APPLE__) && !defined(_WIN32)
         if (edgetpu_delegate_) {
-            edgetpu_free_delegate(edgetpu_delegate_);
+            edgetpu_free_delegate(static_cast<TfLiteDelegate*>(edgetpu_delegate_));
             edgetpu_delegate_ = nullptr;
         }
     #endif
@@ -94,49 +308,58 @@ TPUFeatureExtractor::~TPUFeatureExtractor()
 
 bool TPUFeatureExtractor::loadModel()
 {
-    // 1. Load the TFLite model
-    model_ = tflite::FlatBufferModel::BuildFromFile(model_path_.c_str());
+    // 1. Load the TFLite model (mapped once per process)
+    model_ = loadCachedModel(model_path_);
     if (!model_) {
         std::cerr << "Failed to load TFLite model from: " << model_path_ << std::endl;
         return false;
     }
     std::cout << "Successfully loaded TFLite model: " << model_path_ << std::endl;
 
-    // 2. Create TFLite Interpreter
-    tflite::ops::builtin::BuiltinOpResolver resolver;
-    tflite::InterpreterBuilder builder(*model_, resolver);
-
-    // 3. Prepare and apply EdgeTPU delegate
+    // 2. Prepare the EdgeTPU delegate
     #if !defined(__APPLE__) && !defined(_WIN32)
-        // For Linux/EdgeTPU: Attempt to load the EdgeTPU delegate
-        auto* delegate = edgetpu_create_delegate(nullptr, nullptr, 0); // Use default device
+        // For Linux/EdgeTPU: Attempt to load the EdgeTPU delegate on the requested device
+        size_t num_devices = 0;
+        struct edgetpu_device* devices = edgetpu_list_devices(&num_devices);
+        const size_t index = device_index_ < 0 ? 0 : static_cast<size_t>(device_index_);
+        
+        if (device_index_ >= 0 && index >= num_devices) {
+            std::cerr << "EdgeTPU device " << device_index_ << " not found (" << num_devices
+                      << " devices available)." << std::endl;
+            if (devices) {
+                edgetpu_free_devices(devices);
+            }
+            return false;
+        }
+        
+        TfLiteDelegate* delegate = nullptr;
+        if (index < num_devices) {
+            delegate = edgetpu_create_delegate(devices[index].type, devices[index].path, nullptr, 0);
+        }
         if (delegate) {
-            std::cout << "EdgeTPU delegate created successfully." << std::endl;
-            builder.AddDelegate(delegate);
+            std::cout << "EdgeTPU delegate created successfully on " << devices[index].path << "." << std::endl;
             edgetpu_delegate_ = delegate;
+            on_edgetpu_ = true;
         } else {
             std::cerr << "Warning: EdgeTPU delegate not available or failed to load. Will run on CPU." << std::endl;
         }
+        
+        if (devices) {
+            edgetpu_free_devices(devices);
+        }
     #elif defined(__APPLE__)
         std::cout << "Note: EdgeTPU delegate is not typically used on macOS." << std::endl;
     #else
         std::cout << "Note: EdgeTPU delegate is not typically used on Windows." << std::endl;
     #endif
 
-    // 4. Build interpreter
-    if (builder(&interpreter_) != kTfLiteOk) {
-        std::cerr << "Failed to build TFLite interpreter." << std::endl;
-        return false;
-    }
-    
-    // 5. Set number of threads for CPU fallback
-    interpreter_->SetNumThreads(4); // Use multiple threads for CPU operations
-    
-    // 6. Allocate tensors
-    if (interpreter_->AllocateTensors() != kTfLiteOk) {
-        std::cerr << "Failed to allocate TFLite tensors." << std::endl;
+    // 3-6. Build the interpreter with the delegate and allocate tensors
+    interpreter_ = buildInterpreter();
+    if (!interpreter_) {
         return false;
     }
+    arena_bytes_ = interpreterArenaBytes(*interpreter_);
+    MemoryAccounting::Add(MemoryBreakdown::TPU_ARENAS, arena_bytes_);
     std::cout << "TFLite tensors allocated successfully." << std::endl;
 
     // 7. Get input tensor details
@@ -153,7 +376,9 @@ bool TPUFeatureExtractor::loadModel()
     }
     
     // Parse input dimensions
+    input_tensor_batch_ = 1;
     if (input_dims->size == 4) { // BHWC
+        input_tensor_batch_ = std::max(1, input_dims->data[0]);
         input_tensor_height_ = input_dims->data[1];
         input_tensor_width_ = input_dims->data[2];
         input_tensor_channels_ = input_dims->data[3];
@@ -166,7 +391,8 @@ bool TPUFeatureExtractor::loadModel()
         return false;
     }
 
-    std::cout << "Model Input Details: Height=" << input_tensor_height_ 
+    std::cout << "Model Input Details: Batch=" << input_tensor_batch_
+              << ", Height=" << input_tensor_height_ 
               << ", Width=" << input_tensor_width_ 
               << ", Channels=" << input_tensor_channels_ << std::endl;
     
@@ -240,425 +466,2105 @@ bool TPUFeatureExtractor::loadModel()
     return true;
 }
 
-void TPUFeatureExtractor::initializeScaleFactors()
+std::shared_ptr<tflite::FlatBufferModel> TPUFeatureExtractor::loadCachedModel(const std::string& model_path)
 {
-    inv_scale_factors_.resize(n_levels_);
-    scale_factors_.resize(n_levels_);
-    level_sigma2_.resize(n_levels_);
-    inv_level_sigma2_.resize(n_levels_);
-
-    scale_factors_[0] = 1.0f;
-    inv_scale_factors_[0] = 1.0f;
-    level_sigma2_[0] = 1.0f;
-    inv_level_sigma2_[0] = 1.0f;
-
-    for (int i = 1; i < n_levels_; i++) {
-        scale_factors_[i] = scale_factors_[i - 1] * scale_factor_;
-        inv_scale_factors_[i] = 1.0f / scale_factors_[i];
-        level_sigma2_[i] = scale_factors_[i] * scale_factors_[i];
-        inv_level_sigma2_[i] = 1.0f / level_sigma2_[i];
+    std::lock_guard<std::mutex> lock(model_cache_mutex);
+    auto it = model_cache.find(model_path);
+    if (it != model_cache.end()) {
+        return it->second;
+    }
+    
+    std::shared_ptr<tflite::FlatBufferModel> model(
+        tflite::FlatBufferModel::BuildFromFile(model_path.c_str()));
+    if (!model) {
+        return nullptr;
     }
+    
+    // BuildFromFile maps the file; read it ahead instead of faulting it in during the first Invoke()
+    #if defined(__linux__)
+        const tflite::Allocation* allocation = model->allocation();
+        if (allocation && allocation->base()) {
+            madvise(const_cast<void*>(allocation->base()), allocation->bytes(), MADV_WILLNEED);
+        }
+    #endif
+    
+    model_cache[model_path] = model;
+    return model;
 }
 
-void TPUFeatureExtractor::createImagePyramid(const cv::Mat& image)
+bool TPUFeatureExtractor::PreloadModel(const std::string& model_path)
 {
-    // Clear previous pyramid if any
-    mvImagePyramid.clear();
-    mvImagePyramid.resize(n_levels_);
-    
-    // Copy the original image to the first level
-    image.copyTo(mvImagePyramid[0]);
-    
-    // Create the rest of the pyramid
-    for (int level = 1; level < n_levels_; ++level)
-    {
-        float scale = inv_scale_factors_[level];
-        cv::Size sz(cvRound((float)image.cols * scale), cvRound((float)image.rows * scale));
-        cv::resize(mvImagePyramid[level-1], mvImagePyramid[level], sz, 0, 0, cv::INTER_LINEAR);
-    }
+    return loadCachedModel(model_path) != nullptr;
 }
 
-cv::Mat TPUFeatureExtractor::preprocessImage(const cv::Mat& input_image, const cv::Size& model_input_size)
+bool TPUFeatureExtractor::Warmup(int iterations)
 {
-    cv::Mat processed_image;
+    auto start_time = std::chrono::high_resolution_clock::now();
     
-    // 1. Convert to Grayscale if needed
-    if (input_tensor_channels_ == 1 && input_image.channels() != 1) {
-        cv::cvtColor(input_image, processed_image, cv::COLOR_BGR2GRAY);
-    } else if (input_tensor_channels_ == 3 && input_image.channels() == 1) {
-        cv::cvtColor(input_image, processed_image, cv::COLOR_GRAY2BGR);
+    // A separate interpreter (or NPU context) keeps warm-up off the one operator() uses
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    std::unique_ptr<NPUContext> npu_context;
+    const bool on_npu = backend_ == Backend::RKNN_NPU;
+    if (on_npu) {
+        npu_context = buildNPUContext();
     } else {
-        input_image.copyTo(processed_image);
+        interpreter = buildInterpreter();
     }
-
-    // 2. Resize to model's expected input dimensions
-    if (processed_image.rows != model_input_size.height || processed_image.cols != model_input_size.width) {
-        cv::resize(processed_image, processed_image, model_input_size, 0, 0, cv::INTER_LINEAR);
+    bool ok = on_npu ? npu_context != nullptr : interpreter != nullptr;
+    
+    // Mid-gray dummy input
+    const cv::Size model_size = GetModelInputSize();
+    cv::Mat dummy = preprocessImage(cv::Mat(model_size, CV_8UC1, cv::Scalar(128)), model_size);
+    if (ok && on_npu) {
+        ok = fillNPUInput(npu_context.get(), dummy);
     }
-
-    // 3. Ensure the image is in uint8 format for quantization
-    if (processed_image.type() != CV_8UC1 && processed_image.type() != CV_8UC3) {
-        processed_image.convertTo(processed_image, CV_8U);
+    for (int slot = 0; ok && !on_npu && slot < input_tensor_batch_; ++slot) {
+        ok = fillInputTensor(interpreter.get(), slot, dummy);
     }
     
-    // 4. Ensure memory is continuous for faster copying
-    if (!processed_image.isContinuous()) {
-        processed_image = processed_image.clone();
+    double inference_ms = 0.0;
+    for (int i = 0; ok && i < iterations; ++i) {
+        auto invoke_start = std::chrono::high_resolution_clock::now();
+        ok = on_npu ? invokeNPU(npu_context.get()) : interpreter->Invoke() == kTfLiteOk;
+        inference_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - invoke_start).count();
+        std::cout << "TPUFeatureExtractor warm-up inference " << (i + 1) << "/" << iterations << ": "
+                  << inference_ms << " ms" << std::endl;
     }
     
-    return processed_image;
-}
-
-void TPUFeatureExtractor::runInference(
-    const cv::Mat& preprocessed_image,
-    std::vector<float>& raw_keypoints,
-    std::vector<float>& raw_descriptors,
-    std::vector<float>& raw_scores)
-{
-    if (!interpreter_) {
-        std::cerr << "Interpreter not initialized." << std::endl;
-        return;
+    if (!ok) {
+        std::cerr << "TPUFeatureExtractor warm-up failed." << std::endl;
+    } else {
+        std::cout << "TPUFeatureExtractor warmed up in "
+                  << std::chrono::duration<double, std::milli>(
+                         std::chrono::high_resolution_clock::now() - start_time).count()
+                  << " ms" << std::endl;
     }
-
-    // Get pointer to input tensor data
-    TfLiteTensor* input_tensor_ptr = interpreter_->tensor(interpreter_->inputs()[0]);
     
-    if (input_tensor_ptr->type == kTfLiteInt8) {
-        // Model expects int8 input, need to convert from uint8 to int8
-        int8_t* input_data = interpreter_->typed_input_tensor<int8_t>(0);
-        
-        // Convert uint8 image data to int8 with zero_point shift
-        // For the analyzed model, zero_point is -128, which means uint8_value - 128 = int8_value
-        if (preprocessed_image.isContinuous()) {
-            const uint8_t* img_data = preprocessed_image.data;
-            const size_t total_elements = preprocessed_image.total() * preprocessed_image.elemSize();
-            
-            // Use OpenMP for parallel processing if available
-            #pragma omp parallel for if(total_elements > 10000)
-            for (size_t i = 0; i < total_elements; ++i) {
-                input_data[i] = static_cast<int8_t>(img_data[i]) - 128; // Apply zero point shift
-            }
-        } else {
-            // Handle non-continuous Mat (slower)
-            for (int i = 0; i < preprocessed_image.rows; ++i) {
-                const uint8_t* row_ptr = preprocessed_image.ptr<uint8_t>(i);
-                for (int j = 0; j < preprocessed_image.cols * preprocessed_image.channels(); ++j) {
-                    int idx = i * preprocessed_image.cols * preprocessed_image.channels() + j;
-                    input_data[idx] = static_cast<int8_t>(row_ptr[j]) - 128; // Apply zero point shift
-                }
-            }
+    {
+        std::lock_guard<std::mutex> lock(warmup_mutex_);
+        warmed_up_ = warmed_up_ || ok;
+        if (ok && iterations > 0) {
+            warmup_inference_ms_ = inference_ms; // The last inference runs warm
         }
-    } else {
-        std::cerr << "Unexpected input tensor type: " << TfLiteTypeGetName(input_tensor_ptr->type) 
-                  << ". Expected INT8." << std::endl;
-        return;
     }
+    warmup_cv_.notify_all();
+    return ok;
+}
 
-    // Run inference
-    if (interpreter_->Invoke() != kTfLiteOk) {
-        std::cerr << "Failed to invoke TFLite interpreter." << std::endl;
+void TPUFeatureExtractor::StartWarmup(int iterations)
+{
+    std::lock_guard<std::mutex> lock(warmup_mutex_);
+    if (warmup_running_ || warmed_up_) {
         return;
     }
-
-    // Extract descriptor output tensor
-    if (descriptor_output_index_ != -1) {
-        const TfLiteTensor* descriptor_tensor = interpreter_->tensor(descriptor_output_index_);
-        const int8_t* descriptor_data = descriptor_tensor->data.int8;
-        
-        // Calculate total elements in descriptor tensor
-        int total_elements = descriptor_channels_ * descriptor_height_ * descriptor_width_;
-        
-        // Resize output vector
-        raw_descriptors.resize(total_elements);
-        
-        // Dequantize descriptor data
-        // Use OpenMP for parallel processing if available
-        #pragma omp parallel for if(total_elements > 10000)
-        for (int i = 0; i < total_elements; ++i) {
-            // Dequantize: (int8_value - zero_point) * scale
-            raw_descriptors[i] = (descriptor_data[i] - descriptor_quant_zero_point_) * descriptor_quant_scale_;
-        }
-    } else {
-        std::cerr << "Descriptor output tensor not found." << std::endl;
+    if (warmup_thread_.joinable()) {
+        warmup_thread_.join(); // An earlier warm-up failed
     }
     
-    // Extract semi (keypoints) output tensor
-    if (semi_output_index_ != -1) {
-        const TfLiteTensor* semi_tensor = interpreter_->tensor(semi_output_index_);
-        const int8_t* semi_data = semi_tensor->data.int8;
-        
-        // Calculate total elements in semi tensor
-        int score_channels = semi_channels_ - 1; // 64 score channels
-        int total_elements = semi_height_ * semi_width_ * score_channels;
-        
-        // Resize output vectors
-        raw_scores.resize(total_elements);
-        
-        // Dequantize semi data
-        // Use OpenMP for parallel processing if available
-        #pragma omp parallel for collapse(2) if(semi_height_ * semi_width_ > 100)
-        for (int h = 0; h < semi_height_; ++h) {
-            for (int w = 0; w < semi_width_; ++w) {
-                for (int c = 0; c < score_channels; ++c) {
-                    int idx = h * semi_width_ * semi_channels_ + w * semi_channels_ + c;
-                    int out_idx = h * semi_width_ * score_channels + w * score_channels + c;
-                    
-                    // Dequantize: (int8_value - zero_point) * scale
-                    raw_scores[out_idx] = (semi_data[idx] - semi_quant_zero_point_) * semi_quant_scale_;
-                }
-            }
+    warmup_running_ = true;
+    warmup_thread_ = std::thread([this, iterations]() {
+        Warmup(iterations);
+        {
+            std::lock_guard<std::mutex> lock(warmup_mutex_);
+            warmup_running_ = false;
         }
+        warmup_cv_.notify_all();
+    });
+}
+
+bool TPUFeatureExtractor::WaitForWarmup(int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(warmup_mutex_);
+    auto done = [this]() { return warmed_up_ || !warmup_running_; };
+    if (timeout_ms < 0) {
+        warmup_cv_.wait(lock, done);
     } else {
-        std::cerr << "Semi output tensor not found." << std::endl;
+        warmup_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
     }
+    return warmed_up_;
 }
 
-std::vector<cv::KeyPoint> TPUFeatureExtractor::applyNMS(
-    const std::vector<std::vector<std::vector<float>>>& scores,
-    float radius,
-    float threshold)
+bool TPUFeatureExtractor::IsWarmedUp() const
 {
-    std::vector<cv::KeyPoint> keypoints;
-    const int cell_size = 8; // SuperPoint uses 8x8 cells
-    
-    // First pass: find all points above threshold
-    std::vector<cv::KeyPoint> candidates;
-    for (int h = 0; h < semi_height_; ++h) {
-        for (int w = 0; w < semi_width_; ++w) {
-            for (int c = 0; c < 64; ++c) { // 64 score channels
-                float score = scores[h][w][c];
-                if (score > threshold) {
-                    // Convert cell index to pixel coordinates
-                    int cell_h = c / 8;
-                    int cell_w = c % 8;
-                    
-                    // Calculate pixel coordinates in the feature map
-                    float x = w * cell_size + cell_w;
-                    float y = h * cell_size + cell_h;
-                    
-                    candidates.emplace_back(x, y, 8.0f, -1, score, 0);
-                }
-            }
+    std::lock_guard<std::mutex> lock(warmup_mutex_);
+    return warmed_up_;
+}
+
+std::unique_ptr<tflite::Interpreter> TPUFeatureExtractor::buildInterpreter()
+{
+    // Create TFLite Interpreter
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    tflite::InterpreterBuilder builder(*model_, resolver);
+
+    // Apply the EdgeTPU delegate (shared by all interpreters of this extractor)
+    #if !defined(__APPLE__) && !defined(_WIN32)
+        if (edgetpu_delegate_) {
+            builder.AddDelegate(static_cast<TfLiteDelegate*>(edgetpu_delegate_));
         }
+    #endif
+
+    // Build interpreter
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    if (builder(&interpreter) != kTfLiteOk) {
+        std::cerr << "Failed to build TFLite interpreter." << std::endl;
+        return nullptr;
     }
     
-    // Sort candidates by score (descending)
-    std::sort(candidates.begin(), candidates.end(), 
-             [](const cv::KeyPoint& a, const cv::KeyPoint& b) {
-                 return a.response > b.response;
-             });
+    // Set number of threads for CPU fallback
+    interpreter->SetNumThreads(4); // Use multiple threads for CPU operations
     
-    // Second pass: apply NMS
-    std::vector<bool> is_suppressed(candidates.size(), false);
-    
-    for (size_t i = 0; i < candidates.size(); ++i) {
-        if (is_suppressed[i]) continue;
-        
-        keypoints.push_back(candidates[i]);
-        
-        // Suppress nearby points
-        for (size_t j = i + 1; j < candidates.size(); ++j) {
-            if (is_suppressed[j]) continue;
-            
-            float dx = candidates[i].pt.x - candidates[j].pt.x;
-            float dy = candidates[i].pt.y - candidates[j].pt.y;
-            float dist_sq = dx * dx + dy * dy;
-            
-            if (dist_sq < radius * radius) {
-                is_suppressed[j] = true;
-            }
-        }
+    // Allocate tensors
+    if (interpreter->AllocateTensors() != kTfLiteOk) {
+        std::cerr << "Failed to allocate TFLite tensors." << std::endl;
+        return nullptr;
     }
     
-    return keypoints;
+    return interpreter;
 }
 
-void TPUFeatureExtractor::postprocessResults(
-    const cv::Mat& original_image,
-    const cv::InputArray& mask_in,
-    const std::vector<float>& raw_keypoints,
-    const std::vector<float>& raw_descriptors,
-    const std::vector<float>& raw_scores,
-    std::vector<cv::KeyPoint>& keypoints,
-    cv::Mat& descriptors,
-    std::vector<int>& vLappingArea)
+bool TPUFeatureExtractor::loadNPUModel()
 {
-    keypoints.clear();
+#if defined(HAVE_RKNN)
+    if (device_index_ >= kNPUCores) {
+        std::cerr << "NPU core " << device_index_ << " not found (" << kNPUCores
+                  << " cores available)." << std::endl;
+        return false;
+    }
     
-    // Get mask if provided
-    cv::Mat mask = mask_in.getMat();
+    // 1. Load the RKNN model; the runtime keeps its own copy of the weights
+    std::ifstream file(model_path_, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "Failed to open RKNN model: " << model_path_ << std::endl;
+        return false;
+    }
+    std::vector<char> model_data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(model_data.data(), model_data.size())) {
+        std::cerr << "Failed to read RKNN model: " << model_path_ << std::endl;
+        return false;
+    }
     
-    // 1. Reshape the raw_scores into a 3D tensor [H, W, C]
-    int score_channels = 64; // First 64 channels are keypoint scores
+    npu_.reset(new NPUContext());
+    if (rknn_init(&npu_->context, model_data.data(), static_cast<uint32_t>(model_data.size()), 0, nullptr) != RKNN_SUCC) {
+        std::cerr << "Failed to initialize the RKNN runtime with: " << model_path_ << std::endl;
+        npu_->context = 0;
+        return false;
+    }
+    std::cout << "Successfully loaded RKNN model: " << model_path_ << std::endl;
     
-    // Create a 3D tensor for scores
-    std::vector<std::vector<std::vector<float>>> score_map(
-        semi_height_, 
-        std::vector<std::vector<float>>(
-            semi_width_, 
-            std::vector<float>(score_channels, 0.0f)
-        )
-    );
+    rknn_input_output_num io_num;
+    if (rknn_query(npu_->context, RKNN_QUERY_IN_OUT_NUM, &io_num, sizeof(io_num)) != RKNN_SUCC) {
+        std::cerr << "Failed to query the RKNN model tensors." << std::endl;
+        return false;
+    }
     
-    // Fill the score map
-    for (int h = 0; h < semi_height_; ++h) {
-        for (int w = 0; w < semi_width_; ++w) {
-            for (int c = 0; c < score_channels; ++c) {
-                int idx = h * semi_width_ * score_channels + w * score_channels + c;
-                if (idx < raw_scores.size()) {
-                    score_map[h][w][c] = raw_scores[idx];
-                }
-            }
-        }
+    // 2. Get input tensor details
+    rknn_tensor_attr& input_attr = npu_->input_attr;
+    std::memset(&input_attr, 0, sizeof(input_attr));
+    input_attr.index = 0;
+    if (io_num.n_input < 1 ||
+        rknn_query(npu_->context, RKNN_QUERY_INPUT_ATTR, &input_attr, sizeof(input_attr)) != RKNN_SUCC ||
+        input_attr.n_dims != 4) {
+        std::cerr << "RKNN model has no 4D input tensor." << std::endl;
+        return false;
+    }
+    npuTensorShape(input_attr, input_tensor_batch_, input_tensor_height_, input_tensor_width_, input_tensor_channels_);
+    if (input_tensor_batch_ != 1) {
+        std::cerr << "The NPU backend runs single-image models, got batch " << input_tensor_batch_ << std::endl;
+        return false;
     }
     
-    // 2. Apply non-maximum suppression to extract keypoints
-    std::vector<cv::KeyPoint> nms_keypoints = applyNMS(score_map, nms_radius_, confidence_threshold_);
+    // The NPU converts and quantizes the camera bytes itself
+    input_attr.type = RKNN_TENSOR_UINT8;
+    input_attr.fmt = RKNN_TENSOR_NHWC;
+    input_attr.pass_through = 0;
     
-    // 3. Map keypoints to original image coordinates
-    for (auto& kp : nms_keypoints) {
-        // Convert feature map coordinates to original image coordinates
-        float x = kp.pt.x * original_image.cols / (semi_width_ * 8);
-        float y = kp.pt.y * original_image.rows / (semi_height_ * 8);
+    std::cout << "Model Input Details: Batch=" << input_tensor_batch_
+              << ", Height=" << input_tensor_height_
+              << ", Width=" << input_tensor_width_
+              << ", Channels=" << input_tensor_channels_
+              << ", Row stride=" << input_attr.w_stride << std::endl;
+    
+    // 3. Get output tensor details
+    if (io_num.n_output < 2) {
+        std::cerr << "Expected at least 2 output tensors (descriptors and semi), but got "
+                  << io_num.n_output << std::endl;
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < io_num.n_output; ++i) {
+        rknn_tensor_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.index = i;
+        if (rknn_query(npu_->context, RKNN_QUERY_OUTPUT_ATTR, &attr, sizeof(attr)) != RKNN_SUCC) {
+            std::cerr << "Failed to query RKNN output tensor " << i << std::endl;
+            return false;
+        }
         
-        // Check if the point is within the mask (if provided)
-        if (!mask.empty()) {
-            int img_x = static_cast<int>(x);
-            int img_y = static_cast<int>(y);
+        std::cout << "Output tensor " << i << ": Name=" << attr.name << ", Shape=[";
+        for (uint32_t j = 0; j < attr.n_dims; ++j) {
+            std::cout << attr.dims[j];
+            if (j < attr.n_dims - 1) std::cout << ",";
+        }
+        std::cout << "], Format=" << get_format_string(attr.fmt)
+                  << ", Type=" << get_type_string(attr.type) << std::endl;
+        
+        if (attr.n_dims != 4) {
+            continue;
+        }
+        int batch, height, width, channels;
+        npuTensorShape(attr, batch, height, width, channels);
+        if (channels != 256 && channels != 65) {
+            continue;
+        }
+        
+        // Postprocessing reads the quantized outputs in place
+        if (attr.type != RKNN_TENSOR_INT8 || attr.qnt_type != RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC) {
+            std::cerr << "Unexpected RKNN output tensor type. Expected affine-quantized INT8." << std::endl;
+            return false;
+        }
+        attr.pass_through = 0;
+        
+        // The runtime converts the outputs from the NPU-native layout to the TFLite model's
+        if (channels == 256) {
+            descriptor_output_index_ = static_cast<int>(i);
+            descriptor_height_ = height;
+            descriptor_width_ = width;
+            descriptor_channels_ = channels;
+            descriptor_quant_scale_ = attr.scale;
+            descriptor_quant_zero_point_ = attr.zp;
             
-            // Ensure coordinates are within image bounds
+            attr.fmt = RKNN_TENSOR_NCHW;
+            attr.dims[1] = channels;
+            attr.dims[2] = height;
+            attr.dims[3] = width;
+            npu_->descriptor_attr = attr;
+            
+            std::cout << "Found descriptor tensor: index=" << descriptor_output_index_
+                      << ", shape=[1," << descriptor_channels_ << ","
+                      << descriptor_height_ << "," << descriptor_width_ << "]"
+                      << ", scale=" << descriptor_quant_scale_
+                      << ", zero_point=" << descriptor_quant_zero_point_ << std::endl;
+        } else {
+            semi_output_index_ = static_cast<int>(i);
+            semi_height_ = height;
+            semi_width_ = width;
+            semi_channels_ = channels;
+            semi_quant_scale_ = attr.scale;
+            semi_quant_zero_point_ = attr.zp;
+            
+            attr.fmt = RKNN_TENSOR_NHWC;
+            attr.dims[1] = height;
+            attr.dims[2] = width;
+            attr.dims[3] = channels;
+            npu_->semi_attr = attr;
+            
+            std::cout << "Found semi tensor: index=" << semi_output_index_
+                      << ", shape=[1," << semi_height_ << ","
+                      << semi_width_ << "," << semi_channels_ << "]"
+                      << ", scale=" << semi_quant_scale_
+                      << ", zero_point=" << semi_quant_zero_point_ << std::endl;
+        }
+    }
+    
+    // Verify that we found both output tensors
+    if (descriptor_output_index_ == -1 || semi_output_index_ == -1) {
+        std::cerr << "Failed to identify descriptor or semi output tensors." << std::endl;
+        return false;
+    }
+    
+    // 4. Pin the context to its core and bind the tensor memory
+    if (!npu_->Configure(device_index_)) {
+        return false;
+    }
+    if (device_index_ < 0) {
+        std::cout << "RKNN context created on any idle NPU core." << std::endl;
+    } else {
+        std::cout << "RKNN context created on NPU core " << device_index_ << "." << std::endl;
+    }
+    return true;
+#else
+    std::cerr << "The NPU backend needs a build with HAVE_RKNN (librknnrt)." << std::endl;
+    return false;
+#endif
+}
+
+std::unique_ptr<TPUFeatureExtractor::NPUContext> TPUFeatureExtractor::buildNPUContext()
+{
+#if defined(HAVE_RKNN)
+    // Duplicated contexts share the weights in NPU memory
+    std::unique_ptr<NPUContext> context(new NPUContext());
+    if (rknn_dup_context(&npu_->context, &context->context) != RKNN_SUCC) {
+        std::cerr << "Failed to duplicate the RKNN context." << std::endl;
+        context->context = 0;
+        return nullptr;
+    }
+    
+    context->input_attr = npu_->input_attr;
+    context->semi_attr = npu_->semi_attr;
+    context->descriptor_attr = npu_->descriptor_attr;
+    if (!context->Configure(device_index_)) {
+        return nullptr;
+    }
+    return context;
+#else
+    return nullptr;
+#endif
+}
+
+bool TPUFeatureExtractor::fillNPUInput(NPUContext* context, const cv::Mat& preprocessed_image)
+{
+#if defined(HAVE_RKNN)
+    if (preprocessed_image.cols != input_tensor_width_ || preprocessed_image.rows != input_tensor_height_ ||
+        preprocessed_image.elemSize() != static_cast<size_t>(input_tensor_channels_)) {
+        std::cerr << "NPU input does not match the model input." << std::endl;
+        return false;
+    }
+    
+    const size_t row_bytes = static_cast<size_t>(input_tensor_width_) * input_tensor_channels_;
+    const size_t stride_bytes = static_cast<size_t>(
+        context->input_attr.w_stride > 0 ? context->input_attr.w_stride : input_tensor_width_) * input_tensor_channels_;
+    
+    // 1. Bind an image that lies in a registered DMA-BUF, with the NPU's row stride, in place
+    rknn_tensor_mem* input = nullptr;
+    if (preprocessed_image.step[0] == stride_bytes) {
+        const uint8_t* begin = preprocessed_image.data;
+        const uint8_t* end = begin + (preprocessed_image.rows - 1) * stride_bytes + row_bytes;
+        DmaBuffer buffer = {-1, nullptr, 0, 0};
+        {
+            std::lock_guard<std::mutex> lock(dma_buffers_mutex_);
+            
+            // Imports of replaced buffers keep them alive; release them
+            if (context->imports_generation != dma_buffer_generation_) {
+                for (auto it = context->imports.begin(); it != context->imports.end();) {
+                    const bool registered = std::any_of(dma_buffers_.begin(), dma_buffers_.end(),
+                        [&it](const DmaBuffer& b) { return b.fd == it->fd && b.generation == it->generation; });
+                    if (registered) {
+                        ++it;
+                        continue;
+                    }
+                    if (it->mem) {
+                        if (context->bound_input == it->mem) {
+                            context->bound_input = nullptr;
+                        }
+                        rknn_destroy_mem(context->context, it->mem);
+                    }
+                    it = context->imports.erase(it);
+                }
+                context->imports_generation = dma_buffer_generation_;
+            }
+            
+            for (const DmaBuffer& registered : dma_buffers_) {
+                if (begin >= registered.data && end <= registered.data + registered.size) {
+                    buffer = registered;
+                    break;
+                }
+            }
+        }
+        
+        if (buffer.fd >= 0) {
+            const size_t offset = static_cast<size_t>(begin - buffer.data);
+            auto import = std::find_if(context->imports.begin(), context->imports.end(),
+                [&buffer, offset](const NPUContext::Import& i) {
+                    return i.fd == buffer.fd && i.generation == buffer.generation && i.offset == offset;
+                });
+            if (import == context->imports.end()) {
+                rknn_tensor_mem* mem = rknn_create_mem_from_fd(
+                    context->context, buffer.fd, const_cast<uint8_t*>(buffer.data),
+                    static_cast<uint32_t>(buffer.size), static_cast<int32_t>(offset));
+                if (!mem) {
+                    std::cerr << "Failed to import DMA-BUF " << buffer.fd << " for the NPU, copying its frames." << std::endl;
+                }
+                context->imports.push_back({buffer.fd, buffer.generation, offset, mem});
+                import = context->imports.end() - 1;
+            }
+            input = import->mem;
+        }
+    }
+    
+    // 2. Copy anything else into the context's input memory, at the NPU's row stride
+    if (!input) {
+        input = context->input_mem;
+        uint8_t* input_data = static_cast<uint8_t*>(input->virt_addr);
+        if (row_bytes == stride_bytes && preprocessed_image.isContinuous()) {
+            std::memcpy(input_data, preprocessed_image.data, row_bytes * preprocessed_image.rows);
+        } else {
+            for (int i = 0; i < preprocessed_image.rows; ++i) {
+                std::memcpy(input_data + i * stride_bytes, preprocessed_image.ptr<uint8_t>(i), row_bytes);
+            }
+        }
+        rknn_mem_sync(context->context, input, RKNN_MEMORY_SYNC_TO_DEVICE);
+    }
+    
+    // Rebinding is only needed when the input moves to another buffer
+    if (input != context->bound_input) {
+        if (rknn_set_io_mem(context->context, input, &context->input_attr) != RKNN_SUCC) {
+            std::cerr << "Failed to bind the NPU input memory." << std::endl;
+            context->bound_input = nullptr;
+            return false;
+        }
+        context->bound_input = input;
+    }
+    return true;
+#else
+    (void)context;
+    (void)preprocessed_image;
+    return false;
+#endif
+}
+
+bool TPUFeatureExtractor::invokeNPU(NPUContext* context)
+{
+#if defined(HAVE_RKNN)
+    if (rknn_run(context->context, nullptr) != RKNN_SUCC) {
+        std::cerr << "Failed to run the RKNN model." << std::endl;
+        return false;
+    }
+    
+    // Postprocessing reads the outputs through the CPU cache
+    rknn_mem_sync(context->context, context->semi_mem, RKNN_MEMORY_SYNC_FROM_DEVICE);
+    rknn_mem_sync(context->context, context->descriptor_mem, RKNN_MEMORY_SYNC_FROM_DEVICE);
+    return true;
+#else
+    (void)context;
+    return false;
+#endif
+}
+
+bool TPUFeatureExtractor::getNPUOutputData(
+    NPUContext* context,
+    const int8_t*& semi_data,
+    const int8_t*& descriptor_data)
+{
+#if defined(HAVE_RKNN)
+    semi_data = static_cast<const int8_t*>(context->semi_mem->virt_addr);
+    descriptor_data = static_cast<const int8_t*>(context->descriptor_mem->virt_addr);
+    return semi_data && descriptor_data;
+#else
+    (void)context;
+    semi_data = nullptr;
+    descriptor_data = nullptr;
+    return false;
+#endif
+}
+
+void TPUFeatureExtractor::initializeScaleFactors()
+{
+    inv_scale_factors_.resize(n_levels_);
+    scale_factors_.resize(n_levels_);
+    level_sigma2_.resize(n_levels_);
+    inv_level_sigma2_.resize(n_levels_);
+
+    scale_factors_[0] = 1.0f;
+    inv_scale_factors_[0] = 1.0f;
+    level_sigma2_[0] = 1.0f;
+    inv_level_sigma2_[0] = 1.0f;
+
+    for (int i = 1; i < n_levels_; i++) {
+        scale_factors_[i] = scale_factors_[i - 1] * scale_factor_;
+        inv_scale_factors_[i] = 1.0f / scale_factors_[i];
+        level_sigma2_[i] = scale_factors_[i] * scale_factors_[i];
+        inv_level_sigma2_[i] = 1.0f / level_sigma2_[i];
+    }
+}
+
+void TPUFeatureExtractor::SetPyramid(std::shared_ptr<RGAPyramid> pyramid)
+{
+    next_pyramid_ = std::move(pyramid);
+}
+
+void TPUFeatureExtractor::createImagePyramid(const cv::Mat& image)
+{
+    // Clear previous pyramid if any
+    mvImagePyramid.clear();
+    mvImagePyramid.resize(n_levels_);
+    
+    // Use the levels the RGA built for this image if they have the expected sizes
+    std::shared_ptr<RGAPyramid> pyramid = std::move(next_pyramid_);
+    next_pyramid_.reset();
+    pyramid_.reset();
+    if (pyramid && pyramid->GetLevels() == n_levels_) {
+        bool fits = true;
+        for (int level = 0; level < n_levels_ && fits; ++level) {
+            float scale = inv_scale_factors_[level];
+            cv::Size sz(cvRound((float)image.cols * scale), cvRound((float)image.rows * scale));
+            fits = pyramid->GetLevel(level).size() == sz;
+        }
+        if (fits && pyramid->WaitAll()) {
+            for (int level = 0; level < n_levels_; ++level) {
+                mvImagePyramid[level] = pyramid->GetLevel(level);
+            }
+            pyramid_ = std::move(pyramid);
+            return;
+        }
+    }
+    
+    // Copy the original image to the first level
+    image.copyTo(mvImagePyramid[0]);
+    
+    // Create the rest of the pyramid
+    for (int level = 1; level < n_levels_; ++level)
+    {
+        float scale = inv_scale_factors_[level];
+        cv::Size sz(cvRound((float)image.cols * scale), cvRound((float)image.rows * scale));
+        cv::resize(mvImagePyramid[level-1], mvImagePyramid[level], sz, 0, 0, cv::INTER_LINEAR);
+    }
+}
+
+cv::Mat TPUFeatureExtractor::preprocessImage(const cv::Mat& input_image, const cv::Size& model_input_size)
+{
+    cv::Mat processed_image;
+    
+    // 1. Convert to Grayscale if needed
+    if (input_tensor_channels_ == 1 && input_image.channels() != 1) {
+        cv::cvtColor(input_image, processed_image, cv::COLOR_BGR2GRAY);
+    } else if (input_tensor_channels_ == 3 && input_image.channels() == 1) {
+        cv::cvtColor(input_image, processed_image, cv::COLOR_GRAY2BGR);
+    } else {
+        // Share the buffer; the steps below only write to new buffers
+        processed_image = input_image;
+    }
+
+    // 2. Resize to model's expected input dimensions
+    if (processed_image.rows != model_input_size.height || processed_image.cols != model_input_size.width) {
+        cv::resize(processed_image, processed_image, model_input_size, 0, 0, cv::INTER_LINEAR);
+    }
+
+    // 3. Ensure the image is in uint8 format for quantization
+    if (processed_image.type() != CV_8UC1 && processed_image.type() != CV_8UC3) {
+        processed_image.convertTo(processed_image, CV_8U);
+    }
+    
+    // 4. Ensure memory is continuous for faster copying
+    if (!processed_image.isContinuous()) {
+        processed_image = processed_image.clone();
+    }
+    
+    return processed_image;
+}
+
+bool TPUFeatureExtractor::runInference(const cv::Mat& preprocessed_image)
+{
+    // The NPU reads registered DMA-BUFs in place and copies anything else
+    if (backend_ == Backend::RKNN_NPU) {
+        return fillNPUInput(npu_.get(), preprocessed_image) && invokeNPU(npu_.get());
+    }
+    
+    if (!interpreter_) {
+        std::cerr << "Interpreter not initialized." << std::endl;
+        return false;
+    }
+
+    // Bind the image in place when the model takes the bytes as they are, copy it otherwise
+    if (!bindInputTensor(preprocessed_image) &&
+        !fillInputTensor(interpreter_.get(), 0, preprocessed_image)) {
+        return false;
+    }
+
+    // Run inference
+    if (interpreter_->Invoke() != kTfLiteOk) {
+        std::cerr << "Failed to invoke TFLite interpreter." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TPUFeatureExtractor::fillInputTensor(tflite::Interpreter* interpreter, int slot, const cv::Mat& preprocessed_image)
+{
+    // Never write into caller memory bound by bindInputTensor()
+    if (interpreter == interpreter_.get() && input_bound_ && !unbindInputTensor()) {
+        return false;
+    }
+    
+    // Get pointer to input tensor data
+    TfLiteTensor* input_tensor_ptr = interpreter->tensor(interpreter->inputs()[0]);
+    const size_t slot_elements = static_cast<size_t>(input_tensor_height_) * input_tensor_width_ * input_tensor_channels_;
+    
+    if (input_tensor_ptr->type == kTfLiteUInt8) {
+        // uint8 models take the image bytes as they are
+        uint8_t* input_data = interpreter->typed_input_tensor<uint8_t>(0) + slot * slot_elements;
+        if (preprocessed_image.isContinuous()) {
+            std::memcpy(input_data, preprocessed_image.data,
+                        std::min(preprocessed_image.total() * preprocessed_image.elemSize(), slot_elements));
+        } else {
+            const size_t row_bytes = static_cast<size_t>(preprocessed_image.cols) * preprocessed_image.elemSize();
+            for (int i = 0; i < preprocessed_image.rows; ++i) {
+                std::memcpy(input_data + i * row_bytes, preprocessed_image.ptr<uint8_t>(i), row_bytes);
+            }
+        }
+        return true;
+    }
+    
+    if (input_tensor_ptr->type != kTfLiteInt8) {
+        std::cerr << "Unexpected input tensor type: " << TfLiteTypeGetName(input_tensor_ptr->type) 
+                  << ". Expected INT8 or UINT8." << std::endl;
+        return false;
+    }
+    
+    // Model expects int8 input, need to convert from uint8 to int8
+    int8_t* input_data = interpreter->typed_input_tensor<int8_t>(0) + slot * slot_elements;
+    
+    // Convert uint8 image data to int8 with zero_point shift
+    // For the analyzed model, zero_point is -128, which means uint8_value - 128 = int8_value
+    if (preprocessed_image.isContinuous()) {
+        const uint8_t* img_data = preprocessed_image.data;
+        const size_t total_elements = std::min(preprocessed_image.total() * preprocessed_image.elemSize(), slot_elements);
+        
+        // Use OpenMP for parallel processing if available
+        #pragma omp parallel for if(total_elements > 10000)
+        for (size_t i = 0; i < total_elements; ++i) {
+            input_data[i] = static_cast<int8_t>(img_data[i]) - 128; // Apply zero point shift
+        }
+    } else {
+        // Handle non-continuous Mat (slower)
+        for (int i = 0; i < preprocessed_image.rows; ++i) {
+            const uint8_t* row_ptr = preprocessed_image.ptr<uint8_t>(i);
+            for (int j = 0; j < preprocessed_image.cols * preprocessed_image.channels(); ++j) {
+                int idx = i * preprocessed_image.cols * preprocessed_image.channels() + j;
+                input_data[idx] = static_cast<int8_t>(row_ptr[j]) - 128; // Apply zero point shift
+            }
+        }
+    }
+    
+    return true;
+}
+
+bool TPUFeatureExtractor::bindInputTensor(const cv::Mat& preprocessed_image)
+{
+    if (!SupportsZeroCopyInput() ||
+        preprocessed_image.type() != CV_8UC1 || !preprocessed_image.isContinuous() ||
+        preprocessed_image.cols != input_tensor_width_ || preprocessed_image.rows != input_tensor_height_ ||
+        reinterpret_cast<uintptr_t>(preprocessed_image.data) % 64 != 0) {
+        return false;
+    }
+    
+    // TFLite only reads input tensors, so the caller memory is not written
+    const int input_index = interpreter_->inputs()[0];
+    TfLiteCustomAllocation allocation;
+    allocation.data = preprocessed_image.data;
+    allocation.bytes = preprocessed_image.total();
+    if (interpreter_->SetCustomAllocationForTensor(input_index, allocation) != kTfLiteOk) {
+        return false;
+    }
+    
+    // Replanning is only needed for the first custom allocation; later ones swap the pointer
+    if (!input_custom_allocated_) {
+        if (interpreter_->AllocateTensors() != kTfLiteOk) {
+            std::cerr << "Failed to allocate TFLite tensors for the bound input." << std::endl;
+            return false;
+        }
+        input_custom_allocated_ = true;
+    }
+    
+    input_bound_ = true;
+    return true;
+}
+
+bool TPUFeatureExtractor::unbindInputTensor()
+{
+    const int input_index = interpreter_->inputs()[0];
+    const size_t bytes = interpreter_->tensor(input_index)->bytes;
+    if (!owned_input_) {
+        owned_input_storage_.reset(new uint8_t[bytes + 64]);
+        const uintptr_t address = reinterpret_cast<uintptr_t>(owned_input_storage_.get());
+        owned_input_ = owned_input_storage_.get() + (64 - address % 64) % 64;
+    }
+    
+    TfLiteCustomAllocation allocation;
+    allocation.data = owned_input_;
+    allocation.bytes = bytes;
+    if (interpreter_->SetCustomAllocationForTensor(input_index, allocation) != kTfLiteOk) {
+        std::cerr << "Failed to unbind the TFLite input tensor." << std::endl;
+        return false;
+    }
+    
+    input_bound_ = false;
+    return true;
+}
+
+bool TPUFeatureExtractor::getOutputData(
+    tflite::Interpreter* interpreter,
+    int slot,
+    const int8_t*& semi_data,
+    const int8_t*& descriptor_data)
+{
+    semi_data = nullptr;
+    descriptor_data = nullptr;
+    
+    if (descriptor_output_index_ == -1 || semi_output_index_ == -1) {
+        std::cerr << "Descriptor or semi output tensor not found." << std::endl;
+        return false;
+    }
+    
+    const TfLiteTensor* descriptor_tensor = interpreter->tensor(descriptor_output_index_);
+    const TfLiteTensor* semi_tensor = interpreter->tensor(semi_output_index_);
+    if (descriptor_tensor->type != kTfLiteInt8 || semi_tensor->type != kTfLiteInt8) {
+        std::cerr << "Unexpected output tensor type. Expected INT8." << std::endl;
+        return false;
+    }
+    
+    // No dequantization here; postprocessing reads the int8 data in place
+    descriptor_data = descriptor_tensor->data.int8 + slot * descriptorSlotSize();
+    semi_data = semi_tensor->data.int8 + slot * semiSlotSize();
+    return true;
+}
+
+size_t TPUFeatureExtractor::semiSlotSize() const
+{
+    return static_cast<size_t>(semi_height_) * semi_width_ * semi_channels_;
+}
+
+size_t TPUFeatureExtractor::descriptorSlotSize() const
+{
+    return static_cast<size_t>(descriptor_channels_) * descriptor_height_ * descriptor_width_;
+}
+
+std::vector<cv::KeyPoint> TPUFeatureExtractor::applyNMS(
+    const int8_t* semi_data,
+    float radius,
+    float threshold)
+{
+    std::vector<cv::KeyPoint> keypoints;
+    const int cell_size = 8; // SuperPoint uses 8x8 cells
+    const int score_channels = 64;
+    
+    if (!semi_data || semi_channels_ < score_channels || semi_quant_scale_ <= 0.0f) {
+        return keypoints;
+    }
+    
+    // (q - zero_point) * scale > threshold  <=>  q > zero_point + threshold / scale
+    const int quant_threshold = static_cast<int>(std::max(-129.0f, std::min(127.0f,
+        std::floor(semi_quant_zero_point_ + threshold / semi_quant_scale_))));
+    
+    // Buckets as wide as the radius: every point within the radius of a
+    // bucket's best point lies in the 3x3 neighbouring buckets
+    const int map_width = semi_width_ * cell_size;
+    const int map_height = semi_height_ * cell_size;
+    const int bucket_size = std::max(1, static_cast<int>(std::ceil(radius)));
+    const int grid_width = (map_width + bucket_size - 1) / bucket_size;
+    const int grid_height = (map_height + bucket_size - 1) / bucket_size;
+    
+    std::vector<int> best_score(static_cast<size_t>(grid_width) * grid_height, quant_threshold);
+    std::vector<int> best_pixel(best_score.size(), -1);
+    
+    // First pass: best point above threshold in each bucket
+    for (int h = 0; h < semi_height_; ++h) {
+        for (int w = 0; w < semi_width_; ++w) {
+            const int8_t* cell = semi_data + (static_cast<size_t>(h) * semi_width_ + w) * semi_channels_;
+            
+            #if defined(__ARM_NEON) && defined(__aarch64__)
+                // Most cells have no score above the threshold; skip them 64 scores at a time
+                const int8x16_t cell_max = vmaxq_s8(vmaxq_s8(vld1q_s8(cell), vld1q_s8(cell + 16)),
+                                                    vmaxq_s8(vld1q_s8(cell + 32), vld1q_s8(cell + 48)));
+                if (vmaxvq_s8(cell_max) <= quant_threshold) {
+                    continue;
+                }
+            #endif
+            
+            for (int c = 0; c < score_channels; ++c) {
+                const int score = cell[c];
+                if (score <= quant_threshold) {
+                    continue;
+                }
+                
+                // Convert cell index to pixel coordinates in the feature map
+                const int x = w * cell_size + c % 8;
+                const int y = h * cell_size + c / 8;
+                const int bucket = (y / bucket_size) * grid_width + x / bucket_size;
+                const int pixel = y * map_width + x;
+                
+                // Ties go to the first pixel in raster order
+                if (score > best_score[bucket] ||
+                    (score == best_score[bucket] && best_pixel[bucket] >= 0 && pixel < best_pixel[bucket])) {
+                    best_score[bucket] = score;
+                    best_pixel[bucket] = pixel;
+                }
+            }
+        }
+    }
+    
+    // Second pass: drop bucket maxima beaten by a neighbouring maximum within the radius
+    const float radius_sq = radius * radius;
+    for (int gy = 0; gy < grid_height; ++gy) {
+        for (int gx = 0; gx < grid_width; ++gx) {
+            const int bucket = gy * grid_width + gx;
+            const int pixel = best_pixel[bucket];
+            if (pixel < 0) {
+                continue;
+            }
+            
+            const int score = best_score[bucket];
+            const int x = pixel % map_width;
+            const int y = pixel / map_width;
+            
+            bool suppressed = false;
+            for (int ny = std::max(0, gy - 1); ny <= std::min(grid_height - 1, gy + 1) && !suppressed; ++ny) {
+                for (int nx = std::max(0, gx - 1); nx <= std::min(grid_width - 1, gx + 1); ++nx) {
+                    const int neighbour = ny * grid_width + nx;
+                    const int neighbour_pixel = best_pixel[neighbour];
+                    if (neighbour == bucket || neighbour_pixel < 0) {
+                        continue;
+                    }
+                    
+                    const int neighbour_score = best_score[neighbour];
+                    if (neighbour_score < score || (neighbour_score == score && neighbour_pixel > pixel)) {
+                        continue;
+                    }
+                    
+                    const float dx = static_cast<float>(neighbour_pixel % map_width - x);
+                    const float dy = static_cast<float>(neighbour_pixel / map_width - y);
+                    if (dx * dx + dy * dy < radius_sq) {
+                        suppressed = true;
+                        break;
+                    }
+                }
+            }
+            
+            if (!suppressed) {
+                const float response = (score - semi_quant_zero_point_) * semi_quant_scale_;
+                keypoints.emplace_back(static_cast<float>(x), static_cast<float>(y), 8.0f, -1, response, 0);
+            }
+        }
+    }
+    
+    return keypoints;
+}
+
+void TPUFeatureExtractor::postprocessResults(
+    const cv::Mat& original_image,
+    const cv::InputArray& mask_in,
+    const int8_t* semi_data,
+    const int8_t* descriptor_data,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::Mat& descriptors,
+    std::vector<int>& vLappingArea)
+{
+    keypoints.clear();
+    
+    // Get mask if provided
+    cv::Mat mask = mask_in.getMat();
+    
+    // 1. Apply non-maximum suppression to extract keypoints
+    std::vector<cv::KeyPoint> nms_keypoints = applyNMS(semi_data, nms_radius_, confidence_threshold_);
+    
+    // 2. Map keypoints to original image coordinates
+    for (auto& kp : nms_keypoints) {
+        // Convert feature map coordinates to original image coordinates
+        float x = kp.pt.x * original_image.cols / (semi_width_ * 8);
+        float y = kp.pt.y * original_image.rows / (semi_height_ * 8);
+        
+        // Check if the point is within the mask (if provided)
+        if (!mask.empty()) {
+            int img_x = static_cast<int>(x);
+            int img_y = static_cast<int>(y);
+            
+            // Ensure coordinates are within image bounds
             if (img_x < 0 || img_x >= original_image.cols || 
                 img_y < 0 || img_y >= original_image.rows) {
                 continue;
             }
             
-            // Check mask value
-            if (mask.at<uchar>(img_y, img_x) == 0) {
-                continue; // Skip masked points
+            // Check mask value
+            if (mask.at<uchar>(img_y, img_x) == 0) {
+                continue; // Skip masked points
+            }
+        }
+        
+        // Update keypoint coordinates
+        kp.pt.x = x;
+        kp.pt.y = y;
+        keypoints.push_back(kp);
+    }
+    
+    // 3. If we have a target number of features, keep the top N
+    const int n_features_target = n_features_target_;
+    if (n_features_target > 0 && keypoints.size() > static_cast<size_t>(n_features_target)) {
+        // Partition by score (descending); the order within the top N does not matter
+        std::nth_element(keypoints.begin(), keypoints.begin() + n_features_target, keypoints.end(),
+                 [](const cv::KeyPoint& a, const cv::KeyPoint& b) {
+                     return a.response > b.response;
+                 });
+        
+        // Keep only the top n_features_target keypoints
+        keypoints.resize(n_features_target);
+    }
+    
+    // 4. Extract descriptors for the selected keypoints
+    sampleDescriptors(descriptor_data, original_image.size(), keypoints, descriptors);
+    
+    // 5. Handle vLappingArea (specific to ORB-SLAM3)
+    vLappingArea.clear();
+}
+
+void TPUFeatureExtractor::sampleDescriptors(
+    const int8_t* descriptor_data,
+    const cv::Size& image_size,
+    const std::vector<cv::KeyPoint>& keypoints,
+    cv::Mat& descriptors)
+{
+    const int num_keypoints = static_cast<int>(keypoints.size());
+    const DescriptorMode mode = descriptor_mode_;
+    if (mode == DescriptorMode::BINARY_BILINEAR) {
+        descriptors = cv::Mat(num_keypoints, (descriptor_channels_ + 7) / 8, CV_8U, cv::Scalar(0));
+    } else {
+        descriptors = cv::Mat(num_keypoints, descriptor_channels_, CV_32F, cv::Scalar(0.0f));
+    }
+    if (!descriptor_data || num_keypoints == 0) {
+        return;
+    }
+    
+    const int plane_size = descriptor_height_ * descriptor_width_;
+    
+    // Keypoint to descriptor cell scale; the model sees descriptor_width_ * 8 pixels
+    const float cells_per_px_x = static_cast<float>(descriptor_width_) / image_size.width;
+    const float cells_per_px_y = static_cast<float>(descriptor_height_) / image_size.height;
+    
+    // Use OpenMP for parallel processing if available
+    #pragma omp parallel for if(num_keypoints > 50)
+    for (int i = 0; i < num_keypoints; ++i) {
+        if (mode != DescriptorMode::FLOAT_NEAREST) {
+            // Cell centers sit at the middle of each 8x8 block
+            std::vector<float> values(descriptor_channels_);
+            interpolateDescriptor(descriptor_data,
+                                  keypoints[i].pt.x * cells_per_px_x - 0.5f,
+                                  keypoints[i].pt.y * cells_per_px_y - 0.5f,
+                                  values.data());
+            
+            if (mode == DescriptorMode::BINARY_BILINEAR) {
+                // One bit per channel, set for positive values, packed LSB first as in ORB
+                uchar* row = descriptors.ptr<uchar>(i);
+                for (int c = 0; c < descriptor_channels_; ++c) {
+                    if (values[c] > 0.0f) {
+                        row[c / 8] |= static_cast<uchar>(1 << (c % 8));
+                    }
+                }
+            } else {
+                float sum_sq = 0.0f;
+                for (int c = 0; c < descriptor_channels_; ++c) {
+                    sum_sq += values[c] * values[c];
+                }
+                if (sum_sq > 0.0f) {
+                    const float inv_norm = 1.0f / std::sqrt(sum_sq);
+                    float* row = descriptors.ptr<float>(i);
+                    for (int c = 0; c < descriptor_channels_; ++c) {
+                        row[c] = values[c] * inv_norm;
+                    }
+                }
+            }
+            continue;
+        }
+        
+        // Convert keypoint coordinates to descriptor map coordinates
+        int desc_w = static_cast<int>(keypoints[i].pt.x * descriptor_width_ / image_size.width);
+        int desc_h = static_cast<int>(keypoints[i].pt.y * descriptor_height_ / image_size.height);
+        
+        // Clamp to valid range
+        desc_w = std::max(0, std::min(desc_w, descriptor_width_ - 1));
+        desc_h = std::max(0, std::min(desc_h, descriptor_height_ - 1));
+        
+        // Gather the cell across the channel planes, without the zero point.
+        // The dequantization scale cancels out in the L2 normalization.
+        std::vector<int16_t> centered(descriptor_channels_);
+        const int8_t* cell = descriptor_data + desc_h * descriptor_width_ + desc_w;
+        for (int c = 0; c < descriptor_channels_; ++c) {
+            centered[c] = static_cast<int16_t>(cell[static_cast<size_t>(c) * plane_size] - descriptor_quant_zero_point_);
+        }
+        
+        int c = 0;
+        int32_t sum_sq = 0;
+        #if defined(__ARM_NEON) && defined(__aarch64__)
+            int32x4_t acc = vdupq_n_s32(0);
+            for (; c + 8 <= descriptor_channels_; c += 8) {
+                const int16x8_t v = vld1q_s16(&centered[c]);
+                acc = vmlal_s16(acc, vget_low_s16(v), vget_low_s16(v));
+                acc = vmlal_high_s16(acc, v, v);
+            }
+            sum_sq = vaddvq_s32(acc);
+        #endif
+        for (; c < descriptor_channels_; ++c) {
+            sum_sq += centered[c] * centered[c];
+        }
+        
+        // Normalize descriptor to unit length (L2 norm)
+        if (sum_sq == 0) {
+            continue;
+        }
+        const float inv_norm = 1.0f / std::sqrt(static_cast<float>(sum_sq));
+        float* row = descriptors.ptr<float>(i);
+        
+        c = 0;
+        #if defined(__ARM_NEON) && defined(__aarch64__)
+            for (; c + 8 <= descriptor_channels_; c += 8) {
+                const int16x8_t v = vld1q_s16(&centered[c]);
+                vst1q_f32(row + c, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), inv_norm));
+                vst1q_f32(row + c + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(v)), inv_norm));
+            }
+        #endif
+        for (; c < descriptor_channels_; ++c) {
+            row[c] = centered[c] * inv_norm;
+        }
+    }
+}
+
+void TPUFeatureExtractor::extractMultiScale(
+    const cv::Mat& image,
+    const cv::InputArray& mask_in,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::Mat& descriptors)
+{
+    keypoints.clear();
+    descriptors = cv::Mat();
+    
+    cv::Mat mask = mask_in.getMat();
+    const cv::Size model_size = GetModelInputSize();
+    const cv::Size feature_size(semi_width_ * 8, semi_height_ * 8);
+    const int num_levels = std::min(inference_levels_, static_cast<int>(mvImagePyramid.size()));
+    
+    // Candidates of all levels in image coordinates; descriptors stay in their tile's matrix
+    std::vector<cv::KeyPoint> candidates;
+    std::vector<cv::Mat> tile_descriptors;
+    std::vector<std::pair<int, int>> candidate_rows; // (tile, row)
+    int last_level = 0;
+    
+    for (int level = 0; level < num_levels; ++level) {
+        const cv::Mat& level_image = mvImagePyramid[level];
+        const float level_scale = scale_factors_[level];
+        last_level = level;
+        
+        // The first level that fits into the model (or the last one) runs as a whole
+        const bool whole = (level_image.cols <= model_size.width && level_image.rows <= model_size.height) ||
+                           level == num_levels - 1;
+        
+        // Otherwise cover the level with model-sized tiles, overlapping rather than padding
+        std::vector<cv::Rect> tiles;
+        if (whole) {
+            tiles.emplace_back(0, 0, level_image.cols, level_image.rows);
+        } else {
+            const int tiles_x = (level_image.cols + model_size.width - 1) / model_size.width;
+            const int tiles_y = (level_image.rows + model_size.height - 1) / model_size.height;
+            const int tile_width = std::min(model_size.width, level_image.cols);
+            const int tile_height = std::min(model_size.height, level_image.rows);
+            for (int ty = 0; ty < tiles_y; ++ty) {
+                for (int tx = 0; tx < tiles_x; ++tx) {
+                    const int x = tiles_x > 1 ? tx * (level_image.cols - tile_width) / (tiles_x - 1) : 0;
+                    const int y = tiles_y > 1 ? ty * (level_image.rows - tile_height) / (tiles_y - 1) : 0;
+                    tiles.emplace_back(x, y, tile_width, tile_height);
+                }
+            }
+        }
+        
+        for (const cv::Rect& roi : tiles) {
+            // Skip tiles that see (almost) only masked pixels
+            if (!mask.empty()) {
+                const cv::Rect image_roi = cv::Rect(
+                    static_cast<int>(roi.x * level_scale), static_cast<int>(roi.y * level_scale),
+                    static_cast<int>(std::ceil(roi.width * level_scale)),
+                    static_cast<int>(std::ceil(roi.height * level_scale))) & cv::Rect(0, 0, mask.cols, mask.rows);
+                const int valid = image_roi.area() > 0 ? cv::countNonZero(mask(image_roi)) : 0;
+                if (valid == 0 || valid < min_tile_mask_coverage_ * image_roi.area()) {
+                    continue;
+                }
+            }
+            
+            // A level narrower than the model in one dimension is padded, not stretched
+            cv::Mat tile_image = whole ? level_image : level_image(roi);
+            if (!whole && (roi.width < model_size.width || roi.height < model_size.height)) {
+                cv::copyMakeBorder(tile_image, tile_image, 0, model_size.height - roi.height,
+                                   0, model_size.width - roi.width, cv::BORDER_REPLICATE);
+            }
+            
+            const int8_t* semi_data = nullptr;
+            const int8_t* descriptor_data = nullptr;
+            if (!runInference(preprocessImage(tile_image, model_size))) {
+                continue;
+            }
+            if (backend_ == Backend::RKNN_NPU ? !getNPUOutputData(npu_.get(), semi_data, descriptor_data)
+                                              : !getOutputData(interpreter_.get(), 0, semi_data, descriptor_data)) {
+                continue;
+            }
+            
+            std::vector<cv::KeyPoint> tile_keypoints = applyNMS(semi_data, nms_radius_, confidence_threshold_);
+            cv::Mat tile_desc;
+            sampleDescriptors(descriptor_data, feature_size, tile_keypoints, tile_desc);
+            
+            // Feature map pixels to level pixels
+            const float sx = static_cast<float>(whole ? roi.width : model_size.width) / feature_size.width;
+            const float sy = static_cast<float>(whole ? roi.height : model_size.height) / feature_size.height;
+            
+            for (size_t j = 0; j < tile_keypoints.size(); ++j) {
+                cv::KeyPoint kp = tile_keypoints[j];
+                const float level_x = roi.x + kp.pt.x * sx;
+                const float level_y = roi.y + kp.pt.y * sy;
+                if (level_x >= roi.x + roi.width || level_y >= roi.y + roi.height) {
+                    continue; // Padding
+                }
+                
+                kp.pt.x = level_x * level_scale;
+                kp.pt.y = level_y * level_scale;
+                kp.octave = level;
+                kp.size = 8.0f * level_scale;
+                
+                // Check the mask before NMS so masked points do not suppress others
+                if (!mask.empty()) {
+                    const int img_x = static_cast<int>(kp.pt.x);
+                    const int img_y = static_cast<int>(kp.pt.y);
+                    if (img_x < 0 || img_x >= image.cols || img_y < 0 || img_y >= image.rows ||
+                        mask.at<uchar>(img_y, img_x) == 0) {
+                        continue;
+                    }
+                }
+                
+                candidates.push_back(kp);
+                candidate_rows.emplace_back(static_cast<int>(tile_descriptors.size()), static_cast<int>(j));
+            }
+            tile_descriptors.push_back(tile_desc);
+        }
+        
+        if (whole) {
+            break;
+        }
+    }
+    
+    if (candidates.empty()) {
+        return;
+    }
+    
+    // Scale-aware NMS across levels and overlapping tiles. Each level already
+    // kept at most one point per bucket, so this greedy pass sees few points.
+    std::vector<int> order(candidates.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<int>(i);
+    }
+    std::sort(order.begin(), order.end(), [&candidates](int a, int b) {
+        return candidates[a].response > candidates[b].response;
+    });
+    
+    // Buckets as wide as the largest radius, so neighbours lie in the 3x3 buckets
+    const float max_radius = nms_radius_ * scale_factors_[last_level];
+    const int bucket_size = std::max(1, static_cast<int>(std::ceil(max_radius)));
+    const int grid_width = image.cols / bucket_size + 1;
+    const int grid_height = image.rows / bucket_size + 1;
+    std::vector<std::vector<int>> grid(static_cast<size_t>(grid_width) * grid_height);
+    const int n_features_target = n_features_target_;
+    
+    std::vector<int> accepted;
+    for (int index : order) {
+        const cv::KeyPoint& kp = candidates[index];
+        const float radius = nms_radius_ * scale_factors_[kp.octave];
+        const int gx = std::max(0, std::min(grid_width - 1, static_cast<int>(kp.pt.x) / bucket_size));
+        const int gy = std::max(0, std::min(grid_height - 1, static_cast<int>(kp.pt.y) / bucket_size));
+        
+        bool suppressed = false;
+        for (int ny = std::max(0, gy - 1); ny <= std::min(grid_height - 1, gy + 1) && !suppressed; ++ny) {
+            for (int nx = std::max(0, gx - 1); nx <= std::min(grid_width - 1, gx + 1) && !suppressed; ++nx) {
+                for (int other : grid[ny * grid_width + nx]) {
+                    const cv::KeyPoint& kept = candidates[other];
+                    const float r = std::max(radius, nms_radius_ * scale_factors_[kept.octave]);
+                    const float dx = kp.pt.x - kept.pt.x;
+                    const float dy = kp.pt.y - kept.pt.y;
+                    if (dx * dx + dy * dy < r * r) {
+                        suppressed = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (suppressed) {
+            continue;
+        }
+        
+        grid[gy * grid_width + gx].push_back(index);
+        accepted.push_back(index);
+        
+        // Points come strongest first, so the target count can stop the pass
+        if (n_features_target > 0 && accepted.size() >= static_cast<size_t>(n_features_target)) {
+            break;
+        }
+    }
+    
+    // Gather keypoints and their descriptor rows
+    const cv::Mat& first_desc = tile_descriptors[candidate_rows[accepted[0]].first];
+    descriptors = cv::Mat(static_cast<int>(accepted.size()), first_desc.cols, first_desc.type());
+    keypoints.reserve(accepted.size());
+    for (size_t i = 0; i < accepted.size(); ++i) {
+        const auto& source = candidate_rows[accepted[i]];
+        keypoints.push_back(candidates[accepted[i]]);
+        tile_descriptors[source.first].row(source.second).copyTo(descriptors.row(static_cast<int>(i)));
+    }
+}
+
+void TPUFeatureExtractor::interpolateDescriptor(
+    const int8_t* descriptor_data,
+    float u,
+    float v,
+    float* values) const
+{
+    // Clamp to the cell centers at the border
+    u = std::max(0.0f, std::min(u, static_cast<float>(descriptor_width_ - 1)));
+    v = std::max(0.0f, std::min(v, static_cast<float>(descriptor_height_ - 1)));
+    
+    const int x0 = static_cast<int>(u);
+    const int y0 = static_cast<int>(v);
+    const int x1 = std::min(x0 + 1, descriptor_width_ - 1);
+    const int y1 = std::min(y0 + 1, descriptor_height_ - 1);
+    const float fx = u - x0;
+    const float fy = v - y0;
+    
+    const float w00 = (1.0f - fx) * (1.0f - fy);
+    const float w01 = fx * (1.0f - fy);
+    const float w10 = (1.0f - fx) * fy;
+    const float w11 = fx * fy;
+    
+    const int i00 = y0 * descriptor_width_ + x0;
+    const int i01 = y0 * descriptor_width_ + x1;
+    const int i10 = y1 * descriptor_width_ + x0;
+    const int i11 = y1 * descriptor_width_ + x1;
+    const size_t plane_size = static_cast<size_t>(descriptor_height_) * descriptor_width_;
+    
+    // The weights sum to 1, so the zero point is removed once after interpolation
+    for (int c = 0; c < descriptor_channels_; ++c) {
+        const int8_t* plane = descriptor_data + c * plane_size;
+        values[c] = w00 * plane[i00] + w01 * plane[i01] + w10 * plane[i10] + w11 * plane[i11]
+                    - descriptor_quant_zero_point_;
+    }
+}
+
+int TPUFeatureExtractor::operator()(
+    cv::InputArray image_in,
+    cv::InputArray mask_in,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::OutputArray descriptors_out,
+    std::vector<int>& vLappingArea)
+{
+    return (*this)(image_in, cv::noArray(), mask_in, keypoints, descriptors_out, vLappingArea);
+}
+
+int TPUFeatureExtractor::operator()(
+    cv::InputArray image_in,
+    cv::InputArray model_input_in,
+    cv::InputArray mask_in,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::OutputArray descriptors_out,
+    std::vector<int>& vLappingArea)
+{
+    if (ladder_.size() == 1 || image_in.empty()) {
+        return extract(image_in, model_input_in, mask_in, keypoints, descriptors_out, vLappingArea);
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    TPUFeatureExtractor& extractor = beginLadderCall();
+    const int n_keypoints = extractor.extract(image_in, model_input_in, mask_in, keypoints, descriptors_out, vLappingArea);
+    endLadderCall(extractor, std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start_time).count());
+    return n_keypoints;
+}
+
+int TPUFeatureExtractor::extract(
+    cv::InputArray image_in,
+    cv::InputArray model_input_in,
+    cv::InputArray mask_in,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::OutputArray descriptors_out,
+    std::vector<int>& vLappingArea)
+{
+    if (image_in.empty()) {
+        return 0;
+    }
+    TRACE_SCOPE("TPUExtract");
+    
+    // Performance tracking
+    auto start_time = std::chrono::high_resolution_clock::now();
+    auto preprocess_start = start_time;
+    
+    cv::Mat image = image_in.getMat();
+    
+    // Create image pyramid for compatibility with ORB-SLAM3
+    createImagePyramid(image);
+    
+    // Multi-scale inference runs on the pyramid instead of the model input
+    if (inference_levels_ > 1) {
+        cv::Mat descriptors_mat;
+        extractMultiScale(image, mask_in, keypoints, descriptors_mat);
+        vLappingArea.clear();
+        
+        descriptors_out.create(descriptors_mat.size(), descriptors_mat.type());
+        descriptors_mat.copyTo(descriptors_out.getMat());
+        
+        // Tiles interleave the stages, so the whole extraction counts as inference
+        total_inference_time += std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - start_time).count();
+        frame_count++;
+        
+        return static_cast<int>(keypoints.size());
+    }
+
+    // A fully masked frame has nothing to extract
+    if (!mask_in.empty() && cv::countNonZero(mask_in.getMat()) == 0) {
+        keypoints.clear();
+        descriptors_out.release();
+        vLappingArea.clear();
+        return 0;
+    }
+
+    // 1. Preprocess image (a pre-scaled model input skips the resize)
+    cv::Mat model_input = model_input_in.empty() ? image : model_input_in.getMat();
+    cv::Mat preprocessed_img = preprocessImage(model_input, GetModelInputSize());
+    
+    auto inference_start = std::chrono::high_resolution_clock::now();
+    auto preprocess_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        inference_start - preprocess_start).count();
+    
+    // 2. Run inference
+    const int8_t* semi_data = nullptr;
+    const int8_t* descriptor_data = nullptr;
+    if (runInference(preprocessed_img)) {
+        if (backend_ == Backend::RKNN_NPU) {
+            getNPUOutputData(npu_.get(), semi_data, descriptor_data);
+        } else {
+            getOutputData(interpreter_.get(), 0, semi_data, descriptor_data);
+        }
+    }
+    
+    auto postprocess_start = std::chrono::high_resolution_clock::now();
+    auto inference_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        postprocess_start - inference_start).count();
+
+    // 3. Postprocess results
+    cv::Mat descriptors_mat;
+    postprocessResults(image, mask_in, semi_data, descriptor_data, keypoints, descriptors_mat, vLappingArea);
+
+    // 4. Copy descriptors to output
+    descriptors_out.create(descriptors_mat.size(), descriptors_mat.type());
+    descriptors_mat.copyTo(descriptors_out.getMat());
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto postprocess_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        end_time - postprocess_start).count();
+    
+    // Update performance tracking
+    total_preprocess_time += preprocess_duration;
+    total_inference_time += inference_duration;
+    total_postprocess_time += postprocess_duration;
+    frame_count++;
+    
+    // Log performance for this frame
+    if (frame_count % 10 == 0) {
+        std::cout << "Frame " << frame_count << " timing: "
+                  << "preprocess=" << preprocess_duration << "ms, "
+                  << "inference=" << inference_duration << "ms, "
+                  << "postprocess=" << postprocess_duration << "ms, "
+                  << "total=" << (preprocess_duration + inference_duration + postprocess_duration) << "ms, "
+                  << "keypoints=" << keypoints.size() << std::endl;
+    }
+
+    return static_cast<int>(keypoints.size());
+}
+
+int TPUFeatureExtractor::ExtractBatch(
+    const std::vector<cv::Mat>& images,
+    const std::vector<cv::Mat>& model_inputs,
+    std::vector<std::vector<cv::KeyPoint>>& keypoints,
+    std::vector<cv::Mat>& descriptors)
+{
+    if (ladder_.size() == 1 || images.empty()) {
+        return extractBatch(images, model_inputs, keypoints, descriptors);
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    TPUFeatureExtractor& extractor = beginLadderCall();
+    const int n_keypoints = extractor.extractBatch(images, model_inputs, keypoints, descriptors);
+    endLadderCall(extractor, std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start_time).count());
+    return n_keypoints;
+}
+
+int TPUFeatureExtractor::extractBatch(
+    const std::vector<cv::Mat>& images,
+    const std::vector<cv::Mat>& model_inputs,
+    std::vector<std::vector<cv::KeyPoint>>& keypoints,
+    std::vector<cv::Mat>& descriptors)
+{
+    const size_t num_images = images.size();
+    keypoints.assign(num_images, std::vector<cv::KeyPoint>());
+    descriptors.assign(num_images, cv::Mat());
+    
+    if (num_images == 0 || (!interpreter_ && !npu_)) {
+        return 0;
+    }
+    TRACE_SCOPE_VALUE("TPUExtractBatch", num_images);
+    
+    // Single-image models, which includes all NPU models, go through the
+    // Submit()/Complete() pipeline, which also overlaps the preprocessing of
+    // each image with the previous Invoke()
+    if (input_tensor_batch_ == 1) {
+        std::vector<int64_t> tickets(num_images, -1);
+        for (size_t i = 0; i < num_images; ++i) {
+            const bool has_model_input = i < model_inputs.size() && !model_inputs[i].empty();
+            tickets[i] = Submit(images[i], has_model_input ? model_inputs[i] : cv::Mat(), cv::noArray());
+        }
+        
+        int total_keypoints = 0;
+        for (size_t i = 0; i < num_images; ++i) {
+            std::vector<int> lapping_area;
+            if (tickets[i] >= 0 && Complete(tickets[i], keypoints[i], descriptors[i], lapping_area) > 0) {
+                total_keypoints += static_cast<int>(keypoints[i].size());
+            }
+        }
+        return total_keypoints;
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    // 1. Preprocess all images up front so the TPU is fed back to back
+    std::vector<cv::Mat> preprocessed(num_images);
+    for (size_t i = 0; i < num_images; ++i) {
+        const bool has_model_input = i < model_inputs.size() && !model_inputs[i].empty();
+        preprocessed[i] = preprocessImage(has_model_input ? model_inputs[i] : images[i], GetModelInputSize());
+    }
+    
+    auto inference_start = std::chrono::high_resolution_clock::now();
+    
+    // 2. Run inference, one Invoke() per batch. The int8 outputs are copied
+    // out before the next Invoke() overwrites them, and the postprocessing of
+    // a batch runs on a worker thread while the TPU works on the next one.
+    std::vector<std::future<void>> postprocessing;
+    postprocessing.reserve(num_images);
+    
+    for (size_t first = 0; first < num_images; first += input_tensor_batch_) {
+        const size_t count = std::min(static_cast<size_t>(input_tensor_batch_), num_images - first);
+        
+        bool filled = true;
+        for (size_t slot = 0; slot < count && filled; ++slot) {
+            filled = fillInputTensor(interpreter_.get(), static_cast<int>(slot), preprocessed[first + slot]);
+        }
+        if (!filled) {
+            break;
+        }
+        
+        if (interpreter_->Invoke() != kTfLiteOk) {
+            std::cerr << "Failed to invoke TFLite interpreter." << std::endl;
+            break;
+        }
+        
+        for (size_t slot = 0; slot < count; ++slot) {
+            const size_t i = first + slot;
+            const int8_t* semi_data = nullptr;
+            const int8_t* descriptor_data = nullptr;
+            if (!getOutputData(interpreter_.get(), static_cast<int>(slot), semi_data, descriptor_data)) {
+                continue;
+            }
+            auto semi = std::make_shared<std::vector<int8_t>>(semi_data, semi_data + semiSlotSize());
+            auto desc = std::make_shared<std::vector<int8_t>>(descriptor_data, descriptor_data + descriptorSlotSize());
+            
+            postprocessing.push_back(std::async(std::launch::async,
+                [this, &images, &keypoints, &descriptors, i, semi, desc]() {
+                    std::vector<int> lapping_area;
+                    postprocessResults(images[i], cv::noArray(), semi->data(), desc->data(),
+                                       keypoints[i], descriptors[i], lapping_area);
+                }));
+        }
+    }
+    
+    auto postprocess_start = std::chrono::high_resolution_clock::now();
+    
+    // 3. Wait for the postprocessing of the last batch
+    for (auto& task : postprocessing) {
+        task.get();
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    
+    // Update performance tracking (averages stay per image)
+    total_preprocess_time += std::chrono::duration_cast<std::chrono::milliseconds>(inference_start - start_time).count();
+    total_inference_time += std::chrono::duration_cast<std::chrono::milliseconds>(postprocess_start - inference_start).count();
+    total_postprocess_time += std::chrono::duration_cast<std::chrono::milliseconds>(end_time - postprocess_start).count();
+    frame_count += static_cast<int>(num_images);
+    
+    int total_keypoints = 0;
+    for (const auto& kps : keypoints) {
+        total_keypoints += static_cast<int>(kps.size());
+    }
+    return total_keypoints;
+}
+
+int64_t TPUFeatureExtractor::Submit(
+    cv::InputArray image_in,
+    cv::InputArray model_input_in,
+    cv::InputArray mask_in)
+{
+    if (image_in.empty() || !startPipeline()) {
+        return -1;
+    }
+    TRACE_SCOPE("TPUSubmit");
+    
+    // 1. Preprocess on the calling thread while the TPU works on earlier images
+    auto preprocess_start = std::chrono::high_resolution_clock::now();
+    cv::Mat image = image_in.getMat();
+    cv::Mat model_input = model_input_in.empty() ? image : model_input_in.getMat();
+    cv::Mat preprocessed_img = preprocessImage(model_input, GetModelInputSize());
+    
+    // 2. Take a free slot
+    int slot_index = -1;
+    int64_t ticket = -1;
+    {
+        std::unique_lock<std::mutex> lock(pipeline_mutex_);
+        pipeline_cv_.wait(lock, [this, &slot_index]() {
+            for (size_t i = 0; i < pipeline_slots_.size(); ++i) {
+                if (pipeline_slots_[i]->state == PipelineSlot::State::FREE) {
+                    slot_index = static_cast<int>(i);
+                    return true;
+                }
             }
+            return !pipeline_running_;
+        });
+        
+        if (slot_index < 0) {
+            return -1;
         }
         
-        // Update keypoint coordinates
-        kp.pt.x = x;
-        kp.pt.y = y;
-        keypoints.push_back(kp);
+        ticket = next_ticket_++;
+        pipeline_slots_[slot_index]->state = PipelineSlot::State::FILLING;
+        pipeline_slots_[slot_index]->ticket = ticket;
     }
     
-    // 4. If we have a target number of features, keep the top N
-    if (n_features_target_ > 0 && keypoints.size() > static_cast<size_t>(n_features_target_)) {
-        // Sort by score (descending)
-        std::sort(keypoints.begin(), keypoints.end(), 
-                 [](const cv::KeyPoint& a, const cv::KeyPoint& b) {
-                     return a.response > b.response;
-                 });
-        
-        // Keep only the top n_features_target_ keypoints
-        keypoints.resize(n_features_target_);
+    // 3. Fill the slot's input tensor; no other thread touches a FILLING slot
+    PipelineSlot& slot = *pipeline_slots_[slot_index];
+    slot.image = image;
+    slot.mask = mask_in.getMat();
+    slot.ok = slot.npu ? fillNPUInput(slot.npu.get(), preprocessed_img)
+                       : fillInputTensor(slot.interpreter.get(), 0, preprocessed_img);
+    slot.preprocess_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - preprocess_start).count();
+    
+    // 4. Queue it for the TPU (a failed slot is passed through to Complete())
+    {
+        std::lock_guard<std::mutex> lock(pipeline_mutex_);
+        slot.state = PipelineSlot::State::QUEUED;
+        tpu_queue_.push_back(slot_index);
     }
+    pipeline_cv_.notify_all();
+    
+    return ticket;
+}
+
+int TPUFeatureExtractor::Complete(
+    int64_t ticket,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::OutputArray descriptors_out,
+    std::vector<int>& vLappingArea)
+{
+    keypoints.clear();
+    vLappingArea.clear();
+    TRACE_SCOPE_VALUE("TPUComplete", ticket);
     
-    // 5. Extract descriptors for the selected keypoints
-    int num_keypoints = keypoints.size();
-    descriptors = cv::Mat(num_keypoints, descriptor_channels_, CV_32F);
+    std::unique_lock<std::mutex> lock(pipeline_mutex_);
     
-    // Use OpenMP for parallel processing if available
-    #pragma omp parallel for if(num_keypoints > 50)
-    for (int i = 0; i < num_keypoints; ++i) {
-        // Convert keypoint coordinates to descriptor map coordinates
-        int desc_w = static_cast<int>(keypoints[i].pt.x * descriptor_width_ / original_image.cols);
-        int desc_h = static_cast<int>(keypoints[i].pt.y * descriptor_height_ / original_image.rows);
+    PipelineSlot* slot = nullptr;
+    for (auto& candidate : pipeline_slots_) {
+        if (candidate->state != PipelineSlot::State::FREE && candidate->ticket == ticket) {
+            slot = candidate.get();
+            break;
+        }
+    }
+    if (!slot) {
+        std::cerr << "Unknown pipeline ticket: " << ticket << std::endl;
+        return -1;
+    }
+    
+    pipeline_cv_.wait(lock, [this, slot]() {
+        return slot->state == PipelineSlot::State::DONE || !pipeline_running_;
+    });
+    if (slot->state != PipelineSlot::State::DONE) {
+        return -1;
+    }
+    
+    // Take the results and hand the slot back to Submit()
+    const bool ok = slot->ok;
+    keypoints = std::move(slot->keypoints);
+    vLappingArea = std::move(slot->lapping_area);
+    cv::Mat descriptors_mat = slot->descriptors;
+    slot->keypoints.clear();
+    slot->descriptors = cv::Mat();
+    slot->image = cv::Mat();
+    slot->mask = cv::Mat();
+    slot->ticket = -1;
+    slot->state = PipelineSlot::State::FREE;
+    lock.unlock();
+    pipeline_cv_.notify_all();
+    
+    if (!ok) {
+        return -1;
+    }
+    
+    descriptors_out.create(descriptors_mat.size(), descriptors_mat.type());
+    descriptors_mat.copyTo(descriptors_out.getMat());
+    
+    return static_cast<int>(keypoints.size());
+}
+
+bool TPUFeatureExtractor::SetPipelineDepth(int num_slots)
+{
+    if (num_slots < 1) {
+        std::cerr << "Pipeline depth must be at least 1, got " << num_slots << std::endl;
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(pipeline_mutex_);
+        for (const auto& slot : pipeline_slots_) {
+            if (slot->state != PipelineSlot::State::FREE) {
+                std::cerr << "Cannot change pipeline depth while images are in flight." << std::endl;
+                return false;
+            }
+        }
+    }
+    
+    // The slots are rebuilt with the new depth on the next Submit()
+    stopPipeline();
+    std::lock_guard<std::mutex> lock(pipeline_mutex_);
+    pipeline_depth_ = num_slots;
+    return true;
+}
+
+int TPUFeatureExtractor::GetPipelineDepth() const
+{
+    std::lock_guard<std::mutex> lock(pipeline_mutex_);
+    return pipeline_depth_;
+}
+
+bool TPUFeatureExtractor::startPipeline()
+{
+    std::lock_guard<std::mutex> lock(pipeline_mutex_);
+    if (pipeline_running_) {
+        return true;
+    }
+    if (!model_ && !npu_) {
+        std::cerr << "Model not loaded." << std::endl;
+        return false;
+    }
+    
+    // One interpreter (NPU context) per slot, so a slot can be filled while another runs
+    pipeline_slots_.clear();
+    for (int i = 0; i < pipeline_depth_; ++i) {
+        auto slot = std::unique_ptr<PipelineSlot>(new PipelineSlot());
+        if (backend_ == Backend::RKNN_NPU) {
+            slot->npu = buildNPUContext();
+        } else {
+            slot->interpreter = buildInterpreter();
+        }
+        if (!slot->interpreter && !slot->npu) {
+            std::cerr << "Failed to create interpreter for pipeline slot " << i << std::endl;
+            pipeline_slots_.clear();
+            return false;
+        }
+        pipeline_slots_.push_back(std::move(slot));
+    }
+    for (const auto& slot : pipeline_slots_) {
+        if (slot->interpreter) {
+            pipeline_arena_bytes_ += interpreterArenaBytes(*slot->interpreter);
+        }
+    }
+    MemoryAccounting::Add(MemoryBreakdown::TPU_ARENAS, pipeline_arena_bytes_);
+    
+    tpu_queue_.clear();
+    postprocess_queue_.clear();
+    pipeline_running_ = true;
+    tpu_thread_ = std::thread(&TPUFeatureExtractor::tpuThreadFunc, this);
+    postprocess_thread_ = std::thread(&TPUFeatureExtractor::postprocessThreadFunc, this);
+    
+    std::cout << "TPUFeatureExtractor pipeline started with " << pipeline_depth_ << " slots." << std::endl;
+    return true;
+}
+
+void TPUFeatureExtractor::stopPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(pipeline_mutex_);
+        if (!pipeline_running_) {
+            return;
+        }
+        pipeline_running_ = false;
+    }
+    pipeline_cv_.notify_all();
+    
+    if (tpu_thread_.joinable()) {
+        tpu_thread_.join();
+    }
+    if (postprocess_thread_.joinable()) {
+        postprocess_thread_.join();
+    }
+    
+    std::lock_guard<std::mutex> lock(pipeline_mutex_);
+    tpu_queue_.clear();
+    postprocess_queue_.clear();
+    pipeline_slots_.clear();
+    MemoryAccounting::Remove(MemoryBreakdown::TPU_ARENAS, pipeline_arena_bytes_);
+    pipeline_arena_bytes_ = 0;
+}
+
+void TPUFeatureExtractor::tpuThreadFunc()
+{
+    #ifdef __linux__
+        pthread_setname_np(pthread_self(), "TPU-Invoke");
+    #endif
+    
+    while (true) {
+        int slot_index;
+        {
+            std::unique_lock<std::mutex> lock(pipeline_mutex_);
+            pipeline_cv_.wait(lock, [this]() { return !pipeline_running_ || !tpu_queue_.empty(); });
+            if (!pipeline_running_) {
+                break;
+            }
+            slot_index = tpu_queue_.front();
+            tpu_queue_.pop_front();
+        }
         
-        // Clamp to valid range
-        desc_w = std::max(0, std::min(desc_w, descriptor_width_ - 1));
-        desc_h = std::max(0, std::min(desc_h, descriptor_height_ - 1));
+        // The slot is owned by this stage until it is queued for postprocessing
+        PipelineSlot& slot = *pipeline_slots_[slot_index];
+        TRACE_SCOPE_VALUE("TPUInvoke", slot.ticket);
+        auto inference_start = std::chrono::high_resolution_clock::now();
+        if (slot.ok && slot.npu) {
+            slot.ok = invokeNPU(slot.npu.get());
+        } else if (slot.ok && slot.interpreter->Invoke() != kTfLiteOk) {
+            std::cerr << "Failed to invoke TFLite interpreter." << std::endl;
+            slot.ok = false;
+        }
+        slot.inference_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - inference_start).count();
         
-        // Extract descriptor for this keypoint
-        for (int c = 0; c < descriptor_channels_; ++c) {
-            int idx = c * descriptor_height_ * descriptor_width_ + 
-                      desc_h * descriptor_width_ + desc_w;
-            
-            if (idx < raw_descriptors.size()) {
-                descriptors.at<float>(i, c) = raw_descriptors[idx];
-            } else {
-                descriptors.at<float>(i, c) = 0.0f;
+        {
+            std::lock_guard<std::mutex> lock(pipeline_mutex_);
+            slot.state = PipelineSlot::State::INVOKED;
+            postprocess_queue_.push_back(slot_index);
+        }
+        pipeline_cv_.notify_all();
+    }
+}
+
+void TPUFeatureExtractor::postprocessThreadFunc()
+{
+    #ifdef __linux__
+        pthread_setname_np(pthread_self(), "TPU-Postprocess");
+    #endif
+    
+    while (true) {
+        int slot_index;
+        {
+            std::unique_lock<std::mutex> lock(pipeline_mutex_);
+            pipeline_cv_.wait(lock, [this]() { return !pipeline_running_ || !postprocess_queue_.empty(); });
+            if (!pipeline_running_) {
+                break;
             }
+            slot_index = postprocess_queue_.front();
+            postprocess_queue_.pop_front();
         }
         
-        // Normalize descriptor to unit length (L2 norm)
-        cv::Mat desc_row = descriptors.row(i);
-        float norm = cv::norm(desc_row);
-        if (norm > 1e-6) {
-            desc_row /= norm;
+        // The outputs stay in the slot's own interpreter until it is freed
+        PipelineSlot& slot = *pipeline_slots_[slot_index];
+        TRACE_SCOPE_VALUE("TPUPostprocess", slot.ticket);
+        auto postprocess_start = std::chrono::high_resolution_clock::now();
+        const int8_t* semi_data = nullptr;
+        const int8_t* descriptor_data = nullptr;
+        if (slot.ok && (slot.npu ? !getNPUOutputData(slot.npu.get(), semi_data, descriptor_data)
+                                 : !getOutputData(slot.interpreter.get(), 0, semi_data, descriptor_data))) {
+            slot.ok = false;
+        }
+        if (slot.ok) {
+            postprocessResults(slot.image, slot.mask, semi_data, descriptor_data,
+                               slot.keypoints, slot.descriptors, slot.lapping_area);
+        }
+        const double postprocess_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - postprocess_start).count();
+        
+        // Update performance tracking
+        total_preprocess_time += slot.preprocess_ms;
+        total_inference_time += slot.inference_ms;
+        total_postprocess_time += postprocess_ms;
+        frame_count++;
+        
+        {
+            std::lock_guard<std::mutex> lock(pipeline_mutex_);
+            slot.state = PipelineSlot::State::DONE;
         }
+        pipeline_cv_.notify_all();
     }
-    
-    // 6. Handle vLappingArea (specific to ORB-SLAM3)
-    vLappingArea.clear();
 }
 
-int TPUFeatureExtractor::operator()(
-    cv::InputArray image_in,
-    cv::InputArray mask_in,
-    std::vector<cv::KeyPoint>& keypoints,
-    cv::OutputArray descriptors_out,
-    std::vector<int>& vLappingArea)
+cv::Size TPUFeatureExtractor::GetModelInputSize() const
 {
-    if (image_in.empty()) {
-        return 0;
+    return cv::Size(input_tensor_width_, input_tensor_height_);
+}
+
+bool TPUFeatureExtractor::SupportsZeroCopyInput() const
+{
+    if (backend_ == Backend::RKNN_NPU) {
+        return npu_ && input_tensor_channels_ == 1;
+    }
+    return interpreter_ && input_tensor_batch_ == 1 && input_tensor_channels_ == 1 &&
+           interpreter_->tensor(interpreter_->inputs()[0])->type == kTfLiteUInt8;
+}
+
+bool TPUFeatureExtractor::RegisterDmaBuffer(int dma_fd, const void* data, size_t size)
+{
+    if (backend_ != Backend::RKNN_NPU || dma_fd < 0 || !data || size == 0) {
+        return false;
     }
     
-    // Performance tracking
-    auto start_time = std::chrono::high_resolution_clock::now();
-    auto preprocess_start = start_time;
+    // Any rung may read the next model input
+    for (size_t rung = 1; rung < ladder_.size(); ++rung) {
+        ladder_[rung].extractor->RegisterDmaBuffer(dma_fd, data, size);
+    }
     
-    cv::Mat image = image_in.getMat();
+    const uint8_t* begin = static_cast<const uint8_t*>(data);
+    std::lock_guard<std::mutex> lock(dma_buffers_mutex_);
+    for (const DmaBuffer& buffer : dma_buffers_) {
+        if (buffer.fd == dma_fd && buffer.data == begin && buffer.size == size) {
+            return true;
+        }
+    }
     
-    // Create image pyramid for compatibility with ORB-SLAM3
-    createImagePyramid(image);
+    // A buffer with the same fd or memory was released since it was registered
+    dma_buffers_.erase(std::remove_if(dma_buffers_.begin(), dma_buffers_.end(),
+        [dma_fd, begin, size](const DmaBuffer& buffer) {
+            return buffer.fd == dma_fd || (buffer.data < begin + size && begin < buffer.data + buffer.size);
+        }), dma_buffers_.end());
+    dma_buffers_.push_back({dma_fd, begin, size, ++dma_buffer_generation_});
+    return true;
+}
+
+int TPUFeatureExtractor::GetBatchSize() const
+{
+    return input_tensor_batch_;
+}
+
+int TPUFeatureExtractor::GetDeviceIndex() const
+{
+    if (backend_ == Backend::RKNN_NPU) {
+        return device_index_ < 0 ? 0 : device_index_;
+    }
+    if (!on_edgetpu_) {
+        return -1;
+    }
+    return device_index_ < 0 ? 0 : device_index_;
+}
+
+TPUFeatureExtractor::Backend TPUFeatureExtractor::GetBackend() const
+{
+    return backend_;
+}
+
+std::vector<std::string> TPUFeatureExtractor::ListEdgeTPUDevices()
+{
+    std::vector<std::string> paths;
+    #if !defined(__APPLE__) && !defined(_WIN32)
+        size_t num_devices = 0;
+        struct edgetpu_device* devices = edgetpu_list_devices(&num_devices);
+        for (size_t i = 0; i < num_devices; ++i) {
+            paths.push_back(devices[i].path ? devices[i].path : "");
+        }
+        if (devices) {
+            edgetpu_free_devices(devices);
+        }
+    #endif
+    return paths;
+}
+
+void TPUFeatureExtractor::SetDescriptorMode(DescriptorMode mode)
+{
+    descriptor_mode_ = mode;
+    for (size_t rung = 1; rung < ladder_.size(); ++rung) {
+        ladder_[rung].extractor->SetDescriptorMode(mode);
+    }
+}
+
+TPUFeatureExtractor::DescriptorMode TPUFeatureExtractor::GetDescriptorMode() const
+{
+    return descriptor_mode_;
+}
+
+void TPUFeatureExtractor::SetInferenceLevels(int num_levels)
+{
+    inference_levels_ = std::max(1, std::min(num_levels, n_levels_));
+    for (size_t rung = 1; rung < ladder_.size(); ++rung) {
+        ladder_[rung].extractor->SetInferenceLevels(num_levels);
+    }
+}
+
+int TPUFeatureExtractor::GetInferenceLevels() const
+{
+    return inference_levels_;
+}
+
+void TPUFeatureExtractor::SetMinTileMaskCoverage(float min_coverage)
+{
+    min_tile_mask_coverage_ = std::max(0.0f, std::min(min_coverage, 1.0f));
+    for (size_t rung = 1; rung < ladder_.size(); ++rung) {
+        ladder_[rung].extractor->SetMinTileMaskCoverage(min_coverage);
+    }
+}
+
+float TPUFeatureExtractor::GetMinTileMaskCoverage() const
+{
+    return min_tile_mask_coverage_;
+}
+
+void TPUFeatureExtractor::SetFeatureTarget(int n_features_target)
+{
+    n_features_target_ = std::max(0, n_features_target);
+    for (size_t rung = 1; rung < ladder_.size(); ++rung) {
+        ladder_[rung].extractor->SetFeatureTarget(n_features_target);
+    }
+}
+
+int TPUFeatureExtractor::GetFeatureTarget() const
+{
+    return n_features_target_;
+}
 
-    // 1. Preprocess image
-    cv::Mat preprocessed_img = preprocessImage(image, cv::Size(input_tensor_width_, input_tensor_height_));
+bool TPUFeatureExtractor::AddModelRung(const std::string& model_path, int descriptor_version)
+{
+    std::unique_ptr<TPUFeatureExtractor> extractor;
+    try {
+        extractor.reset(new TPUFeatureExtractor(model_path, delegate_path_, n_features_target_, scale_factor_,
+                                                n_levels_, device_index_, backend_));
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to add model rung " << model_path << ": " << e.what() << std::endl;
+        return false;
+    }
     
-    auto inference_start = std::chrono::high_resolution_clock::now();
-    auto preprocess_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-        inference_start - preprocess_start).count();
+    // Matchers expect the descriptor size of rung 0
+    if (extractor->descriptor_channels_ != descriptor_channels_) {
+        std::cerr << "Model rung " << model_path << " has " << extractor->descriptor_channels_
+                  << " descriptor channels, expected " << descriptor_channels_ << std::endl;
+        return false;
+    }
     
-    // 2. Run inference
-    std::vector<float> raw_kpts, raw_desc, raw_scores;
-    runInference(preprocessed_img, raw_kpts, raw_desc, raw_scores);
+    extractor->nms_radius_ = nms_radius_;
+    extractor->confidence_threshold_ = confidence_threshold_;
+    extractor->SetDescriptorMode(descriptor_mode_);
+    extractor->SetInferenceLevels(inference_levels_);
+    extractor->SetMinTileMaskCoverage(min_tile_mask_coverage_);
+    extractor->SetPipelineDepth(pipeline_depth_);
+    {
+        std::lock_guard<std::mutex> lock(dma_buffers_mutex_);
+        for (const DmaBuffer& buffer : dma_buffers_) {
+            extractor->RegisterDmaBuffer(buffer.fd, buffer.data, buffer.size);
+        }
+    }
     
-    auto postprocess_start = std::chrono::high_resolution_clock::now();
-    auto inference_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-        postprocess_start - inference_start).count();
+    // Resident and warm before the ladder can step onto it
+    extractor->StartWarmup();
+    ladder_.push_back(ModelRung{std::move(extractor), descriptor_version, 0.0, 0.0});
+    std::cout << "TPUFeatureExtractor model rung " << (ladder_.size() - 1) << ": " << model_path
+              << " (descriptor version " << descriptor_version << ")" << std::endl;
+    return true;
+}
 
-    // 3. Postprocess results
-    cv::Mat descriptors_mat;
-    postprocessResults(image, mask_in, raw_kpts, raw_desc, raw_scores, keypoints, descriptors_mat, vLappingArea);
+void TPUFeatureExtractor::SetLadderConfig(const LadderConfig& config)
+{
+    ladder_config_ = config;
+    ladder_config_.hold_frames = std::max(config.hold_frames, 1);
+    ladder_config_.smoothing = std::max(0.0, std::min(config.smoothing, 1.0));
+}
 
-    // 4. Copy descriptors to output
-    descriptors_out.create(descriptors_mat.size(), descriptors_mat.type());
-    descriptors_mat.copyTo(descriptors_out.getMat());
+void TPUFeatureExtractor::SetThermalLevel(int level)
+{
+    thermal_level_.store(std::max(level, 0), std::memory_order_relaxed);
+}
+
+int TPUFeatureExtractor::GetModelRungCount() const
+{
+    return static_cast<int>(ladder_.size());
+}
+
+int TPUFeatureExtractor::GetModelRung() const
+{
+    return last_rung_.load(std::memory_order_relaxed);
+}
+
+int TPUFeatureExtractor::GetDescriptorVersion() const
+{
+    return ladder_[last_rung_.load(std::memory_order_relaxed)].descriptor_version;
+}
+
+TPUFeatureExtractor& TPUFeatureExtractor::beginLadderCall()
+{
+    const int num_rungs = static_cast<int>(ladder_.size());
+    const int thermal_rung = std::min(thermal_level_.load(std::memory_order_relaxed), num_rungs - 1);
     
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto postprocess_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-        end_time - postprocess_start).count();
+    int rung = active_rung_;
+    if (rung < thermal_rung) {
+        rung = thermal_rung;
+    } else if (calls_on_rung_ >= ladder_config_.hold_frames) {
+        const ModelRung& active = ladder_[rung];
+        if (active.latency_ms > ladder_config_.degrade_latency_ms && rung + 1 < num_rungs) {
+            rung++;
+        } else if (rung > thermal_rung) {
+            // The dearer rung costs its unthrottled time, slowed down as much as this one is now;
+            // without its time yet, the ratio of the warm-up inferences stands in
+            const ModelRung& dearer = ladder_[rung - 1];
+            const TPUFeatureExtractor& dearer_extractor = dearer.extractor ? *dearer.extractor : *this;
+            double cost_ratio = 1.0;
+            if (dearer.baseline_ms > 0.0 && active.baseline_ms > 0.0) {
+                cost_ratio = dearer.baseline_ms / active.baseline_ms;
+            } else {
+                std::lock_guard<std::mutex> lock(dearer_extractor.warmup_mutex_);
+                std::lock_guard<std::mutex> active_lock(active.extractor->warmup_mutex_);
+                if (dearer_extractor.warmup_inference_ms_ > 0.0 && active.extractor->warmup_inference_ms_ > 0.0) {
+                    cost_ratio = dearer_extractor.warmup_inference_ms_ / active.extractor->warmup_inference_ms_;
+                }
+            }
+            if (active.latency_ms * cost_ratio < ladder_config_.recover_latency_ms) {
+                rung--;
+            }
+        }
+    }
     
-    // Update performance tracking
-    total_preprocess_time += preprocess_duration;
-    total_inference_time += inference_duration;
-    total_postprocess_time += postprocess_duration;
-    frame_count++;
+    // A rung still warming up would run at cold-start latency
+    if (rung != active_rung_ && rung > 0 && !ladder_[rung].extractor->IsWarmedUp()) {
+        rung = active_rung_;
+    }
     
-    // Log performance for this frame
-    if (frame_count % 10 == 0) {
-        std::cout << "Frame " << frame_count << " timing: "
-                  << "preprocess=" << preprocess_duration << "ms, "
-                  << "inference=" << inference_duration << "ms, "
-                  << "postprocess=" << postprocess_duration << "ms, "
-                  << "total=" << (preprocess_duration + inference_duration + postprocess_duration) << "ms, "
-                  << "keypoints=" << keypoints.size() << std::endl;
+    if (rung != active_rung_) {
+        std::cout << "TPUFeatureExtractor switching from model rung " << active_rung_ << " to " << rung
+                  << " (" << ladder_[active_rung_].latency_ms << " ms per call, thermal level "
+                  << thermal_level_.load(std::memory_order_relaxed) << ")" << std::endl;
+        active_rung_ = rung;
+        calls_on_rung_ = 0;
+        ladder_[rung].latency_ms = 0.0;
+    }
+    last_rung_.store(rung, std::memory_order_relaxed);
+    
+    if (rung == 0) {
+        return *this;
     }
+    
+    // The pyramid set for this call belongs to the rung that runs it
+    TPUFeatureExtractor& extractor = *ladder_[rung].extractor;
+    extractor.SetPyramid(std::move(next_pyramid_));
+    next_pyramid_.reset();
+    return extractor;
+}
 
-    return static_cast<int>(keypoints.size());
+void TPUFeatureExtractor::endLadderCall(TPUFeatureExtractor& extractor, double elapsed_ms)
+{
+    if (&extractor != this) {
+        mvImagePyramid = extractor.mvImagePyramid;
+        pyramid_ = extractor.pyramid_;
+    }
+    
+    ModelRung& rung = ladder_[active_rung_];
+    rung.latency_ms = rung.latency_ms > 0.0
+        ? rung.latency_ms + ladder_config_.smoothing * (elapsed_ms - rung.latency_ms)
+        : elapsed_ms;
+    calls_on_rung_++;
+    if (calls_on_rung_ >= ladder_config_.hold_frames &&
+        (rung.baseline_ms <= 0.0 || rung.latency_ms < rung.baseline_ms)) {
+        rung.baseline_ms = rung.latency_ms;
+    }
 }
 
 // --- Implementation of ORBextractor-like public methods ---
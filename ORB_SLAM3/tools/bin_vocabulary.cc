@@ -0,0 +1,72 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <chrono>
+
+#include "ORBVocabulary.h"
+#include "System.h"
+
+using namespace std;
+
+// Converts the text vocabulary into the binary format that System loads for a .bin path.
+// The checksum of the text file is stored in the header, so atlases saved with either
+// vocabulary can be loaded with the other one.
+int main(int argc, char **argv)
+{
+    if(argc != 3)
+    {
+        cerr << endl << "Usage: ./bin_vocabulary path_to_vocabulary.txt path_to_vocabulary.bin" << endl;
+        return 1;
+    }
+
+    const string strTextFile = argv[1];
+    const string strBinFile = argv[2];
+
+    ORB_SLAM3::ORBVocabulary voc;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    if(!voc.loadFromTextFile(strTextFile))
+    {
+        cerr << "Failed to load the text vocabulary " << strTextFile << endl;
+        return 1;
+    }
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+    const string strChecksum = ORB_SLAM3::System::CalculateCheckSum(strTextFile, ORB_SLAM3::System::TEXT_FILE);
+    if(!voc.saveToBinaryFile(strBinFile, strChecksum))
+    {
+        cerr << "Failed to save the binary vocabulary " << strBinFile << endl;
+        return 1;
+    }
+
+    ORB_SLAM3::ORBVocabulary vocBin;
+    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+    string strBinChecksum;
+    if(!vocBin.loadFromBinaryFile(strBinFile, &strBinChecksum) || vocBin.size() != voc.size() || strBinChecksum != strChecksum)
+    {
+        cerr << "Failed to read back the binary vocabulary " << strBinFile << endl;
+        return 1;
+    }
+    std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+    cout << "Vocabulary with " << voc.size() << " words saved to " << strBinFile << endl;
+    cout << "Text load: " << std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count() << " ms, binary load: "
+         << std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t3 - t2).count() << " ms" << endl;
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Optimizer.h"
+#include "RemoteBackend.h"
+
+using namespace std;
+
+// Solves the Global Bundle Adjustments of the headsets (LoopClosing.remoteBackendHost). Each
+// connection is served by its own thread, so the headsets of an arena are solved in parallel.
+// A headset that gives up on a solution closes the connection, the solve runs to the end.
+static void Serve(int fd)
+{
+    ORB_SLAM3::RemoteBackendHeader header;
+    vector<uint8_t> payload;
+    ORB_SLAM3::BundleAdjustmentProblem problem;
+    ORB_SLAM3::BundleAdjustmentSolution solution;
+
+    while(ORB_SLAM3::RemoteBackend::ReceiveMessage(fd, header, payload, NULL, -1.0))
+    {
+        if(header.kind != ORB_SLAM3::RemoteBackend::KIND_REQUEST || !problem.Decode(payload.data(), payload.size()))
+        {
+            cerr << "Invalid request, closing the connection" << endl;
+            break;
+        }
+
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        ORB_SLAM3::Optimizer::BundleAdjustment(problem, solution);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        cout << "Solved " << problem.vKeyFrames.size() << " keyframes, " << problem.vPoints.size()/3 << " points, "
+             << problem.vObservations.size() << " observations in "
+             << std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count() << " ms" << endl;
+
+        solution.Encode(payload);
+        if(!ORB_SLAM3::RemoteBackend::SendMessage(fd, ORB_SLAM3::RemoteBackend::KIND_SOLUTION, header.requestId, payload, NULL, -1.0))
+            break;
+    }
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc > 2)
+    {
+        cerr << endl << "Usage: ./remote_backend_server [port]" << endl;
+        return 1;
+    }
+
+    const int nPort = argc == 2 ? atoi(argv[1]) : 9956;
+
+    const int fdListen = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(fdListen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(nPort);
+    if(fdListen < 0 || bind(fdListen, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+       listen(fdListen, 16) != 0)
+    {
+        cerr << "Failed to listen on port " << nPort << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    cout << "Listening on port " << nPort << endl;
+
+    while(true)
+    {
+        const int fd = accept(fdListen, NULL, NULL);
+        if(fd < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            cerr << "accept failed: " << strerror(errno) << endl;
+            return 1;
+        }
+        thread(Serve, fd).detach();
+    }
+}
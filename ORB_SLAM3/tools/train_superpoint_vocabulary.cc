@@ -0,0 +1,109 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "ORBVocabulary.h"
+#include "Converter.h"
+#include "System.h"
+#include "tpu_feature_extractor.hpp"
+
+using namespace std;
+
+// Trains a vocabulary on the binarized SuperPoint descriptors that Tracking extracts
+// (BINARY_BILINEAR) and saves it in the text and the binary formats. The files are tagged
+// with the descriptor name, Tracking warns when it runs with a vocabulary of other descriptors.
+int main(int argc, char **argv)
+{
+    if(argc != 4 && argc != 6)
+    {
+        cerr << endl << "Usage: ./train_superpoint_vocabulary path_to_model path_to_image_list output_prefix [k L]" << endl;
+        return 1;
+    }
+
+    const string strModelFile = argv[1];
+    const string strImageList = argv[2];
+    const string strOutputPrefix = argv[3];
+    const int k = argc == 6 ? atoi(argv[4]) : 10;
+    const int L = argc == 6 ? atoi(argv[5]) : 6;
+
+    ifstream fImages(strImageList.c_str());
+    if(!fImages.is_open())
+    {
+        cerr << "Failed to open the image list " << strImageList << endl;
+        return 1;
+    }
+
+    ORB_SLAM3::TPUFeatureExtractor extractor(strModelFile, "", 1000, 1.2f, 1);
+    extractor.SetDescriptorMode(ORB_SLAM3::TPUFeatureExtractor::DescriptorMode::BINARY_BILINEAR);
+
+    vector<vector<cv::Mat> > vvFeatures;
+    string strImage;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    while(getline(fImages, strImage))
+    {
+        if(strImage.empty())
+            continue;
+
+        cv::Mat im = cv::imread(strImage, cv::IMREAD_GRAYSCALE);
+        if(im.empty())
+        {
+            cerr << "Failed to load the image " << strImage << endl;
+            continue;
+        }
+
+        vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors;
+        vector<int> vLapping = {0, 0};
+        if(extractor(im, cv::Mat(), vKeys, descriptors, vLapping) > 0)
+            vvFeatures.push_back(ORB_SLAM3::Converter::toDescriptorVector(descriptors));
+    }
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+    if(vvFeatures.empty())
+    {
+        cerr << "No descriptors extracted from " << strImageList << endl;
+        return 1;
+    }
+
+    ORB_SLAM3::SuperPointVocabulary voc(k, L, DBoW2::TF_IDF, DBoW2::L1_NORM);
+    voc.create(vvFeatures);
+    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+    const string strTextFile = strOutputPrefix + ".txt";
+    const string strBinFile = strOutputPrefix + ".bin";
+    voc.saveToTextFile(strTextFile);
+    const string strChecksum = ORB_SLAM3::System::CalculateCheckSum(strTextFile, ORB_SLAM3::System::TEXT_FILE);
+    if(!voc.saveToBinaryFile(strBinFile, strChecksum))
+    {
+        cerr << "Failed to save the binary vocabulary " << strBinFile << endl;
+        return 1;
+    }
+
+    cout << "Vocabulary with " << voc.size() << " words from " << vvFeatures.size() << " images saved to "
+         << strTextFile << " and " << strBinFile << endl;
+    cout << "Extraction: " << std::chrono::duration_cast<std::chrono::duration<double> >(t1 - t0).count() << " s, training: "
+         << std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count() << " s" << endl;
+
+    return 0;
+}
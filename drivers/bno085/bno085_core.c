@@ -21,6 +21,7 @@
 #include <linux/iio/trigger_consumer.h>
 #include <linux/regmap.h>
 #include <linux/debugfs.h>
+#include <asm/unaligned.h>
 
 #include "bno085_core.h"
 
@@ -267,6 +268,33 @@ const struct iio_buffer_setup_ops bno085_buffer_setup_ops = {
     .predisable = bno085_buffer_predisable,
 };
 
+/*
+ * Pack the enabled channels in scan index order, as the IIO core lays out
+ * the scan for the active mask, and push them; the core appends the timestamp
+ */
+static void bno085_push_scan(struct bno085_device *dev, s64 timestamp)
+{
+    struct iio_dev *indio_dev = dev->indio_dev;
+    const s16 *channel_data[] = {
+        &dev->accel_data[0], &dev->accel_data[1], &dev->accel_data[2],
+        &dev->gyro_data[0], &dev->gyro_data[1], &dev->gyro_data[2],
+        &dev->mag_data[0], &dev->mag_data[1], &dev->mag_data[2],
+        &dev->quaternion_data[0], &dev->quaternion_data[1],
+        &dev->quaternion_data[2], &dev->quaternion_data[3],
+        &dev->temperature_data,
+    };
+    u8 buffer[ALIGN(14 * sizeof(s16) + sizeof(s64), sizeof(s64))] __aligned(8);
+    s16 *samples = (s16 *)buffer;
+    int bit, i = 0;
+    
+    memset(buffer, 0, sizeof(buffer));
+    
+    for_each_set_bit(bit, indio_dev->active_scan_mask, ARRAY_SIZE(channel_data))
+        samples[i++] = *channel_data[bit];
+    
+    iio_push_to_buffers_with_timestamp(indio_dev, buffer, timestamp);
+}
+
 /* IIO trigger handler */
 irqreturn_t bno085_trigger_handler(int irq, void *p)
 {
@@ -274,7 +302,6 @@ irqreturn_t bno085_trigger_handler(int irq, void *p)
     struct iio_dev *indio_dev = pf->indio_dev;
     struct bno085_device *dev = iio_priv(indio_dev);
     int ret;
-    u8 buffer[ALIGN(14 * sizeof(s16) + sizeof(s64), sizeof(s64))];
     
     /* Read sensor data */
     ret = bno085_read_data(dev);
@@ -283,59 +310,163 @@ irqreturn_t bno085_trigger_handler(int irq, void *p)
         goto done;
     }
     
-    /* Fill buffer with data based on enabled channels */
-    memset(buffer, 0, sizeof(buffer));
-    
-    if (test_bit(0, indio_dev->active_scan_mask))
-        memcpy(&buffer[0], &dev->accel_data[0], sizeof(s16));
-    if (test_bit(1, indio_dev->active_scan_mask))
-        memcpy(&buffer[2], &dev->accel_data[1], sizeof(s16));
-    if (test_bit(2, indio_dev->active_scan_mask))
-        memcpy(&buffer[4], &dev->accel_data[2], sizeof(s16));
-    
-    if (test_bit(3, indio_dev->active_scan_mask))
-        memcpy(&buffer[6], &dev->gyro_data[0], sizeof(s16));
-    if (test_bit(4, indio_dev->active_scan_mask))
-        memcpy(&buffer[8], &dev->gyro_data[1], sizeof(s16));
-    if (test_bit(5, indio_dev->active_scan_mask))
-        memcpy(&buffer[10], &dev->gyro_data[2], sizeof(s16));
-    
-    if (test_bit(6, indio_dev->active_scan_mask))
-        memcpy(&buffer[12], &dev->mag_data[0], sizeof(s16));
-    if (test_bit(7, indio_dev->active_scan_mask))
-        memcpy(&buffer[14], &dev->mag_data[1], sizeof(s16));
-    if (test_bit(8, indio_dev->active_scan_mask))
-        memcpy(&buffer[16], &dev->mag_data[2], sizeof(s16));
-    
-    if (test_bit(9, indio_dev->active_scan_mask))
-        memcpy(&buffer[18], &dev->quaternion_data[0], sizeof(s16));
-    if (test_bit(10, indio_dev->active_scan_mask))
-        memcpy(&buffer[20], &dev->quaternion_data[1], sizeof(s16));
-    if (test_bit(11, indio_dev->active_scan_mask))
-        memcpy(&buffer[22], &dev->quaternion_data[2], sizeof(s16));
-    if (test_bit(12, indio_dev->active_scan_mask))
-        memcpy(&buffer[24], &dev->quaternion_data[3], sizeof(s16));
-    
-    if (test_bit(13, indio_dev->active_scan_mask))
-        memcpy(&buffer[26], &dev->temperature_data, sizeof(s16));
-    
-    /* Fill timestamp */
-    dev->timestamp = iio_get_time_ns(indio_dev);
+    /* Fill timestamp: the data-ready edge, not the end of the bus transfers */
+    dev->timestamp = dev->irq_timestamp ? dev->irq_timestamp : iio_get_time_ns(indio_dev);
     
     /* Push data to IIO buffer */
-    iio_push_to_buffers_with_timestamp(indio_dev, buffer, dev->timestamp);
+    bno085_push_scan(dev, dev->timestamp);
     
 done:
     iio_trigger_notify_done(indio_dev->trig);
     return IRQ_HANDLED;
 }
 
+/*
+ * Sensor whose reports produce a scan when draining a batch, the others are
+ * held at their latest value: the gyroscope, which runs fastest, when enabled
+ */
+static u8 bno085_batch_primary_report(struct bno085_device *dev)
+{
+    if (dev->enabled_features & BNO085_FEATURE_GYROSCOPE)
+        return BNO085_REPORT_GYRO;
+    if (dev->enabled_features & BNO085_FEATURE_ACCELEROMETER)
+        return BNO085_REPORT_ACCEL;
+    return BNO085_REPORT_ROTATION;
+}
+
+/**
+ * bno085_drain_fifo - Push every report batched since the last interrupt
+ * @dev: BNO085 device
+ * @irq_timestamp: Time of the interrupt that announced the batch
+ *
+ * The batch opens with a base timestamp report giving the base time in 100 us
+ * ticks before the interrupt, rebase reports move the base and each sensor
+ * report carries its 14-bit delay after the base. Every sample is pushed with
+ * its own reconstructed time, kept increasing and never after the interrupt.
+ *
+ * Return: number of scans pushed, negative error code on failure
+ */
+int bno085_drain_fifo(struct bno085_device *dev, s64 irq_timestamp)
+{
+    u8 count_bytes[2];
+    u8 primary = bno085_batch_primary_report(dev);
+    s64 base = irq_timestamp;
+    s64 timestamp;
+    int count, off, len, ret, pushed = 0;
+    u32 delay;
+    u8 *report;
+    
+    ret = dev->transport.read(dev->dev, BNO085_REG_FIFO_COUNT, count_bytes, 2);
+    if (ret < 0) {
+        dev_err(dev->dev, "Failed to read FIFO count: %d\n", ret);
+        return ret;
+    }
+    
+    count = min_t(int, get_unaligned_le16(count_bytes), BNO085_FIFO_SIZE);
+    
+    /* Drain the whole batch at once, one transport transfer at a time */
+    for (off = 0; off < count; off += len) {
+        len = min_t(int, count - off, BNO085_MAX_TRANSFER_SIZE);
+        ret = dev->transport.read_fifo(dev->dev, dev->fifo_buf + off, len);
+        if (ret < 0) {
+            dev_err(dev->dev, "Failed to read FIFO: %d\n", ret);
+            return ret;
+        }
+    }
+    
+    mutex_lock(&dev->lock);
+    
+    for (off = 0; off < count; off += len) {
+        report = &dev->fifo_buf[off];
+        
+        switch (report[0]) {
+        case BNO085_REPORT_BASE_TIMESTAMP:
+            len = BNO085_REPORT_TIMEBASE_LEN;
+            if (off + len > count)
+                goto truncated;
+            base = irq_timestamp - (s64)get_unaligned_le32(&report[1]) * BNO085_TIMEBASE_NS;
+            continue;
+        case BNO085_REPORT_TIMESTAMP_REBASE:
+            len = BNO085_REPORT_TIMEBASE_LEN;
+            if (off + len > count)
+                goto truncated;
+            base += (s64)(s32)get_unaligned_le32(&report[1]) * BNO085_TIMEBASE_NS;
+            continue;
+        case BNO085_REPORT_ACCEL:
+        case BNO085_REPORT_GYRO:
+        case BNO085_REPORT_MAG:
+            len = BNO085_REPORT_VECTOR_LEN;
+            break;
+        case BNO085_REPORT_ROTATION:
+            len = BNO085_REPORT_ROTATION_LEN;
+            break;
+        default:
+            /* Unknown length, the rest of the batch cannot be parsed */
+            dev_warn_ratelimited(dev->dev, "Unknown report 0x%02x in batch\n", report[0]);
+            goto out;
+        }
+        
+        if (off + len > count)
+            goto truncated;
+        
+        switch (report[0]) {
+        case BNO085_REPORT_ACCEL:
+            memcpy(dev->accel_data, &report[4], 6);
+            break;
+        case BNO085_REPORT_GYRO:
+            memcpy(dev->gyro_data, &report[4], 6);
+            break;
+        case BNO085_REPORT_MAG:
+            memcpy(dev->mag_data, &report[4], 6);
+            break;
+        case BNO085_REPORT_ROTATION:
+            /* Reported i, j, k, real; the channels are w, x, y, z */
+            dev->quaternion_data[0] = get_unaligned_le16(&report[10]);
+            dev->quaternion_data[1] = get_unaligned_le16(&report[4]);
+            dev->quaternion_data[2] = get_unaligned_le16(&report[6]);
+            dev->quaternion_data[3] = get_unaligned_le16(&report[8]);
+            break;
+        }
+        
+        if (report[0] != primary)
+            continue;
+        
+        /* Upper 6 delay bits sit above the accuracy in the status byte */
+        delay = ((u32)(report[2] & 0xFC) << 6) | report[3];
+        timestamp = base + (s64)delay * BNO085_TIMEBASE_NS;
+        
+        if (timestamp > irq_timestamp)
+            timestamp = irq_timestamp;
+        if (timestamp <= dev->batch_last_timestamp)
+            timestamp = dev->batch_last_timestamp + 1;
+        
+        dev->batch_last_timestamp = timestamp;
+        dev->batch_samples++;
+        pushed++;
+        
+        if (dev->buffer_enabled)
+            bno085_push_scan(dev, timestamp);
+    }
+    goto out;
+    
+truncated:
+    dev_warn_ratelimited(dev->dev, "Truncated report 0x%02x in batch\n", dev->fifo_buf[off]);
+out:
+    dev->last_sample_time = ktime_get();
+    mutex_unlock(&dev->lock);
+    
+    return pushed;
+}
+
 /* Hardware interrupt handler */
 static irqreturn_t bno085_irq_handler(int irq, void *private)
 {
     struct iio_dev *indio_dev = private;
     struct bno085_device *dev = iio_priv(indio_dev);
     
+    /* Stamp the edge before any bus access delays it */
+    dev->irq_timestamp = iio_get_time_ns(indio_dev);
+    
     /* Schedule bottom half processing */
     schedule_work(&dev->irq_work);
     
@@ -346,6 +477,7 @@ static irqreturn_t bno085_irq_handler(int irq, void *private)
 static void bno085_irq_work_handler(struct work_struct *work)
 {
     struct bno085_device *dev = container_of(work, struct bno085_device, irq_work);
+    s64 irq_timestamp = READ_ONCE(dev->irq_timestamp);
     u8 status;
     int ret;
     
@@ -376,8 +508,14 @@ static void bno085_irq_work_handler(struct work_struct *work)
     }
     
     if (status & BNO085_INT_FIFO) {
-        /* Handle FIFO overflow */
-        dev_warn(dev->dev, "FIFO overflow detected\n");
+        if (dev->batch_interval_us) {
+            /* Batch ready: drain every report since the last one */
+            if (dev->buffer_enabled)
+                bno085_drain_fifo(dev, irq_timestamp);
+        } else {
+            /* Handle FIFO overflow */
+            dev_warn(dev->dev, "FIFO overflow detected\n");
+        }
     }
     
     /* Clear interrupt status */
@@ -618,17 +756,50 @@ static ssize_t bno085_store_reset(struct device *dev,
     return len;
 }
 
+static ssize_t bno085_show_batch_interval(struct device *dev,
+                                        struct device_attribute *attr,
+                                        char *buf)
+{
+    struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+    struct bno085_device *bno085_dev = iio_priv(indio_dev);
+    
+    return sprintf(buf, "%u\n", bno085_dev->batch_interval_us);
+}
+
+static ssize_t bno085_store_batch_interval(struct device *dev,
+                                         struct device_attribute *attr,
+                                         const char *buf, size_t len)
+{
+    struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+    struct bno085_device *bno085_dev = iio_priv(indio_dev);
+    unsigned long interval;
+    int ret;
+    
+    ret = kstrtoul(buf, 10, &interval);
+    if (ret)
+        return ret;
+    
+    ret = bno085_set_batch_interval(bno085_dev, interval);
+    if (ret)
+        return ret;
+    
+    return len;
+}
+
 static IIO_DEVICE_ATTR(mode, S_IRUGO | S_IWUSR,
                      bno085_show_mode, bno085_store_mode, 0);
 static IIO_DEVICE_ATTR(calibration_status, S_IRUGO,
                      bno085_show_calibration_status, NULL, 0);
 static IIO_DEVICE_ATTR(reset, S_IWUSR,
                      NULL, bno085_store_reset, 0);
+static IIO_DEVICE_ATTR(batch_interval_us, S_IRUGO | S_IWUSR,
+                     bno085_show_batch_interval, bno085_store_batch_interval, 0);
 
 static struct attribute *bno085_attributes[] = {
     &iio_dev_attr_mode.dev_attr.attr,
     &iio_dev_attr_calibration_status.dev_attr.attr,
     &iio_dev_attr_reset.dev_attr.attr,
+    &iio_dev_attr_batch_interval_us.dev_attr.attr,
     NULL
 };
 
@@ -656,6 +827,10 @@ int bno085_buffer_postenable(struct iio_dev *indio_dev)
     u8 int_enable = BNO085_INT_ACCEL | BNO085_INT_GYRO | BNO085_INT_MAG | 
                    BNO085_INT_QUAT | BNO085_INT_ERROR | BNO085_INT_CALIB;
     
+    /* Batching interrupts once per batch instead of once per sample */
+    if (dev->batch_interval_us)
+        int_enable = BNO085_INT_FIFO | BNO085_INT_ERROR | BNO085_INT_CALIB;
+    
     ret = dev->transport.write(dev->dev, BNO085_REG_INT_ENABLE, &int_enable, 1);
     if (ret < 0) {
         dev_err(dev->dev, "Failed to enable interrupts: %d\n", ret);
@@ -964,6 +1139,38 @@ int bno085_set_sampling_frequency(struct bno085_device *dev, u32 frequency)
     return 0;
 }
 
+int bno085_set_batch_interval(struct bno085_device *dev, u32 interval_us)
+{
+    u8 interval_bytes[4];
+    int ret;
+    
+    if (interval_us > BNO085_MAX_BATCH_INTERVAL_US)
+        return -EINVAL;
+    
+    if (dev->batch_interval_us == interval_us)
+        return 0;
+    
+    put_unaligned_le32(interval_us, interval_bytes);
+    
+    ret = dev->transport.write(dev->dev, BNO085_REG_BATCH_INTERVAL, interval_bytes, 4);
+    if (ret < 0) {
+        dev_err(dev->dev, "Failed to set batch interval: %d\n", ret);
+        return ret;
+    }
+    
+    dev->batch_interval_us = interval_us;
+    dev->batch_last_timestamp = 0;
+    
+    /* Switch a running buffer between per-sample and per-batch interrupts */
+    if (dev->buffer_enabled) {
+        ret = bno085_buffer_postenable(dev->indio_dev);
+        if (ret < 0)
+            return ret;
+    }
+    
+    return 0;
+}
+
 int bno085_read_data(struct bno085_device *dev)
 {
     int ret;
@@ -39,12 +39,29 @@
 #define BNO085_REG_QUAT_Y           0x22
 #define BNO085_REG_QUAT_Z           0x24
 #define BNO085_REG_TIMESTAMP        0x26
+#define BNO085_REG_BATCH_INTERVAL   0x28    /* 4 bytes LE, microseconds, 0 reports every sample */
+#define BNO085_REG_FIFO_COUNT       0x2C    /* 2 bytes LE, bytes of batched reports queued */
 
 /* BNO085 Constants */
 #define BNO085_CHIP_ID              0x83
 #define BNO085_RESET_COMMAND        0x01
 #define BNO085_MAX_TRANSFER_SIZE    32
 #define BNO085_FIFO_SIZE            1024
+#define BNO085_MAX_BATCH_INTERVAL_US 100000
+#define BNO085_TIMEBASE_NS          100000  /* SH-2 report timestamps count 100 us ticks */
+
+/* SH-2 report IDs in the batch FIFO */
+#define BNO085_REPORT_ACCEL             0x01
+#define BNO085_REPORT_GYRO              0x02
+#define BNO085_REPORT_MAG               0x03
+#define BNO085_REPORT_ROTATION          0x05
+#define BNO085_REPORT_TIMESTAMP_REBASE  0xFA
+#define BNO085_REPORT_BASE_TIMESTAMP    0xFB
+
+/* Report lengths: ID, sequence, status, delay, then the payload */
+#define BNO085_REPORT_TIMEBASE_LEN      5
+#define BNO085_REPORT_VECTOR_LEN        10
+#define BNO085_REPORT_ROTATION_LEN      14
 
 /* BNO085 Status Register Bits */
 #define BNO085_STATUS_IDLE          0x00
@@ -62,7 +79,7 @@
 #define BNO085_INT_TEMP             0x10
 #define BNO085_INT_ERROR            0x20
 #define BNO085_INT_CALIB            0x40
-#define BNO085_INT_FIFO             0x80
+#define BNO085_INT_FIFO             0x80    /* Batch interval elapsed, or FIFO overflow without batching */
 
 /* BNO085 Operation Modes */
 enum bno085_operation_mode {
@@ -135,6 +152,12 @@ struct bno085_device {
     struct iio_trigger *trig;
     bool buffer_enabled;
     
+    /* Batching: reports drained from the FIFO once per batch interval */
+    u32 batch_interval_us;
+    u8 fifo_buf[BNO085_FIFO_SIZE];
+    s64 batch_last_timestamp;   /* Last sample pushed, keeps the timestamps increasing */
+    u64 batch_samples;
+    
     /* Data buffers */
     s16 accel_data[3];
     s16 gyro_data[3];
@@ -144,6 +167,7 @@ struct bno085_device {
     
     /* Timestamps */
     s64 timestamp;
+    s64 irq_timestamp;      /* Data-ready edge, taken in the hard IRQ handler */
     ktime_t last_sample_time;
     
     /* Debug */
@@ -162,6 +186,8 @@ int bno085_reset(struct bno085_device *dev);
 int bno085_suspend(struct device *dev);
 int bno085_resume(struct device *dev);
 int bno085_update_calibration(struct bno085_device *dev);
+int bno085_set_batch_interval(struct bno085_device *dev, u32 interval_us);
+int bno085_drain_fifo(struct bno085_device *dev, s64 irq_timestamp);
 
 /* Transport layer registration */
 int bno085_i2c_probe(struct i2c_client *client, const struct i2c_device_id *id);
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <vector>
 #include <linux/iio/iio.h>
 #include <linux/iio/buffer.h>
 #include <linux/iio/trigger.h>
@@ -66,6 +67,8 @@ protected:
             memcpy(data, mock_quat_data, 8);
         } else if (reg == BNO085_REG_TEMP && len == 2) {
             memcpy(data, &mock_temp_data, 2);
+        } else if (reg == BNO085_REG_FIFO_COUNT && len == 2) {
+            memcpy(data, &mock_registers[reg], 2);
         } else if (len == 1) {
             *data = mock_registers[reg];
         } else {
@@ -88,14 +91,32 @@ protected:
     
     /* Mock FIFO read function */
     static int mock_read_fifo(struct device *dev, u8 *data, int len) {
-        /* Simulate FIFO data */
+        /* Serve queued batch reports, then simulated FIFO data */
         for (int i = 0; i < len; i++) {
-            data[i] = i & 0xFF;
+            data[i] = mock_fifo_pos < mock_fifo.size() ? mock_fifo[mock_fifo_pos++] : (i & 0xFF);
         }
         
         return 0;
     }
     
+    /* Queue one sensor report with its 14-bit delay in 100 us ticks */
+    static void mock_queue_report(u8 id, u16 delay, const s16 *values, int count) {
+        mock_fifo.push_back(id);
+        mock_fifo.push_back(0);
+        mock_fifo.push_back(((delay >> 8) << 2) | 0x03);
+        mock_fifo.push_back(delay & 0xFF);
+        for (int i = 0; i < count; i++) {
+            mock_fifo.push_back(values[i] & 0xFF);
+            mock_fifo.push_back((values[i] >> 8) & 0xFF);
+        }
+    }
+    
+    static void mock_queue_timebase(u8 id, s32 ticks) {
+        mock_fifo.push_back(id);
+        for (int i = 0; i < 4; i++)
+            mock_fifo.push_back(((u32)ticks >> (8 * i)) & 0xFF);
+    }
+    
     struct device *dev;
     struct bno085_transport transport;
     
@@ -105,6 +126,8 @@ protected:
     static s16 mock_mag_data[3];
     static s16 mock_quat_data[4];
     static s16 mock_temp_data;
+    static std::vector<u8> mock_fifo;
+    static size_t mock_fifo_pos;
 };
 
 /* Initialize static members */
@@ -114,6 +137,8 @@ s16 BNO085Test::mock_gyro_data[3] = {0};
 s16 BNO085Test::mock_mag_data[3] = {0};
 s16 BNO085Test::mock_quat_data[4] = {0};
 s16 BNO085Test::mock_temp_data = 0;
+std::vector<u8> BNO085Test::mock_fifo;
+size_t BNO085Test::mock_fifo_pos = 0;
 
 /* Test device initialization */
 TEST_F(BNO085Test, InitializationTest) {
@@ -297,6 +322,101 @@ TEST_F(BNO085Test, CalibrationTest) {
     EXPECT_TRUE(dev.calibrated);
 }
 
+/* Test batch interval configuration */
+TEST_F(BNO085Test, BatchIntervalTest) {
+    struct bno085_device dev;
+    int ret;
+    
+    /* Initialize device */
+    memset(&dev, 0, sizeof(dev));
+    dev.dev = this->dev;
+    dev.transport = this->transport;
+    
+    /* Test valid interval */
+    ret = bno085_set_batch_interval(&dev, 10000);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(dev.batch_interval_us, 10000u);
+    EXPECT_EQ(mock_registers[BNO085_REG_BATCH_INTERVAL], 10000 & 0xFF);
+    EXPECT_EQ(mock_registers[BNO085_REG_BATCH_INTERVAL + 1], 10000 >> 8);
+    
+    /* Test invalid interval */
+    ret = bno085_set_batch_interval(&dev, BNO085_MAX_BATCH_INTERVAL_US + 1);
+    EXPECT_NE(ret, 0);
+    
+    /* Test disable */
+    ret = bno085_set_batch_interval(&dev, 0);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(dev.batch_interval_us, 0u);
+}
+
+/* Test draining a batch with reconstructed timestamps */
+TEST_F(BNO085Test, BatchDrainTest) {
+    struct bno085_device dev;
+    const s64 irq_timestamp = 1000000000LL;
+    const s16 gyro[3][3] = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+    const s16 accel[3] = {100, 200, 300};
+    const s16 rotation[5] = {11, 12, 13, 14, 0};
+    int ret;
+    
+    /* Initialize device */
+    memset(&dev, 0, sizeof(dev));
+    dev.dev = this->dev;
+    dev.transport = this->transport;
+    dev.enabled_features = BNO085_FEATURE_ACCELEROMETER | 
+                          BNO085_FEATURE_GYROSCOPE | 
+                          BNO085_FEATURE_ROTATION_VECTOR;
+    dev.batch_interval_us = 10000;
+    
+    /* Base 10 ms before the interrupt, gyro at 0, 1 and 2 ms, then a rebase */
+    mock_fifo.clear();
+    mock_fifo_pos = 0;
+    mock_queue_timebase(BNO085_REPORT_BASE_TIMESTAMP, 100);
+    mock_queue_report(BNO085_REPORT_GYRO, 0, gyro[0], 3);
+    mock_queue_report(BNO085_REPORT_ACCEL, 5, accel, 3);
+    mock_queue_report(BNO085_REPORT_GYRO, 10, gyro[1], 3);
+    mock_queue_report(BNO085_REPORT_ROTATION, 12, rotation, 5);
+    mock_queue_timebase(BNO085_REPORT_TIMESTAMP_REBASE, 50);
+    mock_queue_report(BNO085_REPORT_GYRO, 300, gyro[2], 3);
+    mock_registers[BNO085_REG_FIFO_COUNT] = mock_fifo.size() & 0xFF;
+    mock_registers[BNO085_REG_FIFO_COUNT + 1] = mock_fifo.size() >> 8;
+    
+    /* One scan per gyro report */
+    ret = bno085_drain_fifo(&dev, irq_timestamp);
+    EXPECT_EQ(ret, 3);
+    EXPECT_EQ(dev.batch_samples, 3u);
+    
+    /* 5 ms rebase plus a 14-bit delay of 30 ms lands past the interrupt: clamped */
+    EXPECT_EQ(dev.batch_last_timestamp, irq_timestamp);
+    
+    /* Latest values of every sensor, quaternion reordered to w, x, y, z */
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(dev.gyro_data[i], gyro[2][i]);
+        EXPECT_EQ(dev.accel_data[i], accel[i]);
+    }
+    EXPECT_EQ(dev.quaternion_data[0], 14);
+    EXPECT_EQ(dev.quaternion_data[1], 11);
+    EXPECT_EQ(dev.quaternion_data[2], 12);
+    EXPECT_EQ(dev.quaternion_data[3], 13);
+    
+    /* A second batch never goes back in time */
+    mock_fifo.clear();
+    mock_fifo_pos = 0;
+    mock_queue_timebase(BNO085_REPORT_BASE_TIMESTAMP, 100);
+    mock_queue_report(BNO085_REPORT_GYRO, 1, gyro[0], 3);
+    mock_registers[BNO085_REG_FIFO_COUNT] = mock_fifo.size();
+    mock_registers[BNO085_REG_FIFO_COUNT + 1] = 0;
+    
+    ret = bno085_drain_fifo(&dev, irq_timestamp);
+    EXPECT_EQ(ret, 1);
+    EXPECT_EQ(dev.batch_last_timestamp, irq_timestamp + 1);
+    
+    /* A later batch keeps the reconstructed time */
+    mock_fifo_pos = 0;
+    ret = bno085_drain_fifo(&dev, irq_timestamp + 20000000LL);
+    EXPECT_EQ(ret, 1);
+    EXPECT_EQ(dev.batch_last_timestamp, irq_timestamp + 20000000LL - 10000000LL + 100000LL);
+}
+
 /* Test error handling */
 TEST_F(BNO085Test, ErrorHandlingTest) {
     struct bno085_device dev;
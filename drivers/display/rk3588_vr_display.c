@@ -43,10 +43,17 @@ static int max_latency_us = RK3588_VR_MAX_LATENCY_US;
 module_param(max_latency_us, int, 0644);
 MODULE_PARM_DESC(max_latency_us, "Maximum motion-to-photon latency in microseconds (default: 5000)");
 
+static int late_latch_lead_us = RK3588_VR_LATE_LATCH_LEAD_US;
+module_param(late_latch_lead_us, int, 0644);
+MODULE_PARM_DESC(late_latch_lead_us, "Time before scanout the late-latch warp is programmed in microseconds (default: 300)");
+
 /* Forward declarations */
 static int rk3588_vr_display_thread(void *data);
 static void rk3588_vr_display_handle_vsync(struct rk3588_vr_display *vrd, int display_idx);
 static void rk3588_vr_display_handle_commit(struct rk3588_vr_display *vrd, int display_idx);
+static enum hrtimer_restart rk3588_vr_display_late_latch_timer(struct hrtimer *timer);
+static void rk3588_vr_display_cancel_fence(struct dma_fence *fence, int error);
+static void rk3588_vr_display_unmap_buf(struct rk3588_vr_scanout_buf *buf);
 
 /**
  * rk3588_vr_display_init - Initialize the RK3588 VR display driver
@@ -79,6 +86,35 @@ int rk3588_vr_display_init(struct rk3588_vr_display *vrd)
     init_completion(&vrd->vr_thread_completion);
     atomic_set(&vrd->vr_thread_active, 0);
 
+    /* Late-latch timers, armed from the vsync handler once enabled */
+    for (i = 0; i < RK3588_VR_MAX_DISPLAYS; i++) {
+        hrtimer_init(&vrd->late_latch[i].timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_HARD);
+        vrd->late_latch[i].timer.function = rk3588_vr_display_late_latch_timer;
+        vrd->late_latch[i].vrd = vrd;
+        vrd->late_latch[i].display_idx = i;
+        vrd->late_latch[i].render_valid = false;
+        vrd->late_latch[i].chain_slices = 0;
+        init_waitqueue_head(&vrd->late_latch[i].slice_wait);
+    }
+
+    vrd->late_latch_enabled = false;
+    vrd->late_latch_lead_us = late_latch_lead_us;
+    vrd->num_slices = 0;
+
+    /* Scanout layers, nothing shown until the first commit */
+    mutex_init(&vrd->layer_mutex);
+    spin_lock_init(&vrd->fence_lock);
+    vrd->fence_context = dma_fence_context_alloc(RK3588_VR_MAX_PLANES);
+    memset(vrd->scanout_bufs, 0, sizeof(vrd->scanout_bufs));
+    for (i = 0; i < RK3588_VR_MAX_PLANES; i++) {
+        memset(&vrd->layers[i], 0, sizeof(vrd->layers[i]));
+        vrd->layers[i].vrd = vrd;
+        vrd->layers[i].plane = i;
+        vrd->layers[i].programmed_buf = -1;
+        vrd->layers[i].active_buf = -1;
+        init_waitqueue_head(&vrd->layers[i].latch_wait);
+    }
+
     /* Enable clocks */
     ret = clk_prepare_enable(vrd->hclk);
     if (ret) {
@@ -256,6 +292,10 @@ int rk3588_vr_display_init(struct rk3588_vr_display *vrd)
     
     writel(val, vrd->regs + RK3588_VOP_VR_DIRECT_MODE);
 
+    /* Late-latch warp and beam racing stay off until userspace enables them */
+    writel(0, vrd->regs + RK3588_VOP_VR_WARP_CTRL);
+    writel(0, vrd->regs + RK3588_VOP_VR_SLICE_CTRL);
+
     /* Initialize VR thread */
     vrd->vr_thread = kthread_create(rk3588_vr_display_thread, vrd, "rk3588-vr-thread");
     if (IS_ERR(vrd->vr_thread)) {
@@ -298,7 +338,7 @@ err_disable_hclk:
  */
 void rk3588_vr_display_fini(struct rk3588_vr_display *vrd)
 {
-    int i;
+    int i, j;
 
     if (!vrd)
         return;
@@ -312,6 +352,38 @@ void rk3588_vr_display_fini(struct rk3588_vr_display *vrd)
         kthread_stop(vrd->vr_thread);
     }
 
+    /* Stop late latching */
+    for (i = 0; i < RK3588_VR_MAX_DISPLAYS; i++)
+        hrtimer_cancel(&vrd->late_latch[i].timer);
+
+    /* Take down scanout layers, commits not on screen are cancelled */
+    mutex_lock(&vrd->layer_mutex);
+    for (i = 0; i < RK3588_VR_MAX_PLANES; i++) {
+        struct rk3588_vr_layer *layer = &vrd->layers[i];
+
+        if (layer->in_fence) {
+            dma_fence_remove_callback(layer->in_fence, &layer->in_cb);
+            dma_fence_put(layer->in_fence);
+            layer->in_fence = NULL;
+        }
+
+        writel(0, vrd->regs + RK3588_VOP_PLANE_CTRL(i));
+        rk3588_vr_display_cancel_fence(layer->waiting_out_fence, -ECANCELED);
+        rk3588_vr_display_cancel_fence(layer->programmed_out_fence, -ECANCELED);
+        layer->waiting_out_fence = NULL;
+        layer->programmed_out_fence = NULL;
+        layer->fence_waiting = false;
+        layer->programmed = false;
+        layer->active_buf = -1;
+        wake_up_all(&layer->latch_wait);
+    }
+
+    for (i = 0; i < RK3588_VR_MAX_SCANOUT_BUFS; i++) {
+        if (vrd->scanout_bufs[i].dmabuf)
+            rk3588_vr_display_unmap_buf(&vrd->scanout_bufs[i]);
+    }
+    mutex_unlock(&vrd->layer_mutex);
+
     /* Disable hardware */
     writel(0, vrd->regs + RK3588_VOP_SYS_CTRL);
 
@@ -328,6 +400,16 @@ void rk3588_vr_display_fini(struct rk3588_vr_display *vrd)
                              vrd->chromatic_map[i], vrd->chromatic_map_dma[i]);
             vrd->chromatic_map[i] = NULL;
         }
+
+        for (j = 0; j < 2; j++) {
+            if (vrd->mesh[i].slot[j]) {
+                dma_free_coherent(vrd->dev, RK3588_VR_MESH_MAX_SIZE,
+                                 vrd->mesh[i].slot[j], vrd->mesh[i].slot_dma[j]);
+                vrd->mesh[i].slot[j] = NULL;
+            }
+        }
+        vrd->mesh[i].pending = false;
+        vrd->mesh[i].retiring = false;
     }
 
     /* Free motion vectors */
@@ -337,6 +419,14 @@ void rk3588_vr_display_fini(struct rk3588_vr_display *vrd)
         vrd->motion_vectors = NULL;
     }
 
+    /* Free late-latch page */
+    if (vrd->late_latch_page) {
+        dma_free_coherent(vrd->dev, PAGE_SIZE,
+                         vrd->late_latch_page, vrd->late_latch_page_dma);
+        vrd->late_latch_page = NULL;
+    }
+    vrd->late_latch_enabled = false;
+
     /* Cleanup debugfs */
     rk3588_vr_display_debugfs_fini(vrd);
 
@@ -397,6 +487,7 @@ int rk3588_vr_display_enable(struct rk3588_vr_display *vrd)
 void rk3588_vr_display_disable(struct rk3588_vr_display *vrd)
 {
     u32 val;
+    int i;
 
     if (!vrd || !vrd->dev || !vrd->regs || !vrd->enabled)
         return;
@@ -407,6 +498,10 @@ void rk3588_vr_display_disable(struct rk3588_vr_display *vrd)
     atomic_set(&vrd->vr_thread_active, 0);
     complete(&vrd->vr_thread_completion);
 
+    /* No vsync is coming, drop the pending late latches */
+    for (i = 0; i < RK3588_VR_MAX_DISPLAYS; i++)
+        hrtimer_cancel(&vrd->late_latch[i].timer);
+
     /* Disable hardware */
     val = readl(vrd->regs + RK3588_VOP_SYS_CTRL);
     val &= ~RK3588_VOP_SYS_CTRL_EN;
@@ -905,6 +1000,79 @@ int rk3588_vr_display_set_chromatic_map(struct rk3588_vr_display *vrd, int displ
     return 0;
 }
 
+/**
+ * rk3588_vr_display_set_distortion_mesh - Set the sparse distortion mesh of a display
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @display_idx: Display index (0 or 1)
+ * @mesh: struct rk3588_vr_mesh_header followed by cols * rows vertices
+ * @size: Size of the mesh in bytes
+ *
+ * The mesh is copied into the back buffer of the display and swapped in by
+ * the next vsync, the VOP interpolates it in the mesh distortion mode. A mesh
+ * set again before that vsync replaces the pending one. Setting one while the
+ * previous swap has not latched yet fails with -EBUSY, retry after a vsync.
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_set_distortion_mesh(struct rk3588_vr_display *vrd, int display_idx, const void *mesh, size_t size)
+{
+    const struct rk3588_vr_mesh_header *hdr = mesh;
+    struct rk3588_vr_mesh_buffers *mb;
+    unsigned long flags;
+    int i, back;
+
+    if (!vrd || !vrd->dev || !mesh || size < sizeof(*hdr))
+        return -EINVAL;
+
+    if (display_idx < 0 || display_idx >= RK3588_VR_MAX_DISPLAYS)
+        return -EINVAL;
+
+    if (hdr->magic != RK3588_VR_MESH_MAGIC ||
+        hdr->cols < RK3588_VR_MESH_MIN_DIM || hdr->cols > RK3588_VR_MESH_MAX_DIM ||
+        hdr->rows < RK3588_VR_MESH_MIN_DIM || hdr->rows > RK3588_VR_MESH_MAX_DIM ||
+        !hdr->width || !hdr->height)
+        return -EINVAL;
+
+    if (size != sizeof(*hdr) + (size_t)hdr->cols * hdr->rows * sizeof(struct rk3588_vr_mesh_vertex))
+        return -EINVAL;
+
+    mb = &vrd->mesh[display_idx];
+
+    /* Both buffers are sized for the largest mesh on first use */
+    for (i = 0; i < 2; i++) {
+        if (mb->slot[i])
+            continue;
+
+        mb->slot[i] = dma_alloc_coherent(vrd->dev, RK3588_VR_MESH_MAX_SIZE,
+                                         &mb->slot_dma[i], GFP_KERNEL);
+        if (!mb->slot[i])
+            return -ENOMEM;
+    }
+
+    /* Keep the vsync handler off the back buffer while it is rewritten */
+    spin_lock_irqsave(&vrd->lock, flags);
+    if (mb->retiring) {
+        spin_unlock_irqrestore(&vrd->lock, flags);
+        return -EBUSY;
+    }
+    mb->pending = false;
+    back = !mb->front;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    dev_info(vrd->dev, "Setting VR display distortion mesh for display %d, %ux%u vertices\n",
+             display_idx, hdr->cols, hdr->rows);
+
+    memcpy(mb->slot[back], mesh, size);
+    mb->slot_size_reg[back] = RK3588_VOP_VR_MESH_SIZE_COLS(hdr->cols) |
+                              RK3588_VOP_VR_MESH_SIZE_ROWS(hdr->rows);
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    mb->pending = true;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    return 0;
+}
+
 /**
  * rk3588_vr_display_set_motion_vectors - Set the RK3588 VR display motion vectors
  * @vrd: Pointer to the RK3588 VR display device structure
@@ -953,6 +1121,1015 @@ int rk3588_vr_display_set_motion_vectors(struct rk3588_vr_display *vrd, const vo
     return 0;
 }
 
+/**
+ * rk3588_vr_display_set_late_latch - Enable or disable late-latched reprojection
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @enable: Whether to program the warp from the latest pose before each scanout
+ * @lead_us: Time before scanout the warp is programmed, 0 for the module default
+ *
+ * The first enable allocates the pose page userspace maps with
+ * rk3588_vr_display_late_latch_mmap(). The lead has to cover the timer
+ * latency and the register writes, and stay below one vsync period.
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_set_late_latch(struct rk3588_vr_display *vrd, bool enable, u32 lead_us)
+{
+    u32 period_us;
+    int i;
+
+    if (!vrd || !vrd->dev || !vrd->regs)
+        return -EINVAL;
+
+    period_us = 1000000 / vrd->config.target_vrefresh;
+    if (!lead_us)
+        lead_us = late_latch_lead_us;
+
+    if (enable && lead_us >= period_us)
+        return -EINVAL;
+
+    dev_info(vrd->dev, "%s VR display late latch, lead=%u us\n",
+             enable ? "Enabling" : "Disabling", lead_us);
+
+    if (!enable) {
+        vrd->late_latch_enabled = false;
+        for (i = 0; i < RK3588_VR_MAX_DISPLAYS; i++) {
+            hrtimer_cancel(&vrd->late_latch[i].timer);
+            vrd->late_latch[i].chain_slices = 0;
+        }
+        vrd->num_slices = 0;
+        writel(0, vrd->regs + RK3588_VOP_VR_WARP_CTRL);
+        writel(0, vrd->regs + RK3588_VOP_VR_SLICE_CTRL);
+        return 0;
+    }
+
+    if (!vrd->late_latch_page) {
+        vrd->late_latch_page = dma_alloc_coherent(vrd->dev, PAGE_SIZE,
+                                                  &vrd->late_latch_page_dma, GFP_KERNEL);
+        if (!vrd->late_latch_page)
+            return -ENOMEM;
+    }
+
+    vrd->late_latch_lead_us = lead_us;
+    vrd->late_latch_enabled = true;
+    return 0;
+}
+
+/**
+ * rk3588_vr_display_late_latch_mmap - Map the late-latch pose page
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @vma: Userspace mapping of one page
+ *
+ * The page holds a struct rk3588_vr_late_latch_page.
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_late_latch_mmap(struct rk3588_vr_display *vrd, struct vm_area_struct *vma)
+{
+    if (!vrd || !vrd->dev || !vma)
+        return -EINVAL;
+
+    if (!vrd->late_latch_page)
+        return -ENODEV;
+
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_SIZE)
+        return -EINVAL;
+
+    return dma_mmap_coherent(vrd->dev, vma, vrd->late_latch_page,
+                             vrd->late_latch_page_dma, PAGE_SIZE);
+}
+
+/*
+ * Copy a pose userspace may be writing, false if it kept changing or was
+ * never written.
+ */
+static bool rk3588_vr_display_read_pose(const struct rk3588_vr_late_latch_pose *src,
+                                        struct rk3588_vr_late_latch_pose *dst)
+{
+    u32 seq;
+    int i;
+
+    for (i = 0; i < RK3588_VR_LATE_LATCH_RETRIES; i++) {
+        seq = READ_ONCE(src->sequence);
+        if (seq & 1) {
+            cpu_relax();
+            continue;
+        }
+
+        smp_rmb();
+        dst->display_time_ns = READ_ONCE(src->display_time_ns);
+        dst->rotation[0] = READ_ONCE(src->rotation[0]);
+        dst->rotation[1] = READ_ONCE(src->rotation[1]);
+        dst->rotation[2] = READ_ONCE(src->rotation[2]);
+        dst->rotation[3] = READ_ONCE(src->rotation[3]);
+        smp_rmb();
+
+        if (READ_ONCE(src->sequence) == seq) {
+            dst->sequence = seq;
+            return seq != 0;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Program the rotation from the view of the latest pose to the view the frame
+ * was rendered with, q = q_render * conj(q_latest), or identity without one.
+ */
+static void rk3588_vr_display_write_warp(struct rk3588_vr_display *vrd, int display_idx,
+                                         const struct rk3588_vr_late_latch_pose *render,
+                                         const struct rk3588_vr_late_latch_pose *latest)
+{
+    const s64 one = 1LL << 60;  /* Products of two Q2.30 values */
+    s64 rw, rx, ry, rz, lw, lx, ly, lz;
+    s64 w, x, y, z;
+    s64 m[9];
+    int i;
+
+    if (render && latest) {
+        rw = render->rotation[0];
+        rx = render->rotation[1];
+        ry = render->rotation[2];
+        rz = render->rotation[3];
+        lw = latest->rotation[0];
+        lx = latest->rotation[1];
+        ly = latest->rotation[2];
+        lz = latest->rotation[3];
+
+        w = (rw * lw + rx * lx + ry * ly + rz * lz) >> 30;
+        x = (-rw * lx + rx * lw - ry * lz + rz * ly) >> 30;
+        y = (-rw * ly + rx * lz + ry * lw - rz * lx) >> 30;
+        z = (-rw * lz - rx * ly + ry * lx + rz * lw) >> 30;
+
+        m[0] = one - 2 * (y * y + z * z);
+        m[1] = 2 * (x * y - w * z);
+        m[2] = 2 * (x * z + w * y);
+        m[3] = 2 * (x * y + w * z);
+        m[4] = one - 2 * (x * x + z * z);
+        m[5] = 2 * (y * z - w * x);
+        m[6] = 2 * (x * z - w * y);
+        m[7] = 2 * (y * z + w * x);
+        m[8] = one - 2 * (x * x + y * y);
+    } else {
+        for (i = 0; i < 9; i++)
+            m[i] = (i % 4 == 0) ? one : 0;
+    }
+
+    /* Q4.60 to the Q16.16 of the warp registers */
+    for (i = 0; i < 9; i++)
+        writel((u32)(s32)(m[i] >> 44), vrd->regs + RK3588_VOP_VR_WARP_MATRIX(display_idx, i));
+}
+
+/*
+ * Program the warp of one scanout from the latest pose against @render, the
+ * pose its image was rendered with, or as rendered without one. A latest pose
+ * predicted more than a vsync period away from @scanout is ignored.
+ */
+static void rk3588_vr_display_latch_warp(struct rk3588_vr_display *vrd, int display_idx,
+                                         const struct rk3588_vr_late_latch_pose *render,
+                                         ktime_t scanout)
+{
+    struct rk3588_vr_late_latch_page *page = vrd->late_latch_page;
+    struct rk3588_vr_late_latch_pose latest;
+    struct rk3588_vr_late_latch_status *status;
+    bool have_latest;
+    unsigned long flags;
+    s64 skew_ns;
+    u32 val;
+
+    have_latest = render && rk3588_vr_display_read_pose(&page->latest, &latest);
+    if (have_latest) {
+        skew_ns = latest.display_time_ns - ktime_to_ns(scanout);
+        if (abs(skew_ns) > (s64)vrd->vsync_period_us[display_idx] * NSEC_PER_USEC)
+            have_latest = false;
+    }
+
+    if (have_latest)
+        rk3588_vr_display_write_warp(vrd, display_idx, render, &latest);
+    else
+        rk3588_vr_display_write_warp(vrd, display_idx, NULL, NULL);
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    val = readl(vrd->regs + RK3588_VOP_VR_WARP_CTRL);
+    val |= RK3588_VOP_VR_WARP_CTRL_EN(display_idx) | RK3588_VOP_VR_WARP_CTRL_LOAD(display_idx);
+    writel(val, vrd->regs + RK3588_VOP_VR_WARP_CTRL);
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    status = &page->status[display_idx];
+    WRITE_ONCE(status->sequence, have_latest ? latest.sequence : 0);
+    WRITE_ONCE(status->display_time_ns, have_latest ? latest.display_time_ns : 0);
+    WRITE_ONCE(status->latch_time_ns, ktime_get_ns());
+    WRITE_ONCE(status->scanout_time_ns, ktime_to_ns(scanout));
+    WRITE_ONCE(status->latch_count, status->latch_count + 1);
+}
+
+/**
+ * rk3588_vr_display_late_latch_apply - Program the warp from the latest pose
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @display_idx: Display index (0 or 1)
+ * @scanout: Expected start of the next scanout
+ *
+ * Called from the late-latch timer in whole-frame mode. A latest pose
+ * predicted more than a vsync period away from @scanout is ignored and the
+ * frame is shown as it was rendered.
+ */
+void rk3588_vr_display_late_latch_apply(struct rk3588_vr_display *vrd, int display_idx, ktime_t scanout)
+{
+    struct rk3588_vr_late_latch *ll;
+    struct rk3588_vr_late_latch_pose render;
+    bool have_render;
+    unsigned long flags;
+
+    if (!vrd || display_idx < 0 || display_idx >= RK3588_VR_MAX_DISPLAYS)
+        return;
+
+    if (!vrd->late_latch_enabled || !vrd->late_latch_page)
+        return;
+
+    ll = &vrd->late_latch[display_idx];
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    have_render = ll->render_valid;
+    render = ll->render;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    rk3588_vr_display_latch_warp(vrd, display_idx, have_render ? &render : NULL, scanout);
+}
+
+/* Queue a slice deadline event, dropping the oldest one when the reader lags */
+static void rk3588_vr_display_queue_slice_event(struct rk3588_vr_late_latch *ll,
+                                                const struct rk3588_vr_slice_event *ev)
+{
+    struct rk3588_vr_display *vrd = ll->vrd;
+    unsigned long flags;
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    ll->events[ll->event_head % RK3588_VR_SLICE_EVENT_DEPTH] = *ev;
+    ll->event_head++;
+    if (ll->event_head - ll->event_tail > RK3588_VR_SLICE_EVENT_DEPTH)
+        ll->event_tail = ll->event_head - RK3588_VR_SLICE_EVENT_DEPTH;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    wake_up_interruptible(&ll->slice_wait);
+}
+
+/**
+ * rk3588_vr_display_latch_slice - Latch the next slice of a beam-racing chain
+ * @ll: Late-latch state of the display
+ *
+ * Latch k of the chain anchored at vsync t programs the warp of slice
+ * k % num_slices, which starts scanning out at t + k * period / num_slices,
+ * and announces the deadline of the slice after it. The last latch of the
+ * chain is slice 0 of the next frame.
+ *
+ * Return: true while the chain has more slices to latch
+ */
+static bool rk3588_vr_display_latch_slice(struct rk3588_vr_late_latch *ll)
+{
+    struct rk3588_vr_display *vrd = ll->vrd;
+    struct rk3588_vr_late_latch_pose render;
+    struct rk3588_vr_slice_event ev;
+    ktime_t scanout;
+    unsigned long flags;
+    bool have_render, missed;
+    u32 latch, slice, num_slices;
+    u64 frame, period_ns;
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    num_slices = ll->chain_slices;
+    frame = ll->chain_frame;
+    period_ns = ll->slice_period_ns;
+    latch = ++ll->chain_latch;
+    slice = latch % num_slices;
+    scanout = ktime_add_ns(ll->chain_anchor, (u64)latch * period_ns);
+    missed = !(ll->slice_committed & BIT(slice));
+    have_render = ll->slice_render_valid & BIT(slice);
+    render = ll->slice_render[slice];
+    ll->slice_committed &= ~BIT(slice);
+    ll->slice_render_valid &= ~BIT(slice);
+    if (missed)
+        ll->missed_slices++;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    rk3588_vr_display_latch_warp(vrd, ll->display_idx, have_render ? &render : NULL, scanout);
+
+    /* The slice after this one has to be committed by its own latch */
+    ev.frame = frame + (latch + 1) / num_slices;
+    ev.slice = (latch + 1) % num_slices;
+    ev.num_slices = num_slices;
+    ev.scanout_ns = ktime_to_ns(scanout) + period_ns;
+    ev.deadline_ns = ev.scanout_ns - (s64)vrd->late_latch_lead_us * NSEC_PER_USEC;
+    ev.flags = missed ? RK3588_VR_SLICE_EVENT_PREV_MISSED : 0;
+    ev.reserved = 0;
+    rk3588_vr_display_queue_slice_event(ll, &ev);
+
+    return latch < num_slices;
+}
+
+static enum hrtimer_restart rk3588_vr_display_late_latch_timer(struct hrtimer *timer)
+{
+    struct rk3588_vr_late_latch *ll = container_of(timer, struct rk3588_vr_late_latch, timer);
+
+    if (!ll->chain_slices) {
+        rk3588_vr_display_late_latch_apply(ll->vrd, ll->display_idx, ll->scanout);
+        return HRTIMER_NORESTART;
+    }
+
+    if (!rk3588_vr_display_latch_slice(ll))
+        return HRTIMER_NORESTART;
+
+    hrtimer_forward(timer, hrtimer_get_expires(timer), ns_to_ktime(ll->slice_period_ns));
+    return HRTIMER_RESTART;
+}
+
+/**
+ * rk3588_vr_display_set_beam_racing - Split the scanout into separately latched slices
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @num_slices: Number of horizontal slices, 0 for whole frames
+ *
+ * Needs the late latch enabled. Each slice is latched late_latch_lead_us
+ * before the raster reaches it with the render pose posted when it was
+ * committed through rk3588_vr_display_commit_slice(), and its deadline is
+ * announced one slice earlier through rk3588_vr_display_read_slice_event().
+ * Slice k covers rows [k * height / num_slices, (k + 1) * height / num_slices).
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_set_beam_racing(struct rk3588_vr_display *vrd, u32 num_slices)
+{
+    struct rk3588_vr_late_latch *ll;
+    unsigned long flags;
+    u32 period_us, val = 0;
+    int i;
+
+    if (!vrd || !vrd->dev || !vrd->regs)
+        return -EINVAL;
+
+    if (num_slices > RK3588_VR_MAX_SLICES)
+        return -EINVAL;
+
+    if (num_slices && !vrd->late_latch_enabled)
+        return -EINVAL;
+
+    period_us = 1000000 / vrd->config.target_vrefresh;
+    if (num_slices && vrd->late_latch_lead_us >= period_us / num_slices)
+        return -EINVAL;
+
+    dev_info(vrd->dev, "Setting VR display beam racing to %u slices\n", num_slices);
+
+    for (i = 0; i < RK3588_VR_MAX_DISPLAYS; i++) {
+        ll = &vrd->late_latch[i];
+        hrtimer_cancel(&ll->timer);
+
+        spin_lock_irqsave(&vrd->lock, flags);
+        ll->chain_slices = 0;
+        ll->slice_committed = 0;
+        ll->slice_render_valid = 0;
+        ll->event_tail = ll->event_head;
+        spin_unlock_irqrestore(&vrd->lock, flags);
+
+        if (num_slices)
+            val |= RK3588_VOP_VR_SLICE_CTRL_EN(i) | RK3588_VOP_VR_SLICE_CTRL_COUNT(i, num_slices);
+    }
+
+    vrd->num_slices = num_slices;
+    writel(val, vrd->regs + RK3588_VOP_VR_SLICE_CTRL);
+    return 0;
+}
+
+/**
+ * rk3588_vr_display_commit_slice - Commit one rendered slice
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @display_idx: Display index (0 or 1)
+ * @slice: Slice index
+ *
+ * Takes render[display_idx] of the late-latch page as the pose the slice was
+ * rendered with and flushes the slice to the scanout. The slice is shown by
+ * its next latch, a slice committed past its deadline waits for the next frame.
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_commit_slice(struct rk3588_vr_display *vrd, int display_idx, u32 slice)
+{
+    struct rk3588_vr_late_latch *ll;
+    struct rk3588_vr_late_latch_pose render = {};
+    unsigned long flags;
+    bool valid;
+
+    if (!vrd || !vrd->dev || !vrd->regs)
+        return -EINVAL;
+
+    if (display_idx < 0 || display_idx >= RK3588_VR_MAX_DISPLAYS)
+        return -EINVAL;
+
+    if (!vrd->num_slices || slice >= vrd->num_slices || !vrd->late_latch_page)
+        return -EINVAL;
+
+    ll = &vrd->late_latch[display_idx];
+    valid = rk3588_vr_display_read_pose(&vrd->late_latch_page->render[display_idx], &render);
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    ll->slice_render[slice] = render;
+    if (valid)
+        ll->slice_render_valid |= BIT(slice);
+    else
+        ll->slice_render_valid &= ~BIT(slice);
+    ll->slice_committed |= BIT(slice);
+    writel(RK3588_VOP_VR_SLICE_COMMIT_BIT(display_idx, slice), vrd->regs + RK3588_VOP_VR_SLICE_COMMIT);
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    return 0;
+}
+
+/**
+ * rk3588_vr_display_read_slice_event - Take the next slice deadline event
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @display_idx: Display index (0 or 1)
+ * @ev: Pointer to store the event
+ * @nonblock: Return -EAGAIN instead of waiting when there is none
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_read_slice_event(struct rk3588_vr_display *vrd, int display_idx,
+                                       struct rk3588_vr_slice_event *ev, bool nonblock)
+{
+    struct rk3588_vr_late_latch *ll;
+    unsigned long flags;
+    int ret;
+
+    if (!vrd || !vrd->dev || !ev)
+        return -EINVAL;
+
+    if (display_idx < 0 || display_idx >= RK3588_VR_MAX_DISPLAYS)
+        return -EINVAL;
+
+    ll = &vrd->late_latch[display_idx];
+
+    for (;;) {
+        spin_lock_irqsave(&vrd->lock, flags);
+        if (ll->event_tail != ll->event_head) {
+            *ev = ll->events[ll->event_tail % RK3588_VR_SLICE_EVENT_DEPTH];
+            ll->event_tail++;
+            spin_unlock_irqrestore(&vrd->lock, flags);
+            return 0;
+        }
+        spin_unlock_irqrestore(&vrd->lock, flags);
+
+        if (nonblock)
+            return -EAGAIN;
+
+        ret = wait_event_interruptible(ll->slice_wait,
+                                       READ_ONCE(ll->event_tail) != READ_ONCE(ll->event_head));
+        if (ret)
+            return ret;
+    }
+}
+
+/**
+ * rk3588_vr_display_poll_slice_event - Poll for slice deadline events
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @display_idx: Display index (0 or 1)
+ * @file: File being polled
+ * @wait: Poll table
+ *
+ * Return: EPOLLIN when an event is ready
+ */
+__poll_t rk3588_vr_display_poll_slice_event(struct rk3588_vr_display *vrd, int display_idx,
+                                            struct file *file, poll_table *wait)
+{
+    struct rk3588_vr_late_latch *ll;
+
+    if (!vrd || display_idx < 0 || display_idx >= RK3588_VR_MAX_DISPLAYS)
+        return EPOLLERR;
+
+    ll = &vrd->late_latch[display_idx];
+    poll_wait(file, &ll->slice_wait, wait);
+
+    return READ_ONCE(ll->event_tail) != READ_ONCE(ll->event_head) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static const char *rk3588_vr_display_fence_get_driver_name(struct dma_fence *fence)
+{
+    return "rk3588-vr-display";
+}
+
+static const char *rk3588_vr_display_fence_get_timeline_name(struct dma_fence *fence)
+{
+    return "scanout";
+}
+
+static const struct dma_fence_ops rk3588_vr_display_fence_ops = {
+    .get_driver_name = rk3588_vr_display_fence_get_driver_name,
+    .get_timeline_name = rk3588_vr_display_fence_get_timeline_name,
+};
+
+/* Signal an out-fence whose commit never reached the screen */
+static void rk3588_vr_display_cancel_fence(struct dma_fence *fence, int error)
+{
+    if (!fence)
+        return;
+
+    dma_fence_set_error(fence, error);
+    dma_fence_signal(fence);
+    dma_fence_put(fence);
+}
+
+static int rk3588_vr_display_plane_format(u32 format, u32 *fmt, u32 *cpp)
+{
+    switch (format) {
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XRGB8888:
+        *fmt = RK3588_VOP_PLANE_FMT_ARGB8888;
+        *cpp = 4;
+        return 0;
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_XBGR8888:
+        *fmt = RK3588_VOP_PLANE_FMT_ABGR8888;
+        *cpp = 4;
+        return 0;
+    case DRM_FORMAT_RGB565:
+        *fmt = RK3588_VOP_PLANE_FMT_RGB565;
+        *cpp = 2;
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static struct rk3588_vr_scanout_buf *rk3588_vr_display_lookup_buf(struct rk3588_vr_display *vrd,
+                                                                  u32 handle)
+{
+    if (handle < 1 || handle > RK3588_VR_MAX_SCANOUT_BUFS)
+        return NULL;
+
+    if (!vrd->scanout_bufs[handle - 1].dmabuf)
+        return NULL;
+
+    return &vrd->scanout_bufs[handle - 1];
+}
+
+static void rk3588_vr_display_unmap_buf(struct rk3588_vr_scanout_buf *buf)
+{
+    dma_buf_unmap_attachment_unlocked(buf->attach, buf->sgt, DMA_TO_DEVICE);
+    dma_buf_detach(buf->dmabuf, buf->attach);
+    dma_buf_put(buf->dmabuf);
+    memset(buf, 0, sizeof(*buf));
+}
+
+/*
+ * Write a commit to the plane registers, vrd->lock held. The VOP latches them
+ * at the next vsync of the display; a commit still waiting for that is
+ * replaced and its out-fence returned in *dropped.
+ */
+static void rk3588_vr_display_program_layer(struct rk3588_vr_layer *layer,
+                                            const struct rk3588_vr_layer_commit *commit,
+                                            struct dma_fence *out_fence, ktime_t commit_time,
+                                            struct dma_fence **dropped)
+{
+    struct rk3588_vr_display *vrd = layer->vrd;
+    struct rk3588_vr_scanout_buf *buf = &vrd->scanout_bufs[commit->handle - 1];
+    int plane = layer->plane;
+    dma_addr_t addr = buf->dma_addr + commit->offset;
+    u32 fmt, cpp, val;
+
+    rk3588_vr_display_plane_format(commit->format, &fmt, &cpp);
+
+    if (layer->programmed) {
+        vrd->scanout_bufs[layer->programmed_buf].users--;
+        layer->stats.dropped++;
+        layer->settled_seq++;
+        *dropped = layer->programmed_out_fence;
+    }
+
+    writel(((commit->height - 1) << 16) | (commit->width - 1),
+           vrd->regs + RK3588_VOP_PLANE_SRC_INFO(plane));
+    writel(((u32)commit->dst_y << 16) | commit->dst_x,
+           vrd->regs + RK3588_VOP_PLANE_DST_INFO(plane));
+    writel(lower_32_bits(addr), vrd->regs + RK3588_VOP_PLANE_ADDR_BASE(plane));
+    writel(commit->pitch, vrd->regs + RK3588_VOP_PLANE_STRIDE(plane));
+    writel(RK3588_VOP_PLANE_CTRL_EN | RK3588_VOP_PLANE_CTRL_FORMAT(fmt) |
+           RK3588_VOP_PLANE_CTRL_PORT(layer->display_idx),
+           vrd->regs + RK3588_VOP_PLANE_CTRL(plane));
+
+    /* Shadow registers take effect at the next frame start */
+    val = readl(vrd->regs + RK3588_VOP_SYS_CTRL);
+    writel(val | RK3588_VOP_SYS_CTRL_GLOBAL_REGDONE, vrd->regs + RK3588_VOP_SYS_CTRL);
+
+    layer->programmed_buf = commit->handle - 1;
+    layer->programmed_out_fence = out_fence;
+    layer->programmed_commit_time = commit_time;
+    layer->programmed_time = ktime_get();
+    layer->programmed = true;
+}
+
+/* In-fence signalled, runs in the signaller's context under its fence lock */
+static void rk3588_vr_display_layer_fence_cb(struct dma_fence *fence, struct dma_fence_cb *cb)
+{
+    struct rk3588_vr_layer *layer = container_of(cb, struct rk3588_vr_layer, in_cb);
+    struct rk3588_vr_display *vrd = layer->vrd;
+    struct dma_fence *dropped = NULL;
+    int error = -ECANCELED;
+    unsigned long flags;
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    if (layer->fence_waiting) {
+        layer->fence_waiting = false;
+        layer->stats.fence_wait_us = (u32)ktime_us_delta(ktime_get(), layer->waiting_time);
+
+        if (fence->error) {
+            /* Rendering failed, keep showing the previous frame */
+            vrd->scanout_bufs[layer->waiting.handle - 1].users--;
+            layer->stats.dropped++;
+            layer->settled_seq++;
+            dropped = layer->waiting_out_fence;
+            error = fence->error;
+        } else {
+            rk3588_vr_display_program_layer(layer, &layer->waiting, layer->waiting_out_fence,
+                                            layer->waiting_time, &dropped);
+        }
+        layer->waiting_out_fence = NULL;
+    }
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    rk3588_vr_display_cancel_fence(dropped, error);
+    if (dropped)
+        wake_up(&layer->latch_wait);
+}
+
+/* Latch programmed layers of a display at its vsync, fences signalled by the caller */
+static void rk3588_vr_display_latch_layers(struct rk3588_vr_display *vrd, int display_idx,
+                                           ktime_t now, struct dma_fence **latched)
+{
+    struct rk3588_vr_layer *layer;
+    u32 latency_us;
+    int i;
+
+    for (i = 0; i < RK3588_VR_MAX_PLANES; i++) {
+        layer = &vrd->layers[i];
+        latched[i] = NULL;
+
+        if (!layer->programmed || layer->display_idx != display_idx)
+            continue;
+
+        if (layer->active_buf >= 0)
+            vrd->scanout_bufs[layer->active_buf].users--;
+        layer->active_buf = layer->programmed_buf;
+        layer->programmed = false;
+
+        latency_us = (u32)ktime_us_delta(now, layer->programmed_commit_time);
+        layer->stats.latch_wait_us = (u32)ktime_us_delta(now, layer->programmed_time);
+        layer->stats.commit_latency_us = latency_us;
+        if (layer->stats.latched)
+            layer->stats.commit_latency_avg_us =
+                (layer->stats.commit_latency_avg_us * 7 + latency_us) / 8;
+        else
+            layer->stats.commit_latency_avg_us = latency_us;
+        if (latency_us > layer->stats.commit_latency_max_us)
+            layer->stats.commit_latency_max_us = latency_us;
+        layer->stats.latched++;
+        layer->settled_seq++;
+
+        latched[i] = layer->programmed_out_fence;
+        layer->programmed_out_fence = NULL;
+    }
+}
+
+/**
+ * rk3588_vr_display_import_dmabuf - Import a DMA-BUF for scanout
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @fd: DMA-BUF file descriptor, e.g. a compositor swapchain image
+ * @handle: Pointer to store the handle for rk3588_vr_display_commit_layer()
+ *
+ * The buffer is attached and mapped once here, commits then only write its
+ * address to the plane, so frames go from the GPU to the panel without a copy.
+ * It must be contiguous in the VOP's address space, which holds for any buffer
+ * once the VOP IOMMU is enabled.
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_import_dmabuf(struct rk3588_vr_display *vrd, int fd, u32 *handle)
+{
+    struct rk3588_vr_scanout_buf *buf = NULL;
+    struct dma_buf *dmabuf;
+    struct dma_buf_attachment *attach;
+    struct sg_table *sgt;
+    int ret, i;
+
+    if (!vrd || !vrd->dev || !handle)
+        return -EINVAL;
+
+    dmabuf = dma_buf_get(fd);
+    if (IS_ERR(dmabuf))
+        return PTR_ERR(dmabuf);
+
+    mutex_lock(&vrd->layer_mutex);
+
+    for (i = 0; i < RK3588_VR_MAX_SCANOUT_BUFS; i++) {
+        if (!vrd->scanout_bufs[i].dmabuf) {
+            buf = &vrd->scanout_bufs[i];
+            break;
+        }
+    }
+    if (!buf) {
+        ret = -ENOSPC;
+        goto err_put;
+    }
+
+    attach = dma_buf_attach(dmabuf, vrd->dev);
+    if (IS_ERR(attach)) {
+        ret = PTR_ERR(attach);
+        goto err_put;
+    }
+
+    sgt = dma_buf_map_attachment_unlocked(attach, DMA_TO_DEVICE);
+    if (IS_ERR(sgt)) {
+        ret = PTR_ERR(sgt);
+        goto err_detach;
+    }
+
+    /* The plane has a single base address */
+    if (sgt->nents != 1) {
+        dev_err(vrd->dev, "DMA-BUF is not contiguous (%u segments)\n", sgt->nents);
+        ret = -EINVAL;
+        goto err_unmap;
+    }
+
+    buf->dmabuf = dmabuf;
+    buf->attach = attach;
+    buf->sgt = sgt;
+    buf->dma_addr = sg_dma_address(sgt->sgl);
+    buf->size = dmabuf->size;
+    buf->users = 0;
+    *handle = i + 1;
+
+    mutex_unlock(&vrd->layer_mutex);
+    return 0;
+
+err_unmap:
+    dma_buf_unmap_attachment_unlocked(attach, sgt, DMA_TO_DEVICE);
+err_detach:
+    dma_buf_detach(dmabuf, attach);
+err_put:
+    mutex_unlock(&vrd->layer_mutex);
+    dma_buf_put(dmabuf);
+    return ret;
+}
+
+/**
+ * rk3588_vr_display_release_dmabuf - Release an imported DMA-BUF
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @handle: Handle from rk3588_vr_display_import_dmabuf()
+ *
+ * Return: 0 on success, -EBUSY if a layer still shows or is about to show it,
+ * negative error code on other failures
+ */
+int rk3588_vr_display_release_dmabuf(struct rk3588_vr_display *vrd, u32 handle)
+{
+    struct rk3588_vr_scanout_buf *buf;
+    unsigned long flags;
+    u32 users;
+
+    if (!vrd || !vrd->dev)
+        return -EINVAL;
+
+    mutex_lock(&vrd->layer_mutex);
+
+    buf = rk3588_vr_display_lookup_buf(vrd, handle);
+    if (!buf) {
+        mutex_unlock(&vrd->layer_mutex);
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    users = buf->users;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    if (users) {
+        mutex_unlock(&vrd->layer_mutex);
+        return -EBUSY;
+    }
+
+    rk3588_vr_display_unmap_buf(buf);
+    mutex_unlock(&vrd->layer_mutex);
+    return 0;
+}
+
+/**
+ * rk3588_vr_display_commit_layer - Show an imported buffer on a plane
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @display_idx: Display index (0 or 1)
+ * @commit: Buffer, plane, format and placement
+ * @out_fence_fd: Pointer to store a sync_file fd that signals when the buffer
+ *                is on screen, or NULL
+ *
+ * Without an in-fence the plane is programmed at once. Otherwise it is
+ * programmed from the in-fence callback, so the GPU's completion goes straight
+ * to the registers without a round trip through the compositor. Either way it
+ * is latched at the next vsync of the display; a commit that has not been
+ * latched by then is replaced, and its out-fence signalled with -ECANCELED.
+ * The out-fence also signals, then with the rendering error, if the in-fence
+ * fails; the previous frame stays on screen.
+ *
+ * The out-fence signals when the previous buffer of the plane is no longer
+ * scanned out, so it is also the release fence of that buffer.
+ *
+ * Return: 0 on success, -EBUSY if the previous commit of the plane is still
+ * waiting for its in-fence, negative error code on other failures
+ */
+int rk3588_vr_display_commit_layer(struct rk3588_vr_display *vrd, int display_idx,
+                                   const struct rk3588_vr_layer_commit *commit, int *out_fence_fd)
+{
+    struct rk3588_vr_scanout_buf *buf;
+    struct rk3588_vr_layer *layer;
+    struct dma_fence *in_fence = NULL, *out_fence, *old_in_fence, *dropped = NULL;
+    struct sync_file *sync_file = NULL;
+    unsigned long flags;
+    ktime_t now = ktime_get();
+    u32 fmt, cpp;
+    int fd = -1;
+    int ret;
+
+    if (!vrd || !vrd->dev || !commit)
+        return -EINVAL;
+
+    if (display_idx < 0 || display_idx >= RK3588_VR_MAX_DISPLAYS)
+        return -EINVAL;
+
+    if (commit->plane >= RK3588_VR_MAX_PLANES || commit->reserved)
+        return -EINVAL;
+
+    if (rk3588_vr_display_plane_format(commit->format, &fmt, &cpp))
+        return -EINVAL;
+
+    if (!commit->width || !commit->height || commit->width > 4096 || commit->height > 4096 ||
+        commit->pitch < commit->width * cpp)
+        return -EINVAL;
+
+    mutex_lock(&vrd->layer_mutex);
+
+    buf = rk3588_vr_display_lookup_buf(vrd, commit->handle);
+    if (!buf) {
+        ret = -EINVAL;
+        goto err_unlock;
+    }
+
+    if ((u64)commit->offset + (u64)commit->pitch * (commit->height - 1) +
+        (u64)commit->width * cpp > buf->size) {
+        ret = -EINVAL;
+        goto err_unlock;
+    }
+
+    layer = &vrd->layers[commit->plane];
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    ret = (layer->fence_waiting ||
+           (layer->programmed && layer->display_idx != display_idx)) ? -EBUSY : 0;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+    if (ret)
+        goto err_unlock;
+
+    if (commit->in_fence_fd >= 0) {
+        in_fence = sync_file_get_fence(commit->in_fence_fd);
+        if (!in_fence) {
+            ret = -EINVAL;
+            goto err_unlock;
+        }
+    }
+
+    out_fence = kzalloc(sizeof(*out_fence), GFP_KERNEL);
+    if (!out_fence) {
+        ret = -ENOMEM;
+        goto err_put_in;
+    }
+    dma_fence_init(out_fence, &rk3588_vr_display_fence_ops, &vrd->fence_lock,
+                   vrd->fence_context + commit->plane, ++layer->fence_seqno);
+
+    if (out_fence_fd) {
+        fd = get_unused_fd_flags(O_CLOEXEC);
+        if (fd < 0) {
+            ret = fd;
+            goto err_put_out;
+        }
+
+        sync_file = sync_file_create(out_fence);
+        if (!sync_file) {
+            ret = -ENOMEM;
+            goto err_put_fd;
+        }
+    }
+
+    /* The fence callback of the previous commit has run, its in-fence can go */
+    old_in_fence = layer->in_fence;
+    layer->in_fence = NULL;
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    buf->users++;
+    layer->stats.commits++;
+    layer->commit_seq++;
+    layer->display_idx = display_idx;
+    if (in_fence) {
+        layer->waiting = *commit;
+        layer->waiting_out_fence = out_fence;
+        layer->waiting_time = now;
+        layer->fence_waiting = true;
+        layer->in_fence = in_fence;
+    } else {
+        rk3588_vr_display_program_layer(layer, commit, out_fence, now, &dropped);
+    }
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    /* Not under vrd->lock, the callback takes it */
+    if (in_fence && dma_fence_add_callback(in_fence, &layer->in_cb,
+                                           rk3588_vr_display_layer_fence_cb) == -ENOENT)
+        rk3588_vr_display_layer_fence_cb(in_fence, &layer->in_cb);
+
+    mutex_unlock(&vrd->layer_mutex);
+
+    dma_fence_put(old_in_fence);
+    rk3588_vr_display_cancel_fence(dropped, -ECANCELED);
+    if (dropped)
+        wake_up(&layer->latch_wait);
+
+    if (out_fence_fd) {
+        fd_install(fd, sync_file->file);
+        *out_fence_fd = fd;
+    }
+
+    return 0;
+
+err_put_fd:
+    put_unused_fd(fd);
+err_put_out:
+    dma_fence_put(out_fence);
+err_put_in:
+    dma_fence_put(in_fence);
+err_unlock:
+    mutex_unlock(&vrd->layer_mutex);
+    return ret;
+}
+
+/**
+ * rk3588_vr_display_wait_for_layer - Wait for the commits of a plane to settle
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @plane: Plane index
+ *
+ * This function waits until every commit made to the plane before the call
+ * has been latched or replaced, the per-layer counterpart of
+ * rk3588_vr_display_wait_for_commit().
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_wait_for_layer(struct rk3588_vr_display *vrd, u32 plane)
+{
+    struct rk3588_vr_layer *layer;
+    unsigned long flags;
+    u64 target;
+    long ret;
+
+    if (!vrd || !vrd->dev || plane >= RK3588_VR_MAX_PLANES)
+        return -EINVAL;
+
+    layer = &vrd->layers[plane];
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    target = layer->commit_seq;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    ret = wait_event_interruptible_timeout(layer->latch_wait,
+                                           READ_ONCE(layer->settled_seq) >= target,
+                                           msecs_to_jiffies(RK3588_VR_COMMIT_TIMEOUT_MS));
+    if (ret == 0)
+        return -ETIMEDOUT;
+    if (ret < 0)
+        return ret;
+
+    return 0;
+}
+
+/**
+ * rk3588_vr_display_get_layer_stats - Get commit timing of a plane
+ * @vrd: Pointer to the RK3588 VR display device structure
+ * @plane: Plane index
+ * @stats: Pointer to store the statistics
+ *
+ * Return: 0 on success, negative error code on failure
+ */
+int rk3588_vr_display_get_layer_stats(struct rk3588_vr_display *vrd, u32 plane,
+                                      struct rk3588_vr_layer_stats *stats)
+{
+    unsigned long flags;
+
+    if (!vrd || !vrd->dev || !stats || plane >= RK3588_VR_MAX_PLANES)
+        return -EINVAL;
+
+    spin_lock_irqsave(&vrd->lock, flags);
+    *stats = vrd->layers[plane].stats;
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    return 0;
+}
+
 /**
  * rk3588_vr_display_wait_for_vsync - Wait for vsync on the specified display
  * @vrd: Pointer to the RK3588 VR display device structure
@@ -1137,10 +2314,16 @@ static void rk3588_vr_display_handle_vsync(struct rk3588_vr_display *vrd, int di
     ktime_t now = ktime_get();
     ktime_t diff;
     u64 diff_us;
+    struct rk3588_vr_mesh_buffers *mb;
+    struct dma_fence *latched[RK3588_VR_MAX_PLANES];
+    unsigned long flags;
+    int back, i;
 
     if (!vrd || display_idx < 0 || display_idx >= RK3588_VR_MAX_DISPLAYS)
         return;
 
+    mb = &vrd->mesh[display_idx];
+
     /* Update frame counter */
     vrd->frame_counter[display_idx]++;
 
@@ -1156,6 +2339,54 @@ static void rk3588_vr_display_handle_vsync(struct rk3588_vr_display *vrd, int di
     /* Update last vsync time */
     vrd->last_vsync[display_idx] = now;
 
+    /* Swap in a pending distortion mesh, the old one is read until the next vsync */
+    spin_lock_irqsave(&vrd->lock, flags);
+    mb->retiring = false;
+    if (mb->pending) {
+        back = !mb->front;
+        writel((u32)mb->slot_dma[back], vrd->regs + RK3588_VOP_VR_MESH_ADDR(display_idx));
+        writel(mb->slot_size_reg[back], vrd->regs + RK3588_VOP_VR_MESH_SIZE(display_idx));
+        mb->front = back;
+        mb->pending = false;
+        mb->retiring = true;
+    }
+    rk3588_vr_display_latch_layers(vrd, display_idx, now, latched);
+    spin_unlock_irqrestore(&vrd->lock, flags);
+
+    /* Layers latched this frame are on screen, the buffers they replaced are free */
+    for (i = 0; i < RK3588_VR_MAX_PLANES; i++) {
+        if (!latched[i])
+            continue;
+        dma_fence_signal(latched[i]);
+        dma_fence_put(latched[i]);
+        wake_up(&vrd->layers[i].latch_wait);
+    }
+
+    /* Arm the late latch for the next scanout, or the slice chain of this one */
+    if (vrd->late_latch_enabled && vrd->vsync_period_us[display_idx] > vrd->late_latch_lead_us) {
+        struct rk3588_vr_late_latch *ll = &vrd->late_latch[display_idx];
+        u32 num_slices = vrd->num_slices;
+        ktime_t first;
+
+        spin_lock_irqsave(&vrd->lock, flags);
+        ll->scanout = ktime_add_us(now, vrd->vsync_period_us[display_idx]);
+        ll->chain_slices = num_slices;
+        if (num_slices) {
+            ll->chain_anchor = now;
+            ll->chain_frame = vrd->frame_counter[display_idx];
+            ll->chain_latch = 0;
+            ll->slice_period_ns = (u64)vrd->vsync_period_us[display_idx] * NSEC_PER_USEC / num_slices;
+            first = ktime_add_ns(now, ll->slice_period_ns);
+        } else {
+            first = ll->scanout;
+        }
+        spin_unlock_irqrestore(&vrd->lock, flags);
+
+        if (!num_slices || ll->slice_period_ns > (u64)vrd->late_latch_lead_us * NSEC_PER_USEC)
+            hrtimer_start(&ll->timer, ktime_sub_us(first, vrd->late_latch_lead_us),
+                          HRTIMER_MODE_ABS_HARD);
+    }
+
     /* Signal vsync completion */
     complete(&vrd->vsync_completion[display_idx]);
 }
@@ -1188,6 +2419,21 @@ static void rk3588_vr_display_handle_commit(struct rk3588_vr_display *vrd, int d
     /* Update last commit time */
     vrd->last_commit[display_idx] = now;
 
+    /* The committed frame was rendered with the render pose posted for it */
+    if (vrd->late_latch_enabled && vrd->late_latch_page) {
+        struct rk3588_vr_late_latch *ll = &vrd->late_latch[display_idx];
+        struct rk3588_vr_late_latch_pose render = {};
+        bool valid;
+        unsigned long flags;
+
+        valid = rk3588_vr_display_read_pose(&vrd->late_latch_page->render[display_idx], &render);
+
+        spin_lock_irqsave(&vrd->lock, flags);
+        ll->render = render;
+        ll->render_valid = valid;
+        spin_unlock_irqrestore(&vrd->lock, flags);
+    }
+
     /* Signal commit completion */
     complete(&vrd->commit_completion[display_idx]);
 }
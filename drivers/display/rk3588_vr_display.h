@@ -29,6 +29,15 @@
 #include <linux/kthread.h>
 #include <linux/completion.h>
 #include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-fence.h>
+#include <linux/file.h>
+#include <linux/sync_file.h>
+#include <linux/mutex.h>
 
 #include <drm/drm_atomic.h>
 #include <drm/drm_atomic_helper.h>
@@ -57,6 +66,15 @@
 #define RK3588_VR_TARGET_VREFRESH       90
 #define RK3588_VR_LOW_PERSISTENCE_DUTY  70  /* 70% duty cycle for low persistence */
 #define RK3588_VR_MAX_LATENCY_US        5000 /* 5ms max motion-to-photon latency */
+#define RK3588_VR_LATE_LATCH_LEAD_US    300  /* Warp programmed this long before scanout */
+#define RK3588_VR_LATE_LATCH_RETRIES    4    /* Seqlock reads of the pose page per latch */
+#define RK3588_VR_MAX_SLICES            8    /* Beam-racing slices per scanout */
+#define RK3588_VR_SLICE_EVENT_DEPTH     16
+#define RK3588_VR_MESH_MIN_DIM          2    /* Vertices per side of a distortion mesh */
+#define RK3588_VR_MESH_MAX_DIM          65
+#define RK3588_VR_MESH_MAGIC            0x4853454D /* "MESH" */
+#define RK3588_VR_MAX_SCANOUT_BUFS      16   /* Imported DMA-BUFs, both eyes' swapchains */
+#define RK3588_VR_COMMIT_TIMEOUT_MS     100
 
 /* Display controller registers */
 #define RK3588_VOP_SYS_CTRL             0x0000
@@ -98,6 +116,12 @@
 #define RK3588_VOP_VR_MOTION_VECTOR     0x0140
 #define RK3588_VOP_VR_ASYNC_COMMIT      0x0148
 #define RK3588_VOP_VR_DIRECT_MODE       0x0150
+#define RK3588_VOP_VR_WARP_CTRL         0x0158
+#define RK3588_VOP_VR_WARP_MATRIX(d, n) (0x0160 + (d) * 0x40 + (n) * 4) /* 3x3, Q16.16 */
+#define RK3588_VOP_VR_SLICE_CTRL        0x01E0
+#define RK3588_VOP_VR_SLICE_COMMIT      0x01E8
+#define RK3588_VOP_VR_MESH_ADDR(d)      (0x01F0 + (d) * 0x10)
+#define RK3588_VOP_VR_MESH_SIZE(d)      (0x01F8 + (d) * 0x10)
 
 /* Plane registers (per plane) */
 #define RK3588_VOP_PLANE_CTRL(i)        (0x1000 + (i) * 0x100)
@@ -130,6 +154,14 @@
 #define RK3588_VOP_SYS_CTRL_AXI_OUTSTANDING_MAX(x) (((x) & 0xF) << 8)
 #define RK3588_VOP_SYS_CTRL_GLOBAL_REGDONE BIT(12)
 
+#define RK3588_VOP_PLANE_CTRL_EN        BIT(0)
+#define RK3588_VOP_PLANE_CTRL_FORMAT(x) (((x) & 0x1F) << 1)
+#define RK3588_VOP_PLANE_CTRL_PORT(d)   (((d) & 0x1) << 8)  /* Display the plane feeds */
+
+#define RK3588_VOP_PLANE_FMT_ARGB8888   0
+#define RK3588_VOP_PLANE_FMT_ABGR8888   1
+#define RK3588_VOP_PLANE_FMT_RGB565     2
+
 /* VR-specific register bit definitions */
 #define RK3588_VOP_VR_SYNC_CTRL_EN      BIT(0)
 #define RK3588_VOP_VR_SYNC_CTRL_MASTER  BIT(1)
@@ -170,6 +202,16 @@
 #define RK3588_VOP_VR_DIRECT_MODE_BYPASS BIT(1)
 #define RK3588_VOP_VR_DIRECT_MODE_FAST_PATH BIT(2)
 
+#define RK3588_VOP_VR_WARP_CTRL_EN(d)   BIT((d) * 8)
+#define RK3588_VOP_VR_WARP_CTRL_LOAD(d) BIT((d) * 8 + 1) /* Latched at the next frame or slice start */
+
+#define RK3588_VOP_VR_SLICE_CTRL_EN(d)  BIT((d) * 8)
+#define RK3588_VOP_VR_SLICE_CTRL_COUNT(d, x) (((x) & 0xF) << ((d) * 8 + 4))
+#define RK3588_VOP_VR_SLICE_COMMIT_BIT(d, k) BIT((d) * 16 + (k))
+
+#define RK3588_VOP_VR_MESH_SIZE_COLS(x) ((x) & 0x7F)
+#define RK3588_VOP_VR_MESH_SIZE_ROWS(x) (((x) & 0x7F) << 8)
+
 /* VR display operation modes */
 enum rk3588_vr_display_mode {
     RK3588_VR_MODE_NORMAL = 0,
@@ -232,6 +274,193 @@ struct rk3588_vr_display_config {
     u32 max_latency_us;
 };
 
+/*
+ * Late-latch pose, written by userspace into the page mapped with
+ * rk3588_vr_display_late_latch_mmap(). The writer makes sequence odd, fills
+ * the pose, then makes it even again; the driver retries while it is odd or
+ * changed across the read. Rotations are the Tcw quaternion of the head pose
+ * (w, x, y, z) in Q2.30, times are CLOCK_MONOTONIC nanoseconds.
+ */
+struct rk3588_vr_late_latch_pose {
+    __u32 sequence;
+    __u32 reserved;
+    __s64 display_time_ns;  /* Time the pose was predicted for */
+    __s32 rotation[4];
+};
+
+/* Driver feedback of the pose programmed for the last scanout */
+struct rk3588_vr_late_latch_status {
+    __u32 sequence;         /* Sequence of the latest pose used, 0 for identity */
+    __u32 latch_count;
+    __s64 display_time_ns;  /* Prediction time of that pose */
+    __s64 latch_time_ns;    /* Time the warp was programmed */
+    __s64 scanout_time_ns;  /* Expected start of the scanout it was programmed for */
+};
+
+/*
+ * Shared page layout. Userspace keeps latest updated with the pose predicted
+ * for the next scanout and writes render[d] with the pose a frame was rendered
+ * with before committing it, the driver takes its own copy of render[d] when
+ * the commit completes.
+ */
+struct rk3588_vr_late_latch_page {
+    struct rk3588_vr_late_latch_pose latest;
+    struct rk3588_vr_late_latch_pose render[RK3588_VR_MAX_DISPLAYS];
+    struct rk3588_vr_late_latch_status status[RK3588_VR_MAX_DISPLAYS];
+};
+
+/*
+ * Sparse distortion mesh, interpolated bilinearly by the VOP. cols x rows
+ * vertices span the width x height output, vertex (c, r) sits at output pixel
+ * (c * width / (cols - 1), r * height / (rows - 1)) and holds the offset of
+ * the source pixel sampled there for each colour channel, in 1/16 pixels, so
+ * one mesh carries both the lens distortion and the chromatic correction.
+ * Vertices follow the header row by row.
+ */
+struct rk3588_vr_mesh_header {
+    __u32 magic;            /* RK3588_VR_MESH_MAGIC */
+    __u16 cols;
+    __u16 rows;
+    __u16 width;
+    __u16 height;
+    __u32 reserved;
+};
+
+struct rk3588_vr_mesh_vertex {
+    __s16 red[2];           /* x, y */
+    __s16 green[2];
+    __s16 blue[2];
+};
+
+#define RK3588_VR_MESH_MAX_SIZE (sizeof(struct rk3588_vr_mesh_header) + \
+                                 RK3588_VR_MESH_MAX_DIM * RK3588_VR_MESH_MAX_DIM * \
+                                 sizeof(struct rk3588_vr_mesh_vertex))
+
+/* Double-buffered mesh of one display, swapped by the vsync handler */
+struct rk3588_vr_mesh_buffers {
+    void *slot[2];
+    dma_addr_t slot_dma[2];
+    u32 slot_size_reg[2];
+    int front;              /* Slot the VOP reads once the last swap latched */
+    bool pending;           /* Back slot holds a mesh to swap in on vsync */
+    bool retiring;          /* Last swap not latched yet, the old front is still read */
+};
+
+/* The slice before this one was not committed by its deadline */
+#define RK3588_VR_SLICE_EVENT_PREV_MISSED BIT(0)
+
+/* Beam-racing deadline of the slice to render next */
+struct rk3588_vr_slice_event {
+    __u64 frame;            /* Frame counter of the scanout the slice belongs to */
+    __u32 slice;
+    __u32 num_slices;
+    __s64 deadline_ns;      /* Latest rk3588_vr_display_commit_slice() still shown */
+    __s64 scanout_ns;       /* Time the raster reaches the slice, to predict the pose for */
+    __u32 flags;            /* RK3588_VR_SLICE_EVENT_* */
+    __u32 reserved;
+};
+
+/*
+ * Late-latch timer of one display, fired lead_us before its next vsync, or
+ * in beam racing before each slice of the scanout started by the last vsync.
+ */
+struct rk3588_vr_late_latch {
+    struct hrtimer timer;
+    struct rk3588_vr_display *vrd;
+    int display_idx;
+    ktime_t scanout;
+    struct rk3588_vr_late_latch_pose render;
+    bool render_valid;
+
+    /* Slice chain of the current scanout */
+    u32 chain_slices;
+    u32 chain_latch;
+    ktime_t chain_anchor;
+    u64 chain_frame;
+    u64 slice_period_ns;
+    u32 slice_committed;
+    u32 slice_render_valid;
+    struct rk3588_vr_late_latch_pose slice_render[RK3588_VR_MAX_SLICES];
+    u32 missed_slices;
+
+    struct rk3588_vr_slice_event events[RK3588_VR_SLICE_EVENT_DEPTH];
+    u32 event_head;
+    u32 event_tail;
+    wait_queue_head_t slice_wait;
+};
+
+/* Imported DMA-BUF scanned out in place */
+struct rk3588_vr_scanout_buf {
+    struct dma_buf *dmabuf;
+    struct dma_buf_attachment *attach;
+    struct sg_table *sgt;
+    dma_addr_t dma_addr;
+    size_t size;
+    u32 users;              /* Layers showing it or about to */
+};
+
+/*
+ * Layer commit. The buffer is shown on plane at (dst_x, dst_y) unscaled once
+ * in_fence_fd, the sync_file the GPU signals when rendering is done,
+ * signals; -1 shows it at the next vsync.
+ */
+struct rk3588_vr_layer_commit {
+    __u32 handle;           /* From rk3588_vr_display_import_dmabuf() */
+    __u32 plane;
+    __u32 format;           /* DRM_FORMAT_* */
+    __u32 width;
+    __u32 height;
+    __u32 pitch;            /* Bytes */
+    __u32 offset;           /* Bytes into the buffer */
+    __u16 dst_x;
+    __u16 dst_y;
+    __s32 in_fence_fd;
+    __u32 reserved;
+};
+
+/* Per-layer commit timing, the wait_for_commit latency split by layer */
+struct rk3588_vr_layer_stats {
+    __u64 commits;
+    __u64 latched;          /* Commits that reached the screen */
+    __u64 dropped;          /* Commits replaced before their vsync */
+    __u32 fence_wait_us;    /* Last commit to its in-fence signalling */
+    __u32 latch_wait_us;    /* Last in-fence signalling to the vsync that latched it */
+    __u32 commit_latency_us;        /* Last commit to latch */
+    __u32 commit_latency_avg_us;    /* Moving average, 1/8 */
+    __u32 commit_latency_max_us;
+    __u32 reserved;
+};
+
+/* Scanout state of one overlay plane */
+struct rk3588_vr_layer {
+    struct rk3588_vr_display *vrd;
+    int plane;
+    int display_idx;
+
+    /* Commit waiting for its in-fence */
+    struct rk3588_vr_layer_commit waiting;
+    struct dma_fence *in_fence;
+    struct dma_fence_cb in_cb;
+    struct dma_fence *waiting_out_fence;
+    ktime_t waiting_time;
+    bool fence_waiting;
+
+    /* Registers written, latched at the next vsync */
+    int programmed_buf;
+    struct dma_fence *programmed_out_fence;
+    ktime_t programmed_commit_time;
+    ktime_t programmed_time;
+    bool programmed;
+
+    int active_buf;         /* Buffer being scanned out, -1 for none */
+
+    u64 fence_seqno;
+    u64 commit_seq;
+    u64 settled_seq;        /* Commits latched or dropped */
+    wait_queue_head_t latch_wait;
+    struct rk3588_vr_layer_stats stats;
+};
+
 /* VR display device */
 struct rk3588_vr_display {
     struct drm_device *drm;
@@ -284,6 +513,21 @@ struct rk3588_vr_display {
     u32 commit_latency_us[RK3588_VR_MAX_DISPLAYS];
     u32 vsync_period_us[RK3588_VR_MAX_DISPLAYS];
     
+    struct rk3588_vr_late_latch_page *late_latch_page;
+    dma_addr_t late_latch_page_dma;
+    struct rk3588_vr_late_latch late_latch[RK3588_VR_MAX_DISPLAYS];
+    bool late_latch_enabled;
+    u32 late_latch_lead_us;
+    u32 num_slices;
+    
+    struct rk3588_vr_mesh_buffers mesh[RK3588_VR_MAX_DISPLAYS];
+    
+    struct rk3588_vr_scanout_buf scanout_bufs[RK3588_VR_MAX_SCANOUT_BUFS];
+    struct rk3588_vr_layer layers[RK3588_VR_MAX_PLANES];
+    struct mutex layer_mutex;
+    spinlock_t fence_lock;
+    u64 fence_context;      /* One timeline per plane from here */
+    
     spinlock_t lock;
 };
 
@@ -306,8 +550,28 @@ int rk3588_vr_display_set_bypass_options(struct rk3588_vr_display *vrd, bool ble
 
 int rk3588_vr_display_set_distortion_map(struct rk3588_vr_display *vrd, int display_idx, const void *map, size_t size);
 int rk3588_vr_display_set_chromatic_map(struct rk3588_vr_display *vrd, int display_idx, const void *map, size_t size);
+int rk3588_vr_display_set_distortion_mesh(struct rk3588_vr_display *vrd, int display_idx, const void *mesh, size_t size);
 int rk3588_vr_display_set_motion_vectors(struct rk3588_vr_display *vrd, const void *vectors, size_t size);
 
+int rk3588_vr_display_set_late_latch(struct rk3588_vr_display *vrd, bool enable, u32 lead_us);
+int rk3588_vr_display_late_latch_mmap(struct rk3588_vr_display *vrd, struct vm_area_struct *vma);
+void rk3588_vr_display_late_latch_apply(struct rk3588_vr_display *vrd, int display_idx, ktime_t scanout);
+
+int rk3588_vr_display_set_beam_racing(struct rk3588_vr_display *vrd, u32 num_slices);
+int rk3588_vr_display_commit_slice(struct rk3588_vr_display *vrd, int display_idx, u32 slice);
+int rk3588_vr_display_read_slice_event(struct rk3588_vr_display *vrd, int display_idx,
+                                       struct rk3588_vr_slice_event *ev, bool nonblock);
+__poll_t rk3588_vr_display_poll_slice_event(struct rk3588_vr_display *vrd, int display_idx,
+                                            struct file *file, poll_table *wait);
+
+int rk3588_vr_display_import_dmabuf(struct rk3588_vr_display *vrd, int fd, u32 *handle);
+int rk3588_vr_display_release_dmabuf(struct rk3588_vr_display *vrd, u32 handle);
+int rk3588_vr_display_commit_layer(struct rk3588_vr_display *vrd, int display_idx,
+                                   const struct rk3588_vr_layer_commit *commit, int *out_fence_fd);
+int rk3588_vr_display_wait_for_layer(struct rk3588_vr_display *vrd, u32 plane);
+int rk3588_vr_display_get_layer_stats(struct rk3588_vr_display *vrd, u32 plane,
+                                      struct rk3588_vr_layer_stats *stats);
+
 int rk3588_vr_display_wait_for_vsync(struct rk3588_vr_display *vrd, int display_idx);
 int rk3588_vr_display_wait_for_commit(struct rk3588_vr_display *vrd, int display_idx);
 
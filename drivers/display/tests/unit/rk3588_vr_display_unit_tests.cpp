@@ -517,6 +517,261 @@ TEST_F(RK3588VRDisplayUnitTest, BypassOptionsTest) {
     rk3588_vr_display_fini(vrd);
 }
 
+/* Test sparse distortion mesh upload */
+TEST_F(RK3588VRDisplayUnitTest, DistortionMeshTest) {
+    /* Initialize */
+    int ret = rk3588_vr_display_init(vrd);
+    EXPECT_EQ(ret, 0);
+    
+    /* 33x33 mesh spanning one eye */
+    std::vector<uint8_t> mesh(sizeof(struct rk3588_vr_mesh_header) +
+                              33 * 33 * sizeof(struct rk3588_vr_mesh_vertex));
+    struct rk3588_vr_mesh_header *hdr = (struct rk3588_vr_mesh_header*)mesh.data();
+    hdr->magic = RK3588_VR_MESH_MAGIC;
+    hdr->cols = 33;
+    hdr->rows = 33;
+    hdr->width = 1832;
+    hdr->height = 1920;
+    
+    ret = rk3588_vr_display_set_distortion_mesh(vrd, 0, mesh.data(), mesh.size());
+    EXPECT_EQ(ret, 0);
+    EXPECT_TRUE(vrd->mesh[0].pending);
+    EXPECT_NE(vrd->mesh[0].slot[0], nullptr);
+    EXPECT_NE(vrd->mesh[0].slot[1], nullptr);
+    
+    /* Written to the back buffer, the front one is untouched until vsync */
+    int back = !vrd->mesh[0].front;
+    EXPECT_EQ(memcmp(vrd->mesh[0].slot[back], mesh.data(), mesh.size()), 0);
+    EXPECT_EQ(vrd->mesh[0].slot_size_reg[back],
+              RK3588_VOP_VR_MESH_SIZE_COLS(33) | RK3588_VOP_VR_MESH_SIZE_ROWS(33));
+    EXPECT_EQ(*(u32*)(regs + RK3588_VOP_VR_MESH_ADDR(0)), 0u);
+    
+    /* Test a mesh still being latched */
+    vrd->mesh[0].retiring = true;
+    ret = rk3588_vr_display_set_distortion_mesh(vrd, 0, mesh.data(), mesh.size());
+    EXPECT_EQ(ret, -EBUSY);
+    vrd->mesh[0].retiring = false;
+    
+    /* Test invalid size */
+    ret = rk3588_vr_display_set_distortion_mesh(vrd, 0, mesh.data(), mesh.size() - 1);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Test invalid grid */
+    hdr->cols = RK3588_VR_MESH_MAX_DIM + 1;
+    ret = rk3588_vr_display_set_distortion_mesh(vrd, 0, mesh.data(), mesh.size());
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Test invalid magic */
+    hdr->cols = 33;
+    hdr->magic = 0;
+    ret = rk3588_vr_display_set_distortion_mesh(vrd, 1, mesh.data(), mesh.size());
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Finalize */
+    rk3588_vr_display_fini(vrd);
+}
+
+/* Test late-latch warp programming */
+TEST_F(RK3588VRDisplayUnitTest, LateLatchTest) {
+    /* Initialize */
+    int ret = rk3588_vr_display_init(vrd);
+    EXPECT_EQ(ret, 0);
+    
+    /* Test invalid lead, longer than a vsync period */
+    ret = rk3588_vr_display_set_late_latch(vrd, true, 20000);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Test enable with the default lead */
+    ret = rk3588_vr_display_set_late_latch(vrd, true, 0);
+    EXPECT_EQ(ret, 0);
+    EXPECT_TRUE(vrd->late_latch_enabled);
+    EXPECT_EQ(vrd->late_latch_lead_us, RK3588_VR_LATE_LATCH_LEAD_US);
+    ASSERT_NE(vrd->late_latch_page, nullptr);
+    
+    /* Rendered looking ahead, latest pose turned 90 degrees about y */
+    const s32 one = 1 << 30;
+    const s32 half_sqrt2 = 759250125;
+    const s64 scanout_ns = 1000000000LL;
+    
+    vrd->vsync_period_us[0] = 11111;
+    vrd->late_latch[0].render.sequence = 2;
+    vrd->late_latch[0].render.rotation[0] = one;
+    vrd->late_latch[0].render_valid = true;
+    
+    struct rk3588_vr_late_latch_pose *latest = &vrd->late_latch_page->latest;
+    latest->sequence = 4;
+    latest->display_time_ns = scanout_ns + 500000;
+    latest->rotation[0] = half_sqrt2;
+    latest->rotation[2] = half_sqrt2;
+    
+    rk3588_vr_display_late_latch_apply(vrd, 0, ns_to_ktime(scanout_ns));
+    
+    EXPECT_NEAR((s32)*(u32*)(regs + RK3588_VOP_VR_WARP_MATRIX(0, 0)), 0, 2);
+    EXPECT_NEAR((s32)*(u32*)(regs + RK3588_VOP_VR_WARP_MATRIX(0, 2)), -65536, 2);
+    EXPECT_NEAR((s32)*(u32*)(regs + RK3588_VOP_VR_WARP_MATRIX(0, 4)), 65536, 2);
+    EXPECT_NEAR((s32)*(u32*)(regs + RK3588_VOP_VR_WARP_MATRIX(0, 6)), 65536, 2);
+    EXPECT_NEAR((s32)*(u32*)(regs + RK3588_VOP_VR_WARP_MATRIX(0, 8)), 0, 2);
+    
+    u32 warp_ctrl = *(u32*)(regs + RK3588_VOP_VR_WARP_CTRL);
+    EXPECT_TRUE(warp_ctrl & RK3588_VOP_VR_WARP_CTRL_EN(0));
+    EXPECT_TRUE(warp_ctrl & RK3588_VOP_VR_WARP_CTRL_LOAD(0));
+    EXPECT_EQ(vrd->late_latch_page->status[0].sequence, 4u);
+    EXPECT_EQ(vrd->late_latch_page->status[0].latch_count, 1u);
+    
+    /* Test a pose predicted for another frame, shown as rendered */
+    latest->display_time_ns = scanout_ns + 50000000LL;
+    rk3588_vr_display_late_latch_apply(vrd, 0, ns_to_ktime(scanout_ns));
+    
+    EXPECT_EQ((s32)*(u32*)(regs + RK3588_VOP_VR_WARP_MATRIX(0, 0)), 65536);
+    EXPECT_EQ((s32)*(u32*)(regs + RK3588_VOP_VR_WARP_MATRIX(0, 2)), 0);
+    EXPECT_EQ(vrd->late_latch_page->status[0].sequence, 0u);
+    
+    /* Test a pose being written, skipped */
+    latest->sequence = 5;
+    latest->display_time_ns = scanout_ns;
+    rk3588_vr_display_late_latch_apply(vrd, 0, ns_to_ktime(scanout_ns));
+    EXPECT_EQ(vrd->late_latch_page->status[0].sequence, 0u);
+    
+    /* Test disable */
+    ret = rk3588_vr_display_set_late_latch(vrd, false, 0);
+    EXPECT_EQ(ret, 0);
+    EXPECT_FALSE(vrd->late_latch_enabled);
+    EXPECT_EQ(*(u32*)(regs + RK3588_VOP_VR_WARP_CTRL), 0u);
+    
+    /* Finalize */
+    rk3588_vr_display_fini(vrd);
+}
+
+/* Test beam-racing slice setup and commits */
+TEST_F(RK3588VRDisplayUnitTest, BeamRacingTest) {
+    /* Initialize */
+    int ret = rk3588_vr_display_init(vrd);
+    EXPECT_EQ(ret, 0);
+    
+    /* Test beam racing without the late latch */
+    ret = rk3588_vr_display_set_beam_racing(vrd, 4);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    ret = rk3588_vr_display_set_late_latch(vrd, true, 0);
+    EXPECT_EQ(ret, 0);
+    
+    /* Test invalid slice counts */
+    ret = rk3588_vr_display_set_beam_racing(vrd, RK3588_VR_MAX_SLICES + 1);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* 300 us lead does not fit a 11111 / 64 us slice */
+    ret = rk3588_vr_display_set_beam_racing(vrd, 64);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Test four slices */
+    ret = rk3588_vr_display_set_beam_racing(vrd, 4);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(vrd->num_slices, 4u);
+    
+    u32 slice_ctrl = *(u32*)(regs + RK3588_VOP_VR_SLICE_CTRL);
+    EXPECT_TRUE(slice_ctrl & RK3588_VOP_VR_SLICE_CTRL_EN(0));
+    EXPECT_TRUE(slice_ctrl & RK3588_VOP_VR_SLICE_CTRL_EN(1));
+    EXPECT_EQ((slice_ctrl >> 4) & 0xF, 4u);
+    
+    /* Test slice commit with a render pose */
+    struct rk3588_vr_late_latch_pose *render = &vrd->late_latch_page->render[1];
+    render->sequence = 2;
+    render->rotation[0] = 1 << 30;
+    
+    ret = rk3588_vr_display_commit_slice(vrd, 1, 2);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(*(u32*)(regs + RK3588_VOP_VR_SLICE_COMMIT), RK3588_VOP_VR_SLICE_COMMIT_BIT(1, 2));
+    EXPECT_TRUE(vrd->late_latch[1].slice_committed & BIT(2));
+    EXPECT_TRUE(vrd->late_latch[1].slice_render_valid & BIT(2));
+    EXPECT_EQ(vrd->late_latch[1].slice_render[2].rotation[0], 1 << 30);
+    
+    /* Test invalid slice */
+    ret = rk3588_vr_display_commit_slice(vrd, 1, 4);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* No deadline announced before the first vsync */
+    struct rk3588_vr_slice_event ev;
+    ret = rk3588_vr_display_read_slice_event(vrd, 0, &ev, true);
+    EXPECT_EQ(ret, -EAGAIN);
+    
+    /* Test disable */
+    ret = rk3588_vr_display_set_beam_racing(vrd, 0);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(*(u32*)(regs + RK3588_VOP_VR_SLICE_CTRL), 0u);
+    
+    ret = rk3588_vr_display_commit_slice(vrd, 1, 0);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Finalize */
+    rk3588_vr_display_fini(vrd);
+}
+
+/* Test scanout layer argument checks and statistics */
+TEST_F(RK3588VRDisplayUnitTest, LayerCommitTest) {
+    /* Initialize */
+    int ret = rk3588_vr_display_init(vrd);
+    EXPECT_EQ(ret, 0);
+    
+    /* No commits yet */
+    struct rk3588_vr_layer_stats stats;
+    ret = rk3588_vr_display_get_layer_stats(vrd, 0, &stats);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(stats.commits, 0u);
+    EXPECT_EQ(stats.commit_latency_max_us, 0u);
+    EXPECT_EQ(vrd->layers[0].active_buf, -1);
+    
+    ret = rk3588_vr_display_get_layer_stats(vrd, RK3588_VR_MAX_PLANES, &stats);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Test commit of a buffer that was never imported */
+    struct rk3588_vr_layer_commit commit = {};
+    commit.handle = 1;
+    commit.format = DRM_FORMAT_ARGB8888;
+    commit.width = 64;
+    commit.height = 64;
+    commit.pitch = 64 * 4;
+    commit.in_fence_fd = -1;
+    ret = rk3588_vr_display_commit_layer(vrd, 0, &commit, NULL);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Test invalid plane, format and pitch */
+    commit.plane = RK3588_VR_MAX_PLANES;
+    ret = rk3588_vr_display_commit_layer(vrd, 0, &commit, NULL);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    commit.plane = 0;
+    commit.format = DRM_FORMAT_NV12;
+    ret = rk3588_vr_display_commit_layer(vrd, 0, &commit, NULL);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    commit.format = DRM_FORMAT_ARGB8888;
+    commit.pitch = 64;
+    ret = rk3588_vr_display_commit_layer(vrd, 0, &commit, NULL);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Test invalid display and handles */
+    commit.pitch = 64 * 4;
+    ret = rk3588_vr_display_commit_layer(vrd, 2, &commit, NULL);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    ret = rk3588_vr_display_release_dmabuf(vrd, 1);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    ret = rk3588_vr_display_release_dmabuf(vrd, 0);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Nothing committed, nothing to wait for */
+    ret = rk3588_vr_display_wait_for_layer(vrd, 0);
+    EXPECT_EQ(ret, 0);
+    
+    /* Planes stay disabled */
+    EXPECT_EQ(*(u32*)(regs + RK3588_VOP_PLANE_CTRL(0)), 0u);
+    EXPECT_EQ(vrd->layers[0].stats.commits, 0u);
+    
+    /* Finalize */
+    rk3588_vr_display_fini(vrd);
+}
+
 /* Test enable/disable */
 TEST_F(RK3588VRDisplayUnitTest, EnableDisableTest) {
     /* Initialize */
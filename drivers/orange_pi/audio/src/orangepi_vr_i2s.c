@@ -18,6 +18,7 @@
 #include <linux/reset.h>
 #include <linux/dmaengine.h>
 #include <sound/soc.h>
+#include <sound/dmaengine_pcm.h>
 #include <sound/pcm_params.h>
 
 #include "orangepi_vr_i2s.h"
@@ -179,6 +180,28 @@ static int orangepi_vr_i2s_runtime_resume(struct device *dev)
     return 0;
 }
 
+static int orangepi_vr_i2s_startup(struct snd_pcm_substream *substream,
+                                 struct snd_soc_dai *dai)
+{
+    struct orangepi_vr_i2s_dev *i2s = snd_soc_dai_get_drvdata(dai);
+    struct snd_dmaengine_dai_dma_data *dma_data;
+    int ret;
+
+    dma_data = substream->stream == SNDRV_PCM_STREAM_PLAYBACK ?
+               &i2s->playback_dma_data : &i2s->capture_dma_data;
+
+    /* Periods of whole DMA bursts, the small low-latency periods included */
+    ret = snd_pcm_hw_constraint_step(substream->runtime, 0,
+                                     SNDRV_PCM_HW_PARAM_PERIOD_BYTES,
+                                     dma_data->maxburst * dma_data->addr_width);
+    if (ret < 0)
+        return ret;
+
+    return snd_pcm_hw_constraint_step(substream->runtime, 0,
+                                      SNDRV_PCM_HW_PARAM_BUFFER_BYTES,
+                                      dma_data->maxburst * dma_data->addr_width);
+}
+
 static int orangepi_vr_i2s_hw_params(struct snd_pcm_substream *substream,
                                    struct snd_pcm_hw_params *params,
                                    struct snd_soc_dai *dai)
@@ -401,12 +424,40 @@ static int orangepi_vr_i2s_dai_probe(struct snd_soc_dai *dai)
 }
 
 static const struct snd_soc_dai_ops orangepi_vr_i2s_dai_ops = {
+    .startup = orangepi_vr_i2s_startup,
     .hw_params = orangepi_vr_i2s_hw_params,
     .trigger = orangepi_vr_i2s_trigger,
     .set_fmt = orangepi_vr_i2s_set_fmt,
     .set_sysclk = orangepi_vr_i2s_set_sysclk,
 };
 
+/*
+ * mmap'd DMA ring without period wakeups: the cyclic transfer runs without
+ * interrupts when the stream asks for none, and the PL330 reports its
+ * residue per burst, so the pointer is exact whenever userspace reads it.
+ * Periods go down to one DMA burst. No PAUSE/RESUME, the PL330 cannot
+ * resume a paused transfer.
+ */
+static const struct snd_pcm_hardware orangepi_vr_i2s_pcm_hardware = {
+    .info = SNDRV_PCM_INFO_MMAP |
+            SNDRV_PCM_INFO_MMAP_VALID |
+            SNDRV_PCM_INFO_INTERLEAVED |
+            SNDRV_PCM_INFO_BLOCK_TRANSFER |
+            SNDRV_PCM_INFO_NO_PERIOD_WAKEUP,
+    .buffer_bytes_max = VR_PCM_BUFFER_BYTES_MAX,
+    .period_bytes_min = 32,
+    .period_bytes_max = VR_PCM_BUFFER_BYTES_MAX / 2,
+    .periods_min = 2,
+    .periods_max = 256,
+    .fifo_size = 32,
+};
+
+static const struct snd_dmaengine_pcm_config orangepi_vr_i2s_dmaengine_config = {
+    .pcm_hardware = &orangepi_vr_i2s_pcm_hardware,
+    .prepare_slave_config = snd_dmaengine_pcm_prepare_slave_config,
+    .prealloc_buffer_size = VR_PCM_BUFFER_BYTES_MAX,
+};
+
 static const struct snd_soc_component_driver orangepi_vr_i2s_component = {
     .name = "orangepi-vr-i2s",
 };
@@ -554,7 +605,7 @@ static int orangepi_vr_i2s_probe(struct platform_device *pdev)
     }
 
     /* Register PCM */
-    ret = devm_snd_dmaengine_pcm_register(&pdev->dev, NULL, 0);
+    ret = devm_snd_dmaengine_pcm_register(&pdev->dev, &orangepi_vr_i2s_dmaengine_config, 0);
     if (ret) {
         dev_err(&pdev->dev, "Failed to register PCM: %d\n", ret);
         goto err_pm_disable;
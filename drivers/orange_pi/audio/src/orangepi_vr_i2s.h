@@ -23,6 +23,17 @@
 #define VR_DEFAULT_CHANNELS       2
 #define VR_DEFAULT_FORMAT         SNDRV_PCM_FORMAT_S16_LE
 
+/*
+ * Low-latency periods. Streams that open with SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP
+ * get no period interrupts: a real-time render thread writes the mmap'd DMA ring
+ * on its own timer and reads the position from the DMA residue.
+ */
+#define VR_LOW_LATENCY_PERIOD_US     1000   /* Default largest period, vr,period-us */
+#define VR_LOW_LATENCY_PERIOD_US_MIN 250
+#define VR_LOW_LATENCY_PERIOD_US_MAX 2000
+#define VR_LOW_LATENCY_PERIODS_MAX   4
+#define VR_PCM_BUFFER_BYTES_MAX      (128 * 1024)
+
 struct orangepi_vr_i2s_dev {
     struct device *dev;
     struct regmap *regmap;
@@ -30,6 +30,7 @@ struct orangepi_vr_card_data {
     bool vr_low_latency_mode;
     bool vr_beamforming_enabled;
     bool vr_spatial_audio_enabled;
+    unsigned int vr_period_us;          /* Largest period in low-latency mode */
     
     int playback_channels;
     int capture_channels;
@@ -82,15 +83,15 @@ static int orangepi_vr_card_startup(struct snd_pcm_substream *substream)
 
     /* Configure constraints based on VR mode */
     if (priv->vr_low_latency_mode) {
-        /* Limit buffer size for low latency */
+        /* Sub-2 ms periods, a few of them per buffer */
         snd_pcm_hw_constraint_minmax(substream->runtime,
-                                    SNDRV_PCM_HW_PARAM_BUFFER_SIZE,
-                                    1024, 4096);
-        
-        /* Limit period size for low latency */
+                                    SNDRV_PCM_HW_PARAM_PERIOD_TIME,
+                                    VR_LOW_LATENCY_PERIOD_US_MIN,
+                                    priv->vr_period_us);
+
         snd_pcm_hw_constraint_minmax(substream->runtime,
-                                    SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
-                                    256, 1024);
+                                    SNDRV_PCM_HW_PARAM_PERIODS,
+                                    2, VR_LOW_LATENCY_PERIODS_MAX);
     }
 
     return 0;
@@ -192,6 +193,12 @@ static int orangepi_vr_machine_probe(struct platform_device *pdev)
     priv->vr_beamforming_enabled = of_property_read_bool(np, "vr,beamforming-enabled");
     priv->vr_spatial_audio_enabled = of_property_read_bool(np, "vr,spatial-audio-enabled");
 
+    priv->vr_period_us = VR_LOW_LATENCY_PERIOD_US;
+    of_property_read_u32(np, "vr,period-us", &priv->vr_period_us);
+    priv->vr_period_us = clamp_t(unsigned int, priv->vr_period_us,
+                                 VR_LOW_LATENCY_PERIOD_US_MIN,
+                                 VR_LOW_LATENCY_PERIOD_US_MAX);
+
     /* Get channel configuration */
     of_property_read_u32(np, "orangepi,playback-channels", &priv->playback_channels);
     of_property_read_u32(np, "orangepi,capture-channels", &priv->capture_channels);
@@ -239,7 +246,8 @@ static int orangepi_vr_machine_probe(struct platform_device *pdev)
 
     dev_info(&pdev->dev, "Orange Pi CM5 VR Audio Card registered\n");
     if (priv->vr_low_latency_mode)
-        dev_info(&pdev->dev, "VR low-latency mode enabled\n");
+        dev_info(&pdev->dev, "VR low-latency mode enabled, periods up to %u us\n",
+                 priv->vr_period_us);
     if (priv->vr_beamforming_enabled)
         dev_info(&pdev->dev, "VR beamforming enabled\n");
     if (priv->vr_spatial_audio_enabled)
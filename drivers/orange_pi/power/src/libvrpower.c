@@ -18,6 +18,7 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <pthread.h>
 #include <signal.h>
 
@@ -26,12 +27,16 @@
 
 #define DEVICE_PATH "/dev/orangepi-vr-power"
 #define MAX_CALLBACKS 10
+#define STATE_READ_RETRIES 100
 
 /* Global variables */
 static int g_fd = -1;
 static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
 static int g_initialized = 0;
 
+/* State page of the driver, NULL if it could not be mapped */
+static const struct vr_power_state_page *g_state_page = NULL;
+
 /* Callback arrays */
 static vr_power_profile_callback_t g_profile_callbacks[MAX_CALLBACKS];
 static vr_battery_callback_t g_battery_callbacks[MAX_CALLBACKS];
@@ -95,7 +100,17 @@ int vr_power_init(void)
     g_battery_status.time_to_empty = battery.time_to_empty;
     g_battery_status.time_to_full = battery.time_to_full;
     
-    /* TODO: Get thermal status when kernel API is available */
+    /* Map the state page, older drivers without one leave it NULL */
+    void *page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, g_fd, 0);
+    if (page != MAP_FAILED) {
+        const struct vr_power_state_page *state = page;
+        
+        if (state->magic == VR_POWER_STATE_MAGIC && state->version == VR_POWER_STATE_VERSION) {
+            __atomic_store_n(&g_state_page, state, __ATOMIC_RELEASE);
+        } else {
+            munmap(page, sysconf(_SC_PAGESIZE));
+        }
+    }
     
     g_initialized = 1;
     pthread_mutex_unlock(&g_lock);
@@ -113,6 +128,11 @@ void vr_power_cleanup(void)
         return;
     }
     
+    if (g_state_page) {
+        munmap((void *)g_state_page, sysconf(_SC_PAGESIZE));
+        __atomic_store_n(&g_state_page, NULL, __ATOMIC_RELEASE);
+    }
+    
     if (g_fd >= 0) {
         close(g_fd);
         g_fd = -1;
@@ -442,8 +462,12 @@ int vr_power_get_thermal_status(vr_thermal_status_info_t *status)
         return -EINVAL;
     }
     
-    /* TODO: Implement when kernel API is available */
-    /* For now, just return the cached status */
+    /* Without a state page, return the cached status */
+    vr_power_state_info_t state;
+    if (vr_power_read_state(&state) == 0) {
+        memcpy(g_thermal_status.status, state.thermal_status, sizeof(g_thermal_status.status));
+        memcpy(g_thermal_status.temperature, state.temperature, sizeof(g_thermal_status.temperature));
+    }
     *status = g_thermal_status;
     
     pthread_mutex_unlock(&g_lock);
@@ -510,3 +534,61 @@ int vr_power_unregister_thermal_callback(vr_thermal_callback_t callback)
     
     return -ENOENT;
 }
+
+/* Read the power state from the mapped state page */
+int vr_power_read_state(vr_power_state_info_t *state)
+{
+    const struct vr_power_state_page *page = __atomic_load_n(&g_state_page, __ATOMIC_ACQUIRE);
+    struct vr_power_state_page copy;
+    uint32_t seq;
+    int i, retry;
+    
+    if (!state) {
+        return -EINVAL;
+    }
+    
+    if (!page) {
+        return -ENODEV;
+    }
+    
+    /* The driver holds seq odd while it rewrites the page, copy between two equal even reads */
+    for (retry = 0; retry < STATE_READ_RETRIES; retry++) {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        
+        memcpy(&copy, page, sizeof(copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) != seq) {
+            continue;
+        }
+        
+        /* Convert kernel structure to library structure */
+        state->seq = seq;
+        state->update_ns = copy.update_ns;
+        for (i = 0; i < VR_THERMAL_ZONE_COUNT; i++) {
+            state->temperature[i] = copy.temperature[i];
+            state->thermal_status[i] = copy.thermal_status[i];
+        }
+        state->throttle_mask = copy.throttle_mask;
+        state->profile = copy.profile;
+        state->governor_enabled = copy.governor_enabled;
+        state->cpu_freq_min = copy.cpu_freq_min;
+        state->cpu_freq_max = copy.cpu_freq_max;
+        state->gpu_freq_min = copy.gpu_freq_min;
+        state->gpu_freq_max = copy.gpu_freq_max;
+        state->npu_freq_min = copy.npu_freq_min;
+        state->npu_freq_max = copy.npu_freq_max;
+        state->battery_status = copy.battery_status;
+        state->battery_capacity = copy.battery_capacity;
+        state->battery_voltage = copy.battery_voltage;
+        state->battery_current = copy.battery_current;
+        state->battery_power = copy.battery_power;
+        
+        return 0;
+    }
+    
+    return -EAGAIN;
+}
@@ -107,6 +107,34 @@ typedef struct {
     int32_t temperature[VR_THERMAL_ZONE_COUNT];     /* 0.1°C */
 } vr_thermal_status_info_t;
 
+/* Power state snapshot, read from the state page the driver maps */
+typedef struct {
+    uint32_t seq;                                   /* Changes on every driver update */
+    uint64_t update_ns;                             /* CLOCK_MONOTONIC of the update */
+    
+    /* Thermal */
+    int32_t temperature[VR_THERMAL_ZONE_COUNT];     /* 0.1°C */
+    vr_thermal_status_t thermal_status[VR_THERMAL_ZONE_COUNT];
+    uint32_t throttle_mask;                         /* Bit per vr_thermal_zone_t above normal */
+    
+    /* Operating points, the applied clock ranges (kHz) */
+    vr_power_profile_t profile;
+    bool governor_enabled;
+    uint32_t cpu_freq_min;
+    uint32_t cpu_freq_max;
+    uint32_t gpu_freq_min;
+    uint32_t gpu_freq_max;
+    uint32_t npu_freq_min;
+    uint32_t npu_freq_max;
+    
+    /* Battery */
+    vr_battery_status_type_t battery_status;
+    uint32_t battery_capacity;                      /* 0-100% */
+    uint32_t battery_voltage;                       /* mV */
+    int32_t battery_current;                        /* mA (positive = charging, negative = discharging) */
+    int32_t battery_power;                          /* mW, same sign as the current */
+} vr_power_state_info_t;
+
 /* Callback function types */
 typedef void (*vr_power_profile_callback_t)(vr_power_profile_t profile);
 typedef void (*vr_battery_callback_t)(const vr_battery_status_info_t *status);
@@ -227,6 +255,22 @@ int vr_power_register_thermal_callback(vr_thermal_callback_t callback);
  */
 int vr_power_unregister_thermal_callback(vr_thermal_callback_t callback);
 
+/*
+ * State page API
+ */
+
+/**
+ * Read the power state from the page mapped by vr_power_init().
+ *
+ * Lock-free and without a system call, for callers polling at the frame
+ * rate. Safe from any thread between vr_power_init() and vr_power_cleanup().
+ *
+ * @param state Pointer to a vr_power_state_info_t structure to fill
+ * @return 0 on success, -ENODEV if the driver has no state page, -EAGAIN if
+ *         the driver kept rewriting it
+ */
+int vr_power_read_state(vr_power_state_info_t *state);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,9 @@
 #include <linux/fs.h>
 #include <linux/miscdevice.h>
 #include <linux/uaccess.h>
+#include <linux/jiffies.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
 
 #include "orangepi_vr_power.h"
 
@@ -119,6 +122,7 @@ static enum power_supply_property vr_charger_props[] = {
 static int vr_power_open(struct inode *inode, struct file *file);
 static int vr_power_release(struct inode *inode, struct file *file);
 static long vr_power_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+static int vr_power_mmap(struct file *file, struct vm_area_struct *vma);
 
 /* File operations for the device */
 static const struct file_operations vr_power_fops = {
@@ -126,6 +130,7 @@ static const struct file_operations vr_power_fops = {
     .open = vr_power_open,
     .release = vr_power_release,
     .unlocked_ioctl = vr_power_ioctl,
+    .mmap = vr_power_mmap,
 };
 
 /* Miscdevice for the driver */
@@ -135,6 +140,9 @@ static struct miscdevice vr_power_miscdev = {
     .fops = &vr_power_fops,
 };
 
+/* State page of the device behind vr_power_miscdev, for mmap */
+static struct vr_power_state_page *vr_power_shared_state;
+
 /* Battery power supply operations */
 static int vr_battery_get_property(struct power_supply *psy,
                                   enum power_supply_property psp,
@@ -348,6 +356,16 @@ static long vr_power_ioctl(struct file *file, unsigned int cmd, unsigned long ar
                 ret = -EFAULT;
         }
         break;
+    case VR_POWER_IOCTL_SET_TELEMETRY:
+        {
+            struct vr_pipeline_telemetry telemetry;
+            if (copy_from_user(&telemetry, argp, sizeof(telemetry))) {
+                ret = -EFAULT;
+                break;
+            }
+            ret = vr_power_governor_update(data, &telemetry);
+        }
+        break;
     default:
         ret = -ENOTTY;
         break;
@@ -357,6 +375,82 @@ static long vr_power_ioctl(struct file *file, unsigned int cmd, unsigned long ar
     return ret;
 }
 
+/*
+ * Map the state page read-only. The mapping holds its own reference on the
+ * page, so it stays valid after the device is unbound.
+ */
+static int vr_power_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct vr_power_state_page *state = READ_ONCE(vr_power_shared_state);
+
+    if (!state)
+        return -ENODEV;
+
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+        return -EINVAL;
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+    vma->vm_flags &= ~VM_MAYWRITE;
+
+    return vm_insert_page(vma, vma->vm_start, virt_to_page(state));
+}
+
+/**
+ * vr_power_publish_state - Rewrite the mapped state page
+ * @data: Driver data, lock held
+ *
+ * Called after every change of the thermal, battery or clock state. seq is
+ * odd while the fields are rewritten, the barriers order the fields against
+ * it for readers on other cores.
+ */
+void vr_power_publish_state(struct vr_power_data *data)
+{
+    struct vr_power_state_page *state = data->state_page;
+    const struct vr_dvfs_governor *gov = &data->governor;
+    const struct vr_power_profile *profile = &data->current_profile;
+    const struct vr_battery_status *battery = &data->battery_status;
+    bool cpu_governed = gov->enabled && gov->cpu_cap;
+    bool npu_governed = gov->enabled && gov->npu_cap;
+    u32 throttle = 0;
+    int i;
+    
+    if (!state)
+        return;
+    
+    WRITE_ONCE(state->seq, state->seq + 1);
+    smp_wmb();
+    
+    for (i = 0; i < VR_THERMAL_ZONE_COUNT; i++) {
+        state->temperature[i] = data->thermal_status.temperature[i];
+        state->thermal_status[i] = data->thermal_status.status[i];
+        if (data->thermal_status.status[i] != VR_THERMAL_STATUS_NORMAL)
+            throttle |= BIT(i);
+    }
+    state->throttle_mask = throttle;
+    
+    state->profile = profile->type;
+    state->governor_enabled = gov->enabled;
+    state->cpu_freq_min = cpu_governed ? gov->cpu_freq : profile->cpu_freq_min;
+    state->cpu_freq_max = cpu_governed ? gov->cpu_cap : profile->cpu_freq_max;
+    state->gpu_freq_min = profile->gpu_freq_min;
+    state->gpu_freq_max = profile->gpu_freq_max;
+    state->npu_freq_min = npu_governed ? gov->npu_freq : profile->npu_freq_min;
+    state->npu_freq_max = npu_governed ? gov->npu_cap : profile->npu_freq_max;
+    
+    state->battery_status = battery->status;
+    state->battery_capacity = battery->capacity;
+    state->battery_voltage = battery->voltage;
+    state->battery_current = battery->current;
+    state->battery_power = div_s64((s64)battery->voltage * battery->current, 1000);
+    
+    state->update_ns = ktime_get_ns();
+    
+    smp_wmb();
+    WRITE_ONCE(state->seq, state->seq + 1);
+}
+
 /* Initialize battery management */
 int vr_power_init_battery(struct vr_power_data *data)
 {
@@ -437,6 +531,8 @@ int vr_power_update_battery_status(struct vr_power_data *data)
         data->battery_status.time_to_full = 0;
     }
     
+    vr_power_publish_state(data);
+    
     mutex_unlock(&data->lock);
     
     /* Notify power supply change */
@@ -528,6 +624,12 @@ int vr_power_update_thermal_status(struct vr_power_data *data)
         }
     }
     
+    /* Pull the governed clocks under the new thermal caps */
+    if (throttling_changed && data->governor.enabled)
+        vr_power_governor_apply(data);
+    
+    vr_power_publish_state(data);
+    
     mutex_unlock(&data->lock);
     
     return 0;
@@ -601,9 +703,17 @@ int vr_power_set_profile(struct vr_power_data *data, struct vr_power_profile *pr
     
     /* In a real driver, we would also apply display and other settings */
     
+    /* The profile ranges were just applied, govern within them again */
+    if (data->governor.enabled) {
+        data->governor.cpu_cap = 0;
+        data->governor.npu_cap = 0;
+        vr_power_governor_apply(data);
+    }
+    
     dev_info(data->dev, "Power profile set to %d\n", profile->type);
     
 out:
+    vr_power_publish_state(data);
     mutex_unlock(&data->lock);
     return ret;
 }
@@ -624,6 +734,12 @@ int vr_power_init_dvfs(struct vr_power_data *data)
     /* In a real driver, this would initialize regulators and clocks */
     /* For now, we'll just simulate DVFS */
     
+    /* Govern from the first telemetry report on */
+    mutex_lock(&data->lock);
+    memset(&data->governor, 0, sizeof(data->governor));
+    data->governor.enabled = true;
+    mutex_unlock(&data->lock);
+    
     return 0;
 }
 
@@ -666,6 +782,178 @@ int vr_power_set_npu_freq(struct vr_power_data *data, unsigned int min, unsigned
     return 0;
 }
 
+/* Ceiling of a clock range under the thermal status of its zone */
+static unsigned int vr_dvfs_thermal_cap(enum vr_thermal_status status,
+                                        unsigned int min, unsigned int max)
+{
+    switch (status) {
+    case VR_THERMAL_STATUS_NORMAL:
+        return max;
+    case VR_THERMAL_STATUS_WARNING:
+        return min + (max - min) * 3 / 4;
+    case VR_THERMAL_STATUS_CRITICAL:
+        return min + (max - min) / 4;
+    default:
+        return min;
+    }
+}
+
+/* Clock a stage needs to fill the frame period, from its time at the clock it ran at */
+static unsigned int vr_dvfs_demand(unsigned int stage_us, unsigned int period_us,
+                                   unsigned int freq)
+{
+    u64 demand = div_u64((u64)freq * stage_us, period_us);
+    
+    return min_t(u64, demand, UINT_MAX);
+}
+
+/* Follow a rising demand at once, let a falling one decay by 1/8 per frame */
+static unsigned int vr_dvfs_smooth(unsigned int avg, unsigned int sample)
+{
+    if (sample >= avg)
+        return sample;
+    
+    return avg - (avg - sample) / 8;
+}
+
+/* Floor that keeps the stage at the target share of the frame period */
+static unsigned int vr_dvfs_floor(unsigned int demand, unsigned int min, unsigned int cap)
+{
+    u64 freq = DIV_ROUND_UP_ULL((u64)demand * 1000, VR_DVFS_TARGET_LOAD);
+    
+    freq = DIV_ROUND_UP_ULL(freq, VR_DVFS_FREQ_STEP) * VR_DVFS_FREQ_STEP;
+    
+    return clamp_t(u64, freq, min, max(min, cap));
+}
+
+/**
+ * vr_power_governor_update - Feed the governor the timing of one frame
+ * @data: Driver data, lock held
+ * @telemetry: Stage times of the last frame and the load hints for the next
+ *
+ * The demand of each stage is the clock at which it would take the whole
+ * frame period, estimated from the floor it ran at. A load hint holds both
+ * clocks at their thermal cap for VR_DVFS_BOOST_MS so keyframe insertion or
+ * loop closure does not start behind a low clock.
+ *
+ * Return: 0 on success, -EINVAL without a frame period
+ */
+int vr_power_governor_update(struct vr_power_data *data,
+                             const struct vr_pipeline_telemetry *telemetry)
+{
+    struct vr_dvfs_governor *gov = &data->governor;
+    const struct vr_power_profile *profile = &data->current_profile;
+    unsigned int cpu_freq, npu_freq;
+    
+    if (!telemetry->frame_period_us)
+        return -EINVAL;
+    
+    /* Until the governor applied a floor, assume the stages ran at the profile maximum */
+    cpu_freq = gov->cpu_freq ? gov->cpu_freq : profile->cpu_freq_max;
+    npu_freq = gov->npu_freq ? gov->npu_freq : profile->npu_freq_max;
+    
+    gov->cpu_demand = vr_dvfs_smooth(gov->cpu_demand,
+        vr_dvfs_demand(telemetry->stage_time_us[VR_PIPELINE_STAGE_TRACKING],
+                       telemetry->frame_period_us, cpu_freq));
+    gov->npu_demand = vr_dvfs_smooth(gov->npu_demand,
+        vr_dvfs_demand(telemetry->stage_time_us[VR_PIPELINE_STAGE_EXTRACTION],
+                       telemetry->frame_period_us, npu_freq));
+    
+    if (telemetry->hints)
+        gov->boost_until = jiffies + msecs_to_jiffies(VR_DVFS_BOOST_MS);
+    
+    gov->frames++;
+    
+    if (gov->enabled)
+        vr_power_governor_apply(data);
+    
+    return 0;
+}
+
+/**
+ * vr_power_governor_apply - Program the governed CPU and NPU ranges
+ * @data: Driver data, lock held
+ *
+ * The ceiling is the profile maximum lowered by the thermal status of the
+ * zone, the floor follows the demand (or the ceiling while boosted). The
+ * cpufreq governor of the profile still scales within the range.
+ */
+void vr_power_governor_apply(struct vr_power_data *data)
+{
+    struct vr_dvfs_governor *gov = &data->governor;
+    const struct vr_power_profile *profile = &data->current_profile;
+    bool boost = time_before(jiffies, gov->boost_until);
+    unsigned int cpu_cap, npu_cap, cpu_freq, npu_freq;
+    int ret;
+    
+    cpu_cap = vr_dvfs_thermal_cap(data->thermal_status.status[VR_THERMAL_ZONE_CPU],
+                                  profile->cpu_freq_min, profile->cpu_freq_max);
+    npu_cap = vr_dvfs_thermal_cap(data->thermal_status.status[VR_THERMAL_ZONE_NPU],
+                                  profile->npu_freq_min, profile->npu_freq_max);
+    
+    cpu_freq = boost ? cpu_cap : vr_dvfs_floor(gov->cpu_demand, profile->cpu_freq_min, cpu_cap);
+    npu_freq = boost ? npu_cap : vr_dvfs_floor(gov->npu_demand, profile->npu_freq_min, npu_cap);
+    
+    if (cpu_freq != gov->cpu_freq || cpu_cap != gov->cpu_cap) {
+        ret = vr_power_set_cpu_freq(data, cpu_freq, cpu_cap);
+        if (ret) {
+            dev_err(data->dev, "Failed to govern CPU frequency: %d\n", ret);
+        } else {
+            gov->cpu_freq = cpu_freq;
+            gov->cpu_cap = cpu_cap;
+        }
+    }
+    
+    if (npu_freq != gov->npu_freq || npu_cap != gov->npu_cap) {
+        ret = vr_power_set_npu_freq(data, npu_freq, npu_cap);
+        if (ret) {
+            dev_err(data->dev, "Failed to govern NPU frequency: %d\n", ret);
+        } else {
+            gov->npu_freq = npu_freq;
+            gov->npu_cap = npu_cap;
+        }
+    }
+    
+    vr_power_publish_state(data);
+}
+
+/* Enable or disable the governor, disabling restores the profile ranges */
+int vr_power_set_governor(struct vr_power_data *data, bool enable)
+{
+    struct vr_dvfs_governor *gov = &data->governor;
+    int ret = 0;
+    
+    mutex_lock(&data->lock);
+    
+    if (gov->enabled == enable)
+        goto out;
+    
+    gov->enabled = enable;
+    gov->cpu_cap = 0;
+    gov->npu_cap = 0;
+    
+    if (enable) {
+        vr_power_governor_apply(data);
+    } else {
+        gov->cpu_freq = 0;
+        gov->npu_freq = 0;
+        gov->boost_until = jiffies;
+        ret = vr_power_set_cpu_freq(data, data->current_profile.cpu_freq_min,
+                                    data->current_profile.cpu_freq_max);
+        if (!ret)
+            ret = vr_power_set_npu_freq(data, data->current_profile.npu_freq_min,
+                                        data->current_profile.npu_freq_max);
+    }
+    
+    dev_info(data->dev, "DVFS governor %s\n", enable ? "enabled" : "disabled");
+    
+    vr_power_publish_state(data);
+    
+out:
+    mutex_unlock(&data->lock);
+    return ret;
+}
+
 /* Sysfs attribute for power profile */
 static ssize_t power_profile_show(struct device *dev,
                                  struct device_attribute *attr, char *buf)
@@ -734,6 +1022,55 @@ static ssize_t thermal_status_show(struct device *dev,
 
 static DEVICE_ATTR_RO(thermal_status);
 
+/* Sysfs attributes for the DVFS governor */
+static ssize_t dvfs_governor_show(struct device *dev,
+                                 struct device_attribute *attr, char *buf)
+{
+    struct vr_power_data *data = dev_get_drvdata(dev);
+    
+    return sprintf(buf, "%d\n", data->governor.enabled);
+}
+
+static ssize_t dvfs_governor_store(struct device *dev,
+                                  struct device_attribute *attr,
+                                  const char *buf, size_t count)
+{
+    struct vr_power_data *data = dev_get_drvdata(dev);
+    bool enable;
+    int ret;
+    
+    ret = kstrtobool(buf, &enable);
+    if (ret)
+        return ret;
+    
+    ret = vr_power_set_governor(data, enable);
+    if (ret)
+        return ret;
+    
+    return count;
+}
+
+static DEVICE_ATTR_RW(dvfs_governor);
+
+static ssize_t dvfs_state_show(struct device *dev,
+                              struct device_attribute *attr, char *buf)
+{
+    struct vr_power_data *data = dev_get_drvdata(dev);
+    struct vr_dvfs_governor *gov = &data->governor;
+    ssize_t len;
+    
+    mutex_lock(&data->lock);
+    len = sprintf(buf, "cpu_freq=%u cpu_cap=%u cpu_demand=%u npu_freq=%u npu_cap=%u npu_demand=%u boost=%d frames=%u\n",
+                  gov->cpu_freq, gov->cpu_cap, gov->cpu_demand,
+                  gov->npu_freq, gov->npu_cap, gov->npu_demand,
+                  time_before(jiffies, gov->boost_until), gov->frames);
+    mutex_unlock(&data->lock);
+    
+    return len;
+}
+
+static DEVICE_ATTR_RO(dvfs_state);
+
 /* Initialize sysfs interface */
 int vr_power_init_sysfs(struct vr_power_data *data)
 {
@@ -751,8 +1088,20 @@ int vr_power_init_sysfs(struct vr_power_data *data)
     if (ret)
         goto err_thermal;
     
+    ret = device_create_file(data->dev, &dev_attr_dvfs_governor);
+    if (ret)
+        goto err_governor;
+    
+    ret = device_create_file(data->dev, &dev_attr_dvfs_state);
+    if (ret)
+        goto err_state;
+    
     return 0;
     
+err_state:
+    device_remove_file(data->dev, &dev_attr_dvfs_governor);
+err_governor:
+    device_remove_file(data->dev, &dev_attr_thermal_status);
 err_thermal:
     device_remove_file(data->dev, &dev_attr_battery_status);
 err_battery:
@@ -763,6 +1112,8 @@ err_battery:
 /* Cleanup sysfs interface */
 void vr_power_exit_sysfs(struct vr_power_data *data)
 {
+    device_remove_file(data->dev, &dev_attr_dvfs_state);
+    device_remove_file(data->dev, &dev_attr_dvfs_governor);
     device_remove_file(data->dev, &dev_attr_thermal_status);
     device_remove_file(data->dev, &dev_attr_battery_status);
     device_remove_file(data->dev, &dev_attr_power_profile);
@@ -782,13 +1133,24 @@ static int vr_power_probe(struct platform_device *pdev)
     data->dev = &pdev->dev;
     mutex_init(&data->lock);
     
+    /* Allocate the state page before anything can publish to it */
+    BUILD_BUG_ON(sizeof(struct vr_power_state_page) > PAGE_SIZE);
+    data->state_page = (struct vr_power_state_page *)get_zeroed_page(GFP_KERNEL);
+    if (!data->state_page)
+        return -ENOMEM;
+    data->state_page->magic = VR_POWER_STATE_MAGIC;
+    data->state_page->version = VR_POWER_STATE_VERSION;
+    
     /* Create workqueue */
     data->pm_wq = create_singlethread_workqueue("vr_power_wq");
     if (!data->pm_wq) {
         dev_err(&pdev->dev, "Failed to create workqueue\n");
-        return -ENOMEM;
+        ret = -ENOMEM;
+        goto err_wq;
     }
     
+    WRITE_ONCE(vr_power_shared_state, data->state_page);
+    
     /* Register misc device */
     ret = misc_register(&vr_power_miscdev);
     if (ret) {
@@ -845,7 +1207,10 @@ err_thermal:
 err_battery:
     misc_deregister(&vr_power_miscdev);
 err_misc:
+    WRITE_ONCE(vr_power_shared_state, NULL);
     destroy_workqueue(data->pm_wq);
+err_wq:
+    free_page((unsigned long)data->state_page);
     return ret;
 }
 
@@ -860,8 +1225,12 @@ static int vr_power_remove(struct platform_device *pdev)
     vr_power_exit_thermal(data);
     vr_power_exit_battery(data);
     misc_deregister(&vr_power_miscdev);
+    WRITE_ONCE(vr_power_shared_state, NULL);
     destroy_workqueue(data->pm_wq);
     
+    /* Existing mappings keep their own reference on the page */
+    free_page((unsigned long)data->state_page);
+    
     return 0;
 }
 
@@ -12,6 +12,7 @@
 #ifndef _ORANGEPI_VR_POWER_H_
 #define _ORANGEPI_VR_POWER_H_
 
+#include <linux/types.h>
 #include <linux/device.h>
 #include <linux/power_supply.h>
 #include <linux/thermal.h>
@@ -112,6 +113,85 @@ struct vr_battery_status {
     unsigned int time_to_full;    /* minutes */
 };
 
+/* SLAM pipeline stages timed for the DVFS governor */
+enum vr_pipeline_stage {
+    VR_PIPELINE_STAGE_ACQUISITION,  /* Frame dequeue */
+    VR_PIPELINE_STAGE_EXTRACTION,   /* Feature extraction on the NPU */
+    VR_PIPELINE_STAGE_TRACKING,     /* Tracking on the A76 cores */
+    VR_PIPELINE_STAGE_COUNT
+};
+
+/* Load announced ahead of the next frames */
+#define VR_PIPELINE_HINT_KEYFRAME       (1 << 0)  /* Keyframe inserted, local mapping follows */
+#define VR_PIPELINE_HINT_LOOP_CLOSURE   (1 << 1)  /* Loop detected, correction and BA follow */
+#define VR_PIPELINE_HINT_RELOCALIZATION (1 << 2)  /* Tracking lost, relocalization search */
+
+/* Per-frame pipeline telemetry fed to the DVFS governor */
+struct vr_pipeline_telemetry {
+    unsigned int frame_period_us;                       /* Frame period the stages must fit in */
+    unsigned int stage_time_us[VR_PIPELINE_STAGE_COUNT]; /* Time of each stage for the last frame */
+    unsigned int hints;                                 /* VR_PIPELINE_HINT_* */
+    unsigned int reserved;
+};
+
+/* DVFS governor tuning */
+#define VR_DVFS_TARGET_LOAD         700     /* Busy share of the frame period aimed for, per mille */
+#define VR_DVFS_BOOST_MS            250     /* Clocks held at the cap after a load hint */
+#define VR_DVFS_FREQ_STEP           100000  /* Frequency granularity (kHz) */
+
+/* Workload-aware DVFS governor state */
+struct vr_dvfs_governor {
+    bool enabled;
+    unsigned int cpu_demand;        /* Smoothed clock tracking needs to fill the frame period (kHz) */
+    unsigned int npu_demand;        /* Smoothed clock extraction needs to fill the frame period (kHz) */
+    unsigned int cpu_freq;          /* Applied CPU floor (kHz) */
+    unsigned int npu_freq;          /* Applied NPU floor (kHz) */
+    unsigned int cpu_cap;           /* Applied CPU ceiling after thermal limits (kHz) */
+    unsigned int npu_cap;           /* Applied NPU ceiling after thermal limits (kHz) */
+    unsigned long boost_until;      /* jiffies until which a load hint holds the clocks up */
+    unsigned int frames;            /* Telemetry reports received */
+};
+
+/* Read-only state page, mmap() one page at offset 0 of the misc device */
+#define VR_POWER_STATE_MAGIC    0x53505256  /* "VRPS" */
+#define VR_POWER_STATE_VERSION  1
+
+/*
+ * Thermal, clock and battery state rewritten by the driver on every change,
+ * so the performance governor and telemetry read it without a syscall. A
+ * reader copies the fields between two reads of seq and retries while seq
+ * is odd or has moved. Fixed-width fields, shared with userspace.
+ */
+struct vr_power_state_page {
+    __u32 magic;
+    __u32 version;
+    __u32 seq;                                  /* Odd while the driver rewrites the fields below */
+    __u32 reserved;
+    __u64 update_ns;                            /* CLOCK_MONOTONIC of the last write */
+    
+    /* Thermal */
+    __s32 temperature[VR_THERMAL_ZONE_COUNT];   /* 0.1°C */
+    __u32 thermal_status[VR_THERMAL_ZONE_COUNT]; /* enum vr_thermal_status */
+    __u32 throttle_mask;                        /* Bit per enum vr_thermal_zone above NORMAL */
+    
+    /* Operating points, the applied clock ranges (kHz) */
+    __u32 profile;                              /* enum vr_power_profile_type */
+    __u32 governor_enabled;
+    __u32 cpu_freq_min;
+    __u32 cpu_freq_max;
+    __u32 gpu_freq_min;
+    __u32 gpu_freq_max;
+    __u32 npu_freq_min;
+    __u32 npu_freq_max;
+    
+    /* Battery */
+    __u32 battery_status;                       /* enum vr_battery_status_type */
+    __u32 battery_capacity;                     /* 0-100% */
+    __u32 battery_voltage;                      /* mV */
+    __s32 battery_current;                      /* mA (positive = charging, negative = discharging) */
+    __s32 battery_power;                        /* mW, same sign as the current */
+};
+
 /* Main driver data structure */
 struct vr_power_data {
     struct device *dev;
@@ -128,6 +208,10 @@ struct vr_power_data {
     struct vr_power_profile current_profile;
     struct vr_battery_status battery_status;
     struct vr_thermal_status thermal_status;
+    struct vr_dvfs_governor governor;
+    
+    /* Page mapped read-only by userspace, mirror of the power state */
+    struct vr_power_state_page *state_page;
     
     /* Work queue for power management */
     struct workqueue_struct *pm_wq;
@@ -146,6 +230,7 @@ struct vr_power_data {
 #define VR_POWER_IOCTL_GET_THERMAL    _IOR(VR_POWER_IOC_MAGIC, 4, struct vr_thermal_config)
 #define VR_POWER_IOCTL_SET_BATTERY    _IOW(VR_POWER_IOC_MAGIC, 5, struct vr_battery_status)
 #define VR_POWER_IOCTL_GET_BATTERY    _IOR(VR_POWER_IOC_MAGIC, 6, struct vr_battery_status)
+#define VR_POWER_IOCTL_SET_TELEMETRY  _IOW(VR_POWER_IOC_MAGIC, 7, struct vr_pipeline_telemetry)
 
 /* Function prototypes */
 /* Battery management */
@@ -172,6 +257,15 @@ int vr_power_set_cpu_freq(struct vr_power_data *data, unsigned int min, unsigned
 int vr_power_set_gpu_freq(struct vr_power_data *data, unsigned int min, unsigned int max);
 int vr_power_set_npu_freq(struct vr_power_data *data, unsigned int min, unsigned int max);
 
+/* DVFS governor, update and apply are called with data->lock held */
+int vr_power_set_governor(struct vr_power_data *data, bool enable);
+int vr_power_governor_update(struct vr_power_data *data,
+                             const struct vr_pipeline_telemetry *telemetry);
+void vr_power_governor_apply(struct vr_power_data *data);
+
+/* Mapped state page, called with data->lock held */
+void vr_power_publish_state(struct vr_power_data *data);
+
 /* Sysfs interface */
 int vr_power_init_sysfs(struct vr_power_data *data);
 void vr_power_exit_sysfs(struct vr_power_data *data);
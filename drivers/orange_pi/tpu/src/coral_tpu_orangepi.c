@@ -24,6 +24,9 @@
 #include <linux/fs.h>
 #include <linux/cdev.h>
 #include <linux/miscdevice.h>
+#include <linux/dma-buf.h>
+#include <linux/mutex.h>
+#include <linux/pm_qos.h>
 
 // Include the original Coral TPU driver headers
 #include "gasket.h"
@@ -38,13 +41,75 @@
 #define CORAL_TPU_POWER_CONFIG           0x0040
 #define CORAL_TPU_BUFFER_CONFIG          0x0050
 #define CORAL_TPU_VR_MODE_CONFIG         0x0060
+#define CORAL_TPU_INPUT_ADDR_LO          0x0070
+#define CORAL_TPU_INPUT_ADDR_HI          0x0074
+#define CORAL_TPU_INPUT_SIZE             0x0078
 
 /* Coral TPU Register Values for Orange Pi CM5 VR */
 #define CORAL_TPU_CONTROL_ENABLE         0x00000001
 #define CORAL_TPU_DMA_CONFIG_ZEROCOPY    0x00000001
 #define CORAL_TPU_POWER_CONFIG_PERF      0x00000001
+#define CORAL_TPU_POWER_CONFIG_NO_CLKGATE 0x00000002
+#define CORAL_TPU_POWER_CONFIG_NO_L1     0x00000004
 #define CORAL_TPU_VR_MODE_ENABLE         0x00000001
 
+/* Power-state exit latencies, us */
+#define CORAL_TPU_CLKGATE_EXIT_US        20
+#define CORAL_TPU_L1_EXIT_US             70
+
+#define CORAL_TPU_MAX_IMPORTS            32
+#define CORAL_TPU_MAX_AUTOSUSPEND_MS     10000
+
+/* ioctl interface of /dev/coral-tpu-vr */
+#define CORAL_TPU_VR_IOC_MAGIC           'T'
+
+/**
+ * struct coral_tpu_dmabuf_import - DMA-BUF imported as a TPU input
+ * @fd: DMA-BUF fd, e.g. a camera buffer, in
+ * @handle: Mapping handle, out
+ * @size: Buffer size in bytes, out
+ * @device_addr: Address the TPU reads the buffer at, out
+ */
+struct coral_tpu_dmabuf_import {
+    __s32 fd;
+    __u32 handle;
+    __u64 size;
+    __u64 device_addr;
+};
+
+/**
+ * struct coral_tpu_input_bind - Imported buffer range fed to the next inference
+ * @handle: Mapping handle from the import
+ * @reserved: Must be zero
+ * @offset: Start of the input in the buffer
+ * @length: Input length, 0 for the rest of the buffer
+ */
+struct coral_tpu_input_bind {
+    __u32 handle;
+    __u32 reserved;
+    __u64 offset;
+    __u64 length;
+};
+
+/* Drops the wake-up latency constraint of the caller */
+#define CORAL_TPU_RESUME_LATENCY_ANY     0xffffffff
+
+/**
+ * struct coral_tpu_power_latency - Power-state transition limits
+ * @resume_latency_us: Longest wake-up the caller accepts, 0 keeps the TPU
+ *                     powered, CORAL_TPU_RESUME_LATENCY_ANY drops the limit
+ * @autosuspend_delay_ms: Idle time before runtime suspend, 0 keeps the current
+ */
+struct coral_tpu_power_latency {
+    __u32 resume_latency_us;
+    __u32 autosuspend_delay_ms;
+};
+
+#define CORAL_TPU_IOCTL_IMPORT_DMABUF    _IOWR(CORAL_TPU_VR_IOC_MAGIC, 1, struct coral_tpu_dmabuf_import)
+#define CORAL_TPU_IOCTL_RELEASE_DMABUF   _IOW(CORAL_TPU_VR_IOC_MAGIC, 2, __u32)
+#define CORAL_TPU_IOCTL_BIND_INPUT       _IOW(CORAL_TPU_VR_IOC_MAGIC, 3, struct coral_tpu_input_bind)
+#define CORAL_TPU_IOCTL_SET_POWER_LATENCY _IOW(CORAL_TPU_VR_IOC_MAGIC, 4, struct coral_tpu_power_latency)
+
 /* VR-specific TPU configuration */
 struct coral_tpu_vr_config {
     bool vr_mode_enabled;
@@ -65,6 +130,25 @@ struct coral_tpu_orangepi_device {
     dma_addr_t shared_dma_addr;
     void *shared_cpu_addr;
     size_t shared_size;
+    struct miscdevice miscdev;
+    struct mutex vr_lock;
+};
+
+/* Imported DMA-BUF mapped for the TPU */
+struct coral_tpu_dmabuf_mapping {
+    struct dma_buf *dmabuf;
+    struct dma_buf_attachment *attach;
+    struct sg_table *sgt;
+    dma_addr_t dma_addr;
+    size_t size;
+};
+
+/* Per-open state of /dev/coral-tpu-vr */
+struct coral_tpu_vr_file {
+    struct coral_tpu_orangepi_device *orangepi_dev;
+    struct mutex lock;
+    struct coral_tpu_dmabuf_mapping *mappings[CORAL_TPU_MAX_IMPORTS];
+    struct dev_pm_qos_request latency_req;
 };
 
 /* Forward declarations */
@@ -172,6 +256,322 @@ static int coral_tpu_configure_orangepi_cm5_vr(struct apex_driver_data *dev)
     return 0;
 }
 
+/**
+ * coral_tpu_power_config_for_latency - POWER_CONFIG value for a wake-up limit
+ * @performance_mode: Performance mode of the VR configuration
+ * @resume_latency_us: Aggregate resume latency constraint of the device
+ *
+ * Clock gating and PCIe L1 are kept while their exit latency fits the
+ * constraint, so an idle TPU still saves power unless tracking needs it
+ * to answer within a few microseconds.
+ */
+static u32 coral_tpu_power_config_for_latency(bool performance_mode, s32 resume_latency_us)
+{
+    u32 val = performance_mode ? CORAL_TPU_POWER_CONFIG_PERF : 0;
+
+    if (resume_latency_us < CORAL_TPU_L1_EXIT_US)
+        val |= CORAL_TPU_POWER_CONFIG_NO_L1;
+    if (resume_latency_us < CORAL_TPU_CLKGATE_EXIT_US)
+        val |= CORAL_TPU_POWER_CONFIG_NO_CLKGATE;
+
+    return val;
+}
+
+/* Apply the aggregate latency constraint of all users, vr_lock held */
+static int coral_tpu_update_power_config(struct coral_tpu_orangepi_device *orangepi_dev)
+{
+    struct apex_driver_data *dev = &orangepi_dev->base_dev;
+    s32 latency = dev_pm_qos_read_value(dev->dev, DEV_PM_QOS_RESUME_LATENCY);
+
+    return coral_tpu_write_reg(dev, CORAL_TPU_POWER_CONFIG,
+                               coral_tpu_power_config_for_latency(orangepi_dev->vr_config.performance_mode,
+                                                                  latency));
+}
+
+static void coral_tpu_release_mapping(struct coral_tpu_dmabuf_mapping *mapping)
+{
+    dma_buf_unmap_attachment_unlocked(mapping->attach, mapping->sgt, DMA_TO_DEVICE);
+    dma_buf_detach(mapping->dmabuf, mapping->attach);
+    dma_buf_put(mapping->dmabuf);
+    kfree(mapping);
+}
+
+static int coral_tpu_import_dmabuf(struct coral_tpu_vr_file *vr_file,
+                                   struct coral_tpu_dmabuf_import *req)
+{
+    struct device *device = vr_file->orangepi_dev->base_dev.dev;
+    struct coral_tpu_dmabuf_mapping *mapping;
+    struct scatterlist *sg;
+    dma_addr_t next;
+    int slot, i, ret;
+
+    for (slot = 0; slot < CORAL_TPU_MAX_IMPORTS; slot++) {
+        if (!vr_file->mappings[slot])
+            break;
+    }
+    if (slot == CORAL_TPU_MAX_IMPORTS)
+        return -ENOSPC;
+
+    mapping = kzalloc(sizeof(*mapping), GFP_KERNEL);
+    if (!mapping)
+        return -ENOMEM;
+
+    mapping->dmabuf = dma_buf_get(req->fd);
+    if (IS_ERR(mapping->dmabuf)) {
+        ret = PTR_ERR(mapping->dmabuf);
+        goto err_free;
+    }
+
+    mapping->attach = dma_buf_attach(mapping->dmabuf, device);
+    if (IS_ERR(mapping->attach)) {
+        ret = PTR_ERR(mapping->attach);
+        goto err_put;
+    }
+
+    /* The camera writes the buffer, the TPU only reads it */
+    mapping->sgt = dma_buf_map_attachment_unlocked(mapping->attach, DMA_TO_DEVICE);
+    if (IS_ERR(mapping->sgt)) {
+        ret = PTR_ERR(mapping->sgt);
+        goto err_detach;
+    }
+
+    /* An input is a single address range, the IOMMU merges the pages into one */
+    mapping->dma_addr = sg_dma_address(mapping->sgt->sgl);
+    next = mapping->dma_addr;
+    for_each_sgtable_dma_sg(mapping->sgt, sg, i) {
+        if (sg_dma_address(sg) != next) {
+            dev_err(device, "DMA-BUF is not contiguous in the TPU address space\n");
+            ret = -EINVAL;
+            goto err_unmap;
+        }
+        next += sg_dma_len(sg);
+    }
+    mapping->size = mapping->dmabuf->size;
+    if (next - mapping->dma_addr < mapping->size) {
+        ret = -EINVAL;
+        goto err_unmap;
+    }
+
+    vr_file->mappings[slot] = mapping;
+    req->handle = slot + 1;
+    req->size = mapping->size;
+    req->device_addr = mapping->dma_addr;
+
+    return 0;
+
+err_unmap:
+    dma_buf_unmap_attachment_unlocked(mapping->attach, mapping->sgt, DMA_TO_DEVICE);
+err_detach:
+    dma_buf_detach(mapping->dmabuf, mapping->attach);
+err_put:
+    dma_buf_put(mapping->dmabuf);
+err_free:
+    kfree(mapping);
+    return ret;
+}
+
+static struct coral_tpu_dmabuf_mapping *coral_tpu_find_mapping(struct coral_tpu_vr_file *vr_file,
+                                                              u32 handle)
+{
+    if (handle == 0 || handle > CORAL_TPU_MAX_IMPORTS)
+        return NULL;
+
+    return vr_file->mappings[handle - 1];
+}
+
+static int coral_tpu_bind_input(struct coral_tpu_vr_file *vr_file,
+                                const struct coral_tpu_input_bind *req)
+{
+    struct coral_tpu_orangepi_device *orangepi_dev = vr_file->orangepi_dev;
+    struct apex_driver_data *dev = &orangepi_dev->base_dev;
+    struct coral_tpu_dmabuf_mapping *mapping;
+    dma_addr_t addr;
+    u64 length;
+    int ret;
+
+    mapping = coral_tpu_find_mapping(vr_file, req->handle);
+    if (!mapping || req->reserved || req->offset >= mapping->size)
+        return -EINVAL;
+
+    length = req->length ? req->length : mapping->size - req->offset;
+    if (length > mapping->size - req->offset || length > U32_MAX)
+        return -EINVAL;
+
+    /* Camera buffers are reused, drop stale CPU cache lines of the new frame */
+    dma_sync_sgtable_for_device(dev->dev, mapping->sgt, DMA_TO_DEVICE);
+
+    addr = mapping->dma_addr + req->offset;
+
+    mutex_lock(&orangepi_dev->vr_lock);
+    ret = coral_tpu_write_reg(dev, CORAL_TPU_INPUT_ADDR_LO, lower_32_bits(addr));
+    if (!ret)
+        ret = coral_tpu_write_reg(dev, CORAL_TPU_INPUT_ADDR_HI, upper_32_bits(addr));
+    if (!ret)
+        ret = coral_tpu_write_reg(dev, CORAL_TPU_INPUT_SIZE, length);
+    mutex_unlock(&orangepi_dev->vr_lock);
+
+    return ret;
+}
+
+static int coral_tpu_set_power_latency(struct coral_tpu_vr_file *vr_file,
+                                       const struct coral_tpu_power_latency *req)
+{
+    struct coral_tpu_orangepi_device *orangepi_dev = vr_file->orangepi_dev;
+    struct device *device = orangepi_dev->base_dev.dev;
+    s32 latency;
+    int ret;
+
+    if (req->resume_latency_us == CORAL_TPU_RESUME_LATENCY_ANY)
+        latency = PM_QOS_RESUME_LATENCY_NO_CONSTRAINT;
+    else if (req->resume_latency_us < PM_QOS_RESUME_LATENCY_NO_CONSTRAINT)
+        latency = req->resume_latency_us;
+    else
+        return -EINVAL;
+
+    if (req->autosuspend_delay_ms > CORAL_TPU_MAX_AUTOSUSPEND_MS)
+        return -EINVAL;
+
+    /* One request per open file, PM QoS keeps the strictest of them */
+    if (dev_pm_qos_request_active(&vr_file->latency_req))
+        ret = dev_pm_qos_update_request(&vr_file->latency_req, latency);
+    else
+        ret = dev_pm_qos_add_request(device, &vr_file->latency_req,
+                                     DEV_PM_QOS_RESUME_LATENCY, latency);
+    if (ret < 0)
+        return ret;
+
+    mutex_lock(&orangepi_dev->vr_lock);
+    if (req->autosuspend_delay_ms)
+        pm_runtime_set_autosuspend_delay(device, req->autosuspend_delay_ms);
+    ret = coral_tpu_update_power_config(orangepi_dev);
+    mutex_unlock(&orangepi_dev->vr_lock);
+
+    /* A zero limit forbids runtime suspend, wake the TPU now rather than on the next frame */
+    if (latency == 0)
+        pm_request_resume(device);
+
+    return ret;
+}
+
+static int coral_tpu_vr_open(struct inode *inode, struct file *file)
+{
+    struct coral_tpu_orangepi_device *orangepi_dev =
+        container_of(file->private_data, struct coral_tpu_orangepi_device, miscdev);
+    struct coral_tpu_vr_file *vr_file;
+
+    vr_file = kzalloc(sizeof(*vr_file), GFP_KERNEL);
+    if (!vr_file)
+        return -ENOMEM;
+
+    vr_file->orangepi_dev = orangepi_dev;
+    mutex_init(&vr_file->lock);
+    file->private_data = vr_file;
+
+    return 0;
+}
+
+static int coral_tpu_vr_release(struct inode *inode, struct file *file)
+{
+    struct coral_tpu_vr_file *vr_file = file->private_data;
+    struct coral_tpu_orangepi_device *orangepi_dev = vr_file->orangepi_dev;
+    int i;
+
+    for (i = 0; i < CORAL_TPU_MAX_IMPORTS; i++) {
+        if (vr_file->mappings[i])
+            coral_tpu_release_mapping(vr_file->mappings[i]);
+    }
+
+    if (dev_pm_qos_request_active(&vr_file->latency_req)) {
+        dev_pm_qos_remove_request(&vr_file->latency_req);
+        mutex_lock(&orangepi_dev->vr_lock);
+        coral_tpu_update_power_config(orangepi_dev);
+        mutex_unlock(&orangepi_dev->vr_lock);
+    }
+
+    mutex_destroy(&vr_file->lock);
+    kfree(vr_file);
+
+    return 0;
+}
+
+static long coral_tpu_vr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct coral_tpu_vr_file *vr_file = file->private_data;
+    void __user *argp = (void __user *)arg;
+    struct coral_tpu_dmabuf_import import;
+    struct coral_tpu_input_bind bind;
+    struct coral_tpu_power_latency latency;
+    struct coral_tpu_dmabuf_mapping *mapping;
+    u32 handle;
+    long ret;
+
+    mutex_lock(&vr_file->lock);
+
+    switch (cmd) {
+    case CORAL_TPU_IOCTL_IMPORT_DMABUF:
+        if (copy_from_user(&import, argp, sizeof(import))) {
+            ret = -EFAULT;
+            break;
+        }
+        ret = coral_tpu_import_dmabuf(vr_file, &import);
+        if (ret)
+            break;
+        if (copy_to_user(argp, &import, sizeof(import))) {
+            coral_tpu_release_mapping(vr_file->mappings[import.handle - 1]);
+            vr_file->mappings[import.handle - 1] = NULL;
+            ret = -EFAULT;
+        }
+        break;
+
+    case CORAL_TPU_IOCTL_RELEASE_DMABUF:
+        if (copy_from_user(&handle, argp, sizeof(handle))) {
+            ret = -EFAULT;
+            break;
+        }
+        mapping = coral_tpu_find_mapping(vr_file, handle);
+        if (!mapping) {
+            ret = -EINVAL;
+            break;
+        }
+        coral_tpu_release_mapping(mapping);
+        vr_file->mappings[handle - 1] = NULL;
+        ret = 0;
+        break;
+
+    case CORAL_TPU_IOCTL_BIND_INPUT:
+        if (copy_from_user(&bind, argp, sizeof(bind))) {
+            ret = -EFAULT;
+            break;
+        }
+        ret = coral_tpu_bind_input(vr_file, &bind);
+        break;
+
+    case CORAL_TPU_IOCTL_SET_POWER_LATENCY:
+        if (copy_from_user(&latency, argp, sizeof(latency))) {
+            ret = -EFAULT;
+            break;
+        }
+        ret = coral_tpu_set_power_latency(vr_file, &latency);
+        break;
+
+    default:
+        ret = -ENOTTY;
+        break;
+    }
+
+    mutex_unlock(&vr_file->lock);
+
+    return ret;
+}
+
+static const struct file_operations coral_tpu_vr_fops = {
+    .owner = THIS_MODULE,
+    .open = coral_tpu_vr_open,
+    .release = coral_tpu_vr_release,
+    .unlocked_ioctl = coral_tpu_vr_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+};
+
 /* Update probe function to detect Orange Pi CM5 */
 static int coral_tpu_probe_orangepi(struct platform_device *pdev)
 {
@@ -208,6 +608,18 @@ static int coral_tpu_probe_orangepi(struct platform_device *pdev)
             dev_err(dev, "Failed to configure for Orange Pi CM5: %d\n", ret);
             return ret;
         }
+
+        /* DMA-BUF import and power latency interface */
+        mutex_init(&orangepi_dev->vr_lock);
+        orangepi_dev->miscdev.minor = MISC_DYNAMIC_MINOR;
+        orangepi_dev->miscdev.name = "coral-tpu-vr";
+        orangepi_dev->miscdev.fops = &coral_tpu_vr_fops;
+        orangepi_dev->miscdev.parent = dev;
+        ret = misc_register(&orangepi_dev->miscdev);
+        if (ret) {
+            dev_err(dev, "Failed to register VR device: %d\n", ret);
+            return ret;
+        }
     }
 
     return 0;
@@ -219,6 +631,11 @@ static int coral_tpu_remove_orangepi(struct platform_device *pdev)
     struct apex_driver_data *dev = platform_get_drvdata(pdev);
     struct coral_tpu_orangepi_device *orangepi_dev = 
         container_of(dev, struct coral_tpu_orangepi_device, base_dev);
+
+    if (orangepi_dev->is_orangepi_cm5) {
+        misc_deregister(&orangepi_dev->miscdev);
+        mutex_destroy(&orangepi_dev->vr_lock);
+    }
         
     /* Free zero-copy buffer if allocated */
     if (orangepi_dev->shared_cpu_addr) {
@@ -14,6 +14,7 @@
 #include <linux/of_device.h>
 #include <linux/dma-mapping.h>
 #include <linux/delay.h>
+#include <linux/pm_qos.h>
 #include <linux/kunit/test.h>
 
 // Include the driver headers
@@ -223,6 +224,22 @@ static void coral_tpu_orangepi_test_buffer(struct kunit *test)
     KUNIT_EXPECT_EQ(test, ctx->dev->test_write_val, 0x00001000); // 4096KB
 }
 
+/* Test power-state selection from the wake-up latency limit */
+static void coral_tpu_orangepi_test_power_latency(struct kunit *test)
+{
+    // No limit keeps every low-power state
+    KUNIT_EXPECT_EQ(test, coral_tpu_power_config_for_latency(false, PM_QOS_RESUME_LATENCY_NO_CONSTRAINT),
+                    0x00000000);
+    KUNIT_EXPECT_EQ(test, coral_tpu_power_config_for_latency(true, PM_QOS_RESUME_LATENCY_NO_CONSTRAINT),
+                    0x00000001); // POWER_CONFIG_PERF
+
+    // Below the L1 exit latency the link stays in L0, clock gating is kept
+    KUNIT_EXPECT_EQ(test, coral_tpu_power_config_for_latency(false, 50), 0x00000004); // NO_L1
+
+    // Below the clock gating exit latency both are off
+    KUNIT_EXPECT_EQ(test, coral_tpu_power_config_for_latency(true, 0), 0x00000007);
+}
+
 /* Test suite definition */
 static struct kunit_case coral_tpu_orangepi_test_cases[] = {
     KUNIT_CASE(coral_tpu_orangepi_test_detection),
@@ -231,6 +248,7 @@ static struct kunit_case coral_tpu_orangepi_test_cases[] = {
     KUNIT_CASE(coral_tpu_orangepi_test_dma),
     KUNIT_CASE(coral_tpu_orangepi_test_power),
     KUNIT_CASE(coral_tpu_orangepi_test_buffer),
+    KUNIT_CASE(coral_tpu_orangepi_test_power_latency),
     {}
 };
 
@@ -11,6 +11,7 @@
 #include <linux/clk.h>
 #include <linux/gpio/consumer.h>
 #include <linux/i2c.h>
+#include <linux/math64.h>
 #include <linux/regulator/consumer.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
@@ -119,59 +120,40 @@ struct ov9281_reg {
     u8 val;
 };
 
-/* Register settings for different frame rates */
-static const struct ov9281_reg ov9281_30fps_regs[] = {
-    {OV9281_REG_TIMING_HTS_H, 0x0A},
-    {OV9281_REG_TIMING_HTS_L, 0x00},
-    {OV9281_REG_TIMING_VTS_H, 0x04},
-    {OV9281_REG_TIMING_VTS_L, 0x65},
-    {OV9281_REG_CLK_CTRL, 0x10},
-    {0xFFFF, 0xFF}, /* End of array */
-};
-
-static const struct ov9281_reg ov9281_60fps_regs[] = {
-    {OV9281_REG_TIMING_HTS_H, 0x05},
-    {OV9281_REG_TIMING_HTS_L, 0x00},
-    {OV9281_REG_TIMING_VTS_H, 0x04},
-    {OV9281_REG_TIMING_VTS_L, 0x65},
-    {OV9281_REG_CLK_CTRL, 0x10},
-    {0xFFFF, 0xFF}, /* End of array */
-};
-
-static const struct ov9281_reg ov9281_90fps_regs[] = {
-    {OV9281_REG_TIMING_HTS_H, 0x03},
-    {OV9281_REG_TIMING_HTS_L, 0x55},
-    {OV9281_REG_TIMING_VTS_H, 0x04},
-    {OV9281_REG_TIMING_VTS_L, 0x65},
-    {OV9281_REG_CLK_CTRL, 0x0C},
-    {0xFFFF, 0xFF}, /* End of array */
+/*
+ * Line length, frame length and MIPI clock of each frame rate mode. The 240
+ * and 360 fps modes have the frame length of the 400 line subsampled readout.
+ */
+struct ov9281_frame_timing {
+    u32 fps;
+    u16 hts;
+    u16 vts;
+    u8 clk_ctrl;
 };
 
-static const struct ov9281_reg ov9281_120fps_regs[] = {
-    {OV9281_REG_TIMING_HTS_H, 0x02},
-    {OV9281_REG_TIMING_HTS_L, 0x80},
-    {OV9281_REG_TIMING_VTS_H, 0x04},
-    {OV9281_REG_TIMING_VTS_L, 0x65},
-    {OV9281_REG_CLK_CTRL, 0x0A},
-    {0xFFFF, 0xFF}, /* End of array */
+static const struct ov9281_frame_timing ov9281_frame_timings[] = {
+    [OV9281_30_FPS]  = {  30, 0x0A00, 0x0465, 0x10 },
+    [OV9281_60_FPS]  = {  60, 0x0500, 0x0465, 0x10 },
+    [OV9281_90_FPS]  = {  90, 0x0355, 0x0465, 0x0C },
+    [OV9281_120_FPS] = { 120, 0x0280, 0x0465, 0x0A },
+    [OV9281_150_FPS] = { 150, 0x0200, 0x0465, 0x08 },
+    [OV9281_180_FPS] = { 180, 0x01AA, 0x0465, 0x06 },
+    [OV9281_240_FPS] = { 240, 0x0280, 0x0233, 0x0A },
+    [OV9281_360_FPS] = { 360, 0x01AA, 0x0233, 0x06 },
 };
 
-static const struct ov9281_reg ov9281_150fps_regs[] = {
-    {OV9281_REG_TIMING_HTS_H, 0x02},
-    {OV9281_REG_TIMING_HTS_L, 0x00},
-    {OV9281_REG_TIMING_VTS_H, 0x04},
-    {OV9281_REG_TIMING_VTS_L, 0x65},
-    {OV9281_REG_CLK_CTRL, 0x08},
-    {0xFFFF, 0xFF}, /* End of array */
+/* Output size, line and column increments and binning of each readout mode */
+struct ov9281_readout_timing {
+    u16 width;
+    u16 height;
+    u8 inc;
+    u8 binning;
 };
 
-static const struct ov9281_reg ov9281_180fps_regs[] = {
-    {OV9281_REG_TIMING_HTS_H, 0x01},
-    {OV9281_REG_TIMING_HTS_L, 0xAA},
-    {OV9281_REG_TIMING_VTS_H, 0x04},
-    {OV9281_REG_TIMING_VTS_L, 0x65},
-    {OV9281_REG_CLK_CTRL, 0x06},
-    {0xFFFF, 0xFF}, /* End of array */
+static const struct ov9281_readout_timing ov9281_readout_timings[] = {
+    [OV9281_READOUT_FULL]     = { OV9281_MAX_WIDTH, OV9281_MAX_HEIGHT, OV9281_INC_FULL, 0 },
+    [OV9281_READOUT_BINNING]  = { OV9281_SUBSAMPLED_WIDTH, OV9281_SUBSAMPLED_HEIGHT, OV9281_INC_FULL, OV9281_BINNING_ENABLE },
+    [OV9281_READOUT_SKIPPING] = { OV9281_SUBSAMPLED_WIDTH, OV9281_SUBSAMPLED_HEIGHT, OV9281_INC_SKIP, 0 },
 };
 
 /* Register settings for different sync modes */
@@ -247,6 +229,29 @@ static int ov9281_write_reg_array(struct ov9281_device *dev, const struct ov9281
     return 0;
 }
 
+/*
+ * Exposure time of the latched exposure, the exposure registers count in
+ * 1/16 of a line of hts pixel clocks.
+ */
+static u32 ov9281_exposure_time_us(struct ov9281_device *dev, u32 exposure)
+{
+    return div_u64((u64)exposure * dev->hts * USEC_PER_SEC,
+                   16ULL * OV9281_PIXEL_RATE);
+}
+
+static void ov9281_update_exposure_time(struct ov9281_device *dev)
+{
+    unsigned long flags;
+    u32 exposure_us;
+    
+    exposure_us = ov9281_exposure_time_us(dev, dev->cur_exposure);
+    
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    dev->exposure_us = exposure_us;
+    dev->frame_exposure = dev->cur_exposure;
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+}
+
 /* Core initialization function */
 int ov9281_core_init(struct ov9281_device *dev)
 {
@@ -354,69 +359,159 @@ int ov9281_set_mode(struct ov9281_device *dev, enum ov9281_sync_mode mode)
 
 int ov9281_set_frame_rate(struct ov9281_device *dev, enum ov9281_frame_rate rate)
 {
-    int ret;
-    
     if (dev->frame_rate == rate)
         return 0;
     
-    switch (rate) {
-    case OV9281_30_FPS:
-        ret = ov9281_write_reg_array(dev, ov9281_30fps_regs);
-        if (ret)
-            return ret;
-        dev->hts = 0x0A00;
-        dev->vts = 0x0465;
-        dev->high_framerate = false;
-        break;
-    case OV9281_60_FPS:
-        ret = ov9281_write_reg_array(dev, ov9281_60fps_regs);
-        if (ret)
-            return ret;
-        dev->hts = 0x0500;
-        dev->vts = 0x0465;
-        dev->high_framerate = false;
-        break;
-    case OV9281_90_FPS:
-        ret = ov9281_write_reg_array(dev, ov9281_90fps_regs);
-        if (ret)
-            return ret;
-        dev->hts = 0x0355;
-        dev->vts = 0x0465;
-        dev->high_framerate = true;
-        break;
-    case OV9281_120_FPS:
-        ret = ov9281_write_reg_array(dev, ov9281_120fps_regs);
-        if (ret)
-            return ret;
-        dev->hts = 0x0280;
-        dev->vts = 0x0465;
-        dev->high_framerate = true;
-        break;
-    case OV9281_150_FPS:
-        ret = ov9281_write_reg_array(dev, ov9281_150fps_regs);
-        if (ret)
-            return ret;
-        dev->hts = 0x0200;
-        dev->vts = 0x0465;
-        dev->high_framerate = true;
-        break;
-    case OV9281_180_FPS:
-        ret = ov9281_write_reg_array(dev, ov9281_180fps_regs);
-        if (ret)
-            return ret;
-        dev->hts = 0x01AA;
-        dev->vts = 0x0465;
-        dev->high_framerate = true;
-        break;
-    default:
+    return ov9281_set_readout(dev, dev->readout, rate, NULL);
+}
+
+/* Line length, frame length, output size and subsampling of a mode */
+static int ov9281_write_timing(struct ov9281_device *dev,
+                               const struct ov9281_frame_timing *timing,
+                               const struct ov9281_readout_timing *readout)
+{
+    u8 val;
+    int ret;
+    
+    ret = ov9281_write_reg16(dev, OV9281_REG_TIMING_HTS_H, timing->hts);
+    if (!ret)
+        ret = ov9281_write_reg16(dev, OV9281_REG_TIMING_VTS_H, timing->vts);
+    if (!ret)
+        ret = ov9281_write_reg(dev, OV9281_REG_CLK_CTRL, timing->clk_ctrl);
+    if (!ret)
+        ret = ov9281_write_reg16(dev, OV9281_REG_TIMING_X_OUTPUT_H, readout->width);
+    if (!ret)
+        ret = ov9281_write_reg16(dev, OV9281_REG_TIMING_Y_OUTPUT_H, readout->height);
+    if (!ret)
+        ret = ov9281_write_reg(dev, OV9281_REG_TIMING_X_INC, readout->inc);
+    if (!ret)
+        ret = ov9281_write_reg(dev, OV9281_REG_TIMING_Y_INC, readout->inc);
+    if (ret)
+        return ret;
+    
+    /* The binning bits share the format registers with the flips */
+    ret = ov9281_read_reg(dev, OV9281_REG_VFLIP, &val);
+    if (!ret)
+        ret = ov9281_write_reg(dev, OV9281_REG_VFLIP,
+                               (val & ~OV9281_BINNING_ENABLE) | readout->binning);
+    if (!ret)
+        ret = ov9281_read_reg(dev, OV9281_REG_HFLIP, &val);
+    if (!ret)
+        ret = ov9281_write_reg(dev, OV9281_REG_HFLIP,
+                               (val & ~OV9281_BINNING_ENABLE) | readout->binning);
+    
+    return ret;
+}
+
+/*
+ * Switch the frame rate and readout mode. While streaming, the mode is
+ * written in one group hold and latches on a frame boundary, the sensor does
+ * not go through standby; while FSIN triggered it latches on the first pulse
+ * after the launch, returned in sequence, and the trigger period follows from
+ * the next pulse.
+ */
+int ov9281_set_readout(struct ov9281_device *dev, enum ov9281_readout readout,
+                       enum ov9281_frame_rate rate, u32 *sequence)
+{
+    const struct ov9281_frame_timing *timing;
+    const struct ov9281_readout_timing *mode;
+    bool streaming = dev->state == OV9281_STATE_STREAMING;
+    unsigned long flags;
+    u32 exposure_us;
+    int ret = 0;
+    
+    if (readout > OV9281_READOUT_SKIPPING || rate > OV9281_360_FPS)
+        return -EINVAL;
+    
+    /* The full array does not fit the frame length of the fastest modes */
+    if (readout == OV9281_READOUT_FULL && rate > OV9281_180_FPS)
         return -EINVAL;
-    }
+    
+    timing = &ov9281_frame_timings[rate];
+    mode = &ov9281_readout_timings[readout];
+    
+    if (streaming)
+        ret = ov9281_write_reg(dev, OV9281_REG_GROUP_ACCESS, OV9281_GROUP_HOLD_START);
+    if (!ret)
+        ret = ov9281_write_timing(dev, timing, mode);
+    if (!ret && streaming)
+        ret = ov9281_write_reg(dev, OV9281_REG_GROUP_ACCESS, OV9281_GROUP_HOLD_END);
+    if (!ret && streaming)
+        ret = ov9281_write_reg(dev, OV9281_REG_GROUP_ACCESS, OV9281_GROUP_HOLD_LAUNCH);
+    if (ret)
+        return ret;
     
     dev->frame_rate = rate;
+    dev->readout = readout;
+    dev->hts = timing->hts;
+    dev->vts = timing->vts;
+    dev->high_framerate = timing->fps >= 90;
+    dev->fmt.width = mode->width;
+    dev->fmt.height = mode->height;
+    exposure_us = ov9281_exposure_time_us(dev, dev->cur_exposure);
+    
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    dev->fsin_nominal_period = ns_to_ktime(div_u64(NSEC_PER_SEC, timing->fps));
+    dev->fsin_period = dev->fsin_nominal_period;
+    if (dev->fsin_running) {
+        /* Reported from the frame the launch latches on, like the frame settings */
+        dev->next_sequence = dev->frame_sequence;
+        dev->next_exposure = dev->cur_exposure;
+        dev->next_exposure_us = exposure_us;
+        dev->next_gain = dev->cur_gain;
+        dev->next_width = mode->width;
+        dev->next_height = mode->height;
+        dev->next_valid = true;
+    } else {
+        dev->exposure_us = exposure_us;
+        dev->frame_exposure = dev->cur_exposure;
+        dev->frame_width = mode->width;
+        dev->frame_height = mode->height;
+    }
+    if (sequence)
+        *sequence = dev->frame_sequence;
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
     
     return 0;
 }
 
+/* Slowest frame rate mode at least as fast as fps, or the fastest of the readout */
+static enum ov9281_frame_rate ov9281_frame_rate_for_fps(enum ov9281_readout readout, u32 fps)
+{
+    enum ov9281_frame_rate max = readout == OV9281_READOUT_FULL ? OV9281_180_FPS : OV9281_360_FPS;
+    enum ov9281_frame_rate rate;
+    
+    for (rate = OV9281_30_FPS; rate < max; rate++) {
+        if (fps <= ov9281_frame_timings[rate].fps)
+            break;
+    }
+    
+    return rate;
+}
+
+long ov9281_switch_readout(struct ov9281_device *dev, struct ov9281_readout_mode *mode)
+{
+    enum ov9281_frame_rate rate;
+    long ret;
+    
+    if (mode->readout > OV9281_READOUT_SKIPPING)
+        return -EINVAL;
+    
+    mutex_lock(&dev->lock);
+    
+    rate = ov9281_frame_rate_for_fps(mode->readout, mode->fps);
+    ret = ov9281_set_readout(dev, mode->readout, rate, &mode->sequence);
+    if (!ret) {
+        mode->fps = ov9281_frame_timings[rate].fps;
+        mode->width = dev->fmt.width;
+        mode->height = dev->fmt.height;
+    }
+    
+    mutex_unlock(&dev->lock);
+    
+    return ret;
+}
+
 int ov9281_set_test_pattern(struct ov9281_device *dev, enum ov9281_test_pattern pattern)
 {
     int ret;
@@ -456,15 +551,20 @@ int ov9281_set_test_pattern(struct ov9281_device *dev, enum ov9281_test_pattern
     return ov9281_write_reg(dev, OV9281_REG_ISP_CTRL, val);
 }
 
-int ov9281_set_exposure(struct ov9281_device *dev, u32 exposure)
+static u32 ov9281_clamp_exposure(u32 exposure)
+{
+    return clamp_t(u32, exposure, OV9281_EXPOSURE_MIN, OV9281_EXPOSURE_MAX);
+}
+
+static u32 ov9281_clamp_gain(u32 gain)
+{
+    return clamp_t(u32, gain, OV9281_GAIN_MIN, OV9281_GAIN_MAX);
+}
+
+static int ov9281_write_exposure(struct ov9281_device *dev, u32 exposure)
 {
     int ret;
     
-    if (exposure > OV9281_EXPOSURE_MAX)
-        exposure = OV9281_EXPOSURE_MAX;
-    else if (exposure < OV9281_EXPOSURE_MIN)
-        exposure = OV9281_EXPOSURE_MIN;
-    
     ret = ov9281_write_reg(dev, OV9281_REG_AEC_EXPO_H, (exposure >> 16) & 0x0F);
     if (ret)
         return ret;
@@ -476,15 +576,10 @@ int ov9281_set_exposure(struct ov9281_device *dev, u32 exposure)
     return ov9281_write_reg(dev, OV9281_REG_AEC_EXPO_L, exposure & 0xFF);
 }
 
-int ov9281_set_gain(struct ov9281_device *dev, u32 gain)
+static int ov9281_write_gain(struct ov9281_device *dev, u32 gain)
 {
     int ret;
     
-    if (gain > OV9281_GAIN_MAX)
-        gain = OV9281_GAIN_MAX;
-    else if (gain < OV9281_GAIN_MIN)
-        gain = OV9281_GAIN_MIN;
-    
     ret = ov9281_write_reg(dev, OV9281_REG_AEC_AGC_ADJ_H, (gain >> 8) & 0x0F);
     if (ret)
         return ret;
@@ -492,6 +587,42 @@ int ov9281_set_gain(struct ov9281_device *dev, u32 gain)
     return ov9281_write_reg(dev, OV9281_REG_AEC_AGC_ADJ_L, gain & 0xFF);
 }
 
+int ov9281_set_exposure(struct ov9281_device *dev, u32 exposure)
+{
+    int ret;
+    
+    exposure = ov9281_clamp_exposure(exposure);
+    
+    ret = ov9281_write_exposure(dev, exposure);
+    if (ret)
+        return ret;
+    
+    dev->cur_exposure = exposure;
+    ov9281_update_exposure_time(dev);
+    
+    return 0;
+}
+
+int ov9281_set_gain(struct ov9281_device *dev, u32 gain)
+{
+    unsigned long flags;
+    int ret;
+    
+    gain = ov9281_clamp_gain(gain);
+    
+    ret = ov9281_write_gain(dev, gain);
+    if (ret)
+        return ret;
+    
+    dev->cur_gain = gain;
+    
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    dev->frame_gain = gain;
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+    
+    return 0;
+}
+
 int ov9281_set_flip(struct ov9281_device *dev, bool hflip, bool vflip)
 {
     int ret;
@@ -548,8 +679,12 @@ int ov9281_start_streaming(struct ov9281_device *dev)
     if (ret)
         return ret;
     
-    /* Synchronize sensors if master */
-    if (dev->is_master && dev->num_slaves > 0) {
+    /* Trigger every frame from FSIN, or synchronize sensors once if master */
+    if (dev->fsin_trigger && dev->is_master) {
+        ret = ov9281_start_fsin_trigger(dev);
+        if (ret)
+            return ret;
+    } else if (dev->is_master && dev->num_slaves > 0) {
         ret = ov9281_sync_sensors(dev);
         if (ret)
             return ret;
@@ -567,6 +702,9 @@ int ov9281_stop_streaming(struct ov9281_device *dev)
     if (dev->state != OV9281_STATE_STREAMING)
         return 0;
     
+    if (dev->fsin_trigger && dev->is_master)
+        ov9281_stop_fsin_trigger(dev);
+    
     ret = ov9281_write_reg(dev, OV9281_REG_STREAM_CTRL, OV9281_MODE_SW_STANDBY);
     if (ret)
         return ret;
@@ -663,6 +801,390 @@ int ov9281_sync_sensors(struct ov9281_device *dev)
     return 0;
 }
 
+/* Queue the exposure and frame sync events of one FSIN pulse */
+static u32 ov9281_queue_exposure_event(struct ov9281_device *dev, u64 start_ns,
+                                       u32 *exposure_us_out)
+{
+    struct ov9281_exposure_event *exposure;
+    struct v4l2_event ev;
+    unsigned long flags;
+    u32 sequence, exposure_us, exposure_val, gain, width, height;
+    bool pending;
+    
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    sequence = dev->frame_sequence++;
+    
+    /* Settings launched before this pulse latch on it */
+    if (dev->next_valid && (s32)(sequence - dev->next_sequence) >= 0) {
+        dev->exposure_us = dev->next_exposure_us;
+        dev->frame_exposure = dev->next_exposure;
+        dev->frame_gain = dev->next_gain;
+        dev->frame_width = dev->next_width;
+        dev->frame_height = dev->next_height;
+        dev->next_valid = false;
+    }
+    
+    exposure_us = dev->exposure_us;
+    exposure_val = dev->frame_exposure;
+    gain = dev->frame_gain;
+    width = dev->frame_width;
+    height = dev->frame_height;
+    pending = dev->num_settings > 0;
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+    
+    /* Write the settings due next before the following pulse */
+    if (pending)
+        queue_work(system_highpri_wq, &dev->settings_work);
+    
+    if (exposure_us_out)
+        *exposure_us_out = exposure_us;
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.type = OV9281_EVENT_EXPOSURE;
+    exposure = (struct ov9281_exposure_event *)ev.u.data;
+    exposure->sequence = sequence;
+    exposure->exposure_us = exposure_us;
+    exposure->start_ns = start_ns;
+    exposure->exposure = exposure_val;
+    exposure->gain = gain;
+    exposure->width = width;
+    exposure->height = height;
+    v4l2_subdev_notify_event(&dev->sd, &ev);
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.type = V4L2_EVENT_FRAME_SYNC;
+    ev.u.frame_sync.frame_sequence = sequence;
+    v4l2_subdev_notify_event(&dev->sd, &ev);
+    
+    return sequence;
+}
+
+/* Lines of a slice, the bands split the frame height evenly */
+static void ov9281_slice_lines(struct ov9281_device *dev, u32 slice,
+                               u32 *first_line, u32 *num_lines)
+{
+    u32 height = dev->fmt.height;
+    
+    *first_line = slice * height / dev->active_slices;
+    *num_lines = (slice + 1) * height / dev->active_slices - *first_line;
+}
+
+/* Time the last line of a slice has reached the receiver */
+static ktime_t ov9281_slice_ready(struct ov9281_device *dev, u32 slice)
+{
+    u32 first_line, num_lines;
+    u64 readout_ns;
+    
+    ov9281_slice_lines(dev, slice, &first_line, &num_lines);
+    readout_ns = div_u64((u64)(first_line + num_lines) * dev->hts * NSEC_PER_SEC,
+                         OV9281_PIXEL_RATE);
+    
+    return ktime_add_ns(dev->slice_readout,
+                        readout_ns + OV9281_SLICE_LATENCY_US * NSEC_PER_USEC);
+}
+
+static void ov9281_queue_slice_event(struct ov9281_device *dev, u32 sequence,
+                                     u32 slice, u32 num_slices, u32 first_line,
+                                     u32 num_lines, u64 ready_ns)
+{
+    struct ov9281_slice_event *band;
+    struct v4l2_event ev;
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.type = OV9281_EVENT_SLICE;
+    band = (struct ov9281_slice_event *)ev.u.data;
+    band->sequence = sequence;
+    band->slice = slice;
+    band->num_slices = num_slices;
+    band->first_line = first_line;
+    band->num_lines = num_lines;
+    band->ready_ns = ready_ns;
+    v4l2_subdev_notify_event(&dev->sd, &ev);
+}
+
+/*
+ * Slice timer of the master, fires as each band of the triggered frame has
+ * been read out and signals it on every sensor.
+ */
+static enum hrtimer_restart ov9281_slice_timer_fn(struct hrtimer *timer)
+{
+    struct ov9281_device *dev = container_of(timer, struct ov9281_device, slice_timer);
+    u32 slice = dev->slice_index;
+    u32 first_line, num_lines;
+    u64 ready_ns;
+    int i;
+    
+    ov9281_slice_lines(dev, slice, &first_line, &num_lines);
+    ready_ns = ktime_get_ns();
+    
+    ov9281_queue_slice_event(dev, dev->slice_sequence, slice, dev->active_slices,
+                             first_line, num_lines, ready_ns);
+    for (i = 0; i < dev->num_slaves; i++) {
+        if (dev->slaves[i])
+            ov9281_queue_slice_event(dev->slaves[i], dev->slice_sequence, slice,
+                                     dev->active_slices, first_line, num_lines, ready_ns);
+    }
+    
+    if (++dev->slice_index >= dev->active_slices)
+        return HRTIMER_NORESTART;
+    
+    hrtimer_set_expires(timer, ov9281_slice_ready(dev, dev->slice_index));
+    
+    return HRTIMER_RESTART;
+}
+
+/*
+ * FSIN pulse of the master, the rising edge starts the exposure of every
+ * sensor in external mode, so it is stamped for all of them.
+ */
+static enum hrtimer_restart ov9281_fsin_timer_fn(struct hrtimer *timer)
+{
+    struct ov9281_device *dev = container_of(timer, struct ov9281_device, fsin_timer);
+    u32 sequence, exposure_us;
+    u64 start_ns;
+    ktime_t period;
+    s64 phase_ns;
+    int i;
+    
+    gpio_set_value(dev->sync_gpio, 1);
+    start_ns = ktime_get_ns();
+    udelay(OV9281_FSIN_PULSE_US);
+    gpio_set_value(dev->sync_gpio, 0);
+    
+    sequence = ov9281_queue_exposure_event(dev, start_ns, &exposure_us);
+    for (i = 0; i < dev->num_slaves; i++) {
+        if (dev->slaves[i])
+            ov9281_queue_exposure_event(dev->slaves[i], start_ns, NULL);
+    }
+    
+    /* The global shutter frame is read out once the exposure ends */
+    if (dev->num_slices) {
+        dev->active_slices = dev->num_slices;
+        dev->slice_sequence = sequence;
+        dev->slice_index = 0;
+        dev->slice_readout = ktime_add_us(ns_to_ktime(start_ns), exposure_us);
+        hrtimer_start(&dev->slice_timer, ov9281_slice_ready(dev, 0), HRTIMER_MODE_ABS);
+    }
+    
+    spin_lock(&dev->fsin_lock);
+    period = dev->fsin_period;
+    phase_ns = dev->fsin_phase_ns;
+    dev->fsin_phase_ns = 0;
+    spin_unlock(&dev->fsin_lock);
+    
+    hrtimer_forward_now(timer, period);
+    if (phase_ns)
+        hrtimer_set_expires(timer, ktime_add(hrtimer_get_expires(timer), ns_to_ktime(phase_ns)));
+    
+    return HRTIMER_RESTART;
+}
+
+/*
+ * Write the queued settings due by the next frame in one group hold, that the
+ * sensor latches on the next FSIN pulse.
+ */
+static void ov9281_settings_work_fn(struct work_struct *work)
+{
+    struct ov9281_device *dev = container_of(work, struct ov9281_device, settings_work);
+    struct i2c_client *client = dev->client;
+    bool has_exposure = false, has_gain = false;
+    u32 exposure = 0, gain = 0, next, exposure_us;
+    unsigned long flags;
+    int i, ret;
+    
+    mutex_lock(&dev->lock);
+    
+    /* Merge the settings due by the next frame, later ones keep waiting */
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    next = dev->frame_sequence;
+    while (dev->fsin_running && dev->num_settings &&
+           (s32)(dev->settings[0].sequence - next) <= 0) {
+        if (dev->settings[0].flags & OV9281_SETTINGS_EXPOSURE) {
+            exposure = dev->settings[0].exposure;
+            has_exposure = true;
+        }
+        if (dev->settings[0].flags & OV9281_SETTINGS_GAIN) {
+            gain = dev->settings[0].gain;
+            has_gain = true;
+        }
+        
+        for (i = 1; i < dev->num_settings; i++)
+            dev->settings[i - 1] = dev->settings[i];
+        dev->num_settings--;
+    }
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+    
+    if (!has_exposure && !has_gain)
+        goto unlock;
+    
+    exposure = has_exposure ? ov9281_clamp_exposure(exposure) : dev->cur_exposure;
+    gain = has_gain ? ov9281_clamp_gain(gain) : dev->cur_gain;
+    
+    ret = ov9281_write_reg(dev, OV9281_REG_GROUP_ACCESS, OV9281_GROUP_HOLD_START);
+    if (!ret && has_exposure)
+        ret = ov9281_write_exposure(dev, exposure);
+    if (!ret && has_gain)
+        ret = ov9281_write_gain(dev, gain);
+    if (!ret)
+        ret = ov9281_write_reg(dev, OV9281_REG_GROUP_ACCESS, OV9281_GROUP_HOLD_END);
+    if (!ret)
+        ret = ov9281_write_reg(dev, OV9281_REG_GROUP_ACCESS, OV9281_GROUP_HOLD_LAUNCH);
+    if (ret) {
+        dev_err(&client->dev, "Failed to apply frame settings: %d\n", ret);
+        goto unlock;
+    }
+    
+    dev->cur_exposure = exposure;
+    dev->cur_gain = gain;
+    exposure_us = ov9281_exposure_time_us(dev, exposure);
+    
+    /* The launch latches on the first pulse after it */
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    dev->next_sequence = dev->frame_sequence;
+    dev->next_exposure = exposure;
+    dev->next_exposure_us = exposure_us;
+    dev->next_gain = gain;
+    dev->next_width = dev->fmt.width;
+    dev->next_height = dev->fmt.height;
+    dev->next_valid = true;
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+    
+unlock:
+    mutex_unlock(&dev->lock);
+}
+
+long ov9281_queue_settings(struct ov9281_device *dev, const struct ov9281_frame_settings *settings)
+{
+    unsigned long flags;
+    long ret = 0;
+    int i;
+    
+    if (settings->flags & ~(OV9281_SETTINGS_EXPOSURE | OV9281_SETTINGS_GAIN))
+        return -EINVAL;
+    
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    
+    if (!dev->fsin_running) {
+        /* Frames are only numbered while FSIN triggered */
+        ret = -EINVAL;
+    } else if (dev->num_settings >= OV9281_SETTINGS_QUEUE_DEPTH) {
+        ret = -EBUSY;
+    } else {
+        /* Keep the queue in frame order */
+        i = dev->num_settings;
+        while (i > 0 && (s32)(dev->settings[i - 1].sequence - settings->sequence) > 0) {
+            dev->settings[i] = dev->settings[i - 1];
+            i--;
+        }
+        dev->settings[i] = *settings;
+        dev->num_settings++;
+    }
+    
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+    
+    return ret;
+}
+
+long ov9281_adjust_fsin(struct ov9281_device *dev, const struct ov9281_fsin_adjust *adjust)
+{
+    s64 nominal_ns, trim_ns, max_phase_ns;
+    unsigned long flags;
+    long ret = 0;
+    
+    if (!dev->is_master)
+        return -EINVAL;
+    
+    /* The exposure and readout of the frame rate mode have to fit the period */
+    nominal_ns = ktime_to_ns(dev->fsin_nominal_period);
+    trim_ns = div_s64(nominal_ns * OV9281_FSIN_TRIM_PPM, 1000000);
+    if (adjust->period_ns && abs(adjust->period_ns - nominal_ns) > trim_ns)
+        return -ERANGE;
+    
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    
+    if (!dev->fsin_running) {
+        ret = -EINVAL;
+    } else {
+        if (adjust->period_ns)
+            dev->fsin_period = ns_to_ktime(adjust->period_ns);
+        max_phase_ns = div_s64(ktime_to_ns(dev->fsin_period), 4);
+        dev->fsin_phase_ns = clamp_t(s64, adjust->phase_ns, -max_phase_ns, max_phase_ns);
+    }
+    
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+    
+    return ret;
+}
+
+static void ov9281_set_fsin_running(struct ov9281_device *dev, bool running)
+{
+    unsigned long flags;
+    
+    spin_lock_irqsave(&dev->fsin_lock, flags);
+    dev->fsin_running = running;
+    dev->fsin_period = dev->fsin_nominal_period;
+    dev->fsin_phase_ns = 0;
+    dev->frame_sequence = 0;
+    dev->num_settings = 0;
+    dev->next_valid = false;
+    dev->frame_width = dev->fmt.width;
+    dev->frame_height = dev->fmt.height;
+    spin_unlock_irqrestore(&dev->fsin_lock, flags);
+}
+
+int ov9281_start_fsin_trigger(struct ov9281_device *dev)
+{
+    struct i2c_client *client = dev->client;
+    int i, ret;
+    
+    if (!dev->is_master)
+        return -EINVAL;
+    
+    if (dev->sync_gpio < 0) {
+        dev_err(&client->dev, "FSIN trigger needs a sync GPIO\n");
+        return -ENODEV;
+    }
+    
+    /* The master keeps its role but exposes on FSIN like the slaves */
+    ret = ov9281_write_reg_array(dev, ov9281_external_regs);
+    if (ret)
+        return ret;
+    
+    for (i = 0; i < dev->num_slaves; i++) {
+        if (!dev->slaves[i])
+            continue;
+        
+        ret = ov9281_set_mode(dev->slaves[i], OV9281_SYNC_MODE_EXTERNAL);
+        if (ret)
+            return ret;
+        ov9281_set_fsin_running(dev->slaves[i], true);
+    }
+    
+    ov9281_set_fsin_running(dev, true);
+    hrtimer_start(&dev->fsin_timer, dev->fsin_period, HRTIMER_MODE_REL);
+    
+    return 0;
+}
+
+void ov9281_stop_fsin_trigger(struct ov9281_device *dev)
+{
+    int i;
+    
+    hrtimer_cancel(&dev->fsin_timer);
+    hrtimer_cancel(&dev->slice_timer);
+    
+    /* Restore the free running sync configuration, queued settings are dropped */
+    ov9281_set_fsin_running(dev, false);
+    ov9281_write_reg_array(dev, ov9281_master_regs);
+    for (i = 0; i < dev->num_slaves; i++) {
+        if (!dev->slaves[i])
+            continue;
+        
+        ov9281_set_fsin_running(dev->slaves[i], false);
+        ov9281_set_mode(dev->slaves[i], OV9281_SYNC_MODE_SLAVE);
+    }
+}
+
 /* V4L2 subdev operations */
 static int ov9281_s_power(struct v4l2_subdev *sd, int on)
 {
@@ -780,36 +1302,11 @@ static int ov9281_g_frame_interval(struct v4l2_subdev *sd,
     
     mutex_lock(&dev->lock);
     
-    switch (dev->frame_rate) {
-    case OV9281_30_FPS:
-        fi->interval.numerator = 1;
-        fi->interval.denominator = 30;
-        break;
-    case OV9281_60_FPS:
-        fi->interval.numerator = 1;
-        fi->interval.denominator = 60;
-        break;
-    case OV9281_90_FPS:
-        fi->interval.numerator = 1;
-        fi->interval.denominator = 90;
-        break;
-    case OV9281_120_FPS:
-        fi->interval.numerator = 1;
-        fi->interval.denominator = 120;
-        break;
-    case OV9281_150_FPS:
-        fi->interval.numerator = 1;
-        fi->interval.denominator = 150;
-        break;
-    case OV9281_180_FPS:
-        fi->interval.numerator = 1;
-        fi->interval.denominator = 180;
-        break;
-    default:
-        fi->interval.numerator = 1;
+    fi->interval.numerator = 1;
+    if (dev->frame_rate <= OV9281_360_FPS)
+        fi->interval.denominator = ov9281_frame_timings[dev->frame_rate].fps;
+    else
         fi->interval.denominator = 60;
-        break;
-    }
     
     mutex_unlock(&dev->lock);
     
@@ -828,20 +1325,9 @@ static int ov9281_s_frame_interval(struct v4l2_subdev *sd,
         /* Default to 60 FPS */
         ret = ov9281_set_frame_rate(dev, OV9281_60_FPS);
     } else {
-        int fps = fi->interval.denominator / fi->interval.numerator;
+        u32 fps = fi->interval.denominator / fi->interval.numerator;
         
-        if (fps <= 30)
-            ret = ov9281_set_frame_rate(dev, OV9281_30_FPS);
-        else if (fps <= 60)
-            ret = ov9281_set_frame_rate(dev, OV9281_60_FPS);
-        else if (fps <= 90)
-            ret = ov9281_set_frame_rate(dev, OV9281_90_FPS);
-        else if (fps <= 120)
-            ret = ov9281_set_frame_rate(dev, OV9281_120_FPS);
-        else if (fps <= 150)
-            ret = ov9281_set_frame_rate(dev, OV9281_150_FPS);
-        else
-            ret = ov9281_set_frame_rate(dev, OV9281_180_FPS);
+        ret = ov9281_set_frame_rate(dev, ov9281_frame_rate_for_fps(dev->readout, fps));
     }
     
     mutex_unlock(&dev->lock);
@@ -865,16 +1351,17 @@ static int ov9281_enum_frame_size(struct v4l2_subdev *sd,
                                 struct v4l2_subdev_pad_config *cfg,
                                 struct v4l2_subdev_frame_size_enum *fse)
 {
-    if (fse->index > 0)
+    /* The full array, and the binned or skipped one */
+    if (fse->index > OV9281_READOUT_BINNING)
         return -EINVAL;
     
     if (fse->code != MEDIA_BUS_FMT_Y10_1X10)
         return -EINVAL;
     
-    fse->min_width = OV9281_MIN_WIDTH;
-    fse->max_width = OV9281_MAX_WIDTH;
-    fse->min_height = OV9281_MIN_HEIGHT;
-    fse->max_height = OV9281_MAX_HEIGHT;
+    fse->min_width = ov9281_readout_timings[fse->index].width;
+    fse->max_width = fse->min_width;
+    fse->min_height = ov9281_readout_timings[fse->index].height;
+    fse->max_height = fse->min_height;
     
     return 0;
 }
@@ -898,8 +1385,10 @@ static int ov9281_set_fmt(struct v4l2_subdev *sd,
                         struct v4l2_subdev_pad_config *cfg,
                         struct v4l2_subdev_format *format)
 {
-    struct ov9281_device *dev = container_of(sd, struct ov9281_device, sd);
     struct v4l2_mbus_framefmt *fmt = &format->format;
+    struct ov9281_device *dev = container_of(sd, struct ov9281_device, sd);
+    enum ov9281_readout readout;
+    int ret = 0;
     
     mutex_lock(&dev->lock);
     
@@ -907,30 +1396,40 @@ static int ov9281_set_fmt(struct v4l2_subdev *sd,
     if (fmt->code != MEDIA_BUS_FMT_Y10_1X10)
         fmt->code = MEDIA_BUS_FMT_Y10_1X10;
     
-    /* Clamp width and height */
-    if (fmt->width > OV9281_MAX_WIDTH)
-        fmt->width = OV9281_MAX_WIDTH;
-    else if (fmt->width < OV9281_MIN_WIDTH)
-        fmt->width = OV9281_MIN_WIDTH;
-    
-    if (fmt->height > OV9281_MAX_HEIGHT)
-        fmt->height = OV9281_MAX_HEIGHT;
-    else if (fmt->height < OV9281_MIN_HEIGHT)
-        fmt->height = OV9281_MIN_HEIGHT;
+    /* Up to the subsampled size is read binned, unless skipping was selected */
+    if (fmt->width <= OV9281_SUBSAMPLED_WIDTH && fmt->height <= OV9281_SUBSAMPLED_HEIGHT)
+        readout = dev->readout == OV9281_READOUT_SKIPPING ? OV9281_READOUT_SKIPPING : OV9281_READOUT_BINNING;
+    else
+        readout = OV9281_READOUT_FULL;
+    fmt->width = ov9281_readout_timings[readout].width;
+    fmt->height = ov9281_readout_timings[readout].height;
     
     /* Set field and colorspace */
     fmt->field = V4L2_FIELD_NONE;
     fmt->colorspace = V4L2_COLORSPACE_RAW;
     
+    if (format->which == V4L2_SUBDEV_FORMAT_TRY) {
+        cfg->try_fmt = *fmt;
+        goto unlock;
+    }
+    
+    /* The fastest modes only fit a subsampled readout */
+    if (readout != dev->readout) {
+        ret = ov9281_set_readout(dev, readout,
+                                 min_t(enum ov9281_frame_rate, dev->frame_rate,
+                                       readout == OV9281_READOUT_FULL ?
+                                       OV9281_180_FPS : OV9281_360_FPS), NULL);
+        if (ret)
+            goto unlock;
+    }
+    
     /* Update format */
     dev->fmt = *fmt;
     
-    if (format->which == V4L2_SUBDEV_FORMAT_TRY)
-        cfg->try_fmt = *fmt;
-    
+unlock:
     mutex_unlock(&dev->lock);
     
-    return 0;
+    return ret;
 }
 
 static int ov9281_s_stream(struct v4l2_subdev *sd, int enable)
@@ -950,6 +1449,38 @@ static int ov9281_s_stream(struct v4l2_subdev *sd, int enable)
     return ret;
 }
 
+static long ov9281_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg)
+{
+    struct ov9281_device *dev = container_of(sd, struct ov9281_device, sd);
+    
+    switch (cmd) {
+    case OV9281_IOC_QUEUE_SETTINGS:
+        return ov9281_queue_settings(dev, arg);
+    case OV9281_IOC_ADJUST_FSIN:
+        return ov9281_adjust_fsin(dev, arg);
+    case OV9281_IOC_SET_READOUT:
+        return ov9281_switch_readout(dev, arg);
+    default:
+        return -ENOIOCTLCMD;
+    }
+}
+
+static int ov9281_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+                                  struct v4l2_event_subscription *sub)
+{
+    switch (sub->type) {
+    case V4L2_EVENT_FRAME_SYNC:
+    case OV9281_EVENT_EXPOSURE:
+        return v4l2_event_subscribe(fh, sub, OV9281_EVENT_QUEUE_DEPTH, NULL);
+    case OV9281_EVENT_SLICE:
+        return v4l2_event_subscribe(fh, sub, OV9281_MAX_SLICES, NULL);
+    case V4L2_EVENT_CTRL:
+        return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+    default:
+        return -EINVAL;
+    }
+}
+
 /* V4L2 control operations */
 static int ov9281_s_ctrl(struct v4l2_ctrl *ctrl)
 {
@@ -989,6 +1520,12 @@ static int ov9281_s_ctrl(struct v4l2_ctrl *ctrl)
             dev->vr_mode = ctrl->val;
         } else if (ctrl->id == ov9281_ctrl_low_latency.id) {
             dev->low_latency = ctrl->val;
+        } else if (ctrl->id == ov9281_ctrl_fsin_trigger.id) {
+            dev->fsin_trigger = ctrl->val;
+        } else if (ctrl->id == ov9281_ctrl_slice_count.id) {
+            dev->num_slices = ctrl->val;
+        } else if (ctrl->id == ov9281_ctrl_readout.id) {
+            ret = ov9281_set_readout(dev, ctrl->val, dev->frame_rate, NULL);
         } else {
             ret = -EINVAL;
         }
@@ -1003,6 +1540,9 @@ static int ov9281_s_ctrl(struct v4l2_ctrl *ctrl)
 /* V4L2 subdev operations */
 const struct v4l2_subdev_core_ops ov9281_core_ops = {
     .s_power = ov9281_s_power,
+    .ioctl = ov9281_ioctl,
+    .subscribe_event = ov9281_subscribe_event,
+    .unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
 const struct v4l2_subdev_video_ops ov9281_video_ops = {
@@ -1047,7 +1587,7 @@ const struct v4l2_ctrl_config ov9281_ctrl_frame_rate = {
     .name = "Frame Rate Mode",
     .type = V4L2_CTRL_TYPE_INTEGER,
     .min = OV9281_30_FPS,
-    .max = OV9281_180_FPS,
+    .max = OV9281_360_FPS,
     .step = 1,
     .def = OV9281_60_FPS,
 };
@@ -1074,6 +1614,39 @@ const struct v4l2_ctrl_config ov9281_ctrl_low_latency = {
     .def = 0,
 };
 
+const struct v4l2_ctrl_config ov9281_ctrl_fsin_trigger = {
+    .ops = &ov9281_ctrl_ops,
+    .id = V4L2_CID_PRIVATE_BASE + 4,
+    .name = "FSIN Trigger",
+    .type = V4L2_CTRL_TYPE_BOOLEAN,
+    .min = 0,
+    .max = 1,
+    .step = 1,
+    .def = 0,
+};
+
+const struct v4l2_ctrl_config ov9281_ctrl_slice_count = {
+    .ops = &ov9281_ctrl_ops,
+    .id = V4L2_CID_PRIVATE_BASE + 5,
+    .name = "Slice Count",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = 0,
+    .max = OV9281_MAX_SLICES,
+    .step = 1,
+    .def = 0,
+};
+
+const struct v4l2_ctrl_config ov9281_ctrl_readout = {
+    .ops = &ov9281_ctrl_ops,
+    .id = V4L2_CID_PRIVATE_BASE + 6,
+    .name = "Readout Mode",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = OV9281_READOUT_FULL,
+    .max = OV9281_READOUT_SKIPPING,
+    .step = 1,
+    .def = OV9281_READOUT_FULL,
+};
+
 /* Core probe function */
 int ov9281_core_probe(struct i2c_client *client, const struct i2c_device_id *id)
 {
@@ -1095,6 +1668,16 @@ int ov9281_core_probe(struct i2c_client *client, const struct i2c_device_id *id)
     /* Initialize mutex */
     mutex_init(&ov9281_dev->lock);
     
+    /* Initialize FSIN trigger */
+    spin_lock_init(&ov9281_dev->fsin_lock);
+    hrtimer_init(&ov9281_dev->fsin_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    ov9281_dev->fsin_timer.function = ov9281_fsin_timer_fn;
+    hrtimer_init(&ov9281_dev->slice_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    ov9281_dev->slice_timer.function = ov9281_slice_timer_fn;
+    INIT_WORK(&ov9281_dev->settings_work, ov9281_settings_work_fn);
+    ov9281_dev->fsin_nominal_period = ns_to_ktime(div_u64(NSEC_PER_SEC, OV9281_DEFAULT_FRAMERATE));
+    ov9281_dev->fsin_period = ov9281_dev->fsin_nominal_period;
+    
     /* Get resources */
     ov9281_dev->xvclk = devm_clk_get(dev, "xvclk");
     if (IS_ERR(ov9281_dev->xvclk)) {
@@ -1152,6 +1735,7 @@ int ov9281_core_probe(struct i2c_client *client, const struct i2c_device_id *id)
     /* Initialize V4L2 subdev */
     sd = &ov9281_dev->sd;
     v4l2_i2c_subdev_init(sd, client, &ov9281_subdev_ops);
+    sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE | V4L2_SUBDEV_FL_HAS_EVENTS;
     
     /* Initialize media pad */
     pad = &ov9281_dev->pad;
@@ -1164,7 +1748,7 @@ int ov9281_core_probe(struct i2c_client *client, const struct i2c_device_id *id)
     
     /* Initialize controls */
     handler = &ov9281_dev->ctrl_handler;
-    ret = v4l2_ctrl_handler_init(handler, 10);
+    ret = v4l2_ctrl_handler_init(handler, 13);
     if (ret) {
         dev_err(dev, "Failed to initialize control handler: %d\n", ret);
         goto err_media_entity_cleanup;
@@ -1208,6 +1792,9 @@ int ov9281_core_probe(struct i2c_client *client, const struct i2c_device_id *id)
     v4l2_ctrl_new_custom(handler, &ov9281_ctrl_frame_rate, NULL);
     v4l2_ctrl_new_custom(handler, &ov9281_ctrl_vr_mode, NULL);
     v4l2_ctrl_new_custom(handler, &ov9281_ctrl_low_latency, NULL);
+    v4l2_ctrl_new_custom(handler, &ov9281_ctrl_fsin_trigger, NULL);
+    v4l2_ctrl_new_custom(handler, &ov9281_ctrl_slice_count, NULL);
+    v4l2_ctrl_new_custom(handler, &ov9281_ctrl_readout, NULL);
     
     if (handler->error) {
         ret = handler->error;
@@ -1226,6 +1813,8 @@ int ov9281_core_probe(struct i2c_client *client, const struct i2c_device_id *id)
     ov9281_dev->low_latency = false;
     ov9281_dev->high_framerate = false;
     ov9281_dev->zero_copy_enabled = false;
+    ov9281_dev->fsin_trigger = false;
+    ov9281_dev->num_slices = 0;
     
     /* Register V4L2 subdev */
     ret = v4l2_async_register_subdev(sd);
@@ -1259,6 +1848,11 @@ int ov9281_core_remove(struct i2c_client *client)
     struct v4l2_subdev *sd = i2c_get_clientdata(client);
     struct ov9281_device *dev = container_of(sd, struct ov9281_device, sd);
     
+    /* Stop the FSIN trigger */
+    hrtimer_cancel(&dev->fsin_timer);
+    hrtimer_cancel(&dev->slice_timer);
+    cancel_work_sync(&dev->settings_work);
+    
     /* Disable runtime PM */
     pm_runtime_disable(&client->dev);
     
@@ -9,6 +9,10 @@
 #define _OV9281_CORE_H_
 
 #include <linux/types.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/videodev2.h>
 #include <linux/v4l2-mediabus.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-subdev.h>
@@ -36,7 +40,12 @@
 #define OV9281_REG_AEC_MANUAL          0x3503
 #define OV9281_REG_AEC_AGC_ADJ_H       0x3508
 #define OV9281_REG_AEC_AGC_ADJ_L       0x3509
+#define OV9281_REG_GROUP_ACCESS        0x3208
 #define OV9281_REG_TIMING_CONTROL      0x3800
+#define OV9281_REG_TIMING_X_OUTPUT_H   0x3808
+#define OV9281_REG_TIMING_X_OUTPUT_L   0x3809
+#define OV9281_REG_TIMING_Y_OUTPUT_H   0x380A
+#define OV9281_REG_TIMING_Y_OUTPUT_L   0x380B
 #define OV9281_REG_TIMING_HTS_H        0x380C
 #define OV9281_REG_TIMING_HTS_L        0x380D
 #define OV9281_REG_TIMING_VTS_H        0x380E
@@ -76,7 +85,9 @@
 #define OV9281_DEFAULT_LINK_FREQ       400000000
 #define OV9281_DEFAULT_MBUS_CODE       MEDIA_BUS_FMT_Y10_1X10
 #define OV9281_DEFAULT_FRAMERATE       60
-#define OV9281_MAX_FRAMERATE           180
+#define OV9281_MAX_FRAMERATE           360
+#define OV9281_SUBSAMPLED_WIDTH        640
+#define OV9281_SUBSAMPLED_HEIGHT       400
 #define OV9281_DEFAULT_EXPOSURE        500
 #define OV9281_DEFAULT_GAIN            1000
 #define OV9281_DEFAULT_TEST_PATTERN    0
@@ -87,11 +98,17 @@
 #define OV9281_RESET_VALUE             0x1
 #define OV9281_FLIP_ENABLE             0x3
 #define OV9281_FLIP_DISABLE            0x0
+#define OV9281_BINNING_ENABLE          0x40
+#define OV9281_INC_FULL                0x11
+#define OV9281_INC_SKIP                0x31
 #define OV9281_EXPOSURE_MANUAL         0x1
 #define OV9281_EXPOSURE_AUTO           0x0
 #define OV9281_SYNC_MASTER             0x0
 #define OV9281_SYNC_SLAVE              0x1
 #define OV9281_SYNC_EXTERNAL           0x2
+#define OV9281_GROUP_HOLD_START        0x00
+#define OV9281_GROUP_HOLD_END          0x10
+#define OV9281_GROUP_HOLD_LAUNCH       0xA0
 
 /* OV9281 Exposure/Gain Limits */
 #define OV9281_EXPOSURE_MIN            1
@@ -103,6 +120,106 @@
 #define OV9281_GAIN_STEP               1
 #define OV9281_GAIN_DEFAULT            1024
 
+/* OV9281 FSIN Trigger */
+#define OV9281_FSIN_PULSE_US           10
+#define OV9281_EVENT_QUEUE_DEPTH       8
+#define OV9281_MAX_SLICES              16
+#define OV9281_SLICE_LATENCY_US        50
+
+/*
+ * Exposure event, queued on the subdev of every triggered sensor for each
+ * FSIN pulse. start_ns is the CLOCK_MONOTONIC time of the pulse, that starts
+ * the exposure of all sensors, and exposure_us the exposure latched for the
+ * frame. V4L2_EVENT_FRAME_SYNC is queued alongside with the same sequence.
+ */
+#define OV9281_EVENT_EXPOSURE          (V4L2_EVENT_PRIVATE_START + 1)
+
+struct ov9281_exposure_event {
+    __u32 sequence;
+    __u32 exposure_us;
+    __u64 start_ns;
+    __u32 exposure;     /* exposure register value applied to the frame */
+    __u32 gain;         /* gain register value applied to the frame */
+    __u16 width;        /* output size of the readout mode of the frame */
+    __u16 height;
+};
+
+/*
+ * Per-frame settings, queued with OV9281_IOC_QUEUE_SETTINGS on the subdev of
+ * an FSIN triggered sensor. The settings are written in a group hold right
+ * after the FSIN pulse of the frame before sequence, so they latch on the
+ * pulse of sequence; late settings latch on the next pulse and the exposure
+ * event of every frame reports the values it was exposed with.
+ */
+#define OV9281_SETTINGS_EXPOSURE       (1 << 0)
+#define OV9281_SETTINGS_GAIN           (1 << 1)
+#define OV9281_SETTINGS_QUEUE_DEPTH    4
+
+struct ov9281_frame_settings {
+    __u32 sequence;
+    __u32 flags;
+    __u32 exposure;
+    __u32 gain;
+};
+
+#define OV9281_IOC_QUEUE_SETTINGS      _IOW('V', BASE_VIDIOC_PRIVATE + 0, struct ov9281_frame_settings)
+
+/*
+ * FSIN timing adjustment, issued with OV9281_IOC_ADJUST_FSIN on the subdev of
+ * the triggering master, so the frame timing can be locked to an external
+ * clock such as the display vsync. period_ns replaces the trigger period, 0
+ * keeps it; it may be trimmed by up to OV9281_FSIN_TRIM_PPM from the frame
+ * rate mode. phase_ns moves the next pulse once, by at most a quarter of the
+ * period, so the phase slews without a frame being lost.
+ */
+#define OV9281_FSIN_TRIM_PPM           20000
+
+struct ov9281_fsin_adjust {
+    __s64 period_ns;
+    __s64 phase_ns;
+};
+
+#define OV9281_IOC_ADJUST_FSIN         _IOW('V', BASE_VIDIOC_PRIVATE + 1, struct ov9281_fsin_adjust)
+
+/*
+ * Readout mode switch, issued with OV9281_IOC_SET_READOUT on the subdev of a
+ * sensor. The binning and skipping modes read 640x400 out of the full array;
+ * binning sums 2x2 pixels, skipping reads every other line and column. The
+ * line length, frame length and readout of the mode are written in one group
+ * hold, so a streaming sensor switches on a frame boundary without going
+ * through standby, and the trigger of an FSIN master is retimed from the next
+ * pulse. fps selects the slowest frame rate mode at least as fast, the 240 and
+ * 360 fps modes need a subsampled readout; it returns the frame rate of the
+ * mode, with width and height the output size, and sequence the first frame
+ * of the new mode while FSIN triggered.
+ */
+struct ov9281_readout_mode {
+    __u32 readout;
+    __u32 fps;
+    __u32 width;
+    __u32 height;
+    __u32 sequence;
+};
+
+#define OV9281_IOC_SET_READOUT         _IOWR('V', BASE_VIDIOC_PRIVATE + 2, struct ov9281_readout_mode)
+
+/*
+ * Slice event, queued while an FSIN triggered frame is read out when the
+ * slice count control is set: the lines [first_line, first_line + num_lines)
+ * of frame sequence have been transferred at ready_ns (CLOCK_MONOTONIC),
+ * estimated from the exposure and the line time plus the receiver latency.
+ */
+#define OV9281_EVENT_SLICE             (V4L2_EVENT_PRIVATE_START + 2)
+
+struct ov9281_slice_event {
+    __u32 sequence;
+    __u16 slice;
+    __u16 num_slices;
+    __u16 first_line;
+    __u16 num_lines;
+    __u64 ready_ns;
+};
+
 /* OV9281 Sync Mode */
 enum ov9281_sync_mode {
     OV9281_SYNC_MODE_MASTER = 0,
@@ -118,6 +235,15 @@ enum ov9281_frame_rate {
     OV9281_120_FPS,
     OV9281_150_FPS,
     OV9281_180_FPS,
+    OV9281_240_FPS,     /* Subsampled readout only */
+    OV9281_360_FPS,     /* Subsampled readout only */
+};
+
+/* OV9281 Readout Mode */
+enum ov9281_readout {
+    OV9281_READOUT_FULL = 0,
+    OV9281_READOUT_BINNING,
+    OV9281_READOUT_SKIPPING,
 };
 
 /* OV9281 Test Pattern */
@@ -156,6 +282,7 @@ struct ov9281_device {
     enum ov9281_state state;
     enum ov9281_sync_mode sync_mode;
     enum ov9281_frame_rate frame_rate;
+    enum ov9281_readout readout;
     
     /* Format */
     struct v4l2_mbus_framefmt fmt;
@@ -192,6 +319,43 @@ struct ov9281_device {
     int num_slaves;
     struct ov9281_device **slaves;
     
+    /* FSIN trigger, the master pulses sync_gpio once per frame */
+    bool fsin_trigger;
+    struct hrtimer fsin_timer;
+    ktime_t fsin_period;
+    ktime_t fsin_nominal_period;    /* Period of the frame rate mode */
+    s64 fsin_phase_ns;              /* Shift of the next pulse, see OV9281_IOC_ADJUST_FSIN */
+    spinlock_t fsin_lock;
+    u32 frame_sequence;
+    u32 cur_exposure;
+    u32 cur_gain;
+    u32 exposure_us;
+    u32 frame_exposure;
+    u32 frame_gain;
+    u32 frame_width;
+    u32 frame_height;
+    bool fsin_running;
+    
+    /* Per-frame settings queue, applied after each FSIN pulse */
+    struct work_struct settings_work;
+    struct ov9281_frame_settings settings[OV9281_SETTINGS_QUEUE_DEPTH];
+    u32 num_settings;
+    bool next_valid;
+    u32 next_sequence;
+    u32 next_exposure;
+    u32 next_exposure_us;
+    u32 next_gain;
+    u32 next_width;
+    u32 next_height;
+    
+    /* Slice delivery of the triggered frames */
+    u32 num_slices;
+    u32 active_slices;
+    struct hrtimer slice_timer;
+    ktime_t slice_readout;
+    u32 slice_sequence;
+    u32 slice_index;
+    
     /* VR-specific optimizations */
     bool vr_mode;
     bool low_latency;
@@ -207,6 +371,8 @@ int ov9281_core_remove(struct i2c_client *client);
 int ov9281_core_init(struct ov9281_device *dev);
 int ov9281_set_mode(struct ov9281_device *dev, enum ov9281_sync_mode mode);
 int ov9281_set_frame_rate(struct ov9281_device *dev, enum ov9281_frame_rate rate);
+int ov9281_set_readout(struct ov9281_device *dev, enum ov9281_readout readout,
+                       enum ov9281_frame_rate rate, u32 *sequence);
 int ov9281_set_test_pattern(struct ov9281_device *dev, enum ov9281_test_pattern pattern);
 int ov9281_set_exposure(struct ov9281_device *dev, u32 exposure);
 int ov9281_set_gain(struct ov9281_device *dev, u32 gain);
@@ -216,6 +382,11 @@ int ov9281_stop_streaming(struct ov9281_device *dev);
 int ov9281_reset(struct ov9281_device *dev);
 int ov9281_enable_zero_copy(struct ov9281_device *dev, bool enable);
 int ov9281_sync_sensors(struct ov9281_device *dev);
+int ov9281_start_fsin_trigger(struct ov9281_device *dev);
+void ov9281_stop_fsin_trigger(struct ov9281_device *dev);
+long ov9281_queue_settings(struct ov9281_device *dev, const struct ov9281_frame_settings *settings);
+long ov9281_adjust_fsin(struct ov9281_device *dev, const struct ov9281_fsin_adjust *adjust);
+long ov9281_switch_readout(struct ov9281_device *dev, struct ov9281_readout_mode *mode);
 
 /* V4L2 subdev operations */
 int ov9281_s_power(struct v4l2_subdev *sd, int on);
@@ -229,6 +400,8 @@ int ov9281_s_stream(struct v4l2_subdev *sd, int enable);
 
 /* V4L2 control operations */
 int ov9281_s_ctrl(struct v4l2_ctrl *ctrl);
+long ov9281_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg);
+int ov9281_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh, struct v4l2_event_subscription *sub);
 
 /* External declarations */
 extern const struct v4l2_subdev_core_ops ov9281_core_ops;
@@ -240,5 +413,8 @@ extern const struct v4l2_ctrl_config ov9281_ctrl_sync_mode;
 extern const struct v4l2_ctrl_config ov9281_ctrl_frame_rate;
 extern const struct v4l2_ctrl_config ov9281_ctrl_vr_mode;
 extern const struct v4l2_ctrl_config ov9281_ctrl_low_latency;
+extern const struct v4l2_ctrl_config ov9281_ctrl_fsin_trigger;
+extern const struct v4l2_ctrl_config ov9281_ctrl_slice_count;
+extern const struct v4l2_ctrl_config ov9281_ctrl_readout;
 
 #endif /* _OV9281_CORE_H_ */
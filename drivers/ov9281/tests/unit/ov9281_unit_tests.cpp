@@ -390,6 +390,236 @@ TEST_F(OV9281UnitTest, VRModeTest) {
     EXPECT_EQ(mock_registers[OV9281_REG_MIPI_CTRL_01], 0x0F);
 }
 
+/* Test FSIN triggered streaming */
+TEST_F(OV9281UnitTest, FsinTriggerTest) {
+    /* Set up mock I2C functions */
+    EXPECT_CALL(*(MockI2C*)client->dev.driver_data, i2c_transfer(_, _, _))
+        .WillRepeatedly(Invoke([this](struct i2c_client *client, struct i2c_msg *msgs, int num) {
+            if (num == 2 && msgs[0].flags == 0 && msgs[1].flags == I2C_M_RD) {
+                /* Read operation */
+                u16 reg = (msgs[0].buf[0] << 8) | msgs[0].buf[1];
+                msgs[1].buf[0] = mock_registers[reg];
+                return 2;
+            } else if (num == 1 && msgs[0].flags == 0) {
+                /* Write operation */
+                u16 reg = (msgs[0].buf[0] << 8) | msgs[0].buf[1];
+                mock_registers[reg] = msgs[0].buf[2];
+                return 1;
+            }
+            return -EIO;
+        }));
+    
+    /* Initialize state */
+    spin_lock_init(&dev->fsin_lock);
+    hrtimer_init(&dev->fsin_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->state = OV9281_STATE_INITIALIZED;
+    dev->is_master = true;
+    dev->fsin_trigger = true;
+    
+    /* The trigger needs a sync GPIO */
+    dev->sync_gpio = -1;
+    int ret = ov9281_start_streaming(dev);
+    EXPECT_EQ(ret, -ENODEV);
+    EXPECT_NE(dev->state, OV9281_STATE_STREAMING);
+    
+    /* The master exposes on FSIN while streaming */
+    dev->sync_gpio = 1;
+    ret = ov9281_start_streaming(dev);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(dev->state, OV9281_STATE_STREAMING);
+    EXPECT_TRUE(dev->is_master);
+    EXPECT_EQ(dev->sync_mode, OV9281_SYNC_MODE_MASTER);
+    EXPECT_EQ(mock_registers[OV9281_REG_SYNC_MODE], 0x02);
+    EXPECT_EQ(dev->frame_sequence, 0u);
+    
+    /* The free running configuration is restored on stop */
+    ret = ov9281_stop_streaming(dev);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(mock_registers[OV9281_REG_SYNC_MODE], 0x00);
+}
+
+/* Test exposure time reported with the exposure events */
+TEST_F(OV9281UnitTest, ExposureTimeTest) {
+    /* Set up mock I2C functions */
+    EXPECT_CALL(*(MockI2C*)client->dev.driver_data, i2c_transfer(_, _, _))
+        .WillRepeatedly(Invoke([this](struct i2c_client *client, struct i2c_msg *msgs, int num) {
+            if (num == 2 && msgs[0].flags == 0 && msgs[1].flags == I2C_M_RD) {
+                /* Read operation */
+                u16 reg = (msgs[0].buf[0] << 8) | msgs[0].buf[1];
+                msgs[1].buf[0] = mock_registers[reg];
+                return 2;
+            } else if (num == 1 && msgs[0].flags == 0) {
+                /* Write operation */
+                u16 reg = (msgs[0].buf[0] << 8) | msgs[0].buf[1];
+                mock_registers[reg] = msgs[0].buf[2];
+                return 1;
+            }
+            return -EIO;
+        }));
+    
+    spin_lock_init(&dev->fsin_lock);
+    
+    /* 60 fps line of 0x500 clocks at 74.25 MHz is 17.24 us */
+    int ret = ov9281_set_frame_rate(dev, OV9281_60_FPS);
+    EXPECT_EQ(ret, 0);
+    
+    /* 100 lines */
+    ret = ov9281_set_exposure(dev, 100 * 16);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(dev->cur_exposure, 1600u);
+    EXPECT_EQ(dev->exposure_us, 1723u);
+    
+    /* Shorter lines at a higher frame rate shorten the same exposure */
+    ret = ov9281_set_frame_rate(dev, OV9281_120_FPS);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(dev->exposure_us, 861u);
+}
+
+/* Test per-frame settings queue */
+TEST_F(OV9281UnitTest, FrameSettingsQueueTest) {
+    struct ov9281_frame_settings settings;
+    memset(&settings, 0, sizeof(settings));
+    spin_lock_init(&dev->fsin_lock);
+    
+    /* Frames are only numbered while FSIN triggered */
+    settings.sequence = 5;
+    settings.flags = OV9281_SETTINGS_EXPOSURE;
+    settings.exposure = 1600;
+    EXPECT_EQ(ov9281_queue_settings(dev, &settings), -EINVAL);
+    
+    dev->fsin_running = true;
+    
+    /* Unknown flags are rejected */
+    settings.flags = 0x80;
+    EXPECT_EQ(ov9281_queue_settings(dev, &settings), -EINVAL);
+    
+    /* Settings are kept in frame order */
+    const u32 sequences[] = { 7, 5, 6, 4 };
+    for (u32 sequence : sequences) {
+        settings.sequence = sequence;
+        settings.flags = OV9281_SETTINGS_EXPOSURE | OV9281_SETTINGS_GAIN;
+        settings.gain = sequence * 16;
+        EXPECT_EQ(ov9281_queue_settings(dev, &settings), 0);
+    }
+    EXPECT_EQ(dev->num_settings, (u32)OV9281_SETTINGS_QUEUE_DEPTH);
+    for (int i = 0; i < OV9281_SETTINGS_QUEUE_DEPTH; i++) {
+        EXPECT_EQ(dev->settings[i].sequence, (u32)(4 + i));
+        EXPECT_EQ(dev->settings[i].gain, (u32)((4 + i) * 16));
+    }
+    
+    /* The queue is bounded */
+    settings.sequence = 8;
+    EXPECT_EQ(ov9281_queue_settings(dev, &settings), -EBUSY);
+}
+
+/* Test FSIN period trim and phase shift */
+TEST_F(OV9281UnitTest, FsinAdjustTest) {
+    struct ov9281_fsin_adjust adjust;
+    memset(&adjust, 0, sizeof(adjust));
+    spin_lock_init(&dev->fsin_lock);
+    dev->fsin_nominal_period = ns_to_ktime(11111111);
+    dev->fsin_period = dev->fsin_nominal_period;
+    
+    /* Only the triggering master, while triggering */
+    EXPECT_EQ(ov9281_adjust_fsin(dev, &adjust), -EINVAL);
+    dev->is_master = true;
+    EXPECT_EQ(ov9281_adjust_fsin(dev, &adjust), -EINVAL);
+    dev->fsin_running = true;
+    
+    /* The period stays within the trim of the frame rate mode */
+    adjust.period_ns = 11111111 + 300000;
+    EXPECT_EQ(ov9281_adjust_fsin(dev, &adjust), -ERANGE);
+    EXPECT_EQ(ktime_to_ns(dev->fsin_period), 11111111);
+    
+    adjust.period_ns = 11111111 - 100000;
+    adjust.phase_ns = -500000;
+    EXPECT_EQ(ov9281_adjust_fsin(dev, &adjust), 0);
+    EXPECT_EQ(ktime_to_ns(dev->fsin_period), 11011111);
+    EXPECT_EQ(dev->fsin_phase_ns, -500000);
+    
+    /* A phase step is bounded by a quarter period, 0 keeps the period */
+    adjust.period_ns = 0;
+    adjust.phase_ns = 5000000;
+    EXPECT_EQ(ov9281_adjust_fsin(dev, &adjust), 0);
+    EXPECT_EQ(ktime_to_ns(dev->fsin_period), 11011111);
+    EXPECT_EQ(dev->fsin_phase_ns, 11011111 / 4);
+}
+
+/* Test binned and skipped readout modes */
+TEST_F(OV9281UnitTest, ReadoutModeTest) {
+    /* Set up mock I2C functions */
+    EXPECT_CALL(*(MockI2C*)client->dev.driver_data, i2c_transfer(_, _, _))
+        .WillRepeatedly(Invoke([this](struct i2c_client *client, struct i2c_msg *msgs, int num) {
+            if (num == 2 && msgs[0].flags == 0 && msgs[1].flags == I2C_M_RD) {
+                /* Read operation */
+                u16 reg = (msgs[0].buf[0] << 8) | msgs[0].buf[1];
+                msgs[1].buf[0] = mock_registers[reg];
+                return 2;
+            } else if (num == 1 && msgs[0].flags == 0) {
+                /* Write operation */
+                u16 reg = (msgs[0].buf[0] << 8) | msgs[0].buf[1];
+                mock_registers[reg] = msgs[0].buf[2];
+                return 1;
+            }
+            return -EIO;
+        }));
+    mutex_init(&dev->lock);
+    spin_lock_init(&dev->fsin_lock);
+    
+    int ret;
+    
+    /* The full array tops out at 180 FPS */
+    ret = ov9281_set_readout(dev, OV9281_READOUT_FULL, OV9281_240_FPS, NULL);
+    EXPECT_EQ(ret, -EINVAL);
+    
+    /* Binned 640x400 at 360 FPS, the flips are kept */
+    mock_registers[OV9281_REG_VFLIP] = 0x04;
+    ret = ov9281_set_readout(dev, OV9281_READOUT_BINNING, OV9281_360_FPS, NULL);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(dev->fmt.width, 640u);
+    EXPECT_EQ(dev->fmt.height, 400u);
+    EXPECT_EQ(dev->vts, 0x0233);
+    EXPECT_EQ(dev->frame_width, 640u);
+    EXPECT_EQ(mock_registers[OV9281_REG_VFLIP], 0x04 | OV9281_BINNING_ENABLE);
+    EXPECT_EQ(mock_registers[OV9281_REG_TIMING_X_INC], OV9281_INC_FULL);
+    EXPECT_EQ(ktime_to_ns(dev->fsin_nominal_period), 2777777);
+    
+    /* Skipping clears the binning bits */
+    ret = ov9281_set_readout(dev, OV9281_READOUT_SKIPPING, OV9281_240_FPS, NULL);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(mock_registers[OV9281_REG_VFLIP], 0x04);
+    EXPECT_EQ(mock_registers[OV9281_REG_TIMING_X_INC], OV9281_INC_SKIP);
+    
+    /* The ioctl rounds the rate up to a mode and reports it */
+    struct ov9281_readout_mode mode;
+    memset(&mode, 0, sizeof(mode));
+    mode.readout = OV9281_READOUT_BINNING;
+    mode.fps = 200;
+    EXPECT_EQ(ov9281_switch_readout(dev, &mode), 0);
+    EXPECT_EQ(mode.fps, 240u);
+    EXPECT_EQ(mode.width, 640u);
+    EXPECT_EQ(dev->frame_rate, OV9281_240_FPS);
+    
+    /* Back to full resolution, the rate is capped at 180 FPS */
+    mode.readout = OV9281_READOUT_FULL;
+    mode.fps = 200;
+    EXPECT_EQ(ov9281_switch_readout(dev, &mode), 0);
+    EXPECT_EQ(mode.fps, 180u);
+    EXPECT_EQ(mode.width, 1280u);
+    EXPECT_EQ(mode.height, 800u);
+    
+    /* While FSIN triggered the new size is reported from the next exposure */
+    dev->fsin_running = true;
+    dev->frame_sequence = 42;
+    mode.readout = OV9281_READOUT_BINNING;
+    mode.fps = 180;
+    EXPECT_EQ(ov9281_switch_readout(dev, &mode), 0);
+    EXPECT_EQ(mode.sequence, 42u);
+    EXPECT_TRUE(dev->next_valid);
+    EXPECT_EQ(dev->next_width, 640u);
+    EXPECT_EQ(dev->frame_width, 1280u);
+}
+
 /* Main function */
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -95,6 +95,15 @@ static const struct intel_ax210_power_config default_power_config = {
     .enable_uapsd = true,               /* Enable U-APSD */
 };
 
+/* Default latency budgets per traffic class, 0 for none */
+static const u32 default_class_deadline_us[INTEL_AX210_TC_COUNT] = {
+    [INTEL_AX210_TC_TRACKING] = 2000,   /* Pose must reach the host within 2 ms */
+    [INTEL_AX210_TC_CONTROL] = 4000,
+    [INTEL_AX210_TC_VIDEO] = 11000,     /* One frame at 90 Hz */
+    [INTEL_AX210_TC_AUDIO] = 20000,
+    [INTEL_AX210_TC_BACKGROUND] = 0,
+};
+
 /* Private data for registered applications */
 struct intel_ax210_vr_app {
     struct list_head list;
@@ -102,6 +111,16 @@ struct intel_ax210_vr_app {
     u32 id;
 };
 
+/* Scheduling state of a queued packet, kept in skb->cb until hand-off */
+struct intel_ax210_vr_skb_cb {
+    ktime_t enqueue_time;
+    ktime_t deadline;                   /* KTIME_MAX for none */
+};
+
+#define INTEL_AX210_VR_SKB_CB(skb) ((struct intel_ax210_vr_skb_cb *)(skb)->cb)
+
+static void intel_ax210_vr_tx_work(struct work_struct *work);
+
 /* Initialize driver private data */
 static void intel_ax210_vr_init_priv(struct intel_ax210_vr_priv *priv)
 {
@@ -131,6 +150,14 @@ static void intel_ax210_vr_init_priv(struct intel_ax210_vr_priv *priv)
     /* Initialize locks */
     spin_lock_init(&priv->lock);
 
+    /* Initialize TX queues */
+    for (i = 0; i < INTEL_AX210_TC_COUNT; i++) {
+        skb_queue_head_init(&priv->tx_queue[i]);
+        priv->class_deadline_us[i] = default_class_deadline_us[i];
+    }
+    priv->drop_expired_mask = BIT(INTEL_AX210_TC_VIDEO);  /* A late video slice is useless */
+    spin_lock_init(&priv->tx_lock);
+
     /* Initialize statistics */
     atomic_set(&priv->tracking_packets, 0);
     atomic_set(&priv->control_packets, 0);
@@ -176,6 +203,7 @@ int intel_ax210_vr_init(struct net_device *dev)
     INIT_DELAYED_WORK(&priv->metrics_work, intel_ax210_vr_update_metrics);
     INIT_DELAYED_WORK(&priv->channel_scan_work, intel_ax210_vr_scan_channels);
     INIT_DELAYED_WORK(&priv->power_adjust_work, intel_ax210_vr_adjust_power);
+    INIT_DELAYED_WORK(&priv->tx_work, intel_ax210_vr_tx_work);
 
     /* Initialize netlink interface */
     ret = intel_ax210_vr_init_netlink(priv);
@@ -204,6 +232,7 @@ err_netlink:
     cancel_delayed_work_sync(&priv->metrics_work);
     cancel_delayed_work_sync(&priv->channel_scan_work);
     cancel_delayed_work_sync(&priv->power_adjust_work);
+    cancel_delayed_work_sync(&priv->tx_work);
     destroy_workqueue(priv->wq);
 err_wq:
     kfree(priv);
@@ -215,6 +244,7 @@ void intel_ax210_vr_cleanup(struct net_device *dev)
 {
     struct intel_ax210_vr_priv *priv = dev_get_drvdata(dev);
     struct intel_ax210_vr_app *app, *tmp;
+    int i;
 
     if (!priv)
         return;
@@ -229,8 +259,13 @@ void intel_ax210_vr_cleanup(struct net_device *dev)
     cancel_delayed_work_sync(&priv->metrics_work);
     cancel_delayed_work_sync(&priv->channel_scan_work);
     cancel_delayed_work_sync(&priv->power_adjust_work);
+    cancel_delayed_work_sync(&priv->tx_work);
     destroy_workqueue(priv->wq);
 
+    /* Drop packets still queued */
+    for (i = 0; i < INTEL_AX210_TC_COUNT; i++)
+        skb_queue_purge(&priv->tx_queue[i]);
+
     /* Free application list */
     spin_lock(&priv->app_list_lock);
     list_for_each_entry_safe(app, tmp, &priv->app_list, list) {
@@ -256,6 +291,10 @@ int intel_ax210_vr_set_mode(struct intel_ax210_vr_priv *priv, enum intel_ax210_v
     priv->vr_mode = mode;
     spin_unlock(&priv->lock);
 
+    /* Packets queued in VR mode no longer get an xmit call to flush them */
+    if (mode == INTEL_AX210_VR_MODE_DISABLED && priv->wq)
+        queue_delayed_work(priv->wq, &priv->tx_work, 0);
+
     return 0;
 }
 
@@ -315,9 +354,10 @@ int intel_ax210_vr_set_power_config(struct intel_ax210_vr_priv *priv,
     return 0;
 }
 
-/* Classify packet based on various heuristics */
-enum intel_ax210_traffic_class intel_ax210_vr_classify_packet(struct intel_ax210_vr_priv *priv,
-                                                            struct sk_buff *skb)
+/* Classify packet, deadline_us returns the latency budget of a matching application or 0 */
+static enum intel_ax210_traffic_class intel_ax210_vr_classify(struct intel_ax210_vr_priv *priv,
+                                                            struct sk_buff *skb,
+                                                            u32 *deadline_us)
 {
     struct ethhdr *eth;
     struct iphdr *iph;
@@ -330,6 +370,8 @@ enum intel_ax210_traffic_class intel_ax210_vr_classify_packet(struct intel_ax210
     struct intel_ax210_vr_app *app;
     bool found = false;
 
+    *deadline_us = 0;
+
     if (!priv || !skb)
         return INTEL_AX210_TC_BACKGROUND;
 
@@ -382,18 +424,22 @@ enum intel_ax210_traffic_class intel_ax210_vr_classify_packet(struct intel_ax210
     list_for_each_entry(app, &priv->app_list, list) {
         if (app->info.tracking_port == src_port || app->info.tracking_port == dst_port) {
             tc = INTEL_AX210_TC_TRACKING;
+            *deadline_us = app->info.tracking_deadline_us;
             found = true;
             break;
         } else if (app->info.control_port == src_port || app->info.control_port == dst_port) {
             tc = INTEL_AX210_TC_CONTROL;
+            *deadline_us = app->info.control_deadline_us;
             found = true;
             break;
         } else if (app->info.video_port == src_port || app->info.video_port == dst_port) {
             tc = INTEL_AX210_TC_VIDEO;
+            *deadline_us = app->info.video_deadline_us;
             found = true;
             break;
         } else if (app->info.audio_port == src_port || app->info.audio_port == dst_port) {
             tc = INTEL_AX210_TC_AUDIO;
+            *deadline_us = app->info.audio_deadline_us;
             found = true;
             break;
         }
@@ -435,18 +481,179 @@ enum intel_ax210_traffic_class intel_ax210_vr_classify_packet(struct intel_ax210
     return tc;
 }
 
-/* Schedule packet based on traffic class */
+/* Classify packet based on various heuristics */
+enum intel_ax210_traffic_class intel_ax210_vr_classify_packet(struct intel_ax210_vr_priv *priv,
+                                                            struct sk_buff *skb)
+{
+    u32 deadline_us;
+
+    return intel_ax210_vr_classify(priv, skb, &deadline_us);
+}
+
+/* Insert packet in deadline order, walking from the tail as deadlines mostly grow */
+static void intel_ax210_vr_txq_insert(struct sk_buff_head *queue, struct sk_buff *skb)
+{
+    ktime_t deadline = INTEL_AX210_VR_SKB_CB(skb)->deadline;
+    struct sk_buff *pos;
+
+    skb_queue_reverse_walk(queue, pos) {
+        if (ktime_compare(INTEL_AX210_VR_SKB_CB(pos)->deadline, deadline) <= 0) {
+            __skb_queue_after(queue, pos, skb);
+            return;
+        }
+    }
+
+    __skb_queue_head(queue, skb);
+}
+
+/* Schedule packet based on traffic class, with deadline_us or the class budget if 0 */
 void intel_ax210_vr_schedule_packet(struct intel_ax210_vr_priv *priv,
                                   struct sk_buff *skb,
-                                  enum intel_ax210_traffic_class tc)
+                                  enum intel_ax210_traffic_class tc,
+                                  u32 deadline_us)
 {
+    struct intel_ax210_vr_skb_cb *cb = INTEL_AX210_VR_SKB_CB(skb);
+    struct sk_buff_head *queue = &priv->tx_queue[tc];
+    struct sk_buff *drop = NULL;
+    ktime_t now = ktime_get();
+
+    BUILD_BUG_ON(sizeof(struct intel_ax210_vr_skb_cb) > sizeof(skb->cb));
+
     /* Record timestamp for latency calculation */
-    priv->last_tx_timestamp[tc] = ktime_get();
+    priv->last_tx_timestamp[tc] = now;
 
-    /* In a real driver, this would modify the packet's QoS parameters
-     * and potentially adjust its position in the hardware queue.
-     * For this simulation, we just record the timestamp.
-     */
+    if (!deadline_us)
+        deadline_us = priv->class_deadline_us[tc];
+
+    cb->enqueue_time = now;
+    cb->deadline = deadline_us ? ktime_add_us(now, deadline_us) : KTIME_MAX;
+
+    spin_lock_bh(&priv->tx_lock);
+
+    if (skb_queue_len(queue) >= INTEL_AX210_VR_TXQ_LIMIT) {
+        priv->metrics.class_overflow_drops[tc]++;
+
+        /* A droppable class loses its stalest packet, the others refuse the new one */
+        if (!(priv->drop_expired_mask & BIT(tc))) {
+            spin_unlock_bh(&priv->tx_lock);
+            dev_kfree_skb_any(skb);
+            return;
+        }
+        drop = __skb_dequeue(queue);
+    }
+
+    intel_ax210_vr_txq_insert(queue, skb);
+
+    spin_unlock_bh(&priv->tx_lock);
+
+    if (drop)
+        dev_kfree_skb_any(drop);
+}
+
+/* Account a packet handed to the device */
+static void intel_ax210_vr_account_tx(struct intel_ax210_vr_priv *priv,
+                                    enum intel_ax210_traffic_class tc,
+                                    const struct intel_ax210_vr_skb_cb *cb,
+                                    ktime_t now)
+{
+    struct intel_ax210_performance_metrics *m = &priv->metrics;
+    u32 delay_us = (u32)ktime_to_us(ktime_sub(now, cb->enqueue_time));
+
+    /* Moving average over the last 8 packets */
+    if (!m->class_tx_delay_avg_us[tc])
+        m->class_tx_delay_avg_us[tc] = delay_us;
+    else
+        m->class_tx_delay_avg_us[tc] = (m->class_tx_delay_avg_us[tc] * 7 + delay_us) / 8;
+
+    if (delay_us > m->class_tx_delay_max_us[tc])
+        m->class_tx_delay_max_us[tc] = delay_us;
+
+    if (ktime_after(now, cb->deadline))
+        m->class_deadline_misses[tc]++;
+}
+
+/* Hand packet to the original driver, held is the TX queue the caller already locked */
+static bool intel_ax210_vr_hand_off(struct intel_ax210_vr_priv *priv, struct sk_buff *skb,
+                                  struct netdev_queue *held)
+{
+    struct netdev_queue *txq = netdev_get_tx_queue(priv->dev, skb_get_queue_mapping(skb));
+    netdev_tx_t ret = NETDEV_TX_BUSY;
+
+    /* Never wait for another queue, its owner flushes when it is done */
+    if (txq != held && !__netif_tx_trylock(txq))
+        return false;
+
+    if (!netif_xmit_frozen_or_stopped(txq)) {
+        /*
+         * Software TX timestamp of the hand-off, for senders that asked for one
+         * (SO_TIMESTAMPING), e.g. the pose uplink measuring its queueing delay.
+         * mac80211 takes every packet, so none is stamped twice.
+         */
+        skb_tx_timestamp(skb);
+        ret = priv->orig_ops.ndo_start_xmit(skb, priv->dev);
+    }
+
+    if (txq != held)
+        __netif_tx_unlock(txq);
+
+    return ret == NETDEV_TX_OK;
+}
+
+/*
+ * Send queued packets, highest traffic class first and earliest deadline first
+ * within a class. Expired packets of droppable classes are dropped, a class
+ * whose TX queue is busy is skipped and retried later.
+ */
+static void intel_ax210_vr_tx_flush(struct intel_ax210_vr_priv *priv, struct netdev_queue *held)
+{
+    struct intel_ax210_vr_skb_cb cb;
+    struct sk_buff *skb;
+    bool backlog = false;
+    ktime_t now;
+    int tc;
+
+    spin_lock_bh(&priv->tx_lock);
+
+    for (tc = INTEL_AX210_TC_TRACKING; tc < INTEL_AX210_TC_COUNT; tc++) {
+        while ((skb = __skb_dequeue(&priv->tx_queue[tc])) != NULL) {
+            now = ktime_get();
+            cb = *INTEL_AX210_VR_SKB_CB(skb);
+
+            if ((priv->drop_expired_mask & BIT(tc)) && ktime_after(now, cb.deadline)) {
+                priv->metrics.class_expired_drops[tc]++;
+                dev_kfree_skb_any(skb);
+                continue;
+            }
+
+            /* The cb belongs to the lower layers from here */
+            memset(skb->cb, 0, sizeof(cb));
+
+            if (!intel_ax210_vr_hand_off(priv, skb, held)) {
+                *INTEL_AX210_VR_SKB_CB(skb) = cb;
+                __skb_queue_head(&priv->tx_queue[tc], skb);
+                backlog = true;
+                break;
+            }
+
+            intel_ax210_vr_account_tx(priv, tc, &cb, now);
+        }
+    }
+
+    spin_unlock_bh(&priv->tx_lock);
+
+    /* Busy queues get no new xmit call of their own, poll until they drain */
+    if (backlog)
+        queue_delayed_work(priv->wq, &priv->tx_work, 1);
+}
+
+/* Retry packets left behind by a busy TX queue */
+static void intel_ax210_vr_tx_work(struct work_struct *work)
+{
+    struct intel_ax210_vr_priv *priv = container_of(to_delayed_work(work),
+                                                  struct intel_ax210_vr_priv,
+                                                  tx_work);
+
+    intel_ax210_vr_tx_flush(priv, NULL);
 }
 
 /* Update performance metrics */
@@ -515,6 +722,12 @@ int intel_ax210_vr_register_app(struct intel_ax210_vr_priv *priv,
     if (!priv || !app_info || !app_id)
         return -EINVAL;
 
+    if (app_info->tracking_deadline_us > INTEL_AX210_VR_MAX_DEADLINE_US ||
+        app_info->control_deadline_us > INTEL_AX210_VR_MAX_DEADLINE_US ||
+        app_info->video_deadline_us > INTEL_AX210_VR_MAX_DEADLINE_US ||
+        app_info->audio_deadline_us > INTEL_AX210_VR_MAX_DEADLINE_US)
+        return -EINVAL;
+
     /* Allocate application structure */
     app = kzalloc(sizeof(*app), GFP_KERNEL);
     if (!app)
@@ -564,6 +777,8 @@ netdev_tx_t intel_ax210_vr_start_xmit(struct sk_buff *skb, struct net_device *de
 {
     struct intel_ax210_vr_priv *priv = dev_get_drvdata(dev);
     enum intel_ax210_traffic_class tc;
+    struct netdev_queue *txq;
+    u32 deadline_us;
 
     if (!priv)
         return priv->orig_ops.ndo_start_xmit(skb, dev);
@@ -573,13 +788,16 @@ netdev_tx_t intel_ax210_vr_start_xmit(struct sk_buff *skb, struct net_device *de
         return priv->orig_ops.ndo_start_xmit(skb, dev);
 
     /* Classify packet */
-    tc = intel_ax210_vr_classify_packet(priv, skb);
+    tc = intel_ax210_vr_classify(priv, skb, &deadline_us);
+
+    /* The stack holds the lock of this packet's TX queue for us */
+    txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 
-    /* Schedule packet */
-    intel_ax210_vr_schedule_packet(priv, skb, tc);
+    /* Queue packet by deadline and send whatever is due */
+    intel_ax210_vr_schedule_packet(priv, skb, tc, deadline_us);
+    intel_ax210_vr_tx_flush(priv, txq);
 
-    /* Call original transmit function */
-    return priv->orig_ops.ndo_start_xmit(skb, dev);
+    return NETDEV_TX_OK;
 }
 
 /* Select queue for packet */
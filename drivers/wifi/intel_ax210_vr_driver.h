@@ -15,6 +15,11 @@
 #include <linux/ieee80211.h>
 #include <net/cfg80211.h>
 
+/* Deadline-aware TX scheduling */
+#define INTEL_AX210_TC_COUNT            5       /* Number of traffic classes */
+#define INTEL_AX210_VR_TXQ_LIMIT        256     /* Queued packets per traffic class */
+#define INTEL_AX210_VR_MAX_DEADLINE_US  1000000 /* Longest latency budget (1 s) */
+
 /* VR mode configuration */
 enum intel_ax210_vr_mode {
     INTEL_AX210_VR_MODE_DISABLED = 0,
@@ -143,6 +148,13 @@ struct intel_ax210_performance_metrics {
     u32 audio_queue_depth;              /* Audio queue depth */
     u32 background_queue_depth;         /* Background queue depth */
     
+    /* Per-class TX metrics, indexed by traffic class */
+    u32 class_tx_delay_avg_us[INTEL_AX210_TC_COUNT];  /* Enqueue to device hand-off, average */
+    u32 class_tx_delay_max_us[INTEL_AX210_TC_COUNT];  /* Enqueue to device hand-off, maximum */
+    u32 class_deadline_misses[INTEL_AX210_TC_COUNT];  /* Packets sent after their deadline */
+    u32 class_expired_drops[INTEL_AX210_TC_COUNT];    /* Packets dropped once expired */
+    u32 class_overflow_drops[INTEL_AX210_TC_COUNT];   /* Packets dropped on a full queue */
+    
     /* Timestamp */
     u64 timestamp;                      /* Timestamp (microseconds) */
 };
@@ -154,6 +166,10 @@ struct intel_ax210_vr_app_info {
     u16 control_port;                   /* Port used for control data */
     u16 video_port;                     /* Port used for video data */
     u16 audio_port;                     /* Port used for audio data */
+    u32 tracking_deadline_us;           /* Tracking latency budget (0: class default) */
+    u32 control_deadline_us;            /* Control latency budget (0: class default) */
+    u32 video_deadline_us;              /* Video latency budget (0: class default) */
+    u32 audio_deadline_us;              /* Audio latency budget (0: class default) */
     u32 app_id;                         /* Application ID (returned) */
 };
 
@@ -261,6 +277,10 @@ enum intel_ax210_vr_app_attrs {
     INTEL_AX210_VR_APP_ATTR_VIDEO_PORT,         /* Video port (u16) */
     INTEL_AX210_VR_APP_ATTR_AUDIO_PORT,         /* Audio port (u16) */
     INTEL_AX210_VR_APP_ATTR_ID,                 /* App ID (u32) */
+    INTEL_AX210_VR_APP_ATTR_TRACKING_DEADLINE,  /* Tracking deadline (u32) */
+    INTEL_AX210_VR_APP_ATTR_CONTROL_DEADLINE,   /* Control deadline (u32) */
+    INTEL_AX210_VR_APP_ATTR_VIDEO_DEADLINE,     /* Video deadline (u32) */
+    INTEL_AX210_VR_APP_ATTR_AUDIO_DEADLINE,     /* Audio deadline (u32) */
     INTEL_AX210_VR_APP_ATTR_MAX,
 };
 
@@ -322,6 +342,13 @@ struct intel_ax210_vr_priv {
     struct delayed_work metrics_work;
     struct delayed_work channel_scan_work;
     struct delayed_work power_adjust_work;
+    struct delayed_work tx_work;
+    
+    /* Deadline-aware TX queues, earliest deadline first within a class */
+    struct sk_buff_head tx_queue[INTEL_AX210_TC_COUNT];
+    u32 class_deadline_us[INTEL_AX210_TC_COUNT];  /* Default budgets, 0 for none */
+    u32 drop_expired_mask;                        /* Classes dropped once expired */
+    spinlock_t tx_lock;
     
     /* Locks */
     spinlock_t lock;
@@ -369,7 +396,8 @@ enum intel_ax210_traffic_class intel_ax210_vr_classify_packet(struct intel_ax210
 /* Packet scheduling */
 void intel_ax210_vr_schedule_packet(struct intel_ax210_vr_priv *priv,
                                   struct sk_buff *skb,
-                                  enum intel_ax210_traffic_class tc);
+                                  enum intel_ax210_traffic_class tc,
+                                  u32 deadline_us);
 
 /* Metrics */
 void intel_ax210_vr_update_metrics(struct intel_ax210_vr_priv *priv);
@@ -308,6 +308,45 @@ TEST_F(IntelAX210VRDriverTest, RegisterApp) {
     // function signature and basic parameter validation.
 }
 
+// Test application deadline validation
+TEST_F(IntelAX210VRDriverTest, RegisterAppDeadlines) {
+    struct intel_ax210_vr_app_info app_info;
+    u32 app_id;
+    
+    memset(&app_info, 0, sizeof(app_info));
+    strcpy(app_info.app_name, "TestVRApp");
+    app_info.tracking_port = 1234;
+    app_info.video_port = 1236;
+    
+    // Test with budgets above the limit
+    app_info.tracking_deadline_us = INTEL_AX210_VR_MAX_DEADLINE_US + 1;
+    EXPECT_EQ(-EINVAL, intel_ax210_vr_register_app(&priv, &app_info, &app_id));
+    
+    app_info.tracking_deadline_us = 2000;
+    app_info.video_deadline_us = INTEL_AX210_VR_MAX_DEADLINE_US + 1;
+    EXPECT_EQ(-EINVAL, intel_ax210_vr_register_app(&priv, &app_info, &app_id));
+}
+
+// Test per-class TX metrics reporting
+TEST_F(IntelAX210VRDriverTest, GetClassMetrics) {
+    struct intel_ax210_performance_metrics metrics;
+    
+    priv.metrics.class_tx_delay_avg_us[INTEL_AX210_TC_TRACKING] = 150;
+    priv.metrics.class_tx_delay_max_us[INTEL_AX210_TC_TRACKING] = 900;
+    priv.metrics.class_deadline_misses[INTEL_AX210_TC_CONTROL] = 2;
+    priv.metrics.class_expired_drops[INTEL_AX210_TC_VIDEO] = 7;
+    priv.metrics.class_overflow_drops[INTEL_AX210_TC_BACKGROUND] = 3;
+    
+    memset(&metrics, 0, sizeof(metrics));
+    intel_ax210_vr_get_metrics(&priv, &metrics);
+    
+    EXPECT_EQ(150u, metrics.class_tx_delay_avg_us[INTEL_AX210_TC_TRACKING]);
+    EXPECT_EQ(900u, metrics.class_tx_delay_max_us[INTEL_AX210_TC_TRACKING]);
+    EXPECT_EQ(2u, metrics.class_deadline_misses[INTEL_AX210_TC_CONTROL]);
+    EXPECT_EQ(7u, metrics.class_expired_drops[INTEL_AX210_TC_VIDEO]);
+    EXPECT_EQ(3u, metrics.class_overflow_drops[INTEL_AX210_TC_BACKGROUND]);
+}
+
 // Test application unregistration
 TEST_F(IntelAX210VRDriverTest, UnregisterApp) {
     // Test with null parameters
@@ -6,11 +6,12 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
-#include <queue>
 #include <condition_variable>
+#include <functional>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include "ImuTypes.h"
+#include "timestamp_ring_buffer.hpp"
 
 namespace ORB_SLAM3
 {
@@ -61,7 +62,31 @@ public:
     enum class Interface {
         I2C,
         SPI,
-        UART
+        UART,
+        IIO                 ///< Triggered buffer of the bno085 kernel driver
+    };
+
+    /**
+     * @brief How the acquisition thread waits for new samples on the I2C, SPI and UART interfaces
+     */
+    enum class AcquisitionMode {
+        POLLING,            ///< Read at the configured sample rate
+        DATA_READY_GPIO     ///< Read on each H_INTN falling edge (GPIO character device line event)
+    };
+
+    /**
+     * @brief Block of samples in structure-of-arrays layout, for batched correction
+     */
+    struct SampleBlock {
+        static constexpr size_t kCapacity = 64;
+        size_t size = 0;
+        alignas(16) float accel_x[kCapacity];
+        alignas(16) float accel_y[kCapacity];
+        alignas(16) float accel_z[kCapacity];
+        alignas(16) float gyro_x[kCapacity];
+        alignas(16) float gyro_y[kCapacity];
+        alignas(16) float gyro_z[kCapacity];
+        double timestamp[kCapacity];
     };
 
     /**
@@ -79,12 +104,28 @@ public:
         bool use_sensor_fusion = true;                ///< Whether to use on-chip sensor fusion
         bool enable_calibration = true;               ///< Whether to enable continuous calibration
         
+        // Data-ready acquisition
+        AcquisitionMode acquisition_mode = AcquisitionMode::POLLING; ///< How samples are waited for
+        std::string int_gpio_chip = "/dev/gpiochip0"; ///< GPIO chip of the H_INTN line (DATA_READY_GPIO)
+        int int_gpio_line = -1;                       ///< H_INTN line offset on the chip (DATA_READY_GPIO)
+        
+        // Kernel driver (Interface::IIO)
+        std::string iio_device = "iio:device0";       ///< IIO device of the kernel driver
+        int iio_watermark = 1;                        ///< Scans buffered per wakeup of the acquisition thread
+        
         // IMU noise parameters (used for ORB-SLAM3 integration)
         float gyro_noise = 1.7e-4f;                   ///< Gyroscope noise (rad/s/sqrt(Hz))
         float accel_noise = 2.0e-3f;                  ///< Accelerometer noise (m/s^2/sqrt(Hz))
         float gyro_walk = 1.9e-5f;                    ///< Gyroscope random walk (rad/s^2/sqrt(Hz))
         float accel_walk = 3.0e-3f;                   ///< Accelerometer random walk (m/s^3/sqrt(Hz))
         
+        // Sensor error model, corrected = M * (raw - bias - k * (temperature - reference_temperature))
+        Eigen::Matrix3f accel_misalignment = Eigen::Matrix3f::Identity(); ///< Accelerometer misalignment and scale M
+        Eigen::Matrix3f gyro_misalignment = Eigen::Matrix3f::Identity();  ///< Gyroscope misalignment and scale M
+        Eigen::Vector3f accel_temp_coeff = Eigen::Vector3f::Zero();       ///< Accelerometer bias drift k (m/s^2/degC)
+        Eigen::Vector3f gyro_temp_coeff = Eigen::Vector3f::Zero();        ///< Gyroscope bias drift k (rad/s/degC)
+        float reference_temperature = 25.0f;          ///< Temperature the biases were estimated at (degC)
+        
         // Transformation from IMU to camera frame (Tbc)
         Eigen::Matrix4f T_bc = Eigen::Matrix4f::Identity(); ///< Transform from body (IMU) to camera
     };
@@ -118,20 +159,35 @@ public:
     void StopAcquisition();
     
     /**
-     * @brief Get the latest IMU measurements
+     * @brief Get the IMU measurements received since the previous call
      * @param max_samples Maximum number of samples to retrieve (0 for all available)
-     * @return Vector of IMU::Point measurements
+     * @return Vector of IMU::Point measurements, oldest first
      */
     std::vector<IMU::Point> GetMeasurements(size_t max_samples = 0);
     
     /**
-     * @brief Get the latest IMU measurements within a time range
+     * @brief Get a copy of the IMU measurements within a time range
+     * 
+     * The measurements stay available to other readers. Use
+     * GetMeasurementBuffer().GetRange() to read them without copying.
+     * 
      * @param start_time Start time in seconds
      * @param end_time End time in seconds
-     * @return Vector of IMU::Point measurements
+     * @return Vector of IMU::Point measurements, oldest first
      */
     std::vector<IMU::Point> GetMeasurementsInTimeRange(double start_time, double end_time);
     
+    /**
+     * @brief Get the ring of the latest IMU measurements
+     * 
+     * Written by the acquisition thread only. Readers query it without locking
+     * and never block acquisition; see TimestampRingBuffer for the validation
+     * a reader has to do.
+     * 
+     * @return Ring of calibrated measurements with increasing timestamps
+     */
+    const TimestampRingBuffer<IMU::Point>& GetMeasurementBuffer() const;
+    
     /**
      * @brief Get the latest orientation estimate from the BNO085's internal fusion
      * @return Quaternion representing the orientation (w, x, y, z)
@@ -206,6 +262,24 @@ public:
      */
     void SetImuToCameraTransform(const Sophus::SE3<float>& T_bc);
     
+    /**
+     * @brief Get the offset of the IMU clock to the camera clock
+     * @return IMU minus camera time in seconds, subtracted from every measurement timestamp
+     */
+    double GetTimeOffset() const;
+    
+    /**
+     * @brief Set the IMU to camera transform and the clock offset as one update
+     * 
+     * Measurements published from then on are stamped with the new offset. An
+     * increase moves the timestamps back, the measurements that would land
+     * before the last one published are dropped.
+     * 
+     * @param T_bc Sophus::SE3f object representing the transformation
+     * @param time_offset IMU minus camera time in seconds
+     */
+    void SetImuToCameraCalibration(const Sophus::SE3<float>& T_bc, double time_offset);
+    
     /**
      * @brief Check if the sensor is currently connected and responding
      * @return True if sensor is connected, false otherwise
@@ -229,6 +303,27 @@ public:
      * @return Firmware version string
      */
     std::string GetFirmwareVersion() const;
+    
+    /**
+     * @brief Register a callback invoked for every new measurement
+     * 
+     * The callback runs on the acquisition thread after the measurement has
+     * been queued, so it must not block. Register it before StartAcquisition().
+     * 
+     * @param callback Function called with each calibrated measurement
+     */
+    void RegisterMeasurementCallback(std::function<void(const IMU::Point&)> callback);
+    
+    /**
+     * @brief Apply the sensor error model and bias correction to a block of raw samples, in place
+     * 
+     * Same correction as for single measurements, with the misalignment and
+     * scale matrices applied four samples at a time (NEON on aarch64). The
+     * temperature is the last one the sensor reported.
+     * 
+     * @param block Raw samples, corrected on return
+     */
+    void ApplyCalibrationAndBias(SampleBlock& block) const;
 
 private:
     // Configuration
@@ -237,20 +332,43 @@ private:
     // Communication interface
     int mDeviceHandle;
     
+    // Data-ready source: GPIO line event fd (DATA_READY_GPIO)
+    int mDataReadyFd;
+    
+    // Layout of one channel in an IIO scan
+    struct IioChannel {
+        size_t offset = 0;      // Byte offset in the scan
+        size_t bytes = 0;       // Storage bytes
+        int bits = 0;           // Significant bits
+        int shift = 0;          // Right shift before masking
+        bool is_signed = false;
+        bool big_endian = false;
+        double scale = 1.0;     // SI units per LSB
+    };
+    
+    // IIO scan layout (Interface::IIO), read from the scan elements when the buffer is opened
+    IioChannel mIioAccel[3];
+    IioChannel mIioGyro[3];
+    IioChannel mIioTimestamp;
+    size_t mIioScanSize;
+    
     // Thread management
     std::thread mAcquisitionThread;
     std::atomic<bool> mRunning;
-    std::mutex mDataMutex;
+    std::mutex mDataMutex;               // Guards the GetMeasurements() cursor only
     std::condition_variable mDataCondition;
     
     // Data storage
-    std::queue<IMU::Point> mMeasurementQueue;
-    size_t mMaxQueueSize;
+    TimestampRingBuffer<IMU::Point> mMeasurements;
+    uint64_t mReadSequence;              // Next measurement returned by GetMeasurements()
+    std::function<void(const IMU::Point&)> mMeasurementCallback;
     
     // Calibration and state
     IMU::Calib mCalibration;
     IMU::Bias mCurrentBias;
+    mutable std::mutex mExtrinsicMutex;  // Guards mT_bc, so it changes together with mTimeOffset
     Sophus::SE3<float> mT_bc;  // Transform from body (IMU) to camera
+    std::atomic<double> mTimeOffset;     // IMU minus camera clock, read for every measurement
     
     // Sensor state
     std::atomic<bool> mIsConnected;
@@ -281,9 +399,80 @@ private:
     
     /**
      * @brief Read raw data from the sensor
+     * @param timestamp Sample time in seconds (CLOCK_MONOTONIC)
+     * @return True if successful, false otherwise
+     */
+    bool ReadRawData(double timestamp);
+    
+    /**
+     * @brief Queue a measurement and hand it to the callback
+     * @param point Calibrated IMU measurement
+     */
+    void PublishMeasurement(const IMU::Point& point);
+    
+    /**
+     * @brief Request falling-edge events on the H_INTN line
+     * @return True if successful, false otherwise
+     */
+    bool OpenDataReadyLine();
+    
+    /**
+     * @brief Wait for the next H_INTN edge
+     * @param timestamp Edge time in seconds (CLOCK_MONOTONIC)
+     * @param timeout_ms Maximum time to wait
+     * @return True if an edge arrived, false on timeout or error
+     */
+    bool WaitForDataReady(double& timestamp, int timeout_ms);
+    
+    /**
+     * @brief Enable the accel, gyro and timestamp scan elements of the IIO device and open its buffer
+     * 
+     * Every other scan element is disabled. The scan layout is computed from
+     * the index and type of the enabled elements, as the IIO core packs them.
+     * 
+     * @return True if successful, false otherwise
+     */
+    bool OpenIioBuffer();
+    
+    /**
+     * @brief Read the index, type and scale of an enabled scan element
+     * @param name Channel name (e.g., "in_accel_x")
+     * @param channel Channel to fill, the offset is left for the caller
+     * @param index Scan index of the channel
+     * @return True if successful, false otherwise
+     */
+    bool ReadIioChannel(const std::string& name, IioChannel& channel, int& index) const;
+    
+    /**
+     * @brief Decode one channel of a scan
+     * @param scan Start of the scan
+     * @param channel Channel layout
+     * @return Raw value, sign-extended
+     */
+    static int64_t DecodeIioChannel(const uint8_t* scan, const IioChannel& channel);
+    
+    /**
+     * @brief Read the scans available in the IIO buffer, in one read
+     * @param timeout_ms Maximum time to wait for the watermark to be reached
+     * @return True if scans were read, false on timeout or error
+     */
+    bool ReadIioBuffer(int timeout_ms);
+    
+    /**
+     * @brief Write a sysfs attribute of the IIO device
+     * @param attribute Path relative to the device directory
+     * @param value Value to write
+     * @return True if successful, false otherwise
+     */
+    bool WriteIioAttribute(const std::string& attribute, const std::string& value) const;
+    
+    /**
+     * @brief Read a sysfs attribute of the IIO device
+     * @param attribute Path relative to the device directory
+     * @param value Read value
      * @return True if successful, false otherwise
      */
-    bool ReadRawData();
+    bool ReadIioAttribute(const std::string& attribute, std::string& value) const;
     
     /**
      * @brief Process raw data into IMU measurements
@@ -322,7 +511,14 @@ private:
      * @param raw_point Raw IMU measurement
      * @return Corrected IMU measurement
      */
-    IMU::Point ApplyCalibrationAndBias(const IMU::Point& raw_point);
+    IMU::Point ApplyCalibrationAndBias(const IMU::Point& raw_point) const;
+    
+    /**
+     * @brief Get the accelerometer and gyroscope offsets M * (bias + k * (temperature - reference))
+     * @param accel_offset Accelerometer offset
+     * @param gyro_offset Gyroscope offset
+     */
+    void GetCorrectionOffsets(Eigen::Vector3f& accel_offset, Eigen::Vector3f& gyro_offset) const;
 };
 
 } // namespace ORB_SLAM3
@@ -0,0 +1,144 @@
+#ifndef DMA_BUFFER_POOL_HPP
+#define DMA_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Pool of DMA-BUFs allocated once and shared by the camera and the accelerators
+ *
+ * All buffers are allocated and mapped for the CPU at startup, before the
+ * capture starts, and stay in place for the lifetime of the pool. Every
+ * device imports a buffer once by its fd and keeps the import, frames are
+ * then handed around by buffer handle without per-frame import, map or
+ * IOMMU setup.
+ *
+ * The backing is the first source of Options::sources that can hold the
+ * whole pool:
+ *  - a DMA heap, e.g. /dev/dma_heap/linux,cma. The CMA heap is physically
+ *    contiguous, so a device maps a buffer with one IOMMU entry, or none.
+ *  - "udmabuf": a hugetlb memfd exported through /dev/udmabuf. The CPU maps
+ *    the pool with 2 MB pages, and devices see 2 MB chunks; every buffer
+ *    starts on a huge page.
+ *
+ * The CPU mapping of a DMA heap buffer is set up by the heap, which maps it
+ * with base pages. Accelerators that address 32 bits (RGA2) need a heap
+ * below 4 GB, as the CMA and system-dma32 heaps of the Rockchip kernels.
+ *
+ * Acquire() and Release() are thread-safe.
+ */
+class DmaBufferPool {
+public:
+    /// Source name of the hugetlb memfd backing in Options::sources
+    static constexpr const char* kUdmabufSource = "udmabuf";
+
+    struct Options {
+        /// Backings in order of preference, DMA heap paths or kUdmabufSource
+        std::vector<std::string> sources = {"/dev/dma_heap/linux,cma", "/dev/dma_heap/cma",
+                                            kUdmabufSource,
+                                            "/dev/dma_heap/system-dma32", "/dev/dma_heap/system"};
+        std::string udmabuf_path = "/dev/udmabuf";
+        size_t huge_page_size = 2 * 1024 * 1024;  ///< Huge page size of the udmabuf memfd
+    };
+
+    /**
+     * @brief A buffer of the pool, valid until the pool is freed
+     */
+    struct Buffer {
+        int dma_fd = -1;              ///< DMA-BUF fd, owned by the pool
+        void* data = nullptr;         ///< CPU mapping
+        size_t size = 0;              ///< Usable size in bytes
+    };
+
+    DmaBufferPool();
+    explicit DmaBufferPool(const Options& options);
+    ~DmaBufferPool();
+
+    DmaBufferPool(const DmaBufferPool&) = delete;
+    DmaBufferPool& operator=(const DmaBufferPool&) = delete;
+
+    /**
+     * @brief Allocate and map all buffers of the pool
+     * @param count Number of buffers
+     * @param size Size of each buffer in bytes
+     * @return True if all buffers were allocated from one source, false otherwise (nothing stays allocated)
+     */
+    bool Allocate(size_t count, size_t size);
+
+    /**
+     * @brief Unmap and close all buffers; the devices must have dropped their imports
+     */
+    void Free();
+
+    bool IsAllocated() const;
+
+    /**
+     * @brief Source the buffers were allocated from (empty if not allocated)
+     */
+    const std::string& GetSource() const;
+
+    size_t GetBufferCount() const;
+    size_t GetBufferSize() const;
+
+    /**
+     * @brief Get a buffer by handle
+     * @param handle Buffer handle, 0 to GetBufferCount() - 1
+     * @return The buffer
+     */
+    const Buffer& GetBuffer(int handle) const;
+
+    /**
+     * @brief Handle of the buffer a frame was mapped from
+     * @param data Start of the CPU mapping of the buffer
+     * @return Buffer handle, -1 if the memory is not a buffer of the pool
+     */
+    int FindBuffer(const void* data) const;
+
+    /**
+     * @brief Take a free buffer
+     * @return Buffer handle, -1 if all buffers are taken
+     */
+    int Acquire();
+
+    /**
+     * @brief Return a buffer taken with Acquire()
+     * @param handle Buffer handle
+     */
+    void Release(int handle);
+
+    size_t GetFreeCount() const;
+
+    /**
+     * @brief Get the last error message
+     */
+    std::string GetLastErrorMessage() const;
+
+private:
+    bool AllocateFromHeap(const std::string& path, size_t count, size_t size);
+    bool AllocateFromUdmabuf(size_t count, size_t size);
+    void SetErrorMessage(const std::string& message);
+
+    Options mOptions;
+    std::string mSource;
+    std::vector<Buffer> mBuffers;
+    size_t mBufferSize;
+
+    // One mapping of the udmabuf memfd for the whole pool
+    void* mPoolMapping;
+    size_t mPoolMappingSize;
+
+    mutable std::mutex mFreeMutex;
+    std::vector<int> mFreeHandles;
+
+    mutable std::mutex mErrorMutex;
+    std::string mLastErrorMessage;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // DMA_BUFFER_POOL_HPP
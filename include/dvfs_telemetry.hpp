@@ -0,0 +1,113 @@
+#ifndef DVFS_TELEMETRY_HPP
+#define DVFS_TELEMETRY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace ORB_SLAM3
+{
+
+/// Load hints, VR_PIPELINE_HINT_* of the power driver
+constexpr uint32_t kDvfsHintKeyFrame = 1u << 0;       ///< Keyframe inserted, local mapping follows
+constexpr uint32_t kDvfsHintLoopClosure = 1u << 1;    ///< Loop detected, correction and BA follow
+constexpr uint32_t kDvfsHintRelocalization = 1u << 2; ///< Tracking lost, relocalization search
+
+/// Thermal zones, VR_THERMAL_ZONE_* of the power driver
+constexpr uint32_t kDvfsThermalZoneCpu = 0;
+constexpr uint32_t kDvfsThermalZoneGpu = 1;
+constexpr uint32_t kDvfsThermalZoneNpu = 2;
+constexpr uint32_t kDvfsThermalZoneCount = 5;
+
+/**
+ * @brief Per-frame telemetry, mirrors struct vr_pipeline_telemetry of the power driver
+ */
+struct DvfsPipelineTelemetry {
+    uint32_t frame_period_us;      ///< Frame period the stages must fit in
+    uint32_t acquisition_us;       ///< VR_PIPELINE_STAGE_ACQUISITION
+    uint32_t extraction_us;        ///< VR_PIPELINE_STAGE_EXTRACTION, NPU
+    uint32_t tracking_us;          ///< VR_PIPELINE_STAGE_TRACKING, A76 cores
+    uint32_t hints;                ///< kDvfsHint* flags
+    uint32_t reserved;
+};
+
+static_assert(sizeof(DvfsPipelineTelemetry) == 24, "DvfsPipelineTelemetry must match the driver layout");
+
+/**
+ * @brief Feeds the SLAM pipeline timing to the DVFS governor of the power driver
+ *
+ * The governor sets the A76 and NPU clock floors from the stage times and
+ * holds them at their thermal cap for a while after a load hint. Report() is
+ * called once per frame by the tracking stage, HintLoad() from any thread
+ * that knows of load ahead (e.g. a loop closer), the hints go out with the
+ * next report. The thermal status is read from the state page the driver
+ * maps read-only, without a syscall.
+ */
+class DvfsTelemetry
+{
+public:
+    /**
+     * @brief Constructor
+     * @param device Power driver device node
+     */
+    explicit DvfsTelemetry(const std::string& device = "/dev/orangepi-vr-power");
+
+    /**
+     * @brief Destructor, closes the device
+     */
+    ~DvfsTelemetry();
+
+    DvfsTelemetry(const DvfsTelemetry&) = delete;
+    DvfsTelemetry& operator=(const DvfsTelemetry&) = delete;
+
+    /**
+     * @brief Open the device
+     * @return False if the power driver is not loaded
+     */
+    bool Open();
+
+    /**
+     * @brief Check if the device is open
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Announce load for the next report, thread-safe
+     * @param hints kDvfsHint* flags
+     */
+    void HintLoad(uint32_t hints);
+
+    /**
+     * @brief Send the timing of one frame with the pending hints
+     * @param frame_period_ms Frame period
+     * @param acquisition_ms Acquisition stage time
+     * @param extraction_ms Feature extraction stage time
+     * @param tracking_ms Tracking stage time
+     * @return False if the device is not open or rejected the report
+     */
+    bool Report(double frame_period_ms, double acquisition_ms, double extraction_ms, double tracking_ms);
+
+    /**
+     * @brief Read the thermal status of a zone, thread-safe
+     * @param zone kDvfsThermalZone* zone
+     * @return VR_THERMAL_STATUS_* (0 normal, 1 warning, 2 critical, 3 emergency),
+     *         -1 if the driver has no state page or the zone is unknown
+     */
+    int ReadThermalStatus(uint32_t zone) const;
+
+    /**
+     * @brief Build the telemetry the driver takes, times rounded to microseconds
+     */
+    static DvfsPipelineTelemetry Pack(double frame_period_ms, double acquisition_ms,
+                                      double extraction_ms, double tracking_ms, uint32_t hints);
+
+private:
+    std::string mDevice;
+    int mFd;
+    const void* mStatePage;          // struct vr_power_state_page, nullptr if it could not be mapped
+    std::atomic<uint32_t> mPendingHints;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // DVFS_TELEMETRY_HPP
@@ -0,0 +1,169 @@
+#ifndef FIXED_LAG_SMOOTHER_HPP
+#define FIXED_LAG_SMOOTHER_HPP
+
+#include <cstddef>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include <sophus/se3.hpp>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Fixed-lag sliding-window smoother over tracked poses and IMU preintegration
+ *
+ * Keeps the last window_size frames, each with pose, velocity and gyro and
+ * accelerometer bias (15 DoF). Consecutive frames are tied by an IMU
+ * preintegration factor and a bias random-walk factor, and a frame can be
+ * anchored by a tracked pose. Optimize() runs at most max_iterations
+ * Gauss-Newton iterations on the dense window Hessian, then marginalizes the
+ * frames beyond the window into a prior on the oldest kept frame (Schur
+ * complement). The compute per frame only depends on the window size.
+ *
+ * Not thread-safe, the owner serializes the calls.
+ */
+class FixedLagSmoother
+{
+public:
+    /**
+     * @brief Configuration
+     */
+    struct Config {
+        int window_size = 5;                      ///< Frames kept in the window
+        int max_iterations = 3;                   ///< Gauss-Newton iterations per Optimize()
+        Eigen::Vector3f gravity = Eigen::Vector3f(0.0f, 0.0f, -9.81f); ///< Gravity in the world frame in m/s^2
+        float visual_rotation_sigma = 0.01f;      ///< Tracked pose rotation noise in rad
+        float visual_position_sigma = 0.01f;      ///< Tracked pose position noise in m
+        float gyro_walk_sigma = 1.9e-5f;          ///< Gyroscope bias random walk in rad/s/sqrt(s)
+        float acc_walk_sigma = 3.0e-3f;           ///< Accelerometer bias random walk in m/s^2/sqrt(s)
+        float initial_velocity_sigma = 1.0f;      ///< Prior on the first frame's velocity in m/s
+        float initial_gyro_bias_sigma = 0.01f;    ///< Prior on the first frame's gyroscope bias in rad/s
+        float initial_acc_bias_sigma = 0.1f;      ///< Prior on the first frame's accelerometer bias in m/s^2
+    };
+
+    /**
+     * @brief IMU preintegration between two frames (as in IMU::Preintegrated)
+     *
+     * The deltas are integrated with bias_gyro and bias_acc, the bias
+     * Jacobians correct them to first order for other biases.
+     */
+    struct ImuDelta {
+        Eigen::Matrix3f delta_R = Eigen::Matrix3f::Identity();
+        Eigen::Vector3f delta_V = Eigen::Vector3f::Zero();
+        Eigen::Vector3f delta_P = Eigen::Vector3f::Zero();
+        float dt = 0.0f;
+        Eigen::Matrix<float, 9, 9> covariance = Eigen::Matrix<float, 9, 9>::Identity(); ///< Rotation, velocity, position
+        Eigen::Matrix3f JRg = Eigen::Matrix3f::Zero();
+        Eigen::Matrix3f JVg = Eigen::Matrix3f::Zero();
+        Eigen::Matrix3f JVa = Eigen::Matrix3f::Zero();
+        Eigen::Matrix3f JPg = Eigen::Matrix3f::Zero();
+        Eigen::Matrix3f JPa = Eigen::Matrix3f::Zero();
+        Eigen::Vector3f bias_gyro = Eigen::Vector3f::Zero();
+        Eigen::Vector3f bias_acc = Eigen::Vector3f::Zero();
+    };
+
+    /**
+     * @brief Estimated state of a frame
+     */
+    struct FrameState {
+        double timestamp = 0.0;
+        Sophus::SE3f pose;                        ///< Body pose in the world frame
+        Eigen::Vector3f velocity = Eigen::Vector3f::Zero();
+        Eigen::Vector3f bias_gyro = Eigen::Vector3f::Zero();
+        Eigen::Vector3f bias_acc = Eigen::Vector3f::Zero();
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Configuration
+     */
+    explicit FixedLagSmoother(const Config& config);
+
+    /**
+     * @brief Drop all frames and the marginalization prior
+     */
+    void Reset();
+
+    /**
+     * @brief Append a frame, initialized by IMU propagation from the previous one
+     * @param timestamp Frame timestamp in seconds
+     * @param imu Preintegration since the previous frame (ignored for the first frame)
+     * @param visual_pose Tracked body pose in the world frame, nullptr for an IMU-only frame
+     */
+    void AddFrame(double timestamp, const ImuDelta& imu, const Sophus::SE3f* visual_pose);
+
+    /**
+     * @brief Optimize the window and marginalize the frames that left it
+     * @return False if there are no frames or a solve failed
+     */
+    bool Optimize();
+
+    /**
+     * @brief Get the state of the newest frame
+     */
+    FrameState GetLatestState() const;
+
+    /**
+     * @brief Get the number of frames in the window
+     */
+    size_t GetFrameCount() const;
+
+    /**
+     * @brief Check if a marginalization prior anchors the oldest frame
+     */
+    bool HasMarginalizationPrior() const;
+
+private:
+    typedef Eigen::Matrix<double, 15, 15> Matrix15d;
+    typedef Eigen::Matrix<double, 15, 1> Vector15d;
+    typedef Eigen::Matrix<double, 9, 9> Matrix9d;
+
+    struct Frame {
+        double timestamp;
+        Sophus::SO3d R;
+        Eigen::Vector3d p;
+        Eigen::Vector3d v;
+        Eigen::Vector3d bg;
+        Eigen::Vector3d ba;
+        bool has_visual;
+        Sophus::SO3d visual_R;
+        Eigen::Vector3d visual_p;
+
+        // Preintegration from the previous frame
+        Eigen::Matrix3d delta_R;
+        Eigen::Vector3d delta_V;
+        Eigen::Vector3d delta_P;
+        double dt;
+        Matrix9d imu_information;
+        Eigen::Matrix3d JRg, JVg, JVa, JPg, JPa;
+        Eigen::Vector3d imu_bg;
+        Eigen::Vector3d imu_ba;
+    };
+
+    Config mConfig;
+    Eigen::Vector3d mGravity;
+    std::vector<Frame> mFrames;
+
+    // Linear prior on the oldest frame: gradient mPriorG + mPriorH * (x - mPriorAnchor)
+    bool mHasPrior;
+    Matrix15d mPriorH;
+    Vector15d mPriorG;
+    Frame mPriorAnchor;
+
+    // Normal equations of the window and their solution, sized once
+    Eigen::MatrixXd mH;
+    Eigen::VectorXd mG;
+    Eigen::VectorXd mDx;
+    Eigen::LDLT<Eigen::MatrixXd> mSolver;
+
+    void AddPriorFactor(const Frame& frame, Eigen::MatrixXd& H, Eigen::VectorXd& g, size_t index) const;
+    void AddVisualFactor(const Frame& frame, Eigen::MatrixXd& H, Eigen::VectorXd& g, size_t index) const;
+    void AddInertialFactors(const Frame& previous, const Frame& frame,
+                            Eigen::MatrixXd& H, Eigen::VectorXd& g, size_t previous_index) const;
+    void MarginalizeOldest();
+};
+
+} // namespace ORB_SLAM3
+
+#endif // FIXED_LAG_SMOOTHER_HPP
@@ -0,0 +1,178 @@
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency_trace.hpp"
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Always-on recorder of the last seconds of per-frame pipeline state
+ *
+ * The tracking stage adds one record per frame set to a ring sized for
+ * Config::window_s at Config::max_frame_rate_hz. When a frame set's
+ * exposure-to-pose latency exceeds the trigger threshold, recording goes on
+ * for Config::post_trigger_s, then the ring is copied into a preallocated
+ * snapshot and the writer thread writes it to a CSV file, next to the trace
+ * events of all threads if the Tracer is compiled in and running. Add()
+ * neither allocates, locks nor touches the disk; a trigger while the writer
+ * is still busy with the previous dump is counted as missed.
+ *
+ * Add() must be called from one thread only, the other methods are thread-safe.
+ */
+class FlightRecorder
+{
+public:
+    /**
+     * @brief Configuration
+     */
+    struct Config {
+        bool enabled = true;                   ///< Whether the system records
+        double window_s = 10.0;                ///< Time kept before the trigger
+        double max_frame_rate_hz = 120.0;      ///< Frame set rate the ring is sized for
+        double trigger_latency_ms = 50.0;      ///< Exposure-to-pose latency that triggers a dump
+        double post_trigger_s = 1.0;           ///< Time recorded after the triggering frame set
+        double min_dump_interval_s = 30.0;     ///< Triggers sooner after the previous one are ignored
+        std::string output_dir = "/var/log/vr_slam"; ///< Directory of the dumps (created if missing)
+        bool include_trace = true;             ///< Write the Tracer events next to each dump (needs ENABLE_TRACING)
+    };
+
+    /**
+     * @brief Activity of a thread, from getrusage(RUSAGE_THREAD)
+     */
+    struct ThreadCounters {
+        uint32_t voluntary_switches = 0;       ///< Blocking waits (locks, I/O, sleeps)
+        uint32_t involuntary_switches = 0;     ///< Preemptions
+        uint32_t major_faults = 0;             ///< Page faults that read from disk
+
+        /**
+         * @brief Counters of the calling thread since it started
+         */
+        static ThreadCounters Sample();
+
+        /**
+         * @brief Counters accumulated since an earlier sample of the same thread
+         */
+        ThreadCounters Since(const ThreadCounters& start) const;
+    };
+
+    /**
+     * @brief State of one frame set through the pipeline
+     */
+    struct Record {
+        double timestamp = 0.0;                ///< Capture timestamp of the set
+        LatencyStamps latency;                 ///< Stage stamps of the set
+        float acquisition_ms = 0.0f;           ///< Time to get the synchronized set
+        float feature_ms = 0.0f;               ///< Feature extraction time
+        float tracking_ms = 0.0f;              ///< Tracking time
+        float extraction_wait_ms = 0.0f;       ///< Time the extraction stage waited for the set
+        float tracking_wait_ms = 0.0f;         ///< Time the tracking stage waited for the set
+        float motion_lock_wait_ms = 0.0f;      ///< Time the tracking stage waited for the motion model lock
+        uint16_t extraction_queue_depth = 0;   ///< Sets queued for extraction when tracking started it
+        uint16_t tracking_queue_depth = 0;     ///< Sets queued for tracking when tracking started it
+        uint32_t dropped_sets = 0;             ///< Sets dropped by the pipeline queues so far
+        int32_t tracking_state = 0;            ///< Tracking state after the set
+        ThreadCounters extraction_thread;      ///< Extraction thread activity during the set
+        ThreadCounters tracking_thread;        ///< Tracking thread activity during the set
+
+        /**
+         * @brief Exposure-to-pose latency in milliseconds (0 if not stamped)
+         */
+        double GetLatencyMs() const;
+    };
+
+    /**
+     * @brief Constructor, allocates the ring and the snapshot
+     * @param config Configuration
+     */
+    explicit FlightRecorder(const Config& config);
+
+    /**
+     * @brief Destructor, finishes the dump being written and stops the writer
+     */
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    /**
+     * @brief Start the writer thread
+     * @return False if already started
+     */
+    bool Start();
+
+    /**
+     * @brief Write the pending dump and stop the writer thread
+     */
+    void Stop();
+
+    /**
+     * @brief Add the record of a tracked frame set (recording thread only)
+     */
+    void Add(const Record& record);
+
+    /**
+     * @brief Dump on the next Add(), regardless of the latency and the dump interval
+     */
+    void RequestDump();
+
+    /**
+     * @brief Get the number of dumps written
+     */
+    uint64_t GetDumpCount() const;
+
+    /**
+     * @brief Get the number of triggers dropped because the writer was busy
+     */
+    uint64_t GetMissedCount() const;
+
+    /**
+     * @brief Get the path of the last dump written (empty if none)
+     */
+    std::string GetLastDumpPath() const;
+
+private:
+    Config mConfig;
+
+    // Ring, only touched by Add()
+    std::vector<Record> mRing;
+    size_t mNext;
+    size_t mSize;
+    bool mTriggered;
+    Record mTrigger;
+    double mDumpAt;
+    double mLastTrigger;
+    std::atomic<bool> mDumpRequested;
+
+    // Snapshot, owned by Add() while mSnapshotReady is false and by the writer while it is true
+    std::vector<Record> mSnapshot;
+    size_t mSnapshotSize;
+    Record mSnapshotTrigger;
+    std::atomic<bool> mSnapshotReady;
+
+    std::atomic<uint64_t> mDumps;
+    std::atomic<uint64_t> mMissed;
+    mutable std::mutex mPathMutex;
+    std::string mLastDumpPath;
+
+    std::thread mThread;
+    std::mutex mThreadMutex;
+    std::condition_variable mThreadCondition;
+    bool mRunning;
+
+    void TakeSnapshot();
+    void ThreadFunction();
+    void WriteSnapshot();
+};
+
+} // namespace ORB_SLAM3
+
+#endif // FLIGHT_RECORDER_HPP
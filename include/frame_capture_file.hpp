@@ -0,0 +1,208 @@
+#ifndef FRAME_CAPTURE_FILE_HPP
+#define FRAME_CAPTURE_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct iovec;
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Camera stream described in a capture file header
+ */
+struct CaptureCameraInfo {
+    int32_t width;                ///< Frame width in pixels
+    int32_t height;               ///< Frame height in pixels
+    int32_t fps;                  ///< Nominal frames per second
+    int32_t reserved;
+    char pixel_format[8];         ///< Pixel format (e.g., "GREY"), NUL padded
+};
+
+/**
+ * @brief One frame stored in a capture file
+ *
+ * When read back, data and scaled_data point into the read-only mapping of
+ * the file and stay valid as long as the reader is open.
+ */
+struct CaptureFrame {
+    uint64_t frame_id;            ///< Frame identifier at capture time
+    double timestamp;             ///< Capture timestamp in seconds (CLOCK_MONOTONIC)
+    int32_t camera_id;            ///< Camera identifier
+    int32_t width;                ///< Frame width in pixels
+    int32_t height;               ///< Frame height in pixels
+    bool is_keyframe;             ///< Whether this frame is a keyframe
+    const void* data;             ///< Raw frame buffer
+    size_t size;                  ///< Size of the frame buffer in bytes
+
+    // Optional scaled plane (scaled_size == 0 if absent)
+    int32_t scaled_width;         ///< Scaled plane width in pixels
+    int32_t scaled_height;        ///< Scaled plane height in pixels
+    int32_t scaled_stride;        ///< Scaled plane row stride in bytes
+    const void* scaled_data;      ///< Scaled luma plane
+    size_t scaled_size;           ///< Size of the scaled plane in bytes
+};
+
+/**
+ * @brief One IMU sample stored in a capture file
+ */
+struct CaptureImuSample {
+    double timestamp;             ///< Sample timestamp in seconds
+    float acc[3];                 ///< Acceleration in m/s^2
+    float gyro[3];                ///< Angular velocity in rad/s
+};
+
+/**
+ * @brief Append-only writer for frame capture files
+ *
+ * The file starts with a one-page header describing the cameras, followed by
+ * a stream of records. Every frame payload starts on a page boundary so a
+ * reader can map it and hand out the pages without copying. Records are only
+ * ever appended, so a capture cut short by a crash is still readable up to the
+ * last complete record. All methods are thread-safe.
+ */
+class FrameCaptureWriter
+{
+public:
+    FrameCaptureWriter();
+    ~FrameCaptureWriter();
+
+    FrameCaptureWriter(const FrameCaptureWriter&) = delete;
+    FrameCaptureWriter& operator=(const FrameCaptureWriter&) = delete;
+
+    /**
+     * @brief Create a capture file, truncating any existing file
+     * @param path File path
+     * @param cameras Camera streams, indexed by camera_id
+     * @return True if successful, false otherwise
+     */
+    bool Open(const std::string& path, const std::vector<CaptureCameraInfo>& cameras);
+
+    /**
+     * @brief Flush and close the file
+     */
+    void Close();
+
+    /**
+     * @brief Check if a file is open
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Append a frame
+     * @param frame Frame to append (data and scaled_data are copied into the file)
+     * @return True if successful, false otherwise
+     */
+    bool WriteFrame(const CaptureFrame& frame);
+
+    /**
+     * @brief Append an IMU sample
+     * @param sample IMU sample
+     * @return True if successful, false otherwise
+     */
+    bool WriteImuSample(const CaptureImuSample& sample);
+
+    /**
+     * @brief Get the number of bytes written so far
+     */
+    uint64_t GetBytesWritten() const;
+
+    /**
+     * @brief Get the latest error message
+     */
+    std::string GetLastErrorMessage() const;
+
+private:
+    int mFd;
+    uint64_t mOffset;
+    size_t mPageSize;
+    std::vector<uint8_t> mPadding;
+    std::string mLastErrorMessage;
+    mutable std::mutex mMutex;
+
+    /**
+     * @brief Append chunks at the current offset (mMutex must be held)
+     * @param iov Chunks to write
+     * @param iovcnt Number of chunks
+     * @return True if everything was written, false otherwise
+     */
+    bool AppendLocked(struct iovec* iov, int iovcnt);
+};
+
+/**
+ * @brief Reader for frame capture files
+ *
+ * Maps the whole file read-only and indexes its records on Open(). Frames are
+ * returned in file order, which is publication order at capture time.
+ */
+class FrameCaptureReader
+{
+public:
+    FrameCaptureReader();
+    ~FrameCaptureReader();
+
+    FrameCaptureReader(const FrameCaptureReader&) = delete;
+    FrameCaptureReader& operator=(const FrameCaptureReader&) = delete;
+
+    /**
+     * @brief Map and index a capture file
+     * @param path File path
+     * @return True if successful, false otherwise
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * @brief Unmap the file
+     */
+    void Close();
+
+    /**
+     * @brief Check if a file is open
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Get the camera streams described in the header
+     */
+    const std::vector<CaptureCameraInfo>& GetCameras() const;
+
+    /**
+     * @brief Get the number of frames in the file
+     */
+    size_t GetFrameCount() const;
+
+    /**
+     * @brief Get a frame by its position in the file
+     * @param index Frame index (0 to GetFrameCount() - 1)
+     * @param frame Output frame (points into the mapping)
+     * @return True if successful, false if the index is out of range
+     */
+    bool GetFrame(size_t index, CaptureFrame& frame) const;
+
+    /**
+     * @brief Get all IMU samples, sorted by timestamp
+     */
+    const std::vector<CaptureImuSample>& GetImuSamples() const;
+
+    /**
+     * @brief Get the latest error message
+     */
+    std::string GetLastErrorMessage() const;
+
+private:
+    int mFd;
+    const uint8_t* mData;
+    size_t mSize;
+    std::vector<CaptureCameraInfo> mCameras;
+    std::vector<uint64_t> mFrameOffsets;
+    std::vector<CaptureImuSample> mImuSamples;
+    std::string mLastErrorMessage;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // FRAME_CAPTURE_FILE_HPP
@@ -0,0 +1,150 @@
+#ifndef KEYFRAME_POLICY_HPP
+#define KEYFRAME_POLICY_HPP
+
+#include <cstdint>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Cost-aware acceptance of the keyframes the tracker asks for
+ *
+ * The tracker's heuristics (tracked point ratio, frames since the last
+ * keyframe, mapper idle) decide that a keyframe would help. This policy
+ * then weighs what the keyframe adds against what it costs: a keyframe of
+ * the rig costs local mapping roughly one mono keyframe per camera, and
+ * every keyframe queued behind a busy mapper delays the local BA of the
+ * others.
+ *
+ * The value of a keyframe is the largest of its normalized motion since the
+ * last keyframe (baseline and rotation, extrapolated with the head velocity
+ * over the mapping latency) and its novel view coverage (keypoints of the
+ * scheduled cameras not tracked in the map). The keyframe is accepted when
+ * the value reaches min_value scaled by the mapper load, the time its queue
+ * and the keyframe itself take to map relative to mapping_budget_ms. With
+ * no camera seeing enough novel structure and little motion, it is
+ * redundant and suppressed whatever the load.
+ *
+ * Urgent keyframes (weak tracking) and keyframes after max_interval_s are
+ * always accepted, the map must keep up with the head.
+ *
+ * Not thread-safe, meant to be driven from the tracking thread.
+ */
+class KeyFramePolicy
+{
+public:
+    /**
+     * @brief Policy configuration
+     */
+    struct Config {
+        float baseline_m = 0.10f;              ///< Baseline since the last keyframe worth one keyframe
+        float rotation_rad = 0.26f;            ///< Rotation since the last keyframe worth one keyframe (15 deg)
+        float novel_fraction = 0.35f;          ///< Untracked keypoint fraction worth one keyframe
+        float camera_novel_fraction = 0.5f;    ///< Untracked fraction above which a camera sees novel structure
+        float redundant_value = 0.3f;          ///< Value below which a keyframe without novel cameras is redundant
+        float min_value = 0.5f;                ///< Value required from a keyframe with an idle mapper
+        float mapping_budget_ms = 100.0f;      ///< Mapping time of the queue at which the required value doubles
+        float camera_cost_ms = 15.0f;          ///< Mapping time per camera before the mapper was measured
+        float max_interval_s = 1.0f;           ///< Time after the last keyframe at which one is always accepted
+    };
+
+    /**
+     * @brief State of the tracker and the mapper for one keyframe request
+     */
+    struct Candidate {
+        bool urgent = false;                   ///< Tracking is weak, the keyframe is needed to keep tracking
+        double seconds_since_keyframe = 0.0;   ///< Time since the last keyframe
+        int cameras = 1;                       ///< Cameras mapped with the keyframe
+        float keyframe_cost_ms = 0.0f;         ///< Measured mapping time per keyframe (0 if not measured yet)
+        float local_ba_ms = 0.0f;              ///< Measured local BA time (0 if not measured yet)
+        int queued_keyframes = 0;              ///< Keyframes waiting for the mapper
+        float translation_m = 0.0f;            ///< Baseline since the last keyframe
+        float rotation_rad = 0.0f;             ///< Rotation since the last keyframe
+        float speed_mps = 0.0f;                ///< Head speed from the motion model
+        float angular_speed_radps = 0.0f;      ///< Head angular speed from the motion model
+        float novel_fraction = 0.0f;           ///< Untracked keypoints over all scheduled cameras
+        int novel_cameras = 0;                 ///< Cameras above Config::camera_novel_fraction
+    };
+
+    /**
+     * @brief Why a keyframe was accepted or suppressed
+     */
+    enum class Reason {
+        URGENT,                                ///< Accepted, tracking is weak
+        INTERVAL,                              ///< Accepted, max_interval_s since the last keyframe
+        VALUE,                                 ///< Accepted, the value covers the mapper load
+        REDUNDANT,                             ///< Suppressed, no novel view and little motion
+        BACKLOG,                               ///< Suppressed, the value does not cover the mapper load
+        COUNT
+    };
+
+    /**
+     * @brief Outcome of one keyframe request
+     */
+    struct Decision {
+        bool accept = true;                    ///< Insert the keyframe
+        Reason reason = Reason::URGENT;        ///< Rule that decided
+        float value = 0.0f;                    ///< Normalized value of the keyframe
+        float required_value = 0.0f;           ///< Value the mapper load asked for
+        float mapping_ms = 0.0f;               ///< Estimated mapping time of the queue and the keyframe
+    };
+
+    /**
+     * @brief Constructor with the default configuration
+     */
+    KeyFramePolicy();
+
+    /**
+     * @brief Constructor
+     * @param config Policy configuration
+     */
+    explicit KeyFramePolicy(const Config& config);
+
+    /**
+     * @brief Decide on a keyframe the tracker asks for
+     * @param candidate State of the tracker and the mapper
+     * @return Decision, also kept as the last decision
+     */
+    Decision Decide(const Candidate& candidate);
+
+    /**
+     * @brief Get the configuration
+     */
+    const Config& GetConfig() const;
+
+    /**
+     * @brief Set the configuration
+     */
+    void SetConfig(const Config& config);
+
+    /**
+     * @brief Get the last decision
+     */
+    const Decision& GetLastDecision() const;
+
+    /**
+     * @brief Get the number of decisions made for a reason
+     */
+    uint64_t GetCount(Reason reason) const;
+
+    /**
+     * @brief Get the number of suppressed keyframes
+     */
+    uint64_t GetSuppressedCount() const;
+
+    /**
+     * @brief Get the name of a reason (e.g., "redundant")
+     */
+    static const char* GetReasonName(Reason reason);
+
+private:
+    Config mConfig;
+    Decision mLastDecision;
+    uint64_t mCounts[static_cast<int>(Reason::COUNT)];
+
+    Decision Record(Decision decision);
+};
+
+} // namespace ORB_SLAM3
+
+#endif // KEYFRAME_POLICY_HPP
@@ -0,0 +1,189 @@
+#ifndef LATENCY_TRACE_HPP
+#define LATENCY_TRACE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Points in the pipeline at which a frame is stamped, in pipeline order
+ */
+enum class LatencyStage {
+    EXPOSURE_MID,     ///< Midpoint of the sensor exposure
+    DQBUF,            ///< Buffer dequeued from the V4L2 driver
+    TPU_SUBMIT,       ///< Frame submitted to the TPU
+    TPU_DONE,         ///< TPU feature extraction finished
+    TRACK_DONE,       ///< Multi-camera tracking finished
+    POSE_PUBLISHED,   ///< Pose handed to the motion model
+    COUNT
+};
+
+constexpr size_t kNumLatencyStages = static_cast<size_t>(LatencyStage::COUNT);
+
+/**
+ * @brief Get the name of a latency stage (e.g., "tpu_done")
+ */
+const char* GetLatencyStageName(LatencyStage stage);
+
+/**
+ * @brief Current time in seconds on the clock used for latency stamps (CLOCK_MONOTONIC)
+ */
+double LatencyNowSeconds();
+
+/**
+ * @brief Fixed set of monotonic timestamps carried by a frame through the pipeline
+ *
+ * All stamps are CLOCK_MONOTONIC seconds, the clock V4L2 uses for buffer
+ * timestamps; a stamp of 0 means the frame never reached that stage.
+ */
+struct LatencyStamps {
+    std::array<double, kNumLatencyStages> stamps{}; ///< Stamp per stage in seconds (0 if not reached)
+
+    /**
+     * @brief Stamp a stage with the current time
+     */
+    void Stamp(LatencyStage stage) { Set(stage, LatencyNowSeconds()); }
+
+    /**
+     * @brief Stamp a stage with a given time
+     */
+    void Set(LatencyStage stage, double time_s) { stamps[static_cast<size_t>(stage)] = time_s; }
+
+    /**
+     * @brief Get the stamp of a stage in seconds (0 if not reached)
+     */
+    double Get(LatencyStage stage) const { return stamps[static_cast<size_t>(stage)]; }
+
+    /**
+     * @brief Check if a stage was stamped
+     */
+    bool Has(LatencyStage stage) const { return Get(stage) > 0.0; }
+
+    /**
+     * @brief Merge the stamps of another frame of the same frame set
+     *
+     * A frame set reaches a stage when its slowest frame does, so every stage
+     * keeps the latest stamp, except the exposure which keeps the earliest
+     * one: the oldest photons in the set bound its end-to-end latency.
+     */
+    void Merge(const LatencyStamps& other);
+};
+
+/**
+ * @brief Percentiles of a latency distribution
+ */
+struct LatencyPercentiles {
+    uint64_t count = 0;           ///< Number of samples
+    double p50_ms = 0.0;          ///< Median in milliseconds
+    double p99_ms = 0.0;          ///< 99th percentile in milliseconds
+    double p999_ms = 0.0;         ///< 99.9th percentile in milliseconds
+    double max_ms = 0.0;          ///< Largest sample in milliseconds
+};
+
+/**
+ * @brief Lock-free log-linear latency histogram
+ *
+ * Samples are counted in 16 linear sub-buckets per power of two of
+ * microseconds, so percentiles are exact to within 1/16 of their value from
+ * 1 us to about 4 s; larger samples land in the last bucket. Record() may run
+ * concurrently with readers, which may then miss the samples being recorded.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /**
+     * @brief Record a sample
+     * @param latency_ms Latency in milliseconds (negative samples are clamped to 0)
+     */
+    void Record(double latency_ms);
+
+    /**
+     * @brief Get the value below which a fraction of the samples fall
+     * @param percentile Percentile in [0, 100]
+     * @return Upper bound of the bucket holding the percentile in milliseconds (0 if empty)
+     */
+    double GetPercentile(double percentile) const;
+
+    /**
+     * @brief Get p50, p99, p999 and the maximum
+     */
+    LatencyPercentiles GetPercentiles() const;
+
+    /**
+     * @brief Get the number of recorded samples
+     */
+    uint64_t GetCount() const;
+
+    /**
+     * @brief Remove all samples (not safe against a concurrent Record())
+     */
+    void Reset();
+
+private:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMagnitudes = 18;
+    static constexpr int kNumBuckets = (kMagnitudes + 1) * kSubBuckets;
+
+    std::array<std::atomic<uint64_t>, kNumBuckets> mBuckets;
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mMaxUs;
+
+    static int BucketIndex(uint64_t value_us);
+    static uint64_t BucketUpperBound(int index);
+};
+
+/**
+ * @brief Per-stage latency histograms fed with LatencyStamps
+ *
+ * The latency of a stage is the time from the previous stage the frame was
+ * stamped at, so a path that skips a stage (e.g. CPU feature extraction
+ * without TPU stamps) is still accounted for. The end-to-end latency runs from
+ * the exposure midpoint to the pose being published.
+ */
+class LatencyTracker
+{
+public:
+    LatencyTracker() = default;
+
+    LatencyTracker(const LatencyTracker&) = delete;
+    LatencyTracker& operator=(const LatencyTracker&) = delete;
+
+    /**
+     * @brief Record the stamps of one frame (or frame set)
+     */
+    void Record(const LatencyStamps& stamps);
+
+    /**
+     * @brief Get the latency percentiles of a stage
+     * @param stage Stage (EXPOSURE_MID has no previous stage and stays empty)
+     */
+    LatencyPercentiles GetStagePercentiles(LatencyStage stage) const;
+
+    /**
+     * @brief Get the exposure-to-pose latency percentiles
+     */
+    LatencyPercentiles GetEndToEndPercentiles() const;
+
+    /**
+     * @brief Remove all samples (not safe against a concurrent Record())
+     */
+    void Reset();
+
+private:
+    std::array<LatencyHistogram, kNumLatencyStages> mStages;
+    LatencyHistogram mEndToEnd;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // LATENCY_TRACE_HPP
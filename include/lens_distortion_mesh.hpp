@@ -0,0 +1,98 @@
+#ifndef LENS_DISTORTION_MESH_HPP
+#define LENS_DISTORTION_MESH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+constexpr uint32_t kDistortionMeshMagic = 0x4853454D;  ///< "MESH", RK3588_VR_MESH_MAGIC
+constexpr int kDistortionMeshMinDim = 2;                ///< RK3588_VR_MESH_MIN_DIM
+constexpr int kDistortionMeshMaxDim = 65;               ///< RK3588_VR_MESH_MAX_DIM
+constexpr int kDistortionMeshSubpixels = 16;            ///< Vertex offsets are in 1/16 pixels
+
+/**
+ * @brief Mesh header as rk3588_vr_display_set_distortion_mesh() expects it
+ *
+ * Mirrors struct rk3588_vr_mesh_header of the display driver, cols x rows
+ * vertices follow it row by row.
+ */
+struct DistortionMeshHeader {
+    uint32_t magic;               ///< kDistortionMeshMagic
+    uint16_t cols;                ///< Vertices per row
+    uint16_t rows;                ///< Vertex rows
+    uint16_t width;               ///< Output width spanned by the mesh in pixels
+    uint16_t height;              ///< Output height spanned by the mesh in pixels
+    uint32_t reserved;
+};
+
+/**
+ * @brief Mesh vertex, mirrors struct rk3588_vr_mesh_vertex
+ *
+ * Offset from the vertex position to the source pixel sampled there, per
+ * colour channel, in 1/16 pixels.
+ */
+struct DistortionMeshVertex {
+    int16_t red[2];               ///< x, y
+    int16_t green[2];
+    int16_t blue[2];
+};
+
+static_assert(sizeof(DistortionMeshHeader) == 16, "DistortionMeshHeader must match the driver layout");
+static_assert(sizeof(DistortionMeshVertex) == 12, "DistortionMeshVertex must match the driver layout");
+
+/**
+ * @brief Lens calibration of one eye
+ *
+ * Radial model per colour channel: an output pixel at normalized radius r
+ * from the optical centre samples the rendered image at radius
+ * r * (1 + k[0] r^2 + k[1] r^4 + k[2] r^6). Chromatic aberration is the
+ * difference between the channel coefficients.
+ */
+struct LensCalibration {
+    int width;                    ///< Display width in pixels
+    int height;                   ///< Display height in pixels
+    double center_x;              ///< Optical centre on the display in pixels
+    double center_y;
+    double radius_px;             ///< Pixels per unit of normalized radius
+    double k_red[3];              ///< Radial coefficients of the red channel
+    double k_green[3];
+    double k_blue[3];
+};
+
+/**
+ * @brief Builds the sparse distortion mesh of one eye from its calibration
+ *
+ * The display interpolates the mesh bilinearly, so a 33x33 or 65x65 grid
+ * replaces a dense per-pixel map at a fraction of the size and of the memory
+ * bandwidth it takes to upload.
+ *
+ * @param calibration Lens calibration of the eye
+ * @param cols Vertices per row, kDistortionMeshMinDim to kDistortionMeshMaxDim
+ * @param rows Vertex rows, kDistortionMeshMinDim to kDistortionMeshMaxDim
+ * @return Header and vertices ready to upload, empty if the arguments are invalid
+ */
+std::vector<uint8_t> BuildDistortionMesh(const LensCalibration& calibration, int cols, int rows);
+
+/**
+ * @brief Source position the mesh samples for an output pixel, in pixels
+ *
+ * Bilinear interpolation of the mesh as the display does it, for checking
+ * a mesh against its calibration.
+ *
+ * @param mesh Mesh built by BuildDistortionMesh()
+ * @param x Output pixel column
+ * @param y Output pixel row
+ * @param channel 0 red, 1 green, 2 blue
+ * @param src_x Output source column
+ * @param src_y Output source row
+ * @return False if mesh is not a valid mesh
+ */
+bool SampleDistortionMesh(const std::vector<uint8_t>& mesh, double x, double y, int channel,
+                          double& src_x, double& src_y);
+
+} // namespace ORB_SLAM3
+
+#endif // LENS_DISTORTION_MESH_HPP
@@ -0,0 +1,326 @@
+#ifndef MAP_SHARING_HPP
+#define MAP_SHARING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Keypoint of a shared keyframe
+ */
+struct KeyFrameDeltaKeyPoint {
+    float x = 0.0f;                 ///< Undistorted position, pixels
+    float y = 0.0f;
+    uint8_t octave = 0;             ///< Pyramid level
+    float angle = 0.0f;             ///< Orientation, degrees in [0, 360)
+};
+
+/**
+ * @brief Map point observed by a shared keyframe
+ */
+struct MapPointDelta {
+    uint64_t id = 0;                ///< Unique across the headsets, see MakeSharedMapPointId()
+    float position[3] = {0.0f, 0.0f, 0.0f};  ///< World position in the map of the publishing headset
+};
+
+/**
+ * @brief A keyframe one headset adds to the shared map
+ *
+ * Self-contained: the keypoints, their binary descriptors and bag of words,
+ * the pose and the map points the keyframe observes, so another headset can
+ * recognize the place and merge the keyframe without earlier deltas.
+ */
+struct KeyFrameDelta {
+    uint16_t device_id = 0;         ///< Publishing headset
+    uint64_t keyframe_id = 0;       ///< Keyframe id on that headset
+    double timestamp = 0.0;
+    float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};  ///< Tcw quaternion (x, y, z, w)
+    float translation[3] = {0.0f, 0.0f, 0.0f};     ///< Tcw translation
+    uint8_t camera = 0;             ///< Camera of the rig that took the keyframe
+    std::vector<KeyFrameDeltaKeyPoint> keypoints;
+    std::vector<uint8_t> descriptors;              ///< kMapDeltaDescriptorBytes per keypoint
+    std::vector<std::pair<uint32_t, float>> bow;  ///< Word id and weight, increasing word ids
+    std::vector<int32_t> observations;             ///< Index in points per keypoint, -1 for none
+    std::vector<MapPointDelta> points;
+};
+
+/// Bytes of one binary descriptor (256 bits, ORB or binarized SuperPoint)
+constexpr size_t kMapDeltaDescriptorBytes = 32;
+
+constexpr uint32_t kMapDeltaMagic = 0x444d5256;  ///< "VRMD"
+constexpr uint16_t kMapDeltaVersion = 1;
+
+/// Kinds in MapDeltaHeader::kind
+constexpr uint16_t kMapDeltaHello = 0;          ///< First message of a connection, no payload
+constexpr uint16_t kMapDeltaKeyFrame = 1;       ///< Payload is an encoded KeyFrameDelta
+
+/**
+ * @brief Header in front of every message on the map sharing connection
+ *
+ * Fixed-width fields in host order, both ends are little-endian aarch64 or
+ * x86-64.
+ */
+struct MapDeltaHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t kind;                  ///< kMapDelta* kind
+    uint16_t device_id;             ///< Publishing headset
+    uint16_t reserved;
+    uint32_t payload_bytes;
+};
+
+static_assert(sizeof(MapDeltaHeader) == 16, "MapDeltaHeader layout changed");
+
+/// Largest payload either end accepts
+constexpr uint32_t kMaxMapDeltaPayload = 4u << 20;
+
+/**
+ * @brief Map point id unique across the headsets of an arena
+ * @param device_id Headset that created the point
+ * @param local_id Id of the point on that headset
+ */
+inline uint64_t MakeSharedMapPointId(uint16_t device_id, uint64_t local_id)
+{
+    return (static_cast<uint64_t>(device_id) << 48) | (local_id & ((1ull << 48) - 1));
+}
+
+/**
+ * @brief Compact encoding of a keyframe delta
+ *
+ * Keypoints are quantized to 1/16 pixel and their angle to 1.4 degrees (6
+ * bytes instead of the 28 of a cv::KeyPoint), the bag of words weights to 16
+ * bits, and the word ids, map point ids and observations are delta and
+ * varint coded. Descriptors, pose and point positions are kept exact. A
+ * typical 1000 keypoint keyframe takes about 45 kB.
+ */
+class MapDeltaCodec
+{
+public:
+    /**
+     * @brief Encode a delta
+     * @param delta Keyframe delta, keypoints within 4096 pixels
+     * @param payload Output bytes, capacity is reused across calls
+     * @return False if the delta is inconsistent (descriptor or observation count)
+     */
+    static bool Encode(const KeyFrameDelta& delta, std::vector<uint8_t>& payload);
+
+    /**
+     * @brief Decode a delta
+     * @param payload Encoded bytes
+     * @param size Number of bytes
+     * @param device_id Publishing headset, from the message header
+     * @param delta Output keyframe delta
+     * @return False if the payload is truncated or malformed
+     */
+    static bool Decode(const uint8_t* payload, size_t size, uint16_t device_id, KeyFrameDelta& delta);
+};
+
+/**
+ * @brief Publishes the keyframes of a headset to the map server and receives the others'
+ *
+ * Deltas are encoded on Publish() and queued until the connection takes
+ * them. The connection to the map server is a TCP stream over the Wi-Fi
+ * link, kept in the background by Poll(): it reconnects after a loss and
+ * resends the message that was in flight, so no published keyframe is lost
+ * unless the queue overflows. On every (re)connection the server replays
+ * the deltas of the other headsets the client has not seen.
+ *
+ * Publish() is thread-safe, Poll() is called from one thread.
+ */
+class MapShareClient
+{
+public:
+    struct Options {
+        std::string host;                       ///< Map server address (IPv4)
+        int port = 9955;
+        uint16_t device_id = 0;                 ///< Unique per headset of the arena
+        size_t max_queued_bytes = 16u << 20;    ///< Encoded deltas waiting for the connection
+        int reconnect_interval_ms = 1000;
+        int dscp = 10;                          ///< AF11, best effort below the video and pose traffic
+    };
+
+    struct Stats {
+        uint64_t deltas_published = 0;
+        uint64_t deltas_sent = 0;
+        uint64_t deltas_dropped = 0;            ///< Queue overflow or encoding failure
+        uint64_t deltas_received = 0;
+        uint64_t bytes_sent = 0;
+        uint64_t bytes_received = 0;
+        uint64_t messages_invalid = 0;
+        uint64_t connections = 0;
+        size_t queued_bytes = 0;
+    };
+
+    /**
+     * @brief Constructor, the connection is made by Poll()
+     * @param options Map server and queue size
+     */
+    explicit MapShareClient(const Options& options);
+
+    /**
+     * @brief Destructor, closes the connection
+     */
+    ~MapShareClient();
+
+    MapShareClient(const MapShareClient&) = delete;
+    MapShareClient& operator=(const MapShareClient&) = delete;
+
+    /**
+     * @brief Check if the server address was accepted
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Check if the connection to the server is up
+     */
+    bool IsConnected() const;
+
+    /**
+     * @brief Encode a keyframe and queue it for the server
+     * @param delta Keyframe delta, device_id is replaced by the client's
+     * @return False if it could not be encoded or the queue is full
+     */
+    bool Publish(const KeyFrameDelta& delta);
+
+    /**
+     * @brief Keep the connection, send the queued deltas and receive the others'
+     * @param received Output deltas of the other headsets, appended
+     * @param timeout_ms Maximum time to wait for traffic (0 to only do what is ready)
+     * @return Number of deltas received
+     */
+    size_t Poll(std::vector<KeyFrameDelta>& received, int timeout_ms);
+
+    /**
+     * @brief Get the statistics
+     */
+    Stats GetStats() const;
+
+private:
+    bool connect();
+    void disconnect();
+    bool flush();
+    bool receive(std::vector<KeyFrameDelta>& received, size_t& count);
+
+    bool mValid;
+    Options mOptions;
+    int mSocket;
+    bool mConnected;
+    double mNextConnectTime;
+    std::vector<uint8_t> mHello;
+    size_t mHelloSent;                      ///< Bytes of the hello sent on this connection
+    std::vector<uint8_t> mReceiveBuffer;
+    size_t mSendOffset;                     ///< Bytes of the front message sent on this connection
+    std::deque<std::vector<uint8_t>> mQueue;  ///< Header and payload per delta
+    size_t mQueuedBytes;
+    mutable std::mutex mQueueMutex;
+    Stats mStats;
+    mutable std::mutex mStatsMutex;
+};
+
+/**
+ * @brief Map server of an arena, relays the deltas of every headset to the others
+ *
+ * Keeps a log of the deltas so a headset that joins or reconnects gets the
+ * whole shared map, except its own deltas. The log is bounded, the oldest
+ * deltas go first. A headset that does not read its backlog is disconnected,
+ * it gets the log again when it reconnects.
+ *
+ * Not thread-safe, Poll() is called from one thread.
+ */
+class MapShareServer
+{
+public:
+    struct Options {
+        int port = 9955;                        ///< 0 picks a free port, see GetPort()
+        int max_clients = 16;
+        size_t max_log_bytes = 256u << 20;
+        size_t max_client_backlog_bytes = 64u << 20;
+    };
+
+    struct Stats {
+        int clients = 0;
+        uint64_t deltas_received = 0;
+        uint64_t deltas_relayed = 0;            ///< Once per receiving headset
+        uint64_t bytes_relayed = 0;
+        uint64_t messages_invalid = 0;
+        uint64_t clients_dropped = 0;           ///< Backlog overflow
+        size_t log_bytes = 0;
+    };
+
+    /**
+     * @brief Constructor, binds and listens
+     * @param options Port and limits
+     */
+    explicit MapShareServer(const Options& options);
+
+    /**
+     * @brief Destructor, closes every connection
+     */
+    ~MapShareServer();
+
+    MapShareServer(const MapShareServer&) = delete;
+    MapShareServer& operator=(const MapShareServer&) = delete;
+
+    /**
+     * @brief Check if the socket was bound
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Get the bound TCP port
+     */
+    int GetPort() const;
+
+    /**
+     * @brief Accept headsets, relay their deltas and write the backlogs
+     * @param timeout_ms Maximum time to wait for traffic
+     */
+    void Poll(int timeout_ms);
+
+    /**
+     * @brief Get the statistics
+     */
+    Stats GetStats() const;
+
+private:
+    struct Client {
+        int fd = -1;
+        bool hello = false;                 ///< Device known, receives relayed deltas
+        bool dropped = false;               ///< Backlog overflowed, closed by Poll()
+        uint16_t device_id = 0;
+        std::vector<uint8_t> receive_buffer;
+        std::vector<uint8_t> send_buffer;
+        size_t send_offset = 0;
+    };
+
+    struct LogEntry {
+        uint16_t device_id;
+        std::vector<uint8_t> message;       ///< Header and payload
+    };
+
+    void accept();
+    bool receive(Client& client);
+    bool handleMessage(Client& client, const MapDeltaHeader& header, const uint8_t* message, size_t size);
+    bool queueMessage(Client& client, const uint8_t* message, size_t size);
+    bool flush(Client& client);
+    void closeClient(size_t index);
+
+    bool mValid;
+    Options mOptions;
+    int mSocket;
+    int mPort;
+    std::vector<Client> mClients;
+    std::deque<LogEntry> mLog;
+    Stats mStats;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // MAP_SHARING_HPP
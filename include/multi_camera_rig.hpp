@@ -4,7 +4,11 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <utility>
 #include <memory>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <sophus/se3.hpp>
 #include "opencv2/core/mat.hpp"
 #include "opencv2/calib3d.hpp"
 
@@ -36,6 +40,8 @@ public:
         std::string model;              // Camera model (pinhole, fisheye, etc.)
         float fov_horizontal;           // Horizontal field of view in degrees
         float fov_vertical;             // Vertical field of view in degrees
+        std::string mask_path;          // Static mask image file (empty for none)
+        cv::Mat mask;                   // Static mask, CV_8UC1, zero where the view is occluded
     };
     
     /**
@@ -86,6 +92,20 @@ public:
      */
     std::vector<CameraInfo> GetAllCameras() const;
     
+    /**
+     * @brief Get all cameras in the rig without copying them
+     * 
+     * @return Cameras by ID, valid until a camera is added or removed
+     */
+    const std::map<int, CameraInfo>& GetCameras() const;
+    
+    /**
+     * @brief Get the number of cameras in the rig
+     * 
+     * @return Number of cameras
+     */
+    size_t GetNumCameras() const;
+    
     /**
      * @brief Get the reference camera ID
      * 
@@ -101,18 +121,86 @@ public:
      */
     bool SetReferenceCameraId(int camera_id);
     
+    /**
+     * @brief Targets at which the incremental calibration stops taking images
+     */
+    struct CalibrationTargets {
+        int min_views = 8;              // Pattern views of a camera before its intrinsics are solved
+        int max_views = 40;             // Views solved over per camera (0 for no limit)
+        float min_coverage = 0.7f;      // Fraction of the coverage grid cells the corners have visited
+        float max_rms_px = 0.3f;        // Reprojection RMS the intrinsics must reach
+        int coverage_cols = 8;          // Coverage grid over the image
+        int coverage_rows = 6;
+        int min_pair_views = 5;         // Image sets seen by both cameras of a pair linking them in the rig
+    };
+    
     /**
      * @brief Calibrate the camera rig using a set of calibration images
      * 
+     * Runs the incremental calibration over the images in capture order, the
+     * patterns of the next few image sets detected in parallel over images
+     * and cameras, and stops once the targets are met, so the remaining
+     * images are never looked at.
+     * 
      * @param calibration_images Vector of image sets, one set per camera
      * @param pattern_size Size of the calibration pattern (e.g., chessboard)
      * @param square_size Physical size of each square in the pattern
+     * @param targets Coverage and reprojection targets
      * @return true if calibration was successful, false otherwise
      */
     bool CalibrateRig(
         const std::vector<std::vector<cv::Mat>>& calibration_images,
         const cv::Size& pattern_size,
-        float square_size);
+        float square_size,
+        const CalibrationTargets& targets = CalibrationTargets());
+    
+    /**
+     * @brief Start an incremental calibration, e.g. on a calibration station
+     * 
+     * Image sets are then added as they are captured with
+     * AddCalibrationImages() until it reports the targets met, and
+     * FinishCalibration() solves the rig.
+     * 
+     * @param pattern_size Size of the calibration pattern (inner corners)
+     * @param square_size Physical size of each square in the pattern
+     * @param targets Coverage and reprojection targets
+     */
+    void BeginCalibration(
+        const cv::Size& pattern_size,
+        float square_size,
+        const CalibrationTargets& targets = CalibrationTargets());
+    
+    /**
+     * @brief Add a synchronized image set to the incremental calibration
+     * 
+     * The pattern is detected in every camera still short of its targets,
+     * in parallel. A view that adds coverage updates the intrinsics of its
+     * camera, warm-started from the previous solution. A camera stops taking
+     * views once its coverage and RMS targets are met.
+     * 
+     * @param images One image per camera, in camera ID order
+     * @return true once every camera met its targets and the cameras are linked
+     *         to the reference camera by pairs of min_pair_views common views
+     */
+    bool AddCalibrationImages(const std::vector<cv::Mat>& images);
+    
+    /**
+     * @brief Whether the incremental calibration met its targets
+     */
+    bool IsCalibrationConverged() const;
+    
+    /**
+     * @brief Solve the rig from the images added since BeginCalibration()
+     * 
+     * Sets the intrinsics, initializes every camera's pose from the pattern
+     * poses along the pairs linking it to the reference camera, and refines
+     * all of them with the pattern poses in one sparse bundle adjustment
+     * with fixed intrinsics. Cameras short of their targets are solved from
+     * what they have, with a warning.
+     * 
+     * @return true if every camera was calibrated and linked to the reference camera
+     */
+    bool FinishCalibration();
     
     /**
      * @brief Load camera rig calibration from a file
@@ -133,6 +221,10 @@ public:
     /**
      * @brief Project a set of images to a spherical panorama
      * 
+     * The per-camera remap tables are built on the first call for a resolution
+     * and cached (fixed-point, cropped to the pixels the camera sees) until the
+     * calibration changes. The blend runs in parallel over rows of tiles.
+     * 
      * @param images Vector of images, one per camera
      * @param resolution Resolution of the output panorama
      * @return Spherical panorama image
@@ -182,6 +274,51 @@ public:
      */
     int FindBestCameraForPoint(const cv::Point3f& sphere_point);
     
+    /**
+     * @brief Check if the fields of view of two cameras can overlap
+     * 
+     * Conservative test on the angle between the optical axes against the
+     * half-diagonal FOVs, so only pairs that certainly see disjoint directions
+     * are rejected. Cameras without a FOV are assumed to overlap everything.
+     * 
+     * @param camera_id1 ID of the first camera
+     * @param camera_id2 ID of the second camera
+     * @return true if the views may overlap, false otherwise
+     */
+    bool DoCamerasOverlap(int camera_id1, int camera_id2);
+    
+    /**
+     * @brief Precompute the image-space overlap masks of all camera pairs
+     * 
+     * For every ordered pair (camera_id1, camera_id2) marks the pixels of
+     * camera_id1 whose ray at the given depth projects into camera_id2,
+     * sampled on a coarse grid and grown by one cell. The masks are cleared
+     * whenever the calibration changes and must then be computed again.
+     * 
+     * @param depth Depth along the ray at which pixels are projected (meters)
+     * @param margin Margin beyond the image border of camera_id2 still counted as overlap (pixels)
+     */
+    void ComputeOverlapMasks(float depth = 1.0f, float margin = 10.0f);
+    
+    /**
+     * @brief Get the overlap mask of a camera pair
+     * 
+     * @param camera_id1 ID of the camera whose image the mask covers
+     * @param camera_id2 ID of the other camera
+     * @return CV_8UC1 mask at the resolution of camera_id1, non-zero where
+     *         camera_id2 sees the same rays, or empty if not computed
+     */
+    cv::Mat GetOverlapMask(int camera_id1, int camera_id2) const;
+    
+    /**
+     * @brief Get the fraction of camera_id1's image covered by its overlap with camera_id2
+     * 
+     * @param camera_id1 ID of the camera whose image the mask covers
+     * @param camera_id2 ID of the other camera
+     * @return Overlap ratio in [0, 1], or -1 if the masks were not computed
+     */
+    float GetOverlapRatio(int camera_id1, int camera_id2) const;
+    
     /**
      * @brief Transform a point from one camera's coordinate system to another
      * 
@@ -195,6 +332,38 @@ public:
         int source_camera_id,
         int target_camera_id);
     
+    /**
+     * @brief Transform a batch of points from one camera's coordinate system to another
+     * 
+     * @param points 3D points in source camera coordinates
+     * @param source_camera_id ID of the source camera
+     * @param target_camera_id ID of the target camera
+     * @param transformed Output 3D points in target camera coordinates, same order
+     * @return true if both cameras exist, false otherwise
+     */
+    bool TransformPoints(
+        const std::vector<cv::Point3f>& points,
+        int source_camera_id,
+        int target_camera_id,
+        std::vector<cv::Point3f>& transformed);
+    
+    /**
+     * @brief Transform a batch of points from one camera's coordinate system to another
+     * 
+     * @param points Array of count 3D points in source camera coordinates
+     * @param count Number of points
+     * @param source_camera_id ID of the source camera
+     * @param target_camera_id ID of the target camera
+     * @param transformed Output array of count points in target camera coordinates (may alias points)
+     * @return true if both cameras exist, false otherwise
+     */
+    bool TransformPoints(
+        const Eigen::Vector3f* points,
+        size_t count,
+        int source_camera_id,
+        int target_camera_id,
+        Eigen::Vector3f* transformed);
+    
     /**
      * @brief Get the transform from one camera to another
      * 
@@ -204,6 +373,20 @@ public:
      */
     cv::Mat GetTransform(int source_camera_id, int target_camera_id);
     
+    /**
+     * @brief Get the transform from one camera to another
+     * 
+     * Read from a table of all ordered camera pairs that is built on first use
+     * and rebuilt after the calibration changes, so no matrices are inverted
+     * or allocated per call.
+     * 
+     * @param source_camera_id ID of the source camera
+     * @param target_camera_id ID of the target camera
+     * @param T_target_source Output transform from source to target
+     * @return true if both cameras exist, false otherwise
+     */
+    bool GetTransform(int source_camera_id, int target_camera_id, Sophus::SE3f& T_target_source);
+    
     /**
      * @brief Update the transform between two cameras
      * 
@@ -217,24 +400,130 @@ public:
         int target_camera_id,
         const cv::Mat& transform);
     
+    /**
+     * @brief Rectification of a stereo pair at a given resolution
+     */
+    struct StereoRectification {
+        cv::Size size;                  // Resolution of the rectified images
+        cv::Mat map_left_x, map_left_y;   // CV_32FC1 camera pixel of each rectified left pixel
+        cv::Mat map_right_x, map_right_y; // CV_32FC1 camera pixel of each rectified right pixel
+        cv::Mat R_left, R_right;        // Rotations from the camera to the rectified frames (CV_64F)
+        float fx, fy, cx, cy;           // Intrinsics of both rectified images
+        float baseline;                 // Distance between the camera centers (meters)
+    };
+    
+    /**
+     * @brief Get the rectification of a stereo pair, e.g. for dense matching
+     * 
+     * Computed with cv::stereoRectify (cv::fisheye for "fisheye" cameras)
+     * for rectified images of the given size, which may be smaller than the
+     * cameras' resolution, and cached until the calibration changes. The
+     * maps sample the full-resolution camera images, so rectification and
+     * downscaling are one remap. The right camera must be displaced along
+     * the x axis of the left one.
+     * 
+     * @param left_camera_id ID of the left camera
+     * @param right_camera_id ID of the right camera
+     * @param size Resolution of the rectified images
+     * @return Rectification, or nullptr if a camera does not exist or is not calibrated
+     */
+    const StereoRectification* GetStereoRectification(
+        int left_camera_id,
+        int right_camera_id,
+        const cv::Size& size);
+    
 private:
+    // Cached fixed-point remap of a camera into a panorama of a given size
+    struct SphericalRemap {
+        cv::Rect roi;                   // Bounding box of the visible pixels in the panorama
+        cv::Mat map1;                   // CV_16SC2 integer source coordinates over the ROI
+        cv::Mat map2;                   // CV_16UC1 interpolation table indices over the ROI
+        cv::Mat valid;                  // CV_8UC1, non-zero where the camera sees the pixel
+    };
+    
     // Map of camera ID to camera information
     std::map<int, CameraInfo> cameras_;
     
     // ID of the reference camera
     int reference_camera_id_;
     
+    // Overlap masks and ratios per ordered camera pair, see ComputeOverlapMasks()
+    std::map<std::pair<int, int>, cv::Mat> overlap_masks_;
+    std::map<std::pair<int, int>, float> overlap_ratios_;
+    
+    // Spherical remap tables per camera and panorama size (width, height)
+    std::map<std::pair<int, std::pair<int, int>>, SphericalRemap> spherical_remaps_;
+    
+    // Stereo rectifications per camera pair and resolution
+    std::map<std::pair<std::pair<int, int>, std::pair<int, int>>, StereoRectification> stereo_rectifications_;
+    
+    // Transforms of all ordered camera pairs, row-major over the sorted camera
+    // IDs: transforms_[i * n + j] maps camera transform_ids_[i] into transform_ids_[j]
+    std::vector<int> transform_ids_;
+    std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f>> transforms_;
+    bool transforms_valid_;
+    
+    // Incremental calibration state of a camera
+    struct CameraCalibration {
+        int id;                         // Camera identifier
+        cv::Size image_size;            // Resolution of the images
+        std::vector<std::vector<cv::Point2f>> corners; // Refined corners per image set, empty where not found
+        std::vector<int> views;         // Image sets the intrinsics are solved over
+        cv::Mat coverage;               // CV_8UC1 coverage grid, non-zero where a corner was seen
+        int covered_cells;              // Non-zero cells of the coverage grid
+        cv::Mat K, distCoef;            // Last solution (CV_64F), empty before min_views
+        double rms;                     // Reprojection RMS of the last solution
+        bool converged;                 // Coverage and RMS targets met
+    };
+    
+    // Incremental calibration since BeginCalibration()
+    struct CalibrationSession {
+        bool active = false;
+        cv::Size pattern_size;
+        CalibrationTargets targets;
+        std::vector<cv::Point3f> pattern_points; // Corners on the pattern plane, scaled by the square size
+        int num_sets = 0;               // Image sets added
+        std::vector<CameraCalibration> cameras; // In camera ID order
+    };
+    CalibrationSession calibration_;
+    
     // Helper methods for calibration
-    bool CalibrateIndividualCameras(
-        const std::vector<std::vector<cv::Mat>>& calibration_images,
-        const cv::Size& pattern_size,
-        float square_size);
+    void AddCalibrationImageSets(const std::vector<std::vector<cv::Mat>>& image_sets);
     
-    bool CalibrateCameraPairs(
-        const std::vector<std::vector<cv::Mat>>& calibration_images,
-        const cv::Size& pattern_size);
+    void IntegrateCalibrationView(CameraCalibration& camera, int set);
+    
+    // Common image sets of two cameras of the session
+    int CountCommonViews(const CameraCalibration& camera1, const CameraCalibration& camera2) const;
+    
+    // Cameras of the session linked to the reference camera, each with the index of the camera it is
+    // linked through (-1 for the reference camera and unlinked cameras), breadth first
+    std::vector<int> LinkCameras(std::vector<int>& order) const;
+    
+    bool CalibrateIndividualCameras();
+    
+    bool CalibrateCameraPairs(std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d>>& T_cam_ref);
+    
+    bool OptimizeRigCalibration(std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d>>& T_cam_ref);
+    
+    // Helper methods for overlap masks
+    cv::Mat ComputeOverlapMask(
+        int camera_id1,
+        int camera_id2,
+        float depth,
+        float margin);
+    
+    const SphericalRemap& GetSphericalRemap(
+        int camera_id,
+        const cv::Size& panorama_size);
+    
+    // Drops everything derived from the calibration (overlap masks, remap tables, pair transforms)
+    void InvalidateCalibrationCaches();
+    
+    // Helper methods for the pair transform table
+    void BuildTransformTable();
     
-    bool OptimizeRigCalibration();
+    // Entry of the table for a pair, building it if needed, or nullptr if a camera does not exist
+    const Sophus::SE3f* FindTransform(int source_camera_id, int target_camera_id);
     
     // Helper methods for projection
     cv::Mat CreateSphericalMap(
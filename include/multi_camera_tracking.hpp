@@ -3,18 +3,25 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <opencv2/core/mat.hpp>
 
 #include "multi_camera_rig.hpp"
+#include "keyframe_policy.hpp"
+#include "latency_trace.hpp"
+#include "map_sharing.hpp"
+#include "worker_pool.hpp"
 #include "../ORB_SLAM3/include/Tracking.h"
 #include "../ORB_SLAM3/include/System.h"
 #include "../ORB_SLAM3/include/Frame.h"
 #include "../ORB_SLAM3/include/Atlas.h"
 #include "../ORB_SLAM3/include/KeyFrameDatabase.h"
+#include "../ORB_SLAM3/include/MemoryAccounting.h"
 #include "../ORB_SLAM3/include/tpu_feature_extractor.hpp"
 
 namespace ORB_SLAM3
@@ -39,9 +46,21 @@ public:
         bool use_spherical_model = true;            ///< Use spherical field of view model
         bool parallel_feature_extraction = true;    ///< Extract features in parallel across cameras
         float max_depth_difference = 0.1f;          ///< Maximum depth difference for cross-camera matching (ratio)
-        float max_descriptor_distance = 50.0f;      ///< Maximum descriptor distance for cross-camera matching
+        float max_descriptor_distance = 50.0f;      ///< Maximum descriptor distance for cross-camera matching (0-256, see DescriptorTraits.h)
         int min_cross_camera_matches = 10;          ///< Minimum number of cross-camera matches to consider
         float feature_sharing_overlap = 0.2f;       ///< Overlap region for feature sharing (ratio of FOV)
+        std::vector<int> worker_cpu_cores;          ///< Cores to pin the extraction workers to (empty for no pinning)
+        int scheduled_cameras = 0;                  ///< Cameras extracted every frame, chosen by score (0 for all)
+        int unscheduled_camera_interval = 4;        ///< Frames between extractions on the other cameras
+        int min_tracked_points = 50;                ///< Tracked points below which all cameras run until recovery
+        bool joint_pose_optimization = true;        ///< Refine the pose over all scheduled cameras in one solve
+        bool parallel_local_map_search = true;      ///< Project and match the local map over the worker pool
+        bool parallel_triangulation = true;         ///< Triangulate and cull in the local mapper over the worker pool
+        bool parallel_loop_verification = true;     ///< Verify the loop closer's BoW candidates over the worker pool
+        bool async_bow = true;                      ///< Compute the bag of words of keyframe candidates on the worker pool
+        int keyframe_batch_size = 4;                ///< Queued keyframes the local mapper processes together (1 for one at a time)
+        bool cost_aware_keyframes = true;           ///< Weigh each keyframe against its mapping cost before inserting it
+        KeyFramePolicy::Config keyframe_policy;     ///< Thresholds of the cost-aware keyframe insertion
     };
     
     /**
@@ -88,6 +107,21 @@ public:
         const double& timestamp,
         const std::vector<std::string>& filenames = std::vector<std::string>());
     
+    /**
+     * @brief Process multiple synchronized camera frames and stamp TRACK_DONE
+     * 
+     * @param images Vector of images, one per camera
+     * @param timestamp Timestamp of the frame set
+     * @param latency Latency stamps of the frame set, stamped when tracking finishes
+     * @param filenames Vector of filenames (optional)
+     * @return Estimated camera pose
+     */
+    Sophus::SE3f GrabMultiCameraImages(
+        const std::vector<cv::Mat>& images,
+        const double& timestamp,
+        LatencyStamps& latency,
+        const std::vector<std::string>& filenames = std::vector<std::string>());
+    
     /**
      * @brief Get the best camera for viewing a specific 3D point
      * 
@@ -160,6 +194,172 @@ public:
      */
     std::vector<TPUFeatureExtractor*> GetFeatureExtractors() const;
     
+    /**
+     * @brief Save the atlas to a sectioned atlas file through the ORB-SLAM3 system
+     * 
+     * @param filename Path of the atlas file
+     * @return true if the atlas was saved, false without a system or on error
+     */
+    bool SaveMap(const std::string& filename);
+    
+    /**
+     * @brief Load an atlas file through the ORB-SLAM3 system, only before tracking starts
+     * 
+     * @param filename Path of the atlas file
+     * @return true if the atlas was loaded, false without a system or on error
+     */
+    bool LoadMap(const std::string& filename);
+    
+    /**
+     * @brief Checkpoint the atlas to an atlas file in the background while tracking continues
+     * 
+     * @param filename Path of the atlas file, replaced once the new one is complete
+     * @param bytes_per_second Write rate limit, 0 for unthrottled
+     * @return true if the checkpoint was started, false without a system or while the previous one is written
+     */
+    bool Checkpoint(const std::string& filename, size_t bytes_per_second);
+    
+    /**
+     * @brief Whether a checkpoint is being taken or written
+     */
+    bool IsCheckpointing() const;
+    
+    /**
+     * @brief Add the estimated memory of the atlas and the keyframe database, by structure
+     * 
+     * Walks every keyframe and map point of the atlas, call it at a low rate.
+     * 
+     * @param breakdown Breakdown to add to
+     */
+    void GetMemoryBreakdown(MemoryBreakdown& breakdown) const;
+    
+    /**
+     * @brief Set the current head motion used to score the cameras and weigh keyframes
+     * 
+     * Cameras facing the direction of travel score higher, as they see the
+     * map the head is moving into. The keyframe policy extrapolates the motion
+     * since the last keyframe over the mapping latency. Typically fed from VRMotionModel.
+     * 
+     * @param linear_velocity Linear velocity in world coordinates (m/s)
+     * @param angular_velocity Angular velocity (rad/s)
+     */
+    void SetMotionHint(const Eigen::Vector3f& linear_velocity,
+                       const Eigen::Vector3f& angular_velocity = Eigen::Vector3f::Zero());
+    
+    /**
+     * @brief Get the cameras extracted in the last frame set
+     * 
+     * @return Camera IDs extracted in the last GrabMultiCameraImages() call
+     */
+    std::vector<int> GetScheduledCameras() const;
+    
+    /**
+     * @brief Get the scheduling score of each camera
+     * 
+     * @return Score per camera ID in [0, 1] from tracked points, texture and motion
+     */
+    std::vector<float> GetCameraScores() const;
+    
+    /**
+     * @brief Get the keypoints and tracked map points of the last frame set
+     * 
+     * @param keypoints Keypoints extracted, summed over the scheduled cameras
+     * @param tracked_points Tracked map points, summed over the scheduled cameras
+     */
+    void GetFrameSetFeatureCounts(int& keypoints, int& tracked_points) const;
+    
+    /**
+     * @brief Get the last decision of the cost-aware keyframe policy
+     */
+    KeyFramePolicy::Decision GetLastKeyFrameDecision() const;
+    
+    /**
+     * @brief Get the number of keyframes the policy suppressed
+     */
+    uint64_t GetSuppressedKeyFrameCount() const;
+    
+    /**
+     * @brief Get the worker pool used for per-camera extraction and matching
+     * 
+     * Other threads (e.g. LocalMapping) may submit jobs to it to share the cores.
+     * 
+     * @return Worker pool, or nullptr if parallel feature extraction is disabled
+     */
+    WorkerPool* GetWorkerPool() const;
+    
+    /**
+     * @brief Set the local bundle adjustment window of the connected LocalMapping
+     * 
+     * The local map tracked against is limited with SetMaxLocalKeyFrames().
+     * 
+     * @param max_keyframes Maximum number of optimized covisible keyframes (0 for all)
+     */
+    void SetLocalBAWindow(int max_keyframes);
+    
+    /**
+     * @brief Switch between real-time tracking and offline mapping of a recording
+     * 
+     * Offline, new keyframes no longer interrupt the local BA and tracking
+     * waits for local mapping instead of dropping keyframes, the cost-aware
+     * keyframe policy is bypassed and every local BA optimizes all covisible
+     * keyframes on all cores for its full iterations. The BA settings are
+     * left as they are when switching back.
+     * 
+     * @param offline True to map offline
+     */
+    void SetOfflineMapping(bool offline);
+    
+    /**
+     * @brief Run a global BA over every map of the atlas through the ORB-SLAM3 system
+     * 
+     * Waits for local mapping to process its queued keyframes first, call it
+     * once the input has ended.
+     * 
+     * @param iterations Optimizer iterations
+     * @return true if it ran, false without a system
+     */
+    bool RunGlobalBundleAdjustment(int iterations);
+    
+    /**
+     * @brief Callback with the result of every frame set
+     * 
+     * Called with the tracked pose Tcw of the active camera, the frame set timestamp,
+     * and the keypoints and map point matches of each extracted camera, all empty
+     * when tracking is not OK.
+     */
+    typedef std::function<void(const Sophus::SE3f& Tcw, double timestamp,
+                               const std::vector<std::vector<cv::KeyPoint>>& keypoints,
+                               const std::vector<std::vector<MapPoint*>>& map_points)> FrameCallback;
+    
+    /**
+     * @brief Register a callback invoked at the end of every GrabMultiCameraImages() call
+     * 
+     * The callback runs on the tracking thread, so it must not block. An empty
+     * callback unregisters it.
+     * 
+     * @param callback Function called with each frame set result
+     */
+    void RegisterFrameCallback(FrameCallback callback);
+    
+    /**
+     * @brief Callback with every keyframe created, in the shared map encoding
+     * 
+     * The delta is reused across calls, the callback copies what it keeps.
+     */
+    typedef std::function<void(const KeyFrameDelta& delta)> KeyFrameCallback;
+    
+    /**
+     * @brief Register a callback invoked after every keyframe creation, e.g. to publish it to the map server
+     * 
+     * The callback runs on the tracking thread, so it must not block. Keyframes
+     * whose descriptors are not 256-bit binary are not handed to it. An empty
+     * callback unregisters it.
+     * 
+     * @param callback Function called with each new keyframe
+     * @param device_id Headset id that makes the map point ids unique across the headsets
+     */
+    void RegisterKeyFrameCallback(KeyFrameCallback callback, uint16_t device_id);
+    
 protected:
     /**
      * @brief Main tracking function for multi-camera setup
@@ -169,12 +369,26 @@ protected:
     void Track() override;
     
     /**
-     * @brief Extract features from all cameras
+     * @brief Extract features from the scheduled cameras
      * 
      * @param images Vector of images, one per camera
      */
     void ExtractFeaturesFromAllCameras(const std::vector<cv::Mat>& images);
     
+    /**
+     * @brief Choose the cameras to extract in this frame set
+     * 
+     * Runs the active camera and the best scoring others up to
+     * Config::scheduled_cameras, the rest every unscheduled_camera_interval
+     * frames (staggered), and every camera after tracking degraded.
+     */
+    void ScheduleCameras();
+    
+    /**
+     * @brief Update the camera scores after tracking
+     */
+    void UpdateCameraScores();
+    
     /**
      * @brief Match features across cameras
      * 
@@ -185,10 +399,28 @@ protected:
     /**
      * @brief Track local map with multiple cameras
      * 
+     * After the base tracker, projects the local map into the other scheduled
+     * cameras at the pose predicted through the rig extrinsics and refines the
+     * active camera's pose with Optimizer::PoseOptimizationMultiCamera, one
+     * pose vertex with fixed extrinsic edges for the other cameras.
+     * 
      * @return true if tracking was successful, false otherwise
      */
     bool TrackLocalMapWithMultiCameras();
     
+    /**
+     * @brief Weigh a keyframe the base tracker asks for against its mapping cost
+     * 
+     * Feeds KeyFramePolicy with the local mapper's measured cost, queue and BA
+     * latency, the motion since the last keyframe and from the motion hint, and
+     * the untracked keypoint fraction of the scheduled cameras (from the last
+     * frame set for the cameras other than the active one).
+     * 
+     * @param bUrgent Tracking is weak, the keyframe is always accepted
+     * @return true to insert the keyframe
+     */
+    bool AcceptKeyFrame(bool bUrgent) override;
+    
     /**
      * @brief Relocalization with multiple cameras
      * 
@@ -244,6 +476,17 @@ protected:
      */
     void UpdateCameraPoses(const Sophus::SE3f& T_w_ref);
     
+    /**
+     * @brief Route the base tracker's local map search, the local mapper's triangulation and
+     * the loop closer's candidate verification to the worker pool, or back to serial
+     *
+     * Follows Config::parallel_local_map_search, Config::parallel_triangulation,
+     * Config::parallel_loop_verification, Config::async_bow and whether the pool exists, and passes
+     * Config::keyframe_batch_size to the local mapper. Call again once the local mapper and
+     * loop closer are attached.
+     */
+    void UpdateLocalMapParallelism();
+    
 private:
     // Multi-camera rig
     MultiCameraRig mRig;
@@ -267,21 +510,87 @@ private:
     std::vector<Sophus::SE3f> mvCameraPoses;
     
     // Mutex for protecting multi-camera data
-    std::mutex mMutexMultiCamera;
+    mutable std::mutex mMutexMultiCamera;
+    
+    // Rig geometry of a camera pair, precomputed when the rig changes
+    struct CameraPairGeometry {
+        bool overlap = false;                       ///< Rig says the fields of view can overlap
+        Eigen::Matrix3f R_2_1 = Eigen::Matrix3f::Identity(); ///< Rotation from the first to the second camera
+        Eigen::Vector3f t_2_1 = Eigen::Vector3f::Zero();     ///< Translation from the first to the second camera
+        cv::Mat overlap_mask;                       ///< Rig overlap mask in the first camera's image (empty for all)
+    };
+    
+    // Pinhole intrinsics and resolution of a camera
+    struct CameraIntrinsics {
+        float fx = 1.0f, fy = 1.0f, cx = 0.0f, cy = 0.0f;
+        int width = 0, height = 0;
+    };
+    
+    // Optical axis of each camera in the reference camera frame
+    std::vector<Eigen::Vector3f> mvCameraAxes;
+    
+    // Camera scheduling: cameras extracted this frame set, their scores and the motion hint
+    std::vector<bool> mvbCameraScheduled;
+    std::vector<float> mvCameraScores;
+    Eigen::Vector3f mMotionHint = Eigen::Vector3f::Zero();
+    Eigen::Vector3f mAngularHint = Eigen::Vector3f::Zero();
+    bool mbScheduleAllCameras = true;
+    unsigned long mnScheduledFrames = 0;
     
-    // Thread for parallel feature extraction
-    std::vector<std::thread> mvFeatureExtractionThreads;
-    std::mutex mMutexFeatureExtraction;
-    std::condition_variable mCondVarFeatureExtraction;
+    // Keypoints and tracked points of the scheduled cameras in the last frame set
+    int mnFrameSetKeypoints = 0;
+    int mnFrameSetTrackedPoints = 0;
+    
+    // Untracked keypoint fraction of each camera when last extracted, and the keyframe policy
+    std::vector<float> mvCameraNovelty;
+    KeyFramePolicy mKeyFramePolicy;
+    
+    // Camera pair geometry indexed [camera_id1][camera_id2], and intrinsics per camera
+    std::vector<std::vector<CameraPairGeometry>> mvvCameraPairs;
+    std::vector<CameraIntrinsics> mvCameraIntrinsics;
+    
+    // Worker pool for parallel feature extraction and matching
+    std::unique_ptr<WorkerPool> mpWorkerPool;
     std::atomic<int> mNumCamerasProcessed;
     
+    // Frame set result callback, and the per-camera results handed to it (reused)
+    std::mutex mMutexFrameCallback;
+    FrameCallback mFrameCallback;
+    std::vector<std::vector<cv::KeyPoint>> mvCallbackKeypoints;
+    std::vector<std::vector<MapPoint*>> mvCallbackMapPoints;
+    
+    // Keyframe callback, its headset id and the delta handed to it (reused)
+    std::mutex mMutexKeyFrameCallback;
+    KeyFrameCallback mKeyFrameCallback;
+    uint16_t mnKeyFrameDeviceId = 0;
+    KeyFrameDelta mKeyFrameDelta;
+    
     // Helper methods
     
+    /**
+     * @brief Hand the result of the frame set to the frame callback, if any
+     * 
+     * @param timestamp Timestamp of the frame set
+     */
+    void NotifyFrameCallback(double timestamp);
+    
+    /**
+     * @brief Hand a new keyframe to the keyframe callback, if any
+     * 
+     * @param pKF Keyframe just created
+     */
+    void NotifyKeyFrameCallback(KeyFrame* pKF);
+    
     /**
      * @brief Initialize feature extractors for all cameras
      */
     void InitializeFeatureExtractors();
     
+    /**
+     * @brief Precompute the camera pair geometry and intrinsics from the rig
+     */
+    void PrecomputeCameraGeometry();
+    
     /**
      * @brief Extract features from a single camera
      * 
@@ -300,6 +609,17 @@ private:
     std::vector<std::pair<size_t, size_t>> FindMatchesBetweenCameras(
         int camera_id1, int camera_id2);
     
+    /**
+     * @brief Find matches between two cameras with the distance kernel of a descriptor type
+     * 
+     * @param camera_id1 ID of the first camera
+     * @param camera_id2 ID of the second camera
+     * @return Vector of matches (indices in respective frames)
+     */
+    template<class Descriptor>
+    std::vector<std::pair<size_t, size_t>> MatchCameraPair(
+        int camera_id1, int camera_id2);
+    
     /**
      * @brief Merge map points from cross-camera matches
      * 
@@ -0,0 +1,189 @@
+#ifndef ONLINE_CALIBRATION_HPP
+#define ONLINE_CALIBRATION_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Eigen/Core>
+#include <sophus/se3.hpp>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Background refinement of the IMU-camera extrinsic rotation and clock offset
+ *
+ * The calibration loaded at startup drifts: the headset frame warps with
+ * temperature and the OV9281 and BNO085 clocks are stamped with different
+ * delays, so the inertial residuals grow and bundle adjustment iterates more.
+ * Over a sliding window of tracked poses this estimator fits the rotation
+ * residuals between the gyro-integrated and the tracked relative rotations,
+ * Log(dR_imu^T R_bc dR_cam R_bc^T), in the IMU-camera rotation, the time
+ * offset between the clocks and a residual gyro bias (the latter only as a
+ * nuisance parameter). The fit is Gauss-Newton with Huber weights, the
+ * integration is redone at the current time offset in every iteration.
+ *
+ * A new calibration is only applied if the change of rotation and offset is
+ * statistically significant against its covariance (chi-square test) and the
+ * window excited it well enough. It is handed to the apply callback as one
+ * update, and the window restarts since the samples before it carry the old
+ * offset. The extrinsic translation is kept: the gyro does not observe it.
+ */
+class OnlineCalibration
+{
+public:
+    /**
+     * @brief Configuration
+     */
+    struct Config {
+        bool enabled = false;                   ///< Whether the calibration is refined while tracking
+        double window_s = 10.0;                 ///< Poses and gyro samples kept
+        double update_period_s = 2.0;           ///< Time between refinements
+        double min_interval_s = 0.1;            ///< Shortest pose interval a residual spans
+        double max_interval_s = 0.3;            ///< Longer intervals are tracking gaps and skipped
+        int min_intervals = 50;                 ///< Residuals needed for a refinement
+        int max_iterations = 8;                 ///< Gauss-Newton iterations per refinement
+        double huber_threshold_deg = 0.5;       ///< Rotation residual above which it is down-weighted
+        double significance_chi2 = 18.47;       ///< Chi-square of the change to apply it (4 DoF, 99.9%)
+        double max_rotation_sigma_deg = 0.2;    ///< Rotation uncertainty above which nothing is applied
+        double max_time_offset_sigma_ms = 0.5;  ///< Time offset uncertainty above which nothing is applied
+        double max_time_offset_ms = 30.0;       ///< Largest plausible change of the time offset
+    };
+
+    /**
+     * @brief IMU-camera calibration
+     */
+    struct Calibration {
+        Sophus::SE3f T_bc;                      ///< Camera to body (IMU) transform, as BNO085Interface::GetImuToCameraTransform()
+        double time_offset = 0.0;               ///< IMU clock minus camera clock in seconds
+    };
+
+    /**
+     * @brief Gyroscope sample, bias corrected, on the camera timeline of the current offset
+     */
+    struct GyroMeasurement {
+        double timestamp;
+        Eigen::Vector3f gyro;
+    };
+
+    /**
+     * @brief Estimator state
+     */
+    struct State {
+        double time_offset_ms = 0.0;            ///< Time offset currently applied
+        double rotation_change_deg = 0.0;       ///< Rotation applied on top of the initial calibration
+        double time_offset_sigma_ms = 0.0;      ///< Uncertainty of the last refinement
+        double rotation_sigma_deg = 0.0;        ///< Largest rotation uncertainty of the last refinement
+        double residual_rms_deg = 0.0;          ///< Residual of the last refinement
+        double chi2 = 0.0;                      ///< Chi-square of the change found by the last refinement
+        int intervals = 0;                      ///< Residuals of the last refinement
+        int updates = 0;                        ///< Calibrations applied
+    };
+
+    /**
+     * @brief Appends the gyro samples received since its last call
+     */
+    typedef std::function<void(std::vector<GyroMeasurement>&)> GyroSource;
+
+    /**
+     * @brief Applies a refined calibration, rotation and offset together
+     */
+    typedef std::function<void(const Calibration&)> ApplyCallback;
+
+    /**
+     * @brief Constructor
+     * @param config Configuration
+     * @param initial Calibration in use
+     * @param source Gyro samples, polled by every refinement
+     * @param apply Called with each calibration that passes the test
+     */
+    OnlineCalibration(const Config& config, const Calibration& initial, GyroSource source, ApplyCallback apply);
+
+    /**
+     * @brief Destructor, stops the thread
+     */
+    ~OnlineCalibration();
+
+    OnlineCalibration(const OnlineCalibration&) = delete;
+    OnlineCalibration& operator=(const OnlineCalibration&) = delete;
+
+    /**
+     * @brief Start refining every Config::update_period_s on a background thread
+     * @return False if already started
+     */
+    bool Start();
+
+    /**
+     * @brief Stop the thread
+     */
+    void Stop();
+
+    /**
+     * @brief Add a tracked pose, only for frames tracked well
+     * @param timestamp Exposure time of the frame (camera clock)
+     * @param Tcw Camera pose
+     */
+    void AddCameraPose(double timestamp, const Sophus::SE3f& Tcw);
+
+    /**
+     * @brief Poll the gyro source and refine over the current window
+     *
+     * The background thread calls this, it can also be called directly
+     * while the thread is stopped.
+     *
+     * @return True if a new calibration was applied
+     */
+    bool Update();
+
+    /**
+     * @brief Get the calibration currently applied
+     */
+    Calibration GetCalibration() const;
+
+    /**
+     * @brief Get the estimator state
+     */
+    State GetState() const;
+
+private:
+    struct PoseSample {
+        double timestamp;
+        Sophus::SO3d Rwc;
+    };
+
+    Config mConfig;
+    GyroSource mSource;
+    ApplyCallback mApply;
+    Sophus::SO3d mInitialRbc;
+
+    // Poses added by tracking, moved to the window by Update()
+    std::mutex mPoseMutex;
+    std::vector<PoseSample> mPendingPoses;
+
+    // Window, only touched by Update()
+    std::mutex mUpdateMutex;
+    std::deque<PoseSample> mPoses;
+    std::deque<GyroMeasurement> mGyro;
+    std::vector<GyroMeasurement> mNewGyro;
+
+    mutable std::mutex mStateMutex;
+    Calibration mCalibration;
+    State mState;
+
+    std::thread mThread;
+    std::mutex mThreadMutex;
+    std::condition_variable mThreadCondition;
+    bool mRunning;
+
+    void ThreadFunction();
+    bool IntegrateGyro(double start, double end, const Eigen::Vector3d& bias,
+                       Sophus::SO3d& delta_R, Eigen::Matrix3d& JRg) const;
+    Eigen::Vector3d InterpolateGyro(double timestamp) const;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // ONLINE_CALIBRATION_HPP
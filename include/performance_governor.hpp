@@ -0,0 +1,140 @@
+#ifndef PERFORMANCE_GOVERNOR_HPP
+#define PERFORMANCE_GOVERNOR_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "latency_trace.hpp"
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Feedback controller that trades tracking quality for latency
+ *
+ * Frames are fed with their LatencyStamps. After every evaluation window the
+ * governor compares the p99 exposure-to-pose latency of the window with the
+ * budget. Over budget, it degrades one knob by one step, starting with the
+ * knob that relieves the slowest stage of the window. With the p99 below
+ * recovery_ratio * budget for several windows in a row, it restores the
+ * most recently degraded knob by one step. Every decision is kept as the
+ * last decision and appended to the CSV log, if one is configured.
+ *
+ * Not thread-safe, meant to be driven from the tracking thread.
+ */
+class PerformanceGovernor
+{
+public:
+    /**
+     * @brief Settings the governor controls
+     */
+    enum class Knob {
+        FEATURE_TARGET,        ///< Keypoints kept per frame by the TPU extractors
+        LOCAL_MAP_KEYFRAMES,   ///< Keyframes of the local map tracked against
+        LOCAL_BA_KEYFRAMES,    ///< Keyframes optimized by the local bundle adjustment
+        FRAME_DECIMATION,      ///< Frame sets per processed frame set (1 processes every set)
+        COUNT
+    };
+
+    /**
+     * @brief Values of all knobs
+     */
+    struct Settings {
+        int feature_target = 1000;             ///< Keypoints per frame
+        int local_map_keyframes = 80;          ///< Local map keyframes
+        int local_ba_keyframes = 20;           ///< Local BA keyframes
+        int frame_decimation = 1;              ///< Frame set decimation
+
+        int Get(Knob knob) const;
+        void Set(Knob knob, int value);
+    };
+
+    /**
+     * @brief Governor configuration
+     */
+    struct Config {
+        double latency_budget_ms = 20.0;       ///< p99 exposure-to-pose budget
+        double recovery_ratio = 0.7;           ///< Restore quality below this fraction of the budget
+        int evaluation_frames = 60;            ///< Frames per evaluation window
+        int recovery_windows = 3;              ///< Windows under the recovery ratio before restoring a step
+        Settings max_settings;                 ///< Best quality, also the initial settings
+        Settings min_settings = {300, 20, 5, 3}; ///< Lowest quality (highest decimation)
+        Settings step = {100, 10, 3, 1};       ///< Change per decision
+        std::string log_path;                  ///< CSV log of the decisions (empty for none)
+    };
+
+    /**
+     * @brief One change of one knob
+     */
+    struct Decision {
+        double time = 0.0;                     ///< LatencyNowSeconds() of the decision
+        uint64_t window = 0;                   ///< Index of the evaluation window
+        Knob knob = Knob::COUNT;               ///< Changed knob
+        int old_value = 0;                     ///< Value before
+        int new_value = 0;                     ///< Value after
+        double p99_ms = 0.0;                   ///< p99 exposure-to-pose latency of the window
+        LatencyStage slowest_stage = LatencyStage::COUNT; ///< Stage with the largest p99 of the window
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Governor configuration
+     */
+    explicit PerformanceGovernor(const Config& config);
+
+    PerformanceGovernor(const PerformanceGovernor&) = delete;
+    PerformanceGovernor& operator=(const PerformanceGovernor&) = delete;
+
+    /**
+     * @brief Add the stamps of a tracked frame set
+     * @param stamps Stamps up to POSE_PUBLISHED
+     * @return True if the settings changed (see GetSettings() and GetLastDecision())
+     */
+    bool AddFrame(const LatencyStamps& stamps);
+
+    /**
+     * @brief Get the current settings
+     */
+    const Settings& GetSettings() const;
+
+    /**
+     * @brief Get the last decision (knob COUNT if none was made yet)
+     */
+    const Decision& GetLastDecision() const;
+
+    /**
+     * @brief Get the number of decisions made
+     */
+    uint64_t GetDecisionCount() const;
+
+    /**
+     * @brief Get the name of a knob (e.g., "feature_target")
+     */
+    static const char* GetKnobName(Knob knob);
+
+private:
+    Config mConfig;
+    Settings mSettings;
+    Decision mLastDecision;
+    uint64_t mDecisionCount;
+
+    LatencyTracker mWindow;
+    int mWindowFrames;
+    uint64_t mWindowIndex;
+    int mRecoveryWindows;
+    std::vector<Knob> mDegraded;              // Degraded knobs, most recent last
+
+    std::unique_ptr<std::ofstream> mLog;
+
+    bool Evaluate();
+    bool Degrade(double p99_ms, LatencyStage slowest_stage);
+    bool Restore(double p99_ms, LatencyStage slowest_stage);
+    bool Apply(Knob knob, int value, double p99_ms, LatencyStage slowest_stage);
+};
+
+} // namespace ORB_SLAM3
+
+#endif // PERFORMANCE_GOVERNOR_HPP
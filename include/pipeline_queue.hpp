@@ -0,0 +1,200 @@
+#ifndef PIPELINE_QUEUE_HPP
+#define PIPELINE_QUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "spsc_ring_buffer.hpp"
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief What a pipeline stage does when the next stage falls behind
+ */
+enum class PipelineDropPolicy {
+    BLOCK,          ///< Producer waits for space, back-pressure reaches the camera driver
+    KEEP_LATEST     ///< Consumer takes the newest item and drops older ones, a full queue drops the new item
+};
+
+/**
+ * @brief Bounded queue between two pipeline stage threads
+ *
+ * A lock-free SPSCRingBuffer with an eventfd per direction, so an idle stage
+ * sleeps in poll() until the other side pushes or pops instead of polling.
+ * Exactly one thread may push and one other thread may pop. Dropped items are
+ * handed to the drop handler (e.g. to return frame buffers to the driver).
+ */
+template <typename T>
+class PipelineQueue
+{
+public:
+    typedef std::function<void(T&)> DropHandler;
+
+    /**
+     * @brief Constructor
+     * @param depth Minimum number of items the queue holds (rounded up like SPSCRingBuffer)
+     * @param policy Drop policy
+     * @param on_drop Called with every dropped item (optional)
+     */
+    PipelineQueue(size_t depth, PipelineDropPolicy policy, DropHandler on_drop = DropHandler())
+        : mRing(depth > 0 ? depth : 1), mPolicy(policy), mOnDrop(on_drop), mDropped(0), mClosed(false)
+    {
+        mItemFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        mSpaceFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+
+    /**
+     * @brief Destructor, drops the items still queued (no thread may use the queue)
+     */
+    ~PipelineQueue()
+    {
+        T* front;
+        while ((front = mRing.Front()) != nullptr) {
+            T item = std::move(*front);
+            mRing.Pop();
+            Drop(item);
+        }
+        if (mItemFd >= 0) {
+            close(mItemFd);
+        }
+        if (mSpaceFd >= 0) {
+            close(mSpaceFd);
+        }
+    }
+
+    PipelineQueue(const PipelineQueue&) = delete;
+    PipelineQueue& operator=(const PipelineQueue&) = delete;
+
+    /**
+     * @brief Push an item (producer only)
+     *
+     * With BLOCK waits for space until Close(), with KEEP_LATEST drops the
+     * item if the queue is full.
+     *
+     * @param item Item to push, dropped through the handler on failure
+     * @return False if the item was dropped
+     */
+    bool Push(T& item)
+    {
+        while (!mRing.TryPush(item)) {
+            if (mPolicy == PipelineDropPolicy::KEEP_LATEST || mClosed.load(std::memory_order_acquire)) {
+                Drop(item);
+                return false;
+            }
+            Wait(mSpaceFd, -1);
+        }
+        Signal(mItemFd);
+        return true;
+    }
+
+    /**
+     * @brief Pop an item (consumer only)
+     *
+     * With KEEP_LATEST the older queued items are dropped and the newest one
+     * is returned.
+     *
+     * @param item Output item
+     * @param timeout_ms Maximum time to wait for an item (-1 for no limit)
+     * @return False on timeout, or if the queue is closed and empty
+     */
+    bool Pop(T& item, int timeout_ms)
+    {
+        T* front = mRing.Front();
+        while (!front) {
+            if (mClosed.load(std::memory_order_acquire) || !Wait(mItemFd, timeout_ms)) {
+                return false;
+            }
+            front = mRing.Front();
+        }
+
+        // Move the item out so the slot does not keep it alive
+        if (mPolicy == PipelineDropPolicy::KEEP_LATEST) {
+            while (mRing.Size() > 1) {
+                T stale = std::move(*front);
+                mRing.Pop();
+                Drop(stale);
+                front = mRing.Front();
+            }
+        }
+        item = std::move(*front);
+        mRing.Pop();
+        Signal(mSpaceFd);
+        return true;
+    }
+
+    /**
+     * @brief Wake both sides and make further pushes fail
+     */
+    void Close()
+    {
+        mClosed.store(true, std::memory_order_release);
+        Signal(mItemFd);
+        Signal(mSpaceFd);
+    }
+
+    /**
+     * @brief Get the number of dropped items
+     */
+    uint64_t GetDroppedCount() const
+    {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of queued items (approximate when called concurrently)
+     */
+    size_t Size() const
+    {
+        return mRing.Size();
+    }
+
+private:
+    SPSCRingBuffer<T> mRing;
+    PipelineDropPolicy mPolicy;
+    DropHandler mOnDrop;
+    std::atomic<uint64_t> mDropped;
+    std::atomic<bool> mClosed;
+    int mItemFd;
+    int mSpaceFd;
+
+    void Drop(T& item)
+    {
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+        if (mOnDrop) {
+            mOnDrop(item);
+        }
+        item = T();
+    }
+
+    static void Signal(int fd)
+    {
+        const uint64_t one = 1;
+        ssize_t r = write(fd, &one, sizeof(one));
+        (void)r;
+    }
+
+    // Sleep until the fd is signalled, then reset it; spurious wake-ups are re-checked by the callers
+    static bool Wait(int fd, int timeout_ms)
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            return false;
+        }
+        uint64_t count;
+        ssize_t r = read(fd, &count, sizeof(count));
+        (void)r;
+        return true;
+    }
+};
+
+} // namespace ORB_SLAM3
+
+#endif // PIPELINE_QUEUE_HPP
@@ -0,0 +1,257 @@
+#ifndef PIPELINE_SIMULATOR_HPP
+#define PIPELINE_SIMULATOR_HPP
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "latency_trace.hpp"
+#include "pipeline_queue.hpp"
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Stages of the simulated pipeline
+ */
+enum class SimulatedStage {
+    READOUT,          ///< Exposure midpoint to buffer dequeued (sensor readout and driver)
+    ACQUISITION,      ///< Synchronised frame set taken from the frame provider
+    EXTRACTION,       ///< Feature extraction of the frame set
+    TRACKING,         ///< Multi-camera tracking
+    PUBLISH,          ///< Tracked pose to pose handed to the motion model
+    MAPPING,          ///< Local mapping of a keyframe
+    COUNT
+};
+
+constexpr size_t kNumSimulatedStages = static_cast<size_t>(SimulatedStage::COUNT);
+
+/**
+ * @brief Get the name of a simulated stage (e.g., "extraction")
+ */
+const char* GetSimulatedStageName(SimulatedStage stage);
+
+/**
+ * @brief Recorded service times of the pipeline stages
+ *
+ * Filled from flight recorder dumps, whose rows hold the time of every stage
+ * of a frame set, and from Chrome traces of the Tracer, whose LocalMapping
+ * spans give the mapping time per keyframe and, with the TrackFrameSet spans,
+ * the keyframes per frame set. A trace alone also gives the extraction and
+ * tracking times (ExtractFrameSet and TrackFrameSet spans). The simulator
+ * draws from the samples, so their distribution carries over, tails included.
+ */
+class StageTimings
+{
+public:
+    StageTimings();
+
+    /**
+     * @brief Add the stage times of a flight recorder dump
+     * @param path CSV written by FlightRecorder
+     * @return False if the file cannot be read or has none of the stage columns
+     */
+    bool LoadFlightRecorderDump(const std::string& path);
+
+    /**
+     * @brief Add the span times of a Chrome trace written by Tracer::ExportChromeTrace()
+     * @param path Trace JSON
+     * @return False if the file cannot be read or has none of the spans
+     */
+    bool LoadTrace(const std::string& path);
+
+    /**
+     * @brief Add a sample
+     * @param stage Stage
+     * @param time_ms Service time in milliseconds
+     */
+    void Add(SimulatedStage stage, double time_ms);
+
+    /**
+     * @brief Set the keyframes per tracked frame set, replacing the one of the traces
+     */
+    void SetKeyFrameRatio(double ratio);
+
+    /**
+     * @brief Set the setup the extraction times were recorded with
+     *
+     * By default the times are taken as those of the configured cameras on
+     * one unit.
+     *
+     * @param cameras Cameras per frame set
+     * @param units Accelerators the cameras were spread over
+     */
+    void SetRecordedExtraction(int cameras, int units);
+
+    /**
+     * @brief Get the samples of a stage
+     */
+    const std::vector<double>& GetSamples(SimulatedStage stage) const;
+
+    /**
+     * @brief Draw a service time of a stage in milliseconds (0 without samples)
+     */
+    double Draw(SimulatedStage stage, std::mt19937& rng) const;
+
+    /**
+     * @brief Get the keyframes per tracked frame set (0 if unknown)
+     */
+    double GetKeyFrameRatio() const;
+
+    /**
+     * @brief Get the frame set rate of the dumps (0 if unknown)
+     */
+    double GetFrameRateHz() const;
+
+    /**
+     * @brief Get the cameras per frame set of the recorded extraction times (0 if those of the configuration)
+     */
+    int GetRecordedCameras() const;
+
+    /**
+     * @brief Get the accelerators of the recorded extraction times
+     */
+    int GetRecordedUnits() const;
+
+    /**
+     * @brief Get the latest error message
+     */
+    std::string GetLastErrorMessage() const;
+
+private:
+    std::array<std::vector<double>, kNumSimulatedStages> mSamples;
+    uint64_t mTracedFrameSets;
+    uint64_t mTracedKeyFrames;
+    double mKeyFrameRatio;                    // Negative until set explicitly
+    std::vector<double> mFramePeriods;
+    int mRecordedCameras;
+    int mRecordedUnits;
+    std::string mLastErrorMessage;
+};
+
+/**
+ * @brief Discrete-event model of the camera to display pipeline
+ *
+ * Frame sets are exposed at the camera rate, read out, acquired, extracted,
+ * tracked and published by one thread per stage, like VRSLAMSystem, with the
+ * bounded queues and drop policies of PipelineQueue between the stages; a
+ * keyframe goes to local mapping if its queue has room, and is not inserted
+ * otherwise. Service times are drawn from recorded StageTimings, scaled by the
+ * speed of the core or accelerator a candidate configuration puts the stage
+ * on. The extraction of a frame set spreads its cameras over the
+ * accelerators, each camera to the unit that finishes it first, as
+ * TPUZeroCopyIntegration balances them, with frames batched per invocation.
+ *
+ * The display latches the newest published pose latch_to_photon_ms before
+ * every scanout and propagates it with the newest IMU sample, so the model
+ * predicts both the age of the tracked pose at scanout and the
+ * motion-to-photon latency of the IMU path, along with the latency of every
+ * stage as LatencyTracker measures it on the device.
+ *
+ * Runs are deterministic for a seed. Not thread-safe; independent simulators
+ * over the same timings may run concurrently.
+ */
+class PipelineSimulator
+{
+public:
+    /**
+     * @brief Accelerator (or CPU) frames are extracted on
+     */
+    struct ExtractionUnit {
+        std::string name = "edgetpu0";         ///< Name in reports
+        double speed = 1.0;                    ///< Speed relative to the units the extraction was recorded on
+        int batch_size = 1;                    ///< Frames per invocation
+        double invoke_overhead_ms = 0.0;       ///< Fixed cost of an invocation, paid once per batch
+    };
+
+    /**
+     * @brief Queue in front of a stage
+     */
+    struct QueueConfig {
+        int depth = 2;                         ///< Frame sets held
+        PipelineDropPolicy policy = PipelineDropPolicy::KEEP_LATEST; ///< Behaviour when the stage falls behind
+    };
+
+    /**
+     * @brief Candidate configuration
+     */
+    struct Config {
+        double camera_rate_hz = 90.0;          ///< Frame set rate of the cameras
+        int cameras = 4;                       ///< Cameras per frame set
+        int camera_buffers = 4;                ///< Frame sets the driver holds, new ones are dropped beyond
+        int frame_decimation = 1;              ///< Frame sets per processed frame set (as the governor knob)
+        QueueConfig extraction_queue;          ///< Acquisition to extraction
+        QueueConfig tracking_queue;            ///< Extraction to tracking
+        int mapping_queue_depth = 1;           ///< Keyframes waiting for local mapping
+        std::vector<ExtractionUnit> extraction_units = std::vector<ExtractionUnit>(1); ///< Units the cameras are spread over
+        double acquisition_speed = 1.0;        ///< Speed of the acquisition core relative to the recording
+        double tracking_speed = 1.0;           ///< Speed of the tracking core relative to the recording
+        double mapping_speed = 1.0;            ///< Speed of the mapping core relative to the recording
+        double mapping_contention = 0.0;       ///< Tracking slowdown while mapping runs (0.2 for 20% slower)
+        double imu_rate_hz = 1000.0;           ///< IMU sample rate
+        double imu_latency_ms = 1.0;           ///< Sample time to sample available to the pose publisher
+        double display_rate_hz = 90.0;         ///< Display refresh rate
+        double display_phase_ms = 0.0;         ///< First scanout after the first exposure midpoint
+        double latch_to_photon_ms = 2.0;       ///< Late latch of the pose to photons
+        double duration_s = 60.0;              ///< Simulated time
+        uint32_t seed = 1;                     ///< Seed of the service time draws
+    };
+
+    /**
+     * @brief Predicted behaviour of a configuration
+     */
+    struct Result {
+        uint64_t frame_sets = 0;               ///< Frame sets exposed
+        uint64_t tracked = 0;                  ///< Frame sets tracked and published
+        uint64_t decimated = 0;                ///< Frame sets skipped by the decimation
+        uint64_t dropped_readout = 0;          ///< Dropped by the driver, no buffer free
+        uint64_t dropped_extraction = 0;       ///< Dropped by the extraction queue
+        uint64_t dropped_tracking = 0;         ///< Dropped by the tracking queue
+        uint64_t keyframes = 0;                ///< Keyframes mapped
+        uint64_t keyframes_skipped = 0;        ///< Keyframes not inserted, the mapping queue was full
+        double throughput_fps = 0.0;           ///< Tracked frame sets per second
+        LatencyPercentiles end_to_end;         ///< Exposure midpoint to pose published
+        LatencyPercentiles pose_age_at_scanout; ///< Exposure midpoint to scanout of its pose
+        LatencyPercentiles motion_to_photon;   ///< IMU sample to scanout of the pose propagated with it
+        std::array<LatencyPercentiles, kNumLatencyStages> stage_latency; ///< Per-stage latency, indexed by LatencyStage
+        std::array<double, kNumSimulatedStages> utilization{}; ///< Busy fraction of the thread of every stage
+    };
+
+    /**
+     * @brief Constructor
+     * @param timings Recorded service times, must outlive the simulator
+     */
+    explicit PipelineSimulator(const StageTimings& timings);
+
+    /**
+     * @brief Simulate a configuration
+     */
+    Result Run(const Config& config) const;
+
+    /**
+     * @brief Pick the configuration to run
+     *
+     * The candidate with the highest throughput among those whose p99
+     * exposure-to-pose latency is within the budget (the one of
+     * PerformanceGovernor::Config), the lower p99 breaking ties. If none is
+     * within the budget, the one with the lowest p99.
+     *
+     * @param candidates Configurations to compare
+     * @param latency_budget_ms p99 exposure-to-pose budget
+     * @param results Output result of every candidate (optional)
+     * @return Index of the chosen candidate, candidates.size() if there is none
+     */
+    size_t SelectConfiguration(const std::vector<Config>& candidates, double latency_budget_ms,
+                               std::vector<Result>* results = nullptr) const;
+
+private:
+    const StageTimings& mTimings;
+
+    double ExtractionTime(const Config& config, std::mt19937& rng) const;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // PIPELINE_SIMULATOR_HPP
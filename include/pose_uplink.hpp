@@ -0,0 +1,267 @@
+#ifndef POSE_UPLINK_HPP
+#define POSE_UPLINK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shared_pose_export.hpp"
+
+namespace ORB_SLAM3
+{
+
+constexpr uint32_t kPoseUplinkMagic = 0x55505256;  ///< "VRPU"
+constexpr uint16_t kPoseUplinkVersion = 1;
+
+/**
+ * @brief One pose sample on the wire, the payload of a pose uplink datagram
+ *
+ * Fixed-width fields in host order, both ends are little-endian aarch64 or
+ * x86-64. Fields as in SharedPoseSample, without the latency stage stamps
+ * so the datagram stays small, plus the time the sender enqueued it.
+ */
+struct PoseUplinkPacket {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t sequence;                        ///< SharedPoseSample::sequence
+    double enqueue_time;                      ///< Time the sender queued the datagram for the driver
+    double publish_time;
+    double timestamp;
+    float rotation[4];
+    float translation[3];
+    float predicted_rotation[4];
+    float predicted_translation[3];
+    float prediction_horizon_ms;
+    float linear_velocity[3];
+    float angular_velocity[3];
+    int32_t tracking_state;
+    uint32_t flags;                           ///< kSharedPose* flags
+    uint32_t packet_index;                    ///< Datagrams sent before this one, for loss counting
+};
+
+static_assert(sizeof(PoseUplinkPacket) == 136, "PoseUplinkPacket layout changed");
+
+/**
+ * @brief Link and network addresses of a raw pose uplink frame
+ *
+ * IPv4 addresses in network order, ports in host order.
+ */
+struct PoseUplinkFrameAddress {
+    uint8_t source_mac[6] = {0, 0, 0, 0, 0, 0};
+    uint8_t destination_mac[6] = {0, 0, 0, 0, 0, 0};   ///< Next hop, the AP or the host itself
+    uint32_t source_ip = 0;
+    uint32_t destination_ip = 0;
+    uint16_t source_port = 0;
+    uint16_t destination_port = 0;
+};
+
+/// Bytes of a pose uplink frame: Ethernet, IPv4 and UDP headers and the packet
+constexpr size_t kPoseUplinkFrameBytes = 14 + 20 + 8 + sizeof(PoseUplinkPacket);
+
+/**
+ * @brief Streams the shared pose ring to the PC at the rate it is published
+ *
+ * Reads the newest sample of the SharedPoseRegion of VRSLAMSystem as soon
+ * as it is published and sends it as one UDP datagram marked with the
+ * tracking DSCP, so the AX210 driver queues it in its tracking class with
+ * the 2 ms deadline and mac80211 sends it on the voice access category.
+ *
+ * When it can, the sender writes complete Ethernet frames into the TX ring
+ * of a PACKET_QDISC_BYPASS packet socket on the Wi-Fi interface and kicks
+ * it with one sendto(). The frame skips the UDP/IP stack and the qdisc and
+ * goes straight through intel_ax210_vr_select_queue() and
+ * intel_ax210_vr_start_xmit(). The ring needs CAP_NET_RAW and the link
+ * address of the next hop from the neighbour table; until both are there
+ * the datagrams go through a plain UDP socket, which also keeps the
+ * neighbour entry fresh.
+ *
+ * Every datagram carries the time it was enqueued. On the TX ring the
+ * driver also stamps the hand-off of each frame from its deadline queues
+ * (SO_TIMESTAMPING), which gives the per-packet driver queueing delay.
+ *
+ * Not thread-safe, Poll() is called from one thread.
+ */
+class PoseUplinkSender
+{
+public:
+    struct Options {
+        std::string host;                           ///< PC address (IPv4)
+        int port = 9957;
+        std::string interface = "wlan0";            ///< AX210 interface, for the TX ring
+        std::string pose_region = "/vr_slam_pose";  ///< Pose ring to follow (empty to feed Send() by hand)
+        bool use_tx_ring = true;                    ///< Bypass the socket stack when possible
+        int ring_frames = 64;                       ///< Frames of the TX ring, rounded up to whole pages
+        int neighbour_retry_ms = 1000;              ///< Between attempts to set up the TX ring
+        int dscp = 46;                              ///< EF, the AX210 tracking class
+    };
+
+    struct Stats {
+        uint64_t samples_sent = 0;
+        uint64_t samples_skipped = 0;               ///< Published while the previous one was sent
+        uint64_t send_failures = 0;                 ///< Ring full or socket error
+        uint64_t ring_frames_sent = 0;              ///< Of samples_sent, through the TX ring
+        uint64_t handoff_timestamps = 0;            ///< Driver hand-off stamps received
+        uint32_t handoff_delay_us_avg = 0;          ///< Enqueue to driver hand-off, moving average 1/8
+        uint32_t handoff_delay_us_max = 0;
+    };
+
+    /**
+     * @brief Constructor, opens the UDP socket, the TX ring is set up by Poll()
+     * @param options Destination, interface and pose region
+     */
+    explicit PoseUplinkSender(const Options& options);
+
+    /**
+     * @brief Destructor, closes the sockets and unmaps the ring
+     */
+    ~PoseUplinkSender();
+
+    PoseUplinkSender(const PoseUplinkSender&) = delete;
+    PoseUplinkSender& operator=(const PoseUplinkSender&) = delete;
+
+    /**
+     * @brief Check if the options were accepted and the UDP socket opened
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Check if the datagrams go through the TX ring
+     */
+    bool IsUsingTxRing() const;
+
+    /**
+     * @brief Wait for the next sample of the pose ring and send it
+     * @param timeout_ms Maximum time to wait (-1 for no limit)
+     * @return True if a sample was sent
+     */
+    bool Poll(int timeout_ms);
+
+    /**
+     * @brief Send one sample
+     * @param sample Pose sample
+     * @return True if it was queued for the driver
+     */
+    bool Send(const SharedPoseSample& sample);
+
+    /**
+     * @brief Get the send statistics
+     */
+    Stats GetStats() const;
+
+    /**
+     * @brief Write a complete Ethernet/IPv4/UDP frame around a packet
+     * @param address Link and network addresses
+     * @param packet Payload
+     * @param dscp DSCP of the IPv4 header
+     * @param frame Output, at least kPoseUplinkFrameBytes
+     * @return Bytes written, kPoseUplinkFrameBytes
+     */
+    static size_t BuildFrame(const PoseUplinkFrameAddress& address, const PoseUplinkPacket& packet,
+                             int dscp, uint8_t* frame);
+
+private:
+    bool openRing();
+    void closeRing();
+    bool sendRing(PoseUplinkPacket& packet);
+    bool sendSocket(PoseUplinkPacket& packet);
+    void readTimestamps();
+
+    bool mValid;
+    Options mOptions;
+    int mSocket;                            ///< Connected UDP socket
+    int mRingSocket;                        ///< Packet socket of the TX ring, -1 until set up
+    uint8_t* mRing;
+    size_t mRingBytes;
+    size_t mRingFrameSize;
+    uint32_t mRingHead;                     ///< Next frame to fill
+    int mIfIndex;
+    bool mRingDenied;                       ///< No CAP_NET_RAW, never retried
+    double mNextRingAttempt;
+    PoseUplinkFrameAddress mAddress;
+    uint32_t mPacketIndex;
+    std::vector<int64_t> mSendTimes;        ///< CLOCK_REALTIME ns per packet_index % size, for the hand-off stamps
+    std::vector<uint8_t> mErrorBuffer;
+    std::unique_ptr<SharedPoseReader> mPoseReader;
+    uint64_t mLastWriteCount;
+    Stats mStats;
+};
+
+/**
+ * @brief Receives the pose uplink on the PC
+ *
+ * Counts lost datagrams by their packet index and estimates the jitter of
+ * the link as in RFC 3550, from the enqueue time of every datagram and its
+ * arrival: the spread of the transit time, whatever the clock offset
+ * between the headset and the PC.
+ *
+ * Not thread-safe, Poll() is called from one thread.
+ */
+class PoseUplinkReceiver
+{
+public:
+    struct Options {
+        int port = 9957;                    ///< 0 picks a free port, see GetPort()
+    };
+
+    struct Stats {
+        uint64_t packets_received = 0;
+        uint64_t packets_lost = 0;          ///< Gaps in the packet index
+        uint64_t packets_invalid = 0;
+        uint64_t packets_reordered = 0;     ///< Older than one already received, dropped
+        double jitter_us = 0.0;             ///< RFC 3550 interarrival jitter
+    };
+
+    /**
+     * @brief Constructor, binds the socket
+     * @param options Port
+     */
+    explicit PoseUplinkReceiver(const Options& options);
+
+    /**
+     * @brief Destructor, closes the socket
+     */
+    ~PoseUplinkReceiver();
+
+    PoseUplinkReceiver(const PoseUplinkReceiver&) = delete;
+    PoseUplinkReceiver& operator=(const PoseUplinkReceiver&) = delete;
+
+    /**
+     * @brief Check if the socket was bound
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Get the bound UDP port
+     */
+    int GetPort() const;
+
+    /**
+     * @brief Wait for the next pose
+     * @param packet Output packet
+     * @param receive_time Output CLOCK_MONOTONIC arrival time on this machine
+     * @param timeout_ms Maximum time to wait (-1 for no limit)
+     * @return True if a valid, in-order packet was received
+     */
+    bool Poll(PoseUplinkPacket& packet, double& receive_time, int timeout_ms);
+
+    /**
+     * @brief Get the receive statistics
+     */
+    Stats GetStats() const;
+
+private:
+    bool mValid;
+    int mSocket;
+    int mPort;
+    bool mHaveLast;
+    uint32_t mLastIndex;
+    double mLastTransit;
+    Stats mStats;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // POSE_UPLINK_HPP
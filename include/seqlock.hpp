@@ -0,0 +1,114 @@
+#ifndef SEQLOCK_HPP
+#define SEQLOCK_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Single-writer snapshot readable from any number of threads without locking
+ *
+ * The writer bumps a sequence counter to odd, copies the value, and bumps it
+ * back to even. Readers copy the value and retry if the counter was odd or
+ * changed meanwhile, so they never block the writer and only spin for the
+ * duration of one copy. The value is stored as atomic words, which keeps the
+ * torn copies a retried reader observes free of data races.
+ *
+ * T must be trivially copyable.
+ */
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+public:
+    /**
+     * @brief Constructor
+     * @param value Initial value
+     */
+    explicit SeqLock(const T& value = T())
+        : mSequence(0)
+    {
+        Store(value);
+    }
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    /**
+     * @brief Publish a new value (single writer only)
+     * @param value Value to publish
+     */
+    void Store(const T& value)
+    {
+        uint64_t words[kNumWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        const uint64_t sequence = mSequence.load(std::memory_order_relaxed);
+        mSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kNumWords; ++i) {
+            mWords[i].store(words[i], std::memory_order_relaxed);
+        }
+        mSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Try to read the value once
+     * @param value Output value, unchanged on failure
+     * @return False if a write was in progress
+     */
+    bool TryLoad(T& value) const
+    {
+        const uint64_t before = mSequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+
+        uint64_t words[kNumWords];
+        for (size_t i = 0; i < kNumWords; ++i) {
+            words[i] = mWords[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mSequence.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+
+        std::memcpy(&value, words, sizeof(T));
+        return true;
+    }
+
+    /**
+     * @brief Read the value, retrying while a write is in progress
+     */
+    T Load() const
+    {
+        T value;
+        while (!TryLoad(value)) {
+        }
+        return value;
+    }
+
+    /**
+     * @brief Get the number of values stored since construction
+     */
+    uint64_t GetVersion() const
+    {
+        return mSequence.load(std::memory_order_acquire) / 2 - 1;
+    }
+
+private:
+    static constexpr size_t kNumWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> mSequence;
+    std::atomic<uint64_t> mWords[kNumWords];
+};
+
+} // namespace ORB_SLAM3
+
+#endif // SEQLOCK_HPP
@@ -0,0 +1,181 @@
+#ifndef SHARED_POSE_EXPORT_HPP
+#define SHARED_POSE_EXPORT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "latency_trace.hpp"
+#include "seqlock.hpp"
+
+namespace ORB_SLAM3
+{
+
+constexpr uint32_t kSharedPoseMagic = 0x53505256;  ///< "VRPS"
+constexpr uint32_t kSharedPoseVersion = 1;         ///< Bumped on every layout change
+constexpr uint32_t kSharedPoseSlots = 16;          ///< Samples kept in the ring
+
+/// Set in SharedPoseSample::flags when IMU samples newer than the tracked pose were applied
+constexpr uint32_t kSharedPoseImuPropagated = 1u << 0;
+
+/**
+ * @brief One pose sample as laid out in shared memory
+ *
+ * Fixed-width fields only, so readers built with another compiler (or the
+ * Rust driver through FFI) see the same layout. Poses are Tcw, rotations are
+ * quaternions (x, y, z, w), all times are CLOCK_MONOTONIC seconds.
+ */
+struct SharedPoseSample {
+    uint64_t sequence;                        ///< Number of samples published before this one
+    double publish_time;                      ///< Time the sample was written
+    double timestamp;                         ///< Time the pose refers to
+    double tracked_timestamp;                 ///< Timestamp of the tracked pose it was propagated from
+    float rotation[4];                        ///< Current pose rotation
+    float translation[3];                     ///< Current pose translation
+    float predicted_rotation[4];              ///< Predicted pose rotation
+    float predicted_translation[3];           ///< Predicted pose translation
+    float prediction_horizon_ms;              ///< How far ahead of timestamp the prediction is
+    float linear_velocity[3];                 ///< Camera centre velocity in the world frame (m/s)
+    float angular_velocity[3];                ///< Angular velocity in the camera frame (rad/s)
+    int32_t tracking_state;                   ///< VRSLAMSystem::Status
+    uint32_t flags;                           ///< kSharedPose* flags
+    double stage_stamps[kNumLatencyStages];   ///< LatencyStamps of the tracked frame set, indexed by LatencyStage
+};
+
+/**
+ * @brief Shared memory region: header followed by a ring of seqlocked samples
+ *
+ * The writer fills ring slot write_count % kSharedPoseSlots, then increments
+ * write_count and notify_word and wakes the futex waiters on notify_word.
+ * Readers take slot (write_count - 1) % kSharedPoseSlots, which the writer
+ * only touches again kSharedPoseSlots samples later.
+ */
+struct SharedPoseRegion {
+    struct alignas(64) Slot {
+        SeqLock<SharedPoseSample> sample;
+    };
+
+    std::atomic<uint32_t> magic;              ///< kSharedPoseMagic once the region is initialized
+    uint32_t version;                         ///< kSharedPoseVersion
+    uint32_t slot_count;                      ///< kSharedPoseSlots
+    uint32_t sample_size;                     ///< sizeof(SharedPoseSample)
+    alignas(64) std::atomic<uint64_t> write_count;  ///< Number of samples published
+    alignas(64) std::atomic<uint32_t> notify_word;  ///< Futex word, bumped on every publish
+    Slot slots[kSharedPoseSlots];
+};
+
+/**
+ * @brief Publishes pose samples into a POSIX shared memory ring
+ *
+ * Publish() is wait-free apart from one futex wake syscall. Only one writer
+ * per region name.
+ */
+class SharedPoseWriter
+{
+public:
+    /**
+     * @brief Constructor
+     * @param name POSIX shared memory name (e.g. "/vr_slam_pose")
+     */
+    explicit SharedPoseWriter(const std::string& name);
+
+    /**
+     * @brief Destructor, unmaps and unlinks the region
+     */
+    ~SharedPoseWriter();
+
+    SharedPoseWriter(const SharedPoseWriter&) = delete;
+    SharedPoseWriter& operator=(const SharedPoseWriter&) = delete;
+
+    /**
+     * @brief Create (or take over) and initialize the region
+     * @return True if successful, false otherwise
+     */
+    bool Open();
+
+    /**
+     * @brief Unmap and unlink the region
+     */
+    void Close();
+
+    /**
+     * @brief Check if the region is open
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Publish a sample and wake the waiting readers
+     * @param sample Sample to publish, its sequence field is set here
+     */
+    void Publish(const SharedPoseSample& sample);
+
+private:
+    std::string mName;
+    SharedPoseRegion* mRegion;
+};
+
+/**
+ * @brief Reads pose samples from a region published by SharedPoseWriter
+ */
+class SharedPoseReader
+{
+public:
+    /**
+     * @brief Constructor
+     * @param name POSIX shared memory name
+     */
+    explicit SharedPoseReader(const std::string& name);
+
+    /**
+     * @brief Destructor, unmaps the region
+     */
+    ~SharedPoseReader();
+
+    SharedPoseReader(const SharedPoseReader&) = delete;
+    SharedPoseReader& operator=(const SharedPoseReader&) = delete;
+
+    /**
+     * @brief Map the region and check its layout version
+     * @return False if the region does not exist yet or has another layout
+     */
+    bool Open();
+
+    /**
+     * @brief Unmap the region
+     */
+    void Close();
+
+    /**
+     * @brief Check if the region is open
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Get the number of samples published so far
+     */
+    uint64_t GetWriteCount() const;
+
+    /**
+     * @brief Read the newest sample without blocking
+     * @param sample Output sample
+     * @return False if nothing was published yet or the slot could not be read
+     */
+    bool ReadLatest(SharedPoseSample& sample) const;
+
+    /**
+     * @brief Sleep until more than write_count samples were published
+     * @param write_count Write count the caller has already seen
+     * @param timeout_ms Maximum time to wait (-1 for no limit)
+     * @return True if a newer sample is available
+     */
+    bool WaitForSample(uint64_t write_count, int timeout_ms) const;
+
+private:
+    std::string mName;
+    SharedPoseRegion* mRegion;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // SHARED_POSE_EXPORT_HPP
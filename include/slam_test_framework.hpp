@@ -6,7 +6,14 @@
 #include <functional>
 #include <memory>
 #include <chrono>
+#include <cstdint>
+#include <map>
 #include <opencv2/core.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "frame_capture_file.hpp"
+#include "vr_slam_system.hpp"
 
 namespace ORB_SLAM3
 {
@@ -21,8 +28,23 @@ struct TestResult {
     std::string message;           ///< Result message
     double execution_time_ms;      ///< Execution time in milliseconds
     std::vector<std::string> logs; ///< Detailed logs
+    
+    // Resource usage, over the whole process when the test ran alone and over its
+    // own thread when it shared the process with other tests
+    double cpu_time_ms = 0.0;               ///< User plus system CPU time in milliseconds
+    double peak_rss_mb = 0.0;               ///< Peak resident set size in MB
+    long voluntary_context_switches = 0;    ///< Context switches from blocking
+    long involuntary_context_switches = 0;  ///< Context switches from preemption
+    bool process_usage = false;             ///< Whether the usage covers every thread of the process
 };
 
+/// Resource tags: tests sharing a tag never run at the same time
+constexpr char kTestResourceTpu[] = "tpu";
+constexpr char kTestResourceCamera[] = "camera";
+constexpr char kTestResourceImu[] = "imu";
+/// A test tagged exclusive runs alone, for timing and full resource accounting
+constexpr char kTestResourceExclusive[] = "exclusive";
+
 /**
  * @brief Test case base class
  */
@@ -44,9 +66,11 @@ public:
     /**
      * @brief Run the test
      * 
+     * @param exclusive Whether the test has the process to itself, so that CPU time,
+     *                  context switches and peak RSS are measured over all its threads
      * @return Test result
      */
-    TestResult Run();
+    TestResult Run(bool exclusive = true);
     
     /**
      * @brief Get the name of the test
@@ -62,6 +86,20 @@ public:
      */
     std::string GetDescription() const;
     
+    /**
+     * @brief Tag the test with a resource it needs to itself
+     * 
+     * @param resource Resource tag, e.g. kTestResourceTpu
+     */
+    void AddResource(const std::string& resource);
+    
+    /**
+     * @brief Get the resource tags of the test
+     * 
+     * @return Resource tags
+     */
+    const std::vector<std::string>& GetResources() const;
+    
 protected:
     /**
      * @brief Execute the test (to be implemented by derived classes)
@@ -97,6 +135,7 @@ protected:
 private:
     std::string name_;
     std::string description_;
+    std::vector<std::string> resources_;
 };
 
 /**
@@ -126,9 +165,11 @@ public:
     /**
      * @brief Run all tests in the suite
      * 
-     * @return Vector of test results
+     * @param max_concurrency Number of tests run at the same time; tests sharing a
+     *                        resource tag are still run one after the other
+     * @return Vector of test results, in the order the tests were added
      */
-    std::vector<TestResult> RunAll();
+    std::vector<TestResult> RunAll(int max_concurrency = 1);
     
     /**
      * @brief Run a specific test by name
@@ -182,17 +223,19 @@ public:
     /**
      * @brief Run all test suites
      * 
+     * @param max_concurrency Number of tests run at the same time across all suites
      * @return Vector of test results
      */
-    std::vector<TestResult> RunAll();
+    std::vector<TestResult> RunAll(int max_concurrency = 1);
     
     /**
      * @brief Run a specific test suite by name
      * 
      * @param suite_name Name of the test suite to run
+     * @param max_concurrency Number of tests run at the same time
      * @return Vector of test results
      */
-    std::vector<TestResult> RunSuite(const std::string& suite_name);
+    std::vector<TestResult> RunSuite(const std::string& suite_name, int max_concurrency = 1);
     
     /**
      * @brief Run a specific test by suite name and test name
@@ -206,10 +249,18 @@ public:
     /**
      * @brief Generate a report of test results
      * 
+     * With a history file, every test is compared against the mean of its last
+     * kTrendWindow recorded runs, and the results are appended to the history.
+     * 
      * @param results Vector of test results
      * @param output_file Path to output file (empty for console output)
+     * @param history_file Path to the history of earlier runs (empty for no trends)
      */
-    void GenerateReport(const std::vector<TestResult>& results, const std::string& output_file = "");
+    void GenerateReport(const std::vector<TestResult>& results, const std::string& output_file = "",
+                        const std::string& history_file = "");
+    
+    /// Number of earlier runs a trend is computed over
+    static constexpr size_t kTrendWindow = 10;
     
 private:
     std::vector<std::shared_ptr<TestSuite>> suites_;
@@ -428,6 +479,358 @@ private:
     int iterations_;
 };
 
+/**
+ * @brief Layout of a benchmark dataset
+ */
+enum class BenchmarkDatasetFormat {
+    EUROC,            ///< EuRoC MAV, ASL layout with state_groundtruth_estimate0
+    TUM_VI,           ///< TUM-VI, ASL layout with mocap0
+    CAPTURE_FILE      ///< Frame capture file of the headset cameras, see FrameCaptureWriter
+};
+
+/**
+ * @brief Timestamped world-from-body pose of a trajectory
+ */
+struct TrajectoryPose {
+    double timestamp;                 ///< Seconds
+    Eigen::Vector3d position;         ///< Position in the world frame
+    Eigen::Quaterniond rotation;      ///< World-from-body rotation
+};
+
+/**
+ * @brief Recorded sequence to replay through the SLAM system
+ *
+ * ASL datasets (EuRoC, TUM-VI) are read from their mav0 directory: the
+ * cameraN/data.csv indices, imu0/data.csv and the ground truth. Capture files
+ * are read with FrameCaptureReader; their ground truth, if any, is an ASL
+ * style CSV next to the file with a ".groundtruth.csv" suffix. Images of ASL
+ * datasets are decoded when a frame set is loaded, images of capture files
+ * point into the mapping of the file.
+ */
+class BenchmarkDataset {
+public:
+    /**
+     * @brief One synchronised image per camera
+     */
+    struct FrameSet {
+        double timestamp;                       ///< Seconds
+        std::vector<std::string> image_paths;   ///< Per camera (ASL datasets)
+        std::vector<size_t> capture_frames;     ///< Per camera, frame index in the capture file
+    };
+    
+    BenchmarkDataset();
+    ~BenchmarkDataset();
+    
+    /**
+     * @brief Index a dataset
+     * 
+     * @param path mav0 parent directory of an ASL dataset, or capture file path
+     * @param format Dataset layout
+     * @param max_cameras Cameras to use, 0 for all in the dataset
+     * @return True if successful, false otherwise
+     */
+    bool Load(const std::string& path, BenchmarkDatasetFormat format, int max_cameras = 0);
+    
+    /**
+     * @brief Get the dataset name, the last path component
+     */
+    std::string GetName() const;
+    
+    /**
+     * @brief Get the number of cameras of every frame set
+     */
+    int GetCameraCount() const;
+    
+    /**
+     * @brief Get the frame sets in timestamp order
+     */
+    const std::vector<FrameSet>& GetFrameSets() const;
+    
+    /**
+     * @brief Load the images of a frame set
+     * 
+     * @param index Frame set index
+     * @param images Output grayscale images, one per camera
+     * @return True if successful, false otherwise
+     */
+    bool LoadImages(size_t index, std::vector<cv::Mat>& images) const;
+    
+    /**
+     * @brief Get the IMU samples in timestamp order
+     */
+    const std::vector<CaptureImuSample>& GetImuSamples() const;
+    
+    /**
+     * @brief Get the ground truth, empty if the dataset has none
+     */
+    const std::vector<TrajectoryPose>& GetGroundTruth() const;
+    
+    /**
+     * @brief Get the latest error message
+     */
+    std::string GetLastErrorMessage() const;
+    
+private:
+    bool loadAsl(const std::string& path, const std::string& groundtruth_dir, int max_cameras);
+    bool loadCapture(const std::string& path, int max_cameras);
+    bool loadGroundTruth(const std::string& csv_path);
+    
+    std::string name_;
+    int camera_count_;
+    std::vector<FrameSet> frame_sets_;
+    std::vector<CaptureImuSample> imu_samples_;
+    std::vector<TrajectoryPose> groundtruth_;
+    std::unique_ptr<FrameCaptureReader> capture_;
+    std::string last_error_message_;
+};
+
+/**
+ * @brief Trajectory accuracy against ground truth
+ */
+struct TrajectoryError {
+    size_t matched_poses = 0;         ///< Estimated poses with a ground truth pose
+    double scale = 1.0;               ///< Scale of the alignment (1 unless estimated)
+    double ate_rmse_m = 0.0;          ///< Absolute trajectory error after alignment, RMSE
+    double ate_max_m = 0.0;           ///< Largest absolute trajectory error
+    size_t rpe_pairs = 0;             ///< Pose pairs of the relative pose error
+    double rpe_trans_rmse_m = 0.0;    ///< Relative translation error over rpe_delta_s, RMSE
+    double rpe_rot_rmse_deg = 0.0;    ///< Relative rotation error over rpe_delta_s, RMSE
+};
+
+/**
+ * @brief Compare an estimated trajectory with ground truth
+ * 
+ * Every estimated pose is matched to the nearest ground truth pose in time.
+ * The matched positions are aligned with Umeyama's method before the ATE is
+ * taken; the RPE compares the motion between matched poses rpe_delta_s apart
+ * and needs no alignment.
+ * 
+ * @param estimate Estimated world-from-body poses in timestamp order
+ * @param groundtruth Ground truth poses in timestamp order
+ * @param align_scale Whether to estimate a scale, for monocular runs
+ * @param rpe_delta_s Time between the poses of an RPE pair
+ * @param max_time_diff_s Largest time difference of a matched pair
+ * @return Trajectory error, matched_poses is 0 if fewer than three poses matched
+ */
+TrajectoryError ComputeTrajectoryError(const std::vector<TrajectoryPose>& estimate,
+                                       const std::vector<TrajectoryPose>& groundtruth,
+                                       bool align_scale, double rpe_delta_s = 1.0,
+                                       double max_time_diff_s = 0.01);
+
+/**
+ * @brief Peak resident set size of the process in MB since the last reset
+ */
+double GetPeakRssMb();
+
+/**
+ * @brief Restart the peak resident set size from the current size
+ * 
+ * @return True if the kernel supports it (/proc/self/clear_refs)
+ */
+bool ResetPeakRss();
+
+/**
+ * @brief Heap allocations since the process started
+ * 
+ * Counted by the malloc family of the test framework, which replaces the one
+ * of glibc in a build with ENABLE_ALLOCATION_COUNTING. Every allocation is
+ * counted, operator new, OpenCV and Eigen ones included.
+ * 
+ * @param process Allocations of every thread
+ * @param thread Allocations of the calling thread
+ * @return True if the build counts allocations, false if both are 0
+ */
+bool GetAllocationCounts(uint64_t& process, uint64_t& thread);
+
+/**
+ * @brief Benchmark of the full SLAM system over a recorded dataset
+ *
+ * Replays every frame set of the dataset through VRSLAMSystem::ProcessFrame,
+ * interleaved with the IMU samples before it, and reports throughput, the
+ * per-stage latency percentiles of the system, ATE/RPE against the ground
+ * truth and the peak RSS. The metrics are written as JSON and, if a baseline
+ * JSON of an earlier run is given, compared with it: the test fails if any
+ * metric got worse by more than the tolerance.
+ *
+ * Images are decoded before the frame set is timed, so the numbers cover the
+ * SLAM system only. Without real-time pacing frame sets are fed as fast as
+ * the system takes them, which measures throughput; with it they are fed at
+ * their recorded rate, which measures latency under the rate seen on the
+ * headset.
+ */
+class SLAMBenchmarkTest : public TestCase {
+public:
+    struct Options {
+        VRSLAMSystem::Config system;                    ///< System under test
+        std::string dataset_path;                       ///< See BenchmarkDataset::Load()
+        BenchmarkDatasetFormat format = BenchmarkDatasetFormat::EUROC;
+        int max_cameras = 0;                            ///< Cameras to use, 0 for all in the dataset
+        bool realtime = false;                          ///< Pace frame sets at their recorded rate
+        int max_frames = 0;                             ///< Frame sets to replay, 0 for all
+        double rpe_delta_s = 1.0;                       ///< Time between the poses of an RPE pair
+        std::string output_path;                        ///< Metrics JSON (empty to skip)
+        std::string baseline_path;                      ///< Metrics JSON to compare with (empty to skip)
+        double relative_tolerance = 0.10;               ///< Allowed regression relative to the baseline
+        double absolute_tolerance = 0.01;               ///< Allowed regression for metrics near zero
+    };
+    
+    /**
+     * @brief Constructor
+     * 
+     * @param options Dataset, system configuration and baseline
+     */
+    explicit SLAMBenchmarkTest(const Options& options);
+    
+    /**
+     * @brief Destructor
+     */
+    ~SLAMBenchmarkTest() override;
+    
+    /**
+     * @brief Get the metrics of the last run, keyed by name (e.g., "ate_rmse_m")
+     */
+    const std::map<std::string, double>& GetMetrics() const;
+    
+    /**
+     * @brief Write metrics as benchmark JSON
+     * 
+     * @param filename Output file
+     * @param dataset Dataset name
+     * @param metrics Metrics keyed by name
+     * @return True if successful, false otherwise
+     */
+    static bool WriteMetrics(const std::string& filename, const std::string& dataset,
+                             const std::map<std::string, double>& metrics);
+    
+    /**
+     * @brief Read the metrics of a benchmark JSON
+     * 
+     * @param filename Input file
+     * @param metrics Output metrics keyed by name
+     * @return True if successful, false otherwise
+     */
+    static bool ReadMetrics(const std::string& filename, std::map<std::string, double>& metrics);
+    
+    /**
+     * @brief Check whether higher values of a metric are better (e.g., throughput)
+     */
+    static bool IsHigherBetter(const std::string& metric);
+    
+protected:
+    /**
+     * @brief Execute the test
+     * 
+     * @param result Test result to be filled
+     */
+    void Execute(TestResult& result) override;
+    
+private:
+    bool compareWithBaseline(TestResult& result);
+    
+    Options options_;
+    std::map<std::string, double> metrics_;
+};
+
+/**
+ * @brief Performance regression gate against a golden profile
+ *
+ * Replays a recording several times through SLAMBenchmarkTest, every replay
+ * with the same random seed and thread count, and takes the mean and standard
+ * deviation of every metric over the replays: the per-stage latency
+ * percentiles, the allocations per frame set (with ENABLE_ALLOCATION_COUNTING)
+ * and the keypoint and tracked point counts among them. Recording writes them
+ * as the golden profile; checking compares with it and fails with a per-stage
+ * diff. A metric regressed when it got worse by more than the relative
+ * tolerance and by more than sigma_tolerance standard errors of the
+ * difference, so run-to-run noise does not fail the gate. Feature counts fail
+ * in either direction, a change of them is a change of behaviour.
+ *
+ * The replays are only comparable on the same device, build and settings,
+ * and with tracking in one thread: the parallel relocalization still draws
+ * its RANSAC samples in thread order.
+ */
+class GoldenTraceTest : public TestCase {
+public:
+    struct Options {
+        SLAMBenchmarkTest::Options benchmark;   ///< Recording and system, its output and baseline are not used
+        std::string golden_path;                ///< Golden profile JSON
+        bool record = false;                    ///< Write the golden profile instead of checking against it
+        int runs = 5;                           ///< Replays the statistics are taken over
+        unsigned int seed = 42;                 ///< Seed of the random generators before every replay
+        double relative_tolerance = 0.05;       ///< Smallest regression relative to the golden mean that fails
+        double absolute_tolerance = 0.01;       ///< Smallest regression that fails, for metrics near zero
+        double sigma_tolerance = 3.0;           ///< Standard errors of the difference a regression must exceed
+    };
+    
+    /**
+     * @brief Distribution of a metric over the replays
+     */
+    struct MetricStats {
+        double mean = 0.0;                      ///< Mean over the replays
+        double stddev = 0.0;                    ///< Sample standard deviation over the replays
+    };
+    
+    /**
+     * @brief Golden profile, the metrics and the conditions they were measured in
+     */
+    struct Profile {
+        std::string dataset;                    ///< Dataset name
+        int runs = 0;                           ///< Replays of the statistics
+        unsigned int seed = 0;                  ///< Random seed of every replay
+        int threads = 0;                        ///< Processing threads of the system
+        std::map<std::string, MetricStats> metrics; ///< Statistics keyed by metric name
+    };
+    
+    /**
+     * @brief Constructor
+     * 
+     * @param options Recording, golden profile and tolerances
+     */
+    explicit GoldenTraceTest(const Options& options);
+    
+    /**
+     * @brief Destructor
+     */
+    ~GoldenTraceTest() override;
+    
+    /**
+     * @brief Get the profile of the last run
+     */
+    const Profile& GetProfile() const;
+    
+    /**
+     * @brief Write a golden profile as JSON
+     * 
+     * @param filename Output file
+     * @param profile Profile to write
+     * @return True if successful, false otherwise
+     */
+    static bool WriteProfile(const std::string& filename, const Profile& profile);
+    
+    /**
+     * @brief Read a golden profile written by WriteProfile()
+     * 
+     * @param filename Input file
+     * @param profile Output profile
+     * @return True if successful, false otherwise
+     */
+    static bool ReadProfile(const std::string& filename, Profile& profile);
+    
+protected:
+    /**
+     * @brief Execute the test
+     * 
+     * @param result Test result to be filled
+     */
+    void Execute(TestResult& result) override;
+    
+private:
+    bool compareWithGolden(TestResult& result);
+    
+    Options options_;
+    Profile profile_;
+};
+
 } // namespace ORB_SLAM3
 
 #endif // SLAM_TEST_FRAMEWORK_HPP
@@ -0,0 +1,337 @@
+#ifndef SLICE_STREAM_HPP
+#define SLICE_STREAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "shared_pose_export.hpp"
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief One horizontal band of an eye buffer, NV12
+ *
+ * The colour conversion pass writes every band to its own buffer, so the
+ * encoder imports it by DMA-BUF fd without a copy. data is used when there
+ * is no fd.
+ */
+struct SliceImage {
+    int dma_fd = -1;                ///< DMA-BUF holding the band, -1 for none
+    const uint8_t* data = nullptr;  ///< CPU copy of the band when there is no fd
+    size_t size = 0;                ///< Bytes, hor_stride * ver_stride * 3 / 2
+    int width = 0;
+    int height = 0;
+    int hor_stride = 0;             ///< Bytes per luma row
+    int ver_stride = 0;             ///< Luma rows before the chroma plane
+};
+
+/**
+ * @brief Pose a slice was rendered with, Tcw as in SharedPoseSample
+ */
+struct SlicePose {
+    float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};  ///< Quaternion (x, y, z, w)
+    float translation[3] = {0.0f, 0.0f, 0.0f};
+    double timestamp = 0.0;                         ///< Time the pose refers to, sender clock
+};
+
+/**
+ * @brief Encoder settings of one slice stream
+ */
+struct SliceEncoderConfig {
+    int width = 0;
+    int height = 0;
+    int bitrate_bps = 0;
+    int fps = 90;
+    int gop = 0;                    ///< Frames between IDRs, 0 for none unless requested
+};
+
+/**
+ * @brief Hardware encoder of one slice stream
+ *
+ * Slice k of every frame predicts only from slice k of earlier frames, so
+ * each slice can be encoded as soon as it is rendered and decoded as soon
+ * as it arrives.
+ */
+class SliceEncoder
+{
+public:
+    virtual ~SliceEncoder() = default;
+
+    /**
+     * @brief Encode one slice
+     * @param image Slice pixels
+     * @param force_idr Encode an IDR, e.g. after the receiver lost a slice
+     * @param bitstream Output Annex B bytes, capacity is reused across calls
+     * @param is_idr Set if the output is an IDR
+     * @return True if successful, false otherwise
+     */
+    virtual bool Encode(const SliceImage& image, bool force_idr, std::vector<uint8_t>& bitstream, bool& is_idr) = 0;
+};
+
+/**
+ * @brief Create an H.264 encoder on the RK3588 VPU through Rockchip MPP
+ * @return Encoder, nullptr if MPP is not available or refused the config
+ */
+std::unique_ptr<SliceEncoder> CreateMppSliceEncoder(const SliceEncoderConfig& config);
+
+/// Flags in SlicePacketHeader::flags
+constexpr uint8_t kSlicePacketIdr = 1u << 0;
+
+constexpr uint32_t kSlicePacketMagic = 0x53535256;  ///< "VRSS"
+constexpr uint16_t kSlicePacketVersion = 1;
+
+/**
+ * @brief Header in front of every fragment of a slice on the wire
+ *
+ * Fixed-width fields in host order, both ends are little-endian aarch64 or
+ * x86-64. Every fragment carries the full pose tag so a slice can be
+ * reassembled from fragments in any order.
+ */
+struct SlicePacketHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t eye;
+    uint8_t flags;                  ///< kSlicePacket* flags
+    uint64_t frame_id;
+    uint16_t slice_index;
+    uint16_t slice_count;
+    uint16_t fragment_index;
+    uint16_t fragment_count;
+    uint32_t slice_bytes;           ///< Bitstream size of the whole slice
+    uint32_t fragment_offset;       ///< Offset of this fragment in the bitstream
+    float render_rotation[4];
+    float render_translation[3];
+    uint32_t encode_us;             ///< Time the encoder took for the slice
+    double render_timestamp;
+};
+
+static_assert(sizeof(SlicePacketHeader) == 72, "SlicePacketHeader layout changed");
+
+/**
+ * @brief Encodes eye buffers slice by slice and streams them over UDP
+ *
+ * Every slice of every eye has its own encoder, fed as soon as the renderer
+ * finishes the slice rather than at the end of the frame, which removes
+ * about a frame of encode latency. The encoded slice is tagged with its render pose
+ * and split into fragments. All fragments go out in one sendmmsg() call,
+ * marked with the video DSCP so the AX210 driver queues them in its
+ * deadline-ordered video class. A slice whose deadline has already passed
+ * is not encoded at all: it would arrive after its scanout.
+ *
+ * Not thread-safe, slices are sent from the render thread.
+ */
+class SliceStreamSender
+{
+public:
+    struct Options {
+        std::string host;                       ///< Receiver address (IPv4)
+        int port = 9944;
+        int eye_width = 1832;
+        int eye_height = 1920;
+        int slice_count = 4;                    ///< Bands per eye, eye_height / slice_count a multiple of 16
+        int fps = 90;
+        int bitrate_kbps = 80000;               ///< Both eyes together
+        int gop = 0;                            ///< Frames between IDRs per slice stream
+        int max_slice_bytes = 256 * 1024;
+        int fragment_payload = 1400;            ///< Bitstream bytes per datagram
+        int dscp = 34;                          ///< AF41, the AX210 video class
+    };
+
+    struct Stats {
+        uint64_t slices_sent = 0;
+        uint64_t slices_late = 0;               ///< Skipped, deadline passed before encoding
+        uint64_t encode_failures = 0;
+        uint64_t send_failures = 0;
+        uint64_t fragments_sent = 0;
+        uint64_t bytes_sent = 0;
+        uint32_t encode_us_avg = 0;             ///< Moving average, 1/8
+        uint32_t encode_us_max = 0;
+    };
+
+    using EncoderFactory = std::function<std::unique_ptr<SliceEncoder>(const SliceEncoderConfig&)>;
+
+    /**
+     * @brief Constructor
+     * @param options Destination, geometry and rate
+     * @param factory Encoder per slice stream, CreateMppSliceEncoder if empty
+     */
+    explicit SliceStreamSender(const Options& options, EncoderFactory factory = nullptr);
+
+    /**
+     * @brief Destructor, closes the socket
+     */
+    ~SliceStreamSender();
+
+    SliceStreamSender(const SliceStreamSender&) = delete;
+    SliceStreamSender& operator=(const SliceStreamSender&) = delete;
+
+    /**
+     * @brief Check if the options were accepted and all encoders were created
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Encode a rendered slice and send it
+     * @param frame_id Frame the slice belongs to, increasing
+     * @param eye 0 for left, 1 for right
+     * @param slice Band index, 0 at the top
+     * @param image Slice pixels
+     * @param pose Render pose of the slice
+     * @param deadline CLOCK_MONOTONIC time after which the slice is useless, 0 for none
+     * @return True if the slice was sent, false if it was late or failed
+     */
+    bool SendSlice(uint64_t frame_id, int eye, int slice, const SliceImage& image,
+                   const SlicePose& pose, double deadline);
+
+    /**
+     * @brief Make the next frame of a slice stream an IDR, after the receiver lost it
+     */
+    void RequestKeyframe(int eye, int slice);
+
+    /**
+     * @brief Get the send statistics
+     */
+    Stats GetStats() const;
+
+private:
+    bool mValid;
+    Options mOptions;
+    int mSocket;
+    int mSliceHeight;
+    std::vector<std::unique_ptr<SliceEncoder>> mEncoders;  ///< eye x slice
+    std::vector<uint8_t> mForceIdr;                         ///< eye x slice
+    std::vector<uint8_t> mBitstream;
+    std::vector<SlicePacketHeader> mHeaders;                ///< One per fragment, preallocated
+    std::vector<struct iovec> mIov;                         ///< Header and payload per fragment
+    std::vector<struct mmsghdr> mMessages;                  ///< One per fragment
+    Stats mStats;
+};
+
+/**
+ * @brief A reassembled slice, with the rotation to reproject it by
+ */
+struct ReceivedSlice {
+    uint64_t frame_id = 0;
+    int eye = 0;
+    int slice_index = 0;
+    int slice_count = 0;
+    bool is_idr = false;
+    SlicePose render_pose;
+    float reprojection[4] = {0.0f, 0.0f, 0.0f, 1.0f};  ///< Rotation from the render to the latest head frame
+    std::vector<uint8_t> bitstream;                     ///< Capacity is reused across Poll() calls
+};
+
+/**
+ * @brief Receives slice streams on the headset and reassembles them
+ *
+ * Every completed slice comes with the rotation from its render pose to the
+ * newest head pose VRMotionModel predicts for the display. The pose is read
+ * from the shared pose export of VRSLAMSystem. The display late-latches
+ * that rotation for the slice, so a frame encoded and sent with
+ * pose A is shown corrected to the head pose at scanout. Fragments of a
+ * slice older than one already delivered are dropped.
+ *
+ * Not thread-safe, Poll() is called from the decode thread.
+ */
+class SliceStreamReceiver
+{
+public:
+    struct Options {
+        int port = 9944;                            ///< 0 picks a free port, see GetPort()
+        int reassembly_slots = 16;                  ///< Slices being reassembled at once
+        int max_slice_bytes = 256 * 1024;
+        std::string pose_region = "/vr_slam_pose";  ///< Newest head pose (empty to set it by hand)
+    };
+
+    struct Stats {
+        uint64_t slices_completed = 0;
+        uint64_t slices_incomplete = 0;             ///< Evicted before their last fragment arrived
+        uint64_t packets_invalid = 0;
+        uint64_t packets_stale = 0;                 ///< Fragments of already delivered frames
+    };
+
+    /**
+     * @brief Constructor, binds the socket
+     * @param options Port, reassembly capacity and pose region
+     */
+    explicit SliceStreamReceiver(const Options& options);
+
+    /**
+     * @brief Destructor, closes the socket
+     */
+    ~SliceStreamReceiver();
+
+    SliceStreamReceiver(const SliceStreamReceiver&) = delete;
+    SliceStreamReceiver& operator=(const SliceStreamReceiver&) = delete;
+
+    /**
+     * @brief Check if the socket was bound
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Get the bound UDP port
+     */
+    int GetPort() const;
+
+    /**
+     * @brief Set the head pose, used when no pose region is followed
+     * @param rotation Tcw rotation quaternion (x, y, z, w)
+     */
+    void SetLatestPose(const float rotation[4]);
+
+    /**
+     * @brief Wait for the next complete slice
+     * @param slice Output slice
+     * @param timeout_ms Maximum time to wait (-1 for no limit)
+     * @return True if a slice was reassembled
+     */
+    bool Poll(ReceivedSlice& slice, int timeout_ms);
+
+    /**
+     * @brief Get the receive statistics
+     */
+    Stats GetStats() const;
+
+private:
+    struct Slot {
+        bool used = false;
+        bool ready = false;
+        uint64_t age = 0;                   ///< Order of the first fragment
+        SlicePacketHeader header;
+        uint32_t fragments_received = 0;
+        std::vector<uint8_t> fragment_seen;
+        std::vector<uint8_t> data;
+    };
+
+    void receivePackets(int timeout_ms);
+    void handlePacket(const uint8_t* packet, size_t size);
+    bool deliver(ReceivedSlice& slice);
+    void updateLatestPose();
+
+    bool mValid;
+    Options mOptions;
+    int mSocket;
+    int mPort;
+    uint64_t mAge;
+    std::vector<Slot> mSlots;
+    std::vector<uint64_t> mDelivered;       ///< Newest delivered frame id + 1 per (eye, slice), 0 for none
+    std::vector<uint8_t> mPackets;          ///< recvmmsg buffers
+    std::vector<struct iovec> mIov;
+    std::vector<struct mmsghdr> mMessages;
+    float mLatestRotation[4];
+    std::unique_ptr<SharedPoseReader> mPoseReader;
+    int mPoseRetry;
+    Stats mStats;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // SLICE_STREAM_HPP
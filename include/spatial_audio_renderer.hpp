@@ -0,0 +1,172 @@
+#ifndef SPATIAL_AUDIO_RENDERER_HPP
+#define SPATIAL_AUDIO_RENDERER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shared_pose_export.hpp"
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Head-related impulse responses measured on a grid of directions
+ *
+ * Directions follow the SOFA convention: azimuth counter-clockwise from the
+ * front (positive to the left), elevation positive upwards, both in degrees.
+ * left and right hold length taps per direction, direction-major.
+ */
+struct HrtfSet {
+    int sample_rate = 48000;
+    int length = 0;                       ///< Taps per impulse response
+    std::vector<float> azimuth_deg;       ///< One entry per direction
+    std::vector<float> elevation_deg;     ///< One entry per direction
+    std::vector<float> left;              ///< directions x length taps
+    std::vector<float> right;             ///< directions x length taps
+};
+
+/**
+ * @brief Binaural renderer that keeps sources fixed in the world as the head turns
+ *
+ * Once per audio period the renderer reads the newest head pose from the
+ * shared pose export of VRSLAMSystem, picks the nearest measured direction
+ * of every source relative to the head and convolves it with that impulse
+ * response pair. Convolution is uniformly partitioned overlap-save: the
+ * responses are split into block-sized partitions, every source keeps a
+ * delay line of input spectra, and all sources are summed in the frequency
+ * domain, so a block costs one forward FFT per source and two inverse FFTs
+ * whatever the number of sources. Latency is one block. When a source moves
+ * to another direction the old and new responses are rendered for one block
+ * and crossfaded, which avoids the clicks of switching filters mid-stream.
+ *
+ * Not thread-safe, all methods are called from the audio thread.
+ */
+class SpatialAudioRenderer
+{
+public:
+    struct Options {
+        int block_size = 128;                       ///< Samples per audio period, power of two (2.7 ms at 48 kHz)
+        int max_sources = 16;                       ///< Source slots
+        std::string pose_region = "/vr_slam_pose";  ///< Shared pose export to follow (empty to set the pose by hand)
+    };
+
+    /**
+     * @brief Constructor
+     * @param hrtf Impulse responses, transformed once here
+     * @param options Block size, source count and pose region
+     */
+    SpatialAudioRenderer(const HrtfSet& hrtf, const Options& options);
+
+    /**
+     * @brief Destructor
+     */
+    ~SpatialAudioRenderer();
+
+    SpatialAudioRenderer(const SpatialAudioRenderer&) = delete;
+    SpatialAudioRenderer& operator=(const SpatialAudioRenderer&) = delete;
+
+    /**
+     * @brief Check if the HRTF set and options were accepted
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Get the block size Process() takes
+     */
+    int GetBlockSize() const;
+
+    /**
+     * @brief Add a source
+     * @param position Position in the world frame (m)
+     * @return Source slot, or -1 if all slots are taken
+     */
+    int AddSource(const float position[3]);
+
+    /**
+     * @brief Move a source
+     * @param source Slot returned by AddSource()
+     * @param position Position in the world frame (m)
+     * @return False if the slot is not in use
+     */
+    bool SetSourcePosition(int source, const float position[3]);
+
+    /**
+     * @brief Remove a source and clear its delay line
+     */
+    void RemoveSource(int source);
+
+    /**
+     * @brief Set the head pose, used when no pose region is followed
+     * @param rotation Tcw rotation quaternion (x, y, z, w)
+     * @param translation Tcw translation
+     */
+    void SetHeadPose(const float rotation[4], const float translation[3]);
+
+    /**
+     * @brief Render one block
+     * @param inputs Mono input of every source slot, block size samples each,
+     *               null for a silent slot
+     * @param left Left ear output, block size samples
+     * @param right Right ear output, block size samples
+     * @return False if the renderer is not valid
+     */
+    bool Process(const float* const* inputs, float* left, float* right);
+
+    /**
+     * @brief Get the direction a source was last rendered from
+     * @return Index into the HRTF set, or -1 if not rendered yet
+     */
+    int GetSourceDirection(int source) const;
+
+private:
+    struct Source {
+        bool active = false;
+        float position[3] = {0.0f, 0.0f, 0.0f};
+        int direction = -1;
+        int previous_direction = -1;
+        std::vector<float> history;       ///< Previous input block
+        std::vector<float> spectra_re;    ///< Delay line, partitions x bins
+        std::vector<float> spectra_im;
+        int head = 0;                     ///< Partition slot of the newest spectrum
+    };
+
+    void updateHeadPose();
+    int nearestDirection(const Source& source) const;
+    void accumulate(const Source& source, int direction, int mix);
+    void inverse(int mix, int ear, float* out);
+    void fft(float* re, float* im, bool inverse_transform) const;
+
+    bool mValid;
+    int mBlock;
+    int mFftSize;
+    int mBins;
+    int mPartitions;
+    int mDirections;
+
+    std::vector<float> mDirectionVectors;   ///< Unit vector per direction, camera frame
+    std::vector<float> mFilterRe;           ///< Direction x ear x partition x bin
+    std::vector<float> mFilterIm;
+    std::vector<Source> mSources;
+
+    std::vector<int> mBitReverse;
+    std::vector<float> mTwiddleCos;
+    std::vector<float> mTwiddleSin;
+
+    std::vector<float> mFrameRe;            ///< FFT scratch
+    std::vector<float> mFrameIm;
+    std::vector<float> mAccRe;              ///< Mix x ear x bin, mixes: steady, fade-out, fade-in
+    std::vector<float> mAccIm;
+    std::vector<float> mMixOut;             ///< Mix x ear x block
+
+    float mRotation[4];
+    float mTranslation[3];
+    std::string mPoseRegion;
+    std::unique_ptr<SharedPoseReader> mPoseReader;
+    int mPoseRetry;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // SPATIAL_AUDIO_RENDERER_HPP
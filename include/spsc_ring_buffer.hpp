@@ -0,0 +1,148 @@
+#ifndef SPSC_RING_BUFFER_HPP
+#define SPSC_RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Fixed-capacity, lock-free single-producer/single-consumer ring buffer
+ *
+ * One thread may push and one (other) thread may pop concurrently without any
+ * locking. The producer and consumer indices live on separate cache lines so
+ * the two sides never false-share, and each side keeps a private copy of the
+ * other side's index to avoid touching the shared line on every operation.
+ *
+ * The capacity is rounded up to the next power of two.
+ */
+template <typename T>
+class SPSCRingBuffer
+{
+public:
+    static constexpr size_t kCacheLineSize = 64;
+
+    /**
+     * @brief Constructor
+     * @param capacity Minimum number of elements the ring can hold
+     */
+    explicit SPSCRingBuffer(size_t capacity)
+        : mHead(0), mTail(0), mCachedHead(0), mCachedTail(0)
+    {
+        size_t size = 1;
+        while (size < capacity + 1) {
+            size <<= 1;
+        }
+        mSlots.resize(size);
+        mMask = size - 1;
+    }
+
+    SPSCRingBuffer(const SPSCRingBuffer&) = delete;
+    SPSCRingBuffer& operator=(const SPSCRingBuffer&) = delete;
+
+    /**
+     * @brief Push an element (producer only)
+     * @param item Element to push
+     * @return False if the ring is full
+     */
+    bool TryPush(const T& item)
+    {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & mMask;
+        if (next == mCachedHead) {
+            mCachedHead = mHead.load(std::memory_order_acquire);
+            if (next == mCachedHead) {
+                return false;
+            }
+        }
+        mSlots[tail] = item;
+        mTail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Peek at the oldest element (consumer only)
+     * @return Pointer to the oldest element, or nullptr if the ring is empty
+     */
+    T* Front()
+    {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mCachedTail) {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head == mCachedTail) {
+                return nullptr;
+            }
+        }
+        return &mSlots[head];
+    }
+
+    /**
+     * @brief Remove the oldest element (consumer only, ring must not be empty)
+     */
+    void Pop()
+    {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        mHead.store((head + 1) & mMask, std::memory_order_release);
+    }
+
+    /**
+     * @brief Pop the oldest element (consumer only)
+     * @param item Output element
+     * @return False if the ring is empty
+     */
+    bool TryPop(T& item)
+    {
+        T* front = Front();
+        if (!front) {
+            return false;
+        }
+        item = *front;
+        Pop();
+        return true;
+    }
+
+    /**
+     * @brief Check if the ring is empty (approximate when called concurrently)
+     */
+    bool Empty() const
+    {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Number of queued elements (approximate when called concurrently)
+     */
+    size_t Size() const
+    {
+        const size_t head = mHead.load(std::memory_order_acquire);
+        const size_t tail = mTail.load(std::memory_order_acquire);
+        return (tail - head) & mMask;
+    }
+
+    /**
+     * @brief Maximum number of elements the ring can hold
+     */
+    size_t Capacity() const
+    {
+        return mMask;
+    }
+
+private:
+    // Consumer index
+    alignas(kCacheLineSize) std::atomic<size_t> mHead;
+    // Producer index
+    alignas(kCacheLineSize) std::atomic<size_t> mTail;
+    // Producer-private copy of the consumer index
+    alignas(kCacheLineSize) size_t mCachedHead;
+    // Consumer-private copy of the producer index
+    alignas(kCacheLineSize) size_t mCachedTail;
+
+    alignas(kCacheLineSize) std::vector<T> mSlots;
+    size_t mMask;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // SPSC_RING_BUFFER_HPP
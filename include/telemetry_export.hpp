@@ -0,0 +1,208 @@
+#ifndef TELEMETRY_EXPORT_HPP
+#define TELEMETRY_EXPORT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "latency_trace.hpp"
+#include "seqlock.hpp"
+#include "../ORB_SLAM3/include/MemoryAccounting.h"
+
+namespace ORB_SLAM3
+{
+
+constexpr uint32_t kSharedTelemetryMagic = 0x4D545256;  ///< "VRTM"
+constexpr uint32_t kSharedTelemetryVersion = 1;         ///< Bumped on every layout change
+constexpr uint32_t kSharedTelemetrySlots = 8;           ///< Samples kept in the ring
+constexpr uint32_t kSharedTelemetryMaxDevices = 8;      ///< TPU and NPU devices reported
+constexpr uint32_t kSharedTelemetryMaxThermalZones = 8; ///< Thermal zones reported
+constexpr uint32_t kSharedTelemetryZoneNameLength = 24; ///< Thermal zone type, NUL terminated
+
+/**
+ * @brief One telemetry sample as laid out in shared memory
+ *
+ * Fixed-width fields only, mirrored by the Rust monitoring service
+ * (vr_core_api monitoring::slam). Latencies are the distributions of the
+ * LatencyTracker since the start, times are CLOCK_MONOTONIC seconds.
+ */
+struct SharedTelemetrySample {
+    uint64_t sequence;                        ///< Number of samples published before this one
+    double publish_time;                      ///< Time the sample was written
+    uint64_t frames_processed;                ///< Frame sets tracked
+    uint64_t dropped_frames;                  ///< Frame sets dropped between pipeline stages
+    uint64_t tracking_lost_count;             ///< Times tracking was lost
+    float fps;                                ///< Frame sets per second, set by the slowest stage
+    int32_t tracking_state;                   ///< VRSLAMSystem::Status
+
+    // Latency percentiles in milliseconds, indexed by LatencyStage
+    float stage_p50_ms[kNumLatencyStages];
+    float stage_p99_ms[kNumLatencyStages];
+    float stage_p999_ms[kNumLatencyStages];
+    float stage_max_ms[kNumLatencyStages];
+    float end_to_end_p50_ms;                  ///< Exposure midpoint to pose published
+    float end_to_end_p99_ms;
+    float end_to_end_p999_ms;
+    float end_to_end_max_ms;
+
+    uint32_t extraction_queue_depth;          ///< Frame sets waiting for extraction
+    uint32_t tracking_queue_depth;            ///< Frame sets waiting for tracking
+    uint32_t tpu_queue_depth;                 ///< Frames waiting for a TPU
+    uint32_t keypoints;                       ///< Keypoints of the last frame set, all scheduled cameras
+    uint32_t tracked_points;                  ///< Tracked map points of the last frame set
+    uint32_t tpu_device_count;                ///< Valid entries of the tpu_* arrays
+    float tpu_utilization[kSharedTelemetryMaxDevices];  ///< Fraction of wall time each device was busy
+    float tpu_rate_fps[kSharedTelemetryMaxDevices];     ///< Frames per second extracted on each device
+
+    uint32_t thermal_zone_count;              ///< Valid entries of the thermal_* arrays
+    uint32_t cpu_capped_mask;                 ///< Bit n set while cpufreq policyN is capped below its maximum
+    float thermal_celsius[kSharedTelemetryMaxThermalZones];
+    char thermal_zone_type[kSharedTelemetryMaxThermalZones][kSharedTelemetryZoneNameLength];
+
+    uint64_t resident_bytes;                  ///< Resident set of the process
+    uint64_t unattributed_bytes;              ///< Resident set outside the breakdown
+    uint64_t paged_out_bytes;                 ///< Paged out keyframe features, included in memory_bytes
+    uint64_t memory_bytes[MemoryBreakdown::NUM_CATEGORIES];  ///< Indexed by MemoryBreakdown::Category
+};
+
+/**
+ * @brief Shared memory region: header followed by a ring of seqlocked samples
+ *
+ * Same protocol as SharedPoseRegion: the writer fills slot
+ * write_count % kSharedTelemetrySlots, then increments write_count and
+ * notify_word and wakes the futex waiters on notify_word.
+ */
+struct SharedTelemetryRegion {
+    struct alignas(64) Slot {
+        SeqLock<SharedTelemetrySample> sample;
+    };
+
+    std::atomic<uint32_t> magic;              ///< kSharedTelemetryMagic once the region is initialized
+    uint32_t version;                         ///< kSharedTelemetryVersion
+    uint32_t slot_count;                      ///< kSharedTelemetrySlots
+    uint32_t sample_size;                     ///< sizeof(SharedTelemetrySample)
+    alignas(64) std::atomic<uint64_t> write_count;  ///< Number of samples published
+    alignas(64) std::atomic<uint32_t> notify_word;  ///< Futex word, bumped on every publish
+    Slot slots[kSharedTelemetrySlots];
+};
+
+/**
+ * @brief Publishes telemetry samples into a POSIX shared memory ring
+ *
+ * Meant for a low-rate thread off the pipeline, the tracking threads never
+ * write to the region. Only one writer per region name.
+ */
+class SharedTelemetryWriter
+{
+public:
+    /**
+     * @brief Constructor
+     * @param name POSIX shared memory name (e.g. "/vr_slam_telemetry")
+     */
+    explicit SharedTelemetryWriter(const std::string& name);
+
+    /**
+     * @brief Destructor, unmaps and unlinks the region
+     */
+    ~SharedTelemetryWriter();
+
+    SharedTelemetryWriter(const SharedTelemetryWriter&) = delete;
+    SharedTelemetryWriter& operator=(const SharedTelemetryWriter&) = delete;
+
+    /**
+     * @brief Create (or take over) and initialize the region
+     * @return True if successful, false otherwise
+     */
+    bool Open();
+
+    /**
+     * @brief Unmap and unlink the region
+     */
+    void Close();
+
+    /**
+     * @brief Check if the region is open
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Publish a sample and wake the waiting readers
+     * @param sample Sample to publish, its sequence field is set here
+     */
+    void Publish(const SharedTelemetrySample& sample);
+
+private:
+    std::string mName;
+    SharedTelemetryRegion* mRegion;
+};
+
+/**
+ * @brief Reads telemetry samples from a region published by SharedTelemetryWriter
+ */
+class SharedTelemetryReader
+{
+public:
+    /**
+     * @brief Constructor
+     * @param name POSIX shared memory name
+     */
+    explicit SharedTelemetryReader(const std::string& name);
+
+    /**
+     * @brief Destructor, unmaps the region
+     */
+    ~SharedTelemetryReader();
+
+    SharedTelemetryReader(const SharedTelemetryReader&) = delete;
+    SharedTelemetryReader& operator=(const SharedTelemetryReader&) = delete;
+
+    /**
+     * @brief Map the region and check its layout version
+     * @return False if the region does not exist yet or has another layout
+     */
+    bool Open();
+
+    /**
+     * @brief Unmap the region
+     */
+    void Close();
+
+    /**
+     * @brief Check if the region is open
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Get the number of samples published so far
+     */
+    uint64_t GetWriteCount() const;
+
+    /**
+     * @brief Read the newest sample without blocking
+     * @param sample Output sample
+     * @return False if nothing was published yet or the slot could not be read
+     */
+    bool ReadLatest(SharedTelemetrySample& sample) const;
+
+private:
+    std::string mName;
+    SharedTelemetryRegion* mRegion;
+};
+
+/**
+ * @brief Fill the thermal fields of a sample from sysfs
+ *
+ * Reads the temperature and type of the first kSharedTelemetryMaxThermalZones
+ * thermal zones, and sets cpu_capped_mask for the cpufreq policies whose
+ * scaling_max_freq is below cpuinfo_max_freq (thermal or power capping).
+ * A few small file reads, call it at the telemetry rate.
+ *
+ * @param sample Sample to fill
+ * @param sysfs_root Root of the sysfs tree (tests point it to a fake tree)
+ */
+void SampleThermalState(SharedTelemetrySample& sample, const std::string& sysfs_root = "/sys");
+
+} // namespace ORB_SLAM3
+
+#endif // TELEMETRY_EXPORT_HPP
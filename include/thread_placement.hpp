@@ -0,0 +1,184 @@
+#ifndef THREAD_PLACEMENT_HPP
+#define THREAD_PLACEMENT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief What a thread does, each role has its own placement
+ */
+enum class ThreadRole {
+    TRACKING,              ///< Tracking of the frame sets
+    LOCAL_MAPPING,         ///< ORB-SLAM3 LocalMapping
+    LOOP_CLOSING,          ///< ORB-SLAM3 LoopClosing
+    VIEWER,                ///< ORB-SLAM3 Viewer
+    CAMERA_ACQUISITION,    ///< Camera capture and frame set synchronization
+    FEATURE_EXTRACTION,    ///< TPU feeding and extraction workers
+    IMU_ACQUISITION,       ///< IMU sensor reads
+    FUSION,                ///< Visual-inertial fusion
+    POSE_PUBLISHER,        ///< IMU-propagated pose output
+    CALIBRATION,           ///< Online refinement of the IMU-camera calibration
+    DIAGNOSTICS,           ///< Flight recorder dumps
+};
+
+constexpr size_t kThreadRoleCount = static_cast<size_t>(ThreadRole::DIAGNOSTICS) + 1;
+
+/**
+ * @brief Name of a role, for logs and statistics
+ */
+const char* ThreadRoleName(ThreadRole role);
+
+/**
+ * @brief Core cluster of a big.LITTLE CPU
+ */
+enum class CoreClass {
+    ANY,      ///< No pinning
+    BIG,      ///< Cores of the highest cpu_capacity (A76 on the RK3588)
+    LITTLE,   ///< The other cores (A55 on the RK3588)
+};
+
+/**
+ * @brief Cores and scheduling of a role
+ */
+struct ThreadPlacement {
+    CoreClass cores = CoreClass::ANY;   ///< Cluster to run on
+    std::vector<int> cpus;              ///< Explicit cpuset, overrides cores (empty to use the cluster)
+    int realtime_priority = 0;          ///< SCHED_FIFO priority (0 for SCHED_OTHER)
+    int nice = 0;                       ///< Nice value under SCHED_OTHER
+};
+
+/**
+ * @brief Scheduling counters of a placed thread
+ */
+struct ThreadStats {
+    std::string name;                   ///< Name given when placed
+    ThreadRole role;                    ///< Role it was placed as
+    int tid;                            ///< Kernel thread ID
+    bool alive;                         ///< False once the thread exited, the counters are then 0
+    uint64_t migrations;                ///< Moves between CPUs
+    uint64_t preemptions;               ///< Involuntary context switches
+    uint64_t voluntary_switches;        ///< Blocking context switches
+};
+
+/**
+ * @brief Per-role thread placement on big.LITTLE cores with real-time scheduling
+ *
+ * One policy is installed for the process; every thread of a known role
+ * places itself at its start with PlaceCurrentThread(), which does nothing
+ * while no policy is installed. The clusters are told apart by the
+ * cpu_capacity the kernel reports for each CPU. Real-time priorities need
+ * CAP_SYS_NICE and locking memory needs CAP_IPC_LOCK (or a large enough
+ * RLIMIT_MEMLOCK), failures are reported and the thread runs unplaced.
+ */
+class ThreadPlacementPolicy
+{
+public:
+    /**
+     * @brief Configuration
+     */
+    struct Config {
+        bool enabled = false;                            ///< Whether the policy is installed at all
+        std::array<ThreadPlacement, kThreadRoleCount> roles = DefaultRoles(); ///< Placement per ThreadRole
+        bool lock_memory = true;                         ///< mlockall() current and future pages
+        size_t prefault_stack_bytes = 256 * 1024;        ///< Stack touched by each placed thread
+        size_t prefault_heap_bytes = 64 * 1024 * 1024;   ///< Heap touched and kept from the OS (0 to leave malloc alone)
+        std::string cpu_sysfs_root = "/sys/devices/system/cpu"; ///< Where the cpu*/cpu_capacity files are
+    };
+
+    /**
+     * @brief Placement for the RK3588, latency-critical I/O on the A55, compute on the A76
+     */
+    static std::array<ThreadPlacement, kThreadRoleCount> DefaultRoles();
+
+    /**
+     * @brief Constructor, detects the core clusters
+     * @param config Configuration
+     */
+    explicit ThreadPlacementPolicy(const Config& config);
+
+    ThreadPlacementPolicy(const ThreadPlacementPolicy&) = delete;
+    ThreadPlacementPolicy& operator=(const ThreadPlacementPolicy&) = delete;
+
+    /**
+     * @brief Lock the memory of the process and prefault the heap
+     * @return False if any of it failed
+     */
+    bool ApplyProcess();
+
+    /**
+     * @brief Pin and schedule the calling thread for its role, and prefault its stack
+     * @param role Role of the thread
+     * @param name Name reported in the statistics
+     * @return False if any of it failed
+     */
+    bool ApplyToCurrentThread(ThreadRole role, const std::string& name);
+
+    /**
+     * @brief CPUs a placement resolves to on this machine
+     * @return Sorted CPUs, empty for no pinning
+     */
+    std::vector<int> ResolveCpus(const ThreadPlacement& placement) const;
+
+    /**
+     * @brief CPUs of a role on this machine
+     */
+    std::vector<int> GetRoleCpus(ThreadRole role) const;
+
+    /**
+     * @brief Migrations and preemptions of every thread placed so far
+     */
+    std::vector<ThreadStats> GetThreadStats() const;
+
+    /**
+     * @brief Split the CPUs by the cpu_capacity the kernel reports
+     * @param cpu_sysfs_root Directory of the cpu<N> entries
+     * @param big CPUs of the highest capacity
+     * @param little The other CPUs
+     * @return False if the capacities are missing or all equal (not big.LITTLE)
+     */
+    static bool DetectCoreClusters(const std::string& cpu_sysfs_root, std::vector<int>& big, std::vector<int>& little);
+
+    /**
+     * @brief Install the policy threads place themselves with (nullptr to uninstall)
+     */
+    static void Install(std::shared_ptr<ThreadPlacementPolicy> policy);
+
+    /**
+     * @brief Get the installed policy, nullptr if none
+     */
+    static std::shared_ptr<ThreadPlacementPolicy> GetInstalled();
+
+    /**
+     * @brief Place the calling thread with the installed policy, if any
+     * @param role Role of the thread
+     * @param name Name reported in the statistics
+     */
+    static void PlaceCurrentThread(ThreadRole role, const std::string& name);
+
+private:
+    struct PlacedThread {
+        std::string name;
+        ThreadRole role;
+        int tid;
+    };
+
+    Config mConfig;
+    std::vector<int> mBigCpus;
+    std::vector<int> mLittleCpus;
+    bool mIsBigLittle;
+
+    mutable std::mutex mMutex;
+    std::vector<PlacedThread> mThreads;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // THREAD_PLACEMENT_HPP
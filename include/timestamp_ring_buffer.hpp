@@ -0,0 +1,241 @@
+#ifndef TIMESTAMP_RING_BUFFER_HPP
+#define TIMESTAMP_RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Fixed-capacity, lock-free single-writer/multi-reader ring of timestamped samples
+ *
+ * The writer appends samples with strictly increasing timestamps, overwriting
+ * the oldest once the ring is full. Any number of readers query ranges by
+ * timestamp (binary search) or by sequence number without locking and
+ * without copying: a Range refers to the ring slots directly.
+ *
+ * Readers never block the writer, so a slow reader can be lapped. Samples
+ * read through a Range are only guaranteed intact if IsValid(range) still
+ * holds after they were read; check it and retry (or drop) otherwise.
+ *
+ * T needs a double member t holding the timestamp (e.g., IMU::Point). The
+ * capacity is rounded up to the next power of two.
+ */
+template <typename T>
+class TimestampRingBuffer
+{
+public:
+    /**
+     * @brief Consecutive samples in the ring, oldest first
+     */
+    class Range
+    {
+    public:
+        class const_iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const T* pointer;
+            typedef const T& reference;
+
+            const_iterator(const Range* range, size_t index) : mRange(range), mIndex(index) {}
+            const T& operator*() const { return (*mRange)[mIndex]; }
+            const T* operator->() const { return &(*mRange)[mIndex]; }
+            const_iterator& operator++() { ++mIndex; return *this; }
+            const_iterator operator++(int) { const_iterator previous = *this; ++mIndex; return previous; }
+            bool operator==(const const_iterator& other) const { return mIndex == other.mIndex; }
+            bool operator!=(const const_iterator& other) const { return mIndex != other.mIndex; }
+
+        private:
+            const Range* mRange;
+            size_t mIndex;
+        };
+
+        Range() : mSlots(nullptr), mMask(0), mBegin(0), mEnd(0) {}
+
+        size_t size() const { return static_cast<size_t>(mEnd - mBegin); }
+        bool empty() const { return mEnd == mBegin; }
+        const T& operator[](size_t i) const { return mSlots[(mBegin + i) & mMask]; }
+        const T& front() const { return (*this)[0]; }
+        const T& back() const { return (*this)[size() - 1]; }
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size()); }
+
+        /**
+         * @brief Sequence number of the first sample
+         */
+        uint64_t GetBeginSequence() const { return mBegin; }
+
+        /**
+         * @brief Sequence number one past the last sample
+         */
+        uint64_t GetEndSequence() const { return mEnd; }
+
+    private:
+        friend class TimestampRingBuffer;
+
+        Range(const T* slots, uint64_t mask, uint64_t begin, uint64_t end)
+            : mSlots(slots), mMask(mask), mBegin(begin), mEnd(end) {}
+
+        const T* mSlots;
+        uint64_t mMask;
+        uint64_t mBegin;
+        uint64_t mEnd;
+    };
+
+    /**
+     * @brief Constructor
+     * @param capacity Minimum number of samples the ring keeps
+     * @param fill Value the slots start with (for types without a default constructor)
+     */
+    explicit TimestampRingBuffer(size_t capacity, const T& fill = T())
+        : mClaimed(0), mPublished(0)
+    {
+        // One extra slot for the sample being written
+        size_t size = 1;
+        while (size < capacity + 1) {
+            size <<= 1;
+        }
+        mSlots.resize(size, fill);
+        mMask = size - 1;
+    }
+
+    TimestampRingBuffer(const TimestampRingBuffer&) = delete;
+    TimestampRingBuffer& operator=(const TimestampRingBuffer&) = delete;
+
+    /**
+     * @brief Append a sample (writer only)
+     * @param item Sample, newer than the previous one
+     * @return False if the timestamp is not newer than the last sample's
+     */
+    bool Push(const T& item)
+    {
+        const uint64_t count = mPublished.load(std::memory_order_relaxed);
+        if (count > 0 && !(item.t > mSlots[(count - 1) & mMask].t)) {
+            return false;
+        }
+
+        // Announce the overwrite of the oldest slot before touching it
+        mClaimed.store(count + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mSlots[count & mMask] = item;
+        mPublished.store(count + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Get the samples with start_time <= t <= end_time
+     */
+    Range GetRange(double start_time, double end_time) const
+    {
+        for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+            uint64_t oldest;
+            const uint64_t published = snapshot(oldest);
+            const uint64_t begin = lowerBound(oldest, published, start_time, false);
+            const uint64_t end = lowerBound(begin, published, end_time, true);
+
+            // A lapped search read overwritten timestamps, search again
+            const Range range(mSlots.data(), mMask, begin, end);
+            if (IsValid(range)) {
+                return range;
+            }
+        }
+        return Range();
+    }
+
+    /**
+     * @brief Get the samples from a sequence number on (or from the oldest kept)
+     * @param sequence Sequence number, e.g. GetEndSequence() of the last range read
+     */
+    Range GetSince(uint64_t sequence) const
+    {
+        uint64_t oldest;
+        const uint64_t published = snapshot(oldest);
+        const uint64_t begin = sequence < oldest ? oldest : (sequence > published ? published : sequence);
+        return Range(mSlots.data(), mMask, begin, published);
+    }
+
+    /**
+     * @brief Get the newest samples
+     * @param count Maximum number of samples
+     */
+    Range GetLatest(size_t count) const
+    {
+        uint64_t oldest;
+        const uint64_t published = snapshot(oldest);
+        const uint64_t begin = published - oldest > count ? published - count : oldest;
+        return Range(mSlots.data(), mMask, begin, published);
+    }
+
+    /**
+     * @brief Check that no sample of a range has been overwritten
+     *
+     * Call after reading the samples: it orders the reads before the check.
+     */
+    bool IsValid(const Range& range) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t claimed = mClaimed.load(std::memory_order_relaxed);
+        return claimed <= range.mBegin + mSlots.size();
+    }
+
+    /**
+     * @brief Get the number of samples pushed since construction
+     */
+    uint64_t GetWriteCount() const
+    {
+        return mPublished.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Get the number of slots (the samples kept is one less)
+     */
+    size_t GetCapacity() const
+    {
+        return mSlots.size();
+    }
+
+private:
+    // Searches repeated before a range lapped by the writer is given up
+    static constexpr int kMaxAttempts = 8;
+
+    std::vector<T> mSlots;
+    uint64_t mMask;
+
+    // Samples the writer started writing and finished writing
+    alignas(64) std::atomic<uint64_t> mClaimed;
+    alignas(64) std::atomic<uint64_t> mPublished;
+
+    // Published count and oldest sequence number that cannot be in the middle of an overwrite
+    uint64_t snapshot(uint64_t& oldest) const
+    {
+        const uint64_t published = mPublished.load(std::memory_order_acquire);
+        oldest = published + 1 > mSlots.size() ? published + 1 - mSlots.size() : 0;
+        return published;
+    }
+
+    // First sequence number in [first, last) with t >= time (t > time if upper)
+    uint64_t lowerBound(uint64_t first, uint64_t last, double time, bool upper) const
+    {
+        while (first < last) {
+            const uint64_t middle = first + (last - first) / 2;
+            const double t = mSlots[middle & mMask].t;
+            if (upper ? !(time < t) : t < time) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        return first;
+    }
+};
+
+} // namespace ORB_SLAM3
+
+#endif // TIMESTAMP_RING_BUFFER_HPP
@@ -10,11 +10,18 @@
 #include <thread>
 #include <atomic>
 #include <queue>
+#include <chrono>
+#include <functional>
 #include <opencv2/core/mat.hpp>
 
 namespace ORB_SLAM3
 {
 
+class ORBextractor;
+class GPUORBextractor;
+class RGAPyramid;
+class RGAPyramidBuilder;
+
 /**
  * @brief Integration class for zero-copy data flow between camera frames and TPU feature extraction
  * 
@@ -26,6 +33,26 @@ namespace ORB_SLAM3
 class TPUZeroCopyIntegration
 {
 public:
+    /**
+     * @brief Feature extractor a result came from
+     */
+    enum class ExtractorSource {
+        TPU,    ///< SuperPoint on an EdgeTPU or NPU core (float descriptors)
+        CPU,    ///< ORB on the CPU fallback (32-byte binary descriptors)
+        TRACKED ///< Keypoints of an earlier TPU detection propagated with KLT (descriptors carried over)
+    };
+    
+    /**
+     * @brief Motion prior for temporal tracking
+     * 
+     * Fills the homography mapping pixels of a camera's frame at
+     * from_timestamp to its frame at to_timestamp, e.g. K * R * K^-1 from the
+     * rotation predicted by VRMotionModel::PredictPose(). Returns false if no
+     * prediction is available.
+     */
+    typedef std::function<bool(int camera_id, double from_timestamp, double to_timestamp,
+                               cv::Matx33f& homography)> MotionPrior;
+    
     /**
      * @brief Result structure containing extracted features and metadata
      */
@@ -37,6 +64,20 @@ public:
         cv::Mat descriptors;                  ///< Feature descriptors
         std::vector<int> lapping_area;        ///< Lapping area information
         double processing_time_ms;            ///< Total processing time in milliseconds
+        LatencyStamps latency;                ///< Frame stamps, up to TPU_DONE
+        int device_index;                     ///< Index of the device (extractor) in the device pool (-1 for CPU)
+        ExtractorSource source;               ///< Extractor that produced the features
+        int descriptor_version = 0;           ///< Descriptor space of the TPU model rung (see TPUFeatureExtractor::GetDescriptorVersion())
+    };
+    
+    /**
+     * @brief Statistics of one device (EdgeTPU or NPU core) of the device pool
+     */
+    struct DeviceStats {
+        float processing_rate;                ///< Frames per second extracted on the device
+        float utilization;                    ///< Fraction of wall time the device was busy (0-1)
+        int queue_depth;                      ///< Frames (or frame sets) waiting for or running on the device
+        uint64_t frames;                      ///< Total frames extracted on the device
     };
 
     /**
@@ -53,6 +94,28 @@ public:
         int num_threads = 2,
         int queue_size = 4);
     
+    /**
+     * @brief Constructor for a pool of EdgeTPUs and NPU cores
+     * 
+     * Each extractor runs on its own EdgeTPU (see TPUFeatureExtractor::ListEdgeTPUDevices())
+     * or core of the RK3588 NPU (TPUFeatureExtractor::Backend::RKNN_NPU).
+     * Frames go to the device expected to finish them first, from its queue
+     * depth and measured time per frame, so a faster device takes more
+     * cameras. Ties go to the device camera_id maps to (camera_id % device
+     * count), so that a camera stays on one device while the load is
+     * balanced. Use at least as many processing threads as devices.
+     * 
+     * @param frame_provider Shared pointer to ZeroCopyFrameProvider
+     * @param feature_extractors One extractor per EdgeTPU or NPU core
+     * @param num_threads Number of processing threads (default: 2)
+     * @param queue_size Maximum size of the processing queue (default: 4)
+     */
+    TPUZeroCopyIntegration(
+        std::shared_ptr<ZeroCopyFrameProvider> frame_provider,
+        std::vector<std::shared_ptr<TPUFeatureExtractor>> feature_extractors,
+        int num_threads = 2,
+        int queue_size = 4);
+    
     /**
      * @brief Destructor
      */
@@ -92,6 +155,214 @@ public:
         float max_time_diff_ms = 10.0f,
         int timeout_ms = -1);
     
+    /**
+     * @brief Extract features from a synchronized frame set in one batch
+     * 
+     * Runs on the calling thread. All frames of the set go to the TPU in one
+     * batched call (see TPUFeatureExtractor::ExtractBatch) instead of one
+     * invocation per camera. The frames are not released; the caller still
+     * owns the set.
+     * 
+     * @param frame_set Frame set from ZeroCopyFrameProvider::GetSynchronizedFrames()
+     * @param results Output results, one per frame in the order of frame_set.frames
+     * @return True if features were extracted, false otherwise
+     */
+    bool ProcessFrameSet(
+        const ZeroCopyFrameProvider::FrameSet& frame_set,
+        std::vector<ExtractionResult>& results);
+    
+    /**
+     * @brief Acquire the next synchronized frame set, extract its features in one batch and release it
+     * 
+     * @param all_keypoints Output keypoints, one vector per camera
+     * @param all_descriptors Output descriptors, one matrix per camera
+     * @param timeout_ms Timeout for the frame set in milliseconds
+     * @return True if features were extracted, false otherwise
+     */
+    bool ProcessSynchronizedFrames(
+        std::vector<std::vector<cv::KeyPoint>>& all_keypoints,
+        std::vector<cv::Mat>& all_descriptors,
+        int timeout_ms = 100);
+    
+    /**
+     * @brief Enable or disable batched inference in the processing threads
+     * 
+     * When enabled, the acquisition thread queues whole synchronized frame
+     * sets, each set is extracted with one batched call, and its results are
+     * delivered together through GetNextSynchronizedResults(). The queue size
+     * then counts frame sets rather than frames.
+     * 
+     * @param enable Whether to enable batched inference
+     * @return True if the mode was set successfully, false if running
+     */
+    bool EnableBatchedInference(bool enable);
+    
+    /**
+     * @brief Check if batched inference is enabled
+     * 
+     * @return True if batched inference is enabled, false otherwise
+     */
+    bool IsBatchedInferenceEnabled() const;
+    
+    /**
+     * @brief Enable the CPU fallback extractor
+     * 
+     * A dedicated thread, pinned to cpu_cores if given (e.g. the idle A55
+     * cores of the RK3588), extracts ORB features from frames that would
+     * otherwise wait longer than the latency budget for a TPU, for example
+     * while the Coral module is thermally throttled. The TPU latency of a
+     * frame is estimated from the queued and in-flight frames and the recent
+     * time per frame of the devices. The fallback takes one frame at a time
+     * and frames it cannot take still go to the TPUs. Results are tagged with
+     * ExtractorSource::CPU so tracking can apply ORB matcher thresholds.
+     * Frame sets in batched mode always go to the TPUs. A GPUORBextractor
+     * runs the fallback on the Mali GPU and imports the camera DMA-BUFs.
+     * 
+     * @param cpu_extractor ORB extractor used only by the fallback thread
+     * @param latency_budget_ms Estimated TPU latency above which frames go to the CPU
+     * @param cpu_cores CPU cores to pin the fallback thread to (empty for no pinning)
+     * @return True if the fallback was enabled, false if running or the extractor is null
+     */
+    bool EnableCPUFallback(
+        std::shared_ptr<ORBextractor> cpu_extractor,
+        double latency_budget_ms,
+        const std::vector<int>& cpu_cores = std::vector<int>());
+    
+    /**
+     * @brief Disable the CPU fallback extractor
+     * 
+     * @return True if the fallback was disabled, false if running
+     */
+    bool DisableCPUFallback();
+    
+    /**
+     * @brief Check if the CPU fallback extractor is enabled
+     * 
+     * @return True if the CPU fallback is enabled, false otherwise
+     */
+    bool IsCPUFallbackEnabled() const;
+    
+    /**
+     * @brief Get the number of frames extracted by the CPU fallback
+     * 
+     * @return Number of frames
+     */
+    uint64_t GetCPUFallbackCount() const;
+    
+    /**
+     * @brief Build the image pyramids of the extractors on the RGA
+     * 
+     * The pyramid of each GREY frame with a DMA-BUF is started on the RGA
+     * when the frame is queued, so it is built while the frame waits, and
+     * handed to the TPU or CPU fallback extractor with the frame (see
+     * TPUFeatureExtractor::SetPyramid() and ORBextractor::SetPyramid()).
+     * The builder needs a buffer set per queued frame and per extractor
+     * (which keeps the pyramid of its last frame); without a free one the
+     * extractor builds the pyramid on the CPU. Frame sets in batched mode
+     * build no pyramid.
+     * 
+     * @param builder Builder with the levels and scale factor of the extractors
+     * @return True if enabled, false if running or the builder is null
+     */
+    bool EnableRGAPyramid(std::shared_ptr<RGAPyramidBuilder> builder);
+    
+    /**
+     * @brief Build the image pyramids on the CPU again
+     * 
+     * @return True if disabled, false if running
+     */
+    bool DisableRGAPyramid();
+    
+    /**
+     * @brief Enable temporal keypoint tracking between TPU detections
+     * 
+     * The TPU detects features on every detection_interval-th frame of a
+     * camera. On the frames in between, the keypoints of the previous frame
+     * are propagated with pyramidal Lucas-Kanade optical flow on the CPU,
+     * seeded by the motion prior if one is registered, and keep the
+     * descriptors of their detection. Results are tagged with
+     * ExtractorSource::TRACKED. A detection is forced early when fewer than
+     * min_survival of the detected keypoints survive. Frames of a camera are
+     * then processed one at a time; frame sets in batched mode always go to
+     * the TPUs.
+     * 
+     * @param detection_interval Frames per TPU detection (at least 2)
+     * @param min_survival Fraction of surviving keypoints below which the next frame is detected
+     * @return True if tracking was enabled, false if running or the interval is invalid
+     */
+    bool EnableTemporalTracking(int detection_interval, float min_survival = 0.7f);
+    
+    /**
+     * @brief Disable temporal keypoint tracking
+     * 
+     * @return True if tracking was disabled, false if running
+     */
+    bool DisableTemporalTracking();
+    
+    /**
+     * @brief Check if temporal keypoint tracking is enabled
+     * 
+     * @return True if temporal tracking is enabled, false otherwise
+     */
+    bool IsTemporalTrackingEnabled() const;
+    
+    /**
+     * @brief Register the motion prior that seeds temporal tracking
+     * 
+     * @param prior Function predicting the image motion between two frames of a camera
+     */
+    void RegisterMotionPrior(MotionPrior prior);
+    
+    /**
+     * @brief Get the number of frames whose keypoints were tracked instead of detected
+     * 
+     * @return Number of frames
+     */
+    uint64_t GetTrackedFrameCount() const;
+    
+    /**
+     * @brief Set the static mask of a camera
+     * 
+     * Zero pixels mark regions that never hold useful features, such as the
+     * headset shell or the user's face (see MultiCameraRig::CameraInfo::mask).
+     * The mask is combined with the dynamic mask and passed to the extractor,
+     * which does not send fully masked tiles to the TPU.
+     * 
+     * @param camera_id Camera identifier
+     * @param mask CV_8UC1 mask of the frame size (empty to clear)
+     * @return True if the mask was set, false for an invalid camera or mask
+     */
+    bool SetCameraMask(int camera_id, const cv::Mat& mask);
+    
+    /**
+     * @brief Set the dynamic mask of a camera
+     * 
+     * Meant for masks derived from the tracking state (e.g. regions without
+     * map points worth tracking). It applies from the next frame on and can
+     * be changed while running.
+     * 
+     * @param camera_id Camera identifier
+     * @param mask CV_8UC1 mask of the frame size (empty to clear)
+     * @return True if the mask was set, false for an invalid camera or mask
+     */
+    bool SetDynamicMask(int camera_id, const cv::Mat& mask);
+    
+    /**
+     * @brief Set the number of keypoints each extractor keeps per frame
+     * 
+     * Can be changed while running, it applies from the next frame on.
+     * 
+     * @param n_features_target Maximum number of keypoints (0 for no limit)
+     */
+    void SetFeatureTarget(int n_features_target);
+    
+    /**
+     * @brief Get the number of keypoints each extractor keeps per frame
+     * 
+     * @return Maximum number of keypoints of the first extractor (0 for no limit)
+     */
+    int GetFeatureTarget() const;
+    
     /**
      * @brief Register a callback for new extraction results
      * 
@@ -107,10 +378,27 @@ public:
      */
     float GetCurrentProcessingRate(int camera_id) const;
     
+    /**
+     * @brief Get the number of devices (EdgeTPUs and NPU cores) in the device pool
+     * 
+     * @return Number of devices
+     */
+    size_t GetDeviceCount() const;
+    
+    /**
+     * @brief Get the processing rate, utilization and queue depth of a device
+     * 
+     * Rate and utilization are averaged over windows of at least one second.
+     * 
+     * @param device_index Device index (0 to GetDeviceCount() - 1)
+     * @return Device statistics (all zero for an invalid index)
+     */
+    DeviceStats GetDeviceStats(int device_index) const;
+    
     /**
      * @brief Get the current queue size
      * 
-     * @return Current number of frames in the processing queue
+     * @return Current number of frames (frame sets in batched mode) in the processing queue
      */
     size_t GetQueueSize() const;
     
@@ -143,7 +431,24 @@ public:
 private:
     // Component references
     std::shared_ptr<ZeroCopyFrameProvider> frame_provider_;
-    std::shared_ptr<TPUFeatureExtractor> feature_extractor_;
+    
+    // EdgeTPU and NPU device pool, one extractor per device
+    struct TPUDevice {
+        std::shared_ptr<TPUFeatureExtractor> extractor;
+        std::mutex mutex;                     // The TFLite interpreter (RKNN context) is not thread-safe
+        std::atomic<int> queue_depth{0};      // Frames waiting for or running on the device
+        
+        mutable std::mutex stats_mutex;
+        uint64_t frames = 0;
+        uint64_t window_frames = 0;
+        double window_busy_ms = 0.0;
+        std::chrono::steady_clock::time_point window_start;
+        float processing_rate = 0.0f;
+        float utilization = 0.0f;
+        double frame_ms = 0.0;                // Moving average of the time per frame
+    };
+    std::vector<std::unique_ptr<TPUDevice>> devices_;
+    std::atomic<size_t> next_device_;         // Round-robin start for work without camera affinity
     
     // Thread management
     std::vector<std::thread> processing_threads_;
@@ -155,16 +460,60 @@ private:
     struct QueueItem {
         ZeroCopyFrameProvider::FrameMetadata metadata;
         cv::Mat image;  // Only used when direct DMA is not available
+        cv::Mat scaled_image;  // Model-sized plane, only used when direct DMA is not available
+        std::shared_ptr<RGAPyramid> pyramid;  // Started on the RGA when queued (may be null)
     };
     std::queue<QueueItem> frame_queue_;
+    std::queue<std::vector<QueueItem>> set_queue_;  // Frame sets, batched mode only
     std::mutex queue_mutex_;
     std::condition_variable queue_condition_;
     
     // Result queue
     std::queue<ExtractionResult> result_queue_;
+    std::queue<std::vector<ExtractionResult>> set_result_queue_;  // Batched mode only
     std::mutex result_mutex_;
     std::condition_variable result_condition_;
     
+    // CPU fallback, at most one frame in flight, guarded by queue_mutex_
+    std::shared_ptr<ORBextractor> cpu_extractor_;
+    GPUORBextractor* gpu_extractor_;  // cpu_extractor_ if it runs on the GPU
+    
+    // Camera buffer pool of the frame provider, imported by every device at Start()
+    std::shared_ptr<DmaBufferPool> buffer_pool_;
+    double latency_budget_ms_;
+    std::vector<int> cpu_cores_;
+    std::queue<QueueItem> cpu_queue_;
+    std::condition_variable cpu_condition_;
+    bool cpu_busy_;
+    std::atomic<uint64_t> cpu_frames_;
+    
+    // RGA pyramid builder, started from the acquisition thread
+    std::shared_ptr<RGAPyramidBuilder> rga_pyramid_;
+    
+    // Temporal tracking state of a camera
+    struct TemporalTrack {
+        std::mutex mutex;                     // Frames of a camera are tracked in order
+        std::vector<cv::Mat> pyramid;         // Optical flow pyramid of the last frame
+        double timestamp = 0.0;               // Timestamp of the last frame
+        std::vector<cv::KeyPoint> keypoints;  // Keypoints in the last frame
+        cv::Mat descriptors;                  // Descriptors from the last detection
+        int descriptor_version = 0;           // Descriptor version of the last detection
+        size_t detected = 0;                  // Keypoints at the last detection
+        int frames_since_detection = 0;
+        bool force_detection = true;
+    };
+    std::vector<std::unique_ptr<TemporalTrack>> temporal_tracks_;
+    int detection_interval_;                  // 1 when temporal tracking is disabled
+    float min_track_survival_;
+    MotionPrior motion_prior_;
+    std::atomic<uint64_t> tracked_frames_;
+    
+    // Masks per camera; frame_masks_ combines the static and dynamic ones
+    std::vector<cv::Mat> static_masks_;
+    std::vector<cv::Mat> dynamic_masks_;
+    std::vector<cv::Mat> frame_masks_;
+    mutable std::mutex mask_mutex_;
+    
     // Statistics
     std::vector<std::atomic<float>> processing_rates_;
     std::vector<std::atomic<uint64_t>> frame_counters_;
@@ -179,6 +528,7 @@ private:
     
     // Configuration
     bool direct_dma_enabled_;
+    bool batched_enabled_;
     
     /**
      * @brief Frame acquisition thread function
@@ -190,24 +540,164 @@ private:
      */
     void ProcessingThreadFunc();
     
+    /**
+     * @brief CPU fallback thread function
+     */
+    void CPUFallbackThreadFunc();
+    
+    /**
+     * @brief Extract (or track) the features of one frame into a result
+     * 
+     * @param metadata Frame metadata
+     * @param image OpenCV Mat containing the frame data
+     * @param scaled_image Model-sized copy of the frame (empty to resize on the CPU)
+     * @param pyramid Image pyramid started on the RGA (null to build it on the CPU)
+     * @param result Result with the frame fields set; receives the features
+     */
+    void ExtractFrame(
+        const ZeroCopyFrameProvider::FrameMetadata& metadata,
+        const cv::Mat& image,
+        const cv::Mat& scaled_image,
+        const std::shared_ptr<RGAPyramid>& pyramid,
+        ExtractionResult& result);
+    
+    /**
+     * @brief Propagate the keypoints of a camera's last frame to a new frame
+     * 
+     * The caller must hold the track mutex.
+     * 
+     * @param track Temporal tracking state of the camera
+     * @param metadata Frame metadata
+     * @param gray 8-bit grayscale frame
+     * @param mask Combined mask of the camera (may be empty)
+     * @param result Receives the tracked keypoints and their descriptors
+     * @return True if the frame was tracked, false if it needs a detection
+     */
+    bool TrackFrame(
+        TemporalTrack& track,
+        const ZeroCopyFrameProvider::FrameMetadata& metadata,
+        const cv::Mat& gray,
+        const cv::Mat& mask,
+        ExtractionResult& result);
+    
+    /**
+     * @brief Process a frame with the CPU fallback extractor
+     * 
+     * @param metadata Frame metadata
+     * @param image OpenCV Mat containing the frame data (empty to map the frame)
+     * @param pyramid Image pyramid started on the RGA (null to build it on the CPU)
+     * @return Extraction result
+     */
+    ExtractionResult ProcessFrameCPU(
+        const ZeroCopyFrameProvider::FrameMetadata& metadata,
+        const cv::Mat& image,
+        const std::shared_ptr<RGAPyramid>& pyramid);
+    
+    /**
+     * @brief Release a processed frame and deliver its result
+     * 
+     * @param metadata Frame metadata
+     * @param result Extraction result
+     */
+    void PublishResult(
+        const ZeroCopyFrameProvider::FrameMetadata& metadata,
+        const ExtractionResult& result);
+    
+    /**
+     * @brief Set a static or dynamic mask and update the combined mask
+     * 
+     * @param camera_id Camera identifier
+     * @param mask CV_8UC1 mask (empty to clear)
+     * @param masks Static or dynamic masks to store it in
+     * @return True if the mask was set, false for an invalid camera or mask
+     */
+    bool SetMask(int camera_id, const cv::Mat& mask, std::vector<cv::Mat>& masks);
+    
+    /**
+     * @brief Get the combined mask of a camera
+     * 
+     * @param camera_id Camera identifier
+     * @return Mask (empty if the camera has none)
+     */
+    cv::Mat GetFrameMask(int camera_id) const;
+    
+    /**
+     * @brief Estimate the latency of a frame queued now for the TPUs
+     * 
+     * The caller must hold queue_mutex_.
+     * 
+     * @return Estimated latency in milliseconds (0 before any frame was extracted)
+     */
+    double EstimateTPULatencyMs() const;
+    
     /**
      * @brief Process a frame using direct DMA buffer access
      * 
      * @param metadata Frame metadata
+     * @param pyramid Image pyramid started on the RGA (null to build it on the CPU)
      * @return Extraction result
      */
-    ExtractionResult ProcessFrameDMA(const ZeroCopyFrameProvider::FrameMetadata& metadata);
+    ExtractionResult ProcessFrameDMA(
+        const ZeroCopyFrameProvider::FrameMetadata& metadata,
+        const std::shared_ptr<RGAPyramid>& pyramid);
     
     /**
      * @brief Process a frame using OpenCV Mat
      * 
      * @param metadata Frame metadata
      * @param image OpenCV Mat containing the frame data
+     * @param scaled_image Model-sized copy of the frame (empty to resize on the CPU)
+     * @param pyramid Image pyramid started on the RGA (null to build it on the CPU)
      * @return Extraction result
      */
     ExtractionResult ProcessFrameMat(
         const ZeroCopyFrameProvider::FrameMetadata& metadata,
-        const cv::Mat& image);
+        const cv::Mat& image,
+        const cv::Mat& scaled_image,
+        const std::shared_ptr<RGAPyramid>& pyramid);
+    
+    /**
+     * @brief Extract features from the frames of one frame set in one batched call
+     * 
+     * @param items Queued frames of the set
+     * @return Extraction results, one per item
+     */
+    std::vector<ExtractionResult> ProcessFrameBatch(const std::vector<QueueItem>& items);
+    
+    /**
+     * @brief Pick the device expected to finish new work first and count the work against it
+     * 
+     * The expected time is (queue depth + 1) times the device's time per
+     * frame; devices not measured yet count with the mean of the others.
+     * 
+     * @param camera_id Camera whose device is preferred on ties (-1 for round-robin)
+     * @return Device index
+     */
+    int AcquireDevice(int camera_id);
+    
+    /**
+     * @brief Finish work on a device and update its statistics
+     * 
+     * @param device_index Device index from AcquireDevice()
+     * @param busy_ms Time the device spent on the work in milliseconds
+     * @param frames Number of frames extracted
+     */
+    void ReleaseDevice(int device_index, double busy_ms, int frames);
+    
+    /**
+     * @brief Import the camera buffer pool into the NPUs, the GPU and the RGA
+     * 
+     * Done once before the capture starts, so no frame pays for an import.
+     */
+    void ImportBufferPool();
+    
+    /**
+     * @brief Size of the DMA-BUF a frame lies in, as it was imported
+     * 
+     * @param metadata Frame metadata
+     * @return The pool buffer size for a pool buffer, the frame size otherwise
+     */
+    size_t GetDmaBufferSize(const ZeroCopyFrameProvider::FrameMetadata& metadata) const;
     
     /**
      * @brief Set an error message
@@ -1,12 +1,13 @@
 #ifndef VISUAL_INERTIAL_FUSION_HPP
 #define VISUAL_INERTIAL_FUSION_HPP
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include <atomic>
-#include <queue>
 #include <condition_variable>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
@@ -14,6 +15,7 @@
 
 #include "ImuTypes.h"
 #include "bno085_interface.hpp"
+#include "fixed_lag_smoother.hpp"
 #include "multi_camera_tracking.hpp"
 #include "vr_motion_model.hpp"
 
@@ -51,6 +53,11 @@ public:
         float imu_frequency = 200.0f;             ///< IMU data frequency in Hz
         float visual_frequency = 90.0f;           ///< Visual tracking frequency in Hz
         float gravity_magnitude = 9.81f;          ///< Gravity magnitude in m/s^2
+        float bias_reintegration_threshold = 0.02f; ///< Bias change above which preintegration is redone instead of first-order corrected
+        
+        // Processing thread wakeups
+        int imu_wakeup_samples = 4;               ///< IMU samples signalled through ProcessIMUMeasurements() that wake the thread
+        float fallback_wakeup_ms = 50.0f;         ///< Longest time the thread sleeps without an event
         
         // Initialization settings
         float init_time_threshold = 0.5f;         ///< Minimum time for initialization in seconds
@@ -62,6 +69,7 @@ public:
         int fixed_lag_size = 5;                   ///< Fixed-lag smoother size
         float huber_threshold = 0.1f;             ///< Huber loss threshold
         int max_iterations = 10;                  ///< Maximum iterations for optimization
+        bool use_fixed_lag_smoother = false;      ///< Refine each motion update in a fixed_lag_size-frame sliding window
         
         // VR-specific settings
         float prediction_horizon_ms = 16.0f;      ///< Prediction horizon for VR in milliseconds
@@ -71,7 +79,52 @@ public:
         // Failure recovery settings
         float relocalization_timeout = 1.0f;      ///< Timeout for relocalization in seconds
         bool use_imu_only_fallback = true;        ///< Whether to fall back to IMU-only tracking
-        float max_tracking_loss_time = 3.0f;      ///< Maximum time to maintain map during tracking loss
+        float max_tracking_loss_time = 3.0f;      ///< Maximum time to maintain map during tracking loss, and to dead-reckon on the IMU alone
+        float visual_loss_timeout = 0.1f;         ///< Time without a good visual pose after which tracking is IMU-only
+        
+        // Dead-reckoning error model, standard deviations at the loss of vision
+        float dead_reckoning_gyro_sigma = 0.01f;      ///< Residual gyroscope bias in rad/s
+        float dead_reckoning_acc_sigma = 0.05f;       ///< Residual accelerometer bias in m/s^2
+        float dead_reckoning_velocity_sigma = 0.05f;  ///< Velocity error in m/s
+        
+        // State checkpoints for resuming after a restart
+        std::string checkpoint_path;              ///< Checkpoint the processing thread keeps up to date while tracking (empty to disable)
+        float checkpoint_interval_s = 1.0f;       ///< Time between periodic checkpoints
+        float checkpoint_max_age_s = 2.0f;        ///< Oldest checkpoint LoadState() resumes tracking from, older ones only restore bias and gravity
+    };
+    
+    /// Checkpoint file identification
+    static constexpr uint32_t CHECKPOINT_MAGIC = 0x50434956;  ///< "VICP"
+    static constexpr uint32_t CHECKPOINT_VERSION = 1;
+    
+    /**
+     * @brief Fixed-layout state checkpoint, the file holds exactly one
+     * 
+     * Written and read as is, nothing is parsed. Files of another version or
+     * size, or with a bad checksum, are rejected.
+     */
+    struct Checkpoint {
+        uint32_t magic;                       ///< CHECKPOINT_MAGIC
+        uint32_t version;                     ///< CHECKPOINT_VERSION
+        uint32_t size;                        ///< sizeof(Checkpoint)
+        uint32_t checksum;                    ///< FNV-1a of the checkpoint with this field zero
+        double save_time;                     ///< CLOCK_MONOTONIC time of the snapshot in seconds
+        
+        int32_t state;                        ///< State
+        uint8_t gravity_initialized;
+        uint8_t reserved[3];
+        float rotation[4];                    ///< Body orientation (x, y, z, w)
+        float translation[3];                 ///< Body position
+        float velocity[3];
+        float acceleration[3];
+        float angular_velocity[3];
+        float gravity_direction[3];
+        float bias[6];                        ///< Accelerometer then gyroscope bias
+        double last_imu_timestamp;
+        float last_imu_acceleration[3];
+        float last_imu_angular_velocity[3];
+        
+        VRMotionModel::FilterState motion_model;  ///< Filter, pose history and recent IMU window
     };
     
     /**
@@ -83,6 +136,7 @@ public:
         TRACKING_NOMINAL,   ///< Normal tracking with visual and inertial data
         TRACKING_RAPID,     ///< Tracking during rapid motion (prioritizes IMU)
         TRACKING_VISUAL,    ///< Tracking with primarily visual data (static scenes)
+        TRACKING_IMU_ONLY,  ///< Dead reckoning on the IMU while vision is lost, for up to max_tracking_loss_time
         LOST,               ///< Tracking lost
         RELOCALIZATION      ///< Attempting relocalization
     };
@@ -161,6 +215,19 @@ public:
      */
     Sophus::SE3<float> GetPredictedPose(double prediction_time_ms) const;
     
+    /**
+     * @brief Get the pose dead-reckoned on the IMU since vision was lost
+     * 
+     * The covariance grows with the time without vision from the error model of the
+     * Config. It is that of the camera pose Tcw, [translation, rotation] with the rotation
+     * perturbed on the right, as Tracking::SetRelocalizationPrior takes it.
+     * 
+     * @param Twb Body pose in the world frame
+     * @param covariance Covariance of the camera pose
+     * @return True in State::TRACKING_IMU_ONLY, false otherwise
+     */
+    bool GetDeadReckonedPose(Sophus::SE3<float>& Twb, Eigen::Matrix<float, 6, 6>& covariance) const;
+    
     /**
      * @brief Get the current velocity estimate
      * @return Current velocity as Eigen::Vector3f
@@ -198,7 +265,12 @@ public:
     PerformanceMetrics GetPerformanceMetrics() const;
     
     /**
-     * @brief Process a batch of IMU measurements
+     * @brief Signal new IMU measurements
+     * 
+     * The measurements are read from the IMU interface's measurement ring,
+     * this only wakes the processing thread for them, once Config::imu_wakeup_samples
+     * have been signalled since it last ran.
+     * 
      * @param measurements Vector of IMU measurements
      * @return True if processing was successful, false otherwise
      */
@@ -206,6 +278,10 @@ public:
     
     /**
      * @brief Process visual tracking results
+     * 
+     * Wakes the processing thread right away. Called for every frame set of the
+     * tracking from Start() to Stop().
+     * 
      * @param pose Tracked camera pose
      * @param timestamp Timestamp of the pose
      * @param keypoints Vector of keypoints from all cameras
@@ -255,14 +331,23 @@ public:
     float GetTrackingQuality() const;
     
     /**
-     * @brief Save the current state to a file
+     * @brief Save the current state to a checkpoint file
+     * 
+     * The checkpoint is written to a temporary file that is renamed over the
+     * old one, so a reader finds either checkpoint complete. It is not synced
+     * to disk: it survives a restart of the process, not a power loss.
      * @param filename Filename to save to
      * @return True if successful, false otherwise
      */
     bool SaveState(const std::string& filename) const;
     
     /**
-     * @brief Load state from a file
+     * @brief Resume from a checkpoint file
+     * 
+     * A checkpoint up to Config::checkpoint_max_age_s old resumes tracking
+     * with the pose, velocity and motion model it was taken with. An older
+     * one, e.g. from before a reboot, only restores the IMU bias and gravity
+     * so initialization skips the IMU. Call before Start().
      * @param filename Filename to load from
      * @return True if successful, false otherwise
      */
@@ -276,13 +361,14 @@ private:
     std::shared_ptr<BNO085Interface> mIMUInterface;
     std::shared_ptr<MultiCameraTracking> mTracking;
     std::shared_ptr<VRMotionModel> mMotionModel;
+    mutable std::mutex mMotionModelMutex;  // The motion model is updated by the processing thread and read by others
     
     // State variables
     std::atomic<State> mState;
     std::mutex mStateMutex;
     
     // Pose and motion state
-    std::mutex mPoseMutex;
+    mutable std::mutex mPoseMutex;
     Sophus::SE3<float> mCurrentPose;
     Eigen::Vector3f mCurrentVelocity;
     Eigen::Vector3f mCurrentAcceleration;
@@ -290,24 +376,41 @@ private:
     Eigen::Vector3f mGravityDirection;
     
     // IMU state
-    std::mutex mIMUMutex;
+    mutable std::mutex mIMUMutex;
     IMU::Bias mCurrentBias;
-    IMU::Preintegrated* mpImuPreintegrated;
-    std::queue<IMU::Point> mIMUQueue;
+    IMU::Preintegrated* mpImuPreintegrated;          // Interval since the last motion update, integrated as samples arrive
+    IMU::Preintegrated* mpImuPreintegratedPrevious;  // Interval closed by the last motion update, swapped with the current one
+    uint64_t mIMUReadSequence;  // Next sample of the IMU interface's ring to integrate
     double mLastIMUTimestamp;
+    bool mIMUIntegrationGap;    // Next sample starts the interval (no dt to the previous one)
+    Eigen::Vector3f mLastIMUAcceleration;
+    Eigen::Vector3f mLastIMUAngularVelocity;
     
     // Visual tracking state
     std::mutex mVisualMutex;
     double mLastVisualTimestamp;
+    Sophus::SE3<float> mLastVisualPose;
+    bool mHasNewVisualPose;     // mLastVisualPose not yet added to the smoother
     bool mVisualTrackingGood;
     int mTrackingLossCount;
     
+    // Dead reckoning, under mPoseMutex
+    double mDeadReckoningStartTime;  // IMU time vision was lost at, 0 with vision
+    double mDeadReckoningTime;       // Time dead-reckoned so far
+    
+    // Sliding-window smoother backend
+    std::mutex mSmootherMutex;
+    FixedLagSmoother mSmoother;
+    
     // Initialization state
     std::mutex mInitMutex;
     float mInitProgress;
     double mInitStartTime;
     bool mGravityInitialized;
     
+    // Periodic checkpoints, processing thread only
+    double mLastCheckpointTime;
+    
     // Performance monitoring
     std::mutex mMetricsMutex;
     PerformanceMetrics mMetrics;
@@ -317,14 +420,26 @@ private:
     std::atomic<bool> mRunning;
     std::condition_variable mProcessingCondition;
     std::mutex mProcessingMutex;
+    bool mVisualEventPending;   // Visual result not processed yet, under mProcessingMutex
+    int mPendingIMUSamples;     // IMU samples signalled since the thread last ran, under mProcessingMutex
     
     // Private methods
     
     /**
      * @brief Main processing thread function
+     * 
+     * Runs on a visual result, on a batch of IMU samples, or after
+     * Config::fallback_wakeup_ms without either.
      */
     void ProcessingThreadFunction();
     
+    /**
+     * @brief Hand a frame set result of the tracking to ProcessVisualTracking()
+     */
+    void OnTrackedFrame(const Sophus::SE3<float>& Tcw, double timestamp,
+                        const std::vector<std::vector<cv::KeyPoint>>& keypoints,
+                        const std::vector<std::vector<MapPoint*>>& map_points);
+    
     /**
      * @brief Initialize the system with visual and inertial data
      * @return True if initialization was successful, false otherwise
@@ -356,6 +471,14 @@ private:
      */
     bool UpdateMotionState();
     
+    /**
+     * @brief Add a frame to the sliding-window smoother and take over its estimate
+     * @param timestamp Timestamp of the frame
+     * @param imu_delta Preintegration since the previous frame
+     * @return True if the fused state was refined, false otherwise
+     */
+    bool UpdateSmoother(double timestamp, const FixedLagSmoother::ImuDelta& imu_delta);
+    
     /**
      * @brief Attempt relocalization after tracking loss
      * @return True if relocalization was successful, false otherwise
@@ -369,12 +492,60 @@ private:
     bool UpdateMotionModel();
     
     /**
-     * @brief Preintegrate IMU measurements
-     * @param start_time Start time for preintegration
-     * @param end_time End time for preintegration
-     * @return True if successful, false otherwise
+     * @brief Integrate the IMU measurements received since the last call into the current interval
+     * 
+     * Each measurement is integrated exactly once. Called on every wakeup of the processing thread.
      */
-    bool PreintegrateIMU(double start_time, double end_time);
+    void IntegrateNewIMUMeasurements();
+    
+    /**
+     * @brief Close the current preintegration interval and start the next one (mIMUMutex held)
+     * 
+     * Swaps the current and previous intervals instead of allocating a new one.
+     */
+    void SplitPreintegration();
+    
+    /**
+     * @brief Restart both preintegration intervals with a bias (mIMUMutex held)
+     * @param bias IMU bias the new intervals integrate with
+     */
+    void ResetPreintegration(const IMU::Bias& bias);
+    
+    /**
+     * @brief Apply a new bias estimate to the current interval (mIMUMutex held)
+     * 
+     * Small changes are corrected to first order through the bias Jacobians, changes
+     * above Config::bias_reintegration_threshold reintegrate the interval.
+     * @param bias New IMU bias estimate
+     */
+    void UpdatePreintegrationBias(const IMU::Bias& bias);
+    
+    /**
+     * @brief Check whether vision is lost
+     * @return True if no good visual pose arrived for Config::visual_loss_timeout
+     */
+    bool IsVisualLost();
+    
+    /**
+     * @brief Advance dead reckoning by the last motion update
+     * 
+     * Starts the dead-reckoning window on the first call after vision is lost, and hands
+     * the pose to tracking as a relocalization prior.
+     * @return False once the window exceeds Config::max_tracking_loss_time
+     */
+    bool UpdateDeadReckoning();
+    
+    /**
+     * @brief End dead reckoning, vision is back or tracking is lost
+     */
+    void StopDeadReckoning();
+    
+    /**
+     * @brief Covariance of the camera pose dead-reckoned for a time (mPoseMutex held)
+     * @param time Time since vision was lost in seconds
+     * @return Covariance in the convention of GetDeadReckonedPose
+     */
+    Eigen::Matrix<float, 6, 6> ComputeDeadReckoningCovariance(double time) const;
     
     /**
      * @brief Detect and handle rapid motion
@@ -387,6 +558,11 @@ private:
      */
     void UpdateTrackingState();
     
+    /**
+     * @brief Save a checkpoint to Config::checkpoint_path if one is due
+     */
+    void UpdateCheckpoint();
+    
     /**
      * @brief Update performance metrics
      * @param fusion_time Fusion processing time in milliseconds
@@ -0,0 +1,151 @@
+#ifndef VOICE_BEAMFORMER_HPP
+#define VOICE_BEAMFORMER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shared_pose_export.hpp"
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Frequency-domain MVDR beamformer over the headset microphone array
+ *
+ * The channels of orangepi_vr_mic_array are split into 50 % overlapping
+ * frames with a square-root Hann window. Per frequency bin the spatial
+ * covariance R is updated every hop; every update_hops hops the weights are
+ * solved as w = R^-1 d / (d^H R^-1 d) with diagonal loading, where d is the
+ * near-field steering vector to the target. The output is overlap-added
+ * with the same window, so the latency is one FFT frame (5.3 ms with the
+ * default 256 points at 48 kHz) and each call costs one forward FFT per
+ * microphone and one inverse FFT.
+ *
+ * The target is either head-locked (the wearer's mouth, the default) or a
+ * world position, tracked through the pose region of VRSLAMSystem. Positions
+ * are in the camera frame (x right, y down, z forward), metres.
+ *
+ * Not thread-safe. Meant to run on the capture thread, pinned to an A55 core
+ * so the A76 cores stay with tracking.
+ */
+class VoiceBeamformer
+{
+public:
+    struct Options {
+        int sample_rate = 48000;
+        int fft_size = 256;                         ///< Power of two, hop is half of it
+        int update_hops = 4;                        ///< Hops between weight solves
+        float covariance_time_ms = 200.0f;          ///< Time constant of the covariance average
+        float diagonal_loading = 0.01f;             ///< Loading relative to the mean channel power
+        std::vector<float> mic_positions = {        ///< x, y, z per microphone, head frame
+            0.0f, 0.0f, 0.04f,                      // Front
+            -0.04f, 0.0f, 0.0f,                     // Left
+            0.0f, 0.0f, -0.04f,                     // Back
+            0.04f, 0.0f, 0.0f};                     // Right
+        std::string pose_region = "/vr_slam_pose";  ///< Pose for world-locked targets (empty to set it by hand)
+    };
+
+    /**
+     * @brief Constructor
+     * @param options Frame size, array geometry and pose region
+     */
+    explicit VoiceBeamformer(const Options& options);
+
+    /**
+     * @brief Destructor
+     */
+    ~VoiceBeamformer();
+
+    VoiceBeamformer(const VoiceBeamformer&) = delete;
+    VoiceBeamformer& operator=(const VoiceBeamformer&) = delete;
+
+    /**
+     * @brief Check if the options were accepted
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Get the number of samples per channel Process() takes
+     */
+    int GetHopSize() const;
+
+    /**
+     * @brief Get the number of microphones
+     */
+    int GetChannelCount() const;
+
+    /**
+     * @brief Steer at a target
+     * @param position Target position (m)
+     * @param world_locked True if position is in the world frame and follows
+     *                     the head pose, false if it is in the head frame
+     */
+    void SetTarget(const float position[3], bool world_locked);
+
+    /**
+     * @brief Set the head pose, used when no pose region is followed
+     * @param rotation Tcw rotation quaternion (x, y, z, w)
+     * @param translation Tcw translation
+     */
+    void SetHeadPose(const float rotation[4], const float translation[3]);
+
+    /**
+     * @brief Get the target in the head frame the current weights steer at
+     */
+    void GetTargetInHead(float position[3]) const;
+
+    /**
+     * @brief Beamform one hop
+     * @param mics One pointer per microphone, hop size samples each
+     * @param out Output, hop size samples
+     * @return False if the beamformer is not valid
+     */
+    bool Process(const float* const* mics, float* out);
+
+private:
+    void updateHeadPose();
+    void updateWeights();
+    void fft(float* re, float* im, bool inverse_transform) const;
+
+    bool mValid;
+    int mChannels;
+    int mFftSize;
+    int mHop;
+    int mBins;
+    int mPairs;
+    int mUpdateHops;
+    int mHopsSinceUpdate;
+    float mSampleRate;
+    float mForget;
+    float mLoading;
+
+    std::vector<float> mMicPositions;
+    std::vector<float> mWindow;
+    std::vector<int> mBitReverse;
+    std::vector<float> mTwiddleCos;
+    std::vector<float> mTwiddleSin;
+
+    std::vector<float> mInput;          ///< Channel x FFT size, newest samples last
+    std::vector<float> mSpecRe;         ///< Channel x bin
+    std::vector<float> mSpecIm;
+    std::vector<float> mCovRe;          ///< Upper-triangle pair x bin
+    std::vector<float> mCovIm;
+    std::vector<float> mWeightRe;       ///< Channel x bin
+    std::vector<float> mWeightIm;
+    std::vector<float> mFrameRe;        ///< FFT scratch
+    std::vector<float> mFrameIm;
+    std::vector<float> mOverlap;        ///< Overlap-add accumulator, FFT size
+
+    float mTarget[3];
+    bool mWorldLocked;
+    float mTargetInHead[3];
+    float mRotation[4];
+    float mTranslation[3];
+    std::unique_ptr<SharedPoseReader> mPoseReader;
+    int mPoseRetry;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // VOICE_BEAMFORMER_HPP
@@ -1,15 +1,24 @@
 #ifndef VR_MOTION_MODEL_HPP
 #define VR_MOTION_MODEL_HPP
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-#include <deque>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <sophus/se3.hpp>
 
+#include "latency_trace.hpp"
+
 namespace ORB_SLAM3
 {
 
+namespace IMU
+{
+class Bias;
+}
+
 /**
  * @brief VR-specific motion model for headset tracking
  * 
@@ -19,6 +28,8 @@ namespace ORB_SLAM3
 class VRMotionModel
 {
 public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
     /**
      * @brief Headset motion state enumeration
      */
@@ -63,6 +74,112 @@ public:
         float fast_movement_ratio;    ///< Ratio of time spent in fast movement
     };
     
+    /// Horizon buckets of the prediction error statistics, PREDICTION_ERROR_BUCKET_MS wide, the last open-ended
+    static constexpr int PREDICTION_ERROR_BUCKETS = 6;
+    static constexpr double PREDICTION_ERROR_BUCKET_MS = 10.0;
+    
+    /**
+     * @brief Error of the predictions of a horizon bucket
+     * 
+     * Predictions are scored against the pose later observed at their target
+     * time, interpolated between the tracked poses around it. Means are
+     * exponentially weighted, so they follow the user and the settings.
+     */
+    struct PredictionErrorStats {
+        uint64_t count;                ///< Predictions scored
+        double position_error_m;       ///< Mean translation error
+        double rotation_error_rad;     ///< Mean rotation error
+        double perceived_error_rad;    ///< Mean perceived error, rotation plus translation seen at AutoTuneConfig::perceived_distance_m
+        double hold_error_rad;         ///< Mean perceived error of showing the newest tracked pose unpredicted
+        double lag_ms;                 ///< Mean timing error along the motion, positive if the predictions fall behind
+        uint64_t lag_count;            ///< Predictions with enough motion to measure the timing error
+    };
+    
+    /**
+     * @brief Online tuning of the prediction from its scored errors
+     * 
+     * Every adjust_interval scored predictions of the current interaction mode,
+     * the latency compensation is moved to cancel the mean timing error, the
+     * velocity smoothing to the candidate whose constant-velocity predictions
+     * had the lowest perceived error, and the prediction horizon, which then
+     * caps the extrapolation, to where the predictions stop beating the
+     * unpredicted pose. Tuned values are kept per interaction mode.
+     */
+    struct AutoTuneConfig {
+        bool enabled = false;                  ///< Whether to tune at all
+        bool tune_horizon = true;              ///< Tune the prediction horizon
+        bool tune_latency_compensation = true; ///< Tune the latency compensation
+        bool tune_velocity_smoothing = true;   ///< Tune the velocity smoothing
+        int adjust_interval = 90;              ///< Scored predictions between adjustments
+        int min_bucket_count = 30;             ///< Scored predictions a bucket needs to steer the horizon
+        double min_horizon_ms = 5.0;           ///< Shortest tuned horizon
+        double min_latency_compensation_ms = -10.0; ///< Latency compensation range
+        double max_latency_compensation_ms = 30.0;
+        double latency_gain = 0.5;             ///< Fraction of the mean timing error corrected per adjustment
+        float smoothing_step = 0.1f;           ///< Offset of the velocity smoothing candidates around the current one
+        float perceived_distance_m = 1.0f;     ///< Distance the translation error is seen at
+    };
+    
+    /// Poses and IMU samples of the history kept in a FilterState
+    static constexpr int FILTER_STATE_POSES = 8;
+    static constexpr int FILTER_STATE_IMU_SAMPLES = 32;
+    
+    /**
+     * @brief Fixed-layout snapshot of the filter and the recent history
+     *
+     * Plain data without pointers, so it can be written and read back as is,
+     * e.g. in a checkpoint. Histories are newest first; rotations are
+     * quaternions (x, y, z, w).
+     */
+    struct FilterState {
+        struct Pose {
+            float rotation[4];
+            float translation[3];
+            float reserved;
+            double timestamp;
+        };
+        struct IMUSample {
+            float gyro[3];
+            float accel[3];
+            double timestamp;
+        };
+        
+        // Kalman filter, error state [dp, dtheta, dv, dba, dbg]
+        float kalman_rotation[4];           ///< Nominal body orientation in the world frame
+        float kalman_translation[3];        ///< Nominal body position in the world frame
+        float kalman_velocity[3];           ///< Velocity in the world frame
+        float kalman_accel_bias[3];
+        float kalman_gyro_bias[3];
+        float kalman_covariance[15 * 15];   ///< Error state covariance, column-major
+        float kalman_gyro[3];               ///< Latest IMU sample
+        float kalman_accel[3];
+        double kalman_last_update_time;
+        uint8_t kalman_initialized;
+        uint8_t kalman_has_imu;
+        
+        // Motion derivatives of the pose history
+        uint8_t headset_state;              ///< HeadsetState
+        uint8_t interaction_mode;           ///< InteractionMode
+        uint8_t has_raw_velocity;
+        uint8_t has_raw_acceleration;
+        uint8_t reserved[2];
+        float linear_velocity[3];
+        float angular_velocity[3];
+        float linear_acceleration[3];
+        float angular_acceleration[3];
+        float linear_jerk[3];
+        float angular_jerk[3];
+        float raw_linear_velocity[3];
+        float raw_angular_velocity[3];
+        float raw_linear_acceleration[3];
+        float raw_angular_acceleration[3];
+        
+        uint32_t pose_count;                ///< Valid entries of poses
+        uint32_t imu_count;                 ///< Valid entries of imu
+        Pose poses[FILTER_STATE_POSES];
+        IMUSample imu[FILTER_STATE_IMU_SAMPLES];
+    };
+    
     /**
      * @brief Default constructor
      */
@@ -99,8 +216,10 @@ public:
      * 
      * @param pose New pose
      * @param timestamp Timestamp in seconds
+     * @param latency Latency stamps of the frame the pose was tracked from,
+     *                stamped POSE_PUBLISHED once the pose is in the model (optional)
      */
-    void AddPose(const Sophus::SE3f& pose, double timestamp);
+    void AddPose(const Sophus::SE3f& pose, double timestamp, LatencyStamps* latency = nullptr);
     
     /**
      * @brief Add IMU measurement
@@ -120,13 +239,60 @@ public:
     Sophus::SE3f PredictPose(double prediction_time_ms);
     
     /**
-     * @brief Predict pose using Kalman filter
+     * @brief Predict pose using the error-state Kalman filter
+     * 
+     * Extrapolates the filter state with the latest IMU sample (constant
+     * velocity without IMU data), without changing the filter.
      * 
      * @param prediction_time_ms Time in the future to predict (milliseconds)
      * @return Predicted pose
      */
     Sophus::SE3f PredictPoseKalman(double prediction_time_ms);
     
+    /**
+     * @brief Predict poses at a set of absolute times
+     * 
+     * For the display pipeline, e.g. the mid-scanout time of each eye and each
+     * late-warp slice of the next vsync. All poses are predicted from the same
+     * motion state, so they are consistent with each other.
+     * 
+     * @param timestamps Target times in seconds, on the clock of AddPose() and AddIMU()
+     * @param use_kalman Predict with the Kalman filter instead of PredictPose()
+     * @return Predicted poses, one per target time
+     */
+    std::vector<Sophus::SE3f> PredictPosesAt(const std::vector<double>& timestamps, bool use_kalman = false);
+    
+    /**
+     * @brief Predict the pose at an absolute time with its uncertainty
+     * 
+     * Extrapolates the Kalman filter state as PredictPoseKalman() and propagates
+     * its covariance up to the timestamp, without changing the filter. For
+     * Tracking::SetPosePrediction(), whose error convention it follows.
+     * 
+     * @param timestamp Target time in seconds, on the clock of AddPose() and AddIMU()
+     * @param pose Predicted pose
+     * @param covariance Covariance of the pose error [dp, dtheta], dp added to the
+     *                   translation and dtheta a rotation vector applied on the right
+     * @return False if the filter has no pose yet
+     */
+    bool PredictPoseKalmanAt(double timestamp, Sophus::SE3f& pose, Eigen::Matrix<float, 6, 6>& covariance) const;
+    
+    /**
+     * @brief Set the IMU bias the Kalman filter estimates from
+     * 
+     * The estimate is kept across Reset().
+     * 
+     * @param bias Accelerometer and gyroscope bias
+     */
+    void SetImuBias(const IMU::Bias& bias);
+    
+    /**
+     * @brief Get the IMU bias estimated by the Kalman filter
+     * 
+     * @return Current bias estimate
+     */
+    IMU::Bias GetImuBias() const;
+    
     /**
      * @brief Estimate current headset state
      * 
@@ -181,9 +347,29 @@ public:
      */
     void Reset();
     
+    /**
+     * @brief Snapshot the filter and the newest poses and IMU samples
+     * 
+     * @param state Output state
+     */
+    void GetFilterState(FilterState& state) const;
+    
+    /**
+     * @brief Restore a snapshot taken with GetFilterState()
+     * 
+     * The motion model continues as it was when the snapshot was taken;
+     * the user behavior model starts over.
+     * 
+     * @param state State to restore
+     */
+    void SetFilterState(const FilterState& state);
+    
     /**
      * @brief Set latency compensation
      * 
+     * Added to the horizon of PredictPose(), PredictPoseKalman() and
+     * PredictPosesAt(), e.g. for display latency the target times leave out.
+     * 
      * @param latency_ms Latency to compensate for (milliseconds)
      */
     void SetLatencyCompensation(double latency_ms);
@@ -218,6 +404,54 @@ public:
         return user_behavior_;
     }
     
+    /**
+     * @brief Set the smoothing of the velocity estimates
+     * 
+     * @param alpha Weight of the newest finite difference, in (0, 1]
+     */
+    void SetVelocitySmoothing(float alpha);
+    
+    /**
+     * @brief Get the smoothing of the velocity estimates
+     * 
+     * @return Weight of the newest finite difference
+     */
+    float GetVelocitySmoothing() const;
+    
+    /**
+     * @brief Configure the online tuning of the prediction
+     * 
+     * Enabling it replaces the horizon heuristics of the user behavior model.
+     * 
+     * @param config Tuning configuration
+     */
+    void SetAutoTune(const AutoTuneConfig& config);
+    
+    /**
+     * @brief Get the online tuning configuration
+     * 
+     * @return Current tuning configuration
+     */
+    AutoTuneConfig GetAutoTuneConfig() const;
+    
+    /**
+     * @brief Get the error statistics of a horizon bucket
+     * 
+     * Predictions are recorded whether or not tuning is enabled. Statistics
+     * and tuned values are kept across Reset().
+     * 
+     * @param mode Interaction mode the predictions were made in
+     * @param bucket Horizon bucket, horizons from the newest tracked pose of
+     *               [bucket, bucket + 1) * PREDICTION_ERROR_BUCKET_MS
+     * @return Statistics, zero if the bucket is out of range
+     */
+    PredictionErrorStats GetPredictionErrorStats(InteractionMode mode, int bucket) const;
+    
+    /**
+     * @brief Clear the error statistics of every interaction mode
+     */
+    void ResetPredictionErrorStats();
+    
 private:
     // Configuration
     PredictionConfig config_;
@@ -228,12 +462,45 @@ private:
     // User behavior model
     UserBehaviorModel user_behavior_ = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
     
+    // Maximum history size
+    static constexpr int MAX_HISTORY_SIZE = 100;
+    
+    // Fixed-capacity history, newest first. Pushing to a full history
+    // drops the oldest record, nothing is allocated after construction
+    template <typename T, size_t N>
+    class HistoryRing {
+    public:
+        void push_front(const T& record) {
+            head_ = (head_ + N - 1) % N;
+            records_[head_] = record;
+            if (size_ < N) {
+                ++size_;
+            }
+        }
+        void pop_back() { --size_; }
+        void clear() { size_ = 0; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        bool full() const { return size_ == N; }
+        T& operator[](size_t i) { return records_[(head_ + i) % N]; }
+        const T& operator[](size_t i) const { return records_[(head_ + i) % N]; }
+        T& front() { return records_[head_]; }
+        const T& front() const { return records_[head_]; }
+        T& back() { return (*this)[size_ - 1]; }
+        const T& back() const { return (*this)[size_ - 1]; }
+        
+    private:
+        std::array<T, N> records_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+    };
+    
     // Pose history
     struct PoseRecord {
         Sophus::SE3f pose;
         double timestamp;
     };
-    std::deque<PoseRecord> pose_history_;
+    HistoryRing<PoseRecord, MAX_HISTORY_SIZE> pose_history_;
     
     // IMU history
     struct IMURecord {
@@ -241,7 +508,29 @@ private:
         Eigen::Vector3f accel;
         double timestamp;
     };
-    std::deque<IMURecord> imu_history_;
+    HistoryRing<IMURecord, MAX_HISTORY_SIZE> imu_history_;
+    
+    // Motion between consecutive poses of the history, newest first, and the
+    // running totals the user behavior model is computed from
+    struct MotionSample {
+        float linear_speed;
+        float angular_speed;
+        HeadsetState state;
+        bool valid;             ///< False if the poses had invalid timestamps
+    };
+    HistoryRing<MotionSample, MAX_HISTORY_SIZE> motion_samples_;
+    double motion_linear_speed_sum_;
+    double motion_angular_speed_sum_;
+    std::array<int, 4> motion_state_counts_;
+    
+    // Unsmoothed finite differences of the last pose, the next pose
+    // differentiates them again instead of recomputing them from the history
+    Eigen::Vector3f raw_linear_velocity_;
+    Eigen::Vector3f raw_angular_velocity_;
+    Eigen::Vector3f raw_linear_acceleration_;
+    Eigen::Vector3f raw_angular_acceleration_;
+    bool has_raw_velocity_;
+    bool has_raw_acceleration_;
     
     // Current state
     HeadsetState current_state_;
@@ -252,34 +541,105 @@ private:
     Eigen::Vector3f linear_jerk_;
     Eigen::Vector3f angular_jerk_;
     double latency_compensation_ms_;
-    
-    // Kalman filter state
-    Eigen::VectorXf kalman_state_;
-    Eigen::MatrixXf kalman_covariance_;
-    Eigen::MatrixXf kalman_process_noise_;
-    Eigen::MatrixXf kalman_measurement_noise_;
+    float velocity_smoothing_ = 0.7f;
+    
+    // Velocities smoothed with the candidates of the velocity smoothing
+    // tuning, the current smoothing in the middle
+    static constexpr int SMOOTHING_CANDIDATES = 3;
+    std::array<Eigen::Vector3f, SMOOTHING_CANDIDATES> shadow_linear_velocity_;
+    std::array<Eigen::Vector3f, SMOOTHING_CANDIDATES> shadow_angular_velocity_;
+    
+    // Predictions waiting for the pose at their target time, newest first
+    static constexpr int MAX_PENDING_PREDICTIONS = 64;
+    struct PendingPrediction {
+        Sophus::SE3f predicted;
+        Sophus::SE3f base_pose;        // Newest tracked pose when predicted
+        std::array<Eigen::Vector3f, SMOOTHING_CANDIDATES> shadow_linear_velocity;
+        std::array<Eigen::Vector3f, SMOOTHING_CANDIDATES> shadow_angular_velocity;
+        double base_timestamp;
+        double target_timestamp;
+        InteractionMode mode;
+        bool clamped;                  // Horizon cut short, the timing error is not the compensation's
+    };
+    HistoryRing<PendingPrediction, MAX_PENDING_PREDICTIONS> pending_predictions_;
+    
+    // Error statistics per interaction mode and horizon bucket
+    static constexpr int INTERACTION_MODES = 3;
+    std::array<std::array<PredictionErrorStats, PREDICTION_ERROR_BUCKETS>, INTERACTION_MODES> prediction_error_stats_{};
+    
+    // Online tuning, sums over the scored predictions since the last adjustment
+    struct TunedParameters {
+        double prediction_horizon_ms;
+        double latency_compensation_ms;
+        float velocity_smoothing;
+        bool valid;
+    };
+    AutoTuneConfig auto_tune_;
+    std::array<TunedParameters, INTERACTION_MODES> tuned_parameters_{};
+    int tune_scored_ = 0;
+    int tune_lag_count_ = 0;
+    double tune_lag_sum_ms_ = 0.0;
+    std::array<double, SMOOTHING_CANDIDATES> tune_smoothing_error_{};
+    
+    // Error-state Kalman filter: nominal state on SE3, propagated with the IMU
+    // samples, and the covariance of the error state [dp, dtheta, dv, dba, dbg]
+    // (dtheta is a rotation vector in the body frame), fixed-size so updates do not allocate
+    static constexpr int KALMAN_ERROR_SIZE = 15;
+    typedef Eigen::Matrix<float, KALMAN_ERROR_SIZE, 1> KalmanError;
+    typedef Eigen::Matrix<float, KALMAN_ERROR_SIZE, KALMAN_ERROR_SIZE> KalmanCovariance;
+    Sophus::SE3f kalman_pose_;             // Body pose in the world frame
+    Eigen::Vector3f kalman_velocity_;      // Velocity in the world frame
+    Eigen::Vector3f kalman_accel_bias_;
+    Eigen::Vector3f kalman_gyro_bias_;
+    KalmanCovariance kalman_covariance_;
+    Eigen::Vector3f kalman_gyro_;          // Latest IMU sample, held until the next one
+    Eigen::Vector3f kalman_accel_;
+    bool kalman_has_imu_;
+    bool kalman_initialized_;
     double kalman_last_update_time_;
-    
-    // Maximum history size
-    static constexpr int MAX_HISTORY_SIZE = 100;
+    HistoryRing<PoseRecord, MAX_HISTORY_SIZE> kalman_pose_history_;  // Nominal poses, for late pose measurements
+    Sophus::SO3f kalman_history_rotation_;     // Corrections since the poses were recorded,
+    Eigen::Vector3f kalman_history_translation_;  // applied when they are read
     
     // Helper methods
     void UpdateState();
     void PruneHistory();
+    void resetMotionState();
+    void addMotionSample(const MotionSample& sample);
+    void trimMotionSamples();
     Sophus::SE3f PredictWithConstantVelocity(double prediction_time_ms);
     Sophus::SE3f PredictWithConstantAcceleration(double prediction_time_ms);
     Sophus::SE3f PredictWithJerk(double prediction_time_ms);
     Sophus::SE3f PredictWithIMU(double prediction_time_ms);
-    Sophus::SE3f InterpolatePoses(const Sophus::SE3f& pose1, const Sophus::SE3f& pose2, float t);
+    Sophus::SE3f InterpolatePoses(const Sophus::SE3f& pose1, const Sophus::SE3f& pose2, float t) const;
     
     // Kalman filter methods
     void initializeKalmanFilter();
     void updateKalmanFilter(const Sophus::SE3f& pose, double timestamp);
     void updateKalmanFilterWithIMU(const Eigen::Vector3f& gyro, const Eigen::Vector3f& accel, double timestamp);
-    Eigen::VectorXf predictKalmanState(double dt);
+    void propagateKalmanFilter(double timestamp);
+    void getKalmanRates(Eigen::Vector3f& angular_velocity, Eigen::Vector3f& acceleration) const;
+    void getKalmanTransition(float dt, const Eigen::Vector3f& angular_velocity,
+                             KalmanCovariance& F, KalmanCovariance& Q) const;
+    bool getKalmanPoseAt(double timestamp, Sophus::SE3f& pose) const;
+    template <int Offset, int Size>
+    KalmanError applyKalmanCorrection(const Eigen::Matrix<float, Size, 1>& innovation,
+                                      const Eigen::Matrix<float, Size, Size>& noise);
     
     // User behavior modeling
     void updateUserBehaviorModel();
+    
+    // Prediction scoring and tuning
+    Sophus::SE3f predictPose(double prediction_time_ms, bool& clamped);
+    float smoothingCandidate(int candidate) const;
+    void recordPrediction(const Sophus::SE3f& predicted, double target_timestamp, bool clamped);
+    void scorePendingPredictions();
+    bool getObservedMotionAt(double timestamp, Sophus::SE3f& pose,
+                             Eigen::Vector3f& linear_velocity, Eigen::Vector3f& angular_velocity) const;
+    void scorePrediction(const PendingPrediction& prediction, const Sophus::SE3f& observed,
+                         const Eigen::Vector3f& linear_velocity, const Eigen::Vector3f& angular_velocity);
+    void autoTunePrediction();
+    void resetTuningWindow();
 };
 
 } // namespace ORB_SLAM3
@@ -1,6 +1,8 @@
 #ifndef VR_SLAM_SYSTEM_HPP
 #define VR_SLAM_SYSTEM_HPP
 
+#include <array>
+#include <deque>
 #include <memory>
 #include <vector>
 #include <string>
@@ -11,10 +13,27 @@
 
 #include "multi_camera_rig.hpp"
 #include "multi_camera_tracking.hpp"
+#include "online_calibration.hpp"
 #include "vr_motion_model.hpp"
 #include "tpu_zero_copy_integration.hpp"
 #include "bno085_interface.hpp"
+#include "dvfs_telemetry.hpp"
+#include "flight_recorder.hpp"
 #include "zero_copy_frame_provider.hpp"
+#include "latency_trace.hpp"
+#include "map_sharing.hpp"
+#include "performance_governor.hpp"
+#include "pipeline_queue.hpp"
+#include "seqlock.hpp"
+#include "shared_pose_export.hpp"
+#include "spsc_ring_buffer.hpp"
+#include "telemetry_export.hpp"
+#include "thread_placement.hpp"
+#include "vsync_phase_lock.hpp"
+#include "../ORB_SLAM3/include/ProfiledMutex.h"
+#include "../ORB_SLAM3/include/MemoryAccounting.h"
+#include "../ORB_SLAM3/include/PmuCounters.h"
+#include "../ORB_SLAM3/include/EnergyCounters.h"
 
 namespace ORB_SLAM3
 {
@@ -40,13 +59,45 @@ public:
         std::string settings_path;             ///< Path to settings file
         std::string calibration_path;          ///< Path to camera calibration file
         std::string tpu_model_path;            ///< Path to TPU model file
+        std::vector<std::string> tpu_model_ladder; ///< Cheaper models, in order, the extractor degrades to under load or heat (see TPUFeatureExtractor::AddModelRung())
         bool use_imu;                          ///< Whether to use IMU data
         bool enable_mapping;                   ///< Whether to enable mapping
         bool enable_loop_closing;              ///< Whether to enable loop closing
         VRMotionModel::InteractionMode interaction_mode; ///< VR interaction mode
         double prediction_horizon_ms;          ///< Motion prediction horizon
+        bool auto_tune_prediction = false;     ///< Whether the motion model tunes its horizon, latency compensation and smoothing on its scored predictions
         int num_threads;                       ///< Number of processing threads
         bool verbose;                          ///< Whether to print verbose output
+        int pipeline_queue_depth = 2;          ///< Frame sets buffered between pipeline stages
+        PipelineDropPolicy pipeline_drop_policy = PipelineDropPolicy::KEEP_LATEST; ///< What a stage does when the next one falls behind
+        double pose_publish_rate_hz = 500.0;   ///< Rate of the IMU-propagated pose publisher
+        std::string pose_export_name = "/vr_slam_pose"; ///< Shared memory name for out-of-process pose readers (empty to disable)
+        bool enable_governor = true;           ///< Whether to scale quality to hold the latency budget
+        bool seed_tracking_with_prediction = true; ///< Whether tracking starts from the motion model prediction and sizes its search windows from its covariance
+        PerformanceGovernor::Config governor;  ///< Latency budget, knob limits and decision log
+        std::string checkpoint_path;           ///< Atlas file of the periodic checkpoints (empty to disable)
+        double checkpoint_interval_s = 60.0;   ///< Time between checkpoints
+        double checkpoint_write_mbps = 16.0;   ///< Checkpoint write rate limit in MB/s (0 for unthrottled)
+        std::string power_device = "/dev/orangepi-vr-power"; ///< Power driver fed the stage times for DVFS (empty to disable)
+        ThreadPlacementPolicy::Config thread_placement; ///< Cores and real-time priority of every thread role
+        VsyncPhaseLock::Config vsync_lock;     ///< Camera trigger locked to the display's late latch
+        OnlineCalibration::Config online_calibration; ///< Background refinement of the IMU-camera rotation and clock offset
+        std::string trace_path;                ///< Chrome/Perfetto trace written when the system stops (empty to disable, needs ENABLE_TRACING)
+        bool enable_pmu_counters = false;      ///< Whether the trace spans count cycles, instructions, cache and branch misses (needs ENABLE_TRACING)
+        bool enable_energy_counters = false;   ///< Whether the fuel gauge and PMIC rails are sampled and their energy attributed to the trace spans (needs ENABLE_TRACING)
+        int energy_sample_period_us = 1000;    ///< Period of the power rail sampling
+        FlightRecorder::Config flight_recorder; ///< Last seconds of frame set timings, dumped on latency spikes
+        double memory_sample_interval_s = 1.0; ///< Period of the memory breakdown sampling (0 to disable)
+        std::string memory_log_path;           ///< CSV of every memory sample (empty to disable)
+        std::string telemetry_export_name = "/vr_slam_telemetry"; ///< Shared memory name of the telemetry stream for the monitoring service (empty to disable)
+        double telemetry_rate_hz = 1.0;        ///< Rate of the telemetry samples
+        std::string map_share_host;            ///< Map server of the arena the keyframes are shared through (empty to disable)
+        int map_share_port = 9955;             ///< TCP port of the map server
+        uint16_t map_share_device_id = 0;      ///< Unique per headset of the arena
+        size_t max_remote_keyframes = 4096;    ///< Keyframes of the other headsets buffered until taken, oldest dropped first
+        std::string replay_path;               ///< Capture file the cameras are replayed from instead of the live ones (empty for live)
+        bool offline_mapping = false;          ///< Build the map from replay_path as fast as possible (see RunOfflineMapping())
+        int offline_gba_iterations = 20;       ///< Iterations of the global BA that ends offline mapping
     };
     
     /**
@@ -61,6 +112,16 @@ public:
         SHUTDOWN          ///< System shut down
     };
     
+    /**
+     * @brief Latest published pose
+     */
+    struct PoseSnapshot {
+        Sophus::SE3f pose;                     ///< Camera pose (Tcw)
+        double timestamp;                      ///< Time the pose refers to (sensor clock, seconds)
+        double tracked_timestamp;              ///< Timestamp of the tracked pose it was propagated from
+        bool imu_propagated;                   ///< Whether IMU samples newer than the tracked pose were applied
+    };
+    
     /**
      * @brief Performance metrics
      */
@@ -73,6 +134,29 @@ public:
         int frames_processed;                  ///< Number of frames processed
         int tracking_lost_count;               ///< Number of times tracking was lost
         double tracking_percentage;            ///< Percentage of time tracking was successful
+        int pipeline_dropped_frames;           ///< Frame sets dropped between pipeline stages
+        bool vsync_locked;                     ///< Whether the camera trigger is phase-locked to the display
+        double pose_age_at_scanout_ms;         ///< Exposure midpoint to scanout of its pose (0 without the lock)
+        double pose_age_jitter_ms;             ///< Standard deviation of the pose age at scanout
+        
+        // Latency distributions, so spikes are not hidden by the averages
+        std::array<LatencyPercentiles, kNumLatencyStages> stage_latency; ///< Per-stage latency, indexed by LatencyStage
+        LatencyPercentiles end_to_end_latency; ///< Exposure midpoint to pose published
+        
+        // Contention of the ORB-SLAM3 map locks, by total wait (empty without ENABLE_LOCK_PROFILING)
+        std::vector<LockStatistics> lock_contention; ///< Per lock, with its top holder sites
+        
+        // Hardware counters of the traced stages (empty without enable_pmu_counters)
+        std::vector<StageCounters> stage_counters; ///< Per stage and core type, by running time
+        
+        // Energy of the power rails and of the traced stages (empty without enable_energy_counters)
+        std::vector<RailEnergy> rail_energy;   ///< Per rail, with the energy outside every stage
+        std::vector<StageEnergy> stage_energy; ///< Per stage and rail, by energy
+        
+        // Last memory sample (zero before the first one or with sampling disabled)
+        MemoryBreakdown memory;                ///< Estimated bytes per structure, including the paged out ones
+        size_t resident_bytes = 0;             ///< Resident set of the process
+        size_t unattributed_bytes = 0;         ///< Resident set outside the breakdown (allocator, code, stacks, libraries)
     };
     
     /**
@@ -123,10 +207,23 @@ public:
     /**
      * @brief Get current camera pose
      * 
+     * Lock-free, safe to call from any thread at any rate (e.g. the OpenVR driver).
+     * 
      * @return Current camera pose
      */
     Sophus::SE3f GetCurrentPose() const;
     
+    /**
+     * @brief Get the current camera pose with its timestamps
+     * 
+     * Returns the newest of the last tracked pose and the pose the publisher
+     * propagated from it with the IMU samples received since. Lock-free, safe
+     * to call from any thread at any rate.
+     * 
+     * @return Latest pose snapshot
+     */
+    PoseSnapshot GetPoseSnapshot() const;
+    
     /**
      * @brief Get predicted camera pose
      * 
@@ -135,6 +232,18 @@ public:
      */
     Sophus::SE3f GetPredictedPose(double prediction_time_ms) const;
     
+    /**
+     * @brief Get predicted camera poses at a set of display times
+     * 
+     * E.g. the mid-scanout time of each eye and each late-warp slice of the
+     * next vsync. All poses come from one motion model state, so the eyes
+     * and slices are consistent with each other.
+     * 
+     * @param display_timestamps Target times in seconds, on the camera clock
+     * @return Predicted camera poses, one per target time
+     */
+    std::vector<Sophus::SE3f> GetPredictedPoses(const std::vector<double>& display_timestamps) const;
+    
     /**
      * @brief Get performance metrics
      * 
@@ -142,9 +251,44 @@ public:
      */
     PerformanceMetrics GetPerformanceMetrics() const;
     
+    /**
+     * @brief Get the keypoints and tracked map points of the last tracked frame set
+     * 
+     * @param keypoints Keypoints extracted, summed over the scheduled cameras
+     * @param tracked_points Tracked map points, summed over the scheduled cameras
+     */
+    void GetFrameSetFeatureCounts(int& keypoints, int& tracked_points) const;
+    
+    /**
+     * @brief Get the duration of each initialization step of the last Initialize()
+     * 
+     * Independent steps run concurrently, so the durations add up to more than
+     * the initialization took. The last entry is the whole initialization.
+     * 
+     * @return Step names and durations in milliseconds, in completion order
+     */
+    std::vector<std::pair<std::string, double>> GetInitializationTimes() const;
+    
+    /**
+     * @brief Get the CPU migrations and preemptions of the placed threads
+     * 
+     * @return One entry per thread placed by config.thread_placement, empty if it is disabled
+     */
+    std::vector<ThreadStats> GetThreadStats() const;
+    
+    /**
+     * @brief Get the state of the online IMU-camera calibration
+     * 
+     * @param state Time offset and rotation applied so far, and the last refinement
+     * @return False if config.online_calibration is disabled or there is no IMU
+     */
+    bool GetOnlineCalibrationState(OnlineCalibration::State& state) const;
+    
     /**
      * @brief Save map to file
      * 
+     * Writes the ORB-SLAM3 atlas as a sectioned atlas file (see Atlas::SaveToFile).
+     * 
      * @param filename Filename to save map to
      * @return True if map was saved successfully
      */
@@ -153,11 +297,54 @@ public:
     /**
      * @brief Load map from file
      * 
+     * Only before tracking starts; the loaded maps are kept and tracking starts a new one.
+     * 
      * @param filename Filename to load map from
      * @return True if map was loaded successfully
      */
     bool LoadMap(const std::string& filename);
     
+    /**
+     * @brief Checkpoint the map to file while tracking continues
+     * 
+     * The maps are serialized in memory with Local Mapping stopped, then written
+     * on a low priority thread at config.checkpoint_write_mbps. The file is only
+     * replaced once the new checkpoint is complete.
+     * 
+     * @param filename Filename to checkpoint the map to
+     * @return True if the checkpoint was started, false while the previous one is written
+     */
+    bool CheckpointMap(const std::string& filename);
+    
+    /**
+     * @brief Whether a checkpoint is being taken or written
+     */
+    bool IsCheckpointing() const;
+    
+    /**
+     * @brief Dump the flight recorder window on the next tracked frame set
+     * @return False if the flight recorder is disabled
+     */
+    bool DumpFlightRecorder();
+    
+    /**
+     * @brief Build a map from the recording of config.replay_path and save it
+     * 
+     * Needs config.offline_mapping. The recording is served as fast as the
+     * pipeline takes it: the stages block instead of dropping frame sets, the
+     * extraction runs on all cores, and nothing paces or degrades the
+     * processing (no governor, vsync lock, IMU or pose publishing). Local
+     * mapping runs every BA to its end over its full window on all cores and
+     * tracking waits for it instead of dropping keyframes. Once the recording
+     * ends and the queued frame sets are tracked, a global BA refines every
+     * map before the atlas is saved as with SaveMap(). Blocks until done,
+     * call it instead of Start().
+     * 
+     * @param filename Filename to save the map to
+     * @return True if the recording was mapped and the map saved
+     */
+    bool RunOfflineMapping(const std::string& filename);
+    
     /**
      * @brief Reset the system
      * 
@@ -193,6 +380,49 @@ public:
      */
     double GetPredictionHorizon() const;
     
+    /**
+     * @brief Configure the online tuning of the motion prediction
+     * 
+     * The horizon set with SetPredictionHorizon() is where the tuning starts.
+     * 
+     * @param config Tuning configuration
+     */
+    void SetPredictionAutoTune(const VRMotionModel::AutoTuneConfig& config);
+    
+    /**
+     * @brief Get the error statistics of the motion predictions
+     * 
+     * @param mode Interaction mode the predictions were made in
+     * @param bucket Horizon bucket (see VRMotionModel::GetPredictionErrorStats())
+     * @return Statistics, zero before the motion model is initialized
+     */
+    VRMotionModel::PredictionErrorStats GetPredictionErrorStats(VRMotionModel::InteractionMode mode, int bucket) const;
+    
+    /**
+     * @brief Announce load ahead to the DVFS governor of the power driver
+     * 
+     * Keyframe insertion and relocalization are announced by the tracking
+     * stage itself, other threads (e.g. a loop closer) call this.
+     * 
+     * @param hints kDvfsHint* flags
+     */
+    void HintLoad(uint32_t hints);
+    
+    /**
+     * @brief Take the keyframes the other headsets shared since the last call
+     * 
+     * The keyframes are in the publishing headset's map, for a map merge.
+     * 
+     * @param keyframes Output keyframe deltas, appended in arrival order
+     * @return Number of keyframes taken, 0 without a map server
+     */
+    size_t TakeRemoteKeyFrames(std::vector<KeyFrameDelta>& keyframes);
+    
+    /**
+     * @brief Get the statistics of the map server connection, zero without a map server
+     */
+    MapShareClient::Stats GetMapShareStats() const;
+    
     /**
      * @brief Process a single frame
      * 
@@ -215,6 +445,8 @@ public:
      * @param accel Accelerometer measurement (m/s^2)
      * @param timestamp Timestamp of the measurement
      * @return True if measurement was processed successfully
+     * 
+     * Must be called from one thread only, the samples also feed the pose publisher.
      */
     bool ProcessIMU(const Eigen::Vector3f& gyro, const Eigen::Vector3f& accel, double timestamp);
     
@@ -229,25 +461,138 @@ private:
     std::unique_ptr<TPUZeroCopyIntegration> tpu_integration_;
     std::unique_ptr<MultiCameraTracking> tracking_;
     std::unique_ptr<VRMotionModel> motion_model_;
+    mutable std::mutex motion_mutex_;          // Guards motion_model_ calls after initialization
     std::unique_ptr<BNO085Interface> imu_interface_;
     
+    // Duration of each initialization step, set by initializeComponents()
+    std::vector<std::pair<std::string, double>> initialization_times_ms_;
+    
+    // Installed for the process while the system is up, null if disabled
+    std::shared_ptr<ThreadPlacementPolicy> thread_placement_;
+    
     // System state
     std::atomic<Status> status_;
-    std::mutex pose_mutex_;
-    Sophus::SE3f current_pose_;
+    
+    // Pose in a trivially copyable layout for the seqlocks
+    struct PoseRecord {
+        float rotation[4];                     // Quaternion x, y, z, w of Tcw
+        float translation[3];                  // Translation of Tcw
+        double timestamp;
+        double tracked_timestamp;
+        bool imu_propagated;
+    };
+    
+    // Rotation in a trivially copyable layout for the seqlock
+    struct RotationRecord {
+        float rotation[4];                     // Quaternion x, y, z, w
+    };
+    
+    // Gyroscope sample handed from ProcessIMU to the pose publisher
+    struct GyroSample {
+        Eigen::Vector3f gyro;
+        double timestamp;
+    };
+    
+    // Pose publication: tracking writes the tracked pose, the publisher thread
+    // propagates it with the gyro samples and writes the published pose
+    SeqLock<PoseRecord> tracked_pose_;
+    SeqLock<PoseRecord> published_pose_;
+    SPSCRingBuffer<GyroSample> gyro_samples_;
+    SeqLock<RotationRecord> imu_to_camera_rotation_;  // Replaced by the online calibration
+    std::thread pose_publisher_thread_;
+    
+    // Out-of-process export of the published poses, written by the publisher thread
+    std::unique_ptr<SharedPoseWriter> pose_export_;
+    SeqLock<LatencyStamps> tracked_latency_;
+    std::atomic<double> prediction_horizon_ms_;
     
     // Performance monitoring
     PerformanceMetrics metrics_;
-    std::mutex metrics_mutex_;
+    mutable std::mutex metrics_mutex_;
+    LatencyTracker latency_tracker_;
     
-    // Processing thread
+    // Frame set handed from the acquisition to the extraction stage
+    struct AcquiredFrameSet {
+        ZeroCopyFrameProvider::FrameSet frame_set;
+        LatencyStamps latency;
+        double acquisition_time_ms;
+    };
+    
+    // Frame set handed from the extraction to the tracking stage
+    struct ExtractedFrameSet {
+        double timestamp;
+        std::vector<ZeroCopyFrameProvider::FrameViewPtr> frame_views;
+        LatencyStamps latency;
+        double acquisition_time_ms;
+        double feature_time_ms;
+        double extraction_wait_ms;
+        FlightRecorder::ThreadCounters extraction_thread;
+    };
+    
+    // Pipeline stage threads, each stage works on a newer frame set than the next one
+    std::thread acquisition_thread_;
+    std::thread extraction_thread_;
     std::thread processing_thread_;
     std::atomic<bool> running_;
-    std::condition_variable processing_cv_;
-    std::mutex processing_mutex_;
+    std::atomic<uint64_t> empty_acquisitions_;  // Frame set requests that timed out, the replay end is drained after one
+    std::unique_ptr<PipelineQueue<AcquiredFrameSet>> extraction_queue_;
+    std::unique_ptr<PipelineQueue<ExtractedFrameSet>> tracking_queue_;
+    
+    // Latency governor, driven by the tracking stage
+    std::unique_ptr<PerformanceGovernor> governor_;
+    std::atomic<int> frame_decimation_;
+    
+    // Per frame set state of the last seconds, fed by the tracking stage, optional
+    std::unique_ptr<FlightRecorder> flight_recorder_;
+    
+    // Stage times fed to the DVFS governor of the power driver, optional
+    std::unique_ptr<DvfsTelemetry> dvfs_telemetry_;
+    
+    // Display cadence and the camera trigger lock to it, driven by the tracking stage, optional
+    std::unique_ptr<DisplayVsyncSource> vsync_source_;
+    std::unique_ptr<VsyncPhaseLock> vsync_lock_;
+    
+    // Refinement of the IMU-camera calibration, fed by the tracking stage, optional
+    std::unique_ptr<OnlineCalibration> online_calibration_;
+    uint64_t calibration_gyro_sequence_;       // Next IMU measurement handed to it
+    
+    // Memory breakdown sampled at a low rate off the pipeline, the atlas walk takes milliseconds
+    std::thread memory_thread_;
+    mutable std::mutex memory_mutex_;
+    std::condition_variable memory_cv_;
+    MemoryBreakdown memory_;
+    size_t resident_bytes_;
+    
+    // Telemetry stream for the monitoring service, sampled at a low rate off the pipeline, optional
+    std::unique_ptr<SharedTelemetryWriter> telemetry_export_;
+    std::thread telemetry_thread_;
+    std::mutex telemetry_mutex_;
+    std::condition_variable telemetry_cv_;
+    
+    // Keyframes shared with the other headsets of the arena, published by the tracking
+    // stage and received off the pipeline, optional
+    std::unique_ptr<MapShareClient> map_share_client_;
+    std::thread map_share_thread_;
+    std::mutex remote_keyframes_mutex_;
+    std::deque<KeyFrameDelta> remote_keyframes_;
     
     // Helper methods
+    void acquisitionLoop();
+    void extractionLoop();
     void processingLoop();
+    void posePublisherLoop();
+    void memoryLoop();
+    void telemetryLoop();
+    void mapShareLoop();
+    void sampleTelemetry(SharedTelemetrySample& sample) const;
+    void storeTrackedPose(const Sophus::SE3f& pose, double timestamp);
+    void seedPosePrediction(double timestamp);      // Caller holds motion_mutex_
+    void applyGovernorDecision();
+    void updateVsyncLock(const LatencyStamps& latency);
+    void readCalibrationGyro(std::vector<OnlineCalibration::GyroMeasurement>& samples);
+    void applyCalibration(const OnlineCalibration::Calibration& calibration);
+    void exportPose(const PoseRecord& record, const Sophus::SE3f& Twc,
+                    const Eigen::Vector3f& linear_velocity, const Eigen::Vector3f& angular_velocity);
     bool initializeComponents();
     bool processFrameInternal(const std::vector<cv::Mat>& images, double timestamp);
     bool processIMUInternal(const Eigen::Vector3f& gyro, const Eigen::Vector3f& accel, double timestamp);
@@ -0,0 +1,196 @@
+#ifndef VSYNC_PHASE_LOCK_HPP
+#define VSYNC_PHASE_LOCK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Late-latch cadence of a display
+ *
+ * All times are CLOCK_MONOTONIC nanoseconds, the clock of the camera
+ * exposure stamps.
+ */
+struct VsyncTiming {
+    int64_t period_ns = 0;      ///< Time between late latches
+    int64_t latch_ns = 0;       ///< A late latch, later ones follow every period_ns
+    int64_t lead_ns = 0;        ///< Late latch to the scanout it was programmed for
+    bool valid = false;         ///< False until the period was measured
+};
+
+/**
+ * @brief Reads the late-latch cadence of the RK3588 VR display
+ *
+ * The display driver reports the latch and expected scanout times of every
+ * late latch in the status of the pose page (struct rk3588_vr_late_latch_page
+ * in drivers/display/rk3588_vr_display.h). The page is mapped read-only
+ * alongside the compositor, which keeps writing the poses. The latch period
+ * is measured from the scanout times, so it follows the refresh the panel
+ * actually runs at.
+ */
+class DisplayVsyncSource
+{
+public:
+    /**
+     * @brief Constructor
+     * @param device Display device the late-latch page is mapped from
+     * @param display_index Display whose latches are followed (0 or 1)
+     */
+    DisplayVsyncSource(const std::string& device, int display_index);
+
+    ~DisplayVsyncSource();
+
+    DisplayVsyncSource(const DisplayVsyncSource&) = delete;
+    DisplayVsyncSource& operator=(const DisplayVsyncSource&) = delete;
+
+    /**
+     * @brief Map the late-latch page
+     * @return False if the device is missing or the late latch is disabled
+     */
+    bool Open();
+
+    /**
+     * @brief Unmap the page
+     */
+    void Close();
+
+    /**
+     * @brief Check if the page is mapped
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Read the cadence from the status of the last latch
+     * @param timing Cadence, valid once two latches were seen
+     * @return False if the page is not mapped or was being written
+     */
+    bool Read(VsyncTiming& timing);
+
+    /**
+     * @brief Fold the status of a latch into the cadence
+     *
+     * Read() calls this with the status from the page.
+     *
+     * @param latch_ns Time the warp was programmed
+     * @param scanout_ns Expected start of the scanout it was programmed for
+     * @param latch_count Latches so far
+     * @param timing Updated cadence
+     */
+    void Update(int64_t latch_ns, int64_t scanout_ns, uint32_t latch_count, VsyncTiming& timing);
+
+private:
+    std::string mDevice;
+    int mDisplayIndex;
+    int mFd;
+    void* mPage;
+    size_t mPageSize;
+
+    bool mHaveLast;
+    uint32_t mLastCount;
+    int64_t mLastScanout;
+    double mPeriod;
+    double mLead;
+    int mPeriodOutliers;
+};
+
+/**
+ * @brief Phase-locks the camera trigger to the display's late latch
+ *
+ * Cameras, tracking and display free-run against each other, so without it
+ * the pose age at scanout drifts and saws over a beat period. The lock keeps
+ * the FSIN trigger at an integer ratio of the latch period. It then moves the
+ * trigger phase so the pose is ready just before a late latch: the exposure
+ * midpoint plus the pipeline latency plus a margin lands on the latch. The
+ * latency term is a high quantile of the measured exposure-to-pose time.
+ * The phase error drives the phase steps and, integrated, a trim of the
+ * period, so a frequency mismatch left by the period measurement does not
+ * keep the phase drifting.
+ */
+class VsyncPhaseLock
+{
+public:
+    /**
+     * @brief Configuration
+     */
+    struct Config {
+        bool enabled = false;                   ///< Whether the camera trigger follows the display
+        std::string display_device = "/dev/dri/card0"; ///< Device the late-latch page is mapped from
+        int display_index = 0;                  ///< Display followed
+        int trigger_camera_id = 0;              ///< Camera whose sync subdev triggers all sensors
+        int64_t camera_period_ns = 0;           ///< Nominal trigger period of the frame rate mode
+        double max_period_trim = 0.02;          ///< Largest trim of the trigger period (OV9281_FSIN_TRIM_PPM)
+        double latch_margin_ms = 0.5;           ///< Pose ready this long before the late latch
+        double latency_sigmas = 2.0;            ///< Latency quantile, standard deviations over the mean
+        double phase_gain = 0.5;                ///< Fraction of the phase error corrected per step
+        double frequency_gain = 0.05;           ///< Fraction of the phase error integrated into the period per step
+        double deadband_us = 50.0;              ///< Phase error left alone
+        double lock_threshold_us = 500.0;       ///< Phase error below which the lock holds
+        int step_interval_frames = 4;           ///< Frames between steps, a step lands before the next is measured
+    };
+
+    /**
+     * @brief Trigger retiming, the arguments of OV9281_IOC_ADJUST_FSIN
+     */
+    struct Correction {
+        bool valid = false;                     ///< False if nothing is to be changed
+        int64_t period_ns = 0;                  ///< New trigger period
+        int64_t phase_ns = 0;                   ///< One-time shift of the next pulse
+    };
+
+    /**
+     * @brief Lock state
+     */
+    struct State {
+        bool locked = false;                    ///< Phase error within the lock threshold
+        bool reachable = true;                  ///< False if no ratio of the latch period is within the trim
+        double phase_error_ms = 0.0;            ///< Ready time minus the targeted late latch
+        double pipeline_latency_ms = 0.0;       ///< Mean exposure midpoint to pose ready
+        double pose_age_ms = 0.0;               ///< Mean exposure midpoint to scanout of the pose
+        double pose_age_jitter_ms = 0.0;        ///< Standard deviation of the pose age
+        int64_t trigger_period_ns = 0;          ///< Trigger period last requested
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Configuration
+     */
+    explicit VsyncPhaseLock(const Config& config);
+
+    /**
+     * @brief Account for a tracked frame and compute the trigger retiming
+     * @param vsync Display cadence
+     * @param exposure_mid_s Exposure midpoint of the frame (CLOCK_MONOTONIC seconds)
+     * @param pose_ready_s Time its pose was published (CLOCK_MONOTONIC seconds)
+     * @return Retiming to apply to the trigger, invalid between steps
+     */
+    Correction Update(const VsyncTiming& vsync, double exposure_mid_s, double pose_ready_s);
+
+    /**
+     * @brief Get the lock state
+     */
+    State GetState() const;
+
+    /**
+     * @brief Forget the measurements, e.g. after the trigger restarted
+     */
+    void Reset();
+
+private:
+    Config mConfig;
+    State mState;
+
+    int mSamples;
+    double mLatencyMean;
+    double mLatencyVar;
+    double mAgeMean;
+    double mAgeVar;
+    double mPeriodTrim;
+    int mFramesSinceStep;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // VSYNC_PHASE_LOCK_HPP
@@ -0,0 +1,114 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+/**
+ * @brief Single-use countdown latch (std::latch is C++20)
+ */
+class Latch
+{
+public:
+    /**
+     * @brief Constructor
+     * @param count Number of CountDown() calls Wait() waits for
+     */
+    explicit Latch(int count);
+
+    Latch(const Latch&) = delete;
+    Latch& operator=(const Latch&) = delete;
+
+    /**
+     * @brief Decrement the counter, releasing the waiters when it reaches zero
+     */
+    void CountDown();
+
+    /**
+     * @brief Block until the counter reaches zero
+     */
+    void Wait();
+
+    /**
+     * @brief Check if the counter reached zero without blocking
+     */
+    bool TryWait() const;
+
+private:
+    int mCount;
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+};
+
+/**
+ * @brief Long-lived pool of (optionally core-pinned) worker threads
+ *
+ * Jobs are taken from one FIFO queue. ParallelFor() lets the calling thread
+ * work on the range too and only waits for the items themselves, so it
+ * completes even when every worker is busy, including when it is called
+ * from a job of the same pool.
+ */
+class WorkerPool
+{
+public:
+    /**
+     * @brief Constructor
+     * @param num_workers Number of worker threads (at least 1)
+     * @param cpu_cores Cores to pin the workers to, worker i to cpu_cores[i % size] (empty for no pinning)
+     */
+    explicit WorkerPool(int num_workers, const std::vector<int>& cpu_cores = std::vector<int>());
+
+    /**
+     * @brief Destructor, runs the queued jobs and joins the workers
+     */
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Queue a job
+     * @param job Job to run on a worker
+     */
+    void Submit(std::function<void()> job);
+
+    /**
+     * @brief Queue a job that counts down a latch when it finishes
+     * @param job Job to run on a worker
+     * @param latch Latch to count down (must outlive the job)
+     */
+    void Submit(std::function<void()> job, Latch& latch);
+
+    /**
+     * @brief Run job(0) to job(count - 1) on the workers and the calling thread
+     * @param count Number of items
+     * @param job Job run once per item index
+     */
+    void ParallelFor(int count, const std::function<void(int)>& job);
+
+    /**
+     * @brief Get the number of worker threads
+     */
+    size_t GetWorkerCount() const;
+
+private:
+    std::vector<std::thread> mWorkers;
+    std::deque<std::function<void()>> mJobs;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping;
+
+    void WorkerThreadFunc(int cpu_core);
+};
+
+} // namespace ORB_SLAM3
+
+#endif // WORKER_POOL_HPP
@@ -6,11 +6,21 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
-#include <queue>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/core/mat.hpp>
 
+#include "dma_buffer_pool.hpp"
+#include "frame_capture_file.hpp"
+#include "latency_trace.hpp"
+#include "spsc_ring_buffer.hpp"
+
+struct v4l2_buffer;
+
 namespace ORB_SLAM3
 {
 
@@ -28,10 +38,20 @@ namespace ORB_SLAM3
  * 3. Frame timestamping and synchronization with IMU data
  * 4. Efficient buffer management to avoid memory copies
  * 5. Support for different camera configurations and formats
+ * 6. Recording to and replay from capture files for camera-less benchmarks
  */
 class ZeroCopyFrameProvider
 {
 public:
+    /**
+     * @brief Policy for frames the consumer has not picked up yet
+     */
+    enum class FrameDropPolicy {
+        QUEUE_ALL,          ///< Deliver every frame in capture order
+        LATEST_ONLY,        ///< Always deliver the freshest frame, recycle older queued frames
+        BOUNDED_LATENCY     ///< Recycle queued frames older than max_frame_age_ms
+    };
+    
     /**
      * @brief Camera configuration structure
      */
@@ -43,6 +63,7 @@ public:
         std::string pixel_format;     ///< Pixel format (e.g., "GREY", "YUYV", "MJPG")
         bool zero_copy_enabled;       ///< Whether zero-copy is enabled for this camera
         int buffer_count;             ///< Number of buffers to allocate
+        bool dma_pool_buffers = false; ///< Capture into the shared DMA buffer pool (V4L2_MEMORY_DMABUF) instead of driver buffers
         
         // Camera intrinsics
         float fx, fy;                 ///< Focal length in pixels
@@ -51,6 +72,39 @@ public:
         
         // Camera extrinsics (relative to reference camera)
         cv::Mat T_ref_cam;            ///< Transform from reference camera to this camera
+        
+        // Acquisition thread scheduling
+        int cpu_affinity = -1;        ///< CPU core to pin the acquisition thread to (-1 for the thread placement policy)
+        int realtime_priority = 0;    ///< SCHED_FIFO priority of the acquisition thread (0 for the thread placement policy)
+        
+        // Consumer backpressure
+        FrameDropPolicy drop_policy = FrameDropPolicy::QUEUE_ALL; ///< Policy for frames the consumer is behind on
+        float max_frame_age_ms = 20.0f; ///< Maximum capture-to-consume age for BOUNDED_LATENCY
+        
+        // Scaled secondary stream (e.g. the RK3588 ISP self path), delivering a
+        // model-sized copy of every frame so the TPU input needs no CPU resize
+        std::string scaled_device_path;   ///< Scaler output device path (empty to disable)
+        int scaled_width = 0;             ///< Scaled frame width in pixels
+        int scaled_height = 0;            ///< Scaled frame height in pixels
+        std::string scaled_pixel_format = "GREY"; ///< "GREY" or "NV12" (only the luma plane is used)
+        
+        // Sensor subdev of an FSIN-triggered OV9281 (e.g. /dev/v4l-subdev2),
+        // reporting the start and duration of the exposure of every frame
+        std::string sync_subdev_path;     ///< Exposure event device path (empty to disable)
+        int slice_count = 0;              ///< Bands signaled during readout, GREY only (0 for whole frames)
+        bool readout_skipping = false;    ///< Read 640x400 by skipping lines and columns instead of binning
+        
+        // Per-frame auto-exposure on GREY frames, through the settings queue of the sync subdev
+        float auto_exposure_target = 0.0f; ///< Mean level (0-255) to converge to (0 to disable)
+        float auto_exposure_max_ms = 4.0f; ///< Longest exposure before raising the gain, bounds motion blur
+    };
+    
+    /**
+     * @brief Acquisition threading mode
+     */
+    enum class AcquisitionMode {
+        REACTOR,            ///< One epoll reactor thread dequeues from all cameras
+        THREAD_PER_CAMERA   ///< One select() thread per camera (fallback)
     };
     
     /**
@@ -67,6 +121,160 @@ public:
         size_t buffer_size;           ///< Size of the buffer in bytes
         int dma_fd;                   ///< DMA file descriptor for zero-copy
         bool is_keyframe;             ///< Whether this frame is a keyframe
+        
+        // Scaled plane of the same frame (only set when a scaled stream is configured)
+        void* scaled_buffer_ptr = nullptr; ///< Pointer to the scaled luma plane
+        size_t scaled_buffer_size = 0;     ///< Size of the scaled plane in bytes
+        int scaled_dma_fd = -1;            ///< DMA file descriptor of the scaled buffer
+        int scaled_width = 0;              ///< Scaled plane width in pixels
+        int scaled_height = 0;             ///< Scaled plane height in pixels
+        int scaled_stride = 0;             ///< Scaled plane row stride in bytes
+        
+        // Exposure reported by the sensor driver (only set when a sync subdev is configured)
+        double exposure_start = 0.0;       ///< Start of exposure on CLOCK_MONOTONIC in seconds (0 if unknown)
+        double exposure_time = 0.0;        ///< Exposure duration in seconds
+        uint32_t sensor_sequence = 0;      ///< Sensor frame sequence, the target of QueueFrameSettings()
+        uint32_t applied_exposure = 0;     ///< Exposure register value the frame was exposed with
+        uint32_t applied_gain = 0;         ///< Gain register value the frame was exposed with
+        
+        // Pipeline stamps; the provider sets EXPOSURE_MID and DQBUF, later
+        // stages are stamped by the components the frame passes through
+        LatencyStamps latency;             ///< Per-stage monotonic stamps
+    };
+    
+    /**
+     * @brief Horizontal band of a frame that is still being read out
+     *
+     * Points into the capture buffer the driver is filling; the rows of the
+     * band are complete and stay valid until the frame is dequeued and
+     * released. Later bands of the same buffer are not written yet.
+     */
+    struct SliceInfo {
+        int camera_id;                ///< Camera identifier
+        uint32_t sequence;            ///< Sensor frame sequence (matches the exposure events)
+        int slice;                    ///< Band index, top to bottom
+        int num_slices;               ///< Number of bands of the frame
+        int first_row;                ///< First row of the band
+        int num_rows;                 ///< Rows in the band
+        const void* data;             ///< First pixel of the band
+        int stride;                   ///< Row stride in bytes
+        double ready_time;            ///< CLOCK_MONOTONIC time the band landed in seconds
+    };
+    
+    /**
+     * @brief Set of frames captured at the same instant by all cameras
+     *
+     * Frames are matched by their exposure midpoint when the driver reports
+     * the exposure, by their V4L2 buffer timestamp otherwise. The set only holds
+     * metadata; the underlying buffers stay owned by the driver until the set
+     * is released with ReleaseFrameSet().
+     */
+    struct FrameSet {
+        uint64_t set_id;                      ///< Monotonic frame set identifier
+        double timestamp;                     ///< Mean capture time of the frames in seconds
+        double max_skew_ms;                   ///< Largest timestamp difference within the set
+        std::vector<FrameMetadata> frames;    ///< One frame per camera, indexed by camera_id
+    };
+    
+    /**
+     * @brief Reference-counted CPU view of a frame buffer
+     *
+     * Wraps the mmap'd V4L2 buffer without copying. While a view exists the
+     * buffer is held out of the driver queue and, for DMA-BUF exported
+     * buffers, CPU access is bracketed with DMA_BUF_IOCTL_SYNC. The buffer is
+     * re-queued to the driver when the last reference is dropped, so callers
+     * must not call ReleaseFrame() for frames they created views for. The
+     * image is only valid while the view is alive and views must not outlive
+     * the provider.
+     */
+    class FrameView {
+    public:
+        ~FrameView();
+        
+        FrameView(const FrameView&) = delete;
+        FrameView& operator=(const FrameView&) = delete;
+        
+        /**
+         * @brief Get the frame metadata
+         * @return Frame metadata
+         */
+        const FrameMetadata& GetMetadata() const { return mMetadata; }
+        
+        /**
+         * @brief Get the 8-bit grayscale image (wraps the driver buffer for GREY frames)
+         * @return Image
+         */
+        const cv::Mat& GetImage() const { return mImage; }
+        
+        /**
+         * @brief Get the scaled 8-bit grayscale image (wraps the scaled buffer)
+         * @return Scaled image, empty if the frame has no scaled plane
+         */
+        const cv::Mat& GetScaledImage() const { return mScaledImage; }
+        
+    private:
+        friend class ZeroCopyFrameProvider;
+        
+        FrameView(ZeroCopyFrameProvider* provider, const FrameMetadata& metadata);
+        
+        ZeroCopyFrameProvider* mProvider;
+        FrameMetadata mMetadata;
+        cv::Mat mImage;
+        cv::Mat mScaledImage;
+        bool mCpuAccess;
+        bool mScaledCpuAccess;
+    };
+    typedef std::shared_ptr<FrameView> FrameViewPtr;
+    
+    /**
+     * @brief Per-camera frame queue statistics
+     */
+    struct FrameQueueStats {
+        uint64_t frames_enqueued;         ///< Frames handed to the consumer queue
+        uint64_t dropped_queue_full;      ///< Frames dropped because the consumer queue was full
+        uint64_t dropped_unsynchronized;  ///< Frames dropped while matching synchronized frame sets
+        uint64_t driver_sequence_gaps;    ///< Frames skipped by the driver (V4L2 sequence gaps)
+        uint64_t dropped_stale;           ///< Frames recycled by the drop policy
+        uint64_t dropped_readout_switch;  ///< Frames read out in the previous readout mode
+        uint64_t frames_consumed;         ///< Frames handed to the consumer
+        uint64_t missing_scaled_plane;    ///< Frames published without a matching scaled plane
+        double last_frame_age_ms;         ///< Capture-to-consume age of the last consumed frame
+        double mean_frame_age_ms;         ///< Mean capture-to-consume age
+        double max_frame_age_ms;          ///< Maximum capture-to-consume age
+        size_t queue_depth;               ///< Frames currently queued
+        size_t queue_capacity;            ///< Capacity of the consumer queue
+    };
+    
+    /**
+     * @brief Options of an additional frame consumer
+     *
+     * Every subscriber sees the frames of its cameras in its own queue, next
+     * to the consumer of GetNextFrame(). A buffer goes back to the driver once
+     * all consumers released it. A subscriber never holds more than
+     * max_frames_held frames, queued or as views; frames beyond that are
+     * recycled or skipped for this subscriber alone, so a slow subscriber
+     * cannot take buffers from the driver. With QUEUE_ALL the frames beyond
+     * the budget are skipped, the other policies replace the oldest queued
+     * frame.
+     */
+    struct SubscriberOptions {
+        std::string name;                  ///< Name in log messages and statistics
+        std::vector<int> camera_ids;       ///< Cameras to receive frames of (empty for all)
+        FrameDropPolicy drop_policy = FrameDropPolicy::LATEST_ONLY; ///< Policy for frames the subscriber is behind on
+        float max_frame_age_ms = 50.0f;    ///< Maximum capture-to-consume age for BOUNDED_LATENCY
+        int max_frames_held = 1;           ///< Frames queued or held as views at once
+    };
+    
+    /**
+     * @brief Per-subscriber frame statistics
+     */
+    struct SubscriberStats {
+        uint64_t frames_delivered;         ///< Frames handed to the subscriber queue
+        uint64_t frames_consumed;          ///< Frames handed to the subscriber as views
+        uint64_t dropped_busy;             ///< Frames skipped, the subscriber held max_frames_held frames
+        uint64_t dropped_stale;            ///< Queued frames recycled by the drop policy
+        size_t queue_depth;                ///< Frames currently queued
+        int views_held;                    ///< Views currently held by the subscriber
     };
     
     /**
@@ -117,12 +325,36 @@ public:
                                   float max_time_diff_ms = 10.0f,
                                   int timeout_ms = -1);
     
+    /**
+     * @brief Get the next hardware-timestamp-synchronized frame set
+     *
+     * Matches the oldest queued frame of every camera by capture time: the
+     * exposure midpoint reported by the driver, or the V4L2 buffer timestamp.
+     * Frames that cannot be part of any set within the tolerance are dropped
+     * and their buffers re-queued. A single deadline covers the whole set, so
+     * the call never waits longer than timeout_ms in total.
+     *
+     * @param frame_set Output frame set
+     * @param tolerance_ms Maximum timestamp difference within the set in milliseconds
+     * @param timeout_ms Timeout in milliseconds (0 for non-blocking, negative for infinite)
+     * @return True if a synchronized frame set was acquired, false otherwise
+     */
+    bool GetSynchronizedFrames(FrameSet& frame_set,
+                               float tolerance_ms = 2.0f,
+                               int timeout_ms = -1);
+    
     /**
      * @brief Release a frame buffer
      * @param metadata Frame metadata
      */
     void ReleaseFrame(const FrameMetadata& metadata);
     
+    /**
+     * @brief Release all frame buffers of a frame set
+     * @param frame_set Frame set
+     */
+    void ReleaseFrameSet(const FrameSet& frame_set);
+    
     /**
      * @brief Get a cv::Mat wrapper for a frame buffer (avoid using this for zero-copy)
      * @param metadata Frame metadata
@@ -130,6 +362,32 @@ public:
      */
     cv::Mat GetMatForFrame(const FrameMetadata& metadata);
     
+    /**
+     * @brief Get a cv::Mat wrapper for the scaled plane of a frame (no copy)
+     * @param metadata Frame metadata
+     * @return 8-bit grayscale wrapper, empty if the frame has no scaled plane
+     */
+    cv::Mat GetScaledMatForFrame(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Create a reference-counted zero-copy view of a frame
+     *
+     * Takes over ownership of the frame: the buffer returns to the driver
+     * automatically when the last reference to the view is dropped.
+     *
+     * @param metadata Frame metadata (from GetNextFrame or GetSynchronizedFrames)
+     * @return Frame view, or nullptr if the frame could not be mapped (the frame is released)
+     */
+    FrameViewPtr CreateFrameView(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Create views for all frames of a frame set
+     * @param frame_set Frame set (ownership of its frames moves to the views)
+     * @param views Output views, indexed by camera_id
+     * @return True if all views were created, false otherwise (all frames are released)
+     */
+    bool CreateFrameViews(const FrameSet& frame_set, std::vector<FrameViewPtr>& views);
+    
     /**
      * @brief Get the DMA file descriptor for a frame buffer
      * @param metadata Frame metadata
@@ -146,6 +404,14 @@ public:
     
     /**
      * @brief Set a new camera configuration
+     *
+     * While acquisition is running only the frame size, rate and readout of an
+     * OV9281 with a sync subdev can change, to trade resolution for rate:
+     * 1280x800 up to 180 FPS, or 640x400 binned or skipped up to 360 FPS.
+     * The sensor switches on a frame boundary and the receiver is stream-cycled
+     * on the mapped buffers, dropping the frames in flight. The camera
+     * intrinsics are not rescaled, and the cameras of a synchronized rig
+     * should be switched together.
      * @param camera_id Camera identifier
      * @param config New camera configuration
      * @return True if configuration was set successfully, false otherwise
@@ -172,12 +438,182 @@ public:
      */
     float GetCurrentFrameRate(int camera_id) const;
     
+    /**
+     * @brief Get frame queue and drop statistics
+     * @param camera_id Camera identifier
+     * @return Frame queue statistics (all zero for an invalid camera)
+     */
+    FrameQueueStats GetFrameQueueStats(int camera_id) const;
+    
+    /**
+     * @brief Set the acquisition threading mode
+     *
+     * In REACTOR mode the single reactor thread uses the cpu_affinity and
+     * realtime_priority of camera 0. If the epoll reactor cannot be created,
+     * acquisition falls back to THREAD_PER_CAMERA.
+     *
+     * @param mode Acquisition mode
+     * @return True if mode was set successfully, false if acquisition is running
+     */
+    bool SetAcquisitionMode(AcquisitionMode mode);
+    
+    /**
+     * @brief Get the acquisition threading mode
+     * @return Current acquisition mode
+     */
+    AcquisitionMode GetAcquisitionMode() const;
+    
+    /**
+     * @brief Start recording published frames to a capture file
+     *
+     * Every frame handed to the consumer queue is appended, with its scaled
+     * plane if present, from the acquisition thread. IMU samples are added
+     * with RecordImuSample(). Can be called while acquisition is running.
+     *
+     * @param path Capture file path (truncated if it exists)
+     * @return True if recording started, false otherwise
+     */
+    bool StartRecording(const std::string& path);
+    
+    /**
+     * @brief Stop recording and close the capture file
+     */
+    void StopRecording();
+    
+    /**
+     * @brief Check if frames are being recorded
+     * @return True if recording, false otherwise
+     */
+    bool IsRecording() const;
+    
+    /**
+     * @brief Append an IMU sample to the capture file (thread-safe)
+     * @param sample IMU sample, timestamped on the frame clock
+     * @return True if the sample was recorded, false if not recording or on error
+     */
+    bool RecordImuSample(const CaptureImuSample& sample);
+    
+    /**
+     * @brief Serve frames from a capture file instead of the cameras
+     *
+     * Must be called before Initialize(). The capture file must hold as many
+     * cameras as the provider was constructed with; their resolution, frame
+     * rate and pixel format are taken from the file. Frames are served
+     * through the regular API straight out of the read-only file mapping,
+     * with timestamps shifted onto the current CLOCK_MONOTONIC timeline.
+     *
+     * @param path Capture file path
+     * @param playback_rate Speed relative to capture time (1.0 for real time,
+     *                      0 to serve as fast as the consumer drains the queues)
+     * @return True if the replay source was set, false otherwise
+     */
+    bool SetReplaySource(const std::string& path, float playback_rate = 1.0f);
+    
+    /**
+     * @brief Check if the replay thread has served every frame of the capture file
+     * @return True once replay reached the end of the file, false otherwise
+     */
+    bool IsReplayFinished() const;
+    
+    /**
+     * @brief Get recorded IMU samples in a time range during replay
+     * @param start_time Start time in seconds (inclusive, replay timeline)
+     * @param end_time End time in seconds (inclusive, replay timeline)
+     * @param samples Output IMU samples with shifted timestamps
+     * @return True if replaying, false otherwise
+     */
+    bool GetReplayImuSamples(double start_time, double end_time,
+                             std::vector<CaptureImuSample>& samples) const;
+    
     /**
      * @brief Register a callback for new frames
      * @param callback Function to call when a new frame is available
      */
     void RegisterFrameCallback(std::function<void(const FrameMetadata&)> callback);
     
+    /**
+     * @brief Add a frame consumer with its own queue and drop policy
+     *
+     * Can be called while acquisition is running; the subscriber gets the
+     * frames published from then on. The frames held by all subscribers of
+     * a camera must leave the driver at least two buffers and the consumer
+     * of GetNextFrame() one.
+     *
+     * @param options Subscriber options
+     * @return Subscriber identifier, -1 on error
+     */
+    int Subscribe(const SubscriberOptions& options);
+    
+    /**
+     * @brief Remove a subscriber and release its queued frames
+     *
+     * Views the subscriber still holds stay valid and release their buffers
+     * when dropped. A thread waiting in GetSubscribedFrame() returns.
+     *
+     * @param subscriber_id Subscriber identifier
+     */
+    void Unsubscribe(int subscriber_id);
+    
+    /**
+     * @brief Get the next frame of a subscriber as a zero-copy view
+     *
+     * The buffer is shared with the other consumers of the frame and returns
+     * to the driver when every consumer released it; dropping the view is
+     * this subscriber's release. Each subscriber is drained by one thread.
+     *
+     * @param subscriber_id Subscriber identifier
+     * @param timeout_ms Timeout in milliseconds (0 for non-blocking, negative for infinite)
+     * @return Frame view, nullptr on timeout, error or when acquisition stops
+     */
+    FrameViewPtr GetSubscribedFrame(int subscriber_id, int timeout_ms = -1);
+    
+    /**
+     * @brief Get the frame statistics of a subscriber
+     * @param subscriber_id Subscriber identifier
+     * @return Subscriber statistics (all zero for an invalid subscriber)
+     */
+    SubscriberStats GetSubscriberStats(int subscriber_id) const;
+    
+    /**
+     * @brief Register a callback for frame bands signaled during readout
+     *
+     * Called on the acquisition thread for cameras with a slice_count, before
+     * the whole frame is published; the callback must not block.
+     *
+     * @param callback Function to call when a band of a frame has landed
+     */
+    void RegisterSliceCallback(std::function<void(const SliceInfo&)> callback);
+    
+    /**
+     * @brief Queue exposure and gain for a given sensor frame
+     *
+     * The driver writes the settings in a group hold right before the frame,
+     * so they land exactly on it; settings queued too late land on the next
+     * frame. Every frame reports the values it was exposed with in
+     * applied_exposure and applied_gain.
+     *
+     * @param camera_id Camera identifier (needs a sync subdev)
+     * @param sequence Sensor frame sequence the settings apply to
+     * @param exposure Exposure register value (negative to keep)
+     * @param gain Gain register value (negative to keep)
+     * @return True if the settings were queued, false otherwise
+     */
+    bool QueueFrameSettings(int camera_id, uint32_t sequence, int exposure, int gain);
+    
+    /**
+     * @brief Retime the FSIN trigger of all sensors
+     *
+     * Lets the frame timing follow an external clock such as the display
+     * vsync. The driver bounds the period to the trim of the frame rate mode
+     * and the phase shift to a quarter period.
+     *
+     * @param camera_id Camera whose sync subdev drives the trigger
+     * @param period_ns Trigger period (0 to keep)
+     * @param phase_ns One-time shift of the next pulse
+     * @return True if the trigger was retimed, false otherwise
+     */
+    bool AdjustFrameTiming(int camera_id, int64_t period_ns, int64_t phase_ns);
+    
     /**
      * @brief Enable or disable zero-copy mode
      * @param camera_id Camera identifier
@@ -193,6 +629,18 @@ public:
      */
     bool IsZeroCopySupported(int camera_id) const;
     
+    /**
+     * @brief Get the DMA buffer pool the cameras with dma_pool_buffers capture into
+     *
+     * The pool is allocated by Initialize() for all such cameras, from the
+     * CMA heap when there is one, and its buffers stay in place until the
+     * provider is destroyed. Devices can import all of them before the
+     * capture starts; the dma_fd and buffer_ptr of a frame are those of a
+     * pool buffer.
+     * @return The pool, nullptr if no camera captures into it
+     */
+    std::shared_ptr<DmaBufferPool> GetBufferPool() const;
+    
     /**
      * @brief Get the latest error message
      * @return Latest error message
@@ -212,17 +660,111 @@ private:
         size_t length;
         int dma_fd;
         bool in_use;
+        int pool_handle;              ///< Buffer of mBufferPool (-1 for a driver buffer)
+        int refs = 0;                 ///< Consumers holding the dequeued buffer (guarded by the StreamControl mutex)
     };
     std::vector<std::vector<BufferInfo>> mBuffers;
     
+    // Shared DMA-BUFs of the cameras with dma_pool_buffers, sized by the
+    // largest image those cameras were configured for
+    std::shared_ptr<DmaBufferPool> mBufferPool;
+    std::vector<size_t> mImageSizes;
+    
+    // Scaled secondary streams, one per camera. Dequeued buffers of the
+    // primary and the scaled stream are paired by timestamp on the thread
+    // serving the camera before the frame is published.
+    struct ScaledBuffer {
+        int index;
+        double timestamp;
+        size_t bytesused;
+    };
+    struct ScaledStream {
+        int handle = -1;
+        uint32_t buf_type = 0;        ///< V4L2 buffer type (single- or multi-planar)
+        int stride = 0;               ///< Row stride of the luma plane in bytes
+        bool active = false;          ///< Streaming and paired by the acquisition thread
+        std::vector<BufferInfo> buffers;
+        std::deque<FrameMetadata> pending_frames;
+        std::deque<ScaledBuffer> pending_scaled;
+    };
+    std::vector<ScaledStream> mScaledStreams;
+    
     // Thread management
+    AcquisitionMode mAcquisitionMode;
+    int mEpollFd;
     std::vector<std::thread> mAcquisitionThreads;
     std::atomic<bool> mRunning;
-    std::mutex mFrameQueueMutex;
-    std::condition_variable mFrameCondition;
     
-    // Frame queues
-    std::vector<std::queue<FrameMetadata>> mFrameQueues;
+    // Per-camera acquisition state, only touched by the thread dequeuing that camera
+    struct AcquisitionState {
+        uint64_t frame_counter = 0;
+        uint32_t last_sequence = 0;
+        std::chrono::time_point<std::chrono::steady_clock> last_fps_update;
+        double exposure_s = 0.0;      ///< Exposure time read at stream start (0 if unknown)
+        int exposure_fd = -1;         ///< Sync subdev delivering exposure events (-1 if none)
+        struct Exposure {
+            uint32_t sequence;
+            double start;
+            double duration;
+            uint32_t exposure;
+            uint32_t gain;
+            int width;
+            int height;
+        };
+        std::deque<Exposure> exposures; ///< Reported exposures not matched to a buffer yet
+        bool has_exposure_sequence = false;
+        uint32_t last_exposure_sequence = 0; ///< Sensor sequence of the last dequeued frame
+        int exposure_width = 0;       ///< Readout size of the last dequeued frame (0 if not reported)
+        int exposure_height = 0;
+        bool ae_pending = false;      ///< Auto-exposure request not seen on a frame yet
+        uint32_t ae_sequence = 0;
+        uint32_t ae_exposure = 0;
+        uint32_t ae_gain = 0;
+    };
+    std::vector<AcquisitionState> mAcquisitionStates;
+    
+    // Buffers queued to the driver in capture order, for cameras delivering
+    // slices. Filled by ReleaseFrame on the consumer thread and drained by
+    // the acquisition thread.
+    struct QueuedBuffers {
+        std::mutex mutex;
+        std::deque<uint32_t> indices;
+    };
+    std::vector<std::unique_ptr<QueuedBuffers>> mQueuedBuffers;
+    
+    // Held by the acquisition thread while it handles a camera and by
+    // ReleaseFrame, so a readout switch can cycle the stream in between.
+    // Recursive since frames are released from the acquisition thread.
+    struct StreamControl {
+        std::recursive_mutex mutex;
+        bool restarted = false;       ///< Stream cycled since the acquisition thread last waited
+    };
+    std::vector<std::unique_ptr<StreamControl>> mStreamControls;
+    
+    // Frame queues: one lock-free SPSC ring per camera, filled by the
+    // acquisition thread of that camera and drained by a single consumer
+    // thread (GetNextFrame / GetSynchronizedFrames). Each ring has an
+    // eventfd the producer signals after every push.
+    typedef SPSCRingBuffer<FrameMetadata> FrameRing;
+    std::vector<std::unique_ptr<FrameRing>> mFrameQueues;
+    std::vector<int> mFrameEventFds;
+    uint64_t mNextFrameSetId;
+    
+    // Drop counters (see FrameQueueStats)
+    struct QueueCounters {
+        std::atomic<uint64_t> frames_enqueued{0};
+        std::atomic<uint64_t> dropped_queue_full{0};
+        std::atomic<uint64_t> dropped_unsynchronized{0};
+        std::atomic<uint64_t> driver_sequence_gaps{0};
+        std::atomic<uint64_t> dropped_stale{0};
+        std::atomic<uint64_t> dropped_readout_switch{0};
+        std::atomic<uint64_t> frames_consumed{0};
+        std::atomic<uint64_t> missing_scaled_plane{0};
+        std::atomic<uint64_t> last_frame_age_us{0};
+        std::atomic<uint64_t> total_frame_age_us{0};
+        std::atomic<uint64_t> max_frame_age_us{0};
+    };
+    std::vector<std::unique_ptr<QueueCounters>> mQueueCounters;
     
     // Statistics
     std::vector<std::atomic<float>> mCurrentFrameRates;
@@ -231,10 +773,41 @@ private:
     
     // Error handling
     std::string mLastErrorMessage;
-    std::mutex mErrorMutex;
+    mutable std::mutex mErrorMutex;
     
     // Callbacks
     std::function<void(const FrameMetadata&)> mFrameCallback;
+    std::function<void(const SliceInfo&)> mSliceCallback;
+    
+    // Subscribers, each with a queue filled by the thread publishing a frame
+    // and drained by the subscriber's thread. Acquisition threads lock
+    // mSubscribersMutex, then a subscriber's mutex; frames are released
+    // outside the subscriber mutex since releasing takes the StreamControl
+    // mutex the acquisition thread holds while publishing.
+    struct Subscriber {
+        int id;
+        SubscriberOptions options;
+        std::mutex mutex;
+        std::condition_variable frame_available;
+        std::deque<FrameMetadata> frames;
+        bool closed = false;
+        std::atomic<int> views_held{0};
+        std::atomic<uint64_t> frames_delivered{0};
+        std::atomic<uint64_t> frames_consumed{0};
+        std::atomic<uint64_t> dropped_busy{0};
+        std::atomic<uint64_t> dropped_stale{0};
+    };
+    std::vector<std::shared_ptr<Subscriber>> mSubscribers;
+    mutable std::mutex mSubscribersMutex;
+    int mNextSubscriberId;
+    
+    // Recording and replay
+    FrameCaptureWriter mRecorder;
+    FrameCaptureReader mReplayReader;
+    std::string mReplayPath;
+    float mReplayRate;
+    double mReplayTimeOffset;
+    std::atomic<bool> mReplayFinished;
     
     // Private methods
     
@@ -271,6 +844,20 @@ private:
      */
     void FreeBuffers(int camera_id);
     
+    /**
+     * @brief Allocate the DMA buffer pool for the cameras with dma_pool_buffers
+     * @return True if successful or no camera uses the pool, false otherwise
+     */
+    bool AllocateBufferPool();
+    
+    /**
+     * @brief Prepare a v4l2_buffer of a camera for QBUF or DQBUF
+     * @param camera_id Camera identifier
+     * @param buf Buffer to initialize
+     * @param index Buffer index
+     */
+    void InitCaptureBuffer(int camera_id, struct v4l2_buffer& buf, unsigned int index) const;
+    
     /**
      * @brief Start streaming from a camera
      * @param camera_id Camera identifier
@@ -284,12 +871,237 @@ private:
      */
     void StopStreaming(int camera_id);
     
+    /**
+     * @brief Switch the readout mode of a streaming camera
+     * @param camera_id Camera identifier
+     * @param config Configuration with the new frame size and rate
+     * @return True if successful, false otherwise
+     */
+    bool SwitchReadout(int camera_id, const CameraConfig& config);
+    
+    /**
+     * @brief Requeue the buffers the consumer does not hold and restart the receiver
+     * @param camera_id Camera identifier
+     * @return True if successful, false otherwise
+     */
+    bool RestartStreaming(int camera_id);
+    
+    /**
+     * @brief Open, configure and map the scaled stream of a camera
+     * @param camera_id Camera identifier
+     * @return True if successful (or no scaled stream configured), false otherwise
+     */
+    bool OpenScaledStream(int camera_id);
+    
+    /**
+     * @brief Unmap and close the scaled stream of a camera
+     * @param camera_id Camera identifier
+     */
+    void CloseScaledStream(int camera_id);
+    
+    /**
+     * @brief Hand a scaled buffer back to the driver
+     * @param camera_id Camera identifier
+     * @param buffer_index Buffer index
+     * @return True if successful, false otherwise
+     */
+    bool QueueScaledBuffer(int camera_id, int buffer_index);
+    
+    /**
+     * @brief Dequeue one filled buffer from the scaled stream of a camera
+     * @param camera_id Camera identifier
+     * @return False on a fatal dequeue error, true otherwise
+     */
+    bool DequeueScaledFrame(int camera_id);
+    
+    /**
+     * @brief Stop pairing a failed scaled stream and publish its pending frames
+     * @param camera_id Camera identifier
+     */
+    void DisableScaledStream(int camera_id);
+    
+    /**
+     * @brief Pair pending primary frames with scaled buffers and publish them
+     * @param camera_id Camera identifier
+     */
+    void MatchScaledFrames(int camera_id);
+    
+    /**
+     * @brief Hand a complete frame to the callback and the consumer queue
+     * @param metadata Frame metadata
+     */
+    void PublishFrame(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Queue a published frame for every subscriber of its camera
+     *
+     * The frame gets a buffer reference per subscriber it is queued for.
+     * Frames recycled to stay within a subscriber's budget are released.
+     * @param metadata Frame metadata
+     */
+    void PublishToSubscribers(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Add a consumer reference to the buffer of a dequeued frame
+     * @param metadata Frame metadata
+     */
+    void AddFrameReference(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Update the frame rate estimate of a camera (acquisition thread only)
+     * @param camera_id Camera identifier
+     */
+    void UpdateFrameRate(int camera_id);
+    
+    /**
+     * @brief Subscribe to the exposure events of the sync subdev of a camera
+     * @param camera_id Camera identifier
+     * @return True if successful or no sync subdev is configured, false otherwise
+     */
+    bool OpenExposureEvents(int camera_id);
+    
+    /**
+     * @brief Read the queued events of the sync subdev of a camera
+     *
+     * Exposures are kept for MatchExposure(), slices are delivered right away.
+     *
+     * @param camera_id Camera identifier
+     */
+    void DrainSyncEvents(int camera_id);
+    
+    /**
+     * @brief Hand a band of the buffer being filled to the slice callback
+     * @param camera_id Camera identifier
+     * @param slice Band reported by the driver (data is filled in here)
+     */
+    void DeliverSlice(int camera_id, SliceInfo& slice);
+    
+    /**
+     * @brief Record a buffer handed to the driver, in capture order
+     * @param camera_id Camera identifier
+     * @param index Buffer index
+     */
+    void TrackQueuedBuffer(int camera_id, uint32_t index);
+    
+    /**
+     * @brief Drain the exposure events of a camera and attach the one of a frame
+     * @param camera_id Camera identifier
+     * @param metadata Dequeued frame, exposure_start and exposure_time are set on a match
+     * @param start_of_exposure Whether the buffer is stamped at the start of the exposure
+     * @return True if the exposure of the frame was found, false otherwise
+     */
+    bool MatchExposure(int camera_id, FrameMetadata& metadata, bool start_of_exposure);
+    
+    /**
+     * @brief Step the per-frame auto-exposure of a camera with a dequeued frame
+     *
+     * Waits for the frame the previous request landed on, so every step
+     * measures its own effect and the loop converges without oscillating.
+     *
+     * @param camera_id Camera identifier
+     * @param metadata Dequeued frame with its applied exposure
+     */
+    void RunAutoExposure(int camera_id, const FrameMetadata& metadata);
+    
+    /**
+     * @brief Capture time of a frame, its exposure midpoint when known
+     * @param metadata Frame metadata
+     * @return Capture time in seconds
+     */
+    static double CaptureTime(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Append a frame to the capture file
+     * @param metadata Frame metadata
+     */
+    void RecordFrame(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Map the replay capture file and set up the cameras from it
+     * @return True if successful, false otherwise
+     */
+    bool InitializeReplay();
+    
+    /**
+     * @brief Replay thread function serving all cameras from the capture file
+     */
+    void ReplayThreadFunc();
+    
     /**
      * @brief Acquisition thread function
      * @param camera_id Camera identifier
      */
     void AcquisitionThreadFunc(int camera_id);
     
+    /**
+     * @brief Reactor thread function serving all cameras through epoll
+     */
+    void ReactorThreadFunc();
+    
+    /**
+     * @brief Dequeue one filled buffer from a camera and publish it
+     * @param camera_id Camera identifier
+     * @return False on a fatal dequeue error, true otherwise
+     */
+    bool DequeueFrame(int camera_id);
+    
+    /**
+     * @brief Create the epoll set over all open camera fds
+     * @return True if successful, false otherwise
+     */
+    bool CreateReactor();
+    
+    /**
+     * @brief Close the epoll set
+     */
+    void DestroyReactor();
+    
+    /**
+     * @brief Apply CPU pinning and real-time priority to the calling thread
+     *
+     * Without either setting the thread is placed as CAMERA_ACQUISITION by
+     * the installed ThreadPlacementPolicy, if any.
+     *
+     * @param config Camera configuration holding the scheduling settings
+     */
+    void ApplyThreadScheduling(const CameraConfig& config);
+    
+    /**
+     * @brief Create the per-camera frame rings and wakeup eventfds
+     */
+    void CreateFrameQueues();
+    
+    /**
+     * @brief Drop all queued frames of every camera
+     */
+    void ClearFrameQueues();
+    
+    /**
+     * @brief Recycle queued frames according to the camera's drop policy (consumer only)
+     * @param camera_id Camera identifier
+     */
+    void ApplyDropPolicy(int camera_id);
+    
+    /**
+     * @brief Record the capture-to-consume age of a frame handed to the consumer
+     * @param metadata Frame metadata
+     */
+    void RecordFrameConsumed(const FrameMetadata& metadata);
+    
+    /**
+     * @brief Wait until one of the given cameras signals a new frame
+     * @param camera_ids Cameras to wait for
+     * @param timeout_ms Timeout in milliseconds (negative for infinite)
+     * @return True if woken by a frame event, false on timeout or error
+     */
+    bool WaitForFrameEvent(const std::vector<int>& camera_ids, int timeout_ms);
+    
+    /**
+     * @brief Wake up a consumer waiting on a camera
+     * @param camera_id Camera identifier
+     */
+    void SignalFrameEvent(int camera_id);
+    
     /**
      * @brief Set an error message
      * @param message Error message
@@ -301,7 +1113,7 @@ private:
      * @param camera_id Camera identifier
      * @return True if supported, false otherwise
      */
-    bool CheckDmaSupport(int camera_id);
+    bool CheckDmaSupport(int camera_id) const;
     
     /**
      * @brief Export a DMA buffer
@@ -310,6 +1122,14 @@ private:
      * @return DMA file descriptor, or -1 on error
      */
     int ExportDmaBuffer(int camera_id, int buffer_index);
+    
+    /**
+     * @brief Begin or end CPU access to a DMA-BUF exported buffer
+     * @param dma_fd DMA-BUF file descriptor
+     * @param flags DMA_BUF_SYNC_* flags
+     * @return True if successful (or no DMA-BUF), false otherwise
+     */
+    bool SyncDmaBuffer(int dma_fd, uint64_t flags);
 };
 
 } // namespace ORB_SLAM3
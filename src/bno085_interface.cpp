@@ -1,4 +1,6 @@
 #include "include/bno085_interface.hpp"
+#include "include/thread_placement.hpp"
+#include "ORB_SLAM3/include/Trace.h"
 #include <iostream>
 #include <chrono>
 #include <algorithm>
@@ -8,8 +10,17 @@
 #include <sys/ioctl.h>
 #include <linux/i2c-dev.h>
 #include <linux/spi/spidev.h>
+#include <linux/gpio.h>
+#include <poll.h>
 #include <termios.h>
 #include <cmath>
+#include <dirent.h>
+#include <fstream>
+
+// NEON for the batched calibration on the A55 cores
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
 
 // For BNO085 specific registers and commands
 #define BNO085_I2C_ADDR_DEFAULT 0x4A
@@ -37,6 +48,69 @@
 namespace ORB_SLAM3
 {
 
+namespace {
+
+// Longest wait for a data-ready edge or IIO scan before the running flag is checked again
+constexpr int kDataReadyTimeoutMs = 100;
+
+// Measurements kept for range queries (4 s at 1 kHz)
+constexpr size_t kMeasurementCapacity = 4096;
+
+// Scans read per buffer read, corrected as one block
+constexpr size_t kIioMaxScans = BNO085Interface::SampleBlock::kCapacity;
+// Scans the kernel buffer holds
+constexpr int kIioBufferLength = 256;
+
+const char* const kIioAccelChannels[3] = {"in_accel_x", "in_accel_y", "in_accel_z"};
+const char* const kIioGyroChannels[3] = {"in_anglvel_x", "in_anglvel_y", "in_anglvel_z"};
+
+// v = M * v - offset for n samples of a vector sensor, in place
+void correctAxes(const Eigen::Matrix3f& M, const Eigen::Vector3f& offset,
+                 float* x, float* y, float* z, size_t n)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t offset_x = vdupq_n_f32(-offset.x());
+    const float32x4_t offset_y = vdupq_n_f32(-offset.y());
+    const float32x4_t offset_z = vdupq_n_f32(-offset.z());
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t vx = vld1q_f32(x + i);
+        const float32x4_t vy = vld1q_f32(y + i);
+        const float32x4_t vz = vld1q_f32(z + i);
+        float32x4_t cx = vfmaq_n_f32(offset_x, vx, M(0, 0));
+        float32x4_t cy = vfmaq_n_f32(offset_y, vx, M(1, 0));
+        float32x4_t cz = vfmaq_n_f32(offset_z, vx, M(2, 0));
+        cx = vfmaq_n_f32(cx, vy, M(0, 1));
+        cy = vfmaq_n_f32(cy, vy, M(1, 1));
+        cz = vfmaq_n_f32(cz, vy, M(2, 1));
+        cx = vfmaq_n_f32(cx, vz, M(0, 2));
+        cy = vfmaq_n_f32(cy, vz, M(1, 2));
+        cz = vfmaq_n_f32(cz, vz, M(2, 2));
+        vst1q_f32(x + i, cx);
+        vst1q_f32(y + i, cy);
+        vst1q_f32(z + i, cz);
+    }
+#endif
+    for (; i < n; ++i) {
+        const float vx = x[i];
+        const float vy = y[i];
+        const float vz = z[i];
+        x[i] = M(0, 0) * vx + M(0, 1) * vy + M(0, 2) * vz - offset.x();
+        y[i] = M(1, 0) * vx + M(1, 1) * vy + M(1, 2) * vz - offset.y();
+        z[i] = M(2, 0) * vx + M(2, 1) * vy + M(2, 2) * vz - offset.z();
+    }
+}
+
+// Current time on the CLOCK_MONOTONIC timeline shared with the cameras
+double steadyNowSeconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count() / 1e9;
+}
+
+} // namespace
+
 //------------------------------------------------------------------------------
 // Constructor & Destructor
 //------------------------------------------------------------------------------
@@ -44,8 +118,12 @@ namespace ORB_SLAM3
 BNO085Interface::BNO085Interface(const Config& config)
     : mConfig(config),
       mDeviceHandle(-1),
+      mDataReadyFd(-1),
+      mIioScanSize(0),
       mRunning(false),
-      mMaxQueueSize(1000),
+      mMeasurements(kMeasurementCapacity, IMU::Point(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0)),
+      mReadSequence(0),
+      mTimeOffset(0.0),
       mIsConnected(false),
       mSensorStatus(0),
       mTemperature(0.0f)
@@ -79,7 +157,8 @@ BNO085Interface::BNO085Interface(const Config& config)
     
     std::cout << "BNO085Interface created with " 
               << (mConfig.interface_type == Interface::I2C ? "I2C" : 
-                 (mConfig.interface_type == Interface::SPI ? "SPI" : "UART"))
+                 (mConfig.interface_type == Interface::SPI ? "SPI" :
+                 (mConfig.interface_type == Interface::UART ? "UART" : "IIO")))
               << " interface." << std::endl;
 }
 
@@ -116,6 +195,13 @@ bool BNO085Interface::Initialize()
         return false;
     }
     
+    // Request the data-ready line
+    if (mConfig.acquisition_mode == AcquisitionMode::DATA_READY_GPIO && !OpenDataReadyLine()) {
+        std::cerr << "Failed to open BNO085 data-ready line." << std::endl;
+        CloseInterface();
+        return false;
+    }
+    
     // Reset the sensor
     if (!Reset()) {
         std::cerr << "Failed to reset BNO085." << std::endl;
@@ -169,6 +255,12 @@ bool BNO085Interface::StartAcquisition()
         return false;
     }
     
+    // Start the kernel driver's triggered buffer
+    if (mConfig.interface_type == Interface::IIO && !WriteIioAttribute("buffer/enable", "1")) {
+        std::cerr << "Failed to enable BNO085 IIO buffer." << std::endl;
+        return false;
+    }
+    
     // Start acquisition thread
     mRunning = true;
     mAcquisitionThread = std::thread(&BNO085Interface::AcquisitionThreadFunc, this);
@@ -195,6 +287,10 @@ void BNO085Interface::StopAcquisition()
         mAcquisitionThread.join();
     }
     
+    if (mConfig.interface_type == Interface::IIO) {
+        WriteIioAttribute("buffer/enable", "0");
+    }
+    
     std::cout << "BNO085 acquisition stopped." << std::endl;
 }
 
@@ -202,54 +298,48 @@ std::vector<IMU::Point> BNO085Interface::GetMeasurements(size_t max_samples)
 {
     std::vector<IMU::Point> measurements;
     
-    // Lock data mutex
-    std::unique_lock<std::mutex> lock(mDataMutex);
+    // Lock the cursor only, the acquisition thread keeps writing
+    std::lock_guard<std::mutex> lock(mDataMutex);
     
-    // Determine how many samples to retrieve
-    size_t num_samples = max_samples > 0 ? std::min(max_samples, mMeasurementQueue.size()) : mMeasurementQueue.size();
-    
-    // Reserve space for measurements
-    measurements.reserve(num_samples);
-    
-    // Get measurements from queue
-    for (size_t i = 0; i < num_samples; ++i) {
-        measurements.push_back(mMeasurementQueue.front());
-        mMeasurementQueue.pop();
+    while (true) {
+        TimestampRingBuffer<IMU::Point>::Range range = mMeasurements.GetSince(mReadSequence);
+        
+        // Determine how many samples to retrieve
+        size_t num_samples = max_samples > 0 ? std::min(max_samples, range.size()) : range.size();
+        
+        // Get measurements from the ring
+        measurements.clear();
+        measurements.reserve(num_samples);
+        for (size_t i = 0; i < num_samples; ++i) {
+            measurements.push_back(range[i]);
+        }
+        
+        // Lapped while copying, start again from the oldest measurement kept
+        if (mMeasurements.IsValid(range)) {
+            mReadSequence = range.GetBeginSequence() + num_samples;
+            return measurements;
+        }
     }
-    
-    return measurements;
 }
 
 std::vector<IMU::Point> BNO085Interface::GetMeasurementsInTimeRange(double start_time, double end_time)
 {
     std::vector<IMU::Point> measurements;
-    std::vector<IMU::Point> temp_measurements;
-    
-    // Lock data mutex
-    std::unique_lock<std::mutex> lock(mDataMutex);
-    
-    // Get all measurements
-    size_t queue_size = mMeasurementQueue.size();
-    temp_measurements.reserve(queue_size);
-    
-    for (size_t i = 0; i < queue_size; ++i) {
-        temp_measurements.push_back(mMeasurementQueue.front());
-        mMeasurementQueue.pop();
-    }
     
-    // Filter measurements by time range
-    for (const auto& point : temp_measurements) {
-        if (point.t >= start_time && point.t <= end_time) {
-            measurements.push_back(point);
-        }
+    while (true) {
+        TimestampRingBuffer<IMU::Point>::Range range = mMeasurements.GetRange(start_time, end_time);
+        measurements.assign(range.begin(), range.end());
         
-        // If measurement is after end_time, put it back in the queue
-        if (point.t > end_time) {
-            mMeasurementQueue.push(point);
+        // Lapped while copying, the oldest measurements are gone
+        if (mMeasurements.IsValid(range)) {
+            return measurements;
         }
     }
-    
-    return measurements;
+}
+
+const TimestampRingBuffer<IMU::Point>& BNO085Interface::GetMeasurementBuffer() const
+{
+    return mMeasurements;
 }
 
 Eigen::Quaternionf BNO085Interface::GetOrientation()
@@ -296,6 +386,11 @@ bool BNO085Interface::Reset()
         return false;
     }
     
+    // The kernel driver owns the sensor and resets it at probe
+    if (mConfig.interface_type == Interface::IIO) {
+        return true;
+    }
+    
     // Reset the sensor (implementation depends on specific BNO085 commands)
     // This is a simplified implementation
     
@@ -398,12 +493,26 @@ void BNO085Interface::SetBias(const IMU::Bias& bias)
 
 Sophus::SE3<float> BNO085Interface::GetImuToCameraTransform() const
 {
+    std::lock_guard<std::mutex> lock(mExtrinsicMutex);
     return mT_bc;
 }
 
 void BNO085Interface::SetImuToCameraTransform(const Sophus::SE3<float>& T_bc)
 {
+    std::lock_guard<std::mutex> lock(mExtrinsicMutex);
+    mT_bc = T_bc;
+}
+
+double BNO085Interface::GetTimeOffset() const
+{
+    return mTimeOffset;
+}
+
+void BNO085Interface::SetImuToCameraCalibration(const Sophus::SE3<float>& T_bc, double time_offset)
+{
+    std::lock_guard<std::mutex> lock(mExtrinsicMutex);
     mT_bc = T_bc;
+    mTimeOffset = time_offset;
 }
 
 bool BNO085Interface::IsConnected() const
@@ -413,6 +522,11 @@ bool BNO085Interface::IsConnected() const
         return false;
     }
     
+    // The kernel driver only registers the IIO device for a responding sensor
+    if (mConfig.interface_type == Interface::IIO) {
+        return true;
+    }
+    
     // Check if sensor is responding (implementation depends on specific BNO085 commands)
     // This is a simplified implementation
     
@@ -491,12 +605,22 @@ std::string BNO085Interface::GetFirmwareVersion() const
     return "Unknown";
 }
 
+void BNO085Interface::RegisterMeasurementCallback(std::function<void(const IMU::Point&)> callback)
+{
+    mMeasurementCallback = std::move(callback);
+}
+
 //------------------------------------------------------------------------------
 // Private Methods
 //------------------------------------------------------------------------------
 
 bool BNO085Interface::OpenInterface()
 {
+    // With the kernel driver bound, the sensor is read through its IIO buffer
+    if (mConfig.interface_type == Interface::IIO) {
+        return OpenIioBuffer();
+    }
+    
     // Open the appropriate interface based on configuration
     
     // I2C interface
@@ -620,6 +744,12 @@ void BNO085Interface::CloseInterface()
         close(mDeviceHandle);
         mDeviceHandle = -1;
     }
+    
+    // Release the data-ready line
+    if (mDataReadyFd >= 0) {
+        close(mDataReadyFd);
+        mDataReadyFd = -1;
+    }
 }
 
 bool BNO085Interface::ConfigureSensor()
@@ -627,6 +757,19 @@ bool BNO085Interface::ConfigureSensor()
     // Configure the sensor based on the current configuration
     // This is a simplified implementation
     
+    // For the kernel driver, set the rate of the buffered channels
+    if (mConfig.interface_type == Interface::IIO) {
+        const std::string rate = std::to_string(static_cast<int>(mConfig.sample_rate_hz));
+        for (int i = 0; i < 3; ++i) {
+            if (!WriteIioAttribute(std::string(kIioAccelChannels[i]) + "_sampling_frequency", rate) ||
+                !WriteIioAttribute(std::string(kIioGyroChannels[i]) + "_sampling_frequency", rate)) {
+                std::cerr << "Failed to set BNO085 IIO sampling frequency." << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    
     // For I2C interface
     if (mConfig.interface_type == Interface::I2C) {
         // Set operation mode
@@ -713,7 +856,7 @@ bool BNO085Interface::ConfigureSensor()
     return true;
 }
 
-bool BNO085Interface::ReadRawData()
+bool BNO085Interface::ReadRawData(double timestamp)
 {
     // Read raw data from the sensor
     // This is a simplified implementation
@@ -751,11 +894,6 @@ bool BNO085Interface::ReadRawData()
                 float gyro_y = 0.0f;
                 float gyro_z = 0.0f;
                 
-                // Get timestamp
-                double timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                    std::chrono::high_resolution_clock::now().time_since_epoch()
-                ).count() / 1e9;
-                
                 // Create IMU point
                 IMU::Point point = ConvertToImuPoint(
                     accel_x, accel_y, accel_z,
@@ -764,19 +902,7 @@ bool BNO085Interface::ReadRawData()
                 );
                 
                 // Apply calibration and bias correction
-                point = ApplyCalibrationAndBias(point);
-                
-                // Add to queue
-                std::lock_guard<std::mutex> lock(mDataMutex);
-                mMeasurementQueue.push(point);
-                
-                // Limit queue size
-                if (mMeasurementQueue.size() > mMaxQueueSize) {
-                    mMeasurementQueue.pop();
-                }
-                
-                // Notify waiting threads
-                mDataCondition.notify_all();
+                PublishMeasurement(ApplyCalibrationAndBias(point));
                 break;
                 
             case SENSOR_REPORTID_GYROSCOPE:
@@ -808,6 +934,275 @@ bool BNO085Interface::ReadRawData()
     return true;
 }
 
+void BNO085Interface::PublishMeasurement(const IMU::Point& point)
+{
+    // Move the sample onto the camera timeline
+    IMU::Point aligned = point;
+    aligned.t -= mTimeOffset;
+    
+    // Add to the ring, out-of-order samples would break its range queries
+    if (!mMeasurements.Push(aligned)) {
+        return;
+    }
+    
+    // Notify waiting threads
+    mDataCondition.notify_all();
+    
+    if (mMeasurementCallback) {
+        mMeasurementCallback(aligned);
+    }
+}
+
+bool BNO085Interface::OpenDataReadyLine()
+{
+    if (mConfig.int_gpio_line < 0) {
+        std::cerr << "No H_INTN GPIO line configured." << std::endl;
+        return false;
+    }
+    
+    int chip_fd = open(mConfig.int_gpio_chip.c_str(), O_RDONLY);
+    if (chip_fd < 0) {
+        std::cerr << "Failed to open GPIO chip: " << mConfig.int_gpio_chip << std::endl;
+        return false;
+    }
+    
+    // H_INTN is active low, the falling edge signals a new report. The kernel
+    // stamps each edge in its interrupt handler (CLOCK_MONOTONIC since Linux 5.7)
+    struct gpioevent_request request;
+    memset(&request, 0, sizeof(request));
+    request.lineoffset = mConfig.int_gpio_line;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+    strncpy(request.consumer_label, "bno085-int", sizeof(request.consumer_label) - 1);
+    
+    const int ret = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request);
+    close(chip_fd);
+    if (ret < 0) {
+        std::cerr << "Failed to request events on GPIO line " << mConfig.int_gpio_line << std::endl;
+        return false;
+    }
+    
+    mDataReadyFd = request.fd;
+    return true;
+}
+
+bool BNO085Interface::WaitForDataReady(double& timestamp, int timeout_ms)
+{
+    struct pollfd pfd;
+    pfd.fd = mDataReadyFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    if (poll(&pfd, 1, timeout_ms) <= 0 || !(pfd.revents & POLLIN)) {
+        return false;
+    }
+    
+    struct gpioevent_data event;
+    if (read(mDataReadyFd, &event, sizeof(event)) != sizeof(event)) {
+        return false;
+    }
+    
+    timestamp = event.timestamp / 1e9;
+    return true;
+}
+
+bool BNO085Interface::OpenIioBuffer()
+{
+    // Stop a buffer left running so the scan elements can be changed
+    WriteIioAttribute("buffer/enable", "0");
+    
+    // Timestamps on the CLOCK_MONOTONIC timeline shared with the cameras
+    if (!WriteIioAttribute("current_timestamp_clock", "monotonic")) {
+        std::cerr << "Failed to set IIO timestamp clock of " << mConfig.iio_device << std::endl;
+        return false;
+    }
+    
+    // Only accel, gyro and timestamp are buffered
+    const std::string scan_elements = "/sys/bus/iio/devices/" + mConfig.iio_device + "/scan_elements";
+    DIR* dir = opendir(scan_elements.c_str());
+    if (!dir) {
+        std::cerr << "Failed to open IIO scan elements of " << mConfig.iio_device << std::endl;
+        return false;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        const std::string file = entry->d_name;
+        if (file.size() > 3 && file.compare(file.size() - 3, 3, "_en") == 0) {
+            WriteIioAttribute("scan_elements/" + file, "0");
+        }
+    }
+    closedir(dir);
+    
+    struct Element {
+        std::string name;
+        IioChannel* channel;
+        int index;
+    };
+    std::vector<Element> elements;
+    for (int i = 0; i < 3; ++i) {
+        elements.push_back({kIioAccelChannels[i], &mIioAccel[i], 0});
+        elements.push_back({kIioGyroChannels[i], &mIioGyro[i], 0});
+    }
+    elements.push_back({"in_timestamp", &mIioTimestamp, 0});
+    
+    for (Element& element : elements) {
+        if (!WriteIioAttribute("scan_elements/" + element.name + "_en", "1") ||
+            !ReadIioChannel(element.name, *element.channel, element.index)) {
+            std::cerr << "Failed to configure IIO channel " << element.name
+                      << " of " << mConfig.iio_device << std::endl;
+            return false;
+        }
+    }
+    
+    // The IIO core packs the enabled channels in scan index order, each aligned
+    // to its storage size, and pads the scan to the largest storage size
+    std::sort(elements.begin(), elements.end(),
+              [](const Element& a, const Element& b) { return a.index < b.index; });
+    size_t offset = 0;
+    size_t alignment = 1;
+    for (const Element& element : elements) {
+        const size_t bytes = element.channel->bytes;
+        offset = (offset + bytes - 1) / bytes * bytes;
+        element.channel->offset = offset;
+        offset += bytes;
+        alignment = std::max(alignment, bytes);
+    }
+    mIioScanSize = (offset + alignment - 1) / alignment * alignment;
+    
+    // Wake the acquisition thread once per watermark scans instead of once per scan
+    const int watermark = std::max(1, std::min(mConfig.iio_watermark, kIioBufferLength / 2));
+    if (!WriteIioAttribute("buffer/length", std::to_string(kIioBufferLength)) ||
+        !WriteIioAttribute("buffer/watermark", std::to_string(watermark))) {
+        std::cerr << "Failed to size IIO buffer of " << mConfig.iio_device << std::endl;
+        return false;
+    }
+    
+    const std::string buffer_path = "/dev/" + mConfig.iio_device;
+    mDeviceHandle = open(buffer_path.c_str(), O_RDONLY | O_NONBLOCK);
+    if (mDeviceHandle < 0) {
+        std::cerr << "Failed to open IIO buffer: " << buffer_path << std::endl;
+        return false;
+    }
+    
+    return true;
+}
+
+bool BNO085Interface::ReadIioChannel(const std::string& name, IioChannel& channel, int& index) const
+{
+    std::string value;
+    if (!ReadIioAttribute("scan_elements/" + name + "_index", value)) {
+        return false;
+    }
+    index = std::stoi(value);
+    
+    // Type format: [be|le]:[s|u]bits/storagebits>>shift
+    std::string type;
+    char endianness = 0;
+    char sign = 0;
+    int storage_bits = 0;
+    if (!ReadIioAttribute("scan_elements/" + name + "_type", type) ||
+        sscanf(type.c_str(), "%ce:%c%d/%d", &endianness, &sign, &channel.bits, &storage_bits) != 4 ||
+        storage_bits <= 0 || storage_bits % 8 != 0 || storage_bits > 64 ||
+        channel.bits <= 0 || channel.bits > storage_bits) {
+        return false;
+    }
+    const size_t shift_pos = type.find(">>");
+    channel.shift = shift_pos == std::string::npos ? 0 : std::stoi(type.substr(shift_pos + 2));
+    channel.bytes = storage_bits / 8;
+    channel.is_signed = sign == 's';
+    channel.big_endian = endianness == 'b';
+    
+    // The timestamp has no scale
+    channel.scale = 1.0;
+    if (ReadIioAttribute(name + "_scale", value)) {
+        channel.scale = std::stod(value);
+    }
+    return true;
+}
+
+int64_t BNO085Interface::DecodeIioChannel(const uint8_t* scan, const IioChannel& channel)
+{
+    uint64_t raw = 0;
+    for (size_t i = 0; i < channel.bytes; ++i) {
+        const size_t byte = channel.big_endian ? i : channel.bytes - 1 - i;
+        raw = (raw << 8) | scan[channel.offset + byte];
+    }
+    
+    raw >>= channel.shift;
+    if (channel.bits < 64) {
+        const uint64_t mask = (uint64_t(1) << channel.bits) - 1;
+        raw &= mask;
+        if (channel.is_signed && (raw & (uint64_t(1) << (channel.bits - 1)))) {
+            raw |= ~mask;
+        }
+    }
+    return static_cast<int64_t>(raw);
+}
+
+bool BNO085Interface::ReadIioBuffer(int timeout_ms)
+{
+    struct pollfd pfd;
+    pfd.fd = mDeviceHandle;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    if (poll(&pfd, 1, timeout_ms) <= 0 || !(pfd.revents & POLLIN)) {
+        return false;
+    }
+    
+    // Everything buffered since the last wakeup, in one syscall
+    std::vector<uint8_t> scans(mIioScanSize * kIioMaxScans);
+    const ssize_t bytes = read(mDeviceHandle, scans.data(), scans.size());
+    if (bytes < static_cast<ssize_t>(mIioScanSize)) {
+        return false;
+    }
+    
+    // Decode the scans into one block and correct it at once
+    SampleBlock block;
+    for (size_t offset = 0; offset + mIioScanSize <= static_cast<size_t>(bytes); offset += mIioScanSize) {
+        const uint8_t* scan = &scans[offset];
+        const size_t i = block.size++;
+        block.accel_x[i] = static_cast<float>(DecodeIioChannel(scan, mIioAccel[0]) * mIioAccel[0].scale);
+        block.accel_y[i] = static_cast<float>(DecodeIioChannel(scan, mIioAccel[1]) * mIioAccel[1].scale);
+        block.accel_z[i] = static_cast<float>(DecodeIioChannel(scan, mIioAccel[2]) * mIioAccel[2].scale);
+        block.gyro_x[i] = static_cast<float>(DecodeIioChannel(scan, mIioGyro[0]) * mIioGyro[0].scale);
+        block.gyro_y[i] = static_cast<float>(DecodeIioChannel(scan, mIioGyro[1]) * mIioGyro[1].scale);
+        block.gyro_z[i] = static_cast<float>(DecodeIioChannel(scan, mIioGyro[2]) * mIioGyro[2].scale);
+    
+        // Stamped by the driver at the data-ready interrupt
+        block.timestamp[i] = DecodeIioChannel(scan, mIioTimestamp) / 1e9;
+    }
+    
+    ApplyCalibrationAndBias(block);
+    
+    for (size_t i = 0; i < block.size; ++i) {
+        PublishMeasurement(ConvertToImuPoint(
+            block.accel_x[i], block.accel_y[i], block.accel_z[i],
+            block.gyro_x[i], block.gyro_y[i], block.gyro_z[i],
+            block.timestamp[i]
+        ));
+    }
+    
+    return true;
+}
+
+bool BNO085Interface::WriteIioAttribute(const std::string& attribute, const std::string& value) const
+{
+    std::ofstream file("/sys/bus/iio/devices/" + mConfig.iio_device + "/" + attribute);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    file << value;
+    file.flush();
+    return file.good();
+}
+
+bool BNO085Interface::ReadIioAttribute(const std::string& attribute, std::string& value) const
+{
+    std::ifstream file("/sys/bus/iio/devices/" + mConfig.iio_device + "/" + attribute);
+    return file.is_open() && static_cast<bool>(file >> value);
+}
+
 void BNO085Interface::ProcessRawData()
 {
     // This method would process raw data into IMU measurements
@@ -820,13 +1215,39 @@ void BNO085Interface::AcquisitionThreadFunc()
     #ifdef __linux__
         pthread_setname_np(pthread_self(), "BNO085-Acq");
     #endif
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::IMU_ACQUISITION, "BNO085-Acq");
     
-    // Calculate sleep time based on sample rate
-    auto sleep_time = std::chrono::microseconds(static_cast<int>(1000000.0f / mConfig.sample_rate_hz));
+    // Sample period for polling
+    const auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / mConfig.sample_rate_hz));
+    auto next_sample = std::chrono::steady_clock::now();
+    int sample_count = 0;
     
     while (mRunning) {
+        // The kernel driver reads the sensor, a timeout only means no new scans
+        if (mConfig.interface_type == Interface::IIO) {
+            ReadIioBuffer(kDataReadyTimeoutMs);
+            continue;
+        }
+        
+        double timestamp;
+        if (mConfig.acquisition_mode == AcquisitionMode::DATA_READY_GPIO) {
+            // Read on data-ready, stamped at the edge. Without an edge H_INTN
+            // may have been asserted before the request, a read releases it
+            if (!WaitForDataReady(timestamp, kDataReadyTimeoutMs)) {
+                timestamp = steadyNowSeconds();
+            }
+        } else {
+            // Stamp before the transfer so the bus time does not delay the sample
+            timestamp = steadyNowSeconds();
+        }
+        
         // Read and process data
-        if (!ReadRawData()) {
+        bool read = false;
+        {
+            TRACE_SCOPE("IMUSample");
+            read = ReadRawData(timestamp);
+        }
+        if (!read) {
             std::cerr << "Failed to read data from BNO085." << std::endl;
             
             // Check if sensor is still connected
@@ -838,14 +1259,20 @@ void BNO085Interface::AcquisitionThreadFunc()
         }
         
         // Update calibration status periodically (every 100 samples)
-        static int sample_count = 0;
         if (++sample_count >= 100) {
             UpdateCalibrationStatus();
             sample_count = 0;
         }
         
-        // Sleep until next sample
-        std::this_thread::sleep_for(sleep_time);
+        // Sleep until the next sample period, on a fixed schedule so the read time does not drift it
+        if (mConfig.acquisition_mode == AcquisitionMode::POLLING) {
+            next_sample += period;
+            const auto now = std::chrono::steady_clock::now();
+            if (next_sample < now) {
+                next_sample = now;
+            }
+            std::this_thread::sleep_until(next_sample);
+        }
     }
 }
 
@@ -854,6 +1281,11 @@ bool BNO085Interface::UpdateCalibrationStatus()
     // Update calibration status
     // This is a simplified implementation
     
+    // The kernel driver tracks calibration itself
+    if (mConfig.interface_type == Interface::IIO) {
+        return true;
+    }
+    
     // For I2C interface
     if (mConfig.interface_type == Interface::I2C) {
         // Send calibration status request
@@ -898,22 +1330,47 @@ IMU::Point BNO085Interface::ConvertToImuPoint(
     return point;
 }
 
-IMU::Point BNO085Interface::ApplyCalibrationAndBias(const IMU::Point& raw_point)
+IMU::Point BNO085Interface::ApplyCalibrationAndBias(const IMU::Point& raw_point) const
 {
     // Apply calibration and bias correction to raw measurements
+    Eigen::Vector3f accel_offset;
+    Eigen::Vector3f gyro_offset;
+    GetCorrectionOffsets(accel_offset, gyro_offset);
+    
+    const Eigen::Vector3f accel = mConfig.accel_misalignment * raw_point.a - accel_offset;
+    const Eigen::Vector3f gyro = mConfig.gyro_misalignment * raw_point.w - gyro_offset;
     
     // Create corrected point
     IMU::Point corrected_point(
-        raw_point.a.x() - mCurrentBias.bax,
-        raw_point.a.y() - mCurrentBias.bay,
-        raw_point.a.z() - mCurrentBias.baz,
-        raw_point.w.x() - mCurrentBias.bwx,
-        raw_point.w.y() - mCurrentBias.bwy,
-        raw_point.w.z() - mCurrentBias.bwz,
+        accel.x(), accel.y(), accel.z(),
+        gyro.x(), gyro.y(), gyro.z(),
         raw_point.t
     );
     
     return corrected_point;
 }
 
+void BNO085Interface::ApplyCalibrationAndBias(SampleBlock& block) const
+{
+    // The offsets are constant over a block, only M * v is per sample
+    Eigen::Vector3f accel_offset;
+    Eigen::Vector3f gyro_offset;
+    GetCorrectionOffsets(accel_offset, gyro_offset);
+    
+    correctAxes(mConfig.accel_misalignment, accel_offset,
+                block.accel_x, block.accel_y, block.accel_z, block.size);
+    correctAxes(mConfig.gyro_misalignment, gyro_offset,
+                block.gyro_x, block.gyro_y, block.gyro_z, block.size);
+}
+
+void BNO085Interface::GetCorrectionOffsets(Eigen::Vector3f& accel_offset, Eigen::Vector3f& gyro_offset) const
+{
+    const float temperature_delta = mTemperature - mConfig.reference_temperature;
+    const Eigen::Vector3f accel_bias(mCurrentBias.bax, mCurrentBias.bay, mCurrentBias.baz);
+    const Eigen::Vector3f gyro_bias(mCurrentBias.bwx, mCurrentBias.bwy, mCurrentBias.bwz);
+    
+    accel_offset = mConfig.accel_misalignment * (accel_bias + mConfig.accel_temp_coeff * temperature_delta);
+    gyro_offset = mConfig.gyro_misalignment * (gyro_bias + mConfig.gyro_temp_coeff * temperature_delta);
+}
+
 } // namespace ORB_SLAM3
@@ -0,0 +1,306 @@
+#include "include/dma_buffer_pool.hpp"
+#include "ORB_SLAM3/include/MemoryAccounting.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-heap.h>
+#include <linux/memfd.h>
+#include <linux/udmabuf.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+// Buffers start on a CPU page so they can be mapped and imported separately
+constexpr size_t kPageSize = 4096;
+
+size_t RoundUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// log2 of the huge page size in the memfd_create() flags
+unsigned int HugePageShift(size_t huge_page_size)
+{
+    unsigned int shift = 0;
+    while ((static_cast<size_t>(1) << shift) < huge_page_size) {
+        shift++;
+    }
+    return shift;
+}
+}
+
+DmaBufferPool::DmaBufferPool()
+    : DmaBufferPool(Options())
+{
+}
+
+DmaBufferPool::DmaBufferPool(const Options& options)
+    : mOptions(options),
+      mBufferSize(0),
+      mPoolMapping(nullptr),
+      mPoolMappingSize(0)
+{
+    mLastErrorMessage = "No error";
+}
+
+DmaBufferPool::~DmaBufferPool()
+{
+    Free();
+}
+
+bool DmaBufferPool::Allocate(size_t count, size_t size)
+{
+    if (IsAllocated()) {
+        SetErrorMessage("Buffer pool already allocated");
+        return false;
+    }
+
+    if (count == 0 || size == 0) {
+        SetErrorMessage("Invalid buffer pool size");
+        return false;
+    }
+
+    // The first source that holds the whole pool, the buffers of a pool
+    // are all alike
+    std::string errors;
+    for (const std::string& source : mOptions.sources) {
+        const bool allocated = source == kUdmabufSource ? AllocateFromUdmabuf(count, size)
+                                                        : AllocateFromHeap(source, count, size);
+        if (allocated) {
+            mSource = source;
+            mBufferSize = size;
+            std::lock_guard<std::mutex> lock(mFreeMutex);
+            mFreeHandles.clear();
+            for (size_t i = count; i > 0; --i) {
+                mFreeHandles.push_back(static_cast<int>(i - 1));
+            }
+            return true;
+        }
+        errors += (errors.empty() ? "" : "; ") + source + ": " + GetLastErrorMessage();
+    }
+
+    SetErrorMessage("No DMA buffer source holds " + std::to_string(count) + " buffers of " +
+                    std::to_string(size) + " bytes (" + errors + ")");
+    return false;
+}
+
+void DmaBufferPool::Free()
+{
+    for (Buffer& buffer : mBuffers) {
+        if (!mPoolMapping && buffer.data) {
+            munmap(buffer.data, RoundUp(buffer.size, kPageSize));
+            MemoryAccounting::Remove(MemoryBreakdown::FRAME_BUFFERS, RoundUp(buffer.size, kPageSize));
+        }
+        if (buffer.dma_fd >= 0) {
+            close(buffer.dma_fd);
+        }
+    }
+    mBuffers.clear();
+
+    if (mPoolMapping) {
+        munmap(mPoolMapping, mPoolMappingSize);
+        MemoryAccounting::Remove(MemoryBreakdown::FRAME_BUFFERS, mPoolMappingSize);
+        mPoolMapping = nullptr;
+        mPoolMappingSize = 0;
+    }
+
+    mSource.clear();
+    mBufferSize = 0;
+    std::lock_guard<std::mutex> lock(mFreeMutex);
+    mFreeHandles.clear();
+}
+
+bool DmaBufferPool::IsAllocated() const
+{
+    return !mBuffers.empty();
+}
+
+const std::string& DmaBufferPool::GetSource() const
+{
+    return mSource;
+}
+
+size_t DmaBufferPool::GetBufferCount() const
+{
+    return mBuffers.size();
+}
+
+size_t DmaBufferPool::GetBufferSize() const
+{
+    return mBufferSize;
+}
+
+const DmaBufferPool::Buffer& DmaBufferPool::GetBuffer(int handle) const
+{
+    return mBuffers.at(handle);
+}
+
+int DmaBufferPool::FindBuffer(const void* data) const
+{
+    for (size_t i = 0; i < mBuffers.size(); ++i) {
+        if (mBuffers[i].data == data) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+int DmaBufferPool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(mFreeMutex);
+    if (mFreeHandles.empty()) {
+        return -1;
+    }
+
+    const int handle = mFreeHandles.back();
+    mFreeHandles.pop_back();
+    return handle;
+}
+
+void DmaBufferPool::Release(int handle)
+{
+    if (handle < 0 || handle >= static_cast<int>(mBuffers.size())) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mFreeMutex);
+    if (std::find(mFreeHandles.begin(), mFreeHandles.end(), handle) == mFreeHandles.end()) {
+        mFreeHandles.push_back(handle);
+    }
+}
+
+size_t DmaBufferPool::GetFreeCount() const
+{
+    std::lock_guard<std::mutex> lock(mFreeMutex);
+    return mFreeHandles.size();
+}
+
+std::string DmaBufferPool::GetLastErrorMessage() const
+{
+    std::lock_guard<std::mutex> lock(mErrorMutex);
+    return mLastErrorMessage;
+}
+
+//------------------------------------------------------------------------------
+// Private Methods
+//------------------------------------------------------------------------------
+
+bool DmaBufferPool::AllocateFromHeap(const std::string& path, size_t count, size_t size)
+{
+    int heap = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (heap < 0) {
+        SetErrorMessage(strerror(errno));
+        return false;
+    }
+
+    const size_t length = RoundUp(size, kPageSize);
+    mBuffers.resize(count);
+    for (Buffer& buffer : mBuffers) {
+        struct dma_heap_allocation_data allocation;
+        memset(&allocation, 0, sizeof(allocation));
+        allocation.len = length;
+        allocation.fd_flags = O_RDWR | O_CLOEXEC;
+        if (ioctl(heap, DMA_HEAP_IOCTL_ALLOC, &allocation) < 0) {
+            SetErrorMessage(strerror(errno));
+            break;
+        }
+        buffer.dma_fd = static_cast<int>(allocation.fd);
+
+        void* data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.dma_fd, 0);
+        if (data == MAP_FAILED) {
+            SetErrorMessage(strerror(errno));
+            break;
+        }
+        buffer.data = data;
+        buffer.size = size;
+        MemoryAccounting::Add(MemoryBreakdown::FRAME_BUFFERS, length);
+    }
+    close(heap);
+
+    if (mBuffers.back().data == nullptr) {
+        Free();
+        return false;
+    }
+    return true;
+}
+
+bool DmaBufferPool::AllocateFromUdmabuf(size_t count, size_t size)
+{
+    int device = open(mOptions.udmabuf_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (device < 0) {
+        SetErrorMessage(strerror(errno));
+        return false;
+    }
+
+    // Every buffer on its own huge pages, udmabuf needs the memfd sealed
+    // against shrinking
+    const size_t stride = RoundUp(size, mOptions.huge_page_size);
+    const size_t length = stride * count;
+    int memfd = memfd_create("dma_buffer_pool", MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB |
+                                                (HugePageShift(mOptions.huge_page_size) << MFD_HUGE_SHIFT));
+    if (memfd < 0) {
+        SetErrorMessage("memfd_create: " + std::string(strerror(errno)));
+        close(device);
+        return false;
+    }
+    if (ftruncate(memfd, static_cast<off_t>(length)) < 0 || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        SetErrorMessage("Not enough huge pages: " + std::string(strerror(errno)));
+        close(memfd);
+        close(device);
+        return false;
+    }
+
+    // Populated now, a huge page fault in the capture path would stall it
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, memfd, 0);
+    if (mapping == MAP_FAILED) {
+        SetErrorMessage("mmap: " + std::string(strerror(errno)));
+        close(memfd);
+        close(device);
+        return false;
+    }
+    mPoolMapping = mapping;
+    mPoolMappingSize = length;
+    MemoryAccounting::Add(MemoryBreakdown::FRAME_BUFFERS, length);
+
+    mBuffers.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        struct udmabuf_create create;
+        memset(&create, 0, sizeof(create));
+        create.memfd = static_cast<uint32_t>(memfd);
+        create.flags = UDMABUF_FLAGS_CLOEXEC;
+        create.offset = i * stride;
+        create.size = stride;
+        const int fd = ioctl(device, UDMABUF_CREATE, &create);
+        if (fd < 0) {
+            SetErrorMessage("UDMABUF_CREATE: " + std::string(strerror(errno)));
+            break;
+        }
+        mBuffers[i].dma_fd = fd;
+        mBuffers[i].data = static_cast<uint8_t*>(mapping) + i * stride;
+        mBuffers[i].size = size;
+    }
+
+    // The buffers hold the pages, the memfd is not needed anymore
+    close(memfd);
+    close(device);
+
+    if (mBuffers.back().dma_fd < 0) {
+        Free();
+        return false;
+    }
+    return true;
+}
+
+void DmaBufferPool::SetErrorMessage(const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(mErrorMutex);
+    mLastErrorMessage = message;
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,140 @@
+#include "include/dvfs_telemetry.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <linux/ioctl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// VR_POWER_IOCTL_SET_TELEMETRY of the power driver
+constexpr unsigned long kSetTelemetryIoctl = _IOW('V', 7, DvfsPipelineTelemetry);
+
+// Head of struct vr_power_state_page of the power driver, up to the thermal status
+struct StatePageHead {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    uint32_t reserved;
+    uint64_t update_ns;
+    int32_t temperature[kDvfsThermalZoneCount];
+    uint32_t thermal_status[kDvfsThermalZoneCount];
+    uint32_t throttle_mask;
+};
+
+constexpr uint32_t kStatePageMagic = 0x53505256; // VR_POWER_STATE_MAGIC
+constexpr uint32_t kStatePageVersion = 1;
+constexpr size_t kStatePageSize = 4096;
+
+uint32_t ToMicroseconds(double ms)
+{
+    if (!(ms > 0.0)) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::min(std::round(ms * 1000.0),
+                                          static_cast<double>(std::numeric_limits<uint32_t>::max())));
+}
+
+} // namespace
+
+DvfsTelemetry::DvfsTelemetry(const std::string& device)
+    : mDevice(device), mFd(-1), mStatePage(nullptr), mPendingHints(0)
+{
+}
+
+DvfsTelemetry::~DvfsTelemetry()
+{
+    if (mStatePage) {
+        munmap(const_cast<void*>(mStatePage), kStatePageSize);
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool DvfsTelemetry::Open()
+{
+    if (mFd >= 0) {
+        return true;
+    }
+
+    mFd = open(mDevice.c_str(), O_RDWR | O_CLOEXEC);
+    if (mFd < 0) {
+        std::cerr << "Failed to open " << mDevice << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Older drivers have no state page, the telemetry works without it
+    void* page = mmap(nullptr, kStatePageSize, PROT_READ, MAP_SHARED, mFd, 0);
+    if (page == MAP_FAILED) {
+        std::cerr << "No power state page on " << mDevice << ": " << strerror(errno) << std::endl;
+    } else if (static_cast<const StatePageHead*>(page)->magic != kStatePageMagic ||
+               static_cast<const StatePageHead*>(page)->version != kStatePageVersion) {
+        std::cerr << "Unknown power state page layout on " << mDevice << std::endl;
+        munmap(page, kStatePageSize);
+    } else {
+        mStatePage = page;
+    }
+
+    return true;
+}
+
+bool DvfsTelemetry::IsOpen() const
+{
+    return mFd >= 0;
+}
+
+void DvfsTelemetry::HintLoad(uint32_t hints)
+{
+    mPendingHints.fetch_or(hints, std::memory_order_relaxed);
+}
+
+bool DvfsTelemetry::Report(double frame_period_ms, double acquisition_ms, double extraction_ms, double tracking_ms)
+{
+    if (mFd < 0) {
+        return false;
+    }
+
+    DvfsPipelineTelemetry telemetry = Pack(frame_period_ms, acquisition_ms, extraction_ms, tracking_ms,
+                                           mPendingHints.exchange(0, std::memory_order_relaxed));
+    if (telemetry.frame_period_us == 0) {
+        HintLoad(telemetry.hints);
+        return false;
+    }
+
+    return ioctl(mFd, kSetTelemetryIoctl, &telemetry) == 0;
+}
+
+int DvfsTelemetry::ReadThermalStatus(uint32_t zone) const
+{
+    if (!mStatePage || zone >= kDvfsThermalZoneCount) {
+        return -1;
+    }
+
+    // One aligned word cannot tear, so it needs no sequence check
+    const StatePageHead* head = static_cast<const StatePageHead*>(mStatePage);
+    return static_cast<int>(__atomic_load_n(&head->thermal_status[zone], __ATOMIC_RELAXED));
+}
+
+DvfsPipelineTelemetry DvfsTelemetry::Pack(double frame_period_ms, double acquisition_ms,
+                                          double extraction_ms, double tracking_ms, uint32_t hints)
+{
+    DvfsPipelineTelemetry telemetry = {};
+    telemetry.frame_period_us = ToMicroseconds(frame_period_ms);
+    telemetry.acquisition_us = ToMicroseconds(acquisition_ms);
+    telemetry.extraction_us = ToMicroseconds(extraction_ms);
+    telemetry.tracking_us = ToMicroseconds(tracking_ms);
+    telemetry.hints = hints;
+    return telemetry;
+}
+
+} // namespace ORB_SLAM3
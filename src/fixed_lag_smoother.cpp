@@ -0,0 +1,347 @@
+#include "include/fixed_lag_smoother.hpp"
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// Pose prior of the first frame when it has no tracked pose, it only fixes the gauge
+constexpr double kGaugeSigma = 1e-3;
+
+// Keeps the normal equations positive definite along unobservable directions
+constexpr double kDamping = 1e-9;
+
+// Gauss-Newton stops once the update is this small
+constexpr double kConvergedStep = 1e-7;
+
+Eigen::Matrix3d rightJacobian(const Eigen::Vector3d& v)
+{
+    const double theta = v.norm();
+    const Eigen::Matrix3d W = Sophus::SO3d::hat(v);
+    if (theta < 1e-5) {
+        return Eigen::Matrix3d::Identity() - 0.5 * W;
+    }
+    return Eigen::Matrix3d::Identity() - (1.0 - std::cos(theta)) / (theta * theta) * W +
+           (theta - std::sin(theta)) / (theta * theta * theta) * W * W;
+}
+
+Eigen::Matrix3d inverseRightJacobian(const Eigen::Vector3d& v)
+{
+    const double theta = v.norm();
+    const Eigen::Matrix3d W = Sophus::SO3d::hat(v);
+    if (theta < 1e-5) {
+        return Eigen::Matrix3d::Identity() + 0.5 * W;
+    }
+    return Eigen::Matrix3d::Identity() + 0.5 * W +
+           (1.0 / (theta * theta) - (1.0 + std::cos(theta)) / (2.0 * theta * std::sin(theta))) * W * W;
+}
+
+} // namespace
+
+FixedLagSmoother::FixedLagSmoother(const Config& config)
+    : mConfig(config),
+      mGravity(config.gravity.cast<double>()),
+      mHasPrior(false)
+{
+    mConfig.window_size = std::max(1, mConfig.window_size);
+    mConfig.max_iterations = std::max(1, mConfig.max_iterations);
+
+    // One frame over the window until it is marginalized
+    const size_t max_frames = static_cast<size_t>(mConfig.window_size) + 1;
+    mFrames.reserve(max_frames);
+    mH.resize(15 * max_frames, 15 * max_frames);
+    mG.resize(15 * max_frames);
+    mDx.resize(15 * max_frames);
+    mPriorH.setZero();
+    mPriorG.setZero();
+}
+
+void FixedLagSmoother::Reset()
+{
+    mFrames.clear();
+    mHasPrior = false;
+    mPriorH.setZero();
+    mPriorG.setZero();
+}
+
+void FixedLagSmoother::AddFrame(double timestamp, const ImuDelta& imu, const Sophus::SE3f* visual_pose)
+{
+    Frame frame;
+    frame.timestamp = timestamp;
+    frame.has_visual = visual_pose != nullptr;
+    if (visual_pose) {
+        frame.visual_R = visual_pose->so3().cast<double>();
+        frame.visual_p = visual_pose->translation().cast<double>();
+    }
+
+    frame.delta_R = imu.delta_R.cast<double>();
+    frame.delta_V = imu.delta_V.cast<double>();
+    frame.delta_P = imu.delta_P.cast<double>();
+    frame.dt = imu.dt;
+    frame.JRg = imu.JRg.cast<double>();
+    frame.JVg = imu.JVg.cast<double>();
+    frame.JVa = imu.JVa.cast<double>();
+    frame.JPg = imu.JPg.cast<double>();
+    frame.JPa = imu.JPa.cast<double>();
+    frame.imu_bg = imu.bias_gyro.cast<double>();
+    frame.imu_ba = imu.bias_acc.cast<double>();
+    const Matrix9d covariance = imu.covariance.cast<double>() + 1e-12 * Matrix9d::Identity();
+    frame.imu_information = covariance.ldlt().solve(Matrix9d::Identity());
+    frame.imu_information = 0.5 * (frame.imu_information + frame.imu_information.transpose());
+
+    if (mFrames.empty()) {
+        frame.R = frame.has_visual ? frame.visual_R : Sophus::SO3d();
+        frame.p = frame.has_visual ? frame.visual_p : Eigen::Vector3d::Zero();
+        frame.v.setZero();
+        frame.bg = frame.imu_bg;
+        frame.ba = frame.imu_ba;
+
+        // The first frame is anchored by a prior until it is marginalized
+        const double rotation_sigma = frame.has_visual ? mConfig.visual_rotation_sigma : kGaugeSigma;
+        const double position_sigma = frame.has_visual ? mConfig.visual_position_sigma : kGaugeSigma;
+        Vector15d sigmas;
+        sigmas << Eigen::Vector3d::Constant(rotation_sigma),
+                  Eigen::Vector3d::Constant(position_sigma),
+                  Eigen::Vector3d::Constant(mConfig.initial_velocity_sigma),
+                  Eigen::Vector3d::Constant(mConfig.initial_gyro_bias_sigma),
+                  Eigen::Vector3d::Constant(mConfig.initial_acc_bias_sigma);
+        mPriorH = sigmas.array().square().inverse().matrix().asDiagonal();
+        mPriorG.setZero();
+        mPriorAnchor = frame;
+        mHasPrior = true;
+    } else {
+        // Propagate the previous frame through the bias-corrected preintegration
+        const Frame& previous = mFrames.back();
+        const Eigen::Vector3d dbg = previous.bg - frame.imu_bg;
+        const Eigen::Vector3d dba = previous.ba - frame.imu_ba;
+        const Eigen::Matrix3d dR = frame.delta_R * Sophus::SO3d::exp(frame.JRg * dbg).matrix();
+        const Eigen::Vector3d dV = frame.delta_V + frame.JVg * dbg + frame.JVa * dba;
+        const Eigen::Vector3d dP = frame.delta_P + frame.JPg * dbg + frame.JPa * dba;
+        const double dt = frame.dt;
+
+        frame.R = previous.R * Sophus::SO3d::fitToSO3(dR);
+        frame.v = previous.v + mGravity * dt + previous.R * dV;
+        frame.p = previous.p + previous.v * dt + 0.5 * mGravity * dt * dt + previous.R * dP;
+        frame.bg = previous.bg;
+        frame.ba = previous.ba;
+    }
+
+    mFrames.push_back(frame);
+}
+
+bool FixedLagSmoother::Optimize()
+{
+    if (mFrames.empty()) {
+        return false;
+    }
+
+    const size_t count = mFrames.size();
+    const Eigen::Index size = static_cast<Eigen::Index>(15 * count);
+    for (int iteration = 0; iteration < mConfig.max_iterations; ++iteration) {
+        mH.topLeftCorner(size, size).setZero();
+        mG.head(size).setZero();
+
+        if (mHasPrior) {
+            AddPriorFactor(mFrames[0], mH, mG, 0);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            AddVisualFactor(mFrames[i], mH, mG, i);
+            if (i > 0) {
+                AddInertialFactors(mFrames[i - 1], mFrames[i], mH, mG, i - 1);
+            }
+        }
+        mH.topLeftCorner(size, size).diagonal().array() += kDamping;
+
+        mSolver.compute(mH.topLeftCorner(size, size));
+        if (mSolver.info() != Eigen::Success) {
+            return false;
+        }
+        mDx.head(size) = -mSolver.solve(mG.head(size));
+        if (!mDx.head(size).allFinite()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            const Vector15d dx = mDx.segment<15>(15 * i);
+            Frame& frame = mFrames[i];
+            frame.R = frame.R * Sophus::SO3d::exp(dx.segment<3>(0));
+            frame.p += dx.segment<3>(3);
+            frame.v += dx.segment<3>(6);
+            frame.bg += dx.segment<3>(9);
+            frame.ba += dx.segment<3>(12);
+        }
+
+        if (mDx.head(size).norm() < kConvergedStep) {
+            break;
+        }
+    }
+
+    while (mFrames.size() > static_cast<size_t>(mConfig.window_size)) {
+        MarginalizeOldest();
+    }
+    return true;
+}
+
+FixedLagSmoother::FrameState FixedLagSmoother::GetLatestState() const
+{
+    FrameState state;
+    if (mFrames.empty()) {
+        return state;
+    }
+
+    const Frame& frame = mFrames.back();
+    state.timestamp = frame.timestamp;
+    state.pose = Sophus::SE3f(frame.R.cast<float>(), frame.p.cast<float>());
+    state.velocity = frame.v.cast<float>();
+    state.bias_gyro = frame.bg.cast<float>();
+    state.bias_acc = frame.ba.cast<float>();
+    return state;
+}
+
+size_t FixedLagSmoother::GetFrameCount() const
+{
+    return mFrames.size();
+}
+
+bool FixedLagSmoother::HasMarginalizationPrior() const
+{
+    return mHasPrior;
+}
+
+void FixedLagSmoother::AddPriorFactor(const Frame& frame, Eigen::MatrixXd& H, Eigen::VectorXd& g, size_t index) const
+{
+    Vector15d delta;
+    delta << (mPriorAnchor.R.inverse() * frame.R).log(),
+             frame.p - mPriorAnchor.p,
+             frame.v - mPriorAnchor.v,
+             frame.bg - mPriorAnchor.bg,
+             frame.ba - mPriorAnchor.ba;
+
+    const Eigen::Index i = static_cast<Eigen::Index>(15 * index);
+    H.block<15, 15>(i, i) += mPriorH;
+    g.segment<15>(i) += mPriorG + mPriorH * delta;
+}
+
+void FixedLagSmoother::AddVisualFactor(const Frame& frame, Eigen::MatrixXd& H, Eigen::VectorXd& g, size_t index) const
+{
+    if (!frame.has_visual) {
+        return;
+    }
+
+    const Eigen::Vector3d r_R = (frame.visual_R.inverse() * frame.R).log();
+    const Eigen::Vector3d r_p = frame.p - frame.visual_p;
+    const Eigen::Matrix3d J_R = inverseRightJacobian(r_R);
+    const double w_R = 1.0 / (double(mConfig.visual_rotation_sigma) * mConfig.visual_rotation_sigma);
+    const double w_p = 1.0 / (double(mConfig.visual_position_sigma) * mConfig.visual_position_sigma);
+
+    const Eigen::Index i = static_cast<Eigen::Index>(15 * index);
+    H.block<3, 3>(i, i) += w_R * J_R.transpose() * J_R;
+    g.segment<3>(i) += w_R * J_R.transpose() * r_R;
+    H.block<3, 3>(i + 3, i + 3) += w_p * Eigen::Matrix3d::Identity();
+    g.segment<3>(i + 3) += w_p * r_p;
+}
+
+void FixedLagSmoother::AddInertialFactors(const Frame& previous, const Frame& frame,
+                                          Eigen::MatrixXd& H, Eigen::VectorXd& g, size_t previous_index) const
+{
+    const double dt = frame.dt;
+    const Eigen::Matrix3d Ri = previous.R.matrix();
+    const Eigen::Matrix3d RiT = Ri.transpose();
+
+    // Preintegration corrected to the previous frame's bias
+    const Eigen::Vector3d dbg = previous.bg - frame.imu_bg;
+    const Eigen::Vector3d dba = previous.ba - frame.imu_ba;
+    const Eigen::Vector3d JRg_dbg = frame.JRg * dbg;
+    const Sophus::SO3d dR = Sophus::SO3d::fitToSO3(frame.delta_R) * Sophus::SO3d::exp(JRg_dbg);
+    const Eigen::Vector3d dV = frame.delta_V + frame.JVg * dbg + frame.JVa * dba;
+    const Eigen::Vector3d dP = frame.delta_P + frame.JPg * dbg + frame.JPa * dba;
+
+    const Eigen::Vector3d velocity_change = frame.v - previous.v - mGravity * dt;
+    const Eigen::Vector3d position_change = frame.p - previous.p - previous.v * dt - 0.5 * mGravity * dt * dt;
+
+    // Residual order follows the preintegration covariance: rotation, velocity, position
+    Eigen::Matrix<double, 9, 1> r;
+    const Eigen::Vector3d r_R = (dR.inverse() * previous.R.inverse() * frame.R).log();
+    r << r_R, RiT * velocity_change - dV, RiT * position_change - dP;
+
+    // Jacobian over [theta_i p_i v_i bg_i ba_i theta_j p_j v_j bg_j ba_j]
+    Eigen::Matrix<double, 9, 30> J = Eigen::Matrix<double, 9, 30>::Zero();
+    const Eigen::Matrix3d JrInv = inverseRightJacobian(r_R);
+    J.block<3, 3>(0, 0) = -JrInv * frame.R.matrix().transpose() * Ri;
+    J.block<3, 3>(0, 9) = -JrInv * Sophus::SO3d::exp(r_R).matrix().transpose() * rightJacobian(JRg_dbg) * frame.JRg;
+    J.block<3, 3>(0, 15) = JrInv;
+
+    J.block<3, 3>(3, 0) = Sophus::SO3d::hat(RiT * velocity_change);
+    J.block<3, 3>(3, 6) = -RiT;
+    J.block<3, 3>(3, 9) = -frame.JVg;
+    J.block<3, 3>(3, 12) = -frame.JVa;
+    J.block<3, 3>(3, 21) = RiT;
+
+    J.block<3, 3>(6, 0) = Sophus::SO3d::hat(RiT * position_change);
+    J.block<3, 3>(6, 3) = -RiT;
+    J.block<3, 3>(6, 6) = -RiT * dt;
+    J.block<3, 3>(6, 9) = -frame.JPg;
+    J.block<3, 3>(6, 12) = -frame.JPa;
+    J.block<3, 3>(6, 18) = RiT;
+
+    const Eigen::Index i = static_cast<Eigen::Index>(15 * previous_index);
+    const Eigen::Matrix<double, 30, 9> JtW = J.transpose() * frame.imu_information;
+    H.block<30, 30>(i, i) += JtW * J;
+    g.segment<30>(i) += JtW * r;
+
+    // Bias random walk
+    const double walk_dt = std::max(dt, 1e-6);
+    const double w_g = 1.0 / (double(mConfig.gyro_walk_sigma) * mConfig.gyro_walk_sigma * walk_dt);
+    const double w_a = 1.0 / (double(mConfig.acc_walk_sigma) * mConfig.acc_walk_sigma * walk_dt);
+    const Eigen::Vector3d r_g = frame.bg - previous.bg;
+    const Eigen::Vector3d r_a = frame.ba - previous.ba;
+    const Eigen::Matrix3d I = Eigen::Matrix3d::Identity();
+    const Eigen::Index j = i + 15;
+
+    H.block<3, 3>(i + 9, i + 9) += w_g * I;
+    H.block<3, 3>(j + 9, j + 9) += w_g * I;
+    H.block<3, 3>(i + 9, j + 9) -= w_g * I;
+    H.block<3, 3>(j + 9, i + 9) -= w_g * I;
+    g.segment<3>(i + 9) -= w_g * r_g;
+    g.segment<3>(j + 9) += w_g * r_g;
+
+    H.block<3, 3>(i + 12, i + 12) += w_a * I;
+    H.block<3, 3>(j + 12, j + 12) += w_a * I;
+    H.block<3, 3>(i + 12, j + 12) -= w_a * I;
+    H.block<3, 3>(j + 12, i + 12) -= w_a * I;
+    g.segment<3>(i + 12) -= w_a * r_a;
+    g.segment<3>(j + 12) += w_a * r_a;
+}
+
+void FixedLagSmoother::MarginalizeOldest()
+{
+    // Linearize the factors touching the oldest frame at the current estimate
+    mH.topLeftCorner<30, 30>().setZero();
+    mG.head<30>().setZero();
+    if (mHasPrior) {
+        AddPriorFactor(mFrames[0], mH, mG, 0);
+    }
+    AddVisualFactor(mFrames[0], mH, mG, 0);
+    AddInertialFactors(mFrames[0], mFrames[1], mH, mG, 0);
+
+    // Schur complement of the oldest frame onto the next one
+    Matrix15d H00 = mH.block<15, 15>(0, 0);
+    H00.diagonal().array() += kDamping;
+    const Eigen::Matrix<double, 15, 15> H01 = mH.block<15, 15>(0, 15);
+    const Eigen::LDLT<Matrix15d> H00_ldlt(H00);
+    const Eigen::Matrix<double, 15, 15> H00_inv_H01 = H00_ldlt.solve(H01);
+    const Vector15d H00_inv_g0 = H00_ldlt.solve(mG.segment<15>(0));
+
+    mPriorH = mH.block<15, 15>(15, 15) - H01.transpose() * H00_inv_H01;
+    mPriorH = 0.5 * (mPriorH + mPriorH.transpose());
+    mPriorG = mG.segment<15>(15) - H01.transpose() * H00_inv_g0;
+    mPriorAnchor = mFrames[1];
+    mHasPrior = true;
+
+    mFrames.erase(mFrames.begin());
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,281 @@
+#include "include/flight_recorder.hpp"
+#include "include/thread_placement.hpp"
+#include "ORB_SLAM3/include/Trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// Bounds how late the writer notices a snapshot whose wake-up it missed
+constexpr auto kWriterPollPeriod = std::chrono::milliseconds(100);
+
+uint32_t counterSince(long now, long start)
+{
+    return now > start ? static_cast<uint32_t>(now - start) : 0;
+}
+
+} // namespace
+
+FlightRecorder::ThreadCounters FlightRecorder::ThreadCounters::Sample()
+{
+    ThreadCounters counters;
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+        counters.voluntary_switches = static_cast<uint32_t>(usage.ru_nvcsw);
+        counters.involuntary_switches = static_cast<uint32_t>(usage.ru_nivcsw);
+        counters.major_faults = static_cast<uint32_t>(usage.ru_majflt);
+    }
+    return counters;
+}
+
+FlightRecorder::ThreadCounters FlightRecorder::ThreadCounters::Since(const ThreadCounters& start) const
+{
+    ThreadCounters delta;
+    delta.voluntary_switches = counterSince(voluntary_switches, start.voluntary_switches);
+    delta.involuntary_switches = counterSince(involuntary_switches, start.involuntary_switches);
+    delta.major_faults = counterSince(major_faults, start.major_faults);
+    return delta;
+}
+
+double FlightRecorder::Record::GetLatencyMs() const
+{
+    if (!latency.Has(LatencyStage::EXPOSURE_MID) || !latency.Has(LatencyStage::POSE_PUBLISHED)) {
+        return 0.0;
+    }
+    return (latency.Get(LatencyStage::POSE_PUBLISHED) - latency.Get(LatencyStage::EXPOSURE_MID)) * 1000.0;
+}
+
+FlightRecorder::FlightRecorder(const Config& config)
+    : mConfig(config), mNext(0), mSize(0), mTriggered(false), mDumpAt(0.0),
+      mLastTrigger(-std::numeric_limits<double>::infinity()), mDumpRequested(false),
+      mSnapshotSize(0), mSnapshotReady(false), mDumps(0), mMissed(0), mRunning(false)
+{
+    // The ring also covers the frames recorded after the trigger
+    const double seconds = std::max(0.0, mConfig.window_s) + std::max(0.0, mConfig.post_trigger_s);
+    const size_t capacity = static_cast<size_t>(std::ceil(seconds * std::max(1.0, mConfig.max_frame_rate_hz)));
+    mRing.resize(std::max<size_t>(capacity, 1));
+    mSnapshot.resize(mRing.size());
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    Stop();
+}
+
+bool FlightRecorder::Start()
+{
+    std::lock_guard<std::mutex> lock(mThreadMutex);
+    if (mRunning) {
+        return false;
+    }
+    mRunning = true;
+    mThread = std::thread(&FlightRecorder::ThreadFunction, this);
+    return true;
+}
+
+void FlightRecorder::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mThreadMutex);
+        mRunning = false;
+    }
+    mThreadCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    // A snapshot taken without the writer running is written here
+    if (mSnapshotReady.load(std::memory_order_acquire)) {
+        WriteSnapshot();
+    }
+}
+
+void FlightRecorder::Add(const Record& record)
+{
+    mRing[mNext] = record;
+    mNext = (mNext + 1) % mRing.size();
+    mSize = std::min(mSize + 1, mRing.size());
+
+    if (mTriggered) {
+        if (record.timestamp >= mDumpAt) {
+            TakeSnapshot();
+        }
+        return;
+    }
+
+    const bool requested = mDumpRequested.exchange(false, std::memory_order_relaxed);
+    const bool slow = record.GetLatencyMs() > mConfig.trigger_latency_ms &&
+                      record.timestamp - mLastTrigger >= mConfig.min_dump_interval_s;
+    if (!requested && !slow) {
+        return;
+    }
+
+    mTriggered = true;
+    mTrigger = record;
+    mLastTrigger = record.timestamp;
+    mDumpAt = record.timestamp + std::max(0.0, mConfig.post_trigger_s);
+    if (mConfig.post_trigger_s <= 0.0) {
+        TakeSnapshot();
+    }
+}
+
+void FlightRecorder::RequestDump()
+{
+    mDumpRequested.store(true, std::memory_order_relaxed);
+}
+
+uint64_t FlightRecorder::GetDumpCount() const
+{
+    return mDumps.load(std::memory_order_relaxed);
+}
+
+uint64_t FlightRecorder::GetMissedCount() const
+{
+    return mMissed.load(std::memory_order_relaxed);
+}
+
+std::string FlightRecorder::GetLastDumpPath() const
+{
+    std::lock_guard<std::mutex> lock(mPathMutex);
+    return mLastDumpPath;
+}
+
+void FlightRecorder::TakeSnapshot()
+{
+    mTriggered = false;
+    if (mSnapshotReady.load(std::memory_order_acquire)) {
+        mMissed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Oldest first, from the start of the window before the trigger
+    const double window_start = mTrigger.timestamp - std::max(0.0, mConfig.window_s);
+    const size_t oldest = (mNext + mRing.size() - mSize) % mRing.size();
+    mSnapshotSize = 0;
+    for (size_t i = 0; i < mSize; ++i) {
+        const Record& record = mRing[(oldest + i) % mRing.size()];
+        if (record.timestamp >= window_start) {
+            mSnapshot[mSnapshotSize++] = record;
+        }
+    }
+    mSnapshotTrigger = mTrigger;
+
+    // The writer may sleep through this wake-up, it polls the flag as well
+    mSnapshotReady.store(true, std::memory_order_release);
+    mThreadCondition.notify_one();
+}
+
+void FlightRecorder::ThreadFunction()
+{
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::DIAGNOSTICS, "Flight-Recorder");
+
+    std::unique_lock<std::mutex> lock(mThreadMutex);
+    while (mRunning) {
+        mThreadCondition.wait_for(lock, kWriterPollPeriod, [this] {
+            return !mRunning || mSnapshotReady.load(std::memory_order_acquire);
+        });
+        if (mSnapshotReady.load(std::memory_order_acquire)) {
+            lock.unlock();
+            WriteSnapshot();
+            lock.lock();
+        }
+    }
+}
+
+void FlightRecorder::WriteSnapshot()
+{
+    if (mkdir(mConfig.output_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Failed to create flight recorder directory " << mConfig.output_dir << std::endl;
+    }
+
+    const uint64_t index = mDumps.load(std::memory_order_relaxed);
+    char name[64];
+    snprintf(name, sizeof(name), "/flight_%04llu_%.3f", static_cast<unsigned long long>(index),
+             mSnapshotTrigger.timestamp);
+    const std::string base = mConfig.output_dir + name;
+
+    // The Tracer rings still hold the events around the trigger, written first before they wrap
+#ifdef ENABLE_TRACING
+    if (mConfig.include_trace && Tracer::IsEnabled()) {
+        Tracer::ExportChromeTrace(base + ".trace.json");
+    }
+#endif
+
+    const std::string path = base + ".csv";
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write flight recorder dump " << path << std::endl;
+        mSnapshotReady.store(false, std::memory_order_release);
+        return;
+    }
+
+    file << "# trigger_timestamp=" << mSnapshotTrigger.timestamp
+         << " latency_ms=" << mSnapshotTrigger.GetLatencyMs()
+         << " threshold_ms=" << mConfig.trigger_latency_ms
+         << " missed_triggers=" << mMissed.load(std::memory_order_relaxed) << "\n";
+
+    file << "timestamp,latency_ms";
+    for (size_t i = 1; i < kNumLatencyStages; ++i) {
+        file << ',' << GetLatencyStageName(static_cast<LatencyStage>(i)) << "_ms";
+    }
+    file << ",acquisition_ms,feature_ms,tracking_ms,extraction_wait_ms,tracking_wait_ms,motion_lock_wait_ms"
+         << ",extraction_queue,tracking_queue,dropped_sets,tracking_state"
+         << ",extraction_vcsw,extraction_ivcsw,extraction_majflt,tracking_vcsw,tracking_ivcsw,tracking_majflt\n";
+
+    file.precision(6);
+    for (size_t i = 0; i < mSnapshotSize; ++i) {
+        const Record& record = mSnapshot[i];
+        file << std::fixed << record.timestamp << std::defaultfloat << ',' << record.GetLatencyMs();
+
+        // Stage times from the previous stamped stage, as LatencyTracker measures them
+        double previous = record.latency.stamps[0];
+        for (size_t s = 1; s < kNumLatencyStages; ++s) {
+            const double stamp = record.latency.stamps[s];
+            file << ',';
+            if (stamp > 0.0 && previous > 0.0) {
+                file << (stamp - previous) * 1000.0;
+            }
+            if (stamp > 0.0) {
+                previous = stamp;
+            }
+        }
+
+        file << ',' << record.acquisition_ms << ',' << record.feature_ms << ',' << record.tracking_ms
+             << ',' << record.extraction_wait_ms << ',' << record.tracking_wait_ms << ',' << record.motion_lock_wait_ms
+             << ',' << record.extraction_queue_depth << ',' << record.tracking_queue_depth
+             << ',' << record.dropped_sets << ',' << record.tracking_state
+             << ',' << record.extraction_thread.voluntary_switches << ',' << record.extraction_thread.involuntary_switches
+             << ',' << record.extraction_thread.major_faults
+             << ',' << record.tracking_thread.voluntary_switches << ',' << record.tracking_thread.involuntary_switches
+             << ',' << record.tracking_thread.major_faults << '\n';
+    }
+    file.close();
+
+    // The snapshot goes back to Add() only once it is written
+    mSnapshotReady.store(false, std::memory_order_release);
+    if (file.fail()) {
+        std::cerr << "Failed to write flight recorder dump " << path << std::endl;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mPathMutex);
+        mLastDumpPath = path;
+    }
+    mDumps.fetch_add(1, std::memory_order_relaxed);
+    std::cout << "Flight recorder: " << mSnapshotSize << " frame sets before "
+              << mSnapshotTrigger.GetLatencyMs() << " ms written to " << path << std::endl;
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,452 @@
+#include "include/frame_capture_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+// File layout version 1:
+//   [FileHeader, zero padded to one page]
+//   [record]...
+// Each record starts on a kRecordAlignment boundary with a RecordHeader.
+// Frame payloads start on a page boundary inside their record.
+constexpr char kFileMagic[8] = {'V', 'R', 'F', 'C', 'A', 'P', '0', '1'};
+constexpr uint32_t kFileVersion = 1;
+constexpr uint32_t kRecordMagic = 0x52434656; // "VFCR"
+constexpr uint32_t kMaxCameras = 16;
+constexpr uint64_t kRecordAlignment = 64;
+
+enum RecordType : uint32_t {
+    kFrameRecord = 1,
+    kImuRecord = 2
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t num_cameras;
+    uint32_t reserved;
+    CaptureCameraInfo cameras[kMaxCameras];
+};
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t record_size;         // Bytes from this header to the next record
+};
+
+struct FrameRecord {
+    RecordHeader header;
+    uint64_t frame_id;
+    double timestamp;
+    int32_t camera_id;
+    int32_t width;
+    int32_t height;
+    int32_t is_keyframe;
+    uint64_t payload_offset;      // Relative to the record start
+    uint64_t payload_size;
+    int32_t scaled_width;
+    int32_t scaled_height;
+    int32_t scaled_stride;
+    int32_t reserved;
+    uint64_t scaled_payload_offset;
+    uint64_t scaled_payload_size;
+};
+
+struct ImuRecord {
+    RecordHeader header;
+    CaptureImuSample sample;
+};
+
+static_assert(sizeof(FrameRecord) <= kRecordAlignment * 2, "Frame record header too large");
+static_assert(sizeof(ImuRecord) <= kRecordAlignment, "IMU record too large");
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+}
+
+//------------------------------------------------------------------------------
+// FrameCaptureWriter
+//------------------------------------------------------------------------------
+
+FrameCaptureWriter::FrameCaptureWriter()
+    : mFd(-1),
+      mOffset(0),
+      mPageSize(static_cast<size_t>(sysconf(_SC_PAGESIZE)))
+{
+    mPadding.resize(mPageSize, 0);
+}
+
+FrameCaptureWriter::~FrameCaptureWriter()
+{
+    Close();
+}
+
+bool FrameCaptureWriter::Open(const std::string& path, const std::vector<CaptureCameraInfo>& cameras)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mFd >= 0) {
+        mLastErrorMessage = "Capture file already open";
+        return false;
+    }
+
+    if (cameras.size() > kMaxCameras) {
+        mLastErrorMessage = "Too many cameras for capture file: " + std::to_string(cameras.size());
+        return false;
+    }
+
+    mFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (mFd < 0) {
+        mLastErrorMessage = "Failed to create capture file: " + path + " - " + std::string(strerror(errno));
+        return false;
+    }
+    mOffset = 0;
+
+    // Header page
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kFileMagic, sizeof(header.magic));
+    header.version = kFileVersion;
+    header.page_size = static_cast<uint32_t>(mPageSize);
+    header.num_cameras = static_cast<uint32_t>(cameras.size());
+    std::copy(cameras.begin(), cameras.end(), header.cameras);
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = mPadding.data();
+    iov[1].iov_len = AlignUp(sizeof(header), mPageSize) - sizeof(header);
+
+    if (!AppendLocked(iov, 2)) {
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void FrameCaptureWriter::Close()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+bool FrameCaptureWriter::IsOpen() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFd >= 0;
+}
+
+bool FrameCaptureWriter::WriteFrame(const CaptureFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mFd < 0) {
+        mLastErrorMessage = "Capture file not open";
+        return false;
+    }
+
+    const bool has_scaled = frame.scaled_data && frame.scaled_size > 0;
+
+    // Lay out the record: header, then each payload on its own page boundary
+    const uint64_t start = mOffset;
+    const uint64_t payload = AlignUp(start + sizeof(FrameRecord), mPageSize);
+    const uint64_t payload_end = payload + frame.size;
+    const uint64_t scaled = has_scaled ? AlignUp(payload_end, mPageSize) : payload_end;
+    const uint64_t scaled_end = scaled + (has_scaled ? frame.scaled_size : 0);
+    const uint64_t end = AlignUp(scaled_end, kRecordAlignment);
+
+    FrameRecord record;
+    memset(&record, 0, sizeof(record));
+    record.header.magic = kRecordMagic;
+    record.header.type = kFrameRecord;
+    record.header.record_size = end - start;
+    record.frame_id = frame.frame_id;
+    record.timestamp = frame.timestamp;
+    record.camera_id = frame.camera_id;
+    record.width = frame.width;
+    record.height = frame.height;
+    record.is_keyframe = frame.is_keyframe ? 1 : 0;
+    record.payload_offset = payload - start;
+    record.payload_size = frame.size;
+    if (has_scaled) {
+        record.scaled_width = frame.scaled_width;
+        record.scaled_height = frame.scaled_height;
+        record.scaled_stride = frame.scaled_stride;
+        record.scaled_payload_offset = scaled - start;
+        record.scaled_payload_size = frame.scaled_size;
+    }
+
+    struct iovec iov[6];
+    int iovcnt = 0;
+    iov[iovcnt].iov_base = &record;
+    iov[iovcnt++].iov_len = sizeof(record);
+    iov[iovcnt].iov_base = mPadding.data();
+    iov[iovcnt++].iov_len = payload - (start + sizeof(record));
+    iov[iovcnt].iov_base = const_cast<void*>(frame.data);
+    iov[iovcnt++].iov_len = frame.size;
+    if (has_scaled) {
+        iov[iovcnt].iov_base = mPadding.data();
+        iov[iovcnt++].iov_len = scaled - payload_end;
+        iov[iovcnt].iov_base = const_cast<void*>(frame.scaled_data);
+        iov[iovcnt++].iov_len = frame.scaled_size;
+    }
+    iov[iovcnt].iov_base = mPadding.data();
+    iov[iovcnt++].iov_len = end - scaled_end;
+
+    return AppendLocked(iov, iovcnt);
+}
+
+bool FrameCaptureWriter::WriteImuSample(const CaptureImuSample& sample)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mFd < 0) {
+        mLastErrorMessage = "Capture file not open";
+        return false;
+    }
+
+    ImuRecord record;
+    memset(&record, 0, sizeof(record));
+    record.header.magic = kRecordMagic;
+    record.header.type = kImuRecord;
+    record.header.record_size = AlignUp(sizeof(record), kRecordAlignment);
+    record.sample = sample;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = mPadding.data();
+    iov[1].iov_len = record.header.record_size - sizeof(record);
+
+    return AppendLocked(iov, 2);
+}
+
+uint64_t FrameCaptureWriter::GetBytesWritten() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mOffset;
+}
+
+std::string FrameCaptureWriter::GetLastErrorMessage() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLastErrorMessage;
+}
+
+bool FrameCaptureWriter::AppendLocked(struct iovec* iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t written = writev(mFd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            mLastErrorMessage = "Failed to write capture file: " + std::string(strerror(errno));
+            return false;
+        }
+        mOffset += written;
+
+        // Skip what was written and resume after a short write
+        while (iovcnt > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// FrameCaptureReader
+//------------------------------------------------------------------------------
+
+FrameCaptureReader::FrameCaptureReader()
+    : mFd(-1),
+      mData(nullptr),
+      mSize(0)
+{
+}
+
+FrameCaptureReader::~FrameCaptureReader()
+{
+    Close();
+}
+
+bool FrameCaptureReader::Open(const std::string& path)
+{
+    if (mFd >= 0) {
+        mLastErrorMessage = "Capture file already open";
+        return false;
+    }
+
+    mFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (mFd < 0) {
+        mLastErrorMessage = "Failed to open capture file: " + path + " - " + std::string(strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(mFd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        mLastErrorMessage = "Capture file too short: " + path;
+        Close();
+        return false;
+    }
+    mSize = static_cast<size_t>(st.st_size);
+
+    void* data = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, mFd, 0);
+    if (data == MAP_FAILED) {
+        mLastErrorMessage = "Failed to map capture file: " + std::string(strerror(errno));
+        mSize = 0;
+        Close();
+        return false;
+    }
+    mData = static_cast<const uint8_t*>(data);
+    madvise(data, mSize, MADV_SEQUENTIAL);
+
+    // Validate the header
+    FileHeader header;
+    memcpy(&header, mData, sizeof(header));
+    if (memcmp(header.magic, kFileMagic, sizeof(header.magic)) != 0 ||
+        header.version != kFileVersion ||
+        header.num_cameras > kMaxCameras ||
+        header.page_size < sizeof(FileHeader)) {
+        mLastErrorMessage = "Not a frame capture file: " + path;
+        Close();
+        return false;
+    }
+    mCameras.assign(header.cameras, header.cameras + header.num_cameras);
+
+    // Index records; stop at the first incomplete one (capture cut short)
+    uint64_t offset = header.page_size;
+    while (offset + sizeof(RecordHeader) <= mSize) {
+        RecordHeader record_header;
+        memcpy(&record_header, mData + offset, sizeof(record_header));
+
+        if (record_header.magic != kRecordMagic ||
+            record_header.record_size < sizeof(RecordHeader) ||
+            record_header.record_size > mSize - offset) {
+            break;
+        }
+
+        if (record_header.type == kFrameRecord && record_header.record_size >= sizeof(FrameRecord)) {
+            FrameRecord record;
+            memcpy(&record, mData + offset, sizeof(record));
+            if (record.payload_offset + record.payload_size > record_header.record_size ||
+                record.scaled_payload_offset + record.scaled_payload_size > record_header.record_size) {
+                break;
+            }
+            mFrameOffsets.push_back(offset);
+        } else if (record_header.type == kImuRecord && record_header.record_size >= sizeof(ImuRecord)) {
+            ImuRecord record;
+            memcpy(&record, mData + offset, sizeof(record));
+            mImuSamples.push_back(record.sample);
+        }
+        // Unknown record types are skipped
+
+        offset += record_header.record_size;
+    }
+
+    // IMU samples may be appended slightly out of order by concurrent writers
+    std::stable_sort(mImuSamples.begin(), mImuSamples.end(),
+                     [](const CaptureImuSample& a, const CaptureImuSample& b) {
+                         return a.timestamp < b.timestamp;
+                     });
+
+    return true;
+}
+
+void FrameCaptureReader::Close()
+{
+    if (mData) {
+        munmap(const_cast<uint8_t*>(mData), mSize);
+        mData = nullptr;
+    }
+    mSize = 0;
+
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+
+    mCameras.clear();
+    mFrameOffsets.clear();
+    mImuSamples.clear();
+}
+
+bool FrameCaptureReader::IsOpen() const
+{
+    return mData != nullptr;
+}
+
+const std::vector<CaptureCameraInfo>& FrameCaptureReader::GetCameras() const
+{
+    return mCameras;
+}
+
+size_t FrameCaptureReader::GetFrameCount() const
+{
+    return mFrameOffsets.size();
+}
+
+bool FrameCaptureReader::GetFrame(size_t index, CaptureFrame& frame) const
+{
+    if (index >= mFrameOffsets.size()) {
+        return false;
+    }
+
+    const uint64_t offset = mFrameOffsets[index];
+    FrameRecord record;
+    memcpy(&record, mData + offset, sizeof(record));
+
+    frame.frame_id = record.frame_id;
+    frame.timestamp = record.timestamp;
+    frame.camera_id = record.camera_id;
+    frame.width = record.width;
+    frame.height = record.height;
+    frame.is_keyframe = record.is_keyframe != 0;
+    frame.data = mData + offset + record.payload_offset;
+    frame.size = record.payload_size;
+
+    frame.scaled_width = record.scaled_width;
+    frame.scaled_height = record.scaled_height;
+    frame.scaled_stride = record.scaled_stride;
+    frame.scaled_size = record.scaled_payload_size;
+    frame.scaled_data = record.scaled_payload_size > 0 ? mData + offset + record.scaled_payload_offset : nullptr;
+
+    return true;
+}
+
+const std::vector<CaptureImuSample>& FrameCaptureReader::GetImuSamples() const
+{
+    return mImuSamples;
+}
+
+std::string FrameCaptureReader::GetLastErrorMessage() const
+{
+    return mLastErrorMessage;
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,102 @@
+#include "include/keyframe_policy.hpp"
+#include <algorithm>
+
+namespace ORB_SLAM3
+{
+
+KeyFramePolicy::KeyFramePolicy()
+    : KeyFramePolicy(Config())
+{
+}
+
+KeyFramePolicy::KeyFramePolicy(const Config& config)
+    : mConfig(config)
+{
+    std::fill(mCounts, mCounts + static_cast<int>(Reason::COUNT), 0);
+}
+
+KeyFramePolicy::Decision KeyFramePolicy::Decide(const Candidate& candidate)
+{
+    Decision decision;
+
+    // Mapping time of the queue, the keyframe and the local BA that follows them
+    const float keyframe_ms = candidate.keyframe_cost_ms > 0.0f ?
+        candidate.keyframe_cost_ms : mConfig.camera_cost_ms * std::max(candidate.cameras, 1);
+    decision.mapping_ms = (std::max(candidate.queued_keyframes, 0) + 1) * keyframe_ms + candidate.local_ba_ms;
+    const float load = decision.mapping_ms / std::max(mConfig.mapping_budget_ms, 1e-3f);
+    decision.required_value = mConfig.min_value * (1.0f + load);
+
+    // Motion by the time the keyframe is mapped, the head keeps moving meanwhile
+    const float latency_s = decision.mapping_ms / 1000.0f;
+    const float baseline = candidate.translation_m + candidate.speed_mps * latency_s;
+    const float rotation = candidate.rotation_rad + candidate.angular_speed_radps * latency_s;
+    const float motion_value = std::max(baseline / std::max(mConfig.baseline_m, 1e-6f),
+                                        rotation / std::max(mConfig.rotation_rad, 1e-6f));
+    const float novel_value = candidate.novel_fraction / std::max(mConfig.novel_fraction, 1e-6f);
+    decision.value = std::max(motion_value, novel_value);
+
+    if (candidate.urgent) {
+        decision.reason = Reason::URGENT;
+        return Record(decision);
+    }
+    if (candidate.seconds_since_keyframe >= mConfig.max_interval_s) {
+        decision.reason = Reason::INTERVAL;
+        return Record(decision);
+    }
+
+    if (candidate.novel_cameras == 0 && decision.value < mConfig.redundant_value) {
+        decision.accept = false;
+        decision.reason = Reason::REDUNDANT;
+        return Record(decision);
+    }
+
+    decision.accept = decision.value >= decision.required_value;
+    decision.reason = decision.accept ? Reason::VALUE : Reason::BACKLOG;
+    return Record(decision);
+}
+
+const KeyFramePolicy::Config& KeyFramePolicy::GetConfig() const
+{
+    return mConfig;
+}
+
+void KeyFramePolicy::SetConfig(const Config& config)
+{
+    mConfig = config;
+}
+
+const KeyFramePolicy::Decision& KeyFramePolicy::GetLastDecision() const
+{
+    return mLastDecision;
+}
+
+uint64_t KeyFramePolicy::GetCount(Reason reason) const
+{
+    return reason < Reason::COUNT ? mCounts[static_cast<int>(reason)] : 0;
+}
+
+uint64_t KeyFramePolicy::GetSuppressedCount() const
+{
+    return GetCount(Reason::REDUNDANT) + GetCount(Reason::BACKLOG);
+}
+
+const char* KeyFramePolicy::GetReasonName(Reason reason)
+{
+    switch (reason) {
+        case Reason::URGENT: return "urgent";
+        case Reason::INTERVAL: return "interval";
+        case Reason::VALUE: return "value";
+        case Reason::REDUNDANT: return "redundant";
+        case Reason::BACKLOG: return "backlog";
+        default: return "unknown";
+    }
+}
+
+KeyFramePolicy::Decision KeyFramePolicy::Record(Decision decision)
+{
+    mCounts[static_cast<int>(decision.reason)]++;
+    mLastDecision = decision;
+    return decision;
+}
+
+} // namespace ORB_SLAM3
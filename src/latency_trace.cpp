@@ -0,0 +1,200 @@
+#include "include/latency_trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+const char* const kStageNames[kNumLatencyStages] = {
+    "exposure_mid",
+    "dqbuf",
+    "tpu_submit",
+    "tpu_done",
+    "track_done",
+    "pose_published"
+};
+}
+
+const char* GetLatencyStageName(LatencyStage stage)
+{
+    const size_t index = static_cast<size_t>(stage);
+    return index < kNumLatencyStages ? kStageNames[index] : "unknown";
+}
+
+double LatencyNowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+//------------------------------------------------------------------------------
+// LatencyStamps
+//------------------------------------------------------------------------------
+
+void LatencyStamps::Merge(const LatencyStamps& other)
+{
+    for (size_t i = 0; i < kNumLatencyStages; ++i) {
+        if (other.stamps[i] <= 0.0) {
+            continue;
+        }
+        if (stamps[i] <= 0.0) {
+            stamps[i] = other.stamps[i];
+        } else if (i == static_cast<size_t>(LatencyStage::EXPOSURE_MID)) {
+            stamps[i] = std::min(stamps[i], other.stamps[i]);
+        } else {
+            stamps[i] = std::max(stamps[i], other.stamps[i]);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// LatencyHistogram
+//------------------------------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram()
+    : mCount(0), mMaxUs(0)
+{
+    for (auto& bucket : mBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::BucketIndex(uint64_t value_us)
+{
+    // Values below kSubBuckets get one bucket each; above that, each power of
+    // two [2^msb, 2^(msb+1)) is split into kSubBuckets equal buckets
+    if (value_us < static_cast<uint64_t>(kSubBuckets)) {
+        return static_cast<int>(value_us);
+    }
+
+    const int msb = 63 - __builtin_clzll(value_us);
+    const int magnitude = msb - kSubBucketBits + 1;
+    const int sub_bucket = static_cast<int>((value_us >> (msb - kSubBucketBits)) & (kSubBuckets - 1));
+    return std::min(magnitude * kSubBuckets + sub_bucket, kNumBuckets - 1);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int index)
+{
+    const int magnitude = index / kSubBuckets;
+    const uint64_t sub_bucket = static_cast<uint64_t>(index % kSubBuckets);
+    if (magnitude == 0) {
+        return sub_bucket;
+    }
+
+    const int msb = magnitude + kSubBucketBits - 1;
+    const uint64_t width = 1ull << (msb - kSubBucketBits);
+    return (1ull << msb) + (sub_bucket + 1) * width - 1;
+}
+
+void LatencyHistogram::Record(double latency_ms)
+{
+    const uint64_t value_us = latency_ms > 0.0 ? static_cast<uint64_t>(std::llround(latency_ms * 1000.0)) : 0;
+
+    mBuckets[BucketIndex(value_us)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max_us = mMaxUs.load(std::memory_order_relaxed);
+    while (value_us > max_us &&
+           !mMaxUs.compare_exchange_weak(max_us, value_us, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::GetPercentile(double percentile) const
+{
+    const uint64_t count = mCount.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0.0;
+    }
+
+    // Rank of the sample the percentile falls on (1-based)
+    const double clamped = std::min(std::max(percentile, 0.0), 100.0);
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * count)));
+    const uint64_t max_us = mMaxUs.load(std::memory_order_relaxed);
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), max_us) / 1000.0;
+        }
+    }
+
+    // A concurrent Record() bumped the count before its bucket
+    return max_us / 1000.0;
+}
+
+LatencyPercentiles LatencyHistogram::GetPercentiles() const
+{
+    LatencyPercentiles percentiles;
+    percentiles.count = mCount.load(std::memory_order_relaxed);
+    percentiles.p50_ms = GetPercentile(50.0);
+    percentiles.p99_ms = GetPercentile(99.0);
+    percentiles.p999_ms = GetPercentile(99.9);
+    percentiles.max_ms = mMaxUs.load(std::memory_order_relaxed) / 1000.0;
+    return percentiles;
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+    return mCount.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto& bucket : mBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mMaxUs.store(0, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// LatencyTracker
+//------------------------------------------------------------------------------
+
+void LatencyTracker::Record(const LatencyStamps& stamps)
+{
+    // Each stage is measured from the last stage before it that was stamped
+    double previous = stamps.stamps[0];
+    for (size_t i = 1; i < kNumLatencyStages; ++i) {
+        const double stamp = stamps.stamps[i];
+        if (stamp <= 0.0) {
+            continue;
+        }
+        if (previous > 0.0) {
+            mStages[i].Record((stamp - previous) * 1000.0);
+        }
+        previous = stamp;
+    }
+
+    if (stamps.Has(LatencyStage::EXPOSURE_MID) && stamps.Has(LatencyStage::POSE_PUBLISHED)) {
+        mEndToEnd.Record((stamps.Get(LatencyStage::POSE_PUBLISHED) - stamps.Get(LatencyStage::EXPOSURE_MID)) * 1000.0);
+    }
+}
+
+LatencyPercentiles LatencyTracker::GetStagePercentiles(LatencyStage stage) const
+{
+    const size_t index = static_cast<size_t>(stage);
+    if (index >= kNumLatencyStages) {
+        return LatencyPercentiles();
+    }
+    return mStages[index].GetPercentiles();
+}
+
+LatencyPercentiles LatencyTracker::GetEndToEndPercentiles() const
+{
+    return mEndToEnd.GetPercentiles();
+}
+
+void LatencyTracker::Reset()
+{
+    for (auto& stage : mStages) {
+        stage.Reset();
+    }
+    mEndToEnd.Reset();
+}
+
+} // namespace ORB_SLAM3
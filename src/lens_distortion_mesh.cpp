@@ -0,0 +1,124 @@
+#include "include/lens_distortion_mesh.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+int16_t QuantizeOffset(double offset)
+{
+    const double q = std::round(offset * kDistortionMeshSubpixels);
+    return static_cast<int16_t>(std::max<double>(std::numeric_limits<int16_t>::min(),
+                                                 std::min<double>(std::numeric_limits<int16_t>::max(), q)));
+}
+
+// Offset from (x, y) to the pixel the channel with coefficients k samples there
+void RadialOffset(const LensCalibration& calibration, const double k[3], double x, double y,
+                  int16_t offset[2])
+{
+    const double dx = x - calibration.center_x;
+    const double dy = y - calibration.center_y;
+    const double r2 = (dx * dx + dy * dy) / (calibration.radius_px * calibration.radius_px);
+    const double gain = k[0] * r2 + k[1] * r2 * r2 + k[2] * r2 * r2 * r2;
+
+    offset[0] = QuantizeOffset(dx * gain);
+    offset[1] = QuantizeOffset(dy * gain);
+}
+
+const DistortionMeshHeader* MeshHeader(const std::vector<uint8_t>& mesh)
+{
+    if (mesh.size() < sizeof(DistortionMeshHeader))
+        return nullptr;
+
+    const DistortionMeshHeader* header = reinterpret_cast<const DistortionMeshHeader*>(mesh.data());
+    if (header->magic != kDistortionMeshMagic ||
+        header->cols < kDistortionMeshMinDim || header->cols > kDistortionMeshMaxDim ||
+        header->rows < kDistortionMeshMinDim || header->rows > kDistortionMeshMaxDim ||
+        header->width == 0 || header->height == 0)
+        return nullptr;
+
+    if (mesh.size() != sizeof(DistortionMeshHeader) +
+                       static_cast<size_t>(header->cols) * header->rows * sizeof(DistortionMeshVertex))
+        return nullptr;
+
+    return header;
+}
+} // namespace
+
+std::vector<uint8_t> BuildDistortionMesh(const LensCalibration& calibration, int cols, int rows)
+{
+    if (cols < kDistortionMeshMinDim || cols > kDistortionMeshMaxDim ||
+        rows < kDistortionMeshMinDim || rows > kDistortionMeshMaxDim)
+        return {};
+
+    if (calibration.width <= 0 || calibration.width > std::numeric_limits<uint16_t>::max() ||
+        calibration.height <= 0 || calibration.height > std::numeric_limits<uint16_t>::max() ||
+        calibration.radius_px <= 0.0)
+        return {};
+
+    std::vector<uint8_t> mesh(sizeof(DistortionMeshHeader) +
+                              static_cast<size_t>(cols) * rows * sizeof(DistortionMeshVertex));
+
+    DistortionMeshHeader header = {};
+    header.magic = kDistortionMeshMagic;
+    header.cols = static_cast<uint16_t>(cols);
+    header.rows = static_cast<uint16_t>(rows);
+    header.width = static_cast<uint16_t>(calibration.width);
+    header.height = static_cast<uint16_t>(calibration.height);
+    std::memcpy(mesh.data(), &header, sizeof(header));
+
+    DistortionMeshVertex* vertices = reinterpret_cast<DistortionMeshVertex*>(mesh.data() + sizeof(header));
+    for (int r = 0; r < rows; ++r) {
+        const double y = static_cast<double>(r) * calibration.height / (rows - 1);
+        for (int c = 0; c < cols; ++c) {
+            const double x = static_cast<double>(c) * calibration.width / (cols - 1);
+            DistortionMeshVertex& vertex = vertices[r * cols + c];
+            RadialOffset(calibration, calibration.k_red, x, y, vertex.red);
+            RadialOffset(calibration, calibration.k_green, x, y, vertex.green);
+            RadialOffset(calibration, calibration.k_blue, x, y, vertex.blue);
+        }
+    }
+
+    return mesh;
+}
+
+bool SampleDistortionMesh(const std::vector<uint8_t>& mesh, double x, double y, int channel,
+                          double& src_x, double& src_y)
+{
+    const DistortionMeshHeader* header = MeshHeader(mesh);
+    if (!header || channel < 0 || channel > 2)
+        return false;
+
+    const DistortionMeshVertex* vertices =
+        reinterpret_cast<const DistortionMeshVertex*>(mesh.data() + sizeof(DistortionMeshHeader));
+
+    const double fx = x * (header->cols - 1) / header->width;
+    const double fy = y * (header->rows - 1) / header->height;
+    const int c0 = std::max(0, std::min<int>(header->cols - 2, static_cast<int>(std::floor(fx))));
+    const int r0 = std::max(0, std::min<int>(header->rows - 2, static_cast<int>(std::floor(fy))));
+    const double tx = fx - c0;
+    const double ty = fy - r0;
+
+    auto offset = [&](int c, int r, int axis) {
+        const DistortionMeshVertex& vertex = vertices[r * header->cols + c];
+        const int16_t* channels[3] = {vertex.red, vertex.green, vertex.blue};
+        return static_cast<double>(channels[channel][axis]) / kDistortionMeshSubpixels;
+    };
+
+    for (int axis = 0; axis < 2; ++axis) {
+        const double top = offset(c0, r0, axis) * (1.0 - tx) + offset(c0 + 1, r0, axis) * tx;
+        const double bottom = offset(c0, r0 + 1, axis) * (1.0 - tx) + offset(c0 + 1, r0 + 1, axis) * tx;
+        const double value = top * (1.0 - ty) + bottom * ty;
+        if (axis == 0)
+            src_x = x + value;
+        else
+            src_y = y + value;
+    }
+
+    return true;
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,796 @@
+#include "include/map_sharing.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// Keypoint coordinates are stored in 1/kPositionScale pixels
+constexpr float kPositionScale = 16.0f;
+constexpr float kMaxPosition = 65535.0f / kPositionScale;
+
+// Bytes taken per recv() call
+constexpr size_t kReceiveChunk = 64 * 1024;
+
+double MonotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+bool ResolveAddress(const std::string& host, int port, struct sockaddr_in& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    return inet_pton(AF_INET, host.c_str(), &address.sin_addr) == 1;
+}
+
+bool SetNonBlocking(int fd)
+{
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+MapDeltaHeader MakeHeader(uint16_t kind, uint16_t device_id, uint32_t payload_bytes)
+{
+    MapDeltaHeader header;
+    header.magic = kMapDeltaMagic;
+    header.version = kMapDeltaVersion;
+    header.kind = kind;
+    header.device_id = device_id;
+    header.reserved = 0;
+    header.payload_bytes = payload_bytes;
+    return header;
+}
+
+bool ValidHeader(const MapDeltaHeader& header)
+{
+    return header.magic == kMapDeltaMagic && header.version == kMapDeltaVersion &&
+           header.payload_bytes <= kMaxMapDeltaPayload;
+}
+
+// Appends to a payload
+class Writer
+{
+public:
+    explicit Writer(std::vector<uint8_t>& out) : mOut(out) {}
+
+    void Bytes(const void* data, size_t size)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        mOut.insert(mOut.end(), p, p + size);
+    }
+
+    template <typename T>
+    void Raw(const T& value) { Bytes(&value, sizeof(T)); }
+
+    void Varint(uint64_t value)
+    {
+        while (value >= 0x80) {
+            mOut.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        mOut.push_back(static_cast<uint8_t>(value));
+    }
+
+private:
+    std::vector<uint8_t>& mOut;
+};
+
+// Reads a payload, every read fails once the payload is exhausted
+class Reader
+{
+public:
+    Reader(const uint8_t* data, size_t size) : mData(data), mEnd(data + size) {}
+
+    bool Bytes(void* out, size_t size)
+    {
+        if (static_cast<size_t>(mEnd - mData) < size) {
+            return false;
+        }
+        std::memcpy(out, mData, size);
+        mData += size;
+        return true;
+    }
+
+    template <typename T>
+    bool Raw(T& value) { return Bytes(&value, sizeof(T)); }
+
+    bool Varint(uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && mData < mEnd; shift += 7) {
+            const uint8_t byte = *mData++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A count of items taking at least min_bytes each, bounded by the bytes left
+    bool Count(size_t min_bytes, size_t& count)
+    {
+        uint64_t value;
+        if (!Varint(value) || value > static_cast<uint64_t>(mEnd - mData) / std::max<size_t>(min_bytes, 1)) {
+            return false;
+        }
+        count = static_cast<size_t>(value);
+        return true;
+    }
+
+    bool Done() const { return mData == mEnd; }
+
+private:
+    const uint8_t* mData;
+    const uint8_t* mEnd;
+};
+
+} // namespace
+
+bool MapDeltaCodec::Encode(const KeyFrameDelta& delta, std::vector<uint8_t>& payload)
+{
+    const size_t n = delta.keypoints.size();
+    if (delta.descriptors.size() != n * kMapDeltaDescriptorBytes || delta.observations.size() != n) {
+        return false;
+    }
+    for (int32_t observation : delta.observations) {
+        if (observation < -1 || observation >= static_cast<int32_t>(delta.points.size())) {
+            return false;
+        }
+    }
+
+    payload.clear();
+    payload.reserve(64 + n * (6 + kMapDeltaDescriptorBytes + 2) + delta.bow.size() * 4 + delta.points.size() * 16);
+    Writer writer(payload);
+
+    writer.Varint(delta.keyframe_id);
+    writer.Raw(delta.timestamp);
+    writer.Bytes(delta.rotation, sizeof(delta.rotation));
+    writer.Bytes(delta.translation, sizeof(delta.translation));
+    writer.Raw(delta.camera);
+
+    writer.Varint(n);
+    for (const KeyFrameDeltaKeyPoint& keypoint : delta.keypoints) {
+        const uint16_t x = static_cast<uint16_t>(std::lround(std::min(std::max(keypoint.x, 0.0f), kMaxPosition) * kPositionScale));
+        const uint16_t y = static_cast<uint16_t>(std::lround(std::min(std::max(keypoint.y, 0.0f), kMaxPosition) * kPositionScale));
+        float angle = std::fmod(keypoint.angle, 360.0f);
+        if (angle < 0.0f) {
+            angle += 360.0f;
+        }
+        const uint8_t quantized_angle = static_cast<uint8_t>(static_cast<int>(std::lround(angle * (256.0f / 360.0f))) & 0xff);
+        writer.Raw(x);
+        writer.Raw(y);
+        writer.Raw(keypoint.octave);
+        writer.Raw(quantized_angle);
+    }
+    writer.Bytes(delta.descriptors.data(), delta.descriptors.size());
+
+    // Word ids increase, only their differences are stored
+    writer.Varint(delta.bow.size());
+    uint32_t previous_word = 0;
+    for (const auto& word : delta.bow) {
+        writer.Varint(word.first - previous_word);
+        previous_word = word.first;
+        const uint16_t weight = static_cast<uint16_t>(std::lround(std::min(std::max(word.second, 0.0f), 1.0f) * 65535.0f));
+        writer.Raw(weight);
+    }
+
+    // Points in increasing id order, the observations refer to that order
+    std::vector<uint32_t> order(delta.points.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<uint32_t>(i);
+    }
+    std::sort(order.begin(), order.end(), [&delta](uint32_t a, uint32_t b) {
+        return delta.points[a].id < delta.points[b].id;
+    });
+    std::vector<uint32_t> rank(order.size());
+    writer.Varint(order.size());
+    uint64_t previous_id = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        const MapPointDelta& point = delta.points[order[i]];
+        rank[order[i]] = static_cast<uint32_t>(i);
+        writer.Varint(point.id - previous_id);
+        previous_id = point.id;
+        writer.Bytes(point.position, sizeof(point.position));
+    }
+
+    for (int32_t observation : delta.observations) {
+        writer.Varint(observation < 0 ? 0 : rank[observation] + 1);
+    }
+    return true;
+}
+
+bool MapDeltaCodec::Decode(const uint8_t* payload, size_t size, uint16_t device_id, KeyFrameDelta& delta)
+{
+    Reader reader(payload, size);
+    delta.device_id = device_id;
+
+    size_t n;
+    if (!reader.Varint(delta.keyframe_id) || !reader.Raw(delta.timestamp) ||
+        !reader.Bytes(delta.rotation, sizeof(delta.rotation)) ||
+        !reader.Bytes(delta.translation, sizeof(delta.translation)) ||
+        !reader.Raw(delta.camera) || !reader.Count(6 + kMapDeltaDescriptorBytes + 1, n)) {
+        return false;
+    }
+
+    delta.keypoints.resize(n);
+    for (KeyFrameDeltaKeyPoint& keypoint : delta.keypoints) {
+        uint16_t x, y;
+        uint8_t angle;
+        if (!reader.Raw(x) || !reader.Raw(y) || !reader.Raw(keypoint.octave) || !reader.Raw(angle)) {
+            return false;
+        }
+        keypoint.x = x / kPositionScale;
+        keypoint.y = y / kPositionScale;
+        keypoint.angle = angle * (360.0f / 256.0f);
+    }
+    delta.descriptors.resize(n * kMapDeltaDescriptorBytes);
+    if (!reader.Bytes(delta.descriptors.data(), delta.descriptors.size())) {
+        return false;
+    }
+
+    size_t words;
+    if (!reader.Count(3, words)) {
+        return false;
+    }
+    delta.bow.resize(words);
+    uint64_t word_id = 0;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t step;
+        uint16_t weight;
+        if (!reader.Varint(step) || !reader.Raw(weight)) {
+            return false;
+        }
+        word_id += step;
+        if (word_id > UINT32_MAX || (i > 0 && step == 0)) {
+            return false;
+        }
+        delta.bow[i] = std::make_pair(static_cast<uint32_t>(word_id), weight / 65535.0f);
+    }
+
+    size_t points;
+    if (!reader.Count(1 + sizeof(float) * 3, points)) {
+        return false;
+    }
+    delta.points.resize(points);
+    uint64_t point_id = 0;
+    for (MapPointDelta& point : delta.points) {
+        uint64_t step;
+        if (!reader.Varint(step) || !reader.Bytes(point.position, sizeof(point.position))) {
+            return false;
+        }
+        point_id += step;
+        point.id = point_id;
+    }
+
+    delta.observations.resize(n);
+    for (int32_t& observation : delta.observations) {
+        uint64_t value;
+        if (!reader.Varint(value) || value > points) {
+            return false;
+        }
+        observation = static_cast<int32_t>(value) - 1;
+    }
+    return reader.Done();
+}
+
+MapShareClient::MapShareClient(const Options& options)
+    : mValid(false)
+    , mOptions(options)
+    , mSocket(-1)
+    , mConnected(false)
+    , mNextConnectTime(0.0)
+    , mHelloSent(0)
+    , mSendOffset(0)
+    , mQueuedBytes(0)
+{
+    struct sockaddr_in address;
+    mValid = ResolveAddress(options.host, options.port, address);
+
+    const MapDeltaHeader hello = MakeHeader(kMapDeltaHello, options.device_id, 0);
+    mHello.assign(reinterpret_cast<const uint8_t*>(&hello), reinterpret_cast<const uint8_t*>(&hello) + sizeof(hello));
+}
+
+MapShareClient::~MapShareClient()
+{
+    disconnect();
+}
+
+bool MapShareClient::IsValid() const
+{
+    return mValid;
+}
+
+bool MapShareClient::IsConnected() const
+{
+    return mConnected;
+}
+
+bool MapShareClient::Publish(const KeyFrameDelta& delta)
+{
+    std::vector<uint8_t> message(sizeof(MapDeltaHeader));
+    std::vector<uint8_t> payload;
+    const bool encoded = MapDeltaCodec::Encode(delta, payload) && payload.size() <= kMaxMapDeltaPayload;
+    {
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        mStats.deltas_published++;
+        if (!encoded) {
+            mStats.deltas_dropped++;
+            return false;
+        }
+    }
+
+    const MapDeltaHeader header = MakeHeader(kMapDeltaKeyFrame, mOptions.device_id, static_cast<uint32_t>(payload.size()));
+    std::memcpy(message.data(), &header, sizeof(header));
+    message.insert(message.end(), payload.begin(), payload.end());
+
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        if (mQueuedBytes + message.size() <= mOptions.max_queued_bytes) {
+            mQueuedBytes += message.size();
+            mQueue.push_back(std::move(message));
+            return true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats.deltas_dropped++;
+    return false;
+}
+
+size_t MapShareClient::Poll(std::vector<KeyFrameDelta>& received, int timeout_ms)
+{
+    if (!mValid) {
+        return 0;
+    }
+    if (!mConnected && !connect()) {
+        return 0;
+    }
+
+    bool pending_send;
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        pending_send = mHelloSent < mHello.size() || !mQueue.empty();
+    }
+
+    struct pollfd pfd;
+    pfd.fd = mSocket;
+    pfd.events = POLLIN | (pending_send ? POLLOUT : 0);
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return 0;
+    }
+
+    size_t count = 0;
+    if ((pfd.revents & (POLLERR | POLLHUP)) && !(pfd.revents & POLLIN)) {
+        disconnect();
+        return 0;
+    }
+    if ((pfd.revents & POLLOUT) && !flush()) {
+        disconnect();
+        return 0;
+    }
+    if ((pfd.revents & POLLIN) && !receive(received, count)) {
+        disconnect();
+    }
+    return count;
+}
+
+MapShareClient::Stats MapShareClient::GetStats() const
+{
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        stats = mStats;
+    }
+    std::lock_guard<std::mutex> lock(mQueueMutex);
+    stats.queued_bytes = mQueuedBytes;
+    return stats;
+}
+
+bool MapShareClient::connect()
+{
+    const double now = MonotonicSeconds();
+    if (now < mNextConnectTime) {
+        return false;
+    }
+    mNextConnectTime = now + mOptions.reconnect_interval_ms / 1000.0;
+
+    struct sockaddr_in address;
+    ResolveAddress(mOptions.host, mOptions.port, address);
+    mSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (mSocket < 0) {
+        return false;
+    }
+
+    // Deltas are latency tolerant, but a keyframe should not wait for more to coalesce
+    const int one = 1;
+    setsockopt(mSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    const int tos = mOptions.dscp << 2;
+    setsockopt(mSocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    // The connect blocks at most one reconnect interval, the server is on the local network
+    if (::connect(mSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 || !SetNonBlocking(mSocket)) {
+        close(mSocket);
+        mSocket = -1;
+        return false;
+    }
+
+    mConnected = true;
+    mHelloSent = 0;
+    mSendOffset = 0;
+    mReceiveBuffer.clear();
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats.connections++;
+    return true;
+}
+
+void MapShareClient::disconnect()
+{
+    if (mSocket >= 0) {
+        close(mSocket);
+        mSocket = -1;
+    }
+    // The front message is sent again in full on the next connection
+    mConnected = false;
+    mSendOffset = 0;
+}
+
+bool MapShareClient::flush()
+{
+    while (mHelloSent < mHello.size()) {
+        const ssize_t sent = send(mSocket, mHello.data() + mHelloSent, mHello.size() - mHelloSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        mHelloSent += static_cast<size_t>(sent);
+    }
+
+    for (;;) {
+        const std::vector<uint8_t>* message;
+        {
+            std::lock_guard<std::mutex> lock(mQueueMutex);
+            if (mQueue.empty()) {
+                return true;
+            }
+            message = &mQueue.front();
+        }
+
+        // Only Poll() removes from the queue, the front stays valid while Publish() appends
+        const ssize_t sent = send(mSocket, message->data() + mSendOffset, message->size() - mSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        mSendOffset += static_cast<size_t>(sent);
+        {
+            std::lock_guard<std::mutex> lock(mStatsMutex);
+            mStats.bytes_sent += static_cast<uint64_t>(sent);
+        }
+        if (mSendOffset < message->size()) {
+            return true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mQueueMutex);
+            mQueuedBytes -= message->size();
+            mQueue.pop_front();
+        }
+        mSendOffset = 0;
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        mStats.deltas_sent++;
+    }
+}
+
+bool MapShareClient::receive(std::vector<KeyFrameDelta>& received, size_t& count)
+{
+    const size_t old_size = mReceiveBuffer.size();
+    mReceiveBuffer.resize(old_size + kReceiveChunk);
+    const ssize_t bytes = recv(mSocket, mReceiveBuffer.data() + old_size, kReceiveChunk, MSG_DONTWAIT);
+    if (bytes <= 0) {
+        mReceiveBuffer.resize(old_size);
+        return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    mReceiveBuffer.resize(old_size + static_cast<size_t>(bytes));
+
+    uint64_t invalid = 0;
+    size_t offset = 0;
+    bool ok = true;
+    while (mReceiveBuffer.size() - offset >= sizeof(MapDeltaHeader)) {
+        MapDeltaHeader header;
+        std::memcpy(&header, mReceiveBuffer.data() + offset, sizeof(header));
+        if (!ValidHeader(header)) {
+            // The stream cannot be resynchronized, start over on a new connection
+            invalid++;
+            ok = false;
+            break;
+        }
+        if (mReceiveBuffer.size() - offset < sizeof(header) + header.payload_bytes) {
+            break;
+        }
+
+        const uint8_t* payload = mReceiveBuffer.data() + offset + sizeof(header);
+        offset += sizeof(header) + header.payload_bytes;
+        if (header.kind != kMapDeltaKeyFrame || header.device_id == mOptions.device_id) {
+            continue;
+        }
+
+        KeyFrameDelta delta;
+        if (MapDeltaCodec::Decode(payload, header.payload_bytes, header.device_id, delta)) {
+            received.push_back(std::move(delta));
+            count++;
+        } else {
+            invalid++;
+        }
+    }
+    mReceiveBuffer.erase(mReceiveBuffer.begin(), mReceiveBuffer.begin() + offset);
+
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats.bytes_received += static_cast<uint64_t>(bytes);
+    mStats.deltas_received += count;
+    mStats.messages_invalid += invalid;
+    return ok;
+}
+
+MapShareServer::MapShareServer(const Options& options)
+    : mValid(false)
+    , mOptions(options)
+    , mSocket(-1)
+    , mPort(0)
+{
+    mSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (mSocket < 0) {
+        return;
+    }
+
+    const int one = 1;
+    setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    socklen_t length = sizeof(address);
+    if (bind(mSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(mSocket, options.max_clients) != 0 || !SetNonBlocking(mSocket) ||
+        getsockname(mSocket, reinterpret_cast<struct sockaddr*>(&address), &length) != 0) {
+        close(mSocket);
+        mSocket = -1;
+        return;
+    }
+
+    mPort = ntohs(address.sin_port);
+    mValid = true;
+}
+
+MapShareServer::~MapShareServer()
+{
+    for (const Client& client : mClients) {
+        close(client.fd);
+    }
+    if (mSocket >= 0) {
+        close(mSocket);
+    }
+}
+
+bool MapShareServer::IsValid() const
+{
+    return mValid;
+}
+
+int MapShareServer::GetPort() const
+{
+    return mPort;
+}
+
+void MapShareServer::Poll(int timeout_ms)
+{
+    if (!mValid) {
+        return;
+    }
+
+    std::vector<struct pollfd> fds(mClients.size() + 1);
+    fds[0].fd = mSocket;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    for (size_t i = 0; i < mClients.size(); ++i) {
+        fds[i + 1].fd = mClients[i].fd;
+        fds[i + 1].events = POLLIN | (mClients[i].send_offset < mClients[i].send_buffer.size() ? POLLOUT : 0);
+        fds[i + 1].revents = 0;
+    }
+    if (poll(fds.data(), fds.size(), timeout_ms) <= 0) {
+        return;
+    }
+
+    // Clients from the back so closing one does not shift those not visited yet
+    for (size_t i = mClients.size(); i > 0; --i) {
+        const short revents = fds[i].revents;
+        Client& client = mClients[i - 1];
+        bool ok = !((revents & (POLLERR | POLLHUP)) && !(revents & POLLIN));
+        if (ok && (revents & POLLIN)) {
+            ok = receive(client);
+        }
+        if (ok && (revents & POLLOUT)) {
+            ok = flush(client);
+        }
+        if (!ok) {
+            closeClient(i - 1);
+        }
+    }
+
+    // Relayed deltas were queued, write what the sockets take now
+    for (size_t i = mClients.size(); i > 0; --i) {
+        if (!flush(mClients[i - 1])) {
+            closeClient(i - 1);
+        }
+    }
+
+    if (fds[0].revents & POLLIN) {
+        accept();
+    }
+}
+
+MapShareServer::Stats MapShareServer::GetStats() const
+{
+    Stats stats = mStats;
+    stats.clients = static_cast<int>(mClients.size());
+    return stats;
+}
+
+void MapShareServer::accept()
+{
+    for (;;) {
+        const int fd = accept4(mSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (static_cast<int>(mClients.size()) >= mOptions.max_clients) {
+            close(fd);
+            continue;
+        }
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Client client;
+        client.fd = fd;
+        mClients.push_back(std::move(client));
+    }
+}
+
+bool MapShareServer::receive(Client& client)
+{
+    const size_t old_size = client.receive_buffer.size();
+    client.receive_buffer.resize(old_size + kReceiveChunk);
+    const ssize_t bytes = recv(client.fd, client.receive_buffer.data() + old_size, kReceiveChunk, MSG_DONTWAIT);
+    if (bytes <= 0) {
+        client.receive_buffer.resize(old_size);
+        return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    client.receive_buffer.resize(old_size + static_cast<size_t>(bytes));
+
+    size_t offset = 0;
+    while (client.receive_buffer.size() - offset >= sizeof(MapDeltaHeader)) {
+        MapDeltaHeader header;
+        std::memcpy(&header, client.receive_buffer.data() + offset, sizeof(header));
+        if (!ValidHeader(header)) {
+            mStats.messages_invalid++;
+            return false;
+        }
+        const size_t size = sizeof(header) + header.payload_bytes;
+        if (client.receive_buffer.size() - offset < size) {
+            break;
+        }
+        if (!handleMessage(client, header, client.receive_buffer.data() + offset, size)) {
+            return false;
+        }
+        offset += size;
+    }
+    client.receive_buffer.erase(client.receive_buffer.begin(), client.receive_buffer.begin() + offset);
+    return true;
+}
+
+bool MapShareServer::handleMessage(Client& client, const MapDeltaHeader& header, const uint8_t* message, size_t size)
+{
+    if (header.kind == kMapDeltaHello) {
+        if (client.hello) {
+            return true;
+        }
+        client.hello = true;
+        client.device_id = header.device_id;
+
+        // Catch up with the shared map
+        for (const LogEntry& entry : mLog) {
+            if (entry.device_id != client.device_id && !queueMessage(client, entry.message.data(), entry.message.size())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (header.kind != kMapDeltaKeyFrame || !client.hello || header.device_id != client.device_id) {
+        mStats.messages_invalid++;
+        return false;
+    }
+    mStats.deltas_received++;
+
+    LogEntry entry;
+    entry.device_id = header.device_id;
+    entry.message.assign(message, message + size);
+    mStats.log_bytes += size;
+    mLog.push_back(std::move(entry));
+    while (mStats.log_bytes > mOptions.max_log_bytes && !mLog.empty()) {
+        mStats.log_bytes -= mLog.front().message.size();
+        mLog.pop_front();
+    }
+
+    // A client whose backlog overflows is closed by Poll(), the others still get the delta
+    for (Client& other : mClients) {
+        if (&other != &client && other.hello && other.device_id != client.device_id) {
+            queueMessage(other, message, size);
+        }
+    }
+    return true;
+}
+
+bool MapShareServer::queueMessage(Client& client, const uint8_t* message, size_t size)
+{
+    if (client.dropped) {
+        return false;
+    }
+    if (client.send_buffer.size() - client.send_offset + size > mOptions.max_client_backlog_bytes) {
+        client.dropped = true;
+        mStats.clients_dropped++;
+        return false;
+    }
+
+    // Written out bytes are dropped before the buffer grows again
+    if (client.send_offset > 0 && client.send_offset == client.send_buffer.size()) {
+        client.send_buffer.clear();
+        client.send_offset = 0;
+    }
+    client.send_buffer.insert(client.send_buffer.end(), message, message + size);
+    mStats.deltas_relayed++;
+    mStats.bytes_relayed += size;
+    return true;
+}
+
+bool MapShareServer::flush(Client& client)
+{
+    if (client.dropped) {
+        return false;
+    }
+    while (client.send_offset < client.send_buffer.size()) {
+        const ssize_t sent = send(client.fd, client.send_buffer.data() + client.send_offset,
+                                  client.send_buffer.size() - client.send_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.send_offset += static_cast<size_t>(sent);
+    }
+    client.send_buffer.clear();
+    client.send_offset = 0;
+    return true;
+}
+
+void MapShareServer::closeClient(size_t index)
+{
+    close(mClients[index].fd);
+    mClients.erase(mClients.begin() + index);
+}
+
+} // namespace ORB_SLAM3
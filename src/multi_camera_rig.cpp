@@ -1,20 +1,97 @@
 #include "include/multi_camera_rig.hpp"
+#include "../ORB_SLAM3/include/Converter.h"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/calib3d.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <cmath>
+#include <limits>
+#include <Eigen/Dense>
 #include <json/json.h> // For JSON serialization
 
 namespace ORB_SLAM3
 {
 
-MultiCameraRig::MultiCameraRig() : reference_camera_id_(-1)
+namespace {
+
+// Finds and refines the chessboard corners, the fast check rejects images without the pattern early
+bool detectPattern(const cv::Mat& image, const cv::Size& pattern_size, std::vector<cv::Point2f>& corners)
+{
+    cv::Mat gray = image;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    }
+    
+    const int flags = cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK;
+    if (!cv::findChessboardCorners(gray, pattern_size, corners, flags)) {
+        corners.clear();
+        return false;
+    }
+    cv::cornerSubPix(gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
+    return true;
+}
+
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrixXd;
+
+// Rotation vector and translation of a pose
+Vector6d poseToVector(const Sophus::SE3d& T)
 {
+    Vector6d v;
+    v << T.so3().log(), T.translation();
+    return v;
 }
 
-MultiCameraRig::MultiCameraRig(int reference_camera_id) : reference_camera_id_(reference_camera_id)
+Sophus::SE3d vectorToPose(const Vector6d& v)
+{
+    return Sophus::SE3d(Sophus::SO3d::exp(v.head<3>()), v.tail<3>());
+}
+
+// Pose of the pattern in a camera from its corners, and the RMS reprojection error
+Sophus::SE3d solvePatternPose(const std::vector<cv::Point3f>& pattern_points, const std::vector<cv::Point2f>& corners,
+                              const cv::Mat& K, const cv::Mat& distCoef, double& rms)
+{
+    cv::Mat rvec, tvec;
+    cv::solvePnP(pattern_points, corners, K, distCoef, rvec, tvec);
+    
+    std::vector<cv::Point2f> projected;
+    cv::projectPoints(pattern_points, rvec, tvec, K, distCoef, projected);
+    rms = cv::norm(projected, corners, cv::NORM_L2) / std::sqrt(static_cast<double>(corners.size()));
+    
+    Vector6d v;
+    v << rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2),
+         tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2);
+    return vectorToPose(v);
+}
+
+// 6x6 derivative of a composed pose from the four blocks of cv::composeRT
+Matrix6d composeDerivative(const cv::Mat& drdr, const cv::Mat& drdt, const cv::Mat& dtdr, const cv::Mat& dtdt)
+{
+    Matrix6d D;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            D(r, c) = drdr.at<double>(r, c);
+            D(r, c + 3) = drdt.at<double>(r, c);
+            D(r + 3, c) = dtdr.at<double>(r, c);
+            D(r + 3, c + 3) = dtdt.at<double>(r, c);
+        }
+    }
+    return D;
+}
+
+} // namespace
+
+MultiCameraRig::MultiCameraRig() : reference_camera_id_(-1), transforms_valid_(false)
+{
+}
+
+MultiCameraRig::MultiCameraRig(int reference_camera_id)
+    : reference_camera_id_(reference_camera_id), transforms_valid_(false)
 {
 }
 
@@ -38,6 +115,7 @@ bool MultiCameraRig::AddCamera(const CameraInfo& camera)
         reference_camera_id_ = camera.id;
     }
     
+    InvalidateCalibrationCaches();
     return true;
 }
 
@@ -61,6 +139,7 @@ bool MultiCameraRig::RemoveCamera(int camera_id)
         }
     }
     
+    InvalidateCalibrationCaches();
     return true;
 }
 
@@ -85,6 +164,16 @@ std::vector<MultiCameraRig::CameraInfo> MultiCameraRig::GetAllCameras() const
     return result;
 }
 
+const std::map<int, MultiCameraRig::CameraInfo>& MultiCameraRig::GetCameras() const
+{
+    return cameras_;
+}
+
+size_t MultiCameraRig::GetNumCameras() const
+{
+    return cameras_.size();
+}
+
 int MultiCameraRig::GetReferenceCameraId() const
 {
     return reference_camera_id_;
@@ -118,13 +207,15 @@ bool MultiCameraRig::SetReferenceCameraId(int camera_id)
         cameras_[camera_id].T_ref_cam = cv::Mat::eye(4, 4, CV_32F);
     }
     
+    InvalidateCalibrationCaches();
     return true;
 }
 
 bool MultiCameraRig::CalibrateRig(
     const std::vector<std::vector<cv::Mat>>& calibration_images,
     const cv::Size& pattern_size,
-    float square_size)
+    float square_size,
+    const CalibrationTargets& targets)
 {
     // Check if we have enough cameras
     if (cameras_.empty()) {
@@ -139,28 +230,273 @@ bool MultiCameraRig::CalibrateRig(
         return false;
     }
     
-    // Step 1: Calibrate individual cameras
-    if (!CalibrateIndividualCameras(calibration_images, pattern_size, square_size)) {
+    BeginCalibration(pattern_size, square_size, targets);
+    
+    // Image sets in capture order, enough of them at a time to detect on every core
+    size_t num_sets = 0;
+    for (const auto& images : calibration_images) {
+        num_sets = std::max(num_sets, images.size());
+    }
+    const size_t chunk = std::max<size_t>(1, (cv::getNumThreads() + cameras_.size() - 1) / cameras_.size());
+    for (size_t first = 0; first < num_sets && !IsCalibrationConverged(); first += chunk) {
+        std::vector<std::vector<cv::Mat>> image_sets;
+        for (size_t set = first; set < std::min(num_sets, first + chunk); ++set) {
+            std::vector<cv::Mat> images(cameras_.size());
+            for (size_t camera_idx = 0; camera_idx < cameras_.size(); ++camera_idx) {
+                if (set < calibration_images[camera_idx].size()) {
+                    images[camera_idx] = calibration_images[camera_idx][set];
+                }
+            }
+            image_sets.push_back(images);
+        }
+        AddCalibrationImageSets(image_sets);
+    }
+    
+    return FinishCalibration();
+}
+
+void MultiCameraRig::BeginCalibration(
+    const cv::Size& pattern_size,
+    float square_size,
+    const CalibrationTargets& targets)
+{
+    calibration_ = CalibrationSession();
+    calibration_.active = true;
+    calibration_.pattern_size = pattern_size;
+    calibration_.targets = targets;
+    
+    // Object points (3D points on the pattern plane)
+    for (int i = 0; i < pattern_size.height; ++i) {
+        for (int j = 0; j < pattern_size.width; ++j) {
+            calibration_.pattern_points.push_back(cv::Point3f(j * square_size, i * square_size, 0));
+        }
+    }
+    
+    for (const auto& pair : cameras_) {
+        CameraCalibration camera;
+        camera.id = pair.first;
+        camera.image_size = cv::Size(pair.second.width, pair.second.height);
+        camera.coverage = cv::Mat::zeros(std::max(targets.coverage_rows, 1), std::max(targets.coverage_cols, 1), CV_8UC1);
+        camera.covered_cells = 0;
+        camera.rms = -1.0;
+        camera.converged = false;
+        calibration_.cameras.push_back(camera);
+    }
+}
+
+bool MultiCameraRig::AddCalibrationImages(const std::vector<cv::Mat>& images)
+{
+    if (!calibration_.active) {
+        std::cerr << "No calibration started." << std::endl;
+        return false;
+    }
+    if (images.size() != calibration_.cameras.size()) {
+        std::cerr << "Number of images (" << images.size() << ") does not match number of cameras ("
+                  << calibration_.cameras.size() << ")." << std::endl;
+        return false;
+    }
+    
+    AddCalibrationImageSets(std::vector<std::vector<cv::Mat>>(1, images));
+    return IsCalibrationConverged();
+}
+
+bool MultiCameraRig::IsCalibrationConverged() const
+{
+    if (!calibration_.active || calibration_.cameras.empty()) {
+        return false;
+    }
+    for (const CameraCalibration& camera : calibration_.cameras) {
+        if (!camera.converged) {
+            return false;
+        }
+    }
+    
+    std::vector<int> order;
+    LinkCameras(order);
+    return order.size() == calibration_.cameras.size();
+}
+
+void MultiCameraRig::AddCalibrationImageSets(const std::vector<std::vector<cv::Mat>>& image_sets)
+{
+    const size_t num_cameras = calibration_.cameras.size();
+    const int first_set = calibration_.num_sets;
+    calibration_.num_sets += static_cast<int>(image_sets.size());
+    for (CameraCalibration& camera : calibration_.cameras) {
+        camera.corners.resize(calibration_.num_sets);
+    }
+    
+    // A camera that met its targets is only looked at while the rig still needs common views
+    std::vector<int> order;
+    LinkCameras(order);
+    const bool linked = order.size() == num_cameras;
+    
+    // Detect in parallel over every image of the sets
+    const int num_images = static_cast<int>(image_sets.size() * num_cameras);
+    cv::parallel_for_(cv::Range(0, num_images), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            const size_t set = i / num_cameras;
+            const size_t camera_idx = i % num_cameras;
+            CameraCalibration& camera = calibration_.cameras[camera_idx];
+            if (camera_idx >= image_sets[set].size() || image_sets[set][camera_idx].empty() ||
+                (camera.converged && linked)) {
+                continue;
+            }
+            detectPattern(image_sets[set][camera_idx], calibration_.pattern_size, camera.corners[first_set + set]);
+        }
+    });
+    
+    // The views go into the intrinsics in capture order, the cameras in parallel
+    cv::parallel_for_(cv::Range(0, static_cast<int>(num_cameras)), [&](const cv::Range& range) {
+        for (int camera_idx = range.start; camera_idx < range.end; camera_idx++) {
+            CameraCalibration& camera = calibration_.cameras[camera_idx];
+            for (size_t set = 0; set < image_sets.size(); set++) {
+                if (camera.corners[first_set + set].empty()) {
+                    continue;
+                }
+                if (camera.image_size.area() == 0) {
+                    camera.image_size = image_sets[set][camera_idx].size();
+                }
+                IntegrateCalibrationView(camera, first_set + static_cast<int>(set));
+            }
+        }
+    });
+}
+
+void MultiCameraRig::IntegrateCalibrationView(CameraCalibration& camera, int set)
+{
+    const CalibrationTargets& targets = calibration_.targets;
+    if (camera.converged) {
+        return;
+    }
+    
+    // Cells of the coverage grid the view visits
+    const std::vector<cv::Point2f>& corners = camera.corners[set];
+    cv::Mat view_cells = cv::Mat::zeros(camera.coverage.size(), CV_8UC1);
+    for (const cv::Point2f& corner : corners) {
+        const int col = static_cast<int>(corner.x * view_cells.cols / camera.image_size.width);
+        const int row = static_cast<int>(corner.y * view_cells.rows / camera.image_size.height);
+        view_cells.at<uchar>(std::min(std::max(row, 0), view_cells.rows - 1),
+                             std::min(std::max(col, 0), view_cells.cols - 1)) = 255;
+    }
+    cv::Mat new_cells = view_cells & ~camera.coverage;
+    
+    // Past the minimum, only views adding coverage, or any while the RMS is short of its target, up to the limit
+    const int views = static_cast<int>(camera.views.size());
+    const bool below_limit = targets.max_views <= 0 || views < targets.max_views;
+    if (views >= targets.min_views &&
+        !(below_limit && (cv::countNonZero(new_cells) > 0 || camera.rms > targets.max_rms_px))) {
+        return;
+    }
+    camera.views.push_back(set);
+    camera.coverage |= view_cells;
+    camera.covered_cells = cv::countNonZero(camera.coverage);
+    if (static_cast<int>(camera.views.size()) < std::max(targets.min_views, 3)) {
+        return;
+    }
+    
+    std::vector<std::vector<cv::Point3f>> object_points(camera.views.size(), calibration_.pattern_points);
+    std::vector<std::vector<cv::Point2f>> image_points;
+    for (int view : camera.views) {
+        image_points.push_back(camera.corners[view]);
+    }
+    
+    // Warm-started from the previous solution, a few iterations take in the new view
+    int flags = 0;
+    cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, std::numeric_limits<double>::epsilon());
+    if (!camera.K.empty()) {
+        flags = cv::CALIB_USE_INTRINSIC_GUESS;
+        criteria = cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 10, 1e-6);
+    }
+    std::vector<cv::Mat> rvecs, tvecs;
+    camera.rms = cv::calibrateCamera(object_points, image_points, camera.image_size,
+                                     camera.K, camera.distCoef, rvecs, tvecs, flags, criteria);
+    
+    const int cells = camera.coverage.rows * camera.coverage.cols;
+    camera.converged = camera.covered_cells >= targets.min_coverage * cells && camera.rms <= targets.max_rms_px;
+}
+
+int MultiCameraRig::CountCommonViews(const CameraCalibration& camera1, const CameraCalibration& camera2) const
+{
+    int common = 0;
+    const size_t num_sets = std::min(camera1.corners.size(), camera2.corners.size());
+    for (size_t set = 0; set < num_sets; set++) {
+        if (!camera1.corners[set].empty() && !camera2.corners[set].empty()) {
+            common++;
+        }
+    }
+    return common;
+}
+
+std::vector<int> MultiCameraRig::LinkCameras(std::vector<int>& order) const
+{
+    const std::vector<CameraCalibration>& cameras = calibration_.cameras;
+    std::vector<int> links(cameras.size(), -1);
+    order.clear();
+    for (size_t i = 0; i < cameras.size(); i++) {
+        if (cameras[i].id == reference_camera_id_) {
+            order.push_back(static_cast<int>(i));
+        }
+    }
+    
+    // Breadth first from the reference camera over the pairs with enough common views
+    std::vector<bool> visited(cameras.size(), false);
+    if (!order.empty()) {
+        visited[order[0]] = true;
+    }
+    for (size_t head = 0; head < order.size(); head++) {
+        const int from = order[head];
+        for (size_t i = 0; i < cameras.size(); i++) {
+            if (!visited[i] && CountCommonViews(cameras[from], cameras[i]) >= calibration_.targets.min_pair_views) {
+                visited[i] = true;
+                links[i] = from;
+                order.push_back(static_cast<int>(i));
+            }
+        }
+    }
+    return links;
+}
+
+bool MultiCameraRig::FinishCalibration()
+{
+    if (!calibration_.active) {
+        std::cerr << "No calibration started." << std::endl;
+        return false;
+    }
+    
+    // Step 1: Intrinsics of the individual cameras
+    if (!CalibrateIndividualCameras()) {
         std::cerr << "Failed to calibrate individual cameras." << std::endl;
         return false;
     }
     
-    // Step 2: Calibrate camera pairs to establish relative poses
+    // Step 2: Initial camera poses along the pairs linking them to the reference camera
+    // Step 3: Joint optimization of the camera and pattern poses
     if (cameras_.size() > 1) {
-        if (!CalibrateCameraPairs(calibration_images, pattern_size)) {
+        std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d>> T_cam_ref;
+        if (!CalibrateCameraPairs(T_cam_ref)) {
             std::cerr << "Failed to calibrate camera pairs." << std::endl;
             return false;
         }
-    }
-    
-    // Step 3: Optimize the entire rig calibration
-    if (cameras_.size() > 2) {
-        if (!OptimizeRigCalibration()) {
+        if (!OptimizeRigCalibration(T_cam_ref)) {
             std::cerr << "Failed to optimize rig calibration." << std::endl;
             return false;
         }
+        
+        // T_ref_cam maps camera coordinates into the reference camera
+        for (size_t camera_idx = 0; camera_idx < calibration_.cameras.size(); camera_idx++) {
+            const Eigen::Matrix4d T_ref_cam = T_cam_ref[camera_idx].inverse().matrix();
+            cv::Mat T = cv::Mat::eye(4, 4, CV_32F);
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++) {
+                    T.at<float>(r, c) = static_cast<float>(T_ref_cam(r, c));
+                }
+            }
+            cameras_[calibration_.cameras[camera_idx].id].T_ref_cam = T;
+        }
     }
     
+    calibration_ = CalibrationSession();
+    InvalidateCalibrationCaches();
     return true;
 }
 
@@ -198,6 +534,18 @@ bool MultiCameraRig::LoadCalibration(const std::string& filename)
             info.fov_horizontal = camera["fov_horizontal"].asFloat();
             info.fov_vertical = camera["fov_vertical"].asFloat();
             
+            // Read static mask (headset shell, user's face)
+            info.mask_path = camera.get("mask_path", "").asString();
+            if (!info.mask_path.empty()) {
+                info.mask = cv::imread(info.mask_path, cv::IMREAD_GRAYSCALE);
+                if (info.mask.empty()) {
+                    std::cerr << "Failed to load mask for camera " << info.id << ": " << info.mask_path << std::endl;
+                } else if (info.mask.cols != info.width || info.mask.rows != info.height) {
+                    std::cerr << "Mask size does not match camera " << info.id << ", ignoring it" << std::endl;
+                    info.mask.release();
+                }
+            }
+            
             // Read intrinsic matrix
             const Json::Value& K = camera["K"];
             info.K = cv::Mat::zeros(3, 3, CV_32F);
@@ -227,6 +575,7 @@ bool MultiCameraRig::LoadCalibration(const std::string& filename)
             cameras_[info.id] = info;
         }
         
+        InvalidateCalibrationCaches();
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Error loading calibration: " << e.what() << std::endl;
@@ -257,6 +606,9 @@ bool MultiCameraRig::SaveCalibration(const std::string& filename) const
             camera["model"] = info.model;
             camera["fov_horizontal"] = info.fov_horizontal;
             camera["fov_vertical"] = info.fov_vertical;
+            if (!info.mask_path.empty()) {
+                camera["mask_path"] = info.mask_path;
+            }
             
             // Write intrinsic matrix
             Json::Value K(Json::arrayValue);
@@ -318,19 +670,10 @@ cv::Mat MultiCameraRig::ProjectToSpherical(
         return cv::Mat();
     }
     
-    // Create output panorama
-    cv::Mat panorama = cv::Mat::zeros(resolution.height, resolution.width, CV_8UC3);
-    
-    // Create maps for each camera
-    std::vector<cv::Mat> maps;
-    for (const auto& pair : cameras_) {
-        maps.push_back(CreateSphericalMap(pair.first, resolution));
-    }
-    
-    // Blend images into panorama
+    // Check the images and get the cached remap of each camera
+    std::vector<const SphericalRemap*> remaps;
     int camera_idx = 0;
     for (const auto& pair : cameras_) {
-        // Get camera info and image
         const CameraInfo& info = pair.second;
         const cv::Mat& image = images[camera_idx];
         
@@ -342,17 +685,41 @@ cv::Mat MultiCameraRig::ProjectToSpherical(
             return cv::Mat();
         }
         
-        // Remap image to panorama
-        cv::Mat remapped;
-        cv::remap(image, remapped, maps[camera_idx], cv::Mat(), cv::INTER_LINEAR);
-        
-        // Blend into panorama (simple overwrite for now)
-        // TODO: Implement proper blending with weights based on viewing angle
-        remapped.copyTo(panorama, remapped > 0);
-        
+        remaps.push_back(&GetSphericalRemap(pair.first, resolution));
         camera_idx++;
     }
     
+    // Create output panorama
+    cv::Mat panorama = cv::Mat::zeros(resolution.height, resolution.width, CV_8UC3);
+    
+    // Blend rows of tiles in parallel, cameras in rig order within a tile so later cameras overwrite
+    // TODO: Implement proper blending with weights based on viewing angle
+    const int tile_rows = 64;
+    const int num_tiles = (resolution.height + tile_rows - 1) / tile_rows;
+    cv::parallel_for_(cv::Range(0, num_tiles), [&](const cv::Range& range) {
+        for (int t = range.start; t < range.end; t++) {
+            const cv::Rect tile(0, t * tile_rows, resolution.width,
+                                std::min(tile_rows, resolution.height - t * tile_rows));
+            
+            for (size_t i = 0; i < remaps.size(); i++) {
+                const SphericalRemap& remap = *remaps[i];
+                const cv::Rect area = tile & remap.roi;
+                if (area.empty()) {
+                    continue;
+                }
+                
+                // Remap only the part of the tile the camera sees
+                const cv::Rect local = area - remap.roi.tl();
+                cv::Mat remapped;
+                cv::remap(images[i], remapped, remap.map1(local), remap.map2(local),
+                          cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+                
+                cv::Mat target = panorama(area);
+                remapped.copyTo(target, remap.valid(local));
+            }
+        }
+    });
+    
     return panorama;
 }
 
@@ -413,12 +780,11 @@ bool MultiCameraRig::IsPointVisibleToCamera(
     const CameraInfo& info = it->second;
     
     // Transform sphere point to camera coordinates
-    cv::Mat sphere_point_mat = (cv::Mat_<float>(4, 1) << 
-        sphere_point.x, sphere_point.y, sphere_point.z, 1.0f);
-    cv::Mat camera_point_mat = info.T_ref_cam * sphere_point_mat;
+    const Eigen::Vector4f camera_point =
+        Converter::toMatrix4fMap(info.T_ref_cam) * Eigen::Vector4f(sphere_point.x, sphere_point.y, sphere_point.z, 1.0f);
     
     // Check if point is in front of camera
-    if (camera_point_mat.at<float>(2, 0) <= 0) {
+    if (camera_point.z() <= 0) {
         return false;
     }
     
@@ -441,21 +807,17 @@ int MultiCameraRig::FindBestCameraForPoint(const cv::Point3f& sphere_point)
         const CameraInfo& info = pair.second;
         
         // Transform sphere point to camera coordinates
-        cv::Mat sphere_point_mat = (cv::Mat_<float>(4, 1) << 
-            sphere_point.x, sphere_point.y, sphere_point.z, 1.0f);
-        cv::Mat camera_point_mat = info.T_ref_cam * sphere_point_mat;
+        const Eigen::Vector4f camera_point =
+            Converter::toMatrix4fMap(info.T_ref_cam) * Eigen::Vector4f(sphere_point.x, sphere_point.y, sphere_point.z, 1.0f);
         
         // Check if point is in front of camera
-        if (camera_point_mat.at<float>(2, 0) <= 0) {
+        if (camera_point.z() <= 0) {
             continue;
         }
         
         // Normalize camera direction vector (0, 0, 1) and point vector
         cv::Point3f camera_dir(0, 0, 1);
-        cv::Point3f point_dir(
-            camera_point_mat.at<float>(0, 0),
-            camera_point_mat.at<float>(1, 0),
-            camera_point_mat.at<float>(2, 0));
+        cv::Point3f point_dir(camera_point.x(), camera_point.y(), camera_point.z());
         float point_norm = std::sqrt(
             point_dir.x * point_dir.x + 
             point_dir.y * point_dir.y + 
@@ -479,52 +841,243 @@ int MultiCameraRig::FindBestCameraForPoint(const cv::Point3f& sphere_point)
     return best_camera_id;
 }
 
+bool MultiCameraRig::DoCamerasOverlap(int camera_id1, int camera_id2)
+{
+    // Check if cameras exist
+    auto it1 = cameras_.find(camera_id1);
+    auto it2 = cameras_.find(camera_id2);
+    if (it1 == cameras_.end() || it2 == cameras_.end()) {
+        std::cerr << "Camera does not exist in the rig." << std::endl;
+        return false;
+    }
+    
+    const CameraInfo& info1 = it1->second;
+    const CameraInfo& info2 = it2->second;
+    if (info1.fov_horizontal <= 0 || info1.fov_vertical <= 0 ||
+        info2.fov_horizontal <= 0 || info2.fov_vertical <= 0) {
+        return true;
+    }
+    
+    // Half-angle of the cone around the optical axis containing the view
+    auto half_diagonal = [](const CameraInfo& info) {
+        const double tan_h = std::tan(info.fov_horizontal * 0.5 * CV_PI / 180.0);
+        const double tan_v = std::tan(info.fov_vertical * 0.5 * CV_PI / 180.0);
+        return std::atan(std::sqrt(tan_h * tan_h + tan_v * tan_v));
+    };
+    
+    // Angle between the optical axes, R(2, 2) of the relative rotation
+    const Sophus::SE3f* T = FindTransform(camera_id1, camera_id2);
+    const double cos_axes = std::max(-1.0, std::min(1.0, static_cast<double>(T->rotationMatrix()(2, 2))));
+    
+    return std::acos(cos_axes) < half_diagonal(info1) + half_diagonal(info2);
+}
+
+void MultiCameraRig::ComputeOverlapMasks(float depth, float margin)
+{
+    overlap_masks_.clear();
+    overlap_ratios_.clear();
+    
+    for (const auto& pair1 : cameras_) {
+        for (const auto& pair2 : cameras_) {
+            if (pair1.first == pair2.first) {
+                continue;
+            }
+            
+            const std::pair<int, int> key(pair1.first, pair2.first);
+            cv::Mat mask;
+            if (DoCamerasOverlap(pair1.first, pair2.first)) {
+                mask = ComputeOverlapMask(pair1.first, pair2.first, depth, margin);
+            } else {
+                mask = cv::Mat::zeros(pair1.second.height, pair1.second.width, CV_8UC1);
+            }
+            
+            overlap_masks_[key] = mask;
+            overlap_ratios_[key] = mask.empty() ? 0.0f :
+                static_cast<float>(cv::countNonZero(mask)) / static_cast<float>(mask.total());
+        }
+    }
+}
+
+cv::Mat MultiCameraRig::GetOverlapMask(int camera_id1, int camera_id2) const
+{
+    auto it = overlap_masks_.find(std::make_pair(camera_id1, camera_id2));
+    if (it == overlap_masks_.end()) {
+        return cv::Mat();
+    }
+    return it->second;
+}
+
+float MultiCameraRig::GetOverlapRatio(int camera_id1, int camera_id2) const
+{
+    auto it = overlap_ratios_.find(std::make_pair(camera_id1, camera_id2));
+    if (it == overlap_ratios_.end()) {
+        return -1.0f;
+    }
+    return it->second;
+}
+
 cv::Point3f MultiCameraRig::TransformPoint(
     const cv::Point3f& point,
     int source_camera_id,
     int target_camera_id)
 {
-    // Check if cameras exist
-    auto source_it = cameras_.find(source_camera_id);
-    auto target_it = cameras_.find(target_camera_id);
-    if (source_it == cameras_.end() || target_it == cameras_.end()) {
+    const Sophus::SE3f* T = FindTransform(source_camera_id, target_camera_id);
+    if (!T) {
         std::cerr << "Source or target camera does not exist in the rig." << std::endl;
         return cv::Point3f();
     }
     
-    // Get transforms
-    const cv::Mat& T_ref_source = source_it->second.T_ref_cam;
-    const cv::Mat& T_ref_target = target_it->second.T_ref_cam;
-    
-    // Calculate transform from source to target
-    cv::Mat T_source_target = T_ref_target.inv() * T_ref_source;
+    const Eigen::Vector3f transformed = *T * Eigen::Vector3f(point.x, point.y, point.z);
+    return cv::Point3f(transformed.x(), transformed.y(), transformed.z());
+}
+
+bool MultiCameraRig::TransformPoints(
+    const std::vector<cv::Point3f>& points,
+    int source_camera_id,
+    int target_camera_id,
+    std::vector<cv::Point3f>& transformed)
+{
+    const Sophus::SE3f* T = FindTransform(source_camera_id, target_camera_id);
+    if (!T) {
+        std::cerr << "Source or target camera does not exist in the rig." << std::endl;
+        return false;
+    }
     
-    // Transform point
-    cv::Mat point_mat = (cv::Mat_<float>(4, 1) << point.x, point.y, point.z, 1.0f);
-    cv::Mat transformed_point_mat = T_source_target * point_mat;
+    const Eigen::Matrix3f R = T->rotationMatrix();
+    const Eigen::Vector3f t = T->translation();
+    transformed.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        const Eigen::Vector3f p = R * Eigen::Vector3f(points[i].x, points[i].y, points[i].z) + t;
+        transformed[i] = cv::Point3f(p.x(), p.y(), p.z());
+    }
+    return true;
+}
+
+bool MultiCameraRig::TransformPoints(
+    const Eigen::Vector3f* points,
+    size_t count,
+    int source_camera_id,
+    int target_camera_id,
+    Eigen::Vector3f* transformed)
+{
+    const Sophus::SE3f* T = FindTransform(source_camera_id, target_camera_id);
+    if (!T) {
+        std::cerr << "Source or target camera does not exist in the rig." << std::endl;
+        return false;
+    }
     
-    return cv::Point3f(
-        transformed_point_mat.at<float>(0, 0),
-        transformed_point_mat.at<float>(1, 0),
-        transformed_point_mat.at<float>(2, 0));
+    const Eigen::Matrix3f R = T->rotationMatrix();
+    const Eigen::Vector3f t = T->translation();
+    for (size_t i = 0; i < count; i++) {
+        transformed[i] = R * points[i] + t;
+    }
+    return true;
 }
 
 cv::Mat MultiCameraRig::GetTransform(int source_camera_id, int target_camera_id)
 {
-    // Check if cameras exist
-    auto source_it = cameras_.find(source_camera_id);
-    auto target_it = cameras_.find(target_camera_id);
-    if (source_it == cameras_.end() || target_it == cameras_.end()) {
+    const Sophus::SE3f* T = FindTransform(source_camera_id, target_camera_id);
+    if (!T) {
         std::cerr << "Source or target camera does not exist in the rig." << std::endl;
         return cv::Mat();
     }
     
-    // Get transforms
-    const cv::Mat& T_ref_source = source_it->second.T_ref_cam;
-    const cv::Mat& T_ref_target = target_it->second.T_ref_cam;
+    const Eigen::Matrix4f M = T->matrix();
+    cv::Mat transform(4, 4, CV_32F);
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            transform.at<float>(r, c) = M(r, c);
+        }
+    }
+    return transform;
+}
+
+bool MultiCameraRig::GetTransform(int source_camera_id, int target_camera_id, Sophus::SE3f& T_target_source)
+{
+    const Sophus::SE3f* T = FindTransform(source_camera_id, target_camera_id);
+    if (!T) {
+        std::cerr << "Source or target camera does not exist in the rig." << std::endl;
+        return false;
+    }
     
-    // Calculate transform from source to target
-    return T_ref_target.inv() * T_ref_source;
+    T_target_source = *T;
+    return true;
+}
+
+const MultiCameraRig::StereoRectification* MultiCameraRig::GetStereoRectification(
+    int left_camera_id,
+    int right_camera_id,
+    const cv::Size& size)
+{
+    const auto key = std::make_pair(std::make_pair(left_camera_id, right_camera_id),
+                                    std::make_pair(size.width, size.height));
+    auto it = stereo_rectifications_.find(key);
+    if (it != stereo_rectifications_.end()) {
+        return &it->second;
+    }
+    
+    auto left_it = cameras_.find(left_camera_id);
+    auto right_it = cameras_.find(right_camera_id);
+    Sophus::SE3f T_right_left;
+    if (left_it == cameras_.end() || right_it == cameras_.end() ||
+        !GetTransform(left_camera_id, right_camera_id, T_right_left)) {
+        return nullptr;
+    }
+    
+    const CameraInfo& left = left_it->second;
+    const CameraInfo& right = right_it->second;
+    if (left.K.empty() || right.K.empty() || left.width != right.width || left.height != right.height) {
+        std::cerr << "Cameras " << left_camera_id << " and " << right_camera_id
+                  << " are not a calibrated stereo pair." << std::endl;
+        return nullptr;
+    }
+    
+    cv::Mat K1, K2, D1, D2;
+    left.K.convertTo(K1, CV_64F);
+    right.K.convertTo(K2, CV_64F);
+    if (!left.distCoef.empty()) left.distCoef.convertTo(D1, CV_64F);
+    if (!right.distCoef.empty()) right.distCoef.convertTo(D2, CV_64F);
+    
+    const Eigen::Matrix3f R_right_left = T_right_left.rotationMatrix();
+    const Eigen::Vector3f t_right_left = T_right_left.translation();
+    cv::Mat R(3, 3, CV_64F), T(3, 1, CV_64F);
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            R.at<double>(r, c) = R_right_left(r, c);
+        }
+        T.at<double>(r) = t_right_left(r);
+    }
+    
+    // The rectified intrinsics are for the requested size, so the maps also downscale
+    StereoRectification rectification;
+    rectification.size = size;
+    const cv::Size camera_size(left.width, left.height);
+    cv::Mat P1, P2, Q;
+    if (left.model == "fisheye" && right.model == "fisheye") {
+        if (D1.empty()) D1 = cv::Mat::zeros(4, 1, CV_64F);
+        if (D2.empty()) D2 = cv::Mat::zeros(4, 1, CV_64F);
+        cv::fisheye::stereoRectify(K1, D1, K2, D2, camera_size, R, T, rectification.R_left, rectification.R_right,
+                                   P1, P2, Q, cv::CALIB_ZERO_DISPARITY, size);
+        cv::fisheye::initUndistortRectifyMap(K1, D1, rectification.R_left, P1, size, CV_32FC1,
+                                             rectification.map_left_x, rectification.map_left_y);
+        cv::fisheye::initUndistortRectifyMap(K2, D2, rectification.R_right, P2, size, CV_32FC1,
+                                             rectification.map_right_x, rectification.map_right_y);
+    } else {
+        cv::stereoRectify(K1, D1, K2, D2, camera_size, R, T, rectification.R_left, rectification.R_right,
+                          P1, P2, Q, cv::CALIB_ZERO_DISPARITY, 0, size);
+        cv::initUndistortRectifyMap(K1, D1, rectification.R_left, P1, size, CV_32FC1,
+                                    rectification.map_left_x, rectification.map_left_y);
+        cv::initUndistortRectifyMap(K2, D2, rectification.R_right, P2, size, CV_32FC1,
+                                    rectification.map_right_x, rectification.map_right_y);
+    }
+    
+    rectification.fx = static_cast<float>(P1.at<double>(0, 0));
+    rectification.fy = static_cast<float>(P1.at<double>(1, 1));
+    rectification.cx = static_cast<float>(P1.at<double>(0, 2));
+    rectification.cy = static_cast<float>(P1.at<double>(1, 2));
+    rectification.baseline = static_cast<float>(cv::norm(T));
+    
+    return &(stereo_rectifications_[key] = rectification);
 }
 
 bool MultiCameraRig::UpdateTransform(
@@ -549,206 +1102,495 @@ bool MultiCameraRig::UpdateTransform(
     // Update source transform
     source_it->second.T_ref_cam = T_ref_source;
     
+    InvalidateCalibrationCaches();
     return true;
 }
 
 // Private helper methods
 
-bool MultiCameraRig::CalibrateIndividualCameras(
-    const std::vector<std::vector<cv::Mat>>& calibration_images,
-    const cv::Size& pattern_size,
-    float square_size)
+bool MultiCameraRig::CalibrateIndividualCameras()
 {
-    // Calibrate each camera individually
-    int camera_idx = 0;
-    for (auto& pair : cameras_) {
-        CameraInfo& info = pair.second;
-        const std::vector<cv::Mat>& images = calibration_images[camera_idx];
-        
-        // Prepare object points (3D points in real world space)
-        std::vector<std::vector<cv::Point3f>> object_points;
-        std::vector<cv::Point3f> pattern_points;
-        for (int i = 0; i < pattern_size.height; ++i) {
-            for (int j = 0; j < pattern_size.width; ++j) {
-                pattern_points.push_back(cv::Point3f(j * square_size, i * square_size, 0));
-            }
-        }
+    const CalibrationTargets& targets = calibration_.targets;
+    for (CameraCalibration& camera : calibration_.cameras) {
+        CameraInfo& info = cameras_[camera.id];
         
-        // Detect chessboard corners
-        std::vector<std::vector<cv::Point2f>> image_points;
-        for (const auto& image : images) {
-            std::vector<cv::Point2f> corners;
-            bool found = cv::findChessboardCorners(image, pattern_size, corners);
-            if (found) {
-                // Refine corner locations
-                cv::Mat gray;
-                if (image.channels() == 3) {
-                    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-                } else {
-                    gray = image.clone();
+        // Fewer views than the minimum, solve over all of them
+        if (camera.K.empty()) {
+            std::vector<std::vector<cv::Point3f>> object_points;
+            std::vector<std::vector<cv::Point2f>> image_points;
+            for (const auto& corners : camera.corners) {
+                if (!corners.empty()) {
+                    object_points.push_back(calibration_.pattern_points);
+                    image_points.push_back(corners);
                 }
-                cv::cornerSubPix(gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
-                                cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
-                
-                image_points.push_back(corners);
-                object_points.push_back(pattern_points);
             }
+            if (image_points.size() < 3) {
+                std::cerr << "Not enough calibration images with detected pattern for camera " 
+                          << info.id << std::endl;
+                return false;
+            }
+            std::vector<cv::Mat> rvecs, tvecs;
+            camera.rms = cv::calibrateCamera(object_points, image_points, camera.image_size,
+                                             camera.K, camera.distCoef, rvecs, tvecs);
         }
         
-        // Check if we have enough points
-        if (image_points.size() < 3) {
-            std::cerr << "Not enough calibration images with detected pattern for camera " 
-                      << info.id << std::endl;
-            return false;
+        if (!camera.converged) {
+            std::cerr << "Camera " << info.id << " short of its calibration targets: " << camera.views.size()
+                      << " views, coverage " << camera.covered_cells << "/" << camera.coverage.total()
+                      << ", RMS " << camera.rms << " (target " << targets.max_rms_px << ")" << std::endl;
         }
         
-        // Calibrate camera
-        cv::Mat K, distCoef;
-        std::vector<cv::Mat> rvecs, tvecs;
-        double rms = cv::calibrateCamera(object_points, image_points, images[0].size(),
-                                        K, distCoef, rvecs, tvecs);
-        
         // Update camera info
-        info.K = K;
-        info.distCoef = distCoef;
+        camera.K.convertTo(info.K, CV_32F);
+        camera.distCoef.convertTo(info.distCoef, CV_32F);
         
         // Calculate field of view
-        info.fov_horizontal = 2 * atan(info.width / (2 * K.at<double>(0, 0))) * 180 / CV_PI;
-        info.fov_vertical = 2 * atan(info.height / (2 * K.at<double>(1, 1))) * 180 / CV_PI;
+        info.fov_horizontal = 2 * atan(camera.image_size.width / (2 * camera.K.at<double>(0, 0))) * 180 / CV_PI;
+        info.fov_vertical = 2 * atan(camera.image_size.height / (2 * camera.K.at<double>(1, 1))) * 180 / CV_PI;
         
-        std::cout << "Camera " << info.id << " calibrated with RMS error: " << rms << std::endl;
+        std::cout << "Camera " << info.id << " calibrated from " << camera.views.size()
+                  << " views with RMS error: " << camera.rms << std::endl;
         std::cout << "Field of view: " << info.fov_horizontal << "° x " 
                   << info.fov_vertical << "°" << std::endl;
-        
-        camera_idx++;
     }
     
     return true;
 }
 
 bool MultiCameraRig::CalibrateCameraPairs(
-    const std::vector<std::vector<cv::Mat>>& calibration_images,
-    const cv::Size& pattern_size)
+    std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d>>& T_cam_ref)
 {
-    // If we only have one camera, nothing to do
-    if (cameras_.size() <= 1) {
-        return true;
+    const std::vector<CameraCalibration>& cameras = calibration_.cameras;
+    const size_t num_cameras = cameras.size();
+    T_cam_ref.assign(num_cameras, Sophus::SE3d());
+    
+    std::vector<int> order;
+    const std::vector<int> links = LinkCameras(order);
+    if (order.size() != num_cameras) {
+        for (size_t i = 0; i < num_cameras; i++) {
+            if (std::find(order.begin(), order.end(), static_cast<int>(i)) == order.end()) {
+                std::cerr << "Not enough common frames with detected pattern to link camera "
+                          << cameras[i].id << " to the rig" << std::endl;
+            }
+        }
+        return false;
     }
     
-    // Set reference camera transform to identity
-    cameras_[reference_camera_id_].T_ref_cam = cv::Mat::eye(4, 4, CV_32F);
-    
-    // For each camera pair (reference and other)
-    int camera_idx = 0;
-    for (auto& pair : cameras_) {
-        int camera_id = pair.first;
-        CameraInfo& info = pair.second;
-        
-        // Skip reference camera
-        if (camera_id == reference_camera_id_) {
-            camera_idx++;
-            continue;
+    // Pose of the pattern in every view, the cameras in parallel
+    std::vector<std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d>>> T_cam_pattern(num_cameras);
+    std::vector<std::vector<double>> pattern_rms(num_cameras);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(num_cameras)), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            const CameraCalibration& camera = cameras[i];
+            T_cam_pattern[i].resize(camera.corners.size());
+            pattern_rms[i].assign(camera.corners.size(), std::numeric_limits<double>::max());
+            for (size_t set = 0; set < camera.corners.size(); set++) {
+                if (!camera.corners[set].empty()) {
+                    T_cam_pattern[i][set] = solvePatternPose(calibration_.pattern_points, camera.corners[set],
+                                                             camera.K, camera.distCoef, pattern_rms[i][set]);
+                }
+            }
+        }
+    });
+    
+    // Along the links, from the common view both poses fit best
+    for (size_t k = 1; k < order.size(); k++) {
+        const int camera_idx = order[k];
+        const int link_idx = links[camera_idx];
+        int best_set = -1;
+        double best_rms = std::numeric_limits<double>::max();
+        for (size_t set = 0; set < cameras[camera_idx].corners.size() && set < cameras[link_idx].corners.size(); set++) {
+            if (cameras[camera_idx].corners[set].empty() || cameras[link_idx].corners[set].empty()) {
+                continue;
+            }
+            const double rms = pattern_rms[camera_idx][set] + pattern_rms[link_idx][set];
+            if (rms < best_rms) {
+                best_rms = rms;
+                best_set = static_cast<int>(set);
+            }
         }
         
-        // Get calibration images for this camera and reference
-        const std::vector<cv::Mat>& ref_images = calibration_images[0]; // Assuming reference is first
-        const std::vector<cv::Mat>& cam_images = calibration_images[camera_idx];
+        T_cam_ref[camera_idx] = T_cam_pattern[camera_idx][best_set] * T_cam_pattern[link_idx][best_set].inverse() *
+                                T_cam_ref[link_idx];
         
-        // Find common frames where pattern is visible in both cameras
-        std::vector<int> common_frames;
-        for (size_t i = 0; i < std::min(ref_images.size(), cam_images.size()); ++i) {
-            std::vector<cv::Point2f> ref_corners, cam_corners;
-            bool ref_found = cv::findChessboardCorners(ref_images[i], pattern_size, ref_corners);
-            bool cam_found = cv::findChessboardCorners(cam_images[i], pattern_size, cam_corners);
-            
-            if (ref_found && cam_found) {
-                common_frames.push_back(i);
+        std::cout << "Camera pair " << cameras[link_idx].id << " and " << cameras[camera_idx].id << " linked by "
+                  << CountCommonViews(cameras[link_idx], cameras[camera_idx]) << " common views" << std::endl;
+    }
+    
+    return true;
+}
+
+bool MultiCameraRig::OptimizeRigCalibration(
+    std::vector<Sophus::SE3d, Eigen::aligned_allocator<Sophus::SE3d>>& T_cam_ref)
+{
+    const std::vector<CameraCalibration>& cameras = calibration_.cameras;
+    const std::vector<cv::Point3f>& pattern_points = calibration_.pattern_points;
+    const int num_cameras = static_cast<int>(cameras.size());
+    
+    // Parameter blocks of the cameras, the reference camera is fixed
+    std::vector<int> camera_block(num_cameras, -1);
+    int num_camera_blocks = 0;
+    for (int i = 0; i < num_cameras; i++) {
+        if (cameras[i].id != reference_camera_id_) {
+            camera_block[i] = num_camera_blocks++;
+        }
+    }
+    
+    // The image sets seen by several cameras constrain their relative poses, the pattern pose of
+    // each starts from the camera that sees it with the smallest error
+    struct Observation {
+        int camera;
+        int pattern;
+    };
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d>> pattern_poses;
+    std::vector<int> pattern_sets;
+    std::vector<Observation> observations;
+    for (int set = 0; set < calibration_.num_sets; set++) {
+        std::vector<int> seen_by;
+        for (int i = 0; i < num_cameras; i++) {
+            if (set < static_cast<int>(cameras[i].corners.size()) && !cameras[i].corners[set].empty()) {
+                seen_by.push_back(i);
             }
         }
-        
-        // Check if we have enough common frames
-        if (common_frames.size() < 5) {
-            std::cerr << "Not enough common frames with detected pattern for camera pair "
-                      << reference_camera_id_ << " and " << camera_id << std::endl;
-            return false;
+        if (seen_by.size() < 2) {
+            continue;
         }
         
-        // Prepare object points and image points
-        std::vector<std::vector<cv::Point3f>> object_points;
-        std::vector<std::vector<cv::Point2f>> ref_image_points, cam_image_points;
-        
-        for (int frame : common_frames) {
-            // Prepare object points
-            std::vector<cv::Point3f> pattern_points;
-            for (int i = 0; i < pattern_size.height; ++i) {
-                for (int j = 0; j < pattern_size.width; ++j) {
-                    pattern_points.push_back(cv::Point3f(j, i, 0)); // Unit square size
-                }
+        Sophus::SE3d T_ref_pattern;
+        double best_rms = std::numeric_limits<double>::max();
+        for (int i : seen_by) {
+            double rms;
+            const Sophus::SE3d T_cam_pattern = solvePatternPose(pattern_points, cameras[i].corners[set],
+                                                                cameras[i].K, cameras[i].distCoef, rms);
+            if (rms < best_rms) {
+                best_rms = rms;
+                T_ref_pattern = T_cam_ref[i].inverse() * T_cam_pattern;
+            }
+        }
+        for (int i : seen_by) {
+            observations.push_back({i, static_cast<int>(pattern_poses.size())});
+        }
+        pattern_poses.push_back(poseToVector(T_ref_pattern));
+        pattern_sets.push_back(set);
+    }
+    if (observations.empty() || num_camera_blocks == 0) {
+        return true;
+    }
+    
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d>> camera_poses(num_cameras);
+    for (int i = 0; i < num_cameras; i++) {
+        camera_poses[i] = poseToVector(T_cam_ref[i]);
+    }
+    
+    // Normal equations, dense over the cameras and block diagonal over the pattern poses
+    const int num_patterns = static_cast<int>(pattern_poses.size());
+    const int camera_dim = 6 * num_camera_blocks;
+    Eigen::MatrixXd H_cc(camera_dim, camera_dim);
+    Eigen::VectorXd g_c(camera_dim);
+    std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d>> H_pp(num_patterns);
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d>> g_p(num_patterns);
+    std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d>> H_cp(observations.size()); // Camera rows, pattern columns
+    
+    // Squared reprojection error, with the normal equations if asked for
+    auto evaluate = [&](bool linearize) {
+        if (linearize) {
+            H_cc.setZero();
+            g_c.setZero();
+            for (int p = 0; p < num_patterns; p++) {
+                H_pp[p].setZero();
+                g_p[p].setZero();
             }
-            object_points.push_back(pattern_points);
+        }
+        
+        double cost = 0.0;
+        for (size_t o = 0; o < observations.size(); o++) {
+            const Observation& observation = observations[o];
+            const CameraCalibration& camera = cameras[observation.camera];
+            const Vector6d& pattern = pattern_poses[observation.pattern];
+            const Vector6d& pose = camera_poses[observation.camera];
             
-            // Detect and refine corners
-            std::vector<cv::Point2f> ref_corners, cam_corners;
-            cv::findChessboardCorners(ref_images[frame], pattern_size, ref_corners);
-            cv::findChessboardCorners(cam_images[frame], pattern_size, cam_corners);
+            // Pattern to reference camera, then reference camera to this camera
+            cv::Mat rvec_p = (cv::Mat_<double>(3, 1) << pattern(0), pattern(1), pattern(2));
+            cv::Mat tvec_p = (cv::Mat_<double>(3, 1) << pattern(3), pattern(4), pattern(5));
+            cv::Mat rvec_c = (cv::Mat_<double>(3, 1) << pose(0), pose(1), pose(2));
+            cv::Mat tvec_c = (cv::Mat_<double>(3, 1) << pose(3), pose(4), pose(5));
+            cv::Mat rvec, tvec, dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2;
+            cv::composeRT(rvec_p, tvec_p, rvec_c, tvec_c, rvec, tvec,
+                          dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2);
             
-            cv::Mat ref_gray, cam_gray;
-            if (ref_images[frame].channels() == 3) {
-                cv::cvtColor(ref_images[frame], ref_gray, cv::COLOR_BGR2GRAY);
-                cv::cvtColor(cam_images[frame], cam_gray, cv::COLOR_BGR2GRAY);
+            std::vector<cv::Point2f> projected;
+            cv::Mat jacobian;
+            if (linearize) {
+                cv::projectPoints(pattern_points, rvec, tvec, camera.K, camera.distCoef, projected, jacobian);
             } else {
-                ref_gray = ref_images[frame].clone();
-                cam_gray = cam_images[frame].clone();
+                cv::projectPoints(pattern_points, rvec, tvec, camera.K, camera.distCoef, projected);
             }
             
-            cv::cornerSubPix(ref_gray, ref_corners, cv::Size(11, 11), cv::Size(-1, -1),
-                            cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
-            cv::cornerSubPix(cam_gray, cam_corners, cv::Size(11, 11), cv::Size(-1, -1),
-                            cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
+            const std::vector<cv::Point2f>& observed = camera.corners[pattern_sets[observation.pattern]];
+            Eigen::VectorXd residual(2 * projected.size());
+            for (size_t k = 0; k < projected.size(); k++) {
+                residual(2 * k) = projected[k].x - observed[k].x;
+                residual(2 * k + 1) = projected[k].y - observed[k].y;
+            }
+            cost += residual.squaredNorm();
+            if (!linearize) {
+                continue;
+            }
+            
+            // Derivatives of the projections by the pattern pose and the camera pose
+            const Eigen::Map<const RowMatrixXd> J(jacobian.ptr<double>(), jacobian.rows, jacobian.cols);
+            const Eigen::MatrixXd J_pose = J.leftCols(6);
+            const Eigen::MatrixXd J_p = J_pose * composeDerivative(dr3dr1, dr3dt1, dt3dr1, dt3dt1);
+            H_pp[observation.pattern] += J_p.transpose() * J_p;
+            g_p[observation.pattern] += J_p.transpose() * residual;
             
-            ref_image_points.push_back(ref_corners);
-            cam_image_points.push_back(cam_corners);
+            const int block = camera_block[observation.camera];
+            if (block >= 0) {
+                const Eigen::MatrixXd J_c = J_pose * composeDerivative(dr3dr2, dr3dt2, dt3dr2, dt3dt2);
+                H_cc.block<6, 6>(6 * block, 6 * block) += J_c.transpose() * J_c;
+                g_c.segment<6>(6 * block) += J_c.transpose() * residual;
+                H_cp[o] = J_c.transpose() * J_p;
+            }
         }
+        return cost;
+    };
+    
+    const size_t num_residuals = observations.size() * pattern_points.size();
+    double cost = evaluate(true);
+    const double initial_rms = std::sqrt(cost / num_residuals);
+    
+    // Levenberg-Marquardt, the pattern poses eliminated by the Schur complement
+    double lambda = 1e-3;
+    for (int iteration = 0; iteration < 30 && lambda < 1e8; iteration++) {
+        Eigen::MatrixXd S = H_cc;
+        Eigen::VectorXd rhs = -g_c;
+        S.diagonal() *= 1.0 + lambda;
+        std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d>> H_pp_inv(num_patterns);
+        for (int p = 0; p < num_patterns; p++) {
+            Matrix6d H = H_pp[p];
+            H.diagonal() *= 1.0 + lambda;
+            H_pp_inv[p] = H.inverse();
+        }
+        for (size_t o1 = 0; o1 < observations.size(); o1++) {
+            const int block1 = camera_block[observations[o1].camera];
+            if (block1 < 0) {
+                continue;
+            }
+            const int p = observations[o1].pattern;
+            const Matrix6d WB = H_cp[o1] * H_pp_inv[p];
+            rhs.segment<6>(6 * block1) += WB * g_p[p];
+            for (size_t o2 = 0; o2 < observations.size(); o2++) {
+                const int block2 = camera_block[observations[o2].camera];
+                if (block2 >= 0 && observations[o2].pattern == p) {
+                    S.block<6, 6>(6 * block1, 6 * block2) -= WB * H_cp[o2].transpose();
+                }
+            }
+        }
+        const Eigen::VectorXd delta_c = S.ldlt().solve(rhs);
         
-        // Get camera matrices and distortion coefficients
-        const cv::Mat& K_ref = cameras_[reference_camera_id_].K;
-        const cv::Mat& D_ref = cameras_[reference_camera_id_].distCoef;
-        const cv::Mat& K_cam = info.K;
-        const cv::Mat& D_cam = info.distCoef;
-        
-        // Stereo calibration
-        cv::Mat R, T, E, F;
-        double rms = cv::stereoCalibrate(
-            object_points, ref_image_points, cam_image_points,
-            K_ref, D_ref, K_cam, D_cam,
-            ref_images[0].size(), R, T, E, F,
-            cv::CALIB_FIX_INTRINSIC,
-            cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-5));
-        
-        // Create 4x4 transformation matrix
-        cv::Mat T_ref_cam = cv::Mat::eye(4, 4, CV_32F);
-        R.copyTo(T_ref_cam(cv::Rect(0, 0, 3, 3)));
-        T.copyTo(T_ref_cam(cv::Rect(3, 0, 1, 3)));
-        
-        // Update camera info
-        info.T_ref_cam = T_ref_cam;
+        // Back substitution of the pattern poses
+        std::vector<Vector6d, Eigen::aligned_allocator<Vector6d>> rhs_p(g_p.size());
+        for (int p = 0; p < num_patterns; p++) {
+            rhs_p[p] = -g_p[p];
+        }
+        for (size_t o = 0; o < observations.size(); o++) {
+            const int block = camera_block[observations[o].camera];
+            if (block >= 0) {
+                rhs_p[observations[o].pattern] -= H_cp[o].transpose() * delta_c.segment<6>(6 * block);
+            }
+        }
         
-        std::cout << "Camera pair " << reference_camera_id_ << " and " << camera_id
-                  << " calibrated with RMS error: " << rms << std::endl;
+        const auto saved_cameras = camera_poses;
+        const auto saved_patterns = pattern_poses;
+        for (int i = 0; i < num_cameras; i++) {
+            if (camera_block[i] >= 0) {
+                camera_poses[i] += delta_c.segment<6>(6 * camera_block[i]);
+            }
+        }
+        for (int p = 0; p < num_patterns; p++) {
+            pattern_poses[p] += H_pp_inv[p] * rhs_p[p];
+        }
         
-        camera_idx++;
+        const double new_cost = evaluate(false);
+        if (new_cost < cost) {
+            const bool converged = cost - new_cost < 1e-10 * cost;
+            cost = evaluate(true);
+            lambda = std::max(lambda / 10.0, 1e-7);
+            if (converged) {
+                break;
+            }
+        } else {
+            camera_poses = saved_cameras;
+            pattern_poses = saved_patterns;
+            lambda *= 10.0;
+        }
     }
     
+    for (int i = 0; i < num_cameras; i++) {
+        T_cam_ref[i] = vectorToPose(camera_poses[i]);
+    }
+    
+    std::cout << "Rig calibration optimized over " << num_patterns << " common views, RMS error: "
+              << initial_rms << " -> " << std::sqrt(cost / num_residuals) << std::endl;
     return true;
 }
 
-bool MultiCameraRig::OptimizeRigCalibration()
+cv::Mat MultiCameraRig::ComputeOverlapMask(
+    int camera_id1,
+    int camera_id2,
+    float depth,
+    float margin)
 {
-    // For now, just a placeholder for future implementation
-    // This would involve bundle adjustment or similar global optimization
+    const CameraInfo& info1 = cameras_[camera_id1];
+    const CameraInfo& info2 = cameras_[camera_id2];
+    if (info1.K.empty() || info2.K.empty() || info1.width <= 0 || info1.height <= 0) {
+        return cv::Mat();
+    }
     
-    std::cout << "Rig calibration optimization not implemented yet." << std::endl;
-    return true;
+    const Sophus::SE3f* T = FindTransform(camera_id1, camera_id2);
+    if (!T) {
+        return cv::Mat();
+    }
+    const Eigen::Matrix3f R = T->rotationMatrix();
+    const Eigen::Vector3f t = T->translation();
+    
+    const float fx1 = info1.K.at<float>(0, 0), fy1 = info1.K.at<float>(1, 1);
+    const float cx1 = info1.K.at<float>(0, 2), cy1 = info1.K.at<float>(1, 2);
+    const float fx2 = info2.K.at<float>(0, 0), fy2 = info2.K.at<float>(1, 1);
+    const float cx2 = info2.K.at<float>(0, 2), cy2 = info2.K.at<float>(1, 2);
+    
+    // Sample the cell centers of a coarse grid over camera 1
+    const int cell_size = 8;
+    const int cols = (info1.width + cell_size - 1) / cell_size;
+    const int rows = (info1.height + cell_size - 1) / cell_size;
+    cv::Mat coarse = cv::Mat::zeros(rows, cols, CV_8UC1);
+    
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            // Point on the ray of the cell center at the given depth
+            const float u = (c + 0.5f) * cell_size;
+            const float v = (r + 0.5f) * cell_size;
+            const float x1 = (u - cx1) / fx1 * depth;
+            const float y1 = (v - cy1) / fy1 * depth;
+            const float z1 = depth;
+            
+            // Transform to camera 2
+            const float x2 = R(0, 0) * x1 + R(0, 1) * y1 + R(0, 2) * z1 + t(0);
+            const float y2 = R(1, 0) * x1 + R(1, 1) * y1 + R(1, 2) * z1 + t(1);
+            const float z2 = R(2, 0) * x1 + R(2, 1) * y1 + R(2, 2) * z1 + t(2);
+            if (z2 <= 0) {
+                continue;
+            }
+            
+            // Project into camera 2 and check the bounds
+            const float u2 = fx2 * x2 / z2 + cx2;
+            const float v2 = fy2 * y2 / z2 + cy2;
+            if (u2 >= -margin && u2 < info2.width + margin && v2 >= -margin && v2 < info2.height + margin) {
+                coarse.at<uchar>(r, c) = 255;
+            }
+        }
+    }
+    
+    // Grow by one cell so the cell borders are not lost to the sampling
+    cv::dilate(coarse, coarse, cv::Mat::ones(3, 3, CV_8UC1));
+    
+    cv::Mat mask;
+    cv::resize(coarse, mask, cv::Size(cols * cell_size, rows * cell_size), 0, 0, cv::INTER_NEAREST);
+    return mask(cv::Rect(0, 0, info1.width, info1.height)).clone();
+}
+
+void MultiCameraRig::InvalidateCalibrationCaches()
+{
+    overlap_masks_.clear();
+    overlap_ratios_.clear();
+    spherical_remaps_.clear();
+    stereo_rectifications_.clear();
+    transforms_valid_ = false;
+}
+
+void MultiCameraRig::BuildTransformTable()
+{
+    // Extrinsics of every camera as a rigid transform, rotation re-orthonormalized
+    std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f>> T_ref_cams;
+    transform_ids_.clear();
+    for (const auto& pair : cameras_) {
+        Eigen::Matrix4f M = Eigen::Matrix4f::Identity();
+        if (!pair.second.T_ref_cam.empty()) {
+            cv::Mat T_ref_cam;
+            pair.second.T_ref_cam.convertTo(T_ref_cam, CV_32F);
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++) {
+                    M(r, c) = T_ref_cam.at<float>(r, c);
+                }
+            }
+        }
+        const Eigen::Quaternionf q(Eigen::Matrix3f(M.block<3, 3>(0, 0)));
+        T_ref_cams.push_back(Sophus::SE3f(q.normalized(), M.block<3, 1>(0, 3)));
+        transform_ids_.push_back(pair.first);
+    }
+    
+    const size_t n = transform_ids_.size();
+    transforms_.resize(n * n);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            transforms_[i * n + j] = T_ref_cams[j].inverse() * T_ref_cams[i];
+        }
+    }
+    transforms_valid_ = true;
+}
+
+const Sophus::SE3f* MultiCameraRig::FindTransform(int source_camera_id, int target_camera_id)
+{
+    if (!transforms_valid_) {
+        BuildTransformTable();
+    }
+    
+    // cameras_ is ordered by ID, so transform_ids_ is sorted
+    auto source_it = std::lower_bound(transform_ids_.begin(), transform_ids_.end(), source_camera_id);
+    auto target_it = std::lower_bound(transform_ids_.begin(), transform_ids_.end(), target_camera_id);
+    if (source_it == transform_ids_.end() || *source_it != source_camera_id ||
+        target_it == transform_ids_.end() || *target_it != target_camera_id) {
+        return nullptr;
+    }
+    
+    const size_t i = source_it - transform_ids_.begin();
+    const size_t j = target_it - transform_ids_.begin();
+    return &transforms_[i * transform_ids_.size() + j];
+}
+
+const MultiCameraRig::SphericalRemap& MultiCameraRig::GetSphericalRemap(
+    int camera_id,
+    const cv::Size& panorama_size)
+{
+    const auto key = std::make_pair(camera_id, std::make_pair(panorama_size.width, panorama_size.height));
+    auto it = spherical_remaps_.find(key);
+    if (it != spherical_remaps_.end()) {
+        return it->second;
+    }
+    
+    SphericalRemap& remap = spherical_remaps_[key];
+    cv::Mat map = CreateSphericalMap(camera_id, panorama_size);
+    if (map.empty()) {
+        return remap;
+    }
+    
+    // Visible pixels are the ones with non-negative source coordinates
+    std::vector<cv::Mat> channels;
+    cv::split(map, channels);
+    cv::Mat valid = (channels[0] >= 0) & (channels[1] >= 0);
+    
+    std::vector<cv::Point> visible;
+    cv::findNonZero(valid, visible);
+    if (visible.empty()) {
+        return remap;
+    }
+    
+    // Crop to the visible area and convert to the fixed-point format remap runs fastest on
+    remap.roi = cv::boundingRect(visible);
+    remap.valid = valid(remap.roi).clone();
+    cv::convertMaps(map(remap.roi), cv::Mat(), remap.map1, remap.map2, CV_16SC2);
+    
+    return remap;
 }
 
 cv::Mat MultiCameraRig::CreateSphericalMap(
@@ -830,15 +1672,11 @@ cv::Point3f MultiCameraRig::CameraToSphere(
     camera_point.z /= norm;
     
     // Transform to reference frame
-    cv::Mat camera_point_mat = (cv::Mat_<float>(4, 1) << 
-        camera_point.x, camera_point.y, camera_point.z, 1.0f);
-    cv::Mat ref_point_mat = info.T_ref_cam.inv() * camera_point_mat;
+    const Eigen::Vector4f ref_point_h = Converter::toMatrix4fMap(info.T_ref_cam).inverse() *
+        Eigen::Vector4f(camera_point.x, camera_point.y, camera_point.z, 1.0f);
     
     // Return as unit vector on sphere
-    cv::Point3f ref_point(
-        ref_point_mat.at<float>(0, 0),
-        ref_point_mat.at<float>(1, 0),
-        ref_point_mat.at<float>(2, 0));
+    cv::Point3f ref_point(ref_point_h.x(), ref_point_h.y(), ref_point_h.z());
     
     norm = std::sqrt(
         ref_point.x * ref_point.x + 
@@ -866,15 +1704,11 @@ cv::Point2f MultiCameraRig::SphereToCameraProjection(
     const CameraInfo& info = it->second;
     
     // Transform sphere point to camera coordinates
-    cv::Mat sphere_point_mat = (cv::Mat_<float>(4, 1) << 
-        sphere_point.x, sphere_point.y, sphere_point.z, 1.0f);
-    cv::Mat camera_point_mat = info.T_ref_cam * sphere_point_mat;
+    const Eigen::Vector4f camera_point_h =
+        Converter::toMatrix4fMap(info.T_ref_cam) * Eigen::Vector4f(sphere_point.x, sphere_point.y, sphere_point.z, 1.0f);
     
     // Convert to 3D point
-    cv::Point3f camera_point(
-        camera_point_mat.at<float>(0, 0),
-        camera_point_mat.at<float>(1, 0),
-        camera_point_mat.at<float>(2, 0));
+    cv::Point3f camera_point(camera_point_h.x(), camera_point_h.y(), camera_point_h.z());
     
     // Check if point is in front of camera
     if (camera_point.z <= 0) {
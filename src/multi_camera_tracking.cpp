@@ -1,14 +1,58 @@
 #include "include/multi_camera_tracking.hpp"
+#include "../ORB_SLAM3/include/ORBmatcher.h"
+#include "../ORB_SLAM3/include/Optimizer.h"
+#include "../ORB_SLAM3/include/LocalMapping.h"
+#include "../ORB_SLAM3/include/LoopClosing.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <thread>
+#include <atomic>
 #include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <limits>
+#include <utility>
 
 namespace ORB_SLAM3
 {
 
+namespace
+{
+
+// Search radius around the projected keypoint for cross-camera matching (pixels)
+const float kCrossCameraSearchRadius = 10.0f;
+
+// Depth at which keypoints are projected into the other camera for cross-camera matching (meters)
+const float kCrossCameraDepth = 1.0f;
+
+// Projection search radius for the local map in the other rig cameras, wider than the tracked camera's
+// since their pose is predicted through the extrinsics (pixels at the keypoint scale)
+const float kRigProjectionRadius = 3.0f;
+
+// Local map points per task when projecting and matching over the worker pool
+const int kLocalMapBatch = 64;
+
+// Camera scheduling score weights: tracked map points, keypoints, facing the direction of travel
+const float kScoreTrackedWeight = 0.5f;
+const float kScoreTextureWeight = 0.3f;
+const float kScoreMotionWeight = 0.2f;
+
+// Map points tracked in a frame, outliers excluded
+int countTrackedPoints(const Frame& frame)
+{
+    int tracked = 0;
+    for (size_t i = 0; i < frame.mvpMapPoints.size(); i++) {
+        MapPoint* pMP = frame.mvpMapPoints[i];
+        if (pMP && !pMP->isBad() && (i >= frame.mvbOutlier.size() || !frame.mvbOutlier[i])) {
+            tracked++;
+        }
+    }
+    return tracked;
+}
+
+} // namespace
+
 MultiCameraTracking::MultiCameraTracking(
     System* pSys,
     ORBVocabulary* pVoc,
@@ -30,9 +74,20 @@ MultiCameraTracking::MultiCameraTracking(
     
     // Initialize feature extractors for all cameras
     InitializeFeatureExtractors();
+    PrecomputeCameraGeometry();
+    
+    // Start the worker pool once instead of a thread per camera per frame
+    if (mConfig.parallel_feature_extraction) {
+        mpWorkerPool.reset(new WorkerPool(mRig.GetAllCameras().size(), mConfig.worker_cpu_cores));
+    }
+    UpdateLocalMapParallelism();
+    mKeyFramePolicy.SetConfig(mConfig.keyframe_policy);
     
     // Initialize camera frames
     mvCameraFrames.resize(mRig.GetAllCameras().size());
+    mvbCameraScheduled.assign(mRig.GetAllCameras().size(), true);
+    mvCameraScores.assign(mRig.GetAllCameras().size(), 1.0f);
+    mvCameraNovelty.assign(mRig.GetAllCameras().size(), 0.0f);
     
     // Initialize camera poses
     mvCameraPoses.resize(mRig.GetAllCameras().size());
@@ -45,6 +100,18 @@ MultiCameraTracking::MultiCameraTracking(
 
 MultiCameraTracking::~MultiCameraTracking()
 {
+    // The local mapper and loop closer outlive this tracker, stop them from using the pool
+    if (mpLocalMapper) {
+        mpLocalMapper->SetParallelFor(ORBmatcher::ParallelFor());
+    }
+    if (mpLoopClosing) {
+        mpLoopClosing->SetParallelFor(ORBmatcher::ParallelFor());
+    }
+    
+    // Join the workers before the extractors they use are deleted
+    SetBowSubmit(BowCache::Submit());
+    mpWorkerPool.reset();
+    
     // Clean up feature extractors
     for (auto extractor : mvpFeatureExtractors) {
         delete extractor;
@@ -58,13 +125,16 @@ Sophus::SE3f MultiCameraTracking::GrabMultiCameraImages(
     const std::vector<std::string>& filenames)
 {
     // Check if number of images matches number of cameras
-    if (images.size() != mRig.GetAllCameras().size()) {
+    if (images.size() != mRig.GetNumCameras()) {
         std::cerr << "Error: Number of images (" << images.size() 
-                  << ") does not match number of cameras (" << mRig.GetAllCameras().size() << ")" << std::endl;
+                  << ") does not match number of cameras (" << mRig.GetNumCameras() << ")" << std::endl;
         return Sophus::SE3f();
     }
     
-    // Extract features from all cameras
+    // Pick the cameras worth extracting this frame set
+    ScheduleCameras();
+    
+    // Extract features from the scheduled cameras
     ExtractFeaturesFromAllCameras(images);
     
     // Match features across cameras
@@ -83,13 +153,136 @@ Sophus::SE3f MultiCameraTracking::GrabMultiCameraImages(
     // Track with the active camera
     Track();
     
+    // Refine the pose with the other cameras' observations in a joint solve
+    if (mConfig.joint_pose_optimization) {
+        TrackLocalMapWithMultiCameras();
+    }
+    
+    // Score the cameras for the next frame set
+    UpdateCameraScores();
+    
     // Update poses for all cameras based on the active camera's pose
     UpdateCameraPoses(mCurrentFrame.GetPose());
     
+    NotifyFrameCallback(timestamp);
+    
     // Return the pose of the active camera
     return mCurrentFrame.GetPose();
 }
 
+Sophus::SE3f MultiCameraTracking::GrabMultiCameraImages(
+    const std::vector<cv::Mat>& images,
+    const double& timestamp,
+    LatencyStamps& latency,
+    const std::vector<std::string>& filenames)
+{
+    Sophus::SE3f pose = GrabMultiCameraImages(images, timestamp, filenames);
+    latency.Stamp(LatencyStage::TRACK_DONE);
+    return pose;
+}
+
+void MultiCameraTracking::RegisterFrameCallback(FrameCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mMutexFrameCallback);
+    mFrameCallback = std::move(callback);
+}
+
+void MultiCameraTracking::NotifyFrameCallback(double timestamp)
+{
+    std::lock_guard<std::mutex> lock(mMutexFrameCallback);
+    if (!mFrameCallback)
+        return;
+    
+    // The active camera's matches come from tracking, the others' from the joint solve
+    const size_t nCameras = mvCameraFrames.size();
+    mvCallbackKeypoints.resize(nCameras);
+    mvCallbackMapPoints.resize(nCameras);
+    for (size_t i = 0; i < nCameras; ++i) {
+        mvCallbackKeypoints[i].clear();
+        mvCallbackMapPoints[i].clear();
+        if (mState != OK || (i < mvbCameraScheduled.size() && !mvbCameraScheduled[i]))
+            continue;
+        
+        const Frame& frame = static_cast<int>(i) == mActiveCameraId ? mCurrentFrame : mvCameraFrames[i];
+        mvCallbackKeypoints[i].assign(frame.mvKeys.begin(), frame.mvKeys.end());
+        mvCallbackMapPoints[i].assign(frame.mvpMapPoints.begin(), frame.mvpMapPoints.end());
+    }
+    
+    mFrameCallback(mCurrentFrame.GetPose(), timestamp, mvCallbackKeypoints, mvCallbackMapPoints);
+}
+
+void MultiCameraTracking::RegisterKeyFrameCallback(KeyFrameCallback callback, uint16_t device_id)
+{
+    std::lock_guard<std::mutex> lock(mMutexKeyFrameCallback);
+    mKeyFrameCallback = std::move(callback);
+    mnKeyFrameDeviceId = device_id;
+}
+
+void MultiCameraTracking::NotifyKeyFrameCallback(KeyFrame* pKF)
+{
+    std::lock_guard<std::mutex> lock(mMutexKeyFrameCallback);
+    if (!mKeyFrameCallback)
+        return;
+    
+    // The shared map carries 256-bit binary descriptors only
+    const cv::Mat& descriptors = pKF->mDescriptors;
+    if (descriptors.type() != CV_8U || descriptors.cols != static_cast<int>(kMapDeltaDescriptorBytes) ||
+        static_cast<size_t>(descriptors.rows) != pKF->mvKeysUn.size())
+        return;
+    
+    KeyFrameDelta& delta = mKeyFrameDelta;
+    delta.device_id = mnKeyFrameDeviceId;
+    delta.keyframe_id = pKF->mnId;
+    delta.timestamp = pKF->mTimeStamp;
+    delta.camera = static_cast<uint8_t>(std::max(mActiveCameraId, 0));
+    const Sophus::SE3f Tcw = pKF->GetPose();
+    const Eigen::Quaternionf q = Tcw.unit_quaternion();
+    delta.rotation[0] = q.x();
+    delta.rotation[1] = q.y();
+    delta.rotation[2] = q.z();
+    delta.rotation[3] = q.w();
+    for (int i = 0; i < 3; ++i)
+        delta.translation[i] = Tcw.translation()[i];
+    
+    const size_t N = pKF->mvKeysUn.size();
+    delta.keypoints.resize(N);
+    delta.descriptors.resize(N * kMapDeltaDescriptorBytes);
+    for (size_t i = 0; i < N; ++i) {
+        const cv::KeyPoint kp = pKF->mvKeysUn[i];
+        delta.keypoints[i].x = kp.pt.x;
+        delta.keypoints[i].y = kp.pt.y;
+        delta.keypoints[i].octave = static_cast<uint8_t>(kp.octave);
+        delta.keypoints[i].angle = std::max(kp.angle, 0.0f);
+        std::memcpy(&delta.descriptors[i * kMapDeltaDescriptorBytes], descriptors.ptr<uint8_t>(i),
+                    kMapDeltaDescriptorBytes);
+    }
+    
+    // The keyframe's own bag of words is filled by LocalMapping, take the frame's if
+    // tracking computed it, otherwise the receiver computes it from the descriptors
+    delta.bow.clear();
+    for (const auto& word : mCurrentFrame.mBowVec)
+        delta.bow.emplace_back(word.first, static_cast<float>(word.second));
+    
+    const std::vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
+    delta.observations.assign(N, -1);
+    delta.points.clear();
+    for (size_t i = 0; i < N && i < vpMapPoints.size(); ++i) {
+        MapPoint* pMP = vpMapPoints[i];
+        if (!pMP || pMP->isBad())
+            continue;
+        
+        MapPointDelta point;
+        point.id = MakeSharedMapPointId(mnKeyFrameDeviceId, pMP->mnId);
+        const Eigen::Vector3f pos = pMP->GetWorldPos();
+        for (int j = 0; j < 3; ++j)
+            point.position[j] = pos[j];
+        delta.observations[i] = static_cast<int32_t>(delta.points.size());
+        delta.points.push_back(point);
+    }
+    
+    mKeyFrameCallback(delta);
+}
+
 int MultiCameraTracking::GetBestCameraForPoint(const cv::Point3f& worldPoint)
 {
     // Convert world point to reference frame
@@ -115,9 +308,9 @@ std::vector<int> MultiCameraTracking::GetCamerasForPoint(const cv::Point3f& worl
     cv::Point3f refPoint(point_ref(0), point_ref(1), point_ref(2));
     
     // Check visibility for each camera
-    for (const auto& camera : mRig.GetAllCameras()) {
-        if (mRig.IsPointVisibleToCamera(refPoint, camera.id)) {
-            visibleCameras.push_back(camera.id);
+    for (const auto& camera : mRig.GetCameras()) {
+        if (mRig.IsPointVisibleToCamera(refPoint, camera.first)) {
+            visibleCameras.push_back(camera.first);
         }
     }
     
@@ -171,9 +364,14 @@ void MultiCameraTracking::SetMultiCameraRig(const MultiCameraRig& rig)
     }
     mvpFeatureExtractors.clear();
     InitializeFeatureExtractors();
+    PrecomputeCameraGeometry();
     
     // Resize camera frames and poses
     mvCameraFrames.resize(mRig.GetAllCameras().size());
+    mvbCameraScheduled.assign(mRig.GetAllCameras().size(), true);
+    mvCameraScores.assign(mRig.GetAllCameras().size(), 1.0f);
+    mvCameraNovelty.assign(mRig.GetAllCameras().size(), 0.0f);
+    mbScheduleAllCameras = true;
     mvCameraPoses.resize(mRig.GetAllCameras().size());
     for (size_t i = 0; i < mvCameraPoses.size(); i++) {
         mvCameraPoses[i] = Sophus::SE3f();
@@ -188,6 +386,45 @@ MultiCameraTracking::Config MultiCameraTracking::GetConfig() const
 void MultiCameraTracking::SetConfig(const Config& config)
 {
     mConfig = config;
+    
+    // The pool is kept when disabled, LocalMapping may be sharing it
+    if (mConfig.parallel_feature_extraction && !mpWorkerPool) {
+        mpWorkerPool.reset(new WorkerPool(mRig.GetAllCameras().size(), mConfig.worker_cpu_cores));
+    }
+    UpdateLocalMapParallelism();
+    
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    mKeyFramePolicy.SetConfig(mConfig.keyframe_policy);
+}
+
+void MultiCameraTracking::UpdateLocalMapParallelism()
+{
+    ORBmatcher::ParallelFor parallel_for;
+    if (mpWorkerPool) {
+        WorkerPool* pool = mpWorkerPool.get();
+        parallel_for = [pool](int count, const std::function<void(int)>& job) {
+            pool->ParallelFor(count, job);
+        };
+    }
+    
+    SetParallelFor(mConfig.parallel_local_map_search ? parallel_for : ORBmatcher::ParallelFor());
+    
+    // The bag of words is computed once per frame, on a worker while the frame is tracked
+    BowCache::Submit bow_submit;
+    if (mpWorkerPool && mConfig.async_bow) {
+        WorkerPool* pool = mpWorkerPool.get();
+        bow_submit = [pool](const std::function<void()>& job) {
+            pool->Submit(job);
+        };
+    }
+    SetBowSubmit(bow_submit);
+    if (mpLocalMapper) {
+        mpLocalMapper->SetParallelFor(mConfig.parallel_triangulation ? parallel_for : ORBmatcher::ParallelFor());
+        mpLocalMapper->SetKeyFrameBatchSize(mConfig.keyframe_batch_size);
+    }
+    if (mpLoopClosing) {
+        mpLoopClosing->SetParallelFor(mConfig.parallel_loop_verification ? parallel_for : ORBmatcher::ParallelFor());
+    }
 }
 
 int MultiCameraTracking::GetActiveCameraId() const
@@ -198,6 +435,10 @@ int MultiCameraTracking::GetActiveCameraId() const
 void MultiCameraTracking::SetActiveCameraId(int camera_id)
 {
     if (camera_id >= 0 && camera_id < static_cast<int>(mRig.GetAllCameras().size())) {
+        // A prediction is for the previous active camera
+        if (camera_id != mActiveCameraId) {
+            ClearPosePrediction();
+        }
         mActiveCameraId = camera_id;
     } else {
         std::cerr << "Invalid camera ID: " << camera_id << std::endl;
@@ -209,6 +450,125 @@ std::vector<TPUFeatureExtractor*> MultiCameraTracking::GetFeatureExtractors() co
     return mvpFeatureExtractors;
 }
 
+bool MultiCameraTracking::SaveMap(const std::string& filename)
+{
+    if (!mpSystem) {
+        std::cerr << "No ORB-SLAM3 system to save the atlas from" << std::endl;
+        return false;
+    }
+    return mpSystem->SaveMap(filename);
+}
+
+bool MultiCameraTracking::LoadMap(const std::string& filename)
+{
+    if (!mpSystem) {
+        std::cerr << "No ORB-SLAM3 system to load the atlas into" << std::endl;
+        return false;
+    }
+    return mpSystem->LoadMap(filename);
+}
+
+bool MultiCameraTracking::Checkpoint(const std::string& filename, size_t bytes_per_second)
+{
+    if (!mpSystem) {
+        std::cerr << "No ORB-SLAM3 system to checkpoint the atlas from" << std::endl;
+        return false;
+    }
+    return mpSystem->Checkpoint(filename, bytes_per_second);
+}
+
+bool MultiCameraTracking::IsCheckpointing() const
+{
+    return mpSystem && mpSystem->isCheckpointing();
+}
+
+void MultiCameraTracking::GetMemoryBreakdown(MemoryBreakdown& breakdown) const
+{
+    if (mpAtlas) {
+        mpAtlas->GetMemoryBreakdown(breakdown);
+    }
+}
+
+WorkerPool* MultiCameraTracking::GetWorkerPool() const
+{
+    return mpWorkerPool.get();
+}
+
+void MultiCameraTracking::SetLocalBAWindow(int max_keyframes)
+{
+    if (mpLocalMapper) {
+        mpLocalMapper->SetMaxLocalBAKeyFrames(max_keyframes);
+    }
+}
+
+void MultiCameraTracking::SetOfflineMapping(bool offline)
+{
+    if (mpSystem) {
+        mpSystem->SetRealTime(!offline);
+    } else if (mpLocalMapper) {
+        mpLocalMapper->SetRealTime(!offline);
+    }
+    if (offline && mpLocalMapper) {
+        mpLocalMapper->SetMaxLocalBAKeyFrames(0);
+        mpLocalMapper->SetLocalBAThreads(std::max(1u, std::thread::hardware_concurrency()));
+        mpLocalMapper->SetLocalBATermination(0.f, 0.f);
+    }
+}
+
+bool MultiCameraTracking::RunGlobalBundleAdjustment(int iterations)
+{
+    if (!mpSystem) {
+        std::cerr << "No ORB-SLAM3 system to run the global BA on" << std::endl;
+        return false;
+    }
+    mpSystem->RunGlobalBundleAdjustment(iterations);
+    return true;
+}
+
+void MultiCameraTracking::SetMotionHint(const Eigen::Vector3f& linear_velocity, const Eigen::Vector3f& angular_velocity)
+{
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    mMotionHint = linear_velocity;
+    mAngularHint = angular_velocity;
+}
+
+std::vector<int> MultiCameraTracking::GetScheduledCameras() const
+{
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    std::vector<int> cameras;
+    for (size_t i = 0; i < mvbCameraScheduled.size(); i++) {
+        if (mvbCameraScheduled[i]) {
+            cameras.push_back(i);
+        }
+    }
+    return cameras;
+}
+
+std::vector<float> MultiCameraTracking::GetCameraScores() const
+{
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    return mvCameraScores;
+}
+
+void MultiCameraTracking::GetFrameSetFeatureCounts(int& keypoints, int& tracked_points) const
+{
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    keypoints = mnFrameSetKeypoints;
+    tracked_points = mnFrameSetTrackedPoints;
+}
+
+KeyFramePolicy::Decision MultiCameraTracking::GetLastKeyFrameDecision() const
+{
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    return mKeyFramePolicy.GetLastDecision();
+}
+
+uint64_t MultiCameraTracking::GetSuppressedKeyFrameCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    return mKeyFramePolicy.GetSuppressedCount();
+}
+
 void MultiCameraTracking::Track()
 {
     // Call the base class Track method
@@ -221,22 +581,23 @@ void MultiCameraTracking::ExtractFeaturesFromAllCameras(const std::vector<cv::Ma
     // Reset counter for parallel processing
     mNumCamerasProcessed = 0;
     
-    if (mConfig.parallel_feature_extraction) {
-        // Extract features in parallel
-        for (size_t i = 0; i < images.size(); i++) {
-            mvFeatureExtractionThreads.push_back(
-                std::thread(&MultiCameraTracking::ExtractFeaturesFromCamera, this, i, images[i]));
-        }
-        
-        // Wait for all threads to finish
-        for (auto& thread : mvFeatureExtractionThreads) {
-            thread.join();
+    // Only the cameras scheduled for this frame set
+    std::vector<int> cameras;
+    for (size_t i = 0; i < images.size(); i++) {
+        if (mvbCameraScheduled[i]) {
+            cameras.push_back(i);
         }
-        mvFeatureExtractionThreads.clear();
+    }
+    
+    if (mConfig.parallel_feature_extraction && mpWorkerPool) {
+        // Extract features in parallel on the worker pool, this thread takes a camera too
+        mpWorkerPool->ParallelFor(cameras.size(), [this, &images, &cameras](int i) {
+            ExtractFeaturesFromCamera(cameras[i], images[cameras[i]]);
+        });
     } else {
         // Extract features sequentially
-        for (size_t i = 0; i < images.size(); i++) {
-            ExtractFeaturesFromCamera(i, images[i]);
+        for (int camera : cameras) {
+            ExtractFeaturesFromCamera(camera, images[camera]);
         }
     }
 }
@@ -246,33 +607,258 @@ int MultiCameraTracking::MatchFeaturesAcrossCameras()
     int totalMatches = 0;
     mvCrossCameraMatches.clear();
     
-    // For each pair of cameras
+    // Collect the camera pairs whose views overlap, both extracted this frame set
+    std::vector<std::pair<size_t, size_t>> pairs;
     for (size_t i = 0; i < mvCameraFrames.size(); i++) {
         for (size_t j = i + 1; j < mvCameraFrames.size(); j++) {
-            // Find matches between cameras i and j
-            auto matches = FindMatchesBetweenCameras(i, j);
-            
-            // Add to total matches
-            totalMatches += matches.size();
-            
-            // Store matches
-            mvCrossCameraMatches.insert(mvCrossCameraMatches.end(), matches.begin(), matches.end());
-            
-            // Merge map points from matches
-            MergeMapPointsFromMatches(matches, i, j);
+            // Frames of unscheduled cameras are stale
+            if (mvvCameraPairs[i][j].overlap && mvbCameraScheduled[i] && mvbCameraScheduled[j]) {
+                pairs.push_back(std::make_pair(i, j));
+            }
+        }
+    }
+    
+    // Find matches between each pair, in parallel when the pool is running (read-only on the frames)
+    std::vector<std::vector<std::pair<size_t, size_t>>> pairMatches(pairs.size());
+    auto findMatches = [this, &pairs, &pairMatches](int p) {
+        pairMatches[p] = FindMatchesBetweenCameras(pairs[p].first, pairs[p].second);
+    };
+    if (mConfig.parallel_feature_extraction && mpWorkerPool) {
+        mpWorkerPool->ParallelFor(pairs.size(), findMatches);
+    } else {
+        for (size_t p = 0; p < pairs.size(); p++) {
+            findMatches(p);
         }
     }
     
+    // Merge sequentially in pair order, merging modifies the map points
+    for (size_t p = 0; p < pairs.size(); p++) {
+        const size_t i = pairs[p].first;
+        const size_t j = pairs[p].second;
+        const auto& matches = pairMatches[p];
+        
+        // Add to total matches
+        totalMatches += matches.size();
+        
+        // Store matches
+        mvCrossCameraMatches.insert(mvCrossCameraMatches.end(), matches.begin(), matches.end());
+        
+        // Merge map points from matches
+        MergeMapPointsFromMatches(matches, i, j);
+    }
+    
     return totalMatches;
 }
 
+void MultiCameraTracking::ScheduleCameras()
+{
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    
+    const size_t numCameras = mvCameraFrames.size();
+    mvbCameraScheduled.assign(numCameras, true);
+    mnScheduledFrames++;
+    
+    const int budget = mConfig.scheduled_cameras;
+    if (mbScheduleAllCameras || budget <= 0 || budget >= static_cast<int>(numCameras)) {
+        return;
+    }
+    
+    // The active camera always runs, the base tracker works on its frame
+    std::fill(mvbCameraScheduled.begin(), mvbCameraScheduled.end(), false);
+    mvbCameraScheduled[mActiveCameraId] = true;
+    
+    // Then the best scoring cameras up to the budget
+    std::vector<int> order(numCameras);
+    for (size_t i = 0; i < numCameras; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        return mvCameraScores[a] > mvCameraScores[b];
+    });
+    
+    int selected = 1;
+    for (int camera : order) {
+        if (selected >= budget) {
+            break;
+        }
+        if (!mvbCameraScheduled[camera]) {
+            mvbCameraScheduled[camera] = true;
+            selected++;
+        }
+    }
+    
+    // The rest at a reduced rate to keep their scores fresh, staggered across frames
+    const unsigned long interval = std::max(1, mConfig.unscheduled_camera_interval);
+    for (size_t i = 0; i < numCameras; i++) {
+        if ((mnScheduledFrames + i) % interval == 0) {
+            mvbCameraScheduled[i] = true;
+        }
+    }
+}
+
+void MultiCameraTracking::UpdateCameraScores()
+{
+    // The base tracker worked on a copy of the active camera's frame
+    const int activeTracked = countTrackedPoints(mCurrentFrame);
+    
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    
+    // Degraded tracking runs every camera again until it recovers
+    mbScheduleAllCameras = mState != OK || activeTracked < mConfig.min_tracked_points;
+    
+    // Direction of travel in the reference camera frame
+    Eigen::Vector3f direction = Eigen::Vector3f::Zero();
+    const float speed = mMotionHint.norm();
+    const int refId = mRig.GetReferenceCameraId();
+    if (speed > 1e-3f && refId >= 0 && refId < static_cast<int>(mvCameraPoses.size())) {
+        direction = mvCameraPoses[refId].rotationMatrix().transpose() * mMotionHint / speed;
+    }
+    
+    // Raw measures of the cameras extracted this frame set
+    const size_t numCameras = mvCameraFrames.size();
+    std::vector<int> tracked(numCameras, 0);
+    std::vector<int> keypoints(numCameras, 0);
+    int maxTracked = 1;
+    int maxKeypoints = 1;
+    mnFrameSetKeypoints = 0;
+    mnFrameSetTrackedPoints = 0;
+    for (size_t i = 0; i < numCameras; i++) {
+        if (!mvbCameraScheduled[i]) {
+            continue;
+        }
+        tracked[i] = static_cast<int>(i) == mActiveCameraId ? activeTracked : countTrackedPoints(mvCameraFrames[i]);
+        keypoints[i] = mvCameraFrames[i].N;
+        maxTracked = std::max(maxTracked, tracked[i]);
+        maxKeypoints = std::max(maxKeypoints, keypoints[i]);
+        mnFrameSetKeypoints += keypoints[i];
+        mnFrameSetTrackedPoints += tracked[i];
+        mvCameraNovelty[i] = keypoints[i] > 0 ? 1.0f - static_cast<float>(tracked[i]) / keypoints[i] : 0.0f;
+    }
+    
+    // Unscheduled cameras keep their last score until they run again
+    for (size_t i = 0; i < numCameras; i++) {
+        if (!mvbCameraScheduled[i]) {
+            continue;
+        }
+        const float motion = i < mvCameraAxes.size() ? std::max(0.0f, mvCameraAxes[i].dot(direction)) : 0.0f;
+        mvCameraScores[i] =
+            kScoreTrackedWeight * tracked[i] / maxTracked +
+            kScoreTextureWeight * keypoints[i] / maxKeypoints +
+            kScoreMotionWeight * motion;
+    }
+}
+
 bool MultiCameraTracking::TrackLocalMapWithMultiCameras()
 {
-    // This is a placeholder for the implementation
-    // In a full implementation, this would track the local map using all cameras
+    // The base tracker has tracked the local map in the active camera
+    if (mState != OK || mvpLocalMapPoints.empty()) {
+        return false;
+    }
+    
+    const Sophus::SE3f Tcw = mCurrentFrame.GetPose();
+    std::vector<Frame*> vpRigFrames;
+    std::vector<Sophus::SE3f> vTcr;
+    
+    ORBmatcher matcher(0.8);
+    for (size_t i = 0; i < mvCameraFrames.size(); i++) {
+        if (static_cast<int>(i) == mActiveCameraId || !mvbCameraScheduled[i]) {
+            continue;
+        }
+        
+        Frame& frame = mvCameraFrames[i];
+        if (frame.N == 0 || !frame.mpCamera) {
+            continue;
+        }
+        
+        // Predict the camera's pose from the active camera through the rig extrinsics
+        const CameraPairGeometry& pair = mvvCameraPairs[mActiveCameraId][i];
+        const Sophus::SE3f Tca(Eigen::Quaternionf(pair.R_2_1).normalized(), pair.t_2_1);
+        frame.SetPose(Tca * Tcw);
+        
+        // Project the local map (this fills the MapPoint variables for matching)
+        std::atomic<int> nToMatch(0);
+        const int nLocalMPs = static_cast<int>(mvpLocalMapPoints.size());
+        RunParallel((nLocalMPs + kLocalMapBatch - 1) / kLocalMapBatch, [this, &frame, &nToMatch, nLocalMPs](int t) {
+            int n = 0;
+            for (int k = t * kLocalMapBatch; k < std::min(nLocalMPs, (t + 1) * kLocalMapBatch); k++) {
+                MapPoint* pMP = mvpLocalMapPoints[k];
+                if (pMP && !pMP->isBad() && frame.isInFrustum(pMP, 0.5)) {
+                    n++;
+                }
+            }
+            nToMatch += n;
+        });
+        if (nToMatch == 0) {
+            continue;
+        }
+        
+        if (matcher.SearchByProjection(frame, mvpLocalMapPoints, kRigProjectionRadius, false, 50.0f, mParallelFor) > 0) {
+            vpRigFrames.push_back(&frame);
+            vTcr.push_back(Tca);
+        }
+    }
+    
+    if (vpRigFrames.empty()) {
+        return true;
+    }
     
-    // For now, just use the active camera's tracking
-    return TrackLocalMap();
+    // One solve for the rig pose over all cameras
+    const int nInliers = Optimizer::PoseOptimizationMultiCamera(&mCurrentFrame, vpRigFrames, vTcr);
+    
+    // The base tracker copied the frame before this refinement, keep its motion prediction in line
+    mLastFrame.SetPose(mCurrentFrame.GetPose());
+    for (size_t k = 0; k < vpRigFrames.size(); k++) {
+        vpRigFrames[k]->SetPose(vTcr[k] * mCurrentFrame.GetPose());
+    }
+    
+    return nInliers >= mConfig.min_tracked_points;
+}
+
+bool MultiCameraTracking::AcceptKeyFrame(bool bUrgent)
+{
+    // Offline there is no frame deadline to weigh the mapping cost against
+    if (!mConfig.cost_aware_keyframes || !mpLocalMapper || !mpLastKeyFrame || !mpLocalMapper->IsRealTime()) {
+        return true;
+    }
+    
+    KeyFramePolicy::Candidate candidate;
+    candidate.urgent = bUrgent;
+    candidate.seconds_since_keyframe = mCurrentFrame.mTimeStamp - mpLastKeyFrame->mTimeStamp;
+    candidate.queued_keyframes = mpLocalMapper->KeyframesInQueue();
+    mpLocalMapper->GetMappingCost(candidate.keyframe_cost_ms, candidate.local_ba_ms);
+    
+    // Motion of the active camera since the last keyframe
+    const Sophus::SE3f Tlc = mpLastKeyFrame->GetPose() * mCurrentFrame.GetPose().inverse();
+    candidate.translation_m = Tlc.translation().norm();
+    candidate.rotation_rad = Tlc.so3().log().norm();
+    
+    // The base tracker has just tracked the active camera, the others are from the last frame set
+    const int activeKeypoints = mCurrentFrame.N;
+    const float activeNovelty = activeKeypoints > 0 ?
+        1.0f - static_cast<float>(countTrackedPoints(mCurrentFrame)) / activeKeypoints : 0.0f;
+    
+    std::lock_guard<std::mutex> lock(mMutexMultiCamera);
+    candidate.speed_mps = mMotionHint.norm();
+    candidate.angular_speed_radps = mAngularHint.norm();
+    
+    // Novel view coverage over the scheduled cameras
+    int cameras = 0;
+    float novelty = 0.0f;
+    for (size_t i = 0; i < mvCameraNovelty.size(); i++) {
+        if (!mvbCameraScheduled[i]) {
+            continue;
+        }
+        const float cameraNovelty = static_cast<int>(i) == mActiveCameraId ? activeNovelty : mvCameraNovelty[i];
+        novelty += cameraNovelty;
+        if (cameraNovelty > mConfig.keyframe_policy.camera_novel_fraction) {
+            candidate.novel_cameras++;
+        }
+        cameras++;
+    }
+    candidate.cameras = std::max(cameras, 1);
+    candidate.novel_fraction = cameras > 0 ? novelty / cameras : activeNovelty;
+    
+    return mKeyFramePolicy.Decide(candidate).accept;
 }
 
 bool MultiCameraTracking::RelocalizationWithMultiCameras()
@@ -290,7 +876,12 @@ void MultiCameraTracking::CreateNewMultiCameraKeyFrame()
     // In a full implementation, this would create a new keyframe with data from all cameras
     
     // For now, just use the active camera's keyframe creation
+    KeyFrame* pLastKF = mpLastKeyFrame;
     CreateNewKeyFrame();
+    
+    // Local mapping may have refused the keyframe
+    if (mpLastKeyFrame && mpLastKeyFrame != pLastKF)
+        NotifyKeyFrameCallback(mpLastKeyFrame);
 }
 
 std::map<int, std::vector<cv::Point2f>> MultiCameraTracking::ProjectMapPointsToAllCameras(
@@ -299,8 +890,8 @@ std::map<int, std::vector<cv::Point2f>> MultiCameraTracking::ProjectMapPointsToA
     std::map<int, std::vector<cv::Point2f>> projections;
     
     // Initialize projections for each camera
-    for (const auto& camera : mRig.GetAllCameras()) {
-        projections[camera.id] = std::vector<cv::Point2f>();
+    for (const auto& camera : mRig.GetCameras()) {
+        projections[camera.first] = std::vector<cv::Point2f>();
     }
     
     // Project each map point to each camera
@@ -387,26 +978,16 @@ void MultiCameraTracking::UpdateCameraPoses(const Sophus::SE3f& T_w_ref)
     int refId = mRig.GetReferenceCameraId();
     mvCameraPoses[refId] = T_w_ref;
     
-    // Update poses for all other cameras based on their relative transforms
-    for (const auto& camera : mRig.GetAllCameras()) {
-        if (camera.id == refId) continue;
+    // Update poses for all other cameras from the rig's table of pair transforms
+    for (const auto& camera : mRig.GetCameras()) {
+        if (camera.first == refId) continue;
         
-        // Get transform from reference to this camera
-        cv::Mat T_ref_cam = camera.T_ref_cam;
-        
-        // Convert to Sophus::SE3f
-        Eigen::Matrix3f R;
-        Eigen::Vector3f t;
-        for (int i = 0; i < 3; i++) {
-            for (int j = 0; j < 3; j++) {
-                R(i, j) = T_ref_cam.at<float>(i, j);
-            }
-            t(i) = T_ref_cam.at<float>(i, 3);
-        }
-        Sophus::SE3f T_ref_cam_sophus(R, t);
+        // Transform from this camera to the reference camera
+        Sophus::SE3f T_ref_cam;
+        if (!mRig.GetTransform(camera.first, refId, T_ref_cam)) continue;
         
         // Calculate world to camera transform
-        mvCameraPoses[camera.id] = T_w_ref * T_ref_cam_sophus;
+        mvCameraPoses[camera.first] = T_w_ref * T_ref_cam;
     }
 }
 
@@ -446,8 +1027,9 @@ void MultiCameraTracking::ExtractFeaturesFromCamera(int camera_id, const cv::Mat
         grayImage = image.clone();
     }
     
-    // Create a mask (all pixels valid)
-    cv::Mat mask = cv::Mat::ones(grayImage.size(), CV_8UC1);
+    // Use the static mask of the camera, if any (all pixels valid otherwise)
+    cv::Mat mask = cameraInfo.mask.size() == grayImage.size() ?
+                   cameraInfo.mask : cv::Mat::ones(grayImage.size(), CV_8UC1);
     
     // Extract features
     std::vector<cv::KeyPoint> keypoints;
@@ -469,102 +1051,146 @@ void MultiCameraTracking::ExtractFeaturesFromCamera(int camera_id, const cv::Mat
         0.0  // threshold depth for stereo (not used)
     );
     
-    // Store the frame
-    mvCameraFrames[camera_id] = frame;
+    // Store the frame, handing over its buffers
+    mvCameraFrames[camera_id] = std::move(frame);
     
     // Increment the counter for parallel processing
     mNumCamerasProcessed++;
 }
 
-std::vector<std::pair<size_t, size_t>> MultiCameraTracking::FindMatchesBetweenCameras(
+void MultiCameraTracking::PrecomputeCameraGeometry()
+{
+    const size_t numCameras = mRig.GetAllCameras().size();
+    
+    mvCameraIntrinsics.assign(numCameras, CameraIntrinsics());
+    for (size_t i = 0; i < numCameras; i++) {
+        const auto cameraInfo = mRig.GetCameraInfo(i);
+        CameraIntrinsics& intrinsics = mvCameraIntrinsics[i];
+        if (!cameraInfo.K.empty()) {
+            intrinsics.fx = cameraInfo.K.at<float>(0, 0);
+            intrinsics.fy = cameraInfo.K.at<float>(1, 1);
+            intrinsics.cx = cameraInfo.K.at<float>(0, 2);
+            intrinsics.cy = cameraInfo.K.at<float>(1, 2);
+        }
+        intrinsics.width = cameraInfo.width;
+        intrinsics.height = cameraInfo.height;
+    }
+    
+    // Image regions each pair can match in, with the same projection as FindMatchesBetweenCameras
+    mRig.ComputeOverlapMasks(kCrossCameraDepth, kCrossCameraSearchRadius);
+    
+    mvvCameraPairs.assign(numCameras, std::vector<CameraPairGeometry>(numCameras));
+    for (size_t i = 0; i < numCameras; i++) {
+        for (size_t j = 0; j < numCameras; j++) {
+            if (i == j) {
+                continue;
+            }
+            
+            CameraPairGeometry& pair = mvvCameraPairs[i][j];
+            Sophus::SE3f T_2_1;
+            if (!mRig.GetTransform(i, j, T_2_1)) {
+                continue;
+            }
+            
+            pair.R_2_1 = T_2_1.rotationMatrix();
+            pair.t_2_1 = T_2_1.translation();
+            pair.overlap_mask = mRig.GetOverlapMask(i, j);
+            const float ratio = mRig.GetOverlapRatio(i, j);
+            pair.overlap = ratio < 0 ? mRig.DoCamerasOverlap(i, j) : ratio > 0;
+        }
+    }
+    
+    // Optical axes in the reference camera frame, for scoring against the direction of travel
+    const int refId = mRig.GetReferenceCameraId();
+    mvCameraAxes.assign(numCameras, Eigen::Vector3f::UnitZ());
+    for (size_t i = 0; i < numCameras; i++) {
+        if (refId >= 0 && refId < static_cast<int>(numCameras) && static_cast<int>(i) != refId) {
+            mvCameraAxes[i] = mvvCameraPairs[i][refId].R_2_1.col(2);
+        }
+    }
+}
+
+template<class Descriptor>
+std::vector<std::pair<size_t, size_t>> MultiCameraTracking::MatchCameraPair(
     int camera_id1, int camera_id2)
 {
     std::vector<std::pair<size_t, size_t>> matches;
     
-    // Get frames
+    const CameraPairGeometry& pair = mvvCameraPairs[camera_id1][camera_id2];
     const Frame& frame1 = mvCameraFrames[camera_id1];
     const Frame& frame2 = mvCameraFrames[camera_id2];
-    
-    // Get keypoints and descriptors
     const std::vector<cv::KeyPoint>& keypoints1 = frame1.mvKeysUn;
     const std::vector<cv::KeyPoint>& keypoints2 = frame2.mvKeysUn;
     const cv::Mat& descriptors1 = frame1.mDescriptors;
     const cv::Mat& descriptors2 = frame2.mDescriptors;
     
-    // Check if we have keypoints and descriptors
-    if (keypoints1.empty() || keypoints2.empty() || descriptors1.empty() || descriptors2.empty()) {
-        return matches;
-    }
+    const CameraIntrinsics& intrinsics1 = mvCameraIntrinsics[camera_id1];
+    const CameraIntrinsics& intrinsics2 = mvCameraIntrinsics[camera_id2];
+    const float radius2 = kCrossCameraSearchRadius * kCrossCameraSearchRadius;
     
-    // Get camera info
-    const auto& cameraInfo1 = mRig.GetCameraInfo(camera_id1);
-    const auto& cameraInfo2 = mRig.GetCameraInfo(camera_id2);
+    const cv::Mat& overlapMask = pair.overlap_mask;
     
-    // Get transform between cameras
-    cv::Mat T_cam1_cam2 = mRig.GetTransform(camera_id2, camera_id1);
+    std::vector<size_t> candidates;
+    std::vector<int> distances;
     
     // For each keypoint in frame1
     for (size_t i = 0; i < keypoints1.size(); i++) {
-        // Get 3D point in camera1 coordinates (assuming depth = 1)
-        cv::Point3f point1(
-            (keypoints1[i].pt.x - cameraInfo1.K.at<float>(0, 2)) / cameraInfo1.K.at<float>(0, 0),
-            (keypoints1[i].pt.y - cameraInfo1.K.at<float>(1, 2)) / cameraInfo1.K.at<float>(1, 1),
-            1.0f
-        );
+        // Only keypoints inside the overlap with camera2 can match
+        if (!overlapMask.empty()) {
+            const int x = static_cast<int>(keypoints1[i].pt.x);
+            const int y = static_cast<int>(keypoints1[i].pt.y);
+            if (x < 0 || x >= overlapMask.cols || y < 0 || y >= overlapMask.rows || !overlapMask.at<uchar>(y, x)) {
+                continue;
+            }
+        }
+        
+        // Get 3D point in camera1 coordinates at the matching depth
+        const Eigen::Vector3f point1(
+            (keypoints1[i].pt.x - intrinsics1.cx) / intrinsics1.fx * kCrossCameraDepth,
+            (keypoints1[i].pt.y - intrinsics1.cy) / intrinsics1.fy * kCrossCameraDepth,
+            kCrossCameraDepth);
         
         // Transform to camera2 coordinates
-        cv::Mat point1_mat = (cv::Mat_<float>(4, 1) << point1.x, point1.y, point1.z, 1.0f);
-        cv::Mat point2_mat = T_cam1_cam2 * point1_mat;
-        cv::Point3f point2(
-            point2_mat.at<float>(0, 0),
-            point2_mat.at<float>(1, 0),
-            point2_mat.at<float>(2, 0)
-        );
+        const Eigen::Vector3f point2 = pair.R_2_1 * point1 + pair.t_2_1;
         
         // Check if point is in front of camera2
-        if (point2.z <= 0) {
+        if (point2.z() <= 0) {
             continue;
         }
         
         // Project to camera2 image
-        cv::Point2f proj2(
-            cameraInfo2.K.at<float>(0, 0) * point2.x / point2.z + cameraInfo2.K.at<float>(0, 2),
-            cameraInfo2.K.at<float>(1, 1) * point2.y / point2.z + cameraInfo2.K.at<float>(1, 2)
-        );
+        const float invZ = 1.0f / point2.z();
+        const cv::Point2f proj2(
+            intrinsics2.fx * point2.x() * invZ + intrinsics2.cx,
+            intrinsics2.fy * point2.y() * invZ + intrinsics2.cy);
         
         // Check if projection is within image bounds
-        if (proj2.x < 0 || proj2.x >= cameraInfo2.width || proj2.y < 0 || proj2.y >= cameraInfo2.height) {
+        if (proj2.x < 0 || proj2.x >= intrinsics2.width || proj2.y < 0 || proj2.y >= intrinsics2.height) {
+            continue;
+        }
+        
+        // Candidates from the frame grid around the projection, the grid returns a square window
+        // so keep the circular test
+        candidates.clear();
+        for (size_t j : frame2.GetFeaturesInArea(proj2.x, proj2.y, kCrossCameraSearchRadius)) {
+            const cv::Point2f d = proj2 - keypoints2[j].pt;
+            if (d.x * d.x + d.y * d.y <= radius2) {
+                candidates.push_back(j);
+            }
+        }
+        if (candidates.empty()) {
             continue;
         }
         
         // Find the closest keypoint in frame2
+        DescriptorMatcher<Descriptor>::DescriptorDistances(descriptors1.row(static_cast<int>(i)), descriptors2, candidates, distances);
         float minDist = std::numeric_limits<float>::max();
         size_t bestIdx = 0;
-        
-        for (size_t j = 0; j < keypoints2.size(); j++) {
-            // Check distance between projection and keypoint
-            float dist = cv::norm(proj2 - keypoints2[j].pt);
-            
-            // If too far, skip
-            if (dist > 10.0f) {
-                continue;
-            }
-            
-            // Check descriptor distance
-            float descDist = 0.0f;
-            for (int k = 0; k < descriptors1.cols; k++) {
-                descDist += std::abs(descriptors1.at<float>(i, k) - descriptors2.at<float>(j, k));
-            }
-            
-            // If descriptor distance is too large, skip
-            if (descDist > mConfig.max_descriptor_distance) {
-                continue;
-            }
-            
-            // Update best match
-            if (descDist < minDist) {
+        for (size_t c = 0; c < candidates.size(); c++) {
+            const float descDist = static_cast<float>(distances[c]);
+            if (descDist <= mConfig.max_descriptor_distance && descDist < minDist) {
                 minDist = descDist;
-                bestIdx = j;
+                bestIdx = candidates[c];
             }
         }
         
@@ -577,6 +1203,36 @@ std::vector<std::pair<size_t, size_t>> MultiCameraTracking::FindMatchesBetweenCa
     return matches;
 }
 
+std::vector<std::pair<size_t, size_t>> MultiCameraTracking::FindMatchesBetweenCameras(
+    int camera_id1, int camera_id2)
+{
+    // Skip pairs the rig says cannot see the same points
+    const CameraPairGeometry& pair = mvvCameraPairs[camera_id1][camera_id2];
+    if (!pair.overlap) {
+        return std::vector<std::pair<size_t, size_t>>();
+    }
+    
+    const Frame& frame1 = mvCameraFrames[camera_id1];
+    const Frame& frame2 = mvCameraFrames[camera_id2];
+    const cv::Mat& descriptors1 = frame1.mDescriptors;
+    const cv::Mat& descriptors2 = frame2.mDescriptors;
+    
+    // Check if we have keypoints and descriptors
+    if (frame1.mvKeysUn.empty() || frame2.mvKeysUn.empty() || descriptors1.empty() || descriptors2.empty() ||
+        descriptors1.type() != descriptors2.type() || descriptors1.cols != descriptors2.cols) {
+        return std::vector<std::pair<size_t, size_t>>();
+    }
+    
+    // The search is generated for each descriptor type the extractors produce
+    if (descriptors1.type() == OrbDescriptor::CV_TYPE && descriptors1.cols == OrbDescriptor::LENGTH) {
+        return MatchCameraPair<OrbDescriptor>(camera_id1, camera_id2);
+    }
+    if (descriptors1.type() == FloatSuperPointDescriptor::CV_TYPE && descriptors1.cols == FloatSuperPointDescriptor::LENGTH) {
+        return MatchCameraPair<FloatSuperPointDescriptor>(camera_id1, camera_id2);
+    }
+    return std::vector<std::pair<size_t, size_t>>();
+}
+
 void MultiCameraTracking::MergeMapPointsFromMatches(
     const std::vector<std::pair<size_t, size_t>>& matches,
     int camera_id1, int camera_id2)
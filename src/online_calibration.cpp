@@ -0,0 +1,359 @@
+#include "include/online_calibration.hpp"
+#include "include/thread_placement.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <Eigen/Dense>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+constexpr double kDegToRad = M_PI / 180.0;
+
+// Rotation, time offset, gyro bias
+constexpr int kNumParameters = 7;
+typedef Eigen::Matrix<double, kNumParameters, kNumParameters> Matrix7d;
+typedef Eigen::Matrix<double, kNumParameters, 1> Vector7d;
+typedef Eigen::Matrix<double, 3, kNumParameters> Matrix37d;
+
+// Keeps the normal equations positive definite along unexcited directions
+constexpr double kDamping = 1e-9;
+
+// Gauss-Newton stops once the update is this small
+constexpr double kConvergedStep = 1e-8;
+
+// Longest time between gyro samples an interval is integrated over, longer are dropouts
+constexpr double kMaxGyroGap = 0.05;
+
+Eigen::Matrix3d rightJacobian(const Eigen::Vector3d& v)
+{
+    const double theta = v.norm();
+    const Eigen::Matrix3d W = Sophus::SO3d::hat(v);
+    if (theta < 1e-5) {
+        return Eigen::Matrix3d::Identity() - 0.5 * W;
+    }
+    return Eigen::Matrix3d::Identity() - (1.0 - std::cos(theta)) / (theta * theta) * W +
+           (theta - std::sin(theta)) / (theta * theta * theta) * W * W;
+}
+
+Eigen::Matrix3d inverseLeftJacobian(const Eigen::Vector3d& v)
+{
+    const double theta = v.norm();
+    const Eigen::Matrix3d W = Sophus::SO3d::hat(v);
+    if (theta < 1e-5) {
+        return Eigen::Matrix3d::Identity() - 0.5 * W;
+    }
+    return Eigen::Matrix3d::Identity() - 0.5 * W +
+           (1.0 / (theta * theta) - (1.0 + std::cos(theta)) / (2.0 * theta * std::sin(theta))) * W * W;
+}
+
+bool earlierThan(double timestamp, const OnlineCalibration::GyroMeasurement& sample)
+{
+    return timestamp < sample.timestamp;
+}
+
+} // namespace
+
+OnlineCalibration::OnlineCalibration(const Config& config, const Calibration& initial,
+                                     GyroSource source, ApplyCallback apply)
+    : mConfig(config), mSource(std::move(source)), mApply(std::move(apply)),
+      mInitialRbc(initial.T_bc.so3().cast<double>()), mCalibration(initial), mRunning(false)
+{
+    mConfig.max_iterations = std::max(1, mConfig.max_iterations);
+    mState.time_offset_ms = initial.time_offset * 1e3;
+}
+
+OnlineCalibration::~OnlineCalibration()
+{
+    Stop();
+}
+
+bool OnlineCalibration::Start()
+{
+    std::lock_guard<std::mutex> lock(mThreadMutex);
+    if (mRunning) {
+        return false;
+    }
+    mRunning = true;
+    mThread = std::thread(&OnlineCalibration::ThreadFunction, this);
+    return true;
+}
+
+void OnlineCalibration::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mThreadMutex);
+        mRunning = false;
+    }
+    mThreadCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void OnlineCalibration::AddCameraPose(double timestamp, const Sophus::SE3f& Tcw)
+{
+    std::lock_guard<std::mutex> lock(mPoseMutex);
+    mPendingPoses.push_back({timestamp, Tcw.so3().cast<double>().inverse()});
+}
+
+OnlineCalibration::Calibration OnlineCalibration::GetCalibration() const
+{
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    return mCalibration;
+}
+
+OnlineCalibration::State OnlineCalibration::GetState() const
+{
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    return mState;
+}
+
+void OnlineCalibration::ThreadFunction()
+{
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::CALIBRATION, "Online-Calib");
+
+    const auto period = std::chrono::duration<double>(std::max(0.01, mConfig.update_period_s));
+    std::unique_lock<std::mutex> lock(mThreadMutex);
+    while (mRunning) {
+        mThreadCondition.wait_for(lock, period, [this] { return !mRunning; });
+        if (!mRunning) {
+            break;
+        }
+        lock.unlock();
+        Update();
+        lock.lock();
+    }
+}
+
+Eigen::Vector3d OnlineCalibration::InterpolateGyro(double timestamp) const
+{
+    auto next = std::upper_bound(mGyro.begin(), mGyro.end(), timestamp, earlierThan);
+    if (next == mGyro.begin()) {
+        return mGyro.front().gyro.cast<double>();
+    }
+    if (next == mGyro.end()) {
+        return mGyro.back().gyro.cast<double>();
+    }
+    const GyroMeasurement& previous = *(next - 1);
+    const double alpha = (timestamp - previous.timestamp) / (next->timestamp - previous.timestamp);
+    return ((1.0 - alpha) * previous.gyro + alpha * next->gyro).cast<double>();
+}
+
+bool OnlineCalibration::IntegrateGyro(double start, double end, const Eigen::Vector3d& bias,
+                                      Sophus::SO3d& delta_R, Eigen::Matrix3d& JRg) const
+{
+    if (mGyro.empty() || start < mGyro.front().timestamp || end > mGyro.back().timestamp) {
+        return false;
+    }
+
+    // Piecewise between the samples and the interval ends, at the midpoint rate
+    delta_R = Sophus::SO3d();
+    JRg.setZero();
+    auto next = std::upper_bound(mGyro.begin(), mGyro.end(), start, earlierThan);
+    double t = start;
+    while (t < end) {
+        if (next != mGyro.end() && next != mGyro.begin() && next->timestamp - (next - 1)->timestamp > kMaxGyroGap) {
+            return false;
+        }
+        const double segment_end = next == mGyro.end() ? end : std::min(end, next->timestamp);
+        const double dt = segment_end - t;
+        if (dt > 0.0) {
+            const Eigen::Vector3d step = (InterpolateGyro(0.5 * (t + segment_end)) - bias) * dt;
+            const Sophus::SO3d increment = Sophus::SO3d::exp(step);
+            JRg = increment.inverse().matrix() * JRg - rightJacobian(step) * dt;
+            delta_R = delta_R * increment;
+        }
+        t = segment_end;
+        if (next != mGyro.end()) {
+            ++next;
+        }
+    }
+    return true;
+}
+
+bool OnlineCalibration::Update()
+{
+    std::lock_guard<std::mutex> update_lock(mUpdateMutex);
+
+    // Take the new samples, out-of-order ones would break the searches
+    mNewGyro.clear();
+    if (mSource) {
+        mSource(mNewGyro);
+    }
+    for (const GyroMeasurement& sample : mNewGyro) {
+        if (mGyro.empty() || sample.timestamp > mGyro.back().timestamp) {
+            mGyro.push_back(sample);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mPoseMutex);
+        for (const PoseSample& pose : mPendingPoses) {
+            if (mPoses.empty() || pose.timestamp > mPoses.back().timestamp) {
+                mPoses.push_back(pose);
+            }
+        }
+        mPendingPoses.clear();
+    }
+    if (mGyro.empty() || mPoses.empty()) {
+        return false;
+    }
+
+    // Slide the window
+    const double newest = std::max(mGyro.back().timestamp, mPoses.back().timestamp);
+    while (!mGyro.empty() && mGyro.front().timestamp < newest - mConfig.window_s) {
+        mGyro.pop_front();
+    }
+    while (!mPoses.empty() && mPoses.front().timestamp < newest - mConfig.window_s) {
+        mPoses.pop_front();
+    }
+    if (mGyro.size() < 2) {
+        return false;
+    }
+
+    // Chain of pose intervals, each covered by the gyro at any plausible offset
+    const double max_offset = mConfig.max_time_offset_ms * 1e-3;
+    const double gyro_start = mGyro.front().timestamp + max_offset;
+    const double gyro_end = mGyro.back().timestamp - max_offset;
+    std::vector<std::pair<size_t, size_t>> intervals;
+    size_t first = 0;
+    for (size_t i = 1; i < mPoses.size(); ++i) {
+        const double dt = mPoses[i].timestamp - mPoses[first].timestamp;
+        if (dt < mConfig.min_interval_s) {
+            continue;
+        }
+        if (dt <= mConfig.max_interval_s && mPoses[first].timestamp >= gyro_start && mPoses[i].timestamp <= gyro_end) {
+            intervals.emplace_back(first, i);
+        }
+        first = i;
+    }
+
+    const int count = static_cast<int>(intervals.size());
+    if (count < mConfig.min_intervals) {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mState.intervals = count;
+        return false;
+    }
+
+    const Calibration applied = GetCalibration();
+    const Sophus::SO3d applied_Rbc = applied.T_bc.so3().cast<double>();
+    Sophus::SO3d Rbc = applied_Rbc;
+    double time_offset = 0.0;
+    Eigen::Vector3d bias = Eigen::Vector3d::Zero();
+    const double huber = mConfig.huber_threshold_deg * kDegToRad;
+
+    Matrix7d H;
+    Vector7d g;
+    double weighted_squares = 0.0;
+    int residuals = 0;
+    auto linearize = [&]() {
+        H.setZero();
+        g.setZero();
+        weighted_squares = 0.0;
+        residuals = 0;
+        for (const auto& interval : intervals) {
+            const PoseSample& pose_i = mPoses[interval.first];
+            const PoseSample& pose_j = mPoses[interval.second];
+            Sophus::SO3d delta_R;
+            Eigen::Matrix3d JRg;
+            if (!IntegrateGyro(pose_i.timestamp + time_offset, pose_j.timestamp + time_offset, bias, delta_R, JRg)) {
+                continue;
+            }
+            const Eigen::Vector3d w_i = InterpolateGyro(pose_i.timestamp + time_offset) - bias;
+            const Eigen::Vector3d w_j = InterpolateGyro(pose_j.timestamp + time_offset) - bias;
+
+            // Tracked relative rotation in the body frame against the integrated one
+            const Sophus::SO3d A = Rbc * (pose_i.Rwc.inverse() * pose_j.Rwc) * Rbc.inverse();
+            const Sophus::SO3d E = delta_R.inverse() * A;
+            const Eigen::Vector3d r = E.log();
+            const Eigen::Matrix3d Jl_inv = inverseLeftJacobian(r);
+            const Eigen::Matrix3d delta_Rt = delta_R.inverse().matrix();
+
+            // Rotation perturbed on the left, offset shifting both ends, bias through JRg
+            Matrix37d J;
+            J.block<3, 3>(0, 0) = Jl_inv * (delta_Rt - E.matrix());
+            J.col(3) = Jl_inv * (delta_Rt * w_i - w_j);
+            J.block<3, 3>(0, 4) = -Jl_inv * JRg;
+
+            const double norm = r.norm();
+            const double weight = norm <= huber ? 1.0 : huber / norm;
+            H += weight * J.transpose() * J;
+            g += weight * J.transpose() * r;
+            weighted_squares += weight * r.squaredNorm();
+            ++residuals;
+        }
+        H.diagonal().array() += kDamping;
+    };
+
+    for (int iteration = 0; iteration < mConfig.max_iterations; ++iteration) {
+        linearize();
+        const Vector7d dx = -H.ldlt().solve(g);
+        if (!dx.allFinite()) {
+            return false;
+        }
+        Rbc = Sophus::SO3d::exp(dx.head<3>()) * Rbc;
+        time_offset += dx(3);
+        bias += dx.tail<3>();
+        if (dx.squaredNorm() < kConvergedStep * kConvergedStep) {
+            break;
+        }
+    }
+    linearize();
+    if (residuals < mConfig.min_intervals) {
+        return false;
+    }
+
+    // Covariance from the residual scatter, change against it
+    const double variance = weighted_squares / std::max(1, 3 * residuals - kNumParameters);
+    const Matrix7d covariance = variance * H.ldlt().solve(Matrix7d::Identity());
+    Eigen::Matrix<double, 4, 1> change;
+    change.head<3>() = (Rbc * applied_Rbc.inverse()).log();
+    change(3) = time_offset;
+    const Eigen::Matrix4d change_covariance = covariance.topLeftCorner<4, 4>();
+    const double chi2 = change.dot(change_covariance.ldlt().solve(change));
+    const double rotation_sigma = std::sqrt(covariance.diagonal().head<3>().maxCoeff());
+    const double time_offset_sigma = std::sqrt(covariance(3, 3));
+
+    const bool significant = std::isfinite(chi2) && chi2 > mConfig.significance_chi2 &&
+                             rotation_sigma <= mConfig.max_rotation_sigma_deg * kDegToRad &&
+                             time_offset_sigma <= mConfig.max_time_offset_sigma_ms * 1e-3 &&
+                             std::abs(time_offset) <= max_offset;
+
+    Calibration calibration = applied;
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mState.time_offset_sigma_ms = time_offset_sigma * 1e3;
+        mState.rotation_sigma_deg = rotation_sigma / kDegToRad;
+        mState.residual_rms_deg = std::sqrt(weighted_squares / (3 * residuals)) / kDegToRad;
+        mState.chi2 = chi2;
+        mState.intervals = residuals;
+        if (significant) {
+            calibration.T_bc = Sophus::SE3f(Rbc.cast<float>(), applied.T_bc.translation());
+            calibration.time_offset = applied.time_offset + time_offset;
+            mCalibration = calibration;
+            mState.time_offset_ms = calibration.time_offset * 1e3;
+            mState.rotation_change_deg = (Rbc * mInitialRbc.inverse()).log().norm() / kDegToRad;
+            mState.updates++;
+        }
+    }
+    if (!significant) {
+        return false;
+    }
+
+    // The samples so far are stamped with the old offset, so are those the
+    // source still holds from before the calibration was applied
+    mGyro.clear();
+    mPoses.clear();
+    if (mApply) {
+        mApply(calibration);
+    }
+    if (mSource) {
+        mSource(mNewGyro);
+        mNewGyro.clear();
+    }
+    return true;
+}
+
+} // namespace ORB_SLAM3
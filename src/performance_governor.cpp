@@ -0,0 +1,230 @@
+#include "include/performance_governor.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+constexpr size_t kNumKnobs = static_cast<size_t>(PerformanceGovernor::Knob::COUNT);
+typedef PerformanceGovernor::Knob Knob;
+
+// Degradation order per slowest stage: the first knob relieves that stage the most
+const Knob kTrackingOrder[kNumKnobs] = {
+    Knob::LOCAL_MAP_KEYFRAMES, Knob::FEATURE_TARGET, Knob::LOCAL_BA_KEYFRAMES, Knob::FRAME_DECIMATION};
+const Knob kExtractionOrder[kNumKnobs] = {
+    Knob::FEATURE_TARGET, Knob::FRAME_DECIMATION, Knob::LOCAL_BA_KEYFRAMES, Knob::LOCAL_MAP_KEYFRAMES};
+const Knob kBacklogOrder[kNumKnobs] = {
+    Knob::FRAME_DECIMATION, Knob::FEATURE_TARGET, Knob::LOCAL_BA_KEYFRAMES, Knob::LOCAL_MAP_KEYFRAMES};
+const Knob kDefaultOrder[kNumKnobs] = {
+    Knob::FEATURE_TARGET, Knob::LOCAL_MAP_KEYFRAMES, Knob::LOCAL_BA_KEYFRAMES, Knob::FRAME_DECIMATION};
+
+const Knob* degradeOrder(LatencyStage slowest_stage)
+{
+    switch (slowest_stage) {
+        case LatencyStage::TRACK_DONE:
+            return kTrackingOrder;
+        case LatencyStage::TPU_DONE:
+            return kExtractionOrder;
+        case LatencyStage::DQBUF:
+        case LatencyStage::TPU_SUBMIT:
+            // Frames wait before extraction, the pipeline cannot keep up with the frame rate
+            return kBacklogOrder;
+        default:
+            return kDefaultOrder;
+    }
+}
+
+// Frame decimation grows as quality drops, every other knob shrinks
+bool lowerIsWorse(Knob knob)
+{
+    return knob != Knob::FRAME_DECIMATION;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// PerformanceGovernor::Settings
+//------------------------------------------------------------------------------
+
+int PerformanceGovernor::Settings::Get(Knob knob) const
+{
+    switch (knob) {
+        case Knob::FEATURE_TARGET: return feature_target;
+        case Knob::LOCAL_MAP_KEYFRAMES: return local_map_keyframes;
+        case Knob::LOCAL_BA_KEYFRAMES: return local_ba_keyframes;
+        case Knob::FRAME_DECIMATION: return frame_decimation;
+        default: return 0;
+    }
+}
+
+void PerformanceGovernor::Settings::Set(Knob knob, int value)
+{
+    switch (knob) {
+        case Knob::FEATURE_TARGET: feature_target = value; break;
+        case Knob::LOCAL_MAP_KEYFRAMES: local_map_keyframes = value; break;
+        case Knob::LOCAL_BA_KEYFRAMES: local_ba_keyframes = value; break;
+        case Knob::FRAME_DECIMATION: frame_decimation = value; break;
+        default: break;
+    }
+}
+
+//------------------------------------------------------------------------------
+// PerformanceGovernor
+//------------------------------------------------------------------------------
+
+PerformanceGovernor::PerformanceGovernor(const Config& config)
+    : mConfig(config), mSettings(config.max_settings), mDecisionCount(0),
+      mWindowFrames(0), mWindowIndex(0), mRecoveryWindows(0)
+{
+    mConfig.evaluation_frames = std::max(1, mConfig.evaluation_frames);
+    mConfig.recovery_windows = std::max(1, mConfig.recovery_windows);
+
+    if (!mConfig.log_path.empty()) {
+        mLog.reset(new std::ofstream(mConfig.log_path, std::ios::app));
+        if (!mLog->is_open()) {
+            std::cerr << "Failed to open governor log " << mConfig.log_path << std::endl;
+            mLog.reset();
+        } else if (mLog->tellp() == 0) {
+            *mLog << "time,window,knob,old_value,new_value,p99_ms,slowest_stage" << std::endl;
+        }
+    }
+}
+
+bool PerformanceGovernor::AddFrame(const LatencyStamps& stamps)
+{
+    if (!stamps.Has(LatencyStage::EXPOSURE_MID) || !stamps.Has(LatencyStage::POSE_PUBLISHED)) {
+        return false;
+    }
+
+    mWindow.Record(stamps);
+    if (++mWindowFrames < mConfig.evaluation_frames) {
+        return false;
+    }
+
+    const bool changed = Evaluate();
+    mWindow.Reset();
+    mWindowFrames = 0;
+    mWindowIndex++;
+    return changed;
+}
+
+const PerformanceGovernor::Settings& PerformanceGovernor::GetSettings() const
+{
+    return mSettings;
+}
+
+const PerformanceGovernor::Decision& PerformanceGovernor::GetLastDecision() const
+{
+    return mLastDecision;
+}
+
+uint64_t PerformanceGovernor::GetDecisionCount() const
+{
+    return mDecisionCount;
+}
+
+const char* PerformanceGovernor::GetKnobName(Knob knob)
+{
+    switch (knob) {
+        case Knob::FEATURE_TARGET: return "feature_target";
+        case Knob::LOCAL_MAP_KEYFRAMES: return "local_map_keyframes";
+        case Knob::LOCAL_BA_KEYFRAMES: return "local_ba_keyframes";
+        case Knob::FRAME_DECIMATION: return "frame_decimation";
+        default: return "unknown";
+    }
+}
+
+bool PerformanceGovernor::Evaluate()
+{
+    const double p99_ms = mWindow.GetEndToEndPercentiles().p99_ms;
+
+    LatencyStage slowest_stage = LatencyStage::COUNT;
+    double slowest_ms = -1.0;
+    for (size_t i = 1; i < kNumLatencyStages; ++i) {
+        const LatencyStage stage = static_cast<LatencyStage>(i);
+        const LatencyPercentiles percentiles = mWindow.GetStagePercentiles(stage);
+        if (percentiles.count > 0 && percentiles.p99_ms > slowest_ms) {
+            slowest_ms = percentiles.p99_ms;
+            slowest_stage = stage;
+        }
+    }
+
+    if (p99_ms > mConfig.latency_budget_ms) {
+        mRecoveryWindows = 0;
+        return Degrade(p99_ms, slowest_stage);
+    }
+
+    if (p99_ms < mConfig.recovery_ratio * mConfig.latency_budget_ms) {
+        if (++mRecoveryWindows >= mConfig.recovery_windows) {
+            mRecoveryWindows = 0;
+            return Restore(p99_ms, slowest_stage);
+        }
+    } else {
+        mRecoveryWindows = 0;
+    }
+    return false;
+}
+
+bool PerformanceGovernor::Degrade(double p99_ms, LatencyStage slowest_stage)
+{
+    const Knob* order = degradeOrder(slowest_stage);
+    for (size_t i = 0; i < kNumKnobs; ++i) {
+        const Knob knob = order[i];
+        const int value = mSettings.Get(knob);
+        const int step = mConfig.step.Get(knob);
+        const int limit = mConfig.min_settings.Get(knob);
+
+        const int degraded = lowerIsWorse(knob) ? std::max(limit, value - step) : std::min(limit, value + step);
+        if (degraded != value) {
+            mDegraded.push_back(knob);
+            return Apply(knob, degraded, p99_ms, slowest_stage);
+        }
+    }
+
+    // Every knob is at its lowest quality already
+    return false;
+}
+
+bool PerformanceGovernor::Restore(double p99_ms, LatencyStage slowest_stage)
+{
+    if (mDegraded.empty()) {
+        return false;
+    }
+
+    const Knob knob = mDegraded.back();
+    mDegraded.pop_back();
+
+    const int value = mSettings.Get(knob);
+    const int step = mConfig.step.Get(knob);
+    const int limit = mConfig.max_settings.Get(knob);
+    const int restored = lowerIsWorse(knob) ? std::min(limit, value + step) : std::max(limit, value - step);
+    return Apply(knob, restored, p99_ms, slowest_stage);
+}
+
+bool PerformanceGovernor::Apply(Knob knob, int value, double p99_ms, LatencyStage slowest_stage)
+{
+    Decision decision;
+    decision.time = LatencyNowSeconds();
+    decision.window = mWindowIndex;
+    decision.knob = knob;
+    decision.old_value = mSettings.Get(knob);
+    decision.new_value = value;
+    decision.p99_ms = p99_ms;
+    decision.slowest_stage = slowest_stage;
+
+    mSettings.Set(knob, value);
+    mLastDecision = decision;
+    mDecisionCount++;
+
+    if (mLog) {
+        *mLog << decision.time << ',' << decision.window << ',' << GetKnobName(knob) << ','
+              << decision.old_value << ',' << decision.new_value << ',' << decision.p99_ms << ','
+              << (slowest_stage == LatencyStage::COUNT ? "none" : GetLatencyStageName(slowest_stage))
+              << std::endl;
+    }
+    return true;
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,586 @@
+#include "include/pipeline_simulator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <regex>
+#include <sstream>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+const char* const kSimulatedStageNames[kNumSimulatedStages] = {
+    "readout",
+    "acquisition",
+    "extraction",
+    "tracking",
+    "publish",
+    "mapping"
+};
+
+// Offset of the simulated clock, LatencyStamps treat 0 as not stamped
+constexpr double kStartTime = 1.0;
+
+void splitCsv(const std::string& line, std::vector<std::string>& fields)
+{
+    fields.clear();
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, ',')) {
+        fields.push_back(field);
+    }
+}
+
+// Positive sample of a CSV field, false for an empty or unstamped field
+bool parseTime(const std::vector<std::string>& fields, int column, double& value)
+{
+    if (column < 0 || column >= static_cast<int>(fields.size()) || fields[column].empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    value = std::strtod(fields[column].c_str(), &end);
+    return end != fields[column].c_str() && std::isfinite(value) && value > 0.0;
+}
+
+// Stage, queue and drop counters of one simulated stage thread
+struct Server {
+    std::deque<size_t> queue;                 // Frame sets waiting, oldest first
+    size_t depth = 1;
+    PipelineDropPolicy policy = PipelineDropPolicy::KEEP_LATEST;
+    bool busy = false;
+    bool holding = false;                     // Done but blocked on the next queue
+    size_t held = 0;
+    uint64_t dropped = 0;
+    double busy_s = 0.0;
+};
+
+enum EventType {
+    EXPOSED,
+    READ_OUT,
+    ACQUIRED,
+    EXTRACTED,
+    TRACKED,
+    MAPPED
+};
+
+struct Event {
+    double time;
+    uint64_t sequence;                        // Keeps simultaneous events in insertion order
+    EventType type;
+    size_t frame;
+
+    bool operator>(const Event& other) const
+    {
+        return time > other.time || (time == other.time && sequence > other.sequence);
+    }
+};
+
+struct FrameState {
+    LatencyStamps stamps;
+};
+
+} // namespace
+
+const char* GetSimulatedStageName(SimulatedStage stage)
+{
+    const size_t index = static_cast<size_t>(stage);
+    return index < kNumSimulatedStages ? kSimulatedStageNames[index] : "unknown";
+}
+
+//------------------------------------------------------------------------------
+// StageTimings
+//------------------------------------------------------------------------------
+
+StageTimings::StageTimings()
+    : mTracedFrameSets(0), mTracedKeyFrames(0), mKeyFrameRatio(-1.0), mRecordedCameras(0), mRecordedUnits(1)
+{
+}
+
+bool StageTimings::LoadFlightRecorderDump(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        mLastErrorMessage = "Cannot open " + path;
+        return false;
+    }
+
+    // Columns by name, the stage columns follow the latency stages of the build
+    std::string line;
+    std::vector<std::string> fields;
+    std::map<std::string, int> columns;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        splitCsv(line, fields);
+        for (size_t i = 0; i < fields.size(); ++i) {
+            columns[fields[i]] = static_cast<int>(i);
+        }
+        break;
+    }
+    auto column = [&](const std::string& name) {
+        auto it = columns.find(name);
+        return it != columns.end() ? it->second : -1;
+    };
+
+    const std::array<int, kNumSimulatedStages> stage_columns = {
+        column(std::string(GetLatencyStageName(LatencyStage::DQBUF)) + "_ms"),
+        column("acquisition_ms"),
+        column("feature_ms"),
+        column("tracking_ms"),
+        column(std::string(GetLatencyStageName(LatencyStage::POSE_PUBLISHED)) + "_ms"),
+        -1
+    };
+    const int timestamp_column = column("timestamp");
+    if (std::all_of(stage_columns.begin(), stage_columns.end(), [](int c) { return c < 0; })) {
+        mLastErrorMessage = "No stage columns in " + path;
+        return false;
+    }
+
+    double last_timestamp = 0.0;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        splitCsv(line, fields);
+        for (size_t s = 0; s < kNumSimulatedStages; ++s) {
+            double time_ms;
+            if (parseTime(fields, stage_columns[s], time_ms)) {
+                mSamples[s].push_back(time_ms);
+            }
+        }
+        double timestamp;
+        if (parseTime(fields, timestamp_column, timestamp)) {
+            if (last_timestamp > 0.0 && timestamp > last_timestamp) {
+                mFramePeriods.push_back(timestamp - last_timestamp);
+            }
+            last_timestamp = timestamp;
+        }
+    }
+    return true;
+}
+
+bool StageTimings::LoadTrace(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        mLastErrorMessage = "Cannot open " + path;
+        return false;
+    }
+
+    // One event per line, spans are B/E pairs nested per thread
+    static const std::regex event("\"tid\":(\\d+),\"ts\":([0-9.]+),\"ph\":\"([BE])\"(?:,\"name\":\"([^\"]*)\")?");
+    std::map<uint64_t, std::vector<std::pair<std::string, double>>> open_spans;
+    const bool has_extraction = !mSamples[static_cast<size_t>(SimulatedStage::EXTRACTION)].empty();
+    const bool has_tracking = !mSamples[static_cast<size_t>(SimulatedStage::TRACKING)].empty();
+    uint64_t spans = 0;
+    std::string line;
+    std::smatch match;
+    while (std::getline(file, line)) {
+        if (!std::regex_search(line, match, event)) {
+            continue;
+        }
+        std::vector<std::pair<std::string, double>>& stack = open_spans[std::stoull(match[1].str())];
+        const double ts_us = std::stod(match[2].str());
+        if (match[3].str() == "B") {
+            stack.emplace_back(match[4].str(), ts_us);
+            continue;
+        }
+        if (stack.empty()) {
+            continue;
+        }
+        const std::string name = stack.back().first;
+        const double time_ms = (ts_us - stack.back().second) / 1000.0;
+        stack.pop_back();
+
+        // Spans of a dump loaded before are not counted twice
+        if (name == "LocalMapping") {
+            mSamples[static_cast<size_t>(SimulatedStage::MAPPING)].push_back(time_ms);
+            mTracedKeyFrames++;
+            spans++;
+        } else if (name == "TrackFrameSet") {
+            if (!has_tracking) {
+                mSamples[static_cast<size_t>(SimulatedStage::TRACKING)].push_back(time_ms);
+            }
+            mTracedFrameSets++;
+            spans++;
+        } else if (name == "ExtractFrameSet" && !has_extraction) {
+            mSamples[static_cast<size_t>(SimulatedStage::EXTRACTION)].push_back(time_ms);
+            spans++;
+        }
+    }
+    if (spans == 0) {
+        mLastErrorMessage = "No pipeline spans in " + path;
+        return false;
+    }
+    return true;
+}
+
+void StageTimings::Add(SimulatedStage stage, double time_ms)
+{
+    if (stage != SimulatedStage::COUNT && time_ms >= 0.0) {
+        mSamples[static_cast<size_t>(stage)].push_back(time_ms);
+    }
+}
+
+void StageTimings::SetKeyFrameRatio(double ratio)
+{
+    mKeyFrameRatio = std::min(std::max(ratio, 0.0), 1.0);
+}
+
+void StageTimings::SetRecordedExtraction(int cameras, int units)
+{
+    mRecordedCameras = std::max(cameras, 1);
+    mRecordedUnits = std::max(units, 1);
+}
+
+const std::vector<double>& StageTimings::GetSamples(SimulatedStage stage) const
+{
+    return mSamples[std::min(static_cast<size_t>(stage), kNumSimulatedStages - 1)];
+}
+
+double StageTimings::Draw(SimulatedStage stage, std::mt19937& rng) const
+{
+    const std::vector<double>& samples = GetSamples(stage);
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::uniform_int_distribution<size_t> index(0, samples.size() - 1);
+    return samples[index(rng)];
+}
+
+double StageTimings::GetKeyFrameRatio() const
+{
+    if (mKeyFrameRatio >= 0.0) {
+        return mKeyFrameRatio;
+    }
+    return mTracedFrameSets > 0 ? std::min(1.0, static_cast<double>(mTracedKeyFrames) / mTracedFrameSets) : 0.0;
+}
+
+double StageTimings::GetFrameRateHz() const
+{
+    if (mFramePeriods.empty()) {
+        return 0.0;
+    }
+    // Median period, dropped frame sets show up as multiples
+    std::vector<double> periods = mFramePeriods;
+    std::nth_element(periods.begin(), periods.begin() + periods.size() / 2, periods.end());
+    return 1.0 / periods[periods.size() / 2];
+}
+
+int StageTimings::GetRecordedCameras() const
+{
+    return mRecordedCameras;
+}
+
+int StageTimings::GetRecordedUnits() const
+{
+    return mRecordedUnits;
+}
+
+std::string StageTimings::GetLastErrorMessage() const
+{
+    return mLastErrorMessage;
+}
+
+//------------------------------------------------------------------------------
+// PipelineSimulator
+//------------------------------------------------------------------------------
+
+PipelineSimulator::PipelineSimulator(const StageTimings& timings)
+    : mTimings(timings)
+{
+}
+
+double PipelineSimulator::ExtractionTime(const Config& config, std::mt19937& rng) const
+{
+    // Time of one camera on a reference unit, the recorded set was spread over the recorded units
+    const int recorded_cameras = mTimings.GetRecordedCameras() > 0 ? mTimings.GetRecordedCameras()
+                                                                   : std::max(config.cameras, 1);
+    const double camera_ms = mTimings.Draw(SimulatedStage::EXTRACTION, rng) *
+                             mTimings.GetRecordedUnits() / recorded_cameras;
+    if (config.extraction_units.empty()) {
+        return camera_ms * config.cameras;
+    }
+
+    auto unitTime = [&](const ExtractionUnit& unit, int frames) {
+        if (frames == 0) {
+            return 0.0;
+        }
+        const int batch = std::max(unit.batch_size, 1);
+        const int invocations = (frames + batch - 1) / batch;
+        const double frame_ms = std::max(camera_ms / std::max(unit.speed, 1e-6) - unit.invoke_overhead_ms, 0.0);
+        return invocations * unit.invoke_overhead_ms + frames * frame_ms;
+    };
+
+    // Every camera goes to the unit that would finish it first, the set is done with the slowest unit
+    std::vector<int> frames(config.extraction_units.size(), 0);
+    for (int c = 0; c < config.cameras; ++c) {
+        size_t best = 0;
+        double best_ms = 0.0;
+        for (size_t u = 0; u < frames.size(); ++u) {
+            const double ms = unitTime(config.extraction_units[u], frames[u] + 1);
+            if (u == 0 || ms < best_ms) {
+                best = u;
+                best_ms = ms;
+            }
+        }
+        frames[best]++;
+    }
+    double set_ms = 0.0;
+    for (size_t u = 0; u < frames.size(); ++u) {
+        set_ms = std::max(set_ms, unitTime(config.extraction_units[u], frames[u]));
+    }
+    return set_ms;
+}
+
+PipelineSimulator::Result PipelineSimulator::Run(const Config& config) const
+{
+    Result result;
+    std::mt19937 rng(config.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double keyframe_ratio = mTimings.GetKeyFrameRatio();
+
+    // Stage threads, each fed by the queue in front of it
+    enum { ACQUISITION = 0, EXTRACTION, TRACKING, MAPPING, NUM_SERVERS };
+    std::array<Server, NUM_SERVERS> servers;
+    servers[ACQUISITION].depth = std::max(config.camera_buffers, 1);
+    servers[ACQUISITION].policy = PipelineDropPolicy::BLOCK;
+    servers[EXTRACTION].depth = std::max(config.extraction_queue.depth, 1);
+    servers[EXTRACTION].policy = config.extraction_queue.policy;
+    servers[TRACKING].depth = std::max(config.tracking_queue.depth, 1);
+    servers[TRACKING].policy = config.tracking_queue.policy;
+    servers[MAPPING].depth = std::max(config.mapping_queue_depth, 1);
+    servers[MAPPING].policy = PipelineDropPolicy::BLOCK;
+
+    const double camera_period = 1.0 / std::max(config.camera_rate_hz, 1e-3);
+    const double end_time = kStartTime + config.duration_s;
+    const int decimation = std::max(config.frame_decimation, 1);
+
+    std::vector<FrameState> frames;
+    frames.reserve(static_cast<size_t>(config.duration_s / camera_period) + 1);
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    uint64_t sequence = 0;
+    auto schedule = [&](double time, EventType type, size_t frame) {
+        events.push(Event{time, sequence++, type, frame});
+    };
+
+    std::vector<size_t> published;             // Tracked frame sets in publish order
+    LatencyTracker tracker;
+
+    // Service time of a frame set on a stage thread
+    auto serviceTime = [&](int server) {
+        switch (server) {
+            case ACQUISITION:
+                return mTimings.Draw(SimulatedStage::ACQUISITION, rng) / config.acquisition_speed;
+            case EXTRACTION:
+                return ExtractionTime(config, rng);
+            case TRACKING: {
+                const double slowdown = servers[MAPPING].busy ? 1.0 + config.mapping_contention : 1.0;
+                return mTimings.Draw(SimulatedStage::TRACKING, rng) * slowdown / config.tracking_speed;
+            }
+            default:
+                return mTimings.Draw(SimulatedStage::MAPPING, rng) / config.mapping_speed;
+        }
+    };
+    const EventType done_events[NUM_SERVERS] = {ACQUIRED, EXTRACTED, TRACKED, MAPPED};
+
+    // Starts the next frame set of a free stage; taking it makes room for a blocked producer
+    std::function<void(int, double)> start = [&](int server, double now) {
+        Server& stage = servers[server];
+        if (stage.busy || stage.holding || stage.queue.empty()) {
+            return;
+        }
+        if (stage.policy == PipelineDropPolicy::KEEP_LATEST) {
+            stage.dropped += stage.queue.size() - 1;
+            stage.queue.erase(stage.queue.begin(), stage.queue.end() - 1);
+        }
+        const size_t frame = stage.queue.front();
+        stage.queue.pop_front();
+        stage.busy = true;
+
+        double service_ms = serviceTime(server);
+        if (server == EXTRACTION) {
+            frames[frame].stamps.Set(LatencyStage::TPU_SUBMIT, now);
+        } else if (server == TRACKING) {
+            // The tracking thread publishes the pose before it takes the next frame set
+            frames[frame].stamps.Set(LatencyStage::TRACK_DONE, now + service_ms * 1e-3);
+            service_ms += mTimings.Draw(SimulatedStage::PUBLISH, rng) / config.tracking_speed;
+        }
+        stage.busy_s += service_ms * 1e-3;
+        schedule(now + service_ms * 1e-3, done_events[server], frame);
+
+        if (server > ACQUISITION && server < MAPPING && servers[server - 1].holding) {
+            Server& producer = servers[server - 1];
+            producer.holding = false;
+            stage.queue.push_back(producer.held);
+            start(server - 1, now);
+        }
+    };
+
+    // Hands a finished frame set to the next stage, or drops it, or blocks on it
+    auto finish = [&](int server, size_t frame, double now) {
+        Server& stage = servers[server];
+        stage.busy = false;
+        if (server + 1 < MAPPING) {
+            Server& next = servers[server + 1];
+            if (next.queue.size() < next.depth) {
+                next.queue.push_back(frame);
+            } else if (next.policy == PipelineDropPolicy::BLOCK) {
+                stage.holding = true;
+                stage.held = frame;
+            } else {
+                next.dropped++;
+            }
+            start(server + 1, now);
+        }
+        start(server, now);
+    };
+
+    for (size_t i = 0; kStartTime + i * camera_period < end_time; ++i) {
+        schedule(kStartTime + i * camera_period, EXPOSED, i);
+    }
+
+    while (!events.empty()) {
+        const Event event = events.top();
+        events.pop();
+        const double now = event.time;
+
+        switch (event.type) {
+            case EXPOSED: {
+                frames.emplace_back();
+                frames[event.frame].stamps.Set(LatencyStage::EXPOSURE_MID, now);
+                result.frame_sets++;
+                if (event.frame % decimation != 0) {
+                    result.decimated++;
+                    break;
+                }
+                schedule(now + mTimings.Draw(SimulatedStage::READOUT, rng) * 1e-3, READ_OUT, event.frame);
+                break;
+            }
+            case READ_OUT: {
+                // The sensor cannot wait, without a free buffer the frame set is lost
+                Server& acquisition = servers[ACQUISITION];
+                frames[event.frame].stamps.Set(LatencyStage::DQBUF, now);
+                if (acquisition.queue.size() < acquisition.depth) {
+                    acquisition.queue.push_back(event.frame);
+                    start(ACQUISITION, now);
+                } else {
+                    result.dropped_readout++;
+                }
+                break;
+            }
+            case ACQUIRED:
+                finish(ACQUISITION, event.frame, now);
+                break;
+            case EXTRACTED:
+                frames[event.frame].stamps.Set(LatencyStage::TPU_DONE, now);
+                finish(EXTRACTION, event.frame, now);
+                break;
+            case TRACKED: {
+                FrameState& frame = frames[event.frame];
+                frame.stamps.Set(LatencyStage::POSE_PUBLISHED, now);
+                tracker.Record(frame.stamps);
+                published.push_back(event.frame);
+                result.tracked++;
+
+                // A keyframe is only inserted if local mapping accepts it
+                if (uniform(rng) < keyframe_ratio) {
+                    Server& mapping = servers[MAPPING];
+                    if (mapping.queue.size() < mapping.depth) {
+                        mapping.queue.push_back(event.frame);
+                        start(MAPPING, now);
+                    } else {
+                        result.keyframes_skipped++;
+                    }
+                }
+                finish(TRACKING, event.frame, now);
+                break;
+            }
+            case MAPPED:
+                result.keyframes++;
+                finish(MAPPING, event.frame, now);
+                break;
+        }
+    }
+
+    result.dropped_extraction = servers[EXTRACTION].dropped;
+    result.dropped_tracking = servers[TRACKING].dropped;
+    result.throughput_fps = config.duration_s > 0.0 ? result.tracked / config.duration_s : 0.0;
+    for (size_t s = 0; s < kNumLatencyStages; ++s) {
+        result.stage_latency[s] = tracker.GetStagePercentiles(static_cast<LatencyStage>(s));
+    }
+    result.end_to_end = tracker.GetEndToEndPercentiles();
+
+    const double duration = std::max(config.duration_s, 1e-9);
+    result.utilization[static_cast<size_t>(SimulatedStage::ACQUISITION)] = servers[ACQUISITION].busy_s / duration;
+    result.utilization[static_cast<size_t>(SimulatedStage::EXTRACTION)] = servers[EXTRACTION].busy_s / duration;
+    result.utilization[static_cast<size_t>(SimulatedStage::TRACKING)] = servers[TRACKING].busy_s / duration;
+    result.utilization[static_cast<size_t>(SimulatedStage::MAPPING)] = servers[MAPPING].busy_s / duration;
+
+    // Every scanout shows the newest pose published before its latch, propagated with the
+    // newest IMU sample available at the latch
+    LatencyHistogram pose_age;
+    LatencyHistogram motion_to_photon;
+    const double display_period = 1.0 / std::max(config.display_rate_hz, 1e-3);
+    const double imu_period = 1.0 / std::max(config.imu_rate_hz, 1e-3);
+    size_t next = 0;
+    for (double scanout = kStartTime + config.display_phase_ms * 1e-3; scanout < end_time; scanout += display_period) {
+        const double latch = scanout - config.latch_to_photon_ms * 1e-3;
+        while (next < published.size() &&
+               frames[published[next]].stamps.Get(LatencyStage::POSE_PUBLISHED) <= latch) {
+            next++;
+        }
+        if (next > 0) {
+            pose_age.Record((scanout - frames[published[next - 1]].stamps.Get(LatencyStage::EXPOSURE_MID)) * 1000.0);
+        }
+        const double sample = std::floor((latch - config.imu_latency_ms * 1e-3) / imu_period) * imu_period;
+        motion_to_photon.Record((scanout - sample) * 1000.0);
+    }
+    result.pose_age_at_scanout = pose_age.GetPercentiles();
+    result.motion_to_photon = motion_to_photon.GetPercentiles();
+    return result;
+}
+
+size_t PipelineSimulator::SelectConfiguration(const std::vector<Config>& candidates, double latency_budget_ms,
+                                              std::vector<Result>* results) const
+{
+    std::vector<Result> local;
+    std::vector<Result>& simulated = results ? *results : local;
+    simulated.clear();
+    simulated.reserve(candidates.size());
+    for (const Config& candidate : candidates) {
+        simulated.push_back(Run(candidate));
+    }
+
+    size_t best = candidates.size();
+    for (size_t i = 0; i < simulated.size(); ++i) {
+        if (best == candidates.size()) {
+            best = i;
+            continue;
+        }
+        const Result& a = simulated[i];
+        const Result& b = simulated[best];
+        const bool a_within = a.end_to_end.p99_ms <= latency_budget_ms;
+        const bool b_within = b.end_to_end.p99_ms <= latency_budget_ms;
+        if (a_within != b_within) {
+            if (a_within) {
+                best = i;
+            }
+        } else if (a_within && a.throughput_fps != b.throughput_fps) {
+            if (a.throughput_fps > b.throughput_fps) {
+                best = i;
+            }
+        } else if (a.end_to_end.p99_ms < b.end_to_end.p99_ms) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+} // namespace ORB_SLAM3
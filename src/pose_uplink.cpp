@@ -0,0 +1,640 @@
+#include "include/pose_uplink.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+constexpr size_t kEthernetHeaderBytes = 14;
+constexpr size_t kIpHeaderBytes = 20;
+constexpr size_t kUdpHeaderBytes = 8;
+constexpr size_t kPayloadOffset = kEthernetHeaderBytes + kIpHeaderBytes + kUdpHeaderBytes;
+
+// TX ring frame, the tpacket2_hdr and one pose frame
+constexpr size_t kRingFrameSize = 256;
+static_assert(TPACKET2_HDRLEN - sizeof(struct sockaddr_ll) + kPoseUplinkFrameBytes <= kRingFrameSize,
+              "Pose uplink frame does not fit a TX ring frame");
+
+// Sent datagrams remembered for matching the driver hand-off stamps
+constexpr size_t kSendTimeSlots = 256;
+
+// 802.1d priority 6 (voice) for mac80211, 256 + n selects priority n directly
+constexpr int kRingPriority = 256 + 6;
+constexpr int kSocketPriority = 6;
+
+// Wait between attempts to map a pose region that does not exist yet
+constexpr int kPoseRetryMs = 100;
+
+double MonotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Software timestamps of the error queue are on CLOCK_REALTIME
+int64_t RealtimeNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool ResolveAddress(const std::string& host, int port, struct sockaddr_in& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    return inet_pton(AF_INET, host.c_str(), &address.sin_addr) == 1;
+}
+
+void WriteBigEndian16(uint8_t* p, uint32_t value)
+{
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+// Ones' complement sum of big-endian 16-bit words
+uint32_t ChecksumAdd(uint32_t sum, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        sum += (static_cast<uint32_t>(data[i]) << 8) | data[i + 1];
+    }
+    if (size & 1) {
+        sum += static_cast<uint32_t>(data[size - 1]) << 8;
+    }
+    return sum;
+}
+
+uint16_t ChecksumFold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
+
+// Gateway of the most specific route to destination on the interface, or destination itself if on-link
+bool FindNextHop(const std::string& interface, uint32_t destination, uint32_t& next_hop)
+{
+    FILE* file = std::fopen("/proc/net/route", "r");
+    if (!file) {
+        return false;
+    }
+
+    char line[256];
+    bool found = false;
+    uint32_t best_mask = 0;
+    if (std::fgets(line, sizeof(line), file)) {
+        while (std::fgets(line, sizeof(line), file)) {
+            char name[IFNAMSIZ + 1];
+            unsigned int route, gateway, flags, mask;
+            // Addresses are printed as the network-order words, read back as such
+            if (std::sscanf(line, "%16s %x %x %x %*d %*d %*d %x", name, &route, &gateway, &flags, &mask) != 5 ||
+                interface != name || !(flags & RTF_UP) || (destination & mask) != route) {
+                continue;
+            }
+            const uint32_t prefix = ntohl(mask);
+            if (!found || prefix > best_mask) {
+                found = true;
+                best_mask = prefix;
+                next_hop = (flags & RTF_GATEWAY) ? gateway : destination;
+            }
+        }
+    }
+    std::fclose(file);
+    return found;
+}
+
+// Link address of a resolved neighbour
+bool FindNeighbour(const std::string& interface, uint32_t address, uint8_t mac[6])
+{
+    FILE* file = std::fopen("/proc/net/arp", "r");
+    if (!file) {
+        return false;
+    }
+
+    char wanted[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address, wanted, sizeof(wanted));
+
+    char line[256];
+    bool found = false;
+    if (std::fgets(line, sizeof(line), file)) {
+        while (!found && std::fgets(line, sizeof(line), file)) {
+            char ip[64], hw[32], device[IFNAMSIZ + 1];
+            unsigned int flags;
+            if (std::sscanf(line, "%63s %*s %x %31s %*s %16s", ip, &flags, hw, device) != 4 ||
+                !(flags & ATF_COM) || interface != device || std::strcmp(ip, wanted) != 0) {
+                continue;
+            }
+            found = std::sscanf(hw, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+                                &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == 6;
+        }
+    }
+    std::fclose(file);
+    return found;
+}
+
+void FillPacket(const SharedPoseSample& sample, PoseUplinkPacket& packet)
+{
+    std::memset(&packet, 0, sizeof(packet));
+    packet.magic = kPoseUplinkMagic;
+    packet.version = kPoseUplinkVersion;
+    packet.sequence = sample.sequence;
+    packet.publish_time = sample.publish_time;
+    packet.timestamp = sample.timestamp;
+    std::copy(sample.rotation, sample.rotation + 4, packet.rotation);
+    std::copy(sample.translation, sample.translation + 3, packet.translation);
+    std::copy(sample.predicted_rotation, sample.predicted_rotation + 4, packet.predicted_rotation);
+    std::copy(sample.predicted_translation, sample.predicted_translation + 3, packet.predicted_translation);
+    packet.prediction_horizon_ms = sample.prediction_horizon_ms;
+    std::copy(sample.linear_velocity, sample.linear_velocity + 3, packet.linear_velocity);
+    std::copy(sample.angular_velocity, sample.angular_velocity + 3, packet.angular_velocity);
+    packet.tracking_state = sample.tracking_state;
+    packet.flags = sample.flags;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// PoseUplinkSender
+//------------------------------------------------------------------------------
+
+PoseUplinkSender::PoseUplinkSender(const Options& options)
+    : mValid(false), mOptions(options), mSocket(-1), mRingSocket(-1), mRing(nullptr), mRingBytes(0),
+      mRingFrameSize(kRingFrameSize), mRingHead(0), mIfIndex(0), mRingDenied(false), mNextRingAttempt(0.0),
+      mPacketIndex(0), mSendTimes(kSendTimeSlots, 0), mErrorBuffer(kPoseUplinkFrameBytes + 64),
+      mLastWriteCount(0)
+{
+    if (options.port <= 0 || options.port > 65535 || options.ring_frames <= 0 ||
+        options.neighbour_retry_ms < 0 || options.dscp < 0 || options.dscp > 63) {
+        std::cerr << "Invalid pose uplink options" << std::endl;
+        return;
+    }
+
+    struct sockaddr_in address;
+    if (!ResolveAddress(options.host, options.port, address)) {
+        std::cerr << "Invalid pose uplink address: " << options.host << std::endl;
+        return;
+    }
+
+    mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (mSocket < 0) {
+        std::cerr << "Failed to create pose uplink socket" << std::endl;
+        return;
+    }
+
+    // DSCP sits in the upper six bits of the TOS byte
+    const int tos = options.dscp << 2;
+    setsockopt(mSocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    setsockopt(mSocket, SOL_SOCKET, SO_PRIORITY, &kSocketPriority, sizeof(kSocketPriority));
+
+    // Connected, so the route and the source address and port are fixed for the TX ring too
+    if (connect(mSocket, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Failed to connect pose uplink socket to " << options.host << std::endl;
+        return;
+    }
+
+    if (!options.pose_region.empty()) {
+        mPoseReader = std::make_unique<SharedPoseReader>(options.pose_region);
+    }
+
+    mValid = true;
+}
+
+PoseUplinkSender::~PoseUplinkSender()
+{
+    closeRing();
+    if (mSocket >= 0) {
+        close(mSocket);
+    }
+}
+
+bool PoseUplinkSender::IsValid() const
+{
+    return mValid;
+}
+
+bool PoseUplinkSender::IsUsingTxRing() const
+{
+    return mRingSocket >= 0;
+}
+
+bool PoseUplinkSender::Poll(int timeout_ms)
+{
+    if (!mValid || !mPoseReader) {
+        return false;
+    }
+
+    if (mOptions.use_tx_ring && mRingSocket < 0 && !mRingDenied && MonotonicSeconds() >= mNextRingAttempt) {
+        if (!openRing()) {
+            mNextRingAttempt = MonotonicSeconds() + mOptions.neighbour_retry_ms * 1e-3;
+        }
+    }
+    if (mRingSocket >= 0) {
+        readTimestamps();
+    }
+
+    if (!mPoseReader->IsOpen() && !mPoseReader->Open()) {
+        const int wait_ms = timeout_ms < 0 ? kPoseRetryMs : std::min(timeout_ms, kPoseRetryMs);
+        poll(nullptr, 0, wait_ms);
+        return false;
+    }
+
+    SharedPoseSample sample;
+    if (!mPoseReader->WaitForSample(mLastWriteCount, timeout_ms) || !mPoseReader->ReadLatest(sample)) {
+        return false;
+    }
+    if (mLastWriteCount > 0 && sample.sequence > mLastWriteCount) {
+        mStats.samples_skipped += sample.sequence - mLastWriteCount;
+    }
+    mLastWriteCount = sample.sequence + 1;
+
+    return Send(sample);
+}
+
+bool PoseUplinkSender::Send(const SharedPoseSample& sample)
+{
+    if (!mValid) {
+        return false;
+    }
+
+    PoseUplinkPacket packet;
+    FillPacket(sample, packet);
+    packet.packet_index = mPacketIndex;
+
+    const bool ring = mRingSocket >= 0;
+    if (!(ring ? sendRing(packet) : sendSocket(packet))) {
+        ++mStats.send_failures;
+        return false;
+    }
+
+    ++mPacketIndex;
+    ++mStats.samples_sent;
+    if (ring) {
+        ++mStats.ring_frames_sent;
+    }
+    return true;
+}
+
+PoseUplinkSender::Stats PoseUplinkSender::GetStats() const
+{
+    return mStats;
+}
+
+size_t PoseUplinkSender::BuildFrame(const PoseUplinkFrameAddress& address, const PoseUplinkPacket& packet,
+                                    int dscp, uint8_t* frame)
+{
+    std::memcpy(frame, address.destination_mac, 6);
+    std::memcpy(frame + 6, address.source_mac, 6);
+    WriteBigEndian16(frame + 12, 0x0800);
+
+    // IPv4, no options, don't fragment
+    uint8_t* ip = frame + kEthernetHeaderBytes;
+    ip[0] = 0x45;
+    ip[1] = static_cast<uint8_t>(dscp << 2);
+    WriteBigEndian16(ip + 2, kIpHeaderBytes + kUdpHeaderBytes + sizeof(PoseUplinkPacket));
+    WriteBigEndian16(ip + 4, 0);
+    WriteBigEndian16(ip + 6, 0x4000);
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    WriteBigEndian16(ip + 10, 0);
+    std::memcpy(ip + 12, &address.source_ip, 4);
+    std::memcpy(ip + 16, &address.destination_ip, 4);
+    WriteBigEndian16(ip + 10, ChecksumFold(ChecksumAdd(0, ip, kIpHeaderBytes)));
+
+    uint8_t* udp = ip + kIpHeaderBytes;
+    const uint32_t udp_bytes = kUdpHeaderBytes + sizeof(PoseUplinkPacket);
+    WriteBigEndian16(udp, address.source_port);
+    WriteBigEndian16(udp + 2, address.destination_port);
+    WriteBigEndian16(udp + 4, udp_bytes);
+    WriteBigEndian16(udp + 6, 0);
+    std::memcpy(udp + kUdpHeaderBytes, &packet, sizeof(packet));
+
+    // Pseudo header: addresses, protocol and UDP length
+    uint32_t sum = ChecksumAdd(0, ip + 12, 8);
+    sum += IPPROTO_UDP + udp_bytes;
+    uint16_t checksum = ChecksumFold(ChecksumAdd(sum, udp, udp_bytes));
+    WriteBigEndian16(udp + 6, checksum == 0 ? 0xFFFF : checksum);
+
+    return kPoseUplinkFrameBytes;
+}
+
+// mac80211 has no XDP, so AF_XDP on the AX210 would only run in copy mode and end in the same
+// direct xmit as a PACKET_QDISC_BYPASS TX ring, without the neighbour being any easier to find
+bool PoseUplinkSender::openRing()
+{
+    const int ifindex = static_cast<int>(if_nametoindex(mOptions.interface.c_str()));
+    if (ifindex <= 0) {
+        return false;
+    }
+
+    struct ifreq request;
+    std::memset(&request, 0, sizeof(request));
+    std::strncpy(request.ifr_name, mOptions.interface.c_str(), IFNAMSIZ - 1);
+    if (ioctl(mSocket, SIOCGIFHWADDR, &request) != 0 || request.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+        return false;
+    }
+
+    struct sockaddr_in local, remote;
+    socklen_t local_size = sizeof(local), remote_size = sizeof(remote);
+    if (getsockname(mSocket, reinterpret_cast<struct sockaddr*>(&local), &local_size) != 0 ||
+        getpeername(mSocket, reinterpret_cast<struct sockaddr*>(&remote), &remote_size) != 0) {
+        return false;
+    }
+
+    // The UDP datagrams sent meanwhile make the kernel resolve the next hop
+    PoseUplinkFrameAddress address;
+    uint32_t next_hop = 0;
+    if (!FindNextHop(mOptions.interface, remote.sin_addr.s_addr, next_hop) ||
+        !FindNeighbour(mOptions.interface, next_hop, address.destination_mac)) {
+        return false;
+    }
+    std::memcpy(address.source_mac, request.ifr_hwaddr.sa_data, 6);
+    address.source_ip = local.sin_addr.s_addr;
+    address.destination_ip = remote.sin_addr.s_addr;
+    address.source_port = ntohs(local.sin_port);
+    address.destination_port = ntohs(remote.sin_port);
+
+    // Protocol 0, the socket only sends and gets no copy of the received traffic
+    const int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        if (errno == EPERM || errno == EACCES) {
+            std::cerr << "Pose uplink TX ring needs CAP_NET_RAW, staying on the UDP socket" << std::endl;
+            mRingDenied = true;
+        }
+        return false;
+    }
+
+    const int version = TPACKET_V2;
+    const int one = 1;
+    const int timestamping = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    const size_t frames_per_block = static_cast<size_t>(getpagesize()) / kRingFrameSize;
+    const size_t blocks = (static_cast<size_t>(mOptions.ring_frames) + frames_per_block - 1) / frames_per_block;
+    struct tpacket_req ring;
+    ring.tp_block_size = static_cast<unsigned int>(getpagesize());
+    ring.tp_block_nr = static_cast<unsigned int>(blocks);
+    ring.tp_frame_size = static_cast<unsigned int>(kRingFrameSize);
+    ring.tp_frame_nr = static_cast<unsigned int>(blocks * frames_per_block);
+
+    struct sockaddr_ll link;
+    std::memset(&link, 0, sizeof(link));
+    link.sll_family = AF_PACKET;
+    link.sll_ifindex = ifindex;
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one)) != 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &ring, sizeof(ring)) != 0 ||
+        bind(fd, reinterpret_cast<const struct sockaddr*>(&link), sizeof(link)) != 0) {
+        std::cerr << "Failed to set up the pose uplink TX ring on " << mOptions.interface << std::endl;
+        close(fd);
+        mRingDenied = true;
+        return false;
+    }
+
+    const size_t bytes = static_cast<size_t>(ring.tp_block_size) * ring.tp_block_nr;
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close(fd);
+        mRingDenied = true;
+        return false;
+    }
+
+#ifdef PACKET_QDISC_BYPASS
+    setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#endif
+    setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &kRingPriority, sizeof(kRingPriority));
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &timestamping, sizeof(timestamping));
+
+    mRingSocket = fd;
+    mRing = static_cast<uint8_t*>(mapped);
+    mRingBytes = bytes;
+    mRingHead = 0;
+    mIfIndex = ifindex;
+    mAddress = address;
+    return true;
+}
+
+void PoseUplinkSender::closeRing()
+{
+    if (mRing) {
+        munmap(mRing, mRingBytes);
+        mRing = nullptr;
+    }
+    if (mRingSocket >= 0) {
+        close(mRingSocket);
+        mRingSocket = -1;
+    }
+}
+
+bool PoseUplinkSender::sendRing(PoseUplinkPacket& packet)
+{
+    uint8_t* slot = mRing + static_cast<size_t>(mRingHead) * mRingFrameSize;
+    struct tpacket2_hdr* header = reinterpret_cast<struct tpacket2_hdr*>(slot);
+
+    // The kernel still owns the frame: the ring is full
+    const uint32_t status = __atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+        return false;
+    }
+
+    packet.enqueue_time = MonotonicSeconds();
+    BuildFrame(mAddress, packet, mOptions.dscp, slot + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll));
+    header->tp_len = static_cast<uint32_t>(kPoseUplinkFrameBytes);
+    mSendTimes[packet.packet_index % kSendTimeSlots] = RealtimeNanoseconds();
+    __atomic_store_n(&header->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    mRingHead = static_cast<uint32_t>((mRingHead + 1) % (mRingBytes / mRingFrameSize));
+
+    struct sockaddr_ll link;
+    std::memset(&link, 0, sizeof(link));
+    link.sll_family = AF_PACKET;
+    link.sll_protocol = htons(0x0800);
+    link.sll_ifindex = mIfIndex;
+    link.sll_halen = 6;
+    std::memcpy(link.sll_addr, mAddress.destination_mac, 6);
+
+    // Does not wait for the frame to leave. The frame is queued either way, one a failed kick
+    // left behind goes with the next kick
+    sendto(mRingSocket, nullptr, 0, MSG_DONTWAIT, reinterpret_cast<const struct sockaddr*>(&link), sizeof(link));
+    return true;
+}
+
+bool PoseUplinkSender::sendSocket(PoseUplinkPacket& packet)
+{
+    packet.enqueue_time = MonotonicSeconds();
+    return send(mSocket, &packet, sizeof(packet), MSG_DONTWAIT) == static_cast<ssize_t>(sizeof(packet));
+}
+
+// Hand-off stamps the driver queued on the error queue, each with a copy of its frame
+void PoseUplinkSender::readTimestamps()
+{
+    char control[256];
+    while (true) {
+        struct iovec iov;
+        iov.iov_base = mErrorBuffer.data();
+        iov.iov_len = mErrorBuffer.size();
+        struct msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        const ssize_t received = recvmsg(mRingSocket, &message, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (received < 0) {
+            return;
+        }
+        if (static_cast<size_t>(received) < kPoseUplinkFrameBytes) {
+            continue;
+        }
+
+        const struct scm_timestamping* stamps = nullptr;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                stamps = reinterpret_cast<const struct scm_timestamping*>(CMSG_DATA(cmsg));
+            }
+        }
+
+        PoseUplinkPacket packet;
+        std::memcpy(&packet, mErrorBuffer.data() + kPayloadOffset, sizeof(packet));
+        if (!stamps || packet.magic != kPoseUplinkMagic || mPacketIndex - packet.packet_index > kSendTimeSlots) {
+            continue;
+        }
+
+        const int64_t handoff = static_cast<int64_t>(stamps->ts[0].tv_sec) * 1000000000 + stamps->ts[0].tv_nsec;
+        const int64_t delay_ns = handoff - mSendTimes[packet.packet_index % kSendTimeSlots];
+        if (delay_ns < 0 || delay_ns > 1000000000) {
+            continue;
+        }
+
+        const uint32_t delay_us = static_cast<uint32_t>(delay_ns / 1000);
+        mStats.handoff_delay_us_avg = mStats.handoff_timestamps == 0
+            ? delay_us : (mStats.handoff_delay_us_avg * 7 + delay_us) / 8;
+        mStats.handoff_delay_us_max = std::max(mStats.handoff_delay_us_max, delay_us);
+        ++mStats.handoff_timestamps;
+    }
+}
+
+//------------------------------------------------------------------------------
+// PoseUplinkReceiver
+//------------------------------------------------------------------------------
+
+PoseUplinkReceiver::PoseUplinkReceiver(const Options& options)
+    : mValid(false), mSocket(-1), mPort(0), mHaveLast(false), mLastIndex(0), mLastTransit(0.0)
+{
+    if (options.port < 0 || options.port > 65535) {
+        std::cerr << "Invalid pose uplink receiver options" << std::endl;
+        return;
+    }
+
+    mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (mSocket < 0) {
+        std::cerr << "Failed to create pose uplink socket" << std::endl;
+        return;
+    }
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    if (bind(mSocket, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Failed to bind pose uplink socket to port " << options.port << std::endl;
+        return;
+    }
+
+    socklen_t size = sizeof(address);
+    getsockname(mSocket, reinterpret_cast<struct sockaddr*>(&address), &size);
+    mPort = ntohs(address.sin_port);
+    mValid = true;
+}
+
+PoseUplinkReceiver::~PoseUplinkReceiver()
+{
+    if (mSocket >= 0) {
+        close(mSocket);
+    }
+}
+
+bool PoseUplinkReceiver::IsValid() const
+{
+    return mValid;
+}
+
+int PoseUplinkReceiver::GetPort() const
+{
+    return mPort;
+}
+
+bool PoseUplinkReceiver::Poll(PoseUplinkPacket& packet, double& receive_time, int timeout_ms)
+{
+    if (!mValid) {
+        return false;
+    }
+
+    struct pollfd descriptor;
+    descriptor.fd = mSocket;
+    descriptor.events = POLLIN;
+    if (poll(&descriptor, 1, timeout_ms) <= 0) {
+        return false;
+    }
+
+    const ssize_t received = recv(mSocket, &packet, sizeof(packet), MSG_DONTWAIT | MSG_TRUNC);
+    if (received < 0) {
+        return false;
+    }
+    receive_time = MonotonicSeconds();
+    if (received != static_cast<ssize_t>(sizeof(packet)) || packet.magic != kPoseUplinkMagic ||
+        packet.version != kPoseUplinkVersion) {
+        ++mStats.packets_invalid;
+        return false;
+    }
+
+    if (mHaveLast) {
+        const int32_t step = static_cast<int32_t>(packet.packet_index - mLastIndex);
+        if (step <= 0) {
+            ++mStats.packets_reordered;
+            return false;
+        }
+        mStats.packets_lost += static_cast<uint64_t>(step - 1);
+
+        // Transit times differ by the clock offset, their changes do not
+        const double transit = receive_time - packet.enqueue_time;
+        const double difference_us = std::fabs(transit - mLastTransit) * 1e6;
+        mStats.jitter_us += (difference_us - mStats.jitter_us) / 16.0;
+        mLastTransit = transit;
+    } else {
+        mLastTransit = receive_time - packet.enqueue_time;
+    }
+    mHaveLast = true;
+    mLastIndex = packet.packet_index;
+    ++mStats.packets_received;
+    return true;
+}
+
+PoseUplinkReceiver::Stats PoseUplinkReceiver::GetStats() const
+{
+    return mStats;
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,254 @@
+#include "include/shared_pose_export.hpp"
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// Attempts to read a slot before giving up (a writer that died mid-write leaves it locked)
+constexpr int kReadAttempts = 64;
+
+uint32_t* futexWord(const std::atomic<uint32_t>& word)
+{
+    return reinterpret_cast<uint32_t*>(const_cast<std::atomic<uint32_t>*>(&word));
+}
+
+// Shared (not process-private) futex operations, the waiters live in other processes
+long futexWake(const std::atomic<uint32_t>& word)
+{
+    return syscall(SYS_futex, futexWord(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+long futexWait(const std::atomic<uint32_t>& word, uint32_t expected, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, futexWord(word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// SharedPoseWriter
+//------------------------------------------------------------------------------
+
+SharedPoseWriter::SharedPoseWriter(const std::string& name)
+    : mName(name), mRegion(nullptr)
+{
+}
+
+SharedPoseWriter::~SharedPoseWriter()
+{
+    Close();
+}
+
+bool SharedPoseWriter::Open()
+{
+    if (mRegion) {
+        return true;
+    }
+
+    int fd = shm_open(mName.c_str(), O_CREAT | O_RDWR, 0666);
+    if (fd < 0) {
+        std::cerr << "Failed to create shared memory " << mName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(SharedPoseRegion)) != 0) {
+        std::cerr << "Failed to size shared memory " << mName << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(SharedPoseRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << mName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Readers only accept the region once the magic is set
+    SharedPoseRegion* region = static_cast<SharedPoseRegion*>(addr);
+    region->magic.store(0, std::memory_order_release);
+    const uint32_t notify = region->notify_word.load(std::memory_order_relaxed);
+    mRegion = new (addr) SharedPoseRegion();
+    mRegion->version = kSharedPoseVersion;
+    mRegion->slot_count = kSharedPoseSlots;
+    mRegion->sample_size = sizeof(SharedPoseSample);
+    mRegion->write_count.store(0, std::memory_order_relaxed);
+    mRegion->notify_word.store(notify + 1, std::memory_order_relaxed);
+    mRegion->magic.store(kSharedPoseMagic, std::memory_order_release);
+    futexWake(mRegion->notify_word);
+    return true;
+}
+
+void SharedPoseWriter::Close()
+{
+    if (!mRegion) {
+        return;
+    }
+
+    // Tell the readers still mapping the region that no more samples follow
+    mRegion->magic.store(0, std::memory_order_release);
+    mRegion->notify_word.fetch_add(1, std::memory_order_release);
+    futexWake(mRegion->notify_word);
+
+    munmap(mRegion, sizeof(SharedPoseRegion));
+    shm_unlink(mName.c_str());
+    mRegion = nullptr;
+}
+
+bool SharedPoseWriter::IsOpen() const
+{
+    return mRegion != nullptr;
+}
+
+void SharedPoseWriter::Publish(const SharedPoseSample& sample)
+{
+    if (!mRegion) {
+        return;
+    }
+
+    const uint64_t count = mRegion->write_count.load(std::memory_order_relaxed);
+    SharedPoseSample numbered = sample;
+    numbered.sequence = count;
+    mRegion->slots[count % kSharedPoseSlots].sample.Store(numbered);
+    mRegion->write_count.store(count + 1, std::memory_order_release);
+
+    mRegion->notify_word.fetch_add(1, std::memory_order_release);
+    futexWake(mRegion->notify_word);
+}
+
+//------------------------------------------------------------------------------
+// SharedPoseReader
+//------------------------------------------------------------------------------
+
+SharedPoseReader::SharedPoseReader(const std::string& name)
+    : mName(name), mRegion(nullptr)
+{
+}
+
+SharedPoseReader::~SharedPoseReader()
+{
+    Close();
+}
+
+bool SharedPoseReader::Open()
+{
+    if (mRegion) {
+        return true;
+    }
+
+    int fd = shm_open(mName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SharedPoseRegion)) {
+        close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(SharedPoseRegion), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    const SharedPoseRegion* region = static_cast<const SharedPoseRegion*>(addr);
+    if (region->magic.load(std::memory_order_acquire) != kSharedPoseMagic ||
+        region->version != kSharedPoseVersion ||
+        region->slot_count != kSharedPoseSlots ||
+        region->sample_size != sizeof(SharedPoseSample)) {
+        munmap(addr, sizeof(SharedPoseRegion));
+        return false;
+    }
+
+    mRegion = static_cast<SharedPoseRegion*>(addr);
+    return true;
+}
+
+void SharedPoseReader::Close()
+{
+    if (mRegion) {
+        munmap(mRegion, sizeof(SharedPoseRegion));
+        mRegion = nullptr;
+    }
+}
+
+bool SharedPoseReader::IsOpen() const
+{
+    return mRegion != nullptr;
+}
+
+uint64_t SharedPoseReader::GetWriteCount() const
+{
+    return mRegion ? mRegion->write_count.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedPoseReader::ReadLatest(SharedPoseSample& sample) const
+{
+    const uint64_t count = GetWriteCount();
+    if (count == 0) {
+        return false;
+    }
+
+    const SharedPoseRegion::Slot& slot = mRegion->slots[(count - 1) % kSharedPoseSlots];
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+        if (slot.sample.TryLoad(sample)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SharedPoseReader::WaitForSample(uint64_t write_count, int timeout_ms) const
+{
+    using namespace std::chrono;
+
+    if (!mRegion) {
+        return false;
+    }
+
+    const auto deadline = steady_clock::now() + milliseconds(timeout_ms);
+    while (true) {
+        // Read the futex word first so a publish between the check and the wait is not missed
+        const uint32_t word = mRegion->notify_word.load(std::memory_order_acquire);
+        if (GetWriteCount() > write_count) {
+            return true;
+        }
+        if (mRegion->magic.load(std::memory_order_acquire) != kSharedPoseMagic) {
+            return false;
+        }
+
+        struct timespec timeout;
+        const struct timespec* timeout_ptr = nullptr;
+        if (timeout_ms >= 0) {
+            const auto remaining = duration_cast<nanoseconds>(deadline - steady_clock::now()).count();
+            if (remaining <= 0) {
+                return false;
+            }
+            timeout.tv_sec = remaining / 1000000000;
+            timeout.tv_nsec = remaining % 1000000000;
+            timeout_ptr = &timeout;
+        }
+
+        if (futexWait(mRegion->notify_word, word, timeout_ptr) != 0 && errno == ETIMEDOUT) {
+            return GetWriteCount() > write_count;
+        }
+    }
+}
+
+} // namespace ORB_SLAM3
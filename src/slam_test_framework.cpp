@@ -9,10 +9,110 @@
 #include <fstream>
 #include <iomanip>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <numeric>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <sys/resource.h>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#if defined(ENABLE_ALLOCATION_COUNTING) && defined(__GLIBC__)
+
+//------------------------------------------------------------------------------
+// Allocation counting
+//------------------------------------------------------------------------------
+
+// The malloc family of glibc, under the names it keeps for replacements to call
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace
+{
+
+std::atomic<uint64_t> g_process_allocations{0};
+// Initial-exec, so that the first access of a thread does not allocate its TLS block
+__thread uint64_t t_thread_allocations __attribute__((tls_model("initial-exec")));
+
+inline void countAllocation()
+{
+    g_process_allocations.fetch_add(1, std::memory_order_relaxed);
+    t_thread_allocations++;
+}
+
+} // namespace
+
+extern "C" {
+
+void* malloc(size_t size) noexcept
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) noexcept
+{
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    countAllocation();
+    void* p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+} // extern "C"
+
+#endif // ENABLE_ALLOCATION_COUNTING && __GLIBC__
+
 namespace ORB_SLAM3
 {
 
@@ -29,12 +129,21 @@ TestCase::~TestCase()
 {
 }
 
-TestResult TestCase::Run()
+TestResult TestCase::Run(bool exclusive)
 {
     TestResult result;
     result.name = name_;
     result.description = description_;
     result.success = false;
+    result.process_usage = exclusive;
+    
+    // Threads the test starts are only accounted for when it has the process to itself
+    const int who = exclusive ? RUSAGE_SELF : RUSAGE_THREAD;
+    if (exclusive) {
+        ResetPeakRss();
+    }
+    struct rusage usage_start;
+    getrusage(who, &usage_start);
     
     // Measure execution time
     auto start_time = std::chrono::high_resolution_clock::now();
@@ -53,6 +162,16 @@ TestResult TestCase::Run()
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
     result.execution_time_ms = duration.count();
     
+    struct rusage usage_end;
+    getrusage(who, &usage_end);
+    auto to_ms = [](const struct timeval& tv) { return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0; };
+    result.cpu_time_ms = to_ms(usage_end.ru_utime) - to_ms(usage_start.ru_utime) +
+                         to_ms(usage_end.ru_stime) - to_ms(usage_start.ru_stime);
+    result.voluntary_context_switches = usage_end.ru_nvcsw - usage_start.ru_nvcsw;
+    result.involuntary_context_switches = usage_end.ru_nivcsw - usage_start.ru_nivcsw;
+    // Process-wide either way, an upper bound when tests overlapped
+    result.peak_rss_mb = GetPeakRssMb();
+    
     return result;
 }
 
@@ -66,6 +185,18 @@ std::string TestCase::GetDescription() const
     return description_;
 }
 
+void TestCase::AddResource(const std::string& resource)
+{
+    if (std::find(resources_.begin(), resources_.end(), resource) == resources_.end()) {
+        resources_.push_back(resource);
+    }
+}
+
+const std::vector<std::string>& TestCase::GetResources() const
+{
+    return resources_;
+}
+
 void TestCase::Log(TestResult& result, const std::string& message)
 {
     result.logs.push_back(message);
@@ -86,6 +217,131 @@ void TestCase::SetFailure(TestResult& result, const std::string& message)
     Log(result, "FAILURE: " + message);
 }
 
+//------------------------------------------------------------------------------
+// Test scheduling
+//------------------------------------------------------------------------------
+
+namespace
+{
+
+void PrintResult(const TestResult& result, bool with_name)
+{
+    std::cout << (result.success ? "PASSED" : "FAILED");
+    if (with_name) {
+        std::cout << " " << result.name;
+    }
+    std::cout << " (" << result.execution_time_ms << " ms, CPU " << result.cpu_time_ms << " ms, peak RSS "
+              << result.peak_rss_mb << " MB)" << std::endl;
+}
+
+bool IsExclusive(const TestCase& test)
+{
+    const std::vector<std::string>& resources = test.GetResources();
+    return std::find(resources.begin(), resources.end(), kTestResourceExclusive) != resources.end();
+}
+
+/**
+ * @brief Run tests on up to max_concurrency threads, never two sharing a resource tag
+ * 
+ * Pending tests are started in order, skipping those whose resources are held.
+ * 
+ * @return Results in the order of the tests
+ */
+std::vector<TestResult> RunScheduled(const std::vector<std::shared_ptr<TestCase>>& tests, int max_concurrency)
+{
+    std::vector<TestResult> results(tests.size());
+    
+    if (max_concurrency <= 1 || tests.size() <= 1) {
+        for (size_t i = 0; i < tests.size(); ++i) {
+            std::cout << "Running test: " << tests[i]->GetName() << std::endl;
+            results[i] = tests[i]->Run(true);
+            PrintResult(results[i], false);
+            std::cout << "----------------------------------------" << std::endl;
+        }
+        return results;
+    }
+    
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<bool> started(tests.size(), false);
+    std::set<std::string> held;
+    int running = 0;
+    bool exclusive_running = false;
+    
+    auto can_start = [&](const TestCase& test) {
+        if (IsExclusive(test)) {
+            return running == 0;
+        }
+        if (exclusive_running) {
+            return false;
+        }
+        for (const auto& resource : test.GetResources()) {
+            if (held.count(resource)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            size_t next = tests.size();
+            bool pending = false;
+            for (size_t i = 0; i < tests.size() && next == tests.size(); ++i) {
+                if (!started[i]) {
+                    pending = true;
+                    if (can_start(*tests[i])) {
+                        next = i;
+                    }
+                }
+            }
+            if (!pending) {
+                return;
+            }
+            if (next == tests.size()) {
+                finished.wait(lock);
+                continue;
+            }
+            
+            TestCase& test = *tests[next];
+            const bool exclusive = IsExclusive(test);
+            started[next] = true;
+            exclusive_running = exclusive;
+            held.insert(test.GetResources().begin(), test.GetResources().end());
+            ++running;
+            std::cout << "Running test: " << test.GetName() << std::endl;
+            
+            lock.unlock();
+            TestResult result = test.Run(exclusive);
+            lock.lock();
+            
+            for (const auto& resource : test.GetResources()) {
+                held.erase(resource);
+            }
+            exclusive_running = false;
+            --running;
+            PrintResult(result, true);
+            results[next] = std::move(result);
+            finished.notify_all();
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    const size_t count = std::min(tests.size(), static_cast<size_t>(max_concurrency));
+    for (size_t i = 0; i < count; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    std::cout << "----------------------------------------" << std::endl;
+    
+    return results;
+}
+
+} // namespace
+
 //------------------------------------------------------------------------------
 // TestSuite Implementation
 //------------------------------------------------------------------------------
@@ -104,23 +360,12 @@ void TestSuite::AddTest(std::shared_ptr<TestCase> test)
     tests_.push_back(test);
 }
 
-std::vector<TestResult> TestSuite::RunAll()
+std::vector<TestResult> TestSuite::RunAll(int max_concurrency)
 {
-    std::vector<TestResult> results;
-    
     std::cout << "Running test suite: " << name_ << std::endl;
     std::cout << "----------------------------------------" << std::endl;
     
-    for (const auto& test : tests_) {
-        std::cout << "Running test: " << test->GetName() << std::endl;
-        TestResult result = test->Run();
-        results.push_back(result);
-        std::cout << (result.success ? "PASSED" : "FAILED") << " (" 
-                  << result.execution_time_ms << " ms)" << std::endl;
-        std::cout << "----------------------------------------" << std::endl;
-    }
-    
-    return results;
+    return RunScheduled(tests_, max_concurrency);
 }
 
 TestResult TestSuite::RunTest(const std::string& name)
@@ -134,8 +379,7 @@ TestResult TestSuite::RunTest(const std::string& name)
         if (test->GetName() == name) {
             std::cout << "Running test: " << test->GetName() << std::endl;
             TestResult result = test->Run();
-            std::cout << (result.success ? "PASSED" : "FAILED") << " (" 
-                      << result.execution_time_ms << " ms)" << std::endl;
+            PrintResult(result, false);
             return result;
         }
     }
@@ -170,16 +414,26 @@ void TestRunner::AddSuite(std::shared_ptr<TestSuite> suite)
     suites_.push_back(suite);
 }
 
-std::vector<TestResult> TestRunner::RunAll()
+std::vector<TestResult> TestRunner::RunAll(int max_concurrency)
 {
     std::vector<TestResult> all_results;
     
     std::cout << "Running all test suites" << std::endl;
     std::cout << "========================================" << std::endl;
     
-    for (const auto& suite : suites_) {
-        std::vector<TestResult> suite_results = suite->RunAll();
-        all_results.insert(all_results.end(), suite_results.begin(), suite_results.end());
+    if (max_concurrency <= 1) {
+        for (const auto& suite : suites_) {
+            std::vector<TestResult> suite_results = suite->RunAll();
+            all_results.insert(all_results.end(), suite_results.begin(), suite_results.end());
+        }
+    } else {
+        // One schedule across suites, so a slow suite does not hold back the others
+        std::vector<std::shared_ptr<TestCase>> tests;
+        for (const auto& suite : suites_) {
+            const std::vector<std::shared_ptr<TestCase>> suite_tests = suite->GetTests();
+            tests.insert(tests.end(), suite_tests.begin(), suite_tests.end());
+        }
+        all_results = RunScheduled(tests, max_concurrency);
     }
     
     std::cout << "========================================" << std::endl;
@@ -188,11 +442,11 @@ std::vector<TestResult> TestRunner::RunAll()
     return all_results;
 }
 
-std::vector<TestResult> TestRunner::RunSuite(const std::string& suite_name)
+std::vector<TestResult> TestRunner::RunSuite(const std::string& suite_name, int max_concurrency)
 {
     for (const auto& suite : suites_) {
         if (suite->GetName() == suite_name) {
-            return suite->RunAll();
+            return suite->RunAll(max_concurrency);
         }
     }
     
@@ -216,12 +470,14 @@ TestResult TestRunner::RunTest(const std::string& suite_name, const std::string&
     return empty_result;
 }
 
-void TestRunner::GenerateReport(const std::vector<TestResult>& results, const std::string& output_file)
+void TestRunner::GenerateReport(const std::vector<TestResult>& results, const std::string& output_file,
+                                const std::string& history_file)
 {
     // Count passed and failed tests
     int passed = 0;
     int failed = 0;
     double total_time = 0.0;
+    double total_cpu_time = 0.0;
     
     for (const auto& result : results) {
         if (result.success) {
@@ -230,6 +486,30 @@ void TestRunner::GenerateReport(const std::vector<TestResult>& results, const st
             failed++;
         }
         total_time += result.execution_time_ms;
+        total_cpu_time += result.cpu_time_ms;
+    }
+    
+    // Earlier runs per test, oldest first: time, CPU time, peak RSS, context switches
+    std::map<std::string, std::vector<std::array<double, 4>>> history;
+    if (!history_file.empty()) {
+        std::ifstream file(history_file);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::stringstream fields(line);
+            std::string run, name, success;
+            std::array<double, 4> sample;
+            long voluntary = 0;
+            long involuntary = 0;
+            if (std::getline(fields, run, '\t') && std::getline(fields, name, '\t') &&
+                std::getline(fields, success, '\t') &&
+                fields >> sample[0] >> sample[1] >> sample[2] >> voluntary >> involuntary) {
+                sample[3] = static_cast<double>(voluntary + involuntary);
+                history[name].push_back(sample);
+            }
+        }
     }
     
     // Generate report
@@ -240,16 +520,56 @@ void TestRunner::GenerateReport(const std::vector<TestResult>& results, const st
     report << "Passed: " << passed << std::endl;
     report << "Failed: " << failed << std::endl;
     report << "Total time: " << total_time << " ms" << std::endl;
+    report << "Total CPU time: " << total_cpu_time << " ms" << std::endl;
     report << std::endl;
     
     report << "Test Results" << std::endl;
     report << "------------" << std::endl;
     
+    std::vector<std::string> regressions;
     for (const auto& result : results) {
         report << result.name << ": " << (result.success ? "PASSED" : "FAILED") << std::endl;
         report << "  Description: " << result.description << std::endl;
         report << "  Message: " << result.message << std::endl;
         report << "  Time: " << result.execution_time_ms << " ms" << std::endl;
+        report << "  CPU time: " << result.cpu_time_ms << " ms"
+               << (result.process_usage ? "" : " (test thread only, ran in parallel)") << std::endl;
+        report << "  Peak RSS: " << result.peak_rss_mb << " MB" << std::endl;
+        report << "  Context switches: " << result.voluntary_context_switches << " voluntary, "
+               << result.involuntary_context_switches << " involuntary" << std::endl;
+        
+        auto it = history.find(result.name);
+        if (it != history.end()) {
+            const size_t count = std::min(it->second.size(), kTrendWindow);
+            std::array<double, 4> mean = {0.0, 0.0, 0.0, 0.0};
+            for (size_t i = it->second.size() - count; i < it->second.size(); ++i) {
+                for (size_t k = 0; k < mean.size(); ++k) {
+                    mean[k] += it->second[i][k] / count;
+                }
+            }
+            const std::array<double, 4> current = {
+                result.execution_time_ms, result.cpu_time_ms, result.peak_rss_mb,
+                static_cast<double>(result.voluntary_context_switches + result.involuntary_context_switches)};
+            auto change = [](double value, double reference) {
+                std::stringstream text;
+                if (reference <= 0.0) {
+                    text << "n/a";
+                } else {
+                    text << std::showpos << std::fixed << std::setprecision(1)
+                         << 100.0 * (value - reference) / reference << "%";
+                }
+                return text.str();
+            };
+            report << "  Trend vs mean of last " << count << " runs: time " << change(current[0], mean[0])
+                   << ", CPU " << change(current[1], mean[1]) << ", peak RSS " << change(current[2], mean[2])
+                   << ", context switches " << change(current[3], mean[3]) << std::endl;
+            
+            // Sub-millisecond tests are all noise
+            if ((mean[0] >= 1.0 && current[0] > 1.1 * mean[0]) || (mean[1] >= 1.0 && current[1] > 1.1 * mean[1]) ||
+                (mean[2] > 0.0 && current[2] > 1.1 * mean[2])) {
+                regressions.push_back(result.name);
+            }
+        }
         
         if (!result.logs.empty()) {
             report << "  Logs:" << std::endl;
@@ -261,6 +581,40 @@ void TestRunner::GenerateReport(const std::vector<TestResult>& results, const st
         report << std::endl;
     }
     
+    if (!history_file.empty()) {
+        report << "Trends" << std::endl;
+        report << "------" << std::endl;
+        if (history.empty()) {
+            report << "No earlier runs in " << history_file << std::endl;
+        } else if (regressions.empty()) {
+            report << "No test more than 10% above its trend" << std::endl;
+        } else {
+            report << "More than 10% above trend in time, CPU time or peak RSS:" << std::endl;
+            for (const auto& name : regressions) {
+                report << "  " << name << std::endl;
+            }
+        }
+        report << std::endl;
+        
+        std::ifstream existing(history_file);
+        const bool is_new = !existing.good();
+        existing.close();
+        std::ofstream file(history_file, std::ios::app);
+        if (!file.is_open()) {
+            std::cerr << "Failed to append to test history " << history_file << std::endl;
+        } else {
+            if (is_new) {
+                file << "# run\tname\tsuccess\ttime_ms\tcpu_ms\tpeak_rss_mb\tvoluntary_cs\tinvoluntary_cs" << std::endl;
+            }
+            const long run = static_cast<long>(std::time(nullptr));
+            for (const auto& result : results) {
+                file << run << "\t" << result.name << "\t" << (result.success ? 1 : 0) << "\t"
+                     << result.execution_time_ms << "\t" << result.cpu_time_ms << "\t" << result.peak_rss_mb << "\t"
+                     << result.voluntary_context_switches << "\t" << result.involuntary_context_switches << std::endl;
+            }
+        }
+    }
+    
     // Output report
     if (output_file.empty()) {
         std::cout << report.str();
@@ -286,6 +640,7 @@ TPUFeatureExtractorTest::TPUFeatureExtractorTest(const std::string& model_path,
       model_path_(model_path),
       test_image_path_(test_image_path)
 {
+    AddResource(kTestResourceTpu);
 }
 
 TPUFeatureExtractorTest::~TPUFeatureExtractorTest()
@@ -748,6 +1103,7 @@ BNO085InterfaceTest::BNO085InterfaceTest(const std::string& imu_data_path)
     : TestCase("BNO085InterfaceTest", "Test BNO085 Interface functionality"),
       imu_data_path_(imu_data_path)
 {
+    AddResource(kTestResourceImu);
 }
 
 BNO085InterfaceTest::~BNO085InterfaceTest()
@@ -782,6 +1138,7 @@ ZeroCopyFrameProviderTest::ZeroCopyFrameProviderTest(const std::string& video_pa
     : TestCase("ZeroCopyFrameProviderTest", "Test Zero Copy Frame Provider functionality"),
       video_path_(video_path)
 {
+    AddResource(kTestResourceCamera);
 }
 
 ZeroCopyFrameProviderTest::~ZeroCopyFrameProviderTest()
@@ -825,9 +1182,6 @@ SLAMIntegrationTest::~SLAMIntegrationTest()
 
 void SLAMIntegrationTest::Execute(TestResult& result)
 {
-    // This is a placeholder implementation for the full SLAM integration test
-    Log(result, "SLAM Integration test not fully implemented yet");
-    
     // Check if config file exists
     if (!config_path_.empty()) {
         std::ifstream file(config_path_);
@@ -835,23 +1189,32 @@ void SLAMIntegrationTest::Execute(TestResult& result)
             Log(result, "Config file exists: " + config_path_);
             file.close();
         } else {
-            Log(result, "Config file does not exist: " + config_path_);
+            SetFailure(result, "Config file does not exist: " + config_path_);
+            return;
         }
     }
     
-    // Check if dataset exists
-    if (!dataset_path_.empty()) {
-        std::ifstream file(dataset_path_ + "/info.txt");
-        if (file.is_open()) {
-            Log(result, "Dataset exists: " + dataset_path_);
-            file.close();
-        } else {
-            Log(result, "Dataset does not exist or is incomplete: " + dataset_path_);
-        }
+    // Index the dataset the way the benchmark replays it, a capture file or an ASL directory
+    const bool is_capture = dataset_path_.size() > 6 &&
+                            dataset_path_.compare(dataset_path_.size() - 6, 6, ".vrcap") == 0;
+    BenchmarkDataset dataset;
+    if (!dataset.Load(dataset_path_, is_capture ? BenchmarkDatasetFormat::CAPTURE_FILE : BenchmarkDatasetFormat::EUROC)) {
+        SetFailure(result, "Failed to load dataset: " + dataset.GetLastErrorMessage());
+        return;
     }
     
-    // For now, just mark as success
-    SetSuccess(result, "SLAM Integration test placeholder passed");
+    Log(result, "Dataset " + dataset.GetName() + ": " + std::to_string(dataset.GetFrameSets().size()) +
+                " frame sets of " + std::to_string(dataset.GetCameraCount()) + " cameras, " +
+                std::to_string(dataset.GetImuSamples().size()) + " IMU samples, " +
+                std::to_string(dataset.GetGroundTruth().size()) + " ground truth poses");
+    
+    std::vector<cv::Mat> images;
+    if (dataset.GetFrameSets().empty() || !dataset.LoadImages(0, images)) {
+        SetFailure(result, "Dataset has no readable frame set: " + dataset_path_);
+        return;
+    }
+    
+    SetSuccess(result, "SLAM Integration dataset check passed, see SLAMBenchmarkTest for the replay");
 }
 
 //------------------------------------------------------------------------------
@@ -864,6 +1227,11 @@ PerformanceTest::PerformanceTest(const std::string& component_name, const std::s
       test_data_path_(test_data_path),
       iterations_(iterations)
 {
+    // Timings are only meaningful without other tests competing for the cores
+    AddResource(kTestResourceExclusive);
+    if (component_name_ == "TPUFeatureExtractor") {
+        AddResource(kTestResourceTpu);
+    }
 }
 
 PerformanceTest::~PerformanceTest()
@@ -944,4 +1312,1059 @@ void PerformanceTest::Execute(TestResult& result)
     }
 }
 
+//------------------------------------------------------------------------------
+// BenchmarkDataset Implementation
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Splits a CSV row into fields, false for comments and empty lines
+bool splitCsvLine(std::string line, std::vector<std::string>& fields)
+{
+    fields.clear();
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+        return false;
+    }
+    
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, ',')) {
+        const size_t begin = field.find_first_not_of(' ');
+        fields.push_back(begin == std::string::npos ? std::string() : field.substr(begin));
+    }
+    return !fields.empty();
+}
+
+// Reads the rows of a CSV whose first column is a timestamp in nanoseconds
+bool readCsv(const std::string& path, size_t min_fields, std::vector<std::vector<std::string>>& rows)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    rows.clear();
+    std::string line;
+    std::vector<std::string> fields;
+    while (std::getline(file, line)) {
+        if (splitCsvLine(line, fields) && fields.size() >= min_fields) {
+            rows.push_back(fields);
+        }
+    }
+    return true;
+}
+
+double nanosecondsToSeconds(const std::string& field)
+{
+    return static_cast<double>(std::stoull(field)) * 1e-9;
+}
+
+bool fileExists(const std::string& path)
+{
+    std::ifstream file(path);
+    return file.is_open();
+}
+
+// Index of the pose nearest in time, or -1 if further than max_diff
+long nearestPose(const std::vector<TrajectoryPose>& poses, double timestamp, double max_diff)
+{
+    auto it = std::lower_bound(poses.begin(), poses.end(), timestamp,
+                               [](const TrajectoryPose& pose, double t) { return pose.timestamp < t; });
+    long best = -1;
+    double best_diff = max_diff;
+    if (it != poses.end() && it->timestamp - timestamp <= best_diff) {
+        best = it - poses.begin();
+        best_diff = it->timestamp - timestamp;
+    }
+    if (it != poses.begin() && timestamp - (it - 1)->timestamp <= best_diff) {
+        best = (it - 1) - poses.begin();
+    }
+    return best;
+}
+
+double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+std::string jsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Numbers of a flat object, e.g. "metrics": { "name": 1.0, ... }
+bool readJsonNumbers(const std::string& json, const std::string& key, std::map<std::string, double>& values)
+{
+    const size_t begin = json.find("\"" + key + "\"");
+    if (begin == std::string::npos) {
+        return false;
+    }
+    const size_t open = json.find('{', begin);
+    const size_t close = json.find('}', open);
+    if (open == std::string::npos || close == std::string::npos) {
+        return false;
+    }
+    
+    values.clear();
+    const std::string body = json.substr(open + 1, close - open - 1);
+    static const std::regex entry("\"([^\"]+)\"\\s*:\\s*(-?[0-9][0-9.eE+-]*)");
+    for (std::sregex_iterator it(body.begin(), body.end(), entry), end; it != end; ++it) {
+        values[(*it)[1].str()] = std::stod((*it)[2].str());
+    }
+    return !values.empty();
+}
+
+// Number of a top level field, e.g. "runs": 5
+bool readJsonNumber(const std::string& json, const std::string& key, double& value)
+{
+    const std::regex field("\"" + key + "\"\\s*:\\s*(-?[0-9][0-9.eE+-]*)");
+    std::smatch match;
+    if (!std::regex_search(json, match, field)) {
+        return false;
+    }
+    value = std::stod(match[1].str());
+    return true;
+}
+
+bool readFile(const std::string& filename, std::string& contents)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+} // namespace
+
+BenchmarkDataset::BenchmarkDataset()
+    : camera_count_(0)
+{
+}
+
+BenchmarkDataset::~BenchmarkDataset()
+{
+}
+
+bool BenchmarkDataset::Load(const std::string& path, BenchmarkDatasetFormat format, int max_cameras)
+{
+    frame_sets_.clear();
+    imu_samples_.clear();
+    groundtruth_.clear();
+    capture_.reset();
+    camera_count_ = 0;
+    
+    std::string trimmed = path;
+    while (trimmed.size() > 1 && trimmed.back() == '/') {
+        trimmed.pop_back();
+    }
+    const size_t slash = trimmed.find_last_of('/');
+    name_ = slash == std::string::npos ? trimmed : trimmed.substr(slash + 1);
+    
+    switch (format) {
+        case BenchmarkDatasetFormat::EUROC:
+            return loadAsl(trimmed, "state_groundtruth_estimate0", max_cameras);
+        case BenchmarkDatasetFormat::TUM_VI:
+            return loadAsl(trimmed, "mocap0", max_cameras);
+        case BenchmarkDatasetFormat::CAPTURE_FILE:
+            return loadCapture(trimmed, max_cameras);
+    }
+    return false;
+}
+
+bool BenchmarkDataset::loadAsl(const std::string& path, const std::string& groundtruth_dir, int max_cameras)
+{
+    const std::string mav = path + "/mav0";
+    
+    // cam0, cam1, ... up to the first one missing
+    std::vector<std::vector<std::pair<double, std::string>>> cameras;
+    std::vector<std::vector<std::string>> rows;
+    while (max_cameras <= 0 || static_cast<int>(cameras.size()) < max_cameras) {
+        const std::string camera_dir = mav + "/cam" + std::to_string(cameras.size());
+        if (!readCsv(camera_dir + "/data.csv", 2, rows)) {
+            break;
+        }
+        
+        std::vector<std::pair<double, std::string>> images;
+        images.reserve(rows.size());
+        for (const auto& row : rows) {
+            images.emplace_back(nanosecondsToSeconds(row[0]), camera_dir + "/data/" + row[1]);
+        }
+        std::sort(images.begin(), images.end());
+        cameras.push_back(std::move(images));
+    }
+    
+    if (cameras.empty() || cameras[0].empty()) {
+        last_error_message_ = "No camera images in " + mav;
+        return false;
+    }
+    camera_count_ = static_cast<int>(cameras.size());
+    
+    // Stereo images of both datasets are triggered together, a set needs every camera within 1 ms
+    for (const auto& reference : cameras[0]) {
+        FrameSet set;
+        set.timestamp = reference.first;
+        set.image_paths.push_back(reference.second);
+        for (size_t c = 1; c < cameras.size(); ++c) {
+            auto it = std::lower_bound(cameras[c].begin(), cameras[c].end(), std::make_pair(reference.first - 1e-3, std::string()));
+            if (it == cameras[c].end() || it->first > reference.first + 1e-3) {
+                break;
+            }
+            set.image_paths.push_back(it->second);
+        }
+        if (set.image_paths.size() == cameras.size()) {
+            frame_sets_.push_back(std::move(set));
+        }
+    }
+    
+    // timestamp, w_x, w_y, w_z, a_x, a_y, a_z
+    if (readCsv(mav + "/imu0/data.csv", 7, rows)) {
+        imu_samples_.reserve(rows.size());
+        for (const auto& row : rows) {
+            CaptureImuSample sample;
+            sample.timestamp = nanosecondsToSeconds(row[0]);
+            for (int i = 0; i < 3; ++i) {
+                sample.gyro[i] = std::stof(row[1 + i]);
+                sample.acc[i] = std::stof(row[4 + i]);
+            }
+            imu_samples_.push_back(sample);
+        }
+        std::sort(imu_samples_.begin(), imu_samples_.end(),
+                  [](const CaptureImuSample& a, const CaptureImuSample& b) { return a.timestamp < b.timestamp; });
+    }
+    
+    const std::string groundtruth_path = mav + "/" + groundtruth_dir + "/data.csv";
+    if (fileExists(groundtruth_path) && !loadGroundTruth(groundtruth_path)) {
+        return false;
+    }
+    return true;
+}
+
+bool BenchmarkDataset::loadCapture(const std::string& path, int max_cameras)
+{
+    capture_.reset(new FrameCaptureReader());
+    if (!capture_->Open(path)) {
+        last_error_message_ = capture_->GetLastErrorMessage();
+        capture_.reset();
+        return false;
+    }
+    
+    const std::vector<CaptureCameraInfo>& cameras = capture_->GetCameras();
+    camera_count_ = static_cast<int>(cameras.size());
+    if (max_cameras > 0) {
+        camera_count_ = std::min(camera_count_, max_cameras);
+    }
+    if (camera_count_ == 0) {
+        last_error_message_ = "No cameras in " + path;
+        return false;
+    }
+    
+    // Frames of one exposure are published together, a set is closed by a repeated camera or a gap
+    const double max_skew = 0.5 / std::max(1, cameras[0].fps);
+    FrameSet pending;
+    pending.capture_frames.assign(camera_count_, SIZE_MAX);
+    int filled = 0;
+    CaptureFrame frame;
+    for (size_t i = 0; i < capture_->GetFrameCount(); ++i) {
+        if (!capture_->GetFrame(i, frame) || frame.camera_id < 0 || frame.camera_id >= camera_count_) {
+            continue;
+        }
+        
+        if (filled > 0 && (pending.capture_frames[frame.camera_id] != SIZE_MAX ||
+                           std::abs(frame.timestamp - pending.timestamp) > max_skew)) {
+            pending.capture_frames.assign(camera_count_, SIZE_MAX);
+            filled = 0;
+        }
+        if (filled == 0) {
+            pending.timestamp = frame.timestamp;
+        }
+        
+        pending.capture_frames[frame.camera_id] = i;
+        pending.timestamp = std::min(pending.timestamp, frame.timestamp);
+        if (++filled == camera_count_) {
+            frame_sets_.push_back(pending);
+            pending.capture_frames.assign(camera_count_, SIZE_MAX);
+            filled = 0;
+        }
+    }
+    
+    imu_samples_ = capture_->GetImuSamples();
+    
+    const std::string groundtruth_path = path + ".groundtruth.csv";
+    if (fileExists(groundtruth_path) && !loadGroundTruth(groundtruth_path)) {
+        return false;
+    }
+    return true;
+}
+
+bool BenchmarkDataset::loadGroundTruth(const std::string& csv_path)
+{
+    // timestamp, p_x, p_y, p_z, q_w, q_x, q_y, q_z, then velocities and biases for EuRoC
+    std::vector<std::vector<std::string>> rows;
+    if (!readCsv(csv_path, 8, rows)) {
+        last_error_message_ = "Failed to read ground truth " + csv_path;
+        return false;
+    }
+    
+    groundtruth_.reserve(rows.size());
+    for (const auto& row : rows) {
+        TrajectoryPose pose;
+        pose.timestamp = nanosecondsToSeconds(row[0]);
+        pose.position = Eigen::Vector3d(std::stod(row[1]), std::stod(row[2]), std::stod(row[3]));
+        pose.rotation = Eigen::Quaterniond(std::stod(row[4]), std::stod(row[5]), std::stod(row[6]), std::stod(row[7])).normalized();
+        groundtruth_.push_back(pose);
+    }
+    std::sort(groundtruth_.begin(), groundtruth_.end(),
+              [](const TrajectoryPose& a, const TrajectoryPose& b) { return a.timestamp < b.timestamp; });
+    return true;
+}
+
+std::string BenchmarkDataset::GetName() const
+{
+    return name_;
+}
+
+int BenchmarkDataset::GetCameraCount() const
+{
+    return camera_count_;
+}
+
+const std::vector<BenchmarkDataset::FrameSet>& BenchmarkDataset::GetFrameSets() const
+{
+    return frame_sets_;
+}
+
+bool BenchmarkDataset::LoadImages(size_t index, std::vector<cv::Mat>& images) const
+{
+    if (index >= frame_sets_.size()) {
+        return false;
+    }
+    
+    const FrameSet& set = frame_sets_[index];
+    images.resize(camera_count_);
+    for (int c = 0; c < camera_count_; ++c) {
+        if (capture_) {
+            // GREY frames, wrapped without a copy
+            CaptureFrame frame;
+            if (!capture_->GetFrame(set.capture_frames[c], frame) || frame.height <= 0 ||
+                frame.size < static_cast<size_t>(frame.width) * frame.height) {
+                return false;
+            }
+            images[c] = cv::Mat(frame.height, frame.width, CV_8UC1, const_cast<void*>(frame.data),
+                                frame.size / frame.height);
+        } else {
+            images[c] = cv::imread(set.image_paths[c], cv::IMREAD_GRAYSCALE);
+            if (images[c].empty()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const std::vector<CaptureImuSample>& BenchmarkDataset::GetImuSamples() const
+{
+    return imu_samples_;
+}
+
+const std::vector<TrajectoryPose>& BenchmarkDataset::GetGroundTruth() const
+{
+    return groundtruth_;
+}
+
+std::string BenchmarkDataset::GetLastErrorMessage() const
+{
+    return last_error_message_;
+}
+
+//------------------------------------------------------------------------------
+// Trajectory error and resource usage
+//------------------------------------------------------------------------------
+
+TrajectoryError ComputeTrajectoryError(const std::vector<TrajectoryPose>& estimate,
+                                       const std::vector<TrajectoryPose>& groundtruth,
+                                       bool align_scale, double rpe_delta_s,
+                                       double max_time_diff_s)
+{
+    TrajectoryError error;
+    
+    std::vector<size_t> est_index;
+    std::vector<size_t> gt_index;
+    for (size_t i = 0; i < estimate.size(); ++i) {
+        const long match = nearestPose(groundtruth, estimate[i].timestamp, max_time_diff_s);
+        if (match >= 0) {
+            est_index.push_back(i);
+            gt_index.push_back(static_cast<size_t>(match));
+        }
+    }
+    
+    const size_t n = est_index.size();
+    if (n < 3) {
+        return error;
+    }
+    
+    // The estimate lives in the map frame, align it to the ground truth frame
+    Eigen::Matrix3Xd src(3, n);
+    Eigen::Matrix3Xd dst(3, n);
+    for (size_t k = 0; k < n; ++k) {
+        src.col(k) = estimate[est_index[k]].position;
+        dst.col(k) = groundtruth[gt_index[k]].position;
+    }
+    const Eigen::Matrix4d alignment = Eigen::umeyama(src, dst, align_scale);
+    const Eigen::Matrix3d sR = alignment.topLeftCorner<3, 3>();
+    const Eigen::Vector3d t = alignment.topRightCorner<3, 1>();
+    
+    error.matched_poses = n;
+    error.scale = sR.col(0).norm();
+    
+    double sum_sq = 0.0;
+    for (size_t k = 0; k < n; ++k) {
+        const double e = (sR * src.col(k) + t - dst.col(k)).norm();
+        sum_sq += e * e;
+        error.ate_max_m = std::max(error.ate_max_m, e);
+    }
+    error.ate_rmse_m = std::sqrt(sum_sq / n);
+    
+    // Motion between poses rpe_delta_s apart, in the frame of the first pose
+    double trans_sq = 0.0;
+    double rot_sq = 0.0;
+    size_t j = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const TrajectoryPose& est_i = estimate[est_index[i]];
+        j = std::max(j, i + 1);
+        while (j < n && estimate[est_index[j]].timestamp < est_i.timestamp + rpe_delta_s) {
+            ++j;
+        }
+        if (j >= n) {
+            break;
+        }
+        
+        const TrajectoryPose& est_j = estimate[est_index[j]];
+        const TrajectoryPose& gt_i = groundtruth[gt_index[i]];
+        const TrajectoryPose& gt_j = groundtruth[gt_index[j]];
+        
+        const Eigen::Vector3d est_delta = error.scale * (est_i.rotation.conjugate() * (est_j.position - est_i.position));
+        const Eigen::Vector3d gt_delta = gt_i.rotation.conjugate() * (gt_j.position - gt_i.position);
+        const Eigen::Quaterniond est_rot = est_i.rotation.conjugate() * est_j.rotation;
+        const Eigen::Quaterniond gt_rot = gt_i.rotation.conjugate() * gt_j.rotation;
+        
+        const double trans = (est_delta - gt_delta).norm();
+        const double rot = est_rot.angularDistance(gt_rot) * 180.0 / M_PI;
+        trans_sq += trans * trans;
+        rot_sq += rot * rot;
+        error.rpe_pairs++;
+    }
+    if (error.rpe_pairs > 0) {
+        error.rpe_trans_rmse_m = std::sqrt(trans_sq / error.rpe_pairs);
+        error.rpe_rot_rmse_deg = std::sqrt(rot_sq / error.rpe_pairs);
+    }
+    
+    return error;
+}
+
+double GetPeakRssMb()
+{
+    // VmHWM follows clear_refs resets, ru_maxrss only ever grows
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stod(line.substr(6)) / 1024.0;
+        }
+    }
+    
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss / 1024.0;
+    }
+    return 0.0;
+}
+
+bool ResetPeakRss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if (!clear_refs.is_open()) {
+        return false;
+    }
+    clear_refs << "5";
+    return static_cast<bool>(clear_refs.flush());
+}
+
+bool GetAllocationCounts(uint64_t& process, uint64_t& thread)
+{
+#if defined(ENABLE_ALLOCATION_COUNTING) && defined(__GLIBC__)
+    process = g_process_allocations.load(std::memory_order_relaxed);
+    thread = t_thread_allocations;
+    return true;
+#else
+    process = 0;
+    thread = 0;
+    return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// SLAMBenchmarkTest Implementation
+//------------------------------------------------------------------------------
+
+SLAMBenchmarkTest::SLAMBenchmarkTest(const Options& options)
+    : TestCase("SLAMBenchmarkTest", "Replay a dataset through the full SLAM system and compare with a baseline"),
+      options_(options)
+{
+    AddResource(kTestResourceExclusive);
+    AddResource(kTestResourceTpu);
+}
+
+SLAMBenchmarkTest::~SLAMBenchmarkTest()
+{
+}
+
+const std::map<std::string, double>& SLAMBenchmarkTest::GetMetrics() const
+{
+    return metrics_;
+}
+
+void SLAMBenchmarkTest::Execute(TestResult& result)
+{
+    metrics_.clear();
+    
+    BenchmarkDataset dataset;
+    if (!dataset.Load(options_.dataset_path, options_.format, options_.max_cameras)) {
+        SetFailure(result, "Failed to load dataset: " + dataset.GetLastErrorMessage());
+        return;
+    }
+    if (options_.system.use_imu && dataset.GetImuSamples().empty()) {
+        SetFailure(result, "IMU enabled but the dataset has no IMU samples: " + options_.dataset_path);
+        return;
+    }
+    
+    const std::vector<BenchmarkDataset::FrameSet>& frame_sets = dataset.GetFrameSets();
+    size_t frame_count = frame_sets.size();
+    if (options_.max_frames > 0) {
+        frame_count = std::min(frame_count, static_cast<size_t>(options_.max_frames));
+    }
+    Log(result, "Dataset " + dataset.GetName() + ": " + std::to_string(frame_count) + " frame sets of " +
+                std::to_string(dataset.GetCameraCount()) + " cameras");
+    
+    if (!ResetPeakRss()) {
+        Log(result, "Peak RSS cannot be reset, it includes earlier allocations of the process");
+    }
+    
+    VRSLAMSystem system(options_.system);
+    if (!system.Initialize()) {
+        SetFailure(result, "Failed to initialize the SLAM system");
+        return;
+    }
+    
+    const std::vector<CaptureImuSample>& imu = dataset.GetImuSamples();
+    size_t next_imu = 0;
+    std::vector<cv::Mat> images;
+    std::vector<double> frame_times_ms;
+    frame_times_ms.reserve(frame_count);
+    std::vector<TrajectoryPose> trajectory;
+    trajectory.reserve(frame_count);
+    std::vector<double> frame_allocations;
+    frame_allocations.reserve(frame_count);
+    double keypoints_sum = 0.0;
+    double tracked_points_sum = 0.0;
+    double busy_s = 0.0;
+    int failed_frames = 0;
+    
+    uint64_t process_allocations_start = 0;
+    uint64_t thread_allocations = 0;
+    const bool count_allocations = GetAllocationCounts(process_allocations_start, thread_allocations);
+    
+    const auto replay_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < frame_count; ++i) {
+        // Decode outside the timed region
+        if (!dataset.LoadImages(i, images)) {
+            SetFailure(result, "Failed to load frame set " + std::to_string(i));
+            system.Shutdown();
+            return;
+        }
+        
+        const double timestamp = frame_sets[i].timestamp;
+        if (options_.realtime) {
+            std::this_thread::sleep_until(replay_start + std::chrono::duration<double>(timestamp - frame_sets[0].timestamp));
+        }
+        
+        uint64_t process_allocations = 0;
+        uint64_t thread_allocations_start = 0;
+        GetAllocationCounts(process_allocations, thread_allocations_start);
+        const double start = LatencyNowSeconds();
+        if (options_.system.use_imu) {
+            for (; next_imu < imu.size() && imu[next_imu].timestamp <= timestamp; ++next_imu) {
+                const CaptureImuSample& sample = imu[next_imu];
+                system.ProcessIMU(Eigen::Vector3f(sample.gyro[0], sample.gyro[1], sample.gyro[2]),
+                                  Eigen::Vector3f(sample.acc[0], sample.acc[1], sample.acc[2]),
+                                  sample.timestamp);
+            }
+        }
+        if (!system.ProcessFrame(images, timestamp)) {
+            failed_frames++;
+        }
+        const double elapsed = LatencyNowSeconds() - start;
+        GetAllocationCounts(process_allocations, thread_allocations);
+        busy_s += elapsed;
+        frame_times_ms.push_back(elapsed * 1000.0);
+        frame_allocations.push_back(static_cast<double>(thread_allocations - thread_allocations_start));
+        
+        int keypoints = 0;
+        int tracked_points = 0;
+        system.GetFrameSetFeatureCounts(keypoints, tracked_points);
+        keypoints_sum += keypoints;
+        tracked_points_sum += tracked_points;
+        
+        // Store the tracked pose as world-from-camera, like the ground truth
+        if (system.GetStatus() == VRSLAMSystem::Status::TRACKING) {
+            const VRSLAMSystem::PoseSnapshot snapshot = system.GetPoseSnapshot();
+            if (trajectory.empty() || snapshot.timestamp > trajectory.back().timestamp) {
+                const Sophus::SE3d Twc = snapshot.pose.cast<double>().inverse();
+                TrajectoryPose pose;
+                pose.timestamp = snapshot.timestamp;
+                pose.position = Twc.translation();
+                pose.rotation = Twc.unit_quaternion();
+                trajectory.push_back(pose);
+            }
+        }
+    }
+    
+    uint64_t process_allocations_end = 0;
+    GetAllocationCounts(process_allocations_end, thread_allocations);
+    const VRSLAMSystem::PerformanceMetrics performance = system.GetPerformanceMetrics();
+    system.Shutdown();
+    
+    metrics_["frames_processed"] = static_cast<double>(frame_count - failed_frames);
+    metrics_["throughput_fps"] = busy_s > 0.0 ? (frame_count - failed_frames) / busy_s : 0.0;
+    metrics_["frame_time_p50_ms"] = percentile(frame_times_ms, 0.50);
+    metrics_["frame_time_p99_ms"] = percentile(frame_times_ms, 0.99);
+    metrics_["tracking_percentage"] = performance.tracking_percentage;
+    metrics_["tracking_lost_count"] = performance.tracking_lost_count;
+    if (frame_count > 0) {
+        metrics_["features.keypoints_per_frame"] = keypoints_sum / frame_count;
+        metrics_["features.tracked_points_per_frame"] = tracked_points_sum / frame_count;
+    }
+    
+    // The frame thread runs extraction and tracking, the process adds the mapping threads
+    if (count_allocations && frame_count > 0) {
+        metrics_["allocations.frame_thread.p50_per_frame"] = percentile(frame_allocations, 0.50);
+        metrics_["allocations.frame_thread.p99_per_frame"] = percentile(frame_allocations, 0.99);
+        metrics_["allocations.process_per_frame"] =
+            static_cast<double>(process_allocations_end - process_allocations_start) / frame_count;
+    }
+    
+    for (size_t s = 0; s < kNumLatencyStages; ++s) {
+        const LatencyPercentiles& stage = performance.stage_latency[s];
+        if (stage.count == 0) {
+            continue;
+        }
+        const std::string prefix = std::string("latency.") + GetLatencyStageName(static_cast<LatencyStage>(s));
+        metrics_[prefix + ".p50_ms"] = stage.p50_ms;
+        metrics_[prefix + ".p99_ms"] = stage.p99_ms;
+        metrics_[prefix + ".p999_ms"] = stage.p999_ms;
+        metrics_[prefix + ".max_ms"] = stage.max_ms;
+    }
+    if (performance.end_to_end_latency.count > 0) {
+        metrics_["latency.end_to_end.p50_ms"] = performance.end_to_end_latency.p50_ms;
+        metrics_["latency.end_to_end.p99_ms"] = performance.end_to_end_latency.p99_ms;
+        metrics_["latency.end_to_end.p999_ms"] = performance.end_to_end_latency.p999_ms;
+    }
+
+    // Energy per frame set and per keyframe, a keyframe being a LocalMapping span plus the
+    // CreateNewKeyFrame span of the tracking that inserted it
+    const double frames = static_cast<double>(std::max<size_t>(frame_count - failed_frames, 1));
+    for (const RailEnergy& rail : performance.rail_energy) {
+        const std::string prefix = "energy." + rail.name;
+        metrics_[prefix + ".mj_per_frame"] = rail.energyMj / frames;
+        metrics_[prefix + ".idle_mj_per_frame"] = rail.idleMj / frames;
+        metrics_[prefix + ".average_mw"] = rail.averagePowerMw;
+
+        double keyframe_mj = 0.0;
+        uint64_t keyframes = 0;
+        for (const StageEnergy& stage : performance.stage_energy) {
+            if (stage.rail != rail.name) {
+                continue;
+            }
+            if (stage.name == "LocalMapping") {
+                keyframes = stage.nSpans;
+                keyframe_mj += stage.energyMj;
+            } else if (stage.name == "CreateNewKeyFrame") {
+                keyframe_mj += stage.energyMj;
+            }
+            if (rail.name == performance.rail_energy.front().name) {
+                metrics_["energy.stage." + stage.name + ".mj_per_frame"] = stage.energyMj / frames;
+            }
+        }
+        if (keyframes > 0) {
+            metrics_[prefix + ".mj_per_keyframe"] = keyframe_mj / keyframes;
+        }
+    }
+    if (!performance.rail_energy.empty()) {
+        metrics_["energy_mj_per_frame"] = performance.rail_energy.front().energyMj / frames;
+    }
+
+    if (!dataset.GetGroundTruth().empty()) {
+        // A single camera without IMU has no metric scale
+        const bool align_scale = dataset.GetCameraCount() == 1 && !options_.system.use_imu;
+        const TrajectoryError error = ComputeTrajectoryError(trajectory, dataset.GetGroundTruth(),
+                                                             align_scale, options_.rpe_delta_s);
+        if (error.matched_poses == 0) {
+            Log(result, "No tracked pose matched the ground truth");
+        } else {
+            metrics_["trajectory_matched_poses"] = static_cast<double>(error.matched_poses);
+            metrics_["ate_rmse_m"] = error.ate_rmse_m;
+            metrics_["ate_max_m"] = error.ate_max_m;
+            if (error.rpe_pairs > 0) {
+                metrics_["rpe_trans_rmse_m"] = error.rpe_trans_rmse_m;
+                metrics_["rpe_rot_rmse_deg"] = error.rpe_rot_rmse_deg;
+            }
+        }
+    }
+    
+    metrics_["peak_rss_mb"] = GetPeakRssMb();
+    
+    for (const auto& metric : metrics_) {
+        Log(result, "  " + metric.first + ": " + std::to_string(metric.second));
+    }
+    
+    if (!options_.output_path.empty() && !WriteMetrics(options_.output_path, dataset.GetName(), metrics_)) {
+        SetFailure(result, "Failed to write metrics to " + options_.output_path);
+        return;
+    }
+    
+    if (!options_.baseline_path.empty() && !compareWithBaseline(result)) {
+        return;
+    }
+    
+    SetSuccess(result, "Benchmark of " + dataset.GetName() + " completed at " +
+                       std::to_string(metrics_["throughput_fps"]) + " fps");
+}
+
+bool SLAMBenchmarkTest::compareWithBaseline(TestResult& result)
+{
+    std::map<std::string, double> baseline;
+    if (!ReadMetrics(options_.baseline_path, baseline)) {
+        SetFailure(result, "Failed to read baseline " + options_.baseline_path);
+        return false;
+    }
+    
+    int regressions = 0;
+    for (const auto& entry : baseline) {
+        auto current = metrics_.find(entry.first);
+        if (current == metrics_.end()) {
+            Log(result, "Baseline metric not measured: " + entry.first);
+            continue;
+        }
+        
+        const double worse = IsHigherBetter(entry.first) ? entry.second - current->second
+                                                         : current->second - entry.second;
+        const double allowed = std::max(options_.relative_tolerance * std::abs(entry.second), options_.absolute_tolerance);
+        if (worse > allowed) {
+            Log(result, "Regression in " + entry.first + ": " + std::to_string(entry.second) +
+                        " -> " + std::to_string(current->second));
+            regressions++;
+        } else if (-worse > allowed) {
+            Log(result, "Improvement in " + entry.first + ": " + std::to_string(entry.second) +
+                        " -> " + std::to_string(current->second));
+        }
+    }
+    
+    if (regressions > 0) {
+        SetFailure(result, std::to_string(regressions) + " metrics regressed against " + options_.baseline_path);
+        return false;
+    }
+    return true;
+}
+
+bool SLAMBenchmarkTest::WriteMetrics(const std::string& filename, const std::string& dataset,
+                                     const std::map<std::string, double>& metrics)
+{
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    file << "{" << std::endl;
+    file << "  \"dataset\": \"" << jsonEscape(dataset) << "\"," << std::endl;
+    file << "  \"metrics\": {" << std::endl;
+    file << std::setprecision(9);
+    size_t written = 0;
+    for (const auto& metric : metrics) {
+        const double value = std::isfinite(metric.second) ? metric.second : 0.0;
+        file << "    \"" << metric.first << "\": " << value << (++written < metrics.size() ? "," : "") << std::endl;
+    }
+    file << "  }" << std::endl;
+    file << "}" << std::endl;
+    return static_cast<bool>(file);
+}
+
+bool SLAMBenchmarkTest::ReadMetrics(const std::string& filename, std::map<std::string, double>& metrics)
+{
+    std::string json;
+    if (!readFile(filename, json)) {
+        return false;
+    }
+    
+    // Only the flat "metrics" object written by WriteMetrics() is understood
+    return readJsonNumbers(json, "metrics", metrics);
+}
+
+bool SLAMBenchmarkTest::IsHigherBetter(const std::string& metric)
+{
+    return metric == "throughput_fps" || metric == "tracking_percentage" ||
+           metric == "frames_processed" || metric == "trajectory_matched_poses" ||
+           metric.compare(0, 9, "features.") == 0;
+}
+
+
+//------------------------------------------------------------------------------
+// GoldenTraceTest Implementation
+//------------------------------------------------------------------------------
+
+GoldenTraceTest::GoldenTraceTest(const Options& options)
+    : TestCase("GoldenTraceTest", "Replay a recording and compare its performance profile with a golden one"),
+      options_(options)
+{
+    AddResource(kTestResourceExclusive);
+    AddResource(kTestResourceTpu);
+}
+
+GoldenTraceTest::~GoldenTraceTest()
+{
+}
+
+const GoldenTraceTest::Profile& GoldenTraceTest::GetProfile() const
+{
+    return profile_;
+}
+
+void GoldenTraceTest::Execute(TestResult& result)
+{
+    profile_ = Profile();
+    if (options_.runs < 1) {
+        SetFailure(result, "At least one replay is needed");
+        return;
+    }
+    
+    BenchmarkDataset dataset;
+    if (!dataset.Load(options_.benchmark.dataset_path, options_.benchmark.format, options_.benchmark.max_cameras)) {
+        SetFailure(result, "Failed to load dataset: " + dataset.GetLastErrorMessage());
+        return;
+    }
+    
+    // Fed as fast as the system takes them, paced replays would measure the recorded rate
+    SLAMBenchmarkTest::Options benchmark = options_.benchmark;
+    benchmark.realtime = false;
+    benchmark.output_path.clear();
+    benchmark.baseline_path.clear();
+    
+    std::map<std::string, std::vector<double>> samples;
+    for (int run = 0; run < options_.runs; ++run) {
+        // Every replay draws the same random samples with the same thread pools
+        std::srand(options_.seed);
+        cv::setRNGSeed(static_cast<int>(options_.seed));
+        cv::setNumThreads(benchmark.system.num_threads);
+        
+        SLAMBenchmarkTest replay(benchmark);
+        const TestResult replay_result = replay.Run(true);
+        if (!replay_result.success) {
+            SetFailure(result, "Replay " + std::to_string(run + 1) + " failed: " + replay_result.message);
+            return;
+        }
+        for (const auto& metric : replay.GetMetrics()) {
+            samples[metric.first].push_back(metric.second);
+        }
+    }
+    
+    profile_.dataset = dataset.GetName();
+    profile_.runs = options_.runs;
+    profile_.seed = options_.seed;
+    profile_.threads = benchmark.system.num_threads;
+    for (const auto& metric : samples) {
+        const std::vector<double>& values = metric.second;
+        MetricStats& stats = profile_.metrics[metric.first];
+        stats.mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+        if (values.size() > 1) {
+            double sq_sum = 0.0;
+            for (double value : values) {
+                sq_sum += (value - stats.mean) * (value - stats.mean);
+            }
+            stats.stddev = std::sqrt(sq_sum / (values.size() - 1));
+        }
+    }
+    
+    if (options_.record) {
+        if (!WriteProfile(options_.golden_path, profile_)) {
+            SetFailure(result, "Failed to write golden profile to " + options_.golden_path);
+            return;
+        }
+        SetSuccess(result, "Recorded " + std::to_string(profile_.metrics.size()) + " metrics over " +
+                           std::to_string(profile_.runs) + " replays to " + options_.golden_path);
+        return;
+    }
+    
+    if (!compareWithGolden(result)) {
+        return;
+    }
+    SetSuccess(result, "Performance of " + profile_.dataset + " matches " + options_.golden_path);
+}
+
+bool GoldenTraceTest::compareWithGolden(TestResult& result)
+{
+    Profile golden;
+    if (!ReadProfile(options_.golden_path, golden)) {
+        SetFailure(result, "Failed to read golden profile " + options_.golden_path);
+        return false;
+    }
+    if (golden.seed != profile_.seed || golden.threads != profile_.threads) {
+        SetFailure(result, "Golden profile measured with seed " + std::to_string(golden.seed) + " and " +
+                           std::to_string(golden.threads) + " threads, replays used seed " +
+                           std::to_string(profile_.seed) + " and " + std::to_string(profile_.threads) + " threads");
+        return false;
+    }
+    
+    // The metrics of a stage share their name up to the last component, e.g. latency.track_done
+    std::map<std::string, std::vector<std::string>> regressed_stages;
+    Log(result, "Golden mean +- stddev -> replay mean +- stddev:");
+    for (const auto& entry : golden.metrics) {
+        const auto current = profile_.metrics.find(entry.first);
+        if (current == profile_.metrics.end()) {
+            Log(result, "  " + entry.first + ": not measured");
+            continue;
+        }
+        
+        const MetricStats& before = entry.second;
+        const MetricStats& after = current->second;
+        const double change = after.mean - before.mean;
+        double worse = SLAMBenchmarkTest::IsHigherBetter(entry.first) ? -change : change;
+        if (entry.first.compare(0, 9, "features.") == 0) {
+            worse = std::abs(change);
+        }
+        
+        // Worse by more than the tolerance, and by more than the noise of the two means
+        const double allowed = std::max(options_.relative_tolerance * std::abs(before.mean), options_.absolute_tolerance);
+        const double standard_error = std::sqrt(before.stddev * before.stddev / std::max(golden.runs, 1) +
+                                                after.stddev * after.stddev / profile_.runs);
+        const bool regressed = worse > allowed && worse > options_.sigma_tolerance * standard_error;
+        
+        std::ostringstream line;
+        line << std::setprecision(4) << "  " << entry.first << ": " << before.mean << " +- " << before.stddev
+             << " -> " << after.mean << " +- " << after.stddev;
+        if (before.mean != 0.0) {
+            line << " (" << std::showpos << 100.0 * change / std::abs(before.mean) << std::noshowpos << "%)";
+        }
+        if (regressed) {
+            line << " REGRESSED";
+            const size_t dot = entry.first.find_last_of('.');
+            const std::string stage = dot == std::string::npos ? entry.first : entry.first.substr(0, dot);
+            regressed_stages[stage].push_back(dot == std::string::npos ? entry.first : entry.first.substr(dot + 1));
+        }
+        Log(result, line.str());
+    }
+    for (const auto& entry : profile_.metrics) {
+        if (golden.metrics.find(entry.first) == golden.metrics.end()) {
+            Log(result, "  " + entry.first + ": not in the golden profile");
+        }
+    }
+    
+    if (!regressed_stages.empty()) {
+        std::string stages;
+        for (const auto& stage : regressed_stages) {
+            std::string metrics;
+            for (const std::string& metric : stage.second) {
+                metrics += (metrics.empty() ? "" : ", ") + metric;
+            }
+            stages += (stages.empty() ? "" : "; ") + stage.first + " (" + metrics + ")";
+        }
+        SetFailure(result, std::to_string(regressed_stages.size()) + " stages regressed against " +
+                           options_.golden_path + ": " + stages);
+        return false;
+    }
+    return true;
+}
+
+bool GoldenTraceTest::WriteProfile(const std::string& filename, const Profile& profile)
+{
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    auto writeObject = [&](const char* key, double MetricStats::*field, bool last) {
+        file << "  \"" << key << "\": {" << std::endl;
+        size_t written = 0;
+        for (const auto& metric : profile.metrics) {
+            const double value = metric.second.*field;
+            file << "    \"" << metric.first << "\": " << (std::isfinite(value) ? value : 0.0)
+                 << (++written < profile.metrics.size() ? "," : "") << std::endl;
+        }
+        file << "  }" << (last ? "" : ",") << std::endl;
+    };
+    
+    file << "{" << std::endl;
+    file << "  \"dataset\": \"" << jsonEscape(profile.dataset) << "\"," << std::endl;
+    file << "  \"runs\": " << profile.runs << "," << std::endl;
+    file << "  \"seed\": " << profile.seed << "," << std::endl;
+    file << "  \"threads\": " << profile.threads << "," << std::endl;
+    file << std::setprecision(9);
+    writeObject("metrics", &MetricStats::mean, false);
+    writeObject("stddev", &MetricStats::stddev, true);
+    file << "}" << std::endl;
+    return static_cast<bool>(file);
+}
+
+bool GoldenTraceTest::ReadProfile(const std::string& filename, Profile& profile)
+{
+    std::string json;
+    if (!readFile(filename, json)) {
+        return false;
+    }
+    
+    double runs = 0.0;
+    double seed = 0.0;
+    double threads = 0.0;
+    std::map<std::string, double> means;
+    std::map<std::string, double> stddevs;
+    if (!readJsonNumber(json, "runs", runs) || !readJsonNumber(json, "seed", seed) ||
+        !readJsonNumber(json, "threads", threads) || !readJsonNumbers(json, "metrics", means)) {
+        return false;
+    }
+    readJsonNumbers(json, "stddev", stddevs);
+    
+    profile = Profile();
+    static const std::regex dataset("\"dataset\"\\s*:\\s*\"((?:[^\"\\\\]|\\\\.)*)\"");
+    std::smatch match;
+    if (std::regex_search(json, match, dataset)) {
+        profile.dataset = std::regex_replace(match[1].str(), std::regex("\\\\(.)"), "$1");
+    }
+    profile.runs = static_cast<int>(runs);
+    profile.seed = static_cast<unsigned int>(seed);
+    profile.threads = static_cast<int>(threads);
+    for (const auto& mean : means) {
+        MetricStats& stats = profile.metrics[mean.first];
+        stats.mean = mean.second;
+        const auto stddev = stddevs.find(mean.first);
+        stats.stddev = stddev != stddevs.end() ? stddev->second : 0.0;
+    }
+    return true;
+}
+
 } // namespace ORB_SLAM3
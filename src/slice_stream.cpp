@@ -0,0 +1,655 @@
+#include "include/slice_stream.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+#if defined(HAVE_ROCKCHIP_MPP)
+    #include <rockchip/rk_mpi.h>
+    #include <rockchip/mpp_buffer.h>
+    #include <rockchip/mpp_frame.h>
+    #include <rockchip/mpp_packet.h>
+    #include <rockchip/rk_venc_cfg.h>
+#endif
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// Largest datagram either end handles, a jumbo frame
+constexpr int kMaxDatagramBytes = 9000;
+
+// Datagrams taken per recvmmsg() call
+constexpr int kReceiveBatch = 16;
+
+constexpr int kMaxEyes = 2;
+constexpr int kMaxSlices = 32;
+
+// Slices between attempts to map a pose region that does not exist yet
+constexpr int kPoseRetrySlices = 256;
+
+// q_a * q_b for quaternions (x, y, z, w)
+void Multiply(const float a[4], const float b[4], float out[4])
+{
+    out[0] = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+    out[1] = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+    out[2] = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+    out[3] = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+}
+
+bool ResolveAddress(const std::string& host, int port, struct sockaddr_in& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    return inet_pton(AF_INET, host.c_str(), &address.sin_addr) == 1;
+}
+
+#if defined(HAVE_ROCKCHIP_MPP)
+
+// H.264 on the RK3588 VPU, one context per slice stream
+class MppSliceEncoder : public SliceEncoder
+{
+public:
+    MppSliceEncoder() : mCtx(nullptr), mApi(nullptr), mCfg(nullptr), mGroup(nullptr) {}
+
+    ~MppSliceEncoder() override
+    {
+        if (mCtx) {
+            mApi->reset(mCtx);
+            mpp_destroy(mCtx);
+        }
+        if (mCfg) {
+            mpp_enc_cfg_deinit(mCfg);
+        }
+        if (mGroup) {
+            mpp_buffer_group_put(mGroup);
+        }
+    }
+
+    bool Init(const SliceEncoderConfig& config)
+    {
+        mConfig = config;
+        if (mpp_create(&mCtx, &mApi) != MPP_OK || mpp_init(mCtx, MPP_CTX_ENC, MPP_VIDEO_CodingAVC) != MPP_OK) {
+            return false;
+        }
+        if (mpp_enc_cfg_init(&mCfg) != MPP_OK || mApi->control(mCtx, MPP_ENC_GET_CFG, mCfg) != MPP_OK) {
+            return false;
+        }
+
+        mpp_enc_cfg_set_s32(mCfg, "prep:width", config.width);
+        mpp_enc_cfg_set_s32(mCfg, "prep:height", config.height);
+        mpp_enc_cfg_set_s32(mCfg, "prep:hor_stride", config.width);
+        mpp_enc_cfg_set_s32(mCfg, "prep:ver_stride", config.height);
+        mpp_enc_cfg_set_s32(mCfg, "prep:format", MPP_FMT_YUV420SP);
+
+        // CBR with a tight window, a slice must not burst past its share of the link
+        mpp_enc_cfg_set_s32(mCfg, "rc:mode", MPP_ENC_RC_MODE_CBR);
+        mpp_enc_cfg_set_s32(mCfg, "rc:bps_target", config.bitrate_bps);
+        mpp_enc_cfg_set_s32(mCfg, "rc:bps_max", config.bitrate_bps * 17 / 16);
+        mpp_enc_cfg_set_s32(mCfg, "rc:bps_min", config.bitrate_bps * 15 / 16);
+        mpp_enc_cfg_set_s32(mCfg, "rc:fps_in_num", config.fps);
+        mpp_enc_cfg_set_s32(mCfg, "rc:fps_in_denom", 1);
+        mpp_enc_cfg_set_s32(mCfg, "rc:fps_out_num", config.fps);
+        mpp_enc_cfg_set_s32(mCfg, "rc:fps_out_denom", 1);
+        mpp_enc_cfg_set_s32(mCfg, "rc:gop", config.gop > 0 ? config.gop : 1 << 30);
+
+        // Baseline-style: no B frames, no reordering delay
+        mpp_enc_cfg_set_s32(mCfg, "codec:type", MPP_VIDEO_CodingAVC);
+        mpp_enc_cfg_set_s32(mCfg, "h264:profile", 66);
+        mpp_enc_cfg_set_s32(mCfg, "h264:level", 42);
+        mpp_enc_cfg_set_s32(mCfg, "h264:cabac_en", 0);
+        if (mApi->control(mCtx, MPP_ENC_SET_CFG, mCfg) != MPP_OK) {
+            return false;
+        }
+
+        // SPS and PPS in front of every IDR, so a receiver can join at any keyframe
+        MppEncHeaderMode header_mode = MPP_ENC_HEADER_MODE_EACH_IDR;
+        if (mApi->control(mCtx, MPP_ENC_SET_HEADER_MODE, &header_mode) != MPP_OK) {
+            return false;
+        }
+
+        return mpp_buffer_group_get_internal(&mGroup, MPP_BUFFER_TYPE_DRM) == MPP_OK;
+    }
+
+    bool Encode(const SliceImage& image, bool force_idr, std::vector<uint8_t>& bitstream, bool& is_idr) override
+    {
+        MppBuffer buffer = nullptr;
+        if (image.dma_fd >= 0) {
+            MppBufferInfo info;
+            std::memset(&info, 0, sizeof(info));
+            info.type = MPP_BUFFER_TYPE_DRM;
+            info.fd = image.dma_fd;
+            info.size = image.size;
+            if (mpp_buffer_import(&buffer, &info) != MPP_OK) {
+                return false;
+            }
+        } else {
+            // No DMA-BUF, copied into a VPU buffer
+            if (!image.data || mpp_buffer_get(mGroup, &buffer, image.size) != MPP_OK) {
+                return false;
+            }
+            std::memcpy(mpp_buffer_get_ptr(buffer), image.data, image.size);
+        }
+
+        if (force_idr) {
+            mApi->control(mCtx, MPP_ENC_SET_IDR_FRAME, nullptr);
+        }
+
+        MppFrame frame = nullptr;
+        mpp_frame_init(&frame);
+        mpp_frame_set_width(frame, image.width);
+        mpp_frame_set_height(frame, image.height);
+        mpp_frame_set_hor_stride(frame, image.hor_stride);
+        mpp_frame_set_ver_stride(frame, image.ver_stride);
+        mpp_frame_set_fmt(frame, MPP_FMT_YUV420SP);
+        mpp_frame_set_buffer(frame, buffer);
+
+        bool ok = mApi->encode_put_frame(mCtx, frame) == MPP_OK;
+        MppPacket packet = nullptr;
+        if (ok) {
+            ok = mApi->encode_get_packet(mCtx, &packet) == MPP_OK && packet;
+        }
+        if (ok) {
+            const uint8_t* data = static_cast<const uint8_t*>(mpp_packet_get_pos(packet));
+            bitstream.assign(data, data + mpp_packet_get_length(packet));
+
+            RK_S32 intra = 0;
+            MppMeta meta = mpp_packet_get_meta(packet);
+            is_idr = meta && mpp_meta_get_s32(meta, KEY_OUTPUT_INTRA, &intra) == MPP_OK && intra;
+            mpp_packet_deinit(&packet);
+        }
+
+        mpp_frame_deinit(&frame);
+        mpp_buffer_put(buffer);
+        return ok;
+    }
+
+private:
+    SliceEncoderConfig mConfig;
+    MppCtx mCtx;
+    MppApi* mApi;
+    MppEncCfg mCfg;
+    MppBufferGroup mGroup;
+};
+
+#endif
+
+} // namespace
+
+std::unique_ptr<SliceEncoder> CreateMppSliceEncoder(const SliceEncoderConfig& config)
+{
+#if defined(HAVE_ROCKCHIP_MPP)
+    std::unique_ptr<MppSliceEncoder> encoder(new MppSliceEncoder());
+    if (!encoder->Init(config)) {
+        std::cerr << "MPP refused a " << config.width << "x" << config.height << " slice encoder" << std::endl;
+        return nullptr;
+    }
+    return encoder;
+#else
+    (void)config;
+    std::cerr << "Built without Rockchip MPP, no hardware slice encoder" << std::endl;
+    return nullptr;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// SliceStreamSender
+//------------------------------------------------------------------------------
+
+SliceStreamSender::SliceStreamSender(const Options& options, EncoderFactory factory)
+    : mValid(false), mOptions(options), mSocket(-1), mSliceHeight(0)
+{
+    const int header = static_cast<int>(sizeof(SlicePacketHeader));
+    if (options.slice_count < 1 || options.slice_count > kMaxSlices || options.eye_width <= 0 ||
+        options.eye_height <= 0 || options.eye_height % (16 * options.slice_count) != 0 ||
+        options.fps <= 0 || options.bitrate_kbps <= 0 || options.max_slice_bytes <= 0 ||
+        options.fragment_payload <= 0 || options.fragment_payload + header > kMaxDatagramBytes ||
+        options.dscp < 0 || options.dscp > 63) {
+        std::cerr << "Invalid slice stream sender options" << std::endl;
+        return;
+    }
+
+    const int max_fragments = (options.max_slice_bytes + options.fragment_payload - 1) / options.fragment_payload;
+    if (max_fragments > 0xFFFF) {
+        std::cerr << "Slice stream max_slice_bytes needs more than 65535 fragments" << std::endl;
+        return;
+    }
+
+    struct sockaddr_in address;
+    if (!ResolveAddress(options.host, options.port, address)) {
+        std::cerr << "Invalid slice stream receiver address: " << options.host << std::endl;
+        return;
+    }
+
+    mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (mSocket < 0) {
+        std::cerr << "Failed to create slice stream socket" << std::endl;
+        return;
+    }
+
+    // DSCP sits in the upper six bits of the TOS byte
+    const int tos = options.dscp << 2;
+    setsockopt(mSocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    // Connected, so sendmmsg() needs no per-message address
+    if (connect(mSocket, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Failed to connect slice stream socket to " << options.host << std::endl;
+        return;
+    }
+
+    mSliceHeight = options.eye_height / options.slice_count;
+
+    SliceEncoderConfig config;
+    config.width = options.eye_width;
+    config.height = mSliceHeight;
+    config.bitrate_bps = static_cast<int>(static_cast<int64_t>(options.bitrate_kbps) * 1000 /
+                                          (kMaxEyes * options.slice_count));
+    config.fps = options.fps;
+    config.gop = options.gop;
+    if (!factory) {
+        factory = CreateMppSliceEncoder;
+    }
+    for (int i = 0; i < kMaxEyes * options.slice_count; ++i) {
+        std::unique_ptr<SliceEncoder> encoder = factory(config);
+        if (!encoder) {
+            return;
+        }
+        mEncoders.push_back(std::move(encoder));
+    }
+
+    // The first frame of every stream is an IDR
+    mForceIdr.assign(mEncoders.size(), 1);
+    mBitstream.reserve(options.max_slice_bytes);
+    mHeaders.resize(max_fragments);
+    mIov.resize(2 * max_fragments);
+    mMessages.resize(max_fragments);
+    for (int i = 0; i < max_fragments; ++i) {
+        std::memset(&mMessages[i], 0, sizeof(mMessages[i]));
+        mMessages[i].msg_hdr.msg_iov = &mIov[2 * i];
+        mMessages[i].msg_hdr.msg_iovlen = 2;
+        mIov[2 * i].iov_base = &mHeaders[i];
+        mIov[2 * i].iov_len = sizeof(SlicePacketHeader);
+    }
+
+    mValid = true;
+}
+
+SliceStreamSender::~SliceStreamSender()
+{
+    if (mSocket >= 0) {
+        close(mSocket);
+    }
+}
+
+bool SliceStreamSender::IsValid() const
+{
+    return mValid;
+}
+
+bool SliceStreamSender::SendSlice(uint64_t frame_id, int eye, int slice, const SliceImage& image,
+                                  const SlicePose& pose, double deadline)
+{
+    if (!mValid || eye < 0 || eye >= kMaxEyes || slice < 0 || slice >= mOptions.slice_count ||
+        image.width != mOptions.eye_width || image.height != mSliceHeight) {
+        return false;
+    }
+
+    // Would reach the display after its scanout, keep the encoder for the next frame
+    const double start = LatencyNowSeconds();
+    if (deadline > 0.0 && start > deadline) {
+        mStats.slices_late++;
+        return false;
+    }
+
+    const size_t stream = static_cast<size_t>(eye * mOptions.slice_count + slice);
+    bool is_idr = false;
+    if (!mEncoders[stream]->Encode(image, mForceIdr[stream] != 0, mBitstream, is_idr) ||
+        mBitstream.empty() || mBitstream.size() > static_cast<size_t>(mOptions.max_slice_bytes)) {
+        mStats.encode_failures++;
+        mForceIdr[stream] = 1;
+        return false;
+    }
+    if (is_idr) {
+        mForceIdr[stream] = 0;
+    }
+
+    const uint32_t encode_us = static_cast<uint32_t>((LatencyNowSeconds() - start) * 1e6);
+    mStats.encode_us_avg = mStats.slices_sent ? (mStats.encode_us_avg * 7 + encode_us) / 8 : encode_us;
+    mStats.encode_us_max = std::max(mStats.encode_us_max, encode_us);
+
+    const size_t payload = static_cast<size_t>(mOptions.fragment_payload);
+    const size_t fragments = (mBitstream.size() + payload - 1) / payload;
+    for (size_t i = 0; i < fragments; ++i) {
+        SlicePacketHeader& header = mHeaders[i];
+        header.magic = kSlicePacketMagic;
+        header.version = kSlicePacketVersion;
+        header.eye = static_cast<uint8_t>(eye);
+        header.flags = is_idr ? kSlicePacketIdr : 0;
+        header.frame_id = frame_id;
+        header.slice_index = static_cast<uint16_t>(slice);
+        header.slice_count = static_cast<uint16_t>(mOptions.slice_count);
+        header.fragment_index = static_cast<uint16_t>(i);
+        header.fragment_count = static_cast<uint16_t>(fragments);
+        header.slice_bytes = static_cast<uint32_t>(mBitstream.size());
+        header.fragment_offset = static_cast<uint32_t>(i * payload);
+        std::memcpy(header.render_rotation, pose.rotation, sizeof(header.render_rotation));
+        std::memcpy(header.render_translation, pose.translation, sizeof(header.render_translation));
+        header.encode_us = encode_us;
+        header.render_timestamp = pose.timestamp;
+
+        mIov[2 * i + 1].iov_base = mBitstream.data() + i * payload;
+        mIov[2 * i + 1].iov_len = std::min(payload, mBitstream.size() - i * payload);
+    }
+
+    // Fragments the socket buffer did not take are resent from where it stopped
+    size_t sent = 0;
+    while (sent < fragments) {
+        const int count = sendmmsg(mSocket, &mMessages[sent], static_cast<unsigned int>(fragments - sent), 0);
+        if (count <= 0) {
+            mStats.send_failures++;
+            mForceIdr[stream] = 1;
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+
+    mStats.slices_sent++;
+    mStats.fragments_sent += fragments;
+    mStats.bytes_sent += mBitstream.size() + fragments * sizeof(SlicePacketHeader);
+    return true;
+}
+
+void SliceStreamSender::RequestKeyframe(int eye, int slice)
+{
+    if (mValid && eye >= 0 && eye < kMaxEyes && slice >= 0 && slice < mOptions.slice_count) {
+        mForceIdr[eye * mOptions.slice_count + slice] = 1;
+    }
+}
+
+SliceStreamSender::Stats SliceStreamSender::GetStats() const
+{
+    return mStats;
+}
+
+//------------------------------------------------------------------------------
+// SliceStreamReceiver
+//------------------------------------------------------------------------------
+
+SliceStreamReceiver::SliceStreamReceiver(const Options& options)
+    : mValid(false), mOptions(options), mSocket(-1), mPort(0), mAge(0),
+      mLatestRotation{0.0f, 0.0f, 0.0f, 1.0f}, mPoseRetry(0)
+{
+    if (options.port < 0 || options.port > 0xFFFF || options.reassembly_slots < 1 ||
+        options.reassembly_slots > 1024 || options.max_slice_bytes <= 0) {
+        std::cerr << "Invalid slice stream receiver options" << std::endl;
+        return;
+    }
+
+    mSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (mSocket < 0) {
+        std::cerr << "Failed to create slice stream socket" << std::endl;
+        return;
+    }
+
+    // Room for a few frames of slices while the decode thread is busy
+    const int buffer_bytes = 4 * 1024 * 1024;
+    setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &buffer_bytes, sizeof(buffer_bytes));
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    socklen_t length = sizeof(address);
+    if (bind(mSocket, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0 ||
+        getsockname(mSocket, reinterpret_cast<struct sockaddr*>(&address), &length) != 0) {
+        std::cerr << "Failed to bind slice stream socket to port " << options.port << std::endl;
+        return;
+    }
+    mPort = ntohs(address.sin_port);
+
+    mSlots.resize(options.reassembly_slots);
+    mDelivered.assign(kMaxEyes * kMaxSlices, 0);
+    mPackets.resize(static_cast<size_t>(kReceiveBatch) * kMaxDatagramBytes);
+    mIov.resize(kReceiveBatch);
+    mMessages.resize(kReceiveBatch);
+    for (int i = 0; i < kReceiveBatch; ++i) {
+        std::memset(&mMessages[i], 0, sizeof(mMessages[i]));
+        mIov[i].iov_base = mPackets.data() + static_cast<size_t>(i) * kMaxDatagramBytes;
+        mIov[i].iov_len = kMaxDatagramBytes;
+        mMessages[i].msg_hdr.msg_iov = &mIov[i];
+        mMessages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if (!options.pose_region.empty()) {
+        mPoseReader = std::make_unique<SharedPoseReader>(options.pose_region);
+    }
+
+    mValid = true;
+}
+
+SliceStreamReceiver::~SliceStreamReceiver()
+{
+    if (mSocket >= 0) {
+        close(mSocket);
+    }
+}
+
+bool SliceStreamReceiver::IsValid() const
+{
+    return mValid;
+}
+
+int SliceStreamReceiver::GetPort() const
+{
+    return mPort;
+}
+
+void SliceStreamReceiver::SetLatestPose(const float rotation[4])
+{
+    std::copy(rotation, rotation + 4, mLatestRotation);
+}
+
+bool SliceStreamReceiver::Poll(ReceivedSlice& slice, int timeout_ms)
+{
+    if (!mValid) {
+        return false;
+    }
+
+    if (deliver(slice)) {
+        return true;
+    }
+
+    receivePackets(timeout_ms);
+    if (deliver(slice)) {
+        return true;
+    }
+
+    // More datagrams of a slice were inside the batch limit
+    receivePackets(0);
+    return deliver(slice);
+}
+
+SliceStreamReceiver::Stats SliceStreamReceiver::GetStats() const
+{
+    return mStats;
+}
+
+void SliceStreamReceiver::receivePackets(int timeout_ms)
+{
+    struct pollfd fd = {mSocket, POLLIN, 0};
+    if (poll(&fd, 1, timeout_ms) <= 0) {
+        return;
+    }
+
+    // Drain what is queued, one syscall per batch
+    while (true) {
+        const int count = recvmmsg(mSocket, mMessages.data(), kReceiveBatch, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            handlePacket(static_cast<const uint8_t*>(mIov[i].iov_base), mMessages[i].msg_len);
+        }
+        if (count < kReceiveBatch) {
+            return;
+        }
+    }
+}
+
+void SliceStreamReceiver::handlePacket(const uint8_t* packet, size_t size)
+{
+    SlicePacketHeader header;
+    if (size < sizeof(header)) {
+        mStats.packets_invalid++;
+        return;
+    }
+    std::memcpy(&header, packet, sizeof(header));
+
+    const size_t payload = size - sizeof(header);
+    if (header.magic != kSlicePacketMagic || header.version != kSlicePacketVersion ||
+        header.eye >= kMaxEyes || header.slice_count == 0 || header.slice_count > kMaxSlices ||
+        header.slice_index >= header.slice_count || header.fragment_count == 0 ||
+        header.fragment_index >= header.fragment_count ||
+        header.slice_bytes > static_cast<uint32_t>(mOptions.max_slice_bytes) ||
+        static_cast<uint64_t>(header.fragment_offset) + payload > header.slice_bytes) {
+        mStats.packets_invalid++;
+        return;
+    }
+
+    // Late fragments of a slice that was already shown, or replaced by a newer one
+    const size_t stream = static_cast<size_t>(header.eye) * kMaxSlices + header.slice_index;
+    if (header.frame_id < mDelivered[stream]) {
+        mStats.packets_stale++;
+        return;
+    }
+
+    Slot* slot = nullptr;
+    for (Slot& candidate : mSlots) {
+        if (candidate.used && candidate.header.frame_id == header.frame_id &&
+            candidate.header.eye == header.eye && candidate.header.slice_index == header.slice_index) {
+            slot = &candidate;
+            break;
+        }
+    }
+
+    if (!slot) {
+        // A free slot, else the slice being reassembled the longest, which has most likely lost a fragment
+        Slot* victim = nullptr;
+        for (Slot& candidate : mSlots) {
+            if (!candidate.used) {
+                victim = &candidate;
+                break;
+            }
+            if (!candidate.ready && (!victim || candidate.age < victim->age)) {
+                victim = &candidate;
+            }
+        }
+        if (!victim) {
+            // Every slot holds a complete slice the decoder has not taken yet
+            mStats.slices_incomplete++;
+            return;
+        }
+        if (victim->used) {
+            mStats.slices_incomplete++;
+        }
+        slot = victim;
+        slot->used = true;
+        slot->ready = false;
+        slot->age = mAge++;
+        slot->header = header;
+        slot->fragments_received = 0;
+        slot->fragment_seen.assign(header.fragment_count, 0);
+        slot->data.resize(header.slice_bytes);
+    } else if (slot->ready || slot->header.fragment_count != header.fragment_count ||
+               slot->header.slice_bytes != header.slice_bytes) {
+        // Duplicate of a complete slice, or a fragment inconsistent with the first one
+        mStats.packets_invalid++;
+        return;
+    }
+
+    if (slot->fragment_seen[header.fragment_index]) {
+        return;
+    }
+    slot->fragment_seen[header.fragment_index] = 1;
+    std::memcpy(slot->data.data() + header.fragment_offset, packet + sizeof(header), payload);
+    if (++slot->fragments_received == header.fragment_count) {
+        slot->ready = true;
+    }
+}
+
+bool SliceStreamReceiver::deliver(ReceivedSlice& slice)
+{
+    // Oldest complete slice first
+    Slot* ready = nullptr;
+    for (Slot& candidate : mSlots) {
+        if (candidate.used && candidate.ready && (!ready || candidate.age < ready->age)) {
+            ready = &candidate;
+        }
+    }
+    if (!ready) {
+        return false;
+    }
+
+    const SlicePacketHeader& header = ready->header;
+    const size_t stream = static_cast<size_t>(header.eye) * kMaxSlices + header.slice_index;
+    ready->used = false;
+    ready->ready = false;
+    if (header.frame_id < mDelivered[stream]) {
+        // A newer frame of the same slice completed first
+        mStats.packets_stale++;
+        return deliver(slice);
+    }
+    mDelivered[stream] = header.frame_id + 1;
+
+    slice.frame_id = header.frame_id;
+    slice.eye = header.eye;
+    slice.slice_index = header.slice_index;
+    slice.slice_count = header.slice_count;
+    slice.is_idr = (header.flags & kSlicePacketIdr) != 0;
+    std::memcpy(slice.render_pose.rotation, header.render_rotation, sizeof(header.render_rotation));
+    std::memcpy(slice.render_pose.translation, header.render_translation, sizeof(header.render_translation));
+    slice.render_pose.timestamp = header.render_timestamp;
+    slice.bitstream.assign(ready->data.begin(), ready->data.begin() + header.slice_bytes);
+
+    // R_latest * R_render^T takes directions from the render camera frame to the latest one
+    updateLatestPose();
+    const float* r = header.render_rotation;
+    const float render_inverse[4] = {-r[0], -r[1], -r[2], r[3]};
+    Multiply(mLatestRotation, render_inverse, slice.reprojection);
+
+    mStats.slices_completed++;
+    return true;
+}
+
+void SliceStreamReceiver::updateLatestPose()
+{
+    if (!mPoseReader) {
+        return;
+    }
+
+    if (!mPoseReader->IsOpen()) {
+        if (mPoseRetry > 0) {
+            --mPoseRetry;
+            return;
+        }
+        if (!mPoseReader->Open()) {
+            mPoseRetry = kPoseRetrySlices;
+            return;
+        }
+    }
+
+    // The motion model's prediction for the display when there is one
+    SharedPoseSample sample;
+    if (mPoseReader->ReadLatest(sample)) {
+        const float* rotation = sample.prediction_horizon_ms > 0.0f ? sample.predicted_rotation : sample.rotation;
+        std::copy(rotation, rotation + 4, mLatestRotation);
+    }
+}
+
+} // namespace ORB_SLAM3
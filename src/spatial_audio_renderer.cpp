@@ -0,0 +1,422 @@
+#include "include/spatial_audio_renderer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+constexpr float kPi = 3.14159265358979f;
+
+// Accumulator mixes, a source being moved renders into the fade pair for one block
+constexpr int kMixSteady = 0;
+constexpr int kMixFadeOut = 1;
+constexpr int kMixFadeIn = 2;
+constexpr int kMixCount = 3;
+
+// Blocks between attempts to map a pose region that does not exist yet (about 0.7 s at 48 kHz)
+constexpr int kPoseRetryBlocks = 256;
+
+bool IsPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+// y += x * h over split complex arrays
+void ComplexMultiplyAccumulate(const float* x_re, const float* x_im, const float* h_re, const float* h_im,
+                               float* y_re, float* y_im, int count)
+{
+    int i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t xr = vld1q_f32(x_re + i);
+        const float32x4_t xi = vld1q_f32(x_im + i);
+        const float32x4_t hr = vld1q_f32(h_re + i);
+        const float32x4_t hi = vld1q_f32(h_im + i);
+        float32x4_t yr = vld1q_f32(y_re + i);
+        float32x4_t yi = vld1q_f32(y_im + i);
+        yr = vfmaq_f32(yr, xr, hr);
+        yr = vfmsq_f32(yr, xi, hi);
+        yi = vfmaq_f32(yi, xr, hi);
+        yi = vfmaq_f32(yi, xi, hr);
+        vst1q_f32(y_re + i, yr);
+        vst1q_f32(y_im + i, yi);
+    }
+#endif
+    for (; i < count; ++i) {
+        y_re[i] += x_re[i] * h_re[i] - x_im[i] * h_im[i];
+        y_im[i] += x_re[i] * h_im[i] + x_im[i] * h_re[i];
+    }
+}
+
+// v' = R(q) v for a unit quaternion (x, y, z, w)
+void Rotate(const float q[4], const float v[3], float out[3])
+{
+    const float tx = 2.0f * (q[1] * v[2] - q[2] * v[1]);
+    const float ty = 2.0f * (q[2] * v[0] - q[0] * v[2]);
+    const float tz = 2.0f * (q[0] * v[1] - q[1] * v[0]);
+    out[0] = v[0] + q[3] * tx + (q[1] * tz - q[2] * ty);
+    out[1] = v[1] + q[3] * ty + (q[2] * tx - q[0] * tz);
+    out[2] = v[2] + q[3] * tz + (q[0] * ty - q[1] * tx);
+}
+
+} // namespace
+
+SpatialAudioRenderer::SpatialAudioRenderer(const HrtfSet& hrtf, const Options& options)
+    : mValid(false), mBlock(options.block_size), mFftSize(2 * options.block_size),
+      mBins(options.block_size + 1), mPartitions(0), mDirections(0),
+      mRotation{0.0f, 0.0f, 0.0f, 1.0f}, mTranslation{0.0f, 0.0f, 0.0f},
+      mPoseRegion(options.pose_region), mPoseRetry(0)
+{
+    const size_t directions = hrtf.azimuth_deg.size();
+    if (!IsPowerOfTwo(options.block_size) || options.block_size < 16 || options.block_size > 4096 ||
+        options.max_sources < 1 || options.max_sources > 256 ||
+        hrtf.sample_rate <= 0 || hrtf.length <= 0 || directions == 0 ||
+        hrtf.elevation_deg.size() != directions ||
+        hrtf.left.size() != directions * hrtf.length ||
+        hrtf.right.size() != directions * hrtf.length) {
+        std::cerr << "Invalid spatial audio renderer configuration" << std::endl;
+        return;
+    }
+
+    mDirections = static_cast<int>(directions);
+    mPartitions = (hrtf.length + mBlock - 1) / mBlock;
+
+    // FFT tables
+    int bits = 0;
+    while ((1 << bits) < mFftSize) {
+        ++bits;
+    }
+    mBitReverse.resize(mFftSize);
+    for (int i = 0; i < mFftSize; ++i) {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        mBitReverse[i] = reversed;
+    }
+    mTwiddleCos.resize(mFftSize / 2);
+    mTwiddleSin.resize(mFftSize / 2);
+    for (int i = 0; i < mFftSize / 2; ++i) {
+        mTwiddleCos[i] = std::cos(2.0f * kPi * i / mFftSize);
+        mTwiddleSin[i] = std::sin(2.0f * kPi * i / mFftSize);
+    }
+
+    mFrameRe.resize(mFftSize);
+    mFrameIm.resize(mFftSize);
+    mAccRe.resize(kMixCount * 2 * mBins);
+    mAccIm.resize(kMixCount * 2 * mBins);
+    mMixOut.resize(kMixCount * 2 * mBlock);
+
+    // Camera frame is x right, y down, z forward
+    mDirectionVectors.resize(3 * directions);
+    for (size_t d = 0; d < directions; ++d) {
+        const float azimuth = hrtf.azimuth_deg[d] * kPi / 180.0f;
+        const float elevation = hrtf.elevation_deg[d] * kPi / 180.0f;
+        mDirectionVectors[3 * d + 0] = -std::sin(azimuth) * std::cos(elevation);
+        mDirectionVectors[3 * d + 1] = -std::sin(elevation);
+        mDirectionVectors[3 * d + 2] = std::cos(azimuth) * std::cos(elevation);
+    }
+
+    // Spectra of the zero-padded partitions
+    const size_t filter_size = directions * 2 * mPartitions * mBins;
+    mFilterRe.resize(filter_size);
+    mFilterIm.resize(filter_size);
+    for (size_t d = 0; d < directions; ++d) {
+        for (int ear = 0; ear < 2; ++ear) {
+            const float* taps = (ear == 0 ? hrtf.left.data() : hrtf.right.data()) + d * hrtf.length;
+            for (int p = 0; p < mPartitions; ++p) {
+                std::fill(mFrameRe.begin(), mFrameRe.end(), 0.0f);
+                std::fill(mFrameIm.begin(), mFrameIm.end(), 0.0f);
+                const int begin = p * mBlock;
+                const int end = std::min(hrtf.length, begin + mBlock);
+                std::copy(taps + begin, taps + end, mFrameRe.begin());
+                fft(mFrameRe.data(), mFrameIm.data(), false);
+
+                const size_t offset = ((d * 2 + ear) * mPartitions + p) * mBins;
+                std::copy(mFrameRe.begin(), mFrameRe.begin() + mBins, mFilterRe.begin() + offset);
+                std::copy(mFrameIm.begin(), mFrameIm.begin() + mBins, mFilterIm.begin() + offset);
+            }
+        }
+    }
+
+    mSources.resize(options.max_sources);
+    for (Source& source : mSources) {
+        source.history.assign(mBlock, 0.0f);
+        source.spectra_re.assign(mPartitions * mBins, 0.0f);
+        source.spectra_im.assign(mPartitions * mBins, 0.0f);
+    }
+
+    if (!mPoseRegion.empty()) {
+        mPoseReader = std::make_unique<SharedPoseReader>(mPoseRegion);
+    }
+
+    mValid = true;
+}
+
+SpatialAudioRenderer::~SpatialAudioRenderer() = default;
+
+bool SpatialAudioRenderer::IsValid() const
+{
+    return mValid;
+}
+
+int SpatialAudioRenderer::GetBlockSize() const
+{
+    return mBlock;
+}
+
+int SpatialAudioRenderer::AddSource(const float position[3])
+{
+    for (size_t i = 0; i < mSources.size(); ++i) {
+        Source& source = mSources[i];
+        if (source.active) {
+            continue;
+        }
+
+        std::fill(source.history.begin(), source.history.end(), 0.0f);
+        std::fill(source.spectra_re.begin(), source.spectra_re.end(), 0.0f);
+        std::fill(source.spectra_im.begin(), source.spectra_im.end(), 0.0f);
+        std::copy(position, position + 3, source.position);
+        source.direction = -1;
+        source.previous_direction = -1;
+        source.head = 0;
+        source.active = true;
+        return static_cast<int>(i);
+    }
+
+    return -1;
+}
+
+bool SpatialAudioRenderer::SetSourcePosition(int source, const float position[3])
+{
+    if (source < 0 || source >= static_cast<int>(mSources.size()) || !mSources[source].active) {
+        return false;
+    }
+
+    std::copy(position, position + 3, mSources[source].position);
+    return true;
+}
+
+void SpatialAudioRenderer::RemoveSource(int source)
+{
+    if (source >= 0 && source < static_cast<int>(mSources.size())) {
+        mSources[source].active = false;
+    }
+}
+
+void SpatialAudioRenderer::SetHeadPose(const float rotation[4], const float translation[3])
+{
+    std::copy(rotation, rotation + 4, mRotation);
+    std::copy(translation, translation + 3, mTranslation);
+}
+
+int SpatialAudioRenderer::GetSourceDirection(int source) const
+{
+    if (source < 0 || source >= static_cast<int>(mSources.size())) {
+        return -1;
+    }
+    return mSources[source].direction;
+}
+
+bool SpatialAudioRenderer::Process(const float* const* inputs, float* left, float* right)
+{
+    if (!mValid) {
+        return false;
+    }
+
+    updateHeadPose();
+
+    std::fill(mAccRe.begin(), mAccRe.end(), 0.0f);
+    std::fill(mAccIm.begin(), mAccIm.end(), 0.0f);
+    bool fading = false;
+
+    for (size_t i = 0; i < mSources.size(); ++i) {
+        Source& source = mSources[i];
+        if (!source.active) {
+            continue;
+        }
+
+        const int direction = nearestDirection(source);
+        source.previous_direction = source.direction < 0 ? direction : source.direction;
+        source.direction = direction;
+
+        // Overlap-save frame: previous block followed by the new one
+        const float* input = inputs ? inputs[i] : nullptr;
+        std::copy(source.history.begin(), source.history.end(), mFrameRe.begin());
+        if (input) {
+            std::copy(input, input + mBlock, mFrameRe.begin() + mBlock);
+            std::copy(input, input + mBlock, source.history.begin());
+        } else {
+            std::fill(mFrameRe.begin() + mBlock, mFrameRe.end(), 0.0f);
+            std::fill(source.history.begin(), source.history.end(), 0.0f);
+        }
+        std::fill(mFrameIm.begin(), mFrameIm.end(), 0.0f);
+        fft(mFrameRe.data(), mFrameIm.data(), false);
+
+        source.head = (source.head + 1) % mPartitions;
+        std::copy(mFrameRe.begin(), mFrameRe.begin() + mBins, source.spectra_re.begin() + source.head * mBins);
+        std::copy(mFrameIm.begin(), mFrameIm.begin() + mBins, source.spectra_im.begin() + source.head * mBins);
+
+        if (source.previous_direction == source.direction) {
+            accumulate(source, source.direction, kMixSteady);
+        } else {
+            accumulate(source, source.previous_direction, kMixFadeOut);
+            accumulate(source, source.direction, kMixFadeIn);
+            fading = true;
+        }
+    }
+
+    float* steady_left = mMixOut.data() + (kMixSteady * 2 + 0) * mBlock;
+    float* steady_right = mMixOut.data() + (kMixSteady * 2 + 1) * mBlock;
+    inverse(kMixSteady, 0, steady_left);
+    inverse(kMixSteady, 1, steady_right);
+    std::copy(steady_left, steady_left + mBlock, left);
+    std::copy(steady_right, steady_right + mBlock, right);
+
+    if (fading) {
+        for (int ear = 0; ear < 2; ++ear) {
+            float* out_mix = mMixOut.data() + (kMixFadeOut * 2 + ear) * mBlock;
+            float* in_mix = mMixOut.data() + (kMixFadeIn * 2 + ear) * mBlock;
+            inverse(kMixFadeOut, ear, out_mix);
+            inverse(kMixFadeIn, ear, in_mix);
+
+            float* out = ear == 0 ? left : right;
+            for (int n = 0; n < mBlock; ++n) {
+                const float gain = static_cast<float>(n + 1) / mBlock;
+                out[n] += out_mix[n] * (1.0f - gain) + in_mix[n] * gain;
+            }
+        }
+    }
+
+    return true;
+}
+
+void SpatialAudioRenderer::updateHeadPose()
+{
+    if (!mPoseReader) {
+        return;
+    }
+
+    if (!mPoseReader->IsOpen()) {
+        if (mPoseRetry > 0) {
+            --mPoseRetry;
+            return;
+        }
+        if (!mPoseReader->Open()) {
+            mPoseRetry = kPoseRetryBlocks;
+            return;
+        }
+    }
+
+    // Keep the last pose while the writer restarts
+    SharedPoseSample sample;
+    if (mPoseReader->ReadLatest(sample)) {
+        std::copy(sample.rotation, sample.rotation + 4, mRotation);
+        std::copy(sample.translation, sample.translation + 3, mTranslation);
+    }
+}
+
+int SpatialAudioRenderer::nearestDirection(const Source& source) const
+{
+    // Head frame position, p_c = R_cw p_w + t_cw
+    float p[3];
+    Rotate(mRotation, source.position, p);
+    for (int i = 0; i < 3; ++i) {
+        p[i] += mTranslation[i];
+    }
+
+    const float norm = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    if (norm < 1e-6f) {
+        return source.direction < 0 ? 0 : source.direction;
+    }
+
+    int best = 0;
+    float best_dot = -2.0f;
+    for (int d = 0; d < mDirections; ++d) {
+        const float* v = &mDirectionVectors[3 * d];
+        const float dot = (p[0] * v[0] + p[1] * v[1] + p[2] * v[2]) / norm;
+        if (dot > best_dot) {
+            best_dot = dot;
+            best = d;
+        }
+    }
+    return best;
+}
+
+void SpatialAudioRenderer::accumulate(const Source& source, int direction, int mix)
+{
+    for (int ear = 0; ear < 2; ++ear) {
+        float* acc_re = mAccRe.data() + (mix * 2 + ear) * mBins;
+        float* acc_im = mAccIm.data() + (mix * 2 + ear) * mBins;
+
+        // Partition p of the response meets the input from p blocks ago
+        for (int p = 0; p < mPartitions; ++p) {
+            const int slot = (source.head - p + mPartitions) % mPartitions;
+            const size_t filter = ((static_cast<size_t>(direction) * 2 + ear) * mPartitions + p) * mBins;
+            ComplexMultiplyAccumulate(source.spectra_re.data() + slot * mBins, source.spectra_im.data() + slot * mBins,
+                                      mFilterRe.data() + filter, mFilterIm.data() + filter,
+                                      acc_re, acc_im, mBins);
+        }
+    }
+}
+
+void SpatialAudioRenderer::inverse(int mix, int ear, float* out)
+{
+    const float* acc_re = mAccRe.data() + (mix * 2 + ear) * mBins;
+    const float* acc_im = mAccIm.data() + (mix * 2 + ear) * mBins;
+
+    // Rebuild the conjugate-symmetric half of the real signal's spectrum
+    std::copy(acc_re, acc_re + mBins, mFrameRe.begin());
+    std::copy(acc_im, acc_im + mBins, mFrameIm.begin());
+    for (int k = mBins; k < mFftSize; ++k) {
+        mFrameRe[k] = acc_re[mFftSize - k];
+        mFrameIm[k] = -acc_im[mFftSize - k];
+    }
+    fft(mFrameRe.data(), mFrameIm.data(), true);
+
+    // The second half is free of circular wrap-around
+    const float scale = 1.0f / mFftSize;
+    for (int n = 0; n < mBlock; ++n) {
+        out[n] = mFrameRe[mBlock + n] * scale;
+    }
+}
+
+void SpatialAudioRenderer::fft(float* re, float* im, bool inverse_transform) const
+{
+    for (int i = 0; i < mFftSize; ++i) {
+        const int j = mBitReverse[i];
+        if (j > i) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    const float sign = inverse_transform ? 1.0f : -1.0f;
+    for (int length = 2; length <= mFftSize; length <<= 1) {
+        const int half = length / 2;
+        const int step = mFftSize / length;
+        for (int start = 0; start < mFftSize; start += length) {
+            for (int k = 0; k < half; ++k) {
+                const float w_re = mTwiddleCos[k * step];
+                const float w_im = sign * mTwiddleSin[k * step];
+                const int a = start + k;
+                const int b = a + half;
+                const float t_re = re[b] * w_re - im[b] * w_im;
+                const float t_im = re[b] * w_im + im[b] * w_re;
+                re[b] = re[a] - t_re;
+                im[b] = im[a] - t_im;
+                re[a] += t_re;
+                im[a] += t_im;
+            }
+        }
+    }
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,263 @@
+#include "include/telemetry_export.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// Attempts to read a slot before giving up (a writer that died mid-write leaves it locked)
+constexpr int kReadAttempts = 64;
+
+long futexWake(const std::atomic<uint32_t>& word)
+{
+    uint32_t* address = reinterpret_cast<uint32_t*>(const_cast<std::atomic<uint32_t>*>(&word));
+    return syscall(SYS_futex, address, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+bool readSysfsValue(const std::string& path, long long& value)
+{
+    std::ifstream file(path);
+    return static_cast<bool>(file >> value);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// SharedTelemetryWriter
+//------------------------------------------------------------------------------
+
+SharedTelemetryWriter::SharedTelemetryWriter(const std::string& name)
+    : mName(name), mRegion(nullptr)
+{
+}
+
+SharedTelemetryWriter::~SharedTelemetryWriter()
+{
+    Close();
+}
+
+bool SharedTelemetryWriter::Open()
+{
+    if (mRegion) {
+        return true;
+    }
+
+    int fd = shm_open(mName.c_str(), O_CREAT | O_RDWR, 0666);
+    if (fd < 0) {
+        std::cerr << "Failed to create shared memory " << mName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(SharedTelemetryRegion)) != 0) {
+        std::cerr << "Failed to size shared memory " << mName << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(SharedTelemetryRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << mName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Readers only accept the region once the magic is set
+    SharedTelemetryRegion* region = static_cast<SharedTelemetryRegion*>(addr);
+    region->magic.store(0, std::memory_order_release);
+    const uint32_t notify = region->notify_word.load(std::memory_order_relaxed);
+    mRegion = new (addr) SharedTelemetryRegion();
+    mRegion->version = kSharedTelemetryVersion;
+    mRegion->slot_count = kSharedTelemetrySlots;
+    mRegion->sample_size = sizeof(SharedTelemetrySample);
+    mRegion->write_count.store(0, std::memory_order_relaxed);
+    mRegion->notify_word.store(notify + 1, std::memory_order_relaxed);
+    mRegion->magic.store(kSharedTelemetryMagic, std::memory_order_release);
+    futexWake(mRegion->notify_word);
+    return true;
+}
+
+void SharedTelemetryWriter::Close()
+{
+    if (!mRegion) {
+        return;
+    }
+
+    // Tell the readers still mapping the region that no more samples follow
+    mRegion->magic.store(0, std::memory_order_release);
+    mRegion->notify_word.fetch_add(1, std::memory_order_release);
+    futexWake(mRegion->notify_word);
+
+    munmap(mRegion, sizeof(SharedTelemetryRegion));
+    shm_unlink(mName.c_str());
+    mRegion = nullptr;
+}
+
+bool SharedTelemetryWriter::IsOpen() const
+{
+    return mRegion != nullptr;
+}
+
+void SharedTelemetryWriter::Publish(const SharedTelemetrySample& sample)
+{
+    if (!mRegion) {
+        return;
+    }
+
+    const uint64_t count = mRegion->write_count.load(std::memory_order_relaxed);
+    SharedTelemetrySample numbered = sample;
+    numbered.sequence = count;
+    mRegion->slots[count % kSharedTelemetrySlots].sample.Store(numbered);
+    mRegion->write_count.store(count + 1, std::memory_order_release);
+
+    mRegion->notify_word.fetch_add(1, std::memory_order_release);
+    futexWake(mRegion->notify_word);
+}
+
+//------------------------------------------------------------------------------
+// SharedTelemetryReader
+//------------------------------------------------------------------------------
+
+SharedTelemetryReader::SharedTelemetryReader(const std::string& name)
+    : mName(name), mRegion(nullptr)
+{
+}
+
+SharedTelemetryReader::~SharedTelemetryReader()
+{
+    Close();
+}
+
+bool SharedTelemetryReader::Open()
+{
+    if (mRegion) {
+        return true;
+    }
+
+    int fd = shm_open(mName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SharedTelemetryRegion)) {
+        close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(SharedTelemetryRegion), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    const SharedTelemetryRegion* region = static_cast<const SharedTelemetryRegion*>(addr);
+    if (region->magic.load(std::memory_order_acquire) != kSharedTelemetryMagic ||
+        region->version != kSharedTelemetryVersion ||
+        region->slot_count != kSharedTelemetrySlots ||
+        region->sample_size != sizeof(SharedTelemetrySample)) {
+        munmap(addr, sizeof(SharedTelemetryRegion));
+        return false;
+    }
+
+    mRegion = static_cast<SharedTelemetryRegion*>(addr);
+    return true;
+}
+
+void SharedTelemetryReader::Close()
+{
+    if (mRegion) {
+        munmap(mRegion, sizeof(SharedTelemetryRegion));
+        mRegion = nullptr;
+    }
+}
+
+bool SharedTelemetryReader::IsOpen() const
+{
+    return mRegion != nullptr;
+}
+
+uint64_t SharedTelemetryReader::GetWriteCount() const
+{
+    return mRegion ? mRegion->write_count.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedTelemetryReader::ReadLatest(SharedTelemetrySample& sample) const
+{
+    const uint64_t count = GetWriteCount();
+    if (count == 0) {
+        return false;
+    }
+
+    const SharedTelemetryRegion::Slot& slot = mRegion->slots[(count - 1) % kSharedTelemetrySlots];
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+        if (slot.sample.TryLoad(sample)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// Thermal state
+//------------------------------------------------------------------------------
+
+void SampleThermalState(SharedTelemetrySample& sample, const std::string& sysfs_root)
+{
+    // Zones are numbered from 0 without gaps
+    sample.thermal_zone_count = 0;
+    std::memset(sample.thermal_zone_type, 0, sizeof(sample.thermal_zone_type));
+    for (uint32_t zone = 0; zone < kSharedTelemetryMaxThermalZones; ++zone) {
+        const std::string dir = sysfs_root + "/class/thermal/thermal_zone" + std::to_string(zone);
+        long long millidegrees = 0;
+        if (!readSysfsValue(dir + "/temp", millidegrees)) {
+            break;
+        }
+
+        std::string type;
+        std::ifstream type_file(dir + "/type");
+        std::getline(type_file, type);
+        std::strncpy(sample.thermal_zone_type[zone], type.c_str(), kSharedTelemetryZoneNameLength - 1);
+        sample.thermal_celsius[zone] = static_cast<float>(millidegrees / 1000.0);
+        sample.thermal_zone_count = zone + 1;
+    }
+
+    // Policies are named after their first CPU (policy0, policy4, policy6 on the RK3588)
+    sample.cpu_capped_mask = 0;
+    const std::string cpufreq = sysfs_root + "/devices/system/cpu/cpufreq";
+    DIR* dir = opendir(cpufreq.c_str());
+    if (!dir) {
+        return;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        if (std::strncmp(entry->d_name, "policy", 6) != 0) {
+            continue;
+        }
+        const int cpu = std::atoi(entry->d_name + 6);
+        const std::string policy = cpufreq + "/" + entry->d_name;
+        long long scaling_max = 0;
+        long long cpuinfo_max = 0;
+        if (cpu >= 0 && cpu < 32 &&
+            readSysfsValue(policy + "/scaling_max_freq", scaling_max) &&
+            readSysfsValue(policy + "/cpuinfo_max_freq", cpuinfo_max) &&
+            scaling_max < cpuinfo_max) {
+            sample.cpu_capped_mask |= 1u << cpu;
+        }
+    }
+    closedir(dir);
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,305 @@
+#include "include/thread_placement.hpp"
+#include <algorithm>
+#include <alloca.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+std::mutex gInstalledMutex;
+std::shared_ptr<ThreadPlacementPolicy> gInstalled;
+
+int currentTid()
+{
+    return static_cast<int>(syscall(SYS_gettid));
+}
+
+// Touches the pages of the stack below the caller so they are faulted in
+// (and locked under mlockall) before the thread's real-time loop starts
+__attribute__((noinline)) void prefaultStack(size_t bytes)
+{
+    const long page = sysconf(_SC_PAGESIZE);
+    volatile unsigned char* stack = static_cast<volatile unsigned char*>(alloca(bytes));
+    for (size_t i = 0; i < bytes; i += static_cast<size_t>(page)) {
+        stack[i] = 0;
+    }
+}
+
+// Value of a "key: value" or "key : value" line of a /proc file
+bool readProcCounter(const std::string& path, const std::string& key, uint64_t& value)
+{
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, key.size(), key) != 0) {
+            continue;
+        }
+        const size_t colon = line.find(':', key.size());
+        if (colon == std::string::npos || line.find_first_not_of(" \t", key.size()) != colon) {
+            continue;
+        }
+        value = std::strtoull(line.c_str() + colon + 1, nullptr, 10);
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+const char* ThreadRoleName(ThreadRole role)
+{
+    switch (role) {
+        case ThreadRole::TRACKING: return "tracking";
+        case ThreadRole::LOCAL_MAPPING: return "local_mapping";
+        case ThreadRole::LOOP_CLOSING: return "loop_closing";
+        case ThreadRole::VIEWER: return "viewer";
+        case ThreadRole::CAMERA_ACQUISITION: return "camera_acquisition";
+        case ThreadRole::FEATURE_EXTRACTION: return "feature_extraction";
+        case ThreadRole::IMU_ACQUISITION: return "imu_acquisition";
+        case ThreadRole::FUSION: return "fusion";
+        case ThreadRole::POSE_PUBLISHER: return "pose_publisher";
+        case ThreadRole::CALIBRATION: return "calibration";
+        case ThreadRole::DIAGNOSTICS: return "diagnostics";
+    }
+    return "unknown";
+}
+
+std::array<ThreadPlacement, kThreadRoleCount> ThreadPlacementPolicy::DefaultRoles()
+{
+    std::array<ThreadPlacement, kThreadRoleCount> roles;
+    auto set = [&roles](ThreadRole role, CoreClass cores, int realtime_priority, int nice) {
+        ThreadPlacement& placement = roles[static_cast<size_t>(role)];
+        placement.cores = cores;
+        placement.realtime_priority = realtime_priority;
+        placement.nice = nice;
+    };
+
+    // The I/O threads do little work per wakeup but must not wait behind it,
+    // the highest priorities go to the shortest periods
+    set(ThreadRole::IMU_ACQUISITION, CoreClass::LITTLE, 80, 0);
+    set(ThreadRole::POSE_PUBLISHER, CoreClass::LITTLE, 75, 0);
+    set(ThreadRole::CAMERA_ACQUISITION, CoreClass::LITTLE, 70, 0);
+    set(ThreadRole::FUSION, CoreClass::LITTLE, 65, 0);
+
+    // The per-frame compute gets the A76 and still preempts the mapping back end
+    set(ThreadRole::TRACKING, CoreClass::BIG, 60, 0);
+    set(ThreadRole::FEATURE_EXTRACTION, CoreClass::BIG, 55, 0);
+    set(ThreadRole::LOCAL_MAPPING, CoreClass::BIG, 0, 0);
+
+    // Latency-tolerant, kept off the big cores
+    set(ThreadRole::LOOP_CLOSING, CoreClass::LITTLE, 0, 5);
+    set(ThreadRole::VIEWER, CoreClass::LITTLE, 0, 10);
+    set(ThreadRole::CALIBRATION, CoreClass::LITTLE, 0, 15);
+    set(ThreadRole::DIAGNOSTICS, CoreClass::LITTLE, 0, 19);
+
+    return roles;
+}
+
+ThreadPlacementPolicy::ThreadPlacementPolicy(const Config& config)
+    : mConfig(config), mIsBigLittle(false)
+{
+    mIsBigLittle = DetectCoreClusters(mConfig.cpu_sysfs_root, mBigCpus, mLittleCpus);
+}
+
+bool ThreadPlacementPolicy::DetectCoreClusters(const std::string& cpu_sysfs_root, std::vector<int>& big,
+                                               std::vector<int>& little)
+{
+    big.clear();
+    little.clear();
+
+    std::vector<std::pair<int, long>> capacities;
+    for (int cpu = 0;; ++cpu) {
+        std::ifstream file(cpu_sysfs_root + "/cpu" + std::to_string(cpu) + "/cpu_capacity");
+        long capacity = 0;
+        if (!(file >> capacity)) {
+            break;
+        }
+        capacities.emplace_back(cpu, capacity);
+    }
+    if (capacities.empty()) {
+        return false;
+    }
+
+    long max_capacity = 0;
+    for (const auto& entry : capacities) {
+        max_capacity = std::max(max_capacity, entry.second);
+    }
+    for (const auto& entry : capacities) {
+        (entry.second == max_capacity ? big : little).push_back(entry.first);
+    }
+
+    if (little.empty()) {
+        big.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> ThreadPlacementPolicy::ResolveCpus(const ThreadPlacement& placement) const
+{
+    std::vector<int> cpus;
+    if (!placement.cpus.empty()) {
+        cpus = placement.cpus;
+    } else if (mIsBigLittle && placement.cores == CoreClass::BIG) {
+        cpus = mBigCpus;
+    } else if (mIsBigLittle && placement.cores == CoreClass::LITTLE) {
+        cpus = mLittleCpus;
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::vector<int> ThreadPlacementPolicy::GetRoleCpus(ThreadRole role) const
+{
+    return ResolveCpus(mConfig.roles[static_cast<size_t>(role)]);
+}
+
+bool ThreadPlacementPolicy::ApplyProcess()
+{
+    bool ok = true;
+
+    if (mConfig.prefault_heap_bytes > 0) {
+        // Keep freed memory and large blocks in the heap so the prefaulted
+        // pages are reused instead of returned and faulted in again
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+    }
+
+    if (mConfig.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cerr << "Failed to lock memory: " << strerror(errno) << std::endl;
+        ok = false;
+    }
+
+    if (mConfig.prefault_heap_bytes > 0) {
+        unsigned char* heap = static_cast<unsigned char*>(std::malloc(mConfig.prefault_heap_bytes));
+        if (heap) {
+            const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            for (size_t i = 0; i < mConfig.prefault_heap_bytes; i += page) {
+                static_cast<volatile unsigned char*>(heap)[i] = 0;
+            }
+            std::free(heap);
+        } else {
+            std::cerr << "Failed to prefault " << mConfig.prefault_heap_bytes << " bytes of heap" << std::endl;
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+bool ThreadPlacementPolicy::ApplyToCurrentThread(ThreadRole role, const std::string& name)
+{
+    const ThreadPlacement& placement = mConfig.roles[static_cast<size_t>(role)];
+    const int tid = currentTid();
+    bool ok = true;
+
+    const std::vector<int> cpus = ResolveCpus(placement);
+    if (!cpus.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &cpuset);
+        }
+        const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+        if (error != 0) {
+            std::cerr << "Failed to pin " << name << " to the " << ThreadRoleName(role)
+                      << " cores: " << strerror(error) << std::endl;
+            ok = false;
+        }
+    }
+
+    if (placement.realtime_priority > 0) {
+        sched_param param;
+        param.sched_priority = std::min(placement.realtime_priority, sched_get_priority_max(SCHED_FIFO));
+        const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error != 0) {
+            std::cerr << "Failed to set SCHED_FIFO priority " << param.sched_priority << " for " << name
+                      << ": " << strerror(error) << std::endl;
+            ok = false;
+        }
+    } else if (placement.nice != 0) {
+        // Linux applies the nice value of a TID to that thread only
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(tid), placement.nice) != 0) {
+            std::cerr << "Failed to set nice " << placement.nice << " for " << name << ": "
+                      << strerror(errno) << std::endl;
+            ok = false;
+        }
+    }
+
+    if (mConfig.prefault_stack_bytes > 0) {
+        prefaultStack(mConfig.prefault_stack_bytes);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mThreads.push_back({name, role, tid});
+    return ok;
+}
+
+std::vector<ThreadStats> ThreadPlacementPolicy::GetThreadStats() const
+{
+    std::vector<PlacedThread> threads;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        threads = mThreads;
+    }
+
+    std::vector<ThreadStats> stats;
+    stats.reserve(threads.size());
+    for (const PlacedThread& thread : threads) {
+        ThreadStats entry;
+        entry.name = thread.name;
+        entry.role = thread.role;
+        entry.tid = thread.tid;
+        entry.migrations = 0;
+        entry.preemptions = 0;
+        entry.voluntary_switches = 0;
+
+        // A reused TID would belong to another thread of the process, an
+        // exited one has no entry under /proc/self/task
+        const std::string task = "/proc/self/task/" + std::to_string(thread.tid);
+        entry.alive = readProcCounter(task + "/status", "nonvoluntary_ctxt_switches", entry.preemptions);
+        if (entry.alive) {
+            readProcCounter(task + "/status", "voluntary_ctxt_switches", entry.voluntary_switches);
+            readProcCounter(task + "/sched", "se.nr_migrations", entry.migrations);
+        }
+        stats.push_back(entry);
+    }
+    return stats;
+}
+
+void ThreadPlacementPolicy::Install(std::shared_ptr<ThreadPlacementPolicy> policy)
+{
+    std::lock_guard<std::mutex> lock(gInstalledMutex);
+    gInstalled = std::move(policy);
+}
+
+std::shared_ptr<ThreadPlacementPolicy> ThreadPlacementPolicy::GetInstalled()
+{
+    std::lock_guard<std::mutex> lock(gInstalledMutex);
+    return gInstalled;
+}
+
+void ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole role, const std::string& name)
+{
+    std::shared_ptr<ThreadPlacementPolicy> policy = GetInstalled();
+    if (policy) {
+        policy->ApplyToCurrentThread(role, name);
+    }
+}
+
+} // namespace ORB_SLAM3
@@ -1,7 +1,13 @@
 #include "include/tpu_zero_copy_integration.hpp"
+#include "include/thread_placement.hpp"
+#include "ORB_SLAM3/include/ORBextractor.h"
+#include "ORB_SLAM3/include/GPUORBextractor.h"
+#include "ORB_SLAM3/include/RGAPyramid.h"
+#include "ORB_SLAM3/include/Trace.h"
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
@@ -10,6 +16,7 @@
 #include <linux/videodev2.h>
 #include <linux/dma-buf.h>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
 
 // For EdgeTPU DMA buffer handling
 #include "tensorflow/lite/delegates/edgetpu/edgetpu_c.h"
@@ -17,6 +24,10 @@
 namespace ORB_SLAM3
 {
 
+// Lucas-Kanade parameters of temporal tracking (OpenCV defaults)
+static const cv::Size kTrackWindow(21, 21);
+static const int kTrackLevels = 3;
+
 //------------------------------------------------------------------------------
 // Constructor & Destructor
 //------------------------------------------------------------------------------
@@ -26,22 +37,60 @@ TPUZeroCopyIntegration::TPUZeroCopyIntegration(
     std::shared_ptr<TPUFeatureExtractor> feature_extractor,
     int num_threads,
     int queue_size)
+    : TPUZeroCopyIntegration(
+          frame_provider,
+          std::vector<std::shared_ptr<TPUFeatureExtractor>>{feature_extractor},
+          num_threads,
+          queue_size)
+{
+}
+
+TPUZeroCopyIntegration::TPUZeroCopyIntegration(
+    std::shared_ptr<ZeroCopyFrameProvider> frame_provider,
+    std::vector<std::shared_ptr<TPUFeatureExtractor>> feature_extractors,
+    int num_threads,
+    int queue_size)
     : frame_provider_(frame_provider),
-      feature_extractor_(feature_extractor),
+      next_device_(0),
       running_(false),
       num_threads_(num_threads),
       queue_size_(queue_size),
-      direct_dma_enabled_(false)
+      gpu_extractor_(nullptr),
+      latency_budget_ms_(0.0),
+      cpu_busy_(false),
+      cpu_frames_(0),
+      detection_interval_(1),
+      min_track_survival_(0.0f),
+      tracked_frames_(0),
+      direct_dma_enabled_(false),
+      batched_enabled_(false)
 {
     // Initialize statistics
     const size_t num_cameras = frame_provider_->GetCameraCount();
     processing_rates_.resize(num_cameras, 0.0f);
     frame_counters_.resize(num_cameras, 0);
     last_frame_times_.resize(num_cameras);
+    static_masks_.resize(num_cameras);
+    dynamic_masks_.resize(num_cameras);
+    frame_masks_.resize(num_cameras);
+    for (size_t i = 0; i < num_cameras; ++i) {
+        temporal_tracks_.emplace_back(new TemporalTrack());
+    }
     
     // Set default error message
     last_error_message_ = "No error";
     
+    // Build the device pool
+    for (auto& extractor : feature_extractors) {
+        if (!extractor) {
+            continue;
+        }
+        std::unique_ptr<TPUDevice> device(new TPUDevice());
+        device->extractor = extractor;
+        devices_.push_back(std::move(device));
+    }
+    std::cout << "TPUZeroCopyIntegration using " << devices_.size() << " EdgeTPU device(s)." << std::endl;
+    
     // Check if direct DMA access is supported
     direct_dma_enabled_ = IsDirectDMAAccessSupported();
     if (direct_dma_enabled_) {
@@ -74,11 +123,14 @@ bool TPUZeroCopyIntegration::Start()
     }
     
     // Check if components are valid
-    if (!frame_provider_ || !feature_extractor_) {
+    if (!frame_provider_ || devices_.empty()) {
         SetErrorMessage("Invalid frame provider or feature extractor");
         return false;
     }
     
+    // Import the camera buffers before the first frame lands in one
+    ImportBufferPool();
+    
     // Start frame acquisition
     if (!frame_provider_->StartAcquisition()) {
         SetErrorMessage("Failed to start frame acquisition: " + frame_provider_->GetLastErrorMessage());
@@ -98,7 +150,14 @@ bool TPUZeroCopyIntegration::Start()
         processing_threads_.push_back(std::move(processing_thread));
     }
     
-    std::cout << "TPUZeroCopyIntegration started with " << num_threads_ << " processing threads." << std::endl;
+    // Start CPU fallback thread
+    if (cpu_extractor_) {
+        std::thread cpu_thread(&TPUZeroCopyIntegration::CPUFallbackThreadFunc, this);
+        processing_threads_.push_back(std::move(cpu_thread));
+    }
+    
+    std::cout << "TPUZeroCopyIntegration started with " << num_threads_ << " processing threads"
+              << (cpu_extractor_ ? " and a CPU fallback." : ".") << std::endl;
     return true;
 }
 
@@ -114,6 +173,7 @@ void TPUZeroCopyIntegration::Stop()
     
     // Notify all threads
     queue_condition_.notify_all();
+    cpu_condition_.notify_all();
     result_condition_.notify_all();
     
     // Join processing threads
@@ -133,6 +193,22 @@ void TPUZeroCopyIntegration::Stop()
         while (!frame_queue_.empty()) {
             frame_queue_.pop();
         }
+        while (!set_queue_.empty()) {
+            set_queue_.pop();
+        }
+        while (!cpu_queue_.empty()) {
+            cpu_queue_.pop();
+        }
+        cpu_busy_ = false;
+    }
+    
+    // Start tracking from a fresh detection
+    for (auto& track : temporal_tracks_) {
+        std::lock_guard<std::mutex> lock(track->mutex);
+        track->pyramid.clear();
+        track->keypoints.clear();
+        track->descriptors.release();
+        track->force_detection = true;
     }
     
     {
@@ -140,6 +216,9 @@ void TPUZeroCopyIntegration::Stop()
         while (!result_queue_.empty()) {
             result_queue_.pop();
         }
+        while (!set_result_queue_.empty()) {
+            set_result_queue_.pop();
+        }
     }
     
     std::cout << "TPUZeroCopyIntegration stopped." << std::endl;
@@ -207,19 +286,51 @@ bool TPUZeroCopyIntegration::GetNextSynchronizedResults(
         return false;
     }
     
-    // Get the number of cameras
-    const size_t num_cameras = frame_provider_->GetCameraCount();
-    
-    // Collect results from all cameras
-    results.clear();
-    results.reserve(num_cameras);
-    
-    for (size_t i = 0; i < num_cameras; ++i) {
-        ExtractionResult result;
-        if (!GetNextResult(result, timeout_ms)) {
+    // Batched mode delivers the results of a frame set together
+    if (batched_enabled_) {
+        std::unique_lock<std::mutex> lock(result_mutex_);
+        auto ready = [this]() { return !running_ || !set_result_queue_.empty(); };
+        
+        if (timeout_ms < 0) {
+            result_condition_.wait(lock, ready);
+        } else if (timeout_ms > 0 &&
+                   !result_condition_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready)) {
+            SetErrorMessage("Timeout waiting for result");
             return false;
         }
-        results.push_back(result);
+        
+        if (!running_) {
+            SetErrorMessage("Integration stopped while waiting for result");
+            return false;
+        }
+        
+        if (set_result_queue_.empty()) {
+            SetErrorMessage("No result available");
+            return false;
+        }
+        
+        results = std::move(set_result_queue_.front());
+        set_result_queue_.pop();
+    } else {
+        // Get the number of cameras
+        const size_t num_cameras = frame_provider_->GetCameraCount();
+        
+        // Collect results from all cameras
+        results.clear();
+        results.reserve(num_cameras);
+        
+        for (size_t i = 0; i < num_cameras; ++i) {
+            ExtractionResult result;
+            if (!GetNextResult(result, timeout_ms)) {
+                return false;
+            }
+            results.push_back(result);
+        }
+    }
+    
+    if (results.empty()) {
+        SetErrorMessage("No result available");
+        return false;
     }
     
     // Check if results are synchronized
@@ -242,6 +353,228 @@ bool TPUZeroCopyIntegration::GetNextSynchronizedResults(
     return true;
 }
 
+bool TPUZeroCopyIntegration::ProcessFrameSet(
+    const ZeroCopyFrameProvider::FrameSet& frame_set,
+    std::vector<ExtractionResult>& results)
+{
+    results.clear();
+    
+    if (frame_set.frames.empty()) {
+        SetErrorMessage("Empty frame set");
+        return false;
+    }
+    
+    std::vector<QueueItem> items(frame_set.frames.size());
+    for (size_t i = 0; i < frame_set.frames.size(); ++i) {
+        items[i].metadata = frame_set.frames[i];
+        items[i].image = frame_provider_->GetMatForFrame(frame_set.frames[i]);
+        items[i].scaled_image = frame_provider_->GetScaledMatForFrame(frame_set.frames[i]);
+        
+        if (items[i].image.empty()) {
+            SetErrorMessage("Failed to map frame of camera " + std::to_string(frame_set.frames[i].camera_id));
+            return false;
+        }
+    }
+    
+    results = ProcessFrameBatch(items);
+    
+    for (const auto& item : items) {
+        UpdateProcessingRate(item.metadata.camera_id);
+    }
+    
+    return true;
+}
+
+bool TPUZeroCopyIntegration::ProcessSynchronizedFrames(
+    std::vector<std::vector<cv::KeyPoint>>& all_keypoints,
+    std::vector<cv::Mat>& all_descriptors,
+    int timeout_ms)
+{
+    ZeroCopyFrameProvider::FrameSet frame_set;
+    if (!frame_provider_->GetSynchronizedFrames(frame_set, 10.0f, timeout_ms)) {
+        SetErrorMessage("Failed to get synchronized frames");
+        return false;
+    }
+    
+    std::vector<ExtractionResult> results;
+    const bool success = ProcessFrameSet(frame_set, results);
+    
+    // The images were only borrowed for extraction
+    frame_provider_->ReleaseFrameSet(frame_set);
+    
+    if (!success) {
+        return false;
+    }
+    
+    all_keypoints.clear();
+    all_descriptors.clear();
+    all_keypoints.reserve(results.size());
+    all_descriptors.reserve(results.size());
+    for (auto& result : results) {
+        all_keypoints.push_back(std::move(result.keypoints));
+        all_descriptors.push_back(result.descriptors);
+    }
+    
+    return true;
+}
+
+bool TPUZeroCopyIntegration::EnableBatchedInference(bool enable)
+{
+    // Check if running
+    if (running_) {
+        SetErrorMessage("Cannot change batched mode while integration is running");
+        return false;
+    }
+    
+    batched_enabled_ = enable;
+    return true;
+}
+
+bool TPUZeroCopyIntegration::IsBatchedInferenceEnabled() const
+{
+    return batched_enabled_;
+}
+
+bool TPUZeroCopyIntegration::EnableCPUFallback(
+    std::shared_ptr<ORBextractor> cpu_extractor,
+    double latency_budget_ms,
+    const std::vector<int>& cpu_cores)
+{
+    if (running_) {
+        SetErrorMessage("Cannot change the CPU fallback while running");
+        return false;
+    }
+    
+    if (!cpu_extractor) {
+        SetErrorMessage("Invalid CPU fallback extractor");
+        return false;
+    }
+    
+    cpu_extractor_ = cpu_extractor;
+    gpu_extractor_ = dynamic_cast<GPUORBextractor*>(cpu_extractor.get());
+    latency_budget_ms_ = latency_budget_ms;
+    cpu_cores_ = cpu_cores;
+    return true;
+}
+
+bool TPUZeroCopyIntegration::DisableCPUFallback()
+{
+    if (running_) {
+        SetErrorMessage("Cannot change the CPU fallback while running");
+        return false;
+    }
+    
+    cpu_extractor_.reset();
+    gpu_extractor_ = nullptr;
+    return true;
+}
+
+bool TPUZeroCopyIntegration::EnableRGAPyramid(std::shared_ptr<RGAPyramidBuilder> builder)
+{
+    if (running_) {
+        SetErrorMessage("Cannot change the RGA pyramid while running");
+        return false;
+    }
+    
+    if (!builder) {
+        SetErrorMessage("Invalid RGA pyramid builder");
+        return false;
+    }
+    
+    if (!builder->IsAvailable()) {
+        std::cerr << "RGA is not available, image pyramids are built on the CPU" << std::endl;
+    }
+    
+    rga_pyramid_ = builder;
+    return true;
+}
+
+bool TPUZeroCopyIntegration::DisableRGAPyramid()
+{
+    if (running_) {
+        SetErrorMessage("Cannot change the RGA pyramid while running");
+        return false;
+    }
+    
+    rga_pyramid_.reset();
+    return true;
+}
+
+bool TPUZeroCopyIntegration::IsCPUFallbackEnabled() const
+{
+    return cpu_extractor_ != nullptr;
+}
+
+uint64_t TPUZeroCopyIntegration::GetCPUFallbackCount() const
+{
+    return cpu_frames_;
+}
+
+bool TPUZeroCopyIntegration::EnableTemporalTracking(int detection_interval, float min_survival)
+{
+    if (running_) {
+        SetErrorMessage("Cannot change temporal tracking while running");
+        return false;
+    }
+    
+    if (detection_interval < 2) {
+        SetErrorMessage("Detection interval must be at least 2 frames");
+        return false;
+    }
+    
+    detection_interval_ = detection_interval;
+    min_track_survival_ = std::max(0.0f, std::min(min_survival, 1.0f));
+    return true;
+}
+
+bool TPUZeroCopyIntegration::DisableTemporalTracking()
+{
+    if (running_) {
+        SetErrorMessage("Cannot change temporal tracking while running");
+        return false;
+    }
+    
+    detection_interval_ = 1;
+    return true;
+}
+
+bool TPUZeroCopyIntegration::IsTemporalTrackingEnabled() const
+{
+    return detection_interval_ > 1;
+}
+
+void TPUZeroCopyIntegration::RegisterMotionPrior(MotionPrior prior)
+{
+    motion_prior_ = prior;
+}
+
+uint64_t TPUZeroCopyIntegration::GetTrackedFrameCount() const
+{
+    return tracked_frames_;
+}
+
+bool TPUZeroCopyIntegration::SetCameraMask(int camera_id, const cv::Mat& mask)
+{
+    return SetMask(camera_id, mask, static_masks_);
+}
+
+bool TPUZeroCopyIntegration::SetDynamicMask(int camera_id, const cv::Mat& mask)
+{
+    return SetMask(camera_id, mask, dynamic_masks_);
+}
+
+void TPUZeroCopyIntegration::SetFeatureTarget(int n_features_target)
+{
+    for (auto& device : devices_) {
+        device->extractor->SetFeatureTarget(n_features_target);
+    }
+}
+
+int TPUZeroCopyIntegration::GetFeatureTarget() const
+{
+    return devices_.empty() ? 0 : devices_[0]->extractor->GetFeatureTarget();
+}
+
 void TPUZeroCopyIntegration::RegisterResultCallback(std::function<void(const ExtractionResult&)> callback)
 {
     result_callback_ = callback;
@@ -257,10 +590,31 @@ float TPUZeroCopyIntegration::GetCurrentProcessingRate(int camera_id) const
     return processing_rates_[camera_id];
 }
 
+size_t TPUZeroCopyIntegration::GetDeviceCount() const
+{
+    return devices_.size();
+}
+
+TPUZeroCopyIntegration::DeviceStats TPUZeroCopyIntegration::GetDeviceStats(int device_index) const
+{
+    DeviceStats stats = {0.0f, 0.0f, 0, 0};
+    if (device_index < 0 || device_index >= static_cast<int>(devices_.size())) {
+        return stats;
+    }
+    
+    const TPUDevice& device = *devices_[device_index];
+    std::lock_guard<std::mutex> lock(device.stats_mutex);
+    stats.processing_rate = device.processing_rate;
+    stats.utilization = device.utilization;
+    stats.queue_depth = device.queue_depth.load();
+    stats.frames = device.frames;
+    return stats;
+}
+
 size_t TPUZeroCopyIntegration::GetQueueSize() const
 {
     std::lock_guard<std::mutex> lock(queue_mutex_);
-    return frame_queue_.size();
+    return frame_queue_.size() + set_queue_.size();
 }
 
 std::string TPUZeroCopyIntegration::GetLastErrorMessage() const
@@ -298,10 +652,14 @@ bool TPUZeroCopyIntegration::IsDirectDMAAccessSupported() const
         }
     }
     
-    // Check if EdgeTPU supports DMA buffer import
-    // This is a simplified check; in a real implementation, you would need to
-    // check the specific EdgeTPU device capabilities
-    bool edgetpu_supports_dma = true; // Assume EdgeTPU supports DMA
+    // Check if every extractor can bind a DMA-BUF plane as its input tensor
+    bool edgetpu_supports_dma = !devices_.empty();
+    for (const auto& device : devices_) {
+        if (!device->extractor->SupportsZeroCopyInput()) {
+            edgetpu_supports_dma = false;
+            break;
+        }
+    }
     
     return provider_supports_zero_copy && edgetpu_supports_dma;
 }
@@ -316,15 +674,16 @@ void TPUZeroCopyIntegration::AcquisitionThreadFunc()
     #ifdef __linux__
         pthread_setname_np(pthread_self(), "ZC-Acquisition");
     #endif
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::CAMERA_ACQUISITION, "ZC-Acquisition");
     
     while (running_) {
         // Check if queue is full
         {
             std::unique_lock<std::mutex> lock(queue_mutex_);
-            if (frame_queue_.size() >= static_cast<size_t>(queue_size_)) {
+            if (frame_queue_.size() + set_queue_.size() >= static_cast<size_t>(queue_size_)) {
                 // Wait for queue to have space
                 queue_condition_.wait(lock, [this]() {
-                    return !running_ || frame_queue_.size() < static_cast<size_t>(queue_size_);
+                    return !running_ || frame_queue_.size() + set_queue_.size() < static_cast<size_t>(queue_size_);
                 });
             }
             
@@ -337,8 +696,12 @@ void TPUZeroCopyIntegration::AcquisitionThreadFunc()
         // Get next frame from all cameras
         std::vector<ZeroCopyFrameProvider::FrameMetadata> metadata_vec;
         if (frame_provider_->GetNextSynchronizedFrames(metadata_vec, 10.0f, 100)) {
-            // Add frames to queue
-            std::unique_lock<std::mutex> lock(queue_mutex_);
+            TRACE_SCOPE_VALUE("AcquireFrames", metadata_vec.size());
+            if (!metadata_vec.empty()) {
+                TRACE_FLOW_START(metadata_vec[0].timestamp);
+            }
+            std::vector<QueueItem> items;
+            items.reserve(metadata_vec.size());
             
             for (const auto& metadata : metadata_vec) {
                 QueueItem item;
@@ -347,14 +710,42 @@ void TPUZeroCopyIntegration::AcquisitionThreadFunc()
                 // If not using direct DMA, get Mat for frame
                 if (!direct_dma_enabled_) {
                     item.image = frame_provider_->GetMatForFrame(metadata);
+                    item.scaled_image = frame_provider_->GetScaledMatForFrame(metadata);
+                }
+                
+                // The RGA scales the pyramid from the camera buffer while the frame waits
+                if (rga_pyramid_ && !batched_enabled_ && metadata.dma_fd >= 0 && metadata.pixel_format == "GREY") {
+                    item.pyramid = rga_pyramid_->Build(metadata.dma_fd, metadata.buffer_ptr, GetDmaBufferSize(metadata),
+                                                       metadata.width, metadata.height, metadata.width);
                 }
                 
-                frame_queue_.push(item);
+                items.push_back(item);
+            }
+            
+            // Add frames to queue, as one set in batched mode
+            bool offloaded = false;
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            if (batched_enabled_) {
+                set_queue_.push(std::move(items));
+            } else {
+                for (auto& item : items) {
+                    // Hand a frame that would miss the latency budget to the idle CPU fallback
+                    if (cpu_extractor_ && !cpu_busy_ && EstimateTPULatencyMs() > latency_budget_ms_) {
+                        cpu_busy_ = true;
+                        cpu_queue_.push(std::move(item));
+                        offloaded = true;
+                    } else {
+                        frame_queue_.push(std::move(item));
+                    }
+                }
             }
             
             // Notify processing threads
             lock.unlock();
             queue_condition_.notify_one();
+            if (offloaded) {
+                cpu_condition_.notify_one();
+            }
         }
     }
 }
@@ -365,16 +756,18 @@ void TPUZeroCopyIntegration::ProcessingThreadFunc()
     #ifdef __linux__
         pthread_setname_np(pthread_self(), "ZC-Processing");
     #endif
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::FEATURE_EXTRACTION, "ZC-Processing");
     
     while (running_) {
-        // Get next frame from queue
+        // Get next frame (or frame set) from queue
         QueueItem item;
+        std::vector<QueueItem> set_items;
         {
             std::unique_lock<std::mutex> lock(queue_mutex_);
             
             // Wait for a frame
             queue_condition_.wait(lock, [this]() {
-                return !running_ || !frame_queue_.empty();
+                return !running_ || !frame_queue_.empty() || !set_queue_.empty();
             });
             
             // Check if still running
@@ -382,52 +775,153 @@ void TPUZeroCopyIntegration::ProcessingThreadFunc()
                 break;
             }
             
-            // Check if queue is empty
-            if (frame_queue_.empty()) {
+            // Get frame set or frame from queue
+            if (!set_queue_.empty()) {
+                set_items = std::move(set_queue_.front());
+                set_queue_.pop();
+            } else if (!frame_queue_.empty()) {
+                item = frame_queue_.front();
+                frame_queue_.pop();
+            } else {
                 continue;
             }
             
-            // Get frame from queue
-            item = frame_queue_.front();
-            frame_queue_.pop();
-            
             // Notify acquisition thread
             lock.unlock();
             queue_condition_.notify_one();
         }
         
+        if (!set_items.empty()) {
+            // Map the frames the acquisition thread left to the DMA path
+            for (auto& set_item : set_items) {
+                if (set_item.image.empty()) {
+                    set_item.image = frame_provider_->GetMatForFrame(set_item.metadata);
+                    set_item.scaled_image = frame_provider_->GetScaledMatForFrame(set_item.metadata);
+                }
+            }
+            
+            TRACE_SCOPE("ExtractFrameSet");
+            TRACE_FLOW_STEP(set_items[0].metadata.timestamp);
+            std::vector<ExtractionResult> results = ProcessFrameBatch(set_items);
+            
+            // Release frames and update statistics
+            for (const auto& set_item : set_items) {
+                frame_provider_->ReleaseFrame(set_item.metadata);
+                UpdateProcessingRate(set_item.metadata.camera_id);
+            }
+            
+            // Call callback if registered
+            if (result_callback_) {
+                for (const auto& result : results) {
+                    result_callback_(result);
+                }
+            }
+            
+            // Add results to queue
+            {
+                std::lock_guard<std::mutex> lock(result_mutex_);
+                set_result_queue_.push(std::move(results));
+            }
+            
+            // Notify waiting threads
+            result_condition_.notify_one();
+            continue;
+        }
+        
         // Process frame
         ExtractionResult result;
         if (direct_dma_enabled_) {
-            result = ProcessFrameDMA(item.metadata);
+            result = ProcessFrameDMA(item.metadata, item.pyramid);
         } else {
-            result = ProcessFrameMat(item.metadata, item.image);
+            result = ProcessFrameMat(item.metadata, item.image, item.scaled_image, item.pyramid);
         }
         
-        // Release frame
-        frame_provider_->ReleaseFrame(item.metadata);
-        
-        // Update statistics
-        UpdateProcessingRate(item.metadata.camera_id);
+        PublishResult(item.metadata, result);
+    }
+}
+
+void TPUZeroCopyIntegration::CPUFallbackThreadFunc()
+{
+    // Set thread name for debugging
+    #ifdef __linux__
+        pthread_setname_np(pthread_self(), "ZC-CPUFallback");
+    #endif
+    
+    // Keep ORB extraction off the cores running tracking
+    if (!cpu_cores_.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (int core : cpu_cores_) {
+            CPU_SET(core, &cpuset);
+        }
         
-        // Add result to queue
+        int r = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (r != 0) {
+            SetErrorMessage("Failed to set CPU fallback thread affinity: " + std::string(strerror(r)));
+        }
+    }
+    
+    while (running_) {
+        // Get next frame from the fallback queue
+        QueueItem item;
         {
-            std::lock_guard<std::mutex> lock(result_mutex_);
-            result_queue_.push(result);
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            
+            // Wait for a frame
+            cpu_condition_.wait(lock, [this]() {
+                return !running_ || !cpu_queue_.empty();
+            });
+            
+            // Check if still running
+            if (!running_) {
+                break;
+            }
+            
+            item = cpu_queue_.front();
+            cpu_queue_.pop();
         }
         
-        // Notify waiting threads
-        result_condition_.notify_one();
+        ExtractionResult result = ProcessFrameCPU(item.metadata, item.image, item.pyramid);
+        cpu_frames_++;
+        PublishResult(item.metadata, result);
         
-        // Call callback if registered
-        if (result_callback_) {
-            result_callback_(result);
+        // Accept the next overflow frame
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            cpu_busy_ = false;
         }
     }
 }
 
-TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameDMA(
-    const ZeroCopyFrameProvider::FrameMetadata& metadata)
+void TPUZeroCopyIntegration::PublishResult(
+    const ZeroCopyFrameProvider::FrameMetadata& metadata,
+    const ExtractionResult& result)
+{
+    // Release frame
+    frame_provider_->ReleaseFrame(metadata);
+    
+    // Update statistics
+    UpdateProcessingRate(metadata.camera_id);
+    
+    // Add result to queue
+    {
+        std::lock_guard<std::mutex> lock(result_mutex_);
+        result_queue_.push(result);
+    }
+    
+    // Notify waiting threads
+    result_condition_.notify_one();
+    
+    // Call callback if registered
+    if (result_callback_) {
+        result_callback_(result);
+    }
+}
+
+TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameCPU(
+    const ZeroCopyFrameProvider::FrameMetadata& metadata,
+    const cv::Mat& image,
+    const std::shared_ptr<RGAPyramid>& pyramid)
 {
     // Start timing
     auto start_time = std::chrono::high_resolution_clock::now();
@@ -437,24 +931,58 @@ TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameDMA
     result.frame_id = metadata.frame_id;
     result.timestamp = metadata.timestamp;
     result.camera_id = metadata.camera_id;
+    result.latency = metadata.latency;
+    result.device_index = -1;
+    result.source = ExtractorSource::CPU;
     
-    // Get DMA file descriptor for frame
-    int dma_fd = frame_provider_->GetDmaFdForFrame(metadata);
+    // Frames queued in DMA mode are mapped here
+    cv::Mat frame = image.empty() ? frame_provider_->GetMatForFrame(metadata) : image;
+    
+    // The GPU reads the mapped frame from its DMA-BUF
+    if (gpu_extractor_ && image.empty() && metadata.dma_fd >= 0) {
+        gpu_extractor_->RegisterDmaBuffer(metadata.dma_fd, metadata.buffer_ptr, GetDmaBufferSize(metadata));
+    }
     
-    // In a real implementation, you would use the DMA file descriptor to create
-    // a TensorFlow Lite tensor that directly references the DMA buffer, avoiding
-    // any memory copies. This would require custom TensorFlow Lite ops or
-    // extensions to the EdgeTPU delegate.
-    //
-    // For this implementation, we'll simulate the process by getting a Mat for
-    // the frame and then processing it.
+    // Extract ORB features; an empty lapping area keeps every keypoint monocular.
+    // The frame skips the TPU stages, so the tracker charges ORB from DQBUF on.
+    std::vector<int> lapping_area = {0, -1};
+    cpu_extractor_->SetPyramid(pyramid);
+    (*cpu_extractor_)(frame, GetFrameMask(metadata.camera_id), result.keypoints, result.descriptors, lapping_area);
+    
+    // Calculate processing time
+    auto end_time = std::chrono::high_resolution_clock::now();
+    result.processing_time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    
+    return result;
+}
+
+TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameDMA(
+    const ZeroCopyFrameProvider::FrameMetadata& metadata,
+    const std::shared_ptr<RGAPyramid>& pyramid)
+{
+    // Start timing
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    // Create result structure
+    ExtractionResult result;
+    result.frame_id = metadata.frame_id;
+    result.timestamp = metadata.timestamp;
+    result.camera_id = metadata.camera_id;
+    result.latency = metadata.latency;
+    
+    // The full-resolution mapping gives the keypoint coordinate frame (and
+    // feeds tracking); the model reads the ISP-scaled plane of the DMA-BUF
     cv::Mat image = frame_provider_->GetMatForFrame(metadata);
     
-    // Create mask (if needed)
-    cv::Mat mask;
+    // With a uint8-input model, a model-sized, continuous and 64-byte aligned
+    // scaled plane is bound as the interpreter's input tensor, so the camera
+    // bytes reach the EdgeTPU without a CPU copy (see
+    // TPUFeatureExtractor::SupportsZeroCopyInput()). Otherwise it is copied,
+    // still without a CPU resize.
+    cv::Mat scaled_image = frame_provider_->GetScaledMatForFrame(metadata);
     
-    // Extract features using TPUFeatureExtractor
-    (*feature_extractor_)(image, mask, result.keypoints, result.descriptors, result.lapping_area);
+    // Extract or track features
+    ExtractFrame(metadata, image, scaled_image, pyramid, result);
     
     // Calculate processing time
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -465,7 +993,9 @@ TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameDMA
 
 TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameMat(
     const ZeroCopyFrameProvider::FrameMetadata& metadata,
-    const cv::Mat& image)
+    const cv::Mat& image,
+    const cv::Mat& scaled_image,
+    const std::shared_ptr<RGAPyramid>& pyramid)
 {
     // Start timing
     auto start_time = std::chrono::high_resolution_clock::now();
@@ -475,12 +1005,10 @@ TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameMat
     result.frame_id = metadata.frame_id;
     result.timestamp = metadata.timestamp;
     result.camera_id = metadata.camera_id;
+    result.latency = metadata.latency;
     
-    // Create mask (if needed)
-    cv::Mat mask;
-    
-    // Extract features using TPUFeatureExtractor
-    (*feature_extractor_)(image, mask, result.keypoints, result.descriptors, result.lapping_area);
+    // Extract or track features
+    ExtractFrame(metadata, image, scaled_image, pyramid, result);
     
     // Calculate processing time
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -489,6 +1017,386 @@ TPUZeroCopyIntegration::ExtractionResult TPUZeroCopyIntegration::ProcessFrameMat
     return result;
 }
 
+void TPUZeroCopyIntegration::ExtractFrame(
+    const ZeroCopyFrameProvider::FrameMetadata& metadata,
+    const cv::Mat& image,
+    const cv::Mat& scaled_image,
+    const std::shared_ptr<RGAPyramid>& pyramid,
+    ExtractionResult& result)
+{
+    // Static and dynamic mask of the camera
+    cv::Mat mask = GetFrameMask(metadata.camera_id);
+    
+    // Between detections, propagate the keypoints of the last frame instead of running the TPU
+    TemporalTrack* track = nullptr;
+    std::unique_lock<std::mutex> track_lock;
+    cv::Mat gray;
+    if (detection_interval_ > 1 && metadata.camera_id >= 0 &&
+        metadata.camera_id < static_cast<int>(temporal_tracks_.size())) {
+        track = temporal_tracks_[metadata.camera_id].get();
+        track_lock = std::unique_lock<std::mutex>(track->mutex);
+        
+        if (image.channels() == 1) {
+            gray = image;
+        } else {
+            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        }
+        
+        if (TrackFrame(*track, metadata, gray, mask, result)) {
+            tracked_frames_++;
+            return;
+        }
+    }
+    
+    // Extract features using TPUFeatureExtractor
+    result.source = ExtractorSource::TPU;
+    result.device_index = AcquireDevice(metadata.camera_id);
+    TPUDevice& device = *devices_[result.device_index];
+    {
+        std::lock_guard<std::mutex> lock(device.mutex);
+        // An NPU reads the ISP-scaled plane from its DMA-BUF
+        if (!scaled_image.empty() && metadata.scaled_dma_fd >= 0) {
+            device.extractor->RegisterDmaBuffer(metadata.scaled_dma_fd, metadata.scaled_buffer_ptr,
+                                                metadata.scaled_buffer_size);
+        }
+        device.extractor->SetPyramid(pyramid);
+        result.latency.Stamp(LatencyStage::TPU_SUBMIT);
+        (*device.extractor)(image, scaled_image, mask, result.keypoints, result.descriptors, result.lapping_area);
+        result.latency.Stamp(LatencyStage::TPU_DONE);
+        result.descriptor_version = device.extractor->GetDescriptorVersion();
+    }
+    ReleaseDevice(result.device_index,
+                  (result.latency.Get(LatencyStage::TPU_DONE) - result.latency.Get(LatencyStage::TPU_SUBMIT)) * 1000.0, 1);
+    
+    // Restart tracking from the detection (a late frame must not rewind the track)
+    if (track && metadata.timestamp > track->timestamp) {
+        cv::buildOpticalFlowPyramid(gray, track->pyramid, kTrackWindow, kTrackLevels);
+        track->timestamp = metadata.timestamp;
+        track->keypoints = result.keypoints;
+        track->descriptors = result.descriptors;
+        track->descriptor_version = result.descriptor_version;
+        track->detected = result.keypoints.size();
+        track->frames_since_detection = 0;
+        track->force_detection = result.keypoints.empty();
+    }
+}
+
+bool TPUZeroCopyIntegration::TrackFrame(
+    TemporalTrack& track,
+    const ZeroCopyFrameProvider::FrameMetadata& metadata,
+    const cv::Mat& gray,
+    const cv::Mat& mask,
+    ExtractionResult& result)
+{
+    if (track.force_detection || track.pyramid.empty() || track.keypoints.empty() ||
+        track.frames_since_detection + 1 >= detection_interval_ ||
+        metadata.timestamp <= track.timestamp) {
+        return false;
+    }
+    
+    std::vector<cv::Mat> pyramid;
+    cv::buildOpticalFlowPyramid(gray, pyramid, kTrackWindow, kTrackLevels);
+    
+    std::vector<cv::Point2f> prev_points(track.keypoints.size());
+    for (size_t i = 0; i < track.keypoints.size(); ++i) {
+        prev_points[i] = track.keypoints[i].pt;
+    }
+    
+    // Seed the flow with the predicted image motion
+    std::vector<cv::Point2f> next_points = prev_points;
+    int flags = 0;
+    cv::Matx33f homography;
+    if (motion_prior_ && motion_prior_(metadata.camera_id, track.timestamp, metadata.timestamp, homography)) {
+        for (auto& point : next_points) {
+            const float w = homography(2, 0) * point.x + homography(2, 1) * point.y + homography(2, 2);
+            if (std::abs(w) > 1e-6f) {
+                point = cv::Point2f(
+                    (homography(0, 0) * point.x + homography(0, 1) * point.y + homography(0, 2)) / w,
+                    (homography(1, 0) * point.x + homography(1, 1) * point.y + homography(1, 2)) / w);
+            }
+        }
+        flags = cv::OPTFLOW_USE_INITIAL_FLOW;
+    }
+    
+    std::vector<uchar> status;
+    std::vector<float> error;
+    cv::calcOpticalFlowPyrLK(track.pyramid, pyramid, prev_points, next_points, status, error,
+                             kTrackWindow, kTrackLevels,
+                             cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01),
+                             flags);
+    
+    // Keep the points that were found inside the image and the mask
+    std::vector<int> survivors;
+    survivors.reserve(next_points.size());
+    for (size_t i = 0; i < next_points.size(); ++i) {
+        const int x = static_cast<int>(next_points[i].x);
+        const int y = static_cast<int>(next_points[i].y);
+        if (!status[i] || next_points[i].x < 0.0f || next_points[i].y < 0.0f ||
+            x >= gray.cols || y >= gray.rows) {
+            continue;
+        }
+        if (!mask.empty() && mask.at<uchar>(y, x) == 0) {
+            continue;
+        }
+        survivors.push_back(static_cast<int>(i));
+    }
+    
+    result.source = ExtractorSource::TRACKED;
+    result.device_index = -1;
+    result.descriptor_version = track.descriptor_version;
+    result.keypoints.clear();
+    result.keypoints.reserve(survivors.size());
+    result.descriptors = cv::Mat(static_cast<int>(survivors.size()), track.descriptors.cols, track.descriptors.type());
+    for (size_t j = 0; j < survivors.size(); ++j) {
+        cv::KeyPoint keypoint = track.keypoints[survivors[j]];
+        keypoint.pt = next_points[survivors[j]];
+        result.keypoints.push_back(keypoint);
+        track.descriptors.row(survivors[j]).copyTo(result.descriptors.row(static_cast<int>(j)));
+    }
+    result.lapping_area.clear();
+    
+    // The next frame tracks from this one
+    track.pyramid = std::move(pyramid);
+    track.timestamp = metadata.timestamp;
+    track.keypoints = result.keypoints;
+    track.descriptors = result.descriptors;
+    track.frames_since_detection++;
+    track.force_detection = survivors.size() < min_track_survival_ * track.detected;
+    
+    return true;
+}
+
+std::vector<TPUZeroCopyIntegration::ExtractionResult> TPUZeroCopyIntegration::ProcessFrameBatch(
+    const std::vector<QueueItem>& items)
+{
+    TRACE_SCOPE_VALUE("ProcessFrameBatch", items.size());
+    
+    // Start timing
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    std::vector<ExtractionResult> results(items.size());
+    std::vector<cv::Mat> images(items.size());
+    std::vector<cv::Mat> scaled_images(items.size());
+    
+    for (size_t i = 0; i < items.size(); ++i) {
+        results[i].frame_id = items[i].metadata.frame_id;
+        results[i].timestamp = items[i].metadata.timestamp;
+        results[i].camera_id = items[i].metadata.camera_id;
+        results[i].latency = items[i].metadata.latency;
+        images[i] = items[i].image;
+        scaled_images[i] = items[i].scaled_image;
+    }
+    
+    // Extract features of all frames in one batch on the least-loaded device
+    std::vector<std::vector<cv::KeyPoint>> keypoints;
+    std::vector<cv::Mat> descriptors;
+    double submit_s = 0.0;
+    double done_s = 0.0;
+    int descriptor_version = 0;
+    const int device_index = AcquireDevice(-1);
+    TPUDevice& device = *devices_[device_index];
+    {
+        std::lock_guard<std::mutex> lock(device.mutex);
+        for (const QueueItem& item : items) {
+            if (!item.scaled_image.empty() && item.metadata.scaled_dma_fd >= 0) {
+                device.extractor->RegisterDmaBuffer(item.metadata.scaled_dma_fd, item.metadata.scaled_buffer_ptr,
+                                                    item.metadata.scaled_buffer_size);
+            }
+        }
+        submit_s = LatencyNowSeconds();
+        device.extractor->ExtractBatch(images, scaled_images, keypoints, descriptors);
+        done_s = LatencyNowSeconds();
+        descriptor_version = device.extractor->GetDescriptorVersion();
+    }
+    ReleaseDevice(device_index, (done_s - submit_s) * 1000.0, static_cast<int>(items.size()));
+    
+    // Calculate processing time (shared by the whole batch)
+    auto end_time = std::chrono::high_resolution_clock::now();
+    const double processing_time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    
+    for (size_t i = 0; i < results.size(); ++i) {
+        results[i].latency.Set(LatencyStage::TPU_SUBMIT, submit_s);
+        results[i].latency.Set(LatencyStage::TPU_DONE, done_s);
+        results[i].processing_time_ms = processing_time_ms;
+        results[i].device_index = device_index;
+        results[i].source = ExtractorSource::TPU;
+        results[i].descriptor_version = descriptor_version;
+        if (i < keypoints.size()) {
+            results[i].keypoints = std::move(keypoints[i]);
+            results[i].descriptors = descriptors[i];
+        }
+    }
+    
+    return results;
+}
+
+int TPUZeroCopyIntegration::AcquireDevice(int camera_id)
+{
+    const size_t num_devices = devices_.size();
+    
+    // Time per frame of each device; EdgeTPUs and NPU cores differ
+    std::vector<double> frame_ms(num_devices, 0.0);
+    double measured_ms = 0.0;
+    int measured = 0;
+    for (size_t i = 0; i < num_devices; ++i) {
+        std::lock_guard<std::mutex> lock(devices_[i]->stats_mutex);
+        frame_ms[i] = devices_[i]->frame_ms;
+        if (frame_ms[i] > 0.0) {
+            measured_ms += frame_ms[i];
+            measured++;
+        }
+    }
+    const double unmeasured_ms = measured > 0 ? measured_ms / measured : 1.0;
+    
+    // Prefer the camera's device so its frames stay on one device, unless another one finishes first
+    auto expected_ms = [this, &frame_ms, unmeasured_ms](size_t i) {
+        return (std::max(0, devices_[i]->queue_depth.load()) + 1) * (frame_ms[i] > 0.0 ? frame_ms[i] : unmeasured_ms);
+    };
+    size_t best = camera_id >= 0 ? static_cast<size_t>(camera_id) % num_devices
+                                 : next_device_.fetch_add(1) % num_devices;
+    double best_ms = expected_ms(best);
+    for (size_t i = 0; i < num_devices; ++i) {
+        const double ms = expected_ms(i);
+        if (ms < best_ms) {
+            best = i;
+            best_ms = ms;
+        }
+    }
+    
+    devices_[best]->queue_depth.fetch_add(1);
+    return static_cast<int>(best);
+}
+
+void TPUZeroCopyIntegration::ReleaseDevice(int device_index, double busy_ms, int frames)
+{
+    TPUDevice& device = *devices_[device_index];
+    device.queue_depth.fetch_sub(1);
+    
+    std::lock_guard<std::mutex> lock(device.stats_mutex);
+    auto now = std::chrono::steady_clock::now();
+    device.frames += frames;
+    device.window_frames += frames;
+    device.window_busy_ms += busy_ms;
+    if (frames > 0) {
+        const double frame_ms = busy_ms / frames;
+        device.frame_ms = device.frame_ms > 0.0 ? 0.9 * device.frame_ms + 0.1 * frame_ms : frame_ms;
+    }
+    
+    if (device.window_start.time_since_epoch().count() == 0) {
+        // First work on this device
+        device.window_start = now;
+        return;
+    }
+    
+    auto elapsed = std::chrono::duration<double, std::milli>(now - device.window_start).count();
+    if (elapsed >= 1000.0) {
+        device.processing_rate = static_cast<float>(device.window_frames * 1000.0 / elapsed);
+        device.utilization = static_cast<float>(std::min(1.0, device.window_busy_ms / elapsed));
+        device.window_frames = 0;
+        device.window_busy_ms = 0.0;
+        device.window_start = now;
+    }
+}
+
+void TPUZeroCopyIntegration::ImportBufferPool()
+{
+    buffer_pool_ = frame_provider_->GetBufferPool();
+    if (!buffer_pool_) {
+        return;
+    }
+    
+    // The devices keep the imports while the fd and mapping stay the same,
+    // which they do for the lifetime of the pool
+    size_t rga_imports = 0;
+    for (size_t i = 0; i < buffer_pool_->GetBufferCount(); ++i) {
+        const DmaBufferPool::Buffer& buffer = buffer_pool_->GetBuffer(static_cast<int>(i));
+        for (auto& device : devices_) {
+            device->extractor->RegisterDmaBuffer(buffer.dma_fd, buffer.data, buffer.size);
+        }
+        if (gpu_extractor_) {
+            gpu_extractor_->RegisterDmaBuffer(buffer.dma_fd, buffer.data, buffer.size);
+        }
+        if (rga_pyramid_ && rga_pyramid_->Import(buffer.dma_fd, buffer.data, buffer.size)) {
+            rga_imports++;
+        }
+    }
+    
+    std::cout << "TPUZeroCopyIntegration imported " << buffer_pool_->GetBufferCount() << " camera buffers from "
+              << buffer_pool_->GetSource() << (rga_pyramid_ ? " (" + std::to_string(rga_imports) + " into the RGA)" : "")
+              << "." << std::endl;
+}
+
+size_t TPUZeroCopyIntegration::GetDmaBufferSize(const ZeroCopyFrameProvider::FrameMetadata& metadata) const
+{
+    if (buffer_pool_) {
+        const int handle = buffer_pool_->FindBuffer(metadata.buffer_ptr);
+        if (handle >= 0) {
+            return buffer_pool_->GetBuffer(handle).size;
+        }
+    }
+    return metadata.buffer_size;
+}
+
+bool TPUZeroCopyIntegration::SetMask(int camera_id, const cv::Mat& mask, std::vector<cv::Mat>& masks)
+{
+    if (camera_id < 0 || camera_id >= static_cast<int>(masks.size())) {
+        SetErrorMessage("Invalid camera ID for mask: " + std::to_string(camera_id));
+        return false;
+    }
+    
+    if (!mask.empty() && mask.type() != CV_8UC1) {
+        SetErrorMessage("Mask must be CV_8UC1");
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mask_mutex_);
+    masks[camera_id] = mask.clone();
+    
+    // Frames in flight keep the previous combined mask
+    const cv::Mat& static_mask = static_masks_[camera_id];
+    const cv::Mat& dynamic_mask = dynamic_masks_[camera_id];
+    if (static_mask.empty() || dynamic_mask.empty()) {
+        frame_masks_[camera_id] = static_mask.empty() ? dynamic_mask : static_mask;
+    } else if (static_mask.size() != dynamic_mask.size()) {
+        SetErrorMessage("Static and dynamic masks differ in size, using the static mask");
+        frame_masks_[camera_id] = static_mask;
+    } else {
+        cv::Mat combined;
+        cv::bitwise_and(static_mask, dynamic_mask, combined);
+        frame_masks_[camera_id] = combined;
+    }
+    
+    return true;
+}
+
+cv::Mat TPUZeroCopyIntegration::GetFrameMask(int camera_id) const
+{
+    std::lock_guard<std::mutex> lock(mask_mutex_);
+    if (camera_id < 0 || camera_id >= static_cast<int>(frame_masks_.size())) {
+        return cv::Mat();
+    }
+    return frame_masks_[camera_id];
+}
+
+double TPUZeroCopyIntegration::EstimateTPULatencyMs() const
+{
+    // Frames ahead of a new one drain at the summed throughput of the devices
+    double frames_per_ms = 0.0;
+    size_t in_flight = 0;
+    for (const auto& device : devices_) {
+        std::lock_guard<std::mutex> lock(device->stats_mutex);
+        if (device->frame_ms > 0.0) {
+            frames_per_ms += 1.0 / device->frame_ms;
+        }
+        in_flight += static_cast<size_t>(std::max(0, device->queue_depth.load()));
+    }
+    
+    if (frames_per_ms <= 0.0) {
+        return 0.0;
+    }
+    return (frame_queue_.size() + in_flight + 1) / frames_per_ms;
+}
+
 void TPUZeroCopyIntegration::SetErrorMessage(const std::string& message)
 {
     std::lock_guard<std::mutex> lock(error_mutex_);
@@ -1,15 +1,99 @@
 #include "include/visual_inertial_fusion.hpp"
+#include "include/thread_placement.hpp"
+#include "ORB_SLAM3/include/Trace.h"
 
 #include <chrono>
 #include <algorithm>
 #include <cmath>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <iomanip>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
 #include <opencv2/core/eigen.hpp>
 
 namespace ORB_SLAM3
 {
 
+namespace
+{
+
+static_assert(std::is_trivially_copyable<VisualInertialFusion::Checkpoint>::value,
+              "Checkpoints are written and read as is");
+
+double MonotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// FNV-1a over the checkpoint with the checksum field zero
+uint32_t CheckpointChecksum(const VisualInertialFusion::Checkpoint& checkpoint)
+{
+    VisualInertialFusion::Checkpoint copy = checkpoint;
+    copy.checksum = 0;
+    
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&copy);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(copy); ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void StoreVector(const Eigen::Vector3f& vector, float* out)
+{
+    std::copy(vector.data(), vector.data() + 3, out);
+}
+
+Eigen::Vector3f LoadVector(const float* in)
+{
+    return Eigen::Vector3f(in[0], in[1], in[2]);
+}
+
+FixedLagSmoother::Config MakeSmootherConfig(const VisualInertialFusion::Config& config, const IMU::Calib& calib)
+{
+    FixedLagSmoother::Config smoother_config;
+    smoother_config.window_size = config.fixed_lag_size;
+    smoother_config.max_iterations = config.max_iterations;
+    smoother_config.gravity = Eigen::Vector3f(0, 0, -config.gravity_magnitude);
+    if (calib.mbIsSet)
+    {
+        smoother_config.gyro_walk_sigma = std::sqrt(calib.CovWalk.diagonal()(0));
+        smoother_config.acc_walk_sigma = std::sqrt(calib.CovWalk.diagonal()(3));
+    }
+    return smoother_config;
+}
+
+FixedLagSmoother::ImuDelta MakeSmootherDelta(const IMU::Preintegrated& preintegrated)
+{
+    FixedLagSmoother::ImuDelta delta;
+    delta.delta_R = preintegrated.dR;
+    delta.delta_V = preintegrated.dV;
+    delta.delta_P = preintegrated.dP;
+    delta.dt = preintegrated.dT;
+    delta.covariance = preintegrated.C.block<9, 9>(0, 0);
+    delta.JRg = preintegrated.JRg;
+    delta.JVg = preintegrated.JVg;
+    delta.JVa = preintegrated.JVa;
+    delta.JPg = preintegrated.JPg;
+    delta.JPa = preintegrated.JPa;
+    delta.bias_gyro = Eigen::Vector3f(preintegrated.b.bwx, preintegrated.b.bwy, preintegrated.b.bwz);
+    delta.bias_acc = Eigen::Vector3f(preintegrated.b.bax, preintegrated.b.bay, preintegrated.b.baz);
+    return delta;
+}
+
+// Dead-reckoning error at the loss of vision, from the last visual update
+const float kDeadReckoningPositionSigma = 0.01f;  // m
+const float kDeadReckoningRotationSigma = 0.005f; // rad
+
+} // namespace
+
 VisualInertialFusion::VisualInertialFusion(
     const Config& config,
     std::shared_ptr<BNO085Interface> imu_interface,
@@ -24,19 +108,31 @@ VisualInertialFusion::VisualInertialFusion(
       mCurrentAcceleration(Eigen::Vector3f::Zero()),
       mCurrentAngularVelocity(Eigen::Vector3f::Zero()),
       mGravityDirection(0, 0, -1),  // Default gravity direction (down)
+      mIMUReadSequence(0),
       mLastIMUTimestamp(0),
+      mIMUIntegrationGap(true),
+      mLastIMUAcceleration(Eigen::Vector3f::Zero()),
+      mLastIMUAngularVelocity(Eigen::Vector3f::Zero()),
       mLastVisualTimestamp(0),
+      mHasNewVisualPose(false),
       mVisualTrackingGood(false),
       mTrackingLossCount(0),
+      mDeadReckoningStartTime(0),
+      mDeadReckoningTime(0),
+      mSmoother(MakeSmootherConfig(config, imu_interface->GetCalibration())),
       mInitProgress(0.0f),
       mInitStartTime(0),
       mGravityInitialized(false),
-      mRunning(false)
+      mLastCheckpointTime(0),
+      mRunning(false),
+      mVisualEventPending(false),
+      mPendingIMUSamples(0)
 {
-    // Initialize IMU preintegration with default bias
+    // Initialize IMU preintegration with default bias, the two intervals are reused from then on
     IMU::Bias initial_bias;
     IMU::Calib calib = mIMUInterface->GetCalibration();
     mpImuPreintegrated = new IMU::Preintegrated(initial_bias, calib);
+    mpImuPreintegratedPrevious = new IMU::Preintegrated(initial_bias, calib);
 }
 
 VisualInertialFusion::~VisualInertialFusion()
@@ -44,6 +140,8 @@ VisualInertialFusion::~VisualInertialFusion()
     Stop();
     if (mpImuPreintegrated)
         delete mpImuPreintegrated;
+    if (mpImuPreintegratedPrevious)
+        delete mpImuPreintegratedPrevious;
 }
 
 bool VisualInertialFusion::Initialize()
@@ -59,22 +157,37 @@ bool VisualInertialFusion::Initialize()
     mGravityDirection = Eigen::Vector3f(0, 0, -1);
     mLastIMUTimestamp = 0;
     mLastVisualTimestamp = 0;
+    mHasNewVisualPose = false;
     mVisualTrackingGood = false;
     mTrackingLossCount = 0;
+    mDeadReckoningStartTime = 0;
+    mDeadReckoningTime = 0;
     mInitProgress = 0.0f;
     mInitStartTime = 0;
     mGravityInitialized = false;
     
-    // Clear IMU queue
-    std::queue<IMU::Point> empty;
-    std::swap(mIMUQueue, empty);
+    // Drop the events signalled before
+    {
+        std::lock_guard<std::mutex> lock_processing(mProcessingMutex);
+        mVisualEventPending = false;
+        mPendingIMUSamples = 0;
+    }
+    
+    // Skip the IMU measurements received before
+    mIMUReadSequence = mIMUInterface->GetMeasurementBuffer().GetWriteCount();
     
     // Reset IMU preintegration
-    IMU::Bias initial_bias;
-    IMU::Calib calib = mIMUInterface->GetCalibration();
-    if (mpImuPreintegrated)
-        delete mpImuPreintegrated;
-    mpImuPreintegrated = new IMU::Preintegrated(initial_bias, calib);
+    mCurrentBias = IMU::Bias();
+    mIMUIntegrationGap = true;
+    mLastIMUAcceleration = Eigen::Vector3f::Zero();
+    mLastIMUAngularVelocity = Eigen::Vector3f::Zero();
+    ResetPreintegration(mCurrentBias);
+    
+    // Reset the sliding window
+    {
+        std::lock_guard<std::mutex> lock_smoother(mSmootherMutex);
+        mSmoother.Reset();
+    }
     
     // Reset performance metrics
     mMetrics = PerformanceMetrics();
@@ -90,6 +203,17 @@ bool VisualInertialFusion::Start()
     mRunning = true;
     mProcessingThread = std::thread(&VisualInertialFusion::ProcessingThreadFunction, this);
     
+    // Every frame set result wakes the processing thread
+    if (mTracking)
+    {
+        mTracking->RegisterFrameCallback(
+            [this](const Sophus::SE3f& Tcw, double timestamp,
+                   const std::vector<std::vector<cv::KeyPoint>>& keypoints,
+                   const std::vector<std::vector<MapPoint*>>& map_points) {
+                OnTrackedFrame(Tcw, timestamp, keypoints, map_points);
+            });
+    }
+    
     return true;
 }
 
@@ -98,7 +222,13 @@ void VisualInertialFusion::Stop()
     if (!mRunning)
         return;
     
-    mRunning = false;
+    if (mTracking)
+        mTracking->RegisterFrameCallback(MultiCameraTracking::FrameCallback());
+    
+    {
+        std::lock_guard<std::mutex> lock(mProcessingMutex);
+        mRunning = false;
+    }
     mProcessingCondition.notify_all();
     
     if (mProcessingThread.joinable())
@@ -128,9 +258,24 @@ Sophus::SE3<float> VisualInertialFusion::GetCurrentPose() const
 Sophus::SE3<float> VisualInertialFusion::GetPredictedPose(double prediction_time_ms) const
 {
     // Use the VR motion model for prediction
+    std::lock_guard<std::mutex> lock(mMotionModelMutex);
     return mMotionModel->PredictPose(prediction_time_ms);
 }
 
+bool VisualInertialFusion::GetDeadReckonedPose(Sophus::SE3<float>& Twb, Eigen::Matrix<float, 6, 6>& covariance) const
+{
+    if (mState != State::TRACKING_IMU_ONLY)
+        return false;
+    
+    std::lock_guard<std::mutex> lock(mPoseMutex);
+    if (mDeadReckoningStartTime <= 0)
+        return false;
+    
+    Twb = mCurrentPose;
+    covariance = ComputeDeadReckoningCovariance(mDeadReckoningTime);
+    return true;
+}
+
 Eigen::Vector3f VisualInertialFusion::GetCurrentVelocity() const
 {
     std::lock_guard<std::mutex> lock(mPoseMutex);
@@ -172,20 +317,16 @@ bool VisualInertialFusion::ProcessIMUMeasurements(const std::vector<IMU::Point>&
     if (measurements.empty())
         return false;
     
-    std::lock_guard<std::mutex> lock(mIMUMutex);
-    
-    // Add measurements to the queue
-    for (const auto& measurement : measurements)
+    // The measurements are already in the IMU interface's ring, wake
+    // the processing thread for a batch of them rather than each one
+    bool wake;
     {
-        mIMUQueue.push(measurement);
-        
-        // Update last IMU timestamp
-        if (measurement.t > mLastIMUTimestamp)
-            mLastIMUTimestamp = measurement.t;
+        std::lock_guard<std::mutex> lock(mProcessingMutex);
+        mPendingIMUSamples += static_cast<int>(measurements.size());
+        wake = mPendingIMUSamples >= mConfig.imu_wakeup_samples;
     }
-    
-    // Notify processing thread
-    mProcessingCondition.notify_one();
+    if (wake)
+        mProcessingCondition.notify_one();
     
     return true;
 }
@@ -200,6 +341,8 @@ bool VisualInertialFusion::ProcessVisualTracking(
     
     // Update visual tracking state
     mLastVisualTimestamp = timestamp;
+    mLastVisualPose = pose;
+    mHasNewVisualPose = true;
     
     // Check if we have enough features for good tracking
     int total_features = 0;
@@ -208,20 +351,37 @@ bool VisualInertialFusion::ProcessVisualTracking(
     
     mVisualTrackingGood = (total_features >= mConfig.init_min_features);
     
-    // Notify processing thread
+    // Notify processing thread, visual results are fused without delay
+    {
+        std::lock_guard<std::mutex> lock_processing(mProcessingMutex);
+        mVisualEventPending = true;
+    }
     mProcessingCondition.notify_one();
     
     return true;
 }
 
+void VisualInertialFusion::OnTrackedFrame(
+    const Sophus::SE3<float>& Tcw,
+    double timestamp,
+    const std::vector<std::vector<cv::KeyPoint>>& keypoints,
+    const std::vector<std::vector<MapPoint*>>& map_points)
+{
+    // The fusion state is the body pose in the world frame
+    const Sophus::SE3<float> Twb = Tcw.inverse() * mIMUInterface->GetImuToCameraTransform().inverse();
+    ProcessVisualTracking(Twb, timestamp, keypoints, map_points);
+}
+
 void VisualInertialFusion::SetPredictionHorizon(double prediction_horizon_ms)
 {
     mConfig.prediction_horizon_ms = prediction_horizon_ms;
+    std::lock_guard<std::mutex> lock(mMotionModelMutex);
     mMotionModel->SetPredictionHorizon(prediction_horizon_ms);
 }
 
 void VisualInertialFusion::SetVRInteractionMode(VRMotionModel::InteractionMode mode)
 {
+    std::lock_guard<std::mutex> lock(mMotionModelMutex);
     mMotionModel->SetInteractionMode(mode);
 }
 
@@ -232,6 +392,7 @@ bool VisualInertialFusion::IsInitialized() const
 
 bool VisualInertialFusion::IsTrackingGood() const
 {
+    // Not while dead reckoning, the pose drifts
     return mState == State::TRACKING_NOMINAL || 
            mState == State::TRACKING_RAPID || 
            mState == State::TRACKING_VISUAL;
@@ -249,6 +410,13 @@ float VisualInertialFusion::GetTrackingQuality() const
         return 1.0f;
     else if (mState == State::TRACKING_RAPID || mState == State::TRACKING_VISUAL)
         return 0.7f;
+    else if (mState == State::TRACKING_IMU_ONLY)
+    {
+        // Decays to that of a lost tracking over the dead-reckoning window
+        std::lock_guard<std::mutex> lock(mPoseMutex);
+        const double remaining = 1.0 - mDeadReckoningTime / std::max(mConfig.max_tracking_loss_time, 1e-3f);
+        return 0.5f * static_cast<float>(std::max(0.0, std::min(1.0, remaining)));
+    }
     else if (mState == State::RELOCALIZATION)
         return 0.3f;
     else if (mState == State::LOST)
@@ -259,121 +427,164 @@ float VisualInertialFusion::GetTrackingQuality() const
 
 bool VisualInertialFusion::SaveState(const std::string& filename) const
 {
-    try
+    Checkpoint checkpoint;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    checkpoint.magic = CHECKPOINT_MAGIC;
+    checkpoint.version = CHECKPOINT_VERSION;
+    checkpoint.size = sizeof(Checkpoint);
+    checkpoint.save_time = MonotonicSeconds();
+    checkpoint.state = static_cast<int32_t>(mState.load());
+    checkpoint.gravity_initialized = mGravityInitialized;
+    
     {
-        std::ofstream file(filename, std::ios::binary);
-        if (!file.is_open())
-            return false;
-        
-        // Save current pose
-        Eigen::Matrix4f pose_matrix = mCurrentPose.matrix();
-        file.write(reinterpret_cast<char*>(pose_matrix.data()), sizeof(float) * 16);
-        
-        // Save velocity, acceleration, angular velocity
-        file.write(reinterpret_cast<const char*>(mCurrentVelocity.data()), sizeof(float) * 3);
-        file.write(reinterpret_cast<const char*>(mCurrentAcceleration.data()), sizeof(float) * 3);
-        file.write(reinterpret_cast<const char*>(mCurrentAngularVelocity.data()), sizeof(float) * 3);
-        
-        // Save gravity direction
-        file.write(reinterpret_cast<const char*>(mGravityDirection.data()), sizeof(float) * 3);
-        
-        // Save IMU bias
-        file.write(reinterpret_cast<const char*>(&mCurrentBias.bax), sizeof(float));
-        file.write(reinterpret_cast<const char*>(&mCurrentBias.bay), sizeof(float));
-        file.write(reinterpret_cast<const char*>(&mCurrentBias.baz), sizeof(float));
-        file.write(reinterpret_cast<const char*>(&mCurrentBias.bwx), sizeof(float));
-        file.write(reinterpret_cast<const char*>(&mCurrentBias.bwy), sizeof(float));
-        file.write(reinterpret_cast<const char*>(&mCurrentBias.bwz), sizeof(float));
-        
-        file.close();
-        return true;
+        std::lock_guard<std::mutex> lock(mPoseMutex);
+        const Eigen::Quaternionf q = mCurrentPose.unit_quaternion();
+        std::copy(q.coeffs().data(), q.coeffs().data() + 4, checkpoint.rotation);
+        StoreVector(mCurrentPose.translation(), checkpoint.translation);
+        StoreVector(mCurrentVelocity, checkpoint.velocity);
+        StoreVector(mCurrentAcceleration, checkpoint.acceleration);
+        StoreVector(mCurrentAngularVelocity, checkpoint.angular_velocity);
+        StoreVector(mGravityDirection, checkpoint.gravity_direction);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mIMUMutex);
+        const float bias[6] = {mCurrentBias.bax, mCurrentBias.bay, mCurrentBias.baz,
+                               mCurrentBias.bwx, mCurrentBias.bwy, mCurrentBias.bwz};
+        std::copy(bias, bias + 6, checkpoint.bias);
+        checkpoint.last_imu_timestamp = mLastIMUTimestamp;
+        StoreVector(mLastIMUAcceleration, checkpoint.last_imu_acceleration);
+        StoreVector(mLastIMUAngularVelocity, checkpoint.last_imu_angular_velocity);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mMotionModelMutex);
+        mMotionModel->GetFilterState(checkpoint.motion_model);
     }
-    catch (const std::exception& e)
+    
+    checkpoint.checksum = CheckpointChecksum(checkpoint);
+    
+    // Replace the previous checkpoint in one step, a crash leaves either one whole
+    const std::string temp_filename = filename + ".tmp";
+    int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    
+    const bool written = write(fd, &checkpoint, sizeof(checkpoint)) == static_cast<ssize_t>(sizeof(checkpoint));
+    if (close(fd) < 0 || !written || rename(temp_filename.c_str(), filename.c_str()) < 0)
     {
+        unlink(temp_filename.c_str());
         return false;
     }
+    
+    return true;
 }
 
 bool VisualInertialFusion::LoadState(const std::string& filename)
 {
-    try
+    Checkpoint checkpoint;
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    
+    const ssize_t bytes = read(fd, &checkpoint, sizeof(checkpoint));
+    close(fd);
+    
+    if (bytes != static_cast<ssize_t>(sizeof(checkpoint)) || checkpoint.magic != CHECKPOINT_MAGIC ||
+        checkpoint.version != CHECKPOINT_VERSION || checkpoint.size != sizeof(Checkpoint) ||
+        checkpoint.checksum != CheckpointChecksum(checkpoint))
+        return false;
+    
+    // Only a recent checkpoint of a tracking state still describes the headset,
+    // the bias and gravity belong to the sensor and are kept anyway
+    const State saved_state = static_cast<State>(checkpoint.state);
+    const double age = MonotonicSeconds() - checkpoint.save_time;
+    const bool resume = age >= 0.0 && age <= mConfig.checkpoint_max_age_s &&
+                        (saved_state == State::TRACKING_NOMINAL || saved_state == State::TRACKING_RAPID ||
+                         saved_state == State::TRACKING_VISUAL || saved_state == State::TRACKING_IMU_ONLY);
+    
     {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file.is_open())
-            return false;
-        
-        // Load current pose
-        Eigen::Matrix4f pose_matrix;
-        file.read(reinterpret_cast<char*>(pose_matrix.data()), sizeof(float) * 16);
-        
-        // Load velocity, acceleration, angular velocity
-        Eigen::Vector3f velocity, acceleration, angular_velocity;
-        file.read(reinterpret_cast<char*>(velocity.data()), sizeof(float) * 3);
-        file.read(reinterpret_cast<char*>(acceleration.data()), sizeof(float) * 3);
-        file.read(reinterpret_cast<char*>(angular_velocity.data()), sizeof(float) * 3);
-        
-        // Load gravity direction
-        Eigen::Vector3f gravity;
-        file.read(reinterpret_cast<char*>(gravity.data()), sizeof(float) * 3);
-        
-        // Load IMU bias
-        IMU::Bias bias;
-        file.read(reinterpret_cast<char*>(&bias.bax), sizeof(float));
-        file.read(reinterpret_cast<char*>(&bias.bay), sizeof(float));
-        file.read(reinterpret_cast<char*>(&bias.baz), sizeof(float));
-        file.read(reinterpret_cast<char*>(&bias.bwx), sizeof(float));
-        file.read(reinterpret_cast<char*>(&bias.bwy), sizeof(float));
-        file.read(reinterpret_cast<char*>(&bias.bwz), sizeof(float));
+        std::lock_guard<std::mutex> lock_imu(mIMUMutex);
+        mCurrentBias = IMU::Bias(checkpoint.bias[0], checkpoint.bias[1], checkpoint.bias[2],
+                                 checkpoint.bias[3], checkpoint.bias[4], checkpoint.bias[5]);
         
-        file.close();
+        // Integration starts over at the next sample with the loaded bias
+        mIMUReadSequence = mIMUInterface->GetMeasurementBuffer().GetWriteCount();
+        mIMUIntegrationGap = true;
+        ResetPreintegration(mCurrentBias);
         
-        // Update state with loaded values
+        if (resume)
         {
-            std::lock_guard<std::mutex> lock_pose(mPoseMutex);
-            mCurrentPose = Sophus::SE3<float>(pose_matrix);
-            mCurrentVelocity = velocity;
-            mCurrentAcceleration = acceleration;
-            mCurrentAngularVelocity = angular_velocity;
-            mGravityDirection = gravity;
+            mLastIMUTimestamp = checkpoint.last_imu_timestamp;
+            mLastIMUAcceleration = LoadVector(checkpoint.last_imu_acceleration);
+            mLastIMUAngularVelocity = LoadVector(checkpoint.last_imu_angular_velocity);
         }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock_pose(mPoseMutex);
+        mGravityDirection = LoadVector(checkpoint.gravity_direction);
         
+        if (resume)
         {
-            std::lock_guard<std::mutex> lock_imu(mIMUMutex);
-            mCurrentBias = bias;
-            
-            // Update preintegration with loaded bias
-            if (mpImuPreintegrated)
-            {
-                delete mpImuPreintegrated;
-                mpImuPreintegrated = new IMU::Preintegrated(bias, mIMUInterface->GetCalibration());
-            }
+            Eigen::Quaternionf q(checkpoint.rotation[3], checkpoint.rotation[0],
+                                 checkpoint.rotation[1], checkpoint.rotation[2]);
+            mCurrentPose = Sophus::SE3<float>(q.normalized(), LoadVector(checkpoint.translation));
+            mCurrentVelocity = LoadVector(checkpoint.velocity);
+            mCurrentAcceleration = LoadVector(checkpoint.acceleration);
+            mCurrentAngularVelocity = LoadVector(checkpoint.angular_velocity);
         }
-        
-        // Set state to tracking if we were uninitialized
-        if (mState == State::UNINITIALIZED)
+    }
+    mGravityInitialized = checkpoint.gravity_initialized != 0;
+    
+    // The window no longer matches the loaded state
+    {
+        std::lock_guard<std::mutex> lock_smoother(mSmootherMutex);
+        mSmoother.Reset();
+    }
+    
+    if (resume)
+    {
+        // Predicts right away; until vision is back the pose is dead-reckoned
+        // from the loaded state
         {
-            mState = State::TRACKING_NOMINAL;
-            mGravityInitialized = true;
+            std::lock_guard<std::mutex> lock_motion(mMotionModelMutex);
+            mMotionModel->SetFilterState(checkpoint.motion_model);
         }
         
-        return true;
-    }
-    catch (const std::exception& e)
-    {
-        return false;
+        if (mState == State::UNINITIALIZED)
+            mState = State::TRACKING_NOMINAL;
     }
+    
+    return true;
 }
 
 void VisualInertialFusion::ProcessingThreadFunction()
 {
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::FUSION, "VI-Fusion");
+    
+    const auto fallback = std::chrono::microseconds(static_cast<int64_t>(mConfig.fallback_wakeup_ms * 1000.0f));
+    
     while (mRunning)
     {
-        // Wait for new data or timeout
-        std::unique_lock<std::mutex> lock(mProcessingMutex);
-        mProcessingCondition.wait_for(lock, std::chrono::milliseconds(10));
+        // Wait for a visual result or a batch of IMU samples, the deadline only
+        // covers measurements nobody signalled
+        {
+            std::unique_lock<std::mutex> lock(mProcessingMutex);
+            mProcessingCondition.wait_for(lock, fallback, [this] {
+                return !mRunning || mVisualEventPending || mPendingIMUSamples >= mConfig.imu_wakeup_samples;
+            });
+            
+            if (!mRunning)
+                break;
+            
+            mVisualEventPending = false;
+            mPendingIMUSamples = 0;
+        }
         
-        if (!mRunning)
-            break;
+        // Integrate each new IMU measurement once, in every state
+        TRACE_SCOPE_VALUE("FusionUpdate", static_cast<int>(mState));
+        IntegrateNewIMUMeasurements();
         
         // Start timing for performance metrics
         auto start_time = std::chrono::high_resolution_clock::now();
@@ -408,6 +619,14 @@ void VisualInertialFusion::ProcessingThreadFunction()
                     mState = State::LOST;
                     mTrackingLossCount++;
                 }
+                else if (mConfig.use_imu_only_fallback && IsVisualLost())
+                {
+                    // Keep the pose alive on the IMU until vision is back
+                    mState = UpdateDeadReckoning() ? State::TRACKING_IMU_ONLY : State::LOST;
+                    if (mState == State::LOST)
+                        mTrackingLossCount++;
+                    UpdateMotionModel();
+                }
                 else
                 {
                     // Check for rapid motion
@@ -423,6 +642,28 @@ void VisualInertialFusion::ProcessingThreadFunction()
                 }
                 break;
                 
+            case State::TRACKING_IMU_ONLY:
+                if (!IsVisualLost())
+                {
+                    // Vision is back, tracking relocalized near the dead-reckoned pose
+                    StopDeadReckoning();
+                    mState = State::TRACKING_NOMINAL;
+                    
+                    std::lock_guard<std::mutex> lock_metrics(mMetricsMutex);
+                    mMetrics.relocalization_count++;
+                }
+                else if (UpdateMotionState() && UpdateDeadReckoning())
+                {
+                    UpdateMotionModel();
+                }
+                else if (mDeadReckoningTime > mConfig.max_tracking_loss_time)
+                {
+                    // Drifted beyond use, relocalize without a prior
+                    mState = State::LOST;
+                    mTrackingLossCount++;
+                }
+                break;
+                
             case State::LOST:
                 if (AttemptRelocalization())
                 {
@@ -432,10 +673,10 @@ void VisualInertialFusion::ProcessingThreadFunction()
                     std::lock_guard<std::mutex> lock_metrics(mMetricsMutex);
                     mMetrics.relocalization_count++;
                 }
-                else if (mConfig.use_imu_only_fallback)
+                else if (mConfig.use_imu_only_fallback && mDeadReckoningStartTime <= 0)
                 {
-                    // Fall back to IMU-only tracking temporarily
-                    PreintegrateIMU(mLastIMUTimestamp - 0.1, mLastIMUTimestamp);
+                    // Fall back to IMU-only tracking temporarily, the
+                    // interval since the last update is still integrated
                     mState = State::TRACKING_RAPID;
                 }
                 break;
@@ -461,6 +702,8 @@ void VisualInertialFusion::ProcessingThreadFunction()
         
         // Update performance metrics
         UpdatePerformanceMetrics(processing_time_ms);
+        
+        UpdateCheckpoint();
     }
 }
 
@@ -482,9 +725,13 @@ bool VisualInertialFusion::InitializeSystem()
     // Reset IMU preintegration
     {
         std::lock_guard<std::mutex> lock(mIMUMutex);
-        if (mpImuPreintegrated)
-            delete mpImuPreintegrated;
-        mpImuPreintegrated = new IMU::Preintegrated(mCurrentBias, mIMUInterface->GetCalibration());
+        ResetPreintegration(mCurrentBias);
+    }
+    
+    // Restart the sliding window
+    {
+        std::lock_guard<std::mutex> lock(mSmootherMutex);
+        mSmoother.Reset();
     }
     
     // Set initial progress
@@ -501,27 +748,27 @@ bool VisualInertialFusion::InitializeGravity()
     if (mGravityInitialized)
         return true;
     
-    std::lock_guard<std::mutex> lock(mIMUMutex);
+    const TimestampRingBuffer<IMU::Point>& imu_ring = mIMUInterface->GetMeasurementBuffer();
     
     // Need at least 100 IMU measurements for reliable gravity initialization
-    if (mIMUQueue.size() < 100)
+    TimestampRingBuffer<IMU::Point>::Range imu_data = imu_ring.GetLatest(100);
+    if (imu_data.size() < 100)
         return false;
     
     // Compute average acceleration as gravity direction
     Eigen::Vector3f avg_acc = Eigen::Vector3f::Zero();
     int count = 0;
     
-    // Create a copy of the queue to avoid modifying it
-    std::queue<IMU::Point> queue_copy = mIMUQueue;
-    
-    while (!queue_copy.empty() && count < 100)
+    for (const IMU::Point& imu_point : imu_data)
     {
-        const IMU::Point& imu_point = queue_copy.front();
         avg_acc += imu_point.a;
-        queue_copy.pop();
         count++;
     }
     
+    // Overwritten while summing, try again with the next measurements
+    if (!imu_ring.IsValid(imu_data))
+        return false;
+    
     if (count > 0)
     {
         avg_acc /= count;
@@ -586,82 +833,114 @@ bool VisualInertialFusion::PerformVisualInertialBA(bool local_only)
 
 bool VisualInertialFusion::UpdateMotionState()
 {
-    // Get latest IMU data
-    std::vector<IMU::Point> imu_data;
+    // Close the interval integrated since the last update, O(1)
+    Eigen::Matrix3f delta_R;
+    Eigen::Vector3f delta_V;
+    Eigen::Vector3f delta_P;
+    float dT;
+    Eigen::Vector3f latest_acc;
+    Eigen::Vector3f latest_gyro;
+    FixedLagSmoother::ImuDelta imu_delta;
+    double timestamp;
     {
         std::lock_guard<std::mutex> lock(mIMUMutex);
         
-        // Process all available IMU data
-        while (!mIMUQueue.empty())
-        {
-            imu_data.push_back(mIMUQueue.front());
-            mIMUQueue.pop();
-        }
-    }
-    
-    if (imu_data.empty())
-        return false;
-    
-    // Sort IMU data by timestamp
-    std::sort(imu_data.begin(), imu_data.end(), 
-              [](const IMU::Point& a, const IMU::Point& b) { return a.t < b.t; });
-    
-    // Preintegrate IMU measurements
-    {
-        std::lock_guard<std::mutex> lock(mIMUMutex);
+        if (mpImuPreintegrated->dT <= 0.0f)
+            return false;
         
-        for (const auto& imu_point : imu_data)
-        {
-            mpImuPreintegrated->IntegrateNewMeasurement(imu_point.a, imu_point.w, 
-                                                       imu_point.t - mLastIMUTimestamp);
-            mLastIMUTimestamp = imu_point.t;
-        }
+        SplitPreintegration();
+        
+        // Get preintegrated measurements, bias corrected to first order
+        delta_R = mpImuPreintegratedPrevious->GetUpdatedDeltaRotation();
+        delta_V = mpImuPreintegratedPrevious->GetUpdatedDeltaVelocity();
+        delta_P = mpImuPreintegratedPrevious->GetUpdatedDeltaPosition();
+        dT = mpImuPreintegratedPrevious->dT;
+        latest_acc = mLastIMUAcceleration;
+        latest_gyro = mLastIMUAngularVelocity;
+        timestamp = mLastIMUTimestamp;
+        
+        if (mConfig.use_fixed_lag_smoother)
+            imu_delta = MakeSmootherDelta(*mpImuPreintegratedPrevious);
     }
     
     // Update pose, velocity, and acceleration
     {
         std::lock_guard<std::mutex> lock(mPoseMutex);
         
-        // Get preintegrated measurements
-        Eigen::Matrix3f delta_R = mpImuPreintegrated->GetUpdatedDeltaRotation();
-        Eigen::Vector3f delta_V = mpImuPreintegrated->GetUpdatedDeltaVelocity();
-        Eigen::Vector3f delta_P = mpImuPreintegrated->GetUpdatedDeltaPosition();
-        
         // Update orientation
         Eigen::Matrix3f R = mCurrentPose.rotationMatrix() * delta_R;
         
         // Update position
         Eigen::Vector3f P = mCurrentPose.translation() + 
-                           mCurrentVelocity * mpImuPreintegrated->dT +
+                           mCurrentVelocity * dT +
                            0.5f * (mCurrentPose.rotationMatrix() * delta_V + 
-                                  Eigen::Vector3f(0, 0, -mConfig.gravity_magnitude) * mpImuPreintegrated->dT * mpImuPreintegrated->dT);
+                                  Eigen::Vector3f(0, 0, -mConfig.gravity_magnitude) * dT * dT);
         
         // Update velocity
         mCurrentVelocity = mCurrentVelocity + 
                           mCurrentPose.rotationMatrix() * delta_V + 
-                          Eigen::Vector3f(0, 0, -mConfig.gravity_magnitude) * mpImuPreintegrated->dT;
+                          Eigen::Vector3f(0, 0, -mConfig.gravity_magnitude) * dT;
         
         // Update acceleration (from latest IMU measurement)
-        if (!imu_data.empty())
-        {
-            const IMU::Point& latest_imu = imu_data.back();
-            mCurrentAcceleration = mCurrentPose.rotationMatrix() * latest_imu.a + 
-                                  Eigen::Vector3f(0, 0, -mConfig.gravity_magnitude);
-            mCurrentAngularVelocity = latest_imu.w;
-        }
+        mCurrentAcceleration = mCurrentPose.rotationMatrix() * latest_acc + 
+                              Eigen::Vector3f(0, 0, -mConfig.gravity_magnitude);
+        mCurrentAngularVelocity = latest_gyro;
         
         // Update pose
         mCurrentPose = Sophus::SE3<float>(R, P);
     }
     
-    // Reset preintegration
+    // Refine with the sliding window, the dead-reckoned state stays if it cannot
+    if (mConfig.use_fixed_lag_smoother)
+        UpdateSmoother(timestamp, imu_delta);
+    
+    return true;
+}
+
+bool VisualInertialFusion::UpdateSmoother(double timestamp, const FixedLagSmoother::ImuDelta& imu_delta)
+{
+    // Take the tracked pose received since the last frame, if any
+    Sophus::SE3<float> visual_pose;
+    bool has_visual_pose = false;
     {
-        std::lock_guard<std::mutex> lock(mIMUMutex);
-        if (mpImuPreintegrated)
+        std::lock_guard<std::mutex> lock(mVisualMutex);
+        if (mHasNewVisualPose && mVisualTrackingGood)
+        {
+            visual_pose = mLastVisualPose;
+            has_visual_pose = true;
+        }
+        mHasNewVisualPose = false;
+    }
+    
+    FixedLagSmoother::FrameState state;
+    {
+        std::lock_guard<std::mutex> lock(mSmootherMutex);
+        
+        // The window starts at a tracked pose
+        if (mSmoother.GetFrameCount() == 0 && !has_visual_pose)
+            return false;
+        
+        mSmoother.AddFrame(timestamp, imu_delta, has_visual_pose ? &visual_pose : nullptr);
+        if (!mSmoother.Optimize())
         {
-            delete mpImuPreintegrated;
-            mpImuPreintegrated = new IMU::Preintegrated(mCurrentBias, mIMUInterface->GetCalibration());
+            mSmoother.Reset();
+            return false;
         }
+        state = mSmoother.GetLatestState();
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mPoseMutex);
+        mCurrentPose = state.pose;
+        mCurrentVelocity = state.velocity;
+    }
+    
+    // Integrate the next intervals with the refined bias
+    {
+        std::lock_guard<std::mutex> lock(mIMUMutex);
+        mCurrentBias = IMU::Bias(state.bias_acc.x(), state.bias_acc.y(), state.bias_acc.z(),
+                                 state.bias_gyro.x(), state.bias_gyro.y(), state.bias_gyro.z());
+        UpdatePreintegrationBias(mCurrentBias);
     }
     
     return true;
@@ -669,9 +948,104 @@ bool VisualInertialFusion::UpdateMotionState()
 
 bool VisualInertialFusion::AttemptRelocalization()
 {
-    // This would integrate with ORB-SLAM3's relocalization
-    // For now, we'll return false to indicate relocalization is not yet implemented
-    return false;
+    // Tracking relocalizes on its own, the fusion restarts from its pose
+    if (IsVisualLost())
+        return false;
+    
+    Sophus::SE3<float> visual_pose;
+    {
+        std::lock_guard<std::mutex> lock(mVisualMutex);
+        visual_pose = mLastVisualPose;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mPoseMutex);
+        mCurrentPose = visual_pose;
+        mCurrentVelocity = Eigen::Vector3f::Zero();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mSmootherMutex);
+        mSmoother.Reset();
+    }
+    StopDeadReckoning();
+    return true;
+}
+
+bool VisualInertialFusion::IsVisualLost()
+{
+    std::lock_guard<std::mutex> lock(mVisualMutex);
+    return !mVisualTrackingGood || mLastIMUTimestamp - mLastVisualTimestamp > mConfig.visual_loss_timeout;
+}
+
+bool VisualInertialFusion::UpdateDeadReckoning()
+{
+    const Sophus::SE3<float> T_bc = mIMUInterface->GetImuToCameraTransform();
+    Sophus::SE3<float> Tcw;
+    Eigen::Matrix<float, 6, 6> covariance;
+    bool expired;
+    {
+        std::lock_guard<std::mutex> lock(mPoseMutex);
+        if (mDeadReckoningStartTime <= 0)
+            mDeadReckoningStartTime = mLastVisualTimestamp > 0 ? mLastVisualTimestamp : mLastIMUTimestamp;
+        mDeadReckoningTime = mLastIMUTimestamp - mDeadReckoningStartTime;
+        expired = mDeadReckoningTime > mConfig.max_tracking_loss_time;
+        Tcw = (mCurrentPose * T_bc).inverse();
+        covariance = ComputeDeadReckoningCovariance(mDeadReckoningTime);
+    }
+    
+    if (expired)
+    {
+        if (mTracking)
+            mTracking->ClearRelocalizationPrior();
+        return false;
+    }
+    
+    // Relocalization searches the keyframes around the dead-reckoned pose first
+    if (mTracking)
+        mTracking->SetRelocalizationPrior(Tcw, covariance);
+    return true;
+}
+
+void VisualInertialFusion::StopDeadReckoning()
+{
+    {
+        std::lock_guard<std::mutex> lock(mPoseMutex);
+        mDeadReckoningStartTime = 0;
+        mDeadReckoningTime = 0;
+    }
+    if (mTracking)
+        mTracking->ClearRelocalizationPrior();
+}
+
+Eigen::Matrix<float, 6, 6> VisualInertialFusion::ComputeDeadReckoningCovariance(double time) const
+{
+    // Attitude: the gyroscope bias integrates once. Position: the velocity error
+    // integrates once, the accelerometer bias and the gravity leaking through the
+    // tilt twice, the tilt itself growing with the gyroscope bias.
+    const float t = static_cast<float>(std::max(time, 0.0));
+    const float t2 = t * t;
+    const float g2 = mConfig.gravity_magnitude * mConfig.gravity_magnitude;
+    const float sg2 = mConfig.dead_reckoning_gyro_sigma * mConfig.dead_reckoning_gyro_sigma;
+    const float sa2 = mConfig.dead_reckoning_acc_sigma * mConfig.dead_reckoning_acc_sigma;
+    const float sv2 = mConfig.dead_reckoning_velocity_sigma * mConfig.dead_reckoning_velocity_sigma;
+    const float sr02 = kDeadReckoningRotationSigma * kDeadReckoningRotationSigma;
+    const float sp02 = kDeadReckoningPositionSigma * kDeadReckoningPositionSigma;
+    
+    const float rotation_var = sr02 + sg2 * t2;
+    const float position_var = sp02 + sv2 * t2 + (sa2 + g2 * sr02) * t2 * t2 / 4.0f +
+                               g2 * sg2 * t2 * t2 * t2 / 36.0f;
+    
+    // Isotropic errors of the camera center c and attitude, mapped to Tcw = [R | -R c]
+    // perturbed as (R Exp(dtheta), t + dp): dp = -R dc + R [c]x dtheta
+    const Sophus::SE3<float> Twc = mCurrentPose * mIMUInterface->GetImuToCameraTransform();
+    const Eigen::Matrix3f Rcw = Twc.rotationMatrix().transpose();
+    const Eigen::Matrix3f B = Rcw * Sophus::SO3f::hat(Twc.translation());
+    
+    Eigen::Matrix<float, 6, 6> covariance;
+    covariance.topLeftCorner<3, 3>() = position_var * Eigen::Matrix3f::Identity() + rotation_var * B * B.transpose();
+    covariance.topRightCorner<3, 3>() = rotation_var * B;
+    covariance.bottomLeftCorner<3, 3>() = rotation_var * B.transpose();
+    covariance.bottomRightCorner<3, 3>() = rotation_var * Eigen::Matrix3f::Identity();
+    return covariance;
 }
 
 bool VisualInertialFusion::UpdateMotionModel()
@@ -679,6 +1053,7 @@ bool VisualInertialFusion::UpdateMotionModel()
     // Update the VR motion model with latest state
     {
         std::lock_guard<std::mutex> lock(mPoseMutex);
+        std::lock_guard<std::mutex> lock_motion(mMotionModelMutex);
         mMotionModel->AddPose(mCurrentPose, mLastIMUTimestamp);
         mMotionModel->AddVelocity(mCurrentVelocity, mLastIMUTimestamp);
         mMotionModel->AddAcceleration(mCurrentAcceleration, mLastIMUTimestamp);
@@ -688,37 +1063,66 @@ bool VisualInertialFusion::UpdateMotionModel()
     return true;
 }
 
-bool VisualInertialFusion::PreintegrateIMU(double start_time, double end_time)
+void VisualInertialFusion::IntegrateNewIMUMeasurements()
 {
-    std::lock_guard<std::mutex> lock(mIMUMutex);
+    const TimestampRingBuffer<IMU::Point>& imu_ring = mIMUInterface->GetMeasurementBuffer();
     
-    // Get IMU measurements in the specified time range
-    std::vector<IMU::Point> imu_data = mIMUInterface->GetMeasurementsInTimeRange(start_time, end_time);
+    std::lock_guard<std::mutex> lock(mIMUMutex);
     
+    // Measurements since the last call, without copying
+    TimestampRingBuffer<IMU::Point>::Range imu_data = imu_ring.GetSince(mIMUReadSequence);
     if (imu_data.empty())
-        return false;
-    
-    // Sort by timestamp
-    std::sort(imu_data.begin(), imu_data.end(), 
-              [](const IMU::Point& a, const IMU::Point& b) { return a.t < b.t; });
+        return;
     
-    // Reset preintegration
-    if (mpImuPreintegrated)
+    // Timestamps in the ring are increasing, no sorting needed
+    double last_timestamp = mLastIMUTimestamp;
+    bool gap = mIMUIntegrationGap || imu_data.GetBeginSequence() != mIMUReadSequence;
+    for (const auto& imu_point : imu_data)
     {
-        delete mpImuPreintegrated;
-        mpImuPreintegrated = new IMU::Preintegrated(mCurrentBias, mIMUInterface->GetCalibration());
+        if (!gap && last_timestamp > 0)
+            mpImuPreintegrated->IntegrateNewMeasurement(imu_point.a, imu_point.w, 
+                                                       imu_point.t - last_timestamp);
+        gap = false;
+        last_timestamp = imu_point.t;
     }
+    const IMU::Point latest_imu = imu_data.back();
     
-    // Preintegrate measurements
-    double prev_timestamp = start_time;
-    for (const auto& imu_point : imu_data)
+    // Lapped while integrating, restart the interval from the next measurement
+    if (!imu_ring.IsValid(imu_data))
     {
-        mpImuPreintegrated->IntegrateNewMeasurement(imu_point.a, imu_point.w, 
-                                                   imu_point.t - prev_timestamp);
-        prev_timestamp = imu_point.t;
+        mpImuPreintegrated->Initialize(mCurrentBias);
+        mIMUIntegrationGap = true;
+        mIMUReadSequence = imu_ring.GetWriteCount();
+        return;
     }
     
-    return true;
+    mLastIMUTimestamp = last_timestamp;
+    mLastIMUAcceleration = latest_imu.a;
+    mLastIMUAngularVelocity = latest_imu.w;
+    mIMUIntegrationGap = false;
+    mIMUReadSequence = imu_data.GetEndSequence();
+}
+
+void VisualInertialFusion::SplitPreintegration()
+{
+    // The previous interval's measurement storage is reused, no allocation once warmed up
+    std::swap(mpImuPreintegrated, mpImuPreintegratedPrevious);
+    mpImuPreintegrated->Initialize(mCurrentBias);
+}
+
+void VisualInertialFusion::ResetPreintegration(const IMU::Bias& bias)
+{
+    mpImuPreintegrated->Initialize(bias);
+    mpImuPreintegratedPrevious->Initialize(bias);
+}
+
+void VisualInertialFusion::UpdatePreintegrationBias(const IMU::Bias& bias)
+{
+    // First-order correction through the bias Jacobians is exact enough for small changes
+    mpImuPreintegrated->SetNewBias(bias);
+    
+    if (mpImuPreintegrated->GetDeltaBias().norm() > mConfig.bias_reintegration_threshold)
+        mpImuPreintegrated->Reintegrate();
 }
 
 bool VisualInertialFusion::DetectAndHandleRapidMotion()
@@ -756,6 +1160,27 @@ void VisualInertialFusion::UpdateTrackingState()
     }
 }
 
+void VisualInertialFusion::UpdateCheckpoint()
+{
+    if (mConfig.checkpoint_path.empty())
+        return;
+    
+    // Only tracking states are worth resuming from
+    const State state = mState;
+    if (state != State::TRACKING_NOMINAL && state != State::TRACKING_RAPID &&
+        state != State::TRACKING_VISUAL && state != State::TRACKING_IMU_ONLY)
+        return;
+    
+    // A few kB written to the page cache, no sync
+    const double now = MonotonicSeconds();
+    if (now - mLastCheckpointTime < mConfig.checkpoint_interval_s)
+        return;
+    mLastCheckpointTime = now;
+    
+    TRACE_SCOPE("FusionCheckpoint");
+    SaveState(mConfig.checkpoint_path);
+}
+
 void VisualInertialFusion::UpdatePerformanceMetrics(double fusion_time)
 {
     std::lock_guard<std::mutex> lock(mMetricsMutex);
@@ -0,0 +1,442 @@
+#include "include/voice_beamformer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+constexpr float kPi = 3.14159265358979f;
+constexpr float kSpeedOfSound = 343.0f;  // m/s
+constexpr int kMaxChannels = 8;
+
+// Mouth of the wearer relative to the array centre, below and ahead of it
+constexpr float kDefaultTarget[3] = {0.0f, 0.07f, 0.08f};
+
+// Weight solves between attempts to map a pose region that does not exist yet (about 0.7 s by default)
+constexpr int kPoseRetryUpdates = 64;
+
+bool IsPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+// R = forget * R + (1 - forget) * a * conj(b), across bins
+void CovarianceUpdate(const float* a_re, const float* a_im, const float* b_re, const float* b_im,
+                      float* r_re, float* r_im, float forget, int count)
+{
+    const float gain = 1.0f - forget;
+    int i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t vforget = vdupq_n_f32(forget);
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t ar = vld1q_f32(a_re + i);
+        const float32x4_t ai = vld1q_f32(a_im + i);
+        const float32x4_t br = vld1q_f32(b_re + i);
+        const float32x4_t bi = vld1q_f32(b_im + i);
+        const float32x4_t pr = vfmaq_f32(vmulq_f32(ar, br), ai, bi);
+        const float32x4_t pi = vfmsq_f32(vmulq_f32(ai, br), ar, bi);
+        vst1q_f32(r_re + i, vfmaq_n_f32(vmulq_f32(vld1q_f32(r_re + i), vforget), pr, gain));
+        vst1q_f32(r_im + i, vfmaq_n_f32(vmulq_f32(vld1q_f32(r_im + i), vforget), pi, gain));
+    }
+#endif
+    for (; i < count; ++i) {
+        const float pr = a_re[i] * b_re[i] + a_im[i] * b_im[i];
+        const float pi = a_im[i] * b_re[i] - a_re[i] * b_im[i];
+        r_re[i] = forget * r_re[i] + gain * pr;
+        r_im[i] = forget * r_im[i] + gain * pi;
+    }
+}
+
+// y += conj(w) * x, across bins
+void ConjugateMultiplyAccumulate(const float* w_re, const float* w_im, const float* x_re, const float* x_im,
+                                 float* y_re, float* y_im, int count)
+{
+    int i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t wr = vld1q_f32(w_re + i);
+        const float32x4_t wi = vld1q_f32(w_im + i);
+        const float32x4_t xr = vld1q_f32(x_re + i);
+        const float32x4_t xi = vld1q_f32(x_im + i);
+        float32x4_t yr = vld1q_f32(y_re + i);
+        float32x4_t yi = vld1q_f32(y_im + i);
+        yr = vfmaq_f32(yr, wr, xr);
+        yr = vfmaq_f32(yr, wi, xi);
+        yi = vfmaq_f32(yi, wr, xi);
+        yi = vfmsq_f32(yi, wi, xr);
+        vst1q_f32(y_re + i, yr);
+        vst1q_f32(y_im + i, yi);
+    }
+#endif
+    for (; i < count; ++i) {
+        y_re[i] += w_re[i] * x_re[i] + w_im[i] * x_im[i];
+        y_im[i] += w_re[i] * x_im[i] - w_im[i] * x_re[i];
+    }
+}
+
+// v' = R(q) v for a unit quaternion (x, y, z, w)
+void Rotate(const float q[4], const float v[3], float out[3])
+{
+    const float tx = 2.0f * (q[1] * v[2] - q[2] * v[1]);
+    const float ty = 2.0f * (q[2] * v[0] - q[0] * v[2]);
+    const float tz = 2.0f * (q[0] * v[1] - q[1] * v[0]);
+    out[0] = v[0] + q[3] * tx + (q[1] * tz - q[2] * ty);
+    out[1] = v[1] + q[3] * ty + (q[2] * tx - q[0] * tz);
+    out[2] = v[2] + q[3] * tz + (q[0] * ty - q[1] * tx);
+}
+
+// Solve A y = d for Hermitian positive definite A by Cholesky, A is overwritten
+bool CholeskySolve(std::complex<float> a[kMaxChannels][kMaxChannels], const std::complex<float>* d,
+                   std::complex<float>* y, int n)
+{
+    for (int j = 0; j < n; ++j) {
+        float diag = a[j][j].real();
+        for (int k = 0; k < j; ++k) {
+            diag -= std::norm(a[j][k]);
+        }
+        if (!(diag > 0.0f)) {
+            return false;
+        }
+        const float l_jj = std::sqrt(diag);
+        a[j][j] = l_jj;
+        for (int i = j + 1; i < n; ++i) {
+            std::complex<float> sum = a[i][j];
+            for (int k = 0; k < j; ++k) {
+                sum -= a[i][k] * std::conj(a[j][k]);
+            }
+            a[i][j] = sum / l_jj;
+        }
+    }
+
+    // L z = d, then L^H y = z
+    for (int i = 0; i < n; ++i) {
+        std::complex<float> sum = d[i];
+        for (int k = 0; k < i; ++k) {
+            sum -= a[i][k] * y[k];
+        }
+        y[i] = sum / a[i][i].real();
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        std::complex<float> sum = y[i];
+        for (int k = i + 1; k < n; ++k) {
+            sum -= std::conj(a[k][i]) * y[k];
+        }
+        y[i] = sum / a[i][i].real();
+    }
+    return true;
+}
+
+} // namespace
+
+VoiceBeamformer::VoiceBeamformer(const Options& options)
+    : mValid(false), mChannels(static_cast<int>(options.mic_positions.size() / 3)),
+      mFftSize(options.fft_size), mHop(options.fft_size / 2), mBins(options.fft_size / 2 + 1),
+      mPairs(0), mUpdateHops(options.update_hops), mHopsSinceUpdate(0),
+      mSampleRate(static_cast<float>(options.sample_rate)), mForget(0.0f),
+      mLoading(options.diagonal_loading), mMicPositions(options.mic_positions),
+      mTarget{kDefaultTarget[0], kDefaultTarget[1], kDefaultTarget[2]}, mWorldLocked(false),
+      mTargetInHead{kDefaultTarget[0], kDefaultTarget[1], kDefaultTarget[2]},
+      mRotation{0.0f, 0.0f, 0.0f, 1.0f}, mTranslation{0.0f, 0.0f, 0.0f}, mPoseRetry(0)
+{
+    if (!IsPowerOfTwo(options.fft_size) || options.fft_size < 32 || options.fft_size > 4096 ||
+        options.sample_rate <= 0 || options.update_hops < 1 ||
+        !(options.covariance_time_ms > 0.0f) || !(options.diagonal_loading >= 0.0f) ||
+        options.mic_positions.size() % 3 != 0 || mChannels < 2 || mChannels > kMaxChannels) {
+        std::cerr << "Invalid voice beamformer configuration" << std::endl;
+        return;
+    }
+
+    mPairs = mChannels * (mChannels + 1) / 2;
+    mForget = std::exp(-mHop / (options.covariance_time_ms * 0.001f * mSampleRate));
+
+    // Square-root periodic Hann, analysis and synthesis together sum to one at 50 % overlap
+    mWindow.resize(mFftSize);
+    for (int n = 0; n < mFftSize; ++n) {
+        mWindow[n] = std::sin(kPi * n / mFftSize);
+    }
+
+    int bits = 0;
+    while ((1 << bits) < mFftSize) {
+        ++bits;
+    }
+    mBitReverse.resize(mFftSize);
+    for (int i = 0; i < mFftSize; ++i) {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        mBitReverse[i] = reversed;
+    }
+    mTwiddleCos.resize(mFftSize / 2);
+    mTwiddleSin.resize(mFftSize / 2);
+    for (int i = 0; i < mFftSize / 2; ++i) {
+        mTwiddleCos[i] = std::cos(2.0f * kPi * i / mFftSize);
+        mTwiddleSin[i] = std::sin(2.0f * kPi * i / mFftSize);
+    }
+
+    mInput.assign(mChannels * mFftSize, 0.0f);
+    mSpecRe.assign(mChannels * mBins, 0.0f);
+    mSpecIm.assign(mChannels * mBins, 0.0f);
+    mCovRe.assign(mPairs * mBins, 0.0f);
+    mCovIm.assign(mPairs * mBins, 0.0f);
+    mWeightRe.assign(mChannels * mBins, 0.0f);
+    mWeightIm.assign(mChannels * mBins, 0.0f);
+    mFrameRe.resize(mFftSize);
+    mFrameIm.resize(mFftSize);
+    mOverlap.assign(mFftSize, 0.0f);
+
+    if (!options.pose_region.empty()) {
+        mPoseReader = std::make_unique<SharedPoseReader>(options.pose_region);
+    }
+
+    mValid = true;
+
+    // Without covariance the solve gives delay-and-sum towards the target
+    updateWeights();
+}
+
+VoiceBeamformer::~VoiceBeamformer() = default;
+
+bool VoiceBeamformer::IsValid() const
+{
+    return mValid;
+}
+
+int VoiceBeamformer::GetHopSize() const
+{
+    return mHop;
+}
+
+int VoiceBeamformer::GetChannelCount() const
+{
+    return mChannels;
+}
+
+void VoiceBeamformer::SetTarget(const float position[3], bool world_locked)
+{
+    std::copy(position, position + 3, mTarget);
+    mWorldLocked = world_locked;
+
+    // Steer at once, independent of the covariance block
+    if (mValid) {
+        updateWeights();
+    }
+}
+
+void VoiceBeamformer::SetHeadPose(const float rotation[4], const float translation[3])
+{
+    std::copy(rotation, rotation + 4, mRotation);
+    std::copy(translation, translation + 3, mTranslation);
+}
+
+void VoiceBeamformer::GetTargetInHead(float position[3]) const
+{
+    std::copy(mTargetInHead, mTargetInHead + 3, position);
+}
+
+bool VoiceBeamformer::Process(const float* const* mics, float* out)
+{
+    if (!mValid) {
+        return false;
+    }
+
+    // Analysis
+    for (int m = 0; m < mChannels; ++m) {
+        float* input = mInput.data() + m * mFftSize;
+        std::copy(input + mHop, input + mFftSize, input);
+        std::copy(mics[m], mics[m] + mHop, input + mFftSize - mHop);
+
+        for (int n = 0; n < mFftSize; ++n) {
+            mFrameRe[n] = input[n] * mWindow[n];
+        }
+        std::fill(mFrameIm.begin(), mFrameIm.end(), 0.0f);
+        fft(mFrameRe.data(), mFrameIm.data(), false);
+        std::copy(mFrameRe.begin(), mFrameRe.begin() + mBins, mSpecRe.begin() + m * mBins);
+        std::copy(mFrameIm.begin(), mFrameIm.begin() + mBins, mSpecIm.begin() + m * mBins);
+    }
+
+    // Covariance, upper triangle
+    int pair = 0;
+    for (int i = 0; i < mChannels; ++i) {
+        for (int j = i; j < mChannels; ++j, ++pair) {
+            CovarianceUpdate(mSpecRe.data() + i * mBins, mSpecIm.data() + i * mBins,
+                             mSpecRe.data() + j * mBins, mSpecIm.data() + j * mBins,
+                             mCovRe.data() + pair * mBins, mCovIm.data() + pair * mBins, mForget, mBins);
+        }
+    }
+
+    if (++mHopsSinceUpdate >= mUpdateHops) {
+        updateWeights();
+    }
+
+    // y = w^H x
+    std::fill(mFrameRe.begin(), mFrameRe.end(), 0.0f);
+    std::fill(mFrameIm.begin(), mFrameIm.end(), 0.0f);
+    for (int m = 0; m < mChannels; ++m) {
+        ConjugateMultiplyAccumulate(mWeightRe.data() + m * mBins, mWeightIm.data() + m * mBins,
+                                    mSpecRe.data() + m * mBins, mSpecIm.data() + m * mBins,
+                                    mFrameRe.data(), mFrameIm.data(), mBins);
+    }
+
+    // Synthesis
+    for (int k = mBins; k < mFftSize; ++k) {
+        mFrameRe[k] = mFrameRe[mFftSize - k];
+        mFrameIm[k] = -mFrameIm[mFftSize - k];
+    }
+    fft(mFrameRe.data(), mFrameIm.data(), true);
+
+    const float scale = 1.0f / mFftSize;
+    for (int n = 0; n < mFftSize; ++n) {
+        mOverlap[n] += mFrameRe[n] * scale * mWindow[n];
+    }
+    std::copy(mOverlap.begin(), mOverlap.begin() + mHop, out);
+    std::copy(mOverlap.begin() + mHop, mOverlap.end(), mOverlap.begin());
+    std::fill(mOverlap.begin() + mFftSize - mHop, mOverlap.end(), 0.0f);
+
+    return true;
+}
+
+void VoiceBeamformer::updateHeadPose()
+{
+    if (!mPoseReader) {
+        return;
+    }
+
+    if (!mPoseReader->IsOpen()) {
+        if (mPoseRetry > 0) {
+            --mPoseRetry;
+            return;
+        }
+        if (!mPoseReader->Open()) {
+            mPoseRetry = kPoseRetryUpdates;
+            return;
+        }
+    }
+
+    // Keep the last pose while the writer restarts
+    SharedPoseSample sample;
+    if (mPoseReader->ReadLatest(sample)) {
+        std::copy(sample.rotation, sample.rotation + 4, mRotation);
+        std::copy(sample.translation, sample.translation + 3, mTranslation);
+    }
+}
+
+void VoiceBeamformer::updateWeights()
+{
+    if (mWorldLocked) {
+        updateHeadPose();
+
+        // p_c = R_cw p_w + t_cw
+        Rotate(mRotation, mTarget, mTargetInHead);
+        for (int i = 0; i < 3; ++i) {
+            mTargetInHead[i] += mTranslation[i];
+        }
+    } else {
+        std::copy(mTarget, mTarget + 3, mTargetInHead);
+    }
+    mHopsSinceUpdate = 0;
+
+    // Near-field delays relative to the first microphone
+    float delay[kMaxChannels];
+    float reference = 0.0f;
+    for (int m = 0; m < mChannels; ++m) {
+        const float* p = &mMicPositions[3 * m];
+        const float dx = mTargetInHead[0] - p[0];
+        const float dy = mTargetInHead[1] - p[1];
+        const float dz = mTargetInHead[2] - p[2];
+        const float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (m == 0) {
+            reference = distance;
+        }
+        delay[m] = (distance - reference) / kSpeedOfSound;
+    }
+
+    std::complex<float> a[kMaxChannels][kMaxChannels];
+    std::complex<float> d[kMaxChannels];
+    std::complex<float> y[kMaxChannels];
+
+    for (int k = 0; k < mBins; ++k) {
+        const float omega = 2.0f * kPi * k * mSampleRate / mFftSize;
+        for (int m = 0; m < mChannels; ++m) {
+            d[m] = std::polar(1.0f, -omega * delay[m]);
+        }
+
+        float trace = 0.0f;
+        int pair = 0;
+        for (int i = 0; i < mChannels; ++i) {
+            for (int j = i; j < mChannels; ++j, ++pair) {
+                const std::complex<float> r(mCovRe[pair * mBins + k], mCovIm[pair * mBins + k]);
+                a[i][j] = r;
+                a[j][i] = std::conj(r);
+            }
+            trace += a[i][i].real();
+        }
+
+        // Diagonal loading keeps the solve stable and limits target cancellation on steering errors
+        const float loading = mLoading * trace / mChannels + 1e-12f;
+        for (int i = 0; i < mChannels; ++i) {
+            a[i][i] += loading;
+        }
+
+        // w = R^-1 d / (d^H R^-1 d), delay-and-sum if the solve fails
+        std::complex<float> denominator = 0.0f;
+        if (CholeskySolve(a, d, y, mChannels)) {
+            for (int m = 0; m < mChannels; ++m) {
+                denominator += std::conj(d[m]) * y[m];
+            }
+        }
+        if (!(denominator.real() > 0.0f) || !std::isfinite(denominator.real())) {
+            for (int m = 0; m < mChannels; ++m) {
+                y[m] = d[m];
+            }
+            denominator = static_cast<float>(mChannels);
+        }
+
+        for (int m = 0; m < mChannels; ++m) {
+            const std::complex<float> w = y[m] / denominator;
+            mWeightRe[m * mBins + k] = w.real();
+            mWeightIm[m * mBins + k] = w.imag();
+        }
+    }
+}
+
+void VoiceBeamformer::fft(float* re, float* im, bool inverse_transform) const
+{
+    for (int i = 0; i < mFftSize; ++i) {
+        const int j = mBitReverse[i];
+        if (j > i) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    const float sign = inverse_transform ? 1.0f : -1.0f;
+    for (int length = 2; length <= mFftSize; length <<= 1) {
+        const int half = length / 2;
+        const int step = mFftSize / length;
+        for (int start = 0; start < mFftSize; start += length) {
+            for (int k = 0; k < half; ++k) {
+                const float w_re = mTwiddleCos[k * step];
+                const float w_im = sign * mTwiddleSin[k * step];
+                const int a = start + k;
+                const int b = a + half;
+                const float t_re = re[b] * w_re - im[b] * w_im;
+                const float t_im = re[b] * w_im + im[b] * w_re;
+                re[b] = re[a] - t_re;
+                im[b] = im[a] - t_im;
+                re[a] += t_re;
+                im[a] += t_im;
+            }
+        }
+    }
+}
+
+} // namespace ORB_SLAM3
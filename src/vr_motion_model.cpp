@@ -4,9 +4,95 @@
 #include <iostream>
 #include <Eigen/Dense>
 
+#include "ImuTypes.h"
+
 namespace ORB_SLAM3
 {
 
+namespace
+{
+
+// Specific force measured at rest, world frame with Z up
+const Eigen::Vector3f kGravityWorld(0.0f, 0.0f, -9.81f);
+
+// IMU noise densities (BNO085 class MEMS) and bias random walks, per sqrt(Hz)
+constexpr float kGyroNoiseDensity = 3.0e-3f;    // rad/s
+constexpr float kAccelNoiseDensity = 2.0e-2f;   // m/s^2
+constexpr float kGyroBiasWalk = 2.0e-5f;        // rad/s^2
+constexpr float kAccelBiasWalk = 3.0e-3f;       // m/s^3
+
+// Unmodeled head motion while no IMU data is available, per sqrt(Hz)
+constexpr float kNoImuAccelDensity = 1.0f;      // m/s^2
+constexpr float kNoImuRotationDensity = 0.5f;   // rad/s
+
+// Tracked pose measurement noise (standard deviations)
+constexpr float kPosePositionNoise = 0.01f;     // m
+constexpr float kPoseRotationNoise = 0.01f;     // rad
+
+// Prediction scoring: weight of a new error in the running means, longest gap
+// between the tracked poses a target time is interpolated in, error beyond
+// which a pose jumped (relocalization, map merge) rather than was mispredicted,
+// and the slowest motion and largest shift the timing error is measured with
+constexpr double kErrorStatsWeight = 0.02;
+constexpr double kMaxScoringGap = 0.1;          // s
+constexpr float kMaxScoredError = 0.5f;         // rad
+constexpr float kMinLagRate = 0.1f;             // rad/s
+constexpr float kMaxLag = 0.05f;                // s
+    
+// Velocity smoothing tuning: lowest smoothing, and the error ratio a candidate
+// needs over the current smoothing to replace it
+constexpr float kMinVelocitySmoothing = 0.1f;
+constexpr double kSmoothingImprovement = 0.98;
+    
+void StoreVector(const Eigen::Vector3f& vector, float* out)
+{
+    Eigen::Map<Eigen::Vector3f> stored(out);
+    stored = vector;
+}
+
+Eigen::Vector3f LoadVector(const float* in)
+{
+    return Eigen::Map<const Eigen::Vector3f>(in);
+}
+
+void StorePose(const Sophus::SE3f& pose, float* rotation, float* translation)
+{
+    Eigen::Map<Eigen::Vector4f> stored(rotation);
+    stored = pose.unit_quaternion().coeffs();
+    StoreVector(pose.translation(), translation);
+}
+
+Sophus::SE3f LoadPose(const float* rotation, const float* translation)
+{
+    Eigen::Quaternionf q(rotation[3], rotation[0], rotation[1], rotation[2]);
+    return Sophus::SE3f(q.normalized(), LoadVector(translation));
+}
+
+// Rotation error plus the translation error seen at a distance, in rad
+float PerceivedError(const Sophus::SE3f& predicted, const Sophus::SE3f& observed, float distance,
+                     float* position_error = nullptr, float* rotation_error = nullptr)
+{
+    const float position = (observed.translation() - predicted.translation()).norm();
+    const float rotation = (observed.so3() * predicted.so3().inverse()).log().norm();
+    if (position_error) {
+        *position_error = position;
+    }
+    if (rotation_error) {
+        *rotation_error = rotation;
+    }
+    return rotation + position / distance;
+}
+
+// Constant velocity, rotation increments on the left as the pose history differentiates them
+Sophus::SE3f ExtrapolatePose(const Sophus::SE3f& pose, const Eigen::Vector3f& linear_velocity,
+                             const Eigen::Vector3f& angular_velocity, float dt)
+{
+    return Sophus::SE3f(Sophus::SO3f::exp(angular_velocity * dt) * pose.so3(),
+                        pose.translation() + linear_velocity * dt);
+}
+
+} // namespace
+
 VRMotionModel::VRMotionModel() : current_state_(HeadsetState::STATIONARY), latency_compensation_ms_(0.0)
 {
     // Default configuration
@@ -25,8 +111,11 @@ VRMotionModel::VRMotionModel() : current_state_(HeadsetState::STATIONARY), laten
     angular_acceleration_ = Eigen::Vector3f::Zero();
     linear_jerk_ = Eigen::Vector3f::Zero();
     angular_jerk_ = Eigen::Vector3f::Zero();
+    resetMotionState();
     
     // Initialize Kalman filter state
+    kalman_accel_bias_ = Eigen::Vector3f::Zero();
+    kalman_gyro_bias_ = Eigen::Vector3f::Zero();
     initializeKalmanFilter();
 }
 
@@ -40,8 +129,11 @@ VRMotionModel::VRMotionModel(const PredictionConfig& config)
     angular_acceleration_ = Eigen::Vector3f::Zero();
     linear_jerk_ = Eigen::Vector3f::Zero();
     angular_jerk_ = Eigen::Vector3f::Zero();
+    resetMotionState();
     
     // Initialize Kalman filter state
+    kalman_accel_bias_ = Eigen::Vector3f::Zero();
+    kalman_gyro_bias_ = Eigen::Vector3f::Zero();
     initializeKalmanFilter();
 }
 
@@ -59,7 +151,7 @@ VRMotionModel::PredictionConfig VRMotionModel::GetConfig() const
     return config_;
 }
 
-void VRMotionModel::AddPose(const Sophus::SE3f& pose, double timestamp)
+void VRMotionModel::AddPose(const Sophus::SE3f& pose, double timestamp, LatencyStamps* latency)
 {
     // Add new pose to history
     PoseRecord record;
@@ -74,8 +166,13 @@ void VRMotionModel::AddPose(const Sophus::SE3f& pose, double timestamp)
     UpdateState();
     
     // Update Kalman filter with new measurement
-    if (pose_history_.size() >= 2) {
-        updateKalmanFilter(pose, timestamp);
+    updateKalmanFilter(pose, timestamp);
+    
+    // Score the predictions whose target time the pose reached
+    scorePendingPredictions();
+    
+    if (latency) {
+        latency->Stamp(LatencyStage::POSE_PUBLISHED);
     }
 }
 
@@ -86,12 +183,7 @@ void VRMotionModel::AddIMU(const Eigen::Vector3f& gyro, const Eigen::Vector3f& a
     record.gyro = gyro;
     record.accel = accel;
     record.timestamp = timestamp;
-    imu_history_.push_front(record);
-    
-    // Prune history to maintain maximum size
-    while (imu_history_.size() > MAX_HISTORY_SIZE) {
-        imu_history_.pop_back();
-    }
+    imu_history_.push_front(record);  // Drops the oldest measurement when full
     
     // If we have IMU data but no pose data yet, use IMU for initial velocity estimates
     if (!pose_history_.empty() && imu_history_.size() >= 2) {
@@ -99,10 +191,10 @@ void VRMotionModel::AddIMU(const Eigen::Vector3f& gyro, const Eigen::Vector3f& a
         if (pose_history_.size() < 2) {
             angular_velocity_ = gyro;
         }
-        
-        // Update Kalman filter with IMU measurement
-        updateKalmanFilterWithIMU(gyro, accel, timestamp);
     }
+    
+    // Propagate Kalman filter with IMU measurement
+    updateKalmanFilterWithIMU(gyro, accel, timestamp);
 }
 
 Sophus::SE3f VRMotionModel::PredictPose(double prediction_time_ms)
@@ -113,8 +205,22 @@ Sophus::SE3f VRMotionModel::PredictPose(double prediction_time_ms)
         return Sophus::SE3f();
     }
     
-    // Clamp prediction time to maximum
-    double clamped_prediction_ms = std::min(prediction_time_ms, config_.max_prediction_ms);
+    bool clamped = false;
+    const Sophus::SE3f pose = predictPose(prediction_time_ms, clamped);
+    recordPrediction(pose, pose_history_.front().timestamp + prediction_time_ms / 1000.0, clamped);
+    return pose;
+}
+
+Sophus::SE3f VRMotionModel::predictPose(double prediction_time_ms, bool& clamped)
+{
+    // Clamp the compensated prediction time to maximum
+    const double compensated_prediction_ms = prediction_time_ms + latency_compensation_ms_;
+    double clamped_prediction_ms = std::min(compensated_prediction_ms, config_.max_prediction_ms);
+    
+    // A tuned horizon is as far as the predictions were measured to help
+    if (auto_tune_.enabled && auto_tune_.tune_horizon) {
+        clamped_prediction_ms = std::min(clamped_prediction_ms, config_.prediction_horizon_ms);
+    }
     
     // Adjust prediction time based on headset state if adaptive prediction is enabled
     if (config_.adaptive_prediction) {
@@ -135,6 +241,7 @@ Sophus::SE3f VRMotionModel::PredictPose(double prediction_time_ms)
                 break;
         }
     }
+    clamped = clamped_prediction_ms < compensated_prediction_ms;
     
     // Choose prediction method based on available data and configuration
     if (config_.use_imu_for_prediction && !imu_history_.empty()) {
@@ -155,42 +262,90 @@ Sophus::SE3f VRMotionModel::PredictPose(double prediction_time_ms)
 Sophus::SE3f VRMotionModel::PredictPoseKalman(double prediction_time_ms)
 {
     // Ensure we have at least one pose
-    if (pose_history_.empty()) {
+    if (!kalman_initialized_) {
         std::cerr << "Cannot predict pose: No pose history available" << std::endl;
         return Sophus::SE3f();
     }
     
-    // Get most recent pose
-    const Sophus::SE3f& current_pose = pose_history_.front().pose;
+    // Convert the compensated prediction time to seconds
+    const float dt = static_cast<float>((prediction_time_ms + latency_compensation_ms_) / 1000.0);
     
-    // Convert prediction time to seconds
-    double prediction_time_s = prediction_time_ms / 1000.0;
+    // Extrapolate the nominal state, the filter itself moves with the IMU samples
+    Eigen::Vector3f angular_velocity;
+    Eigen::Vector3f acceleration;
+    getKalmanRates(angular_velocity, acceleration);
+    
+    Eigen::Vector3f predicted_translation = kalman_pose_.translation() + 
+                                           kalman_velocity_ * dt + 
+                                           0.5f * acceleration * dt * dt;
+    Sophus::SO3f predicted_rotation = kalman_pose_.so3() * Sophus::SO3f::exp(angular_velocity * dt);
     
-    // Predict using Kalman filter
-    Eigen::VectorXf state_prediction = predictKalmanState(prediction_time_s);
+    // Combine into predicted pose
+    const Sophus::SE3f pose(predicted_rotation, predicted_translation);
+    recordPrediction(pose, kalman_last_update_time_ + prediction_time_ms / 1000.0, false);
+    return pose;
+}
+
+std::vector<Sophus::SE3f> VRMotionModel::PredictPosesAt(const std::vector<double>& timestamps, bool use_kalman)
+{
+    std::vector<Sophus::SE3f> poses;
+    poses.reserve(timestamps.size());
     
-    // Extract position and orientation from state vector
-    Eigen::Vector3f predicted_translation(
-        state_prediction(0),
-        state_prediction(1),
-        state_prediction(2)
-    );
+    // Ensure we have at least one pose
+    if (pose_history_.empty()) {
+        std::cerr << "Cannot predict pose: No pose history available" << std::endl;
+        poses.resize(timestamps.size());
+        return poses;
+    }
     
-    // For rotation, we use the angular velocity from the state vector
-    Eigen::Vector3f angular_velocity(
-        state_prediction(9),
-        state_prediction(10),
-        state_prediction(11)
-    );
+    // Horizons from the time of the state the predictors extrapolate
+    const double reference_time = use_kalman ? kalman_last_update_time_ : pose_history_.front().timestamp;
+    for (double timestamp : timestamps) {
+        const double prediction_time_ms = (timestamp - reference_time) * 1000.0;
+        poses.push_back(use_kalman ? PredictPoseKalman(prediction_time_ms) : PredictPose(prediction_time_ms));
+    }
     
-    // Predict rotation using angular velocity
-    Eigen::Vector3f rotation_vector = angular_velocity * prediction_time_s;
-    Eigen::AngleAxisf rotation(rotation_vector.norm(), 
-                              rotation_vector.norm() > 1e-6 ? rotation_vector.normalized() : Eigen::Vector3f::UnitX());
-    Eigen::Quaternionf predicted_rotation = rotation * current_pose.unit_quaternion();
+    return poses;
+}
+
+bool VRMotionModel::PredictPoseKalmanAt(double timestamp, Sophus::SE3f& pose,
+                                        Eigen::Matrix<float, 6, 6>& covariance) const
+{
+    if (!kalman_initialized_) {
+        return false;
+    }
     
-    // Combine into predicted pose
-    return Sophus::SE3f(predicted_rotation, predicted_translation);
+    // Same horizon clamping as PredictPose(), no extrapolation into the past
+    const double max_dt = config_.max_prediction_ms / 1000.0;
+    const float dt = static_cast<float>(std::min(std::max(timestamp - kalman_last_update_time_, 0.0), max_dt));
+    
+    Eigen::Vector3f angular_velocity;
+    Eigen::Vector3f acceleration;
+    getKalmanRates(angular_velocity, acceleration);
+    
+    pose = Sophus::SE3f(kalman_pose_.so3() * Sophus::SO3f::exp(angular_velocity * dt),
+                        kalman_pose_.translation() + kalman_velocity_ * dt + 0.5f * acceleration * dt * dt);
+    
+    // Covariance of [dp, dtheta], the block of F * P * F^T + Q on the pose error
+    KalmanCovariance F;
+    KalmanCovariance Q;
+    getKalmanTransition(dt, angular_velocity, F, Q);
+    const Eigen::Matrix<float, 6, KALMAN_ERROR_SIZE> F_pose = F.topRows<6>();
+    covariance.noalias() = F_pose * kalman_covariance_ * F_pose.transpose();
+    covariance += Q.topLeftCorner<6, 6>();
+    return true;
+}
+
+void VRMotionModel::SetImuBias(const IMU::Bias& bias)
+{
+    kalman_accel_bias_ = Eigen::Vector3f(bias.bax, bias.bay, bias.baz);
+    kalman_gyro_bias_ = Eigen::Vector3f(bias.bwx, bias.bwy, bias.bwz);
+}
+
+IMU::Bias VRMotionModel::GetImuBias() const
+{
+    return IMU::Bias(kalman_accel_bias_.x(), kalman_accel_bias_.y(), kalman_accel_bias_.z(),
+                     kalman_gyro_bias_.x(), kalman_gyro_bias_.y(), kalman_gyro_bias_.z());
 }
 
 VRMotionModel::HeadsetState VRMotionModel::EstimateHeadsetState()
@@ -230,9 +385,10 @@ Eigen::Vector3f VRMotionModel::EstimateAngularJerk()
 
 void VRMotionModel::Reset()
 {
-    // Clear history
+    // Clear history, the error statistics and tuned values belong to the user and device
     pose_history_.clear();
     imu_history_.clear();
+    pending_predictions_.clear();
     
     // Reset state
     current_state_ = HeadsetState::STATIONARY;
@@ -242,11 +398,110 @@ void VRMotionModel::Reset()
     angular_acceleration_ = Eigen::Vector3f::Zero();
     linear_jerk_ = Eigen::Vector3f::Zero();
     angular_jerk_ = Eigen::Vector3f::Zero();
+    resetMotionState();
     
     // Reset Kalman filter
     initializeKalmanFilter();
 }
 
+void VRMotionModel::GetFilterState(FilterState& state) const
+{
+    state = FilterState();
+    
+    StorePose(kalman_pose_, state.kalman_rotation, state.kalman_translation);
+    StoreVector(kalman_velocity_, state.kalman_velocity);
+    StoreVector(kalman_accel_bias_, state.kalman_accel_bias);
+    StoreVector(kalman_gyro_bias_, state.kalman_gyro_bias);
+    Eigen::Map<KalmanCovariance> covariance(state.kalman_covariance);
+    covariance = kalman_covariance_;
+    StoreVector(kalman_gyro_, state.kalman_gyro);
+    StoreVector(kalman_accel_, state.kalman_accel);
+    state.kalman_last_update_time = kalman_last_update_time_;
+    state.kalman_initialized = kalman_initialized_;
+    state.kalman_has_imu = kalman_has_imu_;
+    
+    state.headset_state = static_cast<uint8_t>(current_state_);
+    state.interaction_mode = static_cast<uint8_t>(interaction_mode_);
+    state.has_raw_velocity = has_raw_velocity_;
+    state.has_raw_acceleration = has_raw_acceleration_;
+    StoreVector(linear_velocity_, state.linear_velocity);
+    StoreVector(angular_velocity_, state.angular_velocity);
+    StoreVector(linear_acceleration_, state.linear_acceleration);
+    StoreVector(angular_acceleration_, state.angular_acceleration);
+    StoreVector(linear_jerk_, state.linear_jerk);
+    StoreVector(angular_jerk_, state.angular_jerk);
+    StoreVector(raw_linear_velocity_, state.raw_linear_velocity);
+    StoreVector(raw_angular_velocity_, state.raw_angular_velocity);
+    StoreVector(raw_linear_acceleration_, state.raw_linear_acceleration);
+    StoreVector(raw_angular_acceleration_, state.raw_angular_acceleration);
+    
+    state.pose_count = static_cast<uint32_t>(std::min<size_t>(pose_history_.size(), FILTER_STATE_POSES));
+    for (uint32_t i = 0; i < state.pose_count; ++i) {
+        StorePose(pose_history_[i].pose, state.poses[i].rotation, state.poses[i].translation);
+        state.poses[i].timestamp = pose_history_[i].timestamp;
+    }
+    
+    state.imu_count = static_cast<uint32_t>(std::min<size_t>(imu_history_.size(), FILTER_STATE_IMU_SAMPLES));
+    for (uint32_t i = 0; i < state.imu_count; ++i) {
+        StoreVector(imu_history_[i].gyro, state.imu[i].gyro);
+        StoreVector(imu_history_[i].accel, state.imu[i].accel);
+        state.imu[i].timestamp = imu_history_[i].timestamp;
+    }
+}
+
+void VRMotionModel::SetFilterState(const FilterState& state)
+{
+    Reset();
+    SetInteractionMode(static_cast<InteractionMode>(
+        std::min<int>(state.interaction_mode, static_cast<int>(InteractionMode::ROOM_SCALE))));
+    
+    // Oldest first, the rings push to the front
+    const uint32_t pose_count = std::min<uint32_t>(state.pose_count, FILTER_STATE_POSES);
+    for (uint32_t i = pose_count; i > 0; --i) {
+        PoseRecord record;
+        record.pose = LoadPose(state.poses[i - 1].rotation, state.poses[i - 1].translation);
+        record.timestamp = state.poses[i - 1].timestamp;
+        pose_history_.push_front(record);
+    }
+    
+    const uint32_t imu_count = std::min<uint32_t>(state.imu_count, FILTER_STATE_IMU_SAMPLES);
+    for (uint32_t i = imu_count; i > 0; --i) {
+        IMURecord record;
+        record.gyro = LoadVector(state.imu[i - 1].gyro);
+        record.accel = LoadVector(state.imu[i - 1].accel);
+        record.timestamp = state.imu[i - 1].timestamp;
+        imu_history_.push_front(record);
+    }
+    
+    current_state_ = static_cast<HeadsetState>(
+        std::min<int>(state.headset_state, static_cast<int>(HeadsetState::ROTATION_ONLY)));
+    has_raw_velocity_ = state.has_raw_velocity != 0;
+    has_raw_acceleration_ = state.has_raw_acceleration != 0;
+    linear_velocity_ = LoadVector(state.linear_velocity);
+    angular_velocity_ = LoadVector(state.angular_velocity);
+    linear_acceleration_ = LoadVector(state.linear_acceleration);
+    angular_acceleration_ = LoadVector(state.angular_acceleration);
+    linear_jerk_ = LoadVector(state.linear_jerk);
+    angular_jerk_ = LoadVector(state.angular_jerk);
+    raw_linear_velocity_ = LoadVector(state.raw_linear_velocity);
+    raw_angular_velocity_ = LoadVector(state.raw_angular_velocity);
+    raw_linear_acceleration_ = LoadVector(state.raw_linear_acceleration);
+    raw_angular_acceleration_ = LoadVector(state.raw_angular_acceleration);
+    shadow_linear_velocity_.fill(linear_velocity_);
+    shadow_angular_velocity_.fill(angular_velocity_);
+    
+    kalman_pose_ = LoadPose(state.kalman_rotation, state.kalman_translation);
+    kalman_velocity_ = LoadVector(state.kalman_velocity);
+    kalman_accel_bias_ = LoadVector(state.kalman_accel_bias);
+    kalman_gyro_bias_ = LoadVector(state.kalman_gyro_bias);
+    kalman_covariance_ = Eigen::Map<const KalmanCovariance>(state.kalman_covariance);
+    kalman_gyro_ = LoadVector(state.kalman_gyro);
+    kalman_accel_ = LoadVector(state.kalman_accel);
+    kalman_last_update_time_ = state.kalman_last_update_time;
+    kalman_initialized_ = state.kalman_initialized != 0;
+    kalman_has_imu_ = state.kalman_has_imu != 0;
+}
+
 void VRMotionModel::SetLatencyCompensation(double latency_ms)
 {
     latency_compensation_ms_ = latency_ms;
@@ -284,6 +539,15 @@ void VRMotionModel::SetInteractionMode(InteractionMode mode)
             config_.rotation_only_threshold = 0.15; // Higher threshold for rotation-only detection
             break;
     }
+    
+    // Continue from the values tuned for the mode
+    const TunedParameters& tuned = tuned_parameters_[static_cast<int>(mode)];
+    if (auto_tune_.enabled && tuned.valid) {
+        config_.prediction_horizon_ms = tuned.prediction_horizon_ms;
+        latency_compensation_ms_ = tuned.latency_compensation_ms;
+        velocity_smoothing_ = tuned.velocity_smoothing;
+    }
+    resetTuningWindow();
 }
 
 VRMotionModel::InteractionMode VRMotionModel::GetInteractionMode() const
@@ -291,10 +555,50 @@ VRMotionModel::InteractionMode VRMotionModel::GetInteractionMode() const
     return interaction_mode_;
 }
 
+void VRMotionModel::SetVelocitySmoothing(float alpha)
+{
+    velocity_smoothing_ = std::min(std::max(alpha, kMinVelocitySmoothing), 1.0f);
+}
+
+float VRMotionModel::GetVelocitySmoothing() const
+{
+    return velocity_smoothing_;
+}
+
+void VRMotionModel::SetAutoTune(const AutoTuneConfig& config)
+{
+    auto_tune_ = config;
+    resetTuningWindow();
+}
+
+VRMotionModel::AutoTuneConfig VRMotionModel::GetAutoTuneConfig() const
+{
+    return auto_tune_;
+}
+
+VRMotionModel::PredictionErrorStats VRMotionModel::GetPredictionErrorStats(InteractionMode mode, int bucket) const
+{
+    const int m = static_cast<int>(mode);
+    if (m < 0 || m >= INTERACTION_MODES || bucket < 0 || bucket >= PREDICTION_ERROR_BUCKETS) {
+        return PredictionErrorStats();
+    }
+    return prediction_error_stats_[m][bucket];
+}
+
+void VRMotionModel::ResetPredictionErrorStats()
+{
+    for (auto& mode_stats : prediction_error_stats_) {
+        mode_stats.fill(PredictionErrorStats());
+    }
+    resetTuningWindow();
+}
+
 void VRMotionModel::UpdateState()
 {
     // Need at least two poses to estimate velocity
     if (pose_history_.size() < 2) {
+        has_raw_velocity_ = false;
+        has_raw_acceleration_ = false;
         current_state_ = HeadsetState::STATIONARY;
         return;
     }
@@ -307,6 +611,11 @@ void VRMotionModel::UpdateState()
     double dt = current.timestamp - previous.timestamp;
     if (dt <= 0.0) {
         std::cerr << "Invalid timestamps in pose history" << std::endl;
+        
+        // Derivatives start over after the invalid interval
+        has_raw_velocity_ = false;
+        has_raw_acceleration_ = false;
+        addMotionSample({0.0f, 0.0f, HeadsetState::STATIONARY, false});
         return;
     }
     
@@ -324,64 +633,54 @@ void VRMotionModel::UpdateState()
     Eigen::Vector3f new_linear_velocity = position_diff / dt;
     Eigen::Vector3f new_angular_velocity = rotation_diff / dt;
     
-    // Calculate linear and angular accelerations if we have enough history
-    if (pose_history_.size() >= 3) {
-        const PoseRecord& prev_prev = pose_history_[2];
-        double prev_dt = previous.timestamp - prev_prev.timestamp;
+    // Calculate linear and angular accelerations from the previous pose's velocities
+    bool has_new_acceleration = false;
+    Eigen::Vector3f new_linear_acceleration;
+    Eigen::Vector3f new_angular_acceleration;
+    if (has_raw_velocity_ && pose_history_.size() >= 3) {
+        new_linear_acceleration = (new_linear_velocity - raw_linear_velocity_) / dt;
+        new_angular_acceleration = (new_angular_velocity - raw_angular_velocity_) / dt;
+        has_new_acceleration = true;
         
-        if (prev_dt > 0.0) {
-            Eigen::Vector3f prev_position_diff = previous.pose.translation() - prev_prev.pose.translation();
-            Eigen::Quaternionf q_prev_prev = prev_prev.pose.unit_quaternion();
-            Eigen::Quaternionf q_prev_diff = q_previous * q_prev_prev.inverse();
-            Eigen::AngleAxisf prev_angle_axis(q_prev_diff);
-            Eigen::Vector3f prev_rotation_diff = prev_angle_axis.axis() * prev_angle_axis.angle();
-            
-            Eigen::Vector3f prev_linear_velocity = prev_position_diff / prev_dt;
-            Eigen::Vector3f prev_angular_velocity = prev_rotation_diff / prev_dt;
-            
-            Eigen::Vector3f new_linear_acceleration = (new_linear_velocity - prev_linear_velocity) / dt;
-            Eigen::Vector3f new_angular_acceleration = (new_angular_velocity - prev_angular_velocity) / dt;
-            
-            // Apply smoothing to acceleration
-            const float accel_alpha = 0.6f; // Smoothing factor for acceleration
-            linear_acceleration_ = accel_alpha * new_linear_acceleration + (1.0f - accel_alpha) * linear_acceleration_;
-            angular_acceleration_ = accel_alpha * new_angular_acceleration + (1.0f - accel_alpha) * angular_acceleration_;
+        // Apply smoothing to acceleration
+        const float accel_alpha = 0.6f; // Smoothing factor for acceleration
+        linear_acceleration_ = accel_alpha * new_linear_acceleration + (1.0f - accel_alpha) * linear_acceleration_;
+        angular_acceleration_ = accel_alpha * new_angular_acceleration + (1.0f - accel_alpha) * angular_acceleration_;
+        
+        // Calculate jerk from the previous pose's accelerations
+        if (has_raw_acceleration_ && pose_history_.size() >= 4) {
+            Eigen::Vector3f new_linear_jerk = (new_linear_acceleration - raw_linear_acceleration_) / dt;
+            Eigen::Vector3f new_angular_jerk = (new_angular_acceleration - raw_angular_acceleration_) / dt;
             
-            // Calculate jerk if we have enough history
-            if (pose_history_.size() >= 4) {
-                const PoseRecord& prev_prev_prev = pose_history_[3];
-                double prev_prev_dt = prev_prev.timestamp - prev_prev_prev.timestamp;
-                
-                if (prev_prev_dt > 0.0) {
-                    Eigen::Vector3f prev_prev_position_diff = prev_prev.pose.translation() - prev_prev_prev.pose.translation();
-                    Eigen::Quaternionf q_prev_prev_prev = prev_prev_prev.pose.unit_quaternion();
-                    Eigen::Quaternionf q_prev_prev_diff = q_prev_prev * q_prev_prev_prev.inverse();
-                    Eigen::AngleAxisf prev_prev_angle_axis(q_prev_prev_diff);
-                    Eigen::Vector3f prev_prev_rotation_diff = prev_prev_angle_axis.axis() * prev_prev_angle_axis.angle();
-                    
-                    Eigen::Vector3f prev_prev_linear_velocity = prev_prev_position_diff / prev_prev_dt;
-                    Eigen::Vector3f prev_prev_angular_velocity = prev_prev_rotation_diff / prev_prev_dt;
-                    
-                    Eigen::Vector3f prev_linear_acceleration = (prev_linear_velocity - prev_prev_linear_velocity) / prev_dt;
-                    Eigen::Vector3f prev_angular_acceleration = (prev_angular_velocity - prev_prev_angular_velocity) / prev_dt;
-                    
-                    Eigen::Vector3f new_linear_jerk = (new_linear_acceleration - prev_linear_acceleration) / dt;
-                    Eigen::Vector3f new_angular_jerk = (new_angular_acceleration - prev_angular_acceleration) / dt;
-                    
-                    // Apply smoothing to jerk
-                    const float jerk_alpha = 0.5f; // Smoothing factor for jerk
-                    linear_jerk_ = jerk_alpha * new_linear_jerk + (1.0f - jerk_alpha) * linear_jerk_;
-                    angular_jerk_ = jerk_alpha * new_angular_jerk + (1.0f - jerk_alpha) * angular_jerk_;
-                }
-            }
+            // Apply smoothing to jerk
+            const float jerk_alpha = 0.5f; // Smoothing factor for jerk
+            linear_jerk_ = jerk_alpha * new_linear_jerk + (1.0f - jerk_alpha) * linear_jerk_;
+            angular_jerk_ = jerk_alpha * new_angular_jerk + (1.0f - jerk_alpha) * angular_jerk_;
         }
     }
     
+    // Keep the unsmoothed derivatives for the next pose
+    raw_linear_velocity_ = new_linear_velocity;
+    raw_angular_velocity_ = new_angular_velocity;
+    has_raw_velocity_ = true;
+    if (has_new_acceleration) {
+        raw_linear_acceleration_ = new_linear_acceleration;
+        raw_angular_acceleration_ = new_angular_acceleration;
+    }
+    has_raw_acceleration_ = has_new_acceleration;
+    
     // Update velocities with some smoothing
-    const float alpha = 0.7f; // Smoothing factor for velocity
+    const float alpha = velocity_smoothing_;
     linear_velocity_ = alpha * new_linear_velocity + (1.0f - alpha) * linear_velocity_;
     angular_velocity_ = alpha * new_angular_velocity + (1.0f - alpha) * angular_velocity_;
     
+    // Same with the smoothing candidates of the tuning
+    for (int k = 0; k < SMOOTHING_CANDIDATES; ++k) {
+        const float candidate = smoothingCandidate(k);
+        shadow_linear_velocity_[k] = candidate * new_linear_velocity + (1.0f - candidate) * shadow_linear_velocity_[k];
+        shadow_angular_velocity_[k] = candidate * new_angular_velocity + (1.0f - candidate) * shadow_angular_velocity_[k];
+    }
+    
     // Determine headset state
     float linear_speed = linear_velocity_.norm();
     float angular_speed = angular_velocity_.norm();
@@ -402,18 +701,30 @@ void VRMotionModel::UpdateState()
         current_state_ = HeadsetState::SLOW_MOVEMENT;
     }
     
+    // Classify the motion between the two poses for the user behavior model
+    MotionSample sample;
+    sample.linear_speed = position_diff.norm() / dt;
+    sample.angular_speed = angle_axis.angle() / dt;
+    sample.valid = true;
+    if (sample.linear_speed < stationary_threshold && sample.angular_speed < 0.1f) {
+        sample.state = HeadsetState::STATIONARY;
+    } else if (sample.linear_speed > fast_movement_threshold) {
+        sample.state = HeadsetState::FAST_MOVEMENT;
+    } else if (sample.linear_speed < rotation_only_threshold && sample.angular_speed > 0.2f) {
+        sample.state = HeadsetState::ROTATION_ONLY;
+    } else {
+        sample.state = HeadsetState::SLOW_MOVEMENT;
+    }
+    addMotionSample(sample);
+    
     // Update user behavior model
     updateUserBehaviorModel();
 }
 
 void VRMotionModel::PruneHistory()
 {
-    // Maintain maximum history size
-    while (pose_history_.size() > MAX_HISTORY_SIZE) {
-        pose_history_.pop_back();
-    }
-    
-    // Also remove poses that are too old (more than 1 second)
+    // The ring keeps at most MAX_HISTORY_SIZE poses, also remove poses that are
+    // too old (more than 1 second)
     if (!pose_history_.empty()) {
         double newest_timestamp = pose_history_.front().timestamp;
         while (!pose_history_.empty() && 
@@ -421,6 +732,52 @@ void VRMotionModel::PruneHistory()
             pose_history_.pop_back();
         }
     }
+    
+    trimMotionSamples();
+}
+
+void VRMotionModel::resetMotionState()
+{
+    motion_samples_.clear();
+    motion_linear_speed_sum_ = 0.0;
+    motion_angular_speed_sum_ = 0.0;
+    motion_state_counts_.fill(0);
+    
+    raw_linear_velocity_ = Eigen::Vector3f::Zero();
+    raw_angular_velocity_ = Eigen::Vector3f::Zero();
+    raw_linear_acceleration_ = Eigen::Vector3f::Zero();
+    raw_angular_acceleration_ = Eigen::Vector3f::Zero();
+    has_raw_velocity_ = false;
+    has_raw_acceleration_ = false;
+    
+    shadow_linear_velocity_.fill(Eigen::Vector3f::Zero());
+    shadow_angular_velocity_.fill(Eigen::Vector3f::Zero());
+}
+
+void VRMotionModel::addMotionSample(const MotionSample& sample)
+{
+    motion_samples_.push_front(sample);
+    if (sample.valid) {
+        motion_linear_speed_sum_ += sample.linear_speed;
+        motion_angular_speed_sum_ += sample.angular_speed;
+        motion_state_counts_[static_cast<int>(sample.state)]++;
+    }
+    
+    trimMotionSamples();
+}
+
+void VRMotionModel::trimMotionSamples()
+{
+    // One sample per pair of consecutive poses, drop those of poses left the history
+    while (!motion_samples_.empty() && motion_samples_.size() + 1 > pose_history_.size()) {
+        const MotionSample& oldest = motion_samples_.back();
+        if (oldest.valid) {
+            motion_linear_speed_sum_ -= oldest.linear_speed;
+            motion_angular_speed_sum_ -= oldest.angular_speed;
+            motion_state_counts_[static_cast<int>(oldest.state)]--;
+        }
+        motion_samples_.pop_back();
+    }
 }
 
 Sophus::SE3f VRMotionModel::PredictWithConstantVelocity(double prediction_time_ms)
@@ -569,7 +926,7 @@ Sophus::SE3f VRMotionModel::PredictWithIMU(double prediction_time_ms)
     return Sophus::SE3f(predicted_rotation, predicted_translation);
 }
 
-Sophus::SE3f VRMotionModel::InterpolatePoses(const Sophus::SE3f& pose1, const Sophus::SE3f& pose2, float t)
+Sophus::SE3f VRMotionModel::InterpolatePoses(const Sophus::SE3f& pose1, const Sophus::SE3f& pose2, float t) const
 {
     // Interpolate translation linearly
     Eigen::Vector3f translation = pose1.translation() * (1 - t) + pose2.translation() * t;
@@ -584,219 +941,230 @@ Sophus::SE3f VRMotionModel::InterpolatePoses(const Sophus::SE3f& pose1, const So
 
 void VRMotionModel::initializeKalmanFilter()
 {
-    // State vector: [x, y, z, qw, qx, qy, qz, vx, vy, vz, wx, wy, wz, ax, ay, az]
-    // where (x,y,z) is position, (qw,qx,qy,qz) is orientation quaternion,
-    // (vx,vy,vz) is linear velocity, (wx,wy,wz) is angular velocity,
-    // and (ax,ay,az) is linear acceleration
-    
-    // Initialize state vector
-    kalman_state_ = Eigen::VectorXf::Zero(16);
-    
-    // Initialize state covariance matrix
-    kalman_covariance_ = Eigen::MatrixXf::Identity(16, 16);
-    
-    // Set initial uncertainties
-    for (int i = 0; i < 3; ++i) {
-        kalman_covariance_(i, i) = 0.01f;  // Position uncertainty
-    }
-    for (int i = 3; i < 7; ++i) {
-        kalman_covariance_(i, i) = 0.01f;  // Orientation uncertainty
-    }
-    for (int i = 7; i < 10; ++i) {
-        kalman_covariance_(i, i) = 0.1f;   // Linear velocity uncertainty
-    }
-    for (int i = 10; i < 13; ++i) {
-        kalman_covariance_(i, i) = 0.1f;   // Angular velocity uncertainty
-    }
-    for (int i = 13; i < 16; ++i) {
-        kalman_covariance_(i, i) = 1.0f;   // Linear acceleration uncertainty
-    }
-    
-    // Initialize process noise covariance
-    kalman_process_noise_ = Eigen::MatrixXf::Identity(16, 16) * 0.01f;
-    
-    // Initialize measurement noise covariance
-    kalman_measurement_noise_ = Eigen::MatrixXf::Identity(7, 7) * 0.01f;
-    
-    // Set last update time
+    // Nominal state: pose, velocity and IMU biases. The biases are kept, they
+    // belong to the sensor, not to the motion
+    kalman_pose_ = Sophus::SE3f();
+    kalman_velocity_ = Eigen::Vector3f::Zero();
+    
+    // Error state covariance: [dp, dtheta, dv, dba, dbg]
+    kalman_covariance_ = KalmanCovariance::Zero();
+    kalman_covariance_.diagonal().segment<3>(0).setConstant(1e-4f);  // Position uncertainty
+    kalman_covariance_.diagonal().segment<3>(3).setConstant(1e-4f);  // Orientation uncertainty
+    kalman_covariance_.diagonal().segment<3>(6).setConstant(1.0f);   // Velocity uncertainty
+    kalman_covariance_.diagonal().segment<3>(9).setConstant(1e-2f);  // Accelerometer bias uncertainty
+    kalman_covariance_.diagonal().segment<3>(12).setConstant(1e-4f); // Gyroscope bias uncertainty
+    
+    // No IMU sample yet
+    kalman_gyro_ = Eigen::Vector3f::Zero();
+    kalman_accel_ = Eigen::Vector3f::Zero();
+    kalman_has_imu_ = false;
+    
+    // The first pose initializes the nominal state
+    kalman_initialized_ = false;
     kalman_last_update_time_ = 0.0;
+    kalman_pose_history_.clear();
+    kalman_history_rotation_ = Sophus::SO3f();
+    kalman_history_translation_ = Eigen::Vector3f::Zero();
 }
 
 void VRMotionModel::updateKalmanFilter(const Sophus::SE3f& pose, double timestamp)
 {
-    // Skip if this is the first update
-    if (kalman_last_update_time_ == 0.0) {
-        // Initialize state with first pose
-        kalman_state_.segment<3>(0) = pose.translation();
-        Eigen::Quaternionf q = pose.unit_quaternion();
-        kalman_state_(3) = q.w();
-        kalman_state_(4) = q.x();
-        kalman_state_(5) = q.y();
-        kalman_state_(6) = q.z();
-        
+    // Initialize state with first pose
+    if (!kalman_initialized_) {
+        kalman_pose_ = pose;
         kalman_last_update_time_ = timestamp;
+        kalman_initialized_ = true;
+        kalman_pose_history_.push_front({pose, timestamp});
         return;
     }
     
-    // Calculate time delta
-    double dt = timestamp - kalman_last_update_time_;
-    if (dt <= 0.0) {
+    // Predict step, up to the pose if it is newer than the last IMU sample
+    propagateKalmanFilter(timestamp);
+    
+    // Tracked poses usually lag the IMU, compare with the nominal pose at their timestamp
+    Sophus::SE3f nominal_pose;
+    if (!getKalmanPoseAt(timestamp, nominal_pose)) {
         return;
     }
     
-    // Predict step
-    predictKalmanState(dt);
-    
     // Update step
     
-    // Measurement vector: [x, y, z, qw, qx, qy, qz]
-    Eigen::VectorXf measurement(7);
-    measurement.segment<3>(0) = pose.translation();
-    Eigen::Quaternionf q = pose.unit_quaternion();
-    measurement(3) = q.w();
-    measurement(4) = q.x();
-    measurement(5) = q.y();
-    measurement(6) = q.z();
-    
-    // Measurement matrix (maps state to measurement)
-    Eigen::MatrixXf H = Eigen::MatrixXf::Zero(7, 16);
-    H.block<3, 3>(0, 0) = Eigen::Matrix3f::Identity(); // Position
-    H.block<4, 4>(3, 3) = Eigen::Matrix4f::Identity(); // Orientation
-    
-    // Kalman gain
-    Eigen::MatrixXf K = kalman_covariance_ * H.transpose() * 
-                       (H * kalman_covariance_ * H.transpose() + kalman_measurement_noise_).inverse();
-    
-    // Update state
-    Eigen::VectorXf innovation = measurement - H * kalman_state_;
-    
-    // Special handling for quaternion innovation (shortest path)
-    Eigen::Quaternionf q_state(kalman_state_(3), kalman_state_(4), kalman_state_(5), kalman_state_(6));
-    Eigen::Quaternionf q_meas(measurement(3), measurement(4), measurement(5), measurement(6));
-    
-    // Ensure quaternions are normalized
-    q_state.normalize();
-    q_meas.normalize();
-    
-    // Calculate quaternion difference
-    Eigen::Quaternionf q_diff = q_meas * q_state.inverse();
-    
-    // Convert to axis-angle representation
-    Eigen::AngleAxisf aa(q_diff);
-    Eigen::Vector3f axis_angle = aa.axis() * aa.angle();
-    
-    // Replace quaternion innovation with axis-angle
-    innovation.segment<4>(3) << 0, axis_angle.x(), axis_angle.y(), axis_angle.z();
-    
-    // Update state
-    kalman_state_ = kalman_state_ + K * innovation;
-    
-    // Normalize quaternion part of state
-    Eigen::Quaternionf q_updated(kalman_state_(3), kalman_state_(4), kalman_state_(5), kalman_state_(6));
-    q_updated.normalize();
-    kalman_state_(3) = q_updated.w();
-    kalman_state_(4) = q_updated.x();
-    kalman_state_(5) = q_updated.y();
-    kalman_state_(6) = q_updated.z();
-    
-    // Update covariance
-    kalman_covariance_ = (Eigen::MatrixXf::Identity(16, 16) - K * H) * kalman_covariance_;
-    
-    // Update last update time
-    kalman_last_update_time_ = timestamp;
+    // Residual on the manifold: position difference and body frame rotation vector
+    Eigen::Matrix<float, 6, 1> innovation;
+    innovation.head<3>() = pose.translation() - nominal_pose.translation();
+    innovation.tail<3>() = (nominal_pose.so3().inverse() * pose.so3()).log();
+    
+    Eigen::Matrix<float, 6, 6> R = Eigen::Matrix<float, 6, 6>::Zero();
+    R.diagonal().head<3>().setConstant(kPosePositionNoise * kPosePositionNoise);
+    R.diagonal().tail<3>().setConstant(kPoseRotationNoise * kPoseRotationNoise);
+    
+    // The measurement observes dp and dtheta, error state elements 0-5
+    const KalmanError error = applyKalmanCorrection<0, 6>(innovation, R);
+    
+    // Inject the error into the nominal state. A late pose corrects the current
+    // state with the error at its timestamp, which holds over tracking latencies
+    const Eigen::Vector3f delta_position = error.segment<3>(0);
+    const Sophus::SO3f delta_rotation = Sophus::SO3f::exp(error.segment<3>(3));
+    kalman_pose_ = Sophus::SE3f(kalman_pose_.so3() * delta_rotation, kalman_pose_.translation() + delta_position);
+    kalman_velocity_ += error.segment<3>(6);
+    kalman_accel_bias_ += error.segment<3>(9);
+    kalman_gyro_bias_ += error.segment<3>(12);
+    
+    // Keep the history consistent for the next late pose, applied when it is read
+    kalman_history_rotation_ = kalman_history_rotation_ * delta_rotation;
+    kalman_history_translation_ += delta_position;
 }
 
 void VRMotionModel::updateKalmanFilterWithIMU(const Eigen::Vector3f& gyro, const Eigen::Vector3f& accel, double timestamp)
 {
-    // Skip if this is the first update
-    if (kalman_last_update_time_ == 0.0) {
-        kalman_last_update_time_ = timestamp;
-        return;
+    // Predict step with the previous sample, held up to this one
+    if (kalman_initialized_) {
+        propagateKalmanFilter(timestamp);
     }
     
+    kalman_gyro_ = gyro;
+    kalman_accel_ = accel;
+    kalman_has_imu_ = true;
+}
+
+void VRMotionModel::propagateKalmanFilter(double timestamp)
+{
     // Calculate time delta
-    double dt = timestamp - kalman_last_update_time_;
-    if (dt <= 0.0) {
+    const float dt = static_cast<float>(timestamp - kalman_last_update_time_);
+    if (!(dt > 0.0f)) {
         return;
     }
     
-    // Predict step
-    predictKalmanState(dt);
+    Eigen::Vector3f angular_velocity;
+    Eigen::Vector3f acceleration;
+    getKalmanRates(angular_velocity, acceleration);
     
-    // Update step for IMU measurements
+    // Error state transition, from the state before the step
+    KalmanCovariance F;
+    KalmanCovariance Q;
+    getKalmanTransition(dt, angular_velocity, F, Q);
     
-    // Measurement vector: [wx, wy, wz, ax, ay, az]
-    Eigen::VectorXf measurement(6);
-    measurement.segment<3>(0) = gyro;
-    measurement.segment<3>(3) = accel;
+    // Nominal state
+    const Eigen::Vector3f translation = kalman_pose_.translation() + 
+                                       kalman_velocity_ * dt + 
+                                       0.5f * acceleration * dt * dt;
+    kalman_pose_ = Sophus::SE3f(kalman_pose_.so3() * Sophus::SO3f::exp(angular_velocity * dt), translation);
+    kalman_velocity_ += acceleration * dt;
     
-    // Measurement matrix (maps state to measurement)
-    Eigen::MatrixXf H = Eigen::MatrixXf::Zero(6, 16);
-    H.block<3, 3>(0, 10) = Eigen::Matrix3f::Identity(); // Angular velocity
-    H.block<3, 3>(3, 13) = Eigen::Matrix3f::Identity(); // Linear acceleration
-    
-    // Measurement noise for IMU
-    Eigen::MatrixXf R = Eigen::MatrixXf::Identity(6, 6) * 0.1f;
-    
-    // Kalman gain
-    Eigen::MatrixXf K = kalman_covariance_ * H.transpose() * 
-                       (H * kalman_covariance_ * H.transpose() + R).inverse();
-    
-    // Update state
-    kalman_state_ = kalman_state_ + K * (measurement - H * kalman_state_);
-    
-    // Update covariance
-    kalman_covariance_ = (Eigen::MatrixXf::Identity(16, 16) - K * H) * kalman_covariance_;
+    // Update state covariance
+    const KalmanCovariance FP = F * kalman_covariance_;
+    kalman_covariance_.noalias() = FP * F.transpose();
+    kalman_covariance_ += Q;
     
     // Update last update time
     kalman_last_update_time_ = timestamp;
+    
+    // Record the nominal pose for late pose measurements, without the corrections
+    // applied when it is read
+    const Sophus::SE3f recorded_pose(kalman_pose_.so3() * kalman_history_rotation_.inverse(),
+                                     kalman_pose_.translation() - kalman_history_translation_);
+    kalman_pose_history_.push_front({recorded_pose, timestamp});
 }
 
-Eigen::VectorXf VRMotionModel::predictKalmanState(double dt)
+void VRMotionModel::getKalmanRates(Eigen::Vector3f& angular_velocity, Eigen::Vector3f& acceleration) const
 {
-    // State transition matrix
-    Eigen::MatrixXf F = Eigen::MatrixXf::Identity(16, 16);
-    
-    // Position update from velocity
-    F.block<3, 3>(0, 7) = Eigen::Matrix3f::Identity() * dt;
-    
-    // Velocity update from acceleration
-    F.block<3, 3>(7, 13) = Eigen::Matrix3f::Identity() * dt;
-    
-    // Predict state
-    Eigen::VectorXf predicted_state = F * kalman_state_;
-    
-    // Special handling for quaternion update using angular velocity
-    Eigen::Quaternionf q(kalman_state_(3), kalman_state_(4), kalman_state_(5), kalman_state_(6));
-    Eigen::Vector3f omega(kalman_state_(10), kalman_state_(11), kalman_state_(12));
+    // Without IMU data the filter is a constant velocity model
+    if (!kalman_has_imu_) {
+        angular_velocity = Eigen::Vector3f::Zero();
+        acceleration = Eigen::Vector3f::Zero();
+        return;
+    }
     
-    // Create quaternion from angular velocity
-    float angle = omega.norm() * dt;
-    Eigen::Vector3f axis = omega.normalized();
-    Eigen::Quaternionf dq;
-    if (angle < 1e-6) {
-        dq = Eigen::Quaternionf::Identity();
+    // Bias-corrected body rate and world frame acceleration
+    angular_velocity = kalman_gyro_ - kalman_gyro_bias_;
+    acceleration = kalman_pose_.so3() * (kalman_accel_ - kalman_accel_bias_) + kGravityWorld;
+}
+
+void VRMotionModel::getKalmanTransition(float dt, const Eigen::Vector3f& angular_velocity,
+                                        KalmanCovariance& F, KalmanCovariance& Q) const
+{
+    const Eigen::Matrix3f R = kalman_pose_.so3().matrix();
+    const Sophus::SO3f delta_rotation = Sophus::SO3f::exp(angular_velocity * dt);
+    
+    F = KalmanCovariance::Identity();
+    F.block<3, 3>(0, 6) = Eigen::Matrix3f::Identity() * dt;
+    F.block<3, 3>(3, 3) = delta_rotation.inverse().matrix();
+    
+    // Process noise
+    Q = KalmanCovariance::Zero();
+    if (kalman_has_imu_) {
+        const Eigen::Vector3f accel_body = kalman_accel_ - kalman_accel_bias_;
+        F.block<3, 3>(3, 12) = -Eigen::Matrix3f::Identity() * dt;
+        F.block<3, 3>(6, 3) = -R * Sophus::SO3f::hat(accel_body) * dt;
+        F.block<3, 3>(6, 9) = -R * dt;
+        
+        Q.diagonal().segment<3>(3).setConstant(kGyroNoiseDensity * kGyroNoiseDensity * dt);
+        Q.diagonal().segment<3>(6).setConstant(kAccelNoiseDensity * kAccelNoiseDensity * dt);
+        Q.diagonal().segment<3>(9).setConstant(kAccelBiasWalk * kAccelBiasWalk * dt);
+        Q.diagonal().segment<3>(12).setConstant(kGyroBiasWalk * kGyroBiasWalk * dt);
     } else {
-        dq = Eigen::Quaternionf(Eigen::AngleAxisf(angle, axis));
+        // Constant velocity and orientation, the head motion is noise
+        Q.diagonal().segment<3>(3).setConstant(kNoImuRotationDensity * kNoImuRotationDensity * dt);
+        Q.diagonal().segment<3>(6).setConstant(kNoImuAccelDensity * kNoImuAccelDensity * dt);
+    }
+}
+
+bool VRMotionModel::getKalmanPoseAt(double timestamp, Sophus::SE3f& pose) const
+{
+    // Newest first, binary search for the first nominal pose not newer than the timestamp
+    size_t first = 0;
+    size_t last = kalman_pose_history_.size();
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        if (kalman_pose_history_[middle].timestamp > timestamp) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
     }
     
-    // Update quaternion
-    Eigen::Quaternionf q_updated = q * dq;
-    q_updated.normalize();
-    
-    // Update quaternion part of state
-    predicted_state(3) = q_updated.w();
-    predicted_state(4) = q_updated.x();
-    predicted_state(5) = q_updated.y();
-    predicted_state(6) = q_updated.z();
-    
-    // Update state covariance
-    kalman_covariance_ = F * kalman_covariance_ * F.transpose() + kalman_process_noise_;
+    // Older than the history, too late to be of use
+    const size_t i = first;
+    if (i == kalman_pose_history_.size()) {
+        return false;
+    }
     
-    // Update state
-    kalman_state_ = predicted_state;
+    const PoseRecord& older = kalman_pose_history_[i];
+    Sophus::SE3f recorded_pose;
+    if (i == 0 || older.timestamp == timestamp) {
+        recorded_pose = older.pose;
+    } else {
+        const PoseRecord& newer = kalman_pose_history_[i - 1];
+        float t = static_cast<float>((timestamp - older.timestamp) / (newer.timestamp - older.timestamp));
+        recorded_pose = InterpolatePoses(older.pose, newer.pose, t);
+    }
     
-    return predicted_state;
+    // Apply the corrections made since it was recorded
+    pose = Sophus::SE3f(recorded_pose.so3() * kalman_history_rotation_,
+                        recorded_pose.translation() + kalman_history_translation_);
+    return true;
+}
+
+template <int Offset, int Size>
+VRMotionModel::KalmanError VRMotionModel::applyKalmanCorrection(const Eigen::Matrix<float, Size, 1>& innovation,
+                                                                const Eigen::Matrix<float, Size, Size>& noise)
+{
+    // H selects the error state elements [Offset, Offset + Size), so H * P is a block of
+    // rows of P and H * P * H^T a diagonal block, no need to form H
+    const Eigen::Matrix<float, Size, KALMAN_ERROR_SIZE> PHt_t =
+        kalman_covariance_.template middleRows<Size>(Offset);
+    const Eigen::Matrix<float, Size, Size> S =
+        kalman_covariance_.template block<Size, Size>(Offset, Offset) + noise;
+    
+    // Kalman gain K = P * H^T * S^-1, with S symmetric positive definite
+    const Eigen::Matrix<float, KALMAN_ERROR_SIZE, Size> K = S.ldlt().solve(PHt_t).transpose();
+    
+    // Update covariance, P = (I - K * H) * P, kept symmetric
+    kalman_covariance_.noalias() -= K * PHt_t;
+    kalman_covariance_ = (0.5f * (kalman_covariance_ + kalman_covariance_.transpose())).eval();
+    
+    // Error state estimate
+    return K * innovation;
 }
 
 void VRMotionModel::updateUserBehaviorModel()
@@ -806,61 +1174,19 @@ void VRMotionModel::updateUserBehaviorModel()
         return;
     }
     
-    // Calculate average time between poses
-    double avg_dt = 0.0;
-    for (size_t i = 1; i < pose_history_.size(); ++i) {
-        avg_dt += pose_history_[i-1].timestamp - pose_history_[i].timestamp;
-    }
-    avg_dt /= (pose_history_.size() - 1);
-    
-    // Calculate average linear and angular speeds
-    float avg_linear_speed = 0.0f;
-    float avg_angular_speed = 0.0f;
-    int stationary_count = 0;
-    int rotation_only_count = 0;
-    int slow_movement_count = 0;
-    int fast_movement_count = 0;
-    
-    for (size_t i = 1; i < pose_history_.size(); ++i) {
-        double dt = pose_history_[i-1].timestamp - pose_history_[i].timestamp;
-        if (dt <= 0.0) continue;
-        
-        Eigen::Vector3f position_diff = pose_history_[i-1].pose.translation() - pose_history_[i].pose.translation();
-        float linear_speed = position_diff.norm() / dt;
-        avg_linear_speed += linear_speed;
-        
-        Eigen::Quaternionf q1 = pose_history_[i-1].pose.unit_quaternion();
-        Eigen::Quaternionf q2 = pose_history_[i].pose.unit_quaternion();
-        Eigen::Quaternionf q_diff = q1 * q2.inverse();
-        Eigen::AngleAxisf angle_axis(q_diff);
-        float angular_speed = angle_axis.angle() / dt;
-        avg_angular_speed += angular_speed;
-        
-        // Count state occurrences
-        if (linear_speed < config_.stationary_threshold && angular_speed < 0.1f) {
-            stationary_count++;
-        } else if (linear_speed > config_.fast_movement_threshold) {
-            fast_movement_count++;
-        } else if (linear_speed < config_.rotation_only_threshold && angular_speed > 0.2f) {
-            rotation_only_count++;
-        } else {
-            slow_movement_count++;
-        }
-    }
-    
-    avg_linear_speed /= (pose_history_.size() - 1);
-    avg_angular_speed /= (pose_history_.size() - 1);
+    // Averages over the motion samples, maintained as poses enter and leave the history
+    const float intervals = static_cast<float>(motion_samples_.size());
     
     // Update user behavior model
-    user_behavior_.avg_linear_speed = avg_linear_speed;
-    user_behavior_.avg_angular_speed = avg_angular_speed;
-    user_behavior_.stationary_ratio = static_cast<float>(stationary_count) / (pose_history_.size() - 1);
-    user_behavior_.rotation_only_ratio = static_cast<float>(rotation_only_count) / (pose_history_.size() - 1);
-    user_behavior_.slow_movement_ratio = static_cast<float>(slow_movement_count) / (pose_history_.size() - 1);
-    user_behavior_.fast_movement_ratio = static_cast<float>(fast_movement_count) / (pose_history_.size() - 1);
-    
-    // Adapt prediction parameters based on user behavior
-    if (config_.adaptive_prediction) {
+    user_behavior_.avg_linear_speed = static_cast<float>(motion_linear_speed_sum_) / intervals;
+    user_behavior_.avg_angular_speed = static_cast<float>(motion_angular_speed_sum_) / intervals;
+    user_behavior_.stationary_ratio = motion_state_counts_[static_cast<int>(HeadsetState::STATIONARY)] / intervals;
+    user_behavior_.rotation_only_ratio = motion_state_counts_[static_cast<int>(HeadsetState::ROTATION_ONLY)] / intervals;
+    user_behavior_.slow_movement_ratio = motion_state_counts_[static_cast<int>(HeadsetState::SLOW_MOVEMENT)] / intervals;
+    user_behavior_.fast_movement_ratio = motion_state_counts_[static_cast<int>(HeadsetState::FAST_MOVEMENT)] / intervals;
+    
+    // Adapt prediction parameters based on user behavior, unless they are tuned on measured errors
+    if (config_.adaptive_prediction && !(auto_tune_.enabled && auto_tune_.tune_horizon)) {
         // If user is mostly stationary, reduce prediction horizon
         if (user_behavior_.stationary_ratio > 0.7f) {
             config_.prediction_horizon_ms = std::min(config_.prediction_horizon_ms, 10.0);
@@ -876,4 +1202,208 @@ void VRMotionModel::updateUserBehaviorModel()
     }
 }
 
+float VRMotionModel::smoothingCandidate(int candidate) const
+{
+    const float alpha = velocity_smoothing_ + (candidate - SMOOTHING_CANDIDATES / 2) * auto_tune_.smoothing_step;
+    return std::min(std::max(alpha, kMinVelocitySmoothing), 1.0f);
+}
+
+void VRMotionModel::recordPrediction(const Sophus::SE3f& predicted, double target_timestamp, bool clamped)
+{
+    // Only targets ahead of the newest pose, near enough to be scored before
+    // their poses leave the history
+    if (pose_history_.empty()) {
+        return;
+    }
+    const PoseRecord& newest = pose_history_.front();
+    const double horizon = target_timestamp - newest.timestamp;
+    if (horizon <= 0.0 || horizon > 1.0) {
+        return;
+    }
+    
+    // Drops the oldest pending prediction when full
+    PendingPrediction prediction;
+    prediction.predicted = predicted;
+    prediction.base_pose = newest.pose;
+    prediction.shadow_linear_velocity = shadow_linear_velocity_;
+    prediction.shadow_angular_velocity = shadow_angular_velocity_;
+    prediction.base_timestamp = newest.timestamp;
+    prediction.target_timestamp = target_timestamp;
+    prediction.mode = interaction_mode_;
+    prediction.clamped = clamped;
+    pending_predictions_.push_front(prediction);
+}
+
+void VRMotionModel::scorePendingPredictions()
+{
+    // Oldest first; a later target ahead of an earlier one holds it back by a few poses at most
+    const double newest_timestamp = pose_history_.front().timestamp;
+    while (!pending_predictions_.empty() && pending_predictions_.back().target_timestamp <= newest_timestamp) {
+        const PendingPrediction& prediction = pending_predictions_.back();
+        Sophus::SE3f observed;
+        Eigen::Vector3f linear_velocity;
+        Eigen::Vector3f angular_velocity;
+        if (getObservedMotionAt(prediction.target_timestamp, observed, linear_velocity, angular_velocity)) {
+            scorePrediction(prediction, observed, linear_velocity, angular_velocity);
+        }
+        pending_predictions_.pop_back();
+    }
+}
+
+bool VRMotionModel::getObservedMotionAt(double timestamp, Sophus::SE3f& pose,
+                                        Eigen::Vector3f& linear_velocity, Eigen::Vector3f& angular_velocity) const
+{
+    // Newest first, the target is usually between the newest poses
+    size_t i = 1;
+    while (i < pose_history_.size() && pose_history_[i].timestamp > timestamp) {
+        ++i;
+    }
+    if (i >= pose_history_.size()) {
+        return false;
+    }
+    
+    // Not across tracking gaps, the motion in between is unknown
+    const PoseRecord& older = pose_history_[i];
+    const PoseRecord& newer = pose_history_[i - 1];
+    const double dt = newer.timestamp - older.timestamp;
+    if (dt <= 0.0 || dt > kMaxScoringGap) {
+        return false;
+    }
+    
+    pose = InterpolatePoses(older.pose, newer.pose, static_cast<float>((timestamp - older.timestamp) / dt));
+    linear_velocity = (newer.pose.translation() - older.pose.translation()) / static_cast<float>(dt);
+    angular_velocity = (newer.pose.so3() * older.pose.so3().inverse()).log() / static_cast<float>(dt);
+    return true;
+}
+
+void VRMotionModel::scorePrediction(const PendingPrediction& prediction, const Sophus::SE3f& observed,
+                                    const Eigen::Vector3f& linear_velocity, const Eigen::Vector3f& angular_velocity)
+{
+    const float distance = std::max(auto_tune_.perceived_distance_m, 1e-3f);
+    float position_error;
+    float rotation_error;
+    const float perceived_error = PerceivedError(prediction.predicted, observed, distance,
+                                                 &position_error, &rotation_error);
+    if (perceived_error > kMaxScoredError) {
+        return;
+    }
+    const float hold_error = PerceivedError(prediction.base_pose, observed, distance);
+    
+    // Timing error: the shift along the observed motion that best explains the
+    // error, least squares over translation (seen at the distance) and rotation
+    const float inverse_distance_sq = 1.0f / (distance * distance);
+    const float rate_sq = linear_velocity.squaredNorm() * inverse_distance_sq + angular_velocity.squaredNorm();
+    const bool has_lag = !prediction.clamped && rate_sq > kMinLagRate * kMinLagRate;
+    double lag_ms = 0.0;
+    if (has_lag) {
+        const Eigen::Vector3f position_residual = observed.translation() - prediction.predicted.translation();
+        const Eigen::Vector3f rotation_residual = (observed.so3() * prediction.predicted.so3().inverse()).log();
+        const float lag = (position_residual.dot(linear_velocity) * inverse_distance_sq +
+                           rotation_residual.dot(angular_velocity)) / rate_sq;
+        lag_ms = 1000.0 * std::min(std::max(lag, -kMaxLag), kMaxLag);
+    }
+    
+    // Running means, plain averages until they hold enough predictions. Horizons
+    // are differences of timestamps, a bucket boundary takes the rounding
+    const double horizon_ms = (prediction.target_timestamp - prediction.base_timestamp) * 1000.0;
+    const int bucket = std::min(static_cast<int>(horizon_ms / PREDICTION_ERROR_BUCKET_MS + 1e-6), PREDICTION_ERROR_BUCKETS - 1);
+    PredictionErrorStats& stats = prediction_error_stats_[static_cast<int>(prediction.mode)][bucket];
+    stats.count++;
+    const double weight = std::max(1.0 / stats.count, kErrorStatsWeight);
+    stats.position_error_m += weight * (position_error - stats.position_error_m);
+    stats.rotation_error_rad += weight * (rotation_error - stats.rotation_error_rad);
+    stats.perceived_error_rad += weight * (perceived_error - stats.perceived_error_rad);
+    stats.hold_error_rad += weight * (hold_error - stats.hold_error_rad);
+    if (has_lag) {
+        stats.lag_count++;
+        stats.lag_ms += std::max(1.0 / stats.lag_count, kErrorStatsWeight) * (lag_ms - stats.lag_ms);
+    }
+    
+    // The tuning window holds the predictions of the current mode
+    if (prediction.mode != interaction_mode_) {
+        return;
+    }
+    tune_scored_++;
+    if (has_lag) {
+        tune_lag_sum_ms_ += lag_ms;
+        tune_lag_count_++;
+    }
+    const float dt = static_cast<float>(prediction.target_timestamp - prediction.base_timestamp);
+    for (int k = 0; k < SMOOTHING_CANDIDATES; ++k) {
+        const Sophus::SE3f shadow = ExtrapolatePose(prediction.base_pose, prediction.shadow_linear_velocity[k],
+                                                    prediction.shadow_angular_velocity[k], dt);
+        tune_smoothing_error_[k] += PerceivedError(shadow, observed, distance);
+    }
+    
+    if (auto_tune_.enabled && tune_scored_ >= std::max(auto_tune_.adjust_interval, 1)) {
+        autoTunePrediction();
+    }
+}
+
+void VRMotionModel::autoTunePrediction()
+{
+    // Latency compensation: cancel part of the mean timing error of the window
+    if (auto_tune_.tune_latency_compensation && tune_lag_count_ > 0) {
+        const double compensation = latency_compensation_ms_ + auto_tune_.latency_gain * tune_lag_sum_ms_ / tune_lag_count_;
+        latency_compensation_ms_ = std::min(std::max(compensation, auto_tune_.min_latency_compensation_ms),
+                                            auto_tune_.max_latency_compensation_ms);
+    }
+    
+    // Velocity smoothing: to the candidate with the lowest error if clearly lower
+    // than the current one, all velocities then continue from the candidate's
+    if (auto_tune_.tune_velocity_smoothing) {
+        const int current = SMOOTHING_CANDIDATES / 2;
+        int best = current;
+        for (int k = 0; k < SMOOTHING_CANDIDATES; ++k) {
+            if (tune_smoothing_error_[k] < tune_smoothing_error_[best]) {
+                best = k;
+            }
+        }
+        if (best != current && tune_smoothing_error_[best] < kSmoothingImprovement * tune_smoothing_error_[current]) {
+            velocity_smoothing_ = smoothingCandidate(best);
+            linear_velocity_ = shadow_linear_velocity_[best];
+            angular_velocity_ = shadow_angular_velocity_[best];
+            shadow_linear_velocity_.fill(linear_velocity_);
+            shadow_angular_velocity_.fill(angular_velocity_);
+        }
+    }
+    
+    // Horizon: back to the first bucket where the predictions are no better than
+    // the unpredicted pose, otherwise longer while the predictions reach it
+    if (auto_tune_.tune_horizon) {
+        const auto& stats = prediction_error_stats_[static_cast<int>(interaction_mode_)];
+        const int min_count = std::max(auto_tune_.min_bucket_count, 1);
+        double limit = config_.max_prediction_ms;
+        for (int b = 0; b < PREDICTION_ERROR_BUCKETS; ++b) {
+            if (stats[b].count >= static_cast<uint64_t>(min_count) && stats[b].perceived_error_rad >= stats[b].hold_error_rad) {
+                limit = b * PREDICTION_ERROR_BUCKET_MS;
+                break;
+            }
+        }
+        
+        double& horizon = config_.prediction_horizon_ms;
+        const int current = std::min(static_cast<int>(horizon / PREDICTION_ERROR_BUCKET_MS), PREDICTION_ERROR_BUCKETS - 1);
+        if (horizon > limit) {
+            horizon = std::max(limit, auto_tune_.min_horizon_ms);
+        } else if (stats[current].count >= static_cast<uint64_t>(min_count)) {
+            horizon = std::min(horizon + 0.5 * PREDICTION_ERROR_BUCKET_MS, limit);
+        }
+    }
+    
+    TunedParameters& tuned = tuned_parameters_[static_cast<int>(interaction_mode_)];
+    tuned.prediction_horizon_ms = config_.prediction_horizon_ms;
+    tuned.latency_compensation_ms = latency_compensation_ms_;
+    tuned.velocity_smoothing = velocity_smoothing_;
+    tuned.valid = true;
+    resetTuningWindow();
+}
+
+void VRMotionModel::resetTuningWindow()
+{
+    tune_scored_ = 0;
+    tune_lag_count_ = 0;
+    tune_lag_sum_ms_ = 0.0;
+    tune_smoothing_error_.fill(0.0);
+}
+
 } // namespace ORB_SLAM3
@@ -1,15 +1,143 @@
 #include "include/vr_slam_system.hpp"
+#include "ORB_SLAM3/include/Trace.h"
 #include <chrono>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
 
 namespace ORB_SLAM3
 {
 
+namespace {
+// Maximum capture timestamp skew within a synchronized frame set
+constexpr float kFrameSyncToleranceMs = 2.0f;
+// Maximum time to wait for a complete frame set
+constexpr int kFrameSetTimeoutMs = 20;
+// Gyro samples buffered between ProcessIMU and the pose publisher
+constexpr size_t kGyroSampleCapacity = 256;
+// Gyro samples kept for replaying onto a newly tracked pose
+constexpr size_t kMaxGyroHistory = 1024;
+// Longest gap a single gyro sample is integrated over
+constexpr double kMaxGyroGapS = 0.05;
+// Longest time the camera velocity is extrapolated past the tracked pose
+constexpr double kMaxTranslationPropagationS = 0.1;
+// Longest wait of the map sharing thread, bounds the delay of a published keyframe
+constexpr int kMapSharePollMs = 20;
+
+void poseToArrays(const Sophus::SE3f& pose, float* rotation, float* translation)
+{
+    const Eigen::Quaternionf q = pose.unit_quaternion();
+    rotation[0] = q.x();
+    rotation[1] = q.y();
+    rotation[2] = q.z();
+    rotation[3] = q.w();
+    for (int i = 0; i < 3; ++i) {
+        translation[i] = pose.translation()[i];
+    }
+}
+
+Sophus::SE3f poseFromArrays(const float* rotation, const float* translation)
+{
+    Eigen::Quaternionf q(rotation[3], rotation[0], rotation[1], rotation[2]);
+    return Sophus::SE3f(q, Eigen::Vector3f(translation[0], translation[1], translation[2]));
+}
+
+void rotationToArray(const Sophus::SO3f& R, float* rotation)
+{
+    const Eigen::Quaternionf q = R.unit_quaternion();
+    rotation[0] = q.x();
+    rotation[1] = q.y();
+    rotation[2] = q.z();
+    rotation[3] = q.w();
+}
+
+Sophus::SO3f rotationFromArray(const float* rotation)
+{
+    return Sophus::SO3f(Eigen::Quaternionf(rotation[3], rotation[0], rotation[1], rotation[2]));
+}
+
+// A step of the component initialization, run once the steps it depends on succeeded
+struct InitStep {
+    std::string name;
+    std::vector<std::string> depends;
+    std::function<bool()> run;
+};
+
+// Runs every step on its own thread as soon as its dependencies are done, and
+// appends the duration of each completed step. False if any step failed or was
+// skipped for a failed dependency.
+bool runInitSteps(const std::vector<InitStep>& steps, std::vector<std::pair<std::string, double>>& durations_ms)
+{
+    using namespace std::chrono;
+    
+    std::vector<std::promise<bool>> done(steps.size());
+    std::vector<std::shared_future<bool>> results;
+    for (auto& promise : done) {
+        results.push_back(promise.get_future().share());
+    }
+    
+    std::mutex durations_mutex;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        std::vector<size_t> depends;
+        for (const std::string& name : steps[i].depends) {
+            for (size_t j = 0; j < i; ++j) {
+                if (steps[j].name == name) {
+                    depends.push_back(j);
+                }
+            }
+        }
+        
+        threads.emplace_back([&, i, depends]() {
+            bool ok = true;
+            for (size_t j : depends) {
+                ok = results[j].get() && ok;
+            }
+            if (ok) {
+                const auto start = steady_clock::now();
+                try {
+                    ok = steps[i].run();
+                } catch (const std::exception& e) {
+                    std::cerr << "Exception in initialization step " << steps[i].name << ": " << e.what() << std::endl;
+                    ok = false;
+                }
+                const double ms = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0;
+                std::lock_guard<std::mutex> lock(durations_mutex);
+                durations_ms.emplace_back(steps[i].name, ms);
+            }
+            done[i].set_value(ok);
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    bool all_ok = true;
+    for (auto& result : results) {
+        all_ok = result.get() && all_ok;
+    }
+    return all_ok;
+}
+}
+
 VRSLAMSystem::VRSLAMSystem(const Config& config)
-    : config_(config), status_(Status::UNINITIALIZED), running_(false)
+    : config_(config), status_(Status::UNINITIALIZED), gyro_samples_(kGyroSampleCapacity),
+      prediction_horizon_ms_(config.prediction_horizon_ms), running_(false), empty_acquisitions_(0), frame_decimation_(1),
+      calibration_gyro_sequence_(0), resident_bytes_(0)
 {
+    // No pose tracked yet
+    storeTrackedPose(Sophus::SE3f(), 0.0);
+    published_pose_.Store(tracked_pose_.Load());
+    
+    // IMU and camera axes aligned until the IMU calibration is read
+    RotationRecord identity;
+    rotationToArray(Sophus::SO3f(), identity.rotation);
+    imu_to_camera_rotation_.Store(identity);
+    
     // Initialize performance metrics
     metrics_.average_tracking_time_ms = 0.0;
     metrics_.average_feature_extraction_time_ms = 0.0;
@@ -19,6 +147,10 @@ VRSLAMSystem::VRSLAMSystem(const Config& config)
     metrics_.frames_processed = 0;
     metrics_.tracking_lost_count = 0;
     metrics_.tracking_percentage = 100.0;
+    metrics_.pipeline_dropped_frames = 0;
+    metrics_.vsync_locked = false;
+    metrics_.pose_age_at_scanout_ms = 0.0;
+    metrics_.pose_age_jitter_ms = 0.0;
 }
 
 VRSLAMSystem::~VRSLAMSystem()
@@ -66,17 +198,78 @@ bool VRSLAMSystem::Start()
         }
     }
     
-    // Start IMU interface
-    if (config_.use_imu && imu_interface_) {
+    // Start IMU interface, the live IMU has nothing to do with a recording mapped offline
+    if (config_.use_imu && imu_interface_ && !config_.offline_mapping) {
         if (!imu_interface_->Start()) {
             std::cerr << "Failed to start IMU interface" << std::endl;
             return false;
         }
     }
     
-    // Start processing thread
+    // Refines the IMU calibration in the background while tracking
+    if (online_calibration_ && !config_.offline_mapping) {
+        online_calibration_->Start();
+    }
+    
+    // Queues between the pipeline stages; frame sets dropped before
+    // extraction go back to the driver, later ones are released by their views.
+    // Offline every frame set of the recording is tracked, the replay waits
+    const size_t depth = std::max(1, config_.pipeline_queue_depth);
+    const PipelineDropPolicy policy = config_.offline_mapping ? PipelineDropPolicy::BLOCK : config_.pipeline_drop_policy;
+    ZeroCopyFrameProvider* provider = frame_provider_.get();
+    extraction_queue_.reset(new PipelineQueue<AcquiredFrameSet>(
+        depth, policy,
+        [provider](AcquiredFrameSet& acquired) { provider->ReleaseFrameSet(acquired.frame_set); }));
+    tracking_queue_.reset(new PipelineQueue<ExtractedFrameSet>(depth, policy));
+    
+    // The driver restarts the trigger at its nominal period
+    if (vsync_lock_) {
+        vsync_lock_->Reset();
+    }
+    
+    // Record the spans of all threads from here until Stop(), the flight recorder dumps them too
+    const bool trace = !config_.trace_path.empty() ||
+                       (config_.flight_recorder.enabled && config_.flight_recorder.include_trace);
+    if (trace) {
+        ORB_SLAM3::Tracer::Start();
+    }
+    
+    // Cycles, instructions, cache and branch misses of the same spans, per core type
+    if (config_.enable_pmu_counters && !ORB_SLAM3::PmuCounters::Start()) {
+        std::cerr << "Hardware counters unavailable (perf_event_paranoid or no PMU)" << std::endl;
+    }
+    
+    // Fuel gauge and PMIC rail power, attributed to the same spans
+    if (config_.enable_energy_counters &&
+        !ORB_SLAM3::EnergyCounters::Start(ORB_SLAM3::EnergyCounters::FindRails(), config_.energy_sample_period_us)) {
+        std::cerr << "Energy counters unavailable (no readable power supply or hwmon power rail)" << std::endl;
+    }
+    
+    // Keeps the last seconds of frame set timings from the first tracked set on
+    if (config_.flight_recorder.enabled) {
+        if (!flight_recorder_) {
+            flight_recorder_ = std::make_unique<FlightRecorder>(config_.flight_recorder);
+        }
+        flight_recorder_->Start();
+    }
+    
+    // Start pipeline stage threads
     running_ = true;
+    acquisition_thread_ = std::thread(&VRSLAMSystem::acquisitionLoop, this);
+    extraction_thread_ = std::thread(&VRSLAMSystem::extractionLoop, this);
     processing_thread_ = std::thread(&VRSLAMSystem::processingLoop, this);
+    if (!config_.offline_mapping) {
+        pose_publisher_thread_ = std::thread(&VRSLAMSystem::posePublisherLoop, this);
+    }
+    if (config_.memory_sample_interval_s > 0.0) {
+        memory_thread_ = std::thread(&VRSLAMSystem::memoryLoop, this);
+    }
+    if (telemetry_export_ && config_.telemetry_rate_hz > 0.0) {
+        telemetry_thread_ = std::thread(&VRSLAMSystem::telemetryLoop, this);
+    }
+    if (map_share_client_) {
+        map_share_thread_ = std::thread(&VRSLAMSystem::mapShareLoop, this);
+    }
     
     return true;
 }
@@ -88,12 +281,63 @@ bool VRSLAMSystem::Stop()
         return false;
     }
     
-    // Stop processing thread
+    // Stop the pipeline front to back, each stage finishes the frame sets already queued for it
     running_ = false;
-    processing_cv_.notify_all();
+    extraction_queue_->Close();
+    if (acquisition_thread_.joinable()) {
+        acquisition_thread_.join();
+    }
+    if (extraction_thread_.joinable()) {
+        extraction_thread_.join();
+    }
+    tracking_queue_->Close();
     if (processing_thread_.joinable()) {
         processing_thread_.join();
     }
+    if (pose_publisher_thread_.joinable()) {
+        pose_publisher_thread_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        memory_cv_.notify_all();
+    }
+    if (memory_thread_.joinable()) {
+        memory_thread_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(telemetry_mutex_);
+        telemetry_cv_.notify_all();
+    }
+    if (telemetry_thread_.joinable()) {
+        telemetry_thread_.join();
+    }
+    if (map_share_thread_.joinable()) {
+        map_share_thread_.join();
+    }
+    
+    // Return the remaining buffers before the driver stops
+    extraction_queue_.reset();
+    tracking_queue_.reset();
+    
+    // Writes a dump triggered by the last frame sets
+    if (flight_recorder_) {
+        flight_recorder_->Stop();
+    }
+    
+    if (config_.enable_energy_counters) {
+        ORB_SLAM3::EnergyCounters::Stop();
+    }
+    
+    if (config_.enable_pmu_counters) {
+        ORB_SLAM3::PmuCounters::Stop();
+    }
+    
+    if (!config_.trace_path.empty()) {
+        ORB_SLAM3::Tracer::Stop();
+        ORB_SLAM3::Tracer::ExportChromeTrace(config_.trace_path);
+    } else if (config_.flight_recorder.enabled && config_.flight_recorder.include_trace) {
+        ORB_SLAM3::Tracer::Stop();
+    }
     
     // Stop frame provider
     if (frame_provider_) {
@@ -103,8 +347,13 @@ bool VRSLAMSystem::Stop()
         }
     }
     
+    // Stop the refinement before the IMU it reads
+    if (online_calibration_ && !config_.offline_mapping) {
+        online_calibration_->Stop();
+    }
+    
     // Stop IMU interface
-    if (config_.use_imu && imu_interface_) {
+    if (config_.use_imu && imu_interface_ && !config_.offline_mapping) {
         if (!imu_interface_->Stop()) {
             std::cerr << "Failed to stop IMU interface" << std::endl;
             return false;
@@ -122,6 +371,18 @@ void VRSLAMSystem::Shutdown()
     }
     
     // Reset components
+    governor_.reset();
+    flight_recorder_.reset();
+    vsync_lock_.reset();
+    vsync_source_.reset();
+    dvfs_telemetry_.reset();
+    pose_export_.reset();
+    telemetry_export_.reset();
+    if (tracking_) {
+        tracking_->RegisterKeyFrameCallback(nullptr, 0);
+    }
+    map_share_client_.reset();
+    online_calibration_.reset();
     imu_interface_.reset();
     motion_model_.reset();
     tracking_.reset();
@@ -130,6 +391,10 @@ void VRSLAMSystem::Shutdown()
     frame_provider_.reset();
     camera_rig_.reset();
     
+    if (thread_placement_ && ThreadPlacementPolicy::GetInstalled() == thread_placement_) {
+        ThreadPlacementPolicy::Install(nullptr);
+    }
+    
     status_ = Status::SHUTDOWN;
 }
 
@@ -140,8 +405,24 @@ VRSLAMSystem::Status VRSLAMSystem::GetStatus() const
 
 Sophus::SE3f VRSLAMSystem::GetCurrentPose() const
 {
-    std::lock_guard<std::mutex> lock(pose_mutex_);
-    return current_pose_;
+    return GetPoseSnapshot().pose;
+}
+
+VRSLAMSystem::PoseSnapshot VRSLAMSystem::GetPoseSnapshot() const
+{
+    // The published pose is stale until the publisher picked up the latest tracked pose
+    PoseRecord record = published_pose_.Load();
+    const PoseRecord tracked = tracked_pose_.Load();
+    if (record.tracked_timestamp < tracked.timestamp) {
+        record = tracked;
+    }
+    
+    PoseSnapshot snapshot;
+    snapshot.pose = poseFromArrays(record.rotation, record.translation);
+    snapshot.timestamp = record.timestamp;
+    snapshot.tracked_timestamp = record.tracked_timestamp;
+    snapshot.imu_propagated = record.imu_propagated;
+    return snapshot;
 }
 
 Sophus::SE3f VRSLAMSystem::GetPredictedPose(double prediction_time_ms) const
@@ -150,13 +431,115 @@ Sophus::SE3f VRSLAMSystem::GetPredictedPose(double prediction_time_ms) const
         return GetCurrentPose();
     }
     
+    std::lock_guard<std::mutex> lock(motion_mutex_);
     return motion_model_->PredictPose(prediction_time_ms);
 }
 
+std::vector<Sophus::SE3f> VRSLAMSystem::GetPredictedPoses(const std::vector<double>& display_timestamps) const
+{
+    if (!motion_model_) {
+        return std::vector<Sophus::SE3f>(display_timestamps.size(), GetCurrentPose());
+    }
+    
+    // One lock, one state for all the targets
+    std::lock_guard<std::mutex> lock(motion_mutex_);
+    return motion_model_->PredictPosesAt(display_timestamps);
+}
+
+std::vector<std::pair<std::string, double>> VRSLAMSystem::GetInitializationTimes() const
+{
+    return initialization_times_ms_;
+}
+
+void VRSLAMSystem::GetFrameSetFeatureCounts(int& keypoints, int& tracked_points) const
+{
+    keypoints = 0;
+    tracked_points = 0;
+    if (tracking_) {
+        tracking_->GetFrameSetFeatureCounts(keypoints, tracked_points);
+    }
+}
+
+std::vector<ThreadStats> VRSLAMSystem::GetThreadStats() const
+{
+    return thread_placement_ ? thread_placement_->GetThreadStats() : std::vector<ThreadStats>();
+}
+
+bool VRSLAMSystem::GetOnlineCalibrationState(OnlineCalibration::State& state) const
+{
+    if (!online_calibration_) {
+        return false;
+    }
+    state = online_calibration_->GetState();
+    return true;
+}
+
 VRSLAMSystem::PerformanceMetrics VRSLAMSystem::GetPerformanceMetrics() const
 {
-    std::lock_guard<std::mutex> lock(metrics_mutex_);
-    return metrics_;
+    PerformanceMetrics metrics;
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        metrics = metrics_;
+    }
+    
+    for (size_t i = 0; i < kNumLatencyStages; ++i) {
+        metrics.stage_latency[i] = latency_tracker_.GetStagePercentiles(static_cast<LatencyStage>(i));
+    }
+    metrics.end_to_end_latency = latency_tracker_.GetEndToEndPercentiles();
+    metrics.lock_contention = LockProfiler::GetStatistics();
+    metrics.stage_counters = PmuCounters::GetStatistics();
+    metrics.rail_energy = EnergyCounters::GetRails();
+    metrics.stage_energy = EnergyCounters::GetStatistics();
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        metrics.memory = memory_;
+        metrics.resident_bytes = resident_bytes_;
+    }
+    
+    // The paged out features are counted by the breakdown but not resident
+    const size_t attributed_bytes = metrics.memory.Total() - metrics.memory.nPagedOutBytes;
+    metrics.unattributed_bytes = metrics.resident_bytes > attributed_bytes ? metrics.resident_bytes - attributed_bytes : 0;
+    return metrics;
+}
+
+bool VRSLAMSystem::RunOfflineMapping(const std::string& filename)
+{
+    using namespace std::chrono;
+    
+    if (!config_.offline_mapping || config_.replay_path.empty()) {
+        std::cerr << "Offline mapping needs config.offline_mapping and a replay path" << std::endl;
+        return false;
+    }
+    
+    const auto start = steady_clock::now();
+    if (!Start()) {
+        return false;
+    }
+    
+    // The replay blocks on the pipeline, it ends once every frame set was taken.
+    // A request timing out after that leaves nothing in the provider
+    while (!frame_provider_->IsReplayFinished()) {
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+    const uint64_t empty_acquisitions = empty_acquisitions_;
+    while (empty_acquisitions_ == empty_acquisitions) {
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    
+    // The stages finish the frame sets queued for them
+    if (!Stop()) {
+        return false;
+    }
+    const double tracked_s = duration<double>(steady_clock::now() - start).count();
+    
+    // Local mapping works off its queue before the global BA
+    if (!tracking_->RunGlobalBundleAdjustment(config_.offline_gba_iterations)) {
+        return false;
+    }
+    std::cout << "Offline mapping tracked the recording in " << tracked_s << " s, finished in "
+              << duration<double>(steady_clock::now() - start).count() << " s" << std::endl;
+    
+    return SaveMap(filename);
 }
 
 bool VRSLAMSystem::SaveMap(const std::string& filename) const
@@ -166,7 +549,7 @@ bool VRSLAMSystem::SaveMap(const std::string& filename) const
         return false;
     }
     
-    // Save map using ORB-SLAM3 Atlas
+    // Sectioned atlas file written by the ORB-SLAM3 system
     return tracking_->SaveMap(filename);
 }
 
@@ -177,10 +560,35 @@ bool VRSLAMSystem::LoadMap(const std::string& filename)
         return false;
     }
     
-    // Load map using ORB-SLAM3 Atlas
+    // Sectioned atlas file, only before tracking starts
     return tracking_->LoadMap(filename);
 }
 
+bool VRSLAMSystem::CheckpointMap(const std::string& filename)
+{
+    if (!tracking_) {
+        std::cerr << "Tracking not initialized" << std::endl;
+        return false;
+    }
+    
+    const size_t bytes_per_second = static_cast<size_t>(std::max(0.0, config_.checkpoint_write_mbps) * 1024.0 * 1024.0);
+    return tracking_->Checkpoint(filename, bytes_per_second);
+}
+
+bool VRSLAMSystem::IsCheckpointing() const
+{
+    return tracking_ && tracking_->IsCheckpointing();
+}
+
+bool VRSLAMSystem::DumpFlightRecorder()
+{
+    if (!flight_recorder_) {
+        return false;
+    }
+    flight_recorder_->RequestDump();
+    return true;
+}
+
 bool VRSLAMSystem::Reset()
 {
     if (status_ == Status::UNINITIALIZED || status_ == Status::SHUTDOWN) {
@@ -196,6 +604,7 @@ bool VRSLAMSystem::Reset()
     
     // Reset components
     if (motion_model_) {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
         motion_model_->Reset();
     }
     
@@ -214,7 +623,14 @@ bool VRSLAMSystem::Reset()
         metrics_.frames_processed = 0;
         metrics_.tracking_lost_count = 0;
         metrics_.tracking_percentage = 100.0;
+        metrics_.pipeline_dropped_frames = 0;
+        metrics_.vsync_locked = false;
+        metrics_.pose_age_at_scanout_ms = 0.0;
+        metrics_.pose_age_jitter_ms = 0.0;
     }
+    latency_tracker_.Reset();
+    storeTrackedPose(Sophus::SE3f(), 0.0);
+    published_pose_.Store(tracked_pose_.Load());
     
     // Restart if was running
     if (was_running) {
@@ -228,6 +644,7 @@ bool VRSLAMSystem::Reset()
 void VRSLAMSystem::SetInteractionMode(VRMotionModel::InteractionMode mode)
 {
     if (motion_model_) {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
         motion_model_->SetInteractionMode(mode);
     }
 }
@@ -235,6 +652,7 @@ void VRSLAMSystem::SetInteractionMode(VRMotionModel::InteractionMode mode)
 VRMotionModel::InteractionMode VRSLAMSystem::GetInteractionMode() const
 {
     if (motion_model_) {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
         return motion_model_->GetInteractionMode();
     }
     return VRMotionModel::InteractionMode::STANDING;  // Default
@@ -242,7 +660,10 @@ VRMotionModel::InteractionMode VRSLAMSystem::GetInteractionMode() const
 
 void VRSLAMSystem::SetPredictionHorizon(double prediction_horizon_ms)
 {
+    prediction_horizon_ms_ = prediction_horizon_ms;
+    
     if (motion_model_) {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
         VRMotionModel::PredictionConfig config = motion_model_->GetConfig();
         config.prediction_horizon_ms = prediction_horizon_ms;
         motion_model_->SetConfig(config);
@@ -252,11 +673,56 @@ void VRSLAMSystem::SetPredictionHorizon(double prediction_horizon_ms)
 double VRSLAMSystem::GetPredictionHorizon() const
 {
     if (motion_model_) {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
         return motion_model_->GetConfig().prediction_horizon_ms;
     }
     return 0.0;
 }
 
+void VRSLAMSystem::SetPredictionAutoTune(const VRMotionModel::AutoTuneConfig& config)
+{
+    if (motion_model_) {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
+        motion_model_->SetAutoTune(config);
+    }
+}
+
+VRMotionModel::PredictionErrorStats VRSLAMSystem::GetPredictionErrorStats(VRMotionModel::InteractionMode mode,
+                                                                          int bucket) const
+{
+    if (motion_model_) {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
+        return motion_model_->GetPredictionErrorStats(mode, bucket);
+    }
+    return VRMotionModel::PredictionErrorStats();
+}
+
+void VRSLAMSystem::HintLoad(uint32_t hints)
+{
+    if (dvfs_telemetry_) {
+        dvfs_telemetry_->HintLoad(hints);
+    }
+}
+
+size_t VRSLAMSystem::TakeRemoteKeyFrames(std::vector<KeyFrameDelta>& keyframes)
+{
+    std::lock_guard<std::mutex> lock(remote_keyframes_mutex_);
+    const size_t count = remote_keyframes_.size();
+    for (auto& delta : remote_keyframes_) {
+        keyframes.push_back(std::move(delta));
+    }
+    remote_keyframes_.clear();
+    return count;
+}
+
+MapShareClient::Stats VRSLAMSystem::GetMapShareStats() const
+{
+    if (map_share_client_) {
+        return map_share_client_->GetStats();
+    }
+    return MapShareClient::Stats();
+}
+
 bool VRSLAMSystem::ProcessFrame(const std::vector<cv::Mat>& images, double timestamp)
 {
     return processFrameInternal(images, timestamp);
@@ -269,26 +735,44 @@ bool VRSLAMSystem::ProcessIMU(const Eigen::Vector3f& gyro, const Eigen::Vector3f
 
 bool VRSLAMSystem::initializeComponents()
 {
-    try {
-        // Initialize camera rig
+    using namespace std::chrono;
+    
+    // Steps only depending on each other's results are ordered, the others run
+    // concurrently: the camera and IMU bring-up overlap the TPU model load. The
+    // steps opening the EdgeTPU (the extractor, the integration and the tracking's
+    // extractors) still run one after the other.
+    std::vector<ZeroCopyFrameProvider::CameraConfig> camera_configs;
+    std::vector<InitStep> steps;
+    
+    // Placed before any component starts a thread; with the memory locked
+    // and prefaulted the real-time loops do not stall on page faults
+    if (config_.thread_placement.enabled && !thread_placement_) {
+        thread_placement_ = std::make_shared<ThreadPlacementPolicy>(config_.thread_placement);
+        if (!thread_placement_->ApplyProcess()) {
+            std::cerr << "Memory not locked, real-time threads may stall on page faults" << std::endl;
+        }
+        ThreadPlacementPolicy::Install(thread_placement_);
+    }
+    
+    steps.push_back({"camera_rig", {}, [&]() {
         camera_rig_ = std::make_unique<MultiCameraRig>(0);  // Reference camera ID = 0
         
         // Load camera calibration
-        if (!config_.calibration_path.empty()) {
-            if (!camera_rig_->LoadCalibration(config_.calibration_path)) {
-                std::cerr << "Failed to load camera calibration from " << config_.calibration_path << std::endl;
-                return false;
-            }
-        } else {
+        if (config_.calibration_path.empty()) {
             std::cerr << "No camera calibration file specified" << std::endl;
             return false;
         }
-        
-        // Initialize frame provider
+        if (!camera_rig_->LoadCalibration(config_.calibration_path)) {
+            std::cerr << "Failed to load camera calibration from " << config_.calibration_path << std::endl;
+            return false;
+        }
+        return true;
+    }});
+    
+    steps.push_back({"frame_provider", {"camera_rig"}, [&]() {
         frame_provider_ = std::make_unique<ZeroCopyFrameProvider>();
         
         // Convert camera rig to frame provider configuration
-        std::vector<ZeroCopyFrameProvider::CameraConfig> camera_configs;
         for (const auto& camera : camera_rig_->GetAllCameras()) {
             ZeroCopyFrameProvider::CameraConfig config;
             config.camera_id = camera.id;
@@ -304,16 +788,45 @@ bool VRSLAMSystem::initializeComponents()
             return false;
         }
         
-        // Initialize TPU feature extractor
+        // A recording instead of the cameras, served as fast as it is taken when mapping offline
+        if (!config_.replay_path.empty() &&
+            !frame_provider_->SetReplaySource(config_.replay_path, config_.offline_mapping ? 0.0f : 1.0f)) {
+            std::cerr << "Failed to replay " << config_.replay_path << ": "
+                      << frame_provider_->GetLastErrorMessage() << std::endl;
+            return false;
+        }
+        return true;
+    }});
+    
+    steps.push_back({"feature_extractor", {}, [&]() {
+        if (!TPUFeatureExtractor::PreloadModel(config_.tpu_model_path)) {
+            std::cerr << "Failed to preload TPU model from " << config_.tpu_model_path << std::endl;
+        }
+        
         feature_extractor_ = std::make_unique<TPUFeatureExtractor>();
         if (!feature_extractor_->Initialize(config_.tpu_model_path, 640, 480)) {
             std::cerr << "Failed to initialize TPU feature extractor" << std::endl;
             return false;
         }
         
-        // Initialize TPU-ZeroCopy integration
+        // Degraded models stay resident so the extractor switches without a stall
+        for (const std::string& model_path : config_.tpu_model_ladder) {
+            if (!feature_extractor_->AddModelRung(model_path)) {
+                std::cerr << "Model " << model_path << " left out of the extractor ladder" << std::endl;
+            }
+        }
+        
+        // Upload the model parameters to the EdgeTPU while the other components start;
+        // frames arriving before it finishes run at cold-start latency
+        feature_extractor_->StartWarmup();
+        return true;
+    }});
+    
+    steps.push_back({"tpu_integration", {"frame_provider", "feature_extractor"}, [&]() {
         TPUZeroCopyIntegration::Config tpu_integration_config;
-        tpu_integration_config.num_threads = config_.num_threads;
+        tpu_integration_config.num_threads = config_.offline_mapping
+            ? std::max(config_.num_threads, static_cast<int>(std::thread::hardware_concurrency()))
+            : config_.num_threads;
         tpu_integration_config.enable_direct_dma = true;
         tpu_integration_config.enable_performance_tracking = true;
         
@@ -324,22 +837,78 @@ bool VRSLAMSystem::initializeComponents()
             std::cerr << "Failed to initialize TPU-ZeroCopy integration" << std::endl;
             return false;
         }
+        return true;
+    }});
+    
+    steps.push_back({"outputs", {}, [&]() {
+        // Export poses to out-of-process readers (the OpenVR driver), optional
+        if (!config_.pose_export_name.empty()) {
+            pose_export_ = std::make_unique<SharedPoseWriter>(config_.pose_export_name);
+            if (!pose_export_->Open()) {
+                std::cerr << "Pose export disabled" << std::endl;
+                pose_export_.reset();
+            }
+        }
         
-        // Initialize ORB-SLAM3 system components
-        // Note: In a real implementation, these would be actual ORB-SLAM3 components
-        // For this implementation, we'll use our custom MultiCameraTracking
+        // Stream the telemetry to the monitoring service, optional
+        if (!config_.telemetry_export_name.empty()) {
+            telemetry_export_ = std::make_unique<SharedTelemetryWriter>(config_.telemetry_export_name);
+            if (!telemetry_export_->Open()) {
+                std::cerr << "Telemetry export disabled" << std::endl;
+                telemetry_export_.reset();
+            }
+        }
         
-        // Initialize motion model
+        // Feed the stage times to the DVFS governor of the power driver, optional
+        if (!config_.power_device.empty()) {
+            dvfs_telemetry_ = std::make_unique<DvfsTelemetry>(config_.power_device);
+            if (!dvfs_telemetry_->Open()) {
+                std::cerr << "DVFS telemetry disabled" << std::endl;
+                dvfs_telemetry_.reset();
+            }
+        }
+        return true;
+    }});
+    
+    // Follow the display's late latch with the camera trigger, optional
+    if (config_.vsync_lock.enabled && !config_.offline_mapping) {
+        steps.push_back({"vsync_lock", {"camera_rig"}, [&]() {
+            VsyncPhaseLock::Config lock_config = config_.vsync_lock;
+            const float fps = camera_rig_->GetCameraInfo(lock_config.trigger_camera_id).fps;
+            if (lock_config.camera_period_ns <= 0 && fps > 0.0f) {
+                lock_config.camera_period_ns = static_cast<int64_t>(1e9 / fps);
+            }
+            
+            vsync_source_ = std::make_unique<DisplayVsyncSource>(lock_config.display_device, lock_config.display_index);
+            if (lock_config.camera_period_ns <= 0 || !vsync_source_->Open()) {
+                std::cerr << "Vsync phase lock disabled" << std::endl;
+                vsync_source_.reset();
+                return true;
+            }
+            vsync_lock_ = std::make_unique<VsyncPhaseLock>(lock_config);
+            return true;
+        }});
+    }
+    
+    steps.push_back({"motion_model", {}, [&]() {
         VRMotionModel::PredictionConfig motion_config;
         motion_config.prediction_horizon_ms = config_.prediction_horizon_ms;
         motion_config.use_imu_for_prediction = config_.use_imu;
         motion_config.adaptive_prediction = true;
         
         motion_model_ = std::make_unique<VRMotionModel>(motion_config);
+        if (config_.auto_tune_prediction) {
+            VRMotionModel::AutoTuneConfig tune_config;
+            tune_config.enabled = true;
+            motion_model_->SetAutoTune(tune_config);
+        }
         motion_model_->SetInteractionMode(config_.interaction_mode);
-        
-        // Initialize IMU interface if enabled
-        if (config_.use_imu) {
+        return true;
+    }});
+    
+    // The sensor resets and configures with sleeps of hundreds of milliseconds
+    if (config_.use_imu) {
+        steps.push_back({"imu", {"motion_model"}, [&]() {
             BNO085Interface::Config imu_config;
             imu_config.interface_type = BNO085Interface::InterfaceType::I2C;
             imu_config.operation_mode = BNO085Interface::OperationMode::VR;
@@ -350,16 +919,44 @@ bool VRSLAMSystem::initializeComponents()
                 std::cerr << "Failed to initialize IMU interface" << std::endl;
                 return false;
             }
-        }
-        
-        // Initialize multi-camera tracking
+            
+            // Rotates gyro measurements from the IMU into the camera frame
+            RotationRecord imu_to_camera;
+            rotationToArray(imu_interface_->GetImuToCameraTransform().so3().inverse(), imu_to_camera.rotation);
+            imu_to_camera_rotation_.Store(imu_to_camera);
+            
+            // Start the motion model's filter from the IMU's bias
+            motion_model_->SetImuBias(imu_interface_->GetCurrentBias());
+            return true;
+        }});
+    }
+    
+    // Track the drift of the IMU-camera rotation and clock offset, optional
+    if (config_.use_imu && config_.online_calibration.enabled) {
+        steps.push_back({"online_calibration", {"imu"}, [&]() {
+            OnlineCalibration::Calibration initial;
+            initial.T_bc = imu_interface_->GetImuToCameraTransform();
+            initial.time_offset = imu_interface_->GetTimeOffset();
+            calibration_gyro_sequence_ = imu_interface_->GetMeasurementBuffer().GetWriteCount();
+            online_calibration_ = std::make_unique<OnlineCalibration>(
+                config_.online_calibration, initial,
+                [this](std::vector<OnlineCalibration::GyroMeasurement>& samples) { readCalibrationGyro(samples); },
+                [this](const OnlineCalibration::Calibration& calibration) { applyCalibration(calibration); });
+            return true;
+        }});
+    }
+    
+    steps.push_back({"tracking", {"camera_rig", "tpu_integration"}, [&]() {
         // Note: In a real implementation, this would initialize the actual ORB-SLAM3 system
         // For this implementation, we'll use placeholder objects
-        
         MultiCameraTracking::Config tracking_config;
         tracking_config.enable_cross_camera_matching = true;
         tracking_config.use_spherical_model = true;
         tracking_config.parallel_feature_extraction = true;
+        // Offline the workers are left to the scheduler on all cores
+        if (thread_placement_ && !config_.offline_mapping) {
+            tracking_config.worker_cpu_cores = thread_placement_->GetRoleCpus(ThreadRole::FEATURE_EXTRACTION);
+        }
         
         tracking_ = std::make_unique<MultiCameraTracking>(
             nullptr,  // System* (not needed for this implementation)
@@ -373,81 +970,240 @@ bool VRSLAMSystem::initializeComponents()
             *camera_rig_,
             tracking_config
         );
-        
+        if (config_.offline_mapping) {
+            tracking_->SetOfflineMapping(true);
+        }
         return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Exception during component initialization: " << e.what() << std::endl;
-        return false;
+    }});
+    
+    // Initialize the latency governor, it starts from the current quality. Offline there is no budget to hold
+    if (config_.enable_governor && !config_.offline_mapping) {
+        steps.push_back({"governor", {"tpu_integration", "tracking"}, [&]() {
+            PerformanceGovernor::Config governor_config = config_.governor;
+            if (tpu_integration_->GetFeatureTarget() > 0) {
+                governor_config.max_settings.feature_target = tpu_integration_->GetFeatureTarget();
+            }
+            governor_config.max_settings.local_map_keyframes = tracking_->GetMaxLocalKeyFrames();
+            governor_ = std::make_unique<PerformanceGovernor>(governor_config);
+            tracking_->SetLocalBAWindow(governor_config.max_settings.local_ba_keyframes);
+            return true;
+        }});
     }
+    
+    // Share the keyframes with the other headsets of the arena, optional
+    if (!config_.map_share_host.empty()) {
+        steps.push_back({"map_share", {"tracking"}, [&]() {
+            MapShareClient::Options share_options;
+            share_options.host = config_.map_share_host;
+            share_options.port = config_.map_share_port;
+            share_options.device_id = config_.map_share_device_id;
+            map_share_client_ = std::make_unique<MapShareClient>(share_options);
+            if (!map_share_client_->IsValid()) {
+                std::cerr << "Map sharing disabled" << std::endl;
+                map_share_client_.reset();
+                return true;
+            }
+            MapShareClient* client = map_share_client_.get();
+            tracking_->RegisterKeyFrameCallback([client](const KeyFrameDelta& delta) {
+                client->Publish(delta);
+            }, config_.map_share_device_id);
+            return true;
+        }});
+    }
+    
+    initialization_times_ms_.clear();
+    const auto start = steady_clock::now();
+    const bool ok = runInitSteps(steps, initialization_times_ms_);
+    initialization_times_ms_.emplace_back("total", duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0);
+    
+    for (const auto& step : initialization_times_ms_) {
+        std::cout << "Initialization " << step.first << ": " << step.second << " ms" << std::endl;
+    }
+    return ok;
 }
 
-void VRSLAMSystem::processingLoop()
+void VRSLAMSystem::acquisitionLoop()
 {
     using namespace std::chrono;
     
-    steady_clock::time_point last_frame_time = steady_clock::now();
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::CAMERA_ACQUISITION, "VR-Acquisition");
     
+    uint64_t acquired_sets = 0;
     while (running_) {
-        // Wait for next frame time or notification
-        {
-            std::unique_lock<std::mutex> lock(processing_mutex_);
-            processing_cv_.wait_for(lock, milliseconds(1));
-        }
-        
-        // Check if we should continue running
-        if (!running_) {
-            break;
-        }
-        
-        // Get synchronized frames from all cameras
-        std::vector<ZeroCopyFrameProvider::FrameBuffer> frame_buffers;
+        // Get a timestamp-synchronized frame set from all cameras, the
+        // timeout bounds how long a stop request waits
+        AcquiredFrameSet acquired;
         auto acquisition_start = steady_clock::now();
-        bool got_frames = frame_provider_->GetSynchronizedFrames(frame_buffers);
+        TRACE_BEGIN("GetSynchronizedFrames");
+        bool got_frames = frame_provider_->GetSynchronizedFrames(acquired.frame_set, kFrameSyncToleranceMs, kFrameSetTimeoutMs);
+        TRACE_END();
         auto acquisition_end = steady_clock::now();
         
         if (!got_frames) {
+            empty_acquisitions_++;
+            continue;
+        }
+        
+        // The flow of the set through extraction and tracking starts here, keyed by its timestamp
+        TRACE_SCOPE("FrameSet");
+        TRACE_FLOW_START(acquired.frame_set.timestamp);
+        
+        // The governor lowers the processed frame rate by skipping sets; the
+        // cameras keep streaming, their configuration cannot change while running
+        const int decimation = frame_decimation_;
+        if (decimation > 1 && (acquired_sets++ % decimation) != 0) {
+            frame_provider_->ReleaseFrameSet(acquired.frame_set);
             continue;
         }
         
-        // Extract features from all frames
-        std::vector<std::vector<cv::KeyPoint>> all_keypoints;
-        std::vector<cv::Mat> all_descriptors;
+        // The set is as late as its slowest frame and as old as its oldest exposure
+        acquired.latency = acquired.frame_set.frames[0].latency;
+        for (size_t i = 1; i < acquired.frame_set.frames.size(); ++i) {
+            acquired.latency.Merge(acquired.frame_set.frames[i].latency);
+        }
+        acquired.acquisition_time_ms = duration_cast<microseconds>(acquisition_end - acquisition_start).count() / 1000.0;
+        
+        // Blocks or drops according to the drop policy when extraction falls behind
+        extraction_queue_->Push(acquired);
+    }
+}
+
+void VRSLAMSystem::extractionLoop()
+{
+    using namespace std::chrono;
+    
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::FEATURE_EXTRACTION, "VR-Extraction");
+    
+    AcquiredFrameSet acquired;
+    for (;;) {
+        auto wait_start = steady_clock::now();
+        if (!extraction_queue_->Pop(acquired, -1)) {
+            break;
+        }
+        auto wait_end = steady_clock::now();
+        const FlightRecorder::ThreadCounters counters_start =
+            flight_recorder_ ? FlightRecorder::ThreadCounters::Sample() : FlightRecorder::ThreadCounters();
+        
+        TRACE_SCOPE("ExtractFrameSet");
+        TRACE_FLOW_STEP(acquired.frame_set.timestamp);
+        
+        // Extract features from all frames of this set in one TPU batch
+        std::vector<TPUZeroCopyIntegration::ExtractionResult> results;
         auto feature_start = steady_clock::now();
-        bool extracted = tpu_integration_->ProcessSynchronizedFrames(all_keypoints, all_descriptors);
+        bool extracted = tpu_integration_->ProcessFrameSet(acquired.frame_set, results);
         auto feature_end = steady_clock::now();
         
         if (!extracted) {
+            frame_provider_->ReleaseFrameSet(acquired.frame_set);
+            continue;
+        }
+        
+        ExtractedFrameSet extracted_set;
+        extracted_set.timestamp = acquired.frame_set.timestamp;
+        extracted_set.latency = acquired.latency;
+        extracted_set.acquisition_time_ms = acquired.acquisition_time_ms;
+        extracted_set.feature_time_ms = duration_cast<microseconds>(feature_end - feature_start).count() / 1000.0;
+        extracted_set.extraction_wait_ms = duration_cast<microseconds>(wait_end - wait_start).count() / 1000.0;
+        if (flight_recorder_) {
+            extracted_set.extraction_thread = FlightRecorder::ThreadCounters::Sample().Since(counters_start);
+        }
+        for (const auto& result : results) {
+            extracted_set.latency.Merge(result.latency);
+        }
+        
+        // Wrap frame buffers as OpenCV images for tracking without copying.
+        // The views hand the buffers back to the driver when they go out of scope.
+        if (!frame_provider_->CreateFrameViews(acquired.frame_set, extracted_set.frame_views)) {
             continue;
         }
         
-        // Convert frame buffers to OpenCV images for tracking
+        tracking_queue_->Push(extracted_set);
+    }
+}
+
+void VRSLAMSystem::processingLoop()
+{
+    using namespace std::chrono;
+    
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::TRACKING, "VR-Tracking");
+    
+    steady_clock::time_point last_frame_time = steady_clock::now();
+    steady_clock::time_point last_checkpoint_time = last_frame_time;
+    KeyFrame* last_keyframe = nullptr;
+    
+    ExtractedFrameSet extracted;
+    for (;;) {
+        auto wait_start = steady_clock::now();
+        if (!tracking_queue_->Pop(extracted, -1)) {
+            break;
+        }
+        auto wait_end = steady_clock::now();
+        
+        TRACE_SCOPE("TrackFrameSet");
+        TRACE_FLOW_STEP(extracted.timestamp);
+        
+        // Pipeline state of this set for the flight recorder
+        FlightRecorder::Record record;
+        if (flight_recorder_) {
+            record.tracking_wait_ms = duration_cast<microseconds>(wait_end - wait_start).count() / 1000.0;
+            record.extraction_queue_depth = static_cast<uint16_t>(extraction_queue_->Size());
+            record.tracking_queue_depth = static_cast<uint16_t>(tracking_queue_->Size());
+        }
+        const FlightRecorder::ThreadCounters counters_start =
+            flight_recorder_ ? FlightRecorder::ThreadCounters::Sample() : FlightRecorder::ThreadCounters();
+        steady_clock::duration motion_lock_wait(0);
+        
         std::vector<cv::Mat> images;
-        for (const auto& buffer : frame_buffers) {
-            cv::Mat image(buffer.height, buffer.width, CV_8UC1);
-            if (buffer.buffer_type == ZeroCopyFrameProvider::BufferType::CPU && buffer.data) {
-                memcpy(image.data, buffer.data, buffer.size);
-            } else {
-                // For DMA buffers, we would need to map them to CPU memory
-                // This is a simplified implementation
-                image = cv::Mat::zeros(buffer.height, buffer.width, CV_8UC1);
-            }
-            images.push_back(image);
+        images.reserve(extracted.frame_views.size());
+        for (const auto& view : extracted.frame_views) {
+            images.push_back(view->GetImage());
         }
         
-        // Track with multi-camera system
+        // Track with multi-camera system using the hardware capture timestamp
         auto tracking_start = steady_clock::now();
-        double timestamp = duration_cast<milliseconds>(tracking_start.time_since_epoch()).count() / 1000.0;
-        Sophus::SE3f pose = tracking_->GrabMultiCameraImages(images, timestamp, all_keypoints, all_descriptors);
+        double timestamp = extracted.timestamp;
+        LatencyStamps& latency = extracted.latency;
+        {
+            auto lock_start = steady_clock::now();
+            std::lock_guard<std::mutex> lock(motion_mutex_);
+            motion_lock_wait += steady_clock::now() - lock_start;
+            tracking_->SetMotionHint(motion_model_->EstimateLinearVelocity(), motion_model_->EstimateAngularVelocity());
+            seedPosePrediction(timestamp);
+        }
+        Sophus::SE3f pose = tracking_->GrabMultiCameraImages(images, timestamp, latency);
         auto tracking_end = steady_clock::now();
         
+        // Hand the buffers back before the bookkeeping
+        images.clear();
+        extracted.frame_views.clear();
+        
         // Update current pose
+        storeTrackedPose(pose, timestamp);
+        
+        // Update motion model
         {
-            std::lock_guard<std::mutex> lock(pose_mutex_);
-            current_pose_ = pose;
+            auto lock_start = steady_clock::now();
+            std::lock_guard<std::mutex> lock(motion_mutex_);
+            motion_lock_wait += steady_clock::now() - lock_start;
+            motion_model_->AddPose(pose, timestamp, &latency);
         }
+        latency_tracker_.Record(latency);
+        tracked_latency_.Store(latency);
         
-        // Update motion model
-        motion_model_->AddPose(pose, timestamp);
+        // Well-tracked poses feed the calibration refinement
+        if (online_calibration_ && tracking_->GetTrackingState() == TrackingState::OK) {
+            online_calibration_->AddCameraPose(timestamp, pose);
+        }
+        
+        // Slew the camera trigger so the next poses are ready right before a late latch
+        if (vsync_lock_) {
+            updateVsyncLock(latency);
+        }
+        
+        // Scale quality to hold the latency budget
+        if (governor_ && governor_->AddFrame(latency)) {
+            applyGovernorDecision();
+        }
         
         // Update status based on tracking result
         if (tracking_->GetTrackingState() == TrackingState::OK) {
@@ -459,33 +1215,462 @@ void VRSLAMSystem::processingLoop()
             status_ = Status::RELOCALIZATION;
         }
         
-        // Calculate timing metrics
-        double acquisition_time = duration_cast<microseconds>(acquisition_end - acquisition_start).count() / 1000.0;
-        double feature_time = duration_cast<microseconds>(feature_end - feature_start).count() / 1000.0;
+        // Update performance metrics
         double tracking_time = duration_cast<microseconds>(tracking_end - tracking_start).count() / 1000.0;
-        double total_time = duration_cast<microseconds>(tracking_end - acquisition_start).count() / 1000.0;
+        updatePerformanceMetrics(tracking_time, extracted.feature_time_ms, extracted.acquisition_time_ms);
         
-        // Update performance metrics
-        updatePerformanceMetrics(tracking_time, feature_time, acquisition_time);
+        // Recorded on every set, dumped to disk by the recorder's own thread after a latency spike
+        if (flight_recorder_) {
+            record.timestamp = timestamp;
+            record.latency = latency;
+            record.acquisition_ms = static_cast<float>(extracted.acquisition_time_ms);
+            record.feature_ms = static_cast<float>(extracted.feature_time_ms);
+            record.tracking_ms = static_cast<float>(tracking_time);
+            record.extraction_wait_ms = static_cast<float>(extracted.extraction_wait_ms);
+            record.motion_lock_wait_ms = duration_cast<microseconds>(motion_lock_wait).count() / 1000.0f;
+            record.dropped_sets = static_cast<uint32_t>(
+                extraction_queue_->GetDroppedCount() + tracking_queue_->GetDroppedCount());
+            record.tracking_state = static_cast<int32_t>(tracking_->GetTrackingState());
+            record.extraction_thread = extracted.extraction_thread;
+            record.tracking_thread = FlightRecorder::ThreadCounters::Sample().Since(counters_start);
+            flight_recorder_->Add(record);
+        }
         
-        // Calculate FPS
+        // Calculate FPS, set by the slowest stage
         auto current_time = steady_clock::now();
         double frame_time = duration_cast<microseconds>(current_time - last_frame_time).count() / 1000.0;
         last_frame_time = current_time;
         
-        // Update FPS in metrics
+        // Clock the A76 cores and the NPU for the stage times, ahead of mapping and relocalization
+        if (dvfs_telemetry_) {
+            KeyFrame* keyframe = tracking_->GetLastKeyFrame();
+            if (keyframe != last_keyframe) {
+                dvfs_telemetry_->HintLoad(kDvfsHintKeyFrame);
+                last_keyframe = keyframe;
+            }
+            if (status_ == Status::LOST || status_ == Status::RELOCALIZATION) {
+                dvfs_telemetry_->HintLoad(kDvfsHintRelocalization);
+            }
+            dvfs_telemetry_->Report(frame_time, extracted.acquisition_time_ms,
+                                    extracted.feature_time_ms, tracking_time);
+            
+            // A hot NPU moves the extractor to a cheaper model before it throttles further
+            const int npu_thermal_status = dvfs_telemetry_->ReadThermalStatus(kDvfsThermalZoneNpu);
+            if (npu_thermal_status >= 0) {
+                feature_extractor_->SetThermalLevel(npu_thermal_status);
+            }
+        }
+        
+        // Update FPS and pipeline drops in metrics
         {
             std::lock_guard<std::mutex> lock(metrics_mutex_);
             metrics_.average_fps = 1000.0 / frame_time;
+            metrics_.pipeline_dropped_frames = static_cast<int>(
+                extraction_queue_->GetDroppedCount() + tracking_queue_->GetDroppedCount());
+        }
+        
+        // Periodic checkpoint, only started here, taken and written in the background
+        if (!config_.checkpoint_path.empty() && config_.checkpoint_interval_s > 0.0 &&
+            duration<double>(current_time - last_checkpoint_time).count() >= config_.checkpoint_interval_s) {
+            last_checkpoint_time = current_time;
+            if (!IsCheckpointing()) {
+                CheckpointMap(config_.checkpoint_path);
+            }
+        }
+    }
+}
+
+void VRSLAMSystem::memoryLoop()
+{
+    using namespace std::chrono;
+    
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::DIAGNOSTICS, "VR-Memory");
+    
+    const auto period = duration_cast<steady_clock::duration>(duration<double>(config_.memory_sample_interval_s));
+    const steady_clock::time_point start_time = steady_clock::now();
+    
+    std::ofstream log;
+    if (!config_.memory_log_path.empty()) {
+        log.open(config_.memory_log_path, std::ios::app);
+        if (!log) {
+            std::cerr << "Failed to open memory log: " << config_.memory_log_path << std::endl;
+        } else if (log.tellp() == 0) {
+            log << "time_s,resident_bytes,paged_out_bytes";
+            for (int i = 0; i < MemoryBreakdown::NUM_CATEGORIES; ++i) {
+                log << "," << MemoryBreakdown::GetCategoryName(static_cast<MemoryBreakdown::Category>(i));
+            }
+            log << "\n";
+        }
+    }
+    
+    std::unique_lock<std::mutex> lock(memory_mutex_);
+    while (running_) {
+        lock.unlock();
+        MemoryBreakdown breakdown;
+        if (tracking_) {
+            tracking_->GetMemoryBreakdown(breakdown);
+        }
+        MemoryAccounting::AddRegistered(breakdown);
+        const size_t resident_bytes = MemoryAccounting::GetResidentBytes();
+        
+        if (log.is_open()) {
+            log << duration<double>(steady_clock::now() - start_time).count() << ","
+                << resident_bytes << "," << breakdown.nPagedOutBytes;
+            for (int i = 0; i < MemoryBreakdown::NUM_CATEGORIES; ++i) {
+                log << "," << breakdown.vBytes[i];
+            }
+            log << std::endl;
+        }
+        
+        lock.lock();
+        memory_ = breakdown;
+        resident_bytes_ = resident_bytes;
+        memory_cv_.wait_for(lock, period, [this]() { return !running_; });
+    }
+}
+
+void VRSLAMSystem::telemetryLoop()
+{
+    using namespace std::chrono;
+    
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::DIAGNOSTICS, "VR-Telemetry");
+    
+    const auto period = duration_cast<steady_clock::duration>(duration<double>(1.0 / config_.telemetry_rate_hz));
+    
+    std::unique_lock<std::mutex> lock(telemetry_mutex_);
+    while (running_) {
+        lock.unlock();
+        SharedTelemetrySample sample = {};
+        sampleTelemetry(sample);
+        telemetry_export_->Publish(sample);
+        
+        lock.lock();
+        telemetry_cv_.wait_for(lock, period, [this]() { return !running_; });
+    }
+}
+
+void VRSLAMSystem::mapShareLoop()
+{
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::DIAGNOSTICS, "VR-MapShare");
+    
+    std::vector<KeyFrameDelta> received;
+    while (running_) {
+        received.clear();
+        map_share_client_->Poll(received, kMapSharePollMs);
+        if (!map_share_client_->IsConnected()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kMapSharePollMs));
+        }
+        if (received.empty()) {
+            continue;
         }
         
-        // Release frame buffers
-        for (auto& buffer : frame_buffers) {
-            frame_provider_->ReleaseFrame(buffer);
+        std::lock_guard<std::mutex> lock(remote_keyframes_mutex_);
+        for (auto& delta : received) {
+            remote_keyframes_.push_back(std::move(delta));
+        }
+        while (remote_keyframes_.size() > config_.max_remote_keyframes) {
+            remote_keyframes_.pop_front();
         }
     }
 }
 
+void VRSLAMSystem::sampleTelemetry(SharedTelemetrySample& sample) const
+{
+    // Everything here is read from the metrics and the components' own counters,
+    // the pipeline threads do no extra work for the stream
+    const PerformanceMetrics metrics = GetPerformanceMetrics();
+    sample.publish_time = LatencyNowSeconds();
+    sample.frames_processed = static_cast<uint64_t>(metrics.frames_processed);
+    sample.dropped_frames = static_cast<uint64_t>(metrics.pipeline_dropped_frames);
+    sample.tracking_lost_count = static_cast<uint64_t>(metrics.tracking_lost_count);
+    sample.fps = static_cast<float>(metrics.average_fps);
+    sample.tracking_state = static_cast<int32_t>(status_.load());
+    
+    for (size_t i = 0; i < kNumLatencyStages; ++i) {
+        sample.stage_p50_ms[i] = static_cast<float>(metrics.stage_latency[i].p50_ms);
+        sample.stage_p99_ms[i] = static_cast<float>(metrics.stage_latency[i].p99_ms);
+        sample.stage_p999_ms[i] = static_cast<float>(metrics.stage_latency[i].p999_ms);
+        sample.stage_max_ms[i] = static_cast<float>(metrics.stage_latency[i].max_ms);
+    }
+    sample.end_to_end_p50_ms = static_cast<float>(metrics.end_to_end_latency.p50_ms);
+    sample.end_to_end_p99_ms = static_cast<float>(metrics.end_to_end_latency.p99_ms);
+    sample.end_to_end_p999_ms = static_cast<float>(metrics.end_to_end_latency.p999_ms);
+    sample.end_to_end_max_ms = static_cast<float>(metrics.end_to_end_latency.max_ms);
+    
+    sample.extraction_queue_depth = static_cast<uint32_t>(extraction_queue_->Size());
+    sample.tracking_queue_depth = static_cast<uint32_t>(tracking_queue_->Size());
+    if (tracking_) {
+        int keypoints = 0;
+        int tracked_points = 0;
+        tracking_->GetFrameSetFeatureCounts(keypoints, tracked_points);
+        sample.keypoints = static_cast<uint32_t>(keypoints);
+        sample.tracked_points = static_cast<uint32_t>(tracked_points);
+    }
+    
+    if (tpu_integration_) {
+        sample.tpu_queue_depth = static_cast<uint32_t>(tpu_integration_->GetQueueSize());
+        sample.tpu_device_count = static_cast<uint32_t>(
+            std::min<size_t>(tpu_integration_->GetDeviceCount(), kSharedTelemetryMaxDevices));
+        for (uint32_t i = 0; i < sample.tpu_device_count; ++i) {
+            const TPUZeroCopyIntegration::DeviceStats stats = tpu_integration_->GetDeviceStats(static_cast<int>(i));
+            sample.tpu_utilization[i] = stats.utilization;
+            sample.tpu_rate_fps[i] = stats.processing_rate;
+        }
+    }
+    
+    SampleThermalState(sample);
+    
+    sample.resident_bytes = metrics.resident_bytes;
+    sample.unattributed_bytes = metrics.unattributed_bytes;
+    sample.paged_out_bytes = metrics.memory.nPagedOutBytes;
+    for (int i = 0; i < MemoryBreakdown::NUM_CATEGORIES; ++i) {
+        sample.memory_bytes[i] = metrics.memory.vBytes[i];
+    }
+}
+
+void VRSLAMSystem::posePublisherLoop()
+{
+    using namespace std::chrono;
+    
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::POSE_PUBLISHER, "VR-PosePublish");
+    
+    const auto period = duration_cast<steady_clock::duration>(
+        duration<double>(1.0 / std::max(1.0, config_.pose_publish_rate_hz)));
+    
+    // Tracked pose the propagation starts from
+    double base_timestamp = -1.0;
+    Sophus::SE3f base_Twc;
+    Eigen::Vector3f velocity = Eigen::Vector3f::Zero();
+    
+    // Propagated orientation and the gyro samples newer than the tracked pose
+    Sophus::SO3f imu_to_camera;
+    Sophus::SO3f Rwc;
+    Eigen::Vector3f angular_velocity = Eigen::Vector3f::Zero();
+    double propagated_timestamp = 0.0;
+    double published_timestamp = -1.0;
+    std::deque<GyroSample> history;
+    
+    auto integrate = [&](const GyroSample& gyro_sample) {
+        const double dt = gyro_sample.timestamp - propagated_timestamp;
+        if (dt <= 0.0) {
+            return;
+        }
+        const float step = static_cast<float>(std::min(dt, kMaxGyroGapS));
+        angular_velocity = imu_to_camera * gyro_sample.gyro;
+        Rwc = Rwc * Sophus::SO3f::exp(angular_velocity * step);
+        propagated_timestamp = gyro_sample.timestamp;
+    };
+    
+    auto next_tick = steady_clock::now();
+    while (running_) {
+        // The online calibration may have refined the rotation
+        imu_to_camera = rotationFromArray(imu_to_camera_rotation_.Load().rotation);
+        
+        // New tracked pose: restart from it and replay the samples received since
+        const PoseRecord tracked = tracked_pose_.Load();
+        if (tracked.timestamp != base_timestamp) {
+            const Sophus::SE3f Twc = poseFromArrays(tracked.rotation, tracked.translation).inverse();
+            if (base_timestamp > 0.0 && tracked.timestamp > base_timestamp) {
+                velocity = (Twc.translation() - base_Twc.translation()) / static_cast<float>(tracked.timestamp - base_timestamp);
+            } else {
+                velocity.setZero();
+            }
+            base_Twc = Twc;
+            base_timestamp = tracked.timestamp;
+            
+            Rwc = Twc.so3();
+            propagated_timestamp = base_timestamp;
+            while (!history.empty() && history.front().timestamp <= base_timestamp) {
+                history.pop_front();
+            }
+            for (const auto& gyro_sample : history) {
+                integrate(gyro_sample);
+            }
+            published_timestamp = -1.0;
+        }
+        
+        // Integrate the new gyro samples
+        GyroSample gyro_sample;
+        while (gyro_samples_.TryPop(gyro_sample)) {
+            if (gyro_sample.timestamp <= base_timestamp) {
+                continue;
+            }
+            history.push_back(gyro_sample);
+            if (history.size() > kMaxGyroHistory) {
+                history.pop_front();
+            }
+            integrate(gyro_sample);
+        }
+        
+        // Publish once something changed, nothing to propagate before the first tracked pose
+        if (base_timestamp > 0.0 && propagated_timestamp != published_timestamp) {
+            const double elapsed = std::min(propagated_timestamp - base_timestamp, kMaxTranslationPropagationS);
+            const Sophus::SE3f Twc(Rwc, base_Twc.translation() + velocity * static_cast<float>(elapsed));
+            
+            PoseRecord record;
+            poseToArrays(Twc.inverse(), record.rotation, record.translation);
+            record.timestamp = propagated_timestamp;
+            record.tracked_timestamp = base_timestamp;
+            record.imu_propagated = propagated_timestamp > base_timestamp;
+            published_pose_.Store(record);
+            published_timestamp = propagated_timestamp;
+            
+            if (pose_export_) {
+                exportPose(record, Twc, velocity, angular_velocity);
+            }
+        }
+        
+        // Fixed rate, without bursts to catch up after a stall
+        next_tick += period;
+        const auto now = steady_clock::now();
+        if (next_tick < now) {
+            next_tick = now;
+        }
+        std::this_thread::sleep_until(next_tick);
+    }
+}
+
+void VRSLAMSystem::exportPose(const PoseRecord& record, const Sophus::SE3f& Twc,
+                              const Eigen::Vector3f& linear_velocity, const Eigen::Vector3f& angular_velocity)
+{
+    SharedPoseSample sample = {};
+    sample.publish_time = LatencyNowSeconds();
+    sample.timestamp = record.timestamp;
+    sample.tracked_timestamp = record.tracked_timestamp;
+    std::copy(record.rotation, record.rotation + 4, sample.rotation);
+    std::copy(record.translation, record.translation + 3, sample.translation);
+    
+    // Same constant-rate model the publisher propagates with, so the prediction
+    // needs no access to the (single-threaded) motion model
+    const float horizon_s = static_cast<float>(prediction_horizon_ms_.load() / 1000.0);
+    const Sophus::SE3f predicted_Twc(Twc.so3() * Sophus::SO3f::exp(angular_velocity * horizon_s),
+                                     Twc.translation() + linear_velocity * horizon_s);
+    poseToArrays(predicted_Twc.inverse(), sample.predicted_rotation, sample.predicted_translation);
+    sample.prediction_horizon_ms = horizon_s * 1000.0f;
+    
+    for (int i = 0; i < 3; ++i) {
+        sample.linear_velocity[i] = linear_velocity[i];
+        sample.angular_velocity[i] = angular_velocity[i];
+    }
+    sample.tracking_state = static_cast<int32_t>(status_.load());
+    sample.flags = record.imu_propagated ? kSharedPoseImuPropagated : 0;
+    
+    const LatencyStamps latency = tracked_latency_.Load();
+    std::copy(latency.stamps.begin(), latency.stamps.end(), sample.stage_stamps);
+    
+    pose_export_->Publish(sample);
+}
+
+void VRSLAMSystem::applyGovernorDecision()
+{
+    const PerformanceGovernor::Decision& decision = governor_->GetLastDecision();
+    switch (decision.knob) {
+        case PerformanceGovernor::Knob::FEATURE_TARGET:
+            tpu_integration_->SetFeatureTarget(decision.new_value);
+            break;
+        case PerformanceGovernor::Knob::LOCAL_MAP_KEYFRAMES:
+            tracking_->SetMaxLocalKeyFrames(decision.new_value);
+            break;
+        case PerformanceGovernor::Knob::LOCAL_BA_KEYFRAMES:
+            tracking_->SetLocalBAWindow(decision.new_value);
+            break;
+        case PerformanceGovernor::Knob::FRAME_DECIMATION:
+            frame_decimation_ = decision.new_value;
+            break;
+        default:
+            break;
+    }
+    
+    if (config_.verbose) {
+        std::cout << "Governor: " << PerformanceGovernor::GetKnobName(decision.knob) << " "
+                  << decision.old_value << " -> " << decision.new_value
+                  << " (p99 " << decision.p99_ms << " ms)" << std::endl;
+    }
+}
+
+void VRSLAMSystem::updateVsyncLock(const LatencyStamps& latency)
+{
+    VsyncTiming vsync;
+    if (!vsync_source_->Read(vsync) || !latency.Has(LatencyStage::EXPOSURE_MID) ||
+        !latency.Has(LatencyStage::POSE_PUBLISHED)) {
+        return;
+    }
+    
+    const VsyncPhaseLock::Correction correction = vsync_lock_->Update(
+        vsync, latency.Get(LatencyStage::EXPOSURE_MID), latency.Get(LatencyStage::POSE_PUBLISHED));
+    if (correction.valid &&
+        !frame_provider_->AdjustFrameTiming(config_.vsync_lock.trigger_camera_id, correction.period_ns, correction.phase_ns)) {
+        // Not FSIN triggered, the cameras free-run
+        std::cerr << "Vsync phase lock disabled: " << frame_provider_->GetLastErrorMessage() << std::endl;
+        vsync_lock_.reset();
+        vsync_source_.reset();
+        return;
+    }
+    
+    const VsyncPhaseLock::State state = vsync_lock_->GetState();
+    std::lock_guard<std::mutex> lock(metrics_mutex_);
+    metrics_.vsync_locked = state.locked;
+    metrics_.pose_age_at_scanout_ms = state.pose_age_ms;
+    metrics_.pose_age_jitter_ms = state.pose_age_jitter_ms;
+}
+
+void VRSLAMSystem::readCalibrationGyro(std::vector<OnlineCalibration::GyroMeasurement>& samples)
+{
+    const TimestampRingBuffer<IMU::Point>& imu_ring = imu_interface_->GetMeasurementBuffer();
+    const TimestampRingBuffer<IMU::Point>::Range imu_data = imu_ring.GetSince(calibration_gyro_sequence_);
+    
+    const size_t first = samples.size();
+    for (const IMU::Point& imu_point : imu_data) {
+        samples.push_back({imu_point.t, imu_point.w});
+    }
+    
+    // Lapped while copying, the window continues after a gap
+    if (!imu_ring.IsValid(imu_data)) {
+        samples.resize(first);
+    }
+    calibration_gyro_sequence_ = imu_data.GetEndSequence();
+}
+
+void VRSLAMSystem::applyCalibration(const OnlineCalibration::Calibration& calibration)
+{
+    imu_interface_->SetImuToCameraCalibration(calibration.T_bc, calibration.time_offset);
+    
+    RotationRecord imu_to_camera;
+    rotationToArray(calibration.T_bc.so3().inverse(), imu_to_camera.rotation);
+    imu_to_camera_rotation_.Store(imu_to_camera);
+    
+    if (config_.verbose) {
+        const OnlineCalibration::State state = online_calibration_->GetState();
+        std::cout << "Online calibration: time offset " << state.time_offset_ms << " ms (sigma "
+                  << state.time_offset_sigma_ms << " ms), rotation changed by " << state.rotation_change_deg
+                  << " deg" << std::endl;
+    }
+}
+
+void VRSLAMSystem::seedPosePrediction(double timestamp)
+{
+    if (!config_.seed_tracking_with_prediction) {
+        return;
+    }
+    
+    // The motion model is fed the tracked Tcw, so its prediction is the Tcw of this frame set
+    Sophus::SE3f predicted_pose;
+    Eigen::Matrix<float, 6, 6> covariance;
+    if (motion_model_->PredictPoseKalmanAt(timestamp, predicted_pose, covariance)) {
+        tracking_->SetPosePrediction(predicted_pose, covariance, timestamp);
+    }
+}
+
+void VRSLAMSystem::storeTrackedPose(const Sophus::SE3f& pose, double timestamp)
+{
+    PoseRecord record;
+    poseToArrays(pose, record.rotation, record.translation);
+    record.timestamp = timestamp;
+    record.tracked_timestamp = timestamp;
+    record.imu_propagated = false;
+    tracked_pose_.Store(record);
+}
+
 bool VRSLAMSystem::processFrameInternal(const std::vector<cv::Mat>& images, double timestamp)
 {
     if (status_ == Status::UNINITIALIZED || status_ == Status::SHUTDOWN) {
@@ -498,6 +1683,8 @@ bool VRSLAMSystem::processFrameInternal(const std::vector<cv::Mat>& images, doub
     std::vector<cv::Mat> all_descriptors(images.size());
     
     auto feature_start = std::chrono::steady_clock::now();
+    LatencyStamps latency;
+    latency.Stamp(LatencyStage::TPU_SUBMIT);
     
     for (size_t i = 0; i < images.size(); ++i) {
         if (!feature_extractor_->Extract(images[i], all_keypoints[i], all_descriptors[i])) {
@@ -506,21 +1693,29 @@ bool VRSLAMSystem::processFrameInternal(const std::vector<cv::Mat>& images, doub
         }
     }
     
+    latency.Stamp(LatencyStage::TPU_DONE);
     auto feature_end = std::chrono::steady_clock::now();
     
     // Track with multi-camera system
     auto tracking_start = std::chrono::steady_clock::now();
-    Sophus::SE3f pose = tracking_->GrabMultiCameraImages(images, timestamp, all_keypoints, all_descriptors);
+    {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
+        tracking_->SetMotionHint(motion_model_->EstimateLinearVelocity(), motion_model_->EstimateAngularVelocity());
+        seedPosePrediction(timestamp);
+    }
+    Sophus::SE3f pose = tracking_->GrabMultiCameraImages(images, timestamp, latency);
     auto tracking_end = std::chrono::steady_clock::now();
     
     // Update current pose
-    {
-        std::lock_guard<std::mutex> lock(pose_mutex_);
-        current_pose_ = pose;
-    }
+    storeTrackedPose(pose, timestamp);
     
     // Update motion model
-    motion_model_->AddPose(pose, timestamp);
+    {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
+        motion_model_->AddPose(pose, timestamp, &latency);
+    }
+    latency_tracker_.Record(latency);
+    tracked_latency_.Store(latency);
     
     // Update status based on tracking result
     if (tracking_->GetTrackingState() == TrackingState::OK) {
@@ -554,8 +1749,17 @@ bool VRSLAMSystem::processIMUInternal(const Eigen::Vector3f& gyro, const Eigen::
         return false;
     }
     
+    // Hand the rotation rate to the pose publisher, dropped if it fell behind
+    GyroSample sample;
+    sample.gyro = gyro;
+    sample.timestamp = timestamp;
+    gyro_samples_.TryPush(sample);
+    
     // Update motion model with IMU data
-    motion_model_->AddIMU(gyro, accel, timestamp);
+    {
+        std::lock_guard<std::mutex> lock(motion_mutex_);
+        motion_model_->AddIMU(gyro, accel, timestamp);
+    }
     
     // Update tracking with IMU data
     tracking_->ProcessIMU(gyro, accel, timestamp);
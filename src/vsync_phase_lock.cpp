@@ -0,0 +1,298 @@
+#include "include/vsync_phase_lock.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ORB_SLAM3
+{
+
+namespace {
+
+// Late-latch page of the display driver (drivers/display/rk3588_vr_display.h)
+constexpr int kMaxDisplays = 2;
+struct LateLatchPose {
+    uint32_t sequence;
+    uint32_t reserved;
+    int64_t display_time_ns;
+    int32_t rotation[4];
+};
+struct LateLatchStatus {
+    uint32_t sequence;
+    uint32_t latch_count;
+    int64_t display_time_ns;
+    int64_t latch_time_ns;
+    int64_t scanout_time_ns;
+};
+struct LateLatchPage {
+    LateLatchPose latest;
+    LateLatchPose render[kMaxDisplays];
+    LateLatchStatus status[kMaxDisplays];
+};
+
+// The driver updates a status field by field, a read is retried until two agree
+constexpr int kReadAttempts = 4;
+// Smoothing of the latch period and lead
+constexpr double kTimingAlpha = 0.1;
+// A latch period this far off the estimate is a missed or late latch, unless it persists
+constexpr double kPeriodOutlier = 0.1;
+constexpr int kPeriodOutlierLimit = 8;
+// Smoothing of the latency and pose age statistics
+constexpr double kStatsAlpha = 0.05;
+
+LateLatchStatus readStatus(const volatile LateLatchStatus& status)
+{
+    LateLatchStatus copy;
+    copy.sequence = status.sequence;
+    copy.latch_count = status.latch_count;
+    copy.display_time_ns = status.display_time_ns;
+    copy.latch_time_ns = status.latch_time_ns;
+    copy.scanout_time_ns = status.scanout_time_ns;
+    return copy;
+}
+
+// x modulo m in [0, m)
+double positiveModulo(double x, double m)
+{
+    const double r = std::fmod(x, m);
+    return r < 0.0 ? r + m : r;
+}
+
+void addSample(double value, int samples, double& mean, double& var)
+{
+    if (samples == 0) {
+        mean = value;
+        var = 0.0;
+        return;
+    }
+    const double delta = value - mean;
+    mean += kStatsAlpha * delta;
+    var = (1.0 - kStatsAlpha) * (var + kStatsAlpha * delta * delta);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// DisplayVsyncSource
+//------------------------------------------------------------------------------
+
+DisplayVsyncSource::DisplayVsyncSource(const std::string& device, int display_index)
+    : mDevice(device), mDisplayIndex(display_index), mFd(-1), mPage(nullptr), mPageSize(0),
+      mHaveLast(false), mLastCount(0), mLastScanout(0), mPeriod(0.0), mLead(0.0), mPeriodOutliers(0)
+{
+}
+
+DisplayVsyncSource::~DisplayVsyncSource()
+{
+    Close();
+}
+
+bool DisplayVsyncSource::Open()
+{
+    if (mPage) {
+        return true;
+    }
+
+    if (mDisplayIndex < 0 || mDisplayIndex >= kMaxDisplays) {
+        std::cerr << "Invalid display index " << mDisplayIndex << std::endl;
+        return false;
+    }
+
+    mFd = open(mDevice.c_str(), O_RDONLY | O_CLOEXEC);
+    if (mFd < 0) {
+        std::cerr << "Failed to open " << mDevice << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // The driver maps the page at offset 0 once the late latch is enabled
+    mPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void* page = mmap(nullptr, mPageSize, PROT_READ, MAP_SHARED, mFd, 0);
+    if (page == MAP_FAILED) {
+        std::cerr << "Failed to map the late-latch page of " << mDevice << ": " << strerror(errno) << std::endl;
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+
+    mPage = page;
+    mHaveLast = false;
+    mPeriod = 0.0;
+    mLead = 0.0;
+    mPeriodOutliers = 0;
+    return true;
+}
+
+void DisplayVsyncSource::Close()
+{
+    if (mPage) {
+        munmap(mPage, mPageSize);
+        mPage = nullptr;
+    }
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+bool DisplayVsyncSource::IsOpen() const
+{
+    return mPage != nullptr;
+}
+
+bool DisplayVsyncSource::Read(VsyncTiming& timing)
+{
+    if (!mPage) {
+        return false;
+    }
+
+    const volatile LateLatchStatus& status =
+        static_cast<const volatile LateLatchPage*>(mPage)->status[mDisplayIndex];
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+        const LateLatchStatus first = readStatus(status);
+        const LateLatchStatus second = readStatus(status);
+        if (memcmp(&first, &second, sizeof(first)) == 0) {
+            if (first.latch_count != 0) {
+                Update(first.latch_time_ns, first.scanout_time_ns, first.latch_count, timing);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void DisplayVsyncSource::Update(int64_t latch_ns, int64_t scanout_ns, uint32_t latch_count, VsyncTiming& timing)
+{
+    if (!mHaveLast || latch_count != mLastCount) {
+        const double lead = std::max<double>(0.0, static_cast<double>(scanout_ns - latch_ns));
+        mLead = mHaveLast ? mLead + kTimingAlpha * (lead - mLead) : lead;
+
+        if (mHaveLast) {
+            const double period = static_cast<double>(scanout_ns - mLastScanout) / (latch_count - mLastCount);
+            if (period > 0.0) {
+                if (mPeriod <= 0.0 || std::abs(period - mPeriod) <= kPeriodOutlier * mPeriod) {
+                    mPeriod = mPeriod > 0.0 ? mPeriod + kTimingAlpha * (period - mPeriod) : period;
+                    mPeriodOutliers = 0;
+                } else if (++mPeriodOutliers >= kPeriodOutlierLimit) {
+                    // The refresh rate changed
+                    mPeriod = period;
+                    mPeriodOutliers = 0;
+                }
+            }
+        }
+
+        mHaveLast = true;
+        mLastCount = latch_count;
+        mLastScanout = scanout_ns;
+    }
+
+    timing.valid = mPeriod > 0.0;
+    timing.period_ns = std::llround(mPeriod);
+    timing.lead_ns = std::llround(mLead);
+    timing.latch_ns = mLastScanout - timing.lead_ns;
+}
+
+//------------------------------------------------------------------------------
+// VsyncPhaseLock
+//------------------------------------------------------------------------------
+
+VsyncPhaseLock::VsyncPhaseLock(const Config& config)
+    : mConfig(config)
+{
+    Reset();
+}
+
+void VsyncPhaseLock::Reset()
+{
+    mState = State();
+    mState.trigger_period_ns = mConfig.camera_period_ns;
+    mSamples = 0;
+    mLatencyMean = 0.0;
+    mLatencyVar = 0.0;
+    mAgeMean = 0.0;
+    mAgeVar = 0.0;
+    mPeriodTrim = 0.0;
+    mFramesSinceStep = 0;
+}
+
+VsyncPhaseLock::State VsyncPhaseLock::GetState() const
+{
+    return mState;
+}
+
+VsyncPhaseLock::Correction VsyncPhaseLock::Update(const VsyncTiming& vsync, double exposure_mid_s, double pose_ready_s)
+{
+    Correction correction;
+    if (!vsync.valid || vsync.period_ns <= 0 || mConfig.camera_period_ns <= 0 ||
+        exposure_mid_s <= 0.0 || pose_ready_s <= exposure_mid_s) {
+        return correction;
+    }
+
+    const double exposure_ns = exposure_mid_s * 1e9;
+    const double ready_ns = pose_ready_s * 1e9;
+    const double latch_period = static_cast<double>(vsync.period_ns);
+    const double camera_period = static_cast<double>(mConfig.camera_period_ns);
+
+    // The trigger runs at an integer ratio of the latch period, the phase is
+    // locked modulo the shorter of the two
+    double target_period, lock_period;
+    if (camera_period >= latch_period) {
+        target_period = std::max(1.0, std::round(camera_period / latch_period)) * latch_period;
+        lock_period = latch_period;
+    } else {
+        target_period = latch_period / std::round(latch_period / camera_period);
+        lock_period = target_period;
+    }
+    mState.reachable = std::abs(target_period - camera_period) <= mConfig.max_period_trim * camera_period;
+    if (!mState.reachable) {
+        mState.locked = false;
+        return correction;
+    }
+
+    // Exposure to pose, and exposure to the scanout of the first latch after the pose
+    addSample(ready_ns - exposure_ns, mSamples, mLatencyMean, mLatencyVar);
+    const double since_latch = positiveModulo(ready_ns - static_cast<double>(vsync.latch_ns), lock_period);
+    const double shown_ns = ready_ns + (since_latch > 0.0 ? lock_period - since_latch : 0.0) + vsync.lead_ns;
+    addSample(shown_ns - exposure_ns, mSamples, mAgeMean, mAgeVar);
+    ++mSamples;
+
+    mState.pipeline_latency_ms = mLatencyMean / 1e6;
+    mState.pose_age_ms = mAgeMean / 1e6;
+    mState.pose_age_jitter_ms = std::sqrt(mAgeVar) / 1e6;
+
+    // Phase error of the ready time targeted against the nearest latch,
+    // positive when the pose would come after it
+    const double ready_target = exposure_ns + mLatencyMean + mConfig.latency_sigmas * std::sqrt(mLatencyVar) +
+                                mConfig.latch_margin_ms * 1e6;
+    double error = positiveModulo(ready_target - static_cast<double>(vsync.latch_ns), lock_period);
+    if (error >= 0.5 * lock_period) {
+        error -= lock_period;
+    }
+    mState.phase_error_ms = error / 1e6;
+    mState.locked = std::abs(error) < mConfig.lock_threshold_us * 1e3;
+
+    // Steps are spaced so the frames they are judged by were triggered after the last one
+    const int interval = std::max(1, mConfig.step_interval_frames);
+    if (++mFramesSinceStep < interval || mSamples < 2 * interval) {
+        return correction;
+    }
+    mFramesSinceStep = 0;
+
+    // A persistent error is a rate mismatch, frames arriving late need a shorter period
+    const double max_trim = mConfig.max_period_trim * camera_period;
+    mPeriodTrim -= mConfig.frequency_gain * error / interval;
+    const double period = std::min(std::max(target_period + mPeriodTrim, camera_period - max_trim),
+                                   camera_period + max_trim);
+    mPeriodTrim = period - target_period;
+
+    correction.valid = true;
+    correction.period_ns = std::llround(period);
+    correction.phase_ns = std::abs(error) > mConfig.deadband_us * 1e3 ? std::llround(-mConfig.phase_gain * error) : 0;
+    mState.trigger_period_ns = correction.period_ns;
+    return correction;
+}
+
+} // namespace ORB_SLAM3
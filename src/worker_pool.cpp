@@ -0,0 +1,173 @@
+#include "include/worker_pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+
+namespace ORB_SLAM3
+{
+
+//------------------------------------------------------------------------------
+// Latch
+//------------------------------------------------------------------------------
+
+Latch::Latch(int count)
+    : mCount(count)
+{
+}
+
+void Latch::CountDown()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCount > 0 && --mCount == 0) {
+        mCondition.notify_all();
+    }
+}
+
+void Latch::Wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this]() { return mCount <= 0; });
+}
+
+bool Latch::TryWait() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCount <= 0;
+}
+
+//------------------------------------------------------------------------------
+// WorkerPool
+//------------------------------------------------------------------------------
+
+WorkerPool::WorkerPool(int num_workers, const std::vector<int>& cpu_cores)
+    : mStopping(false)
+{
+    const int count = std::max(1, num_workers);
+    mWorkers.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const int cpu_core = cpu_cores.empty() ? -1 : cpu_cores[i % cpu_cores.size()];
+        mWorkers.emplace_back(&WorkerPool::WorkerThreadFunc, this, cpu_core);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+
+    for (auto& worker : mWorkers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void WorkerPool::Submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+    }
+    mCondition.notify_one();
+}
+
+void WorkerPool::Submit(std::function<void()> job, Latch& latch)
+{
+    Latch* done = &latch;
+    Submit([job, done]() {
+        job();
+        done->CountDown();
+    });
+}
+
+void WorkerPool::ParallelFor(int count, const std::function<void(int)>& job)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    // Shared with the helper jobs, which may start after this call returned
+    struct Range {
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        int count = 0;
+        const std::function<void(int)>* job = nullptr;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+    auto range = std::make_shared<Range>();
+    range->count = count;
+    range->job = &job;
+
+    // A helper touches the job only while items are left, so never after the caller returns
+    auto run_items = [](Range& r) {
+        int index;
+        while ((index = r.next.fetch_add(1)) < r.count) {
+            (*r.job)(index);
+            if (r.done.fetch_add(1) + 1 == r.count) {
+                std::lock_guard<std::mutex> lock(r.mutex);
+                r.condition.notify_all();
+            }
+        }
+    };
+
+    const int helpers = std::min(count - 1, static_cast<int>(mWorkers.size()));
+    for (int i = 0; i < helpers; ++i) {
+        Submit([range, run_items]() { run_items(*range); });
+    }
+
+    run_items(*range);
+
+    std::unique_lock<std::mutex> lock(range->mutex);
+    range->condition.wait(lock, [&range]() { return range->done.load() == range->count; });
+}
+
+size_t WorkerPool::GetWorkerCount() const
+{
+    return mWorkers.size();
+}
+
+void WorkerPool::WorkerThreadFunc(int cpu_core)
+{
+    // Set thread name for debugging
+    #ifdef __linux__
+        pthread_setname_np(pthread_self(), "WorkerPool");
+    #endif
+
+    if (cpu_core >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu_core, &cpuset);
+
+        int r = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (r != 0) {
+            std::cerr << "Failed to pin worker to core " << cpu_core << ": " << strerror(r) << std::endl;
+        }
+    }
+
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+
+            // Drain the queue before stopping so latches are always released
+            if (mJobs.empty()) {
+                break;
+            }
+
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+} // namespace ORB_SLAM3
@@ -1,12 +1,20 @@
 #include "include/zero_copy_frame_provider.hpp"
+#include "include/thread_placement.hpp"
+#include "ORB_SLAM3/include/MemoryAccounting.h"
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <poll.h>
 #include <linux/videodev2.h>
 #include <linux/dma-buf.h>
 #include <opencv2/imgproc.hpp>
@@ -14,22 +22,161 @@
 namespace ORB_SLAM3
 {
 
+namespace {
+// Reactor wakeup interval used to notice StopAcquisition()
+constexpr int kReactorTimeoutMs = 100;
+// Buffers needed to keep the driver capturing while the consumer holds a
+// frame and stale frames are being recycled
+constexpr int kMinBuffersForDropPolicy = 4;
+// Tag in the epoll event data marking a camera's scaled stream
+constexpr uint32_t kScaledStreamTag = 0x80000000u;
+constexpr uint32_t kSyncEventTag = 0x40000000u;
+// Frames waiting for their scaled counterpart before they are published
+// without one, and scaled buffers waiting for their primary frame
+constexpr size_t kMaxPendingFrames = 1;
+constexpr size_t kMaxPendingScaledBuffers = 2;
+// Back-off of a free-running replay waiting for queue space
+constexpr int kReplayBackoffUs = 200;
+// Exposure event of the OV9281 driver (drivers/ov9281/ov9281_core.h)
+constexpr uint32_t kOV9281EventExposure = V4L2_EVENT_PRIVATE_START + 1;
+struct OV9281ExposureEvent {
+    uint32_t sequence;
+    uint32_t exposure_us;
+    uint64_t start_ns;
+    uint32_t exposure;
+    uint32_t gain;
+    uint16_t width;
+    uint16_t height;
+};
+// Per-frame settings queue of the OV9281 driver
+struct OV9281FrameSettings {
+    uint32_t sequence;
+    uint32_t flags;
+    uint32_t exposure;
+    uint32_t gain;
+};
+constexpr uint32_t kOV9281SettingsExposure = 1u << 0;
+constexpr uint32_t kOV9281SettingsGain = 1u << 1;
+constexpr unsigned long kOV9281IocQueueSettings = _IOW('V', BASE_VIDIOC_PRIVATE + 0, OV9281FrameSettings);
+// FSIN retiming of the OV9281 driver
+struct OV9281FsinAdjust {
+    int64_t period_ns;
+    int64_t phase_ns;
+};
+constexpr unsigned long kOV9281IocAdjustFsin = _IOW('V', BASE_VIDIOC_PRIVATE + 1, OV9281FsinAdjust);
+// Readout mode switch of the OV9281 driver, the full array or 2x2 binned or skipped
+struct OV9281ReadoutMode {
+    uint32_t readout;
+    uint32_t fps;
+    uint32_t width;
+    uint32_t height;
+    uint32_t sequence;
+};
+constexpr uint32_t kOV9281ReadoutFull = 0;
+constexpr uint32_t kOV9281ReadoutBinning = 1;
+constexpr uint32_t kOV9281ReadoutSkipping = 2;
+constexpr unsigned long kOV9281IocSetReadout = _IOWR('V', BASE_VIDIOC_PRIVATE + 2, OV9281ReadoutMode);
+constexpr int kOV9281FullWidth = 1280;
+constexpr int kOV9281FullHeight = 800;
+constexpr int kOV9281SubsampledWidth = 640;
+constexpr int kOV9281SubsampledHeight = 400;
+// OV9281 register ranges; the analog gain counts in 1/16, 0x10 is unity
+constexpr uint32_t kOV9281ExposureMax = 65535;
+constexpr uint32_t kOV9281GainUnity = 16;
+constexpr uint32_t kOV9281GainMax = 4095;
+// Auto-exposure: sampling grid step in pixels, relative error left alone,
+// largest correction of one step, and frames to wait for a request to land
+constexpr int kAutoExposureStep = 16;
+constexpr double kAutoExposureDeadband = 0.05;
+constexpr double kAutoExposureMaxRatio = 4.0;
+constexpr uint32_t kAutoExposureTimeoutFrames = 4;
+// Slice event and slice count control of the OV9281 driver
+constexpr uint32_t kOV9281EventSlice = V4L2_EVENT_PRIVATE_START + 2;
+struct OV9281SliceEvent {
+    uint32_t sequence;
+    uint16_t slice;
+    uint16_t num_slices;
+    uint16_t first_line;
+    uint16_t num_lines;
+    uint64_t ready_ns;
+};
+constexpr uint32_t kOV9281CidSliceCount = V4L2_CID_PRIVATE_BASE + 5;
+// Reported exposures kept for buffers still in flight
+constexpr size_t kMaxPendingExposures = 8;
+
+// Buffers of a camera; dropping policies need spare buffers so the driver
+// never runs dry while stale frames are recycled
+int CaptureBufferCount(const ZeroCopyFrameProvider::CameraConfig& config)
+{
+    if (config.drop_policy != ZeroCopyFrameProvider::FrameDropPolicy::QUEUE_ALL) {
+        return std::max(config.buffer_count, kMinBuffersForDropPolicy);
+    }
+    return config.buffer_count;
+}
+
+// Current time on the clock V4L2 uses for buffer timestamps
+double MonotonicNowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// Prepare a v4l2_buffer for MMAP I/O; multi-planar buffers need a plane array
+void InitV4L2Buffer(struct v4l2_buffer& buf, struct v4l2_plane* planes, uint32_t type, unsigned int index)
+{
+    memset(&buf, 0, sizeof(buf));
+    buf.type = type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    
+    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        memset(planes, 0, sizeof(struct v4l2_plane) * VIDEO_MAX_PLANES);
+        buf.m.planes = planes;
+        buf.length = VIDEO_MAX_PLANES;
+    }
+}
+}
+
 //------------------------------------------------------------------------------
 // Constructor & Destructor
 //------------------------------------------------------------------------------
 
 ZeroCopyFrameProvider::ZeroCopyFrameProvider(const std::vector<CameraConfig>& configs)
     : mCameraConfigs(configs),
-      mRunning(false)
+      mAcquisitionMode(AcquisitionMode::REACTOR),
+      mEpollFd(-1),
+      mRunning(false),
+      mNextFrameSetId(0),
+      mNextSubscriberId(0),
+      mReplayRate(1.0f),
+      mReplayTimeOffset(0.0),
+      mReplayFinished(false)
 {
     // Initialize camera handles, buffers, and statistics
     const size_t num_cameras = configs.size();
     mCameraHandles.resize(num_cameras, -1);
     mBuffers.resize(num_cameras);
+    mScaledStreams.resize(num_cameras);
     mFrameQueues.resize(num_cameras);
+    mFrameEventFds.resize(num_cameras, -1);
+    mQueueCounters.resize(num_cameras);
+    for (size_t i = 0; i < num_cameras; ++i) {
+        mQueueCounters[i].reset(new QueueCounters());
+    }
     mCurrentFrameRates.resize(num_cameras, 0.0f);
     mFrameCounters.resize(num_cameras, 0);
     mLastFrameTimes.resize(num_cameras);
+    mAcquisitionStates.resize(num_cameras);
+    mQueuedBuffers.resize(num_cameras);
+    for (size_t i = 0; i < num_cameras; ++i) {
+        mQueuedBuffers[i].reset(new QueuedBuffers());
+    }
+    mImageSizes.resize(num_cameras, 0);
+    mStreamControls.resize(num_cameras);
+    for (size_t i = 0; i < num_cameras; ++i) {
+        mStreamControls[i].reset(new StreamControl());
+    }
     
     // Set default error message
     mLastErrorMessage = "No error";
@@ -48,6 +195,17 @@ ZeroCopyFrameProvider::~ZeroCopyFrameProvider()
             CloseCamera(i);
         }
     }
+    
+    // Close frame event fds
+    for (int& fd : mFrameEventFds) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    
+    // The cameras dropped their references to the pool buffers
+    mBufferPool.reset();
 }
 
 //------------------------------------------------------------------------------
@@ -63,6 +221,11 @@ bool ZeroCopyFrameProvider::Initialize()
         return false;
     }
     
+    // Serve frames from a capture file instead of the cameras
+    if (!mReplayPath.empty()) {
+        return InitializeReplay();
+    }
+    
     // Initialize each camera
     bool all_success = true;
     for (size_t i = 0; i < mCameraConfigs.size(); ++i) {
@@ -76,12 +239,26 @@ bool ZeroCopyFrameProvider::Initialize()
             all_success = false;
             break;
         }
-        
+    }
+    
+    // The pool is sized by the formats of all cameras capturing into it
+    if (all_success && !AllocateBufferPool()) {
+        all_success = false;
+    }
+    
+    for (size_t i = 0; all_success && i < mCameraConfigs.size(); ++i) {
         if (!AllocateBuffers(i)) {
             CloseCamera(i);
             all_success = false;
             break;
         }
+        
+        if (!OpenScaledStream(i)) {
+            FreeBuffers(i);
+            CloseCamera(i);
+            all_success = false;
+            break;
+        }
     }
     
     // If any camera failed to initialize, close all cameras
@@ -92,6 +269,7 @@ bool ZeroCopyFrameProvider::Initialize()
                 CloseCamera(i);
             }
         }
+        mBufferPool.reset();
         return false;
     }
     
@@ -113,9 +291,10 @@ bool ZeroCopyFrameProvider::StartAcquisition()
         return false;
     }
     
-    // Start streaming on all cameras
+    // Start streaming on all cameras (replayed cameras have nothing to stream)
+    const bool replaying = mReplayReader.IsOpen();
     bool all_success = true;
-    for (size_t i = 0; i < mCameraHandles.size(); ++i) {
+    for (size_t i = 0; i < mCameraHandles.size() && !replaying; ++i) {
         if (mCameraHandles[i] >= 0) {
             if (!StartStreaming(i)) {
                 all_success = false;
@@ -134,11 +313,33 @@ bool ZeroCopyFrameProvider::StartAcquisition()
         return false;
     }
     
-    // Start acquisition threads
+    // Create frame rings sized to the driver buffer count
+    CreateFrameQueues();
+    
+    // Reset per-camera acquisition state
+    const auto now = std::chrono::steady_clock::now();
+    for (auto& state : mAcquisitionStates) {
+        state.frame_counter = 0;
+        state.last_sequence = 0;
+        state.last_fps_update = now;
+    }
+    
+    // Start acquisition threads: one epoll reactor over all cameras, or one
+    // thread per camera as fallback
     mRunning = true;
-    for (size_t i = 0; i < mCameraHandles.size(); ++i) {
-        if (mCameraHandles[i] >= 0) {
-            mAcquisitionThreads.emplace_back(&ZeroCopyFrameProvider::AcquisitionThreadFunc, this, i);
+    if (replaying) {
+        // Shift the recorded timeline so the first frame is captured now
+        CaptureFrame first;
+        mReplayTimeOffset = mReplayReader.GetFrame(0, first) ? MonotonicNowSeconds() - first.timestamp : 0.0;
+        mReplayFinished = false;
+        mAcquisitionThreads.emplace_back(&ZeroCopyFrameProvider::ReplayThreadFunc, this);
+    } else if (mAcquisitionMode == AcquisitionMode::REACTOR && CreateReactor()) {
+        mAcquisitionThreads.emplace_back(&ZeroCopyFrameProvider::ReactorThreadFunc, this);
+    } else {
+        for (size_t i = 0; i < mCameraHandles.size(); ++i) {
+            if (mCameraHandles[i] >= 0) {
+                mAcquisitionThreads.emplace_back(&ZeroCopyFrameProvider::AcquisitionThreadFunc, this, i);
+            }
         }
     }
     
@@ -152,9 +353,18 @@ void ZeroCopyFrameProvider::StopAcquisition()
         return;
     }
     
-    // Stop acquisition threads
+    // Stop acquisition threads and wake up any waiting consumer
     mRunning = false;
-    mFrameCondition.notify_all();
+    for (size_t i = 0; i < mFrameEventFds.size(); ++i) {
+        SignalFrameEvent(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mSubscribersMutex);
+        for (const auto& subscriber : mSubscribers) {
+            std::lock_guard<std::mutex> subscriber_lock(subscriber->mutex);
+            subscriber->frame_available.notify_all();
+        }
+    }
     
     // Join acquisition threads
     for (auto& thread : mAcquisitionThreads) {
@@ -163,21 +373,17 @@ void ZeroCopyFrameProvider::StopAcquisition()
         }
     }
     mAcquisitionThreads.clear();
+    DestroyReactor();
     
     // Stop streaming on all cameras
     for (size_t i = 0; i < mCameraHandles.size(); ++i) {
-        if (mCameraHandles[i] >= 0) {
+        if (mCameraHandles[i] >= 0 && !mReplayReader.IsOpen()) {
             StopStreaming(i);
         }
     }
     
     // Clear frame queues
-    std::lock_guard<std::mutex> lock(mFrameQueueMutex);
-    for (auto& queue : mFrameQueues) {
-        while (!queue.empty()) {
-            queue.pop();
-        }
-    }
+    ClearFrameQueues();
 }
 
 bool ZeroCopyFrameProvider::GetNextFrame(int camera_id, FrameMetadata& metadata, int timeout_ms)
@@ -201,42 +407,37 @@ bool ZeroCopyFrameProvider::GetNextFrame(int camera_id, FrameMetadata& metadata,
     }
     
     // Wait for a frame
-    std::unique_lock<std::mutex> lock(mFrameQueueMutex);
-    
-    if (timeout_ms < 0) {
-        // Wait indefinitely
-        mFrameCondition.wait(lock, [this, camera_id]() {
-            return !mRunning || !mFrameQueues[camera_id].empty();
-        });
-    } else if (timeout_ms > 0) {
-        // Wait with timeout
-        auto result = mFrameCondition.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, camera_id]() {
-            return !mRunning || !mFrameQueues[camera_id].empty();
-        });
-        
-        if (!result) {
-            // Timeout
-            SetErrorMessage("Timeout waiting for frame");
+    FrameRing& queue = *mFrameQueues[camera_id];
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    const std::vector<int> wait_ids = {camera_id};
+    
+    ApplyDropPolicy(camera_id);
+    while (!queue.TryPop(metadata)) {
+        if (!mRunning) {
+            SetErrorMessage("Acquisition stopped while waiting for frame");
             return false;
         }
+        
+        if (timeout_ms == 0) {
+            SetErrorMessage("No frame available");
+            return false;
+        }
+        
+        int wait_ms = -1;
+        if (timeout_ms > 0) {
+            wait_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count());
+            if (wait_ms <= 0) {
+                SetErrorMessage("Timeout waiting for frame");
+                return false;
+            }
+        }
+        
+        WaitForFrameEvent(wait_ids, wait_ms);
+        ApplyDropPolicy(camera_id);
     }
     
-    // Check if running
-    if (!mRunning) {
-        SetErrorMessage("Acquisition stopped while waiting for frame");
-        return false;
-    }
-    
-    // Check if queue is empty (for non-blocking mode)
-    if (mFrameQueues[camera_id].empty()) {
-        SetErrorMessage("No frame available");
-        return false;
-    }
-    
-    // Get frame from queue
-    metadata = mFrameQueues[camera_id].front();
-    mFrameQueues[camera_id].pop();
-    
+    RecordFrameConsumed(metadata);
     return true;
 }
 
@@ -244,99 +445,125 @@ bool ZeroCopyFrameProvider::GetNextSynchronizedFrames(std::vector<FrameMetadata>
                                                      float max_time_diff_ms,
                                                      int timeout_ms)
 {
-    // Check if running
-    if (!mRunning) {
-        SetErrorMessage("Acquisition not running");
+    FrameSet frame_set;
+    if (!GetSynchronizedFrames(frame_set, max_time_diff_ms, timeout_ms)) {
         return false;
     }
     
-    // Wait for frames from all cameras
-    std::unique_lock<std::mutex> lock(mFrameQueueMutex);
-    
-    auto wait_predicate = [this]() {
-        return !mRunning || std::all_of(mFrameQueues.begin(), mFrameQueues.end(),
-                                       [](const std::queue<FrameMetadata>& queue) {
-                                           return !queue.empty();
-                                       });
-    };
-    
-    if (timeout_ms < 0) {
-        // Wait indefinitely
-        mFrameCondition.wait(lock, wait_predicate);
-    } else if (timeout_ms > 0) {
-        // Wait with timeout
-        auto result = mFrameCondition.wait_for(lock, std::chrono::milliseconds(timeout_ms), wait_predicate);
-        
-        if (!result) {
-            // Timeout
-            SetErrorMessage("Timeout waiting for synchronized frames");
-            return false;
-        }
-    }
-    
+    metadata_vec = std::move(frame_set.frames);
+    return true;
+}
+
+bool ZeroCopyFrameProvider::GetSynchronizedFrames(FrameSet& frame_set,
+                                                 float tolerance_ms,
+                                                 int timeout_ms)
+{
     // Check if running
     if (!mRunning) {
-        SetErrorMessage("Acquisition stopped while waiting for synchronized frames");
+        SetErrorMessage("Acquisition not running");
         return false;
     }
     
-    // Check if any queue is empty (for non-blocking mode)
-    if (std::any_of(mFrameQueues.begin(), mFrameQueues.end(),
-                   [](const std::queue<FrameMetadata>& queue) {
-                       return queue.empty();
-                   })) {
-        SetErrorMessage("Not all cameras have frames available");
+    if (mFrameQueues.empty()) {
+        SetErrorMessage("No cameras configured");
         return false;
     }
     
-    // Get frames from all queues
-    metadata_vec.clear();
-    metadata_vec.reserve(mFrameQueues.size());
-    
-    for (auto& queue : mFrameQueues) {
-        metadata_vec.push_back(queue.front());
-    }
+    // One deadline for the whole set, independent of how many frames are dropped
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    const double tolerance_s = tolerance_ms / 1000.0;
+    const size_t num_cameras = mFrameQueues.size();
     
-    // Check if frames are synchronized
-    double reference_time = metadata_vec[0].timestamp;
-    bool synchronized = true;
+    std::vector<FrameMetadata*> heads(num_cameras, nullptr);
+    std::vector<int> empty_ids;
+    empty_ids.reserve(num_cameras);
     
-    for (size_t i = 1; i < metadata_vec.size(); ++i) {
-        double time_diff = std::abs(metadata_vec[i].timestamp - reference_time) * 1000.0; // Convert to ms
-        if (time_diff > max_time_diff_ms) {
-            synchronized = false;
-            break;
+    while (true) {
+        if (!mRunning) {
+            SetErrorMessage("Acquisition stopped while waiting for synchronized frames");
+            return false;
+        }
+        
+        // Peek at the oldest frame of every camera
+        empty_ids.clear();
+        for (size_t i = 0; i < num_cameras; ++i) {
+            ApplyDropPolicy(static_cast<int>(i));
+            heads[i] = mFrameQueues[i] ? mFrameQueues[i]->Front() : nullptr;
+            if (!heads[i]) {
+                empty_ids.push_back(static_cast<int>(i));
+            }
+        }
+        
+        if (!empty_ids.empty()) {
+            // Wait until every camera has at least one frame queued
+            if (timeout_ms == 0) {
+                SetErrorMessage("Not all cameras have frames available");
+                return false;
+            }
+            
+            int wait_ms = -1;
+            if (timeout_ms > 0) {
+                wait_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count());
+                if (wait_ms <= 0) {
+                    SetErrorMessage("Timeout waiting for synchronized frames");
+                    return false;
+                }
+            }
+            
+            WaitForFrameEvent(empty_ids, wait_ms);
+            continue;
         }
-    }
-    
-    if (!synchronized) {
-        // Frames are not synchronized, try to find a better set
-        // This is a simple algorithm that tries to find a set of frames that are synchronized
-        // A more sophisticated algorithm could be implemented if needed
         
-        // Pop the oldest frame
+        // Find the oldest and newest frame at the head of the queues
         size_t oldest_idx = 0;
-        double oldest_time = metadata_vec[0].timestamp;
+        double oldest_time = CaptureTime(*heads[0]);
+        double newest_time = oldest_time;
         
-        for (size_t i = 1; i < metadata_vec.size(); ++i) {
-            if (metadata_vec[i].timestamp < oldest_time) {
-                oldest_time = metadata_vec[i].timestamp;
+        for (size_t i = 1; i < num_cameras; ++i) {
+            const double t = CaptureTime(*heads[i]);
+            if (t < oldest_time) {
+                oldest_time = t;
                 oldest_idx = i;
             }
+            newest_time = std::max(newest_time, t);
         }
         
-        mFrameQueues[oldest_idx].pop();
+        if (newest_time - oldest_time <= tolerance_s) {
+            break;
+        }
         
-        // Release the lock and try again
-        lock.unlock();
-        return GetNextSynchronizedFrames(metadata_vec, max_time_diff_ms, timeout_ms);
+        // The oldest frame cannot match any later frame of the other cameras,
+        // drop it and hand its buffer back to the driver
+        FrameMetadata stale = *heads[oldest_idx];
+        mFrameQueues[oldest_idx]->Pop();
+        mQueueCounters[oldest_idx]->dropped_unsynchronized++;
+        ReleaseFrame(stale);
     }
     
-    // Pop frames from queues
-    for (auto& queue : mFrameQueues) {
-        queue.pop();
+    // Pop the matched frames
+    frame_set.frames.clear();
+    frame_set.frames.reserve(num_cameras);
+    
+    double timestamp_sum = 0.0;
+    double oldest_time = CaptureTime(*heads[0]);
+    double newest_time = oldest_time;
+    
+    for (size_t i = 0; i < num_cameras; ++i) {
+        const FrameMetadata& metadata = *heads[i];
+        const double t = CaptureTime(metadata);
+        timestamp_sum += t;
+        oldest_time = std::min(oldest_time, t);
+        newest_time = std::max(newest_time, t);
+        frame_set.frames.push_back(metadata);
+        RecordFrameConsumed(metadata);
+        mFrameQueues[i]->Pop();
     }
     
+    frame_set.set_id = mNextFrameSetId++;
+    frame_set.timestamp = timestamp_sum / frame_set.frames.size();
+    frame_set.max_skew_ms = (newest_time - oldest_time) * 1000.0;
+    
     return true;
 }
 
@@ -354,28 +581,61 @@ void ZeroCopyFrameProvider::ReleaseFrame(const FrameMetadata& metadata)
         return;
     }
     
+    // Replayed frames live in the capture file mapping, nothing to re-queue
+    if (mReplayReader.IsOpen()) {
+        return;
+    }
+    
+    // Not while a readout switch requeues the buffers
+    std::lock_guard<std::recursive_mutex> lock(mStreamControls[metadata.camera_id]->mutex);
+    
     // Find the buffer
-    for (auto& buffer : mBuffers[metadata.camera_id]) {
-        if (buffer.start == metadata.buffer_ptr) {
-            // Mark buffer as not in use
-            buffer.in_use = false;
-            
-            // Re-queue the buffer for capture
-            struct v4l2_buffer buf;
-            memset(&buf, 0, sizeof(buf));
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_MMAP;
-            buf.index = &buffer - &mBuffers[metadata.camera_id][0]; // Calculate buffer index
-            
-            if (ioctl(mCameraHandles[metadata.camera_id], VIDIOC_QBUF, &buf) < 0) {
-                SetErrorMessage("Failed to re-queue buffer: " + std::string(strerror(errno)));
+    std::vector<BufferInfo>& buffers = mBuffers[metadata.camera_id];
+    auto buffer = std::find_if(buffers.begin(), buffers.end(),
+                               [&metadata](const BufferInfo& info) { return info.start == metadata.buffer_ptr; });
+    
+    // Other consumers still read the frame
+    if (buffer != buffers.end() && buffer->refs > 1) {
+        buffer->refs--;
+        return;
+    }
+    
+    // Hand the scaled plane back to the scaler
+    if (metadata.scaled_buffer_ptr) {
+        const ScaledStream& stream = mScaledStreams[metadata.camera_id];
+        for (size_t i = 0; i < stream.buffers.size(); ++i) {
+            if (stream.buffers[i].start == metadata.scaled_buffer_ptr) {
+                QueueScaledBuffer(metadata.camera_id, static_cast<int>(i));
+                break;
             }
-            
-            return;
         }
     }
     
-    SetErrorMessage("Buffer not found");
+    if (buffer == buffers.end()) {
+        SetErrorMessage("Buffer not found");
+        return;
+    }
+    
+    // Mark buffer as not in use
+    buffer->in_use = false;
+    buffer->refs = 0;
+    
+    // Re-queue the buffer for capture
+    struct v4l2_buffer buf;
+    InitCaptureBuffer(metadata.camera_id, buf, buffer - buffers.begin());
+    
+    if (ioctl(mCameraHandles[metadata.camera_id], VIDIOC_QBUF, &buf) < 0) {
+        SetErrorMessage("Failed to re-queue buffer: " + std::string(strerror(errno)));
+    } else {
+        TrackQueuedBuffer(metadata.camera_id, buf.index);
+    }
+}
+
+void ZeroCopyFrameProvider::ReleaseFrameSet(const FrameSet& frame_set)
+{
+    for (const auto& metadata : frame_set.frames) {
+        ReleaseFrame(metadata);
+    }
 }
 
 cv::Mat ZeroCopyFrameProvider::GetMatForFrame(const FrameMetadata& metadata)
@@ -409,6 +669,89 @@ cv::Mat ZeroCopyFrameProvider::GetMatForFrame(const FrameMetadata& metadata)
     return mat;
 }
 
+cv::Mat ZeroCopyFrameProvider::GetScaledMatForFrame(const FrameMetadata& metadata)
+{
+    if (!metadata.scaled_buffer_ptr) {
+        return cv::Mat();
+    }
+    
+    // GREY and NV12 both start with the luma plane, wrap it in place
+    return cv::Mat(metadata.scaled_height, metadata.scaled_width, CV_8UC1,
+                   metadata.scaled_buffer_ptr, metadata.scaled_stride);
+}
+
+ZeroCopyFrameProvider::FrameViewPtr ZeroCopyFrameProvider::CreateFrameView(const FrameMetadata& metadata)
+{
+    FrameViewPtr view(new FrameView(this, metadata));
+    
+    if (view->mImage.empty()) {
+        // The view destructor hands the buffer back to the driver
+        return nullptr;
+    }
+    
+    return view;
+}
+
+bool ZeroCopyFrameProvider::CreateFrameViews(const FrameSet& frame_set, std::vector<FrameViewPtr>& views)
+{
+    views.clear();
+    views.reserve(frame_set.frames.size());
+    
+    bool all_success = true;
+    for (const auto& metadata : frame_set.frames) {
+        views.push_back(CreateFrameView(metadata));
+        if (!views.back()) {
+            all_success = false;
+        }
+    }
+    
+    if (!all_success) {
+        // Dropping the views releases the remaining frames
+        views.clear();
+    }
+    
+    return all_success;
+}
+
+ZeroCopyFrameProvider::FrameView::FrameView(ZeroCopyFrameProvider* provider, const FrameMetadata& metadata)
+    : mProvider(provider),
+      mMetadata(metadata),
+      mCpuAccess(false),
+      mScaledCpuAccess(false)
+{
+    // Make the device writes visible to the CPU before wrapping the buffer
+    if (!mProvider->SyncDmaBuffer(mMetadata.dma_fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ)) {
+        return;
+    }
+    mCpuAccess = true;
+    
+    // Wraps GREY buffers in place; other formats are converted by GetMatForFrame
+    mImage = mProvider->GetMatForFrame(mMetadata);
+    
+    // A scaled plane that cannot be synced is dropped, the full image still works
+    if (mMetadata.scaled_buffer_ptr &&
+        mProvider->SyncDmaBuffer(mMetadata.scaled_dma_fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ)) {
+        mScaledCpuAccess = true;
+        mScaledImage = mProvider->GetScaledMatForFrame(mMetadata);
+    }
+}
+
+ZeroCopyFrameProvider::FrameView::~FrameView()
+{
+    mImage.release();
+    mScaledImage.release();
+    
+    if (mCpuAccess) {
+        mProvider->SyncDmaBuffer(mMetadata.dma_fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+    }
+    
+    if (mScaledCpuAccess) {
+        mProvider->SyncDmaBuffer(mMetadata.scaled_dma_fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+    }
+    
+    mProvider->ReleaseFrame(mMetadata);
+}
+
 int ZeroCopyFrameProvider::GetDmaFdForFrame(const FrameMetadata& metadata)
 {
     return metadata.dma_fd;
@@ -432,12 +775,17 @@ bool ZeroCopyFrameProvider::SetCameraConfig(int camera_id, const CameraConfig& c
         return false;
     }
     
-    // Check if running
-    if (mRunning) {
-        SetErrorMessage("Cannot change configuration while acquisition is running");
+    // Replayed cameras are described by the capture file
+    if (mReplayReader.IsOpen()) {
+        SetErrorMessage("Cannot change configuration of a replayed camera");
         return false;
     }
     
+    // While running only the readout mode of the sensor can change
+    if (mRunning) {
+        return SwitchReadout(camera_id, config);
+    }
+    
     // Update configuration
     mCameraConfigs[camera_id] = config;
     
@@ -455,6 +803,12 @@ bool ZeroCopyFrameProvider::SetCameraConfig(int camera_id, const CameraConfig& c
         if (!AllocateBuffers(camera_id)) {
             return false;
         }
+        
+        // Reopen the scaled stream with the new configuration
+        CloseScaledStream(camera_id);
+        if (!OpenScaledStream(camera_id)) {
+            return false;
+        }
     }
     
     return true;
@@ -485,87 +839,430 @@ float ZeroCopyFrameProvider::GetCurrentFrameRate(int camera_id) const
     return mCurrentFrameRates[camera_id];
 }
 
-void ZeroCopyFrameProvider::RegisterFrameCallback(std::function<void(const FrameMetadata&)> callback)
-{
-    mFrameCallback = callback;
-}
-
-bool ZeroCopyFrameProvider::EnableZeroCopy(int camera_id, bool enable)
+ZeroCopyFrameProvider::FrameQueueStats ZeroCopyFrameProvider::GetFrameQueueStats(int camera_id) const
 {
+    FrameQueueStats stats = {};
+    
     // Check if camera_id is valid
-    if (camera_id < 0 || camera_id >= static_cast<int>(mCameraConfigs.size())) {
-        SetErrorMessage("Invalid camera ID");
-        return false;
+    if (camera_id < 0 || camera_id >= static_cast<int>(mQueueCounters.size())) {
+        return stats;
     }
     
-    // Check if running
-    if (mRunning) {
-        SetErrorMessage("Cannot change zero-copy mode while acquisition is running");
-        return false;
+    const QueueCounters& counters = *mQueueCounters[camera_id];
+    stats.frames_enqueued = counters.frames_enqueued;
+    stats.dropped_queue_full = counters.dropped_queue_full;
+    stats.dropped_unsynchronized = counters.dropped_unsynchronized;
+    stats.driver_sequence_gaps = counters.driver_sequence_gaps;
+    stats.dropped_stale = counters.dropped_stale;
+    stats.dropped_readout_switch = counters.dropped_readout_switch;
+    stats.frames_consumed = counters.frames_consumed;
+    stats.missing_scaled_plane = counters.missing_scaled_plane;
+    stats.last_frame_age_ms = counters.last_frame_age_us / 1000.0;
+    stats.max_frame_age_ms = counters.max_frame_age_us / 1000.0;
+    if (stats.frames_consumed > 0) {
+        stats.mean_frame_age_ms = counters.total_frame_age_us / 1000.0 / stats.frames_consumed;
     }
     
-    // Check if zero-copy is supported
-    if (enable && !IsZeroCopySupported(camera_id)) {
-        SetErrorMessage("Zero-copy not supported for this camera");
-        return false;
+    if (mFrameQueues[camera_id]) {
+        stats.queue_depth = mFrameQueues[camera_id]->Size();
+        stats.queue_capacity = mFrameQueues[camera_id]->Capacity();
     }
     
-    // Update configuration
-    mCameraConfigs[camera_id].zero_copy_enabled = enable;
+    return stats;
+}
+
+bool ZeroCopyFrameProvider::SetAcquisitionMode(AcquisitionMode mode)
+{
+    // Check if running
+    if (mRunning) {
+        SetErrorMessage("Cannot change acquisition mode while acquisition is running");
+        return false;
+    }
     
+    mAcquisitionMode = mode;
     return true;
 }
 
-bool ZeroCopyFrameProvider::IsZeroCopySupported(int camera_id) const
+ZeroCopyFrameProvider::AcquisitionMode ZeroCopyFrameProvider::GetAcquisitionMode() const
 {
-    // Check if camera_id is valid
-    if (camera_id < 0 || camera_id >= static_cast<int>(mCameraHandles.size())) {
-        return false;
+    return mAcquisitionMode;
+}
+
+bool ZeroCopyFrameProvider::StartRecording(const std::string& path)
+{
+    std::vector<CaptureCameraInfo> cameras(mCameraConfigs.size());
+    for (size_t i = 0; i < mCameraConfigs.size(); ++i) {
+        const CameraConfig& config = mCameraConfigs[i];
+        memset(&cameras[i], 0, sizeof(cameras[i]));
+        cameras[i].width = config.width;
+        cameras[i].height = config.height;
+        cameras[i].fps = config.fps;
+        strncpy(cameras[i].pixel_format, config.pixel_format.c_str(), sizeof(cameras[i].pixel_format) - 1);
     }
     
-    // Check if camera is initialized
-    if (mCameraHandles[camera_id] < 0) {
+    if (!mRecorder.Open(path, cameras)) {
+        SetErrorMessage(mRecorder.GetLastErrorMessage());
         return false;
     }
     
-    // Check if DMA is supported
-    return CheckDmaSupport(camera_id);
+    return true;
 }
 
-std::string ZeroCopyFrameProvider::GetLastErrorMessage() const
+void ZeroCopyFrameProvider::StopRecording()
 {
-    std::lock_guard<std::mutex> lock(mErrorMutex);
-    return mLastErrorMessage;
+    mRecorder.Close();
 }
 
-//------------------------------------------------------------------------------
-// Private Methods
-//------------------------------------------------------------------------------
+bool ZeroCopyFrameProvider::IsRecording() const
+{
+    return mRecorder.IsOpen();
+}
 
-bool ZeroCopyFrameProvider::OpenCamera(int camera_id)
+bool ZeroCopyFrameProvider::RecordImuSample(const CaptureImuSample& sample)
 {
-    // Check if camera_id is valid
-    if (camera_id < 0 || camera_id >= static_cast<int>(mCameraConfigs.size())) {
-        SetErrorMessage("Invalid camera ID");
+    return mRecorder.WriteImuSample(sample);
+}
+
+bool ZeroCopyFrameProvider::SetReplaySource(const std::string& path, float playback_rate)
+{
+    // Check if initialized
+    if (std::any_of(mCameraHandles.begin(), mCameraHandles.end(), 
+                    [](int handle) { return handle >= 0; })) {
+        SetErrorMessage("Cannot set replay source after initialization");
         return false;
     }
     
-    // Check if camera is already open
-    if (mCameraHandles[camera_id] >= 0) {
-        SetErrorMessage("Camera already open");
+    if (playback_rate < 0.0f) {
+        SetErrorMessage("Invalid playback rate: " + std::to_string(playback_rate));
         return false;
     }
     
-    // Open camera device
-    const std::string& device_path = mCameraConfigs[camera_id].device_path;
-    int fd = open(device_path.c_str(), O_RDWR);
-    if (fd < 0) {
-        SetErrorMessage("Failed to open camera device: " + device_path + " - " + std::string(strerror(errno)));
+    mReplayPath = path;
+    mReplayRate = playback_rate;
+    return true;
+}
+
+bool ZeroCopyFrameProvider::IsReplayFinished() const
+{
+    return mReplayFinished;
+}
+
+bool ZeroCopyFrameProvider::GetReplayImuSamples(double start_time, double end_time,
+                                                std::vector<CaptureImuSample>& samples) const
+{
+    samples.clear();
+    
+    if (!mReplayReader.IsOpen()) {
         return false;
     }
     
-    // Check if device is a video capture device
-    struct v4l2_capability cap;
+    // Samples are sorted by recorded timestamp
+    const std::vector<CaptureImuSample>& recorded = mReplayReader.GetImuSamples();
+    const double offset = mReplayTimeOffset;
+    
+    auto it = std::lower_bound(recorded.begin(), recorded.end(), start_time - offset,
+                               [](const CaptureImuSample& sample, double t) { return sample.timestamp < t; });
+    for (; it != recorded.end() && it->timestamp + offset <= end_time; ++it) {
+        samples.push_back(*it);
+        samples.back().timestamp += offset;
+    }
+    
+    return true;
+}
+
+void ZeroCopyFrameProvider::RegisterFrameCallback(std::function<void(const FrameMetadata&)> callback)
+{
+    mFrameCallback = callback;
+}
+
+int ZeroCopyFrameProvider::Subscribe(const SubscriberOptions& options)
+{
+    if (options.max_frames_held < 1) {
+        SetErrorMessage("Subscriber must be able to hold a frame");
+        return -1;
+    }
+    
+    const int num_cameras = static_cast<int>(mCameraConfigs.size());
+    for (int camera_id : options.camera_ids) {
+        if (camera_id < 0 || camera_id >= num_cameras) {
+            SetErrorMessage("Invalid camera ID");
+            return -1;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(mSubscribersMutex);
+    
+    // Replayed frames live in the capture file, live frames in a fixed set
+    // of driver buffers the subscribers must not drain
+    if (mReplayPath.empty()) {
+        for (int camera_id = 0; camera_id < num_cameras; ++camera_id) {
+            auto sees = [camera_id](const SubscriberOptions& subscriber) {
+                return subscriber.camera_ids.empty() ||
+                       std::find(subscriber.camera_ids.begin(), subscriber.camera_ids.end(), camera_id) !=
+                       subscriber.camera_ids.end();
+            };
+            if (!sees(options)) {
+                continue;
+            }
+            
+            int held = options.max_frames_held;
+            for (const auto& subscriber : mSubscribers) {
+                if (sees(subscriber->options)) {
+                    held += subscriber->options.max_frames_held;
+                }
+            }
+            
+            const int buffer_count = mBuffers[camera_id].empty() ? mCameraConfigs[camera_id].buffer_count
+                                                                 : static_cast<int>(mBuffers[camera_id].size());
+            if (held + 3 > buffer_count) {
+                SetErrorMessage("Subscribers of camera " + std::to_string(camera_id) + " would hold " +
+                                std::to_string(held) + " of its " + std::to_string(buffer_count) + " buffers");
+                return -1;
+            }
+        }
+    }
+    
+    std::shared_ptr<Subscriber> subscriber = std::make_shared<Subscriber>();
+    subscriber->id = mNextSubscriberId++;
+    subscriber->options = options;
+    mSubscribers.push_back(subscriber);
+    return subscriber->id;
+}
+
+void ZeroCopyFrameProvider::Unsubscribe(int subscriber_id)
+{
+    std::shared_ptr<Subscriber> subscriber;
+    {
+        std::lock_guard<std::mutex> lock(mSubscribersMutex);
+        auto it = std::find_if(mSubscribers.begin(), mSubscribers.end(),
+                               [subscriber_id](const std::shared_ptr<Subscriber>& s) { return s->id == subscriber_id; });
+        if (it == mSubscribers.end()) {
+            return;
+        }
+        subscriber = *it;
+        mSubscribers.erase(it);
+    }
+    
+    std::deque<FrameMetadata> frames;
+    {
+        std::lock_guard<std::mutex> lock(subscriber->mutex);
+        subscriber->closed = true;
+        frames.swap(subscriber->frames);
+        subscriber->frame_available.notify_all();
+    }
+    
+    for (const FrameMetadata& metadata : frames) {
+        ReleaseFrame(metadata);
+    }
+}
+
+ZeroCopyFrameProvider::FrameViewPtr ZeroCopyFrameProvider::GetSubscribedFrame(int subscriber_id, int timeout_ms)
+{
+    std::shared_ptr<Subscriber> subscriber;
+    {
+        std::lock_guard<std::mutex> lock(mSubscribersMutex);
+        for (const auto& s : mSubscribers) {
+            if (s->id == subscriber_id) {
+                subscriber = s;
+                break;
+            }
+        }
+    }
+    if (!subscriber) {
+        SetErrorMessage("Invalid subscriber ID");
+        return nullptr;
+    }
+    
+    const SubscriberOptions& options = subscriber->options;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    std::vector<FrameMetadata> stale;
+    FrameMetadata metadata;
+    bool have_frame = false;
+    {
+        std::unique_lock<std::mutex> lock(subscriber->mutex);
+        while (true) {
+            // Recycle what the drop policy rules out, the newest frame stays
+            // for LATEST_ONLY
+            const double now = MonotonicNowSeconds();
+            while (!subscriber->frames.empty()) {
+                const FrameMetadata& head = subscriber->frames.front();
+                bool drop = false;
+                if (options.drop_policy == FrameDropPolicy::LATEST_ONLY) {
+                    drop = subscriber->frames.size() > 1;
+                } else if (options.drop_policy == FrameDropPolicy::BOUNDED_LATENCY) {
+                    drop = (now - head.timestamp) * 1000.0 > options.max_frame_age_ms;
+                }
+                if (!drop) {
+                    break;
+                }
+                stale.push_back(head);
+                subscriber->frames.pop_front();
+                subscriber->dropped_stale++;
+            }
+            
+            if (!subscriber->frames.empty()) {
+                metadata = subscriber->frames.front();
+                subscriber->frames.pop_front();
+                
+                // Counted before the queue has room, the frame stays within the budget
+                subscriber->views_held++;
+                have_frame = true;
+                break;
+            }
+            
+            if (subscriber->closed || !mRunning) {
+                SetErrorMessage("Acquisition stopped while waiting for frame");
+                break;
+            }
+            
+            if (timeout_ms == 0) {
+                SetErrorMessage("No frame available");
+                break;
+            }
+            
+            if (timeout_ms < 0) {
+                subscriber->frame_available.wait(lock);
+            } else if (subscriber->frame_available.wait_until(lock, deadline) == std::cv_status::timeout &&
+                       subscriber->frames.empty()) {
+                SetErrorMessage("Timeout waiting for frame");
+                break;
+            }
+        }
+    }
+    
+    // Outside the subscriber lock, releasing can take the StreamControl mutex
+    for (const FrameMetadata& frame : stale) {
+        ReleaseFrame(frame);
+    }
+    
+    if (!have_frame) {
+        return nullptr;
+    }
+    
+    // The deleter drops the subscriber's hold after the view released the buffer
+    FrameView* view = new FrameView(this, metadata);
+    if (view->mImage.empty()) {
+        delete view;
+        subscriber->views_held--;
+        return nullptr;
+    }
+    subscriber->frames_consumed++;
+    
+    return FrameViewPtr(view, [subscriber](FrameView* released) {
+        delete released;
+        subscriber->views_held--;
+    });
+}
+
+ZeroCopyFrameProvider::SubscriberStats ZeroCopyFrameProvider::GetSubscriberStats(int subscriber_id) const
+{
+    SubscriberStats stats = {};
+    
+    std::lock_guard<std::mutex> lock(mSubscribersMutex);
+    for (const auto& subscriber : mSubscribers) {
+        if (subscriber->id != subscriber_id) {
+            continue;
+        }
+        
+        stats.frames_delivered = subscriber->frames_delivered;
+        stats.frames_consumed = subscriber->frames_consumed;
+        stats.dropped_busy = subscriber->dropped_busy;
+        stats.dropped_stale = subscriber->dropped_stale;
+        stats.views_held = subscriber->views_held;
+        std::lock_guard<std::mutex> subscriber_lock(subscriber->mutex);
+        stats.queue_depth = subscriber->frames.size();
+        break;
+    }
+    
+    return stats;
+}
+
+void ZeroCopyFrameProvider::RegisterSliceCallback(std::function<void(const SliceInfo&)> callback)
+{
+    mSliceCallback = callback;
+}
+
+bool ZeroCopyFrameProvider::EnableZeroCopy(int camera_id, bool enable)
+{
+    // Check if camera_id is valid
+    if (camera_id < 0 || camera_id >= static_cast<int>(mCameraConfigs.size())) {
+        SetErrorMessage("Invalid camera ID");
+        return false;
+    }
+    
+    // Check if running
+    if (mRunning) {
+        SetErrorMessage("Cannot change zero-copy mode while acquisition is running");
+        return false;
+    }
+    
+    // Check if zero-copy is supported
+    if (enable && !IsZeroCopySupported(camera_id)) {
+        SetErrorMessage("Zero-copy not supported for this camera");
+        return false;
+    }
+    
+    // Update configuration
+    mCameraConfigs[camera_id].zero_copy_enabled = enable;
+    
+    return true;
+}
+
+bool ZeroCopyFrameProvider::IsZeroCopySupported(int camera_id) const
+{
+    // Check if camera_id is valid
+    if (camera_id < 0 || camera_id >= static_cast<int>(mCameraHandles.size())) {
+        return false;
+    }
+    
+    // Check if camera is initialized
+    if (mCameraHandles[camera_id] < 0) {
+        return false;
+    }
+    
+    // Check if DMA is supported
+    return CheckDmaSupport(camera_id);
+}
+
+std::shared_ptr<DmaBufferPool> ZeroCopyFrameProvider::GetBufferPool() const
+{
+    return mBufferPool;
+}
+
+std::string ZeroCopyFrameProvider::GetLastErrorMessage() const
+{
+    std::lock_guard<std::mutex> lock(mErrorMutex);
+    return mLastErrorMessage;
+}
+
+//------------------------------------------------------------------------------
+// Private Methods
+//------------------------------------------------------------------------------
+
+bool ZeroCopyFrameProvider::OpenCamera(int camera_id)
+{
+    // Check if camera_id is valid
+    if (camera_id < 0 || camera_id >= static_cast<int>(mCameraConfigs.size())) {
+        SetErrorMessage("Invalid camera ID");
+        return false;
+    }
+    
+    // Check if camera is already open
+    if (mCameraHandles[camera_id] >= 0) {
+        SetErrorMessage("Camera already open");
+        return false;
+    }
+    
+    // Open camera device
+    const std::string& device_path = mCameraConfigs[camera_id].device_path;
+    int fd = open(device_path.c_str(), O_RDWR);
+    if (fd < 0) {
+        SetErrorMessage("Failed to open camera device: " + device_path + " - " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    // Check if device is a video capture device
+    struct v4l2_capability cap;
     if (ioctl(fd, VIDIOC_QUERYCAP, &cap) < 0) {
         SetErrorMessage("Failed to query camera capabilities: " + std::string(strerror(errno)));
         close(fd);
@@ -602,7 +1299,8 @@ void ZeroCopyFrameProvider::CloseCamera(int camera_id)
         return;
     }
     
-    // Close camera device
+    // Close the scaled stream and the camera device
+    CloseScaledStream(camera_id);
     close(mCameraHandles[camera_id]);
     mCameraHandles[camera_id] = -1;
 }
@@ -658,6 +1356,7 @@ bool ZeroCopyFrameProvider::ConfigureCamera(int camera_id)
                        ", got: " + std::to_string(fmt.fmt.pix.width) + "x" + std::to_string(fmt.fmt.pix.height));
         return false;
     }
+    mImageSizes[camera_id] = fmt.fmt.pix.sizeimage;
     
     // Set frame rate
     struct v4l2_streamparm parm;
@@ -701,13 +1400,19 @@ bool ZeroCopyFrameProvider::AllocateBuffers(int camera_id)
     
     // Get camera configuration
     const CameraConfig& config = mCameraConfigs[camera_id];
+    const bool use_pool = config.dma_pool_buffers;
+    
+    if (use_pool && (!mBufferPool || mImageSizes[camera_id] > mBufferPool->GetBufferSize())) {
+        SetErrorMessage("Frames do not fit the DMA buffer pool");
+        return false;
+    }
     
     // Request buffers
     struct v4l2_requestbuffers req;
     memset(&req, 0, sizeof(req));
-    req.count = config.buffer_count;
+    req.count = CaptureBufferCount(config);
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
+    req.memory = use_pool ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
     
     if (ioctl(mCameraHandles[camera_id], VIDIOC_REQBUFS, &req) < 0) {
         SetErrorMessage("Failed to request buffers: " + std::string(strerror(errno)));
@@ -719,6 +1424,34 @@ bool ZeroCopyFrameProvider::AllocateBuffers(int camera_id)
         return false;
     }
     
+    // Take pool buffers for the slots; the driver attaches a DMA-BUF on its
+    // first QBUF and keeps the mapping while the same fd comes back
+    if (use_pool) {
+        mBuffers[camera_id].clear();
+        for (unsigned int i = 0; i < req.count; ++i) {
+            const int handle = mBufferPool->Acquire();
+            if (handle < 0) {
+                break;
+            }
+            
+            const DmaBufferPool::Buffer& pooled = mBufferPool->GetBuffer(handle);
+            BufferInfo info;
+            info.start = pooled.data;
+            info.length = pooled.size;
+            info.dma_fd = pooled.dma_fd;
+            info.in_use = false;
+            info.pool_handle = handle;
+            mBuffers[camera_id].push_back(info);
+        }
+        
+        if (mBuffers[camera_id].size() < 2) {
+            SetErrorMessage("DMA buffer pool exhausted");
+            FreeBuffers(camera_id);
+            return false;
+        }
+        return true;
+    }
+    
     // Allocate buffer info structures
     mBuffers[camera_id].resize(req.count);
     
@@ -746,8 +1479,10 @@ bool ZeroCopyFrameProvider::AllocateBuffers(int camera_id)
             FreeBuffers(camera_id);
             return false;
         }
+        MemoryAccounting::Add(MemoryBreakdown::FRAME_BUFFERS, buf.length);
         
         mBuffers[camera_id][i].in_use = false;
+        mBuffers[camera_id][i].pool_handle = -1;
         
         // Export DMA file descriptor if zero-copy is enabled
         if (config.zero_copy_enabled) {
@@ -772,10 +1507,18 @@ void ZeroCopyFrameProvider::FreeBuffers(int camera_id)
         return;
     }
     
-    // Unmap buffers
+    // Unmap buffers; pool buffers go back to the pool
+    bool pooled = false;
     for (auto& buffer : mBuffers[camera_id]) {
+        if (buffer.pool_handle >= 0) {
+            mBufferPool->Release(buffer.pool_handle);
+            pooled = true;
+            continue;
+        }
+        
         if (buffer.start != nullptr && buffer.start != MAP_FAILED) {
             munmap(buffer.start, buffer.length);
+            MemoryAccounting::Remove(MemoryBreakdown::FRAME_BUFFERS, buffer.length);
         }
         
         if (buffer.dma_fd >= 0) {
@@ -783,10 +1526,63 @@ void ZeroCopyFrameProvider::FreeBuffers(int camera_id)
         }
     }
     
+    // Detach the pool buffers from the driver
+    if (pooled && mCameraHandles[camera_id] >= 0) {
+        struct v4l2_requestbuffers req;
+        memset(&req, 0, sizeof(req));
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_DMABUF;
+        ioctl(mCameraHandles[camera_id], VIDIOC_REQBUFS, &req);
+    }
+    
     // Clear buffer info
     mBuffers[camera_id].clear();
 }
 
+bool ZeroCopyFrameProvider::AllocateBufferPool()
+{
+    size_t count = 0;
+    size_t size = 0;
+    for (size_t i = 0; i < mCameraConfigs.size(); ++i) {
+        if (mCameraConfigs[i].dma_pool_buffers) {
+            count += CaptureBufferCount(mCameraConfigs[i]);
+            size = std::max(size, mImageSizes[i]);
+        }
+    }
+    if (count == 0) {
+        return true;
+    }
+    
+    // Allocated once; the devices keep their imports of the buffers
+    std::shared_ptr<DmaBufferPool> pool = std::make_shared<DmaBufferPool>();
+    if (!pool->Allocate(count, size)) {
+        SetErrorMessage("Failed to allocate the DMA buffer pool: " + pool->GetLastErrorMessage());
+        return false;
+    }
+    
+    mBufferPool = pool;
+    return true;
+}
+
+void ZeroCopyFrameProvider::InitCaptureBuffer(int camera_id, struct v4l2_buffer& buf, unsigned int index) const
+{
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.index = index;
+    
+    // Every slot keeps the same DMA-BUF, so the driver reuses its mapping
+    const std::vector<BufferInfo>& buffers = mBuffers[camera_id];
+    if (!buffers.empty() && buffers[0].pool_handle >= 0) {
+        buf.memory = V4L2_MEMORY_DMABUF;
+        if (index < buffers.size()) {
+            buf.m.fd = buffers[index].dma_fd;
+            buf.length = buffers[index].length;
+        }
+    } else {
+        buf.memory = V4L2_MEMORY_MMAP;
+    }
+}
+
 bool ZeroCopyFrameProvider::StartStreaming(int camera_id)
 {
     // Check if camera_id is valid
@@ -802,17 +1598,16 @@ bool ZeroCopyFrameProvider::StartStreaming(int camera_id)
     }
     
     // Queue buffers
+    mQueuedBuffers[camera_id]->indices.clear();
     for (size_t i = 0; i < mBuffers[camera_id].size(); ++i) {
         struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
+        InitCaptureBuffer(camera_id, buf, i);
         
         if (ioctl(mCameraHandles[camera_id], VIDIOC_QBUF, &buf) < 0) {
             SetErrorMessage("Failed to queue buffer: " + std::string(strerror(errno)));
             return false;
         }
+        TrackQueuedBuffer(camera_id, buf.index);
     }
     
     // Start streaming
@@ -822,6 +1617,36 @@ bool ZeroCopyFrameProvider::StartStreaming(int camera_id)
         return false;
     }
     
+    // Read the exposure time to locate the exposure midpoint of each frame
+    // (V4L2_CID_EXPOSURE_ABSOLUTE is in units of 100 us)
+    struct v4l2_control exposure;
+    memset(&exposure, 0, sizeof(exposure));
+    exposure.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+    mAcquisitionStates[camera_id].exposure_s =
+        ioctl(mCameraHandles[camera_id], VIDIOC_G_CTRL, &exposure) == 0 ? exposure.value * 0.0001 : 0.0;
+    
+    // Subscribe to the exposure reported by the sensor driver
+    if (!OpenExposureEvents(camera_id)) {
+        return false;
+    }
+    
+    // Start the scaled stream
+    ScaledStream& stream = mScaledStreams[camera_id];
+    if (stream.handle >= 0) {
+        for (size_t i = 0; i < stream.buffers.size(); ++i) {
+            if (!QueueScaledBuffer(camera_id, static_cast<int>(i))) {
+                return false;
+            }
+        }
+        
+        enum v4l2_buf_type scaled_type = static_cast<enum v4l2_buf_type>(stream.buf_type);
+        if (ioctl(stream.handle, VIDIOC_STREAMON, &scaled_type) < 0) {
+            SetErrorMessage("Failed to start scaled streaming: " + std::string(strerror(errno)));
+            return false;
+        }
+        stream.active = true;
+    }
+    
     return true;
 }
 
@@ -840,105 +1665,1523 @@ void ZeroCopyFrameProvider::StopStreaming(int camera_id)
     // Stop streaming
     enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     ioctl(mCameraHandles[camera_id], VIDIOC_STREAMOFF, &type);
+    
+    // Close the exposure events, the sensor goes back to whole frames
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    if (state.exposure_fd >= 0) {
+        if (mCameraConfigs[camera_id].slice_count > 0) {
+            struct v4l2_control slices;
+            memset(&slices, 0, sizeof(slices));
+            slices.id = kOV9281CidSliceCount;
+            ioctl(state.exposure_fd, VIDIOC_S_CTRL, &slices);
+        }
+        close(state.exposure_fd);
+        state.exposure_fd = -1;
+    }
+    state.exposures.clear();
+    state.has_exposure_sequence = false;
+    
+    // Stop the scaled stream
+    ScaledStream& stream = mScaledStreams[camera_id];
+    if (stream.handle >= 0) {
+        enum v4l2_buf_type scaled_type = static_cast<enum v4l2_buf_type>(stream.buf_type);
+        ioctl(stream.handle, VIDIOC_STREAMOFF, &scaled_type);
+        stream.active = false;
+    }
 }
 
-void ZeroCopyFrameProvider::AcquisitionThreadFunc(int camera_id)
+bool ZeroCopyFrameProvider::SwitchReadout(int camera_id, const CameraConfig& config)
 {
-    // Set thread name
-    pthread_setname_np(pthread_self(), ("ZeroCopyAcq" + std::to_string(camera_id)).c_str());
+    const CameraConfig& current = mCameraConfigs[camera_id];
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    const int handle = mCameraHandles[camera_id];
+    
+    // Everything but the frame size, rate and readout needs a stream restart
+    if (config.device_path != current.device_path || config.pixel_format != current.pixel_format ||
+        config.buffer_count != current.buffer_count || config.zero_copy_enabled != current.zero_copy_enabled ||
+        config.sync_subdev_path != current.sync_subdev_path || config.slice_count != current.slice_count ||
+        config.scaled_device_path != current.scaled_device_path) {
+        SetErrorMessage("Cannot change configuration while acquisition is running");
+        return false;
+    }
     
-    // Initialize frame counter and timer
-    uint64_t frame_counter = 0;
-    auto last_fps_update = std::chrono::steady_clock::now();
-    auto last_frame_time = last_fps_update;
+    if (handle < 0 || state.exposure_fd < 0) {
+        SetErrorMessage("Changing the readout mode while running needs a sync subdev");
+        return false;
+    }
     
-    // Acquisition loop
-    while (mRunning) {
-        // Wait for a buffer
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(mCameraHandles[camera_id], &fds);
-        
-        struct timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        
-        int r = select(mCameraHandles[camera_id] + 1, &fds, nullptr, nullptr, &tv);
-        
-        if (r < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            
-            SetErrorMessage("Select error: " + std::string(strerror(errno)));
-            break;
-        }
-        
-        if (r == 0) {
-            // Timeout
-            continue;
-        }
-        
-        // Dequeue buffer
-        struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        
-        if (ioctl(mCameraHandles[camera_id], VIDIOC_DQBUF, &buf) < 0) {
-            if (errno == EAGAIN) {
+    // The scaler is set up for the input size
+    if (mScaledStreams[camera_id].handle >= 0) {
+        SetErrorMessage("Cannot change the readout mode of a camera with a scaled stream");
+        return false;
+    }
+    
+    OV9281ReadoutMode mode;
+    memset(&mode, 0, sizeof(mode));
+    if (config.width == kOV9281FullWidth && config.height == kOV9281FullHeight) {
+        mode.readout = kOV9281ReadoutFull;
+    } else if (config.width == kOV9281SubsampledWidth && config.height == kOV9281SubsampledHeight) {
+        mode.readout = config.readout_skipping ? kOV9281ReadoutSkipping : kOV9281ReadoutBinning;
+    } else {
+        SetErrorMessage("No readout mode of " + std::to_string(config.width) + "x" + std::to_string(config.height));
+        return false;
+    }
+    mode.fps = std::max(config.fps, 1);
+    
+    // The acquisition thread and ReleaseFrame() keep off the buffers meanwhile
+    std::lock_guard<std::recursive_mutex> lock(mStreamControls[camera_id]->mutex);
+    
+    // Only the receiver stops, the sensor and its trigger keep running
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(handle, VIDIOC_STREAMOFF, &type) < 0) {
+        SetErrorMessage("Failed to stop streaming: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    // A receiver that sizes its buffers by the format refuses to change it
+    // while they are allocated, such a switch needs a stream restart
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(handle, VIDIOC_G_FMT, &fmt) < 0) {
+        SetErrorMessage("Failed to get video format: " + std::string(strerror(errno)));
+        RestartStreaming(camera_id);
+        return false;
+    }
+    const struct v4l2_format previous = fmt;
+    fmt.fmt.pix.width = config.width;
+    fmt.fmt.pix.height = config.height;
+    fmt.fmt.pix.bytesperline = 0;
+    fmt.fmt.pix.sizeimage = 0;
+    if (ioctl(handle, VIDIOC_S_FMT, &fmt) < 0) {
+        SetErrorMessage("Failed to set video format: " + std::string(strerror(errno)) +
+                        ", stop acquisition to change the frame size");
+        RestartStreaming(camera_id);
+        return false;
+    }
+    if (fmt.fmt.pix.width != static_cast<unsigned int>(config.width) ||
+        fmt.fmt.pix.height != static_cast<unsigned int>(config.height) ||
+        mBuffers[camera_id].empty() || fmt.fmt.pix.sizeimage > mBuffers[camera_id][0].length) {
+        SetErrorMessage("Receiver does not fit " + std::to_string(config.width) + "x" +
+                        std::to_string(config.height) + " frames into its buffers");
+        struct v4l2_format restore = previous;
+        ioctl(handle, VIDIOC_S_FMT, &restore);
+        RestartStreaming(camera_id);
+        return false;
+    }
+    
+    // Latches on a frame boundary, the frames read out before it are dropped
+    // by the size their exposure events report
+    if (ioctl(state.exposure_fd, kOV9281IocSetReadout, &mode) < 0) {
+        SetErrorMessage("Failed to switch the readout mode: " + std::string(strerror(errno)));
+        struct v4l2_format restore = previous;
+        ioctl(handle, VIDIOC_S_FMT, &restore);
+        RestartStreaming(camera_id);
+        return false;
+    }
+    
+    mCameraConfigs[camera_id].width = config.width;
+    mCameraConfigs[camera_id].height = config.height;
+    mCameraConfigs[camera_id].fps = static_cast<int>(mode.fps);
+    mCameraConfigs[camera_id].readout_skipping = config.readout_skipping;
+    
+    return RestartStreaming(camera_id);
+}
+
+bool ZeroCopyFrameProvider::RestartStreaming(int camera_id)
+{
+    // The receiver returned every queued buffer, the ones the consumer holds
+    // come back through ReleaseFrame()
+    {
+        QueuedBuffers& queued = *mQueuedBuffers[camera_id];
+        std::lock_guard<std::mutex> lock(queued.mutex);
+        queued.indices.clear();
+    }
+    for (size_t i = 0; i < mBuffers[camera_id].size(); ++i) {
+        if (mBuffers[camera_id][i].in_use) {
+            continue;
+        }
+        
+        struct v4l2_buffer buf;
+        InitCaptureBuffer(camera_id, buf, i);
+        
+        if (ioctl(mCameraHandles[camera_id], VIDIOC_QBUF, &buf) < 0) {
+            SetErrorMessage("Failed to queue buffer: " + std::string(strerror(errno)));
+            return false;
+        }
+        TrackQueuedBuffer(camera_id, buf.index);
+    }
+    
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(mCameraHandles[camera_id], VIDIOC_STREAMON, &type) < 0) {
+        SetErrorMessage("Failed to start streaming: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    // The receiver numbers the frames from 0 again
+    mAcquisitionStates[camera_id].last_sequence = 0;
+    mStreamControls[camera_id]->restarted = true;
+    return true;
+}
+
+bool ZeroCopyFrameProvider::OpenScaledStream(int camera_id)
+{
+    const CameraConfig& config = mCameraConfigs[camera_id];
+    ScaledStream& stream = mScaledStreams[camera_id];
+    
+    // The scaled stream is optional
+    if (config.scaled_device_path.empty()) {
+        return true;
+    }
+    
+    if (config.scaled_width <= 0 || config.scaled_height <= 0) {
+        SetErrorMessage("Invalid scaled stream resolution: " +
+                       std::to_string(config.scaled_width) + "x" + std::to_string(config.scaled_height));
+        return false;
+    }
+    
+    // Only formats starting with a full luma plane can be used as model input
+    uint32_t pixelformat;
+    if (config.scaled_pixel_format == "GREY") {
+        pixelformat = V4L2_PIX_FMT_GREY;
+    } else if (config.scaled_pixel_format == "NV12") {
+        pixelformat = V4L2_PIX_FMT_NV12;
+    } else {
+        SetErrorMessage("Unsupported scaled pixel format: " + config.scaled_pixel_format);
+        return false;
+    }
+    
+    // Open scaler device
+    int fd = open(config.scaled_device_path.c_str(), O_RDWR);
+    if (fd < 0) {
+        SetErrorMessage("Failed to open scaled device: " + config.scaled_device_path + " - " + std::string(strerror(errno)));
+        return false;
+    }
+    stream.handle = fd;
+    
+    // ISP scaler outputs are usually multi-planar only
+    struct v4l2_capability cap;
+    if (ioctl(fd, VIDIOC_QUERYCAP, &cap) < 0) {
+        SetErrorMessage("Failed to query scaled device capabilities: " + std::string(strerror(errno)));
+        CloseScaledStream(camera_id);
+        return false;
+    }
+    
+    const uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+        stream.buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    } else if (caps & V4L2_CAP_VIDEO_CAPTURE) {
+        stream.buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    } else {
+        SetErrorMessage("Scaled device is not a video capture device: " + config.scaled_device_path);
+        CloseScaledStream(camera_id);
+        return false;
+    }
+    
+    if (!(caps & V4L2_CAP_STREAMING)) {
+        SetErrorMessage("Scaled device does not support streaming: " + config.scaled_device_path);
+        CloseScaledStream(camera_id);
+        return false;
+    }
+    
+    const bool mplane = (stream.buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+    
+    // Set scaled format; the scaler follows the sensor frame rate
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = stream.buf_type;
+    if (mplane) {
+        fmt.fmt.pix_mp.width = config.scaled_width;
+        fmt.fmt.pix_mp.height = config.scaled_height;
+        fmt.fmt.pix_mp.pixelformat = pixelformat;
+        fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+        fmt.fmt.pix_mp.num_planes = 1;
+    } else {
+        fmt.fmt.pix.width = config.scaled_width;
+        fmt.fmt.pix.height = config.scaled_height;
+        fmt.fmt.pix.pixelformat = pixelformat;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    }
+    
+    if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
+        SetErrorMessage("Failed to set scaled format: " + std::string(strerror(errno)));
+        CloseScaledStream(camera_id);
+        return false;
+    }
+    
+    const unsigned int width = mplane ? fmt.fmt.pix_mp.width : fmt.fmt.pix.width;
+    const unsigned int height = mplane ? fmt.fmt.pix_mp.height : fmt.fmt.pix.height;
+    if (width != static_cast<unsigned int>(config.scaled_width) ||
+        height != static_cast<unsigned int>(config.scaled_height)) {
+        SetErrorMessage("Scaler does not support requested resolution: " +
+                       std::to_string(config.scaled_width) + "x" + std::to_string(config.scaled_height) +
+                       ", got: " + std::to_string(width) + "x" + std::to_string(height));
+        CloseScaledStream(camera_id);
+        return false;
+    }
+    
+    stream.stride = mplane ? fmt.fmt.pix_mp.plane_fmt[0].bytesperline : fmt.fmt.pix.bytesperline;
+    if (stream.stride < config.scaled_width) {
+        stream.stride = config.scaled_width;
+    }
+    
+    // Request as many buffers as the primary stream so both run equally deep
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = std::max<size_t>(mBuffers[camera_id].size(), 2);
+    req.type = stream.buf_type;
+    req.memory = V4L2_MEMORY_MMAP;
+    
+    if (ioctl(fd, VIDIOC_REQBUFS, &req) < 0) {
+        SetErrorMessage("Failed to request scaled buffers: " + std::string(strerror(errno)));
+        CloseScaledStream(camera_id);
+        return false;
+    }
+    
+    if (req.count < 2) {
+        SetErrorMessage("Insufficient scaled buffer memory");
+        CloseScaledStream(camera_id);
+        return false;
+    }
+    
+    // Map the luma plane of every buffer
+    stream.buffers.resize(req.count);
+    for (auto& buffer : stream.buffers) {
+        buffer.start = nullptr;
+        buffer.length = 0;
+        buffer.dma_fd = -1;
+        buffer.in_use = false;
+    }
+    
+    for (unsigned int i = 0; i < req.count; ++i) {
+        struct v4l2_buffer buf;
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
+        InitV4L2Buffer(buf, planes, stream.buf_type, i);
+        
+        if (ioctl(fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            SetErrorMessage("Failed to query scaled buffer: " + std::string(strerror(errno)));
+            CloseScaledStream(camera_id);
+            return false;
+        }
+        
+        const size_t length = mplane ? planes[0].length : buf.length;
+        const off_t offset = mplane ? planes[0].m.mem_offset : buf.m.offset;
+        
+        BufferInfo& buffer = stream.buffers[i];
+        buffer.length = length;
+        buffer.start = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+        
+        if (buffer.start == MAP_FAILED) {
+            SetErrorMessage("Failed to map scaled buffer: " + std::string(strerror(errno)));
+            CloseScaledStream(camera_id);
+            return false;
+        }
+        MemoryAccounting::Add(MemoryBreakdown::FRAME_BUFFERS, length);
+        
+        // Export DMA file descriptor if zero-copy is enabled
+        if (config.zero_copy_enabled) {
+            struct v4l2_exportbuffer expbuf;
+            memset(&expbuf, 0, sizeof(expbuf));
+            expbuf.type = stream.buf_type;
+            expbuf.index = i;
+            expbuf.plane = 0;
+            expbuf.flags = O_RDONLY;
+            
+            if (ioctl(fd, VIDIOC_EXPBUF, &expbuf) < 0) {
+                SetErrorMessage("Failed to export scaled buffer: " + std::string(strerror(errno)));
+                CloseScaledStream(camera_id);
+                return false;
+            }
+            buffer.dma_fd = expbuf.fd;
+        }
+    }
+    
+    return true;
+}
+
+void ZeroCopyFrameProvider::CloseScaledStream(int camera_id)
+{
+    // Check if camera_id is valid
+    if (camera_id < 0 || camera_id >= static_cast<int>(mScaledStreams.size())) {
+        return;
+    }
+    
+    ScaledStream& stream = mScaledStreams[camera_id];
+    
+    // Unmap buffers
+    for (auto& buffer : stream.buffers) {
+        if (buffer.start != nullptr && buffer.start != MAP_FAILED) {
+            munmap(buffer.start, buffer.length);
+            MemoryAccounting::Remove(MemoryBreakdown::FRAME_BUFFERS, buffer.length);
+        }
+        
+        if (buffer.dma_fd >= 0) {
+            close(buffer.dma_fd);
+        }
+    }
+    stream.buffers.clear();
+    stream.pending_frames.clear();
+    stream.pending_scaled.clear();
+    stream.active = false;
+    
+    // Close scaler device
+    if (stream.handle >= 0) {
+        close(stream.handle);
+        stream.handle = -1;
+    }
+}
+
+bool ZeroCopyFrameProvider::QueueScaledBuffer(int camera_id, int buffer_index)
+{
+    ScaledStream& stream = mScaledStreams[camera_id];
+    if (stream.handle < 0 || buffer_index < 0 || buffer_index >= static_cast<int>(stream.buffers.size())) {
+        return false;
+    }
+    
+    stream.buffers[buffer_index].in_use = false;
+    
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    InitV4L2Buffer(buf, planes, stream.buf_type, buffer_index);
+    
+    if (ioctl(stream.handle, VIDIOC_QBUF, &buf) < 0) {
+        SetErrorMessage("Failed to queue scaled buffer: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    return true;
+}
+
+void ZeroCopyFrameProvider::AcquisitionThreadFunc(int camera_id)
+{
+    // Set thread name and scheduling
+    pthread_setname_np(pthread_self(), ("ZeroCopyAcq" + std::to_string(camera_id)).c_str());
+    ApplyThreadScheduling(mCameraConfigs[camera_id]);
+    
+    // Acquisition loop
+    while (mRunning) {
+        // Wait for a buffer on the camera or its scaled stream
+        const int handle = mCameraHandles[camera_id];
+        const int scaled_handle = mScaledStreams[camera_id].active ? mScaledStreams[camera_id].handle : -1;
+        const int sync_handle = mCameraConfigs[camera_id].slice_count > 0 ? mAcquisitionStates[camera_id].exposure_fd : -1;
+        
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(handle, &fds);
+        if (scaled_handle >= 0) {
+            FD_SET(scaled_handle, &fds);
+        }
+        
+        // V4L2 events are signaled as exceptions
+        fd_set event_fds;
+        FD_ZERO(&event_fds);
+        if (sync_handle >= 0) {
+            FD_SET(sync_handle, &event_fds);
+        }
+        
+        struct timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        
+        int r = select(std::max({handle, scaled_handle, sync_handle}) + 1, &fds, nullptr, &event_fds, &tv);
+        
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            
+            SetErrorMessage("Select error: " + std::string(strerror(errno)));
+            break;
+        }
+        
+        if (r == 0) {
+            // Timeout
+            continue;
+        }
+        
+        // Readiness seen across a readout switch is of the stopped stream
+        StreamControl& control = *mStreamControls[camera_id];
+        std::lock_guard<std::recursive_mutex> lock(control.mutex);
+        if (control.restarted) {
+            control.restarted = false;
+            continue;
+        }
+        
+        if (sync_handle >= 0 && FD_ISSET(sync_handle, &event_fds)) {
+            DrainSyncEvents(camera_id);
+        }
+        
+        if (scaled_handle >= 0 && FD_ISSET(scaled_handle, &fds) && !DequeueScaledFrame(camera_id)) {
+            // Keep capturing full-resolution frames without the scaled plane
+            DisableScaledStream(camera_id);
+        }
+        
+        if (FD_ISSET(handle, &fds) && !DequeueFrame(camera_id)) {
+            break;
+        }
+    }
+}
+
+void ZeroCopyFrameProvider::ReactorThreadFunc()
+{
+    // Set thread name and scheduling; the reactor serves all cameras and
+    // uses the scheduling settings of the first camera
+    pthread_setname_np(pthread_self(), "ZeroCopyReactor");
+    if (!mCameraConfigs.empty()) {
+        ApplyThreadScheduling(mCameraConfigs[0]);
+    }
+    
+    const int max_events = static_cast<int>(mCameraHandles.size() * 3);
+    std::vector<struct epoll_event> events(std::max(max_events, 1));
+    int active_cameras = 0;
+    for (int handle : mCameraHandles) {
+        if (handle >= 0) {
+            active_cameras++;
+        }
+    }
+    
+    // Reactor loop
+    while (mRunning && active_cameras > 0) {
+        // Wait for any camera to have a filled buffer
+        int n = epoll_wait(mEpollFd, events.data(), static_cast<int>(events.size()), kReactorTimeoutMs);
+        
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            
+            SetErrorMessage("epoll_wait error: " + std::string(strerror(errno)));
+            break;
+        }
+        
+        // Dequeue whichever cameras are ready
+        for (int i = 0; i < n; ++i) {
+            const uint32_t tag = events[i].data.u32;
+            const int camera_id = static_cast<int>(tag & ~(kScaledStreamTag | kSyncEventTag));
+            StreamControl& control = *mStreamControls[camera_id];
+            std::lock_guard<std::recursive_mutex> lock(control.mutex);
+            
+            if (tag & kSyncEventTag) {
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    // Slices stop, whole frames keep coming
+                    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, mAcquisitionStates[camera_id].exposure_fd, nullptr);
+                } else {
+                    DrainSyncEvents(camera_id);
+                }
+                continue;
+            }
+            
+            if (tag & kScaledStreamTag) {
+                if ((events[i].events & (EPOLLERR | EPOLLHUP)) || !DequeueScaledFrame(camera_id)) {
+                    // Keep capturing full-resolution frames without the scaled plane
+                    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, mScaledStreams[camera_id].handle, nullptr);
+                    DisableScaledStream(camera_id);
+                }
+                continue;
+            }
+            
+            // Readiness seen across a readout switch is of the stopped stream
+            if (control.restarted) {
+                control.restarted = false;
+                continue;
+            }
+            
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) || !DequeueFrame(camera_id)) {
+                // Stop serving a failed camera but keep the others running
+                epoll_ctl(mEpollFd, EPOLL_CTL_DEL, mCameraHandles[camera_id], nullptr);
+                active_cameras--;
+            }
+        }
+    }
+}
+
+bool ZeroCopyFrameProvider::DequeueFrame(int camera_id)
+{
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    
+    // Dequeue buffer
+    struct v4l2_buffer buf;
+    InitCaptureBuffer(camera_id, buf, 0);
+    
+    if (ioctl(mCameraHandles[camera_id], VIDIOC_DQBUF, &buf) < 0) {
+        if (errno == EAGAIN) {
+            return true;
+        }
+        
+        SetErrorMessage("Failed to dequeue buffer: " + std::string(strerror(errno)));
+        return false;
+    }
+    const double dqbuf_time = MonotonicNowSeconds();
+    
+    // The buffer is no longer filled by the driver
+    if (mCameraConfigs[camera_id].slice_count > 0) {
+        QueuedBuffers& queued = *mQueuedBuffers[camera_id];
+        std::lock_guard<std::mutex> lock(queued.mutex);
+        auto it = std::find(queued.indices.begin(), queued.indices.end(), buf.index);
+        if (it != queued.indices.end()) {
+            queued.indices.erase(it);
+        }
+    }
+    
+    // Track frames skipped by the driver
+    if (state.frame_counter > 0 && buf.sequence > state.last_sequence + 1) {
+        mQueueCounters[camera_id]->driver_sequence_gaps += buf.sequence - state.last_sequence - 1;
+    }
+    state.last_sequence = buf.sequence;
+    
+    // Mark buffer as in use, held by the consumer of GetNextFrame()
+    mBuffers[camera_id][buf.index].in_use = true;
+    mBuffers[camera_id][buf.index].refs = 1;
+    
+    // Create frame metadata
+    FrameMetadata metadata;
+    metadata.frame_id = state.frame_counter++;
+    metadata.timestamp = buf.timestamp.tv_sec + buf.timestamp.tv_usec / 1000000.0;
+    metadata.camera_id = camera_id;
+    metadata.width = mCameraConfigs[camera_id].width;
+    metadata.height = mCameraConfigs[camera_id].height;
+    metadata.pixel_format = mCameraConfigs[camera_id].pixel_format;
+    metadata.buffer_ptr = mBuffers[camera_id][buf.index].start;
+    metadata.buffer_size = buf.bytesused;
+    metadata.dma_fd = mBuffers[camera_id][buf.index].dma_fd;
+    metadata.is_keyframe = (buf.flags & V4L2_BUF_FLAG_KEYFRAME) != 0;
+    
+    // The exposure reported by the driver locates the midpoint exactly, otherwise
+    // the buffer timestamp marks the start or, by default, the end of the exposure
+    const double half_exposure = state.exposure_s / 2.0;
+    const bool start_of_exposure = (buf.flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) == V4L2_BUF_FLAG_TSTAMP_SRC_SOE;
+    if (MatchExposure(camera_id, metadata, start_of_exposure)) {
+        // Frames read out before a readout switch latched do not fit the new format
+        if (state.exposure_width > 0 &&
+            (state.exposure_width != metadata.width || state.exposure_height != metadata.height)) {
+            mQueueCounters[camera_id]->dropped_readout_switch++;
+            ReleaseFrame(metadata);
+            return true;
+        }
+        metadata.latency.Set(LatencyStage::EXPOSURE_MID, CaptureTime(metadata));
+        RunAutoExposure(camera_id, metadata);
+    } else {
+        metadata.latency.Set(LatencyStage::EXPOSURE_MID,
+                             start_of_exposure ? metadata.timestamp + half_exposure : metadata.timestamp - half_exposure);
+    }
+    metadata.latency.Set(LatencyStage::DQBUF, dqbuf_time);
+    
+    // Update frame rate
+    UpdateFrameRate(camera_id);
+    
+    // Hold the frame until its scaled counterpart arrives
+    if (mScaledStreams[camera_id].active) {
+        mScaledStreams[camera_id].pending_frames.push_back(metadata);
+        MatchScaledFrames(camera_id);
+        return true;
+    }
+    
+    PublishFrame(metadata);
+    return true;
+}
+
+bool ZeroCopyFrameProvider::OpenExposureEvents(int camera_id)
+{
+    const CameraConfig& config = mCameraConfigs[camera_id];
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    
+    // The sync subdev is optional, but slices are timed by its events
+    if (config.sync_subdev_path.empty()) {
+        if (config.slice_count > 0) {
+            SetErrorMessage("Slice delivery needs a sync subdev");
+            return false;
+        }
+        return true;
+    }
+    
+    state.exposure_fd = open(config.sync_subdev_path.c_str(), O_RDWR | O_NONBLOCK);
+    if (state.exposure_fd < 0) {
+        SetErrorMessage("Failed to open sync subdev " + config.sync_subdev_path + ": " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    struct v4l2_event_subscription sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.type = kOV9281EventExposure;
+    if (ioctl(state.exposure_fd, VIDIOC_SUBSCRIBE_EVENT, &sub) < 0) {
+        SetErrorMessage("Failed to subscribe to exposure events: " + std::string(strerror(errno)));
+        close(state.exposure_fd);
+        state.exposure_fd = -1;
+        return false;
+    }
+    
+    // Bands are addressed by row, which needs a packed 8-bit format
+    if (config.slice_count > 0) {
+        if (config.pixel_format != "GREY") {
+            SetErrorMessage("Slice delivery needs the GREY pixel format");
+            close(state.exposure_fd);
+            state.exposure_fd = -1;
+            return false;
+        }
+        
+        memset(&sub, 0, sizeof(sub));
+        sub.type = kOV9281EventSlice;
+        struct v4l2_control slices;
+        memset(&slices, 0, sizeof(slices));
+        slices.id = kOV9281CidSliceCount;
+        slices.value = config.slice_count;
+        if (ioctl(state.exposure_fd, VIDIOC_SUBSCRIBE_EVENT, &sub) < 0 ||
+            ioctl(state.exposure_fd, VIDIOC_S_CTRL, &slices) < 0) {
+            SetErrorMessage("Failed to enable slice delivery: " + std::string(strerror(errno)));
+            close(state.exposure_fd);
+            state.exposure_fd = -1;
+            return false;
+        }
+    }
+    
+    state.exposures.clear();
+    state.has_exposure_sequence = false;
+    return true;
+}
+
+void ZeroCopyFrameProvider::DrainSyncEvents(int camera_id)
+{
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    
+    struct v4l2_event ev;
+    memset(&ev, 0, sizeof(ev));
+    while (ioctl(state.exposure_fd, VIDIOC_DQEVENT, &ev) == 0) {
+        if (ev.type == kOV9281EventExposure) {
+            OV9281ExposureEvent exposure;
+            memcpy(&exposure, ev.u.data, sizeof(exposure));
+            state.exposures.push_back({exposure.sequence, exposure.start_ns / 1000000000.0,
+                                       exposure.exposure_us / 1000000.0, exposure.exposure, exposure.gain,
+                                       exposure.width, exposure.height});
+            if (state.exposures.size() > kMaxPendingExposures) {
+                state.exposures.pop_front();
+            }
+        } else if (ev.type == kOV9281EventSlice) {
+            OV9281SliceEvent band;
+            memcpy(&band, ev.u.data, sizeof(band));
+            SliceInfo slice;
+            slice.camera_id = camera_id;
+            slice.sequence = band.sequence;
+            slice.slice = band.slice;
+            slice.num_slices = band.num_slices;
+            slice.first_row = band.first_line;
+            slice.num_rows = band.num_lines;
+            slice.data = nullptr;
+            slice.stride = 0;
+            slice.ready_time = band.ready_ns / 1000000000.0;
+            DeliverSlice(camera_id, slice);
+        }
+        memset(&ev, 0, sizeof(ev));
+    }
+}
+
+void ZeroCopyFrameProvider::DeliverSlice(int camera_id, SliceInfo& slice)
+{
+    const AcquisitionState& state = mAcquisitionStates[camera_id];
+    const CameraConfig& config = mCameraConfigs[camera_id];
+    if (!mSliceCallback) {
+        return;
+    }
+    
+    // The driver fills the queued buffers in order; the frame after the last
+    // dequeued one is at the head of the queue, later frames follow it
+    size_t position = 0;
+    if (state.has_exposure_sequence) {
+        const uint32_t ahead = slice.sequence - state.last_exposure_sequence;
+        if (ahead == 0 || ahead > mBuffers[camera_id].size()) {
+            return;
+        }
+        position = ahead - 1;
+    }
+    
+    int index = -1;
+    {
+        QueuedBuffers& queued = *mQueuedBuffers[camera_id];
+        std::lock_guard<std::mutex> lock(queued.mutex);
+        if (position < queued.indices.size()) {
+            index = static_cast<int>(queued.indices[position]);
+        }
+    }
+    if (index < 0) {
+        return;
+    }
+    
+    // The sensor and the capture format have the same height unless the
+    // receiver crops, keep the band inside the buffer
+    slice.first_row = std::min(slice.first_row, config.height);
+    slice.num_rows = std::min(slice.num_rows, config.height - slice.first_row);
+    slice.stride = config.width;
+    slice.data = static_cast<const uint8_t*>(mBuffers[camera_id][index].start) +
+                 static_cast<size_t>(slice.first_row) * slice.stride;
+    mSliceCallback(slice);
+}
+
+void ZeroCopyFrameProvider::TrackQueuedBuffer(int camera_id, uint32_t index)
+{
+    if (mCameraConfigs[camera_id].slice_count <= 0) {
+        return;
+    }
+    
+    QueuedBuffers& queued = *mQueuedBuffers[camera_id];
+    std::lock_guard<std::mutex> lock(queued.mutex);
+    queued.indices.push_back(index);
+}
+
+bool ZeroCopyFrameProvider::MatchExposure(int camera_id, FrameMetadata& metadata, bool start_of_exposure)
+{
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    if (state.exposure_fd < 0) {
+        return false;
+    }
+    
+    // Drain the events queued since the last buffer
+    DrainSyncEvents(camera_id);
+    
+    // The exposure of the frame is the latest one started before the buffer
+    // timestamp; a start-of-exposure stamp may trail the FSIN pulse by less
+    // than half a frame period either way
+    double limit = metadata.timestamp;
+    if (start_of_exposure) {
+        limit += 0.5 / std::max(mCameraConfigs[camera_id].fps, 1);
+    }
+    
+    size_t match = state.exposures.size();
+    for (size_t i = 0; i < state.exposures.size() && state.exposures[i].start <= limit; ++i) {
+        match = i;
+    }
+    if (match == state.exposures.size()) {
+        return false;
+    }
+    
+    metadata.exposure_start = state.exposures[match].start;
+    metadata.exposure_time = state.exposures[match].duration;
+    metadata.sensor_sequence = state.exposures[match].sequence;
+    metadata.applied_exposure = state.exposures[match].exposure;
+    metadata.applied_gain = state.exposures[match].gain;
+    state.exposure_width = state.exposures[match].width;
+    state.exposure_height = state.exposures[match].height;
+    state.last_exposure_sequence = state.exposures[match].sequence;
+    state.has_exposure_sequence = true;
+    state.exposures.erase(state.exposures.begin(), state.exposures.begin() + match + 1);
+    return true;
+}
+
+bool ZeroCopyFrameProvider::QueueFrameSettings(int camera_id, uint32_t sequence, int exposure, int gain)
+{
+    // Check if camera_id is valid
+    if (camera_id < 0 || camera_id >= static_cast<int>(mAcquisitionStates.size())) {
+        SetErrorMessage("Invalid camera ID");
+        return false;
+    }
+    
+    const int fd = mAcquisitionStates[camera_id].exposure_fd;
+    if (fd < 0) {
+        SetErrorMessage("Frame settings need a streaming sync subdev");
+        return false;
+    }
+    
+    OV9281FrameSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.sequence = sequence;
+    if (exposure >= 0) {
+        settings.flags |= kOV9281SettingsExposure;
+        settings.exposure = static_cast<uint32_t>(exposure);
+    }
+    if (gain >= 0) {
+        settings.flags |= kOV9281SettingsGain;
+        settings.gain = static_cast<uint32_t>(gain);
+    }
+    
+    if (ioctl(fd, kOV9281IocQueueSettings, &settings) < 0) {
+        SetErrorMessage("Failed to queue frame settings: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    return true;
+}
+
+bool ZeroCopyFrameProvider::AdjustFrameTiming(int camera_id, int64_t period_ns, int64_t phase_ns)
+{
+    // Check if camera_id is valid
+    if (camera_id < 0 || camera_id >= static_cast<int>(mAcquisitionStates.size())) {
+        SetErrorMessage("Invalid camera ID");
+        return false;
+    }
+    
+    const int fd = mAcquisitionStates[camera_id].exposure_fd;
+    if (fd < 0) {
+        SetErrorMessage("Frame timing needs a streaming sync subdev");
+        return false;
+    }
+    
+    OV9281FsinAdjust adjust;
+    adjust.period_ns = period_ns;
+    adjust.phase_ns = phase_ns;
+    if (ioctl(fd, kOV9281IocAdjustFsin, &adjust) < 0) {
+        SetErrorMessage("Failed to adjust frame timing: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    return true;
+}
+
+void ZeroCopyFrameProvider::RunAutoExposure(int camera_id, const FrameMetadata& metadata)
+{
+    const CameraConfig& config = mCameraConfigs[camera_id];
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    
+    if (config.auto_exposure_target <= 0.0f || config.pixel_format != "GREY" ||
+        metadata.applied_exposure == 0 || metadata.exposure_time <= 0.0 || !metadata.buffer_ptr) {
+        return;
+    }
+    
+    // Measure only frames exposed with the last request, or give up on it
+    // once it is overdue (e.g. dropped as late by a full driver queue)
+    if (state.ae_pending) {
+        const bool landed = metadata.applied_exposure == state.ae_exposure && metadata.applied_gain == state.ae_gain;
+        const int32_t overdue = static_cast<int32_t>(metadata.sensor_sequence - state.ae_sequence);
+        if (!landed && overdue < static_cast<int32_t>(kAutoExposureTimeoutFrames)) {
+            return;
+        }
+        state.ae_pending = false;
+    }
+    
+    // Mean level on a sparse grid
+    const uint8_t* pixels = static_cast<const uint8_t*>(metadata.buffer_ptr);
+    uint64_t sum = 0;
+    size_t count = 0;
+    for (int y = kAutoExposureStep / 2; y < metadata.height; y += kAutoExposureStep) {
+        const uint8_t* row = pixels + static_cast<size_t>(y) * metadata.width;
+        for (int x = kAutoExposureStep / 2; x < metadata.width; x += kAutoExposureStep) {
+            sum += row[x];
+            count++;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+    
+    const double mean = std::max(static_cast<double>(sum) / count, 1.0);
+    const double ratio = std::min(std::max(config.auto_exposure_target / mean, 1.0 / kAutoExposureMaxRatio),
+                                  kAutoExposureMaxRatio);
+    if (std::abs(ratio - 1.0) < kAutoExposureDeadband) {
+        return;
+    }
+    
+    // Longest exposure within the blur bound first, then analog gain
+    const double exposure_per_s = metadata.applied_exposure / metadata.exposure_time;
+    const double max_exposure = std::min(std::max(exposure_per_s * config.auto_exposure_max_ms / 1000.0, 1.0),
+                                         static_cast<double>(kOV9281ExposureMax));
+    const double total = static_cast<double>(metadata.applied_exposure) *
+                         std::max(metadata.applied_gain, kOV9281GainUnity) * ratio;
+    const double exposure = std::min(std::max(total / kOV9281GainUnity, 1.0), max_exposure);
+    const double gain = std::min(std::max(total / exposure, static_cast<double>(kOV9281GainUnity)),
+                                 static_cast<double>(kOV9281GainMax));
+    
+    // Frames up to the next one may already be exposing
+    const uint32_t sequence = metadata.sensor_sequence + 2;
+    const uint32_t new_exposure = static_cast<uint32_t>(std::lround(exposure));
+    const uint32_t new_gain = static_cast<uint32_t>(std::lround(gain));
+    if (QueueFrameSettings(camera_id, sequence, static_cast<int>(new_exposure), static_cast<int>(new_gain))) {
+        state.ae_pending = true;
+        state.ae_sequence = sequence;
+        state.ae_exposure = new_exposure;
+        state.ae_gain = new_gain;
+    }
+}
+
+double ZeroCopyFrameProvider::CaptureTime(const FrameMetadata& metadata)
+{
+    return metadata.exposure_start > 0.0 ? metadata.exposure_start + metadata.exposure_time / 2.0 : metadata.timestamp;
+}
+
+void ZeroCopyFrameProvider::UpdateFrameRate(int camera_id)
+{
+    AcquisitionState& state = mAcquisitionStates[camera_id];
+    auto now = std::chrono::steady_clock::now();
+    
+    auto fps_update_interval = std::chrono::duration_cast<std::chrono::milliseconds>(now - state.last_fps_update).count();
+    if (fps_update_interval > 1000) {
+        // Update FPS every second
+        mCurrentFrameRates[camera_id] = mFrameCounters[camera_id] * 1000.0f / fps_update_interval;
+        mFrameCounters[camera_id] = 0;
+        state.last_fps_update = now;
+    } else {
+        mFrameCounters[camera_id]++;
+    }
+}
+
+void ZeroCopyFrameProvider::PublishFrame(const FrameMetadata& metadata)
+{
+    const int camera_id = metadata.camera_id;
+    
+    // Call frame callback if registered
+    if (mFrameCallback) {
+        mFrameCallback(metadata);
+    }
+    
+    // Append to the capture file while the buffer is still ours
+    if (mRecorder.IsOpen()) {
+        RecordFrame(metadata);
+    }
+    
+    // Subscribers take their references before the consumer can release it
+    PublishToSubscribers(metadata);
+    
+    // Add frame to queue; if the consumer is behind, hand the buffer
+    // straight back to the driver instead of blocking capture
+    if (!mFrameQueues[camera_id]->TryPush(metadata)) {
+        mQueueCounters[camera_id]->dropped_queue_full++;
+        ReleaseFrame(metadata);
+        return;
+    }
+    mQueueCounters[camera_id]->frames_enqueued++;
+    
+    // Notify the waiting consumer
+    SignalFrameEvent(camera_id);
+}
+
+void ZeroCopyFrameProvider::PublishToSubscribers(const FrameMetadata& metadata)
+{
+    std::vector<FrameMetadata> recycled;
+    {
+        std::lock_guard<std::mutex> lock(mSubscribersMutex);
+        for (const auto& subscriber : mSubscribers) {
+            const std::vector<int>& camera_ids = subscriber->options.camera_ids;
+            if (!camera_ids.empty() &&
+                std::find(camera_ids.begin(), camera_ids.end(), metadata.camera_id) == camera_ids.end()) {
                 continue;
             }
             
-            SetErrorMessage("Failed to dequeue buffer: " + std::string(strerror(errno)));
+            std::lock_guard<std::mutex> subscriber_lock(subscriber->mutex);
+            const int held = static_cast<int>(subscriber->frames.size()) + subscriber->views_held;
+            if (held >= subscriber->options.max_frames_held) {
+                // Over budget: skip the frame, or make room by recycling the oldest queued one
+                if (subscriber->options.drop_policy == FrameDropPolicy::QUEUE_ALL || subscriber->frames.empty()) {
+                    subscriber->dropped_busy++;
+                    continue;
+                }
+                recycled.push_back(subscriber->frames.front());
+                subscriber->frames.pop_front();
+                subscriber->dropped_stale++;
+            }
+            
+            AddFrameReference(metadata);
+            subscriber->frames.push_back(metadata);
+            subscriber->frames_delivered++;
+            subscriber->frame_available.notify_one();
+        }
+    }
+    
+    for (const FrameMetadata& frame : recycled) {
+        ReleaseFrame(frame);
+    }
+}
+
+void ZeroCopyFrameProvider::AddFrameReference(const FrameMetadata& metadata)
+{
+    // Replayed frames live in the capture file mapping and are not counted
+    if (mReplayReader.IsOpen()) {
+        return;
+    }
+    
+    std::lock_guard<std::recursive_mutex> lock(mStreamControls[metadata.camera_id]->mutex);
+    for (auto& buffer : mBuffers[metadata.camera_id]) {
+        if (buffer.start == metadata.buffer_ptr) {
+            buffer.refs++;
+            return;
+        }
+    }
+}
+
+bool ZeroCopyFrameProvider::DequeueScaledFrame(int camera_id)
+{
+    ScaledStream& stream = mScaledStreams[camera_id];
+    
+    // Dequeue buffer
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    InitV4L2Buffer(buf, planes, stream.buf_type, 0);
+    
+    if (ioctl(stream.handle, VIDIOC_DQBUF, &buf) < 0) {
+        if (errno == EAGAIN) {
+            return true;
+        }
+        
+        SetErrorMessage("Failed to dequeue scaled buffer: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    stream.buffers[buf.index].in_use = true;
+    
+    ScaledBuffer scaled;
+    scaled.index = static_cast<int>(buf.index);
+    scaled.timestamp = buf.timestamp.tv_sec + buf.timestamp.tv_usec / 1000000.0;
+    scaled.bytesused = (stream.buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) ? planes[0].bytesused : buf.bytesused;
+    stream.pending_scaled.push_back(scaled);
+    
+    MatchScaledFrames(camera_id);
+    return true;
+}
+
+void ZeroCopyFrameProvider::MatchScaledFrames(int camera_id)
+{
+    ScaledStream& stream = mScaledStreams[camera_id];
+    const CameraConfig& config = mCameraConfigs[camera_id];
+    
+    // Both outputs are stamped from the same sensor frame; allow half a
+    // frame period of jitter between them
+    const double tolerance_s = 0.5 / std::max(config.fps, 1);
+    
+    while (!stream.pending_frames.empty() && !stream.pending_scaled.empty()) {
+        FrameMetadata& metadata = stream.pending_frames.front();
+        const ScaledBuffer& scaled = stream.pending_scaled.front();
+        const double diff = metadata.timestamp - scaled.timestamp;
+        
+        if (std::abs(diff) <= tolerance_s) {
+            // Attach the scaled plane and publish the pair
+            const BufferInfo& buffer = stream.buffers[scaled.index];
+            metadata.scaled_buffer_ptr = buffer.start;
+            metadata.scaled_buffer_size = scaled.bytesused;
+            metadata.scaled_dma_fd = buffer.dma_fd;
+            metadata.scaled_width = config.scaled_width;
+            metadata.scaled_height = config.scaled_height;
+            metadata.scaled_stride = stream.stride;
+            
+            PublishFrame(metadata);
+            stream.pending_frames.pop_front();
+            stream.pending_scaled.pop_front();
+        } else if (diff > 0) {
+            // Older than every pending frame, the primary path dropped its frame
+            QueueScaledBuffer(camera_id, scaled.index);
+            stream.pending_scaled.pop_front();
+        } else {
+            // The scaled path dropped this frame, publish it on its own
+            mQueueCounters[camera_id]->missing_scaled_plane++;
+            PublishFrame(metadata);
+            stream.pending_frames.pop_front();
+        }
+    }
+    
+    // Never hold a frame back longer than it takes the next one to arrive
+    while (stream.pending_frames.size() > kMaxPendingFrames) {
+        mQueueCounters[camera_id]->missing_scaled_plane++;
+        PublishFrame(stream.pending_frames.front());
+        stream.pending_frames.pop_front();
+    }
+    
+    while (stream.pending_scaled.size() > kMaxPendingScaledBuffers) {
+        QueueScaledBuffer(camera_id, stream.pending_scaled.front().index);
+        stream.pending_scaled.pop_front();
+    }
+}
+
+void ZeroCopyFrameProvider::DisableScaledStream(int camera_id)
+{
+    ScaledStream& stream = mScaledStreams[camera_id];
+    stream.active = false;
+    
+    // The scaler is gone, its held buffers are reclaimed by StopStreaming
+    stream.pending_scaled.clear();
+    
+    while (!stream.pending_frames.empty()) {
+        mQueueCounters[camera_id]->missing_scaled_plane++;
+        PublishFrame(stream.pending_frames.front());
+        stream.pending_frames.pop_front();
+    }
+}
+
+bool ZeroCopyFrameProvider::CreateReactor()
+{
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        SetErrorMessage("Failed to create epoll instance: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    for (size_t i = 0; i < mCameraHandles.size(); ++i) {
+        if (mCameraHandles[i] < 0) {
+            continue;
+        }
+        
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = static_cast<uint32_t>(i);
+        
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mCameraHandles[i], &ev) < 0) {
+            SetErrorMessage("Failed to add camera to epoll set: " + std::string(strerror(errno)));
+            DestroyReactor();
+            return false;
+        }
+        
+        if (mScaledStreams[i].active) {
+            ev.data.u32 = static_cast<uint32_t>(i) | kScaledStreamTag;
+            
+            if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mScaledStreams[i].handle, &ev) < 0) {
+                SetErrorMessage("Failed to add scaled stream to epoll set: " + std::string(strerror(errno)));
+                DestroyReactor();
+                return false;
+            }
+        }
+        
+        // Slices are signaled by V4L2 events as they land
+        if (mCameraConfigs[i].slice_count > 0 && mAcquisitionStates[i].exposure_fd >= 0) {
+            struct epoll_event sync_ev;
+            memset(&sync_ev, 0, sizeof(sync_ev));
+            sync_ev.events = EPOLLPRI;
+            sync_ev.data.u32 = static_cast<uint32_t>(i) | kSyncEventTag;
+            
+            if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mAcquisitionStates[i].exposure_fd, &sync_ev) < 0) {
+                SetErrorMessage("Failed to add sync subdev to epoll set: " + std::string(strerror(errno)));
+                DestroyReactor();
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+void ZeroCopyFrameProvider::DestroyReactor()
+{
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+}
+
+void ZeroCopyFrameProvider::ApplyThreadScheduling(const CameraConfig& config)
+{
+    if (config.cpu_affinity < 0 && config.realtime_priority <= 0) {
+        ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::CAMERA_ACQUISITION,
+                                                  "ZeroCopyAcq" + std::to_string(config.camera_id));
+        return;
+    }
+    
+    if (config.cpu_affinity >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(config.cpu_affinity, &cpuset);
+        
+        int r = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (r != 0) {
+            SetErrorMessage("Failed to set acquisition thread affinity: " + std::string(strerror(r)));
+        }
+    }
+    
+    if (config.realtime_priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = config.realtime_priority;
+        
+        int r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (r != 0) {
+            SetErrorMessage("Failed to set SCHED_FIFO priority: " + std::string(strerror(r)));
+        }
+    }
+}
+
+void ZeroCopyFrameProvider::CreateFrameQueues()
+{
+    for (size_t i = 0; i < mCameraConfigs.size(); ++i) {
+        // The driver cannot have more frames in flight than it has buffers,
+        // so the ring never overflows and the drop policy stays in charge
+        const size_t capacity = std::max(std::max<size_t>(mBuffers[i].size(), mCameraConfigs[i].buffer_count), size_t(2));
+        if (!mFrameQueues[i] || mFrameQueues[i]->Capacity() < capacity) {
+            mFrameQueues[i].reset(new FrameRing(capacity));
+        }
+        
+        if (mFrameEventFds[i] < 0) {
+            mFrameEventFds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (mFrameEventFds[i] < 0) {
+                SetErrorMessage("Failed to create frame eventfd: " + std::string(strerror(errno)));
+            }
+        }
+    }
+}
+
+void ZeroCopyFrameProvider::ApplyDropPolicy(int camera_id)
+{
+    const CameraConfig& config = mCameraConfigs[camera_id];
+    if (config.drop_policy == FrameDropPolicy::QUEUE_ALL || !mFrameQueues[camera_id]) {
+        return;
+    }
+    
+    FrameRing& queue = *mFrameQueues[camera_id];
+    const double now = MonotonicNowSeconds();
+    
+    while (FrameMetadata* head = queue.Front()) {
+        bool stale;
+        if (config.drop_policy == FrameDropPolicy::LATEST_ONLY) {
+            // Stale as soon as a newer frame is queued behind it
+            stale = queue.Size() > 1;
+        } else {
+            stale = (now - head->timestamp) * 1000.0 > config.max_frame_age_ms;
+        }
+        
+        if (!stale) {
             break;
         }
         
-        // Mark buffer as in use
-        mBuffers[camera_id][buf.index].in_use = true;
+        // Hand the stale buffer straight back to the driver
+        FrameMetadata metadata = *head;
+        queue.Pop();
+        mQueueCounters[camera_id]->dropped_stale++;
+        ReleaseFrame(metadata);
+    }
+}
+
+void ZeroCopyFrameProvider::RecordFrameConsumed(const FrameMetadata& metadata)
+{
+    QueueCounters& counters = *mQueueCounters[metadata.camera_id];
+    
+    const double age_s = std::max(MonotonicNowSeconds() - metadata.timestamp, 0.0);
+    const uint64_t age_us = static_cast<uint64_t>(age_s * 1000000.0);
+    
+    counters.frames_consumed++;
+    counters.last_frame_age_us = age_us;
+    counters.total_frame_age_us += age_us;
+    if (age_us > counters.max_frame_age_us) {
+        counters.max_frame_age_us = age_us;
+    }
+}
+
+void ZeroCopyFrameProvider::ClearFrameQueues()
+{
+    // Only valid once the producers have been joined. Streaming is already
+    // off, so the driver owns all buffers again and StartStreaming re-queues them.
+    for (size_t i = 0; i < mFrameQueues.size(); ++i) {
+        if (mFrameQueues[i]) {
+            FrameMetadata metadata;
+            while (mFrameQueues[i]->TryPop(metadata)) {
+            }
+        }
+        
+        for (auto& buffer : mBuffers[i]) {
+            buffer.in_use = false;
+            buffer.refs = 0;
+        }
         
-        // Create frame metadata
-        FrameMetadata metadata;
-        metadata.frame_id = frame_counter++;
-        metadata.timestamp = buf.timestamp.tv_sec + buf.timestamp.tv_usec / 1000000.0;
-        metadata.camera_id = camera_id;
-        metadata.width = mCameraConfigs[camera_id].width;
-        metadata.height = mCameraConfigs[camera_id].height;
-        metadata.pixel_format = mCameraConfigs[camera_id].pixel_format;
-        metadata.buffer_ptr = mBuffers[camera_id][buf.index].start;
-        metadata.buffer_size = buf.bytesused;
-        metadata.dma_fd = mBuffers[camera_id][buf.index].dma_fd;
-        metadata.is_keyframe = (buf.flags & V4L2_BUF_FLAG_KEYFRAME) != 0;
-        
-        // Update frame rate
-        auto now = std::chrono::steady_clock::now();
-        auto frame_interval = std::chrono::duration_cast<std::chrono::microseconds>(now - last_frame_time).count();
-        last_frame_time = now;
-        
-        auto fps_update_interval = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_fps_update).count();
-        if (fps_update_interval > 1000) {
-            // Update FPS every second
-            mCurrentFrameRates[camera_id] = mFrameCounters[camera_id] * 1000.0f / fps_update_interval;
-            mFrameCounters[camera_id] = 0;
-            last_fps_update = now;
+        mScaledStreams[i].pending_frames.clear();
+        mScaledStreams[i].pending_scaled.clear();
+        for (auto& buffer : mScaledStreams[i].buffers) {
+            buffer.in_use = false;
+        }
+        
+        if (mFrameEventFds[i] >= 0) {
+            uint64_t value;
+            ssize_t ignored = read(mFrameEventFds[i], &value, sizeof(value));
+            (void)ignored;
+        }
+    }
+    
+    // The frames queued for subscribers went back with the buffers
+    std::lock_guard<std::mutex> lock(mSubscribersMutex);
+    for (const auto& subscriber : mSubscribers) {
+        std::lock_guard<std::mutex> subscriber_lock(subscriber->mutex);
+        subscriber->frames.clear();
+    }
+}
+
+bool ZeroCopyFrameProvider::WaitForFrameEvent(const std::vector<int>& camera_ids, int timeout_ms)
+{
+    struct pollfd fds[8];
+    std::vector<struct pollfd> fd_storage;
+    struct pollfd* pfds = fds;
+    if (camera_ids.size() > sizeof(fds) / sizeof(fds[0])) {
+        fd_storage.resize(camera_ids.size());
+        pfds = fd_storage.data();
+    }
+    
+    nfds_t nfds = 0;
+    for (int camera_id : camera_ids) {
+        if (mFrameEventFds[camera_id] >= 0) {
+            pfds[nfds].fd = mFrameEventFds[camera_id];
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            ++nfds;
+        }
+    }
+    
+    if (nfds == 0) {
+        return false;
+    }
+    
+    int r = poll(pfds, nfds, timeout_ms);
+    if (r <= 0) {
+        if (r < 0 && errno != EINTR) {
+            SetErrorMessage("Poll error: " + std::string(strerror(errno)));
+        }
+        return false;
+    }
+    
+    // Reset the event counters; the rings are re-checked by the caller
+    for (nfds_t i = 0; i < nfds; ++i) {
+        if (pfds[i].revents & POLLIN) {
+            uint64_t value;
+            ssize_t ignored = read(pfds[i].fd, &value, sizeof(value));
+            (void)ignored;
+        }
+    }
+    
+    return true;
+}
+
+void ZeroCopyFrameProvider::SignalFrameEvent(int camera_id)
+{
+    if (mFrameEventFds[camera_id] >= 0) {
+        const uint64_t one = 1;
+        ssize_t ignored = write(mFrameEventFds[camera_id], &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void ZeroCopyFrameProvider::RecordFrame(const FrameMetadata& metadata)
+{
+    CaptureFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.frame_id = metadata.frame_id;
+    frame.timestamp = metadata.timestamp;
+    frame.camera_id = metadata.camera_id;
+    frame.width = metadata.width;
+    frame.height = metadata.height;
+    frame.is_keyframe = metadata.is_keyframe;
+    frame.data = metadata.buffer_ptr;
+    frame.size = metadata.buffer_size;
+    
+    if (metadata.scaled_buffer_ptr) {
+        frame.scaled_width = metadata.scaled_width;
+        frame.scaled_height = metadata.scaled_height;
+        frame.scaled_stride = metadata.scaled_stride;
+        frame.scaled_data = metadata.scaled_buffer_ptr;
+        frame.scaled_size = metadata.scaled_buffer_size;
+    }
+    
+    // Make the device writes visible before the buffers are read on the CPU
+    SyncDmaBuffer(metadata.dma_fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+    SyncDmaBuffer(metadata.scaled_dma_fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+    
+    if (!mRecorder.WriteFrame(frame)) {
+        SetErrorMessage(mRecorder.GetLastErrorMessage());
+    }
+    
+    SyncDmaBuffer(metadata.scaled_dma_fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+    SyncDmaBuffer(metadata.dma_fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+}
+
+bool ZeroCopyFrameProvider::InitializeReplay()
+{
+    if (!mReplayReader.Open(mReplayPath)) {
+        SetErrorMessage(mReplayReader.GetLastErrorMessage());
+        return false;
+    }
+    
+    const std::vector<CaptureCameraInfo>& cameras = mReplayReader.GetCameras();
+    if (cameras.size() != mCameraConfigs.size()) {
+        SetErrorMessage("Capture file holds " + std::to_string(cameras.size()) +
+                       " cameras, expected " + std::to_string(mCameraConfigs.size()));
+        mReplayReader.Close();
+        return false;
+    }
+    
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        CameraConfig& config = mCameraConfigs[i];
+        config.width = cameras[i].width;
+        config.height = cameras[i].height;
+        config.fps = cameras[i].fps;
+        config.pixel_format = std::string(cameras[i].pixel_format,
+                                          strnlen(cameras[i].pixel_format, sizeof(cameras[i].pixel_format)));
+        
+        // Replayed cameras hold a descriptor of the capture file so the
+        // open/closed bookkeeping is the same as for live cameras
+        int fd = open(mReplayPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            SetErrorMessage("Failed to open capture file: " + mReplayPath + " - " + std::string(strerror(errno)));
+            for (size_t j = 0; j < i; ++j) {
+                CloseCamera(j);
+            }
+            mReplayReader.Close();
+            return false;
+        }
+        mCameraHandles[i] = fd;
+    }
+    
+    return true;
+}
+
+void ZeroCopyFrameProvider::ReplayThreadFunc()
+{
+    // Set thread name and scheduling; like the reactor, the replay thread
+    // serves all cameras and uses the scheduling settings of the first camera
+    pthread_setname_np(pthread_self(), "ZeroCopyReplay");
+    if (!mCameraConfigs.empty()) {
+        ApplyThreadScheduling(mCameraConfigs[0]);
+    }
+    
+    CaptureFrame frame;
+    if (!mReplayReader.GetFrame(0, frame)) {
+        mReplayFinished = true;
+        return;
+    }
+    const double replay_start = frame.timestamp + mReplayTimeOffset;
+    
+    // Frames are stored in publication order
+    for (size_t i = 0; mRunning && mReplayReader.GetFrame(i, frame); ++i) {
+        const int camera_id = frame.camera_id;
+        if (camera_id < 0 || camera_id >= static_cast<int>(mCameraConfigs.size())) {
+            continue;
+        }
+        
+        const double timestamp = frame.timestamp + mReplayTimeOffset;
+        
+        if (mReplayRate > 0.0f) {
+            // Pace frames by their recorded timestamps
+            const double due = replay_start + (timestamp - replay_start) / mReplayRate;
+            double wait_s;
+            while (mRunning && (wait_s = due - MonotonicNowSeconds()) > 0.0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(std::min(wait_s, kReactorTimeoutMs / 1000.0)));
+            }
         } else {
-            mFrameCounters[camera_id]++;
+            // Free-running: wait for the consumer instead of dropping frames
+            const FrameRing& queue = *mFrameQueues[camera_id];
+            while (mRunning && queue.Size() >= queue.Capacity()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(kReplayBackoffUs));
+            }
         }
         
-        // Add frame to queue
-        {
-            std::lock_guard<std::mutex> lock(mFrameQueueMutex);
-            mFrameQueues[camera_id].push(metadata);
+        if (!mRunning) {
+            return;
         }
         
-        // Notify waiting threads
-        mFrameCondition.notify_all();
+        // Serve the frame straight out of the file mapping
+        FrameMetadata metadata;
+        metadata.frame_id = frame.frame_id;
+        metadata.timestamp = timestamp;
+        metadata.camera_id = camera_id;
+        metadata.width = frame.width;
+        metadata.height = frame.height;
+        metadata.pixel_format = mCameraConfigs[camera_id].pixel_format;
+        metadata.buffer_ptr = const_cast<void*>(frame.data);
+        metadata.buffer_size = frame.size;
+        metadata.dma_fd = -1;
+        metadata.is_keyframe = frame.is_keyframe;
+        metadata.latency.Set(LatencyStage::EXPOSURE_MID, timestamp);
+        metadata.latency.Stamp(LatencyStage::DQBUF);
         
-        // Call frame callback if registered
-        if (mFrameCallback) {
-            mFrameCallback(metadata);
+        if (frame.scaled_data) {
+            metadata.scaled_buffer_ptr = const_cast<void*>(frame.scaled_data);
+            metadata.scaled_buffer_size = frame.scaled_size;
+            metadata.scaled_width = frame.scaled_width;
+            metadata.scaled_height = frame.scaled_height;
+            metadata.scaled_stride = frame.scaled_stride;
         }
+        
+        UpdateFrameRate(camera_id);
+        PublishFrame(metadata);
     }
+    
+    // Only a replay that reached the end of the file is finished
+    mReplayFinished = mRunning.load();
 }
 
 void ZeroCopyFrameProvider::SetErrorMessage(const std::string& message)
@@ -993,4 +3236,27 @@ int ZeroCopyFrameProvider::ExportDmaBuffer(int camera_id, int buffer_index)
     return expbuf.fd;
 }
 
+bool ZeroCopyFrameProvider::SyncDmaBuffer(int dma_fd, uint64_t flags)
+{
+    // Buffers without a DMA-BUF export are kept coherent by the V4L2 driver
+    if (dma_fd < 0) {
+        return true;
+    }
+    
+    struct dma_buf_sync sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.flags = flags;
+    
+    while (ioctl(dma_fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            continue;
+        }
+        
+        SetErrorMessage("Failed to sync DMA buffer: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    return true;
+}
+
 } // namespace ORB_SLAM3
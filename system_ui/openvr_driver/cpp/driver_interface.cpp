@@ -1,22 +1,215 @@
 //! C++ implementation of the OpenVR driver interface
 
 #include <openvr_driver.h>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <ctime>
 #include <vector>
 #include <string>
 #include <memory>
+#include <thread>
+
+#include "../../../include/shared_pose_export.hpp"
+
+// Frame batch layout, must match FrameDevicePose, FrameComponent and FrameBatch in types.rs
+constexpr uint32_t kFrameBatchMaxDevices = 16;
+constexpr uint32_t kFrameBatchMaxComponents = 64;
+constexpr uint32_t kFrameComponentBoolean = 0;
+constexpr uint32_t kFrameComponentScalar = 1;
+
+struct FrameDevicePose {
+    uint32_t device_index;
+    uint8_t device_is_connected;
+    uint8_t pose_is_valid;
+    uint8_t device_is_tracking;
+    uint8_t reserved;
+    float position[3];
+    float rotation[4];          // x, y, z, w
+    float velocity[3];
+    float angular_velocity[3];
+};
+
+struct FrameComponent {
+    uint64_t handle;
+    uint32_t kind;
+    float value;
+};
+
+struct FrameBatch {
+    FrameDevicePose* devices;
+    uint32_t device_capacity;
+    uint32_t device_count;
+    FrameComponent* components;
+    uint32_t component_capacity;
+    uint32_t component_count;
+};
+
+static_assert(sizeof(FrameDevicePose) == 60, "FrameDevicePose layout differs from types.rs");
+static_assert(sizeof(FrameComponent) == 16, "FrameComponent layout differs from types.rs");
 
 // Forward declarations for the Rust FFI functions
 extern "C" {
     void* vr_driver_get_server_provider();
     int vr_driver_init(void* context, void* driver_log, void* driver_host, void* driver_input, void* driver_properties, void* driver_settings);
     int vr_driver_run_frame();
+    int vr_driver_run_frame_batched(FrameBatch* batch);
+    uint32_t vr_driver_get_hmd_device_index();
     int vr_driver_cleanup();
     int vr_driver_enter_standby();
     int vr_driver_leave_standby();
     const char* const* vr_driver_get_interface_versions();
 }
 
+// Pushes each SLAM pose to SteamVR as soon as it is published, independent of RunFrame
+class CSlamPosePusher {
+public:
+    CSlamPosePusher() : m_reader("/vr_slam_pose"), m_deviceIndex(vr::k_unTrackedDeviceIndexInvalid), m_running(false) {}
+    
+    ~CSlamPosePusher() {
+        Stop();
+    }
+    
+    void Start(uint32_t deviceIndex) {
+        if (m_running || deviceIndex == vr::k_unTrackedDeviceIndexInvalid) {
+            return;
+        }
+        
+        m_deviceIndex = deviceIndex;
+        m_running = true;
+        m_thread = std::thread(&CSlamPosePusher::Run, this);
+    }
+    
+    // Device whose poses this thread sends, invalid when stopped
+    uint32_t GetDeviceIndex() const {
+        return m_running ? m_deviceIndex : vr::k_unTrackedDeviceIndexInvalid;
+    }
+    
+    void Stop() {
+        m_running = false;
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_reader.Close();
+    }
+    
+private:
+    // VRSLAMSystem::Status values in SharedPoseSample::tracking_state
+    static constexpr int32_t kStatusInitializing = 1;
+    static constexpr int32_t kStatusTracking = 2;
+    
+    // Wakes at least this often to notice Stop()
+    static constexpr int kWaitTimeoutMs = 100;
+    
+    // Remap the region after this many empty waits, the SLAM process may have restarted
+    static constexpr int kReopenAfterTimeouts = 10;
+    
+    static double MonotonicNow() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+    
+    void Run() {
+        uint64_t seen = 0;
+        int timeouts = 0;
+        
+        while (m_running) {
+            if (!m_reader.IsOpen()) {
+                if (!m_reader.Open()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(kWaitTimeoutMs));
+                    continue;
+                }
+                seen = 0;
+                timeouts = 0;
+            }
+            
+            // A restarted writer counts from zero again
+            if (m_reader.GetWriteCount() < seen) {
+                seen = 0;
+            }
+            
+            if (!m_reader.WaitForSample(seen, kWaitTimeoutMs)) {
+                if (++timeouts >= kReopenAfterTimeouts) {
+                    m_reader.Close();
+                }
+                continue;
+            }
+            timeouts = 0;
+            
+            ORB_SLAM3::SharedPoseSample sample;
+            if (!m_reader.ReadLatest(sample)) {
+                continue;
+            }
+            seen = sample.sequence + 1;
+            
+            vr::DriverPose_t pose = ToDriverPose(sample, MonotonicNow());
+            vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_deviceIndex, pose, sizeof(vr::DriverPose_t));
+        }
+    }
+    
+    // Tcw in the camera frame (x right, y down, z forward) to the head pose in
+    // OpenVR's frame (x right, y up, z backward): flipping y and z turns the
+    // inverse rotation (-x, -y, -z, w) into (-x, y, z, w)
+    static vr::DriverPose_t ToDriverPose(const ORB_SLAM3::SharedPoseSample& sample, double now) {
+        vr::DriverPose_t pose = {};
+        pose.qWorldFromDriverRotation.w = 1.0;
+        pose.qDriverFromHeadRotation.w = 1.0;
+        
+        const double qx = sample.rotation[0];
+        const double qy = sample.rotation[1];
+        const double qz = sample.rotation[2];
+        const double qw = sample.rotation[3];
+        pose.qRotation.x = -qx;
+        pose.qRotation.y = qy;
+        pose.qRotation.z = qz;
+        pose.qRotation.w = qw;
+        
+        // Rcw as a matrix, the camera centre is -Rcw^T t
+        const double r[3][3] = {
+            {1 - 2 * (qy * qy + qz * qz), 2 * (qx * qy - qz * qw), 2 * (qx * qz + qy * qw)},
+            {2 * (qx * qy + qz * qw), 1 - 2 * (qx * qx + qz * qz), 2 * (qy * qz - qx * qw)},
+            {2 * (qx * qz - qy * qw), 2 * (qy * qz + qx * qw), 1 - 2 * (qx * qx + qy * qy)}};
+        const float* t = sample.translation;
+        const float* w = sample.angular_velocity;
+        const double sign[3] = {1.0, -1.0, -1.0};
+        for (int i = 0; i < 3; ++i) {
+            const double centre = -(r[0][i] * t[0] + r[1][i] * t[1] + r[2][i] * t[2]);
+            const double angular = r[0][i] * w[0] + r[1][i] * w[1] + r[2][i] * w[2];
+            pose.vecPosition[i] = sign[i] * centre;
+            pose.vecVelocity[i] = sign[i] * sample.linear_velocity[i];
+            pose.vecAngularVelocity[i] = sign[i] * angular;
+        }
+        
+        // Negative: the pose is from the past, SteamVR extrapolates it to the photon time
+        pose.poseTimeOffset = sample.timestamp - now;
+        
+        switch (sample.tracking_state) {
+        case kStatusTracking:
+            pose.result = vr::TrackingResult_Running_OK;
+            pose.poseIsValid = true;
+            break;
+        case kStatusInitializing:
+            pose.result = vr::TrackingResult_Calibrating_InProgress;
+            pose.poseIsValid = false;
+            break;
+        default:
+            pose.result = vr::TrackingResult_Running_OutOfRange;
+            pose.poseIsValid = false;
+            break;
+        }
+        pose.deviceIsConnected = true;
+        
+        return pose;
+    }
+    
+    ORB_SLAM3::SharedPoseReader m_reader;
+    uint32_t m_deviceIndex;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+};
+
 // Server tracked device provider implementation
 class CServerTrackedDeviceProvider : public vr::IServerTrackedDeviceProvider {
 public:
@@ -44,11 +237,15 @@ public:
         }
         
         m_initialized = true;
+        
+        // Poses go out from their own thread, RunFrame handles events and input only
+        m_posePusher.Start(vr_driver_get_hmd_device_index());
         return vr::VRInitError_None;
     }
     
     virtual void Cleanup() override {
         if (m_initialized) {
+            m_posePusher.Stop();
             vr_driver_cleanup();
             m_initialized = false;
         }
@@ -59,8 +256,34 @@ public:
     }
     
     virtual void RunFrame() override {
-        if (m_initialized) {
-            vr_driver_run_frame();
+        if (!m_initialized) {
+            return;
+        }
+        
+        // One call into Rust per frame, the buffers are reused
+        FrameBatch batch = {m_framePoses.data(), kFrameBatchMaxDevices, 0,
+                            m_frameComponents.data(), kFrameBatchMaxComponents, 0};
+        if (vr_driver_run_frame_batched(&batch) != 0) {
+            return;
+        }
+        
+        const uint32_t pushedDevice = m_posePusher.GetDeviceIndex();
+        for (uint32_t i = 0; i < batch.device_count; ++i) {
+            const FrameDevicePose& device = m_framePoses[i];
+            if (device.device_index == vr::k_unTrackedDeviceIndexInvalid || device.device_index == pushedDevice) {
+                continue;
+            }
+            vr::DriverPose_t pose = ToDriverPose(device);
+            vr::VRServerDriverHost()->TrackedDevicePoseUpdated(device.device_index, pose, sizeof(vr::DriverPose_t));
+        }
+        
+        for (uint32_t i = 0; i < batch.component_count; ++i) {
+            const FrameComponent& component = m_frameComponents[i];
+            if (component.kind == kFrameComponentBoolean) {
+                vr::VRDriverInput()->UpdateBooleanComponent(component.handle, component.value != 0.0f, 0.0);
+            } else if (component.kind == kFrameComponentScalar) {
+                vr::VRDriverInput()->UpdateScalarComponent(component.handle, component.value, 0.0);
+            }
         }
     }
     
@@ -81,7 +304,29 @@ public:
     }
     
 private:
+    static vr::DriverPose_t ToDriverPose(const FrameDevicePose& device) {
+        vr::DriverPose_t pose = {};
+        pose.qWorldFromDriverRotation.w = 1.0;
+        pose.qDriverFromHeadRotation.w = 1.0;
+        pose.qRotation.x = device.rotation[0];
+        pose.qRotation.y = device.rotation[1];
+        pose.qRotation.z = device.rotation[2];
+        pose.qRotation.w = device.rotation[3];
+        for (int i = 0; i < 3; ++i) {
+            pose.vecPosition[i] = device.position[i];
+            pose.vecVelocity[i] = device.velocity[i];
+            pose.vecAngularVelocity[i] = device.angular_velocity[i];
+        }
+        pose.result = device.device_is_tracking ? vr::TrackingResult_Running_OK : vr::TrackingResult_Running_OutOfRange;
+        pose.poseIsValid = device.pose_is_valid != 0;
+        pose.deviceIsConnected = device.device_is_connected != 0;
+        return pose;
+    }
+    
     bool m_initialized;
+    CSlamPosePusher m_posePusher;
+    std::array<FrameDevicePose, kFrameBatchMaxDevices> m_framePoses;
+    std::array<FrameComponent, kFrameBatchMaxComponents> m_frameComponents;
 };
 
 // Factory function to create the server tracked device provider
@@ -7,7 +7,7 @@ use crate::device::{VRDevice, BaseDevice};
 use crate::tracking::{TrackingProvider, TrackingDataProvider, SLAMInterface};
 use crate::input::{InputHandler, InputInterface};
 use crate::settings::{SettingsManager, SettingsInterface, ConfigInterface};
-use crate::types::{DeviceType, DriverSettings, Pose};
+use crate::types::{DeviceType, DriverSettings, Pose, FrameDevicePose, FrameComponent};
 use crate::error::{Result, Error};
 use crate::utils;
 
@@ -161,6 +161,41 @@ impl DriverCore {
         Ok(())
     }
     
+    /// Run a frame update and pack every device pose and input change into caller buffers
+    ///
+    /// Returns the number of poses and component updates written. Nothing is
+    /// allocated, so the whole frame crosses the FFI boundary in one call.
+    pub fn run_frame_batched(
+        &mut self,
+        poses: &mut [FrameDevicePose],
+        components: &mut [FrameComponent],
+    ) -> Result<(usize, usize)> {
+        if let Ok(mut input_handler) = self.input_handler.lock() {
+            input_handler.set_batched(true);
+        }
+        
+        self.run_frame()?;
+        
+        let mut pose_count = 0;
+        let devices = self.devices.read();
+        for device in devices.iter() {
+            if pose_count == poses.len() {
+                break;
+            }
+            if let Ok(device) = device.lock() {
+                poses[pose_count] = FrameDevicePose::from_pose(device.get_device_index(), &device.get_pose());
+                pose_count += 1;
+            }
+        }
+        
+        let component_count = match self.input_handler.lock() {
+            Ok(mut input_handler) => input_handler.drain_batch(components),
+            Err(_) => 0,
+        };
+        
+        Ok((pose_count, component_count))
+    }
+    
     /// Process OpenVR events
     fn process_openvr_events(&mut self) -> Result<()> {
         // In a real implementation, this would poll events from OpenVR
@@ -240,6 +275,20 @@ impl DriverCore {
         self.add_device(controller)
     }
     
+    /// Get the OpenVR index of the HMD, u32::MAX if none is registered
+    pub fn get_hmd_device_index(&self) -> u32 {
+        let devices = self.devices.read();
+        for device in devices.iter() {
+            if let Ok(device) = device.lock() {
+                if device.get_device_class() == crate::device::DeviceClass::HMD {
+                    return device.get_device_index();
+                }
+            }
+        }
+        
+        u32::MAX
+    }
+    
     /// Log a message
     pub fn log(&self, message: &str) -> Result<()> {
         utils::log_message(self.driver_log, message)
@@ -5,6 +5,7 @@ use std::os::raw::{c_char, c_int, c_void};
 use std::sync::{Arc, Mutex};
 use crate::driver::DriverCore;
 use crate::error::{Result, Error};
+use crate::types::FrameBatch;
 use crate::DRIVER;
 
 /// FFI exports for the OpenVR driver
@@ -89,6 +90,66 @@ pub mod exports {
         })
     }
     
+    /// Run a frame update and fill the caller's pose and input buffers in one call
+    #[no_mangle]
+    pub extern "C" fn vr_driver_run_frame_batched(batch: *mut FrameBatch) -> c_int {
+        if batch.is_null() {
+            return 1;
+        }
+        
+        // The C++ shim owns the buffers for the lifetime of the call
+        let batch = unsafe { &mut *batch };
+        batch.device_count = 0;
+        batch.component_count = 0;
+        if batch.devices.is_null() || batch.components.is_null() {
+            return 1;
+        }
+        let poses = unsafe { std::slice::from_raw_parts_mut(batch.devices, batch.device_capacity as usize) };
+        let components = unsafe {
+            std::slice::from_raw_parts_mut(batch.components, batch.component_capacity as usize)
+        };
+        
+        DRIVER.with(|driver| {
+            if let Some(driver_arc) = driver.get() {
+                if let Ok(mut driver) = driver_arc.lock() {
+                    match driver.run_frame_batched(poses, components) {
+                        Ok((pose_count, component_count)) => {
+                            batch.device_count = pose_count as u32;
+                            batch.component_count = component_count as u32;
+                            0 // Success
+                        },
+                        Err(e) => {
+                            // Log error
+                            let _ = driver.log(&format!("Failed to run frame: {:?}", e));
+                            
+                            1 // Error
+                        }
+                    }
+                } else {
+                    1 // Failed to lock driver
+                }
+            } else {
+                1 // Driver not initialized
+            }
+        })
+    }
+    
+    /// Get the OpenVR index of the HMD, for the C++ pose thread
+    #[no_mangle]
+    pub extern "C" fn vr_driver_get_hmd_device_index() -> u32 {
+        DRIVER.with(|driver| {
+            if let Some(driver_arc) = driver.get() {
+                if let Ok(driver) = driver_arc.lock() {
+                    driver.get_hmd_device_index()
+                } else {
+                    u32::MAX // Failed to lock driver
+                }
+            } else {
+                u32::MAX // Driver not initialized
+            }
+        })
+    }
+    
     /// Clean up the driver
     #[no_mangle]
     pub extern "C" fn vr_driver_cleanup() {
@@ -2,7 +2,8 @@
 
 use std::collections::HashMap;
 use std::sync::{Arc, Mutex};
-use crate::types::{Button, ButtonState, Axis};
+use crate::types::{Button, ButtonState, Axis, FrameComponent, FRAME_BATCH_MAX_COMPONENTS,
+    FRAME_COMPONENT_BOOLEAN, FRAME_COMPONENT_SCALAR};
 use crate::error::{Result, Error};
 
 /// Interface for input handling
@@ -15,6 +16,14 @@ pub trait InputInterface: Send + Sync {
     
     /// Trigger haptic pulse
     fn trigger_haptic_pulse(&mut self, device_serial: &str, duration_micros: u16, frequency: u16, amplitude: f32) -> Result<()>;
+    
+    /// Queue component updates for the frame batch instead of sending each one
+    fn set_batched(&mut self, _batched: bool) {}
+    
+    /// Move the queued component updates into out, returns how many were written
+    fn drain_batch(&mut self, _out: &mut [FrameComponent]) -> usize {
+        0
+    }
 }
 
 /// Input handler for OpenVR
@@ -30,6 +39,12 @@ pub struct InputHandler {
     
     /// Map of device serials to their axis states
     axis_states: HashMap<String, HashMap<Axis, (f32, f32)>>,
+    
+    /// Whether component updates go out with the frame batch
+    batched: bool,
+    
+    /// Component updates since the last batch, one per handle, preallocated
+    pending: Vec<FrameComponent>,
 }
 
 // FFI functions for input handling
@@ -70,9 +85,27 @@ impl InputHandler {
             device_handles: HashMap::new(),
             button_states: HashMap::new(),
             axis_states: HashMap::new(),
+            batched: false,
+            pending: Vec::with_capacity(FRAME_BATCH_MAX_COMPONENTS),
         }
     }
     
+    /// Queue a component update, replacing an older one for the same handle
+    fn queue_component(&mut self, handle: u64, kind: u32, value: f32) -> Result<()> {
+        if let Some(update) = self.pending.iter_mut().find(|update| update.handle == handle) {
+            update.value = value;
+            return Ok(());
+        }
+        
+        // Never grow past the preallocated capacity
+        if self.pending.len() == FRAME_BATCH_MAX_COMPONENTS {
+            return Err(Error::FFIError("Frame batch is full".to_string()));
+        }
+        
+        self.pending.push(FrameComponent { handle, kind, value });
+        Ok(())
+    }
+    
     /// Register a device for input handling
     pub fn register_device(&mut self, serial: &str, device_handle: u32) {
         self.device_handles.insert(serial.to_string(), device_handle);
@@ -109,6 +142,11 @@ impl InputInterface for InputHandler {
             return Err(Error::InvalidDeviceIndex(0));
         }
         
+        if self.batched {
+            return self.queue_component(button.component_handle, FRAME_COMPONENT_BOOLEAN,
+                                        if state.pressed { 1.0 } else { 0.0 });
+        }
+        
         // Update through OpenVR
         let success = unsafe {
             ffi::openvr_update_boolean_component(
@@ -140,6 +178,14 @@ impl InputInterface for InputHandler {
             return Err(Error::InvalidDeviceIndex(0));
         }
         
+        if self.batched {
+            self.queue_component(axis.x_handle, FRAME_COMPONENT_SCALAR, x)?;
+            if axis.has_y {
+                self.queue_component(axis.y_handle, FRAME_COMPONENT_SCALAR, y)?;
+            }
+            return Ok(());
+        }
+        
         // Update X component through OpenVR
         let success_x = unsafe {
             ffi::openvr_update_scalar_component(
@@ -196,4 +242,17 @@ impl InputInterface for InputHandler {
         
         Ok(())
     }
+    
+    fn set_batched(&mut self, batched: bool) {
+        self.batched = batched;
+    }
+    
+    fn drain_batch(&mut self, out: &mut [FrameComponent]) -> usize {
+        let count = self.pending.len().min(out.len());
+        out[..count].copy_from_slice(&self.pending[..count]);
+        
+        // Updates that did not fit go out with the next frame
+        self.pending.drain(..count);
+        count
+    }
 }
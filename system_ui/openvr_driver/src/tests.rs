@@ -193,6 +193,36 @@ mod tests {
         assert_eq!(stored_state.touched, button_state.touched);
     }
 
+    #[test]
+    fn test_input_handler_batched() {
+        use crate::input::InputInterface;
+        use crate::types::{FrameComponent, FRAME_COMPONENT_BOOLEAN, FRAME_COMPONENT_SCALAR};
+        
+        // Batched updates never reach the null driver_input pointer
+        let mut input_handler = InputHandler::new(std::ptr::null_mut());
+        input_handler.register_device("test_controller", 1);
+        input_handler.set_batched(true);
+        
+        let button = Button { id: 1, component_handle: 10 };
+        let axis = Axis { id: 2, x_handle: 20, y_handle: 21, has_y: true };
+        
+        assert!(input_handler.update_button("test_controller", button, ButtonState { pressed: true, touched: true }).is_ok());
+        assert!(input_handler.update_axis("test_controller", axis, 0.25, -0.5).is_ok());
+        
+        // A second change of the same component replaces the first
+        assert!(input_handler.update_axis("test_controller", axis, 0.75, -0.5).is_ok());
+        
+        let mut out = [FrameComponent::default(); 2];
+        assert_eq!(input_handler.drain_batch(&mut out), 2);
+        assert_eq!(out[0], FrameComponent { handle: 10, kind: FRAME_COMPONENT_BOOLEAN, value: 1.0 });
+        assert_eq!(out[1], FrameComponent { handle: 20, kind: FRAME_COMPONENT_SCALAR, value: 0.75 });
+        
+        // The update that did not fit is kept for the next frame
+        assert_eq!(input_handler.drain_batch(&mut out), 1);
+        assert_eq!(out[0].handle, 21);
+        assert_eq!(input_handler.drain_batch(&mut out), 0);
+    }
+
     #[test]
     fn test_settings_manager() {
         // Create a mock config interface
@@ -112,6 +112,89 @@ pub struct Axis {
     pub has_y: bool,
 }
 
+/// Maximum devices in one frame batch
+pub const FRAME_BATCH_MAX_DEVICES: usize = 16;
+
+/// Maximum input component updates in one frame batch
+pub const FRAME_BATCH_MAX_COMPONENTS: usize = 64;
+
+/// Boolean input component, value is 0.0 or 1.0
+pub const FRAME_COMPONENT_BOOLEAN: u32 = 0;
+
+/// Scalar input component
+pub const FRAME_COMPONENT_SCALAR: u32 = 1;
+
+/// Device pose in a frame batch, mirrored by the C++ shim
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct FrameDevicePose {
+    /// OpenVR device index
+    pub device_index: u32,
+    /// Device is connected
+    pub device_is_connected: u8,
+    /// Pose is valid
+    pub pose_is_valid: u8,
+    /// Device is tracking
+    pub device_is_tracking: u8,
+    /// Padding, zero
+    pub reserved: u8,
+    /// Position [x, y, z] in meters
+    pub position: [f32; 3],
+    /// Rotation as quaternion [x, y, z, w]
+    pub rotation: [f32; 4],
+    /// Linear velocity [x, y, z] in meters per second
+    pub velocity: [f32; 3],
+    /// Angular velocity [x, y, z] in radians per second
+    pub angular_velocity: [f32; 3],
+}
+
+/// Input component update in a frame batch, mirrored by the C++ shim
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct FrameComponent {
+    /// OpenVR component handle
+    pub handle: u64,
+    /// FRAME_COMPONENT_BOOLEAN or FRAME_COMPONENT_SCALAR
+    pub kind: u32,
+    /// Component value
+    pub value: f32,
+}
+
+/// Caller-owned buffers filled by one vr_driver_run_frame_batched() call
+#[repr(C)]
+#[derive(Debug)]
+pub struct FrameBatch {
+    /// Device pose array
+    pub devices: *mut FrameDevicePose,
+    /// Length of the device array
+    pub device_capacity: u32,
+    /// Number of devices written
+    pub device_count: u32,
+    /// Component update array
+    pub components: *mut FrameComponent,
+    /// Length of the component array
+    pub component_capacity: u32,
+    /// Number of component updates written
+    pub component_count: u32,
+}
+
+impl FrameDevicePose {
+    /// Pack a device pose
+    pub fn from_pose(device_index: u32, pose: &Pose) -> Self {
+        Self {
+            device_index,
+            device_is_connected: pose.device_is_connected as u8,
+            pose_is_valid: pose.pose_is_valid as u8,
+            device_is_tracking: pose.device_is_tracking as u8,
+            reserved: 0,
+            position: pose.position,
+            rotation: pose.rotation,
+            velocity: pose.velocity,
+            angular_velocity: pose.angular_velocity,
+        }
+    }
+}
+
 /// Driver settings
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct DriverSettings {
@@ -1,7 +1,8 @@
 //! Monitoring interfaces for the VR headset.
 //!
 //! This module provides monitoring functionality for the VR headset,
-//! including performance, power, network, and storage monitoring.
+//! including performance, power, network, and storage monitoring, and the
+//! telemetry stream of the SLAM process.
 
 use std::sync::{Arc, Mutex};
 
@@ -15,6 +16,7 @@ pub mod power;
 pub mod network;
 pub mod storage;
 pub mod process;
+pub mod slam;
 
 use metrics::{Metric, MetricType, MetricsCollector};
 use performance::PerformanceMonitor as PerfMonitor;
@@ -11,6 +11,7 @@ use log::{debug, error, info, warn};
 use serde::{Deserialize, Serialize};
 
 use super::metrics::{Metric, MetricsCollector, MetricType, MetricValue};
+use super::slam::{SlamTelemetryCollector, DEFAULT_TELEMETRY_NAME};
 
 /// CPU metrics collector.
 #[derive(Debug)]
@@ -545,6 +546,9 @@ impl PerformanceMonitor {
         
         // Thermal metrics collector (collect every 5 seconds)
         self.collectors.push(Arc::new(ThermalMetricsCollector::new(5)));
+        
+        // SLAM telemetry collector (collect every second, published by the SLAM process)
+        self.collectors.push(Arc::new(SlamTelemetryCollector::new(DEFAULT_TELEMETRY_NAME, 1)));
     }
     
     /// Add a collector.
@@ -675,13 +679,14 @@ mod tests {
         assert_eq!(monitor.collectors().len(), 0);
         
         monitor.init_default();
-        assert_eq!(monitor.collectors().len(), 4);
+        assert_eq!(monitor.collectors().len(), 5);
         
         // Check collector types
         assert!(monitor.collectors().iter().any(|c| c.name() == "cpu"));
         assert!(monitor.collectors().iter().any(|c| c.name() == "gpu"));
         assert!(monitor.collectors().iter().any(|c| c.name() == "memory"));
         assert!(monitor.collectors().iter().any(|c| c.name() == "thermal"));
+        assert!(monitor.collectors().iter().any(|c| c.name() == "slam"));
         
         // Add custom collector
         struct TestCollector;
@@ -692,6 +697,6 @@ mod tests {
         }
         
         monitor.add_collector(Arc::new(TestCollector));
-        assert_eq!(monitor.collectors().len(), 5);
+        assert_eq!(monitor.collectors().len(), 6);
     }
 }
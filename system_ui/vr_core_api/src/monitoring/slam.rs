@@ -0,0 +1,456 @@
+//! SLAM telemetry for the VR headset.
+//!
+//! This module reads the telemetry stream the SLAM process publishes into
+//! POSIX shared memory (`SharedTelemetryWriter` in `include/telemetry_export.hpp`)
+//! and turns the newest sample into metrics: per-stage latency percentiles,
+//! queue depths, feature counts, TPU utilization, thermal state and memory.
+//!
+//! The region is a header followed by a ring of seqlocked samples. The layout
+//! below mirrors the C++ structures and must change together with
+//! `kSharedTelemetryVersion`.
+
+use std::collections::HashMap;
+use std::fs::File;
+use std::os::unix::io::AsRawFd;
+use std::ptr;
+use std::sync::atomic::{fence, AtomicU32, AtomicU64, Ordering};
+use std::sync::Mutex;
+use std::time::Duration;
+
+use log::debug;
+
+use super::metrics::{Metric, MetricType, MetricValue, MetricsCollector};
+
+/// Default shared memory name of the stream.
+pub const DEFAULT_TELEMETRY_NAME: &str = "/vr_slam_telemetry";
+
+const TELEMETRY_MAGIC: u32 = 0x4D54_5256; // "VRTM"
+const TELEMETRY_VERSION: u32 = 1;
+const TELEMETRY_SLOTS: usize = 8;
+const MAX_DEVICES: usize = 8;
+const MAX_THERMAL_ZONES: usize = 8;
+const ZONE_NAME_LENGTH: usize = 24;
+const NUM_LATENCY_STAGES: usize = 6;
+const NUM_MEMORY_CATEGORIES: usize = 12;
+
+/// Attempts to read a slot before giving up (a writer that died mid-write leaves it locked).
+const READ_ATTEMPTS: usize = 64;
+
+/// Names of the latency stages, indexed like `LatencyStage`.
+const STAGE_NAMES: [&str; NUM_LATENCY_STAGES] = [
+    "exposure_mid",
+    "dqbuf",
+    "tpu_submit",
+    "tpu_done",
+    "track_done",
+    "pose_published",
+];
+
+/// Names of the memory categories, indexed like `MemoryBreakdown::Category`.
+const MEMORY_CATEGORY_NAMES: [&str; NUM_MEMORY_CATEGORIES] = [
+    "map",
+    "keyframe_keypoints",
+    "keyframe_descriptors",
+    "keyframe_grids",
+    "keyframe_bow",
+    "keyframe_graph",
+    "mappoints",
+    "mappoint_descriptors",
+    "keyframe_database",
+    "vocabulary",
+    "tpu_arenas",
+    "frame_buffers",
+];
+
+/// One telemetry sample, laid out like `SharedTelemetrySample`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SlamTelemetrySample {
+    pub sequence: u64,
+    pub publish_time: f64,
+    pub frames_processed: u64,
+    pub dropped_frames: u64,
+    pub tracking_lost_count: u64,
+    pub fps: f32,
+    pub tracking_state: i32,
+    pub stage_p50_ms: [f32; NUM_LATENCY_STAGES],
+    pub stage_p99_ms: [f32; NUM_LATENCY_STAGES],
+    pub stage_p999_ms: [f32; NUM_LATENCY_STAGES],
+    pub stage_max_ms: [f32; NUM_LATENCY_STAGES],
+    pub end_to_end_p50_ms: f32,
+    pub end_to_end_p99_ms: f32,
+    pub end_to_end_p999_ms: f32,
+    pub end_to_end_max_ms: f32,
+    pub extraction_queue_depth: u32,
+    pub tracking_queue_depth: u32,
+    pub tpu_queue_depth: u32,
+    pub keypoints: u32,
+    pub tracked_points: u32,
+    pub tpu_device_count: u32,
+    pub tpu_utilization: [f32; MAX_DEVICES],
+    pub tpu_rate_fps: [f32; MAX_DEVICES],
+    pub thermal_zone_count: u32,
+    pub cpu_capped_mask: u32,
+    pub thermal_celsius: [f32; MAX_THERMAL_ZONES],
+    pub thermal_zone_type: [[u8; ZONE_NAME_LENGTH]; MAX_THERMAL_ZONES],
+    pub resident_bytes: u64,
+    pub unattributed_bytes: u64,
+    pub paged_out_bytes: u64,
+    pub memory_bytes: [u64; NUM_MEMORY_CATEGORIES],
+}
+
+impl SlamTelemetrySample {
+    /// Get the type of a thermal zone, e.g. "bigcore0-thermal".
+    pub fn thermal_zone_name(&self, zone: usize) -> String {
+        let name = &self.thermal_zone_type[zone];
+        let length = name.iter().position(|&c| c == 0).unwrap_or(name.len());
+        String::from_utf8_lossy(&name[..length]).into_owned()
+    }
+}
+
+const SAMPLE_WORDS: usize = (std::mem::size_of::<SlamTelemetrySample>() + 7) / 8;
+
+/// Seqlocked slot, laid out like `SharedTelemetryRegion::Slot`.
+#[repr(C, align(64))]
+struct Slot {
+    sequence: AtomicU64,
+    words: [AtomicU64; SAMPLE_WORDS],
+}
+
+#[repr(C, align(64))]
+struct CacheLine<T>(T);
+
+/// Shared memory region, laid out like `SharedTelemetryRegion`.
+#[repr(C)]
+struct Region {
+    magic: AtomicU32,
+    version: u32,
+    slot_count: u32,
+    sample_size: u32,
+    write_count: CacheLine<AtomicU64>,
+    notify_word: CacheLine<AtomicU32>,
+    slots: [Slot; TELEMETRY_SLOTS],
+}
+
+/// Read-only mapping of the telemetry region.
+#[derive(Debug)]
+pub struct SlamTelemetryReader {
+    region: *const Region,
+}
+
+// The region is only read through atomics
+unsafe impl Send for SlamTelemetryReader {}
+unsafe impl Sync for SlamTelemetryReader {}
+
+impl SlamTelemetryReader {
+    /// Map the region and check its layout version.
+    ///
+    /// Returns `None` if the region does not exist yet or has another layout.
+    pub fn open(name: &str) -> Option<Self> {
+        let path = format!("/dev/shm/{}", name.trim_start_matches('/'));
+        let file = File::open(&path).ok()?;
+        let size = std::mem::size_of::<Region>();
+        if (file.metadata().ok()?.len() as usize) < size {
+            return None;
+        }
+
+        let addr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                size,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if addr == libc::MAP_FAILED {
+            return None;
+        }
+
+        let reader = Self { region: addr as *const Region };
+        let region = reader.region();
+        if region.magic.load(Ordering::Acquire) != TELEMETRY_MAGIC
+            || region.version != TELEMETRY_VERSION
+            || region.slot_count as usize != TELEMETRY_SLOTS
+            || region.sample_size as usize != std::mem::size_of::<SlamTelemetrySample>()
+        {
+            return None;
+        }
+        Some(reader)
+    }
+
+    fn region(&self) -> &Region {
+        unsafe { &*self.region }
+    }
+
+    /// Check if the writer still publishes into the region.
+    pub fn is_live(&self) -> bool {
+        self.region().magic.load(Ordering::Acquire) == TELEMETRY_MAGIC
+    }
+
+    /// Get the number of samples published so far.
+    pub fn write_count(&self) -> u64 {
+        self.region().write_count.0.load(Ordering::Acquire)
+    }
+
+    /// Read the newest sample without blocking.
+    pub fn read_latest(&self) -> Option<SlamTelemetrySample> {
+        let count = self.write_count();
+        if count == 0 {
+            return None;
+        }
+
+        let slot = &self.region().slots[((count - 1) % TELEMETRY_SLOTS as u64) as usize];
+        let mut words = [0u64; SAMPLE_WORDS];
+        for _ in 0..READ_ATTEMPTS {
+            let before = slot.sequence.load(Ordering::Acquire);
+            if before & 1 != 0 {
+                continue;
+            }
+            for (word, shared) in words.iter_mut().zip(slot.words.iter()) {
+                *word = shared.load(Ordering::Relaxed);
+            }
+            fence(Ordering::Acquire);
+            if slot.sequence.load(Ordering::Relaxed) == before {
+                // Plain integers and floats, any bit pattern is a valid sample
+                return Some(unsafe { ptr::read_unaligned(words.as_ptr() as *const SlamTelemetrySample) });
+            }
+        }
+        None
+    }
+}
+
+impl Drop for SlamTelemetryReader {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.region as *mut libc::c_void, std::mem::size_of::<Region>());
+        }
+    }
+}
+
+/// SLAM telemetry metrics collector.
+#[derive(Debug)]
+pub struct SlamTelemetryCollector {
+    /// Collector name
+    name: String,
+
+    /// Collection interval
+    interval: Duration,
+
+    /// Shared memory name of the stream
+    shm_name: String,
+
+    /// Mapped region, reopened when the SLAM process restarts
+    reader: Mutex<Option<SlamTelemetryReader>>,
+}
+
+impl SlamTelemetryCollector {
+    /// Create a new SLAM telemetry collector.
+    pub fn new(shm_name: &str, interval_secs: u64) -> Self {
+        Self {
+            name: "slam".to_string(),
+            interval: Duration::from_secs(interval_secs),
+            shm_name: shm_name.to_string(),
+            reader: Mutex::new(None),
+        }
+    }
+
+    /// Read the newest sample, mapping the region again if the writer restarted.
+    fn read_sample(&self) -> Option<SlamTelemetrySample> {
+        let mut reader = self.reader.lock().unwrap();
+        if reader.as_ref().map_or(true, |r| !r.is_live()) {
+            *reader = SlamTelemetryReader::open(&self.shm_name);
+            if reader.is_none() {
+                debug!("SLAM telemetry {} not available", self.shm_name);
+            }
+        }
+        reader.as_ref().and_then(|r| r.read_latest())
+    }
+
+    /// Convert a sample to metrics.
+    pub fn sample_metrics(sample: &SlamTelemetrySample) -> Vec<Metric> {
+        let mut metrics = Vec::new();
+
+        let gauge = |metrics: &mut Vec<Metric>, name: &str, value: f64, labels: HashMap<String, String>, desc: &str, unit: Option<&str>| {
+            metrics.push(Metric::new(
+                name,
+                MetricType::Gauge,
+                MetricValue::Float(value),
+                if labels.is_empty() { None } else { Some(labels) },
+                Some(desc),
+                unit,
+            ));
+        };
+        let label = |key: &str, value: &str| {
+            let mut labels = HashMap::new();
+            labels.insert(key.to_string(), value.to_string());
+            labels
+        };
+
+        // Pipeline
+        metrics.push(Metric::new(
+            "slam.frames_processed",
+            MetricType::Counter,
+            MetricValue::Integer(sample.frames_processed as i64),
+            None,
+            Some("Frame sets tracked"),
+            None,
+        ));
+        metrics.push(Metric::new(
+            "slam.dropped_frames",
+            MetricType::Counter,
+            MetricValue::Integer(sample.dropped_frames as i64),
+            None,
+            Some("Frame sets dropped between pipeline stages"),
+            None,
+        ));
+        metrics.push(Metric::new(
+            "slam.tracking_lost",
+            MetricType::Counter,
+            MetricValue::Integer(sample.tracking_lost_count as i64),
+            None,
+            Some("Times tracking was lost"),
+            None,
+        ));
+        metrics.push(Metric::new(
+            "slam.tracking_state",
+            MetricType::State,
+            MetricValue::Integer(sample.tracking_state as i64),
+            None,
+            Some("SLAM system status"),
+            None,
+        ));
+        gauge(&mut metrics, "slam.fps", sample.fps as f64, HashMap::new(), "Frame sets per second", Some("fps"));
+
+        // Latency distributions
+        let percentiles = [
+            ("p50", &sample.stage_p50_ms, sample.end_to_end_p50_ms),
+            ("p99", &sample.stage_p99_ms, sample.end_to_end_p99_ms),
+            ("p999", &sample.stage_p999_ms, sample.end_to_end_p999_ms),
+            ("max", &sample.stage_max_ms, sample.end_to_end_max_ms),
+        ];
+        for (percentile, stages, end_to_end) in percentiles.iter() {
+            // The first stage has no previous stage and stays empty
+            for (stage, value) in STAGE_NAMES.iter().zip(stages.iter()).skip(1) {
+                let mut labels = label("stage", stage);
+                labels.insert("percentile".to_string(), percentile.to_string());
+                gauge(&mut metrics, &format!("slam.latency.{}.{}", stage, percentile), *value as f64,
+                      labels, &format!("{} latency of the {} stage", percentile, stage), Some("ms"));
+            }
+            gauge(&mut metrics, &format!("slam.latency.end_to_end.{}", percentile), *end_to_end as f64,
+                  label("percentile", percentile), &format!("{} exposure to pose latency", percentile), Some("ms"));
+        }
+
+        // Queues and features
+        gauge(&mut metrics, "slam.queue.extraction", sample.extraction_queue_depth as f64,
+              label("queue", "extraction"), "Frame sets waiting for extraction", None);
+        gauge(&mut metrics, "slam.queue.tracking", sample.tracking_queue_depth as f64,
+              label("queue", "tracking"), "Frame sets waiting for tracking", None);
+        gauge(&mut metrics, "slam.queue.tpu", sample.tpu_queue_depth as f64,
+              label("queue", "tpu"), "Frames waiting for a TPU", None);
+        gauge(&mut metrics, "slam.features.keypoints", sample.keypoints as f64, HashMap::new(),
+              "Keypoints of the last frame set", None);
+        gauge(&mut metrics, "slam.features.tracked_points", sample.tracked_points as f64, HashMap::new(),
+              "Tracked map points of the last frame set", None);
+
+        // TPU devices
+        for device in 0..(sample.tpu_device_count as usize).min(MAX_DEVICES) {
+            let id = device.to_string();
+            gauge(&mut metrics, &format!("slam.tpu.{}.utilization", device), sample.tpu_utilization[device] as f64 * 100.0,
+                  label("device", &id), "Fraction of wall time the device was busy", Some("%"));
+            gauge(&mut metrics, &format!("slam.tpu.{}.rate", device), sample.tpu_rate_fps[device] as f64,
+                  label("device", &id), "Frames per second extracted on the device", Some("fps"));
+        }
+
+        // Thermal state
+        for zone in 0..(sample.thermal_zone_count as usize).min(MAX_THERMAL_ZONES) {
+            let zone_name = sample.thermal_zone_name(zone);
+            gauge(&mut metrics, &format!("slam.thermal.{}", zone_name), sample.thermal_celsius[zone] as f64,
+                  label("zone", &zone_name), &format!("{} temperature", zone_name), Some("°C"));
+        }
+        metrics.push(Metric::new(
+            "slam.thermal.capped",
+            MetricType::State,
+            MetricValue::Boolean(sample.cpu_capped_mask != 0),
+            Some(label("cpu_mask", &format!("{:#x}", sample.cpu_capped_mask))),
+            Some("CPU clusters capped below their maximum frequency"),
+            None,
+        ));
+
+        // Memory
+        gauge(&mut metrics, "slam.memory.resident", sample.resident_bytes as f64, HashMap::new(),
+              "Resident set of the SLAM process", Some("bytes"));
+        gauge(&mut metrics, "slam.memory.unattributed", sample.unattributed_bytes as f64, HashMap::new(),
+              "Resident set outside the breakdown", Some("bytes"));
+        gauge(&mut metrics, "slam.memory.paged_out", sample.paged_out_bytes as f64, HashMap::new(),
+              "Keyframe features paged out by the memory budget", Some("bytes"));
+        for (category, bytes) in MEMORY_CATEGORY_NAMES.iter().zip(sample.memory_bytes.iter()) {
+            gauge(&mut metrics, &format!("slam.memory.{}", category), *bytes as f64,
+                  label("category", category), &format!("Estimated bytes of the {}", category), Some("bytes"));
+        }
+
+        metrics
+    }
+}
+
+impl MetricsCollector for SlamTelemetryCollector {
+    fn name(&self) -> &str {
+        &self.name
+    }
+
+    fn collect(&self) -> Vec<Metric> {
+        // No metrics while the SLAM process is not running
+        match self.read_sample() {
+            Some(sample) => Self::sample_metrics(&sample),
+            None => Vec::new(),
+        }
+    }
+
+    fn interval(&self) -> Duration {
+        self.interval
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_layout_matches_writer() {
+        // Checked against sizeof/offsetof of the C++ structures
+        assert_eq!(std::mem::size_of::<SlamTelemetrySample>(), 600);
+        assert_eq!(std::mem::size_of::<Slot>(), 640);
+        assert_eq!(std::mem::size_of::<Region>(), 5312);
+    }
+
+    #[test]
+    fn test_missing_region() {
+        let collector = SlamTelemetryCollector::new("/vr_slam_telemetry_missing", 1);
+        assert!(collector.collect().is_empty());
+    }
+
+    #[test]
+    fn test_sample_metrics() {
+        let mut sample: SlamTelemetrySample = unsafe { std::mem::zeroed() };
+        sample.frames_processed = 42;
+        sample.end_to_end_p99_ms = 12.5;
+        sample.tpu_device_count = 2;
+        sample.tpu_utilization[1] = 0.5;
+        sample.thermal_zone_count = 1;
+        sample.thermal_celsius[0] = 71.25;
+        sample.thermal_zone_type[0][..16].copy_from_slice(b"bigcore0-thermal");
+        sample.cpu_capped_mask = 1 << 4;
+
+        let metrics = SlamTelemetryCollector::sample_metrics(&sample);
+        let find = |name: &str| metrics.iter().find(|m| m.name == name).unwrap();
+
+        assert_eq!(find("slam.frames_processed").value.as_integer(), Some(42));
+        assert_eq!(find("slam.latency.end_to_end.p99").value.as_float(), Some(12.5));
+        assert_eq!(find("slam.tpu.1.utilization").value.as_float(), Some(50.0));
+        assert_eq!(find("slam.thermal.bigcore0-thermal").value.as_float(), Some(71.25));
+        assert_eq!(find("slam.thermal.capped").value.as_boolean(), Some(true));
+        assert!(metrics.iter().all(|m| m.name != "slam.tpu.2.utilization"));
+        assert!(metrics.iter().all(|m| m.name != "slam.latency.exposure_mid.p50"));
+    }
+}
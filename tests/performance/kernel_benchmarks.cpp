@@ -0,0 +1,583 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Include the ORB-SLAM3 kernel headers
+#include "../../ORB_SLAM3/include/ORBmatcher.h"
+#include "../../ORB_SLAM3/include/ORBextractor.h"
+#include "../../ORB_SLAM3/include/ORBVocabulary.h"
+#include "../../ORB_SLAM3/include/ImuTypes.h"
+#include "../../ORB_SLAM3/include/Frame.h"
+#include "../../ORB_SLAM3/include/MapPoint.h"
+#include "../../ORB_SLAM3/include/Optimizer.h"
+#include "../../ORB_SLAM3/include/GlobalDescriptor.h"
+#include "../../ORB_SLAM3/include/CameraModels/Pinhole.h"
+#include "../../ORB_SLAM3/include/tpu_feature_extractor.hpp"
+
+// Kernel-level benchmarks of the tracking hot paths.
+//
+// Every benchmark is registered once per core cluster of the RK3588 and pins
+// itself to that cluster, so NEON paths are measured on both the A76 and the
+// A55 cores. Hosts without either cluster run them unpinned.
+//
+// Inputs (all optional, synthetic inputs are used when missing):
+//   --image=FILE        grayscale frame of a capture, e.g. a EuRoC cam0 image
+//   --vocabulary=FILE   ORB vocabulary (.txt or .bin) for the DBoW2 transform
+//   --tpu_model=FILE    EdgeTPU SuperPoint model for the TPU postprocessing
+//   --tensors=PREFIX    int8 output tensors of that model, PREFIX.semi and PREFIX.desc
+// All other arguments go to Google Benchmark (e.g. --benchmark_filter=A76).
+
+namespace ORB_SLAM3
+{
+
+// Friend of TPUFeatureExtractor, reaches its postprocessing for the benchmarks
+class TPUFeatureExtractorBenchmark
+{
+public:
+    static size_t SemiSize(const TPUFeatureExtractor& extractor)
+    {
+        return static_cast<size_t>(extractor.semi_height_) * extractor.semi_width_ * extractor.semi_channels_;
+    }
+
+    static size_t DescriptorSize(const TPUFeatureExtractor& extractor)
+    {
+        return static_cast<size_t>(extractor.descriptor_channels_) * extractor.descriptor_height_ * extractor.descriptor_width_;
+    }
+
+    static cv::Size InputSize(const TPUFeatureExtractor& extractor)
+    {
+        return cv::Size(extractor.input_tensor_width_, extractor.input_tensor_height_);
+    }
+
+    static std::vector<cv::KeyPoint> ApplyNMS(TPUFeatureExtractor& extractor, const int8_t* semi)
+    {
+        return extractor.applyNMS(semi, extractor.nms_radius_, extractor.confidence_threshold_);
+    }
+
+    static void Postprocess(TPUFeatureExtractor& extractor, const cv::Mat& image, const int8_t* semi,
+                            const int8_t* descriptors, std::vector<cv::KeyPoint>& keypoints, cv::Mat& output)
+    {
+        std::vector<int> lapping_area = {0, 0};
+        extractor.postprocessResults(image, cv::noArray(), semi, descriptors, keypoints, output, lapping_area);
+    }
+};
+
+} // namespace ORB_SLAM3
+
+using namespace ORB_SLAM3;
+
+namespace {
+
+constexpr int kFeatures = 1000;
+constexpr float kScaleFactor = 1.2f;
+constexpr int kLevels = 8;
+
+enum class Cluster {
+    A76,
+    A55,
+    HOST        ///< Neither cluster found, unpinned
+};
+
+const char* clusterName(Cluster cluster)
+{
+    switch (cluster) {
+        case Cluster::A76: return "A76";
+        case Cluster::A55: return "A55";
+        case Cluster::HOST: return "host";
+    }
+    return "";
+}
+
+// CPUs per cluster from the "CPU part" lines of /proc/cpuinfo
+std::vector<int> clusterCpus(Cluster cluster)
+{
+    const char* part = cluster == Cluster::A76 ? "0xd0b" : "0xd05";
+    std::vector<int> cpus;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    int processor = -1;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 9, "processor") == 0) {
+            processor = std::atoi(line.c_str() + line.find(':') + 1);
+        } else if (line.compare(0, 8, "CPU part") == 0 && processor >= 0 &&
+                   line.find(part) != std::string::npos) {
+            cpus.push_back(processor);
+        }
+    }
+    return cpus;
+}
+
+// Moves the benchmark thread onto the cluster, false (and the benchmark skipped) if that failed
+bool pinToCluster(benchmark::State& state, Cluster cluster)
+{
+    if (cluster == Cluster::HOST) {
+        return true;
+    }
+
+    const std::vector<int> cpus = clusterCpus(cluster);
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &cpuset);
+    }
+    if (cpus.empty() || pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+        state.SkipWithError("cannot pin to the cluster");
+        return false;
+    }
+    return true;
+}
+
+// Exposes the stages of the extraction, which runs serially unless given a ParallelFor
+class ORBextractorStages : public ORBextractor
+{
+public:
+    ORBextractorStages() : ORBextractor(kFeatures, kScaleFactor, kLevels, 20, 7) {}
+
+    void Pyramid(const cv::Mat& image) { ComputePyramid(image); }
+    void KeyPoints() { ComputeKeyPointsOctTree(mvAllKeypoints); }
+    void Descriptors()
+    {
+        for (int level = 0; level < nlevels; ++level)
+            ComputeDescriptors(level);
+    }
+    size_t KeyPointCount() const
+    {
+        size_t count = 0;
+        for (const auto& level : mvAllKeypoints)
+            count += level.size();
+        return count;
+    }
+};
+
+struct Inputs {
+    std::string image_path;
+    std::string vocabulary_path;
+    std::string tpu_model_path;
+    std::string tensors_prefix;
+
+    cv::Mat image;
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    std::unique_ptr<ORBVocabulary> vocabulary;
+    std::unique_ptr<TPUFeatureExtractor> tpu;
+    std::vector<int8_t> semi;
+    std::vector<int8_t> tpu_descriptors;
+};
+
+Inputs g_inputs;
+
+bool readTensor(const std::string& path, std::vector<int8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    return file.read(reinterpret_cast<char*>(data.data()), data.size()) && file.gcount() == static_cast<std::streamsize>(data.size());
+}
+
+void loadInputs()
+{
+    if (!g_inputs.image_path.empty()) {
+        g_inputs.image = cv::imread(g_inputs.image_path, cv::IMREAD_GRAYSCALE);
+        if (g_inputs.image.empty()) {
+            std::cerr << "Failed to read " << g_inputs.image_path << ", using a synthetic image" << std::endl;
+        }
+    }
+    if (g_inputs.image.empty()) {
+        // Blurred noise has corners at every scale, like a textured scene
+        g_inputs.image.create(480, 752, CV_8UC1);
+        cv::RNG rng(1);
+        rng.fill(g_inputs.image, cv::RNG::UNIFORM, 0, 256);
+        cv::GaussianBlur(g_inputs.image, g_inputs.image, cv::Size(0, 0), 2.5);
+        cv::normalize(g_inputs.image, g_inputs.image, 0, 255, cv::NORM_MINMAX);
+    }
+
+    ORBextractor extractor(kFeatures, kScaleFactor, kLevels, 20, 7);
+    std::vector<int> lapping_area = {0, 0};
+    extractor(g_inputs.image, cv::Mat(), g_inputs.keypoints, g_inputs.descriptors, lapping_area);
+
+    if (!g_inputs.vocabulary_path.empty()) {
+        g_inputs.vocabulary.reset(new ORBVocabulary());
+        const std::string bin = ".bin";
+        const std::string& path = g_inputs.vocabulary_path;
+        const bool loaded = path.size() >= bin.size() && path.compare(path.size() - bin.size(), bin.size(), bin) == 0
+                                ? g_inputs.vocabulary->loadFromBinaryFile(path)
+                                : g_inputs.vocabulary->loadFromTextFile(path);
+        if (!loaded) {
+            std::cerr << "Failed to load vocabulary " << path << std::endl;
+            g_inputs.vocabulary.reset();
+        }
+    }
+
+    if (!g_inputs.tpu_model_path.empty()) {
+        try {
+            g_inputs.tpu.reset(new TPUFeatureExtractor(g_inputs.tpu_model_path, "", kFeatures, kScaleFactor, 1));
+        } catch (const std::exception& e) {
+            std::cerr << "TPU benchmarks disabled: " << e.what() << std::endl;
+        }
+    }
+    if (g_inputs.tpu) {
+        g_inputs.semi.resize(TPUFeatureExtractorBenchmark::SemiSize(*g_inputs.tpu));
+        g_inputs.tpu_descriptors.resize(TPUFeatureExtractorBenchmark::DescriptorSize(*g_inputs.tpu));
+        if (g_inputs.tensors_prefix.empty() ||
+            !readTensor(g_inputs.tensors_prefix + ".semi", g_inputs.semi) ||
+            !readTensor(g_inputs.tensors_prefix + ".desc", g_inputs.tpu_descriptors)) {
+            // NMS runs in time linear in the map size, whatever the scores are
+            std::mt19937 rng(1);
+            std::uniform_int_distribution<int> dist(-128, 127);
+            for (int8_t& v : g_inputs.semi)
+                v = static_cast<int8_t>(dist(rng));
+            for (int8_t& v : g_inputs.tpu_descriptors)
+                v = static_cast<int8_t>(dist(rng));
+        }
+    }
+}
+
+void BM_DescriptorDistance(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    const cv::Mat& d = g_inputs.descriptors;
+    const int n = d.rows;
+    if (n < 2) {
+        state.SkipWithError("no descriptors");
+        return;
+    }
+
+    int64_t pairs = 0;
+    for (auto _ : state) {
+        int sum = 0;
+        for (int i = 0; i < n; ++i)
+            sum += ORBmatcher::DescriptorDistance(d.row(i), d.row((i * 7 + 1) % n));
+        benchmark::DoNotOptimize(sum);
+        pairs += n;
+    }
+    state.SetItemsProcessed(pairs);
+}
+
+void BM_DescriptorDistances(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    const cv::Mat& d = g_inputs.descriptors;
+    if (d.rows < 2) {
+        state.SkipWithError("no descriptors");
+        return;
+    }
+
+    // One query against every descriptor of the frame, like a search window
+    std::vector<size_t> indices(d.rows);
+    for (int i = 0; i < d.rows; ++i)
+        indices[i] = i;
+    std::vector<int> distances;
+    int64_t pairs = 0;
+    int query = 0;
+    for (auto _ : state) {
+        ORBmatcher::DescriptorDistances(d.row(query), d, indices, distances);
+        benchmark::DoNotOptimize(distances.data());
+        query = (query + 1) % d.rows;
+        pairs += d.rows;
+    }
+    state.SetItemsProcessed(pairs);
+}
+
+void BM_FloatDescriptorDistances(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    // L2-normalized SuperPoint-like descriptors, one query against all of them
+    const int n = 1000;
+    cv::Mat d(n, FloatSuperPointDescriptor::LENGTH, CV_32F);
+    std::mt19937 rng(5);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    for (int i = 0; i < n; ++i) {
+        float* row = d.ptr<float>(i);
+        float norm = 0.0f;
+        for (int j = 0; j < d.cols; ++j) {
+            row[j] = noise(rng);
+            norm += row[j] * row[j];
+        }
+        for (int j = 0; j < d.cols; ++j)
+            row[j] /= std::sqrt(norm);
+    }
+
+    std::vector<size_t> indices(n);
+    for (int i = 0; i < n; ++i)
+        indices[i] = i;
+    std::vector<int> distances;
+    int64_t pairs = 0;
+    int query = 0;
+    for (auto _ : state) {
+        FloatSuperPointMatcher::DescriptorDistances(d.row(query), d, indices, distances);
+        benchmark::DoNotOptimize(distances.data());
+        query = (query + 1) % n;
+        pairs += n;
+    }
+    state.SetItemsProcessed(pairs);
+}
+
+void BM_GlobalDescriptorSearch(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    // Arena-sized map, the index only stores the keyframe pointers
+    const int n = 20000;
+    std::mt19937 rng(6);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<std::vector<int8_t>> globals(n, std::vector<int8_t>(GlobalDescriptor::DIM));
+    GlobalDescriptorIndex index;
+    cv::Mat d(500, GlobalDescriptor::DIM, CV_32F);
+    for (int i = 0; i < n; ++i) {
+        for (int r = 0; r < d.rows; ++r)
+            for (int j = 0; j < d.cols; ++j)
+                d.at<float>(r, j) = noise(rng);
+        GlobalDescriptor::Compute(d, globals[i].data());
+        index.add(reinterpret_cast<KeyFrame*>(static_cast<uintptr_t>(i + 1) * 64), globals[i].data());
+    }
+
+    std::vector<KeyFrame*> candidates;
+    int query = 0;
+    for (auto _ : state) {
+        index.Search(globals[query].data(), 50, candidates);
+        benchmark::DoNotOptimize(candidates.data());
+        query = (query + 1) % n;
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_ORBextractorFAST(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    // FAST per cell, octree distribution and orientation of all levels
+    ORBextractorStages extractor;
+    extractor.Pyramid(g_inputs.image);
+    for (auto _ : state) {
+        extractor.KeyPoints();
+    }
+    state.counters["keypoints"] = static_cast<double>(extractor.KeyPointCount());
+    state.SetItemsProcessed(state.iterations() * g_inputs.image.total());
+}
+
+void BM_ORBextractorDescriptors(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    // Blur and computeOrbDescriptor of all levels
+    ORBextractorStages extractor;
+    extractor.Pyramid(g_inputs.image);
+    extractor.KeyPoints();
+    for (auto _ : state) {
+        extractor.Descriptors();
+    }
+    state.SetItemsProcessed(state.iterations() * extractor.KeyPointCount());
+}
+
+void BM_TPUApplyNMS(benchmark::State& state, Cluster cluster)
+{
+    if (!g_inputs.tpu) {
+        state.SkipWithError("needs --tpu_model");
+        return;
+    }
+    if (!pinToCluster(state, cluster))
+        return;
+
+    size_t kept = 0;
+    for (auto _ : state) {
+        std::vector<cv::KeyPoint> keypoints = TPUFeatureExtractorBenchmark::ApplyNMS(*g_inputs.tpu, g_inputs.semi.data());
+        kept = keypoints.size();
+        benchmark::DoNotOptimize(keypoints.data());
+    }
+    state.counters["keypoints"] = static_cast<double>(kept);
+}
+
+void BM_TPUPostprocess(benchmark::State& state, Cluster cluster)
+{
+    if (!g_inputs.tpu) {
+        state.SkipWithError("needs --tpu_model");
+        return;
+    }
+    if (!pinToCluster(state, cluster))
+        return;
+
+    cv::Mat image;
+    cv::resize(g_inputs.image, image, TPUFeatureExtractorBenchmark::InputSize(*g_inputs.tpu));
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    for (auto _ : state) {
+        TPUFeatureExtractorBenchmark::Postprocess(*g_inputs.tpu, image, g_inputs.semi.data(),
+                                                  g_inputs.tpu_descriptors.data(), keypoints, descriptors);
+        benchmark::DoNotOptimize(descriptors.data);
+    }
+    state.counters["keypoints"] = static_cast<double>(keypoints.size());
+}
+
+void BM_IntegrateNewMeasurement(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    // BNO085 noise densities at 1 kHz, one second of head motion per iteration
+    const IMU::Calib calib(Sophus::SE3f(), 1.7e-4f, 2.0e-3f, 1.9e-5f, 3.0e-3f);
+    const int samples = 1000;
+    const float dt = 1.0f / samples;
+    std::vector<Eigen::Vector3f> acc(samples), gyro(samples);
+    for (int i = 0; i < samples; ++i) {
+        const float t = i * dt;
+        acc[i] = Eigen::Vector3f(0.3f * std::sin(7.0f * t), 9.81f + 0.2f * std::cos(5.0f * t), 0.1f * std::sin(3.0f * t));
+        gyro[i] = Eigen::Vector3f(0.8f * std::sin(2.0f * t), 1.5f * std::cos(1.3f * t), 0.2f * std::sin(4.0f * t));
+    }
+
+    for (auto _ : state) {
+        IMU::Preintegrated preintegrated(IMU::Bias(), calib);
+        for (int i = 0; i < samples; ++i)
+            preintegrated.IntegrateNewMeasurement(acc[i], gyro[i], dt);
+        benchmark::DoNotOptimize(preintegrated.dR.data());
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+}
+
+void BM_DBoW2Transform(benchmark::State& state, Cluster cluster)
+{
+    if (!g_inputs.vocabulary) {
+        state.SkipWithError("needs --vocabulary");
+        return;
+    }
+    if (!pinToCluster(state, cluster))
+        return;
+
+    // As Frame::ComputeBoW, with the direct index four levels up
+    DBoW2::BowVector bow;
+    DBoW2::FeatureVector feat;
+    for (auto _ : state) {
+        bow.clear();
+        feat.clear();
+        g_inputs.vocabulary->transform(g_inputs.descriptors, bow, feat, 4);
+        benchmark::DoNotOptimize(bow.size());
+    }
+    state.SetItemsProcessed(state.iterations() * g_inputs.descriptors.rows);
+}
+
+void BM_PoseOptimization(benchmark::State& state, Cluster cluster)
+{
+    if (!pinToCluster(state, cluster))
+        return;
+
+    // EuRoC cam0 intrinsics, the keypoints of the frame back-projected onto a slanted wall
+    Pinhole camera(std::vector<float>{458.654f, 457.296f, 367.215f, 248.375f});
+    cv::Mat dist_coef = cv::Mat::zeros(4, 1, CV_32F);
+    ORBextractor extractor(kFeatures, kScaleFactor, kLevels, 20, 7);
+    Frame frame(g_inputs.image, 0.0, &extractor, nullptr, &camera, dist_coef, 0.0f, 0.0f);
+    if (frame.N < 10) {
+        state.SkipWithError("too few keypoints");
+        return;
+    }
+
+    const Sophus::SE3f Tcw(Eigen::Quaternionf(Eigen::AngleAxisf(0.1f, Eigen::Vector3f::UnitY())), Eigen::Vector3f(0.05f, -0.02f, 0.1f));
+    const Sophus::SE3f Twc = Tcw.inverse();
+    std::vector<MapPoint> points(frame.N);
+    std::mt19937 rng(1);
+    std::normal_distribution<float> pixel_noise(0.0f, 1.0f);
+    for (int i = 0; i < frame.N; ++i) {
+        const cv::KeyPoint& kp = frame.mvKeysUn[i];
+        const float depth = 2.0f + 0.002f * kp.pt.x;
+        const Eigen::Vector3f Xc((kp.pt.x + pixel_noise(rng) - 367.215f) / 458.654f * depth,
+                                 (kp.pt.y + pixel_noise(rng) - 248.375f) / 457.296f * depth, depth);
+        points[i].SetWorldPos(Twc * Xc);
+        frame.mvpMapPoints[i] = &points[i];
+    }
+
+    // Start every iteration from the same pose perturbed off the true one
+    const Sophus::SE3f initial = Sophus::SE3f(Eigen::Quaternionf(Eigen::AngleAxisf(0.02f, Eigen::Vector3f::UnitX())), Eigen::Vector3f(0.01f, 0.0f, -0.01f)) * Tcw;
+    int inliers = 0;
+    for (auto _ : state) {
+        frame.SetPose(initial);
+        inliers = Optimizer::PoseOptimization(&frame);
+    }
+    state.counters["points"] = static_cast<double>(frame.N);
+    state.counters["inliers"] = static_cast<double>(inliers);
+}
+
+void registerKernels(Cluster cluster)
+{
+    const std::string suffix = std::string("/") + clusterName(cluster);
+    benchmark::RegisterBenchmark(("DescriptorDistance" + suffix).c_str(), BM_DescriptorDistance, cluster);
+    benchmark::RegisterBenchmark(("DescriptorDistances" + suffix).c_str(), BM_DescriptorDistances, cluster);
+    benchmark::RegisterBenchmark(("FloatDescriptorDistances" + suffix).c_str(), BM_FloatDescriptorDistances, cluster);
+    benchmark::RegisterBenchmark(("GlobalDescriptorSearch" + suffix).c_str(), BM_GlobalDescriptorSearch, cluster)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("ORBextractorFAST" + suffix).c_str(), BM_ORBextractorFAST, cluster)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("ORBextractorDescriptors" + suffix).c_str(), BM_ORBextractorDescriptors, cluster)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("TPUApplyNMS" + suffix).c_str(), BM_TPUApplyNMS, cluster)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("TPUPostprocess" + suffix).c_str(), BM_TPUPostprocess, cluster)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("IntegrateNewMeasurement" + suffix).c_str(), BM_IntegrateNewMeasurement, cluster)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("DBoW2Transform" + suffix).c_str(), BM_DBoW2Transform, cluster)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("PoseOptimization" + suffix).c_str(), BM_PoseOptimization, cluster)->Unit(benchmark::kMicrosecond);
+}
+
+// Takes the input arguments out of argv, leaving the ones for Google Benchmark
+void parseInputs(int& argc, char** argv)
+{
+    const struct {
+        const char* flag;
+        std::string* value;
+    } flags[] = {
+        {"--image=", &g_inputs.image_path},
+        {"--vocabulary=", &g_inputs.vocabulary_path},
+        {"--tpu_model=", &g_inputs.tpu_model_path},
+        {"--tensors=", &g_inputs.tensors_prefix},
+    };
+
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        bool consumed = false;
+        for (const auto& flag : flags) {
+            const size_t length = std::strlen(flag.flag);
+            if (std::strncmp(argv[i], flag.flag, length) == 0) {
+                *flag.value = argv[i] + length;
+                consumed = true;
+            }
+        }
+        if (!consumed)
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    parseInputs(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    loadInputs();
+
+    const bool big = !clusterCpus(Cluster::A76).empty();
+    const bool little = !clusterCpus(Cluster::A55).empty();
+    if (big)
+        registerKernels(Cluster::A76);
+    if (little)
+        registerKernels(Cluster::A55);
+    if (!big && !little)
+        registerKernels(Cluster::HOST);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
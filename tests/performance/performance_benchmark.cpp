@@ -11,6 +11,9 @@
 #include <algorithm>
 #include <numeric>
 
+#include "../../ORB_SLAM3/include/PmuCounters.h"
+#include "../../ORB_SLAM3/include/EnergyCounters.h"
+
 namespace ORB_SLAM3 {
 namespace Testing {
 
@@ -349,6 +352,34 @@ public:
             }
         }
         
+        // Hardware counters of the traced stages, when PmuCounters was started
+        const std::vector<StageCounters> stage_counters = PmuCounters::GetStatistics();
+        if (!stage_counters.empty()) {
+            file << "\n## Hardware Counters per Stage\n\n";
+            file << "| Stage | Core | Spans | Time (ms) | IPC | L2 Miss (%) | L3 Miss (%) | Branch Misses/kinst |\n";
+            file << "|-------|------|-------|-----------|-----|-------------|-------------|---------------------|\n";
+            
+            for (const auto& stage : stage_counters) {
+                file << "| " << stage.name << " | " << stage.core << " | " << stage.nSpans << " | "
+                     << stage.runningMs << " | " << stage.ipc << " | " << stage.l2MissRate * 100.0 << " | "
+                     << stage.l3MissRate * 100.0 << " | " << stage.branchMissesPKI << " |\n";
+            }
+        }
+        
+        // Rail energy of the traced stages, when EnergyCounters was started
+        const std::vector<StageEnergy> stage_energy = EnergyCounters::GetStatistics();
+        if (!stage_energy.empty()) {
+            file << "\n## Energy per Stage\n\n";
+            file << "| Stage | Rail | Spans | Time (ms) | Energy (mJ) | mJ/span | Power (mW) |\n";
+            file << "|-------|------|-------|-----------|-------------|---------|------------|\n";
+            
+            for (const auto& stage : stage_energy) {
+                file << "| " << stage.name << " | " << stage.rail << " | " << stage.nSpans << " | "
+                     << stage.busyMs << " | " << stage.energyMj << " | " << stage.energyMj / stage.nSpans << " | "
+                     << stage.averagePowerMw << " |\n";
+            }
+        }
+        
         file.close();
         return true;
     }
@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Include the pipeline simulator header
+#include "../../include/pipeline_simulator.hpp"
+
+using ORB_SLAM3::LatencyStage;
+using ORB_SLAM3::PipelineDropPolicy;
+using ORB_SLAM3::PipelineSimulator;
+using ORB_SLAM3::SimulatedStage;
+using ORB_SLAM3::StageTimings;
+
+namespace {
+
+void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--dump FILE]... [--trace FILE]...\n"
+              << "       [--cameras N] [--rate HZ] [--recorded-units N] [--max-units N] [--unit-speed S]\n"
+              << "       [--invoke-overhead MS] [--budget MS] [--duration S] [--seed N]\n"
+              << "\n"
+              << "Replays the stage times of flight recorder dumps and Tracer traces through a\n"
+              << "discrete-event model of the pipeline for every combination of queue depth, drop\n"
+              << "policy, extraction units, batch size and frame decimation, prints the predicted\n"
+              << "throughput and latencies, and the configuration with the highest throughput\n"
+              << "whose p99 exposure-to-pose latency is within --budget (20 ms by default).\n";
+}
+
+const char* policyName(PipelineDropPolicy policy)
+{
+    return policy == PipelineDropPolicy::BLOCK ? "block" : "latest";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    StageTimings timings;
+    bool loaded = false;
+    int cameras = 4;
+    double rate_hz = 0.0;
+    int recorded_units = 1;
+    int max_units = 2;
+    double unit_speed = 1.0;
+    double invoke_overhead_ms = 0.0;
+    double budget_ms = 20.0;
+    double duration_s = 60.0;
+    uint32_t seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "--dump" && has_value) {
+            if (!timings.LoadFlightRecorderDump(argv[++i])) {
+                std::cerr << timings.GetLastErrorMessage() << std::endl;
+                return 1;
+            }
+            loaded = true;
+        } else if (arg == "--trace" && has_value) {
+            if (!timings.LoadTrace(argv[++i])) {
+                std::cerr << timings.GetLastErrorMessage() << std::endl;
+                return 1;
+            }
+            loaded = true;
+        } else if (arg == "--cameras" && has_value) {
+            cameras = std::atoi(argv[++i]);
+        } else if (arg == "--rate" && has_value) {
+            rate_hz = std::atof(argv[++i]);
+        } else if (arg == "--recorded-units" && has_value) {
+            recorded_units = std::atoi(argv[++i]);
+        } else if (arg == "--max-units" && has_value) {
+            max_units = std::atoi(argv[++i]);
+        } else if (arg == "--unit-speed" && has_value) {
+            unit_speed = std::atof(argv[++i]);
+        } else if (arg == "--invoke-overhead" && has_value) {
+            invoke_overhead_ms = std::atof(argv[++i]);
+        } else if (arg == "--budget" && has_value) {
+            budget_ms = std::atof(argv[++i]);
+        } else if (arg == "--duration" && has_value) {
+            duration_s = std::atof(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!loaded || cameras <= 0 || max_units <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    timings.SetRecordedExtraction(cameras, recorded_units);
+    if (rate_hz <= 0.0) {
+        rate_hz = timings.GetFrameRateHz() > 0.0 ? timings.GetFrameRateHz() : 90.0;
+    }
+
+    // Sweep the knobs the system exposes
+    PipelineSimulator::Config base;
+    base.camera_rate_hz = rate_hz;
+    base.cameras = cameras;
+    base.display_rate_hz = rate_hz;
+    base.duration_s = duration_s;
+    base.seed = seed;
+
+    std::vector<PipelineSimulator::Config> candidates;
+    for (int depth = 1; depth <= 3; depth++) {
+        for (PipelineDropPolicy policy : {PipelineDropPolicy::BLOCK, PipelineDropPolicy::KEEP_LATEST}) {
+            for (int units = 1; units <= max_units; units++) {
+                for (int batch : {1, cameras}) {
+                    for (int decimation : {1, 2}) {
+                        PipelineSimulator::Config config = base;
+                        config.extraction_queue.depth = depth;
+                        config.extraction_queue.policy = policy;
+                        config.tracking_queue.depth = depth;
+                        config.tracking_queue.policy = policy;
+                        config.frame_decimation = decimation;
+                        config.extraction_units.clear();
+                        for (int u = 0; u < units; u++) {
+                            PipelineSimulator::ExtractionUnit unit;
+                            unit.name = "edgetpu" + std::to_string(u);
+                            unit.speed = unit_speed;
+                            unit.batch_size = batch;
+                            unit.invoke_overhead_ms = invoke_overhead_ms;
+                            config.extraction_units.push_back(unit);
+                        }
+                        candidates.push_back(config);
+                    }
+                }
+            }
+        }
+    }
+
+    PipelineSimulator simulator(timings);
+    std::vector<PipelineSimulator::Result> results;
+    const size_t chosen = simulator.SelectConfiguration(candidates, budget_ms, &results);
+
+    std::printf("%5s %6s %5s %5s %4s | %8s %8s %8s %8s %8s %8s | %6s\n", "depth", "policy", "units", "batch",
+                "dec", "fps", "e2e_p50", "e2e_p99", "age_p99", "m2p_p99", "extr_p99", "drops");
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const PipelineSimulator::Config& config = candidates[i];
+        const PipelineSimulator::Result& result = results[i];
+        std::printf("%5d %6s %5zu %5d %4d | %8.1f %8.2f %8.2f %8.2f %8.2f %8.2f | %6llu%s\n",
+                    config.tracking_queue.depth, policyName(config.tracking_queue.policy),
+                    config.extraction_units.size(), config.extraction_units[0].batch_size,
+                    config.frame_decimation, result.throughput_fps, result.end_to_end.p50_ms,
+                    result.end_to_end.p99_ms, result.pose_age_at_scanout.p99_ms, result.motion_to_photon.p99_ms,
+                    result.stage_latency[static_cast<size_t>(LatencyStage::TPU_DONE)].p99_ms,
+                    static_cast<unsigned long long>(result.dropped_readout + result.dropped_extraction +
+                                                    result.dropped_tracking),
+                    i == chosen ? "  <- selected" : "");
+    }
+
+    if (chosen == candidates.size()) {
+        return 1;
+    }
+    const PipelineSimulator::Result& best = results[chosen];
+    std::cout << "\nSelected: p99 " << best.end_to_end.p99_ms << " ms, " << best.throughput_fps << " fps"
+              << (best.end_to_end.p99_ms > budget_ms ? " (over the budget)" : "") << std::endl;
+    std::cout << "Utilization:";
+    for (size_t s = 0; s < ORB_SLAM3::kNumSimulatedStages; s++) {
+        if (s == static_cast<size_t>(SimulatedStage::READOUT) || s == static_cast<size_t>(SimulatedStage::PUBLISH)) {
+            continue;
+        }
+        std::cout << " " << ORB_SLAM3::GetSimulatedStageName(static_cast<SimulatedStage>(s)) << " "
+                  << static_cast<int>(best.utilization[s] * 100.0 + 0.5) << "%";
+    }
+    std::cout << std::endl;
+    return best.end_to_end.p99_ms > budget_ms ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Include the SLAM test framework header
+#include "../../include/slam_test_framework.hpp"
+
+using ORB_SLAM3::BenchmarkDatasetFormat;
+using ORB_SLAM3::GoldenTraceTest;
+using ORB_SLAM3::SLAMBenchmarkTest;
+using ORB_SLAM3::TestResult;
+using ORB_SLAM3::TestRunner;
+using ORB_SLAM3::TestSuite;
+
+namespace {
+
+void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " --vocabulary FILE --settings FILE --calibration FILE --tpu-model FILE\n"
+              << "       [--dataset PATH --format euroc|tumvi|capture]...\n"
+              << "       [--cameras N] [--imu] [--realtime] [--energy] [--max-frames N] [--threads N]\n"
+              << "       [--output-dir DIR] [--baseline-dir DIR] [--tolerance FRACTION] [--report FILE]\n"
+              << "       [--history FILE] [--golden-dir DIR [--record-golden] [--runs N] [--seed N]]\n"
+              << "\n"
+              << "Replays every dataset through VRSLAMSystem and writes <output-dir>/<dataset>.json.\n"
+              << "With --baseline-dir, <baseline-dir>/<dataset>.json is compared against and the\n"
+              << "exit status is non-zero if any metric regressed by more than the tolerance.\n"
+              << "With --history, the report shows every run against the trend of earlier runs.\n"
+              << "With --energy, the power rails are sampled and the energy per frame and keyframe\n"
+              << "reported (needs a build with ENABLE_TRACING for the per-stage energy).\n"
+              << "With --golden-dir, every dataset is replayed --runs times with a fixed seed and\n"
+              << "checked against <golden-dir>/<dataset>.golden.json instead, failing with the\n"
+              << "stages that regressed; --record-golden writes that profile. Allocations are only\n"
+              << "counted in a build with ENABLE_ALLOCATION_COUNTING.\n";
+}
+
+bool parseFormat(const std::string& name, BenchmarkDatasetFormat& format)
+{
+    if (name == "euroc") {
+        format = BenchmarkDatasetFormat::EUROC;
+    } else if (name == "tumvi") {
+        format = BenchmarkDatasetFormat::TUM_VI;
+    } else if (name == "capture") {
+        format = BenchmarkDatasetFormat::CAPTURE_FILE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string datasetName(std::string path)
+{
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    SLAMBenchmarkTest::Options defaults;
+    defaults.system.use_imu = false;
+    defaults.system.enable_mapping = true;
+    defaults.system.enable_loop_closing = false;
+    defaults.system.interaction_mode = ORB_SLAM3::VRMotionModel::InteractionMode::STANDING;
+    defaults.system.prediction_horizon_ms = 16.0;
+    defaults.system.num_threads = 4;
+    defaults.system.verbose = false;
+
+    // Reproducible runs: no quality scaling, no side effects on a running system
+    defaults.system.enable_governor = false;
+    defaults.system.pose_export_name = "";
+    defaults.system.power_device = "";
+    defaults.system.checkpoint_path = "";
+
+    std::vector<std::pair<std::string, BenchmarkDatasetFormat>> datasets;
+    BenchmarkDatasetFormat format = BenchmarkDatasetFormat::EUROC;
+    std::string output_dir = ".";
+    std::string baseline_dir;
+    std::string report_path;
+    std::string history_path;
+    std::string golden_dir;
+    bool record_golden = false;
+    GoldenTraceTest::Options golden_defaults;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--imu") {
+            defaults.system.use_imu = true;
+        } else if (arg == "--realtime") {
+            defaults.realtime = true;
+        } else if (arg == "--energy") {
+            defaults.system.enable_energy_counters = true;
+        } else if (arg == "--record-golden") {
+            record_golden = true;
+        } else if (!has_value) {
+            printUsage(argv[0]);
+            return 2;
+        } else if (arg == "--vocabulary") {
+            defaults.system.vocabulary_path = argv[++i];
+        } else if (arg == "--settings") {
+            defaults.system.settings_path = argv[++i];
+        } else if (arg == "--calibration") {
+            defaults.system.calibration_path = argv[++i];
+        } else if (arg == "--tpu-model") {
+            defaults.system.tpu_model_path = argv[++i];
+        } else if (arg == "--format") {
+            if (!parseFormat(argv[++i], format)) {
+                printUsage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "--dataset") {
+            // Applies the format given so far, so datasets of several formats can be mixed
+            datasets.emplace_back(argv[++i], format);
+        } else if (arg == "--cameras") {
+            defaults.max_cameras = std::atoi(argv[++i]);
+        } else if (arg == "--max-frames") {
+            defaults.max_frames = std::atoi(argv[++i]);
+        } else if (arg == "--threads") {
+            defaults.system.num_threads = std::atoi(argv[++i]);
+        } else if (arg == "--output-dir") {
+            output_dir = argv[++i];
+        } else if (arg == "--baseline-dir") {
+            baseline_dir = argv[++i];
+        } else if (arg == "--tolerance") {
+            defaults.relative_tolerance = std::atof(argv[++i]);
+            golden_defaults.relative_tolerance = defaults.relative_tolerance;
+        } else if (arg == "--report") {
+            report_path = argv[++i];
+        } else if (arg == "--history") {
+            history_path = argv[++i];
+        } else if (arg == "--golden-dir") {
+            golden_dir = argv[++i];
+        } else if (arg == "--runs") {
+            golden_defaults.runs = std::atoi(argv[++i]);
+        } else if (arg == "--seed") {
+            golden_defaults.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (datasets.empty() || defaults.system.vocabulary_path.empty() || defaults.system.calibration_path.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    TestSuite suite("SLAMBenchmark");
+    for (const auto& dataset : datasets) {
+        SLAMBenchmarkTest::Options options = defaults;
+        options.dataset_path = dataset.first;
+        options.format = dataset.second;
+        options.output_path = output_dir + "/" + datasetName(dataset.first) + ".json";
+        if (!baseline_dir.empty()) {
+            options.baseline_path = baseline_dir + "/" + datasetName(dataset.first) + ".json";
+        }
+        if (!golden_dir.empty()) {
+            GoldenTraceTest::Options golden = golden_defaults;
+            golden.benchmark = options;
+            golden.golden_path = golden_dir + "/" + datasetName(dataset.first) + ".golden.json";
+            golden.record = record_golden;
+            suite.AddTest(std::make_shared<GoldenTraceTest>(golden));
+            continue;
+        }
+        suite.AddTest(std::make_shared<SLAMBenchmarkTest>(options));
+    }
+
+    const std::vector<TestResult> results = suite.RunAll();
+
+    bool all_passed = true;
+    for (const auto& result : results) {
+        std::cout << result.name << " (" << result.message << "): " << (result.success ? "PASSED" : "FAILED") << std::endl;
+        for (const auto& log : result.logs) {
+            std::cout << "  " << log << std::endl;
+        }
+        all_passed = all_passed && result.success;
+    }
+
+    if (!report_path.empty() || !history_path.empty()) {
+        TestRunner runner;
+        runner.GenerateReport(results, report_path, history_path);
+    }
+
+    return all_passed ? 0 : 1;
+}
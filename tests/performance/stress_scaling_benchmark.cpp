@@ -0,0 +1,203 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Include the SLAM test framework and the stress workload generator
+#include "../../include/slam_test_framework.hpp"
+#include "../simulation/stress_workload_generator.hpp"
+
+using ORB_SLAM3::BenchmarkDatasetFormat;
+using ORB_SLAM3::SLAMBenchmarkTest;
+using ORB_SLAM3::TestResult;
+using ORB_SLAM3::Testing::StressWorkloadGenerator;
+
+// Sweeps camera count, patch density and motion aggressiveness over synthetic
+// workloads, replays each through VRSLAMSystem and reports where the frame
+// time exceeds the frame period or tracking breaks down.
+
+namespace {
+
+struct Point {
+    int cameras;
+    float density;
+    float aggressiveness;
+    size_t patches;
+    bool completed;
+    std::map<std::string, double> metrics;
+};
+
+std::vector<double> parseList(const std::string& text)
+{
+    std::vector<double> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty())
+            values.push_back(std::atof(item.c_str()));
+    }
+    return values;
+}
+
+void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " --vocabulary FILE --settings FILE --tpu-model FILE\n"
+              << "       [--cameras 2,4,6,8] [--densities 2,8,32] [--aggressiveness 0.2,0.8]\n"
+              << "       [--duration S] [--rate HZ] [--imu] [--work-dir DIR] [--keep] [--output FILE]\n"
+              << "\n"
+              << "Every point of the sweep streams a capture of about cameras x rate x duration x 300 KB\n"
+              << "into the work directory, which is removed after the run unless --keep is given.\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    SLAMBenchmarkTest::Options defaults;
+    defaults.format = BenchmarkDatasetFormat::CAPTURE_FILE;
+    defaults.system.use_imu = false;
+    defaults.system.enable_mapping = true;
+    defaults.system.enable_loop_closing = true;
+    defaults.system.interaction_mode = ORB_SLAM3::VRMotionModel::InteractionMode::ROOM_SCALE;
+    defaults.system.prediction_horizon_ms = 16.0;
+    defaults.system.num_threads = 4;
+    defaults.system.verbose = false;
+    defaults.system.enable_governor = false;
+    defaults.system.pose_export_name = "";
+    defaults.system.power_device = "";
+    defaults.system.checkpoint_path = "";
+
+    std::vector<double> cameras = {2, 4, 6, 8};
+    std::vector<double> densities = {2, 8, 32};
+    std::vector<double> aggressiveness = {0.2, 0.8};
+    StressWorkloadGenerator::Options workload;
+    workload.duration_s = 20.0;
+    std::string work_dir = "/tmp";
+    std::string output_path = "stress_scaling.json";
+    bool keep = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--imu") {
+            defaults.system.use_imu = true;
+        } else if (arg == "--keep") {
+            keep = true;
+        } else if (!has_value) {
+            printUsage(argv[0]);
+            return 2;
+        } else if (arg == "--vocabulary") {
+            defaults.system.vocabulary_path = argv[++i];
+        } else if (arg == "--settings") {
+            defaults.system.settings_path = argv[++i];
+        } else if (arg == "--tpu-model") {
+            defaults.system.tpu_model_path = argv[++i];
+        } else if (arg == "--cameras") {
+            cameras = parseList(argv[++i]);
+        } else if (arg == "--densities") {
+            densities = parseList(argv[++i]);
+        } else if (arg == "--aggressiveness") {
+            aggressiveness = parseList(argv[++i]);
+        } else if (arg == "--duration") {
+            workload.duration_s = std::atof(argv[++i]);
+        } else if (arg == "--rate") {
+            workload.camera_rate_hz = std::atof(argv[++i]);
+        } else if (arg == "--work-dir") {
+            work_dir = argv[++i];
+        } else if (arg == "--output") {
+            output_path = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (defaults.system.vocabulary_path.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    const double frame_period_ms = 1000.0 / workload.camera_rate_hz;
+    std::vector<Point> points;
+
+    for (double a : aggressiveness) {
+        for (double d : densities) {
+            for (double c : cameras) {
+                Point point;
+                point.cameras = static_cast<int>(c);
+                point.density = static_cast<float>(d);
+                point.aggressiveness = static_cast<float>(a);
+
+                StressWorkloadGenerator::Options options = workload;
+                options.num_cameras = point.cameras;
+                options.patch_density = point.density;
+                options.aggressiveness = point.aggressiveness;
+                StressWorkloadGenerator generator(options);
+                point.patches = generator.GetPatchCount();
+
+                std::ostringstream name;
+                name << work_dir << "/stress_c" << point.cameras << "_d" << d << "_a" << a << ".vrcap";
+                const std::string capture = name.str();
+                std::cout << "Generating " << capture << " (" << point.patches << " patches)" << std::endl;
+                if (!generator.WriteCapture(capture)) {
+                    std::cerr << "Failed to write " << capture << std::endl;
+                    return 1;
+                }
+
+                SLAMBenchmarkTest::Options run = defaults;
+                run.dataset_path = capture;
+                run.system.calibration_path = capture + ".rig.json";
+                run.output_path = capture + ".json";
+                SLAMBenchmarkTest test(run);
+                const TestResult result = test.Run();
+                point.completed = result.success;
+                point.metrics = test.GetMetrics();
+                if (!result.success)
+                    std::cerr << "  " << result.message << std::endl;
+                points.push_back(point);
+
+                if (!keep) {
+                    std::remove(capture.c_str());
+                    std::remove((capture + ".groundtruth.csv").c_str());
+                    std::remove((capture + ".rig.json").c_str());
+                }
+            }
+        }
+    }
+
+    // A point breaks when it misses the frame period at p99 or loses tracking
+    auto metric = [](const Point& point, const char* name) {
+        auto it = point.metrics.find(name);
+        return it == point.metrics.end() ? 0.0 : it->second;
+    };
+    auto broken = [&](const Point& point) {
+        return !point.completed || metric(point, "frame_time_p99_ms") > frame_period_ms ||
+               metric(point, "tracking_percentage") < 90.0;
+    };
+
+    std::ofstream output(output_path);
+    output << "{\n  \"frame_period_ms\": " << frame_period_ms << ",\n  \"points\": [\n";
+    std::printf("%8s %8s %6s %8s %10s %10s %10s %8s %s\n", "cameras", "density", "aggr", "patches",
+                "fps", "p99_ms", "track_p99", "tracked", "");
+    for (size_t i = 0; i < points.size(); ++i) {
+        const Point& p = points[i];
+        std::printf("%8d %8.1f %6.2f %8zu %10.1f %10.2f %10.2f %7.1f%% %s\n", p.cameras, p.density, p.aggressiveness,
+                    p.patches, metric(p, "throughput_fps"), metric(p, "frame_time_p99_ms"),
+                    metric(p, "latency.track_done.p99_ms"), metric(p, "tracking_percentage"),
+                    broken(p) ? "BREAKPOINT" : "");
+
+        output << "    {\"cameras\": " << p.cameras << ", \"density\": " << p.density
+               << ", \"aggressiveness\": " << p.aggressiveness << ", \"patches\": " << p.patches
+               << ", \"broken\": " << (broken(p) ? "true" : "false");
+        for (const auto& entry : p.metrics)
+            output << ", \"" << entry.first << "\": " << entry.second;
+        output << "}" << (i + 1 < points.size() ? "," : "") << "\n";
+    }
+    output << "  ]\n}\n";
+
+    return 0;
+}
@@ -0,0 +1,441 @@
+#ifndef STRESS_WORKLOAD_GENERATOR_HPP
+#define STRESS_WORKLOAD_GENERATOR_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "../../include/frame_capture_file.hpp"
+#include "../../include/multi_camera_rig.hpp"
+
+namespace ORB_SLAM3 {
+namespace Testing {
+
+/**
+ * @brief Parameterized multi-camera workload for stress benchmarks
+ *
+ * The world is a textured room: square patches with a checker inside are
+ * scattered over the walls, floor and ceiling at a given density. Every
+ * patch is projected through the full perspective of every camera, so
+ * the views of a patch are consistent across cameras and over time. Corners
+ * seen by two cameras triangulate to the same point. The headset follows
+ * smooth sinusoidal head motion whose speed scales with the aggressiveness.
+ * The IMU samples are the exact derivatives of that motion plus white noise.
+ *
+ * Frame sets are rendered one at a time and handed to a sink, so memory
+ * stays bounded whatever the duration. WriteCapture() streams them into a
+ * frame capture file that the replay backend reads: ZeroCopyFrameProvider::SetReplaySource()
+ * or BenchmarkDataset with the CAPTURE_FILE format. It also writes the
+ * ground truth and the rig calibration next to the capture.
+ */
+class StressWorkloadGenerator {
+public:
+    struct Options {
+        int num_cameras = 4;                ///< Cameras on the headset, 2 to 8
+        int width = 640;
+        int height = 480;
+        float fov_horizontal_deg = 90.0f;
+        double camera_rate_hz = 30.0;
+        double imu_rate_hz = 1000.0;
+        double duration_s = 30.0;
+        float patch_density = 4.0f;         ///< Patches per square metre of room surface
+        float patch_size_m = 0.12f;         ///< Edge length of a patch
+        Eigen::Vector3f room_size = Eigen::Vector3f(8.0f, 3.0f, 8.0f); ///< Width, height, depth in metres
+        float aggressiveness = 0.5f;        ///< 0 for slow seated motion, 1 for fast room-scale motion
+        float image_noise_sigma = 2.0f;     ///< Gray levels
+        float gyro_noise_sigma = 1.7e-3f;   ///< rad/s per sample
+        float accel_noise_sigma = 2.0e-2f;  ///< m/s^2 per sample
+        unsigned int seed = 1;              ///< Same seed, same workload
+    };
+
+    /**
+     * @brief One rendered frame set and the IMU samples since the previous one
+     */
+    struct FrameSet {
+        uint64_t index;
+        double timestamp;                       ///< Seconds
+        std::vector<cv::Mat> images;            ///< One GRAY8 image per camera, reused between calls
+        std::vector<CaptureImuSample> imu;      ///< IMU samples up to timestamp
+        Eigen::Vector3f position;               ///< World position of the reference camera
+        Eigen::Quaternionf rotation;            ///< World-from-reference-camera rotation
+    };
+
+    using Sink = std::function<bool(const FrameSet&)>;
+
+    /**
+     * @brief Constructor, builds the world and the rig
+     *
+     * @param options Workload parameters (num_cameras is clamped to 2..8)
+     */
+    explicit StressWorkloadGenerator(const Options& options)
+        : options_(options)
+    {
+        options_.num_cameras = std::max(2, std::min(8, options_.num_cameras));
+        focal_ = 0.5f * options_.width / std::tan(0.5f * options_.fov_horizontal_deg * static_cast<float>(M_PI) / 180.0f);
+        buildRig();
+        buildWorld();
+    }
+
+    /**
+     * @brief Get the number of patches in the world
+     */
+    size_t GetPatchCount() const { return patches_.size(); }
+
+    /**
+     * @brief Get the rig the frames are rendered with, camera 0 is the reference
+     */
+    MultiCameraRig GetRig() const
+    {
+        MultiCameraRig rig(0);
+        for (int c = 0; c < options_.num_cameras; ++c) {
+            MultiCameraRig::CameraInfo info;
+            info.id = c;
+            info.K = (cv::Mat_<float>(3, 3) << focal_, 0, 0.5f * options_.width, 0, focal_, 0.5f * options_.height, 0, 0, 1);
+            info.distCoef = cv::Mat::zeros(1, 4, CV_32F);
+            info.T_ref_cam = cv::Mat::eye(4, 4, CV_32F);
+            const Eigen::Matrix4f T = (ref_from_body_ * body_from_cam_[c]).matrix();
+            for (int i = 0; i < 4; ++i)
+                for (int j = 0; j < 4; ++j)
+                    info.T_ref_cam.at<float>(i, j) = T(i, j);
+            info.fps = static_cast<float>(options_.camera_rate_hz);
+            info.width = options_.width;
+            info.height = options_.height;
+            info.model = "pinhole";
+            info.fov_horizontal = options_.fov_horizontal_deg;
+            info.fov_vertical = 2.0f * std::atan(0.5f * options_.height / focal_) * 180.0f / static_cast<float>(M_PI);
+            rig.AddCamera(info);
+        }
+        return rig;
+    }
+
+    /**
+     * @brief Render the whole workload into a sink
+     *
+     * @param sink Called for every frame set in time order, return false to stop
+     * @return True if every frame set was consumed, false if the sink stopped
+     */
+    bool Generate(const Sink& sink)
+    {
+        std::mt19937 rng(options_.seed ^ 0x5eed);
+        std::normal_distribution<float> gyro_noise(0.0f, options_.gyro_noise_sigma);
+        std::normal_distribution<float> accel_noise(0.0f, options_.accel_noise_sigma);
+        cv::RNG image_rng(options_.seed);
+
+        FrameSet set;
+        set.images.resize(options_.num_cameras);
+        for (auto& image : set.images)
+            image.create(options_.height, options_.width, CV_8UC1);
+        cv::Mat noise(options_.height, options_.width, CV_16SC1);
+        cv::Mat widened;
+
+        const uint64_t frames = static_cast<uint64_t>(options_.duration_s * options_.camera_rate_hz);
+        const double imu_dt = 1.0 / options_.imu_rate_hz;
+        uint64_t imu_index = 0;
+
+        for (uint64_t f = 0; f < frames; ++f) {
+            set.index = f;
+            set.timestamp = kStartTime + f / options_.camera_rate_hz;
+
+            set.imu.clear();
+            for (double t = kStartTime + imu_index * imu_dt; t <= set.timestamp; t = kStartTime + (++imu_index) * imu_dt) {
+                Eigen::Vector3f gyro, accel;
+                imuAt(t - kStartTime, gyro, accel);
+                CaptureImuSample sample;
+                sample.timestamp = t;
+                for (int i = 0; i < 3; ++i) {
+                    sample.gyro[i] = gyro[i] + gyro_noise(rng);
+                    sample.acc[i] = accel[i] + accel_noise(rng);
+                }
+                set.imu.push_back(sample);
+            }
+
+            const Eigen::Isometry3f world_from_body = poseAt(set.timestamp - kStartTime);
+            for (int c = 0; c < options_.num_cameras; ++c) {
+                render(world_from_body * body_from_cam_[c], set.images[c]);
+                if (options_.image_noise_sigma > 0.0f) {
+                    image_rng.fill(noise, cv::RNG::NORMAL, 0.0, options_.image_noise_sigma);
+                    set.images[c].convertTo(widened, CV_16S);
+                    widened += noise;
+                    widened.convertTo(set.images[c], CV_8U);
+                }
+            }
+
+            const Eigen::Isometry3f world_from_ref = world_from_body * body_from_cam_[0];
+            set.position = world_from_ref.translation();
+            set.rotation = Eigen::Quaternionf(world_from_ref.rotation());
+
+            if (!sink(set))
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Stream the workload into a frame capture file
+     *
+     * Besides the capture, <path>.groundtruth.csv holds the reference camera
+     * poses in ASL format and <path>.rig.json the rig calibration.
+     *
+     * @param path Capture file path (e.g. "stress_8cam.vrcap")
+     * @return True if successful, false otherwise
+     */
+    bool WriteCapture(const std::string& path)
+    {
+        std::vector<CaptureCameraInfo> cameras(options_.num_cameras);
+        for (auto& camera : cameras) {
+            std::memset(&camera, 0, sizeof(camera));
+            camera.width = options_.width;
+            camera.height = options_.height;
+            camera.fps = static_cast<int32_t>(std::lround(options_.camera_rate_hz));
+            std::memcpy(camera.pixel_format, "GREY", 4);
+        }
+
+        FrameCaptureWriter writer;
+        if (!writer.Open(path, cameras)) {
+            return false;
+        }
+        std::ofstream groundtruth(path + ".groundtruth.csv");
+        if (!groundtruth.is_open()) {
+            return false;
+        }
+        groundtruth << "#timestamp [ns],p_x [m],p_y [m],p_z [m],q_w [],q_x [],q_y [],q_z []" << std::endl;
+        groundtruth << std::setprecision(9);
+
+        const bool ok = Generate([&](const FrameSet& set) {
+            for (const auto& sample : set.imu) {
+                if (!writer.WriteImuSample(sample))
+                    return false;
+            }
+            for (int c = 0; c < options_.num_cameras; ++c) {
+                CaptureFrame frame;
+                std::memset(&frame, 0, sizeof(frame));
+                frame.frame_id = set.index;
+                frame.timestamp = set.timestamp;
+                frame.camera_id = c;
+                frame.width = options_.width;
+                frame.height = options_.height;
+                frame.data = set.images[c].data;
+                frame.size = set.images[c].total();
+                if (!writer.WriteFrame(frame))
+                    return false;
+            }
+            groundtruth << static_cast<uint64_t>(std::llround(set.timestamp * 1e9)) << ","
+                        << set.position.x() << "," << set.position.y() << "," << set.position.z() << ","
+                        << set.rotation.w() << "," << set.rotation.x() << "," << set.rotation.y() << "," << set.rotation.z() << "\n";
+            return true;
+        });
+        writer.Close();
+
+        return ok && static_cast<bool>(groundtruth.flush()) && GetRig().SaveCalibration(path + ".rig.json");
+    }
+
+private:
+    static constexpr double kStartTime = 1.0;   ///< Timestamp of the first frame set, 0 means "unset" elsewhere
+    static constexpr float kGravity = 9.81f;
+
+    struct Patch {
+        Eigen::Vector3f corners[4];     ///< Outer square
+        Eigen::Vector3f inner[4][4];    ///< Two checker squares of the inner quarter grid
+        Eigen::Vector3f center;
+        Eigen::Vector3f normal;         ///< Facing into the room
+        uint8_t outer_intensity;
+        uint8_t inner_intensity;
+    };
+
+    // Cameras spread in yaw over the front of the headset, every other one tilted down
+    void buildRig()
+    {
+        const int n = options_.num_cameras;
+        const float spread = std::min(300.0f, 60.0f * (n - 1)) * static_cast<float>(M_PI) / 180.0f;
+        body_from_cam_.resize(n);
+        for (int c = 0; c < n; ++c) {
+            const float yaw = -0.5f * spread + spread * c / (n - 1);
+            const float pitch = (c % 2 == 1) ? 0.25f : 0.0f;
+            Eigen::Isometry3f T = Eigen::Isometry3f::Identity();
+            T.linear() = (Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitY()) *
+                          Eigen::AngleAxisf(pitch, Eigen::Vector3f::UnitX())).toRotationMatrix();
+            T.translation() = 0.08f * Eigen::Vector3f(std::sin(yaw), 0.0f, std::cos(yaw));
+            body_from_cam_[c] = T;
+        }
+        ref_from_body_ = body_from_cam_[0].inverse();
+    }
+
+    // Room centred on the origin, y down like the camera frames
+    void buildWorld()
+    {
+        std::mt19937 rng(options_.seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::uniform_int_distribution<int> dark(10, 90);
+        std::uniform_int_distribution<int> bright(160, 250);
+
+        const Eigen::Vector3f half = 0.5f * options_.room_size;
+        struct Face {
+            int axis;       ///< Axis of the normal
+            float sign;     ///< Side of the room
+        };
+        const Face faces[6] = {{0, -1.0f}, {0, 1.0f}, {1, -1.0f}, {1, 1.0f}, {2, -1.0f}, {2, 1.0f}};
+
+        for (const Face& face : faces) {
+            const int u = (face.axis + 1) % 3;
+            const int v = (face.axis + 2) % 3;
+            const float area = options_.room_size[u] * options_.room_size[v];
+            const int count = static_cast<int>(options_.patch_density * area);
+            const float s = 0.5f * options_.patch_size_m;
+
+            for (int i = 0; i < count; ++i) {
+                Patch patch;
+                patch.center[face.axis] = face.sign * half[face.axis];
+                patch.center[u] = (unit(rng) * 2.0f - 1.0f) * (half[u] - s);
+                patch.center[v] = (unit(rng) * 2.0f - 1.0f) * (half[v] - s);
+                patch.normal = Eigen::Vector3f::Zero();
+                patch.normal[face.axis] = -face.sign;
+
+                // Random in-plane rotation, so the descriptors see every orientation
+                const float angle = unit(rng) * 2.0f * static_cast<float>(M_PI);
+                Eigen::Vector3f du = Eigen::Vector3f::Zero(), dv = Eigen::Vector3f::Zero();
+                du[u] = std::cos(angle);
+                du[v] = std::sin(angle);
+                dv[u] = -std::sin(angle);
+                dv[v] = std::cos(angle);
+
+                const float cu[4] = {-1, 1, 1, -1};
+                const float cv[4] = {-1, -1, 1, 1};
+                for (int k = 0; k < 4; ++k)
+                    patch.corners[k] = patch.center + s * (cu[k] * du + cv[k] * dv);
+
+                // Checker of the inner quarter grid: top-left and bottom-right cells
+                const float cells[2][2] = {{-0.5f, -0.5f}, {0.5f, 0.5f}};
+                for (int q = 0; q < 2; ++q) {
+                    const Eigen::Vector3f c = patch.center + s * (cells[q][0] * du + cells[q][1] * dv);
+                    for (int k = 0; k < 4; ++k)
+                        patch.inner[q][k] = c + 0.5f * s * (cu[k] * du + cv[k] * dv);
+                }
+
+                const bool inverted = unit(rng) < 0.5f;
+                patch.outer_intensity = static_cast<uint8_t>(inverted ? bright(rng) : dark(rng));
+                patch.inner_intensity = static_cast<uint8_t>(inverted ? dark(rng) : bright(rng));
+                patches_.push_back(patch);
+            }
+        }
+    }
+
+    // Head motion: sway around the room centre and sinusoidal yaw, pitch and roll
+    Eigen::Isometry3f poseAt(double t) const
+    {
+        const double a = options_.aggressiveness;
+        const double w = 0.3 + 1.2 * a;     // rad/s of the slowest component
+        const double amplitude = 0.3 + 1.2 * a;
+
+        Eigen::Isometry3f T = Eigen::Isometry3f::Identity();
+        T.translation() = Eigen::Vector3f(
+            static_cast<float>(amplitude * std::sin(w * t)),
+            static_cast<float>(0.1 * amplitude * std::sin(2.3 * w * t + 0.4)),
+            static_cast<float>(amplitude * std::sin(0.7 * w * t + 1.1)));
+
+        const double yaw = (0.6 + 0.9 * a) * std::sin(1.3 * w * t) + 0.2 * w * t;
+        const double pitch = (0.15 + 0.3 * a) * std::sin(1.9 * w * t + 0.7);
+        const double roll = (0.05 + 0.15 * a) * std::sin(2.7 * w * t + 0.2);
+        T.linear() = (Eigen::AngleAxisf(static_cast<float>(yaw), Eigen::Vector3f::UnitY()) *
+                      Eigen::AngleAxisf(static_cast<float>(pitch), Eigen::Vector3f::UnitX()) *
+                      Eigen::AngleAxisf(static_cast<float>(roll), Eigen::Vector3f::UnitZ())).toRotationMatrix();
+        return T;
+    }
+
+    // Body-frame rate and specific force by central differences of poseAt()
+    void imuAt(double t, Eigen::Vector3f& gyro, Eigen::Vector3f& accel) const
+    {
+        const double h = 1e-3;
+        const Eigen::Isometry3f before = poseAt(t - h);
+        const Eigen::Isometry3f now = poseAt(t);
+        const Eigen::Isometry3f after = poseAt(t + h);
+
+        const Eigen::AngleAxisf delta(before.rotation().transpose() * after.rotation());
+        gyro = delta.axis() * delta.angle() / static_cast<float>(2.0 * h);
+
+        const Eigen::Vector3f acceleration = (after.translation() - 2.0f * now.translation() + before.translation()) /
+                                             static_cast<float>(h * h);
+        const Eigen::Vector3f gravity(0.0f, kGravity, 0.0f);
+        accel = now.rotation().transpose() * (acceleration - gravity);
+    }
+
+    // Painter's algorithm over the patches facing the camera, far ones first
+    void render(const Eigen::Isometry3f& world_from_cam, cv::Mat& image)
+    {
+        image.setTo(cv::Scalar(128));
+        const Eigen::Isometry3f cam_from_world = world_from_cam.inverse();
+        const Eigen::Vector3f eye = world_from_cam.translation();
+        const float cx = 0.5f * options_.width;
+        const float cy = 0.5f * options_.height;
+
+        visible_.clear();
+        for (size_t i = 0; i < patches_.size(); ++i) {
+            const Patch& patch = patches_[i];
+            if (patch.normal.dot(eye - patch.center) <= 0.0f)
+                continue;
+            const Eigen::Vector3f center = cam_from_world * patch.center;
+            if (center.z() < kNearPlane)
+                continue;
+            const float u = focal_ * center.x() / center.z() + cx;
+            const float v = focal_ * center.y() / center.z() + cy;
+            const float margin = focal_ * options_.patch_size_m / center.z();
+            if (u < -margin || u > options_.width + margin || v < -margin || v > options_.height + margin)
+                continue;
+            visible_.emplace_back(center.z(), i);
+        }
+        std::sort(visible_.begin(), visible_.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+            return a.first > b.first;
+        });
+
+        cv::Point polygon[4];
+        for (const auto& entry : visible_) {
+            const Patch& patch = patches_[entry.second];
+            if (!project(cam_from_world, patch.corners, cx, cy, polygon))
+                continue;
+            cv::fillConvexPoly(image, polygon, 4, cv::Scalar(patch.outer_intensity), cv::LINE_AA, kSubpixelBits);
+            for (int q = 0; q < 2; ++q) {
+                if (project(cam_from_world, patch.inner[q], cx, cy, polygon))
+                    cv::fillConvexPoly(image, polygon, 4, cv::Scalar(patch.inner_intensity), cv::LINE_AA, kSubpixelBits);
+            }
+        }
+    }
+
+    bool project(const Eigen::Isometry3f& cam_from_world, const Eigen::Vector3f* corners,
+                 float cx, float cy, cv::Point* polygon) const
+    {
+        const float scale = static_cast<float>(1 << kSubpixelBits);
+        for (int k = 0; k < 4; ++k) {
+            const Eigen::Vector3f p = cam_from_world * corners[k];
+            if (p.z() < kNearPlane)
+                return false;
+            polygon[k] = cv::Point(static_cast<int>(std::lround((focal_ * p.x() / p.z() + cx) * scale)),
+                                   static_cast<int>(std::lround((focal_ * p.y() / p.z() + cy) * scale)));
+        }
+        return true;
+    }
+
+    static constexpr float kNearPlane = 0.1f;
+    static constexpr int kSubpixelBits = 4;
+
+    Options options_;
+    float focal_;
+    std::vector<Eigen::Isometry3f> body_from_cam_;
+    Eigen::Isometry3f ref_from_body_;
+    std::vector<Patch> patches_;
+    std::vector<std::pair<float, size_t>> visible_;
+};
+
+} // namespace Testing
+} // namespace ORB_SLAM3
+
+#endif // STRESS_WORKLOAD_GENERATOR_HPP
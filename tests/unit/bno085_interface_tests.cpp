@@ -282,6 +282,64 @@ TEST_F(BNO085InterfaceTest, CalibrationAndBias) {
     EXPECT_FLOAT_EQ(bias.bwz, test_bias.bwz);
 }
 
+// Test the batched sensor error model and bias correction
+TEST_F(BNO085InterfaceTest, BatchCalibrationAndBias) {
+    ORB_SLAM3::BNO085Interface::Config config = test_config_;
+    config.accel_misalignment << 1.01f, 0.02f, 0.0f,
+                                 0.0f, 0.99f, -0.01f,
+                                 0.03f, 0.0f, 1.02f;
+    config.gyro_misalignment = Eigen::Matrix3f::Identity() * 1.05f;
+    config.accel_temp_coeff = Eigen::Vector3f(0.001f, 0.002f, 0.003f);
+    config.gyro_temp_coeff = Eigen::Vector3f(0.0001f, 0.0f, -0.0001f);
+    config.reference_temperature = 25.0f;
+    ORB_SLAM3::BNO085Interface imu(config);
+
+    ORB_SLAM3::IMU::Bias bias;
+    bias.bax = 0.1f;
+    bias.bay = -0.2f;
+    bias.baz = 0.3f;
+    bias.bwx = 0.01f;
+    bias.bwy = 0.02f;
+    bias.bwz = -0.03f;
+    imu.SetBias(bias);
+
+    // An odd size covers the vector loop and the scalar tail
+    ORB_SLAM3::BNO085Interface::SampleBlock block;
+    block.size = 7;
+    for (size_t i = 0; i < block.size; ++i) {
+        block.accel_x[i] = 0.1f * i;
+        block.accel_y[i] = -0.2f * i;
+        block.accel_z[i] = 9.81f + 0.05f * i;
+        block.gyro_x[i] = 0.3f - 0.01f * i;
+        block.gyro_y[i] = 0.02f * i;
+        block.gyro_z[i] = -0.1f;
+        block.timestamp[i] = 0.001 * i;
+    }
+    ORB_SLAM3::BNO085Interface::SampleBlock raw = block;
+
+    imu.ApplyCalibrationAndBias(block);
+
+    // No temperature was reported, so the sensor reads 0 degC
+    const float temperature_delta = imu.GetTemperature() - config.reference_temperature;
+    const Eigen::Vector3f accel_bias = Eigen::Vector3f(bias.bax, bias.bay, bias.baz) +
+                                       config.accel_temp_coeff * temperature_delta;
+    const Eigen::Vector3f gyro_bias = Eigen::Vector3f(bias.bwx, bias.bwy, bias.bwz) +
+                                      config.gyro_temp_coeff * temperature_delta;
+    for (size_t i = 0; i < block.size; ++i) {
+        const Eigen::Vector3f accel = config.accel_misalignment *
+            (Eigen::Vector3f(raw.accel_x[i], raw.accel_y[i], raw.accel_z[i]) - accel_bias);
+        const Eigen::Vector3f gyro = config.gyro_misalignment *
+            (Eigen::Vector3f(raw.gyro_x[i], raw.gyro_y[i], raw.gyro_z[i]) - gyro_bias);
+        EXPECT_NEAR(block.accel_x[i], accel.x(), 1e-5f);
+        EXPECT_NEAR(block.accel_y[i], accel.y(), 1e-5f);
+        EXPECT_NEAR(block.accel_z[i], accel.z(), 1e-5f);
+        EXPECT_NEAR(block.gyro_x[i], gyro.x(), 1e-5f);
+        EXPECT_NEAR(block.gyro_y[i], gyro.y(), 1e-5f);
+        EXPECT_NEAR(block.gyro_z[i], gyro.z(), 1e-5f);
+        EXPECT_DOUBLE_EQ(block.timestamp[i], raw.timestamp[i]);
+    }
+}
+
 // Test IMU to camera transform
 TEST_F(BNO085InterfaceTest, ImuToCameraTransform) {
     // This test verifies that IMU to camera transform handling works correctly
@@ -318,6 +376,28 @@ TEST_F(BNO085InterfaceTest, ImuToCameraTransform) {
     EXPECT_NEAR(t_result(2), t(2), 1e-6f);
 }
 
+// Test that the IIO backend and the data-ready mode fail cleanly without their device
+TEST_F(BNO085InterfaceTest, KernelSourcesRequireDevice) {
+    EXPECT_EQ(test_config_.acquisition_mode, ORB_SLAM3::BNO085Interface::AcquisitionMode::POLLING);
+
+    // No IIO device of that name
+    test_config_.interface_type = ORB_SLAM3::BNO085Interface::Interface::IIO;
+    test_config_.iio_device = "iio:device_missing";
+    ORB_SLAM3::BNO085Interface iio_imu(test_config_);
+    EXPECT_FALSE(iio_imu.Initialize());
+    EXPECT_FALSE(iio_imu.StartAcquisition());
+    EXPECT_FALSE(iio_imu.IsConnected());
+
+    // No bus device and no H_INTN line
+    test_config_.interface_type = ORB_SLAM3::BNO085Interface::Interface::I2C;
+    test_config_.acquisition_mode = ORB_SLAM3::BNO085Interface::AcquisitionMode::DATA_READY_GPIO;
+    test_config_.device_path = "/dev/i2c-missing";
+    test_config_.int_gpio_line = -1;
+    ORB_SLAM3::BNO085Interface gpio_imu(test_config_);
+    EXPECT_FALSE(gpio_imu.Initialize());
+    EXPECT_FALSE(gpio_imu.IsConnected());
+}
+
 // Test error handling
 TEST_F(BNO085InterfaceTest, ErrorHandling) {
     // This test would verify that error handling works correctly
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// Include the DMA buffer pool header
+#include "../../include/dma_buffer_pool.hpp"
+
+using ORB_SLAM3::DmaBufferPool;
+
+namespace {
+
+DmaBufferPool::Options missingSources()
+{
+    DmaBufferPool::Options options;
+    options.sources = {"/nonexistent/dma_heap/cma", DmaBufferPool::kUdmabufSource};
+    options.udmabuf_path = "/nonexistent/udmabuf";
+    return options;
+}
+
+} // namespace
+
+TEST(DmaBufferPoolTest, PrefersContiguousHeap)
+{
+    DmaBufferPool::Options options;
+    ASSERT_FALSE(options.sources.empty());
+    EXPECT_EQ(options.sources.front(), "/dev/dma_heap/linux,cma");
+    EXPECT_EQ(options.huge_page_size, 2u * 1024 * 1024);
+
+    DmaBufferPool pool(options);
+    EXPECT_FALSE(pool.IsAllocated());
+    EXPECT_TRUE(pool.GetSource().empty());
+    EXPECT_EQ(pool.GetBufferCount(), 0u);
+    EXPECT_EQ(pool.GetFreeCount(), 0u);
+}
+
+TEST(DmaBufferPoolTest, RejectsEmptyPool)
+{
+    DmaBufferPool pool(missingSources());
+    EXPECT_FALSE(pool.Allocate(0, 4096));
+    EXPECT_FALSE(pool.Allocate(4, 0));
+    EXPECT_FALSE(pool.IsAllocated());
+}
+
+TEST(DmaBufferPoolTest, FailedAllocationLeavesNothing)
+{
+    DmaBufferPool pool(missingSources());
+    EXPECT_FALSE(pool.Allocate(4, 1280 * 800));
+    EXPECT_FALSE(pool.IsAllocated());
+    EXPECT_EQ(pool.GetBufferCount(), 0u);
+    EXPECT_EQ(pool.GetBufferSize(), 0u);
+
+    // Every source tried is in the error
+    const std::string error = pool.GetLastErrorMessage();
+    EXPECT_NE(error.find("/nonexistent/dma_heap/cma"), std::string::npos);
+    EXPECT_NE(error.find(DmaBufferPool::kUdmabufSource), std::string::npos);
+
+    EXPECT_EQ(pool.Acquire(), -1);
+}
+
+TEST(DmaBufferPoolTest, NonHeapDeviceIsRejected)
+{
+    DmaBufferPool::Options options;
+    options.sources = {"/dev/null"};
+    DmaBufferPool pool(options);
+
+    EXPECT_FALSE(pool.Allocate(2, 4096));   // Not a DMA heap, the alloc ioctl fails
+    EXPECT_FALSE(pool.IsAllocated());
+    EXPECT_EQ(pool.Acquire(), -1);
+}
+
+TEST(DmaBufferPoolTest, UnknownMemoryAndHandles)
+{
+    DmaBufferPool pool(missingSources());
+    int value = 0;
+    EXPECT_EQ(pool.FindBuffer(nullptr), -1);
+    EXPECT_EQ(pool.FindBuffer(&value), -1);
+
+    pool.Release(-1);
+    pool.Release(7);
+    EXPECT_EQ(pool.GetFreeCount(), 0u);   // Handles outside the pool are ignored
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
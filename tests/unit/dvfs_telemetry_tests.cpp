@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+// Include the DVFS telemetry header
+#include "../../include/dvfs_telemetry.hpp"
+
+// Times are rounded to microseconds, invalid ones sent as 0
+TEST(DvfsTelemetryTest, Pack) {
+    ORB_SLAM3::DvfsPipelineTelemetry telemetry =
+        ORB_SLAM3::DvfsTelemetry::Pack(11.1111, 0.4, 3.2504, 5.0, ORB_SLAM3::kDvfsHintKeyFrame);
+    EXPECT_EQ(telemetry.frame_period_us, 11111u);
+    EXPECT_EQ(telemetry.acquisition_us, 400u);
+    EXPECT_EQ(telemetry.extraction_us, 3250u);
+    EXPECT_EQ(telemetry.tracking_us, 5000u);
+    EXPECT_EQ(telemetry.hints, ORB_SLAM3::kDvfsHintKeyFrame);
+    EXPECT_EQ(telemetry.reserved, 0u);
+
+    telemetry = ORB_SLAM3::DvfsTelemetry::Pack(-1.0, 0.0, 1e12, 2.0, 0);
+    EXPECT_EQ(telemetry.frame_period_us, 0u);
+    EXPECT_EQ(telemetry.acquisition_us, 0u);
+    EXPECT_EQ(telemetry.extraction_us, UINT32_MAX);
+    EXPECT_EQ(telemetry.tracking_us, 2000u);
+}
+
+// Without the power driver nothing is reported
+TEST(DvfsTelemetryTest, MissingDevice) {
+    ORB_SLAM3::DvfsTelemetry telemetry("/nonexistent/orangepi-vr-power");
+    EXPECT_FALSE(telemetry.Open());
+    EXPECT_FALSE(telemetry.IsOpen());
+
+    telemetry.HintLoad(ORB_SLAM3::kDvfsHintLoopClosure);
+    EXPECT_FALSE(telemetry.Report(11.1, 0.5, 3.0, 5.0));
+    EXPECT_EQ(telemetry.ReadThermalStatus(ORB_SLAM3::kDvfsThermalZoneNpu), -1);
+}
+
+// The thermal status is read from the state page of the driver
+TEST(DvfsTelemetryTest, ThermalStatus) {
+    // A file holding a state page stands in for the device
+    const std::string path = "/tmp/dvfs_telemetry_test_" + std::to_string(getpid());
+    uint32_t page[1024] = {};
+    page[0] = 0x53505256;                   // magic
+    page[1] = 1;                            // version
+    page[6 + ORB_SLAM3::kDvfsThermalZoneCount + ORB_SLAM3::kDvfsThermalZoneNpu] = 2; // thermal_status[NPU]
+    FILE* file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(std::fwrite(page, sizeof(page), 1, file), 1u);
+    std::fclose(file);
+
+    {
+        ORB_SLAM3::DvfsTelemetry telemetry(path);
+        ASSERT_TRUE(telemetry.Open());
+        EXPECT_EQ(telemetry.ReadThermalStatus(ORB_SLAM3::kDvfsThermalZoneNpu), 2);
+        EXPECT_EQ(telemetry.ReadThermalStatus(ORB_SLAM3::kDvfsThermalZoneCpu), 0);
+        EXPECT_EQ(telemetry.ReadThermalStatus(ORB_SLAM3::kDvfsThermalZoneCount), -1);
+    }
+    std::remove(path.c_str());
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+// Include the fixed-lag smoother header
+#include "../../include/fixed_lag_smoother.hpp"
+
+using ORB_SLAM3::FixedLagSmoother;
+
+namespace {
+
+const Eigen::Vector3d kGravity(0.0, 0.0, -9.81);
+const Eigen::Vector3d kAngularVelocity(0.3, -0.2, 0.5);
+const Eigen::Vector3d kInitialVelocity(0.5, -0.2, 0.1);
+constexpr double kImuPeriod = 0.001;
+constexpr double kFramePeriod = 1.0 / 90.0;
+
+// Ground truth: constant body angular velocity, sinusoidal world acceleration
+Sophus::SO3d trueRotation(double t)
+{
+    return Sophus::SO3d::exp(kAngularVelocity * t);
+}
+
+Eigen::Vector3d trueAcceleration(double t)
+{
+    return Eigen::Vector3d(0.8 * std::sin(2.0 * t), 0.5 * std::cos(3.0 * t), 0.2 * std::sin(t));
+}
+
+Eigen::Vector3d trueVelocity(double t)
+{
+    return kInitialVelocity + Eigen::Vector3d(0.4 * (1.0 - std::cos(2.0 * t)),
+                                              0.5 / 3.0 * std::sin(3.0 * t),
+                                              0.2 * (1.0 - std::cos(t)));
+}
+
+Eigen::Vector3d truePosition(double t)
+{
+    return kInitialVelocity * t + Eigen::Vector3d(0.4 * (t - 0.5 * std::sin(2.0 * t)),
+                                                  0.5 / 9.0 * (1.0 - std::cos(3.0 * t)),
+                                                  0.2 * (t - std::sin(t)));
+}
+
+Sophus::SE3f truePose(double t)
+{
+    return Sophus::SE3f(trueRotation(t).cast<float>(), truePosition(t).cast<float>());
+}
+
+Eigen::Matrix3d rightJacobian(const Eigen::Vector3d& v)
+{
+    const double theta = v.norm();
+    const Eigen::Matrix3d W = Sophus::SO3d::hat(v);
+    if (theta < 1e-5) {
+        return Eigen::Matrix3d::Identity() - 0.5 * W;
+    }
+    return Eigen::Matrix3d::Identity() - (1.0 - std::cos(theta)) / (theta * theta) * W +
+           (theta - std::sin(theta)) / (theta * theta * theta) * W * W;
+}
+
+// Preintegrate biased measurements over [t0, t1) the way IMU::Preintegrated does, at zero bias
+FixedLagSmoother::ImuDelta preintegrate(double t0, double t1,
+                                        const Eigen::Vector3d& gyro_bias, const Eigen::Vector3d& acc_bias)
+{
+    Eigen::Matrix3d dR = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d dV = Eigen::Vector3d::Zero();
+    Eigen::Vector3d dP = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d JRg = Eigen::Matrix3d::Zero();
+    Eigen::Matrix3d JVg = Eigen::Matrix3d::Zero();
+    Eigen::Matrix3d JVa = Eigen::Matrix3d::Zero();
+    Eigen::Matrix3d JPg = Eigen::Matrix3d::Zero();
+    Eigen::Matrix3d JPa = Eigen::Matrix3d::Zero();
+    Eigen::Matrix<double, 9, 9> C = Eigen::Matrix<double, 9, 9>::Zero();
+    Eigen::Matrix<double, 6, 6> noise = Eigen::Matrix<double, 6, 6>::Zero();
+    noise.diagonal() << 1e-6, 1e-6, 1e-6, 1e-4, 1e-4, 1e-4;
+
+    const int steps = static_cast<int>(std::round((t1 - t0) / kImuPeriod));
+    const double dt = (t1 - t0) / steps;
+    for (int k = 0; k < steps; ++k) {
+        const double t = t0 + (k + 0.5) * dt;
+        const Eigen::Vector3d w = kAngularVelocity + gyro_bias;
+        const Eigen::Vector3d a = trueRotation(t).inverse() * (trueAcceleration(t) - kGravity) + acc_bias;
+
+        Eigen::Matrix<double, 9, 9> A = Eigen::Matrix<double, 9, 9>::Identity();
+        Eigen::Matrix<double, 9, 6> B = Eigen::Matrix<double, 9, 6>::Zero();
+        const Eigen::Matrix3d Wa = Sophus::SO3d::hat(a);
+        A.block<3, 3>(3, 0) = -dR * dt * Wa;
+        A.block<3, 3>(6, 0) = -0.5 * dR * dt * dt * Wa;
+        A.block<3, 3>(6, 3) = Eigen::Matrix3d::Identity() * dt;
+        B.block<3, 3>(3, 3) = dR * dt;
+        B.block<3, 3>(6, 3) = 0.5 * dR * dt * dt;
+
+        dP += dV * dt + 0.5 * dR * a * dt * dt;
+        dV += dR * a * dt;
+        JPa += JVa * dt - 0.5 * dR * dt * dt;
+        JPg += JVg * dt - 0.5 * dR * dt * dt * Wa * JRg;
+        JVa -= dR * dt;
+        JVg -= dR * dt * Wa * JRg;
+
+        const Eigen::Matrix3d step = Sophus::SO3d::exp(w * dt).matrix();
+        const Eigen::Matrix3d Jr = rightJacobian(w * dt);
+        dR = dR * step;
+        A.block<3, 3>(0, 0) = step.transpose();
+        B.block<3, 3>(0, 0) = Jr * dt;
+        C = A * C * A.transpose() + B * noise * B.transpose();
+        JRg = step.transpose() * JRg - Jr * dt;
+    }
+
+    FixedLagSmoother::ImuDelta delta;
+    delta.delta_R = dR.cast<float>();
+    delta.delta_V = dV.cast<float>();
+    delta.delta_P = dP.cast<float>();
+    delta.dt = static_cast<float>(t1 - t0);
+    delta.covariance = C.cast<float>();
+    delta.JRg = JRg.cast<float>();
+    delta.JVg = JVg.cast<float>();
+    delta.JVa = JVa.cast<float>();
+    delta.JPg = JPg.cast<float>();
+    delta.JPa = JPa.cast<float>();
+    return delta;
+}
+
+FixedLagSmoother::Config makeConfig()
+{
+    FixedLagSmoother::Config config;
+    config.window_size = 5;
+    config.max_iterations = 4;
+    config.visual_position_sigma = 0.002f;
+    config.visual_rotation_sigma = 0.002f;
+    return config;
+}
+
+} // namespace
+
+// Test that the window converges to the trajectory from a zero-velocity start and stays bounded
+TEST(FixedLagSmootherTest, ConvergesToTrajectory) {
+    FixedLagSmoother smoother(makeConfig());
+    const Eigen::Vector3d no_bias = Eigen::Vector3d::Zero();
+
+    for (int i = 0; i < 60; ++i) {
+        const double t = i * kFramePeriod;
+        const Sophus::SE3f pose = truePose(t);
+        smoother.AddFrame(t, preintegrate(t - kFramePeriod, t, no_bias, no_bias), &pose);
+        ASSERT_TRUE(smoother.Optimize());
+        EXPECT_LE(smoother.GetFrameCount(), 5u);
+    }
+
+    const double t = 59 * kFramePeriod;
+    const FixedLagSmoother::FrameState state = smoother.GetLatestState();
+    EXPECT_DOUBLE_EQ(state.timestamp, t);
+    EXPECT_TRUE(smoother.HasMarginalizationPrior());
+    EXPECT_EQ(smoother.GetFrameCount(), 5u);
+    EXPECT_LT((state.pose.translation().cast<double>() - truePosition(t)).norm(), 0.005);
+    EXPECT_LT((state.velocity.cast<double>() - trueVelocity(t)).norm(), 0.05);
+    EXPECT_LT((state.pose.so3().cast<double>().inverse() * trueRotation(t)).log().norm(), 0.005);
+}
+
+// Test that a constant gyroscope bias is observed through the marginalized window
+TEST(FixedLagSmootherTest, EstimatesGyroBias) {
+    FixedLagSmoother smoother(makeConfig());
+    const Eigen::Vector3d gyro_bias(0.02, -0.01, 0.015);
+    const Eigen::Vector3d no_bias = Eigen::Vector3d::Zero();
+
+    for (int i = 0; i < 180; ++i) {
+        const double t = i * kFramePeriod;
+        const Sophus::SE3f pose = truePose(t);
+        smoother.AddFrame(t, preintegrate(t - kFramePeriod, t, gyro_bias, no_bias), &pose);
+        ASSERT_TRUE(smoother.Optimize());
+    }
+
+    const FixedLagSmoother::FrameState state = smoother.GetLatestState();
+    EXPECT_LT((state.bias_gyro.cast<double>() - gyro_bias).norm(), 0.003);
+}
+
+// Test that frames without a tracked pose are carried by the IMU factors
+TEST(FixedLagSmootherTest, ImuOnlyFrames) {
+    FixedLagSmoother smoother(makeConfig());
+    const Eigen::Vector3d no_bias = Eigen::Vector3d::Zero();
+
+    int i = 0;
+    for (; i < 60; ++i) {
+        const double t = i * kFramePeriod;
+        const Sophus::SE3f pose = truePose(t);
+        smoother.AddFrame(t, preintegrate(t - kFramePeriod, t, no_bias, no_bias), &pose);
+        ASSERT_TRUE(smoother.Optimize());
+    }
+    for (; i < 70; ++i) {
+        const double t = i * kFramePeriod;
+        smoother.AddFrame(t, preintegrate(t - kFramePeriod, t, no_bias, no_bias), nullptr);
+        ASSERT_TRUE(smoother.Optimize());
+    }
+
+    const double t = 69 * kFramePeriod;
+    const FixedLagSmoother::FrameState state = smoother.GetLatestState();
+    EXPECT_LT((state.pose.translation().cast<double>() - truePosition(t)).norm(), 0.01);
+    EXPECT_LT((state.velocity.cast<double>() - trueVelocity(t)).norm(), 0.05);
+
+    smoother.Reset();
+    EXPECT_EQ(smoother.GetFrameCount(), 0u);
+    EXPECT_FALSE(smoother.Optimize());
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// Include the flight recorder header
+#include "../../include/flight_recorder.hpp"
+
+using ORB_SLAM3::FlightRecorder;
+using ORB_SLAM3::LatencyStage;
+
+namespace {
+
+constexpr double kFramePeriod = 1.0 / 90.0;
+
+std::string makeOutputDir()
+{
+    char path[] = "/tmp/flight_recorder_testXXXXXX";
+    const char* dir = mkdtemp(path);
+    return dir ? dir : "/tmp";
+}
+
+FlightRecorder::Config makeConfig(const std::string& output_dir)
+{
+    FlightRecorder::Config config;
+    config.window_s = 1.0;
+    config.max_frame_rate_hz = 90.0;
+    config.trigger_latency_ms = 50.0;
+    config.post_trigger_s = 0.1;
+    config.min_dump_interval_s = 5.0;
+    config.output_dir = output_dir;
+    config.include_trace = false;
+    return config;
+}
+
+FlightRecorder::Record makeRecord(int frame, double latency_ms)
+{
+    FlightRecorder::Record record;
+    record.timestamp = 100.0 + frame * kFramePeriod;
+    record.latency.Set(LatencyStage::EXPOSURE_MID, record.timestamp);
+    record.latency.Set(LatencyStage::TRACK_DONE, record.timestamp + latency_ms * 0.5e-3);
+    record.latency.Set(LatencyStage::POSE_PUBLISHED, record.timestamp + latency_ms * 1e-3);
+    record.tracking_ms = static_cast<float>(latency_ms * 0.5);
+    return record;
+}
+
+bool waitForDumps(const FlightRecorder& recorder, uint64_t count)
+{
+    for (int i = 0; i < 200 && recorder.GetDumpCount() < count; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return recorder.GetDumpCount() >= count;
+}
+
+// Data rows of a dump, without the trigger comment and the column header
+int countRows(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    int rows = 0;
+    while (std::getline(file, line)) {
+        rows++;
+    }
+    return rows - 2;
+}
+
+} // namespace
+
+// Test that frame sets within the threshold are never written
+TEST(FlightRecorderTest, NoDumpBelowThreshold) {
+    FlightRecorder recorder(makeConfig(makeOutputDir()));
+    ASSERT_TRUE(recorder.Start());
+
+    for (int i = 0; i < 500; i++) {
+        recorder.Add(makeRecord(i, 20.0));
+    }
+    recorder.Stop();
+
+    EXPECT_EQ(recorder.GetDumpCount(), 0u);
+    EXPECT_TRUE(recorder.GetLastDumpPath().empty());
+}
+
+// Test that a spike writes the window before it and the frames after it
+TEST(FlightRecorderTest, DumpsWindowAroundSpike) {
+    FlightRecorder recorder(makeConfig(makeOutputDir()));
+    ASSERT_TRUE(recorder.Start());
+
+    for (int i = 0; i < 300; i++) {
+        recorder.Add(makeRecord(i, i == 200 ? 80.0 : 20.0));
+    }
+    ASSERT_TRUE(waitForDumps(recorder, 1));
+    recorder.Stop();
+
+    // One second before the spike, the spike, and 0.1 s after it
+    const int rows = countRows(recorder.GetLastDumpPath());
+    EXPECT_GE(rows, 90 + 1 + 9);
+    EXPECT_LE(rows, 90 + 1 + 10);
+
+    std::ifstream file(recorder.GetLastDumpPath());
+    std::string line;
+    std::getline(file, line);
+    EXPECT_NE(line.find("latency_ms=80"), std::string::npos);
+}
+
+// Test that spikes right after a dump do not start another one
+TEST(FlightRecorderTest, RespectsDumpInterval) {
+    FlightRecorder recorder(makeConfig(makeOutputDir()));
+    ASSERT_TRUE(recorder.Start());
+
+    // Spikes 2 s apart, the dump interval is 5 s: the spikes at 0 s and 6 s are dumped
+    for (int i = 0; i < 900; i++) {
+        recorder.Add(makeRecord(i, i % 180 == 10 ? 80.0 : 20.0));
+        if (i == 100) {
+            ASSERT_TRUE(waitForDumps(recorder, 1));
+        }
+    }
+    ASSERT_TRUE(waitForDumps(recorder, 2));
+    recorder.Stop();
+
+    EXPECT_EQ(recorder.GetDumpCount(), 2u);
+    EXPECT_EQ(recorder.GetMissedCount(), 0u);
+}
+
+// Test that a requested dump is written without a spike
+TEST(FlightRecorderTest, RequestedDump) {
+    FlightRecorder recorder(makeConfig(makeOutputDir()));
+    ASSERT_TRUE(recorder.Start());
+
+    for (int i = 0; i < 50; i++) {
+        recorder.Add(makeRecord(i, 20.0));
+    }
+    recorder.RequestDump();
+    for (int i = 50; i < 100; i++) {
+        recorder.Add(makeRecord(i, 20.0));
+    }
+    ASSERT_TRUE(waitForDumps(recorder, 1));
+    recorder.Stop();
+
+    EXPECT_GT(countRows(recorder.GetLastDumpPath()), 50);
+}
+
+// Test that a snapshot taken without the writer is written on Stop()
+TEST(FlightRecorderTest, WritesPendingDumpOnStop) {
+    FlightRecorder::Config config = makeConfig(makeOutputDir());
+    config.post_trigger_s = 0.0;
+    FlightRecorder recorder(config);
+
+    for (int i = 0; i < 20; i++) {
+        recorder.Add(makeRecord(i, i == 19 ? 80.0 : 20.0));
+    }
+    EXPECT_EQ(recorder.GetDumpCount(), 0u);
+    recorder.Stop();
+
+    EXPECT_EQ(recorder.GetDumpCount(), 1u);
+    EXPECT_EQ(countRows(recorder.GetLastDumpPath()), 20);
+}
+
+// Test that thread counters only grow
+TEST(FlightRecorderTest, ThreadCounters) {
+    const FlightRecorder::ThreadCounters start = FlightRecorder::ThreadCounters::Sample();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    const FlightRecorder::ThreadCounters delta = FlightRecorder::ThreadCounters::Sample().Since(start);
+
+    EXPECT_GE(delta.voluntary_switches, 1u);
+    EXPECT_EQ(FlightRecorder::ThreadCounters().Since(start).voluntary_switches, 0u);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Include the frame capture file header
+#include "../../include/frame_capture_file.hpp"
+
+// Test fixture for frame capture file tests
+class FrameCaptureFileTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char path[] = "/tmp/frame_capture_test_XXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        path_ = path;
+
+        ORB_SLAM3::CaptureCameraInfo camera = {};
+        camera.width = 64;
+        camera.height = 48;
+        camera.fps = 90;
+        snprintf(camera.pixel_format, sizeof(camera.pixel_format), "GREY");
+        cameras_.push_back(camera);
+        cameras_.push_back(camera);
+    }
+
+    void TearDown() override {
+        unlink(path_.c_str());
+    }
+
+    ORB_SLAM3::CaptureFrame MakeFrame(int camera_id, double timestamp, const std::vector<uint8_t>& pixels) {
+        ORB_SLAM3::CaptureFrame frame = {};
+        frame.frame_id = static_cast<uint64_t>(timestamp * 1000);
+        frame.timestamp = timestamp;
+        frame.camera_id = camera_id;
+        frame.width = 64;
+        frame.height = 48;
+        frame.data = pixels.data();
+        frame.size = pixels.size();
+        return frame;
+    }
+
+    std::string path_;
+    std::vector<ORB_SLAM3::CaptureCameraInfo> cameras_;
+};
+
+// Test writing and reading back frames and IMU samples
+TEST_F(FrameCaptureFileTest, RoundTrip) {
+    std::vector<uint8_t> pixels0(64 * 48, 10);
+    std::vector<uint8_t> pixels1(64 * 48, 20);
+    std::vector<uint8_t> scaled(32 * 24, 30);
+
+    ORB_SLAM3::FrameCaptureWriter writer;
+    ASSERT_TRUE(writer.Open(path_, cameras_));
+
+    EXPECT_TRUE(writer.WriteFrame(MakeFrame(0, 1.000, pixels0)));
+
+    ORB_SLAM3::CaptureFrame frame1 = MakeFrame(1, 1.001, pixels1);
+    frame1.is_keyframe = true;
+    frame1.scaled_width = 32;
+    frame1.scaled_height = 24;
+    frame1.scaled_stride = 32;
+    frame1.scaled_data = scaled.data();
+    frame1.scaled_size = scaled.size();
+    EXPECT_TRUE(writer.WriteFrame(frame1));
+
+    // IMU samples arriving out of order are sorted on read
+    ORB_SLAM3::CaptureImuSample imu = {};
+    imu.timestamp = 1.002;
+    imu.acc[2] = 9.81f;
+    EXPECT_TRUE(writer.WriteImuSample(imu));
+    imu.timestamp = 0.999;
+    imu.gyro[0] = 0.5f;
+    EXPECT_TRUE(writer.WriteImuSample(imu));
+    writer.Close();
+
+    ORB_SLAM3::FrameCaptureReader reader;
+    ASSERT_TRUE(reader.Open(path_));
+    ASSERT_EQ(reader.GetCameras().size(), 2u);
+    EXPECT_EQ(reader.GetCameras()[0].width, 64);
+    EXPECT_STREQ(reader.GetCameras()[1].pixel_format, "GREY");
+    ASSERT_EQ(reader.GetFrameCount(), 2u);
+
+    const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+    ORB_SLAM3::CaptureFrame frame;
+    ASSERT_TRUE(reader.GetFrame(0, frame));
+    EXPECT_EQ(frame.camera_id, 0);
+    EXPECT_DOUBLE_EQ(frame.timestamp, 1.000);
+    ASSERT_EQ(frame.size, pixels0.size());
+    EXPECT_EQ(static_cast<const uint8_t*>(frame.data)[0], 10);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(frame.data) % page_size, 0u);
+    EXPECT_EQ(frame.scaled_data, nullptr);
+    EXPECT_EQ(frame.scaled_size, 0u);
+
+    ASSERT_TRUE(reader.GetFrame(1, frame));
+    EXPECT_EQ(frame.camera_id, 1);
+    EXPECT_TRUE(frame.is_keyframe);
+    EXPECT_EQ(static_cast<const uint8_t*>(frame.data)[pixels1.size() - 1], 20);
+    ASSERT_NE(frame.scaled_data, nullptr);
+    EXPECT_EQ(frame.scaled_size, scaled.size());
+    EXPECT_EQ(frame.scaled_width, 32);
+    EXPECT_EQ(static_cast<const uint8_t*>(frame.scaled_data)[0], 30);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(frame.scaled_data) % page_size, 0u);
+
+    EXPECT_FALSE(reader.GetFrame(2, frame));
+
+    ASSERT_EQ(reader.GetImuSamples().size(), 2u);
+    EXPECT_DOUBLE_EQ(reader.GetImuSamples()[0].timestamp, 0.999);
+    EXPECT_FLOAT_EQ(reader.GetImuSamples()[0].gyro[0], 0.5f);
+    EXPECT_FLOAT_EQ(reader.GetImuSamples()[1].acc[2], 9.81f);
+}
+
+// Test that a capture cut short is readable up to the last complete record
+TEST_F(FrameCaptureFileTest, TruncatedFile) {
+    std::vector<uint8_t> pixels(64 * 48, 1);
+
+    ORB_SLAM3::FrameCaptureWriter writer;
+    ASSERT_TRUE(writer.Open(path_, cameras_));
+    EXPECT_TRUE(writer.WriteFrame(MakeFrame(0, 1.0, pixels)));
+    const uint64_t complete_size = writer.GetBytesWritten();
+    EXPECT_TRUE(writer.WriteFrame(MakeFrame(1, 1.0, pixels)));
+    writer.Close();
+
+    ASSERT_EQ(truncate(path_.c_str(), static_cast<off_t>(complete_size + 100)), 0);
+
+    ORB_SLAM3::FrameCaptureReader reader;
+    ASSERT_TRUE(reader.Open(path_));
+    EXPECT_EQ(reader.GetFrameCount(), 1u);
+}
+
+// Test error handling
+TEST_F(FrameCaptureFileTest, ErrorHandling) {
+    ORB_SLAM3::FrameCaptureWriter writer;
+    std::vector<uint8_t> pixels(16, 0);
+    EXPECT_FALSE(writer.WriteFrame(MakeFrame(0, 1.0, pixels)));
+    EXPECT_FALSE(writer.Open("/nonexistent/dir/capture.vrcap", cameras_));
+
+    // Not a capture file
+    FILE* file = fopen(path_.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    std::vector<uint8_t> garbage(8192, 0xAB);
+    fwrite(garbage.data(), 1, garbage.size(), file);
+    fclose(file);
+
+    ORB_SLAM3::FrameCaptureReader reader;
+    EXPECT_FALSE(reader.Open(path_));
+    EXPECT_FALSE(reader.IsOpen());
+    EXPECT_FALSE(reader.Open("/nonexistent/capture.vrcap"));
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
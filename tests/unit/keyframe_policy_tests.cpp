@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+// Include the keyframe policy header
+#include "../../include/keyframe_policy.hpp"
+
+using ORB_SLAM3::KeyFramePolicy;
+
+namespace {
+
+// Rig keyframe a short while after the last one, idle mapper that was measured
+KeyFramePolicy::Candidate makeCandidate()
+{
+    KeyFramePolicy::Candidate candidate;
+    candidate.seconds_since_keyframe = 0.2;
+    candidate.cameras = 4;
+    candidate.keyframe_cost_ms = 40.0f;
+    candidate.local_ba_ms = 20.0f;
+    candidate.queued_keyframes = 0;
+    return candidate;
+}
+
+} // namespace
+
+// Test that a keyframe without motion or novel structure is suppressed
+TEST(KeyFramePolicyTest, SuppressesRedundantKeyFrames) {
+    KeyFramePolicy policy;
+    KeyFramePolicy::Candidate candidate = makeCandidate();
+    candidate.translation_m = 0.005f;
+    candidate.novel_fraction = 0.05f;
+
+    KeyFramePolicy::Decision decision = policy.Decide(candidate);
+    EXPECT_FALSE(decision.accept);
+    EXPECT_EQ(decision.reason, KeyFramePolicy::Reason::REDUNDANT);
+    EXPECT_EQ(policy.GetSuppressedCount(), 1u);
+
+    // One camera looking at new structure keeps it out of the redundant case
+    candidate.novel_cameras = 1;
+    decision = policy.Decide(candidate);
+    EXPECT_NE(decision.reason, KeyFramePolicy::Reason::REDUNDANT);
+}
+
+// Test that the value a keyframe needs grows with the mapper queue
+TEST(KeyFramePolicyTest, BacklogRaisesTheRequiredValue) {
+    KeyFramePolicy policy;
+    KeyFramePolicy::Candidate candidate = makeCandidate();
+    candidate.translation_m = 0.09f;
+    candidate.novel_cameras = 2;
+
+    KeyFramePolicy::Decision idle = policy.Decide(candidate);
+    EXPECT_TRUE(idle.accept);
+    EXPECT_EQ(idle.reason, KeyFramePolicy::Reason::VALUE);
+    EXPECT_FLOAT_EQ(idle.mapping_ms, 60.0f);
+
+    candidate.queued_keyframes = 3;
+    KeyFramePolicy::Decision busy = policy.Decide(candidate);
+    EXPECT_FALSE(busy.accept);
+    EXPECT_EQ(busy.reason, KeyFramePolicy::Reason::BACKLOG);
+    EXPECT_FLOAT_EQ(busy.mapping_ms, 180.0f);
+    EXPECT_GT(busy.required_value, idle.required_value);
+
+    // Fast motion is worth the wait
+    candidate.speed_mps = 1.0f;
+    EXPECT_TRUE(policy.Decide(candidate).accept);
+    EXPECT_EQ(policy.GetCount(KeyFramePolicy::Reason::BACKLOG), 1u);
+    EXPECT_EQ(policy.GetCount(KeyFramePolicy::Reason::VALUE), 2u);
+}
+
+// Test the per-camera cost estimate before the mapper was measured
+TEST(KeyFramePolicyTest, UnmeasuredCostScalesWithCameras) {
+    KeyFramePolicy::Config config;
+    config.camera_cost_ms = 10.0f;
+    KeyFramePolicy policy(config);
+
+    KeyFramePolicy::Candidate candidate = makeCandidate();
+    candidate.keyframe_cost_ms = 0.0f;
+    candidate.local_ba_ms = 0.0f;
+    candidate.cameras = 1;
+    const float mono_ms = policy.Decide(candidate).mapping_ms;
+    candidate.cameras = 4;
+    const float rig_ms = policy.Decide(candidate).mapping_ms;
+    EXPECT_FLOAT_EQ(mono_ms, 10.0f);
+    EXPECT_FLOAT_EQ(rig_ms, 40.0f);
+}
+
+// Test that weak tracking and a long gap always get their keyframe
+TEST(KeyFramePolicyTest, UrgentAndIntervalAlwaysAccepted) {
+    KeyFramePolicy policy;
+    KeyFramePolicy::Candidate candidate = makeCandidate();
+    candidate.queued_keyframes = 10;
+
+    candidate.urgent = true;
+    KeyFramePolicy::Decision decision = policy.Decide(candidate);
+    EXPECT_TRUE(decision.accept);
+    EXPECT_EQ(decision.reason, KeyFramePolicy::Reason::URGENT);
+
+    candidate.urgent = false;
+    candidate.seconds_since_keyframe = 1.5;
+    decision = policy.Decide(candidate);
+    EXPECT_TRUE(decision.accept);
+    EXPECT_EQ(decision.reason, KeyFramePolicy::Reason::INTERVAL);
+    EXPECT_EQ(policy.GetLastDecision().reason, KeyFramePolicy::Reason::INTERVAL);
+    EXPECT_EQ(policy.GetSuppressedCount(), 0u);
+    EXPECT_STREQ(KeyFramePolicy::GetReasonName(KeyFramePolicy::Reason::INTERVAL), "interval");
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
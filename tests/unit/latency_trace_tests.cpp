@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+// Include the latency trace header
+#include "../../include/latency_trace.hpp"
+
+using ORB_SLAM3::LatencyStage;
+
+// Test stamping and merging the stamps of a frame set
+TEST(LatencyTraceTest, StampsAndMerge) {
+    ORB_SLAM3::LatencyStamps a;
+    EXPECT_FALSE(a.Has(LatencyStage::DQBUF));
+
+    const double before = ORB_SLAM3::LatencyNowSeconds();
+    a.Stamp(LatencyStage::DQBUF);
+    EXPECT_TRUE(a.Has(LatencyStage::DQBUF));
+    EXPECT_GE(a.Get(LatencyStage::DQBUF), before);
+
+    a.Set(LatencyStage::EXPOSURE_MID, 10.0);
+    a.Set(LatencyStage::DQBUF, 10.5);
+
+    ORB_SLAM3::LatencyStamps b;
+    b.Set(LatencyStage::EXPOSURE_MID, 9.0);
+    b.Set(LatencyStage::DQBUF, 11.0);
+    b.Set(LatencyStage::TPU_DONE, 12.0);
+
+    // Earliest exposure, latest of everything else, unstamped stages adopted
+    a.Merge(b);
+    EXPECT_DOUBLE_EQ(a.Get(LatencyStage::EXPOSURE_MID), 9.0);
+    EXPECT_DOUBLE_EQ(a.Get(LatencyStage::DQBUF), 11.0);
+    EXPECT_DOUBLE_EQ(a.Get(LatencyStage::TPU_DONE), 12.0);
+    EXPECT_FALSE(a.Has(LatencyStage::TPU_SUBMIT));
+
+    EXPECT_STREQ(ORB_SLAM3::GetLatencyStageName(LatencyStage::TPU_DONE), "tpu_done");
+}
+
+// Test that percentiles expose rare spikes within the bucket resolution
+TEST(LatencyTraceTest, HistogramPercentiles) {
+    ORB_SLAM3::LatencyHistogram histogram;
+    EXPECT_EQ(histogram.GetCount(), 0u);
+    EXPECT_DOUBLE_EQ(histogram.GetPercentile(50.0), 0.0);
+
+    // 990 frames at 5 ms and 10 spikes at 40 ms
+    for (int i = 0; i < 990; i++) {
+        histogram.Record(5.0);
+    }
+    for (int i = 0; i < 10; i++) {
+        histogram.Record(40.0);
+    }
+
+    ORB_SLAM3::LatencyPercentiles percentiles = histogram.GetPercentiles();
+    EXPECT_EQ(percentiles.count, 1000u);
+    EXPECT_NEAR(percentiles.p50_ms, 5.0, 5.0 / 16);
+    EXPECT_NEAR(percentiles.p99_ms, 5.0, 5.0 / 16);
+    EXPECT_NEAR(percentiles.p999_ms, 40.0, 40.0 / 16);
+    EXPECT_DOUBLE_EQ(percentiles.max_ms, 40.0);
+    EXPECT_GE(percentiles.p50_ms, 5.0);
+
+    // Small values are exact, huge values still count
+    histogram.Reset();
+    histogram.Record(0.003);
+    EXPECT_DOUBLE_EQ(histogram.GetPercentile(100.0), 0.003);
+    histogram.Record(100000.0);
+    EXPECT_EQ(histogram.GetCount(), 2u);
+    EXPECT_DOUBLE_EQ(histogram.GetPercentiles().max_ms, 100000.0);
+    histogram.Record(-1.0);
+    EXPECT_DOUBLE_EQ(histogram.GetPercentile(0.0), 0.0);
+}
+
+// Test concurrent recording
+TEST(LatencyTraceTest, ConcurrentRecord) {
+    ORB_SLAM3::LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&histogram, t]() {
+            for (int i = 0; i < 10000; i++) {
+                histogram.Record(1.0 + t);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(histogram.GetCount(), 40000u);
+    EXPECT_DOUBLE_EQ(histogram.GetPercentiles().max_ms, 4.0);
+}
+
+// Test per-stage accounting
+TEST(LatencyTraceTest, TrackerStages) {
+    ORB_SLAM3::LatencyTracker tracker;
+
+    ORB_SLAM3::LatencyStamps stamps;
+    stamps.Set(LatencyStage::EXPOSURE_MID, 1.000);
+    stamps.Set(LatencyStage::DQBUF, 1.004);
+    stamps.Set(LatencyStage::TPU_SUBMIT, 1.005);
+    stamps.Set(LatencyStage::TPU_DONE, 1.010);
+    stamps.Set(LatencyStage::TRACK_DONE, 1.012);
+    stamps.Set(LatencyStage::POSE_PUBLISHED, 1.013);
+    tracker.Record(stamps);
+
+    // A frame that skipped the TPU is charged from DQBUF to tracking
+    ORB_SLAM3::LatencyStamps cpu;
+    cpu.Set(LatencyStage::EXPOSURE_MID, 2.000);
+    cpu.Set(LatencyStage::DQBUF, 2.004);
+    cpu.Set(LatencyStage::TRACK_DONE, 2.020);
+    tracker.Record(cpu);
+
+    EXPECT_EQ(tracker.GetStagePercentiles(LatencyStage::EXPOSURE_MID).count, 0u);
+    EXPECT_EQ(tracker.GetStagePercentiles(LatencyStage::DQBUF).count, 2u);
+    EXPECT_NEAR(tracker.GetStagePercentiles(LatencyStage::DQBUF).max_ms, 4.0, 0.01);
+    EXPECT_EQ(tracker.GetStagePercentiles(LatencyStage::TPU_DONE).count, 1u);
+    EXPECT_NEAR(tracker.GetStagePercentiles(LatencyStage::TPU_DONE).max_ms, 5.0, 0.01);
+    EXPECT_EQ(tracker.GetStagePercentiles(LatencyStage::TRACK_DONE).count, 2u);
+    EXPECT_NEAR(tracker.GetStagePercentiles(LatencyStage::TRACK_DONE).max_ms, 16.0, 0.01);
+
+    ORB_SLAM3::LatencyPercentiles end_to_end = tracker.GetEndToEndPercentiles();
+    EXPECT_EQ(end_to_end.count, 1u);
+    EXPECT_NEAR(end_to_end.max_ms, 13.0, 0.01);
+
+    tracker.Reset();
+    EXPECT_EQ(tracker.GetEndToEndPercentiles().count, 0u);
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Include the lens distortion mesh header
+#include "../../include/lens_distortion_mesh.hpp"
+
+// Test fixture for lens distortion mesh tests
+class LensDistortionMeshTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        calibration_.width = 1832;
+        calibration_.height = 1920;
+        calibration_.center_x = 916.0;
+        calibration_.center_y = 960.0;
+        calibration_.radius_px = 960.0;
+        const double k_red[3] = {0.20, 0.05, 0.0};
+        const double k_green[3] = {0.22, 0.06, 0.0};
+        const double k_blue[3] = {0.25, 0.07, 0.0};
+        std::memcpy(calibration_.k_red, k_red, sizeof(k_red));
+        std::memcpy(calibration_.k_green, k_green, sizeof(k_green));
+        std::memcpy(calibration_.k_blue, k_blue, sizeof(k_blue));
+    }
+
+    // Source position the radial model samples for an output pixel
+    void Expected(const double k[3], double x, double y, double& src_x, double& src_y) const {
+        const double dx = x - calibration_.center_x;
+        const double dy = y - calibration_.center_y;
+        const double r2 = (dx * dx + dy * dy) / (calibration_.radius_px * calibration_.radius_px);
+        const double scale = 1.0 + k[0] * r2 + k[1] * r2 * r2 + k[2] * r2 * r2 * r2;
+        src_x = calibration_.center_x + dx * scale;
+        src_y = calibration_.center_y + dy * scale;
+    }
+
+    ORB_SLAM3::LensCalibration calibration_ = {};
+};
+
+// The mesh carries the header the driver checks
+TEST_F(LensDistortionMeshTest, Layout) {
+    std::vector<uint8_t> mesh = ORB_SLAM3::BuildDistortionMesh(calibration_, 33, 33);
+    ASSERT_EQ(mesh.size(), sizeof(ORB_SLAM3::DistortionMeshHeader) + 33 * 33 * sizeof(ORB_SLAM3::DistortionMeshVertex));
+
+    ORB_SLAM3::DistortionMeshHeader header;
+    std::memcpy(&header, mesh.data(), sizeof(header));
+    EXPECT_EQ(header.magic, ORB_SLAM3::kDistortionMeshMagic);
+    EXPECT_EQ(header.cols, 33);
+    EXPECT_EQ(header.rows, 33);
+    EXPECT_EQ(header.width, 1832);
+    EXPECT_EQ(header.height, 1920);
+
+    // A 33x33 mesh is a small fraction of a dense per-pixel map
+    EXPECT_LT(mesh.size(), static_cast<size_t>(calibration_.width) * calibration_.height / 100);
+}
+
+// Vertices hold the model exactly, cells interpolate it closely
+TEST_F(LensDistortionMeshTest, MatchesCalibration) {
+    std::vector<uint8_t> mesh = ORB_SLAM3::BuildDistortionMesh(calibration_, 65, 65);
+    ASSERT_FALSE(mesh.empty());
+
+    const double* k[3] = {calibration_.k_red, calibration_.k_green, calibration_.k_blue};
+    const double points[][2] = {{916.0, 960.0}, {0.0, 0.0}, {1832.0, 1920.0}, {400.0, 1500.0}, {1203.7, 311.2}};
+
+    for (int channel = 0; channel < 3; ++channel) {
+        for (const auto& p : points) {
+            double src_x, src_y, expected_x, expected_y;
+            ASSERT_TRUE(ORB_SLAM3::SampleDistortionMesh(mesh, p[0], p[1], channel, src_x, src_y));
+            Expected(k[channel], p[0], p[1], expected_x, expected_y);
+            EXPECT_NEAR(src_x, expected_x, 1.5);
+            EXPECT_NEAR(src_y, expected_y, 1.5);
+        }
+    }
+
+    // The centre is not displaced, the channels spread towards the corners
+    double red_x, red_y, blue_x, blue_y;
+    ASSERT_TRUE(ORB_SLAM3::SampleDistortionMesh(mesh, 0.0, 0.0, 0, red_x, red_y));
+    ASSERT_TRUE(ORB_SLAM3::SampleDistortionMesh(mesh, 0.0, 0.0, 2, blue_x, blue_y));
+    EXPECT_LT(blue_x, red_x);
+    EXPECT_LT(blue_y, red_y);
+}
+
+// Invalid grids and calibrations are rejected
+TEST_F(LensDistortionMeshTest, RejectsInvalid) {
+    EXPECT_TRUE(ORB_SLAM3::BuildDistortionMesh(calibration_, 1, 33).empty());
+    EXPECT_TRUE(ORB_SLAM3::BuildDistortionMesh(calibration_, 33, 66).empty());
+
+    ORB_SLAM3::LensCalibration bad = calibration_;
+    bad.radius_px = 0.0;
+    EXPECT_TRUE(ORB_SLAM3::BuildDistortionMesh(bad, 33, 33).empty());
+
+    std::vector<uint8_t> mesh = ORB_SLAM3::BuildDistortionMesh(calibration_, 9, 9);
+    mesh.pop_back();
+    double x, y;
+    EXPECT_FALSE(ORB_SLAM3::SampleDistortionMesh(mesh, 10.0, 10.0, 0, x, y));
+}
@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Include the map sharing header
+#include "../../include/map_sharing.hpp"
+
+using ORB_SLAM3::KeyFrameDelta;
+using ORB_SLAM3::MapDeltaCodec;
+using ORB_SLAM3::MapPointDelta;
+using ORB_SLAM3::MapShareClient;
+using ORB_SLAM3::MapShareServer;
+
+namespace {
+
+// Keyframe of n keypoints, every third one observing a map point
+KeyFrameDelta makeDelta(uint64_t keyframe_id, int n, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    KeyFrameDelta delta;
+    delta.keyframe_id = keyframe_id;
+    delta.timestamp = 12.5 + keyframe_id;
+    delta.rotation[0] = 0.1f;
+    delta.rotation[3] = 0.995f;
+    delta.translation[2] = 1.5f;
+    delta.camera = 2;
+    for (int i = 0; i < n; ++i) {
+        ORB_SLAM3::KeyFrameDeltaKeyPoint keypoint;
+        keypoint.x = (rng() % 12800) / 10.0f;
+        keypoint.y = (rng() % 8000) / 10.0f;
+        keypoint.octave = static_cast<uint8_t>(rng() % 8);
+        keypoint.angle = (rng() % 3600) / 10.0f;
+        delta.keypoints.push_back(keypoint);
+        for (size_t j = 0; j < ORB_SLAM3::kMapDeltaDescriptorBytes; ++j) {
+            delta.descriptors.push_back(static_cast<uint8_t>(rng()));
+        }
+        if (i % 3 == 0) {
+            MapPointDelta point;
+            point.id = ORB_SLAM3::MakeSharedMapPointId(7, 1000 + rng() % 100000);
+            point.position[0] = i * 0.01f;
+            point.position[2] = 3.0f;
+            delta.observations.push_back(static_cast<int32_t>(delta.points.size()));
+            delta.points.push_back(point);
+        } else {
+            delta.observations.push_back(-1);
+        }
+    }
+    uint32_t word = 0;
+    for (int i = 0; i < n / 2; ++i) {
+        word += 1 + rng() % 500;
+        delta.bow.emplace_back(word, (rng() % 1000) / 50000.0f);
+    }
+    return delta;
+}
+
+// Polls the server and the clients until done() or the timeout
+template <typename Done>
+bool pump(MapShareServer& server, std::vector<MapShareClient*> clients,
+          std::vector<std::vector<KeyFrameDelta>>& received, Done done)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    received.resize(clients.size());
+    while (std::chrono::steady_clock::now() < deadline) {
+        server.Poll(1);
+        for (size_t i = 0; i < clients.size(); ++i) {
+            clients[i]->Poll(received[i], 1);
+        }
+        if (done()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+// Test that a delta survives the encoding up to the quantization
+TEST(MapSharingTest, CodecRoundTrip) {
+    const KeyFrameDelta delta = makeDelta(42, 1000, 1);
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(MapDeltaCodec::Encode(delta, payload));
+    EXPECT_LT(payload.size(), 50000u);
+
+    KeyFrameDelta decoded;
+    ASSERT_TRUE(MapDeltaCodec::Decode(payload.data(), payload.size(), 7, decoded));
+    EXPECT_EQ(decoded.device_id, 7);
+    EXPECT_EQ(decoded.keyframe_id, 42u);
+    EXPECT_DOUBLE_EQ(decoded.timestamp, delta.timestamp);
+    EXPECT_EQ(std::memcmp(decoded.rotation, delta.rotation, sizeof(delta.rotation)), 0);
+    EXPECT_EQ(decoded.camera, 2);
+    EXPECT_EQ(decoded.descriptors, delta.descriptors);
+    ASSERT_EQ(decoded.keypoints.size(), delta.keypoints.size());
+    for (size_t i = 0; i < delta.keypoints.size(); ++i) {
+        EXPECT_NEAR(decoded.keypoints[i].x, delta.keypoints[i].x, 1.0f / 32.0f);
+        EXPECT_NEAR(decoded.keypoints[i].y, delta.keypoints[i].y, 1.0f / 32.0f);
+        EXPECT_EQ(decoded.keypoints[i].octave, delta.keypoints[i].octave);
+        const float angle_error = std::fabs(decoded.keypoints[i].angle - delta.keypoints[i].angle);
+        EXPECT_LT(std::min(angle_error, 360.0f - angle_error), 0.71f);
+    }
+    ASSERT_EQ(decoded.bow.size(), delta.bow.size());
+    for (size_t i = 0; i < delta.bow.size(); ++i) {
+        EXPECT_EQ(decoded.bow[i].first, delta.bow[i].first);
+        EXPECT_NEAR(decoded.bow[i].second, delta.bow[i].second, 1.0f / 65535.0f);
+    }
+
+    // Points come back sorted by id, the observations follow them
+    ASSERT_EQ(decoded.points.size(), delta.points.size());
+    for (size_t i = 0; i < delta.observations.size(); ++i) {
+        ASSERT_EQ(decoded.observations[i] < 0, delta.observations[i] < 0);
+        if (delta.observations[i] >= 0) {
+            const MapPointDelta& a = decoded.points[decoded.observations[i]];
+            const MapPointDelta& b = delta.points[delta.observations[i]];
+            EXPECT_EQ(a.id, b.id);
+            EXPECT_EQ(a.position[0], b.position[0]);
+        }
+    }
+}
+
+// Test that truncated or inconsistent deltas are rejected
+TEST(MapSharingTest, CodecRejectsMalformedDeltas) {
+    KeyFrameDelta delta = makeDelta(1, 50, 2);
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(MapDeltaCodec::Encode(delta, payload));
+
+    KeyFrameDelta decoded;
+    for (size_t size = 0; size < payload.size(); size += 7) {
+        EXPECT_FALSE(MapDeltaCodec::Decode(payload.data(), size, 1, decoded));
+    }
+    payload.push_back(0);
+    EXPECT_FALSE(MapDeltaCodec::Decode(payload.data(), payload.size(), 1, decoded));
+
+    delta.observations[0] = static_cast<int32_t>(delta.points.size());
+    EXPECT_FALSE(MapDeltaCodec::Encode(delta, payload));
+    delta.observations.pop_back();
+    EXPECT_FALSE(MapDeltaCodec::Encode(delta, payload));
+}
+
+// Test that the server relays deltas to the other headsets and replays them to late joiners
+TEST(MapSharingTest, ServerRelaysAndReplays) {
+    MapShareServer::Options server_options;
+    server_options.port = 0;
+    MapShareServer server(server_options);
+    ASSERT_TRUE(server.IsValid());
+
+    MapShareClient::Options options;
+    options.host = "127.0.0.1";
+    options.port = server.GetPort();
+    options.reconnect_interval_ms = 10;
+    options.device_id = 1;
+    MapShareClient first(options);
+    options.device_id = 2;
+    MapShareClient second(options);
+    ASSERT_TRUE(first.IsValid());
+
+    std::vector<std::vector<KeyFrameDelta>> received;
+    ASSERT_TRUE(pump(server, {&first, &second}, received, [&]() {
+        return first.IsConnected() && second.IsConnected() && server.GetStats().clients == 2;
+    }));
+
+    EXPECT_TRUE(first.Publish(makeDelta(10, 200, 3)));
+    EXPECT_TRUE(first.Publish(makeDelta(11, 200, 4)));
+    EXPECT_TRUE(second.Publish(makeDelta(20, 200, 5)));
+    ASSERT_TRUE(pump(server, {&first, &second}, received, [&]() {
+        return received[0].size() == 1 && received[1].size() == 2;
+    }));
+    EXPECT_EQ(received[0][0].device_id, 2);
+    EXPECT_EQ(received[0][0].keyframe_id, 20u);
+    EXPECT_EQ(received[1][0].keyframe_id, 10u);
+    EXPECT_EQ(received[1][1].keyframe_id, 11u);
+    EXPECT_EQ(first.GetStats().deltas_sent, 2u);
+    EXPECT_EQ(first.GetStats().queued_bytes, 0u);
+
+    // A third headset gets the whole shared map
+    options.device_id = 3;
+    MapShareClient third(options);
+    std::vector<std::vector<KeyFrameDelta>> late;
+    ASSERT_TRUE(pump(server, {&third}, late, [&]() { return late[0].size() == 3; }));
+    EXPECT_EQ(server.GetStats().deltas_received, 3u);
+    EXPECT_EQ(server.GetStats().messages_invalid, 0u);
+}
+
+// Test that deltas published while the server is down are sent once it is up
+TEST(MapSharingTest, QueuesWhileDisconnected) {
+    MapShareServer::Options server_options;
+    server_options.port = 0;
+    auto probe = std::make_unique<MapShareServer>(server_options);
+    const int port = probe->GetPort();
+    probe.reset();
+
+    MapShareClient::Options options;
+    options.host = "127.0.0.1";
+    options.port = port;
+    options.reconnect_interval_ms = 10;
+    options.device_id = 4;
+    options.max_queued_bytes = 12000;
+    MapShareClient client(options);
+
+    std::vector<KeyFrameDelta> received;
+    EXPECT_TRUE(client.Publish(makeDelta(1, 100, 6)));
+    EXPECT_TRUE(client.Publish(makeDelta(2, 100, 7)));
+    EXPECT_FALSE(client.Publish(makeDelta(3, 100, 8)));    // Queue full
+    client.Poll(received, 0);
+    EXPECT_FALSE(client.IsConnected());
+    EXPECT_EQ(client.GetStats().deltas_dropped, 1u);
+
+    server_options.port = port;
+    MapShareServer server(server_options);
+    ASSERT_TRUE(server.IsValid());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::vector<std::vector<KeyFrameDelta>> unused;
+    ASSERT_TRUE(pump(server, {&client}, unused, [&]() { return server.GetStats().deltas_received == 2; }));
+    EXPECT_EQ(client.GetStats().queued_bytes, 0u);
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
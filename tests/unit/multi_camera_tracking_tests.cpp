@@ -235,6 +235,24 @@ TEST_F(MultiCameraTrackingTest, Configuration) {
     EXPECT_FALSE(new_config.parallel_feature_extraction);
 }
 
+// Test camera scheduling
+TEST_F(MultiCameraTrackingTest, CameraScheduling) {
+    // All cameras run before anything was tracked
+    std::vector<float> scores = tracking_->GetCameraScores();
+    EXPECT_EQ(scores.size(), tracking_->GetMultiCameraRig().GetAllCameras().size());
+    EXPECT_EQ(tracking_->GetScheduledCameras().size(), scores.size());
+    
+    // Limiting the scheduled cameras is a configuration change only
+    MultiCameraTracking::Config config = tracking_->GetConfig();
+    config.scheduled_cameras = 2;
+    config.unscheduled_camera_interval = 3;
+    tracking_->SetConfig(config);
+    tracking_->SetMotionHint(Eigen::Vector3f(0.0f, 0.0f, 1.0f));
+    
+    EXPECT_EQ(tracking_->GetConfig().scheduled_cameras, 2);
+    EXPECT_EQ(tracking_->GetConfig().unscheduled_camera_interval, 3);
+}
+
 // Test camera visibility
 TEST_F(MultiCameraTrackingTest, CameraVisibility) {
     // Create a 3D point in front of the reference camera
@@ -280,6 +298,46 @@ TEST_F(MultiCameraTrackingTest, CameraTransforms) {
     }
 }
 
+// Test that the batch transforms agree with the per-point one and follow calibration updates
+TEST_F(MultiCameraTrackingTest, BatchTransforms) {
+    const std::vector<cv::Point3f> points = {
+        cv::Point3f(0.1f, -0.2f, 1.0f), cv::Point3f(1.5f, 0.3f, 2.0f), cv::Point3f(-0.4f, 0.0f, 0.5f)};
+    
+    std::vector<cv::Point3f> transformed;
+    ASSERT_TRUE(rig_.TransformPoints(points, 0, 1, transformed));
+    ASSERT_EQ(transformed.size(), points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        const cv::Point3f expected = rig_.TransformPoint(points[i], 0, 1);
+        EXPECT_NEAR(transformed[i].x, expected.x, 1e-5f);
+        EXPECT_NEAR(transformed[i].y, expected.y, 1e-5f);
+        EXPECT_NEAR(transformed[i].z, expected.z, 1e-5f);
+    }
+    
+    // Round trip through the Eigen batch, in place
+    std::vector<Eigen::Vector3f> eigen_points;
+    for (const auto& p : transformed) {
+        eigen_points.push_back(Eigen::Vector3f(p.x, p.y, p.z));
+    }
+    ASSERT_TRUE(rig_.TransformPoints(eigen_points.data(), eigen_points.size(), 1, 0, eigen_points.data()));
+    for (size_t i = 0; i < points.size(); ++i) {
+        EXPECT_NEAR(eigen_points[i].x(), points[i].x, 1e-5f);
+        EXPECT_NEAR(eigen_points[i].y(), points[i].y, 1e-5f);
+        EXPECT_NEAR(eigen_points[i].z(), points[i].z, 1e-5f);
+    }
+    
+    EXPECT_FALSE(rig_.TransformPoints(points, 0, 42, transformed));
+    
+    // A new extrinsic must not be served from the stale table
+    cv::Mat T_1_0 = cv::Mat::eye(4, 4, CV_32F);
+    T_1_0.at<float>(0, 3) = 0.25f;
+    ASSERT_TRUE(rig_.UpdateTransform(0, 1, T_1_0));
+    Sophus::SE3f T;
+    ASSERT_TRUE(rig_.GetTransform(0, 1, T));
+    EXPECT_NEAR(T.translation().x(), 0.25f, 1e-5f);
+    EXPECT_NEAR(T.translation().y(), 0.0f, 1e-5f);
+    EXPECT_NEAR(T.rotationMatrix()(0, 0), 1.0f, 1e-5f);
+}
+
 // Test spherical projection
 TEST_F(MultiCameraTrackingTest, SphericalProjection) {
     // Create a 3D point on the unit sphere
@@ -306,6 +364,15 @@ TEST_F(MultiCameraTrackingTest, SphericalProjection) {
     }
 }
 
+// Test map saving without an ORB-SLAM3 system
+TEST_F(MultiCameraTrackingTest, MapFileWithoutSystem) {
+    // The atlas file is written and read by the system, which the tests do not create
+    EXPECT_FALSE(tracking_->SaveMap("/tmp/multi_camera_tracking_test.osa"));
+    EXPECT_FALSE(tracking_->LoadMap("/tmp/multi_camera_tracking_test.osa"));
+    EXPECT_FALSE(tracking_->Checkpoint("/tmp/multi_camera_tracking_test.osa", 0));
+    EXPECT_FALSE(tracking_->IsCheckpointing());
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Include the online calibration header
+#include "../../include/online_calibration.hpp"
+
+using ORB_SLAM3::OnlineCalibration;
+
+namespace {
+
+constexpr double kImuPeriod = 1.0 / 200.0;
+constexpr double kFramePeriod = 1.0 / 90.0;
+constexpr double kIntegrationStep = 1e-4;
+constexpr double kDuration = 10.0;
+
+// Ground truth: head-like rotation, the rate changing on every axis
+Eigen::Vector3d trueAngularVelocity(double t)
+{
+    return Eigen::Vector3d(0.8 * std::sin(2.1 * t), 0.6 * std::cos(1.3 * t) + 0.2, 0.9 * std::sin(0.7 * t + 1.0));
+}
+
+struct Recording {
+    std::vector<OnlineCalibration::GyroMeasurement> gyro;
+    std::vector<std::pair<double, Sophus::SE3f>> poses;
+};
+
+// Gyro stamped time_offset late on the IMU clock with a bias, poses of a camera mounted with Rbc
+Recording record(const Sophus::SO3d& Rbc, double time_offset, const Eigen::Vector3d& gyro_bias,
+                 double angular_rate_scale)
+{
+    std::mt19937 rng(7);
+    std::normal_distribution<double> gyro_noise(0.0, 0.003);
+    std::normal_distribution<double> pose_noise(0.0, 0.0002);
+
+    Recording recording;
+    Sophus::SO3d Rwb;
+    double next_imu = 0.0;
+    double next_frame = 0.0;
+    for (double t = 0.0; t < kDuration; t += kIntegrationStep) {
+        const Eigen::Vector3d w = angular_rate_scale * trueAngularVelocity(t);
+        if (t >= next_imu) {
+            const Eigen::Vector3d noise(gyro_noise(rng), gyro_noise(rng), gyro_noise(rng));
+            recording.gyro.push_back({t + time_offset, (w + gyro_bias + noise).cast<float>()});
+            next_imu += kImuPeriod;
+        }
+        if (t >= next_frame) {
+            const Eigen::Vector3d noise(pose_noise(rng), pose_noise(rng), pose_noise(rng));
+            const Sophus::SO3d Rwc = Rwb * Sophus::SO3d::exp(noise) * Rbc;
+            recording.poses.emplace_back(t, Sophus::SE3f(Rwc.inverse().cast<float>(), Eigen::Vector3f::Zero()));
+            next_frame += kFramePeriod;
+        }
+        Rwb = Rwb * Sophus::SO3d::exp(w * kIntegrationStep);
+    }
+    return recording;
+}
+
+struct Harness {
+    Recording recording;
+    OnlineCalibration::Calibration applied;
+    int applied_count = 0;
+    std::unique_ptr<OnlineCalibration> calibration;
+
+    Harness(const OnlineCalibration::Calibration& initial, Recording data)
+        : recording(std::move(data)), applied(initial)
+    {
+        OnlineCalibration::Config config;
+        config.enabled = true;
+        calibration.reset(new OnlineCalibration(
+            config, initial,
+            [this](std::vector<OnlineCalibration::GyroMeasurement>& samples) {
+                samples.insert(samples.end(), recording.gyro.begin(), recording.gyro.end());
+                recording.gyro.clear();
+            },
+            [this](const OnlineCalibration::Calibration& calibration) {
+                applied = calibration;
+                applied_count++;
+            }));
+        for (const auto& pose : recording.poses) {
+            calibration->AddCameraPose(pose.first, pose.second);
+        }
+    }
+};
+
+} // namespace
+
+TEST(OnlineCalibrationTest, EstimatesTimeOffsetAndRotation)
+{
+    const Sophus::SO3d true_Rbc = Sophus::SO3d::exp(Eigen::Vector3d(0.02, -0.03, 0.01));
+    const double true_offset = 0.006;
+    const Eigen::Vector3d bias(0.004, -0.002, 0.003);
+
+    // Calibrated at the factory with the identity and no offset
+    OnlineCalibration::Calibration initial;
+    initial.T_bc = Sophus::SE3f(Sophus::SO3f(), Eigen::Vector3f(0.01f, 0.02f, 0.0f));
+    Harness harness(initial, record(true_Rbc, true_offset, bias, 1.0));
+
+    EXPECT_TRUE(harness.calibration->Update());
+    EXPECT_EQ(harness.applied_count, 1);
+    EXPECT_NEAR(harness.applied.time_offset, true_offset, 2e-4);
+    const double rotation_error = (harness.applied.T_bc.so3().cast<double>() * true_Rbc.inverse()).log().norm();
+    EXPECT_LT(rotation_error, 1e-3);
+    EXPECT_TRUE(harness.applied.T_bc.translation().isApprox(initial.T_bc.translation()));
+
+    const OnlineCalibration::State state = harness.calibration->GetState();
+    EXPECT_EQ(state.updates, 1);
+    EXPECT_NEAR(state.time_offset_ms, true_offset * 1e3, 0.2);
+    EXPECT_GT(state.chi2, 18.47);
+    EXPECT_LT(state.time_offset_sigma_ms, 0.5);
+}
+
+TEST(OnlineCalibrationTest, KeepsCorrectCalibration)
+{
+    const Sophus::SO3d true_Rbc = Sophus::SO3d::exp(Eigen::Vector3d(0.02, -0.03, 0.01));
+    const double true_offset = 0.006;
+
+    // The applied offset already moved the samples onto the camera timeline
+    OnlineCalibration::Calibration initial;
+    initial.T_bc = Sophus::SE3f(true_Rbc.cast<float>(), Eigen::Vector3f::Zero());
+    initial.time_offset = true_offset;
+    Harness harness(initial, record(true_Rbc, 0.0, Eigen::Vector3d::Zero(), 1.0));
+
+    EXPECT_FALSE(harness.calibration->Update());
+    EXPECT_EQ(harness.applied_count, 0);
+    EXPECT_LT(harness.calibration->GetState().chi2, 18.47);
+    EXPECT_DOUBLE_EQ(harness.calibration->GetCalibration().time_offset, true_offset);
+}
+
+TEST(OnlineCalibrationTest, SkipsUnexcitedWindow)
+{
+    // Barely moving, neither the rotation nor the offset is observable
+    const Sophus::SO3d true_Rbc = Sophus::SO3d::exp(Eigen::Vector3d(0.02, -0.03, 0.01));
+    OnlineCalibration::Calibration initial;
+    Harness harness(initial, record(true_Rbc, 0.006, Eigen::Vector3d::Zero(), 0.001));
+
+    EXPECT_FALSE(harness.calibration->Update());
+    EXPECT_EQ(harness.applied_count, 0);
+    EXPECT_GT(harness.calibration->GetState().intervals, 0);
+}
+
+TEST(OnlineCalibrationTest, WaitsForEnoughIntervals)
+{
+    OnlineCalibration::Calibration initial;
+    Recording recording = record(Sophus::SO3d(), 0.0, Eigen::Vector3d::Zero(), 1.0);
+    recording.poses.resize(20);
+    Harness harness(initial, std::move(recording));
+
+    EXPECT_FALSE(harness.calibration->Update());
+    EXPECT_LT(harness.calibration->GetState().intervals, 50);
+}
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+// Include the performance governor header
+#include "../../include/performance_governor.hpp"
+
+using ORB_SLAM3::LatencyStage;
+using ORB_SLAM3::LatencyStamps;
+using ORB_SLAM3::PerformanceGovernor;
+
+namespace {
+
+// Frame with most of its latency spent before the given stage
+LatencyStamps makeFrame(double total_ms, LatencyStage slow_stage)
+{
+    const double exposure = 100.0;
+    const double fast_ms = 0.5;
+    LatencyStamps stamps;
+    stamps.Set(LatencyStage::EXPOSURE_MID, exposure);
+
+    double time = exposure;
+    for (int i = 1; i < static_cast<int>(ORB_SLAM3::kNumLatencyStages); i++) {
+        const LatencyStage stage = static_cast<LatencyStage>(i);
+        const int remaining = static_cast<int>(ORB_SLAM3::kNumLatencyStages) - 2;
+        time += (stage == slow_stage ? total_ms - remaining * fast_ms : fast_ms) / 1000.0;
+        stamps.Set(stage, time);
+    }
+    return stamps;
+}
+
+PerformanceGovernor::Config makeConfig()
+{
+    PerformanceGovernor::Config config;
+    config.latency_budget_ms = 20.0;
+    config.recovery_ratio = 0.5;
+    config.evaluation_frames = 10;
+    config.recovery_windows = 2;
+    return config;
+}
+
+// Feed one evaluation window, returns whether the settings changed
+bool feedWindow(PerformanceGovernor& governor, double total_ms, LatencyStage slow_stage)
+{
+    bool changed = false;
+    for (int i = 0; i < 10; i++) {
+        changed = governor.AddFrame(makeFrame(total_ms, slow_stage)) || changed;
+    }
+    return changed;
+}
+
+} // namespace
+
+// Test that the settings stay put within the budget
+TEST(PerformanceGovernorTest, StaysWithinBudget) {
+    PerformanceGovernor governor(makeConfig());
+
+    for (int i = 0; i < 5; i++) {
+        EXPECT_FALSE(feedWindow(governor, 15.0, LatencyStage::TRACK_DONE));
+    }
+    EXPECT_EQ(governor.GetDecisionCount(), 0u);
+    EXPECT_EQ(governor.GetSettings().feature_target, 1000);
+    EXPECT_EQ(governor.GetLastDecision().knob, PerformanceGovernor::Knob::COUNT);
+}
+
+// Test that the knob relieving the slowest stage is degraded first
+TEST(PerformanceGovernorTest, DegradesSlowestStageFirst) {
+    PerformanceGovernor tracking_bound(makeConfig());
+    EXPECT_TRUE(feedWindow(tracking_bound, 30.0, LatencyStage::TRACK_DONE));
+    EXPECT_EQ(tracking_bound.GetLastDecision().knob, PerformanceGovernor::Knob::LOCAL_MAP_KEYFRAMES);
+    EXPECT_EQ(tracking_bound.GetLastDecision().slowest_stage, LatencyStage::TRACK_DONE);
+    EXPECT_EQ(tracking_bound.GetSettings().local_map_keyframes, 70);
+
+    PerformanceGovernor extraction_bound(makeConfig());
+    EXPECT_TRUE(feedWindow(extraction_bound, 30.0, LatencyStage::TPU_DONE));
+    EXPECT_EQ(extraction_bound.GetLastDecision().knob, PerformanceGovernor::Knob::FEATURE_TARGET);
+    EXPECT_EQ(extraction_bound.GetSettings().feature_target, 900);
+
+    PerformanceGovernor backlogged(makeConfig());
+    EXPECT_TRUE(feedWindow(backlogged, 30.0, LatencyStage::TPU_SUBMIT));
+    EXPECT_EQ(backlogged.GetLastDecision().knob, PerformanceGovernor::Knob::FRAME_DECIMATION);
+    EXPECT_EQ(backlogged.GetSettings().frame_decimation, 2);
+}
+
+// Test that degradation moves on to the next knob at its limit and stops at the minimum
+TEST(PerformanceGovernorTest, DegradesWithinLimits) {
+    PerformanceGovernor governor(makeConfig());
+
+    for (int i = 0; i < 100; i++) {
+        feedWindow(governor, 50.0, LatencyStage::TRACK_DONE);
+    }
+
+    const PerformanceGovernor::Settings& settings = governor.GetSettings();
+    EXPECT_EQ(settings.local_map_keyframes, 20);
+    EXPECT_EQ(settings.feature_target, 300);
+    EXPECT_EQ(settings.local_ba_keyframes, 5);
+    EXPECT_EQ(settings.frame_decimation, 3);
+    EXPECT_FALSE(feedWindow(governor, 50.0, LatencyStage::TRACK_DONE));
+}
+
+// Test that quality comes back in reverse order after enough fast windows
+TEST(PerformanceGovernorTest, RestoresMostRecentFirst) {
+    PerformanceGovernor governor(makeConfig());
+    feedWindow(governor, 30.0, LatencyStage::TPU_DONE);     // feature_target 900
+    feedWindow(governor, 30.0, LatencyStage::TRACK_DONE);   // local_map_keyframes 70
+
+    // Between the recovery ratio and the budget nothing happens
+    EXPECT_FALSE(feedWindow(governor, 15.0, LatencyStage::TRACK_DONE));
+    EXPECT_FALSE(feedWindow(governor, 15.0, LatencyStage::TRACK_DONE));
+
+    EXPECT_FALSE(feedWindow(governor, 5.0, LatencyStage::TRACK_DONE));
+    EXPECT_TRUE(feedWindow(governor, 5.0, LatencyStage::TRACK_DONE));
+    EXPECT_EQ(governor.GetLastDecision().knob, PerformanceGovernor::Knob::LOCAL_MAP_KEYFRAMES);
+    EXPECT_EQ(governor.GetSettings().local_map_keyframes, 80);
+    EXPECT_EQ(governor.GetSettings().feature_target, 900);
+
+    feedWindow(governor, 5.0, LatencyStage::TRACK_DONE);
+    EXPECT_TRUE(feedWindow(governor, 5.0, LatencyStage::TRACK_DONE));
+    EXPECT_EQ(governor.GetSettings().feature_target, 1000);
+    EXPECT_EQ(governor.GetDecisionCount(), 4u);
+}
+
+// Test that every decision is appended to the CSV log
+TEST(PerformanceGovernorTest, LogsDecisions) {
+    const std::string path = "/tmp/performance_governor_test_" + std::to_string(getpid()) + ".csv";
+    std::remove(path.c_str());
+    {
+        PerformanceGovernor::Config config = makeConfig();
+        config.log_path = path;
+        PerformanceGovernor governor(config);
+        feedWindow(governor, 30.0, LatencyStage::TPU_DONE);
+        feedWindow(governor, 30.0, LatencyStage::TPU_DONE);
+    }
+
+    std::ifstream log(path);
+    std::string line;
+    ASSERT_TRUE(std::getline(log, line));
+    EXPECT_EQ(line, "time,window,knob,old_value,new_value,p99_ms,slowest_stage");
+    ASSERT_TRUE(std::getline(log, line));
+    EXPECT_NE(line.find(",0,feature_target,1000,900,"), std::string::npos);
+    EXPECT_NE(line.find("tpu_done"), std::string::npos);
+    ASSERT_TRUE(std::getline(log, line));
+    EXPECT_NE(line.find(",1,feature_target,900,800,"), std::string::npos);
+    EXPECT_FALSE(std::getline(log, line));
+    std::remove(path.c_str());
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
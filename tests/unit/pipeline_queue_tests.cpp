@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Include the pipeline queue header
+#include "../../include/pipeline_queue.hpp"
+
+using ORB_SLAM3::PipelineDropPolicy;
+using ORB_SLAM3::PipelineQueue;
+
+// Test that BLOCK delivers every item in order across threads
+TEST(PipelineQueueTest, BlockKeepsEveryItem) {
+    PipelineQueue<int> queue(2, PipelineDropPolicy::BLOCK);
+
+    std::thread producer([&queue]() {
+        for (int i = 0; i < 1000; i++) {
+            int item = i;
+            EXPECT_TRUE(queue.Push(item));
+        }
+    });
+
+    for (int i = 0; i < 1000; i++) {
+        int item = -1;
+        ASSERT_TRUE(queue.Pop(item, 1000));
+        EXPECT_EQ(item, i);
+    }
+    producer.join();
+
+    EXPECT_EQ(queue.GetDroppedCount(), 0u);
+}
+
+// Test that KEEP_LATEST hands out the newest item and drops the rest
+TEST(PipelineQueueTest, KeepLatestDrops) {
+    std::vector<int> dropped;
+    PipelineQueue<int> queue(3, PipelineDropPolicy::KEEP_LATEST, [&dropped](int& item) {
+        dropped.push_back(item);
+    });
+
+    int a = 1, b = 2, c = 3, d = 4;
+    EXPECT_TRUE(queue.Push(a));
+    EXPECT_TRUE(queue.Push(b));
+    EXPECT_TRUE(queue.Push(c));
+    EXPECT_FALSE(queue.Push(d));  // Full
+
+    int item = 0;
+    ASSERT_TRUE(queue.Pop(item, 0));
+    EXPECT_EQ(item, 3);
+    EXPECT_EQ(queue.GetDroppedCount(), 3u);
+    ASSERT_EQ(dropped.size(), 3u);
+    EXPECT_EQ(dropped[0], 4);
+    EXPECT_EQ(dropped[1], 1);
+    EXPECT_EQ(dropped[2], 2);
+
+    // Empty queue times out
+    EXPECT_FALSE(queue.Pop(item, 10));
+}
+
+// Test that Close wakes a waiting consumer and blocked producer
+TEST(PipelineQueueTest, CloseWakesWaiters) {
+    PipelineQueue<int> queue(1, PipelineDropPolicy::BLOCK);
+
+    std::atomic<bool> consumer_done(false);
+    std::thread consumer([&]() {
+        int item;
+        EXPECT_FALSE(queue.Pop(item, -1));
+        consumer_done = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(consumer_done.load());
+    queue.Close();
+    consumer.join();
+    EXPECT_TRUE(consumer_done.load());
+
+    // Pushing after close fails once the queue is full
+    int a = 1, b = 2;
+    queue.Push(a);
+    EXPECT_FALSE(queue.Push(b));
+}
+
+// Test that popped items are moved out and queued ones are dropped on destruction
+TEST(PipelineQueueTest, ReleasesItems) {
+    auto tracked = std::make_shared<int>(7);
+    int drops = 0;
+    {
+        PipelineQueue<std::shared_ptr<int>> queue(4, PipelineDropPolicy::BLOCK,
+                                                  [&drops](std::shared_ptr<int>&) { drops++; });
+        std::shared_ptr<int> item = tracked;
+        queue.Push(item);
+        item = tracked;
+        queue.Push(item);
+        item.reset();
+
+        std::shared_ptr<int> popped;
+        ASSERT_TRUE(queue.Pop(popped, 0));
+        popped.reset();
+
+        // One still queued, none kept in the popped slot
+        EXPECT_EQ(tracked.use_count(), 2);
+    }
+    EXPECT_EQ(drops, 1);
+    EXPECT_EQ(tracked.use_count(), 1);
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
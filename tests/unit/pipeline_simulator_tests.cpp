@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <unistd.h>
+
+// Include the pipeline simulator header
+#include "../../include/pipeline_simulator.hpp"
+
+using ORB_SLAM3::LatencyStage;
+using ORB_SLAM3::PipelineDropPolicy;
+using ORB_SLAM3::PipelineSimulator;
+using ORB_SLAM3::SimulatedStage;
+using ORB_SLAM3::StageTimings;
+
+namespace {
+
+// Constant stage times, so every frame set takes the same path
+StageTimings makeTimings(double extraction_ms, double tracking_ms)
+{
+    StageTimings timings;
+    timings.Add(SimulatedStage::READOUT, 2.0);
+    timings.Add(SimulatedStage::ACQUISITION, 1.0);
+    timings.Add(SimulatedStage::EXTRACTION, extraction_ms);
+    timings.Add(SimulatedStage::TRACKING, tracking_ms);
+    timings.Add(SimulatedStage::PUBLISH, 0.5);
+    timings.Add(SimulatedStage::MAPPING, 40.0);
+    timings.SetKeyFrameRatio(0.1);
+    return timings;
+}
+
+PipelineSimulator::Config makeConfig()
+{
+    PipelineSimulator::Config config;
+    config.camera_rate_hz = 90.0;
+    config.cameras = 4;
+    config.duration_s = 10.0;
+    return config;
+}
+
+} // namespace
+
+// Test that an idle pipeline adds up the stage times and keeps up with the cameras
+TEST(PipelineSimulatorTest, KeepsUpWhenUnderloaded) {
+    const StageTimings timings = makeTimings(5.0, 4.0);
+    PipelineSimulator simulator(timings);
+    const PipelineSimulator::Result result = simulator.Run(makeConfig());
+
+    EXPECT_EQ(result.frame_sets, 900u);
+    EXPECT_EQ(result.tracked, 900u);
+    EXPECT_EQ(result.dropped_readout + result.dropped_extraction + result.dropped_tracking, 0u);
+    EXPECT_NEAR(result.throughput_fps, 90.0, 0.5);
+
+    // 2 + 1 + 5 + 4 + 0.5 ms, percentiles are exact to 1/16
+    EXPECT_NEAR(result.end_to_end.p50_ms, 12.5, 12.5 / 16);
+    EXPECT_NEAR(result.stage_latency[static_cast<size_t>(LatencyStage::TPU_DONE)].p50_ms, 5.0, 5.0 / 16);
+    EXPECT_GT(result.keyframes, 0u);
+    EXPECT_NEAR(result.utilization[static_cast<size_t>(SimulatedStage::EXTRACTION)], 0.45, 0.01);
+
+    // A pose is at least its own latency old at scanout, at most one camera period older
+    EXPECT_GE(result.pose_age_at_scanout.p50_ms, 12.5 + 2.0 - 1.0);
+    EXPECT_LE(result.pose_age_at_scanout.max_ms, (12.5 + 2.0 + 1000.0 / 90.0) * 17 / 16);
+    EXPECT_GE(result.motion_to_photon.p50_ms, 3.0);
+}
+
+// Test that a stage slower than the frame period limits the throughput and drops frame sets
+TEST(PipelineSimulatorTest, SlowTrackingDropsFrameSets) {
+    const StageTimings timings = makeTimings(5.0, 15.0);
+    PipelineSimulator simulator(timings);
+
+    PipelineSimulator::Config latest = makeConfig();
+    const PipelineSimulator::Result dropped = simulator.Run(latest);
+    EXPECT_NEAR(dropped.throughput_fps, 1000.0 / 15.5, 1.0);
+    EXPECT_GT(dropped.dropped_tracking, 0u);
+    EXPECT_EQ(dropped.dropped_readout, 0u);
+
+    // Blocking fills every queue and the driver, the frame sets that make it wait longer
+    PipelineSimulator::Config blocking = makeConfig();
+    blocking.extraction_queue.policy = PipelineDropPolicy::BLOCK;
+    blocking.tracking_queue.policy = PipelineDropPolicy::BLOCK;
+    const PipelineSimulator::Result blocked = simulator.Run(blocking);
+    EXPECT_NEAR(blocked.throughput_fps, 1000.0 / 15.5, 1.0);
+    EXPECT_GT(blocked.dropped_readout, 0u);
+    EXPECT_EQ(blocked.dropped_tracking, 0u);
+    EXPECT_GT(blocked.end_to_end.p50_ms, 2 * dropped.end_to_end.p50_ms);
+}
+
+// Test that the cameras are spread over the extraction units and batched per invocation
+TEST(PipelineSimulatorTest, SpreadsExtractionOverUnits) {
+    // 8 ms per camera as recorded, 4 cameras on one unit take 32 ms
+    StageTimings timings = makeTimings(8.0, 4.0);
+    timings.SetRecordedExtraction(1, 1);
+    PipelineSimulator simulator(timings);
+
+    PipelineSimulator::Config config = makeConfig();
+    config.camera_rate_hz = 20.0;
+    const double one_unit = simulator.Run(config).stage_latency[static_cast<size_t>(LatencyStage::TPU_DONE)].p50_ms;
+    EXPECT_NEAR(one_unit, 32.0, 2.0);
+
+    // A twice as fast unit takes two cameras for every one of the other
+    PipelineSimulator::ExtractionUnit fast;
+    fast.name = "npu0";
+    fast.speed = 2.0;
+    config.extraction_units.push_back(fast);
+    const double two_units = simulator.Run(config).stage_latency[static_cast<size_t>(LatencyStage::TPU_DONE)].p50_ms;
+    EXPECT_NEAR(two_units, 12.0, 1.0);
+
+    // Batching pays the invocation overhead once per batch
+    PipelineSimulator::Config batched = makeConfig();
+    batched.camera_rate_hz = 20.0;
+    batched.extraction_units[0].invoke_overhead_ms = 4.0;
+    batched.extraction_units[0].batch_size = 4;
+    const double batch = simulator.Run(batched).stage_latency[static_cast<size_t>(LatencyStage::TPU_DONE)].p50_ms;
+    EXPECT_NEAR(batch, 4.0 + 4 * 4.0, 1.5);
+}
+
+// Test that the same seed gives the same prediction
+TEST(PipelineSimulatorTest, DeterministicForSeed) {
+    StageTimings timings;
+    for (int i = 1; i <= 100; i++) {
+        timings.Add(SimulatedStage::EXTRACTION, 3.0 + 0.05 * i);
+        timings.Add(SimulatedStage::TRACKING, 5.0 + 0.1 * (i % 17));
+    }
+    PipelineSimulator simulator(timings);
+    const PipelineSimulator::Config config = makeConfig();
+    const PipelineSimulator::Result a = simulator.Run(config);
+    const PipelineSimulator::Result b = simulator.Run(config);
+    EXPECT_EQ(a.tracked, b.tracked);
+    EXPECT_EQ(a.end_to_end.p99_ms, b.end_to_end.p99_ms);
+    EXPECT_EQ(a.pose_age_at_scanout.p50_ms, b.pose_age_at_scanout.p50_ms);
+}
+
+// Test that the fastest configuration within the latency budget is selected
+TEST(PipelineSimulatorTest, SelectsFastestWithinBudget) {
+    const StageTimings timings = makeTimings(5.0, 12.0);
+    PipelineSimulator simulator(timings);
+
+    // Full rate is over the budget, halving it is within but slower, a faster core is both
+    std::vector<PipelineSimulator::Config> candidates(3, makeConfig());
+    candidates[0].tracking_queue.policy = PipelineDropPolicy::BLOCK;
+    candidates[1].frame_decimation = 2;
+    candidates[2].tracking_speed = 1.5;
+
+    std::vector<PipelineSimulator::Result> results;
+    EXPECT_EQ(simulator.SelectConfiguration(candidates, 25.0, &results), 2u);
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_GT(results[0].end_to_end.p99_ms, 25.0);
+    EXPECT_LT(results[1].throughput_fps, results[2].throughput_fps);
+
+    // Nothing within the budget, the lowest latency wins
+    EXPECT_EQ(simulator.SelectConfiguration(candidates, 1.0), 2u);
+}
+
+// Test that the stage times are read from a flight recorder dump
+TEST(PipelineSimulatorTest, LoadsFlightRecorderDump) {
+    const std::string path = "/tmp/pipeline_simulator_test_" + std::to_string(getpid()) + ".csv";
+    {
+        std::ofstream dump(path);
+        dump << std::setprecision(12);
+        dump << "# trigger_timestamp=100.1 latency_ms=60 threshold_ms=50 missed_triggers=0\n";
+        dump << "timestamp,latency_ms,dqbuf_ms,tpu_submit_ms,tpu_done_ms,track_done_ms,pose_published_ms"
+             << ",acquisition_ms,feature_ms,tracking_ms,extraction_wait_ms,tracking_wait_ms,motion_lock_wait_ms\n";
+        for (int i = 0; i < 10; i++) {
+            dump << 100.0 + i / 90.0 << ",20,2,1.5,6,9,0.4,1.2," << 5.0 + i << ",8,0,0,0\n";
+        }
+    }
+
+    StageTimings timings;
+    ASSERT_TRUE(timings.LoadFlightRecorderDump(path));
+    EXPECT_EQ(timings.GetSamples(SimulatedStage::READOUT).size(), 10u);
+    EXPECT_EQ(timings.GetSamples(SimulatedStage::EXTRACTION).size(), 10u);
+    EXPECT_DOUBLE_EQ(timings.GetSamples(SimulatedStage::EXTRACTION).back(), 14.0);
+    EXPECT_DOUBLE_EQ(timings.GetSamples(SimulatedStage::TRACKING).front(), 8.0);
+    EXPECT_DOUBLE_EQ(timings.GetSamples(SimulatedStage::PUBLISH).front(), 0.4);
+    EXPECT_NEAR(timings.GetFrameRateHz(), 90.0, 0.5);
+    std::remove(path.c_str());
+
+    EXPECT_FALSE(timings.LoadFlightRecorderDump(path));
+}
+
+// Test that mapping times and the keyframe ratio are read from a trace
+TEST(PipelineSimulatorTest, LoadsTrace) {
+    const std::string path = "/tmp/pipeline_simulator_test_" + std::to_string(getpid()) + ".trace.json";
+    {
+        std::ofstream trace(path);
+        trace << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        for (int i = 0; i < 10; i++) {
+            const double start = i * 11000.0;
+            trace << "{\"pid\":1,\"tid\":7,\"ts\":" << start << ",\"ph\":\"B\",\"name\":\"TrackFrameSet\"},\n";
+            trace << "{\"pid\":1,\"tid\":7,\"ts\":" << start + 100 << ",\"ph\":\"B\",\"name\":\"TrackLocalMap\"},\n";
+            trace << "{\"pid\":1,\"tid\":7,\"ts\":" << start + 3000 << ",\"ph\":\"E\"},\n";
+            trace << "{\"pid\":1,\"tid\":7,\"ts\":" << start + 6000 << ",\"ph\":\"E\"},\n";
+        }
+        for (int i = 0; i < 2; i++) {
+            trace << "{\"pid\":1,\"tid\":9,\"ts\":" << i * 50000.0 << ",\"ph\":\"B\",\"name\":\"LocalMapping\"},\n";
+            trace << "{\"pid\":1,\"tid\":9,\"ts\":" << i * 50000.0 + 30000 << ",\"ph\":\"E\"}" << (i ? "\n" : ",\n");
+        }
+        trace << "]}\n";
+    }
+
+    StageTimings timings;
+    ASSERT_TRUE(timings.LoadTrace(path));
+    EXPECT_EQ(timings.GetSamples(SimulatedStage::TRACKING).size(), 10u);
+    EXPECT_DOUBLE_EQ(timings.GetSamples(SimulatedStage::TRACKING).front(), 6.0);
+    EXPECT_EQ(timings.GetSamples(SimulatedStage::MAPPING).size(), 2u);
+    EXPECT_DOUBLE_EQ(timings.GetSamples(SimulatedStage::MAPPING).front(), 30.0);
+    EXPECT_DOUBLE_EQ(timings.GetKeyFrameRatio(), 0.2);
+    std::remove(path.c_str());
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
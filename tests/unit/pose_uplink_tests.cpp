@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Include the pose uplink header
+#include "../../include/pose_uplink.hpp"
+
+using ORB_SLAM3::PoseUplinkFrameAddress;
+using ORB_SLAM3::PoseUplinkPacket;
+using ORB_SLAM3::PoseUplinkReceiver;
+using ORB_SLAM3::PoseUplinkSender;
+using ORB_SLAM3::SharedPoseSample;
+using ORB_SLAM3::SharedPoseWriter;
+
+namespace {
+
+SharedPoseSample makeSample(double timestamp)
+{
+    SharedPoseSample sample = {};
+    sample.sequence = static_cast<uint64_t>(timestamp * 1000.0);
+    sample.timestamp = timestamp;
+    sample.rotation[3] = 1.0f;
+    sample.translation[0] = static_cast<float>(timestamp);
+    sample.tracking_state = 2;
+    return sample;
+}
+
+PoseUplinkSender::Options senderOptions(int port)
+{
+    PoseUplinkSender::Options options;
+    options.host = "127.0.0.1";
+    options.port = port;
+    options.pose_region.clear();
+    options.use_tx_ring = false;
+    return options;
+}
+
+// Ones' complement sum over big-endian words, 0xFFFF for a valid checksummed block
+uint16_t checksum(const std::vector<uint8_t>& data, size_t offset, size_t size, uint32_t sum = 0)
+{
+    for (size_t i = 0; i < size; i += 2) {
+        sum += (data[offset + i] << 8) | data[offset + i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+} // namespace
+
+// Test that the raw frame carries valid headers, the tracking DSCP and the packet
+TEST(PoseUplinkTest, BuildFrame) {
+    PoseUplinkFrameAddress address;
+    const uint8_t source[6] = {0x02, 0x11, 0x22, 0x33, 0x44, 0x55};
+    const uint8_t destination[6] = {0x02, 0xaa, 0xbb, 0xcc, 0xdd, 0xee};
+    std::memcpy(address.source_mac, source, 6);
+    std::memcpy(address.destination_mac, destination, 6);
+    inet_pton(AF_INET, "192.168.50.20", &address.source_ip);
+    inet_pton(AF_INET, "192.168.50.2", &address.destination_ip);
+    address.source_port = 40000;
+    address.destination_port = 9957;
+
+    PoseUplinkPacket packet = {};
+    packet.magic = ORB_SLAM3::kPoseUplinkMagic;
+    packet.packet_index = 77;
+    packet.enqueue_time = 12.25;
+
+    std::vector<uint8_t> frame(ORB_SLAM3::kPoseUplinkFrameBytes);
+    ASSERT_EQ(PoseUplinkSender::BuildFrame(address, packet, 46, frame.data()), frame.size());
+
+    EXPECT_EQ(std::memcmp(frame.data(), destination, 6), 0);
+    EXPECT_EQ(std::memcmp(frame.data() + 6, source, 6), 0);
+    EXPECT_EQ(frame[12], 0x08);
+    EXPECT_EQ(frame[13], 0x00);
+
+    // IPv4 header
+    EXPECT_EQ(frame[14], 0x45);
+    EXPECT_EQ(frame[15] >> 2, 46);
+    EXPECT_EQ((frame[16] << 8) | frame[17], 20 + 8 + 136);
+    EXPECT_EQ(frame[23], 17);
+    EXPECT_EQ(checksum(frame, 14, 20), 0xFFFF);
+
+    // UDP header and checksum over the pseudo header
+    EXPECT_EQ((frame[34] << 8) | frame[35], 40000);
+    EXPECT_EQ((frame[36] << 8) | frame[37], 9957);
+    EXPECT_EQ((frame[38] << 8) | frame[39], 8 + 136);
+    const uint32_t pseudo = checksum(frame, 26, 8) + 17 + 8 + 136;
+    EXPECT_EQ(checksum(frame, 34, 8 + 136, pseudo), 0xFFFF);
+
+    PoseUplinkPacket decoded;
+    std::memcpy(&decoded, frame.data() + 42, sizeof(decoded));
+    EXPECT_EQ(decoded.packet_index, 77u);
+    EXPECT_DOUBLE_EQ(decoded.enqueue_time, 12.25);
+}
+
+// Test that samples arrive in order with their enqueue times and gaps are counted as lost
+TEST(PoseUplinkTest, SendReceive) {
+    PoseUplinkReceiver::Options receiver_options;
+    receiver_options.port = 0;
+    PoseUplinkReceiver receiver(receiver_options);
+    ASSERT_TRUE(receiver.IsValid());
+
+    PoseUplinkSender sender(senderOptions(receiver.GetPort()));
+    ASSERT_TRUE(sender.IsValid());
+    EXPECT_FALSE(sender.IsUsingTxRing());
+
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(sender.Send(makeSample(1.0 + i * 0.001)));
+    }
+
+    PoseUplinkPacket packet;
+    double receive_time = 0.0;
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(receiver.Poll(packet, receive_time, 1000));
+        EXPECT_EQ(packet.packet_index, static_cast<uint32_t>(i));
+        EXPECT_FLOAT_EQ(packet.translation[0], static_cast<float>(1.0 + i * 0.001));
+        EXPECT_GT(packet.enqueue_time, 0.0);
+        EXPECT_GE(receive_time, packet.enqueue_time);
+    }
+    EXPECT_EQ(sender.GetStats().samples_sent, 10u);
+    EXPECT_EQ(receiver.GetStats().packets_received, 10u);
+    EXPECT_EQ(receiver.GetStats().packets_lost, 0u);
+    EXPECT_LT(receiver.GetStats().jitter_us, 100000.0);
+
+    // A packet index jump counts as lost datagrams, an older index is dropped
+    packet.packet_index = 14;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(receiver.GetPort()));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    sendto(sock, &packet, sizeof(packet), 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    packet.packet_index = 12;
+    sendto(sock, &packet, sizeof(packet), 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    sendto(sock, "junk", 4, 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    close(sock);
+
+    ASSERT_TRUE(receiver.Poll(packet, receive_time, 1000));
+    EXPECT_FALSE(receiver.Poll(packet, receive_time, 1000));
+    EXPECT_FALSE(receiver.Poll(packet, receive_time, 1000));
+    EXPECT_EQ(receiver.GetStats().packets_lost, 4u);
+    EXPECT_EQ(receiver.GetStats().packets_reordered, 1u);
+    EXPECT_EQ(receiver.GetStats().packets_invalid, 1u);
+}
+
+// Test that the sender follows the shared pose ring
+TEST(PoseUplinkTest, FollowsPoseRegion) {
+    const std::string name = "/vr_slam_pose_uplink_test_" + std::to_string(getpid());
+    SharedPoseWriter writer(name);
+    ASSERT_TRUE(writer.Open());
+
+    PoseUplinkReceiver::Options receiver_options;
+    receiver_options.port = 0;
+    PoseUplinkReceiver receiver(receiver_options);
+    ASSERT_TRUE(receiver.IsValid());
+
+    PoseUplinkSender::Options options = senderOptions(receiver.GetPort());
+    options.pose_region = name;
+    PoseUplinkSender sender(options);
+    ASSERT_TRUE(sender.IsValid());
+
+    std::thread publisher([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        writer.Publish(makeSample(2.0));
+    });
+    EXPECT_TRUE(sender.Poll(1000));
+    publisher.join();
+
+    PoseUplinkPacket packet;
+    double receive_time = 0.0;
+    ASSERT_TRUE(receiver.Poll(packet, receive_time, 1000));
+    EXPECT_DOUBLE_EQ(packet.timestamp, 2.0);
+    EXPECT_EQ(packet.sequence, 0u);
+
+    // Samples published between two polls are skipped, the newest one goes out
+    writer.Publish(makeSample(3.0));
+    writer.Publish(makeSample(4.0));
+    writer.Publish(makeSample(5.0));
+    EXPECT_TRUE(sender.Poll(1000));
+    ASSERT_TRUE(receiver.Poll(packet, receive_time, 1000));
+    EXPECT_DOUBLE_EQ(packet.timestamp, 5.0);
+    EXPECT_EQ(sender.GetStats().samples_skipped, 2u);
+    EXPECT_FALSE(sender.Poll(10));
+}
+
+// Test that invalid options are rejected
+TEST(PoseUplinkTest, RejectsInvalidOptions) {
+    PoseUplinkSender::Options options = senderOptions(9957);
+    options.host = "not an address";
+    EXPECT_FALSE(PoseUplinkSender(options).IsValid());
+
+    options = senderOptions(9957);
+    options.dscp = 64;
+    EXPECT_FALSE(PoseUplinkSender(options).IsValid());
+
+    PoseUplinkSender sender(senderOptions(9957));
+    EXPECT_FALSE(sender.Poll(0));           // No pose region given
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
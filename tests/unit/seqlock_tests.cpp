@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+// Include the seqlock header
+#include "../../include/seqlock.hpp"
+
+using ORB_SLAM3::SeqLock;
+
+namespace {
+
+// Larger than one word so torn copies would show up as mismatching fields
+struct Sample {
+    uint64_t values[5];
+    double timestamp;
+};
+
+Sample makeSample(uint64_t value)
+{
+    Sample sample;
+    for (auto& v : sample.values) {
+        v = value;
+    }
+    sample.timestamp = static_cast<double>(value);
+    return sample;
+}
+
+} // namespace
+
+// Test that stored values are read back and counted
+TEST(SeqLockTest, StoreAndLoad) {
+    SeqLock<Sample> snapshot(makeSample(3));
+    EXPECT_EQ(snapshot.GetVersion(), 0u);
+    EXPECT_EQ(snapshot.Load().values[4], 3u);
+
+    snapshot.Store(makeSample(8));
+    EXPECT_EQ(snapshot.GetVersion(), 1u);
+
+    Sample sample;
+    ASSERT_TRUE(snapshot.TryLoad(sample));
+    EXPECT_EQ(sample.values[0], 8u);
+    EXPECT_DOUBLE_EQ(sample.timestamp, 8.0);
+}
+
+// Test that readers never observe a partially written value
+TEST(SeqLockTest, ReadersSeeConsistentValues) {
+    SeqLock<Sample> snapshot(makeSample(0));
+    std::atomic<bool> done(false);
+
+    std::thread writer([&]() {
+        for (uint64_t i = 1; i <= 200000; i++) {
+            snapshot.Store(makeSample(i));
+        }
+        done = true;
+    });
+
+    auto read = [&]() {
+        uint64_t last = 0;
+        while (!done.load()) {
+            Sample sample = snapshot.Load();
+            for (auto v : sample.values) {
+                ASSERT_EQ(v, sample.values[0]);
+            }
+            ASSERT_DOUBLE_EQ(sample.timestamp, static_cast<double>(sample.values[0]));
+            ASSERT_GE(sample.values[0], last);
+            last = sample.values[0];
+        }
+    };
+    std::thread reader1(read);
+    std::thread reader2(read);
+
+    writer.join();
+    reader1.join();
+    reader2.join();
+    EXPECT_EQ(snapshot.Load().values[0], 200000u);
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// Include the shared pose export header
+#include "../../include/shared_pose_export.hpp"
+
+using ORB_SLAM3::SharedPoseReader;
+using ORB_SLAM3::SharedPoseSample;
+using ORB_SLAM3::SharedPoseWriter;
+
+namespace {
+
+std::string regionName(const char* test)
+{
+    return std::string("/vr_slam_pose_test_") + test + "_" + std::to_string(getpid());
+}
+
+SharedPoseSample makeSample(double timestamp)
+{
+    SharedPoseSample sample = {};
+    sample.timestamp = timestamp;
+    sample.rotation[3] = 1.0f;
+    sample.translation[0] = static_cast<float>(timestamp);
+    sample.tracking_state = 2;
+    return sample;
+}
+
+} // namespace
+
+// Test that a reader maps the region and reads the newest sample
+TEST(SharedPoseExportTest, ReaderSeesLatestSample) {
+    const std::string name = regionName("latest");
+    SharedPoseReader reader(name);
+    EXPECT_FALSE(reader.Open());  // No writer yet
+
+    SharedPoseWriter writer(name);
+    ASSERT_TRUE(writer.Open());
+    ASSERT_TRUE(reader.Open());
+
+    SharedPoseSample sample;
+    EXPECT_FALSE(reader.ReadLatest(sample));
+
+    // More samples than ring slots
+    for (int i = 1; i <= 40; i++) {
+        writer.Publish(makeSample(i));
+    }
+    EXPECT_EQ(reader.GetWriteCount(), 40u);
+    ASSERT_TRUE(reader.ReadLatest(sample));
+    EXPECT_EQ(sample.sequence, 39u);
+    EXPECT_DOUBLE_EQ(sample.timestamp, 40.0);
+    EXPECT_FLOAT_EQ(sample.translation[0], 40.0f);
+    EXPECT_EQ(sample.tracking_state, 2);
+}
+
+// Test that a waiting reader is woken by a publish and times out without one
+TEST(SharedPoseExportTest, WaitForSample) {
+    const std::string name = regionName("wait");
+    SharedPoseWriter writer(name);
+    ASSERT_TRUE(writer.Open());
+    SharedPoseReader reader(name);
+    ASSERT_TRUE(reader.Open());
+
+    EXPECT_FALSE(reader.WaitForSample(0, 10));
+
+    std::atomic<bool> woken(false);
+    std::thread waiter([&]() {
+        woken = reader.WaitForSample(0, 2000);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    writer.Publish(makeSample(1.0));
+    waiter.join();
+    EXPECT_TRUE(woken.load());
+
+    // Already newer than what the caller saw
+    EXPECT_TRUE(reader.WaitForSample(0, 0));
+}
+
+// Test that closing the writer unlinks the region and releases waiting readers
+TEST(SharedPoseExportTest, WriterCloseReleasesReaders) {
+    const std::string name = regionName("close");
+    SharedPoseWriter writer(name);
+    ASSERT_TRUE(writer.Open());
+    SharedPoseReader reader(name);
+    ASSERT_TRUE(reader.Open());
+
+    std::atomic<bool> woken(true);
+    std::thread waiter([&]() {
+        woken = reader.WaitForSample(0, -1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    writer.Close();
+    waiter.join();
+    EXPECT_FALSE(woken.load());
+
+    SharedPoseReader late_reader(name);
+    EXPECT_FALSE(late_reader.Open());
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Include the slice stream header
+#include "../../include/slice_stream.hpp"
+
+using ORB_SLAM3::ReceivedSlice;
+using ORB_SLAM3::SliceEncoder;
+using ORB_SLAM3::SliceEncoderConfig;
+using ORB_SLAM3::SliceImage;
+using ORB_SLAM3::SlicePose;
+using ORB_SLAM3::SliceStreamReceiver;
+using ORB_SLAM3::SliceStreamSender;
+
+namespace {
+
+constexpr int kWidth = 64;
+constexpr int kSliceHeight = 16;
+
+// Stands in for the VPU: the "bitstream" is the luma plane, IDR when asked for one
+class CopyEncoder : public SliceEncoder
+{
+public:
+    explicit CopyEncoder(int* idr_count) : mIdrCount(idr_count) {}
+
+    bool Encode(const SliceImage& image, bool force_idr, std::vector<uint8_t>& bitstream, bool& is_idr) override
+    {
+        bitstream.assign(image.data, image.data + image.hor_stride * image.height);
+        is_idr = force_idr;
+        if (force_idr) {
+            ++*mIdrCount;
+        }
+        return true;
+    }
+
+private:
+    int* mIdrCount;
+};
+
+struct Harness {
+    Harness()
+    {
+        SliceStreamReceiver::Options receiver_options;
+        receiver_options.port = 0;
+        receiver_options.pose_region = "";
+        receiver = std::make_unique<SliceStreamReceiver>(receiver_options);
+
+        SliceStreamSender::Options sender_options;
+        sender_options.host = "127.0.0.1";
+        sender_options.port = receiver->GetPort();
+        sender_options.eye_width = kWidth;
+        sender_options.eye_height = 4 * kSliceHeight;
+        sender_options.slice_count = 4;
+        sender_options.fragment_payload = 100;  // Ten fragments per slice
+        sender = std::make_unique<SliceStreamSender>(sender_options, [this](const SliceEncoderConfig& config) {
+            EXPECT_EQ(config.width, kWidth);
+            EXPECT_EQ(config.height, kSliceHeight);
+            return std::unique_ptr<SliceEncoder>(new CopyEncoder(&idr_count));
+        });
+
+        pixels.resize(kWidth * kSliceHeight * 3 / 2);
+        image.data = pixels.data();
+        image.size = pixels.size();
+        image.width = kWidth;
+        image.height = kSliceHeight;
+        image.hor_stride = kWidth;
+        image.ver_stride = kSliceHeight;
+    }
+
+    int idr_count = 0;
+    std::unique_ptr<SliceStreamReceiver> receiver;
+    std::unique_ptr<SliceStreamSender> sender;
+    std::vector<uint8_t> pixels;
+    SliceImage image;
+};
+
+} // namespace
+
+// Test that a multi-fragment slice arrives whole, with its pose tag and reprojection
+TEST(SliceStreamTest, RoundTripWithPoseTag) {
+    Harness h;
+    ASSERT_TRUE(h.receiver->IsValid());
+    ASSERT_TRUE(h.sender->IsValid());
+
+    for (size_t i = 0; i < h.pixels.size(); ++i) {
+        h.pixels[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    // Rendered facing forward, the head has turned 90 degrees about y since
+    const float s = std::sqrt(0.5f);
+    const float latest[4] = {0.0f, s, 0.0f, s};
+    h.receiver->SetLatestPose(latest);
+
+    SlicePose pose;
+    pose.translation[0] = 0.5f;
+    pose.timestamp = 12.5;
+    ASSERT_TRUE(h.sender->SendSlice(7, 1, 2, h.image, pose, 0.0));
+
+    ReceivedSlice slice;
+    ASSERT_TRUE(h.receiver->Poll(slice, 1000));
+    EXPECT_EQ(slice.frame_id, 7u);
+    EXPECT_EQ(slice.eye, 1);
+    EXPECT_EQ(slice.slice_index, 2);
+    EXPECT_EQ(slice.slice_count, 4);
+    EXPECT_TRUE(slice.is_idr);  // First frame of the stream
+    EXPECT_FLOAT_EQ(slice.render_pose.translation[0], 0.5f);
+    EXPECT_DOUBLE_EQ(slice.render_pose.timestamp, 12.5);
+    ASSERT_EQ(slice.bitstream.size(), static_cast<size_t>(kWidth * kSliceHeight));
+    EXPECT_EQ(std::memcmp(slice.bitstream.data(), h.pixels.data(), slice.bitstream.size()), 0);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_NEAR(slice.reprojection[i], latest[i], 1e-6);
+    }
+
+    const SliceStreamSender::Stats stats = h.sender->GetStats();
+    EXPECT_EQ(stats.slices_sent, 1u);
+    EXPECT_EQ(stats.fragments_sent, 11u);
+    EXPECT_EQ(h.receiver->GetStats().slices_completed, 1u);
+}
+
+// Test that a slice past its deadline is not encoded, and that keyframes follow requests
+TEST(SliceStreamTest, SkipsLateSlicesAndHonoursKeyframeRequests) {
+    Harness h;
+    ASSERT_TRUE(h.sender->IsValid());
+
+    SlicePose pose;
+    EXPECT_FALSE(h.sender->SendSlice(1, 0, 0, h.image, pose, ORB_SLAM3::LatencyNowSeconds() - 0.001));
+    EXPECT_EQ(h.sender->GetStats().slices_late, 1u);
+    EXPECT_EQ(h.idr_count, 0);
+
+    ASSERT_TRUE(h.sender->SendSlice(1, 0, 0, h.image, pose, ORB_SLAM3::LatencyNowSeconds() + 1.0));
+    ASSERT_TRUE(h.sender->SendSlice(2, 0, 0, h.image, pose, 0.0));
+    EXPECT_EQ(h.idr_count, 1);
+
+    h.sender->RequestKeyframe(0, 0);
+    ASSERT_TRUE(h.sender->SendSlice(3, 0, 0, h.image, pose, 0.0));
+    EXPECT_EQ(h.idr_count, 2);
+}
+
+// Test that a frame older than one already delivered for the same slice is dropped
+TEST(SliceStreamTest, DropsStaleFrames) {
+    Harness h;
+    ASSERT_TRUE(h.sender->IsValid());
+
+    SlicePose pose;
+    ASSERT_TRUE(h.sender->SendSlice(5, 0, 1, h.image, pose, 0.0));
+    ReceivedSlice slice;
+    ASSERT_TRUE(h.receiver->Poll(slice, 1000));
+    EXPECT_EQ(slice.frame_id, 5u);
+
+    ASSERT_TRUE(h.sender->SendSlice(4, 0, 1, h.image, pose, 0.0));
+    ASSERT_TRUE(h.sender->SendSlice(6, 0, 1, h.image, pose, 0.0));
+    ASSERT_TRUE(h.receiver->Poll(slice, 1000));
+    EXPECT_EQ(slice.frame_id, 6u);
+    EXPECT_GT(h.receiver->GetStats().packets_stale, 0u);
+}
+
+// Test that invalid configurations are rejected
+TEST(SliceStreamTest, RejectsInvalid) {
+    auto factory = [](const SliceEncoderConfig&) { return std::unique_ptr<SliceEncoder>(); };
+
+    SliceStreamSender::Options options;
+    options.host = "127.0.0.1";
+    options.eye_height = 1000;  // Not a multiple of 16 per slice
+    EXPECT_FALSE(SliceStreamSender(options, factory).IsValid());
+
+    options.eye_height = 1920;
+    options.host = "not an address";
+    EXPECT_FALSE(SliceStreamSender(options, factory).IsValid());
+
+    // No encoder for the streams
+    options.host = "127.0.0.1";
+    EXPECT_FALSE(SliceStreamSender(options, factory).IsValid());
+
+    SliceStreamReceiver::Options receiver_options;
+    receiver_options.reassembly_slots = 0;
+    SliceStreamReceiver receiver(receiver_options);
+    EXPECT_FALSE(receiver.IsValid());
+    ReceivedSlice slice;
+    EXPECT_FALSE(receiver.Poll(slice, 0));
+}
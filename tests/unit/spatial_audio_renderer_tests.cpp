@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Include the spatial audio renderer header
+#include "../../include/spatial_audio_renderer.hpp"
+
+using ORB_SLAM3::HrtfSet;
+using ORB_SLAM3::SpatialAudioRenderer;
+
+namespace {
+
+constexpr int kBlock = 64;
+
+// Front (azimuth 0) and left (azimuth 90) responses of the given length
+HrtfSet makeHrtf(int length, unsigned seed)
+{
+    HrtfSet hrtf;
+    hrtf.length = length;
+    hrtf.azimuth_deg = {0.0f, 90.0f};
+    hrtf.elevation_deg = {0.0f, 0.0f};
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    hrtf.left.resize(2 * length);
+    hrtf.right.resize(2 * length);
+    for (float& tap : hrtf.left) {
+        tap = dist(rng);
+    }
+    for (float& tap : hrtf.right) {
+        tap = dist(rng);
+    }
+    return hrtf;
+}
+
+SpatialAudioRenderer::Options manualPose()
+{
+    SpatialAudioRenderer::Options options;
+    options.block_size = kBlock;
+    options.max_sources = 4;
+    options.pose_region = "";
+    return options;
+}
+
+} // namespace
+
+// Test that the partitioned convolution matches direct convolution across blocks
+TEST(SpatialAudioRendererTest, MatchesDirectConvolution) {
+    const HrtfSet hrtf = makeHrtf(150, 1);  // Three partitions, the last one partial
+    SpatialAudioRenderer renderer(hrtf, manualPose());
+    ASSERT_TRUE(renderer.IsValid());
+
+    const float front[3] = {0.0f, 0.0f, 2.0f};
+    const int source = renderer.AddSource(front);
+    ASSERT_EQ(source, 0);
+
+    const int blocks = 8;
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<float> input(blocks * kBlock);
+    for (float& sample : input) {
+        sample = dist(rng);
+    }
+
+    std::vector<float> left(blocks * kBlock), right(blocks * kBlock);
+    for (int b = 0; b < blocks; ++b) {
+        const float* inputs[4] = {input.data() + b * kBlock, nullptr, nullptr, nullptr};
+        ASSERT_TRUE(renderer.Process(inputs, left.data() + b * kBlock, right.data() + b * kBlock));
+    }
+    EXPECT_EQ(renderer.GetSourceDirection(source), 0);
+
+    for (int n = 0; n < blocks * kBlock; ++n) {
+        double expected_left = 0.0, expected_right = 0.0;
+        for (int k = 0; k < hrtf.length && k <= n; ++k) {
+            expected_left += hrtf.left[k] * input[n - k];
+            expected_right += hrtf.right[k] * input[n - k];
+        }
+        ASSERT_NEAR(left[n], expected_left, 1e-3) << "sample " << n;
+        ASSERT_NEAR(right[n], expected_right, 1e-3) << "sample " << n;
+    }
+}
+
+// Test that turning the head moves a world-fixed source to another direction
+TEST(SpatialAudioRendererTest, FollowsHeadRotation) {
+    SpatialAudioRenderer renderer(makeHrtf(32, 3), manualPose());
+    ASSERT_TRUE(renderer.IsValid());
+
+    // Camera frame is x right, so -x is to the left of the initial head pose
+    const float position[3] = {-1.0f, 0.0f, 0.0f};
+    const int source = renderer.AddSource(position);
+    std::vector<float> left(kBlock), right(kBlock);
+
+    ASSERT_TRUE(renderer.Process(nullptr, left.data(), right.data()));
+    EXPECT_EQ(renderer.GetSourceDirection(source), 1);
+
+    // Head turned 90 degrees to the left, the source is now in front
+    const float s = std::sqrt(0.5f);
+    const float rotation[4] = {0.0f, s, 0.0f, s};
+    const float translation[3] = {0.0f, 0.0f, 0.0f};
+    renderer.SetHeadPose(rotation, translation);
+    ASSERT_TRUE(renderer.Process(nullptr, left.data(), right.data()));
+    EXPECT_EQ(renderer.GetSourceDirection(source), 0);
+}
+
+// Test that a direction change is crossfaded over one block
+TEST(SpatialAudioRendererTest, CrossfadesDirectionChange) {
+    HrtfSet hrtf;
+    hrtf.length = 1;
+    hrtf.azimuth_deg = {0.0f, 90.0f};
+    hrtf.elevation_deg = {0.0f, 0.0f};
+    hrtf.left = {1.0f, 0.0f};   // Front passes the left ear, left silences it
+    hrtf.right = {0.0f, 0.0f};
+    SpatialAudioRenderer renderer(hrtf, manualPose());
+    ASSERT_TRUE(renderer.IsValid());
+
+    const float front[3] = {0.0f, 0.0f, 1.0f};
+    const int source = renderer.AddSource(front);
+    std::vector<float> input(kBlock, 1.0f), left(kBlock), right(kBlock);
+    const float* inputs[4] = {input.data(), nullptr, nullptr, nullptr};
+
+    ASSERT_TRUE(renderer.Process(inputs, left.data(), right.data()));
+    for (int n = 0; n < kBlock; ++n) {
+        ASSERT_NEAR(left[n], 1.0f, 1e-5);
+    }
+
+    const float side[3] = {-1.0f, 0.0f, 0.0f};
+    ASSERT_TRUE(renderer.SetSourcePosition(source, side));
+    ASSERT_TRUE(renderer.Process(inputs, left.data(), right.data()));
+    for (int n = 0; n < kBlock; ++n) {
+        ASSERT_NEAR(left[n], 1.0f - static_cast<float>(n + 1) / kBlock, 1e-5);
+    }
+
+    ASSERT_TRUE(renderer.Process(inputs, left.data(), right.data()));
+    for (int n = 0; n < kBlock; ++n) {
+        ASSERT_NEAR(left[n], 0.0f, 1e-5);
+    }
+}
+
+// Test that the head pose is read from the shared pose export
+TEST(SpatialAudioRendererTest, ReadsSharedPose) {
+    const std::string name = "/vr_slam_pose_test_audio_" + std::to_string(getpid());
+    ORB_SLAM3::SharedPoseWriter writer(name);
+    ASSERT_TRUE(writer.Open());
+
+    SpatialAudioRenderer::Options options = manualPose();
+    options.pose_region = name;
+    SpatialAudioRenderer renderer(makeHrtf(32, 4), options);
+    ASSERT_TRUE(renderer.IsValid());
+
+    const float position[3] = {-1.0f, 0.0f, 0.0f};
+    const int source = renderer.AddSource(position);
+    std::vector<float> left(kBlock), right(kBlock);
+
+    const float s = std::sqrt(0.5f);
+    ORB_SLAM3::SharedPoseSample sample = {};
+    sample.rotation[1] = s;
+    sample.rotation[3] = s;
+    writer.Publish(sample);
+
+    ASSERT_TRUE(renderer.Process(nullptr, left.data(), right.data()));
+    EXPECT_EQ(renderer.GetSourceDirection(source), 0);
+}
+
+// Test that invalid configurations are rejected
+TEST(SpatialAudioRendererTest, RejectsInvalid) {
+    SpatialAudioRenderer::Options options = manualPose();
+    options.block_size = 100;
+    SpatialAudioRenderer bad_block(makeHrtf(32, 5), options);
+    EXPECT_FALSE(bad_block.IsValid());
+    std::vector<float> left(100), right(100);
+    EXPECT_FALSE(bad_block.Process(nullptr, left.data(), right.data()));
+
+    HrtfSet hrtf = makeHrtf(32, 6);
+    hrtf.right.pop_back();
+    SpatialAudioRenderer bad_hrtf(hrtf, manualPose());
+    EXPECT_FALSE(bad_hrtf.IsValid());
+
+    SpatialAudioRenderer renderer(makeHrtf(32, 7), manualPose());
+    const float position[3] = {0.0f, 0.0f, 1.0f};
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(renderer.AddSource(position), i);
+    }
+    EXPECT_EQ(renderer.AddSource(position), -1);
+    renderer.RemoveSource(2);
+    EXPECT_EQ(renderer.AddSource(position), 2);
+}
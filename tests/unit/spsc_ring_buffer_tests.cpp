@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+// Include the SPSCRingBuffer header
+#include "../../include/spsc_ring_buffer.hpp"
+
+// Test capacity rounding and full/empty behaviour
+TEST(SPSCRingBufferTest, CapacityAndFull) {
+    ORB_SLAM3::SPSCRingBuffer<int> ring(5);
+
+    // Capacity is rounded up so at least the requested number fits
+    EXPECT_GE(ring.Capacity(), 5u);
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_EQ(ring.Front(), nullptr);
+
+    size_t pushed = 0;
+    while (ring.TryPush(static_cast<int>(pushed))) {
+        pushed++;
+    }
+    EXPECT_EQ(pushed, ring.Capacity());
+    EXPECT_EQ(ring.Size(), ring.Capacity());
+
+    // Elements come out in FIFO order
+    for (size_t i = 0; i < pushed; i++) {
+        ASSERT_NE(ring.Front(), nullptr);
+        EXPECT_EQ(*ring.Front(), static_cast<int>(i));
+        ring.Pop();
+    }
+    EXPECT_TRUE(ring.Empty());
+
+    int value = -1;
+    EXPECT_FALSE(ring.TryPop(value));
+    EXPECT_EQ(value, -1);
+}
+
+// Test concurrent producer and consumer
+TEST(SPSCRingBufferTest, ConcurrentProducerConsumer) {
+    ORB_SLAM3::SPSCRingBuffer<uint64_t> ring(8);
+    const uint64_t kCount = 100000;
+
+    std::thread producer([&ring, kCount]() {
+        for (uint64_t i = 0; i < kCount; i++) {
+            while (!ring.TryPush(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t expected = 0;
+    while (expected < kCount) {
+        uint64_t value;
+        if (ring.TryPop(value)) {
+            ASSERT_EQ(value, expected);
+            expected++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+    EXPECT_TRUE(ring.Empty());
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
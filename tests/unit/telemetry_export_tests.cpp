@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Include the telemetry export header
+#include "../../include/telemetry_export.hpp"
+
+using ORB_SLAM3::SampleThermalState;
+using ORB_SLAM3::SharedTelemetryReader;
+using ORB_SLAM3::SharedTelemetrySample;
+using ORB_SLAM3::SharedTelemetryWriter;
+
+namespace {
+
+std::string regionName(const char* test)
+{
+    return std::string("/vr_slam_telemetry_test_") + test + "_" + std::to_string(getpid());
+}
+
+void writeFile(const std::string& path, const std::string& contents)
+{
+    std::ofstream file(path);
+    file << contents << "\n";
+}
+
+} // namespace
+
+// Test that the layout mirrored by the Rust monitoring service does not change silently
+TEST(TelemetryExportTest, SampleLayout) {
+    EXPECT_EQ(sizeof(SharedTelemetrySample), 600u);
+    EXPECT_EQ(offsetof(SharedTelemetrySample, stage_p50_ms), 48u);
+    EXPECT_EQ(offsetof(SharedTelemetrySample, extraction_queue_depth), 160u);
+    EXPECT_EQ(offsetof(SharedTelemetrySample, thermal_zone_count), 248u);
+    EXPECT_EQ(offsetof(SharedTelemetrySample, resident_bytes), 480u);
+}
+
+// Test that a reader maps the region and reads the newest sample
+TEST(TelemetryExportTest, ReaderSeesLatestSample) {
+    const std::string name = regionName("latest");
+    SharedTelemetryReader reader(name);
+    EXPECT_FALSE(reader.Open());  // No writer yet
+
+    SharedTelemetryWriter writer(name);
+    ASSERT_TRUE(writer.Open());
+    ASSERT_TRUE(reader.Open());
+
+    SharedTelemetrySample sample;
+    EXPECT_FALSE(reader.ReadLatest(sample));
+
+    // More samples than ring slots
+    for (int i = 1; i <= 20; i++) {
+        SharedTelemetrySample published = {};
+        published.frames_processed = i;
+        published.end_to_end_p99_ms = 0.5f * i;
+        published.memory_bytes[ORB_SLAM3::MemoryBreakdown::VOCABULARY] = 1000 * i;
+        writer.Publish(published);
+    }
+    EXPECT_EQ(reader.GetWriteCount(), 20u);
+    ASSERT_TRUE(reader.ReadLatest(sample));
+    EXPECT_EQ(sample.sequence, 19u);
+    EXPECT_EQ(sample.frames_processed, 20u);
+    EXPECT_FLOAT_EQ(sample.end_to_end_p99_ms, 10.0f);
+    EXPECT_EQ(sample.memory_bytes[ORB_SLAM3::MemoryBreakdown::VOCABULARY], 20000u);
+
+    // A closed writer unlinks the region
+    writer.Close();
+    SharedTelemetryReader late_reader(name);
+    EXPECT_FALSE(late_reader.Open());
+}
+
+// Test the thermal zones and cpufreq caps read from a fake sysfs tree
+TEST(TelemetryExportTest, SampleThermalState) {
+    char root_template[] = "/tmp/telemetry_sysfs_XXXXXX";
+    ASSERT_NE(mkdtemp(root_template), nullptr);
+    const std::string root = root_template;
+
+    const std::string thermal = root + "/class/thermal";
+    mkdir((root + "/class").c_str(), 0755);
+    mkdir(thermal.c_str(), 0755);
+    mkdir((thermal + "/thermal_zone0").c_str(), 0755);
+    mkdir((thermal + "/thermal_zone1").c_str(), 0755);
+    writeFile(thermal + "/thermal_zone0/temp", "45500");
+    writeFile(thermal + "/thermal_zone0/type", "soc-thermal");
+    writeFile(thermal + "/thermal_zone1/temp", "71250");
+    writeFile(thermal + "/thermal_zone1/type", "bigcore0-thermal");
+
+    const std::string cpufreq = root + "/devices/system/cpu/cpufreq";
+    mkdir((root + "/devices").c_str(), 0755);
+    mkdir((root + "/devices/system").c_str(), 0755);
+    mkdir((root + "/devices/system/cpu").c_str(), 0755);
+    mkdir(cpufreq.c_str(), 0755);
+    mkdir((cpufreq + "/policy0").c_str(), 0755);
+    mkdir((cpufreq + "/policy4").c_str(), 0755);
+    writeFile(cpufreq + "/policy0/scaling_max_freq", "1800000");
+    writeFile(cpufreq + "/policy0/cpuinfo_max_freq", "1800000");
+    writeFile(cpufreq + "/policy4/scaling_max_freq", "1608000");
+    writeFile(cpufreq + "/policy4/cpuinfo_max_freq", "2256000");
+
+    SharedTelemetrySample sample = {};
+    SampleThermalState(sample, root);
+    EXPECT_EQ(sample.thermal_zone_count, 2u);
+    EXPECT_FLOAT_EQ(sample.thermal_celsius[0], 45.5f);
+    EXPECT_FLOAT_EQ(sample.thermal_celsius[1], 71.25f);
+    EXPECT_STREQ(sample.thermal_zone_type[0], "soc-thermal");
+    EXPECT_STREQ(sample.thermal_zone_type[1], "bigcore0-thermal");
+    EXPECT_EQ(sample.cpu_capped_mask, 1u << 4);
+
+    std::system(("rm -rf " + root).c_str());
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// Include the thread placement header
+#include "../../include/thread_placement.hpp"
+
+using ORB_SLAM3::CoreClass;
+using ORB_SLAM3::ThreadPlacement;
+using ORB_SLAM3::ThreadPlacementPolicy;
+using ORB_SLAM3::ThreadRole;
+
+namespace {
+
+// Fake sysfs with one cpu<N>/cpu_capacity per given capacity
+std::string makeCpuRoot(const std::vector<int>& capacities)
+{
+    char path[] = "/tmp/thread_placement_XXXXXX";
+    const std::string root = mkdtemp(path);
+    for (size_t cpu = 0; cpu < capacities.size(); ++cpu) {
+        const std::string dir = root + "/cpu" + std::to_string(cpu);
+        mkdir(dir.c_str(), 0755);
+        std::ofstream(dir + "/cpu_capacity") << capacities[cpu] << "\n";
+    }
+    return root;
+}
+
+void removeCpuRoot(const std::string& root, size_t count)
+{
+    for (size_t cpu = 0; cpu < count; ++cpu) {
+        const std::string dir = root + "/cpu" + std::to_string(cpu);
+        std::remove((dir + "/cpu_capacity").c_str());
+        rmdir(dir.c_str());
+    }
+    rmdir(root.c_str());
+}
+
+ThreadPlacementPolicy::Config unprivilegedConfig(const std::string& root)
+{
+    ThreadPlacementPolicy::Config config;
+    config.enabled = true;
+    config.cpu_sysfs_root = root;
+    config.lock_memory = false;
+    config.prefault_heap_bytes = 0;
+    for (ThreadPlacement& placement : config.roles) {
+        placement.realtime_priority = 0;
+        placement.nice = 0;
+    }
+    return config;
+}
+
+} // namespace
+
+// The RK3588 reports 414 for the A55 and 1024 for the A76
+TEST(ThreadPlacementTest, DetectsRK3588Clusters) {
+    const std::string root = makeCpuRoot({414, 414, 414, 414, 1024, 1024, 1024, 1024});
+    std::vector<int> big, little;
+    EXPECT_TRUE(ThreadPlacementPolicy::DetectCoreClusters(root, big, little));
+    EXPECT_EQ(big, std::vector<int>({4, 5, 6, 7}));
+    EXPECT_EQ(little, std::vector<int>({0, 1, 2, 3}));
+
+    ThreadPlacementPolicy policy(unprivilegedConfig(root));
+    EXPECT_EQ(policy.GetRoleCpus(ThreadRole::TRACKING), big);
+    EXPECT_EQ(policy.GetRoleCpus(ThreadRole::IMU_ACQUISITION), little);
+
+    ThreadPlacement explicit_cpus;
+    explicit_cpus.cores = CoreClass::BIG;
+    explicit_cpus.cpus = {7, 5, 7};
+    EXPECT_EQ(policy.ResolveCpus(explicit_cpus), std::vector<int>({5, 7}));
+    removeCpuRoot(root, 8);
+}
+
+// Without distinct capacities nothing is pinned by cluster
+TEST(ThreadPlacementTest, SymmetricCpusAreNotPinned) {
+    const std::string root = makeCpuRoot({1024, 1024, 1024, 1024});
+    std::vector<int> big, little;
+    EXPECT_FALSE(ThreadPlacementPolicy::DetectCoreClusters(root, big, little));
+    EXPECT_TRUE(big.empty());
+
+    ThreadPlacementPolicy policy(unprivilegedConfig(root));
+    EXPECT_TRUE(policy.GetRoleCpus(ThreadRole::TRACKING).empty());
+    removeCpuRoot(root, 4);
+
+    EXPECT_FALSE(ThreadPlacementPolicy::DetectCoreClusters("/nonexistent", big, little));
+}
+
+// Placed threads are pinned and reported with their counters
+TEST(ThreadPlacementTest, PlacesInstalledThreads) {
+    const std::string root = makeCpuRoot({1024});
+    ThreadPlacementPolicy::Config config = unprivilegedConfig(root);
+    config.roles[static_cast<size_t>(ThreadRole::FUSION)].cpus = {0};
+
+    // Nothing happens without an installed policy
+    ThreadPlacementPolicy::Install(nullptr);
+    ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::FUSION, "unplaced");
+
+    auto policy = std::make_shared<ThreadPlacementPolicy>(config);
+    ThreadPlacementPolicy::Install(policy);
+    EXPECT_EQ(ThreadPlacementPolicy::GetInstalled(), policy);
+
+    int cpu = -1;
+    std::thread thread([&cpu]() {
+        ThreadPlacementPolicy::PlaceCurrentThread(ThreadRole::FUSION, "fusion");
+        cpu = sched_getcpu();
+    });
+    thread.join();
+    ThreadPlacementPolicy::Install(nullptr);
+
+    EXPECT_EQ(cpu, 0);
+    const std::vector<ORB_SLAM3::ThreadStats> stats = policy->GetThreadStats();
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].name, "fusion");
+    EXPECT_EQ(stats[0].role, ThreadRole::FUSION);
+    EXPECT_FALSE(stats[0].alive);
+    removeCpuRoot(root, 1);
+}
+
+// The counters of a live thread come from /proc
+TEST(ThreadPlacementTest, ReportsLiveThread) {
+    ThreadPlacementPolicy policy(unprivilegedConfig("/nonexistent"));
+    EXPECT_TRUE(policy.ApplyToCurrentThread(ThreadRole::TRACKING, "main"));
+    usleep(1000);
+
+    const std::vector<ORB_SLAM3::ThreadStats> stats = policy.GetThreadStats();
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_TRUE(stats[0].alive);
+    EXPECT_GT(stats[0].voluntary_switches, 0u);
+    EXPECT_STREQ(ORB_SLAM3::ThreadRoleName(stats[0].role), "tracking");
+}
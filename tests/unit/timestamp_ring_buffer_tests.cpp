@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+// Include the timestamp ring buffer header
+#include "../../include/timestamp_ring_buffer.hpp"
+
+using ORB_SLAM3::TimestampRingBuffer;
+
+namespace {
+
+struct Sample {
+    double t = 0.0;
+    uint64_t value = 0;
+};
+
+Sample makeSample(uint64_t i)
+{
+    Sample sample;
+    sample.t = 0.001 * static_cast<double>(i);
+    sample.value = i;
+    return sample;
+}
+
+} // namespace
+
+// Test that range queries find the samples inside the interval
+TEST(TimestampRingBufferTest, GetRange) {
+    TimestampRingBuffer<Sample> ring(64);
+    EXPECT_TRUE(ring.GetRange(0.0, 1.0).empty());
+
+    for (uint64_t i = 0; i < 20; i++) {
+        ASSERT_TRUE(ring.Push(makeSample(i)));
+    }
+
+    TimestampRingBuffer<Sample>::Range range = ring.GetRange(0.0045, 0.010);
+    ASSERT_EQ(range.size(), 6u);
+    EXPECT_EQ(range.front().value, 5u);
+    EXPECT_EQ(range.back().value, 10u);
+    EXPECT_EQ(range.GetBeginSequence(), 5u);
+    EXPECT_EQ(range.GetEndSequence(), 11u);
+    EXPECT_TRUE(ring.IsValid(range));
+
+    uint64_t expected = 5;
+    for (const Sample& sample : range) {
+        EXPECT_EQ(sample.value, expected++);
+    }
+
+    EXPECT_TRUE(ring.GetRange(0.5, 1.0).empty());
+    EXPECT_EQ(ring.GetRange(-1.0, 0.0).size(), 1u);
+}
+
+// Test that only strictly newer samples are accepted
+TEST(TimestampRingBufferTest, RejectsOutOfOrder) {
+    TimestampRingBuffer<Sample> ring(8);
+    EXPECT_TRUE(ring.Push(makeSample(2)));
+    EXPECT_FALSE(ring.Push(makeSample(2)));
+    EXPECT_FALSE(ring.Push(makeSample(1)));
+    EXPECT_TRUE(ring.Push(makeSample(3)));
+    EXPECT_EQ(ring.GetWriteCount(), 2u);
+}
+
+// Test that overwritten samples drop out of the queries and the cursor
+TEST(TimestampRingBufferTest, Wraparound) {
+    TimestampRingBuffer<Sample> ring(7);
+    ASSERT_EQ(ring.GetCapacity(), 8u);
+
+    for (uint64_t i = 0; i < 100; i++) {
+        ring.Push(makeSample(i));
+    }
+
+    // Seven samples are kept, the eighth slot is the next one written
+    TimestampRingBuffer<Sample>::Range all = ring.GetRange(0.0, 1.0);
+    ASSERT_EQ(all.size(), 7u);
+    EXPECT_EQ(all.front().value, 93u);
+    EXPECT_EQ(all.back().value, 99u);
+
+    TimestampRingBuffer<Sample>::Range since = ring.GetSince(10);
+    EXPECT_EQ(since.GetBeginSequence(), 93u);
+    EXPECT_EQ(since.size(), 7u);
+    EXPECT_TRUE(ring.GetSince(100).empty());
+
+    TimestampRingBuffer<Sample>::Range latest = ring.GetLatest(3);
+    ASSERT_EQ(latest.size(), 3u);
+    EXPECT_EQ(latest.front().value, 97u);
+
+    // The first write reuses the slot left out, the second the oldest kept sample's
+    ring.Push(makeSample(100));
+    EXPECT_TRUE(ring.IsValid(all));
+    ring.Push(makeSample(101));
+    EXPECT_FALSE(ring.IsValid(all));
+    EXPECT_TRUE(ring.IsValid(latest));
+}
+
+// Test that a reader racing the writer never accepts a torn range
+TEST(TimestampRingBufferTest, ConcurrentReader) {
+    TimestampRingBuffer<Sample> ring(64);
+    std::atomic<bool> started(false);
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> checked(0);
+
+    std::thread reader([&]() {
+        uint64_t cursor = 0;
+        started = true;
+        while (!done) {
+            TimestampRingBuffer<Sample>::Range range = ring.GetSince(cursor);
+            bool consistent = true;
+            for (size_t i = 0; i < range.size(); i++) {
+                consistent = consistent && range[i].value == range.GetBeginSequence() + i;
+            }
+            if (ring.IsValid(range)) {
+                EXPECT_TRUE(consistent);
+                checked += range.size();
+            }
+            cursor = range.GetEndSequence();
+        }
+    });
+
+    while (!started) {
+        std::this_thread::yield();
+    }
+    for (uint64_t i = 0; i < 200000; i++) {
+        ring.Push(makeSample(i));
+        if (i % 64 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    done = true;
+    reader.join();
+    EXPECT_GT(checked.load(), 0u);
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -2,6 +2,9 @@
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
 
 #include "include/visual_inertial_fusion.hpp"
 #include "include/bno085_interface.hpp"
@@ -144,6 +147,17 @@ TEST_F(VisualInertialFusionTest, StateManagement) {
     EXPECT_TRUE(fusion->Reset());
 }
 
+TEST_F(VisualInertialFusionTest, NoDeadReckoningWithoutVisualLoss) {
+    EXPECT_TRUE(fusion->Initialize());
+    
+    // Nothing to dead-reckon from before tracking ever started
+    Sophus::SE3<float> pose;
+    Eigen::Matrix<float, 6, 6> covariance;
+    EXPECT_FALSE(fusion->GetDeadReckonedPose(pose, covariance));
+    EXPECT_NE(fusion->GetState(), VisualInertialFusion::State::TRACKING_IMU_ONLY);
+    EXPECT_FALSE(fusion->IsTrackingGood());
+}
+
 TEST_F(VisualInertialFusionTest, PerformanceMetrics) {
     // Get initial performance metrics
     auto metrics = fusion->GetPerformanceMetrics();
@@ -152,6 +166,41 @@ TEST_F(VisualInertialFusionTest, PerformanceMetrics) {
     EXPECT_EQ(metrics.relocalization_count, 0);
 }
 
+TEST_F(VisualInertialFusionTest, CheckpointRoundTrip) {
+    const std::string path = "/tmp/visual_inertial_fusion_test.ckpt";
+    EXPECT_TRUE(fusion->Initialize());
+    EXPECT_TRUE(fusion->SaveState(path));
+    
+    // The checkpoint is the struct as is, the temporary file is gone
+    FILE* file = fopen(path.c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    VisualInertialFusion::Checkpoint checkpoint;
+    ASSERT_EQ(fread(&checkpoint, 1, sizeof(checkpoint), file), sizeof(checkpoint));
+    fclose(file);
+    EXPECT_EQ(checkpoint.magic, VisualInertialFusion::CHECKPOINT_MAGIC);
+    EXPECT_EQ(checkpoint.version, VisualInertialFusion::CHECKPOINT_VERSION);
+    EXPECT_EQ(checkpoint.size, sizeof(VisualInertialFusion::Checkpoint));
+    EXPECT_EQ(access((path + ".tmp").c_str(), F_OK), -1);
+    
+    // Not tracking when saved, nothing to resume but the bias and gravity
+    EXPECT_TRUE(fusion->LoadState(path));
+    EXPECT_EQ(fusion->GetState(), VisualInertialFusion::State::UNINITIALIZED);
+    
+    // A damaged checkpoint is rejected
+    checkpoint.bias[0] += 1.0f;
+    file = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    fwrite(&checkpoint, 1, sizeof(checkpoint), file);
+    fclose(file);
+    EXPECT_FALSE(fusion->LoadState(path));
+    
+    ASSERT_EQ(truncate(path.c_str(), sizeof(checkpoint) / 2), 0);
+    EXPECT_FALSE(fusion->LoadState(path));
+    
+    unlink(path.c_str());
+    EXPECT_FALSE(fusion->LoadState(path));
+}
+
 } // namespace ORB_SLAM3
 
 int main(int argc, char **argv) {
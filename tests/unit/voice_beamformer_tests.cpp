@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Include the voice beamformer header
+#include "../../include/voice_beamformer.hpp"
+
+using ORB_SLAM3::VoiceBeamformer;
+
+namespace {
+
+// Microphone offset for which a far-field source on the x axis arrives two samples apart at 48 kHz
+constexpr float kRadius = 2.0f * 343.0f / 48000.0f;
+
+VoiceBeamformer::Options squareArray()
+{
+    VoiceBeamformer::Options options;
+    options.mic_positions = {
+        0.0f, 0.0f, kRadius,
+        -kRadius, 0.0f, 0.0f,
+        0.0f, 0.0f, -kRadius,
+        kRadius, 0.0f, 0.0f};
+    options.pose_region = "";
+    return options;
+}
+
+std::vector<float> noise(size_t count, unsigned seed, float amplitude)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> dist(0.0f, amplitude);
+    std::vector<float> samples(count);
+    for (float& sample : samples) {
+        sample = dist(rng);
+    }
+    return samples;
+}
+
+// Runs the beamformer over per-microphone signals, returns the output
+std::vector<float> run(VoiceBeamformer& beamformer, const std::vector<std::vector<float>>& mics)
+{
+    const int hop = beamformer.GetHopSize();
+    const size_t hops = mics[0].size() / hop;
+    std::vector<float> out(hops * hop);
+    for (size_t h = 0; h < hops; ++h) {
+        const float* inputs[4];
+        for (int m = 0; m < 4; ++m) {
+            inputs[m] = mics[m].data() + h * hop;
+        }
+        EXPECT_TRUE(beamformer.Process(inputs, out.data() + h * hop));
+    }
+    return out;
+}
+
+} // namespace
+
+// Test that a target at equal distance from all microphones passes unchanged, one frame late
+TEST(VoiceBeamformerTest, DistortionlessTowardsTarget) {
+    VoiceBeamformer beamformer(squareArray());
+    ASSERT_TRUE(beamformer.IsValid());
+    ASSERT_EQ(beamformer.GetChannelCount(), 4);
+    ASSERT_EQ(beamformer.GetHopSize(), 128);
+
+    // Straight below the array centre
+    const float target[3] = {0.0f, 0.1f, 0.0f};
+    beamformer.SetTarget(target, false);
+
+    const std::vector<float> speech = noise(128 * 200, 1, 0.5f);
+    const std::vector<float> out = run(beamformer, {speech, speech, speech, speech});
+
+    // Latency is one hop of buffering plus one hop of overlap
+    const int latency = beamformer.GetHopSize();
+    for (size_t n = 1000; n < out.size(); ++n) {
+        ASSERT_NEAR(out[n], speech[n - latency], 1e-3) << "sample " << n;
+    }
+}
+
+// Test that a point interferer off the target direction is suppressed once R has converged
+TEST(VoiceBeamformerTest, SuppressesInterferer) {
+    VoiceBeamformer beamformer(squareArray());
+    ASSERT_TRUE(beamformer.IsValid());
+    const float target[3] = {0.0f, 0.1f, 0.0f};
+    beamformer.SetTarget(target, false);
+
+    const size_t count = 128 * 1500;  // 4 s
+    const std::vector<float> speech = noise(count, 2, 0.3f);
+    const std::vector<float> jammer = noise(count + 8, 3, 1.0f);
+
+    // Far-field jammer from +x: the right microphone hears it two samples early, the left two late
+    const int shift[4] = {0, 2, 0, -2};
+    std::vector<std::vector<float>> mics(4, std::vector<float>(count));
+    for (int m = 0; m < 4; ++m) {
+        const std::vector<float> sensor = noise(count, 10 + m, 0.01f);
+        for (size_t n = 0; n < count; ++n) {
+            mics[m][n] = speech[n] + jammer[n + 4 - shift[m]] + sensor[n];
+        }
+    }
+
+    const std::vector<float> out = run(beamformer, mics);
+
+    // Residual against the delayed target over the last second
+    const int latency = beamformer.GetHopSize();
+    double residual = 0.0, jammer_power = 0.0;
+    for (size_t n = count - 48000; n < count; ++n) {
+        const double error = out[n] - speech[n - latency];
+        residual += error * error;
+        jammer_power += jammer[n] * jammer[n];
+    }
+    EXPECT_LT(residual, 0.1 * jammer_power);
+}
+
+// Test that a world-locked target is steered at through the head pose
+TEST(VoiceBeamformerTest, WorldLockedTargetFollowsPose) {
+    const std::string name = "/vr_slam_pose_test_beam_" + std::to_string(getpid());
+    ORB_SLAM3::SharedPoseWriter writer(name);
+    ASSERT_TRUE(writer.Open());
+
+    VoiceBeamformer::Options options = squareArray();
+    options.pose_region = name;
+    VoiceBeamformer beamformer(options);
+    ASSERT_TRUE(beamformer.IsValid());
+
+    // Head turned 90 degrees to the left, a talker on the initial left is now in front
+    const float s = std::sqrt(0.5f);
+    ORB_SLAM3::SharedPoseSample sample = {};
+    sample.rotation[1] = s;
+    sample.rotation[3] = s;
+    writer.Publish(sample);
+
+    const float talker[3] = {-2.0f, 0.0f, 0.0f};
+    beamformer.SetTarget(talker, true);
+
+    float in_head[3];
+    beamformer.GetTargetInHead(in_head);
+    EXPECT_NEAR(in_head[0], 0.0f, 1e-5);
+    EXPECT_NEAR(in_head[1], 0.0f, 1e-5);
+    EXPECT_NEAR(in_head[2], 2.0f, 1e-5);
+
+    const float head_locked[3] = {0.0f, 0.07f, 0.08f};
+    beamformer.SetTarget(head_locked, false);
+    beamformer.GetTargetInHead(in_head);
+    EXPECT_FLOAT_EQ(in_head[1], 0.07f);
+}
+
+// Test that invalid configurations are rejected
+TEST(VoiceBeamformerTest, RejectsInvalid) {
+    VoiceBeamformer::Options options = squareArray();
+    options.fft_size = 300;
+    EXPECT_FALSE(VoiceBeamformer(options).IsValid());
+
+    options = squareArray();
+    options.mic_positions = {0.0f, 0.0f, 0.0f};
+    EXPECT_FALSE(VoiceBeamformer(options).IsValid());
+
+    options = squareArray();
+    options.mic_positions.pop_back();
+    VoiceBeamformer bad(options);
+    EXPECT_FALSE(bad.IsValid());
+    std::vector<float> out(128);
+    EXPECT_FALSE(bad.Process(nullptr, out.data()));
+}
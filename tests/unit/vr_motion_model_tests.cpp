@@ -1,12 +1,14 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include <memory>
+#include <random>
 #include <vector>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <sophus/se3.hpp>
 
 #include "../include/vr_motion_model.hpp"
+#include "ImuTypes.h"
 
 using namespace ORB_SLAM3;
 using namespace testing;
@@ -311,6 +313,78 @@ TEST_F(VRMotionModelTest, KalmanFilterPrediction) {
     EXPECT_NEAR(actual_position.z(), expected_position.z(), 0.01f);
 }
 
+// Test IMU-driven Kalman filter prediction with a known gyro bias
+TEST_F(VRMotionModelTest, KalmanFilterIMUPrediction) {
+    motion_model_->SetImuBias(IMU::Bias(0.0f, 0.0f, 0.0f, 0.0f, 0.1f, 0.0f));
+    motion_model_->AddPose(createPose(0.0f, 0.0f, 0.0f), 0.0);
+    
+    // 1 rad/s around Y after removing the bias, at rest otherwise
+    Eigen::Vector3f gyro(0.0f, 1.1f, 0.0f);
+    Eigen::Vector3f accel(0.0f, 0.0f, 9.81f);
+    addIMUMeasurements(0.0, 0.001, 11, gyro, accel);  // 11 measurements, 1ms apart
+    
+    // Predict 40ms ahead of the last sample: 50ms of rotation
+    Sophus::SE3f predicted_pose = motion_model_->PredictPoseKalman(40.0);
+    Eigen::AngleAxisf angle_axis(predicted_pose.unit_quaternion());
+    
+    EXPECT_NEAR(angle_axis.angle(), 0.05f, 0.005f);
+    EXPECT_NEAR(angle_axis.axis().y(), 1.0f, 0.01f);
+    EXPECT_LT(predicted_pose.translation().norm(), 0.01f);
+    
+    // The prediction leaves the filter unchanged
+    Sophus::SE3f repeated_pose = motion_model_->PredictPoseKalman(40.0);
+    EXPECT_TRUE(repeated_pose.matrix().isApprox(predicted_pose.matrix()));
+    EXPECT_NEAR(motion_model_->GetImuBias().bwy, 0.1f, 0.01f);
+}
+
+// Test batch prediction at absolute display times
+TEST_F(VRMotionModelTest, PredictPosesAt) {
+    createLinearMotionSequence(0.0, 0.1, 5);  // Last pose at 0.4s
+    
+    std::vector<double> timestamps = {0.404, 0.408, 0.412};
+    std::vector<Sophus::SE3f> poses = motion_model_->PredictPosesAt(timestamps);
+    ASSERT_EQ(poses.size(), timestamps.size());
+    
+    // Same results as relative predictions from the last pose
+    for (size_t i = 0; i < timestamps.size(); ++i) {
+        Sophus::SE3f expected = motion_model_->PredictPose((timestamps[i] - 0.4) * 1000.0);
+        EXPECT_TRUE(poses[i].matrix().isApprox(expected.matrix(), 1e-5f));
+    }
+    
+    // Later targets are further along the motion
+    EXPECT_LT(poses[0].translation().x(), poses[2].translation().x());
+    
+    std::vector<Sophus::SE3f> kalman_poses = motion_model_->PredictPosesAt(timestamps, true);
+    ASSERT_EQ(kalman_poses.size(), timestamps.size());
+    EXPECT_NEAR(kalman_poses[1].translation().x(), 0.408f, 0.01f);
+}
+
+// Test prediction with covariance at an absolute time
+TEST_F(VRMotionModelTest, PredictPoseKalmanAt) {
+    Sophus::SE3f pose;
+    Eigen::Matrix<float, 6, 6> covariance;
+    EXPECT_FALSE(motion_model_->PredictPoseKalmanAt(0.0, pose, covariance));
+    
+    createLinearMotionSequence(0.0, 0.1, 5);  // Last pose at 0.4s
+    
+    // Same pose as the batch Kalman prediction
+    ASSERT_TRUE(motion_model_->PredictPoseKalmanAt(0.408, pose, covariance));
+    std::vector<Sophus::SE3f> kalman_poses = motion_model_->PredictPosesAt({0.408}, true);
+    EXPECT_TRUE(pose.matrix().isApprox(kalman_poses[0].matrix(), 1e-5f));
+    EXPECT_TRUE(covariance.isApprox(covariance.transpose()));
+    EXPECT_GT(covariance.diagonal().minCoeff(), 0.0f);
+    
+    // The uncertainty grows with the horizon and the prediction leaves the filter unchanged
+    Sophus::SE3f later_pose;
+    Eigen::Matrix<float, 6, 6> later_covariance;
+    ASSERT_TRUE(motion_model_->PredictPoseKalmanAt(0.440, later_pose, later_covariance));
+    EXPECT_GT(later_covariance.trace(), covariance.trace());
+    
+    Eigen::Matrix<float, 6, 6> repeated_covariance;
+    ASSERT_TRUE(motion_model_->PredictPoseKalmanAt(0.408, pose, repeated_covariance));
+    EXPECT_TRUE(repeated_covariance.isApprox(covariance));
+}
+
 // Test jerk estimation
 TEST_F(VRMotionModelTest, JerkEstimation) {
     // Create a sequence of poses with changing acceleration
@@ -352,6 +426,24 @@ TEST_F(VRMotionModelTest, UserBehaviorModel) {
     EXPECT_NEAR(sum, 1.0f, 0.01f);
 }
 
+// Test that the statistics follow the history once it wraps around
+TEST_F(VRMotionModelTest, HistoryWraparound) {
+    // 0.4 m/s for 2.5 s at 200 Hz, more poses than the history keeps
+    for (int i = 0; i < 500; ++i) {
+        motion_model_->AddPose(createPose(0.002f * i, 0.0f, 0.0f), i * 0.005);
+    }
+    
+    // Then stationary for a full history
+    for (int i = 500; i < 600; ++i) {
+        motion_model_->AddPose(createPose(1.0f, 0.0f, 0.0f), i * 0.005);
+    }
+    
+    VRMotionModel::UserBehaviorModel behavior = motion_model_->GetUserBehaviorModel();
+    EXPECT_NEAR(behavior.avg_linear_speed, 0.0f, 1e-4f);
+    EXPECT_FLOAT_EQ(behavior.stationary_ratio, 1.0f);
+    EXPECT_NEAR(motion_model_->EstimateLinearVelocity().norm(), 0.0f, 1e-4f);
+}
+
 // Test latency compensation
 TEST_F(VRMotionModelTest, LatencyCompensation) {
     // Set latency compensation
@@ -362,6 +454,133 @@ TEST_F(VRMotionModelTest, LatencyCompensation) {
     EXPECT_FLOAT_EQ(motion_model_->GetLatencyCompensation(), latency_ms);
 }
 
+// Test that adding a pose stamps the frame's latency trace
+TEST_F(VRMotionModelTest, PosePublishedStamp) {
+    LatencyStamps latency;
+    latency.Stamp(LatencyStage::TRACK_DONE);
+
+    motion_model_->AddPose(createPose(0.0f, 0.0f, 0.0f), 0.0, &latency);
+
+    EXPECT_TRUE(latency.Has(LatencyStage::POSE_PUBLISHED));
+    EXPECT_GE(latency.Get(LatencyStage::POSE_PUBLISHED), latency.Get(LatencyStage::TRACK_DONE));
+}
+
+// Test that a restored filter state predicts like the original
+TEST_F(VRMotionModelTest, FilterStateRoundTrip) {
+    createLinearMotionSequence(0.0, 0.01, 20);
+    for (int i = 0; i < 40; ++i) {
+        motion_model_->AddIMU(Eigen::Vector3f(0.0f, 0.1f, 0.0f), Eigen::Vector3f(0.0f, 0.0f, 9.81f), 0.19 + i * 0.0025);
+    }
+    motion_model_->SetInteractionMode(VRMotionModel::InteractionMode::SEATED);
+    
+    VRMotionModel::FilterState state;
+    motion_model_->GetFilterState(state);
+    EXPECT_EQ(state.pose_count, static_cast<uint32_t>(VRMotionModel::FILTER_STATE_POSES));
+    EXPECT_EQ(state.imu_count, static_cast<uint32_t>(VRMotionModel::FILTER_STATE_IMU_SAMPLES));
+    EXPECT_DOUBLE_EQ(state.poses[0].timestamp, 0.19);
+    
+    VRMotionModel restored;
+    restored.SetFilterState(state);
+    EXPECT_EQ(restored.GetInteractionMode(), VRMotionModel::InteractionMode::SEATED);
+    EXPECT_TRUE(restored.EstimateLinearVelocity().isApprox(motion_model_->EstimateLinearVelocity(), 1e-5f));
+    EXPECT_TRUE(restored.PredictPose(16.0).matrix().isApprox(motion_model_->PredictPose(16.0).matrix(), 1e-4f));
+    EXPECT_TRUE(restored.PredictPoseKalman(16.0).matrix().isApprox(motion_model_->PredictPoseKalman(16.0).matrix(), 1e-4f));
+    
+    // Both continue alike
+    motion_model_->AddPose(createPose(2.0f, 0.0f, 0.0f), 0.20);
+    restored.AddPose(createPose(2.0f, 0.0f, 0.0f), 0.20);
+    EXPECT_TRUE(restored.EstimateLinearVelocity().isApprox(motion_model_->EstimateLinearVelocity(), 1e-4f));
+}
+
+// Test that predictions are scored against the poses later observed at their target times
+TEST_F(VRMotionModelTest, PredictionErrorStats) {
+    VRMotionModel::PredictionConfig config = motion_model_->GetConfig();
+    config.use_imu_for_prediction = false;
+    config.adaptive_prediction = false;
+    motion_model_->SetConfig(config);
+    
+    // 0.5 m/s along X at 90 Hz, 25 ms ahead after every pose
+    const double dt = 1.0 / 90.0;
+    for (int i = 0; i < 200; ++i) {
+        motion_model_->AddPose(createPose(0.5f * static_cast<float>(i * dt), 0.0f, 0.0f), i * dt);
+        motion_model_->PredictPose(25.0);
+    }
+    
+    const VRMotionModel::PredictionErrorStats stats =
+        motion_model_->GetPredictionErrorStats(VRMotionModel::InteractionMode::STANDING, 2);
+    EXPECT_GT(stats.count, 150u);
+    EXPECT_GT(stats.lag_count, 150u);
+    EXPECT_LT(stats.position_error_m, 1e-3);
+    EXPECT_NEAR(stats.hold_error_rad, 0.5 * 0.025, 1e-3);
+    EXPECT_NEAR(stats.lag_ms, 0.0, 1.0);
+    EXPECT_EQ(motion_model_->GetPredictionErrorStats(VRMotionModel::InteractionMode::STANDING, 0).count, 0u);
+    EXPECT_EQ(motion_model_->GetPredictionErrorStats(VRMotionModel::InteractionMode::SEATED, 2).count, 0u);
+    
+    motion_model_->ResetPredictionErrorStats();
+    EXPECT_EQ(motion_model_->GetPredictionErrorStats(VRMotionModel::InteractionMode::STANDING, 2).count, 0u);
+}
+
+// Test that the latency compensation is tuned to cancel predictions falling behind
+TEST_F(VRMotionModelTest, AutoTuneLatencyCompensation) {
+    VRMotionModel::PredictionConfig config = motion_model_->GetConfig();
+    config.adaptive_prediction = false;
+    motion_model_->SetConfig(config);
+    
+    VRMotionModel::AutoTuneConfig tune;
+    tune.enabled = true;
+    tune.tune_horizon = false;
+    tune.tune_velocity_smoothing = false;
+    motion_model_->SetAutoTune(tune);
+    
+    // Yaw at 1 rad/s with a gyroscope reading half the rate, predictions 20 ms
+    // ahead fall behind by half their horizon until compensated by as much
+    const double dt = 1.0 / 90.0;
+    for (int i = 0; i < 1800; ++i) {
+        const double t = i * dt;
+        Eigen::Quaternionf q(Eigen::AngleAxisf(static_cast<float>(t), Eigen::Vector3f::UnitZ()));
+        motion_model_->AddIMU(Eigen::Vector3f(0.0f, 0.0f, 0.5f), Eigen::Vector3f(0.0f, 0.0f, 9.81f), t);
+        motion_model_->AddPose(createPose(0.0f, 0.0f, 0.0f, q.w(), q.x(), q.y(), q.z()), t);
+        motion_model_->PredictPose(20.0);
+    }
+    
+    EXPECT_NEAR(motion_model_->GetLatencyCompensation(), 20.0, 1.0);
+    EXPECT_NEAR(motion_model_->GetPredictionErrorStats(VRMotionModel::InteractionMode::STANDING, 2).lag_ms, 0.0, 2.0);
+    
+    // Tuned values are kept per interaction mode
+    motion_model_->SetInteractionMode(VRMotionModel::InteractionMode::SEATED);
+    motion_model_->SetLatencyCompensation(0.0);
+    motion_model_->SetInteractionMode(VRMotionModel::InteractionMode::STANDING);
+    EXPECT_NEAR(motion_model_->GetLatencyCompensation(), 20.0, 1.0);
+}
+
+// Test that noisy poses are smoothed more and not extrapolated far
+TEST_F(VRMotionModelTest, AutoTuneSmoothingAndHorizon) {
+    VRMotionModel::PredictionConfig config = motion_model_->GetConfig();
+    config.use_imu_for_prediction = false;
+    config.adaptive_prediction = false;
+    motion_model_->SetConfig(config);
+    
+    VRMotionModel::AutoTuneConfig tune;
+    tune.enabled = true;
+    tune.tune_latency_compensation = false;
+    motion_model_->SetAutoTune(tune);
+    
+    // Standing still, tracked with 3 mm of noise
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.003f);
+    const double dt = 1.0 / 90.0;
+    for (int i = 0; i < 1800; ++i) {
+        motion_model_->AddPose(createPose(noise(rng), noise(rng), noise(rng)), i * dt);
+        motion_model_->PredictPose(5.0 + 10.0 * (i % 4));
+    }
+    
+    EXPECT_LT(motion_model_->GetVelocitySmoothing(), 0.5f);
+    EXPECT_DOUBLE_EQ(motion_model_->GetConfig().prediction_horizon_ms, tune.min_horizon_ms);
+    const VRMotionModel::PredictionErrorStats stats =
+        motion_model_->GetPredictionErrorStats(VRMotionModel::InteractionMode::STANDING, 0);
+    EXPECT_GE(stats.perceived_error_rad, stats.hold_error_rad);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+
+// Include the vsync phase lock header
+#include "../../include/vsync_phase_lock.hpp"
+
+using ORB_SLAM3::DisplayVsyncSource;
+using ORB_SLAM3::VsyncPhaseLock;
+using ORB_SLAM3::VsyncTiming;
+
+namespace {
+
+constexpr int64_t kLatchPeriodNs = 11111111;    // 90 Hz panel
+constexpr int64_t kLeadNs = 300000;             // Late latch 300 us before scanout
+constexpr int64_t kFirstLatchNs = 1000000000;
+
+// Latest late latch at or before a time
+VsyncTiming displayAt(double time_ns)
+{
+    VsyncTiming timing;
+    timing.valid = true;
+    timing.period_ns = kLatchPeriodNs;
+    timing.lead_ns = kLeadNs;
+    timing.latch_ns = kFirstLatchNs +
+        static_cast<int64_t>(std::floor((time_ns - kFirstLatchNs) / kLatchPeriodNs)) * kLatchPeriodNs;
+    return timing;
+}
+
+// FSIN-triggered camera feeding a pipeline of 6 ms +- 0.2 ms into the lock.
+// Like the OV9281 driver, a correction sets the period and shifts the pulse
+// after the next one. Returns the pose age jitter of the last frames.
+double runCamera(VsyncPhaseLock* lock, int64_t camera_period_ns, int frames)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> jitter(-0.2e6, 0.2e6);
+
+    double pulse_ns = kFirstLatchNs + 4.3e6;
+    double period_ns = static_cast<double>(camera_period_ns);
+    double pending_phase_ns = 0.0;
+    double age_sum = 0.0, age_sq = 0.0;
+    int ages = 0;
+
+    for (int i = 0; i < frames; ++i) {
+        const double exposure_mid_ns = pulse_ns + 1.0e6;
+        const double ready_ns = exposure_mid_ns + 6.0e6 + jitter(rng);
+        const VsyncTiming vsync = displayAt(ready_ns);
+
+        if (lock) {
+            const VsyncPhaseLock::Correction correction = lock->Update(vsync, exposure_mid_ns / 1e9, ready_ns / 1e9);
+            if (correction.valid) {
+                period_ns = static_cast<double>(correction.period_ns);
+                pending_phase_ns = static_cast<double>(correction.phase_ns);
+            }
+        }
+
+        // Shown at the scanout of the first latch after the pose
+        const double next_latch_ns = vsync.latch_ns + (ready_ns > vsync.latch_ns ? kLatchPeriodNs : 0);
+        if (i >= frames / 2) {
+            const double age_ms = (next_latch_ns + kLeadNs - exposure_mid_ns) / 1e6;
+            age_sum += age_ms;
+            age_sq += age_ms * age_ms;
+            ++ages;
+        }
+
+        pulse_ns += period_ns + pending_phase_ns;
+        pending_phase_ns = 0.0;
+    }
+
+    const double mean = age_sum / ages;
+    return std::sqrt(std::max(0.0, age_sq / ages - mean * mean));
+}
+
+VsyncPhaseLock::Config lockConfig(int64_t camera_period_ns)
+{
+    VsyncPhaseLock::Config config;
+    config.enabled = true;
+    config.camera_period_ns = camera_period_ns;
+    return config;
+}
+
+} // namespace
+
+// The latch period is measured from the scanout times, a missed latch does not disturb it
+TEST(VsyncPhaseLockTest, MeasuresLatchCadence) {
+    DisplayVsyncSource source("/nonexistent", 0);
+    VsyncTiming timing;
+    EXPECT_FALSE(source.Read(timing));
+
+    source.Update(kFirstLatchNs - kLeadNs, kFirstLatchNs, 1, timing);
+    EXPECT_FALSE(timing.valid);
+
+    source.Update(kFirstLatchNs + kLatchPeriodNs - kLeadNs, kFirstLatchNs + kLatchPeriodNs, 2, timing);
+    EXPECT_TRUE(timing.valid);
+    EXPECT_EQ(timing.period_ns, kLatchPeriodNs);
+    EXPECT_EQ(timing.lead_ns, kLeadNs);
+    EXPECT_EQ(timing.latch_ns, kFirstLatchNs + kLatchPeriodNs - kLeadNs);
+
+    // Two latches apart, and a status read twice
+    source.Update(kFirstLatchNs + 3 * kLatchPeriodNs - kLeadNs, kFirstLatchNs + 3 * kLatchPeriodNs, 4, timing);
+    source.Update(kFirstLatchNs + 3 * kLatchPeriodNs - kLeadNs, kFirstLatchNs + 3 * kLatchPeriodNs, 4, timing);
+    EXPECT_EQ(timing.period_ns, kLatchPeriodNs);
+    EXPECT_EQ(timing.latch_ns, kFirstLatchNs + 3 * kLatchPeriodNs - kLeadNs);
+}
+
+// A camera close to the panel rate locks and the pose age stops sawing
+TEST(VsyncPhaseLockTest, LocksCameraToLatch) {
+    // 90.5 fps against a 90 Hz panel beats every 2 s
+    const int64_t camera_period_ns = 11049724;
+    const double free_running_jitter = runCamera(nullptr, camera_period_ns, 600);
+    EXPECT_GT(free_running_jitter, 2.0);
+
+    VsyncPhaseLock lock(lockConfig(camera_period_ns));
+    const double locked_jitter = runCamera(&lock, camera_period_ns, 600);
+    const VsyncPhaseLock::State state = lock.GetState();
+    EXPECT_TRUE(state.reachable);
+    EXPECT_TRUE(state.locked);
+    EXPECT_LT(std::abs(state.phase_error_ms), 0.5);
+    EXPECT_NEAR(static_cast<double>(state.trigger_period_ns), kLatchPeriodNs, 2000.0);
+    EXPECT_LT(locked_jitter, 0.5);
+    EXPECT_NEAR(state.pipeline_latency_ms, 6.0, 0.1);
+
+    // Ready just before the latch: latency, margin and lead, plus the jitter quantile
+    EXPECT_LT(state.pose_age_ms, 6.0 + 0.5 + 0.3 + 1.0);
+}
+
+// A camera at half the panel rate locks to every other latch
+TEST(VsyncPhaseLockTest, LocksAtIntegerRatio) {
+    const int64_t camera_period_ns = 22000000;
+    VsyncPhaseLock lock(lockConfig(camera_period_ns));
+    const double locked_jitter = runCamera(&lock, camera_period_ns, 400);
+    EXPECT_TRUE(lock.GetState().locked);
+    EXPECT_NEAR(static_cast<double>(lock.GetState().trigger_period_ns), 2.0 * kLatchPeriodNs, 4000.0);
+    EXPECT_LT(locked_jitter, 0.5);
+}
+
+// No ratio of the latch period within the trim, the trigger is left alone
+TEST(VsyncPhaseLockTest, UnreachableRate) {
+    VsyncPhaseLock lock(lockConfig(16666667));
+    for (int i = 0; i < 20; ++i) {
+        const double exposure_s = 1.0 + i * 0.016666667;
+        const VsyncPhaseLock::Correction correction = lock.Update(displayAt(exposure_s * 1e9 + 6e6), exposure_s, exposure_s + 0.006);
+        EXPECT_FALSE(correction.valid);
+    }
+    EXPECT_FALSE(lock.GetState().reachable);
+    EXPECT_FALSE(lock.GetState().locked);
+}
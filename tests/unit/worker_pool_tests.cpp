@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Include the worker pool header
+#include "../../include/worker_pool.hpp"
+
+// Test that submitted jobs run and release their latch
+TEST(WorkerPoolTest, SubmitWithLatch) {
+    ORB_SLAM3::WorkerPool pool(3);
+    EXPECT_EQ(pool.GetWorkerCount(), 3u);
+
+    std::atomic<int> sum(0);
+    ORB_SLAM3::Latch latch(10);
+    for (int i = 1; i <= 10; i++) {
+        pool.Submit([&sum, i]() { sum += i; }, latch);
+    }
+    latch.Wait();
+
+    EXPECT_TRUE(latch.TryWait());
+    EXPECT_EQ(sum.load(), 55);
+}
+
+// Test that every index runs exactly once, also on more threads than items
+TEST(WorkerPoolTest, ParallelForCoversRange) {
+    ORB_SLAM3::WorkerPool pool(4);
+
+    for (int count : {0, 1, 3, 100}) {
+        std::vector<std::atomic<int>> hits(count);
+        pool.ParallelFor(count, [&hits](int i) { hits[i]++; });
+        for (int i = 0; i < count; i++) {
+            EXPECT_EQ(hits[i].load(), 1) << "count " << count << " index " << i;
+        }
+    }
+}
+
+// Test the same pool threads serve repeated frames
+TEST(WorkerPoolTest, ReusesThreads) {
+    ORB_SLAM3::WorkerPool pool(2);
+
+    std::mutex mutex;
+    std::vector<std::thread::id> ids;
+    for (int frame = 0; frame < 50; frame++) {
+        pool.ParallelFor(4, [&](int) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (std::find(ids.begin(), ids.end(), std::this_thread::get_id()) == ids.end()) {
+                ids.push_back(std::this_thread::get_id());
+            }
+        });
+    }
+
+    // Two workers plus the calling thread
+    EXPECT_LE(ids.size(), 3u);
+}
+
+// Test that a nested ParallelFor from a job completes even with every worker busy
+TEST(WorkerPoolTest, NestedParallelFor) {
+    ORB_SLAM3::WorkerPool pool(1);
+
+    std::atomic<int> count(0);
+    pool.ParallelFor(2, [&pool, &count](int) {
+        pool.ParallelFor(3, [&count](int) { count++; });
+    });
+
+    EXPECT_EQ(count.load(), 6);
+}
+
+// Test that the destructor runs the queued jobs
+TEST(WorkerPoolTest, DestructorDrainsQueue) {
+    std::atomic<int> count(0);
+    {
+        ORB_SLAM3::WorkerPool pool(1);
+        for (int i = 0; i < 20; i++) {
+            pool.Submit([&count]() { count++; });
+        }
+    }
+    EXPECT_EQ(count.load(), 20);
+}
+
+// Main function
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
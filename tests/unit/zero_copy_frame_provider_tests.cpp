@@ -5,6 +5,8 @@
 #include <string>
 #include <chrono>
 #include <thread>
+#include <cstdio>
+#include <unistd.h>
 
 // Include the ZeroCopyFrameProvider header
 #include "../../include/zero_copy_frame_provider.hpp"
@@ -183,6 +185,363 @@ TEST_F(ZeroCopyFrameProviderTest, SynchronizedFrameAcquisition) {
     GTEST_SKIP() << "SynchronizedFrameAcquisition test requires mock V4L2 functions";
 }
 
+// Test synchronized frame set API without running acquisition
+TEST_F(ZeroCopyFrameProviderTest, SynchronizedFrameSetRequiresAcquisition) {
+    // This test verifies that the frame set API fails cleanly when acquisition is not running
+    
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    
+    ORB_SLAM3::ZeroCopyFrameProvider::FrameSet frame_set;
+    EXPECT_FALSE(provider.GetSynchronizedFrames(frame_set, 1.0f, 0));
+    EXPECT_EQ(provider.GetLastErrorMessage(), "Acquisition not running");
+    
+    // The legacy vector API goes through the same path
+    std::vector<ORB_SLAM3::ZeroCopyFrameProvider::FrameMetadata> metadata_vec;
+    EXPECT_FALSE(provider.GetNextSynchronizedFrames(metadata_vec, 1.0f, 0));
+    EXPECT_TRUE(metadata_vec.empty());
+}
+
+// Test frame queue statistics before acquisition
+TEST_F(ZeroCopyFrameProviderTest, FrameQueueStats) {
+    // This test verifies that drop counters start at zero and invalid IDs are handled
+    
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    
+    for (size_t i = 0; i < test_configs_.size(); i++) {
+        ORB_SLAM3::ZeroCopyFrameProvider::FrameQueueStats stats = provider.GetFrameQueueStats(i);
+        EXPECT_EQ(stats.frames_enqueued, 0u);
+        EXPECT_EQ(stats.dropped_queue_full, 0u);
+        EXPECT_EQ(stats.dropped_unsynchronized, 0u);
+        EXPECT_EQ(stats.driver_sequence_gaps, 0u);
+        EXPECT_EQ(stats.queue_depth, 0u);
+        EXPECT_EQ(stats.dropped_stale, 0u);
+        EXPECT_EQ(stats.frames_consumed, 0u);
+        EXPECT_DOUBLE_EQ(stats.mean_frame_age_ms, 0.0);
+        EXPECT_DOUBLE_EQ(stats.max_frame_age_ms, 0.0);
+    }
+    
+    ORB_SLAM3::ZeroCopyFrameProvider::FrameQueueStats invalid = provider.GetFrameQueueStats(-1);
+    EXPECT_EQ(invalid.frames_enqueued, 0u);
+    EXPECT_EQ(invalid.queue_capacity, 0u);
+}
+
+// Test acquisition mode selection
+TEST_F(ZeroCopyFrameProviderTest, AcquisitionMode) {
+    // This test verifies that the epoll reactor is the default and the per-camera mode can be selected
+    
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    EXPECT_EQ(provider.GetAcquisitionMode(), ORB_SLAM3::ZeroCopyFrameProvider::AcquisitionMode::REACTOR);
+    
+    EXPECT_TRUE(provider.SetAcquisitionMode(ORB_SLAM3::ZeroCopyFrameProvider::AcquisitionMode::THREAD_PER_CAMERA));
+    EXPECT_EQ(provider.GetAcquisitionMode(), ORB_SLAM3::ZeroCopyFrameProvider::AcquisitionMode::THREAD_PER_CAMERA);
+    
+    // Scheduling defaults leave the acquisition threads unpinned on the default policy
+    ORB_SLAM3::ZeroCopyFrameProvider::CameraConfig config = provider.GetCameraConfig(0);
+    EXPECT_EQ(config.cpu_affinity, -1);
+    EXPECT_EQ(config.realtime_priority, 0);
+}
+
+// Test frame drop policy configuration
+TEST_F(ZeroCopyFrameProviderTest, FrameDropPolicy) {
+    // This test verifies that the drop policy defaults to queueing every frame and can be changed
+    
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    EXPECT_EQ(provider.GetCameraConfig(0).drop_policy, ORB_SLAM3::ZeroCopyFrameProvider::FrameDropPolicy::QUEUE_ALL);
+    
+    ORB_SLAM3::ZeroCopyFrameProvider::CameraConfig config = test_configs_[0];
+    config.drop_policy = ORB_SLAM3::ZeroCopyFrameProvider::FrameDropPolicy::BOUNDED_LATENCY;
+    config.max_frame_age_ms = 12.0f;
+    EXPECT_TRUE(provider.SetCameraConfig(0, config));
+    
+    EXPECT_EQ(provider.GetCameraConfig(0).drop_policy, ORB_SLAM3::ZeroCopyFrameProvider::FrameDropPolicy::BOUNDED_LATENCY);
+    EXPECT_FLOAT_EQ(provider.GetCameraConfig(0).max_frame_age_ms, 12.0f);
+}
+
+// Test scaled secondary stream
+TEST_F(ZeroCopyFrameProviderTest, ScaledStream) {
+    // This test verifies that the scaled stream is off by default and frames without a scaled plane map to an empty image
+
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    EXPECT_TRUE(provider.GetCameraConfig(0).scaled_device_path.empty());
+    EXPECT_EQ(provider.GetFrameQueueStats(0).missing_scaled_plane, 0u);
+
+    ORB_SLAM3::ZeroCopyFrameProvider::FrameMetadata metadata;
+    metadata.camera_id = 0;
+    metadata.width = 640;
+    metadata.height = 480;
+    EXPECT_EQ(metadata.scaled_buffer_ptr, nullptr);
+    EXPECT_EQ(metadata.scaled_dma_fd, -1);
+    EXPECT_TRUE(provider.GetScaledMatForFrame(metadata).empty());
+
+    // A scaled plane is wrapped in place with its row stride
+    std::vector<uint8_t> plane(64 * 48, 0);
+    metadata.scaled_buffer_ptr = plane.data();
+    metadata.scaled_buffer_size = plane.size();
+    metadata.scaled_width = 60;
+    metadata.scaled_height = 48;
+    metadata.scaled_stride = 64;
+    cv::Mat scaled = provider.GetScaledMatForFrame(metadata);
+    EXPECT_EQ(scaled.cols, 60);
+    EXPECT_EQ(scaled.rows, 48);
+    EXPECT_EQ(scaled.step[0], 64u);
+    EXPECT_EQ(scaled.data, plane.data());
+}
+
+// Test exposure events and slice delivery
+TEST_F(ZeroCopyFrameProviderTest, ExposureAndSlices) {
+    // This test verifies that exposure reporting and slices are off by default and that frames
+    // without a reported exposure keep their buffer timestamp
+
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    EXPECT_TRUE(provider.GetCameraConfig(0).sync_subdev_path.empty());
+    EXPECT_EQ(provider.GetCameraConfig(0).slice_count, 0);
+
+    ORB_SLAM3::ZeroCopyFrameProvider::FrameMetadata metadata;
+    EXPECT_EQ(metadata.exposure_start, 0.0);
+    EXPECT_EQ(metadata.exposure_time, 0.0);
+
+    int slices = 0;
+    provider.RegisterSliceCallback([&slices](const ORB_SLAM3::ZeroCopyFrameProvider::SliceInfo&) { slices++; });
+    EXPECT_EQ(slices, 0);
+
+    // Slices are timed by the sensor events and cannot start without a sync subdev
+    std::vector<ORB_SLAM3::ZeroCopyFrameProvider::CameraConfig> configs = test_configs_;
+    configs[0].slice_count = 4;
+    ORB_SLAM3::ZeroCopyFrameProvider sliced(configs);
+    EXPECT_EQ(sliced.GetCameraConfig(0).slice_count, 4);
+}
+
+// Test per-frame exposure settings
+TEST_F(ZeroCopyFrameProviderTest, FrameSettings) {
+    // This test verifies that auto-exposure is off by default and that frame settings need a sync subdev
+
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    EXPECT_EQ(provider.GetCameraConfig(0).auto_exposure_target, 0.0f);
+    EXPECT_GT(provider.GetCameraConfig(0).auto_exposure_max_ms, 0.0f);
+
+    ORB_SLAM3::ZeroCopyFrameProvider::FrameMetadata metadata;
+    EXPECT_EQ(metadata.sensor_sequence, 0u);
+    EXPECT_EQ(metadata.applied_exposure, 0u);
+    EXPECT_EQ(metadata.applied_gain, 0u);
+
+    EXPECT_FALSE(provider.QueueFrameSettings(0, 10, 1600, -1));
+    EXPECT_FALSE(provider.GetLastErrorMessage().empty());
+    EXPECT_FALSE(provider.QueueFrameSettings(5, 10, -1, 32));
+}
+
+// Test readout mode switching
+TEST_F(ZeroCopyFrameProviderTest, ReadoutSwitch) {
+    // This test verifies that subsampled frames are binned by default and that the readout can be configured
+
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    EXPECT_FALSE(provider.GetCameraConfig(0).readout_skipping);
+    EXPECT_EQ(provider.GetFrameQueueStats(0).dropped_readout_switch, 0u);
+
+    // Without acquisition the whole configuration changes
+    ORB_SLAM3::ZeroCopyFrameProvider::CameraConfig config = test_configs_[0];
+    config.width = 640;
+    config.height = 400;
+    config.fps = 240;
+    config.readout_skipping = true;
+    EXPECT_TRUE(provider.SetCameraConfig(0, config));
+    EXPECT_EQ(provider.GetCameraConfig(0).fps, 240);
+    EXPECT_TRUE(provider.GetCameraConfig(0).readout_skipping);
+}
+
+// Test replay from a capture file
+TEST_F(ZeroCopyFrameProviderTest, Replay) {
+    // This test verifies that recorded frames are served through GetNextFrame without cameras and re-recorded
+
+    const std::string capture_path = "/tmp/zero_copy_replay_test.vrcap";
+    const std::string rerecord_path = "/tmp/zero_copy_rerecord_test.vrcap";
+    const int kFramesPerCamera = 5;
+
+    // Record a short two-camera capture with IMU samples
+    std::vector<uint8_t> pixels(320 * 240, 128);
+    {
+        ORB_SLAM3::CaptureCameraInfo camera = {};
+        camera.width = 320;
+        camera.height = 240;
+        camera.fps = 90;
+        snprintf(camera.pixel_format, sizeof(camera.pixel_format), "GREY");
+
+        ORB_SLAM3::FrameCaptureWriter writer;
+        ASSERT_TRUE(writer.Open(capture_path, {camera, camera}));
+        for (int i = 0; i < kFramesPerCamera; i++) {
+            for (int cam = 0; cam < 2; cam++) {
+                ORB_SLAM3::CaptureFrame frame = {};
+                frame.frame_id = i;
+                frame.timestamp = 100.0 + i / 90.0;
+                frame.camera_id = cam;
+                frame.width = 320;
+                frame.height = 240;
+                frame.data = pixels.data();
+                frame.size = pixels.size();
+                ASSERT_TRUE(writer.WriteFrame(frame));
+            }
+
+            ORB_SLAM3::CaptureImuSample imu = {};
+            imu.timestamp = 100.0 + i / 90.0;
+            ASSERT_TRUE(writer.WriteImuSample(imu));
+        }
+    }
+
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    EXPECT_FALSE(provider.SetReplaySource(capture_path, -1.0f));
+    ASSERT_TRUE(provider.SetReplaySource(capture_path, 0.0f));
+    ASSERT_TRUE(provider.Initialize());
+    EXPECT_EQ(provider.GetCameraConfig(0).width, 320);
+    EXPECT_TRUE(provider.IsCameraConnected(1));
+    EXPECT_FALSE(provider.SetCameraConfig(0, test_configs_[0]));
+
+    ASSERT_TRUE(provider.StartRecording(rerecord_path));
+    ASSERT_TRUE(provider.StartAcquisition());
+
+    double first_timestamp = 0.0;
+    double last_timestamp = 0.0;
+    for (int i = 0; i < kFramesPerCamera; i++) {
+        ORB_SLAM3::ZeroCopyFrameProvider::FrameSet frame_set;
+        ASSERT_TRUE(provider.GetSynchronizedFrames(frame_set, 2.0f, 1000));
+        ASSERT_EQ(frame_set.frames.size(), 2u);
+        EXPECT_EQ(frame_set.frames[0].frame_id, static_cast<uint64_t>(i));
+        EXPECT_EQ(static_cast<uint8_t*>(frame_set.frames[1].buffer_ptr)[0], 128);
+        if (i == 0) {
+            first_timestamp = frame_set.timestamp;
+        }
+        last_timestamp = frame_set.timestamp;
+        provider.ReleaseFrameSet(frame_set);
+    }
+
+    // Recorded spacing is preserved on the replay timeline
+    EXPECT_NEAR(last_timestamp - first_timestamp, (kFramesPerCamera - 1) / 90.0, 1e-6);
+
+    std::vector<ORB_SLAM3::CaptureImuSample> imu_samples;
+    ASSERT_TRUE(provider.GetReplayImuSamples(first_timestamp, last_timestamp, imu_samples));
+    EXPECT_EQ(imu_samples.size(), static_cast<size_t>(kFramesPerCamera));
+
+    for (int i = 0; i < 100 && !provider.IsReplayFinished(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(provider.IsReplayFinished());
+
+    provider.StopAcquisition();
+    provider.StopRecording();
+
+    ORB_SLAM3::FrameCaptureReader reader;
+    ASSERT_TRUE(reader.Open(rerecord_path));
+    EXPECT_EQ(reader.GetFrameCount(), static_cast<size_t>(2 * kFramesPerCamera));
+
+    unlink(capture_path.c_str());
+    unlink(rerecord_path.c_str());
+}
+
+// Test subscriber budgets
+TEST_F(ZeroCopyFrameProviderTest, Subscribers) {
+    // This test verifies that subscribers cannot take the buffers the driver and the main consumer need
+
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+
+    ORB_SLAM3::ZeroCopyFrameProvider::SubscriberOptions options;
+    options.name = "debug";
+    EXPECT_EQ(options.drop_policy, ORB_SLAM3::ZeroCopyFrameProvider::FrameDropPolicy::LATEST_ONLY);
+    EXPECT_EQ(options.max_frames_held, 1);
+
+    options.max_frames_held = 0;
+    EXPECT_EQ(provider.Subscribe(options), -1);
+    options.max_frames_held = 1;
+    options.camera_ids = {2};
+    EXPECT_EQ(provider.Subscribe(options), -1);
+
+    // Four buffers: two for the driver, one for GetNextFrame(), one for a subscriber
+    options.camera_ids.clear();
+    const int debug_id = provider.Subscribe(options);
+    ASSERT_GE(debug_id, 0);
+    EXPECT_EQ(provider.Subscribe(options), -1);
+
+    provider.Unsubscribe(debug_id);
+    const int record_id = provider.Subscribe(options);
+    EXPECT_GE(record_id, 0);
+    EXPECT_NE(record_id, debug_id);
+
+    EXPECT_EQ(provider.GetSubscribedFrame(debug_id, 0), nullptr);
+    EXPECT_EQ(provider.GetSubscribedFrame(record_id, 0), nullptr);   // Acquisition not running
+    EXPECT_EQ(provider.GetSubscriberStats(record_id).frames_delivered, 0u);
+}
+
+// Test frame fan-out to subscribers
+TEST_F(ZeroCopyFrameProviderTest, SubscriberFanOut) {
+    // This test verifies that a subscriber shares the frames of the main consumer and only keeps the latest
+
+    const std::string capture_path = "/tmp/zero_copy_subscriber_test.vrcap";
+    const int kFramesPerCamera = 5;
+
+    std::vector<uint8_t> pixels(320 * 240, 128);
+    {
+        ORB_SLAM3::CaptureCameraInfo camera = {};
+        camera.width = 320;
+        camera.height = 240;
+        camera.fps = 90;
+        snprintf(camera.pixel_format, sizeof(camera.pixel_format), "GREY");
+
+        ORB_SLAM3::FrameCaptureWriter writer;
+        ASSERT_TRUE(writer.Open(capture_path, {camera, camera}));
+        for (int i = 0; i < kFramesPerCamera; i++) {
+            for (int cam = 0; cam < 2; cam++) {
+                ORB_SLAM3::CaptureFrame frame = {};
+                frame.frame_id = i;
+                frame.timestamp = 100.0 + i / 90.0;
+                frame.camera_id = cam;
+                frame.width = 320;
+                frame.height = 240;
+                frame.data = pixels.data();
+                frame.size = pixels.size();
+                ASSERT_TRUE(writer.WriteFrame(frame));
+            }
+        }
+    }
+
+    ORB_SLAM3::ZeroCopyFrameProvider provider(test_configs_);
+    ASSERT_TRUE(provider.SetReplaySource(capture_path, 0.0f));
+    ASSERT_TRUE(provider.Initialize());
+
+    ORB_SLAM3::ZeroCopyFrameProvider::SubscriberOptions options;
+    options.name = "passthrough";
+    options.camera_ids = {1};
+    const int subscriber_id = provider.Subscribe(options);
+    ASSERT_GE(subscriber_id, 0);
+    ASSERT_TRUE(provider.StartAcquisition());
+
+    // The main consumer sees every frame while the subscriber is not reading
+    void* last_buffer = nullptr;
+    for (int i = 0; i < kFramesPerCamera; i++) {
+        ORB_SLAM3::ZeroCopyFrameProvider::FrameSet frame_set;
+        ASSERT_TRUE(provider.GetSynchronizedFrames(frame_set, 2.0f, 1000));
+        EXPECT_EQ(frame_set.frames[1].frame_id, static_cast<uint64_t>(i));
+        last_buffer = frame_set.frames[1].buffer_ptr;
+        provider.ReleaseFrameSet(frame_set);
+    }
+
+    // Only the latest frame is left for the subscriber, in the same buffer
+    ORB_SLAM3::ZeroCopyFrameProvider::FrameViewPtr view = provider.GetSubscribedFrame(subscriber_id, 1000);
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(view->GetMetadata().camera_id, 1);
+    EXPECT_EQ(view->GetMetadata().frame_id, static_cast<uint64_t>(kFramesPerCamera - 1));
+    EXPECT_EQ(view->GetMetadata().buffer_ptr, last_buffer);
+
+    ORB_SLAM3::ZeroCopyFrameProvider::SubscriberStats stats = provider.GetSubscriberStats(subscriber_id);
+    EXPECT_EQ(stats.frames_delivered, static_cast<uint64_t>(kFramesPerCamera));
+    EXPECT_EQ(stats.dropped_stale, static_cast<uint64_t>(kFramesPerCamera - 1));
+    EXPECT_EQ(stats.frames_consumed, 1u);
+    EXPECT_EQ(stats.views_held, 1);
+
+    view.reset();
+    EXPECT_EQ(provider.GetSubscriberStats(subscriber_id).views_held, 0);
+
+    provider.StopAcquisition();
+    EXPECT_EQ(provider.GetSubscribedFrame(subscriber_id, 0), nullptr);
+    unlink(capture_path.c_str());
+}
+
 // Test error handling
 TEST_F(ZeroCopyFrameProviderTest, ErrorHandling) {
     // This test would verify that error handling works correctly